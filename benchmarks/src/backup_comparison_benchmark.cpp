@@ -0,0 +1,566 @@
+// file backup_comparison_benchmark.cpp:
+// Runs rdemo-backup and the tools it replaces, rsync, restic and borg, through the same scenarios on one
+// generated source tree and prints one JSON report: an initial run, a no-op run, a run after changing 1%
+// of the files, a rename storm and a run after adding one huge file. The tree changes once per scenario
+// and every tool then backs it up into a repository of its own, so all tools see the same trees.
+//
+// Every tool, rdemo-backup included, runs as a child process and is measured the same way: elapsed time,
+// user plus system CPU time and peak resident memory from wait4, and the bytes it read and wrote from its
+// /proc/<pid>/io, read after it exited but before it is reaped. rchar and wchar count what passed through
+// read and write calls, read_bytes and write_bytes what reached the storage layer. A tool not found on the
+// PATH is reported as skipped. The tools do different work: rsync mirrors the tree, restic and borg
+// deduplicate into encrypted or compressed repositories, so the repository size is reported as well.
+// Runs start with a warm page cache unless --drop-caches is given, which needs root.
+//
+// Usage: backup_comparison_benchmark [--files N] [--tools rdemo,rsync,restic,borg] [--work-dir DIR] [--output FILE] ...
+
+#include "cxxopts.hpp"
+#include "helpers/SourceTreeGenerator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace
+{
+constexpr int ExecFailedStatus = 127;
+
+/**
+ * @brief Byte counters of one process from /proc/<pid>/io.
+ */
+struct ProcessIo
+{
+    std::uint64_t readChars = 0;  /**< rchar: bytes passed to read calls, page cache hits included */
+    std::uint64_t writeChars = 0; /**< wchar: bytes passed to write calls */
+    std::uint64_t readBytes = 0;  /**< read_bytes: bytes fetched from the storage layer */
+    std::uint64_t writeBytes = 0; /**< write_bytes: bytes sent to the storage layer */
+};
+
+/**
+ * @brief Measurements of one tool run.
+ */
+struct ToolRun
+{
+    std::string tool;                  /**< Tool name */
+    bool skipped = false;              /**< The tool was not found */
+    bool success = false;              /**< The tool exited with status 0 */
+    double wallSeconds = 0.0;          /**< Elapsed time */
+    double cpuSeconds = 0.0;           /**< User plus system time of the tool and the children it waited for */
+    long peakRssKiB = 0;               /**< Largest resident set of the tool or one of its children */
+    ProcessIo io;                      /**< Bytes read and written */
+    std::uint64_t repositoryBytes = 0; /**< Size of the tool's repository after the run */
+};
+
+/**
+ * @brief One scenario: a change to the tree and the run of every tool after it.
+ */
+struct ScenarioResult
+{
+    std::string name;                  /**< Scenario label */
+    std::size_t files = 0;             /**< Files in the tree the tools backed up */
+    std::uint64_t bytes = 0;           /**< Bytes in the tree the tools backed up */
+    SourceTreeMutationSummary changes; /**< Files changed by the scenario */
+    std::size_t renamed = 0;           /**< Files moved by the scenario */
+    std::vector<ToolRun> runs;         /**< One run per tool */
+};
+
+/**
+ * @brief Command lines of one tool.
+ */
+struct Tool
+{
+    std::string name;                                      /**< Tool name used in --tools and the report */
+    std::filesystem::path executable;                      /**< Resolved executable, empty if not found */
+    std::filesystem::path repository;                      /**< Directory the tool backs up into */
+    std::vector<std::string> initArguments;                /**< Untimed command creating the repository, empty if none */
+    std::function<std::vector<std::string>(int)> backup;   /**< Arguments of the timed backup, given the run number */
+    std::vector<std::pair<std::string, std::string>> environment; /**< Variables set for every command */
+};
+
+/**
+ * @brief Find an executable the way the shell would.
+ *
+ * @param[in] name Executable name, or a path containing a slash
+ * @return Path of the executable, empty if none is found
+ */
+std::filesystem::path FindExecutable(const std::string& name)
+{
+    if (std::string::npos != name.find('/'))
+    {
+        return (0 == access(name.c_str(), X_OK)) ? std::filesystem::path(name) : std::filesystem::path();
+    }
+    const char* path = std::getenv("PATH");
+    std::istringstream directories((nullptr != path) ? path : "");
+    std::string directory;
+    while (std::getline(directories, directory, ':'))
+    {
+        const std::filesystem::path candidate = std::filesystem::path(directory.empty() ? "." : directory) / name;
+        if (0 == access(candidate.c_str(), X_OK))
+        {
+            return candidate;
+        }
+    }
+    return {};
+}
+
+/**
+ * @brief Read the byte counters of a process.
+ *
+ * @param[in] pid Process, which may have exited but not yet been reaped
+ * @param[out] outputIo Counters read
+ * @return true on success, false if the file cannot be read
+ */
+bool ReadProcessIo(pid_t pid, ProcessIo& outputIo)
+{
+    std::ifstream inputStream("/proc/" + std::to_string(pid) + "/io");
+    std::string key;
+    std::uint64_t value = 0;
+    bool found = false;
+    while (inputStream >> key >> value)
+    {
+        found = true;
+        if ("rchar:" == key)
+        {
+            outputIo.readChars = value;
+        }
+        else if ("wchar:" == key)
+        {
+            outputIo.writeChars = value;
+        }
+        else if ("read_bytes:" == key)
+        {
+            outputIo.readBytes = value;
+        }
+        else if ("write_bytes:" == key)
+        {
+            outputIo.writeBytes = value;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Run a command to completion and measure it.
+ *
+ * @param[in] executable Program to run
+ * @param[in] arguments Arguments after the program name
+ * @param[in] environment Variables set for the command
+ * @param[in] logFile File the command's output is appended to
+ * @param[out] outputRun Exit status, times, memory and I/O of the command
+ * @return true if the command could be started and waited for, false otherwise
+ */
+bool RunMeasured(const std::filesystem::path& executable, const std::vector<std::string>& arguments,
+                 const std::vector<std::pair<std::string, std::string>>& environment, const std::filesystem::path& logFile, ToolRun& outputRun)
+{
+    std::vector<std::string> argumentStrings;
+    argumentStrings.push_back(executable.string());
+    argumentStrings.insert(argumentStrings.end(), arguments.begin(), arguments.end());
+    std::vector<char*> argumentPointers;
+    for (std::string& argument : argumentStrings)
+    {
+        argumentPointers.push_back(&argument[0]);
+    }
+    argumentPointers.push_back(nullptr);
+
+    const auto wallStart = std::chrono::steady_clock::now();
+    const pid_t pid = fork();
+    if (-1 == pid)
+    {
+        return false;
+    }
+    if (0 == pid)
+    {
+        // The benchmark is single-threaded, so the child may still set variables before exec.
+        const int logDescriptor = open(logFile.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (-1 != logDescriptor)
+        {
+            dup2(logDescriptor, STDOUT_FILENO);
+            dup2(logDescriptor, STDERR_FILENO);
+        }
+        for (const auto& variable : environment)
+        {
+            setenv(variable.first.c_str(), variable.second.c_str(), 1);
+        }
+        execv(argumentPointers[0], argumentPointers.data());
+        _exit(ExecFailedStatus);
+    }
+
+    // Waiting without reaping leaves /proc/<pid>/io readable, holding the totals of all the tool's threads.
+    siginfo_t info{};
+    if (-1 == waitid(P_PID, static_cast<id_t>(pid), &info, WEXITED | WNOWAIT))
+    {
+        return false;
+    }
+    const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wallStart;
+    ReadProcessIo(pid, outputRun.io);
+    int status = 0;
+    rusage usage{};
+    if (pid != wait4(pid, &status, 0, &usage))
+    {
+        return false;
+    }
+    outputRun.success = (true == WIFEXITED(status)) && (0 == WEXITSTATUS(status));
+    outputRun.wallSeconds = wall.count();
+    outputRun.cpuSeconds = static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+                           (static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6);
+    outputRun.peakRssKiB = usage.ru_maxrss;
+    return true;
+}
+
+/**
+ * @brief Get the bytes allocated to the regular files below a directory.
+ */
+std::uint64_t DirectoryBytes(const std::filesystem::path& directory)
+{
+    std::uint64_t total = 0;
+    std::error_code errorCode;
+    for (std::filesystem::recursive_directory_iterator entry(directory, errorCode), end; (0 == errorCode.value()) && (end != entry);
+         entry.increment(errorCode))
+    {
+        std::error_code sizeErrorCode;
+        if (true == entry->is_regular_file(sizeErrorCode))
+        {
+            const std::uintmax_t size = entry->file_size(sizeErrorCode);
+            total += (0 == sizeErrorCode.value()) ? size : 0;
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief Write dirty pages back and empty the page cache, so the next run reads from the device.
+ *
+ * @return true on success, false without the privileges to do so
+ */
+bool DropCaches()
+{
+    sync();
+    std::ofstream control("/proc/sys/vm/drop_caches");
+    control << "3\n";
+    control.flush();
+    return static_cast<bool>(control);
+}
+
+/**
+ * @brief Escape a string for a JSON string literal.
+ */
+std::string JsonString(const std::string& value)
+{
+    std::string escaped = "\"";
+    for (const char character : value)
+    {
+        if (('"' == character) || ('\\' == character))
+        {
+            escaped += '\\';
+            escaped += character;
+        }
+        else if (static_cast<unsigned char>(character) < 0x20)
+        {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(character)));
+            escaped += code;
+        }
+        else
+        {
+            escaped += character;
+        }
+    }
+    return escaped + "\"";
+}
+
+/**
+ * @brief Format the tools and results as one JSON document.
+ */
+std::string FormatJson(const std::string& label, const SourceTreeOptions& tree, const std::filesystem::path& workDirectory, bool cachesDropped,
+                       const std::vector<Tool>& tools, const std::vector<ScenarioResult>& scenarios)
+{
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"benchmark\": \"backup_comparison\",\n";
+    json << "  \"label\": " << JsonString(label) << ",\n";
+    json << "  \"work_dir\": " << JsonString(workDirectory.string()) << ",\n";
+    json << "  \"caches_dropped\": " << ((true == cachesDropped) ? "true" : "false") << ",\n";
+    json << "  \"tree\": {\"seed\": " << tree.seed << ", \"files\": " << tree.fileCount << ", \"depth\": " << tree.directoryDepth
+         << ", \"fanout\": " << tree.directoryFanout << ", \"min_size\": " << tree.minimumFileSize << ", \"max_size\": " << tree.maximumFileSize
+         << "},\n";
+    json << "  \"tools\": {";
+    for (std::size_t i = 0; i < tools.size(); ++i)
+    {
+        json << ((0 == i) ? "" : ", ") << JsonString(tools[i].name) << ": " << JsonString(tools[i].executable.string());
+    }
+    json << "},\n";
+    json << "  \"scenarios\": [\n";
+    for (std::size_t i = 0; i < scenarios.size(); ++i)
+    {
+        const ScenarioResult& scenario = scenarios[i];
+        json << "    {\"name\": " << JsonString(scenario.name) << ", \"files\": " << scenario.files << ", \"bytes\": " << scenario.bytes
+             << ", \"modified\": " << scenario.changes.modified << ", \"added\": " << scenario.changes.added
+             << ", \"deleted\": " << scenario.changes.deleted << ", \"renamed\": " << scenario.renamed << ", \"runs\": [\n";
+        for (std::size_t j = 0; j < scenario.runs.size(); ++j)
+        {
+            const ToolRun& run = scenario.runs[j];
+            json << "      {\"tool\": " << JsonString(run.tool);
+            if (true == run.skipped)
+            {
+                json << ", \"skipped\": true}";
+            }
+            else
+            {
+                json << ", \"success\": " << ((true == run.success) ? "true" : "false") << ", \"wall_seconds\": " << run.wallSeconds
+                     << ", \"cpu_seconds\": " << run.cpuSeconds << ", \"peak_rss_kib\": " << run.peakRssKiB
+                     << ", \"rchar\": " << run.io.readChars << ", \"wchar\": " << run.io.writeChars << ", \"read_bytes\": " << run.io.readBytes
+                     << ", \"write_bytes\": " << run.io.writeBytes << ", \"repository_bytes\": " << run.repositoryBytes << "}";
+            }
+            json << ((j + 1 < scenario.runs.size()) ? ",\n" : "\n");
+        }
+        json << "    ]}" << ((i + 1 < scenarios.size()) ? ",\n" : "\n");
+    }
+    json << "  ]\n";
+    json << "}\n";
+    return json.str();
+}
+
+/**
+ * @brief Describe the supported tools, with their repositories below the work directory.
+ */
+std::vector<Tool> DefineTools(const cxxopts::ParseResult& arguments, const std::filesystem::path& workDirectory, const std::filesystem::path& source)
+{
+    const std::filesystem::path passwordFile = workDirectory / "restic-password";
+    std::vector<Tool> tools;
+
+    Tool rdemo;
+    rdemo.name = "rdemo";
+    rdemo.executable = FindExecutable(arguments["rdemo-backup"].as<std::string>());
+    rdemo.repository = workDirectory / "rdemo";
+    rdemo.backup = [source, repository = rdemo.repository](int) { return std::vector<std::string>{"--source", source.string(), "--backup", repository.string()}; };
+    tools.push_back(rdemo);
+
+    // The trailing slash copies the content of the source rather than the directory itself.
+    Tool rsync;
+    rsync.name = "rsync";
+    rsync.executable = FindExecutable(arguments["rsync"].as<std::string>());
+    rsync.repository = workDirectory / "rsync";
+    rsync.backup = [source, repository = rsync.repository](int)
+    { return std::vector<std::string>{"-a", "--delete", source.string() + "/", repository.string() + "/"}; };
+    tools.push_back(rsync);
+
+    Tool restic;
+    restic.name = "restic";
+    restic.executable = FindExecutable(arguments["restic"].as<std::string>());
+    restic.repository = workDirectory / "restic";
+    restic.initArguments = {"init", "--repo", restic.repository.string(), "--password-file", passwordFile.string()};
+    restic.backup = [source, passwordFile, workDirectory, repository = restic.repository](int)
+    {
+        return std::vector<std::string>{"backup", "--repo", repository.string(), "--password-file", passwordFile.string(),
+                                        "--cache-dir", (workDirectory / "restic-cache").string(), source.string()};
+    };
+    tools.push_back(restic);
+
+    Tool borg;
+    borg.name = "borg";
+    borg.executable = FindExecutable(arguments["borg"].as<std::string>());
+    borg.repository = workDirectory / "borg";
+    borg.initArguments = {"init", "--encryption=none", borg.repository.string()};
+    borg.backup = [source, repository = borg.repository](int run)
+    { return std::vector<std::string>{"create", repository.string() + "::run" + std::to_string(run), source.string()}; };
+    borg.environment = {{"BORG_BASE_DIR", (workDirectory / "borg-home").string()}, {"BORG_UNKNOWN_UNENCRYPTED_REPO_ACCESS_IS_OK", "yes"}};
+    tools.push_back(borg);
+
+    std::ofstream(passwordFile, std::ios::trunc) << "backup_comparison_benchmark\n";
+    return tools;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    cxxopts::Options options("backup_comparison_benchmark", "Compare rdemo-backup with rsync, restic and borg on a generated source tree");
+    const SourceTreeOptions treeDefaults;
+
+    // clang-format off
+    options.add_options()
+        ("files", "Files in the generated tree", cxxopts::value<std::size_t>()->default_value(std::to_string(treeDefaults.fileCount)))
+        ("depth", "Directory levels below the root", cxxopts::value<unsigned int>()->default_value(std::to_string(treeDefaults.directoryDepth)))
+        ("fanout", "Subdirectories per directory", cxxopts::value<unsigned int>()->default_value(std::to_string(treeDefaults.directoryFanout)))
+        ("min-size", "Smallest file size in bytes", cxxopts::value<std::uint64_t>()->default_value(std::to_string(treeDefaults.minimumFileSize)))
+        ("max-size", "Largest file size in bytes", cxxopts::value<std::uint64_t>()->default_value(std::to_string(treeDefaults.maximumFileSize)))
+        ("seed", "Seed of the generated tree", cxxopts::value<std::uint64_t>()->default_value(std::to_string(treeDefaults.seed)))
+        ("change-rate", "Fraction of files changed by the change scenario", cxxopts::value<double>()->default_value("0.01"))
+        ("rename-fraction", "Fraction of files moved by the rename storm", cxxopts::value<double>()->default_value("0.1"))
+        ("huge-size", "Size in MiB of the file added by the huge-file scenario", cxxopts::value<std::uint64_t>()->default_value("1024"))
+        ("tools", "Tools to run, of rdemo, rsync, restic and borg", cxxopts::value<std::vector<std::string>>()->default_value("rdemo,rsync,restic,borg"))
+        ("rdemo-backup", "rdemo-backup executable", cxxopts::value<std::string>()->default_value(RDEMO_BACKUP_EXECUTABLE))
+        ("rsync", "rsync executable", cxxopts::value<std::string>()->default_value("rsync"))
+        ("restic", "restic executable", cxxopts::value<std::string>()->default_value("restic"))
+        ("borg", "borg executable", cxxopts::value<std::string>()->default_value("borg"))
+        ("work-dir", "Directory holding the tree and the repositories", cxxopts::value<std::string>()->default_value((std::filesystem::temp_directory_path() / "rdemo_comparison").string()))
+        ("drop-caches", "Empty the page cache before every run (needs root)")
+        ("label", "Free-form label copied into the JSON, such as a release tag", cxxopts::value<std::string>()->default_value(""))
+        ("output", "Write the JSON to this file instead of stdout", cxxopts::value<std::string>())
+        ("keep", "Keep the tree, the repositories and the tool logs after the runs")
+        ("h,help", "Print usage");
+    // clang-format on
+
+    cxxopts::ParseResult arguments;
+    try
+    {
+        arguments = options.parse(argc, argv);
+    }
+    catch (const cxxopts::exceptions::exception& exception)
+    {
+        std::cerr << exception.what() << "\n";
+        return 1;
+    }
+    if (0 != arguments.count("help"))
+    {
+        std::cout << options.help() << "\n";
+        return 0;
+    }
+
+    SourceTreeOptions tree;
+    tree.seed = arguments["seed"].as<std::uint64_t>();
+    tree.fileCount = arguments["files"].as<std::size_t>();
+    tree.directoryDepth = arguments["depth"].as<unsigned int>();
+    tree.directoryFanout = arguments["fanout"].as<unsigned int>();
+    tree.minimumFileSize = arguments["min-size"].as<std::uint64_t>();
+    tree.maximumFileSize = arguments["max-size"].as<std::uint64_t>();
+    SourceTreeMutation change;
+    change.rate = arguments["change-rate"].as<double>();
+    const bool dropCaches = (0 != arguments.count("drop-caches"));
+
+    const std::filesystem::path workDirectory = arguments["work-dir"].as<std::string>();
+    const std::filesystem::path source = workDirectory / "source";
+    std::error_code errorCode;
+    std::filesystem::remove_all(workDirectory, errorCode);
+    std::filesystem::create_directories(workDirectory, errorCode);
+
+    const std::vector<std::string> selected = arguments["tools"].as<std::vector<std::string>>();
+    std::vector<Tool> tools;
+    for (Tool& tool : DefineTools(arguments, workDirectory, source))
+    {
+        if (selected.end() != std::find(selected.begin(), selected.end(), tool.name))
+        {
+            tools.push_back(std::move(tool));
+        }
+    }
+    if (tools.size() != selected.size())
+    {
+        std::cerr << "--tools takes rdemo, rsync, restic and borg\n";
+        return 1;
+    }
+
+    SourceTreeGenerator generator(source, tree);
+    if (false == generator.Generate())
+    {
+        std::cerr << "Failed to generate the source tree in " << source << "\n";
+        return 1;
+    }
+    bool succeeded = true;
+    for (Tool& tool : tools)
+    {
+        if (true == tool.executable.empty())
+        {
+            std::cerr << tool.name << " not found, reported as skipped\n";
+            continue;
+        }
+        // Tools with an init command create their repository themselves.
+        if (true == tool.initArguments.empty())
+        {
+            std::filesystem::create_directories(tool.repository, errorCode);
+        }
+        ToolRun init;
+        if ((false == tool.initArguments.empty()) &&
+            ((false == RunMeasured(tool.executable, tool.initArguments, tool.environment, workDirectory / (tool.name + ".log"), init)) ||
+             (false == init.success)))
+        {
+            std::cerr << tool.name << " could not create its repository, see " << (workDirectory / (tool.name + ".log")) << "\n";
+            tool.executable.clear();
+            succeeded = false;
+        }
+    }
+
+    // Each scenario changes the tree left by the one before it.
+    const std::vector<std::pair<std::string, std::function<bool(ScenarioResult&)>>> scenarios = {
+        {"initial", [](ScenarioResult&) { return true; }},
+        {"noop", [](ScenarioResult&) { return true; }},
+        {"change", [&](ScenarioResult& result) { return generator.Mutate(change, result.changes); }},
+        {"rename_storm", [&](ScenarioResult& result) { return generator.Rename(arguments["rename-fraction"].as<double>(), result.renamed); }},
+        {"huge_file",
+         [&](ScenarioResult& result)
+         {
+             result.changes.added = 1;
+             return generator.AddFileOfSize(arguments["huge-size"].as<std::uint64_t>() * 1024 * 1024);
+         }},
+    };
+    std::vector<ScenarioResult> results;
+    bool cachesDropped = dropCaches;
+    for (std::size_t scenario = 0; scenario < scenarios.size(); ++scenario)
+    {
+        ScenarioResult result;
+        result.name = scenarios[scenario].first;
+        if (false == scenarios[scenario].second(result))
+        {
+            std::cerr << "Failed to prepare the " << result.name << " scenario\n";
+            return 1;
+        }
+        result.files = generator.Files().size();
+        result.bytes = generator.TotalBytes();
+        for (const Tool& tool : tools)
+        {
+            ToolRun run;
+            run.tool = tool.name;
+            run.skipped = tool.executable.empty();
+            if (false == run.skipped)
+            {
+                if ((true == dropCaches) && (false == DropCaches()))
+                {
+                    cachesDropped = false;
+                }
+                if (false == RunMeasured(tool.executable, tool.backup(static_cast<int>(scenario)), tool.environment,
+                                         workDirectory / (tool.name + ".log"), run))
+                {
+                    std::cerr << "Failed to run " << tool.executable << "\n";
+                }
+                run.repositoryBytes = DirectoryBytes(tool.repository);
+                succeeded = succeeded && run.success;
+            }
+            result.runs.push_back(run);
+        }
+        results.push_back(std::move(result));
+    }
+    if ((true == dropCaches) && (false == cachesDropped))
+    {
+        std::cerr << "The page cache could not be dropped before every run; caches_dropped is false\n";
+    }
+
+    const std::string json = FormatJson(arguments["label"].as<std::string>(), tree, workDirectory, cachesDropped, tools, results);
+    if (0 != arguments.count("output"))
+    {
+        std::ofstream outputStream(arguments["output"].as<std::string>(), std::ios::trunc);
+        outputStream << json;
+    }
+    else
+    {
+        std::cout << json;
+    }
+
+    if (0 == arguments.count("keep"))
+    {
+        std::filesystem::remove_all(workDirectory, errorCode);
+    }
+    return (true == succeeded) ? 0 : 1;
+}
@@ -0,0 +1,410 @@
+// file backup_macrobenchmark.cpp:
+// Times RunBackup on a generated source tree for an initial run, a no-op incremental run and a run after
+// a mutation, and prints the results as JSON for tracking across releases. Runs start with a warm page
+// cache, since the tree was just written.
+//
+// With --scaling, it instead times initial runs at each listed thread count, sweeping the walk, hash and
+// copy stages one at a time while the others keep the largest count, then all of them together. Every
+// point reports speedup and efficiency against the smallest count and how busy each stage's threads
+// were, so the stage that stops scaling (queue handoff, the SQLite writer, the disk) stands out. Put
+// --work-dir on a tmpfs such as /dev/shm to take the device out, and on the real disk to put it back.
+//
+// Usage: backup_macrobenchmark [--files N] [--mutation-rate R] [--work-dir DIR] [--output FILE] ...
+//        backup_macrobenchmark --scaling 1,2,4,8 [--work-dir DIR] ...
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "cxxopts.hpp"
+#include "helpers/SourceTreeGenerator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+/**
+ * @brief Measurements of one RunBackup call.
+ */
+struct RunResult
+{
+    std::string name;                  /**< Run label */
+    bool success;                      /**< RunBackup result */
+    double wallSeconds;                /**< Elapsed time */
+    double cpuSeconds;                 /**< User plus system time of the process, 0 where unavailable */
+    std::size_t files;                 /**< Files in the source tree */
+    std::uint64_t bytes;               /**< Bytes in the source tree */
+    SourceTreeMutationSummary changes; /**< Changes made to the tree before the run */
+};
+
+/**
+ * @brief Get the CPU time used by this process so far.
+ *
+ * @return User plus system seconds, 0 where unavailable
+ */
+double ProcessCpuSeconds()
+{
+#ifndef _WIN32
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           (static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6);
+#else
+    return 0.0;
+#endif
+}
+
+/**
+ * @brief Run one backup and measure it.
+ */
+RunResult TimeRun(const std::string& name, const BackupConfig& configuration, const SourceTreeGenerator& generator,
+                  const SourceTreeMutationSummary& changes)
+{
+    const double cpuStart = ProcessCpuSeconds();
+    const auto wallStart = std::chrono::steady_clock::now();
+    const bool success = RunBackup(configuration);
+    const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wallStart;
+    return {name, success, wall.count(), ProcessCpuSeconds() - cpuStart, generator.Files().size(), generator.TotalBytes(), changes};
+}
+
+/**
+ * @brief Measurements of one initial run of a thread-scaling sweep.
+ */
+struct ScalingPoint
+{
+    std::string component; /**< Stage whose thread count was swept: walk, hash, copy or all */
+    unsigned int threads;  /**< Thread count of the swept stage */
+    bool success;          /**< RunBackup result */
+    double wallSeconds;    /**< Elapsed time */
+    BackupStats stats;     /**< Stage times and resolved thread counts of the run */
+};
+
+/**
+ * @brief Run one initial backup into an empty backup root and measure it.
+ */
+ScalingPoint TimeScalingRun(const std::string& component, unsigned int threads, const BackupConfig& configuration)
+{
+    std::error_code errorCode;
+    std::filesystem::remove_all(configuration.backupRoot, errorCode);
+    std::filesystem::remove(configuration.databaseFile, errorCode);
+    std::filesystem::create_directories(configuration.backupRoot, errorCode);
+    ScalingPoint point{component, threads, false, 0.0, {}};
+    const auto wallStart = std::chrono::steady_clock::now();
+    point.success = RunBackup(configuration, point.stats);
+    const std::chrono::duration<double> wall = std::chrono::steady_clock::now() - wallStart;
+    point.wallSeconds = wall.count();
+    return point;
+}
+
+/**
+ * @brief Time initial runs sweeping each stage's thread count with the other stages at the largest count.
+ */
+std::vector<ScalingPoint> RunScaling(const BackupConfig& baseConfiguration, const std::vector<unsigned int>& threadCounts)
+{
+    const unsigned int maxThreads = *std::max_element(threadCounts.begin(), threadCounts.end());
+    std::vector<ScalingPoint> points;
+    for (const std::string component : {"walk", "hash", "copy", "all"})
+    {
+        for (const unsigned int threads : threadCounts)
+        {
+            BackupConfig configuration = baseConfiguration;
+            configuration.walkThreads = (("walk" == component) || ("all" == component)) ? threads : maxThreads;
+            configuration.hashThreads = (("hash" == component) || ("all" == component)) ? threads : maxThreads;
+            configuration.copyThreads = (("copy" == component) || ("all" == component)) ? threads : maxThreads;
+            points.push_back(TimeScalingRun(component, threads, configuration));
+        }
+    }
+    return points;
+}
+
+/**
+ * @brief Escape a string for a JSON string literal.
+ */
+std::string JsonString(const std::string& value)
+{
+    std::string escaped = "\"";
+    for (const char character : value)
+    {
+        if (('"' == character) || ('\\' == character))
+        {
+            escaped += '\\';
+            escaped += character;
+        }
+        else if (static_cast<unsigned char>(character) < 0x20)
+        {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(character)));
+            escaped += code;
+        }
+        else
+        {
+            escaped += character;
+        }
+    }
+    return escaped + "\"";
+}
+
+/**
+ * @brief Format the options and results as one JSON document.
+ */
+std::string FormatJson(const std::string& label, const SourceTreeOptions& tree, const SourceTreeMutation& mutation, const IoLimits& limits,
+                       const std::vector<RunResult>& runs)
+{
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"benchmark\": \"backup_macrobenchmark\",\n";
+    json << "  \"label\": " << JsonString(label) << ",\n";
+    json << "  \"tree\": {\"seed\": " << tree.seed << ", \"files\": " << tree.fileCount << ", \"depth\": " << tree.directoryDepth
+         << ", \"fanout\": " << tree.directoryFanout << ", \"directory_skew\": " << tree.directorySkew
+         << ", \"pareto_shape\": " << tree.paretoShape << ", \"min_size\": " << tree.minimumFileSize
+         << ", \"max_size\": " << tree.maximumFileSize << "},\n";
+    json << "  \"mutation\": {\"rate\": " << mutation.rate << ", \"add_fraction\": " << mutation.addFraction
+         << ", \"delete_fraction\": " << mutation.deleteFraction << "},\n";
+    json << "  \"io_limits\": {\"read_bytes_per_second\": " << limits.readBytesPerSecond << ", \"write_bytes_per_second\": " << limits.writeBytesPerSecond
+         << ", \"read_latency_us\": " << limits.readLatencyUs << ", \"write_latency_us\": " << limits.writeLatencyUs
+         << ", \"metadata_latency_us\": " << limits.metadataLatencyUs << "},\n";
+    json << "  \"runs\": [\n";
+    for (std::size_t i = 0; i < runs.size(); ++i)
+    {
+        const RunResult& run = runs[i];
+        const double filesPerSecond = (0.0 < run.wallSeconds) ? (static_cast<double>(run.files) / run.wallSeconds) : 0.0;
+        const double bytesPerSecond = (0.0 < run.wallSeconds) ? (static_cast<double>(run.bytes) / run.wallSeconds) : 0.0;
+        json << "    {\"name\": " << JsonString(run.name) << ", \"success\": " << ((true == run.success) ? "true" : "false")
+             << ", \"wall_seconds\": " << run.wallSeconds << ", \"cpu_seconds\": " << run.cpuSeconds << ", \"files\": " << run.files
+             << ", \"bytes\": " << run.bytes << ", \"files_per_second\": " << filesPerSecond
+             << ", \"bytes_per_second\": " << bytesPerSecond << ", \"modified\": " << run.changes.modified
+             << ", \"added\": " << run.changes.added << ", \"deleted\": " << run.changes.deleted << "}"
+             << ((i + 1 < runs.size()) ? ",\n" : "\n");
+    }
+    json << "  ]\n";
+    json << "}\n";
+    return json.str();
+}
+
+/**
+ * @brief Get the threads a stage ran on in a measured run.
+ */
+unsigned int StageThreads(BackupStage stage, const BackupStats& stats, const BackupConfig& configuration)
+{
+    switch (stage)
+    {
+    case BackupStage::Enumerate:
+        return stats.walkThreads;
+    case BackupStage::Hash:
+        return stats.hashThreads;
+    case BackupStage::Copy:
+        return (0 != stats.copyThreads) ? stats.copyThreads : stats.hashThreads;
+    case BackupStage::Database:
+        return (true == configuration.dedicatedWriter) ? 1U : stats.hashThreads;
+    case BackupStage::DeletionScan:
+        return 1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Format a thread-scaling sweep as one JSON document.
+ *
+ * Speedup and efficiency compare each point with the smallest thread count of its component. The busy
+ * fraction of a stage is its time summed over its threads divided by those threads times the elapsed
+ * time; the stage closest to 1 is the bottleneck of the point.
+ */
+std::string FormatScalingJson(const std::string& label, const SourceTreeOptions& tree, const std::filesystem::path& workDirectory,
+                              const BackupConfig& configuration, const std::vector<ScalingPoint>& points)
+{
+    std::ostringstream json;
+    json << "{\n";
+    json << "  \"benchmark\": \"backup_scaling\",\n";
+    json << "  \"label\": " << JsonString(label) << ",\n";
+    json << "  \"work_dir\": " << JsonString(workDirectory.string()) << ",\n";
+    json << "  \"tree\": {\"seed\": " << tree.seed << ", \"files\": " << tree.fileCount << ", \"min_size\": " << tree.minimumFileSize
+         << ", \"max_size\": " << tree.maximumFileSize << "},\n";
+    json << "  \"points\": [\n";
+    for (std::size_t i = 0; i < points.size(); ++i)
+    {
+        const ScalingPoint& point = points[i];
+        const auto baseline = std::find_if(points.begin(), points.end(),
+                                           [&point](const ScalingPoint& candidate) { return candidate.component == point.component; });
+        const double speedup = (0.0 < point.wallSeconds) ? (baseline->wallSeconds / point.wallSeconds) : 0.0;
+        const double efficiency = speedup * static_cast<double>(baseline->threads) / static_cast<double>(point.threads);
+        json << "    {\"component\": " << JsonString(point.component) << ", \"threads\": " << point.threads
+             << ", \"success\": " << ((true == point.success) ? "true" : "false") << ", \"wall_seconds\": " << point.wallSeconds
+             << ", \"speedup\": " << speedup << ", \"efficiency\": " << efficiency
+             << ", \"queue_wait_seconds\": " << point.stats.queueWaitSeconds
+             << ", \"enqueue_wait_seconds\": " << point.stats.enqueueWaitSeconds
+             << ", \"sqlite_busy_retries\": " << point.stats.sqliteBusyRetries << ", \"stages\": {";
+        std::string bottleneck;
+        double bottleneckBusy = -1.0;
+        for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+        {
+            const BackupStage stageValue = static_cast<BackupStage>(stage);
+            const unsigned int threads = std::max(1U, StageThreads(stageValue, point.stats, configuration));
+            const double seconds = point.stats.stages[stage].wallSeconds;
+            const double busy = (0.0 < point.wallSeconds) ? (seconds / (static_cast<double>(threads) * point.wallSeconds)) : 0.0;
+            if (bottleneckBusy < busy)
+            {
+                bottleneckBusy = busy;
+                bottleneck = BackupStageToString(stageValue);
+            }
+            json << ((0 == stage) ? "" : ", ") << JsonString(BackupStageToString(stageValue)) << ": {\"threads\": " << threads
+                 << ", \"wall_seconds\": " << seconds << ", \"busy\": " << busy << "}";
+        }
+        json << "}, \"bottleneck\": " << JsonString(bottleneck) << "}" << ((i + 1 < points.size()) ? ",\n" : "\n");
+    }
+    json << "  ]\n";
+    json << "}\n";
+    return json.str();
+}
+}
+
+int main(int argc, char* argv[])
+{
+    cxxopts::Options options("backup_macrobenchmark", "Time RunBackup on a generated source tree");
+    const SourceTreeOptions treeDefaults;
+    const SourceTreeMutation mutationDefaults;
+
+    // clang-format off
+    options.add_options()
+        ("files", "Files in the generated tree", cxxopts::value<std::size_t>()->default_value(std::to_string(treeDefaults.fileCount)))
+        ("depth", "Directory levels below the root", cxxopts::value<unsigned int>()->default_value(std::to_string(treeDefaults.directoryDepth)))
+        ("fanout", "Subdirectories per directory", cxxopts::value<unsigned int>()->default_value(std::to_string(treeDefaults.directoryFanout)))
+        ("directory-skew", "Zipf exponent spreading files over directories", cxxopts::value<double>()->default_value(std::to_string(treeDefaults.directorySkew)))
+        ("pareto-shape", "Pareto shape of file sizes", cxxopts::value<double>()->default_value(std::to_string(treeDefaults.paretoShape)))
+        ("min-size", "Smallest file size in bytes", cxxopts::value<std::uint64_t>()->default_value(std::to_string(treeDefaults.minimumFileSize)))
+        ("max-size", "Largest file size in bytes", cxxopts::value<std::uint64_t>()->default_value(std::to_string(treeDefaults.maximumFileSize)))
+        ("mutation-rate", "Fraction of files changed before the last run", cxxopts::value<double>()->default_value(std::to_string(mutationDefaults.rate)))
+        ("seed", "Seed of the generated tree", cxxopts::value<std::uint64_t>()->default_value(std::to_string(treeDefaults.seed)))
+        ("work-dir", "Directory holding the tree and the backup", cxxopts::value<std::string>()->default_value((std::filesystem::temp_directory_path() / "rdemo_macrobenchmark").string()))
+        ("device-class", "Storage class passed to RunBackup (default, hdd, ssd, nvme, network)", cxxopts::value<std::string>()->default_value("default"))
+        ("read-bwlimit", "Read bandwidth cap in MiB/s, 0 for none", cxxopts::value<double>()->default_value("0"))
+        ("write-bwlimit", "Write bandwidth cap in MiB/s, 0 for none", cxxopts::value<double>()->default_value("0"))
+        ("read-latency", "Milliseconds added to every read", cxxopts::value<double>()->default_value("0"))
+        ("write-latency", "Milliseconds added to every write", cxxopts::value<double>()->default_value("0"))
+        ("metadata-latency", "Milliseconds added to every open, stat and directory listing", cxxopts::value<double>()->default_value("0"))
+        ("label", "Free-form label copied into the JSON, such as a release tag", cxxopts::value<std::string>()->default_value(""))
+        ("scaling", "Time initial runs at these thread counts per stage instead, such as 1,2,4,8", cxxopts::value<std::vector<unsigned int>>())
+        ("output", "Write the JSON to this file instead of stdout", cxxopts::value<std::string>())
+        ("keep", "Keep the tree and the backup after the runs")
+        ("h,help", "Print usage");
+    // clang-format on
+
+    cxxopts::ParseResult arguments;
+    try
+    {
+        arguments = options.parse(argc, argv);
+    }
+    catch (const cxxopts::exceptions::exception& exception)
+    {
+        std::cerr << exception.what() << "\n";
+        return 1;
+    }
+    if (0 != arguments.count("help"))
+    {
+        std::cout << options.help() << "\n";
+        return 0;
+    }
+
+    SourceTreeOptions tree;
+    tree.seed = arguments["seed"].as<std::uint64_t>();
+    tree.fileCount = arguments["files"].as<std::size_t>();
+    tree.directoryDepth = arguments["depth"].as<unsigned int>();
+    tree.directoryFanout = arguments["fanout"].as<unsigned int>();
+    tree.directorySkew = arguments["directory-skew"].as<double>();
+    tree.paretoShape = arguments["pareto-shape"].as<double>();
+    tree.minimumFileSize = arguments["min-size"].as<std::uint64_t>();
+    tree.maximumFileSize = arguments["max-size"].as<std::uint64_t>();
+    SourceTreeMutation mutation;
+    mutation.rate = arguments["mutation-rate"].as<double>();
+
+    const std::filesystem::path workDirectory = arguments["work-dir"].as<std::string>();
+    BackupConfig configuration;
+    configuration.sourceDir = workDirectory / "source";
+    configuration.backupRoot = workDirectory / "backup";
+    configuration.databaseFile = workDirectory / "backup.db";
+    if (false == StringToDeviceClass(arguments["device-class"].as<std::string>(), configuration.deviceClass))
+    {
+        std::cerr << "Unknown device class: " << arguments["device-class"].as<std::string>() << "\n";
+        return 1;
+    }
+    // The limits only apply to RunBackup, so the tree is generated and mutated at full speed.
+    configuration.ioLimits.readBytesPerSecond = static_cast<std::uint64_t>(std::max(0.0, arguments["read-bwlimit"].as<double>()) * 1024 * 1024);
+    configuration.ioLimits.writeBytesPerSecond = static_cast<std::uint64_t>(std::max(0.0, arguments["write-bwlimit"].as<double>()) * 1024 * 1024);
+    configuration.ioLimits.readLatencyUs = static_cast<std::uint64_t>(std::max(0.0, arguments["read-latency"].as<double>()) * 1000);
+    configuration.ioLimits.writeLatencyUs = static_cast<std::uint64_t>(std::max(0.0, arguments["write-latency"].as<double>()) * 1000);
+    configuration.ioLimits.metadataLatencyUs = static_cast<std::uint64_t>(std::max(0.0, arguments["metadata-latency"].as<double>()) * 1000);
+
+    std::error_code errorCode;
+    std::filesystem::remove_all(workDirectory, errorCode);
+    std::filesystem::create_directories(configuration.backupRoot, errorCode);
+    SourceTreeGenerator generator(configuration.sourceDir, tree);
+    if (false == generator.Generate())
+    {
+        std::cerr << "Failed to generate the source tree in " << configuration.sourceDir << "\n";
+        return 1;
+    }
+
+    std::string json;
+    bool succeeded = true;
+    if (0 != arguments.count("scaling"))
+    {
+        std::vector<unsigned int> threadCounts = arguments["scaling"].as<std::vector<unsigned int>>();
+        threadCounts.erase(std::remove(threadCounts.begin(), threadCounts.end(), 0U), threadCounts.end());
+        if (true == threadCounts.empty())
+        {
+            std::cerr << "--scaling needs at least one thread count above 0\n";
+            return 1;
+        }
+        std::sort(threadCounts.begin(), threadCounts.end());
+        const std::vector<ScalingPoint> points = RunScaling(configuration, threadCounts);
+        for (const ScalingPoint& point : points)
+        {
+            succeeded = succeeded && point.success;
+        }
+        json = FormatScalingJson(arguments["label"].as<std::string>(), tree, workDirectory, configuration, points);
+    }
+    else
+    {
+        std::vector<RunResult> runs;
+        runs.push_back(TimeRun("initial", configuration, generator, {}));
+        runs.push_back(TimeRun("noop_incremental", configuration, generator, {}));
+        SourceTreeMutationSummary changes;
+        if (false == generator.Mutate(mutation, changes))
+        {
+            std::cerr << "Failed to mutate the source tree\n";
+            return 1;
+        }
+        runs.push_back(TimeRun("mutated_incremental", configuration, generator, changes));
+        json = FormatJson(arguments["label"].as<std::string>(), tree, mutation, configuration.ioLimits, runs);
+        for (const RunResult& run : runs)
+        {
+            succeeded = succeeded && run.success;
+        }
+    }
+
+    if (0 != arguments.count("output"))
+    {
+        std::ofstream outputStream(arguments["output"].as<std::string>(), std::ios::trunc);
+        outputStream << json;
+    }
+    else
+    {
+        std::cout << json;
+    }
+
+    if (0 == arguments.count("keep"))
+    {
+        std::filesystem::remove_all(workDirectory, errorCode);
+    }
+    return (true == succeeded) ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+// file file_hasher_benchmarks.cpp:
+// Hashing throughput of FileHasher by file size and algorithm, and of ComputeMany on batches of small files.
+// Files are hashed once before timing, so the numbers measure the hash and read path with a warm page cache
+// rather than the disk.
+
+#include "FileHasher/FileHasher.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr std::int64_t KiB = 1024;
+constexpr std::int64_t MiB = 1024 * KiB;
+constexpr std::size_t BatchFileCount = 64;
+
+/**
+ * @brief Temporary file of the benchmark's size, filled with a repeating non-trivial pattern.
+ */
+class HashFileFixture : public benchmark::Fixture
+{
+  public:
+    void SetUp(const benchmark::State& state) override
+    {
+        _filePath = std::filesystem::temp_directory_path() / ("rdemo_hash_bench_" + std::to_string(state.range(0)) + ".bin");
+        std::vector<char> content(static_cast<std::size_t>(state.range(0)));
+        for (std::size_t i = 0; i < content.size(); ++i)
+        {
+            content[i] = static_cast<char>((i * 131) ^ (i >> 9));
+        }
+        std::ofstream outputStream(_filePath, std::ios::binary | std::ios::trunc);
+        outputStream.write(content.data(), static_cast<std::streamsize>(content.size()));
+    }
+
+    void TearDown(const benchmark::State&) override
+    {
+        std::error_code errorCode;
+        std::filesystem::remove(_filePath, errorCode);
+    }
+
+  protected:
+    std::filesystem::path _filePath;
+};
+
+/**
+ * @brief Temporary directory of BatchFileCount files of the benchmark's size, as one worker batch holds.
+ */
+class HashBatchFixture : public benchmark::Fixture
+{
+  public:
+    void SetUp(const benchmark::State& state) override
+    {
+        _directory = std::filesystem::temp_directory_path() / ("rdemo_hash_batch_bench_" + std::to_string(state.range(0)));
+        std::filesystem::create_directories(_directory);
+        std::vector<char> content(static_cast<std::size_t>(state.range(0)));
+        _jobs.clear();
+        for (std::size_t file = 0; file < BatchFileCount; ++file)
+        {
+            for (std::size_t i = 0; i < content.size(); ++i)
+            {
+                content[i] = static_cast<char>((i * 131) ^ (i >> 9) ^ file);
+            }
+            const std::filesystem::path filePath = _directory / ("file" + std::to_string(file) + ".bin");
+            std::ofstream outputStream(filePath, std::ios::binary | std::ios::trunc);
+            outputStream.write(content.data(), static_cast<std::streamsize>(content.size()));
+            _jobs.push_back(HashJob{filePath, HashDigest{}, false});
+        }
+    }
+
+    void TearDown(const benchmark::State&) override
+    {
+        std::error_code errorCode;
+        std::filesystem::remove_all(_directory, errorCode);
+    }
+
+  protected:
+    std::filesystem::path _directory;
+    std::vector<HashJob> _jobs;
+};
+
+/**
+ * @brief Hash the fixture file with the algorithm in range(1).
+ */
+void RunHash(benchmark::State& state, const std::filesystem::path& filePath)
+{
+    const FileHasher hasher(static_cast<HashAlgorithm>(state.range(1)));
+    HashDigest digest{};
+    if (false == hasher.Compute(filePath, digest))
+    {
+        state.SkipWithError("hashing the fixture file failed");
+        return;
+    }
+    for (auto _ : state)
+    {
+        hasher.Compute(filePath, digest);
+        benchmark::DoNotOptimize(digest);
+    }
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations()) * state.range(0));
+    state.SetLabel(HashAlgorithmToString(static_cast<HashAlgorithm>(state.range(1))));
+}
+}
+
+BENCHMARK_DEFINE_F(HashFileFixture, Compute)(benchmark::State& state)
+{
+    RunHash(state, _filePath);
+}
+
+BENCHMARK_REGISTER_F(HashFileFixture, Compute)
+    ->ArgNames({"bytes", "algorithm"})
+    ->ArgsProduct({{4 * KiB, 64 * KiB, 1 * MiB, 16 * MiB, 256 * MiB},
+                   {static_cast<std::int64_t>(HashAlgorithm::XXH64), static_cast<std::int64_t>(HashAlgorithm::XXH3_64),
+                    static_cast<std::int64_t>(HashAlgorithm::XXH3_128), static_cast<std::int64_t>(HashAlgorithm::XXH3_128_Tree),
+                    static_cast<std::int64_t>(HashAlgorithm::BLAKE3)}})
+    ->Unit(benchmark::kMicrosecond)
+    ->UseRealTime();
+
+BENCHMARK_DEFINE_F(HashBatchFixture, ComputeMany)(benchmark::State& state)
+{
+    const FileHasher hasher(static_cast<HashAlgorithm>(state.range(1)));
+    for (auto _ : state)
+    {
+        hasher.ComputeMany(_jobs);
+        benchmark::DoNotOptimize(_jobs.data());
+    }
+    if (true == std::any_of(_jobs.begin(), _jobs.end(), [](const HashJob& job) { return false == job.hashed; }))
+    {
+        state.SkipWithError("hashing a fixture file failed");
+        return;
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * BatchFileCount));
+    state.SetLabel(HashAlgorithmToString(static_cast<HashAlgorithm>(state.range(1))));
+}
+
+BENCHMARK_REGISTER_F(HashBatchFixture, ComputeMany)
+    ->ArgNames({"bytes", "algorithm"})
+    ->ArgsProduct({{64, 1 * KiB, 4 * KiB, 16 * KiB},
+                   {static_cast<std::int64_t>(HashAlgorithm::XXH3_128), static_cast<std::int64_t>(HashAlgorithm::BLAKE3)}})
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,160 @@
+// file file_state_repository_benchmarks.cpp:
+// Upsert and lookup rates of FileStateRepository on a database file in the temporary directory, by batch
+// size for upserts and by table size for lookups.
+
+#include "FileStateRepository.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr std::size_t LookupPathStride = 7919;
+
+/**
+ * @brief Repository-relative path of the n-th benchmark file.
+ */
+std::string BenchmarkPath(std::size_t index)
+{
+    return "dir" + std::to_string(index % 256) + "/file" + std::to_string(index) + ".dat";
+}
+
+/**
+ * @brief File state record whose digest and metadata depend on the index.
+ */
+FileStateRecord BenchmarkRecord(std::size_t index)
+{
+    FileStateRecord record{};
+    record.hashAlgorithm = HashAlgorithm::XXH3_128;
+    record.hash.size = static_cast<std::uint8_t>(HashAlgorithmDigestSize(record.hashAlgorithm));
+    for (std::size_t i = 0; i < record.hash.size; ++i)
+    {
+        record.hash.bytes[i] = static_cast<std::uint8_t>(index >> (i % 8));
+    }
+    record.status = ChangeType::Added;
+    record.timestamp = "2025-01-01T00:00:00Z";
+    record.metadata.size = index * 512;
+    record.metadata.modificationTimeNs = static_cast<std::int64_t>(index) * 1000;
+    record.metadata.inode = index;
+    record.metadata.device = 1;
+    return record;
+}
+
+/**
+ * @brief Fresh database with an initialised schema and an open generation.
+ */
+class FileStateRepositoryFixture : public benchmark::Fixture
+{
+  public:
+    void SetUp(const benchmark::State&) override
+    {
+        _databasePath = std::filesystem::temp_directory_path() / "rdemo_file_state_bench.db";
+        RemoveDatabase();
+        _session = std::make_unique<SQLiteSession>(_databasePath);
+        _repository = std::make_unique<FileStateRepository>(*_session);
+        BackupRunRecord run{};
+        _ready = _repository->InitializeSchema() && _repository->BeginGeneration("2025-01-01_00-00-00", false, run);
+    }
+
+    void TearDown(const benchmark::State&) override
+    {
+        _repository.reset();
+        _session.reset();
+        RemoveDatabase();
+    }
+
+  protected:
+    void RemoveDatabase()
+    {
+        std::error_code errorCode;
+        for (const char* suffix : {"", "-wal", "-shm", "-journal"})
+        {
+            std::filesystem::remove(_databasePath.string() + suffix, errorCode);
+        }
+    }
+
+    std::filesystem::path _databasePath;
+    std::unique_ptr<SQLiteSession> _session;
+    std::unique_ptr<FileStateRepository> _repository;
+    bool _ready = false;
+};
+}
+
+/**
+ * @brief Upsert batches of range(0) records in one transaction each; the first batch inserts, later ones update.
+ */
+BENCHMARK_DEFINE_F(FileStateRepositoryFixture, UpsertBatch)(benchmark::State& state)
+{
+    if (false == _ready)
+    {
+        state.SkipWithError("database setup failed");
+        return;
+    }
+    const std::size_t batchSize = static_cast<std::size_t>(state.range(0));
+    std::vector<FileStateUpdate> updates;
+    updates.reserve(batchSize);
+    for (std::size_t i = 0; i < batchSize; ++i)
+    {
+        updates.push_back({BenchmarkPath(i), BenchmarkRecord(i)});
+    }
+
+    for (auto _ : state)
+    {
+        if (false == _repository->UpdateFileStates(updates))
+        {
+            state.SkipWithError("upsert failed");
+            return;
+        }
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * batchSize));
+}
+
+BENCHMARK_REGISTER_F(FileStateRepositoryFixture, UpsertBatch)
+    ->ArgName("batch")
+    ->RangeMultiplier(8)
+    ->Range(1, 4096)
+    ->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief Look up single records in a table of range(0) records, visiting them in a scattered order.
+ */
+BENCHMARK_DEFINE_F(FileStateRepositoryFixture, Lookup)(benchmark::State& state)
+{
+    const std::size_t rowCount = static_cast<std::size_t>(state.range(0));
+    std::vector<FileStateUpdate> updates;
+    updates.reserve(rowCount);
+    for (std::size_t i = 0; i < rowCount; ++i)
+    {
+        updates.push_back({BenchmarkPath(i), BenchmarkRecord(i)});
+    }
+    if ((false == _ready) || (false == _repository->UpdateFileStates(updates)))
+    {
+        state.SkipWithError("database setup failed");
+        return;
+    }
+
+    std::size_t index = 0;
+    FileStateRecord record{};
+    for (auto _ : state)
+    {
+        if (false == _repository->GetFileState(updates[index].path, record))
+        {
+            state.SkipWithError("lookup missed a stored record");
+            return;
+        }
+        benchmark::DoNotOptimize(record);
+        index = (index + LookupPathStride) % rowCount;
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+
+BENCHMARK_REGISTER_F(FileStateRepositoryFixture, Lookup)
+    ->ArgName("rows")
+    ->RangeMultiplier(10)
+    ->Range(1000, 100000)
+    ->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,207 @@
+// file queue_wakeup_benchmark.cpp:
+// Compares context switches and throughput of the ThreadedFileQueue backends against a replica of the
+// original single condition variable queue that broadcast on every push and pop.
+//
+// Usage: queue_wakeup_benchmark [threads] [items] [queueSize]
+
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+constexpr unsigned long DefaultItemCount = 200000;
+constexpr unsigned long DefaultQueueSize = 64;
+constexpr unsigned int FallbackThreadCount = 4;
+
+/**
+ * @brief Replica of the original queue: one condition variable shared by producers and consumers,
+ * broadcast on every push and pop.
+ */
+class BroadcastQueue
+{
+  public:
+    BroadcastQueue(unsigned int threadCount, std::size_t maxQueueSize, const std::function<void(const std::filesystem::path&)>& workItem)
+        : _maxQueueSize(maxQueueSize), _workItem(workItem), _done(false)
+    {
+        for (unsigned int i = 0; i < threadCount; ++i)
+        {
+            _workers.emplace_back([this]() { WorkerLoop(); });
+        }
+    }
+
+    void Enqueue(const std::filesystem::path& file)
+    {
+        std::unique_lock lock(_queueMutex);
+        _queueCv.wait(lock, [&]() { return _fileQueue.size() < _maxQueueSize; });
+        _fileQueue.push(file);
+        _queueCv.notify_all();
+    }
+
+    void Finalize()
+    {
+        {
+            std::lock_guard lock(_queueMutex);
+            _done = true;
+        }
+        _queueCv.notify_all();
+        for (auto& worker : _workers)
+        {
+            worker.join();
+        }
+    }
+
+  private:
+    void WorkerLoop()
+    {
+        while (true)
+        {
+            std::filesystem::path file;
+            {
+                std::unique_lock lock(_queueMutex);
+                _queueCv.wait(lock, [&]() { return (true == _done) || (false == _fileQueue.empty()); });
+                if (true == _fileQueue.empty())
+                {
+                    return;
+                }
+                file = std::move(_fileQueue.front());
+                _fileQueue.pop();
+                _queueCv.notify_all();
+            }
+            _workItem(file);
+        }
+    }
+
+    std::size_t _maxQueueSize;
+    std::function<void(const std::filesystem::path&)> _workItem;
+    std::mutex _queueMutex;
+    std::condition_variable _queueCv;
+    std::queue<std::filesystem::path> _fileQueue;
+    std::vector<std::thread> _workers;
+    bool _done;
+};
+
+/**
+ * @brief Process-wide context switch counters.
+ */
+struct ContextSwitches
+{
+    long voluntary = 0;
+    long involuntary = 0;
+};
+
+/**
+ * @brief Read the context switch counters of the current process.
+ *
+ * @return Counters, zero where the platform does not report them
+ */
+ContextSwitches ReadContextSwitches()
+{
+    ContextSwitches switches;
+#ifndef _WIN32
+    struct rusage usage{};
+    if (0 == getrusage(RUSAGE_SELF, &usage))
+    {
+        switches.voluntary = usage.ru_nvcsw;
+        switches.involuntary = usage.ru_nivcsw;
+    }
+#endif
+    return switches;
+}
+
+/**
+ * @brief Push a fixed set of paths through a queue and print the elapsed time and context switches.
+ *
+ * @param[in] name Label printed in the results table
+ * @param[in] paths Paths to enqueue
+ * @param[in] createQueue Builds the queue around the work item
+ */
+template <typename Queue, typename Factory>
+void RunScenario(const char* name, const std::vector<std::filesystem::path>& paths, const Factory& createQueue)
+{
+    std::atomic<std::size_t> processed{0};
+    const std::function<void(const std::filesystem::path&)> workItem = [&](const std::filesystem::path& file) {
+        processed.fetch_add(file.native().size(), std::memory_order_relaxed);
+    };
+
+    const ContextSwitches before = ReadContextSwitches();
+    const auto startTime = std::chrono::steady_clock::now();
+    {
+        std::unique_ptr<Queue> queue = createQueue(workItem);
+        for (const auto& path : paths)
+        {
+            queue->Enqueue(path);
+        }
+        queue->Finalize();
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+    const ContextSwitches after = ReadContextSwitches();
+
+    std::printf("%-20s %10lld ms %14ld %14ld\n", name, static_cast<long long>(elapsed.count()), after.voluntary - before.voluntary,
+                after.involuntary - before.involuntary);
+}
+
+/**
+ * @brief Parse a positive integer argument.
+ *
+ * @param[in] text Argument text
+ * @param[in] fallback Value used when the argument is missing or invalid
+ * @return Parsed value
+ */
+unsigned long ParseArgument(const char* text, unsigned long fallback)
+{
+    if (nullptr == text)
+    {
+        return fallback;
+    }
+    const unsigned long value = std::strtoul(text, nullptr, 10);
+    return (0 == value) ? fallback : value;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    const unsigned int threadCount =
+        static_cast<unsigned int>(ParseArgument((1 < argc) ? argv[1] : nullptr, (0 == hardwareThreads) ? FallbackThreadCount : hardwareThreads));
+    const unsigned long itemCount = ParseArgument((2 < argc) ? argv[2] : nullptr, DefaultItemCount);
+    const std::size_t queueSize = ParseArgument((3 < argc) ? argv[3] : nullptr, DefaultQueueSize);
+
+    std::vector<std::filesystem::path> paths;
+    paths.reserve(itemCount);
+    for (unsigned long i = 0; i < itemCount; ++i)
+    {
+        paths.emplace_back("dir" + std::to_string(i % 97) + "/file" + std::to_string(i));
+    }
+
+    std::printf("threads=%u items=%lu queueSize=%zu\n", threadCount, itemCount, queueSize);
+    std::printf("%-20s %13s %14s %14s\n", "queue", "elapsed", "voluntary cs", "involuntary cs");
+
+    RunScenario<BroadcastQueue>("broadcast (old)", paths, [&](const auto& workItem) {
+        return std::make_unique<BroadcastQueue>(threadCount, queueSize, workItem);
+    });
+    for (const QueueBackend backend : {QueueBackend::Mutex, QueueBackend::LockFreeRing})
+    {
+        RunScenario<ThreadedFileQueue>(QueueBackendToString(backend), paths, [&](const auto& workItem) {
+            ThreadedFileQueueOptions options;
+            options.backend = backend;
+            return std::make_unique<ThreadedFileQueue>(threadCount, queueSize, workItem, nullptr, options);
+        });
+    }
+    return 0;
+}
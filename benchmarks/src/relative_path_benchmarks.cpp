@@ -0,0 +1,100 @@
+// file relative_path_benchmarks.cpp:
+// Cost of keying a file relative to the source root: the prefix match the walker's spelling allows, the
+// lexical fallback for other spellings, and std::filesystem::relative, on files of a real tree whose depth
+// is range(0), since std::filesystem::relative stats every component of both paths.
+
+#include "RelativePathBuilder.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+namespace
+{
+/**
+ * @brief Temporary tree holding one file range(0) directories below the root.
+ */
+class RelativePathFixture : public benchmark::Fixture
+{
+  public:
+    void SetUp(const benchmark::State& state) override
+    {
+        _root = std::filesystem::temp_directory_path() / "rdemo_relative_path_bench";
+        std::error_code errorCode;
+        std::filesystem::remove_all(_root, errorCode);
+        std::filesystem::path directory = _root;
+        for (std::int64_t i = 0; i < state.range(0); ++i)
+        {
+            directory /= "level" + std::to_string(i);
+        }
+        std::filesystem::create_directories(directory, errorCode);
+        _file = directory / "file.dat";
+        std::ofstream(_file) << "content";
+    }
+
+    void TearDown(const benchmark::State&) override
+    {
+        std::error_code errorCode;
+        std::filesystem::remove_all(_root, errorCode);
+    }
+
+  protected:
+    std::filesystem::path _root;
+    std::filesystem::path _file;
+};
+
+/**
+ * @brief Key one spelling of the fixture's file with a builder reused across iterations.
+ */
+void BuildKeys(benchmark::State& state, const std::filesystem::path& root, const std::filesystem::path& file)
+{
+    const RelativePathBuilder pathBuilder(root);
+    std::string key;
+    for (auto _ : state)
+    {
+        if (false == pathBuilder.BuildKey(file, key))
+        {
+            state.SkipWithError("file not below the root");
+            return;
+        }
+        benchmark::DoNotOptimize(key);
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+}
+
+/**
+ * @brief Key a file spelled below the root, as the walker spells it.
+ */
+BENCHMARK_DEFINE_F(RelativePathFixture, PrefixMatch)(benchmark::State& state)
+{
+    BuildKeys(state, _root, _file);
+}
+
+/**
+ * @brief Key a file spelled with a `.` component, which the prefix match misses.
+ */
+BENCHMARK_DEFINE_F(RelativePathFixture, LexicalFallback)(benchmark::State& state)
+{
+    BuildKeys(state, _root / ".", _file);
+}
+
+/**
+ * @brief Key a file with std::filesystem::relative, as the fallback did for every spelling.
+ */
+BENCHMARK_DEFINE_F(RelativePathFixture, FilesystemRelative)(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        std::error_code errorCode;
+        benchmark::DoNotOptimize(std::filesystem::relative(_file, _root / ".", errorCode));
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+
+BENCHMARK_REGISTER_F(RelativePathFixture, PrefixMatch)->ArgName("depth")->Arg(2)->Arg(8)->Unit(benchmark::kNanosecond);
+BENCHMARK_REGISTER_F(RelativePathFixture, LexicalFallback)->ArgName("depth")->Arg(2)->Arg(8)->Unit(benchmark::kNanosecond);
+BENCHMARK_REGISTER_F(RelativePathFixture, FilesystemRelative)->ArgName("depth")->Arg(2)->Arg(8)->Unit(benchmark::kNanosecond);
@@ -0,0 +1,210 @@
+// file state_store_benchmarks.cpp:
+// Batch write, point lookup and full scan rates of each StateStore backend in the temporary directory;
+// range(0) selects the backend and range(1) the batch or store size.
+
+#include "StateStore/StateStore.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr std::size_t LookupKeyStride = 7919;
+constexpr std::size_t ValueSize = 64;
+
+/**
+ * @brief Repository-relative path of the n-th benchmark file, used as its key.
+ */
+std::string BenchmarkKey(std::size_t index)
+{
+    return "dir" + std::to_string(index % 256) + "/file" + std::to_string(index) + ".dat";
+}
+
+/**
+ * @brief Batch of entries with keys 0 to count-1 and values of ValueSize bytes.
+ */
+std::vector<StateStoreEntry> BenchmarkEntries(std::size_t count)
+{
+    std::vector<StateStoreEntry> entries;
+    entries.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        entries.push_back({BenchmarkKey(i), std::string(ValueSize, static_cast<char>('a' + i % 26))});
+    }
+    return entries;
+}
+
+/**
+ * @brief Fresh store of the backend range(0) selects.
+ */
+class StateStoreFixture : public benchmark::Fixture
+{
+  public:
+    void SetUp(const benchmark::State& state) override
+    {
+        _backend = static_cast<StateStoreBackend>(state.range(0));
+        _location = std::filesystem::temp_directory_path() / "rdemo_state_store_bench";
+        RemoveStore();
+        _ready = StateStore::Open(_backend, _location, StateStoreOptions(), _store);
+    }
+
+    void TearDown(const benchmark::State&) override
+    {
+        _store.reset();
+        RemoveStore();
+    }
+
+  protected:
+    /**
+     * @brief Label the run with the backend, or skip it when the store did not open.
+     *
+     * @return true if the benchmark can run
+     */
+    bool Prepare(benchmark::State& state)
+    {
+        state.SetLabel(StateStoreBackendToString(_backend));
+        if (false == _ready)
+        {
+            state.SkipWithError((false == StateStore::IsAvailable(_backend)) ? "backend not built in" : "store setup failed");
+            return false;
+        }
+        return true;
+    }
+
+    void RemoveStore()
+    {
+        std::error_code errorCode;
+        for (const char* suffix : {"", "-wal", "-shm", "-journal"})
+        {
+            std::filesystem::remove_all(_location.string() + suffix, errorCode);
+        }
+    }
+
+    StateStoreBackend _backend = StateStoreBackend::SQLite;
+    std::filesystem::path _location;
+    std::unique_ptr<StateStore> _store;
+    bool _ready = false;
+};
+
+/**
+ * @brief Argument pairs of every backend with each of the given sizes.
+ */
+void BackendArguments(benchmark::internal::Benchmark* benchmark, const std::vector<std::int64_t>& sizes)
+{
+    for (StateStoreBackend backend : {StateStoreBackend::SQLite, StateStoreBackend::Lmdb, StateStoreBackend::Lsm})
+    {
+        for (std::int64_t size : sizes)
+        {
+            benchmark->Args({static_cast<std::int64_t>(backend), size});
+        }
+    }
+}
+}
+
+/**
+ * @brief Write batches of range(1) entries; the first batch inserts, later ones overwrite.
+ */
+BENCHMARK_DEFINE_F(StateStoreFixture, PutBatch)(benchmark::State& state)
+{
+    if (false == Prepare(state))
+    {
+        return;
+    }
+    const std::vector<StateStoreEntry> entries = BenchmarkEntries(static_cast<std::size_t>(state.range(1)));
+
+    for (auto _ : state)
+    {
+        if (false == _store->PutBatch(entries))
+        {
+            state.SkipWithError("batch write failed");
+            return;
+        }
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * entries.size()));
+}
+
+BENCHMARK_REGISTER_F(StateStoreFixture, PutBatch)
+    ->ArgNames({"backend", "batch"})
+    ->Apply([](benchmark::internal::Benchmark* benchmark) { BackendArguments(benchmark, {64, 4096}); })
+    ->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief Look up single entries in a store of range(1) entries, visiting them in a scattered order.
+ */
+BENCHMARK_DEFINE_F(StateStoreFixture, Get)(benchmark::State& state)
+{
+    if (false == Prepare(state))
+    {
+        return;
+    }
+    const std::size_t entryCount = static_cast<std::size_t>(state.range(1));
+    const std::vector<StateStoreEntry> entries = BenchmarkEntries(entryCount);
+    if (false == _store->PutBatch(entries))
+    {
+        state.SkipWithError("store setup failed");
+        return;
+    }
+
+    std::size_t index = 0;
+    std::string value;
+    for (auto _ : state)
+    {
+        if (false == _store->Get(entries[index].key, value))
+        {
+            state.SkipWithError("lookup missed a stored entry");
+            return;
+        }
+        benchmark::DoNotOptimize(value);
+        index = (index + LookupKeyStride) % entryCount;
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations()));
+}
+
+BENCHMARK_REGISTER_F(StateStoreFixture, Get)
+    ->ArgNames({"backend", "entries"})
+    ->Apply([](benchmark::internal::Benchmark* benchmark) { BackendArguments(benchmark, {1000, 100000}); })
+    ->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief Visit every entry of a store of range(1) entries in key order.
+ */
+BENCHMARK_DEFINE_F(StateStoreFixture, Scan)(benchmark::State& state)
+{
+    if (false == Prepare(state))
+    {
+        return;
+    }
+    const std::size_t entryCount = static_cast<std::size_t>(state.range(1));
+    if (false == _store->PutBatch(BenchmarkEntries(entryCount)))
+    {
+        state.SkipWithError("store setup failed");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        std::size_t visited = 0;
+        if ((false == _store->Scan(
+                          [&visited](std::string_view, std::string_view)
+                          {
+                              ++visited;
+                              return true;
+                          })) ||
+            (entryCount != visited))
+        {
+            state.SkipWithError("scan missed stored entries");
+            return;
+        }
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * entryCount));
+}
+
+BENCHMARK_REGISTER_F(StateStoreFixture, Scan)
+    ->ArgNames({"backend", "entries"})
+    ->Apply([](benchmark::internal::Benchmark* benchmark) { BackendArguments(benchmark, {100000}); })
+    ->Unit(benchmark::kMillisecond);
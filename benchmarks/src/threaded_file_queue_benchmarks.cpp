@@ -0,0 +1,75 @@
+// file threaded_file_queue_benchmarks.cpp:
+// Queue operations per second of ThreadedFileQueue by worker thread count and backend. Work items do no
+// work, so the numbers measure enqueue, dequeue and wakeup cost; thread start-up is amortised over the
+// items of one iteration.
+
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr std::size_t ItemsPerIteration = 100000;
+constexpr std::size_t MaxQueueSize = 1024;
+
+/**
+ * @brief Paths enqueued by every iteration, built once.
+ */
+const std::vector<std::filesystem::path>& ItemPaths()
+{
+    static const std::vector<std::filesystem::path> paths = []() {
+        std::vector<std::filesystem::path> result;
+        result.reserve(ItemsPerIteration);
+        for (std::size_t i = 0; i < ItemsPerIteration; ++i)
+        {
+            result.emplace_back("dir" + std::to_string(i % 64) + "/file" + std::to_string(i) + ".dat");
+        }
+        return result;
+    }();
+    return paths;
+}
+
+/**
+ * @brief Push every path through a queue with range(0) workers and the backend in range(1).
+ */
+void BM_EnqueueAndDrain(benchmark::State& state)
+{
+    const std::vector<std::filesystem::path>& paths = ItemPaths();
+    ThreadedFileQueueOptions options;
+    options.backend = static_cast<QueueBackend>(state.range(1));
+
+    std::atomic<std::size_t> processed{0};
+    for (auto _ : state)
+    {
+        ThreadedFileQueue queue(static_cast<unsigned int>(state.range(0)), MaxQueueSize,
+                                [&processed](const std::filesystem::path&) { processed.fetch_add(1, std::memory_order_relaxed); },
+                                nullptr, options);
+        for (const std::filesystem::path& path : paths)
+        {
+            queue.Enqueue(path);
+        }
+        queue.Finalize();
+    }
+    if ((static_cast<std::size_t>(state.iterations()) * ItemsPerIteration) != processed.load())
+    {
+        state.SkipWithError("queue dropped items");
+        return;
+    }
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * ItemsPerIteration));
+    state.SetLabel(QueueBackendToString(options.backend));
+}
+}
+
+BENCHMARK(BM_EnqueueAndDrain)
+    ->ArgNames({"threads", "backend"})
+    ->ArgsProduct({{1, 2, 4, 8, 16},
+                   {static_cast<std::int64_t>(QueueBackend::Mutex), static_cast<std::int64_t>(QueueBackend::LockFreeRing),
+                    static_cast<std::int64_t>(QueueBackend::WorkStealing)}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
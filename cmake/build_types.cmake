@@ -8,6 +8,10 @@ set_property(
     PROPERTY STRINGS
         Debug
         Release
+        ReleaseLTO
+        PGOGenerate
+        PGOUse
+        RelWithNative
         Coverage
         Valgrind
         AddressSanitizer
@@ -17,6 +21,6 @@ set_property(
 )
 
 message(STATUS
-    "Available build types: Debug, Release, Coverage, Valgrind, "
+    "Available build types: Debug, Release, ReleaseLTO, PGOGenerate, PGOUse, RelWithNative, Coverage, Valgrind, "
     "AddressSanitizer, ThreadSanitizer, MemorySanitizer, UndefinedBehaviorSanitizer"
 )
@@ -1,3 +1,26 @@
+# -----------------------------------------------------------------------------
+# Optimized variants
+#   ReleaseLTO   : Release plus link-time optimization
+#   PGOGenerate  : Release instrumented to write execution profiles
+#   PGOUse       : ReleaseLTO optimized with the profiles of a PGOGenerate build
+#   RelWithNative: Release tuned for the CPU of the build machine
+# -----------------------------------------------------------------------------
+set(RDEMO_PGO_PROFILE_DIR "${CMAKE_BINARY_DIR}/pgo-profiles" CACHE PATH
+    "Directory PGOGenerate builds write execution profiles to and PGOUse builds read them from")
+
+if(PROJECT_BUILD_VARIANT STREQUAL "RELEASELTO" OR PROJECT_BUILD_VARIANT STREQUAL "PGOUSE")
+    include(CheckIPOSupported)
+    check_ipo_supported(RESULT RDEMO_IPO_SUPPORTED OUTPUT RDEMO_IPO_OUTPUT LANGUAGES C CXX)
+    if(NOT RDEMO_IPO_SUPPORTED)
+        message(WARNING "Link-time optimization is not supported, building without it: ${RDEMO_IPO_OUTPUT}")
+    endif()
+endif()
+
+if(PROJECT_BUILD_VARIANT STREQUAL "PGOUSE" AND CMAKE_C_COMPILER_ID MATCHES "Clang"
+   AND NOT EXISTS "${RDEMO_PGO_PROFILE_DIR}/default.profdata")
+    message(FATAL_ERROR "PGOUse needs ${RDEMO_PGO_PROFILE_DIR}/default.profdata; build the pgo-train target of a PGOGenerate build first")
+endif()
+
 function(set_target_flags target)
 
     if(NOT CMAKE_BUILD_TYPE)
@@ -34,6 +57,73 @@ function(set_target_flags target)
             target_compile_options(${target} PRIVATE -O3 -DNDEBUG)
         endif()
 
+    # -------------------------------------------------------------------------
+    # RELEASE WITH LINK-TIME OPTIMIZATION
+    # -------------------------------------------------------------------------
+    elseif(BUILD_ID STREQUAL "RELEASELTO")
+        if(MSVC)
+            target_compile_options(${target} PRIVATE /O2 /DNDEBUG)
+        else()
+            target_compile_options(${target} PRIVATE -O3 -DNDEBUG)
+        endif()
+        if(RDEMO_IPO_SUPPORTED)
+            set_property(TARGET ${target} PROPERTY INTERPROCEDURAL_OPTIMIZATION TRUE)
+        endif()
+
+    # -------------------------------------------------------------------------
+    # PROFILE-GUIDED OPTIMIZATION: INSTRUMENTED BUILD
+    # -------------------------------------------------------------------------
+    elseif(BUILD_ID STREQUAL "PGOGENERATE")
+        if(MSVC)
+            message(FATAL_ERROR "Profile-guided optimization requires clang-cl or GCC")
+        endif()
+
+        # Worker threads update the same counters, so the updates must be atomic.
+        target_compile_options(${target} PRIVATE
+            -O3
+            -DNDEBUG
+            -fprofile-generate=${RDEMO_PGO_PROFILE_DIR}
+            -fprofile-update=atomic
+        )
+        target_link_options(${target} PRIVATE
+            -fprofile-generate=${RDEMO_PGO_PROFILE_DIR}
+        )
+
+    # -------------------------------------------------------------------------
+    # PROFILE-GUIDED OPTIMIZATION: OPTIMIZED BUILD
+    # -------------------------------------------------------------------------
+    elseif(BUILD_ID STREQUAL "PGOUSE")
+        if(MSVC)
+            message(FATAL_ERROR "Profile-guided optimization requires clang-cl or GCC")
+        elseif(CMAKE_C_COMPILER_ID MATCHES "Clang")
+            set(PGO_USE_FLAGS -fprofile-use=${RDEMO_PGO_PROFILE_DIR}/default.profdata)
+        else()
+            # GCC finds each object's profile by its path, so the profiles must come from this build directory.
+            set(PGO_USE_FLAGS -fprofile-use=${RDEMO_PGO_PROFILE_DIR} -fprofile-correction -Wno-missing-profile)
+        endif()
+
+        target_compile_options(${target} PRIVATE
+            -O3
+            -DNDEBUG
+            ${PGO_USE_FLAGS}
+        )
+        target_link_options(${target} PRIVATE
+            ${PGO_USE_FLAGS}
+        )
+        if(RDEMO_IPO_SUPPORTED)
+            set_property(TARGET ${target} PROPERTY INTERPROCEDURAL_OPTIMIZATION TRUE)
+        endif()
+
+    # -------------------------------------------------------------------------
+    # RELEASE TUNED FOR THE BUILD MACHINE
+    # -------------------------------------------------------------------------
+    elseif(BUILD_ID STREQUAL "RELWITHNATIVE")
+        if(MSVC)
+            target_compile_options(${target} PRIVATE /O2 /DNDEBUG /arch:AVX2)
+        else()
+            target_compile_options(${target} PRIVATE -O3 -DNDEBUG -march=native)
+        endif()
+
     # -------------------------------------------------------------------------
     # COVERAGE
     # -------------------------------------------------------------------------
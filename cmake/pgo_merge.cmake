@@ -0,0 +1,17 @@
+# -----------------------------------------------------------------------------
+# cmake/pgo_merge.cmake
+# Merge the raw Clang profiles of a PGOGenerate run into the file PGOUse reads.
+#   cmake -DLLVM_PROFDATA=<tool> -DPROFILE_DIR=<dir> -P pgo_merge.cmake
+# -----------------------------------------------------------------------------
+file(GLOB RAW_PROFILES "${PROFILE_DIR}/*.profraw")
+if(NOT RAW_PROFILES)
+    message(FATAL_ERROR "No raw profiles in ${PROFILE_DIR}")
+endif()
+
+execute_process(
+    COMMAND ${LLVM_PROFDATA} merge -output=${PROFILE_DIR}/default.profdata ${RAW_PROFILES}
+    RESULT_VARIABLE MERGE_RESULT
+)
+if(NOT MERGE_RESULT EQUAL 0)
+    message(FATAL_ERROR "llvm-profdata merge failed: ${MERGE_RESULT}")
+endif()
@@ -2,21 +2,47 @@
 
 #pragma once
 
+#include "FileCompressor/FileCompressor.hpp"
+#include "FileEncryptor/FileEncryptor.hpp"
+#include "FileHasher/FileChunker.hpp"
+#include "FileHasher/FileHasher.hpp"
+#include "FileIterator/PathFilter.hpp"
+#include "Instrumentation/Instrumentation.hpp"
+#include "IoThrottle/IoThrottle.hpp"
+#include "SQLite/SQLitePerformanceProfile.hpp"
+#include "StorageBackend/StorageBackend.hpp"
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+#include "ThreadedFileQueue/WorkerBudget.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 /**
  * @brief Enumeration of possible file change states during backup operations.
+ *
+ * The values are stored in the state database and must not change.
  */
 enum class ChangeType
 {
-    Unchanged, /**< File has not changed since last backup */
-    Added,     /**< File is new and was not present in previous backup */
-    Modified,  /**< File exists but content has changed */
-    Deleted    /**< File was present before but has been removed */
+    Unchanged = 0, /**< File has not changed since last backup */
+    Added = 1,     /**< File is new and was not present in previous backup */
+    Modified = 2,  /**< File exists but content has changed */
+    Deleted = 3    /**< File was present before but has been removed */
 };
 
+/**
+ * @brief Number of ChangeType values.
+ */
+constexpr std::size_t ChangeTypeCount = 4;
+
 /**
  * @brief Convert a ChangeType enumeration value to its string representation.
  *
@@ -45,7 +71,7 @@ inline const char* ChangeTypeToString(ChangeType changeType)
  * @param[in] stringValue The string to convert
  * @return Corresponding ChangeType value, defaults to Unchanged if string is not recognized
  */
-inline ChangeType StringToChangeType(const std::string& stringValue)
+inline ChangeType StringToChangeType(std::string_view stringValue)
 {
     if ("Unchanged" == stringValue)
     {
@@ -66,6 +92,112 @@ inline ChangeType StringToChangeType(const std::string& stringValue)
     return ChangeType::Unchanged;
 }
 
+/**
+ * @brief Storage class that the pipeline's default thread counts and queue depths are tuned for.
+ */
+enum class DeviceClass
+{
+    Default, /**< One pool that reads, hashes and copies, sized to the core count */
+    Hdd,     /**< Spinning disk: few concurrent readers to limit seeking */
+    Ssd,     /**< SATA SSD: one reader per core, a few copiers */
+    Nvme,    /**< NVMe: more readers than cores to keep many I/Os outstanding */
+    Network  /**< Network filesystem: many readers to hide round-trip latency */
+};
+
+/**
+ * @brief Convert a DeviceClass enumeration value to its string representation.
+ *
+ * @param[in] deviceClass The device class to convert
+ * @return String representation of the device class
+ */
+inline const char* DeviceClassToString(DeviceClass deviceClass)
+{
+    switch (deviceClass)
+    {
+    case DeviceClass::Default:
+        return "default";
+    case DeviceClass::Hdd:
+        return "hdd";
+    case DeviceClass::Ssd:
+        return "ssd";
+    case DeviceClass::Nvme:
+        return "nvme";
+    case DeviceClass::Network:
+        return "network";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Convert a string to its corresponding DeviceClass enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @param[out] outputDeviceClass Parsed device class
+ * @return true if the string names a known device class, false otherwise
+ */
+inline bool StringToDeviceClass(const std::string& stringValue, DeviceClass& outputDeviceClass)
+{
+    for (DeviceClass deviceClass : {DeviceClass::Default, DeviceClass::Hdd, DeviceClass::Ssd, DeviceClass::Nvme, DeviceClass::Network})
+    {
+        if (DeviceClassToString(deviceClass) == stringValue)
+        {
+            outputDeviceClass = deviceClass;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief When the backup copies written by a run are forced to stable storage.
+ */
+enum class DurabilityPolicy
+{
+    None,     /**< Leave writeback to the system: a crash may leave rows that refer to copies never written */
+    EndOfRun, /**< Flush the backup and database volumes once before the run is recorded as finished */
+    Batched   /**< Also flush before each batch of state rows is committed, so committed rows only refer to durable copies */
+};
+
+/**
+ * @brief Convert a DurabilityPolicy enumeration value to its string representation.
+ *
+ * @param[in] policy The durability policy to convert
+ * @return String representation of the durability policy
+ */
+inline const char* DurabilityPolicyToString(DurabilityPolicy policy)
+{
+    switch (policy)
+    {
+    case DurabilityPolicy::None:
+        return "none";
+    case DurabilityPolicy::EndOfRun:
+        return "end-of-run";
+    case DurabilityPolicy::Batched:
+        return "batched";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Convert a string to its corresponding DurabilityPolicy enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @param[out] outputPolicy Parsed durability policy
+ * @return true if the string names a known durability policy, false otherwise
+ */
+inline bool StringToDurabilityPolicy(const std::string& stringValue, DurabilityPolicy& outputPolicy)
+{
+    for (DurabilityPolicy policy : {DurabilityPolicy::None, DurabilityPolicy::EndOfRun, DurabilityPolicy::Batched})
+    {
+        if (DurabilityPolicyToString(policy) == stringValue)
+        {
+            outputPolicy = policy;
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * @brief Progress information for backup operations.
  */
@@ -73,8 +205,233 @@ struct BackupProgress
 {
     const char* stage;     /**< Current stage of backup operation */
     std::size_t processed; /**< Number of items processed so far */
-    std::size_t total;     /**< Total number of items to process */
-    std::filesystem::path file; /**< Currently processing file path */
+    std::size_t total;     /**< Total number of files to process as counted by the pre-scan so far, 0 without a pre-scan */
+    std::filesystem::path file; /**< Currently processing file path, empty in sampled reports */
+    std::size_t dropped;        /**< Per-file events lost so far because the event ring was full */
+    std::uint64_t totalBytes;   /**< Total size of the files counted by the pre-scan so far */
+    bool totalFinal;            /**< The pre-scan has finished, so total and totalBytes no longer grow */
+};
+
+/**
+ * @brief Counters of one worker thread read from a live status segment.
+ */
+struct LiveWorkerStatus
+{
+    std::uint64_t files;     /**< Files the worker finished */
+    std::uint64_t bytes;     /**< Bytes of those files */
+    std::string currentFile; /**< File the worker started on last, shortened to its end; empty for workers beyond the slots */
+};
+
+/**
+ * @brief Live counters of a backup run read from its shared-memory status segment.
+ */
+struct LiveStatus
+{
+    std::uint64_t processId = 0;      /**< Process running the backup */
+    std::string stage;                /**< starting, scanning, collecting, deleted, finishing, finished or failed */
+    std::uint64_t filesProcessed = 0; /**< Files finished by all workers, including archived deletions */
+    std::uint64_t bytesProcessed = 0; /**< Bytes of those files */
+    std::uint64_t filesQueued = 0;    /**< Files handed to the workers */
+    std::uint64_t queueDepth = 0;     /**< Files queued and not yet finished */
+    std::uint64_t totalFiles = 0;     /**< Files counted by the pre-scan so far, 0 without a pre-scan */
+    std::uint64_t totalBytes = 0;     /**< Their total size */
+    bool totalFinal = false;          /**< The pre-scan has finished */
+    std::vector<LiveWorkerStatus> workers; /**< Workers in the order they started */
+};
+
+/**
+ * @brief Number of buckets in a file size histogram.
+ *
+ * Bucket 0 counts empty files and bucket b > 0 counts files of 2^(b-1) up to 2^b - 1 bytes.
+ */
+constexpr std::size_t FileSizeHistogramBuckets = 65;
+
+/**
+ * @brief Stages of a backup run whose time is measured separately.
+ */
+enum class BackupStage
+{
+    Enumerate,   /**< Walking the source tree */
+    Hash,        /**< Reading metadata and content of source files and hashing it, including copies made while hashing */
+    Copy,        /**< Writing changed files into the backup and archiving their previous versions */
+    Database,    /**< File state lookups and commits, hash cache queries and index loading */
+    DeletionScan /**< Finding and archiving files removed from the source, without its database work */
+};
+
+/**
+ * @brief Number of BackupStage values.
+ */
+constexpr std::size_t BackupStageCount = 5;
+
+/**
+ * @brief Convert a BackupStage enumeration value to its string representation.
+ *
+ * @param[in] stage The stage to convert
+ * @return String representation of the stage
+ */
+inline const char* BackupStageToString(BackupStage stage)
+{
+    switch (stage)
+    {
+    case BackupStage::Enumerate:
+        return "enumerate";
+    case BackupStage::Hash:
+        return "hash";
+    case BackupStage::Copy:
+        return "copy";
+    case BackupStage::Database:
+        return "database";
+    case BackupStage::DeletionScan:
+        return "deletion-scan";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Time spent in one stage, summed over the threads working in it.
+ *
+ * Several threads work in most stages at once, so the sums can exceed the run's elapsed time. Time in a
+ * nested stage, such as a state lookup while hashing, counts only for the nested stage.
+ */
+struct BackupStageTime
+{
+    double wallSeconds; /**< Elapsed time inside the stage */
+    double cpuSeconds;  /**< CPU time of the threads while inside the stage */
+};
+
+/**
+ * @brief Distribution of the durations of one stage's operations during a backup run.
+ *
+ * Every timed scope of the stage is one operation, such as hashing, copying or looking up one file, or
+ * the walk handing over one batch. Durations are the scope's own time, without nested stages, and are
+ * accurate to about 3%.
+ */
+struct BackupLatency
+{
+    std::uint64_t count; /**< Operations measured */
+    double p50Seconds;   /**< Median duration */
+    double p99Seconds;   /**< Duration 99% of the operations did not exceed */
+    double p999Seconds;  /**< Duration 99.9% of the operations did not exceed */
+    double maxSeconds;   /**< Longest duration */
+};
+
+/**
+ * @brief Measurements of one backup run.
+ */
+struct BackupStats
+{
+    double elapsedSeconds;                                  /**< Wall time of the whole run */
+    std::array<BackupStageTime, BackupStageCount> stages;   /**< Time per stage, indexed by BackupStage */
+    std::array<BackupLatency, BackupStageCount> latencies;  /**< Operation durations per stage, indexed by BackupStage */
+    std::uint64_t bytesRead;                                /**< Source bytes read for hashing and copying */
+    std::uint64_t bytesWritten;                             /**< Bytes of new content written into the backup */
+    std::uint64_t bytesHashed;                              /**< Bytes passed through the hash function */
+    std::array<std::size_t, ChangeTypeCount> filesByChange; /**< Files per outcome, indexed by ChangeType */
+    std::size_t filesMoved;                                 /**< Added files that took over the backup copy of a file moved away, without copying */
+    std::size_t filesSampled;                               /**< Unchanged files a paranoid run confirmed by a sample of their blocks instead of a full hash */
+    double queueWaitSeconds;                                /**< Time workers waited between files for the next one, summed over workers */
+    double enqueueWaitSeconds;                              /**< Time spent handing files to a full stage queue, summed over threads */
+    std::uint64_t sqliteBusyRetries;                        /**< Retries of a database locked by another connection */
+    bool writerEscalated;                                   /**< Contention made the run switch to committing file states from a single writer thread */
+    std::uint64_t preScanFiles;                             /**< Files counted by the pre-scan, 0 without one */
+    std::uint64_t preScanBytes;                             /**< Bytes counted by the pre-scan */
+    std::array<std::uint64_t, FileSizeHistogramBuckets> fileSizeHistogram; /**< Pre-scan file sizes, bucketed by FileSizeHistogramBuckets */
+    bool stopped;                                           /**< The run was stopped early and is continued by the next one; the counts cover what it did */
+    std::string runTimestamp;                               /**< Timestamp of the run, which names its snapshot directories; empty if the run did not start */
+    std::filesystem::path snapshotPath;                     /**< Snapshot directory holding the versions the run replaced or deleted, empty if it archived none */
+    unsigned int walkThreads;                               /**< Threads listing directories */
+    unsigned int hashThreads;                               /**< Read/hash worker threads, the most an adaptive run may use */
+    unsigned int copyThreads;                               /**< Copy stage threads, 0 when the read/hash workers copy */
+    std::vector<InstrumentationTotal> scopes;               /**< RDEMO_SCOPE and RDEMO_COUNT totals recorded during the run, empty unless built with RDEMO_INSTRUMENTATION */
+};
+
+/**
+ * @brief How a backup run recorded in the run history ended.
+ */
+enum class RunOutcome
+{
+    Completed, /**< The run finished successfully */
+    Stopped,   /**< The run was stopped early and is continued by the next one */
+    Failed     /**< The run failed */
+};
+
+/**
+ * @brief Convert a RunOutcome enumeration value to its string representation.
+ *
+ * @param[in] outcome The outcome to convert
+ * @return String representation of the outcome
+ */
+inline const char* RunOutcomeToString(RunOutcome outcome)
+{
+    switch (outcome)
+    {
+    case RunOutcome::Completed:
+        return "completed";
+    case RunOutcome::Stopped:
+        return "stopped";
+    case RunOutcome::Failed:
+        return "failed";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Convert a string to its corresponding RunOutcome enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @return Corresponding RunOutcome value, defaults to Failed if string is not recognized
+ */
+inline RunOutcome StringToRunOutcome(std::string_view stringValue)
+{
+    if ("completed" == stringValue)
+    {
+        return RunOutcome::Completed;
+    }
+    if ("stopped" == stringValue)
+    {
+        return RunOutcome::Stopped;
+    }
+    return RunOutcome::Failed;
+}
+
+/**
+ * @brief One backup run recorded in the run history of the state database.
+ */
+struct RunHistoryEntry
+{
+    std::int64_t runId;                                     /**< Entry of the run in the runs table, shared by a stopped run and the run resuming it; 0 if unknown */
+    std::string started;                                    /**< Timestamp of the run, as in BackupStats::runTimestamp */
+    std::int64_t finishedAt;                                /**< End of the run in seconds since the Unix epoch */
+    double elapsedSeconds;                                  /**< Wall time of the run */
+    RunOutcome outcome;                                     /**< How the run ended */
+    std::array<BackupStageTime, BackupStageCount> stages;   /**< Time per stage, indexed by BackupStage */
+    std::array<std::size_t, ChangeTypeCount> filesByChange; /**< Files per outcome, indexed by ChangeType */
+    std::size_t filesMoved;                                 /**< Added files that took over the backup copy of a moved file */
+    std::uint64_t bytesRead;                                /**< Source bytes read for hashing and copying */
+    std::uint64_t bytesWritten;                             /**< Bytes of new content written into the backup */
+    std::uint64_t bytesHashed;                              /**< Bytes passed through the hash function */
+    unsigned int walkThreads;                               /**< Threads listing directories */
+    unsigned int hashThreads;                               /**< Read/hash worker threads */
+    unsigned int copyThreads;                               /**< Copy stage threads, 0 when the read/hash workers copied */
+};
+
+/**
+ * @brief What a backup run would do, as estimated by PreviewBackup.
+ */
+struct BackupPreview
+{
+    std::array<std::size_t, ChangeTypeCount> filesByChange;   /**< Files per expected outcome, indexed by ChangeType */
+    std::array<std::uint64_t, ChangeTypeCount> bytesByChange; /**< Bytes copied for added and modified files, archived for deleted ones */
+    bool deletionsCounted;                                    /**< Deleted counts are set; false if the walk was incomplete */
+};
+
+/**
+ * @brief One of several source directories of a backup run.
+ */
+struct BackupSource
+{
+    std::filesystem::path path; /**< Source directory to back up */
+    std::string name;           /**< Namespace of its files in the backup and the state database, empty for the directory name */
 };
 
 /**
@@ -82,28 +439,1585 @@ struct BackupProgress
  */
 struct BackupConfig
 {
+    /**
+     * @brief Default minimum file size in bytes for memory-mapped hashing.
+     */
+    static constexpr std::uintmax_t DefaultMemoryMapThreshold = FileHasher::DefaultMemoryMapThreshold;
+
+    /**
+     * @brief Default minimum file size in bytes for unbuffered I/O.
+     */
+    static constexpr std::uintmax_t DefaultUnbufferedThreshold = 64 * 1024 * 1024;
+
+    /**
+     * @brief Default number of file state rows committed per transaction.
+     */
+    static constexpr std::size_t DefaultStateBatchSize = 512;
+
+    /**
+     * @brief Default maximum age in milliseconds of an uncommitted file state batch.
+     */
+    static constexpr unsigned int DefaultStateBatchIntervalMs = 250;
+
+    /**
+     * @brief Default busy retries of the state database after which a run switches to the dedicated writer thread.
+     */
+    static constexpr std::uint64_t DefaultWriterEscalationRetries = 1000;
+
+    /**
+     * @brief Default time in milliseconds between two background WAL checkpoints.
+     */
+    static constexpr unsigned int DefaultCheckpointIntervalMs = 1000;
+
+    /**
+     * @brief Default memory cap in bytes for the preloaded file state index.
+     */
+    static constexpr std::size_t DefaultStateIndexMemoryLimit = 256 * 1024 * 1024;
+
+    /**
+     * @brief Default block size in bytes matched by delta history.
+     */
+    static constexpr std::uint32_t DefaultDeltaBlockSize = 2048;
+
+    /**
+     * @brief Default size in bytes below which files are packed into segment files.
+     */
+    static constexpr std::uint64_t DefaultPackThreshold = 16 * 1024;
+
+    /**
+     * @brief Default size in bytes at which a pack segment is closed and the next one started.
+     */
+    static constexpr std::uint64_t DefaultPackSegmentSize = 256 * 1024 * 1024;
+
+    /**
+     * @brief Default number of data blocks per parity stripe.
+     */
+    static constexpr std::size_t DefaultParityDataShards = 10;
+
+    /**
+     * @brief Default size in bytes from which a backup copy gets parity.
+     */
+    static constexpr std::uint64_t DefaultParityThreshold = 1024 * 1024;
+
+    /**
+     * @brief Default number of trace events kept per thread.
+     */
+    static constexpr std::size_t DefaultTraceEventsPerThread = 65536;
+
+    /**
+     * @brief Default duration in milliseconds from which an operation is written to the slow operation log.
+     */
+    static constexpr unsigned int DefaultSlowOperationThresholdMs = 1000;
+
+    /**
+     * @brief Default time in milliseconds between two progress reports.
+     */
+    static constexpr unsigned int DefaultProgressIntervalMs = 100;
+
+    /**
+     * @brief Suggested per-file progress events buffered between two reports.
+     */
+    static constexpr std::size_t DefaultProgressEventCapacity = 65536;
+
+    /**
+     * @brief Default number of journal runs between two full walks of the source tree.
+     */
+    static constexpr unsigned int DefaultJournalReconcileRuns = 24;
+
+    /**
+     * @brief Default blocks a sampled check reads between the first and the last block of a file.
+     */
+    static constexpr unsigned int DefaultSampledCheckBlocks = 8;
+
+    /**
+     * @brief Default runs between two full hashes of a file confirmed by sampled checks.
+     */
+    static constexpr unsigned int DefaultSampledCheckFullEvery = 8;
+
+    /**
+     * @brief Bytes per block read by a sampled check.
+     */
+    static constexpr std::size_t SampledCheckBlockSize = 1024 * 1024;
+
     std::filesystem::path sourceDir;    /**< Source directory to back up */
+    std::vector<BackupSource> sources;  /**< Directories backed up together in one run, each under its name; replaces sourceDir when not empty */
     std::filesystem::path backupRoot;   /**< Root directory for backup storage */
+    std::shared_ptr<StorageBackend> storage; /**< Store backup/ and deleted/ are written to instead of backupRoot, nullptr uses backupRoot */
     std::filesystem::path databaseFile; /**< Path to SQLite database file for tracking state */
+    std::filesystem::path hashCacheFile; /**< SQLite digest cache shared with other jobs, empty disables it */
+    bool resumeAppends; /**< Keep resume points in the hash cache and hash and copy a large file that only grew from where its stored version ends */
+    std::uint64_t copyCheckpointInterval; /**< Commit a checkpoint every this many bytes of a larger copy, so an interrupted run's copy is continued; 0 disables it */
+    bool digestAttributes; /**< Cache digests in an extended attribute (an alternate data stream on Windows) on each source file */
+
+    bool verbose;  /**< Enable verbose progress output */
+    bool paranoid; /**< Rehash every file instead of trusting unchanged size, mtime and identity */
+    std::uint64_t sampledCheckThreshold; /**< In paranoid runs, files of at least this many bytes with unchanged metadata are only checked by a sample of their blocks, 0 hashes them whole */
+    unsigned int sampledCheckBlocks;     /**< Blocks a sampled check reads between the first and the last block */
+    unsigned int sampledCheckFullEvery;  /**< A file is hashed whole on every this many paranoid runs instead of sampled, 0 keeps sampling it while its metadata is unchanged */
+    bool resume;   /**< Continue an interrupted run, skipping the files it already committed, instead of starting over */
+    bool extendedAttributes; /**< Record each file's extended attributes along with its mode, owner and times, on Linux */
+    std::atomic<bool>* stopRequested; /**< Set from any thread to stop the run early, also set when timeLimitSeconds passes; nullptr never stops */
+    unsigned int timeLimitSeconds;    /**< Stop the run early this long after it started, 0 for no limit */
+
+    std::uintmax_t memoryMapThreshold; /**< Minimum file size in bytes for memory-mapped hashing, 0 disables mapping */
+    HashAlgorithm hashAlgorithm;       /**< Algorithm for newly computed content hashes */
+    unsigned int treeHashThreads;      /**< Threads hashing one large file with the tree algorithm, 0 uses the hardware concurrency */
+    ReadEngine readEngine;             /**< How files are read for hashing; io_uring falls back to blocking reads where unavailable */
+    unsigned int readQueueDepth;       /**< Reads in flight per hashing thread with the io_uring engine */
+    bool unbufferedIo;                 /**< Keep large files out of the page cache while hashing and copying */
+    std::uintmax_t unbufferedThreshold; /**< Minimum file size in bytes for unbuffered I/O */
+    std::size_t hashBufferSize;        /**< Read buffer size in bytes of each hashing thread */
+    std::uint64_t readaheadBytes;      /**< Bytes of queued files the kernel is asked to read into the page cache ahead of the workers, 0 disables readahead */
+    IoLimits ioLimits;                 /**< Read and write budgets shared by all hashing and copying threads */
+    std::filesystem::path throttleFile; /**< File re-read while the run goes on to change ioLimits, empty disables it */
+
+    std::size_t stateBatchSize;        /**< File state rows committed per transaction, 0 or 1 commits each row */
+    unsigned int stateBatchIntervalMs; /**< Maximum age in milliseconds of an uncommitted file state batch */
+    bool dedicatedWriter;              /**< Commit file states from a single writer thread instead of from each worker */
+    std::uint64_t writerEscalationRetries; /**< Busy retries of the state database after which the rest of the run commits from a single writer thread, 0 never switches */
+    std::size_t stateShards;           /**< Databases the file rows are split across, each with its own write lock, 1 keeps them in the state database, 0 keeps the current layout */
+    std::size_t stateIndexMemoryLimit; /**< Memory cap in bytes for preloading stored states, 0 queries per file instead */
+    bool stateSnapshot;                /**< With the index enabled, write the stored states to a memory-mapped file next to the database after a successful run and read them from it at the next start */
+    bool mergeStateLookups;            /**< Without a loaded state index, read each listed directory's stored states in one ordered scan merged with the listing, instead of one query per file */
+    bool bulkImport;                   /**< Into an empty database, append the file rows in key order, build the secondary indexes at the end and sync only after the final checkpoint */
+    bool prefetchStates;               /**< Without a loaded state index, read the stored states of each walker batch with a few IN queries and hand them to the workers with the files */
+    std::uint64_t memoryLimit;         /**< Budget in bytes shrinking the state index, SQLite caches, read buffers and queue depths to fit, 0 is unlimited */
+    SQLitePerformanceProfile databaseProfile; /**< Durability and caching of the state database and the hash cache */
+    unsigned int checkpointIntervalMs; /**< Time between background WAL checkpoints of the state database, 0 checkpoints on commit */
+    DurabilityPolicy durability;       /**< When backup copies and the state database are flushed to stable storage */
+
+    unsigned int walkThreads; /**< Threads enumerating the source tree, 1 walks on the calling thread */
+    bool orderedWalk;         /**< Enqueue files in sorted depth-first order instead of discovery order */
+    bool mftWalk;             /**< On NTFS, list the source tree from the master file table when the process may open the volume */
+    bool preScan;             /**< Count files and bytes in a metadata-only walk running alongside the backup */
+    unsigned int preScanThreads; /**< Threads of the pre-scan walk, 0 uses the hardware concurrency */
+    bool useChangeJournal;       /**< Visit only the directories a running watcher recorded as changed, when its journal is complete */
+    unsigned int journalReconcileRuns; /**< Journal runs between two full walks, 0 walks the whole tree every run */
+    std::filesystem::path changeListFile; /**< Output of `zfs diff -H` or `btrfs subvolume find-new` between the snapshot the previous run read and
+                                               the one sourceDir points at; a run with stored states lists only the directories it names. Empty walks the tree */
+    std::filesystem::path changeListRoot; /**< Directory the absolute paths of changeListFile are relative to, empty uses sourceDir */
+    PathFilterRules filterRules;       /**< Files and directories left out of the backup; what they exclude is archived like deleted files */
+
+    QueueBackend queueBackend;        /**< Work queue implementation between the walker and the workers */
+    SchedulingPolicy scheduling;      /**< Order in which files are handed to workers; size-aware policies stat every file */
+    std::uint64_t largeFileThreshold; /**< Size in bytes from which a file counts as large for size-aware scheduling */
+    std::size_t lookaheadWindow; /**< Queued files largest-first, recent-first and physical scheduling reorder among */
 
-    bool verbose; /**< Enable verbose progress output */
+    DeviceClass deviceClass;    /**< Storage class the stage defaults are taken from; other than Default also commits from a writer thread */
+    unsigned int hashThreads;   /**< Read/hash stage threads, 0 uses the device class default */
+    std::size_t hashQueueDepth; /**< Files queued ahead of the read/hash stage, 0 uses the device class default */
+    bool adaptiveThreads;       /**< Hill-climb the active read/hash threads on measured throughput, starting from hashThreads */
+    unsigned int maxAdaptiveThreads; /**< Most active read/hash threads with adaptiveThreads, 0 uses four per core up to 64 */
+    bool pinWorkers;            /**< Pin the read/hash threads to CPUs spread over the NUMA nodes and queue files per node */
+    bool idlePriority;          /**< Run the read/hash and copy threads at idle CPU and I/O priority, leaving the coordinating threads at normal priority */
+    std::shared_ptr<WorkerBudget> workerBudget; /**< Read/hash slots and device limits shared with concurrent RunBackup calls, such as WorkerBudget::ProcessWide(); nullptr limits only this job's own threads */
+    unsigned int jobWeight;     /**< Share of workerBudget relative to the other jobs using it */
+    unsigned int copyThreads;   /**< Copy stage threads, 0 uses the device class default; Default copies on the hash threads */
+    std::size_t copyQueueDepth; /**< Files queued ahead of the copy stage, 0 uses the device class default */
 
-    std::function<void(const BackupProgress&)> onProgress; /**< Optional callback for progress notifications */
+    bool contentStore; /**< Store each distinct content once under objects/ and hardlink backup and snapshot files to it */
+    bool chunkedHistory;            /**< Archive previous versions as chunk manifests over a deduplicating chunk store; excludes contentStore */
+    std::uint32_t averageChunkSize; /**< Target chunk size in bytes for chunked history */
+    bool deltaHistory;              /**< Archive previous versions as reverse deltas against the new version; excludes the other stores */
+    std::uint32_t deltaBlockSize;   /**< Block size in bytes matched by delta history */
+    bool compressHistory;           /**< zstd-compress archived files that are kept whole; excludes contentStore */
+    int compressionLevel;           /**< zstd level for compressed history */
+    unsigned int compressionThreads; /**< zstd worker threads for large archived files, 0 compresses on the archiving thread */
+    bool compressionDictionaries;   /**< Train zstd dictionaries per extension from small backup copies and compress small archived files with them; needs compressHistory */
+    bool packSmallFiles;            /**< Append files below packThreshold to segment files under packs/ instead of storing them one by one */
+    std::uint64_t packThreshold;    /**< Size in bytes below which packSmallFiles packs a file */
+    std::uint64_t inlineThreshold;  /**< Size in bytes below which packSmallFiles holds a content inline in the pack index instead of a segment, 0 for none */
+    std::uint64_t packSegmentSize;  /**< Size in bytes at which a pack segment is closed */
+    bool snapshotTrees;             /**< Link each successful run into a complete tree under snapshots/<timestamp>/ */
+    bool stateCopies;               /**< Write a consistent, compressed copy of the state database under state/<timestamp>/ after each successful run */
+    std::size_t parityDataShards;   /**< Data blocks per stripe of the Reed-Solomon parity kept under parity/ */
+    std::size_t parityShards;       /**< Parity blocks per stripe, any this many damaged blocks of a stripe can be rebuilt; 0 keeps no parity.
+                                         Excludes chunked, delta and compressed history, encryption and a storage backend */
+    std::uint64_t parityThreshold;  /**< Size in bytes from which a backup copy gets parity; packed files are covered by the parity of their closed segment */
+    bool detectMoves;               /**< Take over the backup copy of a file moved or renamed in the source by matching size and digest, instead of copying it again; excludes contentStore and a storage backend */
+    std::filesystem::path encryptionKeyFile; /**< Key file new backup copies are encrypted with, empty stores them in plain; excludes the other stores */
+    EncryptionAlgorithm encryptionAlgorithm; /**< Cipher of encrypted copies; Auto picks AES-256-GCM where the CPU has AES instructions */
+
+    std::filesystem::path traceFile;   /**< Chrome trace-event JSON written at the end of the run, empty disables tracing */
+    std::size_t traceEventsPerThread; /**< Trace events kept per thread; older events are overwritten */
+    std::filesystem::path ioTraceFile; /**< Text file every file system and database operation of the run is recorded to with its timing, for ReplayIoTrace; paths are left out; empty records none */
+    std::filesystem::path changeLogFile; /**< NDJSON file listing every path the run added, modified or deleted, rewritten each run; empty writes none */
+    std::filesystem::path metricsFile; /**< Prometheus text file written at the end of the run for the node exporter's textfile collector, empty writes none */
+    std::filesystem::path slowOperationLog; /**< Text file listing each operation slower than slowOperationThresholdMs with its stage and file, empty disables it */
+    unsigned int slowOperationThresholdMs;  /**< Operations taking at least this many milliseconds are logged, 0 logs every operation */
+
+    std::function<void(const BackupProgress&)> onProgress; /**< Optional callback for progress notifications, called from one reporter thread */
+    unsigned int progressIntervalMs;                      /**< Time in milliseconds between two progress reports */
+    std::size_t progressEventCapacity;                    /**< Per-file events buffered for onProgress, 0 reports sampled counts only */
+    std::string statusSegment;                            /**< Name of a shared-memory segment live counters are published in for ReadLiveStatus, empty publishes none */
 
     /**
      * @brief Initialize configuration with default values.
      */
-    BackupConfig() : verbose(false), onProgress(nullptr) {}
+    BackupConfig()
+        : resumeAppends(false), copyCheckpointInterval(0), digestAttributes(false), verbose(false), paranoid(false), sampledCheckThreshold(0), sampledCheckBlocks(DefaultSampledCheckBlocks),
+          sampledCheckFullEvery(DefaultSampledCheckFullEvery), resume(true), extendedAttributes(false), stopRequested(nullptr), timeLimitSeconds(0), memoryMapThreshold(DefaultMemoryMapThreshold), hashAlgorithm(FileHasher::DefaultAlgorithm),
+          treeHashThreads(0), readEngine(ReadEngine::Blocking), readQueueDepth(FileHasher::DefaultReadQueueDepth),
+          unbufferedIo(false), unbufferedThreshold(DefaultUnbufferedThreshold),
+          hashBufferSize(FileHasher::DefaultReadBufferSize), readaheadBytes(0),
+          stateBatchSize(DefaultStateBatchSize), stateBatchIntervalMs(DefaultStateBatchIntervalMs),
+          dedicatedWriter(false), writerEscalationRetries(DefaultWriterEscalationRetries), stateShards(0), stateIndexMemoryLimit(DefaultStateIndexMemoryLimit), stateSnapshot(true), mergeStateLookups(false), bulkImport(true), prefetchStates(false), memoryLimit(0),
+          databaseProfile(SQLitePerformanceProfile::Balanced), checkpointIntervalMs(DefaultCheckpointIntervalMs), durability(DurabilityPolicy::None), walkThreads(1),
+          orderedWalk(false), mftWalk(false), preScan(false), preScanThreads(0), useChangeJournal(false),
+          journalReconcileRuns(DefaultJournalReconcileRuns), queueBackend(QueueBackend::LockFreeRing), scheduling(SchedulingPolicy::Fifo),
+          largeFileThreshold(ThreadedFileQueueOptions::DefaultLargeFileThreshold),
+          lookaheadWindow(ThreadedFileQueueOptions::DefaultLookaheadWindow), deviceClass(DeviceClass::Default), hashThreads(0),
+          hashQueueDepth(0), adaptiveThreads(false), maxAdaptiveThreads(0), pinWorkers(false), idlePriority(false), jobWeight(1), copyThreads(0), copyQueueDepth(0), contentStore(false),
+          chunkedHistory(false), averageChunkSize(FileChunkerOptions::DefaultAverageSize), deltaHistory(false),
+          deltaBlockSize(DefaultDeltaBlockSize), compressHistory(false),
+          compressionLevel(FileCompressorOptions::DefaultLevel), compressionThreads(0), compressionDictionaries(false), packSmallFiles(false),
+          packThreshold(DefaultPackThreshold), inlineThreshold(0), packSegmentSize(DefaultPackSegmentSize), snapshotTrees(false), stateCopies(false),
+          parityDataShards(DefaultParityDataShards), parityShards(0), parityThreshold(DefaultParityThreshold), detectMoves(false),
+          encryptionAlgorithm(EncryptionAlgorithm::Auto),
+          traceEventsPerThread(DefaultTraceEventsPerThread), slowOperationThresholdMs(DefaultSlowOperationThresholdMs), onProgress(nullptr), progressIntervalMs(DefaultProgressIntervalMs),
+          progressEventCapacity(0)
+    {
+    }
 };
 
 /**
- * @brief Execute a backup operation based on provided configuration.
- *
- * This function performs an incremental backup of the source directory,
- * tracking file changes, archiving modified or deleted files, and maintaining
- * backup state in a SQLite database.
- *
- * @param[in] configuration Configuration parameters for the backup operation
- * @return true if backup completed successfully, false on error
+ * @brief Configuration parameters for watching a source tree for changes.
  */
-bool RunBackup(const BackupConfig& configuration);
+struct WatchConfig
+{
+    /**
+     * @brief Default time in milliseconds between two flushes of the recorded changes.
+     */
+    static constexpr unsigned int DefaultFlushIntervalMs = 1000;
+
+    std::filesystem::path sourceDir;          /**< Source directory to watch, as passed to RunBackup */
+    std::filesystem::path databaseFile;       /**< SQLite database of the backup the journal is kept in */
+    SQLitePerformanceProfile databaseProfile; /**< Durability and caching of the database connection */
+    unsigned int flushIntervalMs;             /**< Time in milliseconds between two flushes of the recorded changes */
+    std::function<void()> onReady;            /**< Optional callback once every directory is watched */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    WatchConfig() : databaseProfile(SQLitePerformanceProfile::Balanced), flushIntervalMs(DefaultFlushIntervalMs), onReady(nullptr)
+    {
+    }
+};
+
+/**
+ * @brief Configuration for RunDaemon.
+ */
+struct DaemonConfig
+{
+    /**
+     * @brief Default time in milliseconds between two checks of the trigger file and the journal.
+     */
+    static constexpr unsigned int DefaultPollIntervalMs = 1000;
+
+    BackupConfig backup;                /**< Backup every run performs; its stopRequested is replaced by the daemon's */
+    unsigned int intervalSeconds;       /**< Time from the start of one run to the next, 0 runs only when triggered */
+    std::filesystem::path triggerFile;  /**< File whose modification starts a run, such as with touch, empty disables it */
+    std::uint64_t journalThreshold;     /**< Directories in the change journal that start a run, 0 disables it */
+    unsigned int pollIntervalMs;        /**< Time in milliseconds between two checks of the trigger file and the journal */
+    std::function<void(bool, const BackupStats&)> onRunFinished; /**< Optional callback after each run with its outcome and measurements */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    DaemonConfig() : intervalSeconds(0), journalThreshold(0), pollIntervalMs(DefaultPollIntervalMs), onRunFinished(nullptr)
+    {
+    }
+};
+
+/**
+ * @brief Configuration parameters for restore operations.
+ */
+struct RestoreConfig
+{
+    std::filesystem::path backupRoot;   /**< Root directory of the backup storage, as passed to RunBackup */
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    std::filesystem::path targetDir;    /**< Directory the tree is restored into; files already there are replaced */
+    std::string timestamp;              /**< Restore the tree as of `YYYY-MM-DD_HH-MM-SS` or a prefix of it, empty restores the last run */
+    unsigned int threads;               /**< Restoring threads, 0 uses the hardware concurrency */
+    bool verify;                        /**< Rehash restored files that have a recorded digest and fail on a mismatch */
+    bool restoreMetadata;               /**< Apply the recorded mode, owner, times and extended attributes to restored files, on POSIX */
+    std::filesystem::path encryptionKeyFile; /**< Key the backup was encrypted with, empty when it is not encrypted */
+    std::vector<std::string> priorityPatterns; /**< gitignore-style patterns of the files restored before all others; a directory pattern covers its tree */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    RestoreConfig() : threads(0), verify(true), restoreMetadata(true)
+    {
+    }
+};
+
+/**
+ * @brief Configuration parameters for exporting a tree as a tar stream.
+ */
+struct ExportConfig
+{
+    std::filesystem::path backupRoot;   /**< Root directory of the backup storage, as passed to RunBackup */
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    std::string timestamp;              /**< Export the tree as of `YYYY-MM-DD_HH-MM-SS` or a prefix of it, empty exports the last run */
+    std::filesystem::path outputFile;   /**< Archive to create or replace, empty writes to standard output */
+    bool compress;                      /**< Write the archive as one zstd frame */
+    int compressionLevel;               /**< zstd level when compressing */
+    unsigned int compressionThreads;    /**< zstd worker threads when compressing, 0 compresses on the writing thread */
+    unsigned int threads;               /**< Threads rebuilding archived versions ahead of the writer, 0 uses the hardware concurrency */
+    bool verify;                        /**< Rehash rebuilt versions that have a recorded digest and fail on a mismatch */
+    std::filesystem::path encryptionKeyFile; /**< Key the backup was encrypted with, empty when it is not encrypted */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    ExportConfig() : compress(false), compressionLevel(FileCompressorOptions::DefaultLevel), compressionThreads(0), threads(0), verify(true)
+    {
+    }
+};
+
+/**
+ * @brief Outcome of RunExport.
+ */
+struct ExportReport
+{
+    std::uint64_t members;      /**< Files written to the archive */
+    std::uint64_t contentBytes; /**< Content bytes of those files */
+    std::uint64_t outputBytes;  /**< Bytes of the archive as written, compressed when compressing */
+    std::uint64_t splicedBytes; /**< Content bytes moved from stored copies into a pipe with splice, without a copy through user space */
+};
+
+/**
+ * @brief Configuration parameters for mounting the history of a backup as a read-only filesystem.
+ */
+struct MountConfig
+{
+    /**
+     * @brief Default memory of the block cache in MiB.
+     */
+    static constexpr std::size_t DefaultCacheMegabytes = 64;
+
+    std::filesystem::path backupRoot;        /**< Root directory of the backup storage, as passed to RunBackup */
+    std::filesystem::path databaseFile;      /**< SQLite database of the backup */
+    std::filesystem::path mountPoint;        /**< Existing empty directory the history is mounted on */
+    std::size_t cacheMegabytes;              /**< Memory of the block cache in MiB; at least one block is kept */
+    bool verify;                             /**< Rehash rebuilt versions that have a recorded digest and fail reads of them on a mismatch */
+    std::filesystem::path encryptionKeyFile; /**< Key the backup was encrypted with, empty when it is not encrypted */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    MountConfig() : cacheMegabytes(DefaultCacheMegabytes), verify(true)
+    {
+    }
+};
+
+/**
+ * @brief Attributes of a file or directory of the mounted history.
+ */
+struct HistoryMountEntry
+{
+    bool directory;                  /**< The root, a point in time or a directory of its tree */
+    std::uint64_t size;              /**< Content size in bytes of a file, 0 for a directory */
+    std::int64_t modificationTimeNs; /**< Recorded modification time of a current version, 0 for other versions and directories */
+    std::uint32_t mode;              /**< Permission bits, never with write permission */
+};
+
+/**
+ * @brief Counters of the reads a HistoryMount served.
+ */
+struct HistoryMountCounters
+{
+    std::uint64_t blockHits;    /**< Blocks served from the block cache */
+    std::uint64_t blockMisses;  /**< Blocks read from a stored or rebuilt file */
+    std::uint64_t filesRebuilt; /**< Versions rebuilt into the staging directory on first read */
+};
+
+/**
+ * @brief Read-only view of every point in time of a backup, served by RunMount.
+ *
+ * The root holds one directory per recorded run and snapshot, named after its timestamp, and `latest`
+ * for the last run; each holds the tree as of that point, planned as by RunRestore on first access.
+ * Paths are absolute within the view, `/` being its root. Plain stored copies are read in place;
+ * compressed, chunked, delta, packed and encrypted versions are rebuilt into a staging directory
+ * below `staging/` on their first read and kept there until the view is destroyed. Reads go through
+ * an LRU cache of BlockSize blocks. The points in time are those recorded when the view was opened.
+ * All methods may be called from several threads at once.
+ */
+class HistoryMount
+{
+  public:
+    /**
+     * @brief Name of the directory holding the tree as of the last run.
+     */
+    static constexpr const char* LatestName = "latest";
+
+    /**
+     * @brief Size of the blocks of the block cache.
+     */
+    static constexpr std::size_t BlockSize = 128 * 1024;
+
+    /**
+     * @brief Construct a view; nothing is read before Open.
+     *
+     * @param[in] configuration Backup to view, its key and the cache size; mountPoint is not used
+     */
+    explicit HistoryMount(const MountConfig& configuration);
+
+    /**
+     * @brief Destroy the view and its staging directory.
+     */
+    ~HistoryMount();
+
+    HistoryMount(const HistoryMount&) = delete;
+    HistoryMount& operator=(const HistoryMount&) = delete;
+
+    /**
+     * @brief Open the backup database and list the points in time.
+     *
+     * @return true on success, false if the database or the key cannot be read
+     */
+    bool Open();
+
+    /**
+     * @brief Get the attributes of a path.
+     *
+     * @param[in] path Absolute path within the view
+     * @param[out] outputEntry Attributes of the path
+     * @return true if the path exists, false otherwise
+     */
+    bool Stat(const std::string& path, HistoryMountEntry& outputEntry);
+
+    /**
+     * @brief List a directory.
+     *
+     * @param[in] path Absolute path of a directory within the view
+     * @param[out] outputNames Names of its entries in ascending order
+     * @return true if the path is a directory, false otherwise
+     */
+    bool List(const std::string& path, std::vector<std::string>& outputNames);
+
+    /**
+     * @brief Read part of a file.
+     *
+     * @param[in] path Absolute path of a file within the view
+     * @param[in] offset First byte to read
+     * @param[in] size Bytes to read at most
+     * @param[out] buffer Receives the bytes, at least size long
+     * @param[out] outputRead Bytes read, fewer than size only at the end of the file
+     * @return true on success, false if the path is not a file or its version cannot be read or rebuilt
+     */
+    bool Read(const std::string& path, std::uint64_t offset, std::size_t size, char* buffer, std::size_t& outputRead);
+
+    /**
+     * @brief Get the counters of the reads served so far.
+     *
+     * @return Counters since Open
+     */
+    HistoryMountCounters Counters() const;
+
+  private:
+    struct State;
+
+    MountConfig _configuration;
+    std::unique_ptr<State> _state;
+};
+
+/**
+ * @brief How RunImport places the files of a mirror under `backup/`.
+ */
+enum class ImportMethod
+{
+    Rename,   /**< Move the files, so the mirror is emptied; copies only across filesystems */
+    Hardlink, /**< Link the files, so the mirror and the store share them and the mirror must no longer be written */
+    Reflink   /**< Clone the files where the filesystem shares extents, copy them elsewhere */
+};
+
+/**
+ * @brief Convert an ImportMethod enumeration value to its string representation.
+ *
+ * @param[in] method The import method to convert
+ * @return String representation of the import method
+ */
+inline const char* ImportMethodToString(ImportMethod method)
+{
+    switch (method)
+    {
+    case ImportMethod::Rename:
+        return "rename";
+    case ImportMethod::Hardlink:
+        return "hardlink";
+    case ImportMethod::Reflink:
+        return "reflink";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Convert a string to an ImportMethod enumeration value.
+ *
+ * @param[in] stringValue String representation of the import method
+ * @param[out] outputMethod Parsed import method
+ * @return true if the string names an import method, false otherwise
+ */
+inline bool StringToImportMethod(const std::string& stringValue, ImportMethod& outputMethod)
+{
+    for (ImportMethod method : {ImportMethod::Rename, ImportMethod::Hardlink, ImportMethod::Reflink})
+    {
+        if (ImportMethodToString(method) == stringValue)
+        {
+            outputMethod = method;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Configuration parameters for seeding a new backup store from an existing copy of the source.
+ */
+struct ImportConfig
+{
+    std::filesystem::path mirrorDir;    /**< Existing copy of the source tree, for example an rsync mirror; empty when importing tarFile */
+    std::filesystem::path tarFile;      /**< Tar archive of the source tree, `-` reads standard input; empty when importing mirrorDir */
+    std::filesystem::path sourceDir;    /**< Source the backups will run on, empty records the imported copies' own metadata */
+    std::filesystem::path backupRoot;   /**< Root directory of the backup storage, whose `backup/` must be missing or empty */
+    std::filesystem::path databaseFile; /**< SQLite database of the backup, which must hold no file states yet */
+    ImportMethod method;                /**< How mirror files are placed; tar members are always unpacked */
+    HashAlgorithm hashAlgorithm;        /**< Algorithm for the recorded digests, the one later backups will use */
+    unsigned int threads;               /**< Placing and hashing threads, 0 uses the hardware concurrency */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    ImportConfig() : method(ImportMethod::Rename), hashAlgorithm(FileHasher::DefaultAlgorithm), threads(0)
+    {
+    }
+};
+
+/**
+ * @brief Outcome of RunImport.
+ */
+struct ImportReport
+{
+    std::uint64_t files;   /**< Files placed under `backup/` and recorded */
+    std::uint64_t bytes;   /**< Content bytes of those files */
+    std::uint64_t matched; /**< Files recorded with the metadata of their source counterpart, which the first backup skips without reading */
+    std::uint64_t skipped; /**< Entries left out: symbolic links, devices, tar members named outside the tree or repeated */
+    std::uint64_t failed;  /**< Files that could not be placed, hashed or recorded */
+};
+
+/**
+ * @brief Configuration parameters for verifying the backup store.
+ */
+struct VerifyConfig
+{
+    std::filesystem::path backupRoot;   /**< Root directory of the backup storage, as passed to RunBackup */
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    unsigned int threads;               /**< Hashing threads, 0 uses the hardware concurrency */
+    unsigned int slices;                /**< Runs it takes to cover the whole store, 1 verifies everything every run */
+    bool snapshots;                     /**< Verify the versions archived under deleted/ too, not only backup/ */
+    IoLimits ioLimits;                  /**< Read bandwidth and request limits shared by all threads; write limits are unused */
+    std::filesystem::path encryptionKeyFile; /**< Key the backup was encrypted with, empty when it is not encrypted */
+    bool repair;                        /**< Rebuild damaged plain copies and pack segments in place from their parity where they have any */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    VerifyConfig() : threads(0), slices(1), snapshots(false), repair(false)
+    {
+    }
+};
+
+/**
+ * @brief Kind of problem found by RunVerify.
+ */
+enum class VerifyIssueType
+{
+    Missing,    /**< The stored file does not exist */
+    Mismatch,   /**< The content does not hash to the recorded digest */
+    Unreadable  /**< The stored file exists but could not be read */
+};
+
+/**
+ * @brief One stored file that failed verification.
+ */
+struct VerifyIssue
+{
+    std::string path;     /**< Stored file relative to the backup root, under backup/ or deleted/ */
+    VerifyIssueType type; /**< What is wrong with it */
+};
+
+/**
+ * @brief Outcome of a verify run.
+ */
+struct VerifyReport
+{
+    unsigned int slice;              /**< Slice verified by the run */
+    unsigned int slices;             /**< Number of slices the store is split into */
+    std::size_t filesVerified;       /**< Stored files hashed or found missing */
+    std::uint64_t bytesVerified;     /**< Bytes hashed */
+    std::size_t filesSkipped;        /**< Archived versions stored as chunks, compressed or as deltas, which only a restore can check */
+    std::vector<VerifyIssue> issues; /**< Files that failed, sorted by path */
+    std::vector<std::string> repaired; /**< Files that failed and were rebuilt from parity, sorted by path; not among the issues */
+};
+
+/**
+ * @brief Which snapshots a prune keeps; a snapshot matching any rule is kept.
+ */
+struct RetentionPolicy
+{
+    unsigned int keepLast;   /**< Newest snapshots kept */
+    unsigned int keepDaily;  /**< Days, newest first, whose newest snapshot is kept */
+    unsigned int keepWeekly; /**< Weeks from Monday, newest first, whose newest snapshot is kept */
+
+    /**
+     * @brief Initialize a policy that keeps nothing, which RunPrune refuses.
+     */
+    RetentionPolicy() : keepLast(0), keepDaily(0), keepWeekly(0)
+    {
+    }
+};
+
+/**
+ * @brief Configuration for RunPrune.
+ */
+struct PruneConfig
+{
+    std::filesystem::path backupRoot;   /**< Root directory of the backup storage, as passed to RunBackup */
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    RetentionPolicy policy;             /**< Snapshots to keep */
+    unsigned int threads;               /**< Deleting threads, 0 uses the hardware concurrency */
+    bool dryRun;                        /**< Report what would be pruned without changing anything */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    PruneConfig() : threads(0), dryRun(false)
+    {
+    }
+};
+
+/**
+ * @brief Outcome of a prune run.
+ */
+struct PruneReport
+{
+    std::vector<std::string> kept;     /**< Snapshots kept, oldest first */
+    std::vector<std::string> pruned;   /**< Snapshots deleted, or to delete on a dry run, oldest first */
+    std::size_t keptAsDeltaBasis;      /**< Expired snapshots kept because a kept delta is based on a version in them */
+    std::uint64_t versionsRemoved;     /**< Archived versions forgotten */
+    std::size_t objectsReclaimed;      /**< Content objects deleted once no version linked them, not counted on a dry run */
+    std::size_t chunksReclaimed;       /**< Chunks deleted once no manifest listed them, not counted on a dry run */
+    std::size_t parityReclaimed;       /**< Parity files deleted once no file state or version had their content, not counted on a dry run */
+};
+
+/**
+ * @brief Configuration for RunConsolidate.
+ */
+struct ConsolidateConfig
+{
+    static constexpr unsigned int DefaultKeyframeInterval = 8; /**< Default keyframeInterval */
+
+    std::filesystem::path backupRoot;   /**< Root directory of the backup storage, as passed to RunBackup */
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    unsigned int keyframeInterval;      /**< Most deltas applied to rebuild any version, 0 leaves the chain length unbounded */
+    std::uint64_t maxChainBytes;        /**< Most bytes rebuilt along a chain of two or more deltas, 0 leaves the cost unbounded */
+    unsigned int threads;               /**< Rewriting threads, each at idle priority; 0 uses the hardware concurrency */
+    IoLimits ioLimits;                  /**< Bandwidth shared by all threads; reads count the bytes rebuilt, writes the keyframes */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    ConsolidateConfig() : keyframeInterval(DefaultKeyframeInterval), maxChainBytes(0), threads(1)
+    {
+    }
+};
+
+/**
+ * @brief Outcome of a consolidation.
+ */
+struct ConsolidateReport
+{
+    std::size_t chains;           /**< Archived files with at least one delta version */
+    std::size_t keyframesWritten; /**< Delta versions rewritten as full versions */
+    std::uint64_t bytesWritten;   /**< Bytes of the keyframes written */
+    std::size_t longestChain;     /**< Most deltas a restore of any version applies afterwards */
+    std::size_t failed;           /**< Delta versions that should have become keyframes but could not be rebuilt */
+};
+
+/**
+ * @brief Configuration for RunTier.
+ */
+struct TierConfig
+{
+    std::filesystem::path backupRoot;   /**< Root directory of the backup storage, the hot tier */
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    std::filesystem::path coldRoot;     /**< Directory of the cold tier, on another device or a mounted object store */
+    unsigned int olderThanDays;         /**< Move the snapshots started more than this many days ago */
+    IoLimits ioLimits;                  /**< Read and write bandwidth of the mover */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    TierConfig() : olderThanDays(30)
+    {
+    }
+};
+
+/**
+ * @brief Outcome of a move to the cold tier.
+ */
+struct TierReport
+{
+    std::size_t snapshotsMoved;  /**< Snapshot directories now on the cold tier */
+    std::uint64_t filesMoved;    /**< Files written to the cold tier */
+    std::uint64_t bytesMoved;    /**< Bytes written to the cold tier */
+    std::uint64_t deltasRebuilt; /**< Delta versions stored in full on the cold tier */
+};
+
+/**
+ * @brief Configuration for RunMaintain.
+ */
+struct MaintainConfig
+{
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    unsigned int purgeDeletedDays;      /**< Forget files deleted more than this many days ago, 0 keeps them all */
+    bool vacuum;                        /**< Rewrite a database not yet in incremental auto-vacuum mode once to switch it over */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    MaintainConfig() : purgeDeletedDays(0), vacuum(false)
+    {
+    }
+};
+
+/**
+ * @brief Outcome of a maintenance run.
+ */
+struct MaintainReport
+{
+    std::uint64_t rowsPurged;  /**< Rows of deleted files forgotten */
+    std::uint64_t bytesBefore; /**< Database size before the run */
+    std::uint64_t bytesAfter;  /**< Database size after the run */
+    bool converted;            /**< The database was rewritten into incremental auto-vacuum mode */
+};
+
+/**
+ * @brief Configuration for RunReplicate.
+ */
+struct ReplicateConfig
+{
+    std::filesystem::path backupRoot;   /**< Backup root replicated */
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    std::filesystem::path target;       /**< Directory the replica is kept in, for example a mounted share */
+    unsigned int threads;               /**< Copying threads, 0 uses the hardware concurrency */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    ReplicateConfig() : threads(0)
+    {
+    }
+};
+
+/**
+ * @brief Outcome of a replication.
+ */
+struct ReplicateReport
+{
+    std::int64_t runId;           /**< Newest run the replica holds */
+    bool full;                    /**< The replica had no mark, so the whole store was sent */
+    std::uint64_t filesCopied;    /**< Files sent */
+    std::uint64_t bytesCopied;    /**< Bytes of the files sent, without the database copy */
+    std::uint64_t entriesRemoved; /**< Files and snapshot directories removed from the replica */
+};
+
+/**
+ * @brief Configuration for RunDiff.
+ */
+struct DiffConfig
+{
+    std::filesystem::path databaseFile;      /**< SQLite database of the backup compared from */
+    std::filesystem::path otherDatabaseFile; /**< SQLite database of the backup compared to */
+};
+
+/**
+ * @brief One file that differs between two backups.
+ */
+struct DiffEntry
+{
+    std::string path;  /**< File path relative to the source root */
+    ChangeType change; /**< Added: only in the other backup; Deleted: only in the first; Modified: different digests */
+};
+
+/**
+ * @brief Outcome of RunDiff.
+ */
+struct DiffReport
+{
+    std::vector<DiffEntry> entries;  /**< Differing files in ascending path order */
+    std::size_t directoriesCompared; /**< Directories present in both backups whose files were compared */
+    std::size_t directoriesSkipped;  /**< Directories present in both backups skipped because their digests matched */
+    std::uint64_t digestsRefreshed;  /**< Directory digests recomputed in both databases before comparing */
+};
+
+/**
+ * @brief Configuration for RunHistory.
+ */
+struct HistoryConfig
+{
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    std::size_t limit;                  /**< Most runs reported, 0 for all */
+};
+
+/**
+ * @brief Outcome of RunHistory.
+ */
+struct HistoryReport
+{
+    std::vector<RunHistoryEntry> runs; /**< Recorded runs, newest first */
+};
+
+/**
+ * @brief Configuration for RunSnapshotDiff.
+ */
+struct SnapshotDiffConfig
+{
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    std::string from;                   /**< Point in time compared from: a run timestamp or a prefix of one */
+    std::string to;                     /**< Point in time compared to, earlier or later than from */
+};
+
+/**
+ * @brief Configuration for RunFind.
+ */
+struct FindConfig
+{
+    std::filesystem::path databaseFile; /**< SQLite database of the backup */
+    std::string pattern;                /**< GLOB pattern over the relative path; without `*`, `?` or `[` any path containing it matches */
+};
+
+/**
+ * @brief One recorded version of a file found by RunFind.
+ */
+struct FoundVersion
+{
+    std::string path;     /**< File path relative to the source root */
+    std::string version;  /**< Timestamp of the run that backed the version up */
+    std::uint64_t size;   /**< Size in bytes */
+    std::string snapshot; /**< Snapshot directory the version was archived into, empty while it is current */
+};
+
+/**
+ * @brief Configuration for RunHashManifest.
+ */
+struct HashManifestConfig
+{
+    std::filesystem::path sourceDir;     /**< File or directory tree to hash */
+    std::filesystem::path outputFile;    /**< Manifest to write, created or truncated */
+    HashAlgorithm hashAlgorithm;         /**< Algorithm of the listed digests */
+    unsigned int threads;                /**< Hashing threads, 0 uses the hardware concurrency */
+    unsigned int walkThreads;            /**< Threads enumerating the tree, 1 walks on the calling thread */
+    bool sorted;                         /**< List files in the walk's sorted depth-first order instead of the order they finish in */
+    PathFilterRules filterRules;         /**< Files and directories left out of the manifest */
+    std::filesystem::path hashCacheFile; /**< SQLite digest cache shared with backup jobs, empty disables it */
+    bool digestAttributes;               /**< Use and refresh the digests cached in an extended attribute on each file */
+    ReadEngine readEngine;               /**< How files are read for hashing */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    HashManifestConfig()
+        : hashAlgorithm(FileHasher::DefaultAlgorithm), threads(0), walkThreads(1), sorted(false), digestAttributes(false), readEngine(ReadEngine::Blocking)
+    {
+    }
+};
+
+/**
+ * @brief Outcome of RunHashManifest.
+ */
+struct HashManifestReport
+{
+    std::uint64_t files;      /**< Files listed in the manifest */
+    std::uint64_t bytes;      /**< Bytes of the listed files */
+    std::uint64_t cacheHits;  /**< Listed files whose digest came from a cache instead of being read */
+    std::uint64_t failed;     /**< Files left out because they could not be read */
+};
+
+/**
+ * @brief Count and total time of one operation, in the recorded trace and in its replay.
+ */
+struct IoTraceOperation
+{
+    std::string name;            /**< Operation name, such as "FileHasher::Compute" or "UpdateFileStates" */
+    std::uint64_t recordedCount; /**< Times the recorded run did it */
+    std::uint64_t recordedNs;    /**< Time the recorded run spent in it, summed over threads */
+    std::uint64_t replayedCount; /**< Times the replayed run did it */
+    std::uint64_t replayedNs;    /**< Time the replayed run spent in it, summed over threads */
+};
+
+/**
+ * @brief Outcome of ReplayIoTrace.
+ */
+struct IoTraceReplayReport
+{
+    std::uint64_t directories;                /**< Directories of the generated tree */
+    std::uint64_t files;                      /**< Files of the generated tree */
+    std::uint64_t bytes;                      /**< Bytes of the generated files */
+    std::uint64_t recordedThreads;            /**< Threads that recorded operations */
+    double recordedSeconds;                   /**< Time from the first to the end of the last recorded operation */
+    BackupStats stats;                        /**< Measurements of the replayed run */
+    std::vector<IoTraceOperation> operations; /**< Every operation of either run, by name */
+};
+
+/**
+ * @brief Configuration for RunServe.
+ */
+struct ServeConfig
+{
+    /**
+     * @brief Default port of the remote backup protocol.
+     */
+    static constexpr std::uint16_t DefaultPort = 7420;
+
+    /**
+     * @brief Default port of the HTTP `/metrics` endpoint.
+     */
+    static constexpr std::uint16_t DefaultMetricsPort = 9742;
+
+    std::filesystem::path backupRoot;               /**< Directory holding one backup per client name, each laid out like a local backup */
+    std::string listenAddress;                      /**< Numeric local address to listen on */
+    std::uint16_t port;                             /**< Port to listen on, 0 picks a free one */
+    HashAlgorithm hashAlgorithm;                    /**< Algorithm clients hash with and received files are rehashed with */
+    SQLitePerformanceProfile databaseProfile;       /**< Durability and caching of the state databases */
+    unsigned int threads;                           /**< Threads per session applying received files, 0 uses the hardware concurrency */
+    std::function<void(std::uint16_t)> onListening; /**< Optional callback with the bound port once clients can connect */
+    std::string metricsAddress;                     /**< Numeric local address of the HTTP `/metrics` endpoint, empty disables it */
+    std::uint16_t metricsPort;                      /**< Port of the `/metrics` endpoint, 0 picks a free one */
+    std::function<void(std::uint16_t)> onMetricsListening; /**< Optional callback with the bound port of the `/metrics` endpoint */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    ServeConfig()
+        : listenAddress("0.0.0.0"), port(DefaultPort), hashAlgorithm(FileHasher::DefaultAlgorithm),
+          databaseProfile(SQLitePerformanceProfile::Balanced), threads(0), onListening(nullptr), metricsPort(DefaultMetricsPort),
+          onMetricsListening(nullptr)
+    {
+    }
+};
+
+/**
+ * @brief Configuration for RunRemoteBackup.
+ */
+struct RemoteBackupConfig
+{
+    /**
+     * @brief Default number of files listed per batch.
+     */
+    static constexpr std::size_t DefaultBatchSize = 256;
+
+    /**
+     * @brief Default number of batches sent before the oldest one is complete.
+     */
+    static constexpr std::size_t DefaultBatchesInFlight = 16;
+
+    std::filesystem::path sourceDir;     /**< Directory to back up */
+    std::string host;                    /**< Server host name or address */
+    std::uint16_t port;                  /**< Server port */
+    std::string name;                    /**< Name of the backup on the server, one directory under its backup root */
+    PathFilterRules filterRules;         /**< Include and exclude rules applied during the walk */
+    unsigned int hashThreads;            /**< Threads hashing and uploading files, 0 uses the hardware concurrency */
+    std::size_t batchSize;               /**< Files listed per batch */
+    std::size_t batchesInFlight;         /**< Batches sent before the oldest one is complete */
+    bool compress;                       /**< Send zstd compressed chunks where both sides support it and it saves bytes */
+    std::filesystem::path hashCacheFile; /**< Optional digest cache consulted before hashing, empty disables it */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    RemoteBackupConfig()
+        : port(ServeConfig::DefaultPort), hashThreads(0), batchSize(DefaultBatchSize), batchesInFlight(DefaultBatchesInFlight), compress(true)
+    {
+    }
+};
+
+/**
+ * @brief Outcome of a remote backup.
+ */
+struct RemoteBackupReport
+{
+    bool succeeded;                                         /**< The server completed the run successfully */
+    std::array<std::size_t, ChangeTypeCount> filesByChange; /**< Files per outcome as stored by the server, indexed by ChangeType */
+    std::uint64_t bytesHashed;                              /**< Bytes the client hashed, files found in the hash cache excluded */
+    std::uint64_t contentBytes;                             /**< Bytes of file content uploaded, before compression */
+    std::uint64_t bytesSent;                                /**< Bytes sent on the connection, framing and compression included */
+    std::string error;                                      /**< Why the run failed, as far as known; empty on success */
+};
+
+/**
+ * @brief Configuration for RunPartitionPlan.
+ */
+struct PartitionPlanConfig
+{
+    std::filesystem::path sourceDir;  /**< Source directory split by its top-level entries */
+    std::filesystem::path backupRoot; /**< Backup root shared by the nodes; the plan, the catalog and each partition's store live under partitions/ */
+    unsigned int partitions;          /**< Number of partitions, one per node */
+    bool rebalance;                   /**< Reassign every entry instead of only the entries the previous plan does not know */
+
+    /**
+     * @brief Initialize configuration with default values.
+     */
+    PartitionPlanConfig() : partitions(1), rebalance(false)
+    {
+    }
+};
+
+/**
+ * @brief Outcome of a partition plan.
+ */
+struct PartitionPlanReport
+{
+    std::string created;                        /**< Timestamp of the plan, also the name of the snapshot merged from it */
+    std::size_t entries;                        /**< Top-level entries assigned */
+    std::size_t entriesWithHistory;             /**< Entries whose cost was measured by an earlier backup rather than estimated */
+    std::vector<std::uint64_t> partitionCosts;  /**< Estimated cost per partition */
+};
+
+/**
+ * @brief Configuration for RunPartitionMerge.
+ */
+struct PartitionMergeConfig
+{
+    std::filesystem::path backupRoot; /**< Backup root the plan was made for */
+};
+
+/**
+ * @brief Outcome of a partition merge.
+ */
+struct PartitionMergeReport
+{
+    std::string snapshot;                       /**< Name of the merged snapshot, the creation timestamp of the plan */
+    std::vector<unsigned int> pendingPartitions; /**< Partitions without a completed run since the plan was made */
+    std::uint64_t files;                        /**< Live files over all partitions */
+    std::uint64_t bytes;                        /**< Bytes of those files */
+};
+
+/**
+ * @brief Execute a backup operation based on provided configuration.
+ *
+ * This function performs an incremental backup of the source directory,
+ * tracking file changes, archiving modified or deleted files, and maintaining
+ * backup state in a SQLite database.
+ *
+ * With a trace file configured, the run is traced and fails if the trace cannot be written. Likewise with
+ * a slow operation log, which is written while the run goes on, and a metrics file, which is replaced
+ * at the end of the run.
+ *
+ * With a storage backend, changed files are uploaded straight from the source and previous versions are
+ * moved within the store; the database stays local. The content store, chunked, delta and compressed
+ * history, small file packing and snapshot trees all need a filesystem and fail the run.
+ *
+ * With an encryption key file, every copy written to backup/ or uploaded to the storage backend is
+ * encrypted with an authenticated cipher, fed from the same read buffer that hashes the file; versions
+ * moved to deleted/ stay encrypted. Copies written before the key was set stay in plain. The content
+ * store, chunked, delta and compressed history, small file packing and snapshot trees read or rewrite
+ * stored content and fail the run, as does a key file that cannot be read or a build without OpenSSL.
+ *
+ * Setting stopRequested, or reaching timeLimitSeconds, stops the run early: no further directory is
+ * listed, queued files are dropped unprocessed, files already being processed finish and every batched
+ * state is committed. The deletion pass, the change journal and the snapshot tree are skipped, and the
+ * run stays marked as running, so the next run with resume set continues it. A stopped run returns false.
+ *
+ * Every run that started, also a failed or stopped one, is measured and recorded in the run history of
+ * the state database, which RunHistory lists. A history that cannot be written fails the run.
+ *
+ * @param[in] configuration Configuration parameters for the backup operation
+ * @return true if backup completed successfully, false on error or when stopped early
+ */
+bool RunBackup(const BackupConfig& configuration);
+
+/**
+ * @brief Execute a backup operation and measure it.
+ *
+ * Behaves like RunBackup(configuration). Each thread counts into its own counters, which are summed
+ * once the run is over.
+ *
+ * @param[in] configuration Configuration parameters for the backup operation
+ * @param[out] outputStats Per-stage times, byte and file counts of the run, also filled in when it fails or is stopped
+ * @return true if backup completed successfully, false on error or when stopped early
+ */
+bool RunBackup(const BackupConfig& configuration, BackupStats& outputStats);
+
+/**
+ * @brief Render a measured backup run as a JSON document for orchestration tools.
+ *
+ * The document holds the outcome, every field of the stats with stages and change types keyed by name,
+ * and the configuration the run used, with the device class defaults it resolved to in the thread counts.
+ *
+ * @param[in] configuration Configuration the run was started with
+ * @param[in] stats Measurements filled in by RunBackup
+ * @param[in] success Result of RunBackup
+ * @return JSON object, ending with a newline
+ */
+std::string FormatBackupReport(const BackupConfig& configuration, const BackupStats& stats, bool success);
+
+/**
+ * @brief Preview a backup: count the files and bytes a run would add, modify and delete, writing nothing.
+ *
+ * Walks the sources with the configured filters and compares each file against its stored state through
+ * the in-memory state index, falling back to per-file queries when the index does not fit. A file whose
+ * metadata changed counts as modified unless hashCandidates is set, in which case it is hashed and
+ * compared; configuration.paranoid then hashes every known file. Nothing is copied, no directory is
+ * created and no database row is written; without a database every file counts as added.
+ *
+ * @param[in] configuration Configuration of the backup to preview
+ * @param[in] hashCandidates Hash files whose metadata changed instead of counting them as modified
+ * @param[out] outputPreview Expected files and bytes per change type
+ * @return true if every file was classified, false on error
+ */
+bool PreviewBackup(const BackupConfig& configuration, bool hashCandidates, BackupPreview& outputPreview);
+
+/**
+ * @brief Read the live counters a backup run publishes in its status segment.
+ *
+ * Reading maps the segment read-only and never slows the run; it may be called at any rate, also after
+ * the run has ended.
+ *
+ * @param[in] segmentName Name set as BackupConfig::statusSegment
+ * @param[out] outputStatus Counters at the time of the call
+ * @return true on success, false if no segment of that name exists
+ */
+bool ReadLiveStatus(const std::string& segmentName, LiveStatus& outputStatus);
+
+/**
+ * @brief Watch a source tree and record the directories that change into the backup's change journal.
+ *
+ * Backups with useChangeJournal visit only the recorded directories as long as the watcher keeps running
+ * without losing events since the previous backup started; otherwise they walk the whole tree. Only
+ * available on Linux, where inotify is used.
+ *
+ * @param[in] configuration Configuration parameters for the watcher
+ * @param[in] stopRequested Set to stop watching
+ * @return true if the watcher stopped on request, false on error or where watching is unavailable
+ */
+bool RunWatch(const WatchConfig& configuration, const std::atomic<bool>& stopRequested);
+
+/**
+ * @brief Run backups on a timer, on request or when enough changes were journaled, keeping warm state in between.
+ *
+ * The state database stays open, so its connections keep their page caches and the schema is checked
+ * once. The file state index mapped from the state snapshot stays mapped while no file row changes, and
+ * a run that changes rows maps the snapshot it writes right away, so the next run neither waits for nor
+ * validates it. Backup directories already created are not checked again. Each run is otherwise a full
+ * RunBackup with its measurements; a failed run drops the kept state, so the next one starts cold. With
+ * a timer the first run starts at once.
+ *
+ * @param[in] configuration Backup and triggers
+ * @param[in] stopRequested Set to stop the daemon; a run in progress stops as with BackupConfig::stopRequested
+ * @return true if the daemon stopped on request, false if the database could not be opened
+ */
+bool RunDaemon(const DaemonConfig& configuration, std::atomic<bool>& stopRequested);
+
+/**
+ * @brief Restore the backed up tree as it was at a point in time.
+ *
+ * The version history in the database names the version of each file current at the timestamp and
+ * the snapshot under `deleted/` holding it, or `backup/` for versions still current. Snapshots written
+ * before the version history existed are searched instead: the oldest one newer than the timestamp
+ * holding a file has its version. Archived chunk manifests, compressed files and deltas are rebuilt.
+ * Files are restored in parallel, plain copies as reflinks where the filesystem supports them, and
+ * versions from the history are checked against their recorded digest.
+ *
+ * Every change of a run is stamped with the run's start, so any timestamp from that second on restores
+ * the tree as the run left it.
+ *
+ * @param[in] configuration Configuration parameters for the restore operation
+ * @return true if every file was restored, false on error
+ */
+bool RunRestore(const RestoreConfig& configuration);
+
+/**
+ * @brief Restore a tree as RunRestore does, the files matching the priority patterns first.
+ *
+ * The priority files are restored, and get their metadata, before any other file is started, so a
+ * service needing a few of them can start while the rest of the tree streams in behind it. Once the
+ * last of them is in place the callback runs on the calling thread; the remaining files are then
+ * restored as usual. If a priority file fails, the callback is skipped, the rest is still restored
+ * and the call returns false.
+ *
+ * @param[in] configuration Configuration parameters for the restore operation, with the priority patterns
+ * @param[in] onPriorityRestored Callback receiving the number of priority files once all of them are restored; empty for none
+ * @return true if every file was restored, false on error or if a priority pattern is malformed
+ */
+bool RunRestore(const RestoreConfig& configuration, const std::function<void(std::size_t)>& onPriorityRestored);
+
+/**
+ * @brief Write the tree as of a point in time as a POSIX tar stream, optionally zstd-compressed.
+ *
+ * The tree is planned as by RunRestore. Members are written in path order; archived versions are rebuilt
+ * by a pool of threads into staging files below `staging/` ahead of the writer and checked against their
+ * recorded digest, while plain backup copies are streamed as stored. Mode, owner and modification time
+ * are those recorded for current versions; other versions get mode 0644, owner 0 and time 0. When the
+ * output is a pipe and not compressed, stored content is moved into it with splice on Linux.
+ *
+ * @param[in] configuration Configuration parameters for the export
+ * @param[out] outputReport Counts of what was written
+ * @return true if every file was written, false on error; the stream is complete but lacks failed files unless a write failed
+ */
+bool RunExport(const ExportConfig& configuration, ExportReport& outputReport);
+
+/**
+ * @brief Check whether this build can mount the backup history.
+ *
+ * @return true when built with FUSE, false otherwise
+ */
+bool IsMountSupported();
+
+/**
+ * @brief Mount the history of a backup read-only through FUSE and serve it until it is unmounted.
+ *
+ * Serves a HistoryMount: one directory per point in time, file contents rebuilt on demand. Returns
+ * once the filesystem is unmounted with `fusermount -u` or the process gets SIGINT or SIGTERM.
+ *
+ * @param[in] configuration Configuration parameters for the mount
+ * @return true if the history was mounted and later unmounted, false on error or when built without FUSE
+ */
+bool RunMount(const MountConfig& configuration);
+
+/**
+ * @brief Adopt an existing copy of the source tree as the first run of a new backup store.
+ *
+ * The files of a mirror directory are renamed, hard linked or cloned into `backup/`, or the regular
+ * members of a tar stream are unpacked there, and a pool of threads hashes each placed file once and
+ * records it as added by one run, so migrating an existing copy costs a single read pass instead of a
+ * full copy. A file whose counterpart in the source has the same size and the same modification time to
+ * the second, the check rsync makes, is recorded with the counterpart's metadata, so the first backup
+ * skips it without reading it; the others are rehashed by that backup and kept if their digest matches.
+ *
+ * @param[in] configuration Configuration parameters for the import
+ * @param[out] outputReport Counts of what was imported
+ * @return true if every file was imported, false on error or if the store is not new
+ */
+bool RunImport(const ImportConfig& configuration, ImportReport& outputReport);
+
+/**
+ * @brief Rehash stored files against the digests recorded for them.
+ *
+ * Covers the files under `backup/` and, if configured, the versions archived as plain copies under
+ * `deleted/`. Each file belongs to one slice by a hash of its path; a run verifies the slice the state
+ * database schedules next and moves the schedule on, so a store too large to read in one go is covered
+ * by a series of runs. Files are hashed in parallel with the digest algorithm recorded for them, subject
+ * to the configured read limits.
+ *
+ * @param[in] configuration Configuration parameters for the verify operation
+ * @param[out] outputReport Files verified and the problems found
+ * @return true if the slice was verified, whether or not it had problems; false if the database cannot be read
+ */
+bool RunVerify(const VerifyConfig& configuration, VerifyReport& outputReport);
+
+/**
+ * @brief Pick the snapshots a retention policy keeps.
+ *
+ * Snapshot names are run timestamps, `YYYY-MM-DD_HH-MM-SS`. A name of another form is always kept.
+ *
+ * @param[in] names Snapshot names in any order
+ * @param[in] policy Rules to apply
+ * @return Kept names, oldest first
+ */
+std::vector<std::string> SelectSnapshotsToKeep(const std::vector<std::string>& names, const RetentionPolicy& policy);
+
+/**
+ * @brief Delete the snapshots a retention policy no longer keeps.
+ *
+ * Snapshots are the `deleted/<timestamp>` directories and, with snapshot trees, `snapshots/<timestamp>`.
+ * An expired snapshot still holding the version a kept delta is based on is kept. The pruned snapshots
+ * and their versions are forgotten, and the content objects and chunks they referenced are released, in
+ * one transaction; then the directories, and the objects and chunks no longer referenced, are deleted in
+ * parallel. Directories a stopped run left behind are still listed as snapshots, so the next run deletes them.
+ *
+ * @param[in] configuration Configuration parameters for the prune operation
+ * @param[out] outputReport Snapshots kept and pruned, and what was reclaimed
+ * @return true on success, false if the policy keeps nothing, the store cannot be read or a deletion failed
+ */
+bool RunPrune(const PruneConfig& configuration, PruneReport& outputReport);
+
+/**
+ * @brief Bound the delta chains of a history kept with delta history by rewriting some versions in full.
+ *
+ * A delta rebuilds its version from the next newer one, so restoring an old version applies every delta
+ * back from the nearest version stored in full. Walking each file's versions from newest to oldest, the
+ * delta that would make the chain longer than the keyframe interval, or make a chain of two or more deltas
+ * rebuild more than the byte limit, is rebuilt and verified, stored as a plain version, and its delta
+ * removed; the chain starts again from there. Files are taken by threads at idle CPU and I/O priority,
+ * paced by the bandwidth limits, so it can run alongside other work. Run it while no backup is running.
+ *
+ * @param[in] configuration Configuration parameters for the consolidation
+ * @param[out] outputReport Chains found, keyframes written and the longest chain left
+ * @return true on success, false if a run is in progress, the store cannot be read or a version could not be rebuilt
+ */
+bool RunConsolidate(const ConsolidateConfig& configuration, ConsolidateReport& outputReport);
+
+/**
+ * @brief Move the snapshots past an age from the backup root to a cold tier.
+ *
+ * Runs keep archiving into deleted/ below the backup root, the hot tier. Snapshots started more than
+ * olderThanDays ago are copied, oldest first and one at a time in path order, into deleted/ below the cold
+ * root, with deltas rebuilt in full since their basis stays hot. The state database records which
+ * snapshots are cold and where, and restore, mount, verify and prune read them there. The move runs on a
+ * thread at idle CPU and I/O priority. Stores with a content store are refused, since their archived
+ * versions are links to objects that take no space of their own. Run it while no backup is running.
+ *
+ * @param[in] configuration Configuration parameters for the move
+ * @param[out] outputReport Snapshots, files and bytes moved
+ * @return true on success, false if a run is in progress, the store cannot be moved or a copy failed
+ */
+bool RunTier(const TierConfig& configuration, TierReport& outputReport);
+
+/**
+ * @brief Compact the state database and refresh its query statistics.
+ *
+ * Rows of files deleted before the purge window are forgotten first, then ANALYZE gathers fresh
+ * statistics and, in incremental auto-vacuum mode, the free pages are handed back to the file system.
+ * Databases created before incremental auto-vacuum keep their free pages unless vacuum is set. Run it
+ * while no backup uses the database.
+ *
+ * @param[in] configuration Configuration parameters for the maintenance
+ * @param[out] outputReport Rows purged and the database size before and after
+ * @return true on success, false if the database is missing or a step failed
+ */
+bool RunMaintain(const MaintainConfig& configuration, MaintainReport& outputReport);
+
+/**
+ * @brief Bring a replica of the backup store in another directory up to date.
+ *
+ * The first replication copies the current copies, the snapshot directories and the content areas.
+ * Later ones send only the current copies of the paths the version history reports changed since the
+ * run the replica holds, the snapshot directories started since then, and the content and pack files
+ * the replica lacks; what is gone from the store is removed from the replica. The state database is
+ * copied as a consistent snapshot and a mark file in the replica records the run it holds. Hard-link
+ * snapshot trees are not replicated.
+ *
+ * @param[in] configuration Configuration parameters for the replication
+ * @param[out] outputReport Run replicated, whether everything was sent, and the files sent and removed
+ * @return true on success, false if a run is in progress, nothing was backed up or a copy failed
+ */
+bool RunReplicate(const ReplicateConfig& configuration, ReplicateReport& outputReport);
+
+/**
+ * @brief List the backup runs recorded in a state database, newest first.
+ *
+ * Every run that got as far as starting records its times per stage, file and byte counts, thread
+ * counts and outcome when it ends, so regressions and the expected cost of a run can be read back.
+ *
+ * @param[in] configuration Database to read and the most runs to report
+ * @param[out] outputReport Recorded runs
+ * @return true on success, false if the database is missing or cannot be read
+ */
+bool RunHistory(const HistoryConfig& configuration, HistoryReport& outputReport);
+
+/**
+ * @brief List the files that differ between two backups of a tree.
+ *
+ * Both databases first recompute the directory digests their runs invalidated. The trees are then
+ * walked from the root together, and a directory whose digest is the same in both is skipped with
+ * everything below it, so the work grows with the changed part of the tree rather than its size. The
+ * databases can be two backups of the same source, such as a local one and the one a server keeps, or
+ * a copy of a database kept from an earlier run and the database now. Run it while no backup uses
+ * either database.
+ *
+ * @param[in] configuration Databases to compare
+ * @param[out] outputReport Differing files and how many directories were compared and skipped
+ * @return true on success, false if a database is missing or cannot be read
+ */
+bool RunDiff(const DiffConfig& configuration, DiffReport& outputReport);
+
+/**
+ * @brief Stream the files that differ between the trees one backup held at two points in time.
+ *
+ * Answered from the version history: only files with a version that started or was archived between
+ * the two points are read, through range queries on its indexes, and each is handed to the callback as
+ * soon as it is classified. The first entries therefore arrive at once and memory does not grow with the
+ * size of the diff; entries come in no particular order. A point in time is read as by RunRestore, so a
+ * prefix of a timestamp stands for the start of that period.
+ *
+ * @param[in] configuration Database and the two points in time
+ * @param[in] onEntry Callback receiving each differing file, returns false to stop early
+ * @return true if every difference was visited, false if the database cannot be read, a point in time is empty or on an early stop
+ */
+bool RunSnapshotDiff(const SnapshotDiffConfig& configuration, const std::function<bool(const DiffEntry&)>& onEntry);
+
+/**
+ * @brief Stream every recorded version of the files whose path matches a pattern.
+ *
+ * Paths are looked up in a trigram index of the version history instead of walking the snapshot
+ * directories, so a pattern with a literal part of three characters or more is answered in milliseconds.
+ * Paths recorded since the last search are indexed first, so the first search of a large backup pays
+ * for indexing all of them once. `*` and `?` also match path separators, so a pattern starting with
+ * `*` matches at any depth. Versions of deleted files are found as long as they are kept.
+ *
+ * @param[in] configuration Database and pattern
+ * @param[in] onVersion Callback receiving each version, in ascending path and version order; returns false to stop early
+ * @return true if every version was visited, false if the database cannot be read, the pattern is empty or on an early stop
+ */
+bool RunFind(const FindConfig& configuration, const std::function<bool(const FoundVersion&)>& onVersion);
+
+/**
+ * @brief Write a content manifest of a tree without copying anything, for audits and cross-site comparison.
+ *
+ * The manifest is in the hashdeep text format: two `%%%%` header lines naming the columns, then one
+ * `size,digest,path` line per file, the path relative to the source and the digest in lowercase hex.
+ * Files are walked and hashed in parallel and each line is written as soon as its file is hashed. Sorted
+ * output is put back into walk order as lines complete, holding back only the lines that finish while an
+ * earlier file is still being hashed, so two trees with the same content give identical manifests. A digest cached on the file or
+ * in the hash cache for unchanged metadata is listed without reading the file; newly hashed digests are
+ * cached for later runs and backups.
+ *
+ * @param[in] configuration Source, manifest file, ordering and caches
+ * @param[out] outputReport Counts of the run
+ * @return true if every file was listed, false if the manifest or a cache cannot be opened, the walk was
+ *         incomplete or a file could not be hashed
+ */
+bool RunHashManifest(const HashManifestConfig& configuration, HashManifestReport& outputReport);
+
+/**
+ * @brief Replay a run recorded with BackupConfig::ioTraceFile against another storage target or configuration.
+ *
+ * A tree of the recorded shape is generated in configuration.sourceDir, which must be empty: one file of
+ * the recorded size per processed file, filled with pseudo-random bytes, so no customer data is needed. A
+ * first, unmeasured backup into the configured target records every file the trace saw as unchanged or
+ * modified. The modified files are then rewritten and the added ones created, and a measured backup with
+ * the configuration repeats the recorded run's work. Its own I/O trace is compared with the recorded one
+ * per operation, so queue depths, copy engines, thread counts and storage targets can be compared on a
+ * production access pattern. The file order follows the replay's walk, not the recorded one.
+ *
+ * @param[in] traceFile I/O trace written by the run to replay
+ * @param[in] configuration Backup configuration to replay with; its ioTraceFile receives the replay's trace,
+ *            empty writes it as replay.iotrace below backupRoot
+ * @param[out] outputReport Tree, measurements and per-operation comparison of the replay
+ * @return true if both backups succeeded, false if the trace cannot be read, the source directory is not
+ *         empty or the tree or a backup failed
+ */
+bool ReplayIoTrace(const std::filesystem::path& traceFile, const BackupConfig& configuration, IoTraceReplayReport& outputReport);
+
+/**
+ * @brief Serve remote backups until a stop is requested.
+ *
+ * Each client pushes into the backup named in its Hello, `<backupRoot>/<name>`, which can be restored,
+ * verified and pruned like a local backup. Clients send their file list in batches; the server answers
+ * which files changed metadata, then which digests changed, and stores only the content it needs. Only
+ * one client at a time may push to a name. Stopping ends the open sessions, recording their runs as failed.
+ *
+ * With a metrics address, an HTTP endpoint answers `GET /metrics` with the measurements of each backup
+ * name in the Prometheus text format: a snapshot of the running session, or else the last run.
+ *
+ * @param[in] configuration Backup root, listen address and session settings
+ * @param[in] stopRequested Set to stop serving
+ * @return true if the server stopped on request, false if it could not listen on either address
+ */
+bool RunServe(const ServeConfig& configuration, const std::atomic<bool>& stopRequested);
+
+/**
+ * @brief Push a source tree to a server started with RunServe.
+ *
+ * The walk sends the file list in batches without waiting for answers, up to the configured number of
+ * batches in flight. Only files whose metadata changed are hashed, and only files whose digest changed
+ * are uploaded, in chunks compressed where that saves bytes. The server marks files it did not see as
+ * deleted only after a complete walk in which every file could be read.
+ *
+ * @param[in] configuration Source, server and pipeline settings
+ * @param[out] outputReport Files per change type as counted by the server, and bytes hashed and sent
+ * @return true if the server completed the run successfully, false on error
+ */
+bool RunRemoteBackup(const RemoteBackupConfig& configuration, RemoteBackupReport& outputReport);
+
+/**
+ * @brief Split a source tree by its top-level entries across the nodes of a distributed backup.
+ *
+ * Each top-level entry is weighted by its files and bytes as measured by the last merge, or by the
+ * database of a single-node backup in the same root before the first one; entries without history get
+ * the mean weight. Entries are then handed, heaviest first, to the least loaded partition, and the plan
+ * is written to partitions/plan. Entries a previous plan with the same number of partitions assigned
+ * keep their partition unless rebalance is set, since moving an entry copies it again.
+ *
+ * @param[in] configuration Source, backup root and number of partitions
+ * @param[out] outputReport Plan timestamp, entries and estimated cost per partition
+ * @return true on success, false if the source cannot be listed or the plan cannot be written
+ */
+bool RunPartitionPlan(const PartitionPlanConfig& configuration, PartitionPlanReport& outputReport);
+
+/**
+ * @brief Limit a backup to one partition of the plan in its backup root.
+ *
+ * The backup is redirected to the partition's own store and database under partitions/<partition>, and
+ * filter patterns selecting the partition's entries are put before the configured ones. Partition 0
+ * also takes the entries created since the plan was made. Run the result with RunBackup on the node
+ * the partition belongs to.
+ *
+ * @param[in] partition Partition to back up
+ * @param[in,out] configuration Backup configuration whose backupRoot holds the plan
+ * @return true on success, false if the plan is missing or has no such partition, or the backup has several sources
+ */
+bool ApplyPartition(unsigned int partition, BackupConfig& configuration);
+
+/**
+ * @brief Record the runs of all partitions of a plan as one snapshot once every partition completed.
+ *
+ * A partition counts as done when the latest run in its database completed and started no earlier than
+ * the plan. When all are done, the snapshot, the run it is made of in each partition and the files and
+ * bytes per top-level entry are stored in partitions/catalog.db, where the next plan reads its weights.
+ *
+ * @param[in] configuration Backup root the plan was made for
+ * @param[out] outputReport Snapshot name and totals, or the partitions still pending
+ * @return true if the snapshot was recorded, false if a partition is pending or on error
+ */
+bool RunPartitionMerge(const PartitionMergeConfig& configuration, PartitionMergeReport& outputReport);
+
+/**
+ * @brief Rebuild a file version archived by a run with chunked history.
+ *
+ * @param[in] backupRoot Root directory of the backup storage
+ * @param[in] manifestPath Manifest of the version, `deleted/<timestamp>/<path>.chunks`
+ * @param[in] outputPath File to create or replace
+ * @return true if the version was restored and verified, false on error
+ */
+bool RestoreChunkedFile(const std::filesystem::path& backupRoot, const std::filesystem::path& manifestPath,
+                        const std::filesystem::path& outputPath);
+
+/**
+ * @brief Rebuild a file version archived by a run with compressed history.
+ *
+ * @param[in] compressedPath Compressed version, `deleted/<timestamp>/<path>.zst`
+ * @param[in] outputPath File to create or replace
+ * @param[in] databaseFile Backup database holding the dictionaries of compression dictionary runs, empty when none was used
+ * @return true if the version was restored, false on error, a missing dictionary or when zstd is unavailable
+ */
+bool RestoreCompressedFile(const std::filesystem::path& compressedPath, const std::filesystem::path& outputPath,
+                           const std::filesystem::path& databaseFile = {});
+
+/**
+ * @brief Decrypt a backup copy or archived version written by a run with an encryption key.
+ *
+ * @param[in] encryptedPath Encrypted file below `backup/` or `deleted/<timestamp>/`
+ * @param[in] keyFile Key file the backup was encrypted with
+ * @param[in] outputPath File to create or replace
+ * @return true if the file was decrypted and authenticated, false on error, a wrong key or when encryption is unavailable
+ */
+bool RestoreEncryptedFile(const std::filesystem::path& encryptedPath, const std::filesystem::path& keyFile, const std::filesystem::path& outputPath);
+
+/**
+ * @brief Rebuild a file version archived by a run with delta history.
+ *
+ * The delta is applied to the next newer version of the file, which is rebuilt the same way first when
+ * it is a delta itself; the newest version is the current backup copy.
+ *
+ * @param[in] backupRoot Root directory of the backup storage
+ * @param[in] deltaPath Delta of the version, `deleted/<timestamp>/<path>.delta`
+ * @param[in] outputPath File to create or replace
+ * @param[in] databaseFile Backup database holding the dictionaries of compression dictionary runs, empty when none was used
+ * @return true if the version was restored and verified, false on error
+ */
+bool RestoreDeltaFile(const std::filesystem::path& backupRoot, const std::filesystem::path& deltaPath, const std::filesystem::path& outputPath,
+                      const std::filesystem::path& databaseFile = {});
@@ -0,0 +1,284 @@
+#include "BackupMetrics.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <system_error>
+
+namespace
+{
+/**
+ * @brief Quantiles exported for the operation durations, with their label values.
+ */
+constexpr const char* QuantileLabels[] = {"0.5", "0.99", "0.999"};
+
+/**
+ * @brief Escape a label value: backslash, double quote and newline.
+ */
+std::string EscapeLabel(const std::string& value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (const char character : value)
+    {
+        if (('\\' == character) || ('"' == character))
+        {
+            escaped += '\\';
+            escaped += character;
+        }
+        else if ('\n' == character)
+        {
+            escaped += "\\n";
+        }
+        else
+        {
+            escaped += character;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * @brief Writes metric families, each with a HELP and a TYPE line, and their samples.
+ */
+class ExpositionWriter
+{
+  public:
+    ExpositionWriter()
+    {
+        _stream << std::setprecision(12);
+    }
+
+    /**
+     * @brief Start a metric family; its samples follow before the next family.
+     */
+    void Family(const char* name, const char* type, const char* help)
+    {
+        _stream << "# HELP " << name << ' ' << help << '\n' << "# TYPE " << name << ' ' << type << '\n';
+    }
+
+    /**
+     * @brief Write a sample with the backup label of an entry and up to two more labels.
+     */
+    void Sample(const std::string& name, const BackupMetricsEntry& entry, double value, const char* labelName = nullptr,
+                const std::string& labelValue = std::string(), const char* secondName = nullptr,
+                const std::string& secondValue = std::string())
+    {
+        std::string labels;
+        const auto addLabel = [&](const char* label, const std::string& labelText)
+        {
+            labels += (true == labels.empty()) ? "{" : ",";
+            labels += label;
+            labels += "=\"" + EscapeLabel(labelText) + "\"";
+        };
+        if (false == entry.backup.empty())
+        {
+            addLabel("backup", entry.backup);
+        }
+        if (nullptr != labelName)
+        {
+            addLabel(labelName, labelValue);
+        }
+        if (nullptr != secondName)
+        {
+            addLabel(secondName, secondValue);
+        }
+        labels += (true == labels.empty()) ? "" : "}";
+        _stream << name << labels << ' ' << value << '\n';
+    }
+
+    std::string Text() const
+    {
+        return _stream.str();
+    }
+
+  private:
+    std::ostringstream _stream;
+};
+
+std::uint64_t FilesProcessed(const BackupStats& stats)
+{
+    std::uint64_t files = 0;
+    for (const std::size_t count : stats.filesByChange)
+    {
+        files += count;
+    }
+    return files;
+}
+
+double PerSecond(double amount, const BackupStats& stats)
+{
+    return (0.0 < stats.elapsedSeconds) ? (amount / stats.elapsedSeconds) : 0.0;
+}
+
+/**
+ * @brief Share of the workers' time spent on files rather than waiting for the next one.
+ */
+double WorkerUtilization(const BackupStats& stats)
+{
+    double busySeconds = 0.0;
+    for (BackupStage stage : {BackupStage::Hash, BackupStage::Copy, BackupStage::Database})
+    {
+        busySeconds += stats.stages[static_cast<std::size_t>(stage)].wallSeconds;
+    }
+    const double totalSeconds = busySeconds + stats.queueWaitSeconds;
+    return (0.0 < totalSeconds) ? (busySeconds / totalSeconds) : 0.0;
+}
+}
+
+std::string FormatBackupMetrics(const std::vector<BackupMetricsEntry>& entries)
+{
+    ExpositionWriter writer;
+
+    writer.Family("rdemo_backup_running", "gauge", "Whether a backup run is in progress.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        writer.Sample("rdemo_backup_running", entry, (true == entry.running) ? 1.0 : 0.0);
+    }
+
+    writer.Family("rdemo_backup_last_success", "gauge", "Whether the last finished backup run succeeded.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        if (true == entry.finished)
+        {
+            writer.Sample("rdemo_backup_last_success", entry, (true == entry.lastSucceeded) ? 1.0 : 0.0);
+        }
+    }
+
+    writer.Family("rdemo_backup_last_run_timestamp_seconds", "gauge", "Unix time the last backup run finished.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        if (true == entry.finished)
+        {
+            writer.Sample("rdemo_backup_last_run_timestamp_seconds", entry, static_cast<double>(entry.finishedAt));
+        }
+    }
+
+    writer.Family("rdemo_backup_run_duration_seconds", "gauge", "Elapsed time of the current or last backup run.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        writer.Sample("rdemo_backup_run_duration_seconds", entry, entry.stats.elapsedSeconds);
+    }
+
+    writer.Family("rdemo_backup_bytes", "gauge", "Bytes read, written and hashed by the current or last backup run.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        writer.Sample("rdemo_backup_bytes", entry, static_cast<double>(entry.stats.bytesRead), "kind", "read");
+        writer.Sample("rdemo_backup_bytes", entry, static_cast<double>(entry.stats.bytesWritten), "kind", "written");
+        writer.Sample("rdemo_backup_bytes", entry, static_cast<double>(entry.stats.bytesHashed), "kind", "hashed");
+    }
+
+    writer.Family("rdemo_backup_files", "gauge", "Files processed by the current or last backup run, per outcome.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        for (std::size_t changeType = 0; changeType < ChangeTypeCount; ++changeType)
+        {
+            writer.Sample("rdemo_backup_files", entry, static_cast<double>(entry.stats.filesByChange[changeType]), "change",
+                          ChangeTypeToString(static_cast<ChangeType>(changeType)));
+        }
+    }
+
+    writer.Family("rdemo_backup_read_bytes_per_second", "gauge", "Source bytes read per second of the current or last backup run.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        writer.Sample("rdemo_backup_read_bytes_per_second", entry, PerSecond(static_cast<double>(entry.stats.bytesRead), entry.stats));
+    }
+
+    writer.Family("rdemo_backup_files_per_second", "gauge", "Files processed per second of the current or last backup run.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        writer.Sample("rdemo_backup_files_per_second", entry, PerSecond(static_cast<double>(FilesProcessed(entry.stats)), entry.stats));
+    }
+
+    writer.Family("rdemo_backup_stage_seconds", "gauge", "Time spent per stage, summed over threads.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+        {
+            const std::string stageName = BackupStageToString(static_cast<BackupStage>(stage));
+            writer.Sample("rdemo_backup_stage_seconds", entry, entry.stats.stages[stage].wallSeconds, "stage", stageName, "clock", "wall");
+            writer.Sample("rdemo_backup_stage_seconds", entry, entry.stats.stages[stage].cpuSeconds, "stage", stageName, "clock", "cpu");
+        }
+    }
+
+    // The summed stage time is the sum of the operation durations, which is what a summary's _sum holds.
+    writer.Family("rdemo_backup_operation_seconds", "summary", "Duration of one operation of a stage, such as a file hash or a state commit.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+        {
+            const std::string stageName = BackupStageToString(static_cast<BackupStage>(stage));
+            const BackupLatency& latency = entry.stats.latencies[stage];
+            const double quantiles[] = {latency.p50Seconds, latency.p99Seconds, latency.p999Seconds};
+            for (std::size_t quantile = 0; quantile < 3; ++quantile)
+            {
+                writer.Sample("rdemo_backup_operation_seconds", entry, quantiles[quantile], "stage", stageName, "quantile", QuantileLabels[quantile]);
+            }
+            writer.Sample("rdemo_backup_operation_seconds_sum", entry, entry.stats.stages[stage].wallSeconds, "stage", stageName);
+            writer.Sample("rdemo_backup_operation_seconds_count", entry, static_cast<double>(latency.count), "stage", stageName);
+        }
+    }
+
+    writer.Family("rdemo_backup_queue_wait_seconds", "gauge", "Time workers waited for the next file, summed over workers.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        writer.Sample("rdemo_backup_queue_wait_seconds", entry, entry.stats.queueWaitSeconds);
+    }
+
+    writer.Family("rdemo_backup_enqueue_wait_seconds", "gauge", "Time spent handing files to a full queue, summed over threads.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        writer.Sample("rdemo_backup_enqueue_wait_seconds", entry, entry.stats.enqueueWaitSeconds);
+    }
+
+    writer.Family("rdemo_backup_worker_utilization", "gauge", "Share of worker time spent on files rather than waiting for them.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        writer.Sample("rdemo_backup_worker_utilization", entry, WorkerUtilization(entry.stats));
+    }
+
+    writer.Family("rdemo_backup_queued_files", "gauge", "Files waiting for a worker of a running backup.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        if (true == entry.running)
+        {
+            writer.Sample("rdemo_backup_queued_files", entry, static_cast<double>(entry.queuedFiles));
+        }
+    }
+
+    writer.Family("rdemo_backup_sqlite_busy_retries", "gauge", "Retries of a state database locked by another connection.");
+    for (const BackupMetricsEntry& entry : entries)
+    {
+        writer.Sample("rdemo_backup_sqlite_busy_retries", entry, static_cast<double>(entry.stats.sqliteBusyRetries));
+    }
+    return writer.Text();
+}
+
+bool WriteBackupMetricsFile(const std::filesystem::path& metricsFile, const std::string& text)
+{
+    std::filesystem::path temporaryFile = metricsFile;
+    temporaryFile += ".tmp";
+    {
+        std::ofstream outputStream(temporaryFile, std::ios::binary | std::ios::trunc);
+        if (false == outputStream.is_open())
+        {
+            return false;
+        }
+        outputStream << text;
+        outputStream.close();
+        if (true == outputStream.fail())
+        {
+            std::error_code ec;
+            std::filesystem::remove(temporaryFile, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporaryFile, metricsFile, ec);
+    if (0 != ec.value())
+    {
+        std::filesystem::remove(temporaryFile, ec);
+        return false;
+    }
+    return true;
+}
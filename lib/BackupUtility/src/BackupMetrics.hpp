@@ -0,0 +1,44 @@
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Measurements of one backup, as exported to Prometheus.
+ */
+struct BackupMetricsEntry
+{
+    std::string backup;        /**< Value of the backup label, empty leaves the label out */
+    BackupStats stats;         /**< Measurements of the run in progress, or else of the last run */
+    bool running;              /**< stats sample a run still in progress */
+    bool finished;             /**< A run of this backup has finished, so lastSucceeded and finishedAt are set */
+    bool lastSucceeded;        /**< The last finished run succeeded */
+    std::int64_t finishedAt;   /**< Unix time in seconds the last run finished */
+    std::uint64_t queuedFiles; /**< Files waiting for a worker, meaningful while running */
+};
+
+/**
+ * @brief Render backup measurements in the Prometheus text exposition format.
+ *
+ * The samples of all entries are grouped by metric family, as the format requires. Throughput, queue
+ * waits and the worker utilization are derived from the counters of the entry's run.
+ *
+ * @param[in] entries Backups to export
+ * @return Exposition text, ending with a newline
+ */
+std::string FormatBackupMetrics(const std::vector<BackupMetricsEntry>& entries);
+
+/**
+ * @brief Replace a metrics file for the node exporter's textfile collector.
+ *
+ * The text is written next to the file and renamed over it, so the collector never reads half a file.
+ *
+ * @param[in] metricsFile File to replace, usually named `*.prom`
+ * @param[in] text Exposition text from FormatBackupMetrics
+ * @return true on success, false if the file could not be written
+ */
+bool WriteBackupMetricsFile(const std::filesystem::path& metricsFile, const std::string& text);
@@ -0,0 +1,105 @@
+// file BackupPreScan.cpp:
+
+#include "BackupPreScan.hpp"
+
+#include "FileIterator/FileIterator.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+constexpr unsigned int MinPreScanThreadCount = 1;
+
+/**
+ * @brief Get the histogram bucket of a file size: the number of significant bits.
+ */
+std::size_t SizeBucket(std::uint64_t size)
+{
+    std::size_t bucket = 0;
+    while (0 != size)
+    {
+        ++bucket;
+        size >>= 1;
+    }
+    return bucket;
+}
+}
+
+BackupPreScan::BackupPreScan(const std::vector<std::filesystem::path>& sourceDirs, unsigned int threadCount, const PathFilter* filter,
+                             ProgressReporter* progressReporter, const std::atomic<bool>* stopRequested)
+    : _filter(filter), _progressReporter(progressReporter), _stopRequested(stopRequested), _files(0), _bytes(0), _histogram{}
+{
+    const unsigned int threads = (0 != threadCount) ? threadCount : std::max(MinPreScanThreadCount, std::thread::hardware_concurrency());
+    _scanner = std::thread([this, sourceDirs, threads]() { Scan(sourceDirs, threads); });
+}
+
+BackupPreScan::~BackupPreScan()
+{
+    Join();
+}
+
+void BackupPreScan::Join()
+{
+    if (true == _scanner.joinable())
+    {
+        _scanner.join();
+    }
+}
+
+void BackupPreScan::Collect(std::uint64_t& outputFiles, std::uint64_t& outputBytes,
+                            std::array<std::uint64_t, FileSizeHistogramBuckets>& outputHistogram) const
+{
+    outputFiles = _files.load(std::memory_order_relaxed);
+    outputBytes = _bytes.load(std::memory_order_relaxed);
+    for (std::size_t bucket = 0; bucket < FileSizeHistogramBuckets; ++bucket)
+    {
+        outputHistogram[bucket] = _histogram[bucket].load(std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Walk the tree and count it batch by batch.
+ *
+ * Counts are summed per batch before they touch the shared atomics, so walker threads meet there once per
+ * directory rather than once per file. A failed walk still reports what it counted.
+ *
+ * @param[in] sourceDirs Files or directories to count
+ * @param[in] threadCount Walker threads
+ */
+void BackupPreScan::Scan(const std::vector<std::filesystem::path>& sourceDirs, unsigned int threadCount)
+{
+    const auto countBatch = [this](std::vector<FileEntry>&& files)
+    {
+        std::uint64_t bytes = 0;
+        std::array<std::uint64_t, FileSizeHistogramBuckets> histogram{};
+        for (const FileEntry& file : files)
+        {
+            bytes += file.info.size;
+            ++histogram[SizeBucket(file.info.size)];
+        }
+        _files.fetch_add(files.size(), std::memory_order_relaxed);
+        _bytes.fetch_add(bytes, std::memory_order_relaxed);
+        for (std::size_t bucket = 0; bucket < FileSizeHistogramBuckets; ++bucket)
+        {
+            if (0 != histogram[bucket])
+            {
+                _histogram[bucket].fetch_add(histogram[bucket], std::memory_order_relaxed);
+            }
+        }
+        if (nullptr != _progressReporter)
+        {
+            _progressReporter->AddToTotal(files.size(), bytes);
+        }
+    };
+    // Each source is its own filter root, as in the backup walk.
+    for (const auto& sourceDir : sourceDirs)
+    {
+        const FileIterator iterator(threadCount, false, true, _filter, sourceDir, _stopRequested);
+        iterator.IterateBatchesWithInfo(sourceDir, countBatch);
+    }
+    if (nullptr != _progressReporter)
+    {
+        _progressReporter->MarkTotalFinal();
+    }
+}
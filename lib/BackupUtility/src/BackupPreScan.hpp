@@ -0,0 +1,68 @@
+// file BackupPreScan.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "ProgressReporter.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Metadata-only walk of the source tree that counts files and bytes while the backup runs.
+ *
+ * The walk runs on its own threads with the same native enumeration as the backup walk, but only reads
+ * directory records and stats, never file content. Each batch is added to the progress totals as soon as
+ * it is counted, so progress reports carry a growing total long before the walk ends.
+ */
+class BackupPreScan
+{
+  public:
+    /**
+     * @brief Start the pre-scan.
+     *
+     * @param[in] sourceDirs Files or directories to count, one after the other
+     * @param[in] threadCount Walker threads, 0 uses the hardware concurrency
+     * @param[in] filter Rules of the backup walk, so only backed up files are counted; nullptr counts everything
+     * @param[in,out] progressReporter Reporter the totals are added to, nullptr only counts
+     * @param[in] stopRequested Stop flag of the backup run, which ends the count early too; nullptr never stops
+     */
+    BackupPreScan(const std::vector<std::filesystem::path>& sourceDirs, unsigned int threadCount, const PathFilter* filter, ProgressReporter* progressReporter,
+                  const std::atomic<bool>* stopRequested = nullptr);
+    /**
+     * @brief Wait for the pre-scan to finish.
+     */
+    ~BackupPreScan();
+
+    BackupPreScan(const BackupPreScan&) = delete;
+    BackupPreScan& operator=(const BackupPreScan&) = delete;
+
+    /**
+     * @brief Wait for the pre-scan to finish.
+     */
+    void Join();
+
+    /**
+     * @brief Get the counts, only valid after Join.
+     *
+     * @param[out] outputFiles Files found
+     * @param[out] outputBytes Their total size
+     * @param[out] outputHistogram File sizes bucketed as described at FileSizeHistogramBuckets
+     */
+    void Collect(std::uint64_t& outputFiles, std::uint64_t& outputBytes, std::array<std::uint64_t, FileSizeHistogramBuckets>& outputHistogram) const;
+
+  private:
+    void Scan(const std::vector<std::filesystem::path>& sourceDirs, unsigned int threadCount);
+
+    const PathFilter* _filter;
+    ProgressReporter* _progressReporter;
+    const std::atomic<bool>* _stopRequested;
+    std::atomic<std::uint64_t> _files;
+    std::atomic<std::uint64_t> _bytes;
+    std::array<std::atomic<std::uint64_t>, FileSizeHistogramBuckets> _histogram;
+    std::thread _scanner;
+};
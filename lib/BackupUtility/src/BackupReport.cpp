@@ -0,0 +1,284 @@
+#include "BackupUtility/BackupUtility.hpp"
+
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+namespace
+{
+constexpr double NanosecondsPerSecond = 1000000000.0;
+
+/**
+ * @brief Writes a JSON document member by member, inserting the commas between them.
+ */
+class JsonWriter
+{
+  public:
+    JsonWriter()
+    {
+        _stream << std::setprecision(12);
+    }
+
+    /**
+     * @brief Open an object, as a member when a key is given.
+     */
+    void Begin(const char* key = nullptr)
+    {
+        Key(key);
+        _stream << '{';
+        _first = true;
+    }
+
+    /**
+     * @brief Close the innermost object.
+     */
+    void End()
+    {
+        _stream << '}';
+        _first = false;
+    }
+
+    void Member(const char* key, const std::string& value)
+    {
+        Key(key);
+        _stream << '"';
+        for (const char character : value)
+        {
+            switch (character)
+            {
+            case '"':
+                _stream << "\\\"";
+                break;
+            case '\\':
+                _stream << "\\\\";
+                break;
+            case '\n':
+                _stream << "\\n";
+                break;
+            case '\r':
+                _stream << "\\r";
+                break;
+            case '\t':
+                _stream << "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(character) < 0x20)
+                {
+                    _stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(character) << std::dec
+                            << std::setfill(' ');
+                }
+                else
+                {
+                    _stream << character;
+                }
+                break;
+            }
+        }
+        _stream << '"';
+    }
+
+    void Member(const char* key, const char* value)
+    {
+        Member(key, std::string(value));
+    }
+
+    void Member(const char* key, bool value)
+    {
+        Key(key);
+        _stream << ((true == value) ? "true" : "false");
+    }
+
+    void Member(const char* key, double value)
+    {
+        Key(key);
+        _stream << value;
+    }
+
+    void Member(const char* key, std::uint64_t value)
+    {
+        Key(key);
+        _stream << value;
+    }
+
+    void Member(const char* key, unsigned int value)
+    {
+        Member(key, static_cast<std::uint64_t>(value));
+    }
+
+    void Member(const char* key, int value)
+    {
+        Key(key);
+        _stream << value;
+    }
+
+    std::string Text() const
+    {
+        return _stream.str() + "\n";
+    }
+
+  private:
+    void Key(const char* key)
+    {
+        if (nullptr == key)
+        {
+            return;
+        }
+        _stream << ((true == _first) ? "" : ",") << '"' << key << "\":";
+        _first = false;
+    }
+
+    std::ostringstream _stream;
+    bool _first = true;
+};
+
+const char* EncryptionAlgorithmName(EncryptionAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case EncryptionAlgorithm::Auto:
+        return "auto";
+    case EncryptionAlgorithm::Aes256Gcm:
+        return "aes-256-gcm";
+    case EncryptionAlgorithm::ChaCha20Poly1305:
+        return "chacha20-poly1305";
+    }
+    return "unknown";
+}
+
+void WriteStats(JsonWriter& writer, const BackupStats& stats)
+{
+    writer.Member("elapsedSeconds", stats.elapsedSeconds);
+    writer.Member("runTimestamp", stats.runTimestamp);
+    writer.Member("snapshotPath", stats.snapshotPath.string());
+    writer.Begin("threads");
+    writer.Member("walk", stats.walkThreads);
+    writer.Member("hash", stats.hashThreads);
+    writer.Member("copy", stats.copyThreads);
+    writer.End();
+    writer.Begin("stages");
+    for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+    {
+        const BackupLatency& latency = stats.latencies[stage];
+        writer.Begin(BackupStageToString(static_cast<BackupStage>(stage)));
+        writer.Member("wallSeconds", stats.stages[stage].wallSeconds);
+        writer.Member("cpuSeconds", stats.stages[stage].cpuSeconds);
+        writer.Member("operations", latency.count);
+        writer.Member("p50Seconds", latency.p50Seconds);
+        writer.Member("p99Seconds", latency.p99Seconds);
+        writer.Member("p999Seconds", latency.p999Seconds);
+        writer.Member("maxSeconds", latency.maxSeconds);
+        writer.End();
+    }
+    writer.End();
+    writer.Begin("bytes");
+    writer.Member("read", stats.bytesRead);
+    writer.Member("written", stats.bytesWritten);
+    writer.Member("hashed", stats.bytesHashed);
+    writer.End();
+    writer.Begin("files");
+    for (std::size_t changeType = 0; changeType < ChangeTypeCount; ++changeType)
+    {
+        writer.Member(ChangeTypeToString(static_cast<ChangeType>(changeType)), static_cast<std::uint64_t>(stats.filesByChange[changeType]));
+    }
+    writer.Member("Moved", static_cast<std::uint64_t>(stats.filesMoved));
+    writer.Member("Sampled", static_cast<std::uint64_t>(stats.filesSampled));
+    writer.End();
+    writer.Member("queueWaitSeconds", stats.queueWaitSeconds);
+    writer.Member("enqueueWaitSeconds", stats.enqueueWaitSeconds);
+    writer.Member("sqliteBusyRetries", stats.sqliteBusyRetries);
+    writer.Member("writerEscalated", stats.writerEscalated);
+    writer.Begin("preScan");
+    writer.Member("files", stats.preScanFiles);
+    writer.Member("bytes", stats.preScanBytes);
+    writer.End();
+    writer.Begin("scopes");
+    for (const InstrumentationTotal& scope : stats.scopes)
+    {
+        writer.Begin(scope.name.c_str());
+        writer.Member("calls", scope.calls);
+        writer.Member("totalSeconds", static_cast<double>(scope.totalNs) / NanosecondsPerSecond);
+        writer.Member("value", scope.value);
+        writer.End();
+    }
+    writer.End();
+}
+
+void WriteConfig(JsonWriter& writer, const BackupConfig& config)
+{
+    writer.Begin("config");
+    writer.Member("sourceDir", config.sourceDir.string());
+    writer.Begin("sources");
+    for (const BackupSource& source : config.sources)
+    {
+        writer.Member(source.name.c_str(), source.path.string());
+    }
+    writer.End();
+    writer.Member("backupRoot", config.backupRoot.string());
+    writer.Member("databaseFile", config.databaseFile.string());
+    writer.Member("remoteStorage", nullptr != config.storage);
+    writer.Member("hashCacheFile", config.hashCacheFile.string());
+    writer.Member("resumeAppends", config.resumeAppends);
+    writer.Member("copyCheckpointInterval", config.copyCheckpointInterval);
+    writer.Member("digestAttributes", config.digestAttributes);
+    writer.Member("paranoid", config.paranoid);
+    writer.Member("sampledCheckThreshold", config.sampledCheckThreshold);
+    writer.Member("sampledCheckBlocks", config.sampledCheckBlocks);
+    writer.Member("sampledCheckFullEvery", config.sampledCheckFullEvery);
+    writer.Member("resume", config.resume);
+    writer.Member("extendedAttributes", config.extendedAttributes);
+    writer.Member("timeLimitSeconds", config.timeLimitSeconds);
+    writer.Member("hashAlgorithm", HashAlgorithmToString(config.hashAlgorithm));
+    writer.Member("readEngine", ReadEngineToString(config.readEngine));
+    writer.Member("readQueueDepth", config.readQueueDepth);
+    writer.Member("memoryMapThreshold", static_cast<std::uint64_t>(config.memoryMapThreshold));
+    writer.Member("unbufferedIo", config.unbufferedIo);
+    writer.Member("hashBufferSize", static_cast<std::uint64_t>(config.hashBufferSize));
+    writer.Member("memoryLimit", static_cast<std::uint64_t>(config.memoryLimit));
+    writer.Member("databaseProfile", SQLitePerformanceProfileToString(config.databaseProfile));
+    writer.Member("stateBatchSize", static_cast<std::uint64_t>(config.stateBatchSize));
+    writer.Member("stateBatchIntervalMs", config.stateBatchIntervalMs);
+    writer.Member("dedicatedWriter", config.dedicatedWriter);
+    writer.Member("writerEscalationRetries", config.writerEscalationRetries);
+    writer.Member("stateIndexMemoryLimit", static_cast<std::uint64_t>(config.stateIndexMemoryLimit));
+    writer.Member("mergeStateLookups", config.mergeStateLookups);
+    writer.Member("bulkImport", config.bulkImport);
+    writer.Member("prefetchStates", config.prefetchStates);
+    writer.Member("orderedWalk", config.orderedWalk);
+    writer.Member("mftWalk", config.mftWalk);
+    writer.Member("preScan", config.preScan);
+    writer.Member("useChangeJournal", config.useChangeJournal);
+    writer.Member("queueBackend", QueueBackendToString(config.queueBackend));
+    writer.Member("scheduling", SchedulingPolicyToString(config.scheduling));
+    writer.Member("lookaheadWindow", static_cast<std::uint64_t>(config.lookaheadWindow));
+    writer.Member("deviceClass", DeviceClassToString(config.deviceClass));
+    writer.Member("adaptiveThreads", config.adaptiveThreads);
+    writer.Member("pinWorkers", config.pinWorkers);
+    writer.Member("idlePriority", config.idlePriority);
+    writer.Member("sharedWorkerBudget", nullptr != config.workerBudget);
+    writer.Member("jobWeight", config.jobWeight);
+    writer.Member("contentStore", config.contentStore);
+    writer.Member("chunkedHistory", config.chunkedHistory);
+    writer.Member("deltaHistory", config.deltaHistory);
+    writer.Member("compressHistory", config.compressHistory);
+    writer.Member("compressionLevel", config.compressionLevel);
+    writer.Member("compressionDictionaries", config.compressionDictionaries);
+    writer.Member("packSmallFiles", config.packSmallFiles);
+    writer.Member("snapshotTrees", config.snapshotTrees);
+    writer.Member("encrypted", false == config.encryptionKeyFile.empty());
+    writer.Member("encryptionAlgorithm", EncryptionAlgorithmName(config.encryptionAlgorithm));
+    writer.End();
+}
+}
+
+std::string FormatBackupReport(const BackupConfig& configuration, const BackupStats& stats, bool success)
+{
+    JsonWriter writer;
+    writer.Begin();
+    writer.Member("success", success);
+    writer.Member("stopped", stats.stopped);
+    WriteStats(writer, stats);
+    WriteConfig(writer, configuration);
+    writer.End();
+    return writer.Text();
+}
@@ -0,0 +1,277 @@
+// file BackupStatsCollector.cpp:
+
+#include "BackupStatsCollector.hpp"
+
+#include "Instrumentation/Probes.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace
+{
+constexpr double NanosecondsPerSecond = 1e9;
+
+/**
+ * @brief Get the nanoseconds between two points of the steady clock.
+ */
+std::uint64_t ElapsedNs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count());
+}
+
+double ToSeconds(std::uint64_t nanoseconds)
+{
+    return static_cast<double>(nanoseconds) / NanosecondsPerSecond;
+}
+}
+
+BackupStatsCollector::BackupStatsCollector(BackupTrace* trace, SlowOperationLog* slowLog, IoTraceLog* ioTrace, ChangeLog* changeLog)
+    : _trace(trace), _slowLog(slowLog), _ioTrace(ioTrace), _changeLog(changeLog), _start(std::chrono::steady_clock::now()), _walkStart(_start), _sqliteBusyRetries(0), _writerEscalated(false), _preScanFiles(0),
+      _preScanBytes(0), _fileSizeHistogram{}, _stopped(false), _walkThreads(0),
+      _hashThreads(0), _copyThreads(0), _scopeBaseline(Instrumentation::Totals())
+{
+}
+
+BackupStatsCollector::ThreadCounters& BackupStatsCollector::Current()
+{
+    std::lock_guard<std::mutex> lock(_countersMutex);
+    std::unique_ptr<ThreadCounters>& counters = _counters[std::this_thread::get_id()];
+    if (nullptr == counters)
+    {
+        counters = std::make_unique<ThreadCounters>();
+        counters->trace = (nullptr != _trace) ? &_trace->Current() : nullptr;
+        counters->slowLog = _slowLog;
+        counters->ioTrace = (nullptr != _ioTrace) ? &_ioTrace->Current() : nullptr;
+        counters->changeLog = (nullptr != _changeLog) ? &_changeLog->Current() : nullptr;
+    }
+    return *counters;
+}
+
+void BackupStatsCollector::MarkBusy(ThreadCounters& counters)
+{
+    if (true == counters.idle)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        Add(counters.queueWaitNs, ElapsedNs(counters.idleSince, now));
+        if (nullptr != counters.trace)
+        {
+            counters.trace->Record("queue_wait", counters.idleSince, now);
+        }
+        counters.idle = false;
+    }
+}
+
+void BackupStatsCollector::MarkIdle(ThreadCounters& counters)
+{
+    counters.idle = true;
+    counters.idleSince = std::chrono::steady_clock::now();
+}
+
+void BackupStatsCollector::BeginWalk(ThreadCounters& counters)
+{
+    _walkStart = std::chrono::steady_clock::now();
+    counters.walking = true;
+    counters.walkWallMark = _walkStart;
+    counters.walkCpuMark = ThreadCpuNs();
+}
+
+void BackupStatsCollector::MarkWalk(ThreadCounters& counters)
+{
+    const auto now = std::chrono::steady_clock::now();
+    const std::uint64_t cpuNow = ThreadCpuNs();
+    // A walker thread's first batch is measured from the start of the walk, and its CPU time from the
+    // start of the thread, which began with the walk.
+    const auto wallMark = (true == counters.walking) ? counters.walkWallMark : _walkStart;
+    const std::uint64_t cpuMark = (true == counters.walking) ? counters.walkCpuMark : 0;
+    constexpr std::size_t Stage = static_cast<std::size_t>(BackupStage::Enumerate);
+    const std::uint64_t wallNs = ElapsedNs(wallMark, now);
+    Add(counters.stageWallNs[Stage], wallNs);
+    RecordLatency(counters, BackupStage::Enumerate, wallNs);
+    Add(counters.stageCpuNs[Stage], (cpuMark < cpuNow) ? (cpuNow - cpuMark) : 0);
+    if (nullptr != counters.trace)
+    {
+        counters.trace->Record(BackupStageToString(BackupStage::Enumerate), wallMark, now);
+    }
+    counters.walking = true;
+    counters.walkWallMark = now;
+    counters.walkCpuMark = cpuNow;
+}
+
+void BackupStatsCollector::SkipWalk(ThreadCounters& counters)
+{
+    counters.walking = true;
+    counters.walkWallMark = std::chrono::steady_clock::now();
+    counters.walkCpuMark = ThreadCpuNs();
+}
+
+void BackupStatsCollector::AddSqliteBusyRetries(std::uint64_t retries)
+{
+    _sqliteBusyRetries.fetch_add(retries, std::memory_order_relaxed);
+}
+
+void BackupStatsCollector::SetWriterEscalated()
+{
+    _writerEscalated.store(true, std::memory_order_relaxed);
+}
+
+void BackupStatsCollector::SetPreScan(std::uint64_t files, std::uint64_t bytes,
+                                      const std::array<std::uint64_t, FileSizeHistogramBuckets>& histogram)
+{
+    _preScanFiles = files;
+    _preScanBytes = bytes;
+    _fileSizeHistogram = histogram;
+}
+
+void BackupStatsCollector::SetStopped()
+{
+    _stopped = true;
+}
+
+void BackupStatsCollector::SetRun(const std::string& timestamp, unsigned int walkThreads, unsigned int hashThreads, unsigned int copyThreads)
+{
+    _runTimestamp = timestamp;
+    _walkThreads = walkThreads;
+    _hashThreads = hashThreads;
+    _copyThreads = copyThreads;
+}
+
+void BackupStatsCollector::SetSnapshot(const std::filesystem::path& snapshotPath)
+{
+    std::lock_guard<std::mutex> lock(_countersMutex);
+    _snapshotPath = snapshotPath;
+}
+
+void BackupStatsCollector::Collect(BackupStats& outputStats)
+{
+    outputStats = BackupStats{};
+    outputStats.stopped = _stopped;
+    outputStats.runTimestamp = _runTimestamp;
+    outputStats.walkThreads = _walkThreads;
+    outputStats.hashThreads = _hashThreads;
+    outputStats.copyThreads = _copyThreads;
+    outputStats.preScanFiles = _preScanFiles;
+    outputStats.preScanBytes = _preScanBytes;
+    outputStats.fileSizeHistogram = _fileSizeHistogram;
+    outputStats.elapsedSeconds = ToSeconds(ElapsedNs(_start, std::chrono::steady_clock::now()));
+    outputStats.sqliteBusyRetries = _sqliteBusyRetries.load(std::memory_order_relaxed);
+    outputStats.writerEscalated = _writerEscalated.load(std::memory_order_relaxed);
+    outputStats.scopes = Instrumentation::Since(_scopeBaseline);
+
+    std::uint64_t queueWaitNs = 0;
+    std::uint64_t enqueueWaitNs = 0;
+    std::array<std::uint64_t, BackupStageCount> wallNs{};
+    std::array<std::uint64_t, BackupStageCount> cpuNs{};
+    // Merged on the heap: a histogram per stage is too large for the stack of every caller.
+    auto latency = std::make_unique<std::array<LatencyHistogram, BackupStageCount>>();
+    std::lock_guard<std::mutex> lock(_countersMutex);
+    outputStats.snapshotPath = _snapshotPath;
+    for (const auto& entry : _counters)
+    {
+        const ThreadCounters& counters = *entry.second;
+        for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+        {
+            wallNs[stage] += counters.stageWallNs[stage].load(std::memory_order_relaxed);
+            cpuNs[stage] += counters.stageCpuNs[stage].load(std::memory_order_relaxed);
+            (*latency)[stage].Merge(counters.stageLatency[stage]);
+        }
+        for (std::size_t changeType = 0; changeType < ChangeTypeCount; ++changeType)
+        {
+            outputStats.filesByChange[changeType] += static_cast<std::size_t>(counters.filesByChange[changeType].load(std::memory_order_relaxed));
+        }
+        outputStats.filesMoved += static_cast<std::size_t>(counters.filesMoved.load(std::memory_order_relaxed));
+        outputStats.filesSampled += static_cast<std::size_t>(counters.filesSampled.load(std::memory_order_relaxed));
+        outputStats.bytesRead += counters.bytesRead.load(std::memory_order_relaxed);
+        outputStats.bytesWritten += counters.bytesWritten.load(std::memory_order_relaxed);
+        outputStats.bytesHashed += counters.bytesHashed.load(std::memory_order_relaxed);
+        queueWaitNs += counters.queueWaitNs.load(std::memory_order_relaxed);
+        enqueueWaitNs += counters.enqueueWaitNs.load(std::memory_order_relaxed);
+    }
+    for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+    {
+        outputStats.stages[stage] = BackupStageTime{ToSeconds(wallNs[stage]), ToSeconds(cpuNs[stage])};
+        const LatencyHistogram& histogram = (*latency)[stage];
+        outputStats.latencies[stage] =
+            BackupLatency{histogram.Count(), ToSeconds(histogram.ValueAtQuantile(0.5)), ToSeconds(histogram.ValueAtQuantile(0.99)),
+                          ToSeconds(histogram.ValueAtQuantile(0.999)), ToSeconds(histogram.Max())};
+    }
+    outputStats.queueWaitSeconds = ToSeconds(queueWaitNs);
+    outputStats.enqueueWaitSeconds = ToSeconds(enqueueWaitNs);
+}
+
+std::uint64_t BackupStatsCollector::ThreadCpuNs()
+{
+#ifdef _WIN32
+    FILETIME creationTime;
+    FILETIME exitTime;
+    FILETIME kernelTime;
+    FILETIME userTime;
+    if (0 == GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+    {
+        return 0;
+    }
+    // FILETIME counts 100 ns intervals.
+    const std::uint64_t kernel = (static_cast<std::uint64_t>(kernelTime.dwHighDateTime) << 32) | kernelTime.dwLowDateTime;
+    const std::uint64_t user = (static_cast<std::uint64_t>(userTime.dwHighDateTime) << 32) | userTime.dwLowDateTime;
+    return (kernel + user) * 100;
+#else
+    timespec now{};
+    if (0 != clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now))
+    {
+        return 0;
+    }
+    return (static_cast<std::uint64_t>(now.tv_sec) * 1000000000ULL) + static_cast<std::uint64_t>(now.tv_nsec);
+#endif
+}
+
+StageTimer::StageTimer(BackupStatsCollector::ThreadCounters* counters, BackupStage stage)
+    : _counters(counters), _stage(stage), _parent(nullptr), _cpuStart(0), _childWallNs(0), _childCpuNs(0)
+{
+    if (nullptr == _counters)
+    {
+        return;
+    }
+    _parent = _counters->activeTimer;
+    _counters->activeTimer = this;
+    RDEMO_PROBE2(stage_begin, BackupStageToString(_stage), (nullptr != _counters->currentFile) ? _counters->currentFile->c_str() : "");
+    Instrumentation::BeginTask(BackupStageToString(_stage));
+    _wallStart = std::chrono::steady_clock::now();
+    _cpuStart = BackupStatsCollector::ThreadCpuNs();
+}
+
+StageTimer::~StageTimer()
+{
+    if (nullptr == _counters)
+    {
+        return;
+    }
+    const auto wallEnd = std::chrono::steady_clock::now();
+    const std::uint64_t wallNs = ElapsedNs(_wallStart, wallEnd);
+    const std::uint64_t cpuNow = BackupStatsCollector::ThreadCpuNs();
+    const std::uint64_t cpuNs = (_cpuStart < cpuNow) ? (cpuNow - _cpuStart) : 0;
+    const std::size_t stage = static_cast<std::size_t>(_stage);
+    const std::uint64_t ownWallNs = (_childWallNs < wallNs) ? (wallNs - _childWallNs) : 0;
+    Instrumentation::EndTask();
+    RDEMO_PROBE3(stage_done, BackupStageToString(_stage), (nullptr != _counters->currentFile) ? _counters->currentFile->c_str() : "", ownWallNs);
+    BackupStatsCollector::Add(_counters->stageWallNs[stage], ownWallNs);
+    BackupStatsCollector::Add(_counters->stageCpuNs[stage], (_childCpuNs < cpuNs) ? (cpuNs - _childCpuNs) : 0);
+    if (nullptr != _parent)
+    {
+        _parent->_childWallNs += wallNs;
+        _parent->_childCpuNs += cpuNs;
+    }
+    _counters->activeTimer = _parent;
+    BackupStatsCollector::RecordLatency(*_counters, _stage, ownWallNs);
+    if (nullptr != _counters->trace)
+    {
+        _counters->trace->Record(BackupStageToString(_stage), _wallStart, wallEnd);
+    }
+}
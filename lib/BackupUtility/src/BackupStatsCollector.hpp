@@ -0,0 +1,400 @@
+// file BackupStatsCollector.hpp:
+
+#pragma once
+
+#include "BackupTrace.hpp"
+#include "BackupUtility/BackupUtility.hpp"
+#include "ChangeLog.hpp"
+#include "IoTraceLog.hpp"
+#include "LatencyHistogram.hpp"
+#include "SlowOperationLog.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class StageTimer;
+
+/**
+ * @brief Collects the measurements of one backup run in per-thread counters.
+ *
+ * Each thread only writes its own counters, with relaxed loads and stores instead of read-modify-write
+ * operations, so counting costs no shared cache lines or locked instructions. Collect sums the counters
+ * once the threads are done. With a trace attached, the same timers also record their spans into
+ * the thread's trace ring. Every timed scope also counts into a per-thread latency histogram of its
+ * stage, merged by Collect, and with a slow operation log attached, scopes above its threshold are
+ * logged with the file the thread is working on. With an I/O trace attached, every trace span is also
+ * recorded there with that file.
+ */
+class BackupStatsCollector
+{
+  public:
+    /**
+     * @brief Counters written by one thread.
+     */
+    struct ThreadCounters
+    {
+        std::array<std::atomic<std::uint64_t>, BackupStageCount> stageWallNs{};  /**< Elapsed time per stage */
+        std::array<std::atomic<std::uint64_t>, BackupStageCount> stageCpuNs{};   /**< Thread CPU time per stage */
+        std::atomic<std::uint64_t> bytesRead{0};                                 /**< Source bytes read */
+        std::atomic<std::uint64_t> bytesWritten{0};                              /**< Bytes of new content written */
+        std::atomic<std::uint64_t> bytesHashed{0};                               /**< Bytes hashed */
+        std::array<std::atomic<std::uint64_t>, ChangeTypeCount> filesByChange{}; /**< Files per ChangeType */
+        std::atomic<std::uint64_t> filesMoved{0};                                /**< Added files that took over a moved backup copy */
+        std::atomic<std::uint64_t> filesSampled{0};                              /**< Files confirmed by a sampled check */
+        std::atomic<std::uint64_t> queueWaitNs{0};                               /**< Time between files of a worker */
+        std::atomic<std::uint64_t> enqueueWaitNs{0};                             /**< Time blocked handing files on */
+        std::array<LatencyHistogram, BackupStageCount> stageLatency;             /**< Durations of the timed scopes per stage */
+
+        StageTimer* activeTimer = nullptr;                                       /**< Innermost running timer of the thread */
+        bool idle = false;                                                       /**< The thread finished a file and waits for the next */
+        std::chrono::steady_clock::time_point idleSince;                         /**< When the thread finished its last file */
+        bool walking = false;                                                    /**< walkWallMark and walkCpuMark are set */
+        std::chrono::steady_clock::time_point walkWallMark;                      /**< Start of the walk segment being measured */
+        std::uint64_t walkCpuMark = 0;                                           /**< Thread CPU time at walkWallMark */
+        BackupTrace::ThreadTrace* trace = nullptr;                               /**< Trace ring of the thread, nullptr without tracing */
+        SlowOperationLog* slowLog = nullptr;                                     /**< Log of slow operations, nullptr without one */
+        IoTraceLog::ThreadLog* ioTrace = nullptr;                                /**< I/O trace buffer of the thread, nullptr without an I/O trace */
+        ChangeLog::ThreadBuffer* changeLog = nullptr;                            /**< Change log buffer of the thread, nullptr without a change log */
+        const std::filesystem::path* currentFile = nullptr;                      /**< Source file the thread works on, nullptr between files */
+    };
+
+    /**
+     * @brief Construct a collector.
+     *
+     * @param[in,out] trace Trace the timers also record spans into, nullptr records none
+     * @param[in,out] slowLog Log the timers write slow operations to, nullptr logs none
+     * @param[in,out] ioTrace I/O trace the trace spans are also recorded into, nullptr records none
+     * @param[in,out] changeLog Log the changed paths are listed in, nullptr lists none
+     */
+    explicit BackupStatsCollector(BackupTrace* trace = nullptr, SlowOperationLog* slowLog = nullptr, IoTraceLog* ioTrace = nullptr,
+                                  ChangeLog* changeLog = nullptr);
+
+    BackupStatsCollector(const BackupStatsCollector&) = delete;
+    BackupStatsCollector& operator=(const BackupStatsCollector&) = delete;
+
+    /**
+     * @brief Get the counters of the calling thread, creating them on first use.
+     *
+     * Looking them up takes a lock, so callers fetch them once per file or per batch.
+     *
+     * @return Counters only written by the calling thread
+     */
+    ThreadCounters& Current();
+
+    /**
+     * @brief Add a count to a counter of the calling thread.
+     *
+     * @param[in,out] counter Counter owned by the calling thread
+     * @param[in] amount Amount to add
+     */
+    static void Add(std::atomic<std::uint64_t>& counter, std::uint64_t amount)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Count the duration of a timed scope and log it if it is slow.
+     *
+     * @param[in,out] counters Counters of the calling thread
+     * @param[in] stage Stage the scope belongs to
+     * @param[in] durationNs Time of the scope in nanoseconds
+     */
+    static void RecordLatency(ThreadCounters& counters, BackupStage stage, std::uint64_t durationNs)
+    {
+        counters.stageLatency[static_cast<std::size_t>(stage)].Record(durationNs);
+        if ((nullptr != counters.slowLog) && (true == counters.slowLog->IsSlow(durationNs)))
+        {
+            counters.slowLog->Record(BackupStageToString(stage), counters.currentFile, durationNs);
+        }
+    }
+
+    /**
+     * @brief Note that a worker starts on a file; the time since it finished its last file counts as queue wait.
+     *
+     * @param[in,out] counters Counters of the calling thread
+     */
+    static void MarkBusy(ThreadCounters& counters);
+
+    /**
+     * @brief Note that a worker finished a file.
+     *
+     * @param[in,out] counters Counters of the calling thread
+     */
+    static void MarkIdle(ThreadCounters& counters);
+
+    /**
+     * @brief Start measuring the walk on the calling thread.
+     *
+     * Walker threads that report batches without calling this are measured from the same moment.
+     *
+     * @param[in,out] counters Counters of the calling thread
+     */
+    void BeginWalk(ThreadCounters& counters);
+
+    /**
+     * @brief Add the walk time since the last mark of the calling thread, then mark again.
+     *
+     * Called when a walker thread hands over a batch and when the walk ends.
+     *
+     * @param[in,out] counters Counters of the calling thread
+     */
+    void MarkWalk(ThreadCounters& counters);
+
+    /**
+     * @brief Restart the walk measurement of the calling thread without counting the time since the last mark.
+     *
+     * Called when a walker thread returns from handing over a batch, which is counted as enqueue wait.
+     *
+     * @param[in,out] counters Counters of the calling thread
+     */
+    static void SkipWalk(ThreadCounters& counters);
+
+    /**
+     * @brief Add retries of locked databases.
+     *
+     * @param[in] retries Busy handler retries
+     */
+    void AddSqliteBusyRetries(std::uint64_t retries);
+
+    /**
+     * @brief Record that contention made the run switch to a single writer thread; thread-safe.
+     */
+    void SetWriterEscalated();
+
+    /**
+     * @brief Record the counts of a finished pre-scan.
+     *
+     * @param[in] files Files found
+     * @param[in] bytes Their total size
+     * @param[in] histogram File sizes bucketed as described at FileSizeHistogramBuckets
+     */
+    void SetPreScan(std::uint64_t files, std::uint64_t bytes, const std::array<std::uint64_t, FileSizeHistogramBuckets>& histogram);
+
+    /**
+     * @brief Record that the run was stopped early.
+     */
+    void SetStopped();
+
+    /**
+     * @brief Record the timestamp of the run and the threads it uses.
+     *
+     * @param[in] timestamp Timestamp naming the run's snapshot directories
+     * @param[in] walkThreads Threads listing directories
+     * @param[in] hashThreads Read/hash worker threads, the most an adaptive run may use
+     * @param[in] copyThreads Copy stage threads, 0 when the read/hash workers copy
+     */
+    void SetRun(const std::string& timestamp, unsigned int walkThreads, unsigned int hashThreads, unsigned int copyThreads);
+
+    /**
+     * @brief Record the snapshot directory the run created; thread-safe.
+     *
+     * @param[in] snapshotPath Snapshot directory
+     */
+    void SetSnapshot(const std::filesystem::path& snapshotPath);
+
+    /**
+     * @brief Sum the counters of all threads.
+     *
+     * Complete once the threads that count have stopped. During a run it returns a snapshot of the
+     * counters, which is how a server samples running sessions; SetPreScan and SetStopped must not run
+     * at the same time.
+     *
+     * @param[out] outputStats Summed measurements; the elapsed time runs from construction to this call
+     */
+    void Collect(BackupStats& outputStats);
+
+    /**
+     * @brief Get the CPU time used by the calling thread.
+     *
+     * @return Thread CPU time in nanoseconds, 0 where unavailable
+     */
+    static std::uint64_t ThreadCpuNs();
+
+  private:
+    BackupTrace* _trace;
+    SlowOperationLog* _slowLog;
+    IoTraceLog* _ioTrace;
+    ChangeLog* _changeLog;
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _walkStart;
+    std::atomic<std::uint64_t> _sqliteBusyRetries;
+    std::atomic<bool> _writerEscalated;
+    std::uint64_t _preScanFiles;
+    std::uint64_t _preScanBytes;
+    std::array<std::uint64_t, FileSizeHistogramBuckets> _fileSizeHistogram;
+    bool _stopped;
+    std::string _runTimestamp;
+    unsigned int _walkThreads;
+    unsigned int _hashThreads;
+    unsigned int _copyThreads;
+    std::vector<InstrumentationTotal> _scopeBaseline; /**< Instrumentation totals at construction, so a run reports only its own */
+    std::mutex _countersMutex;
+    std::filesystem::path _snapshotPath;
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadCounters>> _counters;
+};
+
+/**
+ * @brief Adds the time of a scope to one stage of the calling thread.
+ *
+ * Timers nest: time spent in an inner timer is taken off the outer one, so it counts for one stage only.
+ * Without counters the timer does nothing, which is how RunBackup without stats skips the clock reads.
+ */
+class StageTimer
+{
+  public:
+    /**
+     * @brief Start timing.
+     *
+     * @param[in,out] counters Counters of the calling thread, nullptr disables the timer
+     * @param[in] stage Stage the time counts for
+     */
+    StageTimer(BackupStatsCollector::ThreadCounters* counters, BackupStage stage);
+
+    ~StageTimer();
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+  private:
+    BackupStatsCollector::ThreadCounters* _counters;
+    BackupStage _stage;
+    StageTimer* _parent;
+    std::chrono::steady_clock::time_point _wallStart;
+    std::uint64_t _cpuStart;
+    std::uint64_t _childWallNs;
+    std::uint64_t _childCpuNs;
+};
+
+/**
+ * @brief Names the source file the calling thread works on for the slow operation log, for the length of a scope.
+ */
+class FileScope
+{
+  public:
+    /**
+     * @brief Set the file.
+     *
+     * @param[in,out] counters Counters of the calling thread, nullptr disables the scope
+     * @param[in] file Source file; must outlive the scope
+     */
+    FileScope(BackupStatsCollector::ThreadCounters* counters, const std::filesystem::path& file)
+        : _counters(counters), _previous((nullptr != counters) ? counters->currentFile : nullptr)
+    {
+        if (nullptr != _counters)
+        {
+            _counters->currentFile = &file;
+        }
+    }
+
+    ~FileScope()
+    {
+        if (nullptr != _counters)
+        {
+            _counters->currentFile = _previous;
+        }
+    }
+
+    FileScope(const FileScope&) = delete;
+    FileScope& operator=(const FileScope&) = delete;
+
+  private:
+    BackupStatsCollector::ThreadCounters* _counters;
+    const std::filesystem::path* _previous;
+};
+
+/**
+ * @brief Adds the time of a scope to the enqueue wait of the calling thread.
+ */
+class WaitTimer
+{
+  public:
+    /**
+     * @brief Start timing.
+     *
+     * @param[in,out] counters Counters of the calling thread, nullptr disables the timer
+     */
+    explicit WaitTimer(BackupStatsCollector::ThreadCounters* counters)
+        : _counters(counters), _start((nullptr != counters) ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+    {
+    }
+
+    ~WaitTimer()
+    {
+        if (nullptr != _counters)
+        {
+            const auto end = std::chrono::steady_clock::now();
+            BackupStatsCollector::Add(_counters->enqueueWaitNs,
+                                      static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - _start).count()));
+            if (nullptr != _counters->trace)
+            {
+                _counters->trace->Record("enqueue_wait", _start, end);
+            }
+        }
+    }
+
+    WaitTimer(const WaitTimer&) = delete;
+    WaitTimer& operator=(const WaitTimer&) = delete;
+
+  private:
+    BackupStatsCollector::ThreadCounters* _counters;
+    std::chrono::steady_clock::time_point _start;
+};
+
+/**
+ * @brief Records a scope as a trace event of the calling thread, without counting it for any stage.
+ *
+ * Used for the individual operations inside a stage, such as hashing or copying one file. The I/O trace
+ * gets the span too, with the file the thread works on.
+ */
+class TraceSpan
+{
+  public:
+    /**
+     * @brief Start the span.
+     *
+     * @param[in] counters Counters of the calling thread, nullptr or counters without a trace or I/O trace disable the span
+     * @param[in] name Static event name
+     */
+    TraceSpan(const BackupStatsCollector::ThreadCounters* counters, const char* name)
+        : _trace((nullptr != counters) ? counters->trace : nullptr), _ioTrace((nullptr != counters) ? counters->ioTrace : nullptr),
+          _file((nullptr != counters) ? counters->currentFile : nullptr), _name(name),
+          _start(((nullptr != _trace) || (nullptr != _ioTrace)) ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if ((nullptr == _trace) && (nullptr == _ioTrace))
+        {
+            return;
+        }
+        const auto end = std::chrono::steady_clock::now();
+        if (nullptr != _trace)
+        {
+            _trace->Record(_name, _start, end);
+        }
+        if (nullptr != _ioTrace)
+        {
+            _ioTrace->Record(_name, _file, _start, end);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+  private:
+    BackupTrace::ThreadTrace* _trace;
+    IoTraceLog::ThreadLog* _ioTrace;
+    const std::filesystem::path* _file;
+    const char* _name;
+    std::chrono::steady_clock::time_point _start;
+};
@@ -0,0 +1,93 @@
+// file BackupTrace.cpp:
+
+#include "BackupTrace.hpp"
+
+#include "Instrumentation/Instrumentation.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace
+{
+constexpr double NanosecondsPerMicrosecond = 1000.0;
+constexpr int TraceProcessId = 1;
+constexpr int InstrumentationProcessId = 2; /**< RDEMO_SCOPE spans, whose thread numbers are those of the instrumentation buffers */
+}
+
+BackupTrace::ThreadTrace::ThreadTrace(std::size_t threadIndex, std::size_t capacity)
+    : _threadIndex(threadIndex), _events(std::max<std::size_t>(1, capacity)), _recorded(0)
+{
+}
+
+BackupTrace::BackupTrace(std::size_t eventsPerThread) : _start(std::chrono::steady_clock::now()), _eventsPerThread(eventsPerThread)
+{
+}
+
+BackupTrace::ThreadTrace& BackupTrace::Current()
+{
+    std::lock_guard<std::mutex> lock(_threadsMutex);
+    std::unique_ptr<ThreadTrace>& thread = _threads[std::this_thread::get_id()];
+    if (nullptr == thread)
+    {
+        // The map already holds the new entry, so the first thread is numbered 1.
+        thread = std::make_unique<ThreadTrace>(_threads.size(), _eventsPerThread);
+    }
+    return *thread;
+}
+
+bool BackupTrace::Write(const std::filesystem::path& traceFile)
+{
+    std::ofstream outputStream(traceFile, std::ios::trunc);
+    if (false == outputStream.is_open())
+    {
+        return false;
+    }
+
+    const auto originNs = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(_start.time_since_epoch()).count());
+    std::lock_guard<std::mutex> lock(_threadsMutex);
+    std::vector<const ThreadTrace*> threads;
+    threads.reserve(_threads.size());
+    for (const auto& entry : _threads)
+    {
+        threads.push_back(entry.second.get());
+    }
+    std::sort(threads.begin(), threads.end(), [](const ThreadTrace* left, const ThreadTrace* right) { return left->_threadIndex < right->_threadIndex; });
+
+    outputStream << std::fixed << std::setprecision(3);
+    outputStream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const ThreadTrace* thread : threads)
+    {
+        outputStream << ((true == first) ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << TraceProcessId
+                     << ",\"tid\":" << thread->_threadIndex << ",\"args\":{\"name\":\"thread " << thread->_threadIndex << "\"}}";
+        first = false;
+
+        // Oldest first: once the ring wrapped, the slot after the newest event holds the oldest one.
+        const std::uint64_t capacity = thread->_events.size();
+        const std::uint64_t kept = std::min(thread->_recorded, capacity);
+        for (std::uint64_t i = thread->_recorded - kept; i < thread->_recorded; ++i)
+        {
+            const Event& event = thread->_events[static_cast<std::size_t>(i % capacity)];
+            const std::uint64_t relativeNs = (originNs < event.startNs) ? (event.startNs - originNs) : 0;
+            outputStream << ",\n{\"ph\":\"X\",\"name\":\"" << event.name << "\",\"pid\":" << TraceProcessId << ",\"tid\":" << thread->_threadIndex
+                         << ",\"ts\":" << (static_cast<double>(relativeNs) / NanosecondsPerMicrosecond)
+                         << ",\"dur\":" << (static_cast<double>(event.durationNs) / NanosecondsPerMicrosecond) << "}";
+        }
+    }
+    const std::vector<InstrumentationSpan> spans = Instrumentation::Spans(originNs);
+    if (false == spans.empty())
+    {
+        outputStream << ((true == first) ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << InstrumentationProcessId
+                     << ",\"args\":{\"name\":\"RDEMO_SCOPE\"}}";
+        first = false;
+    }
+    for (const InstrumentationSpan& span : spans)
+    {
+        outputStream << ",\n{\"ph\":\"X\",\"name\":\"" << span.name << "\",\"pid\":" << InstrumentationProcessId << ",\"tid\":" << span.threadIndex
+                     << ",\"ts\":" << (static_cast<double>(span.startNs - originNs) / NanosecondsPerMicrosecond)
+                     << ",\"dur\":" << (static_cast<double>(span.durationNs) / NanosecondsPerMicrosecond) << "}";
+    }
+    outputStream << "\n]}\n";
+    return static_cast<bool>(outputStream.flush());
+}
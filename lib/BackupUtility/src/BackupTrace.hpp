@@ -0,0 +1,107 @@
+// file BackupTrace.hpp:
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Records timed events of a backup run per thread and writes them in Chrome trace-event format.
+ *
+ * Every thread records into its own fixed-size ring, written only by that thread, so recording takes no
+ * lock and no atomic operation. When a ring is full the oldest events are overwritten. The rings are read
+ * once the recording threads have stopped; the resulting file opens in chrome://tracing and Perfetto.
+ */
+class BackupTrace
+{
+  public:
+    /**
+     * @brief One completed span.
+     */
+    struct Event
+    {
+        const char* name;         /**< Static event name */
+        std::uint64_t startNs;    /**< Start on the steady clock */
+        std::uint64_t durationNs; /**< Length of the span */
+    };
+
+    /**
+     * @brief Ring of the events recorded by one thread.
+     */
+    class ThreadTrace
+    {
+      public:
+        /**
+         * @brief Construct an empty ring.
+         *
+         * @param[in] threadIndex Number the thread is shown under
+         * @param[in] capacity Events kept, at least 1
+         */
+        ThreadTrace(std::size_t threadIndex, std::size_t capacity);
+
+        /**
+         * @brief Record a span, overwriting the oldest event when the ring is full.
+         *
+         * @param[in] name Static event name
+         * @param[in] start Start of the span
+         * @param[in] end End of the span
+         */
+        void Record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+        {
+            const auto startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+            const auto durationNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            _events[_recorded % _events.size()] = Event{name, static_cast<std::uint64_t>(startNs), static_cast<std::uint64_t>(durationNs)};
+            ++_recorded;
+        }
+
+      private:
+        friend class BackupTrace;
+
+        std::size_t _threadIndex;
+        std::vector<Event> _events;
+        std::uint64_t _recorded;
+    };
+
+    /**
+     * @brief Construct a trace.
+     *
+     * @param[in] eventsPerThread Events kept per thread before the oldest are overwritten
+     */
+    explicit BackupTrace(std::size_t eventsPerThread);
+
+    BackupTrace(const BackupTrace&) = delete;
+    BackupTrace& operator=(const BackupTrace&) = delete;
+
+    /**
+     * @brief Get the ring of the calling thread, creating it on first use.
+     *
+     * Looking it up takes a lock, so callers fetch it once per thread.
+     *
+     * @return Ring only written by the calling thread
+     */
+    ThreadTrace& Current();
+
+    /**
+     * @brief Write all recorded events as a Chrome trace-event JSON file.
+     *
+     * Only valid once the recording threads have stopped. Times are relative to the construction of the trace.
+     * RDEMO_SCOPE spans recorded since then, if built with RDEMO_INSTRUMENTATION, follow as a second process.
+     *
+     * @param[in] traceFile File to write
+     * @return true on success, false if the file could not be written
+     */
+    bool Write(const std::filesystem::path& traceFile);
+
+  private:
+    std::chrono::steady_clock::time_point _start;
+    std::size_t _eventsPerThread;
+    std::mutex _threadsMutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadTrace>> _threads;
+};
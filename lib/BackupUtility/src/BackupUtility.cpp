@@ -1,91 +1,3112 @@
 // file BackupUtility.cpp
 #include "BackupUtility/BackupUtility.hpp"
 
+#include "BackupMetrics.hpp"
+#include "BackupPreScan.hpp"
+#include "BackupStatsCollector.hpp"
+#include "BackupTrace.hpp"
+#include "ChangeJournal.hpp"
+#include "ChangeJournalWatcher.hpp"
+#include "ChunkStore.hpp"
+#include "CompressionDictionaryStore.hpp"
+#include "ContentObjectStore.hpp"
+#include "CopyCheckpointStore.hpp"
+#include "DatabaseMaintenance.hpp"
+#include "DeltaChainConsolidator.hpp"
+#include "DigestAttributeCache.hpp"
+#include "DirectoryCompletionTracker.hpp"
+#include "DirectoryStateMerger.hpp"
+#include "DurabilityBarrier.hpp"
+#include "EncryptedStorageBackend.hpp"
+#include "ExportStream.hpp"
+#include "FileDelta.hpp"
+#include "FileStateBatchWriter.hpp"
+#include "FileStateIndex.hpp"
+#include "FileStatePrefetch.hpp"
 #include "FileStateRepository.hpp"
+#include "FileStateAccess.hpp"
+#include "HashCache.hpp"
+#include "HistoryMountView.hpp"
+#include "IoTraceLog.hpp"
+#include "KnownPathFilter.hpp"
+#include "LiveStatusSegment.hpp"
+#include "MoveDetector.hpp"
+#include "PackStore.hpp"
+#include "PackWriterThread.hpp"
+#include "ParityFile.hpp"
+#include "PartitionCatalog.hpp"
+#include "PartitionPlan.hpp"
+#include "PreviewBackupFile.hpp"
+#include "PipelineStage.hpp"
 #include "ProcessBackupFile.hpp"
 #include "ProcessDeletedFiles.hpp"
+#include "ProcessHashManifestFile.hpp"
+#include "ProcessImportFile.hpp"
+#include "ProcessRestoreFile.hpp"
+#include "ProcessVerifyFile.hpp"
+#include "ProgressReporter.hpp"
+#include "ReadaheadPrefetcher.hpp"
+#include "RelativePathBuilder.hpp"
+#include "RemoteBackupClient.hpp"
+#include "RemoteBackupServer.hpp"
+#include "RestoreMetadataApplier.hpp"
+#include "RestorePlanner.hpp"
+#include "RunDeadline.hpp"
+#include "RunHistoryLog.hpp"
+#include "SlowOperationLog.hpp"
+#include "SnapshotChangeList.hpp"
+#include "SnapshotPruner.hpp"
+#include "SnapshotTierMover.hpp"
+#include "SnapshotTreeBuilder.hpp"
+#include "StoreReplicator.hpp"
+#include "StateDatabaseCopy.hpp"
+#include "StateSnapshotFile.hpp"
+#include "StateTreeDiff.hpp"
+#include "TarExporter.hpp"
+#include "TarReader.hpp"
+#include "ThrottleControlFile.hpp"
+#include "TrashQueue.hpp"
+#include "VerifySchedule.hpp"
+#include "WalkAhead.hpp"
+#ifdef RDEMO_HAVE_FUSE
+#include "FuseMount.hpp"
+#endif
 
+#include "FileCopier/DirectoryCache.hpp"
+#include "FileCopier/FileCopier.hpp"
 #include "FileHasher/FileHasher.hpp"
 #include "FileIterator/FileIterator.hpp"
+#include "FileIterator/FileMetadata.hpp"
+#include "FileIterator/PathFilter.hpp"
+#include "IoThrottle/IoThrottle.hpp"
 #include "SnapshotDirectoryProvider/SnapshotDirectoryProvider.hpp"
+#include "SQLite/SQLiteMemoryLimit.hpp"
 #include "SQLite/SQLiteSession.hpp"
 #include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+#include "TimestampProvider/RunContext.hpp"
 #include "TimestampProvider/TimestampProvider.hpp"
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cctype>
+#include <cstdio>
+#include <ctime>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <set>
+#include <stdexcept>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace
 {
 constexpr unsigned int MaxQueueSizeMultiplier = 4;
 constexpr unsigned int MinWorkerThreadCount = 1;
+constexpr unsigned int DeepQueueSizeMultiplier = 8;
+constexpr unsigned int MaxNetworkHashThreads = 64;
+constexpr std::size_t QueuedFileBytes = sizeof(FileWorkItem) + 256;
+constexpr std::size_t QueuedPlanBytes = 1024;
+constexpr std::size_t SnapshotDateLength = 10;
+constexpr std::int64_t DaysPerWeek = 7;
+constexpr std::int64_t EpochDaysAfterMonday = 3;
+constexpr std::time_t SecondsPerDay = 24 * 60 * 60;
+constexpr const char* PartitionsDirectory = "partitions";
+constexpr const char* PartitionPlanFile = "plan";
+constexpr const char* PartitionCatalogFile = "catalog.db";
+constexpr std::uint64_t PartitionFileCostBytes = 64 * 1024;
+constexpr std::size_t WalkAheadFiles = 64 * 1024;
+
+/**
+ * @brief Concrete thread counts and queue depths of the read/hash and copy stages.
+ */
+struct PipelineSizing
+{
+    unsigned int hashThreads;   /**< Read/hash stage threads, the active ones at the start when adaptive */
+    std::size_t hashQueueDepth; /**< Files queued ahead of the read/hash stage */
+    unsigned int maxHashThreads; /**< Read/hash threads started, above hashThreads only when adaptive */
+    unsigned int copyThreads;   /**< Copy stage threads, 0 copies on the hash threads */
+    std::size_t copyQueueDepth; /**< Files queued ahead of the copy stage */
+};
+
+/**
+ * @brief Get the path of the state snapshot file kept next to a state database.
+ *
+ * @param[in] databaseFile State database
+ * @return Snapshot file path
+ */
+std::filesystem::path StateSnapshotPath(const std::filesystem::path& databaseFile)
+{
+    std::filesystem::path snapshotPath = databaseFile;
+    snapshotPath += ".state";
+    return snapshotPath;
+}
+
+/**
+ * @brief Add the live files of a state database to the cost of the top-level entries they are below.
+ *
+ * @param[in] databaseFile Existing state database
+ * @param[in,out] costs Files and bytes per top-level entry name
+ * @return true on success, false if the database cannot be read
+ */
+bool AccumulateEntryCosts(const std::filesystem::path& databaseFile, std::map<std::string, PartitionEntryCost>& costs)
+{
+    SQLiteSession databaseSession(databaseFile);
+    FileStateRepository fileStateRepository(databaseSession);
+    if (false == fileStateRepository.InitializeSchema())
+    {
+        return false;
+    }
+    return fileStateRepository.ForEachFileState(
+        [&costs](const std::string& filePath, const FileStateRecord& record)
+        {
+            if (ChangeType::Deleted != record.status)
+            {
+                PartitionEntryCost& cost = costs[filePath.substr(0, filePath.find('/'))];
+                ++cost.files;
+                cost.bytes += record.metadata.size;
+            }
+            return true;
+        });
+}
+
+/**
+ * @brief Get the weight a partition plan gives a top-level entry.
+ *
+ * @param[in] cost Files and bytes below the entry
+ * @return Bytes plus a fixed charge per file for the lookups and commits it costs whatever its size
+ */
+std::uint64_t EntryWeight(const PartitionEntryCost& cost)
+{
+    return cost.bytes + cost.files * PartitionFileCostBytes;
+}
+
+/**
+ * @brief Get the reads in flight per hashing thread with the io_uring engine.
+ *
+ * @param[in] config Backup configuration
+ * @return Read queue depth, the hasher's default when none is set
+ */
+unsigned int ResolveReadQueueDepth(const BackupConfig& config)
+{
+    return (0 != config.readQueueDepth) ? config.readQueueDepth : FileHasher::DefaultReadQueueDepth;
+}
+
+/**
+ * @brief Resolve the stage sizes from the device class defaults and the explicit overrides.
+ *
+ * @param[in] config Backup configuration
+ * @return Stage sizes
+ */
+PipelineSizing ResolvePipelineSizing(const BackupConfig& config)
+{
+    const unsigned int cores = std::max(MinWorkerThreadCount, std::thread::hardware_concurrency());
+    const unsigned int networkThreads = std::min(MaxNetworkHashThreads, cores * 4);
+    PipelineSizing sizing{cores, cores * MaxQueueSizeMultiplier, 0, 0, 0};
+    switch (config.deviceClass)
+    {
+    case DeviceClass::Default:
+        break;
+    case DeviceClass::Hdd:
+        sizing = PipelineSizing{2, 32, 0, 1, 16};
+        break;
+    case DeviceClass::Ssd:
+        sizing = PipelineSizing{cores, cores * MaxQueueSizeMultiplier, 0, std::max(2u, cores / 2), 64};
+        break;
+    case DeviceClass::Nvme:
+        sizing = PipelineSizing{cores * 2, cores * 2 * DeepQueueSizeMultiplier, 0, cores, 256};
+        break;
+    case DeviceClass::Network:
+        sizing = PipelineSizing{networkThreads, networkThreads * MaxQueueSizeMultiplier, 0, 8, 128};
+        break;
+    }
+
+    if (0 != config.hashThreads)
+    {
+        sizing.hashThreads = config.hashThreads;
+    }
+    if (0 != config.hashQueueDepth)
+    {
+        sizing.hashQueueDepth = config.hashQueueDepth;
+    }
+    if (0 != config.copyThreads)
+    {
+        sizing.copyThreads = config.copyThreads;
+    }
+    if (0 != config.copyQueueDepth)
+    {
+        sizing.copyQueueDepth = config.copyQueueDepth;
+    }
+    sizing.maxHashThreads = sizing.hashThreads;
+    if (true == config.adaptiveThreads)
+    {
+        // The controller climbs between one thread and the ceiling, so queue depth follows the ceiling.
+        const unsigned int ceiling = (0 != config.maxAdaptiveThreads) ? config.maxAdaptiveThreads : networkThreads;
+        sizing.maxHashThreads = std::max(sizing.hashThreads, ceiling);
+        if (0 == config.hashQueueDepth)
+        {
+            sizing.hashQueueDepth = std::max(sizing.hashQueueDepth, static_cast<std::size_t>(sizing.maxHashThreads) * MaxQueueSizeMultiplier);
+        }
+    }
+    if ((true == FileHasher::HashesConcurrently(config.readEngine)) && (0 == config.hashQueueDepth))
+    {
+        // Each worker takes up to a whole ring's worth of files at once, so the queue has to hold that many.
+        sizing.hashQueueDepth = std::max(sizing.hashQueueDepth, static_cast<std::size_t>(sizing.maxHashThreads) * ResolveReadQueueDepth(config));
+    }
+    if ((0 != sizing.copyThreads) && (0 == sizing.copyQueueDepth))
+    {
+        sizing.copyQueueDepth = static_cast<std::size_t>(sizing.copyThreads) * MaxQueueSizeMultiplier;
+    }
+    return sizing;
+}
+
+/**
+ * @brief Shares of a memory limit given to the consumers that grow with the tree or the thread count.
+ */
+struct MemoryBudget
+{
+    std::size_t stateIndexBytes; /**< Preloaded file states */
+    std::uint64_t databaseBytes; /**< SQLite page caches of all connections */
+    std::size_t readBufferBytes; /**< Read buffers of all hashing threads */
+    std::size_t queueBytes;      /**< Files and plans queued ahead of the read/hash and copy stages */
+};
+
+/**
+ * @brief Split a memory limit and shrink the stage sizes, buffers and index cap to fit it.
+ *
+ * Each consumer is only ever made smaller: explicit settings below their share are kept, queues keep at
+ * least one entry per worker and read buffers at least one read block, so a tight limit slows the run
+ * down instead of failing it.
+ *
+ * @param[in] memoryLimit Total budget in bytes, 0 leaves everything as configured
+ * @param[in,out] sizing Stage sizes whose queue depths are capped
+ * @param[in,out] hashBufferSize Per-thread read buffer size that is capped
+ * @param[in,out] stateIndexMemoryLimit State index cap that is lowered; 0 stays disabled
+ * @return Budget shares, all 0 when memoryLimit is 0
+ */
+MemoryBudget ApplyMemoryLimit(std::uint64_t memoryLimit, PipelineSizing& sizing, std::size_t& hashBufferSize, std::size_t& stateIndexMemoryLimit)
+{
+    // Half for the state index, which grows with the tree; the rest for the caches, buffers and queues.
+    const std::size_t limit = static_cast<std::size_t>(std::min<std::uint64_t>(memoryLimit, std::numeric_limits<std::size_t>::max()));
+    const MemoryBudget budget{limit / 2, limit / 4, limit / 8, limit / 8};
+    if (0 == limit)
+    {
+        return budget;
+    }
+
+    if (0 != stateIndexMemoryLimit)
+    {
+        stateIndexMemoryLimit = std::min(stateIndexMemoryLimit, budget.stateIndexBytes);
+    }
+
+    const std::size_t perThreadBuffer = budget.readBufferBytes / std::max(1u, sizing.maxHashThreads);
+    hashBufferSize = std::min(hashBufferSize, std::max(perThreadBuffer, FileHasher::ReadBlockSize));
+
+    // Without a copy stage the whole queue share goes to the read/hash stage.
+    const std::size_t copyQueueBytes = (0 != sizing.copyThreads) ? budget.queueBytes / 2 : 0;
+    const std::size_t hashQueueBytes = budget.queueBytes - copyQueueBytes;
+    sizing.hashQueueDepth = std::min(sizing.hashQueueDepth, std::max<std::size_t>(hashQueueBytes / QueuedFileBytes, sizing.maxHashThreads));
+    if (0 != sizing.copyThreads)
+    {
+        sizing.copyQueueDepth = std::min(sizing.copyQueueDepth, std::max<std::size_t>(copyQueueBytes / QueuedPlanBytes, sizing.copyThreads));
+    }
+    return budget;
+}
+
+/**
+ * @brief Check whether the change journal holds every change since the previous run started.
+ *
+ * @param[in] state Journal state read at the start of the run
+ * @param[in] reconcileRuns Journal runs allowed between two full walks
+ * @return true if the run may visit only the journaled directories
+ */
+bool CanRunFromJournal(const ChangeJournalState& state, unsigned int reconcileRuns)
+{
+    return (true == ChangeJournal::IsWatcherLive(state)) && (0 != state.coveredSession) && (state.session == state.coveredSession) &&
+           (state.overflows == state.coveredOverflows) && (static_cast<std::int64_t>(reconcileRuns) > state.journalRuns);
+}
+
+/**
+ * @brief Turn a journal key into the `/`-separated form path filters match.
+ *
+ * @param[in] key Key relative to the source directory, with native separators
+ * @return Key with `/` separators
+ */
+std::string MakeFilterPath(std::string key)
+{
+    std::replace(key.begin(), key.end(), static_cast<char>(std::filesystem::path::preferred_separator), '/');
+    return key;
+}
+
+/**
+ * @brief Turn journal entries into the directories a run lists, each at most once.
+ *
+ * A directory that no longer exists lost its whole subtree, and a directory below a recursive entry is
+ * listed by that entry's walk already.
+ *
+ * @param[in] sourceDir Source directory the journal keys are relative to
+ * @param[in,out] directories Journal entries, replaced by the directories to list
+ */
+void NormalizeChangedDirectories(const std::filesystem::path& sourceDir, std::vector<ChangedDirectory>& directories)
+{
+    constexpr char KeySeparator = static_cast<char>(std::filesystem::path::preferred_separator);
+    std::unordered_set<std::string> recursiveKeys;
+    for (auto& directory : directories)
+    {
+        std::error_code ec;
+        const std::filesystem::path location = (true == directory.path.empty()) ? sourceDir : sourceDir / directory.path;
+        directory.recursive = (true == directory.recursive) || (false == std::filesystem::is_directory(std::filesystem::symlink_status(location, ec)));
+        if (true == directory.recursive)
+        {
+            recursiveKeys.insert(directory.path);
+        }
+    }
+    auto coveredByAncestor = [&recursiveKeys](const std::string& key)
+    {
+        if (true == key.empty())
+        {
+            return false;
+        }
+        if (0 != recursiveKeys.count(std::string()))
+        {
+            return true;
+        }
+        for (std::size_t separator = key.find_last_of(KeySeparator); (std::string::npos != separator) && (0 != separator);
+             separator = key.find_last_of(KeySeparator, separator - 1))
+        {
+            if (0 != recursiveKeys.count(key.substr(0, separator)))
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+    directories.erase(std::remove_if(directories.begin(), directories.end(),
+                                     [&](const ChangedDirectory& directory) { return coveredByAncestor(directory.path); }),
+                      directories.end());
+}
+
+/**
+ * @brief Resolve the sources of a multi-root run into named roots.
+ *
+ * Names are the first key component of each root's files, so they must be distinct plain names, and a
+ * root must not lie inside another, which would key its files twice.
+ *
+ * @param[in] sources Sources of the run
+ * @param[out] outputRoots Roots with their names, in the order of the sources
+ * @return true on success, false if a source is not a directory or the roots collide
+ */
+bool ResolveSourceRoots(const std::vector<BackupSource>& sources, std::vector<NamedSourceRoot>& outputRoots)
+{
+    outputRoots.clear();
+    std::vector<std::filesystem::path> canonicalRoots;
+    std::unordered_set<std::string> names;
+    for (const auto& source : sources)
+    {
+        std::error_code ec;
+        std::filesystem::path canonicalRoot = std::filesystem::weakly_canonical(source.path, ec);
+        if ((0 != ec.value()) || (false == std::filesystem::is_directory(source.path, ec)))
+        {
+            return false;
+        }
+        if ((true == canonicalRoot.filename().empty()) && (true == canonicalRoot.has_relative_path()))
+        {
+            canonicalRoot = canonicalRoot.parent_path();
+        }
+        const std::string name = (false == source.name.empty()) ? source.name : canonicalRoot.filename().string();
+        const bool plainName = (false == name.empty()) && ("." != name) && (".." != name) &&
+                               (std::string::npos == name.find_first_of("/\\"));
+        if ((false == plainName) || (false == names.insert(name).second))
+        {
+            return false;
+        }
+        for (const auto& other : canonicalRoots)
+        {
+            const auto mismatch = std::mismatch(other.begin(), other.end(), canonicalRoot.begin(), canonicalRoot.end());
+            if ((other.end() == mismatch.first) || (canonicalRoot.end() == mismatch.second))
+            {
+                return false;
+            }
+        }
+        canonicalRoots.push_back(canonicalRoot);
+        outputRoots.push_back(NamedSourceRoot{source.path, name});
+    }
+    return true;
+}
+
+/**
+ * @brief Resolve the roots a run walks and the root its keys are relative to.
+ *
+ * Several sources share one key space, each below its name; a single source keeps the plain keys.
+ *
+ * @param[in] config Backup configuration
+ * @param[out] outputNamedRoots Named roots of a multi-root run, empty otherwise
+ * @param[out] outputWalkRoots Files or directories to walk, one after the other
+ * @param[out] outputSourceRoot Directory the keys of a single-source run are relative to
+ * @return true on success, false if a source is missing or the roots collide
+ */
+bool ResolveSources(const BackupConfig& config, std::vector<NamedSourceRoot>& outputNamedRoots, std::vector<std::filesystem::path>& outputWalkRoots,
+                    std::filesystem::path& outputSourceRoot)
+{
+    outputWalkRoots.clear();
+    if (false == config.sources.empty())
+    {
+        if (false == ResolveSourceRoots(config.sources, outputNamedRoots))
+        {
+            return false;
+        }
+        for (const auto& root : outputNamedRoots)
+        {
+            outputWalkRoots.push_back(root.path);
+        }
+        return true;
+    }
+
+    std::error_code ec;
+    outputSourceRoot = std::filesystem::is_regular_file(config.sourceDir, ec) ? config.sourceDir.parent_path() : config.sourceDir;
+    if ((0 != ec.value()) || (false == std::filesystem::exists(outputSourceRoot)))
+    {
+        return false;
+    }
+    outputWalkRoots.push_back(config.sourceDir);
+    return true;
+}
+
+/**
+ * @brief Group roots by the device they are stored on.
+ *
+ * @param[in] roots Roots of the run
+ * @return Indices of the roots of each device, in the order the devices first appear
+ */
+std::vector<std::vector<std::size_t>> GroupRootsByDevice(const std::vector<NamedSourceRoot>& roots)
+{
+    std::vector<std::vector<std::size_t>> groups;
+    std::unordered_map<std::uint64_t, std::size_t> groupOfDevice;
+    for (std::size_t index = 0; index < roots.size(); ++index)
+    {
+        FileMetadata metadata{};
+        if (false == ReadFileMetadata(roots[index].path, metadata))
+        {
+            // An unknown device is walked on its own rather than serialized with an unrelated one.
+            groups.push_back({index});
+            continue;
+        }
+        const auto group = groupOfDevice.emplace(metadata.device, groups.size());
+        if (true == group.second)
+        {
+            groups.emplace_back();
+        }
+        groups[group.first->second].push_back(index);
+    }
+    return groups;
+}
+
+/**
+ * @brief Get the day of a snapshot name as days since 1970-01-01.
+ *
+ * @param[in] name Snapshot name, `YYYY-MM-DD_HH-MM-SS`
+ * @param[out] outputDay Day number
+ * @return true if the name starts with a date, false otherwise
+ */
+bool SnapshotDay(const std::string& name, std::int64_t& outputDay)
+{
+    int year = 0;
+    int month = 0;
+    int day = 0;
+    if ((SnapshotDateLength > name.size()) || (3 != std::sscanf(name.c_str(), "%4d-%2d-%2d", &year, &month, &day)) || (1 > month) || (12 < month) ||
+        (1 > day) || (31 < day))
+    {
+        return false;
+    }
+    // Civil date to day count, with March as the first month so leap days end a year.
+    year -= (2 >= month) ? 1 : 0;
+    const std::int64_t era = ((0 <= year) ? year : (year - 399)) / 400;
+    const std::int64_t yearOfEra = year - (era * 400);
+    const std::int64_t dayOfYear = ((153 * (month + ((2 < month) ? -3 : 9)) + 2) / 5) + day - 1;
+    const std::int64_t dayOfEra = (yearOfEra * 365) + (yearOfEra / 4) - (yearOfEra / 100) + dayOfYear;
+    outputDay = (era * 146097) + dayOfEra - 719468;
+    return true;
+}
+
+/**
+ * @brief Set up the encryptor for a key file.
+ *
+ * @param[in] keyFile Key file, empty for a backup without encryption
+ * @param[in] algorithm Cipher new files are encrypted with
+ * @param[out] outputEncryptor Encryptor with the key, nullptr without a key file
+ * @return true on success, false if the key cannot be read or the build cannot encrypt
+ */
+bool OpenEncryptor(const std::filesystem::path& keyFile, EncryptionAlgorithm algorithm, std::unique_ptr<FileEncryptor>& outputEncryptor)
+{
+    outputEncryptor.reset();
+    if (true == keyFile.empty())
+    {
+        return true;
+    }
+    FileEncryptor::Key key{};
+    if ((false == FileEncryptor::IsAvailable()) || (false == FileEncryptor::LoadKey(keyFile, key)))
+    {
+        return false;
+    }
+    outputEncryptor = std::make_unique<FileEncryptor>(key, algorithm);
+    return true;
+}
+
+/**
+ * @brief Database state a daemon keeps open from one run to the next.
+ */
+struct WarmBackupState
+{
+    std::unique_ptr<SQLiteSession> databaseSession;            /**< Session whose connections keep their page caches between runs */
+    std::unique_ptr<FileStateRepository> fileStateRepository;  /**< Repository with its schema checked and its shards attached */
+    FileStateIndex fileStateIndex;                             /**< Index of the last run, reused while no row changed */
+    std::unique_ptr<DirectoryCache> directoryCache;            /**< Backup directories known to exist */
+};
+
+/**
+ * @brief Drop everything a state holds, closing the database.
+ *
+ * @param[in,out] state State to close
+ */
+void CloseWarmState(WarmBackupState& state)
+{
+    state.fileStateIndex.Clear();
+    state.directoryCache.reset();
+    state.fileStateRepository.reset();
+    state.databaseSession.reset();
+}
+
+/**
+ * @brief Open the state database of a run and check its schema, unless a daemon kept it open.
+ *
+ * @param[in] config Backup configuration
+ * @param[in,out] state State to open, left as it is when already open
+ * @return true on success, false if the database cannot be opened or migrated
+ */
+bool OpenWarmState(const BackupConfig& config, WarmBackupState& state)
+{
+    if (nullptr != state.fileStateRepository)
+    {
+        return true;
+    }
+    state.databaseSession = std::make_unique<SQLiteSession>(config.databaseFile, config.databaseProfile);
+    state.fileStateRepository = std::make_unique<FileStateRepository>(*state.databaseSession);
+    state.directoryCache = std::make_unique<DirectoryCache>();
+    if ((false == state.fileStateRepository->InitializeSchema()) || (false == state.fileStateRepository->SetShardCount(config.stateShards)))
+    {
+        CloseWarmState(state);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Prepare a repository on a read-only session for queries, upgrading an older database first.
+ *
+ * A read-only session cannot migrate, so a database of an older schema is upgraded once through a
+ * read-write session of its own before the read-only one opens it again.
+ *
+ * @param[in,out] repository Repository on a read-only session
+ * @param[in] databaseFile State database of the repository
+ * @return true on success, false if the database cannot be opened or migrated
+ */
+bool InitializeForQueries(FileStateRepository& repository, const std::filesystem::path& databaseFile)
+{
+    if (true == repository.InitializeSchema())
+    {
+        return true;
+    }
+    SQLiteSession upgradeSession(databaseFile);
+    FileStateRepository upgradeRepository(upgradeSession);
+    return (true == upgradeRepository.InitializeSchema()) && (true == repository.InitializeSchema());
+}
+
+/**
+ * @brief Run one backup.
+ *
+ * @param[in] config Backup configuration
+ * @param[in,out] statsCollector Collector of run measurements, nullptr skips measuring
+ * @param[in,out] warmState State a daemon keeps between runs, nullptr opens and drops everything within the run
+ * @return true on success, false on error
+ */
+bool Run(const BackupConfig& config, BackupStatsCollector* statsCollector, WarmBackupState* warmState)
+{
+    std::atomic<bool> success{true};
+    std::error_code ec;
+    // The time limit counts from here; the walker and the workers only see the flag.
+    const RunDeadline deadline(config.stopRequested, std::chrono::seconds(config.timeLimitSeconds));
+    const std::atomic<bool>* stopRequested = deadline.StopFlag();
+
+    const bool multiRoot = (false == config.sources.empty());
+    std::vector<NamedSourceRoot> namedRoots;
+    std::vector<std::filesystem::path> walkRoots;
+    std::filesystem::path sourceRoot;
+    if (false == ResolveSources(config, namedRoots, walkRoots, sourceRoot))
+    {
+        return false;
+    }
+    const RelativePathBuilder sourceKeys = (true == multiRoot) ? RelativePathBuilder(namedRoots) : RelativePathBuilder(sourceRoot);
+
+    // Chunked history, delta history and compression replace archived files, which would drop content
+    // store links; a version can be archived in only one of the chunked and delta forms.
+    const int historyStoreCount = ((true == config.contentStore) ? 1 : 0) + ((true == config.chunkedHistory) ? 1 : 0) +
+                                  ((true == config.deltaHistory) ? 1 : 0);
+    if ((1 < historyStoreCount) || ((true == config.compressHistory) && ((true == config.contentStore) || (false == FileCompressor::IsAvailable()))) ||
+        ((true == config.compressionDictionaries) && (false == config.compressHistory)))
+    {
+        return false;
+    }
+    // These link, append to or rewrite files in place, which a storage backend has no operations for.
+    StorageBackend* storage = config.storage.get();
+    if ((nullptr != storage) && ((0 < historyStoreCount) || (true == config.compressHistory) || (true == config.packSmallFiles) ||
+                                 (true == config.snapshotTrees) || (true == config.detectMoves)))
+    {
+        return false;
+    }
+    // Copies of the database go below the backup root, which is only a staging area in front of a storage backend.
+    if ((nullptr != storage) && (true == config.stateCopies))
+    {
+        return false;
+    }
+    // Parity covers plain copies below the backup root; archived versions the history stores rewrite and encrypted
+    // copies, whose bytes differ between equal contents, would leave parity that nothing can use.
+    std::unique_ptr<ReedSolomon> parityCode;
+    if (0 < config.parityShards)
+    {
+        if ((nullptr != storage) || (true == config.chunkedHistory) || (true == config.deltaHistory) || (true == config.compressHistory) ||
+            (false == config.encryptionKeyFile.empty()))
+        {
+            return false;
+        }
+        try
+        {
+            parityCode = std::make_unique<ReedSolomon>(config.parityDataShards, config.parityShards);
+        }
+        catch (const std::invalid_argument&)
+        {
+            return false;
+        }
+    }
+    const std::filesystem::path parityRoot = config.backupRoot / ParityFile::Area;
+    // A moved backup copy changes path by a rename, which would leave the references of a content store object uncounted.
+    if ((true == config.detectMoves) && (true == config.contentStore))
+    {
+        return false;
+    }
+    // Encrypted copies cannot be linked by content, chunked, diffed, compressed or packed, which all read stored content in plain.
+    std::unique_ptr<FileEncryptor> fileEncryptor;
+    if (((false == config.encryptionKeyFile.empty()) && ((0 < historyStoreCount) || (true == config.compressHistory) || (true == config.packSmallFiles))) ||
+        (false == OpenEncryptor(config.encryptionKeyFile, config.encryptionAlgorithm, fileEncryptor)))
+    {
+        return false;
+    }
+    std::unique_ptr<EncryptedStorageBackend> encryptedStorage;
+    if ((nullptr != fileEncryptor) && (nullptr != storage))
+    {
+        encryptedStorage = std::make_unique<EncryptedStorageBackend>(*storage, *fileEncryptor, config.backupRoot / "staging");
+        storage = encryptedStorage.get();
+    }
+
+    PathFilter pathFilter;
+    if (false == PathFilter::Compile(config.filterRules, pathFilter))
+    {
+        return false;
+    }
+    // Files outside the size and mtime limits are still walked and handed to the workers, which keep their
+    // stored states, so a file that only left the limits is not archived as deleted. Only patterns prune the walk.
+    const PathFilter patternFilter = pathFilter.WithoutLimits();
+    const PathFilter* walkFilter = (true == patternFilter.IsEmpty()) ? nullptr : &patternFilter;
+    const PathFilter* limitFilter = (true == pathFilter.NeedsSizeAndTime()) ? &pathFilter : nullptr;
+
+    // Opened first, so a run that fails to start is published as failed too.
+    LiveStatusSegment statusSegment;
+    if ((false == config.statusSegment.empty()) && (false == statusSegment.Open(config.statusSegment)))
+    {
+        return false;
+    }
+
+    // In a storage backend the two roots are key prefixes.
+    std::filesystem::path backupRoot = (nullptr != storage) ? std::filesystem::path("backup") : config.backupRoot / "backup";
+    std::filesystem::path historyRoot = (nullptr != storage) ? std::filesystem::path("deleted") : config.backupRoot / "deleted";
+    // Declared before everything that discards through it, so its destructor removes the last queued entries once they are done.
+    std::unique_ptr<TrashQueue> trashQueue;
+    if (nullptr == storage)
+    {
+        std::filesystem::create_directories(backupRoot, ec);
+        std::filesystem::create_directories(historyRoot, ec);
+        trashQueue = std::make_unique<TrashQueue>(config.backupRoot / "trash");
+    }
+
+    // Without limits or a control file there is no throttle, so hashing and copying skip the accounting entirely.
+    std::unique_ptr<IoThrottle> ioThrottle;
+    std::unique_ptr<ThrottleControlFile> throttleControl;
+    if ((true == config.ioLimits.IsLimited()) || (false == config.throttleFile.empty()))
+    {
+        ioThrottle = std::make_unique<IoThrottle>(config.ioLimits);
+    }
+    if (false == config.throttleFile.empty())
+    {
+        throttleControl = std::make_unique<ThrottleControlFile>(config.throttleFile, config.ioLimits, *ioThrottle);
+    }
+
+    // Every file is stat'ed once, by the walk, relative to its open directory; the metadata travels with
+    // the file through the queue, where the scheduling policies and the adaptive controller use it too.
+    auto createIterator = [&](const std::atomic<bool>* walkStopRequested)
+    {
+        return std::make_unique<FileIterator>(config.walkThreads, config.orderedWalk, true, walkFilter,
+                                              (true == multiRoot) ? std::filesystem::path() : config.sourceDir, walkStopRequested, ioThrottle.get(),
+                                              config.mftWalk);
+    };
+    auto walkTree = [&](const FileIterator& iterator, const std::function<void(std::vector<FileEntry>&&)>& onBatch,
+                        const FileIterator::DirectoryCallback& onDirectory)
+    {
+        if (false == multiRoot)
+        {
+            return iterator.IterateBatchesWithInfo(config.sourceDir, onBatch, onDirectory);
+        }
+        // Roots on one device are walked one after the other so they do not seek against each other,
+        // while the devices are walked side by side into the shared queue.
+        std::atomic<bool> rootsComplete{true};
+        std::vector<std::thread> deviceWalkers;
+        for (const auto& group : GroupRootsByDevice(namedRoots))
+        {
+            deviceWalkers.emplace_back(
+                [&, group]()
+                {
+                    for (const std::size_t index : group)
+                    {
+                        if (false == iterator.IterateBatchesWithInfo(walkRoots[index], onBatch, onDirectory))
+                        {
+                            rootsComplete.store(false);
+                        }
+                    }
+                });
+        }
+        for (auto& deviceWalker : deviceWalkers)
+        {
+            deviceWalker.join();
+        }
+        return rootsComplete.load();
+    };
+    // Only journal and change list runs list what the database says, so every other walk starts now and runs
+    // while the database is opened and the state index preloaded; its batches wait for the pipeline.
+    std::unique_ptr<WalkAhead> walkAhead;
+    if ((true == multiRoot) || ((false == config.useChangeJournal) && (true == config.changeListFile.empty())))
+    {
+        walkAhead = std::make_unique<WalkAhead>(stopRequested, WalkAheadFiles);
+        walkAhead->Start(
+            [&](const std::function<void(std::vector<FileEntry>&&)>& hold, const FileIterator::DirectoryCallback& holdDirectory)
+            {
+                const std::unique_ptr<FileIterator> aheadIterator = createIterator(walkAhead->StopFlag());
+                if (nullptr != statsCollector)
+                {
+                    statsCollector->BeginWalk(statsCollector->Current());
+                }
+                const bool complete = walkTree(
+                    *aheadIterator,
+                    [&](std::vector<FileEntry>&& files)
+                    {
+                        BackupStatsCollector::ThreadCounters* walkCounters = (nullptr != statsCollector) ? &statsCollector->Current() : nullptr;
+                        if (nullptr != walkCounters)
+                        {
+                            statsCollector->MarkWalk(*walkCounters);
+                        }
+                        hold(std::move(files));
+                        if (nullptr != walkCounters)
+                        {
+                            BackupStatsCollector::SkipWalk(*walkCounters);
+                        }
+                    },
+                    holdDirectory);
+                if (nullptr != statsCollector)
+                {
+                    statsCollector->MarkWalk(statsCollector->Current());
+                }
+                return complete;
+            });
+    }
+
+    PipelineSizing sizing = ResolvePipelineSizing(config);
+    std::size_t hashBufferSize = config.hashBufferSize;
+    std::size_t stateIndexMemoryLimit = config.stateIndexMemoryLimit;
+    const MemoryBudget memoryBudget = ApplyMemoryLimit(config.memoryLimit, sizing, hashBufferSize, stateIndexMemoryLimit);
+    // Covers the hash cache connections too; the previous limit is back once the run ends.
+    const SQLiteMemoryLimit databaseMemoryLimit(memoryBudget.databaseBytes);
+
+    BackupStatsCollector::ThreadCounters* mainCounters = (nullptr != statsCollector) ? &statsCollector->Current() : nullptr;
+    WarmBackupState coldState;
+    WarmBackupState& state = (nullptr != warmState) ? *warmState : coldState;
+    {
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        if (false == OpenWarmState(config, state))
+        {
+            return false;
+        }
+    }
+    SQLiteSession& databaseSession = *state.databaseSession;
+    FileStateRepository& fileStateRepository = *state.fileStateRepository;
+    const std::uint64_t busyRetriesBefore = databaseSession.BusyRetries();
+
+    std::unique_ptr<SQLiteSession> hashCacheSession;
+    std::unique_ptr<HashCache> hashCache;
+    if (false == config.hashCacheFile.empty())
+    {
+        hashCacheSession = std::make_unique<SQLiteSession>(config.hashCacheFile, config.databaseProfile);
+        hashCache = std::make_unique<HashCache>(*hashCacheSession);
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        if (false == hashCache->InitializeSchema())
+        {
+            return false;
+        }
+    }
+
+    // The journal is read before the walk, so changes made while the run is walking stay in it for the next run.
+    ChangeJournal changeJournal(databaseSession);
+    CopyCheckpointStore copyCheckpoints(databaseSession);
+    ChangeJournalState journalState{};
+    std::vector<ChangedDirectory> changedDirectories;
+    bool journalRun = false;
+    // A change list replaces the walk only once a previous run stored the states it is a diff against.
+    bool changeListRun = false;
+    BackupRunRecord run{};
+    // The journal records one watched tree, so multi-root runs always walk.
+    const bool sourceIsTree = (false == multiRoot) && (sourceRoot.native() == config.sourceDir.native());
+    {
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        if ((false == changeJournal.InitializeSchema()) || (false == changeJournal.ReadState(journalState)) ||
+            ((0 < config.copyCheckpointInterval) && (false == copyCheckpoints.InitializeSchema())) ||
+            (false == fileStateRepository.BeginGeneration(RunContext().Timestamp(), config.resume, run)))
+        {
+            return false;
+        }
+        if ((true == config.useChangeJournal) && (true == sourceIsTree) && (true == CanRunFromJournal(journalState, config.journalReconcileRuns)))
+        {
+            journalRun = changeJournal.LoadEntries(journalState.maxSequence, changedDirectories);
+        }
+        bool hasFileStates = false;
+        if ((false == journalRun) && (false == config.changeListFile.empty()) && (true == sourceIsTree) &&
+            (true == fileStateRepository.HasFileStates(hasFileStates)) && (true == hasFileStates))
+        {
+            const std::filesystem::path listRoot = (true == config.changeListRoot.empty()) ? config.sourceDir : config.changeListRoot;
+            changeListRun = SnapshotChangeList::Read(config.changeListFile, listRoot, changedDirectories);
+        }
+    }
+    // Journal and change list runs list only the changed directories, and search only them for deletions.
+    const bool partialRun = (true == journalRun) || (true == changeListRun);
+    if (true == partialRun)
+    {
+        NormalizeChangedDirectories(config.sourceDir, changedDirectories);
+    }
+    // A first run into an empty database appends every row, so it skips the upsert's conflict check, the
+    // per-row index maintenance and the per-commit syncs; one flush after the final checkpoint covers it all.
+    bool bulkImport = false;
+    if ((true == config.bulkImport) && (false == partialRun))
+    {
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        bool hasFileStates = true;
+        if ((false == fileStateRepository.HasFileStates(hasFileStates)) ||
+            ((false == hasFileStates) && (false == fileStateRepository.BeginBulkImport())))
+        {
+            return false;
+        }
+        bulkImport = (false == hasFileStates);
+        if (true == bulkImport)
+        {
+            databaseSession.SetSyncDeferred(true);
+        }
+    }
+    if (0 != config.checkpointIntervalMs)
+    {
+        databaseSession.StartCheckpointing(std::chrono::milliseconds(config.checkpointIntervalMs));
+    }
+
+    FileStateIndex& fileStateIndex = state.fileStateIndex;
+    KnownPathFilter knownPathFilter;
+    // A daemon's index mapped from a snapshot is still exact if no row changed since, so it is used as it is.
+    std::uint64_t storedToken = 0;
+    const bool indexCurrent = (true == fileStateIndex.IsLoaded()) && (0 != fileStateIndex.SnapshotToken()) &&
+                              (true == fileStateRepository.ReadStateSnapshotToken(storedToken)) && (fileStateIndex.SnapshotToken() == storedToken);
+    if (false == indexCurrent)
+    {
+        fileStateIndex.Clear();
+    }
+    // A journal or change list run looks up only the files of a few directories, so preloading every state would dominate it.
+    if ((0 != stateIndexMemoryLimit) && (false == partialRun) && (false == indexCurrent))
+    {
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        // The snapshot the last run left is mapped as it is; only a missing or stale one costs a table scan.
+        // A failed or oversized load leaves the index empty and lookups fall back to per-row queries,
+        // which the far smaller path filter spares every file that is certainly new.
+        if (((false == config.stateSnapshot) || (false == fileStateIndex.LoadSnapshot(StateSnapshotPath(config.databaseFile), fileStateRepository))) &&
+            (false == fileStateIndex.Load(fileStateRepository, stateIndexMemoryLimit)))
+        {
+            knownPathFilter.Load(fileStateRepository, stateIndexMemoryLimit);
+        }
+    }
+
+    // Without the index, a merge reads each listed directory's rows in one ordered scan instead of probing per file.
+    std::unique_ptr<DirectoryStateMerger> stateMerger;
+    if ((true == config.mergeStateLookups) && (false == fileStateIndex.IsLoaded()))
+    {
+        stateMerger = std::make_unique<DirectoryStateMerger>(fileStateRepository);
+    }
+    // The cheaper alternative reads just the states of each walker batch and attaches them to its work items.
+    const bool prefetchStates = (nullptr == stateMerger) && (true == config.prefetchStates) && (false == fileStateIndex.IsLoaded());
+
+    // Without a callback or a status segment there is no reporter, so the processors skip progress accounting entirely.
+    std::unique_ptr<ProgressReporter> progressReporter;
+    if ((nullptr != config.onProgress) || (false == config.statusSegment.empty()))
+    {
+        progressReporter = std::make_unique<ProgressReporter>(config.onProgress, std::chrono::milliseconds(config.progressIntervalMs),
+                                                              config.progressEventCapacity, (false == config.statusSegment.empty()) ? &statusSegment : nullptr);
+    }
+
+    // A resumed run keeps the timestamp it started with, so it continues the same snapshot.
+    const RunContext runContext(run.started);
+    if (nullptr != statsCollector)
+    {
+        statsCollector->SetRun(run.started, std::max(1u, config.walkThreads), sizing.maxHashThreads, sizing.copyThreads);
+    }
+    // Backup and snapshot directories are created once, by whichever worker needs them first; a daemon remembers them across runs.
+    DirectoryCache& directoryCache = *state.directoryCache;
+    // The snapshot is recorded as soon as it exists, so the versions archived into it can be found by name.
+    SnapshotDirectoryProvider snapshotOnce(historyRoot, runContext,
+                                           [&](const std::filesystem::path& snapshotPath)
+                                           {
+                                               if (false == fileStateRepository.RecordSnapshot(snapshotPath.filename().string()))
+                                               {
+                                                   throw std::runtime_error("Failed to record snapshot " + snapshotPath.string());
+                                               }
+                                               if (nullptr != statsCollector)
+                                               {
+                                                   statsCollector->SetSnapshot(snapshotPath);
+                                               }
+                                           },
+                                           storage);
+    const std::uintmax_t unbufferedThreshold = (true == config.unbufferedIo) ? config.unbufferedThreshold : 0;
+    FileHasher fileHasher(config.hashAlgorithm, config.memoryMapThreshold, config.treeHashThreads, config.readEngine, config.readQueueDepth,
+                          unbufferedThreshold, hashBufferSize, ioThrottle.get());
+    FileCopier fileCopier(CopyMethod::Clone, unbufferedThreshold, ioThrottle.get());
+    std::unique_ptr<ContentObjectStore> contentStore;
+    if (true == config.contentStore)
+    {
+        contentStore = std::make_unique<ContentObjectStore>(config.backupRoot / "objects", fileCopier);
+        fileStateRepository.EnableObjectReferenceCounting();
+    }
+
+    FileChunkerOptions chunkerOptions;
+    chunkerOptions.averageSize = config.averageChunkSize;
+    const FileChunker fileChunker(chunkerOptions);
+    std::unique_ptr<ChunkStore> chunkStore;
+    if (true == config.chunkedHistory)
+    {
+        chunkStore = std::make_unique<ChunkStore>(config.backupRoot / "chunks", fileChunker, fileStateRepository);
+    }
+    const FileDelta fileDelta(config.deltaBlockSize);
+    FileCompressorOptions compressorOptions;
+    compressorOptions.level = config.compressionLevel;
+    compressorOptions.workerThreads = config.compressionThreads;
+    // Dictionaries are trained from the backup copies as they are before the run, the versions it archives.
+    CompressionDictionaries compressionDictionaries;
+    if (true == config.compressionDictionaries)
+    {
+        CompressionDictionaryStore dictionaryStore(databaseSession);
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        if ((false == dictionaryStore.InitializeSchema()) || (false == dictionaryStore.Load(compressionDictionaries)) ||
+            (false == dictionaryStore.TrainMissing(config.backupRoot / "backup", compressorOptions.dictionaryFileSize, compressionDictionaries)))
+        {
+            return false;
+        }
+        compressorOptions.dictionaries = &compressionDictionaries;
+    }
+    const FileCompressor fileCompressor(compressorOptions);
+    const FileCompressor* historyCompressor = (true == config.compressHistory) ? &fileCompressor : nullptr;
+
+    // One flush of the backup and database volumes replaces an fsync per copied file.
+    std::unique_ptr<DurabilityBarrier> durabilityBarrier;
+    if (DurabilityPolicy::None != config.durability)
+    {
+        durabilityBarrier = std::make_unique<DurabilityBarrier>(std::vector<std::filesystem::path>{config.backupRoot, config.databaseFile});
+    }
+    DurabilityBarrier* batchBarrier = (DurabilityPolicy::Batched == config.durability) ? durabilityBarrier.get() : nullptr;
+
+    const std::chrono::milliseconds stateBatchInterval(config.stateBatchIntervalMs);
+    FileStateBatchWriter batchWriter(fileStateRepository, config.stateBatchSize, stateBatchInterval, batchBarrier);
+    // The tuned device classes run the full pipeline, which ends in a database stage of its own.
+    FileStateSink stateSink(fileStateRepository, batchWriter, config.stateBatchSize, stateBatchInterval, statsCollector, batchBarrier,
+                            (true == config.dedicatedWriter) || (DeviceClass::Default != config.deviceClass), databaseSession, busyRetriesBefore,
+                            config.writerEscalationRetries);
+
+    auto flushWorkerBatch = [&]()
+    {
+        BackupStatsCollector::ThreadCounters* counters = (nullptr != statsCollector) ? &statsCollector->Current() : nullptr;
+        StageTimer databaseTimer(counters, BackupStage::Database);
+        TraceSpan flushSpan(counters, "UpdateFileStates");
+        if (false == batchWriter.FlushCurrentThread())
+        {
+            success.store(false);
+        }
+    };
+
+    // The packer stores the states of the files it packs, so it flushes its own batch like a worker.
+    std::unique_ptr<PackStore> packStore;
+    std::unique_ptr<PackWriterThread> packWriter;
+    // Snapshot trees look up packed files even in a run that packs nothing new.
+    if ((true == config.packSmallFiles) || (true == config.snapshotTrees))
+    {
+        packStore = std::make_unique<PackStore>(config.backupRoot / "packs", databaseSession);
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        if (false == packStore->InitializeSchema())
+        {
+            return false;
+        }
+    }
+    if (true == config.packSmallFiles)
+    {
+        packWriter = std::make_unique<PackWriterThread>(*packStore, config.packThreshold, config.inlineThreshold, config.packSegmentSize, PackWriterThread::DefaultQueueBytes,
+                                                        ioThrottle.get(), parityCode.get(), parityRoot, flushWorkerBatch);
+    }
+
+    // Nothing stored can be the source of a move, and without the content index each lookup would scan.
+    std::unique_ptr<MoveDetector> moveDetector;
+    if ((true == config.detectMoves) && (false == bulkImport))
+    {
+        moveDetector = std::make_unique<MoveDetector>(sourceKeys, backupRoot, snapshotOnce, fileStateRepository, fileCopier, directoryCache, runContext);
+    }
+
+    const DigestAttributeCache digestAttributeCache;
+    // How stored states are looked up is fixed for the run, so only the instantiation for it is built and
+    // the workers pick it once per batch instead of calling the lookup through std::function per file.
+    std::optional<ProcessBackupFile<IndexedStateLookup>> indexedProcessor;
+    std::optional<ProcessBackupFile<RepositoryStateLookup>> repositoryProcessor;
+    auto createProcessor = [&](auto& processor, const auto& stateLookup)
+    {
+        processor.emplace(sourceKeys, backupRoot, snapshotOnce, stateLookup, stateSink, fileHasher, hashCache.get(), fileCopier, directoryCache,
+                          contentStore.get(), chunkStore.get(), (true == config.deltaHistory) ? &fileDelta : nullptr, historyCompressor,
+                          fileEncryptor.get(), packWriter.get(), moveDetector.get(), storage, runContext, progressReporter.get(), statsCollector,
+                          success, config.paranoid, config.extendedAttributes, config.resumeAppends,
+                          (true == config.digestAttributes) ? &digestAttributeCache : nullptr,
+                          SampledCheckPolicy{config.sampledCheckThreshold, BackupConfig::SampledCheckBlockSize, config.sampledCheckBlocks,
+                                             config.sampledCheckFullEvery},
+                          (0 < config.copyCheckpointInterval) ? &copyCheckpoints : nullptr, config.copyCheckpointInterval, trashQueue.get(),
+                          ParityPolicy{parityCode.get(), parityRoot, config.parityThreshold}, limitFilter);
+    };
+    if (true == fileStateIndex.IsLoaded())
+    {
+        createProcessor(indexedProcessor, IndexedStateLookup(fileStateIndex));
+    }
+    else
+    {
+        createProcessor(repositoryProcessor, RepositoryStateLookup(fileStateRepository, knownPathFilter, stateMerger.get()));
+    }
+    auto withProcessor = [&](auto&& action)
+    {
+        if (true == indexedProcessor.has_value())
+        {
+            action(*indexedProcessor);
+            return;
+        }
+        action(*repositoryProcessor);
+    };
+
+    // Pipeline: enumerate -> read/hash -> copy -> database commit. Without a copy stage the hash
+    // workers copy changed files themselves.
+    std::unique_ptr<PipelineStage<BackupFilePlan>> copyStage;
+    if (0 != sizing.copyThreads)
+    {
+        copyStage = std::make_unique<PipelineStage<BackupFilePlan>>(
+            sizing.copyThreads, sizing.copyQueueDepth, [&](BackupFilePlan& plan) { withProcessor([&](auto& processor) { processor.Apply(plan); }); }, flushWorkerBatch,
+            (true == config.idlePriority) ? std::function<void()>([]() { SetIdlePriority(); }) : std::function<void()>());
+    }
+
+    ThreadedFileQueueOptions queueOptions;
+    queueOptions.backend = config.queueBackend;
+    queueOptions.scheduling = config.scheduling;
+    queueOptions.largeFileThreshold = config.largeFileThreshold;
+    queueOptions.lookaheadWindow = config.lookaheadWindow;
+    queueOptions.adaptive = config.adaptiveThreads;
+    queueOptions.initialActiveThreads = sizing.hashThreads;
+    queueOptions.pinWorkers = config.pinWorkers;
+    queueOptions.idlePriority = config.idlePriority;
+    queueOptions.cancelRequested = stopRequested;
+    queueOptions.workerBudget = config.workerBudget.get();
+    queueOptions.budgetWeight = config.jobWeight;
+    const bool hashesConcurrently = FileHasher::HashesConcurrently(config.readEngine);
+    if (true == hashesConcurrently)
+    {
+        // A worker hashes what it dequeues together, so a dequeue fills its ring.
+        queueOptions.dequeueBatchSize = std::max<std::size_t>(queueOptions.dequeueBatchSize, ResolveReadQueueDepth(config));
+    }
+
+    // Follows the queue a byte budget ahead of the workers, so their reads find the data in the page cache.
+    std::unique_ptr<ReadaheadPrefetcher> readahead;
+    if (0 != config.readaheadBytes)
+    {
+        readahead = std::make_unique<ReadaheadPrefetcher>(config.readaheadBytes);
+    }
+
+    // The handler is part of the queue's type, so workers call it without going through std::function per file.
+    ThreadedWorkQueue fileQueue(
+        sizing.maxHashThreads, sizing.hashQueueDepth,
+        [&](const std::vector<FileWorkItem>& files)
+        {
+            if (nullptr != readahead)
+            {
+                for (const auto& file : files)
+                {
+                    readahead->Consumed(file.costHint);
+                }
+            }
+            withProcessor(
+                [&](auto& processor)
+                {
+                    if (true == hashesConcurrently)
+                    {
+                        processor.ExecuteBatch(files, copyStage.get());
+                        return;
+                    }
+                    for (const auto& file : files)
+                    {
+                        processor.Execute(file, copyStage.get());
+                    }
+                });
+        },
+        flushWorkerBatch, queueOptions);
+
+    // Started last, so the counting walk competes with the backup walk only once there are workers to feed.
+    std::unique_ptr<BackupPreScan> preScan;
+    if (true == config.preScan)
+    {
+        preScan = std::make_unique<BackupPreScan>(walkRoots, config.preScanThreads, (true == pathFilter.IsEmpty()) ? nullptr : &pathFilter,
+                                                  progressReporter.get(), stopRequested);
+    }
+
+    ProcessDeletedFiles processDeletedFiles(sourceKeys, backupRoot, snapshotOnce, fileStateRepository, fileCopier, directoryCache, chunkStore.get(),
+                                            historyCompressor, storage, runContext, progressReporter.get(), statsCollector,
+                                            sizing.hashThreads, config.stateBatchSize, batchBarrier, trashQueue.get());
+    // A directory's deletions are known once its listing is complete, so they are archived while the rest of the tree is hashed.
+    processDeletedFiles.StartSubmissions();
+    DirectoryCompletionTracker completionTracker(
+        sourceKeys, fileStateRepository, [&](std::vector<std::string>&& databasePaths) { processDeletedFiles.Submit(std::move(databasePaths)); },
+        stateMerger.get());
+
+    if (nullptr != mainCounters)
+    {
+        // A walk ahead measures itself; this thread only counts the batches it replays.
+        if (nullptr == walkAhead)
+        {
+            statsCollector->BeginWalk(*mainCounters);
+        }
+        else
+        {
+            BackupStatsCollector::SkipWalk(*mainCounters);
+        }
+    }
+    // Unchanged files are only recorded and files read unbuffered bypass the page cache, so neither is read ahead.
+    auto willReadFile = [&](const FileEntry& file, std::uint64_t costHint, const FileStatePrefetch* prefetch)
+    {
+        if ((0 == costHint) || ((0 != unbufferedThreshold) && (unbufferedThreshold <= costHint)))
+        {
+            return false;
+        }
+        std::string key;
+        if ((true == config.paranoid) || (false == file.info.hasMetadata) || (false == sourceKeys.BuildKey(file.path, key)))
+        {
+            return true;
+        }
+        FileStateRecord storedRecord;
+        bool stored = false;
+        if (true == fileStateIndex.IsLoaded())
+        {
+            stored = fileStateIndex.Find(key, storedRecord);
+        }
+        else if ((nullptr == prefetch) || (false == prefetch->Find(key, storedRecord, stored)))
+        {
+            return true;
+        }
+        return (false == stored) || (ChangeType::Deleted == storedRecord.status) || (storedRecord.hashAlgorithm != fileHasher.Algorithm()) ||
+               (false == (storedRecord.metadata == file.info.metadata));
+    };
+    const std::function<void(std::vector<FileEntry>&&)> onBatch = [&](std::vector<FileEntry>&& files)
+    {
+        BackupStatsCollector::ThreadCounters* walkCounters = (nullptr != statsCollector) ? &statsCollector->Current() : nullptr;
+        // Reading the batch's stored states counts as database time, not as walking.
+        const bool readsStates = (nullptr != stateMerger) || (true == prefetchStates);
+        BackupStatsCollector::ThreadCounters* stateCounters = (true == readsStates) ? walkCounters : nullptr;
+        if (nullptr != stateCounters)
+        {
+            statsCollector->MarkWalk(*stateCounters);
+        }
+        std::shared_ptr<const FileStatePrefetch> prefetch;
+        {
+            StageTimer databaseTimer(stateCounters, BackupStage::Database);
+            completionTracker.AddListed(files);
+            if (true == prefetchStates)
+            {
+                prefetch = FileStatePrefetch::Load(fileStateRepository, sourceKeys, files);
+            }
+        }
+        if (nullptr != stateCounters)
+        {
+            statsCollector->SkipWalk(*stateCounters);
+        }
+        std::vector<ReadaheadRequest> readaheadRequests;
+        if (nullptr != readahead)
+        {
+            readaheadRequests.reserve(files.size());
+        }
+        std::vector<FileWorkItem> items;
+        items.reserve(files.size());
+        for (auto& file : files)
+        {
+            const std::uint64_t costHint = (true == file.info.hasSizeAndTime) ? file.info.size : 0;
+            if (nullptr != readahead)
+            {
+                const bool advise = willReadFile(file, costHint, prefetch.get());
+                readaheadRequests.push_back(ReadaheadRequest{(true == advise) ? file.path : std::filesystem::path(), costHint, advise});
+            }
+            items.push_back(FileWorkItem{std::move(file.path), costHint, file.info.device, file.info.hasMetadata, file.info.metadata, prefetch,
+                                         (true == file.info.hasSizeAndTime) ? file.info.modificationTimeNs : 0});
+        }
+        if (nullptr != readahead)
+        {
+            readahead->Submit(std::move(readaheadRequests));
+        }
+        if (nullptr != progressReporter)
+        {
+            progressReporter->AddQueued(items.size());
+        }
+        if (nullptr == walkCounters)
+        {
+            fileQueue.EnqueueBatch(std::move(items));
+            return;
+        }
+        statsCollector->MarkWalk(*walkCounters);
+        {
+            WaitTimer enqueueTimer(walkCounters);
+            fileQueue.EnqueueBatch(std::move(items));
+        }
+        statsCollector->SkipWalk(*walkCounters);
+    };
+    const FileIterator::DirectoryCallback onDirectory = [&](const std::filesystem::path& directory, bool listed)
+    {
+        BackupStatsCollector::ThreadCounters* walkCounters = (nullptr != statsCollector) ? &statsCollector->Current() : nullptr;
+        if (nullptr == walkCounters)
+        {
+            completionTracker.CompleteDirectory(directory, listed);
+            return;
+        }
+        statsCollector->MarkWalk(*walkCounters);
+        {
+            StageTimer deletionTimer(walkCounters, BackupStage::DeletionScan);
+            completionTracker.CompleteDirectory(directory, listed);
+        }
+        statsCollector->SkipWalk(*walkCounters);
+    };
+    bool walkComplete = true;
+    if (true == partialRun)
+    {
+        const std::unique_ptr<FileIterator> iterator = createIterator(stopRequested);
+        for (const auto& directory : changedDirectories)
+        {
+            // Vanished and excluded directories have nothing to list; their files are found by the deletion pass.
+            const std::filesystem::path location = (true == directory.path.empty()) ? config.sourceDir : config.sourceDir / directory.path;
+            if (((nullptr != walkFilter) && (true == walkFilter->ExcludesDirectoryTree(MakeFilterPath(directory.path)))) ||
+                (false == std::filesystem::is_directory(std::filesystem::symlink_status(location, ec))))
+            {
+                continue;
+            }
+            const bool listed = (true == directory.recursive) ? iterator->IterateBatchesWithInfo(location, onBatch, onDirectory)
+                                                              : iterator->ListDirectoryWithInfo(location, onBatch, onDirectory);
+            walkComplete = (true == walkComplete) && (true == listed);
+        }
+    }
+    else if (nullptr != walkAhead)
+    {
+        walkComplete = walkAhead->Finish(onBatch, onDirectory);
+    }
+    else
+    {
+        walkComplete = walkTree(*createIterator(stopRequested), onBatch, onDirectory);
+    }
+    if ((nullptr != mainCounters) && (nullptr == walkAhead))
+    {
+        statsCollector->MarkWalk(*mainCounters);
+    }
+
+    fileQueue.Finalize();
+    if (nullptr != readahead)
+    {
+        readahead->Stop();
+    }
+    if (nullptr != copyStage)
+    {
+        copyStage->Finalize();
+    }
+    if ((nullptr != packWriter) && (false == packWriter->Stop()))
+    {
+        success.store(false);
+    }
+    {
+        StageTimer deletionTimer(mainCounters, BackupStage::DeletionScan);
+        if (false == processDeletedFiles.FinishSubmissions())
+        {
+            success.store(false);
+        }
+    }
+    {
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        if (false == batchWriter.FlushAll())
+        {
+            success.store(false);
+        }
+        if (false == stateSink.Stop())
+        {
+            success.store(false);
+        }
+        // Even a stopped import gets its indexes back, since the next run is no bulk import.
+        if ((true == bulkImport) && (false == fileStateRepository.FinishBulkImport()))
+        {
+            success.store(false);
+        }
+    }
+
+    // A stopped run dropped queued files, so even a complete walk says nothing about which rows are deleted.
+    const bool stopped = deadline.IsStopRequested();
+    if ((true == success.load()) && (false == stopped))
+    {
+        // A complete walk of a directory wrote every live file with the current generation, so unseen
+        // rows are the deletions not found during the walk. Otherwise (walk errors, single-file sources) fall back to probing.
+        const bool sourceIsDirectory = (true == multiRoot) || (true == std::filesystem::is_directory(config.sourceDir, ec));
+        const bool useGenerations = (true == walkComplete) && (0 == ec.value()) && (true == sourceIsDirectory);
+        if ((true == partialRun) && (true == walkComplete))
+        {
+            success.store(processDeletedFiles.ExecuteUnseenIn(changedDirectories));
+        }
+        else
+        {
+            success.store((true == useGenerations) ? processDeletedFiles.ExecuteUnseen() : processDeletedFiles.Execute());
+        }
+    }
+    // A change list run visited only the list's directories, so the journal keeps what it recorded meanwhile.
+    if ((true == success.load()) && (false == stopped) && (true == walkComplete) && (true == sourceIsTree) && (false == changeListRun))
+    {
+        // An incomplete walk keeps the journal, so its directories are visited again by the next run.
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        // A walk that began before the journal was read may have missed changes recorded in between, so it
+        // does not count as continuing the watcher's session and the next journal run walks in full.
+        ChangeJournalState completedState = journalState;
+        if (nullptr != walkAhead)
+        {
+            completedState.heartbeatMs = 0;
+        }
+        if (false == changeJournal.CompleteRun(completedState, journalRun))
+        {
+            success.store(false);
+        }
+    }
+    if ((true == success.load()) && (false == stopped) && (true == config.snapshotTrees))
+    {
+        SnapshotTreeBuilder snapshotTreeBuilder(config.backupRoot, fileCopier, packStore.get());
+        if (false == snapshotTreeBuilder.Build(fileStateRepository, runContext.Timestamp(), sizing.hashThreads, sizing.hashQueueDepth))
+        {
+            success.store(false);
+        }
+    }
+    statusSegment.SetStage("finishing");
+    if (false == stopped)
+    {
+        // Until here the run stays marked as running, so a run that is killed or stopped is resumed by the next one.
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        // The run is recorded as finished only once everything it wrote is on stable storage.
+        if ((nullptr != durabilityBarrier) && (false == durabilityBarrier->Sync()))
+        {
+            success.store(false);
+        }
+        if (false == fileStateRepository.FinishGeneration(success.load()))
+        {
+            success.store(false);
+        }
+        // Stale statistics only cost query speed, so a failure here does not fail the run.
+        DatabaseMaintenance(databaseSession).Optimize();
+        // A run that changed no row leaves the mapped snapshot valid. A snapshot that cannot be written
+        // only makes the next run load the table, so that does not fail the run either.
+        std::uint64_t snapshotToken = 0;
+        const bool snapshotCurrent = (true == fileStateRepository.ReadStateSnapshotToken(snapshotToken)) && (fileStateIndex.SnapshotToken() == snapshotToken);
+        if ((true == success.load()) && (true == config.stateSnapshot) && (0 != stateIndexMemoryLimit) && (false == partialRun) && (false == snapshotCurrent))
+        {
+            fileStateIndex.Clear();
+            // A daemon maps the new snapshot now, while it waits, instead of at the start of its next run.
+            if ((true == StateSnapshotFile::Write(StateSnapshotPath(config.databaseFile), fileStateRepository, stateIndexMemoryLimit)) && (nullptr != warmState))
+            {
+                fileStateIndex.LoadSnapshot(StateSnapshotPath(config.databaseFile), fileStateRepository);
+            }
+        }
+    }
+
+    if (nullptr != preScan)
+    {
+        preScan->Join();
+        if (nullptr != statsCollector)
+        {
+            std::uint64_t files = 0;
+            std::uint64_t bytes = 0;
+            std::array<std::uint64_t, FileSizeHistogramBuckets> histogram{};
+            preScan->Collect(files, bytes, histogram);
+            statsCollector->SetPreScan(files, bytes, histogram);
+        }
+    }
+    {
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        // A final checkpoint that cannot truncate leaves a large WAL behind, never lost commits.
+        databaseSession.StopCheckpointing();
+        if (true == bulkImport)
+        {
+            databaseSession.SetSyncDeferred(false);
+        }
+        // The checkpointed database is flushed too, which the Bulk profile's synchronous=OFF would skip.
+        if ((nullptr != durabilityBarrier) && (false == durabilityBarrier->Sync()))
+        {
+            success.store(false);
+        }
+        else if ((nullptr == durabilityBarrier) && (true == bulkImport) &&
+                 (false == DurabilityBarrier(std::vector<std::filesystem::path>{config.databaseFile}).Sync()))
+        {
+            success.store(false);
+        }
+    }
+    // The copy is taken after the final checkpoint, so it holds the states the run finished with.
+    if ((true == success.load()) && (false == stopped) && (true == config.stateCopies))
+    {
+        StageTimer databaseTimer(mainCounters, BackupStage::Database);
+        if (false == StateDatabaseCopy::Write(databaseSession, config.backupRoot, runContext.Timestamp()))
+        {
+            success.store(false);
+        }
+    }
+    if (nullptr != progressReporter)
+    {
+        progressReporter->Stop();
+    }
+    if (nullptr != statsCollector)
+    {
+        statsCollector->AddSqliteBusyRetries(databaseSession.BusyRetries() - busyRetriesBefore);
+        if (nullptr != hashCacheSession)
+        {
+            statsCollector->AddSqliteBusyRetries(hashCacheSession->BusyRetries());
+        }
+        if (true == stopped)
+        {
+            statsCollector->SetStopped();
+        }
+    }
+    // An index read from the table cannot be checked against later changes, so a daemon does not hold on to it.
+    if ((nullptr != warmState) && (0 == fileStateIndex.SnapshotToken()))
+    {
+        fileStateIndex.Clear();
+    }
+    if ((true == success.load()) && (false == stopped))
+    {
+        statusSegment.SetStage("finished");
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Record a measured run in the run history of its state database.
+ *
+ * @param[in] config Backup configuration
+ * @param[in] stats Measurements of the run
+ * @param[in] success Whether the run succeeded
+ * @param[in,out] warmState State a daemon keeps between runs, whose session is used when open
+ * @return true on success or if the run never started, false if the history could not be written
+ */
+bool RecordRunHistory(const BackupConfig& config, const BackupStats& stats, bool success, WarmBackupState* warmState)
+{
+    if (true == stats.runTimestamp.empty())
+    {
+        return true;
+    }
+    std::unique_ptr<SQLiteSession> ownSession;
+    SQLiteSession* databaseSession = ((nullptr != warmState) && (nullptr != warmState->databaseSession)) ? warmState->databaseSession.get() : nullptr;
+    if (nullptr == databaseSession)
+    {
+        ownSession = std::make_unique<SQLiteSession>(config.databaseFile, config.databaseProfile);
+        databaseSession = ownSession.get();
+    }
+    const RunOutcome outcome = (true == success) ? RunOutcome::Completed : ((true == stats.stopped) ? RunOutcome::Stopped : RunOutcome::Failed);
+    const std::int64_t finishedAt = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    RunHistoryLog historyLog(*databaseSession);
+    return (true == historyLog.InitializeSchema()) && (true == historyLog.Record(stats, outcome, finishedAt));
+}
+
+/**
+ * @brief Run one backup with its measurements, trace, I/O trace, slow operation log and metrics file.
+ *
+ * @param[in] config Backup configuration
+ * @param[out] outputStats Measurements of the run
+ * @param[in,out] warmState State a daemon keeps between runs, nullptr opens and drops everything within the run
+ * @return true on success, false on error or if an output file could not be written
+ */
+bool RunMeasured(const BackupConfig& config, BackupStats& outputStats, WarmBackupState* warmState)
+{
+    std::unique_ptr<BackupTrace> trace;
+    if (false == config.traceFile.empty())
+    {
+        trace = std::make_unique<BackupTrace>(config.traceEventsPerThread);
+    }
+    std::unique_ptr<SlowOperationLog> slowLog;
+    if (false == config.slowOperationLog.empty())
+    {
+        constexpr std::uint64_t NanosecondsPerMillisecond = 1000000;
+        slowLog = std::make_unique<SlowOperationLog>(config.slowOperationLog, config.slowOperationThresholdMs * NanosecondsPerMillisecond);
+        if (false == slowLog->IsOpen())
+        {
+            outputStats = BackupStats{};
+            return false;
+        }
+    }
+    std::unique_ptr<IoTraceLog> ioTrace;
+    if (false == config.ioTraceFile.empty())
+    {
+        ioTrace = std::make_unique<IoTraceLog>(config.ioTraceFile);
+        if (false == ioTrace->IsOpen())
+        {
+            outputStats = BackupStats{};
+            return false;
+        }
+    }
+    std::unique_ptr<ChangeLog> changeLog;
+    if (false == config.changeLogFile.empty())
+    {
+        changeLog = std::make_unique<ChangeLog>(config.changeLogFile);
+        if (false == changeLog->IsOpen())
+        {
+            outputStats = BackupStats{};
+            return false;
+        }
+    }
+    BackupStatsCollector statsCollector(trace.get(), slowLog.get(), ioTrace.get(), changeLog.get());
+    const std::uint64_t frame = Instrumentation::BeginFrame();
+    bool success = Run(config, &statsCollector, warmState);
+    Instrumentation::EndFrame(frame);
+    statsCollector.Collect(outputStats);
+    if (false == RecordRunHistory(config, outputStats, success, warmState))
+    {
+        success = false;
+    }
+    if ((nullptr != trace) && (false == trace->Write(config.traceFile)))
+    {
+        success = false;
+    }
+    if ((nullptr != ioTrace) && (false == ioTrace->Close()))
+    {
+        success = false;
+    }
+    if ((nullptr != changeLog) && (false == changeLog->Close()))
+    {
+        success = false;
+    }
+    if ((nullptr != slowLog) && (false == slowLog->Close()))
+    {
+        success = false;
+    }
+    if (false == config.metricsFile.empty())
+    {
+        BackupMetricsEntry entry{};
+        entry.stats = outputStats;
+        entry.finished = true;
+        entry.lastSucceeded = success;
+        entry.finishedAt = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        if (false == WriteBackupMetricsFile(config.metricsFile, FormatBackupMetrics({entry})))
+        {
+            success = false;
+        }
+    }
+    return success;
+}
+
+/**
+ * @brief Check whether a daemon should start a run now.
+ *
+ * @param[in] config Daemon configuration
+ * @param[in] state Open database state of the daemon
+ * @param[in] nextTimedRun Time the timer next fires
+ * @param[in,out] triggerWriteTime Modification time of the trigger file when last seen, updated when it changed
+ * @return true if the timer fired, the trigger file changed or the journal reached its threshold
+ */
+bool IsRunDue(const DaemonConfig& config, WarmBackupState& state, std::chrono::steady_clock::time_point nextTimedRun,
+              std::filesystem::file_time_type& triggerWriteTime)
+{
+    bool due = (0 != config.intervalSeconds) && (std::chrono::steady_clock::now() >= nextTimedRun);
+    if (false == config.triggerFile.empty())
+    {
+        std::error_code ec;
+        const std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(config.triggerFile, ec);
+        if ((0 == ec.value()) && (writeTime != triggerWriteTime))
+        {
+            triggerWriteTime = writeTime;
+            due = true;
+        }
+    }
+    std::uint64_t journaled = 0;
+    if ((false == due) && (0 != config.journalThreshold) && (nullptr != state.databaseSession) &&
+        (true == ChangeJournal(*state.databaseSession).CountEntries(journaled)))
+    {
+        due = (config.journalThreshold <= journaled);
+    }
+    return due;
+}
+
+/**
+ * @brief Decompress an archived version, loading the stored dictionaries only when its frame names one.
+ *
+ * @param[in] compressedPath Compressed version
+ * @param[in] outputPath File to create or replace
+ * @param[in] databaseFile Backup database holding the dictionaries, empty when none was used
+ * @return true if the version was restored, false on error or a missing dictionary
+ */
+bool DecompressArchivedFile(const std::filesystem::path& compressedPath, const std::filesystem::path& outputPath, const std::filesystem::path& databaseFile)
+{
+    if ((0 == FileCompressor::FrameDictionaryId(compressedPath)) || (true == databaseFile.empty()))
+    {
+        return FileCompressor::Decompress(compressedPath, outputPath);
+    }
+    SQLiteSession databaseSession(databaseFile);
+    CompressionDictionaryStore dictionaryStore(databaseSession);
+    CompressionDictionaries dictionaries;
+    return (true == dictionaryStore.InitializeSchema()) && (true == dictionaryStore.Load(dictionaries)) &&
+           (true == FileCompressor::Decompress(compressedPath, outputPath, &dictionaries));
+}
+
+/**
+ * @brief Unpack the regular members of a tar stream below the backup directory and queue them for hashing.
+ *
+ * @param[in] tarFile Archive to read, `-` reads standard input
+ * @param[in] backupDirectory Directory receiving the members
+ * @param[in,out] fileQueue Queue of the hashing workers
+ * @param[in,out] processImportFile Counts the members that are left out
+ * @return true if the stream was read to its end and every member unpacked, false otherwise
+ */
+bool UnpackTar(const std::filesystem::path& tarFile, const std::filesystem::path& backupDirectory, ThreadedFileQueue& fileQueue,
+               ProcessImportFile& processImportFile)
+{
+    const int descriptor = TarReader::OpenInput(tarFile);
+    if (0 > descriptor)
+    {
+        return false;
+    }
+    TarReader reader(descriptor);
+    bool unpacked = true;
+    std::unordered_set<std::string> names;
+    TarMember member{};
+    TarEntryType type = TarEntryType::Other;
+    std::error_code ec;
+    while (true == reader.Next(member, type))
+    {
+        if (TarEntryType::Directory == type)
+        {
+            continue;
+        }
+        // A name leaving the tree is never unpacked. A repeated name keeps its first member, since that one
+        // may be hashing already and its key must be recorded once.
+        const std::filesystem::path relativePath = std::filesystem::path(member.name).lexically_normal();
+        const bool contained = (true == relativePath.has_filename()) && (false == relativePath.has_root_path()) && (".." != *relativePath.begin());
+        if ((TarEntryType::RegularFile != type) || (false == contained) || (false == names.insert(relativePath.generic_string()).second))
+        {
+            processImportFile.Skip();
+            continue;
+        }
+        const std::filesystem::path destination = backupDirectory / relativePath;
+        std::filesystem::create_directories(destination.parent_path(), ec);
+        if (false == reader.ExtractTo(destination, member))
+        {
+            unpacked = false;
+            continue;
+        }
+        fileQueue.Enqueue(destination);
+    }
+    TarReader::CloseInput(descriptor);
+    return (true == unpacked) && (false == reader.Failed());
+}
+}
+
+bool RunWatch(const WatchConfig& config, const std::atomic<bool>& stopRequested)
+{
+    std::error_code ec;
+    if ((false == ChangeJournalWatcher::IsAvailable()) || (false == std::filesystem::is_directory(config.sourceDir, ec)))
+    {
+        return false;
+    }
+    SQLiteSession databaseSession(config.databaseFile, config.databaseProfile);
+    ChangeJournal changeJournal(databaseSession);
+    if (false == changeJournal.InitializeSchema())
+    {
+        return false;
+    }
+    ChangeJournalWatcher watcher(config.sourceDir, changeJournal, std::chrono::milliseconds(config.flushIntervalMs));
+    return watcher.Run(stopRequested, config.onReady);
+}
+
+bool RunBackup(const BackupConfig& config)
+{
+    // The run history is recorded from the measurements, so every run is measured.
+    BackupStats stats{};
+    return RunBackup(config, stats);
+}
+
+bool RunBackup(const BackupConfig& config, BackupStats& outputStats)
+{
+    return RunMeasured(config, outputStats, nullptr);
+}
+
+bool ReadLiveStatus(const std::string& segmentName, LiveStatus& outputStatus)
+{
+    return LiveStatusSegment::Read(segmentName, outputStatus);
+}
+
+bool RunDaemon(const DaemonConfig& config, std::atomic<bool>& stopRequested)
+{
+    BackupConfig backupConfig = config.backup;
+    backupConfig.stopRequested = &stopRequested;
+    WarmBackupState state;
+    if (false == OpenWarmState(backupConfig, state))
+    {
+        return false;
+    }
+    std::error_code ec;
+    // A trigger file that exists already has been seen; only a later change asks for a run.
+    std::filesystem::file_time_type triggerWriteTime = std::filesystem::file_time_type::min();
+    if (false == config.triggerFile.empty())
+    {
+        const std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(config.triggerFile, ec);
+        triggerWriteTime = (0 == ec.value()) ? writeTime : triggerWriteTime;
+    }
+    // With a timer the first run starts right away, as a scheduler would start it.
+    std::chrono::steady_clock::time_point nextTimedRun = std::chrono::steady_clock::now();
+    const std::chrono::milliseconds pollInterval(std::max(1U, config.pollIntervalMs));
+    while (false == stopRequested.load())
+    {
+        if (false == IsRunDue(config, state, nextTimedRun, triggerWriteTime))
+        {
+            std::this_thread::sleep_for(pollInterval);
+            continue;
+        }
+        nextTimedRun = std::chrono::steady_clock::now() + std::chrono::seconds(config.intervalSeconds);
+        BackupStats stats{};
+        const bool success = RunMeasured(backupConfig, stats, &state);
+        if (nullptr != config.onRunFinished)
+        {
+            config.onRunFinished(success, stats);
+        }
+        // Whatever made a run fail may have left the kept state behind the disk, so the next run starts cold.
+        if ((false == success) && (false == stopRequested.load()))
+        {
+            CloseWarmState(state);
+            if (false == OpenWarmState(backupConfig, state))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool PreviewBackup(const BackupConfig& config, bool hashCandidates, BackupPreview& outputPreview)
+{
+    outputPreview = BackupPreview{};
+    const bool multiRoot = (false == config.sources.empty());
+    std::vector<NamedSourceRoot> namedRoots;
+    std::vector<std::filesystem::path> walkRoots;
+    std::filesystem::path sourceRoot;
+    if (false == ResolveSources(config, namedRoots, walkRoots, sourceRoot))
+    {
+        return false;
+    }
+    const RelativePathBuilder sourceKeys = (true == multiRoot) ? RelativePathBuilder(namedRoots) : RelativePathBuilder(sourceRoot);
+    PathFilter pathFilter;
+    if (false == PathFilter::Compile(config.filterRules, pathFilter))
+    {
+        return false;
+    }
+    // As in a backup, files outside the size and mtime limits are walked so they are not counted as deleted.
+    const PathFilter patternFilter = pathFilter.WithoutLimits();
+    const PathFilter* walkFilter = (true == patternFilter.IsEmpty()) ? nullptr : &patternFilter;
+
+    // Opening a missing database would create it; without one every file is new.
+    std::error_code ec;
+    std::unique_ptr<SQLiteSession> databaseSession;
+    std::unique_ptr<FileStateRepository> fileStateRepository;
+    FileStateIndex fileStateIndex;
+    KnownPathFilter knownPathFilter;
+    if (true == std::filesystem::is_regular_file(config.databaseFile, ec))
+    {
+        databaseSession = std::make_unique<SQLiteSession>(config.databaseFile, config.databaseProfile);
+        fileStateRepository = std::make_unique<FileStateRepository>(*databaseSession);
+        if (false == fileStateRepository->OpenShards())
+        {
+            return false;
+        }
+        if ((0 != config.stateIndexMemoryLimit) && (false == fileStateIndex.Load(*fileStateRepository, config.stateIndexMemoryLimit)))
+        {
+            knownPathFilter.Load(*fileStateRepository, config.stateIndexMemoryLimit);
+        }
+    }
+    auto loadFileState = [&](const std::string& filePath, FileStateRecord& outputRecord)
+    {
+        if (true == fileStateIndex.IsLoaded())
+        {
+            return fileStateIndex.Find(filePath, outputRecord);
+        }
+        return (nullptr != fileStateRepository) && (true == knownPathFilter.MayContain(filePath)) &&
+               (true == fileStateRepository->GetFileState(filePath, outputRecord));
+    };
+
+    std::unique_ptr<FileHasher> fileHasher;
+    if (true == hashCandidates)
+    {
+        fileHasher = std::make_unique<FileHasher>(config.hashAlgorithm, config.memoryMapThreshold, config.treeHashThreads, config.readEngine,
+                                                  config.readQueueDepth, 0, config.hashBufferSize);
+    }
+    PreviewBackupFile previewBackupFile(sourceKeys, loadFileState, fileHasher.get(), config.paranoid,
+                                        (true == pathFilter.NeedsSizeAndTime()) ? &pathFilter : nullptr);
+    std::atomic<bool> success{true};
+    auto previewFile = [&](const std::filesystem::path& file)
+    {
+        if (false == previewBackupFile.Execute(file))
+        {
+            success.store(false);
+        }
+    };
+
+    // Only hashing is worth the worker threads; the metadata path classifies files on the walker threads.
+    std::unique_ptr<ThreadedFileQueue> fileQueue;
+    if (nullptr != fileHasher)
+    {
+        const PipelineSizing sizing = ResolvePipelineSizing(config);
+        fileQueue = std::make_unique<ThreadedFileQueue>(sizing.hashThreads, sizing.hashQueueDepth, previewFile);
+    }
+    FileIterator iterator(config.walkThreads, false, false, walkFilter, (true == multiRoot) ? std::filesystem::path() : config.sourceDir);
+    bool walkComplete = true;
+    for (const auto& walkRoot : walkRoots)
+    {
+        walkComplete = iterator.IterateBatches(walkRoot,
+                                               [&](std::vector<std::filesystem::path>&& files)
+                                               {
+                                                   if (nullptr != fileQueue)
+                                                   {
+                                                       fileQueue->EnqueueBatch(std::move(files));
+                                                       return;
+                                                   }
+                                                   for (const auto& file : files)
+                                                   {
+                                                       previewFile(file);
+                                                   }
+                                               }) &&
+                       (true == walkComplete);
+    }
+    if (nullptr != fileQueue)
+    {
+        fileQueue->Finalize();
+    }
+
+    // Deletions are the stored files a complete walk of directories did not reach.
+    const bool sourceIsDirectory = (true == multiRoot) || (true == std::filesystem::is_directory(config.sourceDir, ec));
+    outputPreview.deletionsCounted = (true == walkComplete) && (true == sourceIsDirectory);
+    if ((true == outputPreview.deletionsCounted) && (nullptr != fileStateRepository) && (false == previewBackupFile.CountUnseen(*fileStateRepository)))
+    {
+        outputPreview.deletionsCounted = false;
+        success.store(false);
+    }
+    previewBackupFile.Collect(outputPreview);
+    return (true == success.load()) && (true == walkComplete);
+}
+
+bool RunRestore(const RestoreConfig& config)
+{
+    return RunRestore(config, nullptr);
+}
+
+bool RunRestore(const RestoreConfig& config, const std::function<void(std::size_t)>& onPriorityRestored)
+{
+    std::error_code ec;
+    if ((false == std::filesystem::is_regular_file(config.databaseFile, ec)) || (true == config.targetDir.empty()))
+    {
+        return false;
+    }
+    PathFilterRules priorityRules;
+    priorityRules.patterns = config.priorityPatterns;
+    PathFilter priorityFilter;
+    if (false == PathFilter::Compile(priorityRules, priorityFilter))
+    {
+        return false;
+    }
+    std::filesystem::create_directories(config.targetDir, ec);
+    if (false == std::filesystem::is_directory(config.targetDir, ec))
+    {
+        return false;
+    }
+
+    SQLiteSession databaseSession(config.databaseFile);
+    FileStateRepository fileStateRepository(databaseSession);
+    PackStore packStore(config.backupRoot / "packs", databaseSession);
+    CompressionDictionaryStore dictionaryStore(databaseSession);
+    CompressionDictionaries dictionaries;
+    if ((false == fileStateRepository.InitializeSchema()) || (false == packStore.InitializeSchema()) || (false == dictionaryStore.InitializeSchema()) ||
+        (false == dictionaryStore.Load(dictionaries)))
+    {
+        return false;
+    }
+    std::unordered_map<std::string, RestoreItem> items;
+    RestorePlanner planner(config.backupRoot, fileStateRepository, packStore);
+    if (false == planner.Build(config.timestamp, items))
+    {
+        return false;
+    }
+
+    std::unique_ptr<FileEncryptor> fileEncryptor;
+    if (false == OpenEncryptor(config.encryptionKeyFile, EncryptionAlgorithm::Auto, fileEncryptor))
+    {
+        return false;
+    }
+
+    std::atomic<bool> success{true};
+    const FileCopier fileCopier(CopyMethod::Clone);
+    const FileHasher fileHasher;
+    const ProcessRestoreFile processRestoreFile(config.backupRoot, config.targetDir, fileCopier, fileHasher, fileEncryptor.get(), dictionaries,
+                                                config.databaseFile, config.verify, success);
+
+    // The priority files are split off first; the filter excludes what they match, as a walk would skip it.
+    std::unordered_map<std::string, RestoreItem> priorityItems;
+    if (false == priorityFilter.IsEmpty())
+    {
+        for (auto item = items.begin(); items.end() != item;)
+        {
+            const std::string& key = item->first;
+            const std::size_t slash = key.rfind('/');
+            const bool priority = (true == priorityFilter.ExcludesFile(key, FileEntryInfo{})) ||
+                                  ((std::string::npos != slash) && (true == priorityFilter.ExcludesDirectoryTree(std::string_view(key).substr(0, slash))));
+            if (true == priority)
+            {
+                priorityItems.insert(items.extract(item++));
+            }
+            else
+            {
+                ++item;
+            }
+        }
+    }
+
+    // Large files go first so one of them does not trail the restore on its own.
+    const unsigned int threads = (0 != config.threads) ? config.threads : std::max(MinWorkerThreadCount, std::thread::hardware_concurrency());
+    // Metadata goes on once every file of a set is written, so no later write bumps the restored times.
+    auto restoreSet = [&](const std::unordered_map<std::string, RestoreItem>& set)
+    {
+        ThreadedFileQueueOptions queueOptions;
+        queueOptions.scheduling = SchedulingPolicy::LargestFirst;
+        // The planned items are only read while the workers run, so they need no lock.
+        ThreadedFileQueue fileQueue(
+            threads, static_cast<std::size_t>(threads) * MaxQueueSizeMultiplier,
+            [&](const std::filesystem::path& relativePath)
+            {
+                const std::string relativeKey = RelativePathBuilder::KeyOf(relativePath);
+                processRestoreFile.Execute(relativeKey, set.at(relativeKey));
+            }, nullptr,
+            queueOptions);
+        std::vector<FileWorkItem> workItems;
+        workItems.reserve(set.size());
+        for (const auto& entry : set)
+        {
+            workItems.push_back(FileWorkItem{RelativePathBuilder::PathOf(entry.first), entry.second.size});
+        }
+        fileQueue.EnqueueBatch(std::move(workItems));
+        fileQueue.Finalize();
+        if ((true == config.restoreMetadata) && (false == RestoreMetadataApplier(config.targetDir, set).Apply(threads)))
+        {
+            success.store(false);
+        }
+    };
+    if (false == priorityFilter.IsEmpty())
+    {
+        restoreSet(priorityItems);
+        if ((true == success.load()) && (onPriorityRestored))
+        {
+            onPriorityRestored(priorityItems.size());
+        }
+    }
+    restoreSet(items);
+    return success.load();
+}
+
+bool RunExport(const ExportConfig& config, ExportReport& outputReport)
+{
+    outputReport = ExportReport{};
+    if (false == std::filesystem::is_regular_file(config.databaseFile))
+    {
+        return false;
+    }
+    SQLiteSession databaseSession(config.databaseFile);
+    FileStateRepository fileStateRepository(databaseSession);
+    PackStore packStore(config.backupRoot / "packs", databaseSession);
+    CompressionDictionaryStore dictionaryStore(databaseSession);
+    CompressionDictionaries dictionaries;
+    if ((false == fileStateRepository.InitializeSchema()) || (false == packStore.InitializeSchema()) || (false == dictionaryStore.InitializeSchema()) ||
+        (false == dictionaryStore.Load(dictionaries)))
+    {
+        return false;
+    }
+    std::unordered_map<std::string, RestoreItem> items;
+    RestorePlanner planner(config.backupRoot, fileStateRepository, packStore);
+    if (false == planner.Build(config.timestamp, items))
+    {
+        return false;
+    }
+    std::vector<std::pair<std::string, const RestoreItem*>> members;
+    members.reserve(items.size());
+    for (const auto& entry : items)
+    {
+        members.emplace_back(entry.first, &entry.second);
+    }
+    std::sort(members.begin(), members.end(), [](const auto& left, const auto& right) { return left.first < right.first; });
+
+    std::unique_ptr<FileEncryptor> fileEncryptor;
+    if (false == OpenEncryptor(config.encryptionKeyFile, EncryptionAlgorithm::Auto, fileEncryptor))
+    {
+        return false;
+    }
+    std::unique_ptr<StreamCompressor> compressor;
+    if (true == config.compress)
+    {
+        compressor = std::make_unique<StreamCompressor>(config.compressionLevel, config.compressionThreads);
+        if (false == compressor->IsValid())
+        {
+            return false;
+        }
+    }
+
+    // Each export stages into its own directory, so two exports of one store do not share staging files.
+    std::error_code ec;
+    const std::filesystem::path stagingDir =
+        config.backupRoot / "staging" / ("export-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::filesystem::create_directories(stagingDir, ec);
+    const int descriptor = ExportStream::OpenOutput(config.outputFile);
+    if ((false == std::filesystem::is_directory(stagingDir, ec)) || (0 > descriptor))
+    {
+        std::filesystem::remove_all(stagingDir, ec);
+        ExportStream::CloseOutput(descriptor);
+        return false;
+    }
+
+    std::atomic<bool> success{true};
+    const FileCopier fileCopier(CopyMethod::Clone);
+    const FileHasher fileHasher;
+    const ProcessRestoreFile processRestoreFile(config.backupRoot, stagingDir, fileCopier, fileHasher, fileEncryptor.get(), dictionaries,
+                                                config.databaseFile, config.verify, success);
+    const unsigned int threads = (0 != config.threads) ? config.threads : std::max(MinWorkerThreadCount, std::thread::hardware_concurrency());
+    ExportStream stream(descriptor, compressor.get());
+    TarExporter exporter(processRestoreFile, stagingDir, stream, threads, static_cast<std::size_t>(threads) * TarExporter::DefaultSlotsPerThread);
+    bool exported = exporter.Export(members);
+    exported = (true == ExportStream::CloseOutput(descriptor)) && (true == exported);
+    std::filesystem::remove_all(stagingDir, ec);
+
+    outputReport.members = exporter.Members();
+    outputReport.contentBytes = exporter.ContentBytes();
+    outputReport.outputBytes = stream.BytesWritten();
+    outputReport.splicedBytes = stream.SplicedBytes();
+    return exported;
+}
+
+/**
+ * @brief Everything an opened HistoryMount reads through; members are declared in the order they depend on each other.
+ */
+struct HistoryMount::State
+{
+    std::unique_ptr<SQLiteSession> databaseSession;           /**< Session on the backup database */
+    std::unique_ptr<FileStateRepository> fileStateRepository; /**< Version history and runs */
+    std::unique_ptr<PackStore> packStore;                     /**< Index of the pack segments */
+    CompressionDictionaries dictionaries;                     /**< Dictionaries of compressed versions */
+    std::unique_ptr<FileEncryptor> fileEncryptor;             /**< Decrypts encrypted copies, nullptr without a key */
+    std::filesystem::path stagingDir;                         /**< Directory rebuilt versions are kept in */
+    std::atomic<bool> success{true};                          /**< Required by ProcessRestoreFile, which only clears it in Execute */
+    FileCopier fileCopier{CopyMethod::Clone};                 /**< Unused by Stage for rebuilt versions, required by ProcessRestoreFile */
+    FileHasher fileHasher;                                    /**< Checks rebuilt versions against their digest */
+    std::unique_ptr<ProcessRestoreFile> processRestoreFile;   /**< Rebuilds versions into staging files */
+    std::unique_ptr<HistoryMountView> view;                   /**< Paths, trees and the block cache */
+};
+
+HistoryMount::HistoryMount(const MountConfig& configuration) : _configuration(configuration)
+{
+}
+
+HistoryMount::~HistoryMount()
+{
+    if (nullptr != _state)
+    {
+        std::error_code ec;
+        const std::filesystem::path stagingDir = _state->stagingDir;
+        _state.reset();
+        std::filesystem::remove_all(stagingDir, ec);
+    }
+}
+
+bool HistoryMount::Open()
+{
+    std::error_code ec;
+    if ((nullptr != _state) || (false == std::filesystem::is_regular_file(_configuration.databaseFile, ec)))
+    {
+        return false;
+    }
+    auto state = std::make_unique<State>();
+    state->databaseSession = std::make_unique<SQLiteSession>(_configuration.databaseFile);
+    state->fileStateRepository = std::make_unique<FileStateRepository>(*state->databaseSession);
+    state->packStore = std::make_unique<PackStore>(_configuration.backupRoot / "packs", *state->databaseSession);
+    CompressionDictionaryStore dictionaryStore(*state->databaseSession);
+    if ((false == state->fileStateRepository->InitializeSchema()) || (false == state->packStore->InitializeSchema()) ||
+        (false == dictionaryStore.InitializeSchema()) || (false == dictionaryStore.Load(state->dictionaries)) ||
+        (false == OpenEncryptor(_configuration.encryptionKeyFile, EncryptionAlgorithm::Auto, state->fileEncryptor)))
+    {
+        return false;
+    }
+
+    // Each mount stages into its own directory, like an export, so two mounts of one store do not share staging files.
+    state->stagingDir = _configuration.backupRoot / "staging" / ("mount-" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    state->processRestoreFile = std::make_unique<ProcessRestoreFile>(_configuration.backupRoot, state->stagingDir, state->fileCopier, state->fileHasher,
+                                                                     state->fileEncryptor.get(), state->dictionaries, _configuration.databaseFile,
+                                                                     _configuration.verify, state->success);
+    const std::size_t cacheBlocks = (_configuration.cacheMegabytes * 1024 * 1024) / BlockSize;
+    state->view = std::make_unique<HistoryMountView>(_configuration.backupRoot, *state->fileStateRepository, *state->packStore,
+                                                     *state->processRestoreFile, state->stagingDir, cacheBlocks);
+    if (false == state->view->LoadPoints())
+    {
+        return false;
+    }
+    _state = std::move(state);
+    return true;
+}
+
+bool HistoryMount::Stat(const std::string& path, HistoryMountEntry& outputEntry)
+{
+    return (nullptr != _state) && (true == _state->view->Stat(path, outputEntry));
+}
+
+bool HistoryMount::List(const std::string& path, std::vector<std::string>& outputNames)
+{
+    outputNames.clear();
+    return (nullptr != _state) && (true == _state->view->List(path, outputNames));
+}
+
+bool HistoryMount::Read(const std::string& path, std::uint64_t offset, std::size_t size, char* buffer, std::size_t& outputRead)
+{
+    outputRead = 0;
+    return (nullptr != _state) && (true == _state->view->Read(path, offset, size, buffer, outputRead));
+}
+
+HistoryMountCounters HistoryMount::Counters() const
+{
+    return (nullptr != _state) ? _state->view->Counters() : HistoryMountCounters{0, 0, 0};
+}
+
+bool IsMountSupported()
+{
+#ifdef RDEMO_HAVE_FUSE
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool RunMount(const MountConfig& config)
+{
+#ifdef RDEMO_HAVE_FUSE
+    std::error_code ec;
+    if (false == std::filesystem::is_directory(config.mountPoint, ec))
+    {
+        return false;
+    }
+    HistoryMount historyMount(config);
+    return (true == historyMount.Open()) && (true == ServeFuseMount(historyMount, config.mountPoint));
+#else
+    static_cast<void>(config);
+    return false;
+#endif
+}
+
+bool RunImport(const ImportConfig& config, ImportReport& outputReport)
+{
+    outputReport = ImportReport{};
+    std::error_code ec;
+    const bool fromTar = (false == config.tarFile.empty());
+    if ((true == fromTar) == (false == config.mirrorDir.empty()))
+    {
+        return false;
+    }
+    if ((false == fromTar) && (false == std::filesystem::is_directory(config.mirrorDir, ec)))
+    {
+        return false;
+    }
+    // Only a new store is seeded, so nothing already backed up can be overwritten or recorded twice.
+    const std::filesystem::path backupDirectory = config.backupRoot / "backup";
+    if ((true == std::filesystem::exists(backupDirectory, ec)) && (false == std::filesystem::is_empty(backupDirectory, ec)))
+    {
+        return false;
+    }
+    std::filesystem::create_directories(backupDirectory, ec);
+    if (false == std::filesystem::is_directory(backupDirectory, ec))
+    {
+        return false;
+    }
+
+    SQLiteSession databaseSession(config.databaseFile);
+    FileStateRepository fileStateRepository(databaseSession);
+    bool hasFileStates = true;
+    BackupRunRecord run{};
+    if ((false == fileStateRepository.InitializeSchema()) || (false == fileStateRepository.HasFileStates(hasFileStates)) || (true == hasFileStates) ||
+        (false == fileStateRepository.BeginGeneration(RunContext().Timestamp(), false, run)) || (false == fileStateRepository.BeginBulkImport()))
+    {
+        return false;
+    }
+    // Like a first backup, the import appends every row and is flushed once at the end.
+    databaseSession.SetSyncDeferred(true);
+
+    std::atomic<bool> success{true};
+    const FileCopier fileCopier(CopyMethod::Clone);
+    const FileHasher fileHasher(config.hashAlgorithm);
+    FileStateBatchWriter batchWriter(fileStateRepository, BackupConfig::DefaultStateBatchSize,
+                                     std::chrono::milliseconds(BackupConfig::DefaultStateBatchIntervalMs), nullptr);
+    // Tar members are unpacked into place by the reading thread, so they are keyed relative to the backup directory.
+    ProcessImportFile processImportFile((true == fromTar) ? backupDirectory : config.mirrorDir, backupDirectory, config.sourceDir, config.method,
+                                        fileCopier, fileHasher, batchWriter, run.started);
+    const unsigned int threads = (0 != config.threads) ? config.threads : std::max(MinWorkerThreadCount, std::thread::hardware_concurrency());
+    {
+        ThreadedFileQueue fileQueue(
+            threads, static_cast<std::size_t>(threads) * MaxQueueSizeMultiplier,
+            [&](const std::filesystem::path& file)
+            {
+                if (false == processImportFile.Execute(file))
+                {
+                    success.store(false);
+                }
+            },
+            [&]()
+            {
+                if (false == batchWriter.FlushCurrentThread())
+                {
+                    success.store(false);
+                }
+            });
+        if (true == fromTar)
+        {
+            success.store((true == UnpackTar(config.tarFile, backupDirectory, fileQueue, processImportFile)) && (true == success.load()));
+        }
+        else
+        {
+            for (std::filesystem::recursive_directory_iterator entry(config.mirrorDir, ec), end; (0 == ec.value()) && (end != entry); entry.increment(ec))
+            {
+                const std::filesystem::file_status status = entry->symlink_status(ec);
+                if (true == std::filesystem::is_regular_file(status))
+                {
+                    fileQueue.Enqueue(entry->path());
+                }
+                else if (false == std::filesystem::is_directory(status))
+                {
+                    processImportFile.Skip();
+                }
+            }
+            if (0 != ec.value())
+            {
+                success.store(false);
+            }
+        }
+        fileQueue.Finalize();
+    }
+    if ((false == batchWriter.FlushAll()) || (false == fileStateRepository.FinishBulkImport()))
+    {
+        success.store(false);
+    }
+    if (false == fileStateRepository.FinishGeneration(success.load()))
+    {
+        success.store(false);
+    }
+    DatabaseMaintenance(databaseSession).Optimize();
+    databaseSession.SetSyncDeferred(false);
+    if (false == DurabilityBarrier(std::vector<std::filesystem::path>{config.databaseFile, backupDirectory}).Sync())
+    {
+        success.store(false);
+    }
+    processImportFile.Collect(outputReport);
+    return (true == success.load()) && (0 == outputReport.failed);
+}
+
+bool RunVerify(const VerifyConfig& config, VerifyReport& outputReport)
+{
+    outputReport = VerifyReport{};
+    std::error_code ec;
+    if ((false == std::filesystem::is_regular_file(config.databaseFile, ec)) || (0 == config.slices))
+    {
+        return false;
+    }
+
+    SQLiteSession databaseSession(config.databaseFile);
+    FileStateRepository fileStateRepository(databaseSession);
+    VerifySchedule verifySchedule(databaseSession);
+    PackStore packStore(config.backupRoot / "packs", databaseSession);
+    unsigned int slice = 0;
+    if ((false == fileStateRepository.InitializeSchema()) || (false == verifySchedule.InitializeSchema()) || (false == packStore.InitializeSchema()) ||
+        (false == verifySchedule.NextSlice(config.slices, slice)))
+    {
+        return false;
+    }
+    outputReport.slice = slice;
+    outputReport.slices = config.slices;
+
+    // Items are keyed by the stored path relative to the backup root, which is also how problems are reported.
+    std::unordered_map<std::string, VerifyItem> items;
+    const bool listed = fileStateRepository.ForEachFileState(
+        [&](const std::string& filePath, const FileStateRecord& record)
+        {
+            if ((ChangeType::Deleted != record.status) && (slice == VerifySchedule::SliceOf(filePath, config.slices)))
+            {
+                const std::string storedKey = (std::filesystem::path("backup") / filePath).generic_string();
+                VerifyItem item{config.backupRoot / storedKey, record.metadata.size, record.hash, record.hashAlgorithm, false, PackLocation{}};
+                std::error_code existsError;
+                if (false == std::filesystem::exists(item.storedPath, existsError))
+                {
+                    item.packed = packStore.Find(item.hash, item.hashAlgorithm, item.packLocation);
+                }
+                items.emplace(storedKey, item);
+            }
+            return true;
+        });
+    if (false == listed)
+    {
+        return false;
+    }
+    std::unordered_map<std::string, std::filesystem::path> coldRoots;
+    if ((true == config.snapshots) && (false == fileStateRepository.GetColdSnapshots(coldRoots)))
+    {
+        return false;
+    }
+    if (true == config.snapshots)
+    {
+        const bool archivedListed = fileStateRepository.ForEachArchivedVersion(
+            [&](const FileVersionRecord& version)
+            {
+                if (slice != VerifySchedule::SliceOf(version.path, config.slices))
+                {
+                    return true;
+                }
+                const std::string storedKey = (std::filesystem::path("deleted") / version.snapshot / version.path).generic_string();
+                const std::filesystem::path storedPath = SnapshotTierMover::SnapshotDirectory(config.backupRoot, coldRoots, version.snapshot) / version.path;
+                std::error_code existsError;
+                const bool plainExists = std::filesystem::exists(storedPath, existsError);
+                if (false == plainExists)
+                {
+                    // Versions archived in another form have no plain copy to hash.
+                    for (const char* suffix : {ChunkStore::ManifestSuffix, FileCompressor::CompressedSuffix, FileDelta::DeltaSuffix})
+                    {
+                        std::filesystem::path archivedForm = storedPath;
+                        archivedForm += suffix;
+                        if (true == std::filesystem::exists(archivedForm, existsError))
+                        {
+                            ++outputReport.filesSkipped;
+                            return true;
+                        }
+                    }
+                }
+                VerifyItem item{storedPath, version.size, version.hash, version.hashAlgorithm, false, PackLocation{}};
+                if (false == plainExists)
+                {
+                    item.packed = packStore.Find(item.hash, item.hashAlgorithm, item.packLocation);
+                }
+                items.emplace(storedKey, item);
+                return true;
+            });
+        if (false == archivedListed)
+        {
+            return false;
+        }
+    }
+
+    std::unique_ptr<FileEncryptor> fileEncryptor;
+    if (false == OpenEncryptor(config.encryptionKeyFile, EncryptionAlgorithm::Auto, fileEncryptor))
+    {
+        return false;
+    }
+    std::unique_ptr<IoThrottle> ioThrottle;
+    if (true == config.ioLimits.IsLimited())
+    {
+        ioThrottle = std::make_unique<IoThrottle>(config.ioLimits);
+    }
+    const FileHasher fileHasher(FileHasher::DefaultAlgorithm, FileHasher::DefaultMemoryMapThreshold, 0, ReadEngine::Blocking,
+                                FileHasher::DefaultReadQueueDepth, 0, FileHasher::DefaultReadBufferSize, ioThrottle.get());
+    ProcessVerifyFile processVerifyFile(fileHasher, packStore.Root(), fileEncryptor.get(), ioThrottle.get(),
+                                        (true == config.repair) ? config.backupRoot / ParityFile::Area : std::filesystem::path());
+
+    // Large files go first so one of them does not trail the run on its own.
+    const unsigned int threads = (0 != config.threads) ? config.threads : std::max(MinWorkerThreadCount, std::thread::hardware_concurrency());
+    ThreadedFileQueueOptions queueOptions;
+    queueOptions.scheduling = SchedulingPolicy::LargestFirst;
+    // The planned items are only read while the workers run, so they need no lock.
+    ThreadedFileQueue fileQueue(
+        threads, static_cast<std::size_t>(threads) * MaxQueueSizeMultiplier,
+        [&](const std::filesystem::path& storedPath)
+        {
+            const std::string storedKey = RelativePathBuilder::KeyOf(storedPath);
+            processVerifyFile.Execute(storedKey, items.at(storedKey));
+        },
+        nullptr, queueOptions);
+    std::vector<FileWorkItem> workItems;
+    workItems.reserve(items.size());
+    for (const auto& entry : items)
+    {
+        workItems.push_back(FileWorkItem{RelativePathBuilder::PathOf(entry.first), entry.second.size});
+    }
+    fileQueue.EnqueueBatch(std::move(workItems));
+    fileQueue.Finalize();
+    processVerifyFile.Collect(outputReport);
+
+    return verifySchedule.Advance(config.slices, slice);
 }
 
-bool RunBackup(const BackupConfig& config)
+std::vector<std::string> SelectSnapshotsToKeep(const std::vector<std::string>& names, const RetentionPolicy& policy)
 {
-    std::atomic<bool> success{true};
+    std::vector<std::string> newestFirst(names);
+    std::sort(newestFirst.begin(), newestFirst.end(), std::greater<std::string>());
+    newestFirst.erase(std::unique(newestFirst.begin(), newestFirst.end()), newestFirst.end());
+
+    std::set<std::string> kept(newestFirst.begin(), newestFirst.begin() + std::min<std::size_t>(policy.keepLast, newestFirst.size()));
+    // Each rule keeps the newest snapshot of its newest periods; a name without a date is never expired.
+    const auto keepPeriods = [&](unsigned int periods, std::int64_t daysPerPeriod, std::int64_t dayOffset)
+    {
+        std::set<std::int64_t> seen;
+        for (const std::string& name : newestFirst)
+        {
+            std::int64_t day = 0;
+            if (false == SnapshotDay(name, day))
+            {
+                kept.insert(name);
+            }
+            else if ((seen.size() < periods) && (true == seen.insert((day + dayOffset) / daysPerPeriod).second))
+            {
+                kept.insert(name);
+            }
+        }
+    };
+    keepPeriods(policy.keepDaily, 1, 0);
+    keepPeriods(policy.keepWeekly, DaysPerWeek, EpochDaysAfterMonday);
+    return std::vector<std::string>(kept.begin(), kept.end());
+}
+
+bool RunPrune(const PruneConfig& config, PruneReport& outputReport)
+{
+    outputReport = PruneReport{};
+    // A policy keeping nothing would delete the whole history, which is never what was meant.
+    if ((0 == config.policy.keepLast) && (0 == config.policy.keepDaily) && (0 == config.policy.keepWeekly))
+    {
+        return false;
+    }
+    std::error_code ec;
+    if (false == std::filesystem::is_regular_file(config.databaseFile, ec))
+    {
+        return false;
+    }
+
+    SQLiteSession databaseSession(config.databaseFile);
+    FileStateRepository fileStateRepository(databaseSession);
+    if (false == fileStateRepository.InitializeSchema())
+    {
+        return false;
+    }
+    SnapshotPruner snapshotPruner(config.backupRoot, fileStateRepository);
+    if (false == snapshotPruner.Plan(config.policy, outputReport))
+    {
+        return false;
+    }
+    if (true == config.dryRun)
+    {
+        return true;
+    }
+    const unsigned int threads = (0 != config.threads) ? config.threads : std::max(MinWorkerThreadCount, std::thread::hardware_concurrency());
+    return snapshotPruner.Execute(threads, static_cast<std::size_t>(threads) * MaxQueueSizeMultiplier, outputReport);
+}
+
+bool RunConsolidate(const ConsolidateConfig& config, ConsolidateReport& outputReport)
+{
+    outputReport = ConsolidateReport{};
+    std::error_code ec;
+    if (false == std::filesystem::is_regular_file(config.databaseFile, ec))
+    {
+        return false;
+    }
+    // A running backup archives new deltas into the chains being rewritten.
+    SQLiteSession databaseSession(config.databaseFile, SQLitePerformanceProfile::Safe, SQLiteSession::DefaultMaxConnections, SQLiteOpenMode::ReadOnly);
+    FileStateRepository fileStateRepository(databaseSession);
+    bool running = false;
+    if ((false == InitializeForQueries(fileStateRepository, config.databaseFile)) || (false == fileStateRepository.IsRunInProgress(running)) ||
+        (true == running))
+    {
+        return false;
+    }
+
+    ConsolidateConfig effectiveConfig = config;
+    effectiveConfig.threads = (0 != config.threads) ? config.threads : std::max(MinWorkerThreadCount, std::thread::hardware_concurrency());
+    IoThrottle ioThrottle(config.ioLimits);
+    DeltaChainConsolidator deltaChainConsolidator(effectiveConfig, ioThrottle);
+    return (true == deltaChainConsolidator.Plan(outputReport)) &&
+           (true == deltaChainConsolidator.Execute(static_cast<std::size_t>(effectiveConfig.threads) * MaxQueueSizeMultiplier, outputReport));
+}
+
+bool RunTier(const TierConfig& config, TierReport& outputReport)
+{
+    outputReport = TierReport{};
     std::error_code ec;
+    if ((false == std::filesystem::is_regular_file(config.databaseFile, ec)) || (true == config.coldRoot.empty()) ||
+        (true == std::filesystem::exists(config.backupRoot / "objects", ec)))
+    {
+        return false;
+    }
+    std::filesystem::create_directories(config.coldRoot / "deleted", ec);
+    if ((0 != ec.value()) || (true == std::filesystem::equivalent(config.coldRoot, config.backupRoot, ec)))
+    {
+        return false;
+    }
+
+    SQLiteSession databaseSession(config.databaseFile);
+    FileStateRepository fileStateRepository(databaseSession);
+    bool running = false;
+    if ((false == fileStateRepository.InitializeSchema()) || (false == fileStateRepository.IsRunInProgress(running)) || (true == running))
+    {
+        return false;
+    }
+    const std::time_t cutoff = std::time(nullptr) - static_cast<std::time_t>(config.olderThanDays) * SecondsPerDay;
+    SnapshotTierMover snapshotTierMover(config, fileStateRepository);
+    return (true == snapshotTierMover.Plan(TimestampProvider::FormatFilesystemSafe(cutoff))) && (true == snapshotTierMover.Execute(outputReport));
+}
 
-    std::filesystem::path sourceRoot = std::filesystem::is_regular_file(config.sourceDir, ec) ? config.sourceDir.parent_path()
-                                                                                               : config.sourceDir;
-    if ((0 != ec.value()) || (false == std::filesystem::exists(sourceRoot)))
+bool RunMaintain(const MaintainConfig& config, MaintainReport& outputReport)
+{
+    outputReport = MaintainReport{};
+    std::error_code ec;
+    if (false == std::filesystem::is_regular_file(config.databaseFile, ec))
     {
         return false;
     }
 
-    std::filesystem::path backupRoot = config.backupRoot / "backup";
-    std::filesystem::path historyRoot = config.backupRoot / "deleted";
-    std::filesystem::create_directories(backupRoot, ec);
-    std::filesystem::create_directories(historyRoot, ec);
+    SQLiteSession databaseSession(config.databaseFile);
+    FileStateRepository fileStateRepository(databaseSession);
+    DatabaseMaintenance databaseMaintenance(databaseSession);
+    if ((false == fileStateRepository.InitializeSchema()) || (false == databaseMaintenance.Size(outputReport.bytesBefore)))
+    {
+        return false;
+    }
+    if (0 != config.purgeDeletedDays)
+    {
+        const std::time_t cutoff = std::time(nullptr) - static_cast<std::time_t>(config.purgeDeletedDays) * SecondsPerDay;
+        if (false == fileStateRepository.PurgeDeletedFiles(TimestampProvider::FormatFilesystemSafe(cutoff), outputReport.rowsPurged))
+        {
+            return false;
+        }
+    }
+    if ((true == config.vacuum) && (false == databaseMaintenance.EnableIncrementalVacuum(outputReport.converted)))
+    {
+        return false;
+    }
+    return (true == databaseMaintenance.Analyze()) && (true == databaseMaintenance.IncrementalVacuum()) &&
+           (true == databaseMaintenance.Size(outputReport.bytesAfter));
+}
 
+bool RunReplicate(const ReplicateConfig& config, ReplicateReport& outputReport)
+{
+    outputReport = ReplicateReport{};
+    std::error_code ec;
+    if (false == std::filesystem::is_regular_file(config.databaseFile, ec))
+    {
+        return false;
+    }
+    std::filesystem::create_directories(config.target, ec);
+    if (0 != ec.value())
+    {
+        return false;
+    }
+    // VACUUM INTO attaches its output with the flags of the connection, so the session cannot be read-only.
     SQLiteSession databaseSession(config.databaseFile);
     FileStateRepository fileStateRepository(databaseSession);
     if (false == fileStateRepository.InitializeSchema())
     {
         return false;
     }
+    StoreReplicator storeReplicator(config.backupRoot, config.target, fileStateRepository);
+    if (false == storeReplicator.Plan(outputReport))
+    {
+        return false;
+    }
+    const unsigned int threads = (0 != config.threads) ? config.threads : std::max(MinWorkerThreadCount, std::thread::hardware_concurrency());
+    return storeReplicator.Execute(databaseSession.Acquire(), config.databaseFile, threads, static_cast<std::size_t>(threads) * MaxQueueSizeMultiplier,
+                                   outputReport);
+}
 
-    std::mutex progressMutex;
-    auto threadSafeProgress = [&](const BackupProgress& prog)
+bool RunHistory(const HistoryConfig& config, HistoryReport& outputReport)
+{
+    outputReport = HistoryReport{};
+    std::error_code ec;
+    if (false == std::filesystem::is_regular_file(config.databaseFile, ec))
+    {
+        return false;
+    }
+    SQLiteSession databaseSession(config.databaseFile, SQLitePerformanceProfile::Safe, SQLiteSession::DefaultMaxConnections, SQLiteOpenMode::ReadOnly);
+    RunHistoryLog historyLog(databaseSession);
+    if (false == historyLog.InitializeSchema())
     {
-        if (nullptr == config.onProgress)
+        // A database no run of this build recorded into lacks the history tables until created read-write.
+        SQLiteSession createSession(config.databaseFile);
+        RunHistoryLog createLog(createSession);
+        if ((false == createLog.InitializeSchema()) || (false == historyLog.InitializeSchema()))
         {
-            return;
+            return false;
         }
-        std::lock_guard<std::mutex> lock(progressMutex);
-        config.onProgress(prog);
-    };
+    }
+    return historyLog.GetLatest(config.limit, outputReport.runs);
+}
 
-    std::atomic<std::size_t> processedCount{0};
+bool RunDiff(const DiffConfig& config, DiffReport& outputReport)
+{
+    outputReport = DiffReport{};
+    std::error_code ec;
+    if ((false == std::filesystem::is_regular_file(config.databaseFile, ec)) ||
+        (false == std::filesystem::is_regular_file(config.otherDatabaseFile, ec)))
+    {
+        return false;
+    }
 
-    TimestampProvider timestampProvider;
-    SnapshotDirectoryProvider snapshotOnce(historyRoot, timestampProvider);
-    FileHasher fileHasher;
+    SQLiteSession fromSession(config.databaseFile);
+    SQLiteSession toSession(config.otherDatabaseFile);
+    FileStateRepository fromRepository(fromSession);
+    FileStateRepository toRepository(toSession);
+    std::uint64_t fromRefreshed = 0;
+    std::uint64_t toRefreshed = 0;
+    if ((false == fromRepository.InitializeSchema()) || (false == toRepository.InitializeSchema()) ||
+        (false == fromRepository.RefreshDirectoryDigests(fromRefreshed)) || (false == toRepository.RefreshDirectoryDigests(toRefreshed)))
+    {
+        return false;
+    }
+    outputReport.digestsRefreshed = fromRefreshed + toRefreshed;
+    StateTreeDiff diff(fromRepository, toRepository);
+    return diff.Compare(outputReport);
+}
 
-    ProcessBackupFile processBackupFile(sourceRoot, backupRoot, snapshotOnce, fileStateRepository, fileHasher, timestampProvider,
-                                        threadSafeProgress, success, processedCount);
+bool RunSnapshotDiff(const SnapshotDiffConfig& config, const std::function<bool(const DiffEntry&)>& onEntry)
+{
+    std::error_code ec;
+    if ((true == config.from.empty()) || (true == config.to.empty()) || (false == std::filesystem::is_regular_file(config.databaseFile, ec)))
+    {
+        return false;
+    }
+    SQLiteSession databaseSession(config.databaseFile, SQLitePerformanceProfile::Safe, SQLiteSession::DefaultMaxConnections, SQLiteOpenMode::ReadOnly);
+    FileStateRepository fileStateRepository(databaseSession);
+    return (true == InitializeForQueries(fileStateRepository, config.databaseFile)) &&
+           (true == fileStateRepository.ForEachChangeBetween(config.from, config.to, onEntry));
+}
 
-    unsigned int threadCount = std::max(MinWorkerThreadCount, std::thread::hardware_concurrency());
-    const std::size_t maxQueueSize = threadCount * MaxQueueSizeMultiplier;
+bool RunFind(const FindConfig& config, const std::function<bool(const FoundVersion&)>& onVersion)
+{
+    std::error_code ec;
+    if ((true == config.pattern.empty()) || (false == std::filesystem::is_regular_file(config.databaseFile, ec)))
+    {
+        return false;
+    }
+    SQLiteSession databaseSession(config.databaseFile, SQLitePerformanceProfile::Safe, SQLiteSession::DefaultMaxConnections, SQLiteOpenMode::ReadOnly);
+    FileStateRepository fileStateRepository(databaseSession);
+    bool running = false;
+    if ((false == InitializeForQueries(fileStateRepository, config.databaseFile)) || (false == fileStateRepository.IsRunInProgress(running)))
+    {
+        return false;
+    }
+    if (false == running)
+    {
+        // Indexing the new paths takes the write lock, which a running backup holds for long stretches; meanwhile
+        // the search only covers the paths indexed before that run started.
+        SQLiteSession indexSession(config.databaseFile);
+        FileStateRepository indexRepository(indexSession);
+        std::uint64_t indexed = 0;
+        if ((false == indexRepository.InitializeSchema()) || (false == indexRepository.RefreshPathSearch(indexed)))
+        {
+            return false;
+        }
+    }
+    const bool wildcard = (std::string::npos != config.pattern.find_first_of("*?["));
+    const std::string pattern = (true == wildcard) ? config.pattern : ("*" + config.pattern + "*");
+    FoundVersion found{};
+    return fileStateRepository.ForEachVersionMatching(pattern,
+                                                      [&](const FileVersionRecord& version)
+                                                      {
+                                                          found.path = version.path;
+                                                          found.version = version.version;
+                                                          found.size = version.size;
+                                                          found.snapshot = version.snapshot;
+                                                          return onVersion(found);
+                                                      });
+}
 
-    ThreadedFileQueue fileQueue(threadCount, maxQueueSize,
-                                [&](const std::filesystem::path& file) { processBackupFile.Execute(file); });
+bool RunHashManifest(const HashManifestConfig& config, HashManifestReport& outputReport)
+{
+    outputReport = HashManifestReport{};
+    std::error_code ec;
+    if (false == std::filesystem::exists(config.sourceDir, ec))
+    {
+        return false;
+    }
+    PathFilter pathFilter;
+    if (false == PathFilter::Compile(config.filterRules, pathFilter))
+    {
+        return false;
+    }
+    std::unique_ptr<SQLiteSession> hashCacheSession;
+    std::unique_ptr<HashCache> hashCache;
+    if (false == config.hashCacheFile.empty())
+    {
+        hashCacheSession = std::make_unique<SQLiteSession>(config.hashCacheFile);
+        hashCache = std::make_unique<HashCache>(*hashCacheSession);
+        if (false == hashCache->InitializeSchema())
+        {
+            return false;
+        }
+    }
+    std::ofstream output(config.outputFile, std::ios::binary | std::ios::trunc);
+    if (false == output.is_open())
+    {
+        return false;
+    }
+    std::string algorithmName = HashAlgorithmToString(config.hashAlgorithm);
+    std::transform(algorithmName.begin(), algorithmName.end(), algorithmName.begin(),
+                   [](unsigned char character) { return static_cast<char>(std::tolower(character)); });
+    output << "%%%% HASHDEEP-1.0\n%%%% size," << algorithmName << ",filename\n";
 
-    FileIterator iterator;
-    iterator.Iterate(config.sourceDir, [&](const std::filesystem::path& file) { fileQueue.Enqueue(file); });
+    const unsigned int threads = (0 != config.threads) ? config.threads : std::max(MinWorkerThreadCount, std::thread::hardware_concurrency());
+    const FileHasher fileHasher(config.hashAlgorithm, FileHasher::DefaultMemoryMapThreshold, 0, config.readEngine);
+    const DigestAttributeCache digestAttributeCache;
+    const RelativePathBuilder sourceKeys(config.sourceDir);
+    ProcessHashManifestFile processHashManifestFile(sourceKeys, fileHasher, hashCache.get(),
+                                                    (true == config.digestAttributes) ? &digestAttributeCache : nullptr, output);
+    std::atomic<bool> success{true};
+    ThreadedFileQueueOptions queueOptions;
+    queueOptions.fileWorkItem = [&](const FileWorkItem& item)
+    {
+        if (false == processHashManifestFile.Execute(item))
+        {
+            success.store(false);
+        }
+    };
+    ThreadedFileQueue fileQueue(threads, static_cast<std::size_t>(threads) * MaxQueueSizeMultiplier, nullptr, nullptr, queueOptions);
 
+    // A sorted walk reports on the calling thread, so the positions are numbered without a lock.
+    std::uint64_t sequence = 0;
+    FileIterator iterator(config.walkThreads, config.sorted, true, (true == pathFilter.IsEmpty()) ? nullptr : &pathFilter, config.sourceDir);
+    const bool walkComplete = iterator.IterateBatchesWithInfo(config.sourceDir,
+                                                              [&](std::vector<FileEntry>&& files)
+                                                              {
+                                                                  std::vector<FileWorkItem> items;
+                                                                  items.reserve(files.size());
+                                                                  for (auto& file : files)
+                                                                  {
+                                                                      FileWorkItem item;
+                                                                      item.path = std::move(file.path);
+                                                                      item.costHint = file.info.size;
+                                                                      item.device = file.info.device;
+                                                                      item.hasMetadata = file.info.hasMetadata;
+                                                                      item.metadata = file.info.metadata;
+                                                                      if (true == config.sorted)
+                                                                      {
+                                                                          item.attachment = std::make_shared<ManifestSequence>(sequence++);
+                                                                      }
+                                                                      items.push_back(std::move(item));
+                                                                  }
+                                                                  fileQueue.EnqueueBatch(std::move(items));
+                                                              });
     fileQueue.Finalize();
+    const bool written = processHashManifestFile.Collect(outputReport);
+    return (true == walkComplete) && (true == success.load()) && (true == written);
+}
 
-    if (true == success.load())
+bool RunServe(const ServeConfig& config, const std::atomic<bool>& stopRequested)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(config.backupRoot, ec);
+    if (false == std::filesystem::is_directory(config.backupRoot, ec))
     {
-        ProcessDeletedFiles processDeletedFiles(sourceRoot, backupRoot, snapshotOnce, fileStateRepository, timestampProvider,
-                                                threadSafeProgress);
-        success.store(processDeletedFiles.Execute());
+        return false;
     }
+    RemoteBackupServer server(config);
+    return server.Run(stopRequested);
+}
 
-    return success.load();
-}
\ No newline at end of file
+bool RunRemoteBackup(const RemoteBackupConfig& config, RemoteBackupReport& outputReport)
+{
+    RemoteBackupClient client(config);
+    return client.Run(outputReport);
+}
+
+bool RunPartitionPlan(const PartitionPlanConfig& config, PartitionPlanReport& outputReport)
+{
+    outputReport = PartitionPlanReport{};
+    const std::filesystem::path partitionsRoot = config.backupRoot / PartitionsDirectory;
+    std::error_code ec;
+    std::filesystem::create_directories(partitionsRoot, ec);
+    if ((0 == config.partitions) || (false == std::filesystem::is_directory(config.sourceDir, ec)) ||
+        (false == std::filesystem::is_directory(partitionsRoot, ec)))
+    {
+        return false;
+    }
+
+    std::map<std::string, PartitionEntryCost> costs;
+    {
+        SQLiteSession catalogSession(partitionsRoot / PartitionCatalogFile);
+        PartitionCatalog catalog(catalogSession);
+        if ((false == catalog.InitializeSchema()) || (false == catalog.GetEntryCosts(costs)))
+        {
+            return false;
+        }
+    }
+    // Until the first merge, a single-node backup kept in the same root knows what each entry costs.
+    const std::filesystem::path singleNodeDatabase = config.backupRoot / "backup.db";
+    if ((true == costs.empty()) && (true == std::filesystem::is_regular_file(singleNodeDatabase, ec)) &&
+        (false == AccumulateEntryCosts(singleNodeDatabase, costs)))
+    {
+        return false;
+    }
+
+    std::vector<PartitionCandidate> candidates;
+    std::vector<bool> measured;
+    std::uint64_t measuredWeight = 0;
+    for (std::filesystem::directory_iterator entry(config.sourceDir, ec), end; (0 == ec.value()) && (end != entry); entry.increment(ec))
+    {
+        const std::string name = entry->path().filename().generic_string();
+        const auto cost = costs.find(name);
+        measured.push_back(costs.end() != cost);
+        candidates.push_back(PartitionCandidate{name, (costs.end() != cost) ? EntryWeight(cost->second) : 0});
+        measuredWeight += candidates.back().cost;
+    }
+    if (0 != ec.value())
+    {
+        return false;
+    }
+    for (const bool known : measured)
+    {
+        outputReport.entriesWithHistory += (true == known) ? 1 : 0;
+    }
+    const std::uint64_t meanWeight = (0 != outputReport.entriesWithHistory) ? std::max<std::uint64_t>(1, measuredWeight / outputReport.entriesWithHistory) : 1;
+    for (std::size_t i = 0; i < candidates.size(); ++i)
+    {
+        if (false == measured[i])
+        {
+            candidates[i].cost = meanWeight;
+        }
+    }
+
+    const std::filesystem::path planFile = partitionsRoot / PartitionPlanFile;
+    PartitionPlan plan;
+    // A missing or unreadable previous plan only means every entry is assigned afresh.
+    plan.Read(planFile);
+    plan.Assign(candidates, config.partitions, config.rebalance, TimestampProvider().NowFilesystemSafe());
+    if (false == plan.Write(planFile))
+    {
+        return false;
+    }
+
+    std::unordered_map<std::string, std::uint64_t> weights;
+    for (const auto& candidate : candidates)
+    {
+        weights.emplace(candidate.name, candidate.cost);
+    }
+    outputReport.created = plan.Created();
+    outputReport.entries = plan.Entries().size();
+    outputReport.partitionCosts.assign(plan.Partitions(), 0);
+    for (const auto& entry : plan.Entries())
+    {
+        outputReport.partitionCosts[entry.partition] += weights[entry.name];
+    }
+    return true;
+}
+
+bool ApplyPartition(unsigned int partition, BackupConfig& config)
+{
+    PartitionPlan plan;
+    if ((false == config.sources.empty()) || (false == plan.Read(config.backupRoot / PartitionsDirectory / PartitionPlanFile)) ||
+        (partition >= plan.Partitions()))
+    {
+        return false;
+    }
+    // The partition's patterns come first, so configured patterns can still leave things out within it.
+    std::vector<std::string> patterns = plan.FilterPatterns(partition);
+    patterns.insert(patterns.end(), config.filterRules.patterns.begin(), config.filterRules.patterns.end());
+    config.filterRules.patterns = std::move(patterns);
+    config.backupRoot = config.backupRoot / PartitionsDirectory / std::to_string(partition);
+    config.databaseFile = config.backupRoot / "backup.db";
+    return true;
+}
+
+bool RunPartitionMerge(const PartitionMergeConfig& config, PartitionMergeReport& outputReport)
+{
+    outputReport = PartitionMergeReport{};
+    const std::filesystem::path partitionsRoot = config.backupRoot / PartitionsDirectory;
+    PartitionPlan plan;
+    if (false == plan.Read(partitionsRoot / PartitionPlanFile))
+    {
+        return false;
+    }
+    outputReport.snapshot = plan.Created();
+
+    std::vector<PartitionSnapshotPart> parts;
+    std::map<std::string, PartitionEntryCost> costs;
+    std::error_code ec;
+    for (unsigned int partition = 0; partition < plan.Partitions(); ++partition)
+    {
+        const std::filesystem::path databaseFile = partitionsRoot / std::to_string(partition) / "backup.db";
+        if (false == std::filesystem::is_regular_file(databaseFile, ec))
+        {
+            outputReport.pendingPartitions.push_back(partition);
+            continue;
+        }
+        BackupRunRecord run{};
+        bool completed = false;
+        {
+            SQLiteSession databaseSession(databaseFile);
+            FileStateRepository fileStateRepository(databaseSession);
+            if ((false == fileStateRepository.InitializeSchema()) || (false == fileStateRepository.GetLatestRun(run, completed)))
+            {
+                return false;
+            }
+        }
+        // Run timestamps sort in time order, so a run that started before the plan followed an older one.
+        if ((false == completed) || (run.started < plan.Created()))
+        {
+            outputReport.pendingPartitions.push_back(partition);
+            continue;
+        }
+        std::map<std::string, PartitionEntryCost> partitionCosts;
+        if (false == AccumulateEntryCosts(databaseFile, partitionCosts))
+        {
+            return false;
+        }
+        PartitionSnapshotPart part{partition, run.started, 0, 0};
+        for (const auto& [name, cost] : partitionCosts)
+        {
+            part.files += cost.files;
+            part.bytes += cost.bytes;
+            costs[name].files += cost.files;
+            costs[name].bytes += cost.bytes;
+        }
+        outputReport.files += part.files;
+        outputReport.bytes += part.bytes;
+        parts.push_back(part);
+    }
+    if (false == outputReport.pendingPartitions.empty())
+    {
+        return false;
+    }
+
+    SQLiteSession catalogSession(partitionsRoot / PartitionCatalogFile);
+    PartitionCatalog catalog(catalogSession);
+    return (true == catalog.InitializeSchema()) && (true == catalog.RecordSnapshot(plan.Created(), parts, costs));
+}
+
+bool RestoreChunkedFile(const std::filesystem::path& backupRoot, const std::filesystem::path& manifestPath,
+                        const std::filesystem::path& outputPath)
+{
+    return ChunkStore::Restore(backupRoot / "chunks", manifestPath, outputPath);
+}
+
+bool RestoreCompressedFile(const std::filesystem::path& compressedPath, const std::filesystem::path& outputPath, const std::filesystem::path& databaseFile)
+{
+    return DecompressArchivedFile(compressedPath, outputPath, databaseFile);
+}
+
+bool RestoreEncryptedFile(const std::filesystem::path& encryptedPath, const std::filesystem::path& keyFile, const std::filesystem::path& outputPath)
+{
+    std::unique_ptr<FileEncryptor> fileEncryptor;
+    return (false == keyFile.empty()) && (true == OpenEncryptor(keyFile, EncryptionAlgorithm::Auto, fileEncryptor)) &&
+           (true == fileEncryptor->Decrypt(encryptedPath, outputPath));
+}
+
+bool RestoreDeltaFile(const std::filesystem::path& backupRoot, const std::filesystem::path& deltaPath, const std::filesystem::path& outputPath,
+                      const std::filesystem::path& databaseFile)
+{
+    const std::filesystem::path historyRoot = backupRoot / "deleted";
+    std::error_code ec;
+    const std::filesystem::path relativeDelta = std::filesystem::relative(deltaPath, historyRoot, ec);
+    if ((0 != ec.value()) || (true == relativeDelta.empty()) || (FileDelta::DeltaSuffix != relativeDelta.extension()))
+    {
+        return false;
+    }
+    const std::string snapshotName = relativeDelta.begin()->string();
+    const std::filesystem::path relativePath = std::filesystem::relative(relativeDelta, snapshotName).replace_extension();
+
+    // Snapshot directories are named by timestamp, so name order is age order.
+    std::vector<std::string> newerSnapshots;
+    for (const auto& entry : std::filesystem::directory_iterator(historyRoot, ec))
+    {
+        const std::string name = entry.path().filename().string();
+        if ((true == entry.is_directory(ec)) && (snapshotName < name))
+        {
+            newerSnapshots.push_back(name);
+        }
+    }
+    std::sort(newerSnapshots.begin(), newerSnapshots.end());
+
+    // Collect the deltas up to the nearest version stored in full, then apply them newest first.
+    std::vector<std::filesystem::path> deltas{deltaPath};
+    std::filesystem::path basis = backupRoot / "backup" / relativePath;
+    for (const auto& name : newerSnapshots)
+    {
+        const std::filesystem::path plainVersion = historyRoot / name / relativePath;
+        std::filesystem::path deltaVersion = plainVersion;
+        deltaVersion += FileDelta::DeltaSuffix;
+        std::filesystem::path compressedVersion = plainVersion;
+        compressedVersion += FileCompressor::CompressedSuffix;
+        if (true == std::filesystem::exists(plainVersion, ec))
+        {
+            basis = plainVersion;
+            break;
+        }
+        if (true == std::filesystem::exists(compressedVersion, ec))
+        {
+            basis = compressedVersion;
+            break;
+        }
+        if (true == std::filesystem::exists(deltaVersion, ec))
+        {
+            deltas.push_back(deltaVersion);
+        }
+    }
+
+    std::filesystem::path scratch[] = {outputPath, outputPath};
+    scratch[0] += ".basis-a";
+    scratch[1] += ".basis-b";
+    std::filesystem::path compressedBasis = outputPath;
+    compressedBasis += ".basis-zst";
+    bool restored = true;
+    if (FileCompressor::CompressedSuffix == basis.extension())
+    {
+        restored = DecompressArchivedFile(basis, compressedBasis, databaseFile);
+        basis = compressedBasis;
+    }
+    for (std::size_t i = deltas.size(); (true == restored) && (0 < i); --i)
+    {
+        const std::filesystem::path& target = (1 == i) ? outputPath : scratch[i % 2];
+        restored = FileDelta::Apply(basis, deltas[i - 1], target);
+        basis = target;
+    }
+    std::filesystem::remove(scratch[0], ec);
+    std::filesystem::remove(scratch[1], ec);
+    std::filesystem::remove(compressedBasis, ec);
+    return restored;
+}
@@ -0,0 +1,260 @@
+// file ChangeJournal.cpp:
+
+#include "ChangeJournal.hpp"
+
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <chrono>
+#include <stdexcept>
+
+namespace
+{
+constexpr const char* SqlCreateChangeJournalTable = "CREATE TABLE IF NOT EXISTS change_journal ("
+                                                    "path TEXT PRIMARY KEY,"
+                                                    "recursive INTEGER NOT NULL,"
+                                                    "seq INTEGER NOT NULL) WITHOUT ROWID;";
+
+constexpr const char* SqlCreateJournalStateTable = "CREATE TABLE IF NOT EXISTS journal_state ("
+                                                   "id INTEGER PRIMARY KEY CHECK (id = 1),"
+                                                   "session INTEGER NOT NULL,"
+                                                   "overflows INTEGER NOT NULL,"
+                                                   "heartbeat_ms INTEGER NOT NULL,"
+                                                   "flush_interval_ms INTEGER NOT NULL,"
+                                                   "covered_session INTEGER NOT NULL,"
+                                                   "covered_overflows INTEGER NOT NULL,"
+                                                   "journal_runs INTEGER NOT NULL);";
+
+constexpr const char* SqlInsertJournalState = "INSERT OR IGNORE INTO journal_state VALUES (1, 0, 0, 0, 0, 0, 0, 0);";
+
+/**
+ * @brief Slack in milliseconds on top of two flush intervals before a silent watcher counts as stopped.
+ */
+constexpr std::int64_t HeartbeatSlackMs = 1000;
+
+/**
+ * @brief Get the current wall clock time.
+ *
+ * @return Milliseconds since the epoch
+ */
+std::int64_t NowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+}
+
+ChangeJournal::ChangeJournal(SQLiteSession& databaseSession) : _databaseSession(databaseSession)
+{
+}
+
+bool ChangeJournal::InitializeSchema()
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute(SqlCreateChangeJournalTable);
+        connection.Execute(SqlCreateJournalStateTable);
+        connection.Execute(SqlInsertJournalState);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool ChangeJournal::BeginSession(std::int64_t flushIntervalMs)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("UPDATE journal_state SET session=session + 1, overflows=0, heartbeat_ms=?1, flush_interval_ms=?2 WHERE id=1;");
+        statement.BindInt64(1, NowMs());
+        statement.BindInt64(2, flushIntervalMs);
+        return statement.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool ChangeJournal::Record(const std::vector<ChangedDirectory>& directories, bool overflowed)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        // The entries and the heartbeat are committed together, so a run never sees one without the other.
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            std::int64_t sequence = 0;
+            {
+                auto cachedStatement = connection.PrepareCached("SELECT COALESCE(MAX(seq), 0) + 1 FROM change_journal;");
+                if (false == cachedStatement->FetchRow())
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+                sequence = cachedStatement->ColumnInt64(0);
+            }
+            for (const auto& directory : directories)
+            {
+                // A directory stays recursive until a run consumes it.
+                auto cachedStatement = connection.PrepareCached("INSERT INTO change_journal (path, recursive, seq) VALUES (?1, ?2, ?3) "
+                                                                "ON CONFLICT(path) DO UPDATE SET recursive=MAX(recursive, excluded.recursive), "
+                                                                "seq=excluded.seq;");
+                SQLiteStatement& statement = *cachedStatement;
+                statement.BindText(1, directory.path);
+                statement.BindInt64(2, (true == directory.recursive) ? 1 : 0);
+                statement.BindInt64(3, sequence);
+                if (false == statement.ExecuteStatement())
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+            }
+            auto cachedStatement = connection.PrepareCached("UPDATE journal_state SET heartbeat_ms=?1, overflows=overflows + ?2 WHERE id=1;");
+            cachedStatement->BindInt64(1, NowMs());
+            cachedStatement->BindInt64(2, (true == overflowed) ? 1 : 0);
+            if (false == cachedStatement->ExecuteStatement())
+            {
+                connection.Execute("ROLLBACK;");
+                return false;
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool ChangeJournal::EndSession()
+{
+    try
+    {
+        _databaseSession.Acquire().Execute("UPDATE journal_state SET heartbeat_ms=0 WHERE id=1;");
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool ChangeJournal::ReadState(ChangeJournalState& outputState)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT session, overflows, heartbeat_ms, flush_interval_ms, covered_session, covered_overflows, "
+                                            "journal_runs, (SELECT COALESCE(MAX(seq), 0) FROM change_journal) FROM journal_state WHERE id=1;");
+        if (false == statement.FetchRow())
+        {
+            return false;
+        }
+        outputState.session = statement.ColumnInt64(0);
+        outputState.overflows = statement.ColumnInt64(1);
+        outputState.heartbeatMs = statement.ColumnInt64(2);
+        outputState.flushIntervalMs = statement.ColumnInt64(3);
+        outputState.coveredSession = statement.ColumnInt64(4);
+        outputState.coveredOverflows = statement.ColumnInt64(5);
+        outputState.journalRuns = statement.ColumnInt64(6);
+        outputState.maxSequence = statement.ColumnInt64(7);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool ChangeJournal::IsWatcherLive(const ChangeJournalState& state)
+{
+    return (0 != state.session) && (0 != state.heartbeatMs) && (NowMs() <= state.heartbeatMs + (2 * state.flushIntervalMs) + HeartbeatSlackMs);
+}
+
+bool ChangeJournal::LoadEntries(std::int64_t maxSequence, std::vector<ChangedDirectory>& outputDirectories)
+{
+    outputDirectories.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT path, recursive FROM change_journal WHERE seq <= ?1;");
+        statement.BindInt64(1, maxSequence);
+        return statement.ForEachRow(
+            [&outputDirectories](const SQLiteStatement& row)
+            {
+                outputDirectories.push_back(ChangedDirectory{std::string(row.ColumnView(0)), 0 != row.ColumnInt64(1)});
+                return true;
+            });
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool ChangeJournal::CountEntries(std::uint64_t& outputCount)
+{
+    outputCount = 0;
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT COUNT(*) FROM change_journal;");
+        if (false == statement.FetchRow())
+        {
+            return false;
+        }
+        outputCount = static_cast<std::uint64_t>(statement.ColumnInt64(0));
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool ChangeJournal::CompleteRun(const ChangeJournalState& observed, bool journalRun)
+{
+    // Without a live watcher at the start, changes made during the run may be missing from the journal.
+    const bool live = IsWatcherLive(observed);
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            auto deleteStatement = connection.Prepare("DELETE FROM change_journal WHERE seq <= ?1;");
+            deleteStatement.BindInt64(1, observed.maxSequence);
+            auto updateStatement = connection.Prepare("UPDATE journal_state SET covered_session=?1, covered_overflows=?2, "
+                                                      "journal_runs=CASE WHEN ?3 THEN journal_runs + 1 ELSE 0 END WHERE id=1;");
+            updateStatement.BindInt64(1, (true == live) ? observed.session : 0);
+            updateStatement.BindInt64(2, observed.overflows);
+            updateStatement.BindInt64(3, (true == journalRun) ? 1 : 0);
+            if ((false == deleteStatement.ExecuteStatement()) || (false == updateStatement.ExecuteStatement()))
+            {
+                connection.Execute("ROLLBACK;");
+                return false;
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
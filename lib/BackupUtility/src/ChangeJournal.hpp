@@ -0,0 +1,128 @@
+// file ChangeJournal.hpp:
+
+#pragma once
+
+#include "SQLite/SQLiteSession.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Directory recorded as changed by the watcher.
+ */
+struct ChangedDirectory
+{
+    std::string path; /**< Repository-relative directory path, empty for the source root */
+    bool recursive;   /**< The whole subtree may have changed, not only the directory's own files */
+};
+
+/**
+ * @brief Watcher state read by a backup run before it decides between a journal run and a full walk.
+ */
+struct ChangeJournalState
+{
+    std::int64_t session;          /**< Watcher sessions started so far, 0 if no watcher ever ran */
+    std::int64_t overflows;        /**< Event losses the watcher reported in its current session */
+    std::int64_t heartbeatMs;      /**< Last heartbeat of a running watcher in ms since the epoch, 0 once it stopped */
+    std::int64_t flushIntervalMs;  /**< Time between two flushes of the running watcher */
+    std::int64_t coveredSession;   /**< Session whose journal continued the last completed run, 0 for none */
+    std::int64_t coveredOverflows; /**< Overflow count of that session when the run started */
+    std::int64_t journalRuns;      /**< Journal runs completed since the last full walk */
+    std::int64_t maxSequence;      /**< Newest journal entry when the state was read */
+};
+
+/**
+ * @brief Journal of directories changed since the last backup, written by the watcher and consumed by runs.
+ *
+ * The journal lives in the state database next to the file rows. Every flush of the watcher gives its
+ * entries a new sequence number, so a directory that changes again while a run consumes the journal
+ * stays dirty for the next run. A run may trust the journal only while the watcher session that was
+ * live when the previous run started is still running without having lost events.
+ */
+class ChangeJournal
+{
+  public:
+    /**
+     * @brief Create a journal bound to a SQLite session on the state database.
+     *
+     * @param[in] databaseSession Active SQLite session for the state database
+     */
+    explicit ChangeJournal(SQLiteSession& databaseSession);
+
+    /**
+     * @brief Create the journal tables if they do not exist.
+     *
+     * @return true on success, false on error
+     */
+    bool InitializeSchema();
+
+    /**
+     * @brief Start a new watcher session; the journal of earlier sessions no longer counts as complete.
+     *
+     * @param[in] flushIntervalMs Time between two flushes of the watcher
+     * @return true on success, false on error
+     */
+    bool BeginSession(std::int64_t flushIntervalMs);
+
+    /**
+     * @brief Record changed directories and refresh the watcher's heartbeat.
+     *
+     * @param[in] directories Directories changed since the previous flush, may be empty
+     * @param[in] overflowed Events were lost since the previous flush
+     * @return true on success, false on error
+     */
+    bool Record(const std::vector<ChangedDirectory>& directories, bool overflowed);
+
+    /**
+     * @brief Mark the current watcher session as stopped.
+     *
+     * @return true on success, false on error
+     */
+    bool EndSession();
+
+    /**
+     * @brief Read the watcher state and the newest journal sequence.
+     *
+     * @param[out] outputState Current state
+     * @return true on success, false on error
+     */
+    bool ReadState(ChangeJournalState& outputState);
+
+    /**
+     * @brief Check whether a watcher was running when a state was read.
+     *
+     * @param[in] state State from ReadState()
+     * @return true if the state's heartbeat is recent enough for a running watcher
+     */
+    static bool IsWatcherLive(const ChangeJournalState& state);
+
+    /**
+     * @brief Load the journal entries up to a sequence number.
+     *
+     * @param[in] maxSequence Newest sequence to load, from ReadState()
+     * @param[out] outputDirectories Changed directories
+     * @return true on success, false on error
+     */
+    bool LoadEntries(std::int64_t maxSequence, std::vector<ChangedDirectory>& outputDirectories);
+
+    /**
+     * @brief Count the directories the journal holds.
+     *
+     * @param[out] outputCount Journaled directories
+     * @return true on success, false on error
+     */
+    bool CountEntries(std::uint64_t& outputCount);
+
+    /**
+     * @brief Consume the entries of a completed run and record which watcher session continues from it.
+     *
+     * @param[in] observed State read when the run started
+     * @param[in] journalRun The run processed the journal instead of walking the whole tree
+     * @return true on success, false on error
+     */
+    bool CompleteRun(const ChangeJournalState& observed, bool journalRun);
+
+  private:
+    SQLiteSession& _databaseSession;
+};
@@ -0,0 +1,306 @@
+// file ChangeJournalWatcher.cpp:
+
+#include "ChangeJournalWatcher.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef __linux__
+/**
+ * @brief Longest wait in milliseconds for events before the stop flag is checked again.
+ */
+constexpr int PollIntervalMs = 100;
+
+/**
+ * @brief Size in bytes of the buffer events are read into.
+ */
+constexpr std::size_t EventBufferSize = 64 * 1024;
+
+/**
+ * @brief Events that can change what a backup finds in a directory.
+ */
+constexpr std::uint32_t WatchMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+                                    IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+#endif
+
+constexpr char KeySeparator = static_cast<char>(std::filesystem::path::preferred_separator);
+
+/**
+ * @brief Compute the key of a directory entry from its parent's key.
+ *
+ * @param[in] parentKey Key of the parent directory, empty for the source root
+ * @param[in] name Name of the entry
+ * @return Repository-relative key of the entry
+ */
+std::string JoinKey(const std::string& parentKey, const std::string& name)
+{
+    return (true == parentKey.empty()) ? name : parentKey + KeySeparator + name;
+}
+}
+
+ChangeJournalWatcher::ChangeJournalWatcher(const std::filesystem::path& sourceDir, ChangeJournal& journal, std::chrono::milliseconds flushInterval)
+    : _sourceDir(sourceDir), _journal(journal), _flushInterval(flushInterval), _descriptor(-1), _overflowed(false)
+{
+#ifdef __linux__
+    _descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+ChangeJournalWatcher::~ChangeJournalWatcher()
+{
+#ifdef __linux__
+    if (0 <= _descriptor)
+    {
+        close(_descriptor);
+    }
+#endif
+}
+
+bool ChangeJournalWatcher::IsAvailable()
+{
+#ifdef __linux__
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ChangeJournalWatcher::Run(const std::atomic<bool>& stopRequested, const std::function<void()>& onReady)
+{
+#ifdef __linux__
+    if (0 > _descriptor)
+    {
+        return false;
+    }
+    AddWatches(std::string());
+    // Events of the setup are queued by the kernel and recorded with the first flush of the session.
+    if ((true == _watchedKeys.empty()) || (false == _journal.BeginSession(_flushInterval.count())))
+    {
+        return false;
+    }
+    if (onReady)
+    {
+        onReady();
+    }
+
+    alignas(struct inotify_event) char buffer[EventBufferSize];
+    auto drainEvents = [&]()
+    {
+        ssize_t bytesRead = 0;
+        while (0 < (bytesRead = read(_descriptor, buffer, sizeof(buffer))))
+        {
+            HandleEvents(buffer, static_cast<std::size_t>(bytesRead));
+        }
+    };
+
+    bool success = true;
+    auto nextFlush = std::chrono::steady_clock::now() + _flushInterval;
+    while (false == stopRequested.load())
+    {
+        const auto untilFlush = std::chrono::duration_cast<std::chrono::milliseconds>(nextFlush - std::chrono::steady_clock::now()).count();
+        const int timeoutMs = static_cast<int>(std::clamp<long long>(untilFlush, 0, PollIntervalMs));
+        pollfd pollEntry{_descriptor, POLLIN, 0};
+        const int ready = poll(&pollEntry, 1, timeoutMs);
+        if ((0 > ready) && (EINTR != errno))
+        {
+            success = false;
+            break;
+        }
+        if (0 < ready)
+        {
+            drainEvents();
+        }
+        if (std::chrono::steady_clock::now() >= nextFlush)
+        {
+            if (false == Flush())
+            {
+                success = false;
+                break;
+            }
+            nextFlush = std::chrono::steady_clock::now() + _flushInterval;
+        }
+    }
+    drainEvents();
+    success = (true == Flush()) && (true == success);
+    return (true == _journal.EndSession()) && (true == success);
+#else
+    (void)stopRequested;
+    (void)onReady;
+    return false;
+#endif
+}
+
+/**
+ * @brief Watch a directory and every directory below it.
+ *
+ * A directory that cannot be watched for a reason other than having disappeared counts as an overflow.
+ *
+ * @param[in] directoryKey Key of the directory to start from, empty for the source root
+ */
+void ChangeJournalWatcher::AddWatches(const std::string& directoryKey)
+{
+#ifdef __linux__
+    std::vector<std::string> pendingKeys{directoryKey};
+    while (false == pendingKeys.empty())
+    {
+        const std::string key = std::move(pendingKeys.back());
+        pendingKeys.pop_back();
+        const std::filesystem::path directory = (true == key.empty()) ? _sourceDir : _sourceDir / key;
+        const int watch = inotify_add_watch(_descriptor, directory.c_str(), WatchMask);
+        if (0 > watch)
+        {
+            _overflowed = _overflowed || ((ENOENT != errno) && (ENOTDIR != errno));
+            continue;
+        }
+        _watchedKeys[watch] = key;
+
+        std::error_code ec;
+        for (std::filesystem::directory_iterator entry(directory, ec), end; (0 == ec.value()) && (end != entry); entry.increment(ec))
+        {
+            std::error_code entryEc;
+            if ((true == entry->is_directory(entryEc)) && (false == entry->is_symlink(entryEc)))
+            {
+                pendingKeys.push_back(JoinKey(key, entry->path().filename().string()));
+            }
+        }
+        _overflowed = _overflowed || ((0 != ec.value()) && (std::errc::no_such_file_or_directory != ec));
+    }
+#else
+    (void)directoryKey;
+#endif
+}
+
+/**
+ * @brief Drop the watches of a directory and every directory below it, e.g. once it moved away.
+ *
+ * @param[in] directoryKey Key of the directory
+ */
+void ChangeJournalWatcher::RemoveWatches(const std::string& directoryKey)
+{
+#ifdef __linux__
+    const std::string prefix = directoryKey + KeySeparator;
+    for (auto entry = _watchedKeys.begin(); _watchedKeys.end() != entry;)
+    {
+        if ((directoryKey == entry->second) || (0 == entry->second.compare(0, prefix.size(), prefix)))
+        {
+            inotify_rm_watch(_descriptor, entry->first);
+            entry = _watchedKeys.erase(entry);
+            continue;
+        }
+        ++entry;
+    }
+#else
+    (void)directoryKey;
+#endif
+}
+
+/**
+ * @brief Turn a buffer of inotify events into changed directories.
+ *
+ * @param[in] buffer Events as read from the inotify descriptor
+ * @param[in] size Bytes in the buffer
+ */
+void ChangeJournalWatcher::HandleEvents(const char* buffer, std::size_t size)
+{
+#ifdef __linux__
+    for (std::size_t offset = 0; offset + sizeof(struct inotify_event) <= size;)
+    {
+        const auto* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+        offset += sizeof(struct inotify_event) + event->len;
+
+        if (0 != (event->mask & IN_Q_OVERFLOW))
+        {
+            _overflowed = true;
+            continue;
+        }
+        const auto watched = _watchedKeys.find(event->wd);
+        if (_watchedKeys.end() == watched)
+        {
+            continue;
+        }
+        if (0 != (event->mask & IN_IGNORED))
+        {
+            _watchedKeys.erase(watched);
+            continue;
+        }
+        const std::string directoryKey = watched->second;
+        if (0 != (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)))
+        {
+            // The parent reports the loss of any other directory; losing the root leaves nothing to watch.
+            _overflowed = _overflowed || (true == directoryKey.empty());
+            continue;
+        }
+        if (0 == event->len)
+        {
+            continue;
+        }
+
+        const std::string name(event->name);
+        if (0 == (event->mask & IN_ISDIR))
+        {
+            MarkChanged(directoryKey, false);
+            continue;
+        }
+        const std::string childKey = JoinKey(directoryKey, name);
+        if (0 != (event->mask & (IN_DELETE | IN_MOVED_FROM)))
+        {
+            RemoveWatches(childKey);
+            MarkChanged(childKey, true);
+        }
+        else if (0 != (event->mask & (IN_CREATE | IN_MOVED_TO)))
+        {
+            // Files created before the new watch exists are found by listing the whole subtree.
+            AddWatches(childKey);
+            MarkChanged(childKey, true);
+        }
+    }
+#else
+    (void)buffer;
+    (void)size;
+#endif
+}
+
+/**
+ * @brief Record a directory as changed until the next flush.
+ *
+ * @param[in] directoryKey Key of the directory
+ * @param[in] recursive The whole subtree may have changed
+ */
+void ChangeJournalWatcher::MarkChanged(const std::string& directoryKey, bool recursive)
+{
+    bool& entryRecursive = _changedKeys[directoryKey];
+    entryRecursive = (true == entryRecursive) || (true == recursive);
+}
+
+/**
+ * @brief Write the collected changes and a heartbeat into the journal.
+ *
+ * @return true on success, false on error; the changes are kept for the next flush
+ */
+bool ChangeJournalWatcher::Flush()
+{
+    std::vector<ChangedDirectory> directories;
+    directories.reserve(_changedKeys.size());
+    for (const auto& entry : _changedKeys)
+    {
+        directories.push_back(ChangedDirectory{entry.first, entry.second});
+    }
+    if (false == _journal.Record(directories, _overflowed))
+    {
+        return false;
+    }
+    _changedKeys.clear();
+    _overflowed = false;
+    return true;
+}
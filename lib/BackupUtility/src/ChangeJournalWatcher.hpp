@@ -0,0 +1,73 @@
+// file ChangeJournalWatcher.hpp:
+
+#pragma once
+
+#include "ChangeJournal.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Watches a source tree with inotify and records the directories that change into a ChangeJournal.
+ *
+ * Every directory of the tree gets a watch. A file event dirties its directory, and a directory that is
+ * created, deleted or moved dirties its whole subtree, since it may have brought or taken files along.
+ * Changed directories are collected in memory and flushed together with a heartbeat once per flush
+ * interval. Lost events, from a queue overflow or a watch that could not be added, are recorded as an
+ * overflow, which makes the next backup walk the whole tree.
+ */
+class ChangeJournalWatcher
+{
+  public:
+    /**
+     * @brief Construct a watcher for a source tree.
+     *
+     * @param[in] sourceDir Directory to watch, the root of the backed up tree
+     * @param[in] journal Journal the changes are recorded into
+     * @param[in] flushInterval Time between two flushes of the collected changes
+     */
+    ChangeJournalWatcher(const std::filesystem::path& sourceDir, ChangeJournal& journal, std::chrono::milliseconds flushInterval);
+    /**
+     * @brief Close the inotify instance, removing every watch.
+     */
+    ~ChangeJournalWatcher();
+
+    ChangeJournalWatcher(const ChangeJournalWatcher&) = delete;
+    ChangeJournalWatcher& operator=(const ChangeJournalWatcher&) = delete;
+
+    /**
+     * @brief Check whether the platform can watch a tree.
+     *
+     * @return true on Linux, false elsewhere
+     */
+    static bool IsAvailable();
+
+    /**
+     * @brief Watch the tree until a stop is requested, then flush the last changes and end the session.
+     *
+     * @param[in] stopRequested Set to stop watching; checked at least every 100 ms
+     * @param[in] onReady Called once every directory is watched and the session has started, may be empty
+     * @return true if the session ended normally, false if it could not start or a flush failed
+     */
+    bool Run(const std::atomic<bool>& stopRequested, const std::function<void()>& onReady);
+
+  private:
+    void AddWatches(const std::string& directoryKey);
+    void RemoveWatches(const std::string& directoryKey);
+    void HandleEvents(const char* buffer, std::size_t size);
+    void MarkChanged(const std::string& directoryKey, bool recursive);
+    bool Flush();
+
+    std::filesystem::path _sourceDir;
+    ChangeJournal& _journal;
+    std::chrono::milliseconds _flushInterval;
+    int _descriptor;
+
+    std::unordered_map<int, std::string> _watchedKeys;   /**< Directory key of each watch descriptor */
+    std::unordered_map<std::string, bool> _changedKeys; /**< Directories changed since the last flush, true for whole subtrees */
+    bool _overflowed;
+};
@@ -0,0 +1,183 @@
+// file ChangeLog.cpp:
+
+#include "ChangeLog.hpp"
+
+#include <chrono>
+
+namespace
+{
+constexpr std::size_t FlushThreshold = 256 * 1024; /**< Buffered bytes at which a thread hands its lines to the logger thread */
+
+/**
+ * @brief Longest time a handed buffer waits for the logger thread; producers notify without the lock, so a wake-up can be missed.
+ */
+constexpr std::chrono::milliseconds WakeInterval(100);
+
+/**
+ * @brief Append text as a JSON string literal.
+ *
+ * @param[in] text Text to quote
+ * @param[in,out] output String the literal is appended to
+ */
+void AppendJsonString(const std::string& text, std::string& output)
+{
+    static constexpr char HexDigits[] = "0123456789abcdef";
+    output += '"';
+    for (const char character : text)
+    {
+        switch (character)
+        {
+        case '"':
+            output += "\\\"";
+            break;
+        case '\\':
+            output += "\\\\";
+            break;
+        case '\n':
+            output += "\\n";
+            break;
+        case '\r':
+            output += "\\r";
+            break;
+        case '\t':
+            output += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(character) < 0x20)
+            {
+                output += "\\u00";
+                output += HexDigits[static_cast<unsigned char>(character) >> 4];
+                output += HexDigits[static_cast<unsigned char>(character) & 0xF];
+            }
+            else
+            {
+                output += character;
+            }
+            break;
+        }
+    }
+    output += '"';
+}
+} // namespace
+
+ChangeLog::ThreadBuffer::ThreadBuffer(ChangeLog& log) : _log(log)
+{
+    _buffer.reserve(FlushThreshold);
+}
+
+void ChangeLog::ThreadBuffer::Record(ChangeType change, const std::string& relativeKey, std::uint64_t size)
+{
+    if (ChangeType::Unchanged == change)
+    {
+        return;
+    }
+    _buffer += "{\"change\":\"";
+    _buffer += ChangeTypeToString(change);
+    _buffer += "\",\"path\":";
+    AppendJsonString(relativeKey, _buffer);
+    _buffer += ",\"size\":";
+    _buffer += std::to_string(size);
+    _buffer += "}\n";
+    if (FlushThreshold <= _buffer.size())
+    {
+        _log.Hand(_buffer);
+    }
+}
+
+ChangeLog::ChangeLog(const std::filesystem::path& logFile) : _stream(logFile, std::ios::binary | std::ios::trunc), _stopping(false)
+{
+    if (true == _stream.is_open())
+    {
+        _logger = std::thread([this]() { LoggerLoop(); });
+    }
+}
+
+ChangeLog::~ChangeLog()
+{
+    Close();
+}
+
+bool ChangeLog::IsOpen() const
+{
+    return _stream.is_open();
+}
+
+ChangeLog::ThreadBuffer& ChangeLog::Current()
+{
+    std::lock_guard<std::mutex> lock(_threadsMutex);
+    std::unique_ptr<ThreadBuffer>& thread = _threads[std::this_thread::get_id()];
+    if (nullptr == thread)
+    {
+        thread = std::make_unique<ThreadBuffer>(*this);
+    }
+    return *thread;
+}
+
+bool ChangeLog::Close()
+{
+    if (true == _logger.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_threadsMutex);
+            for (auto& entry : _threads)
+            {
+                if (false == entry.second->_buffer.empty())
+                {
+                    Hand(entry.second->_buffer);
+                }
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(_wakeMutex);
+            _stopping.store(true);
+        }
+        _wakeCv.notify_one();
+        _logger.join();
+    }
+    if (false == _stream.is_open())
+    {
+        return false;
+    }
+    _stream.close();
+    return false == _stream.fail();
+}
+
+/**
+ * @brief Push a filled buffer onto the queue of the logger thread and start the caller on an empty one.
+ *
+ * @param[in,out] buffer Buffer of the calling thread
+ */
+void ChangeLog::Hand(std::string& buffer)
+{
+    _full.Push(std::move(buffer));
+    buffer.clear();
+    buffer.reserve(FlushThreshold);
+    _wakeCv.notify_one();
+}
+
+/**
+ * @brief Logger thread loop: write the handed buffers until stopped, then write the rest.
+ */
+void ChangeLog::LoggerLoop()
+{
+    while (false == _stopping.load())
+    {
+        WritePending();
+        std::unique_lock<std::mutex> lock(_wakeMutex);
+        _wakeCv.wait_for(lock, WakeInterval, [this]() { return (true == _stopping.load()) || (false == _full.IsEmpty()); });
+    }
+    WritePending();
+}
+
+/**
+ * @brief Write every buffer handed over so far, each with one write.
+ */
+void ChangeLog::WritePending()
+{
+    std::string buffer;
+    while (true == _full.TryPop(buffer))
+    {
+        _stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    }
+    _stream.flush();
+}
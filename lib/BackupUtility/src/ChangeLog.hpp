@@ -0,0 +1,113 @@
+// file ChangeLog.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "ThreadedFileQueue/MpscQueue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * @brief Lists every path a backup run added, modified or deleted in an NDJSON file, for audit, replication and indexing.
+ *
+ * Each line is one object: `{"change":"Added","path":"dir/file.txt","size":123}`, with the state key as
+ * path and size 0 for deleted files. Lines appear in the order the threads committed their files, not in
+ * path order. Each thread formats its lines into its own buffer and pushes the buffer onto a lock-free
+ * queue once it holds 256 KiB. A logger thread pops the buffers and writes each one with a single
+ * sequential write, so workers never wait on the file or on each other.
+ */
+class ChangeLog
+{
+  public:
+    /**
+     * @brief Buffer of the lines recorded by one thread.
+     */
+    class ThreadBuffer
+    {
+      public:
+        /**
+         * @brief Construct an empty buffer.
+         *
+         * @param[in,out] log Log the buffer is handed to
+         */
+        explicit ThreadBuffer(ChangeLog& log);
+
+        /**
+         * @brief Record a changed path; unchanged files are not recorded.
+         *
+         * @param[in] change Outcome of the file in the run
+         * @param[in] relativeKey State key of the file
+         * @param[in] size Size in bytes
+         */
+        void Record(ChangeType change, const std::string& relativeKey, std::uint64_t size);
+
+      private:
+        friend class ChangeLog;
+
+        ChangeLog& _log;
+        std::string _buffer;
+    };
+
+    /**
+     * @brief Create or truncate the log file and start the logger thread.
+     *
+     * @param[in] logFile File to write
+     */
+    explicit ChangeLog(const std::filesystem::path& logFile);
+
+    /**
+     * @brief Stop the logger thread, writing what is still pending.
+     */
+    ~ChangeLog();
+
+    ChangeLog(const ChangeLog&) = delete;
+    ChangeLog& operator=(const ChangeLog&) = delete;
+
+    /**
+     * @brief Check whether the log file could be created.
+     *
+     * @return true if changes can be recorded
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Get the buffer of the calling thread, creating it on first use.
+     *
+     * Looking it up takes a lock, so callers fetch it once per thread.
+     *
+     * @return Buffer only written by the calling thread
+     */
+    ThreadBuffer& Current();
+
+    /**
+     * @brief Hand over what every thread still buffers, stop the logger thread, then flush and close the file.
+     *
+     * Only valid once the recording threads have stopped.
+     *
+     * @return true if every line was written, false otherwise
+     */
+    bool Close();
+
+  private:
+    void Hand(std::string& buffer);
+    void LoggerLoop();
+    void WritePending();
+
+    std::ofstream _stream;
+    MpscQueue<std::string> _full; /**< Filled thread buffers in the order they were handed over */
+    std::mutex _threadsMutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadBuffer>> _threads;
+    std::mutex _wakeMutex;
+    std::condition_variable _wakeCv;
+    std::atomic<bool> _stopping;
+    std::thread _logger;
+};
@@ -0,0 +1,272 @@
+// file ChunkStore.cpp:
+
+#include "ChunkStore.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+constexpr char ManifestMagic[] = {'R', 'D', 'C', 'H', 'U', 'N', 'K', '1'};
+constexpr std::size_t ChunkDirectoryDigits = 2;
+constexpr std::size_t ChunkDigestSize = 16;
+constexpr unsigned int BitsPerByte = 8;
+constexpr const char* TemporarySuffix = ".tmp-";
+
+/**
+ * @brief Append an unsigned integer in little-endian byte order.
+ *
+ * @param[in,out] output Buffer to append to
+ * @param[in] value Value to append
+ * @param[in] byteCount Number of bytes to write
+ */
+void AppendLittleEndian(std::string& output, std::uint64_t value, std::size_t byteCount)
+{
+    for (std::size_t i = 0; i < byteCount; ++i)
+    {
+        output.push_back(static_cast<char>((value >> (i * BitsPerByte)) & 0xFF));
+    }
+}
+
+/**
+ * @brief Read an unsigned little-endian integer from a stream.
+ *
+ * @param[in] inputStream Stream to read
+ * @param[in] byteCount Number of bytes to read
+ * @param[out] outputValue Decoded value
+ * @return true on success, false on a short read
+ */
+bool ReadLittleEndian(std::istream& inputStream, std::size_t byteCount, std::uint64_t& outputValue)
+{
+    unsigned char bytes[sizeof(std::uint64_t)] = {};
+    if (false == static_cast<bool>(inputStream.read(reinterpret_cast<char*>(bytes), static_cast<std::streamsize>(byteCount))))
+    {
+        return false;
+    }
+    outputValue = 0;
+    for (std::size_t i = 0; i < byteCount; ++i)
+    {
+        outputValue |= static_cast<std::uint64_t>(bytes[i]) << (i * BitsPerByte);
+    }
+    return true;
+}
+
+/**
+ * @brief Build a temporary name next to a target that no other thread uses at the same time.
+ *
+ * @param[in] targetPath Final path
+ * @return Temporary path in the same directory
+ */
+std::filesystem::path TemporaryPathFor(const std::filesystem::path& targetPath)
+{
+    std::filesystem::path temporaryPath = targetPath;
+    temporaryPath += TemporarySuffix + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    return temporaryPath;
+}
+
+/**
+ * @brief Get the location of a chunk below a chunk store root.
+ *
+ * @param[in] chunksRoot Directory holding the chunks
+ * @param[in] digest Chunk digest
+ * @return Path of the chunk
+ */
+std::filesystem::path ChunkPathBelow(const std::filesystem::path& chunksRoot, const HashDigest& digest)
+{
+    const std::string hexDigest = digest.ToHex();
+    return chunksRoot / hexDigest.substr(0, ChunkDirectoryDigits) / hexDigest.substr(ChunkDirectoryDigits);
+}
+
+/**
+ * @brief Write a buffer to a new file and rename it into place.
+ *
+ * @param[in] targetPath Final path
+ * @param[in] data Content
+ * @param[in] length Content length in bytes
+ * @return true on success, false on error
+ */
+bool WriteFileAtomically(const std::filesystem::path& targetPath, const char* data, std::size_t length)
+{
+    std::error_code errorCode;
+    const std::filesystem::path temporaryPath = TemporaryPathFor(targetPath);
+    {
+        std::ofstream outputStream(temporaryPath, std::ios::binary | std::ios::trunc);
+        if ((false == outputStream.is_open()) || (false == static_cast<bool>(outputStream.write(data, static_cast<std::streamsize>(length)))) ||
+            (false == static_cast<bool>(outputStream.flush())))
+        {
+            outputStream.close();
+            std::filesystem::remove(temporaryPath, errorCode);
+            return false;
+        }
+    }
+    std::filesystem::rename(temporaryPath, targetPath, errorCode);
+    if (0 != errorCode.value())
+    {
+        std::filesystem::remove(temporaryPath, errorCode);
+        return false;
+    }
+    return true;
+}
+}
+
+ChunkStore::ChunkStore(const std::filesystem::path& chunksRoot, const FileChunker& fileChunker, FileStateRepository& fileStateRepository)
+    : _chunksRoot(chunksRoot), _fileChunker(fileChunker), _fileStateRepository(fileStateRepository)
+{
+}
+
+std::filesystem::path ChunkStore::ChunkPath(const HashDigest& digest) const
+{
+    return ChunkPathBelow(_chunksRoot, digest);
+}
+
+std::filesystem::path ChunkStore::ChunkPath(const std::filesystem::path& chunksRoot, const HashDigest& digest)
+{
+    return ChunkPathBelow(chunksRoot, digest);
+}
+
+bool ChunkStore::Archive(const std::filesystem::path& filePath, const std::filesystem::path& manifestPath) const
+{
+    std::vector<FileChunk> chunks;
+    HashDigest fileDigest{};
+    const bool chunked = _fileChunker.Chunk(
+        filePath,
+        [&](const FileChunk& chunk, const std::uint8_t* data)
+        {
+            chunks.push_back(chunk);
+            return StoreChunk(chunk, data);
+        },
+        fileDigest);
+    if (false == chunked)
+    {
+        return false;
+    }
+
+    std::string manifest(ManifestMagic, sizeof(ManifestMagic));
+    const std::uint64_t fileSize = (true == chunks.empty()) ? 0 : (chunks.back().offset + chunks.back().length);
+    AppendLittleEndian(manifest, fileSize, sizeof(std::uint64_t));
+    AppendLittleEndian(manifest, fileDigest.size, sizeof(std::uint8_t));
+    manifest.append(reinterpret_cast<const char*>(fileDigest.bytes.data()), ChunkDigestSize);
+    AppendLittleEndian(manifest, chunks.size(), sizeof(std::uint64_t));
+    for (const auto& chunk : chunks)
+    {
+        AppendLittleEndian(manifest, chunk.length, sizeof(std::uint32_t));
+        manifest.append(reinterpret_cast<const char*>(chunk.digest.bytes.data()), ChunkDigestSize);
+    }
+
+    // References are counted before the manifest appears, so a referenced chunk is never collected early.
+    std::error_code errorCode;
+    std::filesystem::create_directories(manifestPath.parent_path(), errorCode);
+    return (true == _fileStateRepository.AddChunkReferences(chunks)) && (true == WriteFileAtomically(manifestPath, manifest.data(), manifest.size()));
+}
+
+bool ChunkStore::ReadManifest(const std::filesystem::path& manifestPath, std::uint64_t& outputFileSize, HashDigest& outputFileDigest,
+                              std::vector<FileChunk>& outputChunks)
+{
+    outputChunks.clear();
+    std::ifstream manifestStream(manifestPath, std::ios::binary);
+    char magic[sizeof(ManifestMagic)] = {};
+    if ((false == manifestStream.is_open()) || (false == static_cast<bool>(manifestStream.read(magic, sizeof(magic)))) ||
+        (0 != std::memcmp(magic, ManifestMagic, sizeof(magic))))
+    {
+        return false;
+    }
+
+    std::uint64_t digestSize = 0;
+    std::uint8_t digestBytes[ChunkDigestSize] = {};
+    std::uint64_t chunkCount = 0;
+    if ((false == ReadLittleEndian(manifestStream, sizeof(std::uint64_t), outputFileSize)) ||
+        (false == ReadLittleEndian(manifestStream, sizeof(std::uint8_t), digestSize)) ||
+        (false == static_cast<bool>(manifestStream.read(reinterpret_cast<char*>(digestBytes), ChunkDigestSize))) ||
+        (false == HashDigest::FromBytes(digestBytes, static_cast<std::size_t>(digestSize), outputFileDigest)) ||
+        (false == ReadLittleEndian(manifestStream, sizeof(std::uint64_t), chunkCount)))
+    {
+        return false;
+    }
+
+    std::uint64_t offset = 0;
+    for (std::uint64_t i = 0; i < chunkCount; ++i)
+    {
+        std::uint64_t chunkLength = 0;
+        FileChunk chunk{};
+        if ((false == ReadLittleEndian(manifestStream, sizeof(std::uint32_t), chunkLength)) ||
+            (false == static_cast<bool>(manifestStream.read(reinterpret_cast<char*>(digestBytes), ChunkDigestSize))) ||
+            (false == HashDigest::FromBytes(digestBytes, ChunkDigestSize, chunk.digest)))
+        {
+            return false;
+        }
+        chunk.offset = offset;
+        chunk.length = static_cast<std::uint32_t>(chunkLength);
+        outputChunks.push_back(chunk);
+        offset += chunkLength;
+    }
+    return true;
+}
+
+bool ChunkStore::Restore(const std::filesystem::path& chunksRoot, const std::filesystem::path& manifestPath, const std::filesystem::path& outputPath)
+{
+    std::uint64_t fileSize = 0;
+    HashDigest fileDigest{};
+    std::vector<FileChunk> chunks;
+    if (false == ReadManifest(manifestPath, fileSize, fileDigest, chunks))
+    {
+        return false;
+    }
+
+    std::ofstream outputStream(outputPath, std::ios::binary | std::ios::trunc);
+    if (false == outputStream.is_open())
+    {
+        return false;
+    }
+
+    std::vector<std::uint8_t> chunkData;
+    std::uint64_t restoredSize = 0;
+    for (const FileChunk& chunk : chunks)
+    {
+        chunkData.resize(chunk.length);
+        std::ifstream chunkStream(ChunkPathBelow(chunksRoot, chunk.digest), std::ios::binary);
+        if ((false == chunkStream.is_open()) ||
+            (false == static_cast<bool>(chunkStream.read(reinterpret_cast<char*>(chunkData.data()), static_cast<std::streamsize>(chunk.length)))) ||
+            (chunk.digest != FileChunker::ChunkDigest(chunkData.data(), chunkData.size())))
+        {
+            return false;
+        }
+        if (false == static_cast<bool>(outputStream.write(reinterpret_cast<const char*>(chunkData.data()), static_cast<std::streamsize>(chunk.length))))
+        {
+            return false;
+        }
+        restoredSize += chunk.length;
+    }
+
+    if ((fileSize != restoredSize) || (false == static_cast<bool>(outputStream.flush())))
+    {
+        return false;
+    }
+    outputStream.close();
+
+    HashDigest restoredDigest{};
+    return (true == FileHasher(HashAlgorithm::XXH3_128).Compute(outputPath, restoredDigest)) && (fileDigest == restoredDigest);
+}
+
+/**
+ * @brief Write a chunk unless the store already holds it.
+ *
+ * @param[in] chunk Chunk description
+ * @param[in] data Chunk content
+ * @return true if the chunk is stored, false on error
+ */
+bool ChunkStore::StoreChunk(const FileChunk& chunk, const std::uint8_t* data) const
+{
+    std::error_code errorCode;
+    const std::filesystem::path chunkPath = ChunkPath(chunk.digest);
+    if (true == std::filesystem::exists(chunkPath, errorCode))
+    {
+        return true;
+    }
+
+    std::filesystem::create_directories(chunkPath.parent_path(), errorCode);
+    return WriteFileAtomically(chunkPath, reinterpret_cast<const char*>(data), chunk.length);
+}
@@ -0,0 +1,99 @@
+// file ChunkStore.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+#include "FileHasher/FileChunker.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+/**
+ * @brief Chunk-level deduplicating store for archived file versions.
+ *
+ * An archived version is replaced by a manifest listing its content-defined chunks. Each distinct
+ * chunk is written once to `<root>/<first two hex digits>/<remaining hex digits>`, so versions of a
+ * large, slowly changing file only add the chunks around their edits.
+ *
+ * Manifest layout, all integers little-endian:
+ * - 8 bytes magic "RDCHUNK1"
+ * - u64 file size, u8 digest size, 16 bytes XXH3_128 file digest
+ * - u64 chunk count, then per chunk u32 length and 16 bytes XXH3_128 chunk digest
+ */
+class ChunkStore
+{
+  public:
+    /**
+     * @brief Suffix appended to the archived path of a file to name its manifest.
+     */
+    static constexpr const char* ManifestSuffix = ".chunks";
+
+    /**
+     * @brief Create a store rooted at a directory.
+     *
+     * @param[in] chunksRoot Directory holding the chunks
+     * @param[in] fileChunker Chunker that splits archived files
+     * @param[in] fileStateRepository Repository counting chunk references
+     */
+    ChunkStore(const std::filesystem::path& chunksRoot, const FileChunker& fileChunker, FileStateRepository& fileStateRepository);
+
+    /**
+     * @brief Get the location of a chunk.
+     *
+     * @param[in] digest Chunk digest
+     * @return Path of the chunk
+     */
+    std::filesystem::path ChunkPath(const HashDigest& digest) const;
+
+    /**
+     * @brief Get the location of a chunk below a chunk store root.
+     *
+     * @param[in] chunksRoot Directory holding the chunks
+     * @param[in] digest Chunk digest
+     * @return Path of the chunk
+     */
+    static std::filesystem::path ChunkPath(const std::filesystem::path& chunksRoot, const HashDigest& digest);
+
+    /**
+     * @brief Store the chunks of a file that are not stored yet and write a manifest for it.
+     *
+     * The manifest appears only once every chunk is stored and referenced. The file itself is left in place.
+     *
+     * @param[in] filePath File version to archive
+     * @param[in] manifestPath Manifest to create
+     * @return true on success, false on error
+     */
+    bool Archive(const std::filesystem::path& filePath, const std::filesystem::path& manifestPath) const;
+
+    /**
+     * @brief Rebuild an archived file version from its manifest.
+     *
+     * Every chunk and the reassembled file are checked against their recorded digests.
+     *
+     * @param[in] chunksRoot Directory holding the chunks
+     * @param[in] manifestPath Manifest written by Archive
+     * @param[in] outputPath File to create or replace
+     * @return true on success, false on error or digest mismatch
+     */
+    static bool Restore(const std::filesystem::path& chunksRoot, const std::filesystem::path& manifestPath, const std::filesystem::path& outputPath);
+
+    /**
+     * @brief Read the file size, file digest and chunk list of a manifest.
+     *
+     * @param[in] manifestPath Manifest written by Archive
+     * @param[out] outputFileSize Size in bytes of the archived version
+     * @param[out] outputFileDigest XXH3_128 digest of the archived version
+     * @param[out] outputChunks Chunks in file order, with their offsets
+     * @return true on success, false if the manifest is missing or malformed
+     */
+    static bool ReadManifest(const std::filesystem::path& manifestPath, std::uint64_t& outputFileSize, HashDigest& outputFileDigest,
+                             std::vector<FileChunk>& outputChunks);
+
+  private:
+    bool StoreChunk(const FileChunk& chunk, const std::uint8_t* data) const;
+
+    std::filesystem::path _chunksRoot;
+    const FileChunker& _fileChunker;
+    FileStateRepository& _fileStateRepository;
+};
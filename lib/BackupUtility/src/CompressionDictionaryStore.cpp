@@ -0,0 +1,173 @@
+// file CompressionDictionaryStore.cpp:
+
+#include "CompressionDictionaryStore.hpp"
+
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace
+{
+constexpr const char* SqlCreateCompressionDictionariesTable = "CREATE TABLE IF NOT EXISTS compression_dictionaries ("
+                                                              "id INTEGER PRIMARY KEY,"
+                                                              "extension TEXT NOT NULL UNIQUE,"
+                                                              "dictionary BLOB NOT NULL);";
+
+/**
+ * @brief Append a whole file to a sample buffer.
+ *
+ * @param[in] path File to read
+ * @param[in] size Size of the file in bytes
+ * @param[in,out] samples Concatenated samples
+ * @return true if the file was read completely, false otherwise, leaving the buffer as it was
+ */
+bool AppendSample(const std::filesystem::path& path, std::size_t size, std::vector<std::uint8_t>& samples)
+{
+    std::ifstream inputStream(path, std::ios::binary);
+    const std::size_t offset = samples.size();
+    samples.resize(offset + size);
+    inputStream.read(reinterpret_cast<char*>(samples.data() + offset), static_cast<std::streamsize>(size));
+    if (static_cast<std::size_t>(inputStream.gcount()) != size)
+    {
+        samples.resize(offset);
+        return false;
+    }
+    return true;
+}
+}
+
+CompressionDictionaryStore::CompressionDictionaryStore(SQLiteSession& databaseSession) : _databaseSession(databaseSession)
+{
+}
+
+bool CompressionDictionaryStore::InitializeSchema()
+{
+    try
+    {
+        _databaseSession.Acquire().Execute(SqlCreateCompressionDictionariesTable);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool CompressionDictionaryStore::Load(CompressionDictionaries& outputDictionaries)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT extension, dictionary FROM compression_dictionaries;");
+        while (true == statement.FetchRow())
+        {
+            const SQLiteBlob blob = statement.ColumnBlob(1);
+            const std::uint8_t* bytes = static_cast<const std::uint8_t*>(blob.data);
+            if (false == outputDictionaries.Add(std::string(statement.ColumnView(0)), std::vector<std::uint8_t>(bytes, bytes + blob.size)))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool CompressionDictionaryStore::TrainMissing(const std::filesystem::path& sampleRoot, std::uintmax_t maximumFileSize,
+                                              CompressionDictionaries& dictionaries)
+{
+    // Gather candidate samples per class in one bounded walk; files of classes that already have a dictionary are only counted.
+    std::map<std::string, std::vector<std::pair<std::filesystem::path, std::size_t>>> candidates;
+    std::error_code ec;
+    std::size_t walkedFiles = 0;
+    for (std::filesystem::recursive_directory_iterator iterator(sampleRoot, std::filesystem::directory_options::skip_permission_denied, ec), end;
+         (false == static_cast<bool>(ec)) && (iterator != end) && (walkedFiles < MaximumWalkedFiles); iterator.increment(ec))
+    {
+        if (false == iterator->is_regular_file(ec))
+        {
+            continue;
+        }
+        ++walkedFiles;
+        const std::uintmax_t size = iterator->file_size(ec);
+        const std::string extensionClass = CompressionDictionaries::ExtensionClass(iterator->path());
+        if ((0 != ec.value()) || (0 == size) || (maximumFileSize < size) || (true == dictionaries.HasClass(extensionClass)))
+        {
+            continue;
+        }
+        auto& samples = candidates[extensionClass];
+        if (samples.size() < MaximumSampleFiles)
+        {
+            samples.emplace_back(iterator->path(), static_cast<std::size_t>(size));
+        }
+    }
+
+    std::vector<std::pair<std::size_t, std::string>> classes;
+    for (const auto& [extensionClass, samples] : candidates)
+    {
+        if (MinimumSampleFiles <= samples.size())
+        {
+            classes.emplace_back(samples.size(), extensionClass);
+        }
+    }
+    std::sort(classes.begin(), classes.end(), [](const auto& left, const auto& right) { return left.first > right.first; });
+    classes.resize(std::min(classes.size(), MaximumTrainedClasses));
+
+    for (const auto& trainedClass : classes)
+    {
+        std::vector<std::uint8_t> samples;
+        std::vector<std::size_t> sampleSizes;
+        for (const auto& [path, size] : candidates[trainedClass.second])
+        {
+            if (MaximumSampleBytes < samples.size() + size)
+            {
+                break;
+            }
+            if (true == AppendSample(path, size, samples))
+            {
+                sampleSizes.push_back(size);
+            }
+        }
+        std::vector<std::uint8_t> dictionary;
+        if ((sampleSizes.size() < MinimumSampleFiles) ||
+            (false == CompressionDictionaries::Train(samples, sampleSizes, CompressionDictionaries::DefaultDictionarySize, dictionary)))
+        {
+            continue;
+        }
+        const std::uint32_t id = CompressionDictionaries::DictionaryId(dictionary);
+        if ((0 == id) || (nullptr != dictionaries.Find(id)))
+        {
+            continue;
+        }
+        if (false == Store(id, trainedClass.second, dictionary))
+        {
+            return false;
+        }
+        dictionaries.Add(trainedClass.second, std::move(dictionary));
+    }
+    return true;
+}
+
+bool CompressionDictionaryStore::Store(std::uint32_t id, const std::string& extensionClass, const std::vector<std::uint8_t>& dictionary)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("INSERT INTO compression_dictionaries(id, extension, dictionary) VALUES(?1, ?2, ?3);");
+        statement.BindInt64(1, static_cast<std::int64_t>(id));
+        statement.BindText(2, extensionClass);
+        statement.BindBlob(3, dictionary.data(), dictionary.size());
+        return statement.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
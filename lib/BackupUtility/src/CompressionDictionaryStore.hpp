@@ -0,0 +1,86 @@
+// file CompressionDictionaryStore.hpp:
+
+#pragma once
+
+#include "FileCompressor/FileCompressor.hpp"
+#include "SQLite/SQLiteSession.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Trained zstd dictionaries of compressed history, kept in the backup database by dictionary ID.
+ *
+ * A dictionary is never replaced once stored, since archived files name it by ID and need it to restore.
+ */
+class CompressionDictionaryStore
+{
+  public:
+    /**
+     * @brief Most extension classes trained in one run, the most frequent first.
+     */
+    static constexpr std::size_t MaximumTrainedClasses = 8;
+
+    /**
+     * @brief Fewest sample files a class needs to be trained.
+     */
+    static constexpr std::size_t MinimumSampleFiles = 32;
+
+    /**
+     * @brief Most sample files read per class.
+     */
+    static constexpr std::size_t MaximumSampleFiles = 4096;
+
+    /**
+     * @brief Most sample bytes read per class.
+     */
+    static constexpr std::size_t MaximumSampleBytes = 4 * 1024 * 1024;
+
+    /**
+     * @brief Most files looked at while walking for samples.
+     */
+    static constexpr std::size_t MaximumWalkedFiles = 65536;
+
+    /**
+     * @brief Create a store bound to a SQLite session on the backup database.
+     *
+     * @param[in] databaseSession Active SQLite session for the backup database
+     */
+    explicit CompressionDictionaryStore(SQLiteSession& databaseSession);
+
+    /**
+     * @brief Create the dictionary table if it does not exist.
+     *
+     * @return true on success, false on error
+     */
+    bool InitializeSchema();
+
+    /**
+     * @brief Load every stored dictionary.
+     *
+     * @param[out] outputDictionaries Set the dictionaries are added to
+     * @return true on success, false on error
+     */
+    bool Load(CompressionDictionaries& outputDictionaries);
+
+    /**
+     * @brief Train and store dictionaries for the frequent small-file classes below a tree that have none yet.
+     *
+     * Classes with too few samples, or whose training fails, are left without a dictionary and tried again
+     * by a later run.
+     *
+     * @param[in] sampleRoot Tree the samples are read from, the current backup copies
+     * @param[in] maximumFileSize Largest file size in bytes sampled, the largest compressed with a dictionary
+     * @param[in,out] dictionaries Loaded dictionaries; new ones are added
+     * @return true on success, false on a database error
+     */
+    bool TrainMissing(const std::filesystem::path& sampleRoot, std::uintmax_t maximumFileSize, CompressionDictionaries& dictionaries);
+
+  private:
+    bool Store(std::uint32_t id, const std::string& extensionClass, const std::vector<std::uint8_t>& dictionary);
+
+    SQLiteSession& _databaseSession;
+};
@@ -0,0 +1,112 @@
+// file ContentObjectStore.cpp:
+
+#include "ContentObjectStore.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr std::size_t ObjectDirectoryDigits = 2;
+constexpr std::size_t TrustedDigestSize = 16;
+constexpr std::size_t CompareBufferSize = 64 * 1024;
+
+/**
+ * @brief Check whether two files hold the same bytes.
+ *
+ * @param[in] firstPath First file
+ * @param[in] secondPath Second file
+ * @param[in] compareBytes Compare the content, not just the size
+ * @return true if the files match, false if they differ or cannot be read
+ */
+bool FilesMatch(const std::filesystem::path& firstPath, const std::filesystem::path& secondPath, bool compareBytes)
+{
+    std::error_code errorCode;
+    const std::uintmax_t firstSize = std::filesystem::file_size(firstPath, errorCode);
+    if (0 != errorCode.value())
+    {
+        return false;
+    }
+    const std::uintmax_t secondSize = std::filesystem::file_size(secondPath, errorCode);
+    if ((0 != errorCode.value()) || (firstSize != secondSize))
+    {
+        return false;
+    }
+    if (false == compareBytes)
+    {
+        return true;
+    }
+
+    std::ifstream firstStream(firstPath, std::ios::binary);
+    std::ifstream secondStream(secondPath, std::ios::binary);
+    if ((false == firstStream.is_open()) || (false == secondStream.is_open()))
+    {
+        return false;
+    }
+
+    std::vector<char> firstBuffer(CompareBufferSize);
+    std::vector<char> secondBuffer(CompareBufferSize);
+    const std::streamsize bufferSize = static_cast<std::streamsize>(CompareBufferSize);
+    while (true)
+    {
+        firstStream.read(firstBuffer.data(), bufferSize);
+        secondStream.read(secondBuffer.data(), bufferSize);
+        const std::streamsize bytesRead = firstStream.gcount();
+        if ((bytesRead != secondStream.gcount()) || (0 != std::memcmp(firstBuffer.data(), secondBuffer.data(), static_cast<std::size_t>(bytesRead))))
+        {
+            return false;
+        }
+        if (bufferSize > bytesRead)
+        {
+            return true;
+        }
+    }
+}
+}
+
+ContentObjectStore::ContentObjectStore(const std::filesystem::path& objectsRoot, const FileCopier& fileCopier)
+    : _objectsRoot(objectsRoot), _fileCopier(fileCopier)
+{
+}
+
+std::filesystem::path ContentObjectStore::ObjectPath(const HashDigest& digest) const
+{
+    const std::string hexDigest = digest.ToHex();
+    return _objectsRoot / hexDigest.substr(0, ObjectDirectoryDigits) / hexDigest.substr(ObjectDirectoryDigits);
+}
+
+bool ContentObjectStore::Insert(const std::filesystem::path& filePath, const HashDigest& digest) const
+{
+    std::error_code errorCode;
+    const std::filesystem::path objectPath = ObjectPath(digest);
+
+    // Concurrent inserts of the same content race benignly: whichever rename lands last holds identical bytes.
+    if (true == std::filesystem::exists(objectPath, errorCode))
+    {
+        if (false == FilesMatch(objectPath, filePath, TrustedDigestSize > digest.size))
+        {
+            return false;
+        }
+        std::filesystem::remove(filePath, errorCode);
+        return 0 == errorCode.value();
+    }
+
+    std::filesystem::create_directories(objectPath.parent_path(), errorCode);
+    return _fileCopier.Move(filePath, objectPath);
+}
+
+bool ContentObjectStore::Link(const HashDigest& digest, const std::filesystem::path& linkPath) const
+{
+    std::error_code errorCode;
+    const std::filesystem::path objectPath = ObjectPath(digest);
+
+    std::filesystem::remove(linkPath, errorCode);
+    std::filesystem::create_hard_link(objectPath, linkPath, errorCode);
+    if (0 == errorCode.value())
+    {
+        return true;
+    }
+    return _fileCopier.Copy(objectPath, linkPath);
+}
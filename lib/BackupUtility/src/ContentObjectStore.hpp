@@ -0,0 +1,60 @@
+// file ContentObjectStore.hpp:
+
+#pragma once
+
+#include "FileCopier/FileCopier.hpp"
+#include "FileHasher/FileHasher.hpp"
+
+#include <filesystem>
+
+/**
+ * @brief Content-addressed store holding each distinct file content once.
+ *
+ * Objects live at `<root>/<first two hex digits>/<remaining hex digits>` of their digest. Backup and
+ * snapshot files are hardlinks to an object, so a new version of a file costs one object and
+ * archiving it costs a rename. Objects are never modified in place.
+ */
+class ContentObjectStore
+{
+  public:
+    /**
+     * @brief Create a store rooted at a directory.
+     *
+     * @param[in] objectsRoot Directory holding the objects
+     * @param[in] fileCopier Used when an object cannot be moved or linked
+     */
+    ContentObjectStore(const std::filesystem::path& objectsRoot, const FileCopier& fileCopier);
+
+    /**
+     * @brief Get the location of an object.
+     *
+     * @param[in] digest Content digest
+     * @return Path of the object
+     */
+    std::filesystem::path ObjectPath(const HashDigest& digest) const;
+
+    /**
+     * @brief Add a complete file to the store, consuming it.
+     *
+     * When the object already exists the file is removed instead. Digests shorter than 128 bits are
+     * confirmed by comparing content, longer ones by comparing size.
+     *
+     * @param[in] filePath File holding the content; it no longer exists after success
+     * @param[in] digest Digest of the content
+     * @return true on success, false on error or if an existing object does not match; the file is kept then
+     */
+    bool Insert(const std::filesystem::path& filePath, const HashDigest& digest) const;
+
+    /**
+     * @brief Create a new hardlink to an object, copying the object where links are not supported.
+     *
+     * @param[in] digest Digest of the object
+     * @param[in] linkPath Path to create; an existing file there is replaced
+     * @return true on success, false on error
+     */
+    bool Link(const HashDigest& digest, const std::filesystem::path& linkPath) const;
+
+  private:
+    std::filesystem::path _objectsRoot;
+    const FileCopier& _fileCopier;
+};
@@ -0,0 +1,122 @@
+// file CopyCheckpointStore.cpp:
+
+#include "CopyCheckpointStore.hpp"
+
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+constexpr const char* SqlCreateCopyCheckpointTable = "CREATE TABLE IF NOT EXISTS copy_checkpoints ("
+                                                     "path TEXT NOT NULL,"
+                                                     "offset INTEGER NOT NULL,"
+                                                     "size INTEGER NOT NULL,"
+                                                     "mtime_ns INTEGER NOT NULL,"
+                                                     "ctime_ns INTEGER NOT NULL,"
+                                                     "algorithm TEXT NOT NULL,"
+                                                     "tail_hash INTEGER NOT NULL,"
+                                                     "chunk_hash INTEGER NOT NULL,"
+                                                     "state BLOB NOT NULL,"
+                                                     "PRIMARY KEY (path, offset)) WITHOUT ROWID;";
+}
+
+CopyCheckpointStore::CopyCheckpointStore(SQLiteSession& databaseSession) : _databaseSession(databaseSession)
+{
+}
+
+bool CopyCheckpointStore::InitializeSchema()
+{
+    try
+    {
+        _databaseSession.Acquire().Execute(SqlCreateCopyCheckpointTable);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool CopyCheckpointStore::Record(const std::string& relativeKey, const FileMetadata& metadata, const CopyCheckpoint& checkpoint)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto cachedStatement = connection.PrepareCached("INSERT OR REPLACE INTO copy_checkpoints "
+                                                        "(path, offset, size, mtime_ns, ctime_ns, algorithm, tail_hash, chunk_hash, state) "
+                                                        "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9);");
+        SQLiteStatement& statement = *cachedStatement;
+
+        statement.BindText(1, relativeKey);
+        statement.BindInt64(2, static_cast<std::int64_t>(checkpoint.point.size));
+        statement.BindInt64(3, static_cast<std::int64_t>(metadata.size));
+        statement.BindInt64(4, metadata.modificationTimeNs);
+        statement.BindInt64(5, metadata.changeTimeNs);
+        statement.BindText(6, HashAlgorithmToString(checkpoint.point.algorithm));
+        statement.BindInt64(7, static_cast<std::int64_t>(checkpoint.point.tailHash));
+        statement.BindInt64(8, static_cast<std::int64_t>(checkpoint.chunkHash));
+        statement.BindBlob(9, checkpoint.point.state.data(), checkpoint.point.state.size());
+        return statement.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool CopyCheckpointStore::Load(const std::string& relativeKey, const FileMetadata& metadata, HashAlgorithm algorithm,
+                               std::vector<CopyCheckpoint>& outputCheckpoints)
+{
+    outputCheckpoints.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto cachedStatement = connection.PrepareCached("SELECT offset, tail_hash, chunk_hash, state FROM copy_checkpoints WHERE path=?1 AND size=?2 "
+                                                        "AND mtime_ns=?3 AND ctime_ns=?4 AND algorithm=?5 ORDER BY offset;");
+        SQLiteStatement& statement = *cachedStatement;
+
+        statement.BindText(1, relativeKey);
+        statement.BindInt64(2, static_cast<std::int64_t>(metadata.size));
+        statement.BindInt64(3, metadata.modificationTimeNs);
+        statement.BindInt64(4, metadata.changeTimeNs);
+        statement.BindText(5, HashAlgorithmToString(algorithm));
+
+        while (true == statement.FetchRow())
+        {
+            const SQLiteBlob stateBlob = statement.ColumnBlob(3);
+            const std::uint8_t* stateBytes = static_cast<const std::uint8_t*>(stateBlob.data);
+            CopyCheckpoint checkpoint{};
+            checkpoint.point.algorithm = algorithm;
+            checkpoint.point.size = static_cast<std::uintmax_t>(statement.ColumnInt64(0));
+            checkpoint.point.tailHash = static_cast<std::uint64_t>(statement.ColumnInt64(1));
+            checkpoint.chunkHash = static_cast<std::uint64_t>(statement.ColumnInt64(2));
+            checkpoint.point.state.assign(stateBytes, stateBytes + stateBlob.size);
+            outputCheckpoints.push_back(std::move(checkpoint));
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        outputCheckpoints.clear();
+        return false;
+    }
+}
+
+bool CopyCheckpointStore::Truncate(const std::string& relativeKey, std::uintmax_t offset)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto cachedStatement = connection.PrepareCached("DELETE FROM copy_checkpoints WHERE path=?1 AND offset>?2;");
+        SQLiteStatement& statement = *cachedStatement;
+
+        statement.BindText(1, relativeKey);
+        statement.BindInt64(2, static_cast<std::int64_t>(offset));
+        return statement.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
@@ -0,0 +1,79 @@
+// file CopyCheckpointStore.hpp:
+
+#pragma once
+
+#include "FileHasher/FileHasher.hpp"
+#include "FileIterator/FileMetadata.hpp"
+#include "SQLite/SQLiteSession.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Committed chunk of a staged copy: the hash state after it and the XXH3_64 of its bytes.
+ */
+struct CopyCheckpoint
+{
+    HashResumePoint point;   /**< State after the chunk; point.size is the offset the chunk ends at */
+    std::uint64_t chunkHash; /**< XXH3_64 of the bytes since the previous checkpoint */
+};
+
+/**
+ * @brief Checkpoints of large copies in flight, kept in the state database so an interrupted run continues them.
+ *
+ * Checkpoints are keyed by state key and offset and are valid only while the source's size, mtime and
+ * ctime still match the metadata captured when the copy started. The staged copy they describe is checked
+ * against the chunk hash before a run continues from it, since it may have been torn after the checkpoint
+ * was committed.
+ */
+class CopyCheckpointStore
+{
+  public:
+    /**
+     * @brief Create a store bound to a SQLite session on the state database.
+     *
+     * @param[in] databaseSession Active SQLite session for the state database
+     */
+    explicit CopyCheckpointStore(SQLiteSession& databaseSession);
+
+    /**
+     * @brief Create the checkpoint table if it does not exist.
+     *
+     * @return true on success, false on error
+     */
+    bool InitializeSchema();
+
+    /**
+     * @brief Record a checkpoint of a copy.
+     *
+     * @param[in] relativeKey State key of the source file
+     * @param[in] metadata Metadata of the source, captured before the copy started
+     * @param[in] checkpoint Checkpoint to record
+     * @return true on success, false on error
+     */
+    bool Record(const std::string& relativeKey, const FileMetadata& metadata, const CopyCheckpoint& checkpoint);
+
+    /**
+     * @brief Load the checkpoints of a copy whose source is unchanged.
+     *
+     * @param[in] relativeKey State key of the source file
+     * @param[in] metadata Current metadata of the source
+     * @param[in] algorithm Algorithm of the wanted states
+     * @param[out] outputCheckpoints Checkpoints by ascending offset, empty if none match
+     * @return true on success, false on error
+     */
+    bool Load(const std::string& relativeKey, const FileMetadata& metadata, HashAlgorithm algorithm, std::vector<CopyCheckpoint>& outputCheckpoints);
+
+    /**
+     * @brief Drop the checkpoints of a copy past an offset.
+     *
+     * @param[in] relativeKey State key of the source file
+     * @param[in] offset Offset to keep checkpoints up to, 0 to drop them all
+     * @return true on success, false on error
+     */
+    bool Truncate(const std::string& relativeKey, std::uintmax_t offset);
+
+  private:
+    SQLiteSession& _databaseSession;
+};
@@ -0,0 +1,118 @@
+// file DatabaseMaintenance.cpp:
+
+#include "DatabaseMaintenance.hpp"
+
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+/**
+ * @brief Value of `PRAGMA auto_vacuum` for incremental mode.
+ */
+constexpr std::int64_t AutoVacuumIncremental = 2;
+
+/**
+ * @brief Rows per index `PRAGMA optimize` samples, as recommended by SQLite for running it often.
+ */
+constexpr int OptimizeAnalysisLimit = 400;
+
+/**
+ * @brief Read a pragma returning a single integer.
+ */
+std::int64_t ReadPragma(SQLiteConnection& connection, const char* pragma)
+{
+    auto statement = connection.Prepare(pragma);
+    if (false == statement.FetchRow())
+    {
+        throw std::runtime_error("Pragma returned no row");
+    }
+    return statement.ColumnInt64(0);
+}
+}
+
+DatabaseMaintenance::DatabaseMaintenance(SQLiteSession& databaseSession) : _databaseSession(databaseSession)
+{
+}
+
+bool DatabaseMaintenance::Size(std::uint64_t& outputBytes)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        outputBytes = static_cast<std::uint64_t>(ReadPragma(connection, "PRAGMA page_count;")) *
+                      static_cast<std::uint64_t>(ReadPragma(connection, "PRAGMA page_size;"));
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool DatabaseMaintenance::Analyze()
+{
+    try
+    {
+        _databaseSession.Acquire().Execute("ANALYZE;");
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool DatabaseMaintenance::Optimize()
+{
+    try
+    {
+        _databaseSession.Acquire().Execute("PRAGMA analysis_limit=" + std::to_string(OptimizeAnalysisLimit) + "; PRAGMA optimize;");
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool DatabaseMaintenance::EnableIncrementalVacuum(bool& outputConverted)
+{
+    outputConverted = false;
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        if (AutoVacuumIncremental == ReadPragma(connection, "PRAGMA auto_vacuum;"))
+        {
+            return true;
+        }
+        // Leaving auto-vacuum NONE only takes effect through a VACUUM, which rewrites the whole file.
+        connection.Execute("PRAGMA auto_vacuum=INCREMENTAL; VACUUM;");
+        outputConverted = (AutoVacuumIncremental == ReadPragma(connection, "PRAGMA auto_vacuum;"));
+        return true == outputConverted;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool DatabaseMaintenance::IncrementalVacuum()
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        if (AutoVacuumIncremental == ReadPragma(connection, "PRAGMA auto_vacuum;"))
+        {
+            connection.Execute("PRAGMA incremental_vacuum;");
+        }
+        // Freed pages leave the file only once the WAL is checkpointed into it.
+        return connection.Checkpoint(SQLiteCheckpointMode::Truncate);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
@@ -0,0 +1,72 @@
+// file DatabaseMaintenance.hpp:
+
+#pragma once
+
+#include "SQLite/SQLiteSession.hpp"
+
+#include <cstdint>
+
+/**
+ * @brief Keeps the state database compact and its query plans current.
+ *
+ * Months of upserts and deletions leave free pages behind and statistics that no longer match the
+ * tables. Statistics are refreshed with ANALYZE, or cheaply with `PRAGMA optimize` at the end of a run.
+ * Databases in incremental auto-vacuum mode hand their free pages back to the file system online; an
+ * older database is rewritten into that mode once on request.
+ */
+class DatabaseMaintenance
+{
+  public:
+    /**
+     * @brief Create a maintainer bound to a SQLite session on the state database.
+     *
+     * @param[in] databaseSession Active SQLite session for the state database
+     */
+    explicit DatabaseMaintenance(SQLiteSession& databaseSession);
+
+    /**
+     * @brief Get the size of the database, free pages included.
+     *
+     * @param[out] outputBytes Pages times page size
+     * @return true on success, false on error
+     */
+    bool Size(std::uint64_t& outputBytes);
+
+    /**
+     * @brief Gather fresh statistics on every table and index.
+     *
+     * @return true on success, false on error
+     */
+    bool Analyze();
+
+    /**
+     * @brief Refresh the statistics the queries of this thread's connection rely on, when they look stale.
+     *
+     * The analysis is limited to a sample of each index, so it stays cheap enough to run after every backup.
+     *
+     * @return true on success, false on error
+     */
+    bool Optimize();
+
+    /**
+     * @brief Switch the database to incremental auto-vacuum, rewriting it once with VACUUM if needed.
+     *
+     * The rewrite needs as much free space as the database and no other connection in a transaction.
+     *
+     * @param[out] outputConverted true if the database was rewritten, false if it already was incremental
+     * @return true on success, false on error
+     */
+    bool EnableIncrementalVacuum(bool& outputConverted);
+
+    /**
+     * @brief Return the free pages to the file system and truncate the WAL.
+     *
+     * Does nothing but the checkpoint on a database that is not in incremental auto-vacuum mode.
+     *
+     * @return true on success, false on error
+     */
+    bool IncrementalVacuum();
+
+  private:
+    SQLiteSession& _databaseSession;
+};
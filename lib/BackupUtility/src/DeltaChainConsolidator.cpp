@@ -0,0 +1,242 @@
+// file DeltaChainConsolidator.cpp:
+
+#include "DeltaChainConsolidator.hpp"
+
+#include "ChunkStore.hpp"
+#include "FileDelta.hpp"
+#include "RelativePathBuilder.hpp"
+#include "FileCompressor/FileCompressor.hpp"
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+
+namespace
+{
+constexpr const char* StagingPrefix = "consolidate-";
+
+/**
+ * @brief Remove a suffix from the end of a string if it is there.
+ *
+ * @param[in,out] value String to shorten
+ * @param[in] suffix Suffix to remove
+ * @return true if the suffix was removed
+ */
+bool StripSuffix(std::string& value, const std::string& suffix)
+{
+    if ((suffix.size() < value.size()) && (0 == value.compare(value.size() - suffix.size(), suffix.size(), suffix)))
+    {
+        value.resize(value.size() - suffix.size());
+        return true;
+    }
+    return false;
+}
+} // namespace
+
+DeltaChainConsolidator::DeltaChainConsolidator(const ConsolidateConfig& configuration, IoThrottle& ioThrottle)
+    : _configuration(configuration), _ioThrottle(ioThrottle)
+{
+}
+
+bool DeltaChainConsolidator::Plan(ConsolidateReport& outputReport)
+{
+    const std::filesystem::path historyRoot = _configuration.backupRoot / "deleted";
+    std::error_code ec;
+    // Keyframes an interrupted consolidation was rebuilding are never renamed into place now.
+    for (std::filesystem::directory_iterator entry(_configuration.backupRoot / "staging", ec), end; (0 == ec.value()) && (end != entry);
+         entry.increment(ec))
+    {
+        if (0 == entry->path().filename().string().rfind(StagingPrefix, 0))
+        {
+            std::error_code removeEc;
+            std::filesystem::remove(entry->path(), removeEc);
+        }
+    }
+    ec.clear();
+
+    // Snapshot directories are named by timestamp, so name order is age order.
+    for (const auto& entry : std::filesystem::directory_iterator(historyRoot, ec))
+    {
+        if (true == entry.is_directory(ec))
+        {
+            _snapshots.push_back(entry.path().filename().string());
+        }
+    }
+    if ((0 != ec.value()) && (std::errc::no_such_file_or_directory != ec))
+    {
+        return false;
+    }
+    std::sort(_snapshots.begin(), _snapshots.end());
+
+    for (std::uint32_t snapshot = 0; snapshot < _snapshots.size(); ++snapshot)
+    {
+        const std::filesystem::path snapshotRoot = historyRoot / _snapshots[snapshot];
+        for (std::filesystem::recursive_directory_iterator entry(snapshotRoot, ec), end; (0 == ec.value()) && (end != entry); entry.increment(ec))
+        {
+            std::error_code typeEc;
+            if (false == entry->is_regular_file(typeEc))
+            {
+                continue;
+            }
+            std::string relativePath;
+            try
+            {
+                relativePath = RelativePathBuilder::KeyOf(entry->path().lexically_relative(snapshotRoot));
+            }
+            catch (const std::runtime_error&)
+            {
+                // A name with no UTF-8 spelling was never archived under a key, so it belongs to no chain.
+                continue;
+            }
+            const bool delta = StripSuffix(relativePath, FileDelta::DeltaSuffix);
+            if ((false == delta) && (false == StripSuffix(relativePath, FileCompressor::CompressedSuffix)))
+            {
+                StripSuffix(relativePath, ChunkStore::ManifestSuffix);
+            }
+            // Full versions older than every delta of their file end no chain, so they are not kept.
+            auto found = _versions.find(relativePath);
+            if (_versions.end() == found)
+            {
+                if (true == delta)
+                {
+                    _versions[relativePath].push_back(ArchivedVersion{snapshot, true});
+                }
+                continue;
+            }
+            if ((false == found->second.empty()) && (snapshot == found->second.back().snapshot))
+            {
+                // A plain version next to its delta is a rewrite that stopped before removing the delta.
+                if (found->second.back().delta != delta)
+                {
+                    std::filesystem::path staleDelta = snapshotRoot / RelativePathBuilder::PathOf(relativePath);
+                    staleDelta += FileDelta::DeltaSuffix;
+                    std::error_code removeEc;
+                    std::filesystem::remove(staleDelta, removeEc);
+                    found->second.back().delta = false;
+                }
+                continue;
+            }
+            found->second.push_back(ArchivedVersion{snapshot, delta});
+        }
+        if (0 != ec.value())
+        {
+            return false;
+        }
+    }
+    outputReport.chains = _versions.size();
+    return true;
+}
+
+bool DeltaChainConsolidator::Execute(std::size_t queueDepth, ConsolidateReport& outputReport)
+{
+    _report = ConsolidateReport{};
+    if (false == _versions.empty())
+    {
+        ThreadedFileQueueOptions options;
+        options.idlePriority = true;
+        ThreadedFileQueue chainQueue(
+            _configuration.threads, queueDepth, [this](const std::filesystem::path& relativePath) { ConsolidateChain(relativePath); }, nullptr,
+            options);
+        std::vector<std::filesystem::path> relativePaths;
+        relativePaths.reserve(_versions.size());
+        for (const auto& entry : _versions)
+        {
+            relativePaths.push_back(RelativePathBuilder::PathOf(entry.first));
+        }
+        chainQueue.EnqueueBatch(std::move(relativePaths));
+        chainQueue.Finalize();
+    }
+    outputReport.keyframesWritten += _report.keyframesWritten;
+    outputReport.bytesWritten += _report.bytesWritten;
+    outputReport.longestChain = std::max(outputReport.longestChain, _report.longestChain);
+    outputReport.failed += _report.failed;
+    return 0 == _report.failed;
+}
+
+/**
+ * @brief Walk the versions of one file from newest to oldest and rewrite the deltas that cross a bound.
+ *
+ * @param[in] relativePath Location of the file below a snapshot directory
+ */
+void DeltaChainConsolidator::ConsolidateChain(const std::filesystem::path& relativePath)
+{
+    const std::vector<ArchivedVersion>& versions = _versions.at(RelativePathBuilder::KeyOf(relativePath));
+    const std::filesystem::path historyRoot = _configuration.backupRoot / "deleted";
+    ConsolidateReport chainReport{};
+    std::size_t depth = 0;
+    std::uint64_t rebuiltBytes = 0;
+    for (std::size_t i = versions.size(); 0 < i; --i)
+    {
+        const std::filesystem::path plainPath = historyRoot / _snapshots[versions[i - 1].snapshot] / relativePath;
+        std::filesystem::path deltaPath = plainPath;
+        deltaPath += FileDelta::DeltaSuffix;
+        if (false == versions[i - 1].delta)
+        {
+            depth = 0;
+            rebuiltBytes = 0;
+            continue;
+        }
+        std::uint64_t size = 0;
+        if (false == FileDelta::ReadTargetSize(deltaPath, size))
+        {
+            ++chainReport.failed;
+        }
+        ++depth;
+        rebuiltBytes += size;
+        const bool tooLong = (0 != _configuration.keyframeInterval) && (_configuration.keyframeInterval < depth);
+        const bool tooCostly = (0 != _configuration.maxChainBytes) && (1 < depth) && (_configuration.maxChainBytes < rebuiltBytes);
+        if ((true == tooLong) || (true == tooCostly))
+        {
+            if (true == WriteKeyframe(deltaPath, plainPath, rebuiltBytes))
+            {
+                ++chainReport.keyframesWritten;
+                chainReport.bytesWritten += size;
+                depth = 0;
+                rebuiltBytes = 0;
+                continue;
+            }
+            ++chainReport.failed;
+        }
+        chainReport.longestChain = std::max(chainReport.longestChain, depth);
+    }
+
+    std::lock_guard<std::mutex> lock(_reportMutex);
+    _report.keyframesWritten += chainReport.keyframesWritten;
+    _report.bytesWritten += chainReport.bytesWritten;
+    _report.longestChain = std::max(_report.longestChain, chainReport.longestChain);
+    _report.failed += chainReport.failed;
+}
+
+/**
+ * @brief Rebuild a delta version into staging, move it over its plain name and remove the delta.
+ *
+ * @param[in] deltaPath Delta of the version
+ * @param[in] plainPath Name the version gets in full
+ * @param[in] rebuiltBytes Bytes the chain rebuilds, which the throttle counts as read
+ * @return true if the version is stored in full, false if it could not be rebuilt or moved
+ */
+bool DeltaChainConsolidator::WriteKeyframe(const std::filesystem::path& deltaPath, const std::filesystem::path& plainPath, std::uint64_t rebuiltBytes)
+{
+    const std::filesystem::path stagingDirectory = _configuration.backupRoot / "staging";
+    const std::filesystem::path stagedFile = stagingDirectory / (StagingPrefix + std::to_string(_nextStaging.fetch_add(1)));
+    std::error_code ec;
+    std::filesystem::create_directories(stagingDirectory, ec);
+    const bool rebuilt = RestoreDeltaFile(_configuration.backupRoot, deltaPath, stagedFile, _configuration.databaseFile);
+    _ioThrottle.AcquireRead(rebuiltBytes);
+    const std::uint64_t size = std::filesystem::file_size(stagedFile, ec);
+    if ((false == rebuilt) || (0 != ec.value()))
+    {
+        std::filesystem::remove(stagedFile, ec);
+        return false;
+    }
+    _ioThrottle.AcquireWrite(size);
+    std::filesystem::rename(stagedFile, plainPath, ec);
+    if (0 != ec.value())
+    {
+        std::filesystem::remove(stagedFile, ec);
+        return false;
+    }
+    std::filesystem::remove(deltaPath, ec);
+    return true;
+}
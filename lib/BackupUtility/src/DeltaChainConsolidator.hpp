@@ -0,0 +1,77 @@
+// file DeltaChainConsolidator.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Rewrites delta versions of the history as full versions so that no delta chain grows past a bound.
+ *
+ * Plan walks the snapshot directories once, oldest first, and records for every archived file the
+ * snapshots holding a version of it and whether that version is a delta. Execute hands each file with a
+ * delta to a pool of idle-priority threads. A thread walks the versions of its file from newest to oldest,
+ * counting the deltas and the bytes they rebuild since the nearest full version; the current copy and
+ * any plain or compressed version start the count again. The delta that crosses a bound is rebuilt into
+ * staging/, verified against its digest by the delta itself, renamed over its plain name, and then
+ * removed. Restore prefers a plain version to a delta, so a rewrite interrupted between the two leaves
+ * a store that restores correctly and is finished by the next consolidation.
+ */
+class DeltaChainConsolidator
+{
+  public:
+    /**
+     * @brief Create a consolidator.
+     *
+     * @param[in] configuration Store, bounds and database holding the compression dictionaries
+     * @param[in,out] ioThrottle Throttle paced by the bytes rebuilt and written
+     */
+    DeltaChainConsolidator(const ConsolidateConfig& configuration, IoThrottle& ioThrottle);
+
+    /**
+     * @brief Find the archived files with delta versions.
+     *
+     * @param[out] outputReport Number of files with a delta chain
+     * @return true on success, false if the history cannot be listed
+     */
+    bool Plan(ConsolidateReport& outputReport);
+
+    /**
+     * @brief Rewrite the versions that cross a bound on a pool of idle-priority threads.
+     *
+     * @param[in] queueDepth Bound of the work queue
+     * @param[in,out] outputReport Keyframes written, longest chain left and failures are added
+     * @return true if every version that crossed a bound was rewritten, false otherwise
+     */
+    bool Execute(std::size_t queueDepth, ConsolidateReport& outputReport);
+
+  private:
+    /**
+     * @brief One archived version of a file.
+     */
+    struct ArchivedVersion
+    {
+        std::uint32_t snapshot; /**< Index into _snapshots */
+        bool delta;             /**< Stored as a delta against the next newer version */
+    };
+
+    void ConsolidateChain(const std::filesystem::path& relativePath);
+    bool WriteKeyframe(const std::filesystem::path& deltaPath, const std::filesystem::path& plainPath, std::uint64_t rebuiltBytes);
+
+    ConsolidateConfig _configuration;
+    IoThrottle& _ioThrottle;
+    std::vector<std::string> _snapshots;                                    /**< Snapshot directory names, oldest first */
+    std::unordered_map<std::string, std::vector<ArchivedVersion>> _versions; /**< Versions of each archived file, oldest first */
+    std::atomic<std::uint64_t> _nextStaging{0};
+    std::mutex _reportMutex;
+    ConsolidateReport _report{};
+};
@@ -0,0 +1,156 @@
+// file DigestAttributeCache.cpp:
+
+#include "DigestAttributeCache.hpp"
+
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/xattr.h>
+#endif
+
+namespace
+{
+constexpr std::uint8_t EntryVersion = 1;
+constexpr std::size_t MaximumAlgorithmNameSize = 32;
+/**< Version, size, mtime, algorithm name length and name, digest length and digest */
+constexpr std::size_t MaximumEntrySize = 1 + 8 + 8 + 1 + MaximumAlgorithmNameSize + 1 + HashDigest::MaxSize;
+#ifdef _WIN32
+// FILETIME counts 100 ns intervals since 1601-01-01.
+constexpr std::int64_t FileTimeToUnixEpochIntervals = 116444736000000000LL;
+constexpr std::int64_t NanosecondsPerFileTimeInterval = 100;
+#endif
+
+void AppendUint64(std::string& output, std::uint64_t value)
+{
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        output.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+std::uint64_t ReadUint64(const std::uint8_t* bytes)
+{
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        value |= static_cast<std::uint64_t>(*bytes++) << shift;
+    }
+    return value;
+}
+
+/**
+ * @brief Encode an entry: version, size and mtime as little-endian 64-bit numbers, then the algorithm name and the digest, each after its length byte.
+ */
+std::string EncodeEntry(const FileMetadata& metadata, HashAlgorithm algorithm, const HashDigest& digest)
+{
+    const char* algorithmName = HashAlgorithmToString(algorithm);
+    const std::string name(algorithmName);
+    std::string entry;
+    entry.reserve(MaximumEntrySize);
+    entry.push_back(static_cast<char>(EntryVersion));
+    AppendUint64(entry, metadata.size);
+    AppendUint64(entry, static_cast<std::uint64_t>(metadata.modificationTimeNs));
+    entry.push_back(static_cast<char>(name.size()));
+    entry += name;
+    entry.push_back(static_cast<char>(digest.size));
+    entry.append(reinterpret_cast<const char*>(digest.bytes.data()), digest.size);
+    return entry;
+}
+
+bool DecodeEntry(const std::uint8_t* entry, std::size_t entrySize, const FileMetadata& metadata, HashAlgorithm algorithm, HashDigest& outputDigest)
+{
+    constexpr std::size_t NameOffset = 1 + 8 + 8 + 1;
+    if ((NameOffset > entrySize) || (EntryVersion != entry[0]) || (metadata.size != ReadUint64(entry + 1)) ||
+        (metadata.modificationTimeNs != static_cast<std::int64_t>(ReadUint64(entry + 9))))
+    {
+        return false;
+    }
+    const std::size_t nameSize = entry[NameOffset - 1];
+    if ((NameOffset + nameSize + 1) > entrySize)
+    {
+        return false;
+    }
+    const std::string name(reinterpret_cast<const char*>(entry + NameOffset), nameSize);
+    const std::size_t digestSize = entry[NameOffset + nameSize];
+    const std::size_t digestOffset = NameOffset + nameSize + 1;
+    if ((name != HashAlgorithmToString(algorithm)) || ((digestOffset + digestSize) != entrySize) || (HashAlgorithmDigestSize(algorithm) != digestSize))
+    {
+        return false;
+    }
+    return HashDigest::FromBytes(entry + digestOffset, digestSize, outputDigest);
+}
+
+#ifdef _WIN32
+std::wstring StreamPath(const std::filesystem::path& file)
+{
+    return file.native() + L":" + DigestAttributeCache::StreamName;
+}
+#endif
+}
+
+bool DigestAttributeCache::Lookup(const std::filesystem::path& file, const FileMetadata& metadata, HashAlgorithm algorithm, HashDigest& outputDigest) const
+{
+    std::uint8_t entry[MaximumEntrySize];
+#ifdef _WIN32
+    const HANDLE stream = CreateFileW(StreamPath(file).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == stream)
+    {
+        return false;
+    }
+    DWORD entrySize = 0;
+    const BOOL read = ReadFile(stream, entry, sizeof(entry), &entrySize, nullptr);
+    CloseHandle(stream);
+    return (FALSE != read) && (true == DecodeEntry(entry, entrySize, metadata, algorithm, outputDigest));
+#elif defined(__linux__)
+    // Symlinks are backed up as links, so the attribute of a link target is never the file's own.
+    const ssize_t entrySize = lgetxattr(file.c_str(), AttributeName, entry, sizeof(entry));
+    return (0 < entrySize) && (true == DecodeEntry(entry, static_cast<std::size_t>(entrySize), metadata, algorithm, outputDigest));
+#else
+    static_cast<void>(file);
+    static_cast<void>(metadata);
+    static_cast<void>(algorithm);
+    static_cast<void>(outputDigest);
+    static_cast<void>(entry);
+    return false;
+#endif
+}
+
+bool DigestAttributeCache::Store(const std::filesystem::path& file, const FileMetadata& metadata, HashAlgorithm algorithm, const HashDigest& digest) const
+{
+    const std::string entry = EncodeEntry(metadata, algorithm, digest);
+#ifdef _WIN32
+    const HANDLE stream = CreateFileW(StreamPath(file).c_str(), GENERIC_WRITE | FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                      nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == stream)
+    {
+        return false;
+    }
+    DWORD written = 0;
+    bool stored = (FALSE != WriteFile(stream, entry.data(), static_cast<DWORD>(entry.size()), &written, nullptr)) && (entry.size() == written);
+    // Writing a stream moves the file's last write time, which is its mtime; it is put back to the time the digest is for.
+    const std::uint64_t intervals =
+        static_cast<std::uint64_t>((metadata.modificationTimeNs / NanosecondsPerFileTimeInterval) + FileTimeToUnixEpochIntervals);
+    FILETIME lastWriteTime{};
+    lastWriteTime.dwLowDateTime = static_cast<DWORD>(intervals & 0xFFFFFFFFU);
+    lastWriteTime.dwHighDateTime = static_cast<DWORD>(intervals >> 32);
+    stored = (true == stored) && (FALSE != SetFileTime(stream, nullptr, nullptr, &lastWriteTime));
+    CloseHandle(stream);
+    return stored;
+#elif defined(__linux__)
+    return 0 == lsetxattr(file.c_str(), AttributeName, entry.data(), entry.size(), 0);
+#else
+    static_cast<void>(file);
+    static_cast<void>(entry);
+    return false;
+#endif
+}
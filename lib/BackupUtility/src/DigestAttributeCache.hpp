@@ -0,0 +1,52 @@
+// file DigestAttributeCache.hpp:
+
+#pragma once
+
+#include "FileHasher/FileHasher.hpp"
+#include "FileIterator/FileMetadata.hpp"
+
+#include <filesystem>
+
+/**
+ * @brief Digest cache kept on each source file itself, in an extended attribute or an NTFS alternate data stream.
+ *
+ * The entry holds the digest, the algorithm and the size and mtime it was computed for, so any job or host
+ * reading the same filesystem can skip hashing an unchanged file with one attribute read. Unlike HashCache it
+ * follows the file through renames. Writing it needs write access to the file and changes its ctime, never its
+ * mtime. Linux and Windows only; elsewhere nothing is cached.
+ */
+class DigestAttributeCache
+{
+  public:
+    /**
+     * @brief Name of the extended attribute on Linux.
+     */
+    static constexpr const char* AttributeName = "user.rdemo.digest";
+
+    /**
+     * @brief Name of the alternate data stream on Windows.
+     */
+    static constexpr const wchar_t* StreamName = L"rdemo.digest";
+
+    /**
+     * @brief Read the digest cached on a file whose size and mtime are unchanged.
+     *
+     * @param[in] file File to look up
+     * @param[in] metadata Metadata of the file, captured before the lookup
+     * @param[in] algorithm Algorithm of the wanted digest
+     * @param[out] outputDigest Cached digest
+     * @return true on a hit, false on a miss, a stale or malformed entry, or an error
+     */
+    bool Lookup(const std::filesystem::path& file, const FileMetadata& metadata, HashAlgorithm algorithm, HashDigest& outputDigest) const;
+
+    /**
+     * @brief Cache the digest of a file on the file.
+     *
+     * @param[in] file File that was hashed
+     * @param[in] metadata Metadata of the file, captured before it was hashed
+     * @param[in] algorithm Algorithm that produced the digest
+     * @param[in] digest Digest to cache
+     * @return true on success, false if the file cannot carry the entry, for example without write access
+     */
+    bool Store(const std::filesystem::path& file, const FileMetadata& metadata, HashAlgorithm algorithm, const HashDigest& digest) const;
+};
@@ -0,0 +1,116 @@
+// file DirectoryCompletionTracker.cpp:
+
+#include "DirectoryCompletionTracker.hpp"
+
+#include <utility>
+
+namespace
+{
+constexpr char KeySeparator = static_cast<char>(std::filesystem::path::preferred_separator);
+}
+
+DirectoryCompletionTracker::DirectoryCompletionTracker(const RelativePathBuilder& sourceKeys, FileStateRepository& fileStateRepository,
+                                                       DeletionSink onDeleted, DirectoryStateMerger* stateMerger)
+    : _pathBuilder(sourceKeys), _fileStateRepository(fileStateRepository), _onDeleted(std::move(onDeleted)), _stateMerger(stateMerger)
+{
+}
+
+void DirectoryCompletionTracker::AddListed(const std::vector<FileEntry>& files)
+{
+    if (true == files.empty())
+    {
+        return;
+    }
+    std::string directoryKey;
+    std::vector<std::string> names;
+    names.reserve(files.size());
+    std::string key;
+    for (const auto& file : files)
+    {
+        if (false == _pathBuilder.BuildKey(file.path, key))
+        {
+            continue;
+        }
+        const std::size_t separator = key.find_last_of(KeySeparator);
+        if (true == names.empty())
+        {
+            directoryKey.assign(key, 0, (std::string::npos == separator) ? 0 : separator);
+        }
+        names.emplace_back(key, (std::string::npos == separator) ? 0 : separator + 1);
+    }
+    if (nullptr != _stateMerger)
+    {
+        _stateMerger->Merge(directoryKey, names);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_listedMutex);
+    auto& listed = _listedNames[directoryKey];
+    for (auto& name : names)
+    {
+        listed.insert(std::move(name));
+    }
+}
+
+void DirectoryCompletionTracker::CompleteDirectory(const std::filesystem::path& directory, bool listed)
+{
+    std::string directoryKey;
+    if (false == _pathBuilder.BuildDirectoryKey(directory, directoryKey))
+    {
+        return;
+    }
+    // An incomplete listing might hide files, so its stored files are left to the final pass.
+    std::vector<std::string> missingNames;
+    if (nullptr != _stateMerger)
+    {
+        if (false == listed)
+        {
+            _stateMerger->Discard(directoryKey);
+            return;
+        }
+        if (false == _stateMerger->TakeUnlisted(directoryKey, missingNames))
+        {
+            return;
+        }
+    }
+    else
+    {
+        std::unordered_set<std::string> listedNames;
+        {
+            std::lock_guard<std::mutex> lock(_listedMutex);
+            const auto entry = _listedNames.find(directoryKey);
+            if (_listedNames.end() != entry)
+            {
+                listedNames = std::move(entry->second);
+                _listedNames.erase(entry);
+            }
+        }
+        if (false == listed)
+        {
+            return;
+        }
+
+        std::vector<std::string> storedNames;
+        if (false == _fileStateRepository.GetLiveFileNames(directoryKey, storedNames))
+        {
+            return;
+        }
+        for (auto& name : storedNames)
+        {
+            if (0 == listedNames.count(name))
+            {
+                missingNames.push_back(std::move(name));
+            }
+        }
+    }
+
+    std::vector<std::string> deletedPaths;
+    for (const auto& name : missingNames)
+    {
+        deletedPaths.push_back((true == directoryKey.empty()) ? name : directoryKey + KeySeparator + name);
+    }
+    if (false == deletedPaths.empty())
+    {
+        _onDeleted(std::move(deletedPaths));
+    }
+}
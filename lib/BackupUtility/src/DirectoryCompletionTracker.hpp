@@ -0,0 +1,73 @@
+// file DirectoryCompletionTracker.hpp:
+
+#pragma once
+
+#include "DirectoryStateMerger.hpp"
+#include "FileIterator/FileIterator.hpp"
+#include "FileStateRepository.hpp"
+#include "RelativePathBuilder.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Finds deleted files directory by directory while the walk is still running.
+ *
+ * The walker's batches are recorded per directory until the directory is reported complete. A stored
+ * live file that is missing from a complete listing has been deleted, so the directory's missing files
+ * are handed on together right away, without waiting for the rest of the tree. Files of directories
+ * that disappeared, or that could not be listed, are left to the deletion pass after the backup. With a
+ * DirectoryStateMerger the batches are merged with the stored rows instead, which then also yield the
+ * missing files without another query.
+ */
+class DirectoryCompletionTracker
+{
+  public:
+    /**
+     * @brief Receives the repository-relative paths of the files found deleted from one directory.
+     */
+    using DeletionSink = std::function<void(std::vector<std::string>&&)>;
+
+    /**
+     * @brief Construct a tracker for one walk.
+     *
+     * @param[in] sourceKeys Mapping of walked directories and files to their state keys
+     * @param[in] fileStateRepository Repository holding the stored files of each directory
+     * @param[in] onDeleted Sink for files found deleted; called from the walker threads
+     * @param[in] stateMerger Merger receiving the batches instead of the tracker's own records, nullptr keeps the records
+     */
+    DirectoryCompletionTracker(const RelativePathBuilder& sourceKeys, FileStateRepository& fileStateRepository, DeletionSink onDeleted,
+                               DirectoryStateMerger* stateMerger = nullptr);
+
+    DirectoryCompletionTracker(const DirectoryCompletionTracker&) = delete;
+    DirectoryCompletionTracker& operator=(const DirectoryCompletionTracker&) = delete;
+
+    /**
+     * @brief Record a batch of listed files, all from one directory.
+     *
+     * @param[in] files Files of the batch
+     */
+    void AddListed(const std::vector<FileEntry>& files);
+
+    /**
+     * @brief Compare a finished directory listing with the stored files and hand on those that are missing.
+     *
+     * @param[in] directory Directory whose files have all been recorded
+     * @param[in] listed The directory was listed completely; otherwise nothing is handed on
+     */
+    void CompleteDirectory(const std::filesystem::path& directory, bool listed);
+
+  private:
+    RelativePathBuilder _pathBuilder;
+    FileStateRepository& _fileStateRepository;
+    DeletionSink _onDeleted;
+    DirectoryStateMerger* _stateMerger;
+
+    std::mutex _listedMutex;
+    std::unordered_map<std::string, std::unordered_set<std::string>> _listedNames; /**< Listed file names by directory key */
+};
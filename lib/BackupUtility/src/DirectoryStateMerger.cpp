@@ -0,0 +1,129 @@
+// file DirectoryStateMerger.cpp:
+
+#include "DirectoryStateMerger.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <utility>
+
+namespace
+{
+constexpr char KeySeparator = static_cast<char>(std::filesystem::path::preferred_separator);
+}
+
+DirectoryStateMerger::DirectoryStateMerger(FileStateRepository& fileStateRepository) : _fileStateRepository(fileStateRepository)
+{
+}
+
+void DirectoryStateMerger::Merge(const std::string& directoryKey, const std::vector<std::string>& names)
+{
+    std::vector<const std::string*> sortedNames;
+    sortedNames.reserve(names.size());
+    for (const auto& name : names)
+    {
+        sortedNames.push_back(&name);
+    }
+    std::sort(sortedNames.begin(), sortedNames.end(), [](const std::string* left, const std::string* right) { return *left < *right; });
+
+    std::unique_lock<std::mutex> lock(_directoriesMutex);
+    auto entry = _directories.find(directoryKey);
+    if (_directories.end() == entry)
+    {
+        // A directory is listed by one walker, so no other batch of it waits for this scan.
+        lock.unlock();
+        DirectoryStates states{};
+        states.loaded = _fileStateRepository.GetDirectoryFileStates(directoryKey, states.rows);
+        states.listed.assign(states.rows.size(), false);
+        lock.lock();
+        entry = _directories.emplace(directoryKey, std::move(states)).first;
+    }
+    DirectoryStates& states = entry->second;
+    if (false == states.loaded)
+    {
+        return;
+    }
+
+    std::vector<std::pair<std::string, MergedState>> merged;
+    merged.reserve(sortedNames.size());
+    std::size_t row = 0;
+    for (const std::string* name : sortedNames)
+    {
+        while ((row < states.rows.size()) && (states.rows[row].name < *name))
+        {
+            ++row;
+        }
+        MergedState state{};
+        if ((row < states.rows.size()) && (states.rows[row].name == *name))
+        {
+            states.listed[row] = true;
+            state.stored = true;
+            state.record = std::move(states.rows[row].record);
+        }
+        merged.emplace_back((true == directoryKey.empty()) ? *name : directoryKey + KeySeparator + *name, std::move(state));
+    }
+    lock.unlock();
+
+    std::lock_guard<std::mutex> mergedLock(_mergedMutex);
+    for (auto& entryState : merged)
+    {
+        _merged.insert_or_assign(std::move(entryState.first), std::move(entryState.second));
+    }
+}
+
+bool DirectoryStateMerger::TakeState(const std::string& fileKey, FileStateRecord& outputRecord, bool& outputStored)
+{
+    std::lock_guard<std::mutex> lock(_mergedMutex);
+    const auto entry = _merged.find(fileKey);
+    if (_merged.end() == entry)
+    {
+        return false;
+    }
+    outputStored = entry->second.stored;
+    if (true == outputStored)
+    {
+        outputRecord = std::move(entry->second.record);
+    }
+    _merged.erase(entry);
+    return true;
+}
+
+bool DirectoryStateMerger::TakeUnlisted(const std::string& directoryKey, std::vector<std::string>& outputNames)
+{
+    outputNames.clear();
+    DirectoryStates states{};
+    bool merged = false;
+    {
+        std::lock_guard<std::mutex> lock(_directoriesMutex);
+        const auto entry = _directories.find(directoryKey);
+        if (_directories.end() != entry)
+        {
+            states = std::move(entry->second);
+            _directories.erase(entry);
+            merged = true;
+        }
+    }
+    if (false == merged)
+    {
+        // No batch came from the directory, so every stored live file is missing from it.
+        states.loaded = _fileStateRepository.GetDirectoryFileStates(directoryKey, states.rows);
+        states.listed.assign(states.rows.size(), false);
+    }
+    if (false == states.loaded)
+    {
+        return false;
+    }
+    for (std::size_t row = 0; row < states.rows.size(); ++row)
+    {
+        if ((false == states.listed[row]) && (ChangeType::Deleted != states.rows[row].record.status))
+        {
+            outputNames.push_back(std::move(states.rows[row].name));
+        }
+    }
+    return true;
+}
+
+void DirectoryStateMerger::Discard(const std::string& directoryKey)
+{
+    std::lock_guard<std::mutex> lock(_directoriesMutex);
+    _directories.erase(directoryKey);
+}
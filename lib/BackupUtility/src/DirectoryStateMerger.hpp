@@ -0,0 +1,96 @@
+// file DirectoryStateMerger.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Looks up stored file states directory by directory, merging each listing with an ordered scan.
+ *
+ * The alternative to one GetFileState probe per file when the FileStateIndex is not loaded. The first
+ * batch of a directory reads all of its stored rows in one scan along the primary key; every batch is
+ * then sorted and merge-joined against them, and the state found for each file, or that none is stored,
+ * is kept until a worker takes it. Rows no batch matched once the directory is complete are its
+ * deletions, so they come out of the same scan. Rows are held only while their directory is being
+ * listed, and each merged state only until it is taken.
+ */
+class DirectoryStateMerger
+{
+  public:
+    /**
+     * @brief Construct a merger for one walk.
+     *
+     * @param[in] fileStateRepository Repository holding the stored files of each directory
+     */
+    explicit DirectoryStateMerger(FileStateRepository& fileStateRepository);
+
+    DirectoryStateMerger(const DirectoryStateMerger&) = delete;
+    DirectoryStateMerger& operator=(const DirectoryStateMerger&) = delete;
+
+    /**
+     * @brief Merge a batch of listed names with the stored states of their directory.
+     *
+     * @param[in] directoryKey Key of the directory, empty for the root of a single-root run
+     * @param[in] names Names of the listed files, in any order
+     */
+    void Merge(const std::string& directoryKey, const std::vector<std::string>& names);
+
+    /**
+     * @brief Take the state merged for a listed file.
+     *
+     * @param[in] fileKey Repository-relative file path
+     * @param[out] outputRecord Stored state, meaningful if outputStored
+     * @param[out] outputStored The file has a stored row
+     * @return true if the file was merged, false if it has to be looked up on its own
+     */
+    bool TakeState(const std::string& fileKey, FileStateRecord& outputRecord, bool& outputStored);
+
+    /**
+     * @brief Get the live files of a completely listed directory that no batch matched, and forget the directory.
+     *
+     * @param[in] directoryKey Key of the directory
+     * @param[out] outputNames Names of the stored live files missing from the listing
+     * @return true on success, false if the stored files could not be read
+     */
+    bool TakeUnlisted(const std::string& directoryKey, std::vector<std::string>& outputNames);
+
+    /**
+     * @brief Forget a directory whose listing is incomplete.
+     *
+     * @param[in] directoryKey Key of the directory
+     */
+    void Discard(const std::string& directoryKey);
+
+  private:
+    /**
+     * @brief Stored rows of a directory being listed.
+     */
+    struct DirectoryStates
+    {
+        bool loaded;                       /**< The rows were read; otherwise its files are looked up one by one */
+        std::vector<NamedFileState> rows;  /**< Stored rows in ascending name order */
+        std::vector<bool> listed;          /**< Rows matched by a listed file, by row index */
+    };
+
+    /**
+     * @brief State merged for a listed file, until a worker takes it.
+     */
+    struct MergedState
+    {
+        bool stored;            /**< The file has a stored row */
+        FileStateRecord record; /**< Stored state, meaningful if stored */
+    };
+
+    FileStateRepository& _fileStateRepository;
+
+    std::mutex _directoriesMutex;
+    std::unordered_map<std::string, DirectoryStates> _directories; /**< Directories being listed, by directory key */
+
+    std::mutex _mergedMutex;
+    std::unordered_map<std::string, MergedState> _merged; /**< Merged states not taken yet, by file key */
+};
@@ -0,0 +1,164 @@
+// file DurabilityBarrier.cpp:
+
+#include "DurabilityBarrier.hpp"
+
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+/**
+ * @brief Get the volume a path lives on as the device name CreateFileW opens.
+ *
+ * @param[in] path Existing file or directory
+ * @return Device name such as \\.\C:, empty if the path has no drive letter
+ */
+std::wstring VolumeDevice(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    const std::wstring rootName = std::filesystem::absolute(path, ec).root_name().wstring();
+    if ((2 != rootName.size()) || (L':' != rootName[1]))
+    {
+        return std::wstring();
+    }
+    return L"\\\\.\\" + rootName;
+}
+#endif
+
+/**
+ * @brief Flush the volume holding a path.
+ *
+ * @param[in] path Existing file or directory
+ * @return true on success or where the volume cannot be flushed, false if the flush reported an error
+ */
+bool SyncVolume(const std::filesystem::path& path)
+{
+#if defined(_WIN32)
+    const std::wstring device = VolumeDevice(path);
+    if (true == device.empty())
+    {
+        return true;
+    }
+    // Opening a volume for writing needs administrator rights; without them the flush is left to the system.
+    HANDLE volume = CreateFileW(device.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (INVALID_HANDLE_VALUE == volume)
+    {
+        return true;
+    }
+    const bool flushed = (FALSE != FlushFileBuffers(volume));
+    CloseHandle(volume);
+    return flushed;
+#elif defined(__linux__)
+    const int fileDescriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (0 > fileDescriptor)
+    {
+        return false;
+    }
+    const bool flushed = (0 == syncfs(fileDescriptor));
+    close(fileDescriptor);
+    return flushed;
+#else
+    (void)path;
+    sync();
+    return true;
+#endif
+}
+}
+
+DurabilityBarrier::DurabilityBarrier(const std::vector<std::filesystem::path>& paths)
+    : _startedSyncs(0), _finishedSyncs(0), _syncing(false), _failed(false)
+{
+#ifdef _WIN32
+    std::vector<std::wstring> devices;
+    for (const auto& path : paths)
+    {
+        const std::wstring device = VolumeDevice(path);
+        bool known = false;
+        for (const auto& knownDevice : devices)
+        {
+            known = (true == known) || (knownDevice == device);
+        }
+        if (false == known)
+        {
+            devices.push_back(device);
+            _volumePaths.push_back(path);
+        }
+    }
+#else
+    std::vector<dev_t> devices;
+    for (const auto& path : paths)
+    {
+        struct stat status;
+        if (0 != stat(path.c_str(), &status))
+        {
+            // A path that cannot be examined is kept, so its flush reports the error.
+            _volumePaths.push_back(path);
+            continue;
+        }
+        bool known = false;
+        for (const dev_t device : devices)
+        {
+            known = (true == known) || (device == status.st_dev);
+        }
+        if (false == known)
+        {
+            devices.push_back(status.st_dev);
+            _volumePaths.push_back(path);
+        }
+    }
+#endif
+}
+
+bool DurabilityBarrier::Sync()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    // A flush already running may have started before the caller's writes, so only the next one covers them.
+    const std::uint64_t ticket = _startedSyncs + 1;
+    while (_finishedSyncs < ticket)
+    {
+        if (true == _syncing)
+        {
+            _condition.wait(lock);
+            continue;
+        }
+        _syncing = true;
+        ++_startedSyncs;
+        lock.unlock();
+        const bool flushed = SyncVolumes();
+        lock.lock();
+        _finishedSyncs = _startedSyncs;
+        _syncing = false;
+        _failed = (true == _failed) || (false == flushed);
+        _condition.notify_all();
+    }
+    return false == _failed;
+}
+
+/**
+ * @brief Flush every volume of the barrier.
+ *
+ * @return true if every flush succeeded, false otherwise
+ */
+bool DurabilityBarrier::SyncVolumes() const
+{
+    bool flushed = true;
+    for (const auto& path : _volumePaths)
+    {
+        flushed = (true == SyncVolume(path)) && (true == flushed);
+    }
+    return flushed;
+}
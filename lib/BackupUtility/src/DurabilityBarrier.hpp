@@ -0,0 +1,49 @@
+// file DurabilityBarrier.hpp:
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Flushes the volumes holding the backup and its database, merging concurrent requests into one flush.
+ *
+ * A flush covers a whole volume: syncfs on Linux, sync elsewhere on POSIX, and FlushFileBuffers on
+ * the volume handle on Windows, skipped where the volume cannot be opened without administrator
+ * rights. Callers that ask while a flush is running wait for the next one, which then covers all
+ * of them, so many threads committing batches at once cost one flush rather than one each.
+ */
+class DurabilityBarrier
+{
+  public:
+    /**
+     * @brief Create a barrier over the volumes of a set of paths.
+     *
+     * @param[in] paths Existing files or directories; paths on the same volume are flushed once
+     */
+    explicit DurabilityBarrier(const std::vector<std::filesystem::path>& paths);
+
+    DurabilityBarrier(const DurabilityBarrier&) = delete;
+    DurabilityBarrier& operator=(const DurabilityBarrier&) = delete;
+
+    /**
+     * @brief Make every write completed before the call durable.
+     *
+     * @return true on success, false if this or an earlier flush failed
+     */
+    bool Sync();
+
+  private:
+    bool SyncVolumes() const;
+
+    std::vector<std::filesystem::path> _volumePaths; /**< One path per volume */
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::uint64_t _startedSyncs;  /**< Flushes started so far */
+    std::uint64_t _finishedSyncs; /**< Flushes finished so far */
+    bool _syncing;
+    bool _failed;
+};
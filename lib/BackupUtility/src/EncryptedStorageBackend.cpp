@@ -0,0 +1,77 @@
+// file EncryptedStorageBackend.cpp:
+
+#include "EncryptedStorageBackend.hpp"
+
+#include <system_error>
+#include <utility>
+
+namespace
+{
+constexpr const char* StagedFileSuffix = ".rdemo-partial";
+}
+
+EncryptedStorageBackend::EncryptedStorageBackend(StorageBackend& inner, const FileEncryptor& fileEncryptor,
+                                                 const std::filesystem::path& stagingDirectory)
+    : _inner(inner), _fileEncryptor(fileEncryptor), _stagingDirectory(stagingDirectory), _nextStagingFile(0)
+{
+}
+
+bool EncryptedStorageBackend::Put(const std::filesystem::path& source, const std::string& key)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(_stagingDirectory, ec);
+    const std::filesystem::path stagedFile = NextStagingFile();
+    const bool stored = (true == _fileEncryptor.Encrypt(source, stagedFile)) && (true == _inner.Put(stagedFile, key));
+    std::filesystem::remove(stagedFile, ec);
+    return stored;
+}
+
+bool EncryptedStorageBackend::Get(const std::string& key, const std::filesystem::path& destination)
+{
+    std::error_code ec;
+    std::filesystem::path stagedFile = destination;
+    stagedFile += StagedFileSuffix;
+    const bool fetched = (true == _inner.Get(key, stagedFile)) && (true == _fileEncryptor.Decrypt(stagedFile, destination));
+    std::filesystem::remove(stagedFile, ec);
+    return fetched;
+}
+
+bool EncryptedStorageBackend::Rename(const std::string& fromKey, const std::string& toKey)
+{
+    return _inner.Rename(fromKey, toKey);
+}
+
+bool EncryptedStorageBackend::List(const std::string& prefix, std::vector<std::string>& outputKeys)
+{
+    return _inner.List(prefix, outputKeys);
+}
+
+bool EncryptedStorageBackend::Remove(const std::string& key)
+{
+    return _inner.Remove(key);
+}
+
+bool EncryptedStorageBackend::Exists(const std::string& key, bool& outputExists)
+{
+    return _inner.Exists(key, outputExists);
+}
+
+std::future<bool> EncryptedStorageBackend::RenameBatch(std::vector<StorageRename> renames)
+{
+    return _inner.RenameBatch(std::move(renames));
+}
+
+std::future<bool> EncryptedStorageBackend::RemoveBatch(std::vector<std::string> keys)
+{
+    return _inner.RemoveBatch(std::move(keys));
+}
+
+/**
+ * @brief Get a staging file name no other Put of this wrapper uses.
+ *
+ * @return Path below the staging directory
+ */
+std::filesystem::path EncryptedStorageBackend::NextStagingFile()
+{
+    return _stagingDirectory / ("upload-" + std::to_string(_nextStagingFile.fetch_add(1)) + StagedFileSuffix);
+}
@@ -0,0 +1,49 @@
+// file EncryptedStorageBackend.hpp:
+
+#pragma once
+
+#include "FileEncryptor/FileEncryptor.hpp"
+#include "StorageBackend/StorageBackend.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Storage backend encrypting what is stored in another one and decrypting what is fetched.
+ *
+ * Put encrypts the file into a local staging directory and stores the encrypted copy, so the wrapped
+ * store only ever receives ciphertext. Moves, listings and deletions are passed through unchanged.
+ */
+class EncryptedStorageBackend : public StorageBackend
+{
+  public:
+    /**
+     * @brief Wrap a store.
+     *
+     * @param[in,out] inner Store the encrypted files go to; must outlive the wrapper
+     * @param[in] fileEncryptor Key and cipher; must outlive the wrapper
+     * @param[in] stagingDirectory Local directory encrypted copies are written to before they are stored, created on the first Put
+     */
+    EncryptedStorageBackend(StorageBackend& inner, const FileEncryptor& fileEncryptor, const std::filesystem::path& stagingDirectory);
+
+    bool Put(const std::filesystem::path& source, const std::string& key) override;
+    bool Get(const std::string& key, const std::filesystem::path& destination) override;
+    bool Rename(const std::string& fromKey, const std::string& toKey) override;
+    bool List(const std::string& prefix, std::vector<std::string>& outputKeys) override;
+    bool Remove(const std::string& key) override;
+    bool Exists(const std::string& key, bool& outputExists) override;
+    std::future<bool> RenameBatch(std::vector<StorageRename> renames) override;
+    std::future<bool> RemoveBatch(std::vector<std::string> keys) override;
+
+  private:
+    std::filesystem::path NextStagingFile();
+
+    StorageBackend& _inner;
+    const FileEncryptor& _fileEncryptor;
+    std::filesystem::path _stagingDirectory;
+    std::atomic<std::uint64_t> _nextStagingFile;
+};
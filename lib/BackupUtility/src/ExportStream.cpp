@@ -0,0 +1,219 @@
+// file ExportStream.cpp:
+
+#include "ExportStream.hpp"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+constexpr std::size_t ReadBufferSize = 1024 * 1024;
+constexpr std::size_t MaximumSpliceSize = 1024 * 1024;
+constexpr int StandardOutput = 1;
+
+#ifdef _WIN32
+int WriteDescriptor(int descriptor, const void* data, std::size_t size)
+{
+    return _write(descriptor, data, static_cast<unsigned int>(std::min<std::size_t>(size, 1U << 30)));
+}
+
+int ReadDescriptor(int descriptor, void* data, std::size_t size)
+{
+    return _read(descriptor, data, static_cast<unsigned int>(std::min<std::size_t>(size, 1U << 30)));
+}
+
+int OpenForReading(const std::filesystem::path& path)
+{
+    return _wopen(path.c_str(), _O_RDONLY | _O_BINARY);
+}
+
+void CloseDescriptor(int descriptor)
+{
+    _close(descriptor);
+}
+#else
+ssize_t WriteDescriptor(int descriptor, const void* data, std::size_t size)
+{
+    return ::write(descriptor, data, size);
+}
+
+ssize_t ReadDescriptor(int descriptor, void* data, std::size_t size)
+{
+    return ::read(descriptor, data, size);
+}
+
+int OpenForReading(const std::filesystem::path& path)
+{
+    return ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+void CloseDescriptor(int descriptor)
+{
+    ::close(descriptor);
+}
+#endif
+}
+
+ExportStream::ExportStream(int descriptor, StreamCompressor* compressor)
+    : _descriptor(descriptor), _compressor(compressor), _isPipe(false), _bytesWritten(0), _splicedBytes(0)
+{
+#ifdef __linux__
+    struct stat status = {};
+    _isPipe = (0 == ::fstat(descriptor, &status)) && (true == S_ISFIFO(status.st_mode));
+#endif
+}
+
+int ExportStream::OpenOutput(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    if (true == path.empty())
+    {
+        _setmode(StandardOutput, _O_BINARY);
+        return StandardOutput;
+    }
+    return _wopen(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    return (true == path.empty()) ? StandardOutput : ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+}
+
+bool ExportStream::CloseOutput(int descriptor)
+{
+    if (StandardOutput == descriptor)
+    {
+        return true;
+    }
+#ifdef _WIN32
+    return 0 == _close(descriptor);
+#else
+    return 0 == ::close(descriptor);
+#endif
+}
+
+bool ExportStream::Write(const void* data, std::size_t size)
+{
+    if (nullptr == _compressor)
+    {
+        return WriteAll(data, size);
+    }
+    return (true == _compressor->Write(data, size, _compressed)) && (true == WriteAll(_compressed.data(), _compressed.size()));
+}
+
+bool ExportStream::WriteFile(const std::filesystem::path& path, std::uint64_t size)
+{
+    const int fileDescriptor = OpenForReading(path);
+    if (0 > fileDescriptor)
+    {
+        return false;
+    }
+    bool fallback = true;
+    bool written = (nullptr == _compressor) && (true == _isPipe) && (true == SpliceFile(fileDescriptor, size, fallback));
+    if ((false == written) && (true == fallback))
+    {
+        _readBuffer.resize(ReadBufferSize);
+        std::uint64_t remaining = size;
+        written = true;
+        while ((true == written) && (0 < remaining))
+        {
+            const std::size_t wanted = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, _readBuffer.size()));
+            const auto bytesRead = ReadDescriptor(fileDescriptor, _readBuffer.data(), wanted);
+            if ((0 > bytesRead) && (EINTR == errno))
+            {
+                continue;
+            }
+            written = (0 < bytesRead) && (true == Write(_readBuffer.data(), static_cast<std::size_t>(bytesRead)));
+            remaining -= (0 < bytesRead) ? static_cast<std::uint64_t>(bytesRead) : 0;
+        }
+    }
+    CloseDescriptor(fileDescriptor);
+    return written;
+}
+
+bool ExportStream::Finish()
+{
+    return (nullptr == _compressor) || ((true == _compressor->Finish(_compressed)) && (true == WriteAll(_compressed.data(), _compressed.size())));
+}
+
+std::uint64_t ExportStream::BytesWritten() const
+{
+    return _bytesWritten;
+}
+
+std::uint64_t ExportStream::SplicedBytes() const
+{
+    return _splicedBytes;
+}
+
+bool ExportStream::WriteAll(const void* data, std::size_t size)
+{
+    const char* bytes = static_cast<const char*>(data);
+    while (0 < size)
+    {
+        const auto written = WriteDescriptor(_descriptor, bytes, size);
+        if (0 > written)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<std::size_t>(written);
+        _bytesWritten += static_cast<std::uint64_t>(written);
+    }
+    return true;
+}
+
+/**
+ * @brief Move file content into the pipe with splice.
+ *
+ * @param[in] fileDescriptor File opened for reading at offset 0
+ * @param[in] size Bytes to move
+ * @param[out] outputFallback Set when splice is unsupported before anything moved, so the caller copies instead
+ * @return true if every byte moved, false otherwise
+ */
+bool ExportStream::SpliceFile(int fileDescriptor, std::uint64_t size, bool& outputFallback)
+{
+    outputFallback = false;
+#ifdef __linux__
+    loff_t offset = 0;
+    std::uint64_t remaining = size;
+    while (0 < remaining)
+    {
+        const std::size_t wanted = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, MaximumSpliceSize));
+        const ssize_t moved = ::splice(fileDescriptor, &offset, _descriptor, nullptr, wanted, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (0 > moved)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            // Filesystems without splice support fail the first call; fall back to copying.
+            outputFallback = (size == remaining) && ((EINVAL == errno) || (ENOSYS == errno));
+            return false;
+        }
+        if (0 == moved)
+        {
+            return false;
+        }
+        remaining -= static_cast<std::uint64_t>(moved);
+        _bytesWritten += static_cast<std::uint64_t>(moved);
+        _splicedBytes += static_cast<std::uint64_t>(moved);
+    }
+    return true;
+#else
+    static_cast<void>(fileDescriptor);
+    static_cast<void>(size);
+    outputFallback = true;
+    return false;
+#endif
+}
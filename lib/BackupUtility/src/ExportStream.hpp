@@ -0,0 +1,98 @@
+// file ExportStream.hpp:
+
+#pragma once
+
+#include "FileCompressor/FileCompressor.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Infrastructure component writing an export archive to a file descriptor, optionally as one zstd frame.
+ *
+ * When the descriptor is a pipe and the stream is not compressed, file contents are moved into it with
+ * splice on Linux, so they go from the page cache to the pipe without passing through user space.
+ * Headers are small and written with write; vmsplice is not used for them, since it only lends the
+ * pages to the pipe and the buffers are reused before the reader is guaranteed to have consumed them.
+ */
+class ExportStream
+{
+  public:
+    /**
+     * @brief Bind a stream to an open descriptor; the descriptor is not closed.
+     *
+     * @param[in] descriptor Descriptor opened for writing
+     * @param[in] compressor Compresses everything written, nullptr writes the archive as is
+     */
+    ExportStream(int descriptor, StreamCompressor* compressor);
+
+    /**
+     * @brief Open the descriptor an archive is written to.
+     *
+     * @param[in] path File to create or replace, empty for standard output
+     * @return Descriptor, negative on error
+     */
+    static int OpenOutput(const std::filesystem::path& path);
+
+    /**
+     * @brief Close a descriptor from OpenOutput; standard output stays open.
+     *
+     * @param[in] descriptor Descriptor to close
+     * @return true on success, false if closing reported a write error
+     */
+    static bool CloseOutput(int descriptor);
+
+    /**
+     * @brief Write bytes.
+     *
+     * @param[in] data Bytes to write
+     * @param[in] size Number of bytes
+     * @return true on success, false on a write or compression error
+     */
+    bool Write(const void* data, std::size_t size);
+
+    /**
+     * @brief Write the first bytes of a file.
+     *
+     * @param[in] path File to copy
+     * @param[in] size Number of bytes to copy; a shorter file fails
+     * @return true on success, false on error
+     */
+    bool WriteFile(const std::filesystem::path& path, std::uint64_t size);
+
+    /**
+     * @brief End the compressed frame, if any.
+     *
+     * @return true on success, false on error
+     */
+    bool Finish();
+
+    /**
+     * @brief Get the bytes handed to the descriptor.
+     *
+     * @return Output bytes, compressed when a compressor is set
+     */
+    std::uint64_t BytesWritten() const;
+
+    /**
+     * @brief Get the file bytes moved with splice.
+     *
+     * @return Spliced bytes
+     */
+    std::uint64_t SplicedBytes() const;
+
+  private:
+    bool WriteAll(const void* data, std::size_t size);
+    bool SpliceFile(int fileDescriptor, std::uint64_t size, bool& outputFallback);
+
+    int _descriptor;
+    StreamCompressor* _compressor;
+    bool _isPipe;
+    std::vector<std::uint8_t> _compressed;
+    std::vector<char> _readBuffer;
+    std::uint64_t _bytesWritten;
+    std::uint64_t _splicedBytes;
+};
@@ -0,0 +1,486 @@
+// file FileDelta.cpp:
+
+#include "FileDelta.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <xxhash.h>
+#ifdef RDEMO_XXHASH_DISPATCH
+// Replaces the XXH3 one-shot and update functions with their XXH3_*_dispatch counterparts.
+#include <xxh_x86dispatch.h>
+#endif
+
+namespace
+{
+constexpr char DeltaMagic[] = {'R', 'D', 'D', 'E', 'L', 'T', 'A', '1'};
+constexpr std::uint8_t EndInstruction = 0;
+constexpr std::uint8_t CopyInstruction = 1;
+constexpr std::uint8_t LiteralInstruction = 2;
+constexpr std::size_t DigestSize = sizeof(XXH128_canonical_t);
+constexpr std::streamoff DigestOffset = sizeof(DeltaMagic) + sizeof(std::uint32_t) + sizeof(std::uint64_t);
+constexpr std::size_t MaxLiteralSize = 64 * 1024;
+constexpr std::size_t ScanBufferSize = 4 * 1024 * 1024;
+constexpr std::size_t ApplyBufferSize = 1024 * 1024;
+constexpr std::uint32_t MinimumBlockSize = 64;
+constexpr std::uint32_t ChecksumHalfMask = 0xFFFF;
+constexpr unsigned int ChecksumHalfBits = 16;
+constexpr unsigned int BitsPerByte = 8;
+
+/**
+ * @brief rsync weak checksum over a fixed-size window that can be moved by one byte in constant time.
+ */
+class RollingChecksum
+{
+  public:
+    void Reset(const std::uint8_t* data, std::uint32_t length)
+    {
+        _sum = 0;
+        _weightedSum = 0;
+        _length = length;
+        for (std::uint32_t i = 0; i < length; ++i)
+        {
+            _sum += data[i];
+            _weightedSum += (length - i) * static_cast<std::uint32_t>(data[i]);
+        }
+    }
+
+    void Roll(std::uint8_t outgoing, std::uint8_t incoming)
+    {
+        _sum = _sum - outgoing + incoming;
+        _weightedSum = _weightedSum - (_length * static_cast<std::uint32_t>(outgoing)) + _sum;
+    }
+
+    std::uint32_t Value() const
+    {
+        return (_sum & ChecksumHalfMask) | ((_weightedSum & ChecksumHalfMask) << ChecksumHalfBits);
+    }
+
+  private:
+    std::uint32_t _sum = 0;
+    std::uint32_t _weightedSum = 0;
+    std::uint32_t _length = 0;
+};
+
+/**
+ * @brief Strong hash and position of one basis block.
+ */
+struct BlockSignature
+{
+    std::uint64_t strongHash; /**< XXH3_64 of the block */
+    std::uint64_t offset;     /**< Block position in the basis */
+};
+
+/**
+ * @brief Free an XXH3 state when leaving scope.
+ */
+struct XXH3StateDeleter
+{
+    void operator()(XXH3_state_t* state) const
+    {
+        XXH3_freeState(state);
+    }
+};
+
+/**
+ * @brief Write an unsigned integer in little-endian byte order.
+ *
+ * @param[in] outputStream Stream to write
+ * @param[in] value Value to write
+ * @param[in] byteCount Number of bytes to write
+ */
+void WriteLittleEndian(std::ostream& outputStream, std::uint64_t value, std::size_t byteCount)
+{
+    for (std::size_t i = 0; i < byteCount; ++i)
+    {
+        outputStream.put(static_cast<char>((value >> (i * BitsPerByte)) & 0xFF));
+    }
+}
+
+/**
+ * @brief Read an unsigned little-endian integer from a stream.
+ *
+ * @param[in] inputStream Stream to read
+ * @param[in] byteCount Number of bytes to read
+ * @param[out] outputValue Decoded value
+ * @return true on success, false on a short read
+ */
+bool ReadLittleEndian(std::istream& inputStream, std::size_t byteCount, std::uint64_t& outputValue)
+{
+    unsigned char bytes[sizeof(std::uint64_t)] = {};
+    if (false == static_cast<bool>(inputStream.read(reinterpret_cast<char*>(bytes), static_cast<std::streamsize>(byteCount))))
+    {
+        return false;
+    }
+    outputValue = 0;
+    for (std::size_t i = 0; i < byteCount; ++i)
+    {
+        outputValue |= static_cast<std::uint64_t>(bytes[i]) << (i * BitsPerByte);
+    }
+    return true;
+}
+
+/**
+ * @brief Instruction stream writer that merges adjacent copies and batches literals.
+ */
+class DeltaWriter
+{
+  public:
+    DeltaWriter(std::ostream& outputStream, std::uint64_t sizeLimit) : _outputStream(outputStream), _sizeLimit(sizeLimit)
+    {
+    }
+
+    void AddCopy(std::uint64_t offset, std::uint32_t length)
+    {
+        FlushLiteral();
+        if ((0 != _copyLength) && ((_copyOffset + _copyLength) == offset) &&
+            (length <= (std::numeric_limits<std::uint32_t>::max() - _copyLength)))
+        {
+            _copyLength += length;
+            return;
+        }
+        FlushCopy();
+        _copyOffset = offset;
+        _copyLength = length;
+    }
+
+    void AddLiteral(const std::uint8_t* data, std::size_t length)
+    {
+        FlushCopy();
+        _literal.append(reinterpret_cast<const char*>(data), length);
+        if (MaxLiteralSize <= _literal.size())
+        {
+            FlushLiteral();
+        }
+    }
+
+    void Finish()
+    {
+        FlushCopy();
+        FlushLiteral();
+        _outputStream.put(static_cast<char>(EndInstruction));
+        ++_bytesWritten;
+    }
+
+    /**
+     * @brief Check that writing succeeded and the delta is still smaller than its target.
+     */
+    bool IsWorthwhile() const
+    {
+        return (true == _outputStream.good()) && (_bytesWritten + _literal.size() < _sizeLimit);
+    }
+
+  private:
+    void FlushCopy()
+    {
+        if (0 == _copyLength)
+        {
+            return;
+        }
+        _outputStream.put(static_cast<char>(CopyInstruction));
+        WriteLittleEndian(_outputStream, _copyOffset, sizeof(std::uint64_t));
+        WriteLittleEndian(_outputStream, _copyLength, sizeof(std::uint32_t));
+        _bytesWritten += 1 + sizeof(std::uint64_t) + sizeof(std::uint32_t);
+        _copyLength = 0;
+    }
+
+    void FlushLiteral()
+    {
+        if (true == _literal.empty())
+        {
+            return;
+        }
+        _outputStream.put(static_cast<char>(LiteralInstruction));
+        WriteLittleEndian(_outputStream, _literal.size(), sizeof(std::uint32_t));
+        _outputStream.write(_literal.data(), static_cast<std::streamsize>(_literal.size()));
+        _bytesWritten += 1 + sizeof(std::uint32_t) + _literal.size();
+        _literal.clear();
+    }
+
+    std::ostream& _outputStream;
+    std::uint64_t _sizeLimit;
+    std::uint64_t _bytesWritten = sizeof(DeltaMagic) + sizeof(std::uint32_t) + sizeof(std::uint64_t) + DigestSize;
+    std::uint64_t _copyOffset = 0;
+    std::uint32_t _copyLength = 0;
+    std::string _literal;
+};
+
+/**
+ * @brief Compute the signatures of every full block of the basis.
+ *
+ * @param[in] basisPath Basis file
+ * @param[in] blockSize Block size in bytes
+ * @param[out] outputSignatures Signatures keyed by weak checksum
+ * @return true on success, false on read error
+ */
+bool ComputeSignatures(const std::filesystem::path& basisPath, std::uint32_t blockSize,
+                       std::unordered_map<std::uint32_t, std::vector<BlockSignature>>& outputSignatures)
+{
+    std::ifstream basisStream(basisPath, std::ios::binary);
+    if (false == basisStream.is_open())
+    {
+        return false;
+    }
+
+    std::vector<std::uint8_t> block(blockSize);
+    RollingChecksum checksum;
+    std::uint64_t offset = 0;
+    while (true == static_cast<bool>(basisStream.read(reinterpret_cast<char*>(block.data()), blockSize)))
+    {
+        checksum.Reset(block.data(), blockSize);
+        outputSignatures[checksum.Value()].push_back(BlockSignature{XXH3_64bits(block.data(), blockSize), offset});
+        offset += blockSize;
+    }
+    return false == basisStream.bad();
+}
+}
+
+FileDelta::FileDelta(std::uint32_t blockSize) : _blockSize(std::max(MinimumBlockSize, blockSize))
+{
+}
+
+bool FileDelta::Encode(const std::filesystem::path& basisPath, const std::filesystem::path& targetPath,
+                       const std::filesystem::path& deltaPath) const
+{
+    std::error_code errorCode;
+    const std::uintmax_t targetSize = std::filesystem::file_size(targetPath, errorCode);
+    if (0 != errorCode.value())
+    {
+        return false;
+    }
+
+    std::unordered_map<std::uint32_t, std::vector<BlockSignature>> signatures;
+    std::ifstream targetStream(targetPath, std::ios::binary);
+    std::unique_ptr<XXH3_state_t, XXH3StateDeleter> targetHash(XXH3_createState());
+    if ((false == ComputeSignatures(basisPath, _blockSize, signatures)) || (false == targetStream.is_open()) || (nullptr == targetHash) ||
+        (XXH_OK != XXH3_128bits_reset(targetHash.get())))
+    {
+        return false;
+    }
+
+    std::ofstream deltaStream(deltaPath, std::ios::binary | std::ios::trunc);
+    if (false == deltaStream.is_open())
+    {
+        return false;
+    }
+    deltaStream.write(DeltaMagic, sizeof(DeltaMagic));
+    WriteLittleEndian(deltaStream, _blockSize, sizeof(std::uint32_t));
+    WriteLittleEndian(deltaStream, targetSize, sizeof(std::uint64_t));
+    const char placeholderDigest[DigestSize] = {};
+    deltaStream.write(placeholderDigest, DigestSize);
+
+    DeltaWriter writer(deltaStream, targetSize);
+    std::vector<std::uint8_t> buffer(std::max<std::size_t>(ScanBufferSize, static_cast<std::size_t>(_blockSize) * 4));
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    bool endOfFile = false;
+    RollingChecksum checksum;
+    bool checksumValid = false;
+    std::uint64_t scannedBytes = 0;
+
+    auto abandon = [&]()
+    {
+        deltaStream.close();
+        std::filesystem::remove(deltaPath, errorCode);
+        return false;
+    };
+
+    while (true)
+    {
+        // Rolling needs the byte after the window, so keep more than one block buffered.
+        if ((false == endOfFile) && ((end - begin) <= _blockSize))
+        {
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+            while ((false == endOfFile) && (end < buffer.size()))
+            {
+                targetStream.read(reinterpret_cast<char*>(buffer.data() + end), static_cast<std::streamsize>(buffer.size() - end));
+                end += static_cast<std::size_t>(targetStream.gcount());
+                if (false == targetStream.good())
+                {
+                    if (true == targetStream.bad())
+                    {
+                        return abandon();
+                    }
+                    endOfFile = true;
+                }
+            }
+        }
+
+        const std::size_t available = end - begin;
+        if (available < _blockSize)
+        {
+            XXH3_128bits_update(targetHash.get(), buffer.data() + begin, available);
+            writer.AddLiteral(buffer.data() + begin, available);
+            scannedBytes += available;
+            break;
+        }
+
+        const std::uint8_t* window = buffer.data() + begin;
+        if (false == checksumValid)
+        {
+            checksum.Reset(window, _blockSize);
+            checksumValid = true;
+        }
+
+        bool matched = false;
+        const auto candidates = signatures.find(checksum.Value());
+        if (signatures.end() != candidates)
+        {
+            const std::uint64_t strongHash = XXH3_64bits(window, _blockSize);
+            for (const auto& signature : candidates->second)
+            {
+                if (strongHash == signature.strongHash)
+                {
+                    writer.AddCopy(signature.offset, _blockSize);
+                    matched = true;
+                    break;
+                }
+            }
+        }
+
+        if (true == matched)
+        {
+            XXH3_128bits_update(targetHash.get(), window, _blockSize);
+            begin += _blockSize;
+            scannedBytes += _blockSize;
+            checksumValid = false;
+        }
+        else
+        {
+            XXH3_128bits_update(targetHash.get(), window, 1);
+            writer.AddLiteral(window, 1);
+            if (available > _blockSize)
+            {
+                checksum.Roll(window[0], window[_blockSize]);
+            }
+            else
+            {
+                checksumValid = false;
+            }
+            ++begin;
+            ++scannedBytes;
+        }
+
+        if (false == writer.IsWorthwhile())
+        {
+            return abandon();
+        }
+    }
+
+    writer.Finish();
+    if ((scannedBytes != targetSize) || (false == writer.IsWorthwhile()))
+    {
+        return abandon();
+    }
+
+    XXH128_canonical_t targetDigest;
+    XXH128_canonicalFromHash(&targetDigest, XXH3_128bits_digest(targetHash.get()));
+    deltaStream.seekp(DigestOffset);
+    deltaStream.write(reinterpret_cast<const char*>(targetDigest.digest), DigestSize);
+    if (false == static_cast<bool>(deltaStream.flush()))
+    {
+        return abandon();
+    }
+    return true;
+}
+
+bool FileDelta::Apply(const std::filesystem::path& basisPath, const std::filesystem::path& deltaPath, const std::filesystem::path& outputPath)
+{
+    std::ifstream deltaStream(deltaPath, std::ios::binary);
+    std::ifstream basisStream(basisPath, std::ios::binary);
+    char magic[sizeof(DeltaMagic)] = {};
+    if ((false == deltaStream.is_open()) || (false == basisStream.is_open()) ||
+        (false == static_cast<bool>(deltaStream.read(magic, sizeof(magic)))) || (0 != std::memcmp(magic, DeltaMagic, sizeof(magic))))
+    {
+        return false;
+    }
+
+    std::uint64_t blockSize = 0;
+    std::uint64_t targetSize = 0;
+    XXH128_canonical_t expectedDigest;
+    if ((false == ReadLittleEndian(deltaStream, sizeof(std::uint32_t), blockSize)) ||
+        (false == ReadLittleEndian(deltaStream, sizeof(std::uint64_t), targetSize)) ||
+        (false == static_cast<bool>(deltaStream.read(reinterpret_cast<char*>(expectedDigest.digest), DigestSize))))
+    {
+        return false;
+    }
+
+    std::unique_ptr<XXH3_state_t, XXH3StateDeleter> outputHash(XXH3_createState());
+    std::ofstream outputStream(outputPath, std::ios::binary | std::ios::trunc);
+    if ((nullptr == outputHash) || (XXH_OK != XXH3_128bits_reset(outputHash.get())) || (false == outputStream.is_open()))
+    {
+        return false;
+    }
+
+    auto emit = [&](std::istream& source, std::uint64_t length, std::vector<char>& buffer)
+    {
+        while (0 < length)
+        {
+            const std::size_t pieceLength = static_cast<std::size_t>(std::min<std::uint64_t>(length, buffer.size()));
+            if (false == static_cast<bool>(source.read(buffer.data(), static_cast<std::streamsize>(pieceLength))))
+            {
+                return false;
+            }
+            XXH3_128bits_update(outputHash.get(), buffer.data(), pieceLength);
+            outputStream.write(buffer.data(), static_cast<std::streamsize>(pieceLength));
+            length -= pieceLength;
+        }
+        return true == outputStream.good();
+    };
+
+    std::vector<char> buffer(ApplyBufferSize);
+    std::uint64_t writtenBytes = 0;
+    while (true)
+    {
+        std::uint64_t instruction = 0;
+        if (false == ReadLittleEndian(deltaStream, sizeof(std::uint8_t), instruction))
+        {
+            return false;
+        }
+        if (EndInstruction == instruction)
+        {
+            break;
+        }
+
+        std::uint64_t offset = 0;
+        std::uint64_t length = 0;
+        if (CopyInstruction == instruction)
+        {
+            if ((false == ReadLittleEndian(deltaStream, sizeof(std::uint64_t), offset)) ||
+                (false == ReadLittleEndian(deltaStream, sizeof(std::uint32_t), length)) ||
+                (false == static_cast<bool>(basisStream.seekg(static_cast<std::streamoff>(offset)))) || (false == emit(basisStream, length, buffer)))
+            {
+                return false;
+            }
+        }
+        else if ((LiteralInstruction != instruction) || (false == ReadLittleEndian(deltaStream, sizeof(std::uint32_t), length)) ||
+                 (false == emit(deltaStream, length, buffer)))
+        {
+            return false;
+        }
+        writtenBytes += length;
+    }
+
+    XXH128_canonical_t outputDigest;
+    XXH128_canonicalFromHash(&outputDigest, XXH3_128bits_digest(outputHash.get()));
+    return (targetSize == writtenBytes) && (0 == std::memcmp(expectedDigest.digest, outputDigest.digest, DigestSize)) &&
+           (true == static_cast<bool>(outputStream.flush()));
+}
+
+bool FileDelta::ReadTargetSize(const std::filesystem::path& deltaPath, std::uint64_t& outputSize)
+{
+    std::ifstream deltaStream(deltaPath, std::ios::binary);
+    char magic[sizeof(DeltaMagic)] = {};
+    std::uint64_t blockSize = 0;
+    return (true == static_cast<bool>(deltaStream.read(magic, sizeof(magic)))) && (0 == std::memcmp(magic, DeltaMagic, sizeof(magic))) &&
+           (true == ReadLittleEndian(deltaStream, sizeof(std::uint32_t), blockSize)) &&
+           (true == ReadLittleEndian(deltaStream, sizeof(std::uint64_t), outputSize));
+}
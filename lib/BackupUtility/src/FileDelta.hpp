@@ -0,0 +1,73 @@
+// file FileDelta.hpp:
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+/**
+ * @brief rsync-style binary delta between two versions of a file.
+ *
+ * The basis file is cut into fixed-size blocks, each with a rolling weak checksum and an XXH3_64 strong
+ * hash. The target is scanned byte by byte with the rolling checksum and every window that matches a
+ * basis block becomes a copy instruction; everything else is stored literally. Backups use it in
+ * reverse: the new version is the basis and the delta rebuilds the previous one from it.
+ *
+ * Delta layout, all integers little-endian:
+ * - 8 bytes magic "RDDELTA1", u32 block size, u64 target size, 16 bytes XXH3_128 target digest
+ * - instructions: u8 1 + u64 basis offset + u32 length (copy), u8 2 + u32 length + bytes (literal), u8 0 (end)
+ */
+class FileDelta
+{
+  public:
+    /**
+     * @brief Default basis block size in bytes.
+     */
+    static constexpr std::uint32_t DefaultBlockSize = 2048;
+
+    /**
+     * @brief Suffix appended to the archived path of a file to name its delta.
+     */
+    static constexpr const char* DeltaSuffix = ".delta";
+
+    /**
+     * @brief Construct an encoder.
+     *
+     * @param[in] blockSize Basis block size in bytes
+     */
+    explicit FileDelta(std::uint32_t blockSize = DefaultBlockSize);
+
+    /**
+     * @brief Write a delta that rebuilds the target from the basis.
+     *
+     * Gives up, writing nothing, when the delta would not be smaller than the target.
+     *
+     * @param[in] basisPath File the delta refers to
+     * @param[in] targetPath File the delta rebuilds
+     * @param[in] deltaPath Delta to create
+     * @return true if a delta was written, false on error or when it would not save space
+     */
+    bool Encode(const std::filesystem::path& basisPath, const std::filesystem::path& targetPath, const std::filesystem::path& deltaPath) const;
+
+    /**
+     * @brief Rebuild a target from its basis and delta, verifying the result.
+     *
+     * @param[in] basisPath File the delta refers to
+     * @param[in] deltaPath Delta written by Encode
+     * @param[in] outputPath File to create or replace; must differ from basisPath
+     * @return true on success, false on error or digest mismatch
+     */
+    static bool Apply(const std::filesystem::path& basisPath, const std::filesystem::path& deltaPath, const std::filesystem::path& outputPath);
+
+    /**
+     * @brief Read the size of the file a delta rebuilds from its header.
+     *
+     * @param[in] deltaPath Delta written by Encode
+     * @param[out] outputSize Size of the rebuilt file in bytes
+     * @return true on success, false if the file is not a delta or cannot be read
+     */
+    static bool ReadTargetSize(const std::filesystem::path& deltaPath, std::uint64_t& outputSize);
+
+  private:
+    std::uint32_t _blockSize;
+};
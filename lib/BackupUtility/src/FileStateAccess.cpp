@@ -0,0 +1,47 @@
+// file FileStateAccess.cpp:
+
+#include "FileStateAccess.hpp"
+
+FileStateSink::FileStateSink(FileStateRepository& fileStateRepository, FileStateBatchWriter& batchWriter, std::size_t batchSize,
+                             std::chrono::milliseconds flushInterval, BackupStatsCollector* statsCollector, DurabilityBarrier* durabilityBarrier,
+                             bool dedicatedWriter, const SQLiteSession& databaseSession, std::uint64_t busyRetriesBefore,
+                             std::uint64_t escalationRetries)
+    : _fileStateRepository(fileStateRepository), _batchWriter(batchWriter), _batchSize(batchSize), _flushInterval(flushInterval),
+      _statsCollector(statsCollector), _durabilityBarrier(durabilityBarrier), _databaseSession(databaseSession),
+      _busyRetriesBefore(busyRetriesBefore), _escalationRetries(escalationRetries), _activeWriter(nullptr)
+{
+    if (true == dedicatedWriter)
+    {
+        _writerThread = std::make_unique<FileStateWriterThread>(_fileStateRepository, _batchSize, _flushInterval, _statsCollector, _durabilityBarrier);
+        _activeWriter.store(_writerThread.get());
+    }
+}
+
+bool FileStateSink::Store(const std::string& filePath, const FileStateRecord& record)
+{
+    FileStateWriterThread* writer = _activeWriter.load(std::memory_order_acquire);
+    if ((nullptr == writer) && (0 != _escalationRetries) && (_escalationRetries <= _databaseSession.BusyRetries() - _busyRetriesBefore))
+    {
+        std::call_once(_escalateOnce, [this]() { Escalate(); });
+        writer = _activeWriter.load(std::memory_order_acquire);
+    }
+    return (nullptr != writer) ? writer->Add(filePath, record) : _batchWriter.Add(filePath, record);
+}
+
+bool FileStateSink::Stop()
+{
+    return (nullptr == _writerThread) || (true == _writerThread->Stop());
+}
+
+/**
+ * @brief Start the writer thread the workers hand their rows to from now on.
+ */
+void FileStateSink::Escalate()
+{
+    _writerThread = std::make_unique<FileStateWriterThread>(_fileStateRepository, _batchSize, _flushInterval, _statsCollector, _durabilityBarrier);
+    _activeWriter.store(_writerThread.get(), std::memory_order_release);
+    if (nullptr != _statsCollector)
+    {
+        _statsCollector->SetWriterEscalated();
+    }
+}
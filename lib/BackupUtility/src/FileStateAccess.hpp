@@ -0,0 +1,163 @@
+// file FileStateAccess.hpp:
+
+#pragma once
+
+#include "BackupStatsCollector.hpp"
+#include "DirectoryStateMerger.hpp"
+#include "DurabilityBarrier.hpp"
+#include "FileStateBatchWriter.hpp"
+#include "FileStateIndex.hpp"
+#include "FileStateRepository.hpp"
+#include "FileStateWriterThread.hpp"
+#include "KnownPathFilter.hpp"
+#include "SQLite/SQLiteSession.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief Stored state lookup of a run whose FileStateIndex is loaded: every lookup is answered from memory.
+ *
+ * One of the lookup policies ProcessBackupFile is instantiated with. The run picks its policy once, so
+ * the per-file path calls the lookup directly instead of branching on how the states are held.
+ */
+class IndexedStateLookup
+{
+  public:
+    /**
+     * @brief Look up in an index.
+     *
+     * @param[in] fileStateIndex Loaded index; must outlive the lookup
+     */
+    explicit IndexedStateLookup(const FileStateIndex& fileStateIndex) : _fileStateIndex(fileStateIndex)
+    {
+    }
+
+    /**
+     * @brief Look up the stored state of a file.
+     *
+     * @param[in] filePath State key of the file
+     * @param[out] outputRecord Stored state
+     * @return true if a state is stored, false otherwise
+     */
+    bool Load(const std::string& filePath, FileStateRecord& outputRecord) const
+    {
+        return _fileStateIndex.Find(filePath, outputRecord);
+    }
+
+  private:
+    const FileStateIndex& _fileStateIndex;
+};
+
+/**
+ * @brief Stored state lookup of a run without the index: merged directory scans, then per-file queries the path filter lets through.
+ */
+class RepositoryStateLookup
+{
+  public:
+    /**
+     * @brief Look up in the repository.
+     *
+     * @param[in] fileStateRepository Repository queried per file
+     * @param[in] knownPathFilter Filter sparing the query for files that are certainly new; an unloaded filter lets every file through
+     * @param[in] stateMerger Merger whose directory scans are taken first, nullptr queries every file
+     */
+    RepositoryStateLookup(FileStateRepository& fileStateRepository, const KnownPathFilter& knownPathFilter, DirectoryStateMerger* stateMerger)
+        : _fileStateRepository(fileStateRepository), _knownPathFilter(knownPathFilter), _stateMerger(stateMerger)
+    {
+    }
+
+    /**
+     * @brief Look up the stored state of a file.
+     *
+     * @param[in] filePath State key of the file
+     * @param[out] outputRecord Stored state
+     * @return true if a state is stored, false otherwise
+     */
+    bool Load(const std::string& filePath, FileStateRecord& outputRecord) const
+    {
+        bool stored = false;
+        if ((nullptr != _stateMerger) && (true == _stateMerger->TakeState(filePath, outputRecord, stored)))
+        {
+            return stored;
+        }
+        return (true == _knownPathFilter.MayContain(filePath)) && (true == _fileStateRepository.GetFileState(filePath, outputRecord));
+    }
+
+  private:
+    FileStateRepository& _fileStateRepository;
+    const KnownPathFilter& _knownPathFilter;
+    DirectoryStateMerger* _stateMerger;
+};
+
+/**
+ * @brief Where the workers of a run store file states: their own batches, or a dedicated writer thread.
+ *
+ * A dedicated writer runs from the start if asked for. Otherwise workers that keep waiting for each
+ * other's write lock start one once the session has retried escalationRetries times, and hand their
+ * rows to it from then on; rows already in their batches are still committed by themselves.
+ */
+class FileStateSink
+{
+  public:
+    /**
+     * @brief Create the sink, starting the dedicated writer if asked for.
+     *
+     * @param[in] fileStateRepository Repository a writer thread commits to
+     * @param[in,out] batchWriter Per-thread batches used while there is no writer thread
+     * @param[in] batchSize Maximum rows per transaction of a writer thread
+     * @param[in] flushInterval Maximum time a row waits in a writer thread
+     * @param[in] statsCollector Collector a writer thread counts its commits in, nullptr without stats
+     * @param[in] durabilityBarrier Barrier a writer thread syncs before each commit, nullptr commits without syncing
+     * @param[in] dedicatedWriter Start the writer thread right away
+     * @param[in] databaseSession Session whose busy retries trigger the escalation
+     * @param[in] busyRetriesBefore Busy retries of the session when the run started
+     * @param[in] escalationRetries Busy retries since the start of the run that start a writer thread, 0 never starts one
+     */
+    FileStateSink(FileStateRepository& fileStateRepository, FileStateBatchWriter& batchWriter, std::size_t batchSize,
+                  std::chrono::milliseconds flushInterval, BackupStatsCollector* statsCollector, DurabilityBarrier* durabilityBarrier,
+                  bool dedicatedWriter, const SQLiteSession& databaseSession, std::uint64_t busyRetriesBefore,
+                  std::uint64_t escalationRetries);
+
+    FileStateSink(const FileStateSink&) = delete;
+    FileStateSink& operator=(const FileStateSink&) = delete;
+
+    /**
+     * @brief Store the state of a file.
+     *
+     * @param[in] filePath State key of the file
+     * @param[in] record State to store
+     * @return false if an earlier commit failed, true otherwise
+     */
+    bool Store(const std::string& filePath, const FileStateRecord& record);
+
+    /**
+     * @brief Commit what the writer thread still holds and join it, if one was started.
+     *
+     * Producers must have stopped storing before this is called.
+     *
+     * @return true if every commit of the writer thread succeeded or there was none, false on error
+     */
+    bool Stop();
+
+  private:
+    void Escalate();
+
+    FileStateRepository& _fileStateRepository;
+    FileStateBatchWriter& _batchWriter;
+    std::size_t _batchSize;
+    std::chrono::milliseconds _flushInterval;
+    BackupStatsCollector* _statsCollector;
+    DurabilityBarrier* _durabilityBarrier;
+    const SQLiteSession& _databaseSession;
+    std::uint64_t _busyRetriesBefore;
+    std::uint64_t _escalationRetries;
+    std::unique_ptr<FileStateWriterThread> _writerThread;
+    std::atomic<FileStateWriterThread*> _activeWriter;
+    std::once_flag _escalateOnce;
+};
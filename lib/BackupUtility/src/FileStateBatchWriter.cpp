@@ -0,0 +1,73 @@
+// file FileStateBatchWriter.cpp
+
+#include "FileStateBatchWriter.hpp"
+
+FileStateBatchWriter::FileStateBatchWriter(FileStateRepository& fileStateRepository, std::size_t batchSize,
+                                           std::chrono::milliseconds flushInterval, DurabilityBarrier* durabilityBarrier)
+    : _fileStateRepository(fileStateRepository), _batchSize(batchSize), _flushInterval(flushInterval), _durabilityBarrier(durabilityBarrier)
+{
+}
+
+bool FileStateBatchWriter::Add(const std::string& filePath, const FileStateRecord& record)
+{
+    PendingBatch& batch = CurrentBatch();
+    const auto now = std::chrono::steady_clock::now();
+    if (true == batch.updates.empty())
+    {
+        batch.startTime = now;
+    }
+    batch.updates.push_back({filePath, record});
+
+    if ((_batchSize <= batch.updates.size()) || (_flushInterval <= (now - batch.startTime)))
+    {
+        return Flush(batch);
+    }
+    return true;
+}
+
+bool FileStateBatchWriter::FlushCurrentThread()
+{
+    return Flush(CurrentBatch());
+}
+
+bool FileStateBatchWriter::FlushAll()
+{
+    std::lock_guard<std::mutex> lock(_batchesMutex);
+    bool flushed = true;
+    for (auto& entry : _batches)
+    {
+        flushed = Flush(*entry.second) && flushed;
+    }
+    return flushed;
+}
+
+/**
+ * @brief Get the pending batch owned by the calling thread, creating it on first use.
+ *
+ * @return Pending batch for the calling thread
+ */
+FileStateBatchWriter::PendingBatch& FileStateBatchWriter::CurrentBatch()
+{
+    std::lock_guard<std::mutex> lock(_batchesMutex);
+    auto& batch = _batches[std::this_thread::get_id()];
+    if (nullptr == batch)
+    {
+        batch = std::make_unique<PendingBatch>();
+        batch->updates.reserve(_batchSize);
+    }
+    return *batch;
+}
+
+/**
+ * @brief Commit a pending batch in one transaction and empty it.
+ *
+ * @param[in/out] batch Batch to commit
+ * @return true on success, false on error
+ */
+bool FileStateBatchWriter::Flush(PendingBatch& batch)
+{
+    const bool synced = (nullptr == _durabilityBarrier) || (true == batch.updates.empty()) || (true == _durabilityBarrier->Sync());
+    const bool committed = (true == synced) && (true == _fileStateRepository.UpdateFileStates(batch.updates));
+    batch.updates.clear();
+    return committed;
+}
@@ -0,0 +1,85 @@
+// file FileStateBatchWriter.hpp:
+
+#pragma once
+
+#include "DurabilityBarrier.hpp"
+#include "FileStateRepository.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Collects file state upserts per thread and commits them in batched transactions.
+ *
+ * Each thread appends to its own pending batch, which is committed once it holds the configured
+ * number of rows or has been open for the configured interval. Pending rows must be flushed
+ * before they are read back, typically from the worker exit hook of ThreadedFileQueue.
+ */
+class FileStateBatchWriter
+{
+  public:
+    /**
+     * @brief Create a batch writer over a repository.
+     *
+     * @param[in] fileStateRepository Repository that commits the batches
+     * @param[in] batchSize Number of rows per transaction, 0 or 1 commits every row on its own
+     * @param[in] flushInterval Maximum age of a pending batch before it is committed
+     * @param[in] durabilityBarrier Barrier synced before each commit so rows only refer to durable copies, nullptr commits without syncing
+     */
+    FileStateBatchWriter(FileStateRepository& fileStateRepository, std::size_t batchSize, std::chrono::milliseconds flushInterval,
+                         DurabilityBarrier* durabilityBarrier);
+
+    FileStateBatchWriter(const FileStateBatchWriter&) = delete;
+    FileStateBatchWriter& operator=(const FileStateBatchWriter&) = delete;
+
+    /**
+     * @brief Queue an upsert on the calling thread's batch, committing the batch when it is due.
+     *
+     * @param[in] filePath Repository-relative file path
+     * @param[in] record File state to store
+     * @return true on success, false if committing the batch failed
+     */
+    bool Add(const std::string& filePath, const FileStateRecord& record);
+
+    /**
+     * @brief Commit the calling thread's pending batch.
+     *
+     * @return true on success, false on error
+     */
+    bool FlushCurrentThread();
+
+    /**
+     * @brief Commit every pending batch from the calling thread.
+     *
+     * Only safe once the threads that own the batches have stopped adding.
+     *
+     * @return true if every batch was committed, false on error
+     */
+    bool FlushAll();
+
+  private:
+    /**
+     * @brief Rows queued by one thread since its last commit.
+     */
+    struct PendingBatch
+    {
+        std::vector<FileStateUpdate> updates;            /**< Queued upserts */
+        std::chrono::steady_clock::time_point startTime; /**< Time the first queued row was added */
+    };
+
+    PendingBatch& CurrentBatch();
+    bool Flush(PendingBatch& batch);
+
+    FileStateRepository& _fileStateRepository;
+    std::size_t _batchSize;
+    std::chrono::milliseconds _flushInterval;
+    DurabilityBarrier* _durabilityBarrier;
+    std::mutex _batchesMutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<PendingBatch>> _batches;
+};
@@ -0,0 +1,164 @@
+// file FileStateIndex.cpp
+
+#include "FileStateIndex.hpp"
+
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+FileStateIndex::FileStateIndex() : _loaded(false)
+{
+}
+
+bool FileStateIndex::Load(FileStateRepository& fileStateRepository, std::size_t memoryLimit)
+{
+    Clear();
+
+    std::unordered_map<std::string, std::uint32_t> timestampIds;
+    std::size_t timestampBytes = 0;
+    bool withinLimit = true;
+
+    const bool visited = fileStateRepository.ForEachFileState(
+        [&](const std::string& filePath, const FileStateRecord& record)
+        {
+            const PathStore::PathId pathId = _paths.Intern(filePath);
+            if ((std::numeric_limits<std::uint32_t>::max() <= _entries.size()) || (PathStore::InvalidId == pathId))
+            {
+                withinLimit = false;
+                return false;
+            }
+            if (_entryOfPath.size() < _paths.Size())
+            {
+                _entryOfPath.resize(_paths.Size(), NoEntry);
+            }
+            // A path stored twice cannot be told apart, so the index is not used.
+            if (NoEntry != _entryOfPath[pathId])
+            {
+                withinLimit = false;
+                return false;
+            }
+
+            auto timestamp = timestampIds.find(record.timestamp);
+            if (timestampIds.end() == timestamp)
+            {
+                timestamp = timestampIds.emplace(record.timestamp, static_cast<std::uint32_t>(_timestamps.size())).first;
+                _timestamps.push_back(record.timestamp);
+                timestampBytes += sizeof(std::string) + record.timestamp.size();
+            }
+
+            PackedEntry entry{};
+            entry.timestampId = timestamp->second;
+            entry.metadata = record.metadata;
+            std::memcpy(entry.hash, record.hash.bytes.data(), record.hash.size);
+            entry.hashSize = record.hash.size;
+            entry.hashAlgorithm = static_cast<std::uint8_t>(record.hashAlgorithm);
+            entry.status = static_cast<std::uint8_t>(record.status);
+            entry.committedInRun = record.committedInRun;
+            entry.digestScheme = static_cast<std::uint8_t>(record.digestScheme);
+            std::memcpy(entry.sample, record.sampleDigest.bytes.data(), record.sampleDigest.size);
+            entry.sampleSize = record.sampleDigest.size;
+            entry.sampledRuns = record.sampledRuns;
+
+            _entries.push_back(entry);
+            _entryOfPath[pathId] = static_cast<std::uint32_t>(_entries.size());
+
+            if (memoryLimit < Footprint() + timestampBytes)
+            {
+                withinLimit = false;
+                return false;
+            }
+            return true;
+        });
+
+    if ((false == visited) || (false == withinLimit))
+    {
+        Clear();
+        return false;
+    }
+    _entries.shrink_to_fit();
+    _entryOfPath.resize(_paths.Size(), NoEntry);
+
+    _loaded = true;
+    return true;
+}
+
+bool FileStateIndex::LoadSnapshot(const std::filesystem::path& snapshotPath, FileStateRepository& fileStateRepository)
+{
+    Clear();
+    _loaded = _snapshot.Open(snapshotPath, fileStateRepository);
+    return _loaded;
+}
+
+std::uint64_t FileStateIndex::SnapshotToken() const
+{
+    return _snapshot.Token();
+}
+
+bool FileStateIndex::IsLoaded() const
+{
+    return _loaded;
+}
+
+bool FileStateIndex::Find(std::string_view filePath, FileStateRecord& outputRecord) const
+{
+    if (false == _loaded)
+    {
+        return false;
+    }
+    if (0 != _snapshot.Token())
+    {
+        return _snapshot.Find(filePath, outputRecord);
+    }
+    const PathStore::PathId pathId = _paths.Find(filePath);
+    if ((PathStore::InvalidId == pathId) || (NoEntry == _entryOfPath[pathId]))
+    {
+        return false;
+    }
+
+    const PackedEntry& entry = _entries[_entryOfPath[pathId] - 1];
+    FileStateRecord record{};
+    HashDigest::FromBytes(entry.hash, entry.hashSize, record.hash);
+    record.hashAlgorithm = static_cast<HashAlgorithm>(entry.hashAlgorithm);
+    record.status = static_cast<ChangeType>(entry.status);
+    record.timestamp = _timestamps[entry.timestampId];
+    record.metadata = entry.metadata;
+    record.committedInRun = entry.committedInRun;
+    record.digestScheme = static_cast<DigestScheme>(entry.digestScheme);
+    HashDigest::FromBytes(entry.sample, entry.sampleSize, record.sampleDigest);
+    record.sampledRuns = entry.sampledRuns;
+    outputRecord = std::move(record);
+    return true;
+}
+
+std::size_t FileStateIndex::MemoryUsage() const
+{
+    std::size_t timestampBytes = 0;
+    for (const auto& timestamp : _timestamps)
+    {
+        timestampBytes += sizeof(std::string) + timestamp.size();
+    }
+    return Footprint() + timestampBytes;
+}
+
+/**
+ * @brief Compute the bytes used by the path store, the entries and the entry of each path.
+ *
+ * @return Memory use in bytes, excluding timestamps
+ */
+std::size_t FileStateIndex::Footprint() const
+{
+    return _paths.MemoryUsage() + (_entries.capacity() * sizeof(PackedEntry)) + (_entryOfPath.capacity() * sizeof(std::uint32_t));
+}
+
+void FileStateIndex::Clear()
+{
+    _snapshot.Close();
+    _paths.Clear();
+    _timestamps.clear();
+    _timestamps.shrink_to_fit();
+    _entries.clear();
+    _entries.shrink_to_fit();
+    _entryOfPath.clear();
+    _entryOfPath.shrink_to_fit();
+    _loaded = false;
+}
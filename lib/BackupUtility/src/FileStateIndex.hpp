@@ -0,0 +1,120 @@
+// file FileStateIndex.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+#include "PathStore.hpp"
+#include "StateSnapshotFile.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Read-only in-memory index of every stored file state, loaded with a single query.
+ *
+ * Paths are interned into a PathStore, so the directories files share are stored once, and states
+ * are packed into fixed-size entries found by the ID of their path. Alternatively the index maps the
+ * state snapshot file the previous run left behind and looks paths up in it directly. Once loaded the
+ * index is never modified, so any number of threads may call Find without locking.
+ */
+class FileStateIndex
+{
+  public:
+    /**
+     * @brief Create an empty index.
+     */
+    FileStateIndex();
+
+    FileStateIndex(const FileStateIndex&) = delete;
+    FileStateIndex& operator=(const FileStateIndex&) = delete;
+
+    /**
+     * @brief Bulk-load every stored file state.
+     *
+     * Loading stops and the index is left empty as soon as its memory use would exceed the cap, in
+     * which case callers should fall back to per-row queries.
+     *
+     * @param[in] fileStateRepository Repository to read from
+     * @param[in] memoryLimit Maximum number of bytes the index may use
+     * @return true if the whole table was loaded, false on error or when the cap was exceeded
+     */
+    bool Load(FileStateRepository& fileStateRepository, std::size_t memoryLimit);
+
+    /**
+     * @brief Map the state snapshot file instead of loading the table, if the file matches the stored states.
+     *
+     * @param[in] snapshotPath Snapshot file written by StateSnapshotFile::Write
+     * @param[in] fileStateRepository Repository holding the token of the current snapshot
+     * @return true if the snapshot is mapped, false if it is missing, stale or corrupt and Load should be used
+     */
+    bool LoadSnapshot(const std::filesystem::path& snapshotPath, FileStateRepository& fileStateRepository);
+
+    /**
+     * @brief Get the token of the mapped snapshot file.
+     *
+     * @return Token of the snapshot, 0 when the index was loaded from the table or not at all
+     */
+    std::uint64_t SnapshotToken() const;
+
+    /**
+     * @brief Release all loaded data and unmap the snapshot file.
+     */
+    void Clear();
+
+    /**
+     * @brief Check whether Load completed successfully.
+     *
+     * @return true if lookups reflect the whole table
+     */
+    bool IsLoaded() const;
+
+    /**
+     * @brief Look up the stored state for a path.
+     *
+     * @param[in] filePath Repository-relative file path
+     * @param[out] outputRecord Stored file state
+     * @return true if the path is present, false otherwise
+     */
+    bool Find(std::string_view filePath, FileStateRecord& outputRecord) const;
+
+    /**
+     * @brief Get the approximate number of bytes held by the index.
+     *
+     * @return Memory use in bytes
+     */
+    std::size_t MemoryUsage() const;
+
+  private:
+    /**
+     * @brief Packed file state; the path and timestamp live in shared pools.
+     */
+    struct PackedEntry
+    {
+        std::uint32_t timestampId;                     /**< Index into the timestamp pool */
+        FileMetadata metadata;                         /**< Stored size, mtime and identity */
+        std::uint8_t hash[HashDigest::MaxSize];        /**< Digest bytes */
+        std::uint8_t hashSize;                         /**< Number of meaningful digest bytes */
+        std::uint8_t hashAlgorithm;                    /**< HashAlgorithm value */
+        std::uint8_t status;                           /**< ChangeType value */
+        bool committedInRun;                           /**< Written by the current run before it was interrupted */
+        std::uint8_t digestScheme;                     /**< DigestScheme value */
+        std::uint8_t sampleSize;                       /**< Number of meaningful sample digest bytes, 0 without a sample */
+        std::uint32_t sampledRuns;                     /**< Runs confirmed by the sample since the last full hash */
+        std::uint8_t sample[HashDigest::MaxSize];      /**< Sample digest bytes */
+    };
+
+    static constexpr std::uint32_t NoEntry = 0;
+
+    std::size_t Footprint() const;
+
+    PathStore _paths;
+    std::vector<std::string> _timestamps;
+    std::vector<PackedEntry> _entries;
+    std::vector<std::uint32_t> _entryOfPath;
+    StateSnapshotFile _snapshot;
+    bool _loaded;
+};
@@ -0,0 +1,57 @@
+// file FileStatePrefetch.cpp:
+
+#include "FileStatePrefetch.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+namespace
+{
+constexpr char KeySeparator = static_cast<char>(std::filesystem::path::preferred_separator);
+}
+
+std::shared_ptr<const FileStatePrefetch> FileStatePrefetch::Load(FileStateRepository& fileStateRepository, const RelativePathBuilder& sourceKeys,
+                                                                 const std::vector<FileEntry>& files)
+{
+    auto prefetch = std::make_shared<FileStatePrefetch>();
+    prefetch->_names.reserve(files.size());
+    std::string key;
+    for (const auto& file : files)
+    {
+        if (false == sourceKeys.BuildKey(file.path, key))
+        {
+            continue;
+        }
+        const std::size_t separator = key.find_last_of(KeySeparator);
+        if (true == prefetch->_names.empty())
+        {
+            prefetch->_directoryKey.assign(key, 0, (std::string::npos == separator) ? 0 : separator);
+        }
+        prefetch->_names.emplace_back(key, (std::string::npos == separator) ? 0 : separator + 1);
+    }
+    std::sort(prefetch->_names.begin(), prefetch->_names.end());
+    if ((true == prefetch->_names.empty()) || (false == fileStateRepository.GetFileStates(prefetch->_directoryKey, prefetch->_names, prefetch->_states)))
+    {
+        return nullptr;
+    }
+    return prefetch;
+}
+
+bool FileStatePrefetch::Find(std::string_view fileKey, FileStateRecord& outputRecord, bool& outputStored) const
+{
+    const std::size_t separator = fileKey.find_last_of(KeySeparator);
+    const std::string_view directoryKey = fileKey.substr(0, (std::string_view::npos == separator) ? 0 : separator);
+    const std::string_view name = fileKey.substr((std::string_view::npos == separator) ? 0 : separator + 1);
+    if ((directoryKey != _directoryKey) || (false == std::binary_search(_names.begin(), _names.end(), name)))
+    {
+        return false;
+    }
+    const auto state = std::lower_bound(_states.begin(), _states.end(), name,
+                                        [](const NamedFileState& entry, std::string_view value) { return entry.name < value; });
+    outputStored = (_states.end() != state) && (state->name == name);
+    if (true == outputStored)
+    {
+        outputRecord = state->record;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+// file FileStatePrefetch.hpp:
+
+#pragma once
+
+#include "FileIterator/FileIterator.hpp"
+#include "FileStateRepository.hpp"
+#include "RelativePathBuilder.hpp"
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Stored states of one walker batch, read before the batch is queued and attached to its work items.
+ *
+ * A batch holds files of a single directory, so its states come from a few IN queries on the primary key
+ * instead of one query per file, and workers find their file's state with a binary search, without
+ * touching the database or taking a lock. The batch's items share one instance, which is never modified
+ * once built.
+ */
+class FileStatePrefetch final : public WorkItemAttachment
+{
+  public:
+    /**
+     * @brief Read the stored states of a batch.
+     *
+     * @param[in] fileStateRepository Repository to read from
+     * @param[in] sourceKeys Mapping of walked files to their state keys
+     * @param[in] files Batch of files from one directory
+     * @return Prefetched states, nullptr if the batch is empty or the query failed, so workers look their files up themselves
+     */
+    static std::shared_ptr<const FileStatePrefetch> Load(FileStateRepository& fileStateRepository, const RelativePathBuilder& sourceKeys,
+                                                         const std::vector<FileEntry>& files);
+
+    /**
+     * @brief Find the state prefetched for a file of the batch.
+     *
+     * @param[in] fileKey Repository-relative file path
+     * @param[out] outputRecord Stored state, assigned if outputStored
+     * @param[out] outputStored The file has a stored row
+     * @return true if the file was prefetched, false if it has to be looked up on its own
+     */
+    bool Find(std::string_view fileKey, FileStateRecord& outputRecord, bool& outputStored) const;
+
+  private:
+    std::string _directoryKey;            /**< Key of the batch's directory */
+    std::vector<std::string> _names;      /**< Names of the batch's files in ascending order */
+    std::vector<NamedFileState> _states;  /**< States of the stored files among them in ascending name order */
+};
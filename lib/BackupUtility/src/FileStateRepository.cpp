@@ -1,29 +1,3365 @@
 // file FileStateRepository.cpp
 
 #include "FileStateRepository.hpp"
+#include "PathIdBitmap.hpp"
 
+#include "Instrumentation/Instrumentation.hpp"
+#include "Instrumentation/Probes.hpp"
 #include "SQLite/SQLiteConnection.hpp"
+#include "SQLite/SQLiteText.hpp"
+#include "TimestampProvider/TimestampProvider.hpp"
 
+#include <xxhash.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <limits>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace
+{
+constexpr int CurrentSchemaVersion = 21;
+
+/**
+ * @brief Schema version from which stored names are UTF-8 on every platform; shard databases record it as their own version.
+ */
+constexpr int Utf8NamesSchemaVersion = 21;
+
+/**
+ * @brief Directory id of the source root, which has no row in the dirs table.
+ */
+constexpr std::int64_t RootDirectoryId = 0;
+
+/**
+ * @brief Most file rows buffered by one page of a paged file scan.
+ */
+constexpr std::int64_t FileScanPageRows = 4096;
+
+constexpr char PathSeparator = static_cast<char>(std::filesystem::path::preferred_separator);
+#ifdef _WIN32
+constexpr const char* PathSeparators = "\\/";
+#else
+constexpr const char* PathSeparators = "/";
+#endif
+
+constexpr const char* SqlCreateDirsTable = "CREATE TABLE IF NOT EXISTS dirs ("
+                                           "id INTEGER PRIMARY KEY,"
+                                           "parent_id INTEGER NOT NULL,"
+                                           "name TEXT NOT NULL,"
+                                           "digest BLOB,"
+                                           "UNIQUE(parent_id, name));";
+
+constexpr const char* SqlFilesColumns = "(dir_id INTEGER NOT NULL,"
+                                        "name TEXT NOT NULL,"
+                                        "hash BLOB NOT NULL,"
+                                        "last_updated INTEGER NOT NULL,"
+                                        "status INTEGER NOT NULL,"
+                                        "hash_algorithm TEXT NOT NULL DEFAULT 'XXH64',"
+                                        "size INTEGER NOT NULL DEFAULT 0,"
+                                        "mtime_ns INTEGER NOT NULL DEFAULT -1,"
+                                        "inode INTEGER NOT NULL DEFAULT 0,"
+                                        "device INTEGER NOT NULL DEFAULT 0,"
+                                        "generation INTEGER NOT NULL DEFAULT 0,"
+                                        "mode INTEGER NOT NULL DEFAULT 0,"
+                                        "uid INTEGER NOT NULL DEFAULT 0,"
+                                        "gid INTEGER NOT NULL DEFAULT 0,"
+                                        "atime_ns INTEGER NOT NULL DEFAULT 0,"
+                                        "xattrs BLOB,"
+                                        "digest_scheme TEXT NOT NULL DEFAULT 'full',"
+                                        "sample_digest BLOB,"
+                                        "sampled_runs INTEGER NOT NULL DEFAULT 0,"
+                                        "PRIMARY KEY(dir_id, name)) WITHOUT ROWID;";
+
+constexpr const char* SqlPathsColumns = "(id INTEGER PRIMARY KEY,"
+                                        "dir_id INTEGER NOT NULL,"
+                                        "name TEXT NOT NULL,"
+                                        "UNIQUE(dir_id, name));";
+
+constexpr const char* SqlCreateObjectsTable = "CREATE TABLE IF NOT EXISTS objects ("
+                                              "digest BLOB PRIMARY KEY,"
+                                              "size INTEGER NOT NULL,"
+                                              "refcount INTEGER NOT NULL);";
+
+constexpr const char* SqlCreateChunksTable = "CREATE TABLE IF NOT EXISTS chunks ("
+                                             "digest BLOB PRIMARY KEY,"
+                                             "size INTEGER NOT NULL,"
+                                             "refcount INTEGER NOT NULL);";
+
+constexpr const char* SqlCreateLegacyPathsTable = "CREATE TABLE IF NOT EXISTS paths ("
+                                                  "id INTEGER PRIMARY KEY,"
+                                                  "path TEXT NOT NULL UNIQUE);";
+
+constexpr const char* SqlCreateSnapshotsTable = "CREATE TABLE IF NOT EXISTS snapshots ("
+                                                "id INTEGER PRIMARY KEY,"
+                                                "name TEXT NOT NULL);";
+
+constexpr const char* SqlCreateRunsTable = "CREATE TABLE IF NOT EXISTS runs ("
+                                           "id INTEGER PRIMARY KEY,"
+                                           "started TEXT NOT NULL,"
+                                           "state TEXT NOT NULL);";
+
+// The ids of the paths with a current version when a run completed; a run without a row falls back to the version history.
+constexpr const char* SqlCreateRunMembersTable = "CREATE TABLE IF NOT EXISTS run_members ("
+                                                 "run_id INTEGER PRIMARY KEY,"
+                                                 "live BLOB NOT NULL);";
+
+// Snapshots moved to a cold tier and the root holding their deleted/ directory; a snapshot without a row stays below the backup root.
+constexpr const char* SqlCreateColdSnapshotsTable = "CREATE TABLE IF NOT EXISTS cold_snapshots ("
+                                                    "snapshot_id INTEGER PRIMARY KEY,"
+                                                    "root TEXT NOT NULL);";
+
+constexpr const char* RunStateRunning = "running";
+constexpr const char* RunStateCompleted = "completed";
+constexpr const char* RunStateFailed = "failed";
+constexpr const char* RunStateAbandoned = "abandoned";
+
+constexpr const char* SqlCreateFileVersionsTable = "CREATE TABLE IF NOT EXISTS file_versions ("
+                                                   "path_id INTEGER NOT NULL,"
+                                                   "version TEXT NOT NULL,"
+                                                   "hash BLOB NOT NULL,"
+                                                   "hash_algorithm TEXT NOT NULL,"
+                                                   "size INTEGER NOT NULL,"
+                                                   "snapshot_id INTEGER);";
+
+constexpr const char* SqlCreateVersionIndexes = "CREATE INDEX IF NOT EXISTS file_versions_by_path ON file_versions(path_id, version);"
+                                                "CREATE INDEX IF NOT EXISTS file_versions_by_snapshot ON file_versions(snapshot_id);"
+                                                "CREATE INDEX IF NOT EXISTS file_versions_by_version ON file_versions(version);"
+                                                "CREATE INDEX IF NOT EXISTS snapshots_by_name ON snapshots(name);";
+
+/**
+ * @brief Stored status of a deleted file; the status column holds ChangeType values.
+ */
+constexpr std::int64_t DeletedStatus = static_cast<std::int64_t>(ChangeType::Deleted);
+static_assert(3 == DeletedStatus, "the triggers on files compare status with 3");
+
+// A directory's digest covers the names and digests of its live files, so only changes to those clear it.
+// Ancestors are found stale by RefreshDirectoryDigests, which keeps the triggers to one row each.
+constexpr const char* SqlCreateDirectoryDigests =
+    "CREATE INDEX IF NOT EXISTS dirs_stale ON dirs(id) WHERE digest IS NULL;"
+    "CREATE TRIGGER IF NOT EXISTS files_insert_stales_dir AFTER INSERT ON files WHEN NEW.status != 3 BEGIN "
+    "UPDATE dirs SET digest=NULL WHERE id=NEW.dir_id AND digest IS NOT NULL; END;"
+    "CREATE TRIGGER IF NOT EXISTS files_update_stales_dir AFTER UPDATE OF hash, status ON files "
+    "WHEN (OLD.hash IS NOT NEW.hash) OR ((OLD.status = 3) IS NOT (NEW.status = 3)) BEGIN "
+    "UPDATE dirs SET digest=NULL WHERE id=NEW.dir_id AND digest IS NOT NULL; END;"
+    "CREATE TRIGGER IF NOT EXISTS files_delete_stales_dir AFTER DELETE ON files WHEN OLD.status != 3 BEGIN "
+    "UPDATE dirs SET digest=NULL WHERE id=OLD.dir_id AND digest IS NOT NULL; END;";
+
+// Move detection looks up the files holding a new file's content by size first, and by digest only when the size matches.
+constexpr const char* SqlCreateContentIndex = "CREATE INDEX IF NOT EXISTS files_by_size_hash ON files(size, hash);";
+
+// The state snapshot file is valid while its token is stored; any change to a file row or to a directory's path drops the token.
+constexpr const char* SqlCreateStateSnapshot =
+    "CREATE TABLE IF NOT EXISTS state_snapshot (id INTEGER PRIMARY KEY CHECK (id = 1), token INTEGER NOT NULL);"
+    "CREATE TRIGGER IF NOT EXISTS files_insert_stales_snapshot AFTER INSERT ON files WHEN EXISTS (SELECT 1 FROM state_snapshot) BEGIN "
+    "DELETE FROM state_snapshot; END;"
+    "CREATE TRIGGER IF NOT EXISTS files_update_stales_snapshot AFTER UPDATE ON files WHEN EXISTS (SELECT 1 FROM state_snapshot) BEGIN "
+    "DELETE FROM state_snapshot; END;"
+    "CREATE TRIGGER IF NOT EXISTS files_delete_stales_snapshot AFTER DELETE ON files WHEN EXISTS (SELECT 1 FROM state_snapshot) BEGIN "
+    "DELETE FROM state_snapshot; END;"
+    "CREATE TRIGGER IF NOT EXISTS dirs_update_stales_snapshot AFTER UPDATE OF parent_id, name ON dirs WHEN EXISTS (SELECT 1 FROM state_snapshot) BEGIN "
+    "DELETE FROM state_snapshot; END;"
+    "CREATE TRIGGER IF NOT EXISTS dirs_delete_stales_snapshot AFTER DELETE ON dirs WHEN EXISTS (SELECT 1 FROM state_snapshot) BEGIN "
+    "DELETE FROM state_snapshot; END;";
+
+// A missing row means every file row is in the main database.
+constexpr const char* SqlCreateFileShards = "CREATE TABLE IF NOT EXISTS file_shards (id INTEGER PRIMARY KEY CHECK (id = 1), count INTEGER NOT NULL);";
+
+// A shard cannot reach the dirs table, so its triggers collect the directories they would clear for RefreshDirectoryDigests
+// to carry over, and it keeps its own copy of the state snapshot token. The triggers check for the row themselves, since
+// the conflict clause of an upsert overrides an OR IGNORE in a trigger it fires.
+constexpr const char* SqlCreateShardTables =
+    "CREATE TABLE IF NOT EXISTS stale_dirs (dir_id INTEGER PRIMARY KEY);"
+    "CREATE TRIGGER IF NOT EXISTS files_insert_stales_dir AFTER INSERT ON files WHEN NEW.status != 3 BEGIN "
+    "INSERT INTO stale_dirs(dir_id) SELECT NEW.dir_id WHERE NOT EXISTS (SELECT 1 FROM stale_dirs WHERE dir_id=NEW.dir_id); END;"
+    "CREATE TRIGGER IF NOT EXISTS files_update_stales_dir AFTER UPDATE OF hash, status ON files "
+    "WHEN (OLD.hash IS NOT NEW.hash) OR ((OLD.status = 3) IS NOT (NEW.status = 3)) BEGIN "
+    "INSERT INTO stale_dirs(dir_id) SELECT NEW.dir_id WHERE NOT EXISTS (SELECT 1 FROM stale_dirs WHERE dir_id=NEW.dir_id); END;"
+    "CREATE TRIGGER IF NOT EXISTS files_delete_stales_dir AFTER DELETE ON files WHEN OLD.status != 3 BEGIN "
+    "INSERT INTO stale_dirs(dir_id) SELECT OLD.dir_id WHERE NOT EXISTS (SELECT 1 FROM stale_dirs WHERE dir_id=OLD.dir_id); END;"
+    "CREATE TABLE IF NOT EXISTS state_snapshot (id INTEGER PRIMARY KEY CHECK (id = 1), token INTEGER NOT NULL);"
+    "CREATE TRIGGER IF NOT EXISTS files_insert_stales_snapshot AFTER INSERT ON files WHEN EXISTS (SELECT 1 FROM state_snapshot) BEGIN "
+    "DELETE FROM state_snapshot; END;"
+    "CREATE TRIGGER IF NOT EXISTS files_update_stales_snapshot AFTER UPDATE ON files WHEN EXISTS (SELECT 1 FROM state_snapshot) BEGIN "
+    "DELETE FROM state_snapshot; END;"
+    "CREATE TRIGGER IF NOT EXISTS files_delete_stales_snapshot AFTER DELETE ON files WHEN EXISTS (SELECT 1 FROM state_snapshot) BEGIN "
+    "DELETE FROM state_snapshot; END;";
+
+// Rows are keyed by path id and hold the full repository-relative path, split into trigrams so GLOB patterns with a
+// literal part of three characters or more are answered from the index.
+constexpr const char* SqlCreatePathSearch = "CREATE VIRTUAL TABLE IF NOT EXISTS path_search USING fts5(path, tokenize='trigram case_sensitive 1');";
+
+constexpr const char* SqlUpsertFileState = "INSERT INTO files(dir_id, name, hash, status, last_updated, hash_algorithm, size, mtime_ns, inode, "
+                                           "device, generation, mode, uid, gid, atime_ns, xattrs, digest_scheme, sample_digest, sampled_runs) "
+                                           "VALUES(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18, ?19) "
+                                           "ON CONFLICT(dir_id, name) DO UPDATE SET "
+                                           "hash=excluded.hash, status=excluded.status, last_updated=excluded.last_updated, "
+                                           "hash_algorithm=excluded.hash_algorithm, size=excluded.size, mtime_ns=excluded.mtime_ns, "
+                                           "inode=excluded.inode, device=excluded.device, generation=excluded.generation, "
+                                           "mode=excluded.mode, uid=excluded.uid, gid=excluded.gid, atime_ns=excluded.atime_ns, "
+                                           "xattrs=excluded.xattrs, digest_scheme=excluded.digest_scheme, sample_digest=excluded.sample_digest, "
+                                           "sampled_runs=excluded.sampled_runs;";
+
+constexpr const char* SqlAppendFileState = "INSERT INTO files(dir_id, name, hash, status, last_updated, hash_algorithm, size, mtime_ns, inode, "
+                                           "device, generation, mode, uid, gid, atime_ns, xattrs, digest_scheme, sample_digest, sampled_runs) "
+                                           "VALUES(?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18, ?19);";
+
+// Indexes a bulk import builds once at its end instead of row by row; the path index stays, since storing a version looks up by it.
+constexpr const char* SqlDropDeferredIndexes = "DROP INDEX IF EXISTS files_by_size_hash;"
+                                               "DROP INDEX IF EXISTS file_versions_by_snapshot;"
+                                               "DROP INDEX IF EXISTS file_versions_by_version;"
+                                               "DROP INDEX IF EXISTS snapshots_by_name;";
+
+constexpr const char* SqlWriteStateSnapshotToken = "INSERT OR REPLACE INTO state_snapshot (id, token) VALUES (1, ?1);";
+
+constexpr const char* HashAlgorithmColumnName = "hash_algorithm";
+constexpr int TableInfoNameColumn = 1;
+
+/**
+ * @brief Fires the db_commit_begin and db_commit probes around one commit of file states.
+ */
+class CommitProbe
+{
+  public:
+    explicit CommitProbe(std::size_t files) : _files(files)
+    {
+        RDEMO_PROBE1(db_commit_begin, _files);
+    }
+
+    ~CommitProbe()
+    {
+        RDEMO_PROBE1(db_commit, _files);
+    }
+
+    CommitProbe(const CommitProbe&) = delete;
+    CommitProbe& operator=(const CommitProbe&) = delete;
+
+  private:
+    std::size_t _files;
+};
+
+/**
+ * @brief Read the schema version stored in the database header.
+ *
+ * @param[in] connection Connection to query
+ * @return Stored schema version, 0 for unversioned databases
+ */
+int ReadSchemaVersion(SQLiteConnection& connection)
+{
+    auto statement = connection.Prepare("PRAGMA user_version;");
+    if (false == statement.FetchRow())
+    {
+        return 0;
+    }
+    return static_cast<int>(statement.ColumnInt64(0));
+}
+
+/**
+ * @brief Check whether the files table exists.
+ *
+ * @param[in] connection Connection to query
+ * @return true if the table exists, false otherwise
+ */
+bool FilesTableExists(SQLiteConnection& connection)
+{
+    auto statement = connection.Prepare("SELECT 1 FROM sqlite_master WHERE type='table' AND name='files';");
+    return statement.FetchRow();
+}
+
+/**
+ * @brief Check whether a table contains the specified column.
+ *
+ * @param[in] connection Connection to query
+ * @param[in] tableName Table to inspect
+ * @param[in] columnName Column name to look for
+ * @return true if the column exists, false otherwise
+ */
+bool TableHasColumn(SQLiteConnection& connection, const std::string& tableName, const std::string& columnName)
+{
+    auto statement = connection.Prepare("PRAGMA table_info(" + tableName + ");");
+    while (true == statement.FetchRow())
+    {
+        if (columnName == statement.ColumnText(TableInfoNameColumn))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Read a status column holding a ChangeType value.
+ *
+ * @param[in] statement Statement positioned on a row
+ * @param[in] column Index of the status column
+ * @param[out] outputStatus Decoded status
+ * @return true if the column holds a ChangeType value, false otherwise
+ */
+bool ReadStatusColumn(const SQLiteStatement& statement, int column, ChangeType& outputStatus)
+{
+    const std::int64_t status = statement.ColumnInt64(column);
+    if ((status < 0) || (static_cast<std::int64_t>(ChangeTypeCount) <= status))
+    {
+        return false;
+    }
+    outputStatus = static_cast<ChangeType>(status);
+    return true;
+}
+
+/**
+ * @brief Version 1: record the hash algorithm per row.
+ *
+ * Databases created before hash algorithms were recorded hold XXH64 digests only.
+ */
+void MigrateAddHashAlgorithm(SQLiteConnection& connection)
+{
+    if (false == TableHasColumn(connection, "files", HashAlgorithmColumnName))
+    {
+        connection.Execute("ALTER TABLE files ADD COLUMN hash_algorithm TEXT NOT NULL DEFAULT 'XXH64';");
+    }
+}
+
+/**
+ * @brief Version 2: convert hex TEXT digests into canonical binary BLOBs.
+ *
+ * Legacy 64-bit digests were written without leading zeros and are padded before decoding. Rows whose
+ * digest cannot be decoded are dropped and will be re-added by the next run.
+ */
+void MigrateBinaryHash(SQLiteConnection& connection)
+{
+    connection.Execute("CREATE TABLE files_migration ("
+                       "path TEXT PRIMARY KEY,"
+                       "hash BLOB NOT NULL,"
+                       "last_updated TEXT NOT NULL,"
+                       "status TEXT NOT NULL,"
+                       "hash_algorithm TEXT NOT NULL DEFAULT 'XXH64');");
+    connection.Execute("INSERT INTO files_migration(path, hash, last_updated, status, hash_algorithm) "
+                       "SELECT path, decoded, last_updated, status, hash_algorithm FROM ("
+                       "SELECT *, CASE WHEN typeof(hash)='blob' THEN hash "
+                       "WHEN length(hash) <= 16 THEN unhex(substr('0000000000000000' || hash, -16)) "
+                       "ELSE unhex(hash) END AS decoded FROM files) WHERE decoded IS NOT NULL;");
+    connection.Execute("DROP TABLE files;");
+    connection.Execute("ALTER TABLE files_migration RENAME TO files;");
+}
+
+/**
+ * @brief Version 3: add file metadata columns for the unchanged-file fast path.
+ *
+ * Migrated rows get an mtime of -1, which never matches a real file, so they are rehashed once.
+ */
+void MigrateFileMetadata(SQLiteConnection& connection)
+{
+    connection.Execute("ALTER TABLE files ADD COLUMN size INTEGER NOT NULL DEFAULT 0;");
+    connection.Execute("ALTER TABLE files ADD COLUMN mtime_ns INTEGER NOT NULL DEFAULT -1;");
+    connection.Execute("ALTER TABLE files ADD COLUMN inode INTEGER NOT NULL DEFAULT 0;");
+    connection.Execute("ALTER TABLE files ADD COLUMN device INTEGER NOT NULL DEFAULT 0;");
+}
+
+/**
+ * @brief Version 4: add the run generation that last saw each file.
+ */
+void MigrateRunGeneration(SQLiteConnection& connection)
+{
+    connection.Execute("ALTER TABLE files ADD COLUMN generation INTEGER NOT NULL DEFAULT 0;");
+}
+
+/**
+ * @brief Version 5: add reference counts for the content-addressed object store.
+ */
+void MigrateObjectReferences(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateObjectsTable);
+}
+
+/**
+ * @brief Version 6: add the chunk index for chunked snapshot history.
+ */
+void MigrateChunkIndex(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateChunksTable);
+}
+
+/**
+ * @brief Create the version history tables other than paths, and their indexes.
+ *
+ * @param[in] connection Connection to write through
+ */
+void CreateVersionHistory(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateSnapshotsTable);
+    connection.Execute(SqlCreateFileVersionsTable);
+    connection.Execute(SqlCreateVersionIndexes);
+}
+
+/**
+ * @brief Version 7: add the version history, seeded with the current version of every live file.
+ *
+ * Versions archived before the upgrade are not recorded; their snapshot directories are missing from
+ * the snapshots table.
+ */
+void MigrateVersionHistory(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateLegacyPathsTable);
+    CreateVersionHistory(connection);
+    connection.Execute("INSERT OR IGNORE INTO paths(path) SELECT path FROM files;");
+    connection.Execute("INSERT INTO file_versions(path_id, version, hash, hash_algorithm, size, snapshot_id) "
+                       "SELECT paths.id, files.last_updated, files.hash, files.hash_algorithm, files.size, NULL "
+                       "FROM files JOIN paths ON paths.path = files.path WHERE files.status != 'Deleted';");
+}
+
+/**
+ * @brief Version 9: record each run and its state, so an interrupted run can be resumed.
+ */
+void MigrateRunRecords(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateRunsTable);
+}
+
+/**
+ * @brief Split a repository-relative path into its parent directory path and its last component.
+ *
+ * @param[in] path Repository-relative path
+ * @param[out] outputParent Parent directory path, empty for the source root
+ * @param[out] outputName Last component
+ */
+void SplitPath(const std::string& path, std::string& outputParent, std::string& outputName)
+{
+    const std::size_t separator = path.find_last_of(PathSeparators);
+    if (std::string::npos == separator)
+    {
+        outputParent.clear();
+        outputName = path;
+        return;
+    }
+    outputParent = path.substr(0, separator);
+    outputName = path.substr(separator + 1);
+}
+
+/**
+ * @brief Write a repository-relative directory path with a component appended into a buffer.
+ *
+ * The buffer keeps its capacity, so a scan reusing it allocates only when a path outgrows it.
+ */
+void JoinPath(const std::string& parent, std::string_view name, std::string& outputPath)
+{
+    outputPath.assign(parent);
+    if (false == parent.empty())
+    {
+        outputPath += PathSeparator;
+    }
+    outputPath.append(name);
+}
+
+/**
+ * @brief Append a component to a repository-relative directory path.
+ */
+std::string JoinPath(const std::string& parent, std::string_view name)
+{
+    std::string path;
+    JoinPath(parent, name, path);
+    return path;
+}
+
+/**
+ * @brief Get the digest of a subtree without live files, which parents leave out of their own digest.
+ *
+ * @return Digest of the empty input
+ */
+const HashDigest& EmptyTreeDigest()
+{
+    static const HashDigest digest = FileHasher::ComputeBuffer(HashAlgorithm::XXH3_128, "", 0);
+    return digest;
+}
+
+/**
+ * @brief Hash the names and digests of a directory's live files and non-empty subdirectories.
+ *
+ * Files and subdirectories are each taken in name order and tagged, so the digest does not depend on
+ * the database the rows come from.
+ *
+ * @param[in] connection Connection to query
+ * @param[in] directoryId Directory to hash
+ * @param[out] outputDigest Digest of the directory's subtree
+ * @return true on success, false if a subdirectory's digest is stale
+ */
+bool ComputeDirectoryDigest(SQLiteConnection& connection, std::int64_t directoryId, HashDigest& outputDigest)
+{
+    std::string entries;
+    auto files = connection.PrepareCached("SELECT name, hash FROM files WHERE dir_id=?1 AND status != ?2 ORDER BY name;");
+    files->BindInt64(1, directoryId);
+    files->BindInt64(2, DeletedStatus);
+    files->ForEachRow(
+        [&entries](const SQLiteStatement& row)
+        {
+            const SQLiteBlob hash = row.ColumnBlob(1);
+            entries += 'f';
+            entries.append(row.ColumnView(0));
+            entries += '\0';
+            entries += static_cast<char>(hash.size);
+            entries.append(static_cast<const char*>(hash.data), hash.size);
+            return true;
+        });
+
+    bool complete = true;
+    auto directories = connection.PrepareCached("SELECT name, digest FROM dirs WHERE parent_id=?1 ORDER BY name;");
+    directories->BindInt64(1, directoryId);
+    directories->ForEachRow(
+        [&entries, &complete](const SQLiteStatement& row)
+        {
+            const SQLiteBlob digest = row.ColumnBlob(1);
+            HashDigest childDigest{};
+            if (false == HashDigest::FromBytes(digest.data, digest.size, childDigest))
+            {
+                complete = false;
+                return false;
+            }
+            if (EmptyTreeDigest() != childDigest)
+            {
+                entries += 'd';
+                entries.append(row.ColumnView(0));
+                entries += '\0';
+                entries.append(reinterpret_cast<const char*>(childDigest.bytes.data()), childDigest.size);
+            }
+            return true;
+        });
+    if (false == complete)
+    {
+        return false;
+    }
+    outputDigest = FileHasher::ComputeBuffer(HashAlgorithm::XXH3_128, entries.data(), entries.size());
+    return true;
+}
+
+/**
+ * @brief Look up the id of a directory row by its parent and name.
+ *
+ * @param[in] connection Connection to query
+ * @param[in] parentId Id of the parent directory
+ * @param[in] name Directory name
+ * @param[out] outputId Directory id
+ * @return true if the directory exists, false otherwise
+ */
+bool SelectDirectory(SQLiteConnection& connection, std::int64_t parentId, const std::string& name, std::int64_t& outputId)
+{
+    auto cachedStatement = connection.PrepareCached("SELECT id FROM dirs WHERE parent_id=?1 AND name=?2;");
+    SQLiteStatement& statement = *cachedStatement;
+    statement.BindInt64(1, parentId);
+    statement.BindText(2, name);
+    if (false == statement.FetchRow())
+    {
+        return false;
+    }
+    outputId = statement.ColumnInt64(0);
+    return true;
+}
+
+/**
+ * @brief Look up a directory row by its parent and name, optionally adding it.
+ *
+ * @param[in] connection Connection to query
+ * @param[in] parentId Id of the parent directory
+ * @param[in] name Directory name
+ * @param[in] create Add the directory when it is missing
+ * @param[out] outputId Directory id
+ * @param[out] outputAdded Whether this call added the directory
+ * @return true if the directory exists, false otherwise
+ */
+bool FindDirectory(SQLiteConnection& connection, std::int64_t parentId, const std::string& name, bool create, std::int64_t& outputId,
+                   bool& outputAdded)
+{
+    outputAdded = false;
+    if (true == SelectDirectory(connection, parentId, name, outputId))
+    {
+        return true;
+    }
+    if (false == create)
+    {
+        return false;
+    }
+    auto cachedStatement = connection.PrepareCached("INSERT OR IGNORE INTO dirs(parent_id, name) VALUES(?1, ?2);");
+    SQLiteStatement& statement = *cachedStatement;
+    statement.BindInt64(1, parentId);
+    statement.BindText(2, name);
+    if (false == statement.ExecuteStatement())
+    {
+        return false;
+    }
+    outputAdded = true;
+    return SelectDirectory(connection, parentId, name, outputId);
+}
+
+/**
+ * @brief Get the id of a directory while migrating, adding it and its parents on first use.
+ *
+ * @param[in] connection Connection to write through
+ * @param[in] directoryPath Repository-relative directory path
+ * @param[in,out] directoryIds Ids of the directories added so far, keyed by path
+ * @return Directory id
+ */
+std::int64_t InternDirectory(SQLiteConnection& connection, const std::string& directoryPath,
+                             std::unordered_map<std::string, std::int64_t>& directoryIds)
+{
+    const auto known = directoryIds.find(directoryPath);
+    if (directoryIds.end() != known)
+    {
+        return known->second;
+    }
+    std::string parentPath;
+    std::string name;
+    SplitPath(directoryPath, parentPath, name);
+    const std::int64_t parentId = InternDirectory(connection, parentPath, directoryIds);
+    std::int64_t directoryId = RootDirectoryId;
+    bool added = false;
+    if (false == FindDirectory(connection, parentId, name, true, directoryId, added))
+    {
+        throw std::runtime_error("Failed to add directory: " + directoryPath);
+    }
+    directoryIds.emplace(directoryPath, directoryId);
+    return directoryId;
+}
+
+/**
+ * @brief Version 8: key files and paths by directory id and name instead of the full path.
+ *
+ * Every directory is stored once in the dirs table, so rows no longer repeat their directory prefix.
+ * Path ids are kept, so the version history stays valid.
+ */
+void MigrateDirectoryTable(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateDirsTable);
+    connection.Execute(std::string("CREATE TABLE files_migration") + SqlFilesColumns);
+    connection.Execute(std::string("CREATE TABLE paths_migration") + SqlPathsColumns);
+
+    std::unordered_map<std::string, std::int64_t> directoryIds{{std::string(), RootDirectoryId}};
+    std::string directoryPath;
+    std::string name;
+
+    // Each scan is finalized before its table is dropped.
+    {
+        auto copyFile = connection.Prepare("INSERT INTO files_migration(dir_id, name, hash, last_updated, status, hash_algorithm, size, "
+                                           "mtime_ns, inode, device, generation) "
+                                           "SELECT ?1, ?2, hash, last_updated, status, hash_algorithm, size, mtime_ns, inode, device, "
+                                           "generation FROM files WHERE path=?3;");
+        auto files = connection.Prepare("SELECT path FROM files;");
+        while (true == files.FetchRow())
+        {
+            const std::string path = files.ColumnText(0);
+            SplitPath(path, directoryPath, name);
+            if (true == name.empty())
+            {
+                continue;
+            }
+            copyFile.Reset();
+            copyFile.BindInt64(1, InternDirectory(connection, directoryPath, directoryIds));
+            copyFile.BindText(2, name);
+            copyFile.BindText(3, path);
+            copyFile.ExecuteStatement();
+        }
+    }
+    {
+        auto copyPath = connection.Prepare("INSERT INTO paths_migration(id, dir_id, name) VALUES(?1, ?2, ?3);");
+        auto paths = connection.Prepare("SELECT id, path FROM paths;");
+        while (true == paths.FetchRow())
+        {
+            SplitPath(paths.ColumnText(1), directoryPath, name);
+            if (true == name.empty())
+            {
+                continue;
+            }
+            copyPath.Reset();
+            copyPath.BindInt64(1, paths.ColumnInt64(0));
+            copyPath.BindInt64(2, InternDirectory(connection, directoryPath, directoryIds));
+            copyPath.BindText(3, name);
+            copyPath.ExecuteStatement();
+        }
+    }
+
+    connection.Execute("DROP TABLE files;");
+    connection.Execute("ALTER TABLE files_migration RENAME TO files;");
+    connection.Execute("DROP TABLE paths;");
+    connection.Execute("ALTER TABLE paths_migration RENAME TO paths;");
+}
+
+/**
+ * @brief Version 10: add the permissions, owner, access time and extended attributes restored with each file.
+ *
+ * Migrated rows get mode 0, which restore reads as unknown, until the next run stores the real values.
+ * Databases migrated through version 8 already have the columns.
+ */
+void MigratePermissionMetadata(SQLiteConnection& connection)
+{
+    if (false == TableHasColumn(connection, "files", "mode"))
+    {
+        connection.Execute("ALTER TABLE files ADD COLUMN mode INTEGER NOT NULL DEFAULT 0;");
+        connection.Execute("ALTER TABLE files ADD COLUMN uid INTEGER NOT NULL DEFAULT 0;");
+        connection.Execute("ALTER TABLE files ADD COLUMN gid INTEGER NOT NULL DEFAULT 0;");
+        connection.Execute("ALTER TABLE files ADD COLUMN atime_ns INTEGER NOT NULL DEFAULT 0;");
+        connection.Execute("ALTER TABLE files ADD COLUMN xattrs BLOB;");
+    }
+}
+
+/**
+ * @brief Version 11: add the directory digests and the triggers that mark them stale.
+ *
+ * Every directory starts stale, so the first RefreshDirectoryDigests computes the whole tree once.
+ */
+void MigrateDirectoryDigests(SQLiteConnection& connection)
+{
+    if (false == TableHasColumn(connection, "dirs", "digest"))
+    {
+        connection.Execute("ALTER TABLE dirs ADD COLUMN digest BLOB;");
+    }
+    connection.Execute(SqlCreateDirectoryDigests);
+}
+
+/**
+ * @brief Version 12: index the version history by start time, so the changes between two points in time are a range query.
+ */
+void MigrateVersionTimeIndex(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateVersionIndexes);
+}
+
+/**
+ * @brief Version 13: index the files by size and digest, so a new file's content is matched against stored files without a scan.
+ */
+void MigrateContentIndex(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateContentIndex);
+}
+
+/**
+ * @brief Version 14: add the state snapshot token and the triggers that drop it when file rows change.
+ */
+void MigrateStateSnapshot(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateStateSnapshot);
+}
+
+/**
+ * @brief Version 15: record how many shard databases hold the file rows.
+ */
+void MigrateFileShards(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateFileShards);
+}
+
+/**
+ * @brief Version 16: add the trigram index over the paths of the version history.
+ *
+ * Every path starts unindexed, so the first RefreshPathSearch indexes all of them once.
+ */
+void MigratePathSearch(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreatePathSearch);
+}
+
+/**
+ * @brief Version 17: add the digest scheme and the sample digest of the sampled quick check of large files.
+ *
+ * Migrated rows start with a full scheme and no sample, so their first sampled check hashes them in full.
+ */
+void MigrateSampledChecks(SQLiteConnection& connection)
+{
+    if (false == TableHasColumn(connection, "files", "digest_scheme"))
+    {
+        connection.Execute("ALTER TABLE files ADD COLUMN digest_scheme TEXT NOT NULL DEFAULT 'full';");
+        connection.Execute("ALTER TABLE files ADD COLUMN sample_digest BLOB;");
+        connection.Execute("ALTER TABLE files ADD COLUMN sampled_runs INTEGER NOT NULL DEFAULT 0;");
+    }
+}
+
+// Columns of a files row, in the order of SqlFilesColumns.
+constexpr const char* SqlFilesColumnNames = "dir_id, name, hash, last_updated, status, hash_algorithm, size, mtime_ns, inode, device, generation, "
+                                            "mode, uid, gid, atime_ns, xattrs, digest_scheme, sample_digest, sampled_runs";
+
+// The rows of a pre-version 18 files table with the status as its ChangeType value and last_updated as the seconds of
+// TimestampProvider::ParseWallClockSeconds, which SQLite computes alike by reading the fields as UTC. Rows whose
+// timestamp cannot be read are left out and re-added by the next run.
+constexpr const char* SqlCreateCompactFileRowsView =
+    "CREATE VIEW IF NOT EXISTS files_compact_rows AS "
+    "SELECT dir_id, name, hash, seconds AS last_updated, "
+    "CASE status WHEN 'Added' THEN 1 WHEN 'Modified' THEN 2 WHEN 'Deleted' THEN 3 ELSE 0 END AS status, "
+    "hash_algorithm, size, mtime_ns, inode, device, generation, mode, uid, gid, atime_ns, xattrs, digest_scheme, "
+    "sample_digest, sampled_runs FROM ("
+    "SELECT *, CASE WHEN last_updated GLOB '[0-9][0-9][0-9][0-9]-[0-9][0-9]-[0-9][0-9]_[0-9][0-9]-[0-9][0-9]-[0-9][0-9]' "
+    "THEN CAST(strftime('%s', substr(last_updated, 1, 10) || ' ' || replace(substr(last_updated, 12), '-', ':')) AS INTEGER) "
+    "END AS seconds FROM files) WHERE seconds IS NOT NULL;";
+
+/**
+ * @brief Replace the files table with files_compact once every row is copied.
+ *
+ * The table's triggers and indexes are dropped with it; the caller creates them again.
+ *
+ * @param[in] connection Connection to the database holding the tables, inside a transaction
+ */
+void SwapCompactFileRows(SQLiteConnection& connection)
+{
+    connection.Execute("DROP VIEW files_compact_rows;");
+    connection.Execute("DROP TABLE files;");
+    connection.Execute("ALTER TABLE files_compact RENAME TO files;");
+}
+
+/**
+ * @brief Rewrite a files table holding TEXT statuses and timestamps with their INTEGER encodings in one go.
+ *
+ * The table's triggers and indexes are dropped with it; the caller creates them again.
+ *
+ * @param[in] connection Connection to the database holding the table, inside a transaction
+ */
+void CompactFileRows(SQLiteConnection& connection)
+{
+    connection.Execute(std::string("CREATE TABLE files_compact") + SqlFilesColumns);
+    connection.Execute(SqlCreateCompactFileRowsView);
+    connection.Execute(std::string("INSERT INTO files_compact(") + SqlFilesColumnNames + ") SELECT " + SqlFilesColumnNames +
+                       " FROM files_compact_rows;");
+    SwapCompactFileRows(connection);
+}
+
+/**
+ * @brief Create the compact files table, the view converting the old rows and the triggers mirroring writes into it.
+ *
+ * Idempotent, so an interrupted migration resumes with what it already copied.
+ *
+ * @param[in] connection Connection to the database holding the table, inside a transaction
+ */
+void PrepareCompactFileRows(SQLiteConnection& connection)
+{
+    connection.Execute(std::string("CREATE TABLE IF NOT EXISTS files_compact") + SqlFilesColumns);
+    connection.Execute(SqlCreateCompactFileRowsView);
+    const std::string copyNew = std::string("INSERT OR REPLACE INTO files_compact(") + SqlFilesColumnNames + ") SELECT " + SqlFilesColumnNames +
+                                " FROM files_compact_rows WHERE dir_id=NEW.dir_id AND name=NEW.name;";
+    connection.Execute("CREATE TRIGGER IF NOT EXISTS files_compact_insert AFTER INSERT ON files BEGIN " + copyNew + " END;");
+    connection.Execute("CREATE TRIGGER IF NOT EXISTS files_compact_update AFTER UPDATE ON files BEGIN "
+                       "DELETE FROM files_compact WHERE dir_id=OLD.dir_id AND name=OLD.name; " +
+                       copyNew + " END;");
+    connection.Execute("CREATE TRIGGER IF NOT EXISTS files_compact_delete AFTER DELETE ON files BEGIN "
+                       "DELETE FROM files_compact WHERE dir_id=OLD.dir_id AND name=OLD.name; END;");
+}
+
+/**
+ * @brief Version 18: replace the old files table with the copied compact rows and recreate its triggers and index.
+ *
+ * The triggers are created again so they compare with the integer status.
+ */
+void CutOverCompactFileRows(SQLiteConnection& connection)
+{
+    connection.Execute("DROP TRIGGER files_compact_insert;");
+    connection.Execute("DROP TRIGGER files_compact_update;");
+    connection.Execute("DROP TRIGGER files_compact_delete;");
+    SwapCompactFileRows(connection);
+    connection.Execute(SqlCreateDirectoryDigests);
+    connection.Execute(SqlCreateContentIndex);
+    connection.Execute(SqlCreateStateSnapshot);
+}
+
+/**
+ * @brief Most rows one transaction of a batched migration copies.
+ */
+constexpr std::int64_t MigrationBatchRows = 20000;
+
+// Key after which a batched migration resumes. The key starts below every (dir_id, name), and the table is
+// dropped at the cutover.
+constexpr const char* SqlCreateMigrationProgress = "CREATE TABLE IF NOT EXISTS schema_migration_progress ("
+                                                   "target_version INTEGER PRIMARY KEY,"
+                                                   "dir_id INTEGER NOT NULL,"
+                                                   "name TEXT NOT NULL);";
+
+/**
+ * @brief Migration step that rewrites a table keyed by (dir_id, name) in short, resumable transactions.
+ *
+ * The rows are copied into a new table in key order, one batch per transaction, and the key reached is
+ * stored with each batch. Triggers installed by prepare keep the copied rows in step with writes to the
+ * old table between batches, so other connections keep working on the old layout, and the stored
+ * schema version only changes with the cutover, which swaps the tables in one short transaction.
+ */
+struct BatchedMigration
+{
+    const char* table;                  /**< Table whose rows are rewritten */
+    void (*prepare)(SQLiteConnection&); /**< Creates the new table and the mirroring triggers; idempotent */
+    const char* copyBatch;              /**< Copies the rows with keys after (?1, ?2) up to and including (?3, ?4), replacing mirrored ones */
+    void (*cutover)(SQLiteConnection&); /**< Drops the triggers and puts the new table in place of the old one */
+};
+
+constexpr BatchedMigration CompactFileRowsMigration = {
+    "files", &PrepareCompactFileRows,
+    "INSERT OR REPLACE INTO files_compact(dir_id, name, hash, last_updated, status, hash_algorithm, size, mtime_ns, inode, device, generation, "
+    "mode, uid, gid, atime_ns, xattrs, digest_scheme, sample_digest, sampled_runs) "
+    "SELECT dir_id, name, hash, last_updated, status, hash_algorithm, size, mtime_ns, inode, device, generation, mode, uid, gid, atime_ns, "
+    "xattrs, digest_scheme, sample_digest, sampled_runs FROM files_compact_rows WHERE (dir_id, name) > (?1, ?2) AND (dir_id, name) <= (?3, ?4);",
+    &CutOverCompactFileRows};
+
+/**
+ * @brief Version 19: record the paths live after each completed run as a compressed bitmap of their ids.
+ *
+ * Runs completed before the upgrade have no bitmap, so queries about them keep reading the version history.
+ */
+void MigrateRunMembers(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateRunMembersTable);
+}
+
+/**
+ * @brief Version 20: record the snapshots moved to a cold tier.
+ */
+void MigrateColdSnapshots(SQLiteConnection& connection)
+{
+    connection.Execute(SqlCreateColdSnapshotsTable);
+}
+
+#ifdef _WIN32
+/**
+ * @brief Re-encode the names of a table from the ANSI code page to UTF-8.
+ *
+ * Renamed rows first move to negative parent ids, which no row uses, so a new name never collides with
+ * a row still holding the same bytes as its old name.
+ *
+ * @param[in] connection Connection holding the table, inside a transaction
+ * @param[in] table Table with a name column
+ * @param[in] parentColumn Column the names are unique within
+ * @return Number of rows renamed
+ * @throws std::runtime_error on SQLite errors or a name not valid in the ANSI code page
+ */
+std::int64_t ReencodeAnsiNames(SQLiteConnection& connection, const std::string& table, const std::string& parentColumn)
+{
+    connection.Execute("CREATE TEMP TABLE utf8_names (parent INTEGER NOT NULL, name TEXT NOT NULL, utf8 TEXT NOT NULL, PRIMARY KEY(parent, name));");
+    std::int64_t renamed = 0;
+    {
+        auto addName = connection.Prepare("INSERT INTO temp.utf8_names (parent, name, utf8) VALUES (?1, ?2, ?3);");
+        auto names = connection.Prepare("SELECT " + parentColumn + ", name FROM " + table + ";");
+        std::string utf8;
+        while (true == names.FetchRow())
+        {
+            const std::string_view name = names.ColumnView(1);
+            // Names made of ASCII alone are spelled the same in both encodings.
+            if (true == std::all_of(name.begin(), name.end(), [](char character) { return 0 == (static_cast<unsigned char>(character) & 0x80); }))
+            {
+                continue;
+            }
+            if (false == SQLiteText::FromAnsi(name, utf8))
+            {
+                throw std::runtime_error("Stored name is not valid in the ANSI code page: " + table);
+            }
+            addName.Reset();
+            addName.BindInt64(1, names.ColumnInt64(0));
+            addName.BindText(2, std::string(name));
+            addName.BindText(3, utf8);
+            addName.ExecuteStatement();
+            ++renamed;
+        }
+    }
+    connection.Execute("UPDATE " + table + " SET " + parentColumn + " = -1 - " + parentColumn + " WHERE (" + parentColumn +
+                       ", name) IN (SELECT parent, name FROM temp.utf8_names);");
+    connection.Execute("UPDATE " + table + " SET " + parentColumn + " = -1 - " + parentColumn +
+                       ", name = (SELECT utf8 FROM temp.utf8_names WHERE utf8_names.parent = -1 - " + table + "." + parentColumn +
+                       " AND utf8_names.name = " + table + ".name) WHERE " + parentColumn + " < 0;");
+    connection.Execute("DROP TABLE temp.utf8_names;");
+    return renamed;
+}
+#endif
+
+/**
+ * @brief Version 21: re-encode the stored names in UTF-8, the encoding keys are built in.
+ *
+ * Windows builds stored path::string spellings, which are in the ANSI code page; every name it could
+ * spell converts. The path search index is rebuilt from the new names by the next RefreshPathSearch, and
+ * shard databases are re-encoded when they are next opened. Elsewhere names always were the native bytes.
+ */
+void MigrateUtf8Names(SQLiteConnection& connection)
+{
+#ifdef _WIN32
+    ReencodeAnsiNames(connection, "dirs", "parent_id");
+    ReencodeAnsiNames(connection, "files", "dir_id");
+    ReencodeAnsiNames(connection, "paths", "dir_id");
+    connection.Execute("DELETE FROM path_search;");
+#else
+    static_cast<void>(connection);
+#endif
+}
+
+/**
+ * @brief Schema migration step applied to reach a specific version.
+ */
+struct SchemaMigration
+{
+    int targetVersion;                         /**< Version stored after the step completes */
+    void (*apply)(SQLiteConnection&);          /**< Step implementation, applied in one transaction */
+    const BatchedMigration* batched = nullptr; /**< Batched step used instead of apply, nullptr for none */
+};
+
+constexpr SchemaMigration SchemaMigrations[] = {
+    {1, &MigrateAddHashAlgorithm},
+    {2, &MigrateBinaryHash},
+    {3, &MigrateFileMetadata},
+    {4, &MigrateRunGeneration},
+    {5, &MigrateObjectReferences},
+    {6, &MigrateChunkIndex},
+    {7, &MigrateVersionHistory},
+    {8, &MigrateDirectoryTable},
+    {9, &MigrateRunRecords},
+    {10, &MigratePermissionMetadata},
+    {11, &MigrateDirectoryDigests},
+    {12, &MigrateVersionTimeIndex},
+    {13, &MigrateContentIndex},
+    {14, &MigrateStateSnapshot},
+    {15, &MigrateFileShards},
+    {16, &MigratePathSearch},
+    {17, &MigrateSampledChecks},
+    {18, nullptr, &CompactFileRowsMigration},
+    {19, &MigrateRunMembers},
+    {20, &MigrateColdSnapshots},
+    {21, &MigrateUtf8Names},
+};
+
+/**
+ * @brief Run part of a migration in its own write transaction, rolling it back on error.
+ *
+ * @param[in] connection Connection to migrate
+ * @param[in] body Work to commit
+ */
+void RunMigrationTransaction(SQLiteConnection& connection, const std::function<void()>& body)
+{
+    connection.Execute("BEGIN IMMEDIATE;");
+    try
+    {
+        body();
+        connection.Execute("COMMIT;");
+    }
+    catch (const std::runtime_error&)
+    {
+        connection.Execute("ROLLBACK;");
+        throw;
+    }
+}
+
+/**
+ * @brief Apply a batched migration step, resuming after the last batch an interrupted run committed.
+ *
+ * @param[in] connection Connection to migrate
+ * @param[in] targetVersion Version stored by the cutover
+ * @param[in] migration Step to apply
+ */
+void ApplyBatchedMigration(SQLiteConnection& connection, int targetVersion, const BatchedMigration& migration)
+{
+    RunMigrationTransaction(connection, [&]() {
+        connection.Execute(SqlCreateMigrationProgress);
+        migration.prepare(connection);
+        auto start = connection.Prepare("INSERT OR IGNORE INTO schema_migration_progress(target_version, dir_id, name) VALUES(?1, -1, '');");
+        start.BindInt64(1, targetVersion);
+        start.ExecuteStatement();
+    });
+
+    const std::string batchEndSql = std::string("SELECT dir_id, name FROM (SELECT dir_id, name FROM ") + migration.table +
+                                    " WHERE (dir_id, name) > (?1, ?2) ORDER BY dir_id, name LIMIT ?3) ORDER BY dir_id DESC, name DESC LIMIT 1;";
+    bool copied = false;
+    while (false == copied)
+    {
+        // Each batch ends its transaction, so other connections can write between batches.
+        RunMigrationTransaction(connection, [&]() {
+            auto progress = connection.Prepare("SELECT dir_id, name FROM schema_migration_progress WHERE target_version=?1;");
+            progress.BindInt64(1, targetVersion);
+            if (false == progress.FetchRow())
+            {
+                throw std::runtime_error("Missing migration progress");
+            }
+            const std::int64_t startDirectory = progress.ColumnInt64(0);
+            const std::string startName = progress.ColumnText(1);
+            progress.Reset();
+
+            auto batchEnd = connection.Prepare(batchEndSql);
+            batchEnd.BindInt64(1, startDirectory);
+            batchEnd.BindText(2, startName);
+            batchEnd.BindInt64(3, MigrationBatchRows);
+            if (false == batchEnd.FetchRow())
+            {
+                copied = true;
+                return;
+            }
+            const std::int64_t endDirectory = batchEnd.ColumnInt64(0);
+            const std::string endName = batchEnd.ColumnText(1);
+            batchEnd.Reset();
+
+            auto copyBatch = connection.Prepare(migration.copyBatch);
+            copyBatch.BindInt64(1, startDirectory);
+            copyBatch.BindText(2, startName);
+            copyBatch.BindInt64(3, endDirectory);
+            copyBatch.BindText(4, endName);
+            copyBatch.ExecuteStatement();
+            auto advance = connection.Prepare("UPDATE schema_migration_progress SET dir_id=?2, name=?3 WHERE target_version=?1;");
+            advance.BindInt64(1, targetVersion);
+            advance.BindInt64(2, endDirectory);
+            advance.BindText(3, endName);
+            advance.ExecuteStatement();
+        });
+    }
+
+    RunMigrationTransaction(connection, [&]() {
+        migration.cutover(connection);
+        connection.Execute("DROP TABLE schema_migration_progress;");
+        connection.Execute("PRAGMA user_version = " + std::to_string(targetVersion) + ";");
+    });
+}
+
+/**
+ * @brief Apply a single migration step and bump the stored version atomically.
+ *
+ * @param[in] connection Connection to migrate
+ * @param[in] migration Step to apply
+ */
+void ApplyMigration(SQLiteConnection& connection, const SchemaMigration& migration)
+{
+    if (nullptr != migration.batched)
+    {
+        ApplyBatchedMigration(connection, migration.targetVersion, *migration.batched);
+        return;
+    }
+    RunMigrationTransaction(connection, [&]() {
+        migration.apply(connection);
+        connection.Execute("PRAGMA user_version = " + std::to_string(migration.targetVersion) + ";");
+    });
+}
+
+/**
+ * @brief Bind a digest as a BLOB parameter.
+ *
+ * @param[in] statement Statement to bind
+ * @param[in] index 1-based parameter index
+ * @param[in] digest Digest to bind
+ */
+void BindDigest(SQLiteStatement& statement, int index, const HashDigest& digest)
+{
+    statement.BindBlob(index, digest.bytes.data(), digest.size);
+}
+
+/**
+ * @brief Decode the file state columns of the current row.
+ *
+ * Expects hash, status, last_updated, hash_algorithm, size, mtime_ns, inode, device, generation, mode, uid, gid, atime_ns,
+ * xattrs, digest_scheme, sample_digest and sampled_runs in that order.
+ *
+ * @param[in] statement Statement positioned on a row
+ * @param[in] firstColumn Index of the hash column
+ * @param[in] generation Generation of the current run, 0 before one began
+ * @param[out] outputRecord Decoded file state
+ * @return true if the row is well formed, false otherwise
+ */
+bool ReadFileStateColumns(const SQLiteStatement& statement, int firstColumn, std::int64_t generation, FileStateRecord& outputRecord)
+{
+    const SQLiteBlob hashBlob = statement.ColumnBlob(firstColumn);
+    ChangeType status{};
+    if (false == ReadStatusColumn(statement, firstColumn + 1, status))
+    {
+        return false;
+    }
+
+    HashDigest hash{};
+    if (false == HashDigest::FromBytes(hashBlob.data, hashBlob.size, hash))
+    {
+        return false;
+    }
+
+    HashAlgorithm hashAlgorithm{};
+    if (false == StringToHashAlgorithm(statement.ColumnView(firstColumn + 3), hashAlgorithm))
+    {
+        return false;
+    }
+
+    // An empty or malformed sample only costs the next sampled check a full hash.
+    const SQLiteBlob sampleBlob = statement.ColumnBlob(firstColumn + 15);
+    HashDigest sampleDigest{};
+    if (false == HashDigest::FromBytes(sampleBlob.data, sampleBlob.size, sampleDigest))
+    {
+        sampleDigest = HashDigest{};
+    }
+
+    // The record is only written once the row is known to be well formed, and its timestamp keeps its buffer across a scan.
+    outputRecord.hash = hash;
+    outputRecord.hashAlgorithm = hashAlgorithm;
+    outputRecord.status = status;
+    TimestampProvider::FormatWallClockSeconds(statement.ColumnInt64(firstColumn + 2), outputRecord.timestamp);
+    outputRecord.metadata.size = static_cast<std::uint64_t>(statement.ColumnInt64(firstColumn + 4));
+    outputRecord.metadata.modificationTimeNs = statement.ColumnInt64(firstColumn + 5);
+    outputRecord.metadata.inode = static_cast<std::uint64_t>(statement.ColumnInt64(firstColumn + 6));
+    outputRecord.metadata.device = static_cast<std::uint64_t>(statement.ColumnInt64(firstColumn + 7));
+    outputRecord.committedInRun = (0 != generation) && (generation == statement.ColumnInt64(firstColumn + 8));
+    outputRecord.metadata.mode = static_cast<std::uint32_t>(statement.ColumnInt64(firstColumn + 9));
+    outputRecord.metadata.userId = static_cast<std::uint32_t>(statement.ColumnInt64(firstColumn + 10));
+    outputRecord.metadata.groupId = static_cast<std::uint32_t>(statement.ColumnInt64(firstColumn + 11));
+    outputRecord.metadata.accessTimeNs = statement.ColumnInt64(firstColumn + 12);
+    const SQLiteBlob attributesBlob = statement.ColumnBlob(firstColumn + 13);
+    outputRecord.extendedAttributes.assign(static_cast<const char*>(attributesBlob.data), attributesBlob.size);
+    outputRecord.digestScheme = StringToDigestScheme(statement.ColumnView(firstColumn + 14));
+    outputRecord.sampleDigest = sampleDigest;
+    outputRecord.sampledRuns = static_cast<std::uint32_t>(statement.ColumnInt64(firstColumn + 16));
+    return true;
+}
+
+/**
+ * @brief Stream version rows through a callback.
+ *
+ * Expects dir_id, name, version, hash, hash_algorithm, size and snapshot name in that order. Malformed rows
+ * and rows of unknown directories are skipped.
+ *
+ * @param[in] statement Statement to step
+ * @param[in] directoryPaths Repository-relative paths of the directories the rows can refer to, keyed by id
+ * @param[in] onVersion Callback receiving each version, returns false to stop early
+ * @return true if every row was visited, false when stopped early
+ */
+bool ReadFileVersions(SQLiteStatement& statement, const std::unordered_map<std::int64_t, std::string>& directoryPaths,
+                      const std::function<bool(const FileVersionRecord&)>& onVersion)
+{
+    FileVersionRecord version{};
+    return statement.ForEachRow(
+        [&](const SQLiteStatement& row)
+        {
+            const auto directory = directoryPaths.find(row.ColumnInt64(0));
+            const std::string_view name = row.ColumnView(1);
+            const SQLiteBlob hashBlob = row.ColumnBlob(3);
+            if ((directoryPaths.end() == directory) || (true == name.empty()) ||
+                (false == HashDigest::FromBytes(hashBlob.data, hashBlob.size, version.hash)) ||
+                (false == StringToHashAlgorithm(row.ColumnView(4), version.hashAlgorithm)))
+            {
+                return true;
+            }
+            JoinPath(directory->second, name, version.path);
+            version.version.assign(row.ColumnView(2));
+            version.size = static_cast<std::uint64_t>(row.ColumnInt64(5));
+            version.snapshot.assign(row.ColumnView(6));
+            return onVersion(version);
+        });
+}
+
+/**
+ * @brief Look up the version of a file that was current at a point in time.
+ *
+ * @param[in] statement Cached lookup by path id and point in time
+ * @param[in] pathId Path id of the file
+ * @param[in] asOf Point in time, as in ForEachVersionAsOf
+ * @param[out] outputHash Digest of the version
+ * @param[out] outputAlgorithm Algorithm of the digest
+ * @return true if a version was current, false if the file did not exist then
+ */
+bool ReadVersionAsOf(SQLiteStatement& statement, std::int64_t pathId, const std::string& asOf, HashDigest& outputHash,
+                     HashAlgorithm& outputAlgorithm)
+{
+    statement.Reset();
+    statement.BindInt64(1, pathId);
+    statement.BindText(2, asOf);
+    bool found = false;
+    if (true == statement.FetchRow())
+    {
+        const SQLiteBlob hashBlob = statement.ColumnBlob(0);
+        found = (true == HashDigest::FromBytes(hashBlob.data, hashBlob.size, outputHash)) &&
+                (true == StringToHashAlgorithm(statement.ColumnView(1), outputAlgorithm));
+    }
+    statement.Reset();
+    return found;
+}
+
+/**
+ * @brief Check whether a path id is in a membership bitmap; ids past 32 bits are never stored in one.
+ *
+ * @param[in] members Membership bitmap of a run
+ * @param[in] pathId Path id to look up
+ * @return true if the path is a member
+ */
+bool IsRunMember(const PathIdBitmap& members, std::int64_t pathId)
+{
+    return (0 <= pathId) && (std::numeric_limits<std::uint32_t>::max() >= pathId) && (true == members.Contains(static_cast<std::uint32_t>(pathId)));
+}
+
+/**
+ * @brief Store the ids of the paths that have a current version as the membership bitmap of a run.
+ *
+ * A history whose path ids outgrew 32 bits stores no bitmap, which leaves the run to the version history queries.
+ *
+ * @param[in] connection Connection to write through
+ * @param[in] runId Run that just completed
+ * @return true on success, false on error
+ */
+bool RecordRunMembers(SQLiteConnection& connection, std::int64_t runId)
+{
+    PathIdBitmap members;
+    auto current = connection.Prepare("SELECT path_id FROM file_versions WHERE snapshot_id IS NULL ORDER BY path_id;");
+    if (false == current.ForEachRow(
+                     [&members](const SQLiteStatement& row)
+                     {
+                         const std::int64_t pathId = row.ColumnInt64(0);
+                         if ((0 > pathId) || (std::numeric_limits<std::uint32_t>::max() < pathId))
+                         {
+                             return false;
+                         }
+                         members.Add(static_cast<std::uint32_t>(pathId));
+                         return true;
+                     }))
+    {
+        return true;
+    }
+    const std::vector<std::uint8_t> live = members.Serialize();
+    auto insert = connection.Prepare("INSERT OR REPLACE INTO run_members(run_id, live) VALUES(?1, ?2);");
+    insert.BindInt64(1, runId);
+    insert.BindBlob(2, live.data(), live.size());
+    return insert.ExecuteStatement();
+}
+
+/**
+ * @brief Load the set of paths live at a point in time from the membership bitmap of the run it falls in.
+ *
+ * A point in time sees what the newest run started at or before it left current, so that run's bitmap
+ * answers for it. A run that is running, failed or abandoned left no complete picture and has no bitmap.
+ *
+ * @param[in] connection Connection to read through
+ * @param[in] asOf Point in time as a run timestamp
+ * @param[out] outputMembers Ids of the paths live at that time
+ * @return true if a bitmap answers for the time, false if the version history must be read instead
+ */
+bool LoadRunMembers(SQLiteConnection& connection, const std::string& asOf, PathIdBitmap& outputMembers)
+{
+    auto statement = connection.Prepare("SELECT runs.state, run_members.live FROM runs LEFT JOIN run_members ON run_members.run_id = runs.id "
+                                        "WHERE runs.started <= ?1 ORDER BY runs.started DESC, runs.id DESC LIMIT 1;");
+    statement.BindText(1, asOf);
+    if ((false == statement.FetchRow()) || (RunStateCompleted != statement.ColumnView(0)))
+    {
+        return false;
+    }
+    // A run completed before the bitmaps were recorded reads as an empty BLOB, which does not deserialize.
+    const SQLiteBlob live = statement.ColumnBlob(1);
+    return PathIdBitmap::Deserialize(static_cast<const std::uint8_t*>(live.data), live.size, outputMembers);
+}
+
+/**
+ * @brief Version removed by a prune, which the membership bitmaps of the runs it was live after must drop.
+ */
+struct PrunedVersion
+{
+    std::int64_t pathId;  /**< Path id of the version */
+    std::string version;  /**< Timestamp the version became current at */
+    std::string snapshot; /**< Name of the snapshot it was archived into */
+};
+
+/**
+ * @brief Drop pruned versions from the membership bitmaps of the runs they were live after.
+ *
+ * The version history no longer lists a pruned version at any time, so the bitmaps follow it and both
+ * answer alike.
+ *
+ * @param[in] connection Connection to write through, inside the prune's transaction
+ * @param[in] prunedVersions Versions the prune deleted
+ * @return true on success, false on error
+ */
+bool RemovePrunedRunMembers(SQLiteConnection& connection, const std::vector<PrunedVersion>& prunedVersions)
+{
+    if (true == prunedVersions.empty())
+    {
+        return true;
+    }
+    std::string latestSnapshot;
+    for (const PrunedVersion& pruned : prunedVersions)
+    {
+        latestSnapshot = std::max(latestSnapshot, pruned.snapshot);
+    }
+    std::vector<std::pair<std::int64_t, PathIdBitmap>> updatedMembers;
+    auto affected = connection.Prepare("SELECT run_members.run_id, runs.started, run_members.live FROM run_members "
+                                       "JOIN runs ON runs.id = run_members.run_id WHERE runs.started < ?1;");
+    affected.BindText(1, latestSnapshot);
+    while (true == affected.FetchRow())
+    {
+        const std::string started(affected.ColumnView(1));
+        PathIdBitmap removed;
+        for (const PrunedVersion& pruned : prunedVersions)
+        {
+            if ((pruned.version <= started) && (pruned.snapshot > started) && (0 <= pruned.pathId) &&
+                (std::numeric_limits<std::uint32_t>::max() >= pruned.pathId))
+            {
+                removed.Add(static_cast<std::uint32_t>(pruned.pathId));
+            }
+        }
+        const SQLiteBlob live = affected.ColumnBlob(2);
+        PathIdBitmap members;
+        if ((0 == removed.Cardinality()) ||
+            (false == PathIdBitmap::Deserialize(static_cast<const std::uint8_t*>(live.data), live.size, members)))
+        {
+            continue;
+        }
+        members.AndNot(removed);
+        updatedMembers.emplace_back(affected.ColumnInt64(0), std::move(members));
+    }
+    affected.Reset();
+    auto update = connection.Prepare("UPDATE run_members SET live=?2 WHERE run_id=?1;");
+    for (const auto& runMembers : updatedMembers)
+    {
+        const std::vector<std::uint8_t> live = runMembers.second.Serialize();
+        update.Reset();
+        update.BindInt64(1, runMembers.first);
+        update.BindBlob(2, live.data(), live.size());
+        if (false == update.ExecuteStatement())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief File row buffered from one page of a paged file scan.
+ */
+struct ScannedFileRow
+{
+    std::int64_t dirId; /**< Directory id of the file */
+    std::string name;   /**< File name within the directory */
+    ChangeType status;  /**< Stored change status */
+};
+
+/**
+ * @brief Scan file rows in primary key order, one page at a time.
+ *
+ * Each page is read into a reused buffer and its statement reset before the rows are visited, so memory
+ * stays bounded by the page size and the visitor may write through the same connection. Rows with an
+ * empty name or an unknown status are skipped.
+ *
+ * @param[in] connection Connection to read through
+ * @param[in] sql Query selecting dir_id, name and status of at most ?3 rows after the key (?1, ?2) in key order
+ * @param[in] bindFilter Binds the query's parameters after ?3, empty if it has none
+ * @param[in] onRow Visitor receiving each row, returns false to stop early
+ * @return true if every row was visited, false when stopped early
+ */
+bool ScanFilePages(SQLiteConnection& connection, const char* sql, const std::function<void(SQLiteStatement&)>& bindFilter,
+                   const std::function<bool(const ScannedFileRow&)>& onRow)
+{
+    auto statement = connection.PrepareCached(sql);
+    std::vector<ScannedFileRow> page(static_cast<std::size_t>(FileScanPageRows));
+    std::int64_t lastDirId = RootDirectoryId - 1;
+    std::string lastName;
+    while (true)
+    {
+        statement->BindInt64(1, lastDirId);
+        statement->BindText(2, lastName);
+        statement->BindInt64(3, FileScanPageRows);
+        if (bindFilter)
+        {
+            bindFilter(*statement);
+        }
+        std::int64_t fetched = 0;
+        std::size_t buffered = 0;
+        statement->ForEachRow(
+            [&](const SQLiteStatement& row)
+            {
+                ++fetched;
+                lastDirId = row.ColumnInt64(0);
+                lastName.assign(row.ColumnView(1));
+                ChangeType status{};
+                if ((false == lastName.empty()) && (true == ReadStatusColumn(row, 2, status)))
+                {
+                    ScannedFileRow& buffer = page[buffered++];
+                    buffer.dirId = lastDirId;
+                    buffer.name.assign(lastName);
+                    buffer.status = status;
+                }
+                return true;
+            });
+        statement->Reset();
+
+        for (std::size_t index = 0; index < buffered; ++index)
+        {
+            if (false == onRow(page[index]))
+            {
+                return false;
+            }
+        }
+        if (fetched < FileScanPageRows)
+        {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief Order file states by directory and then by name, the order of the files table's key within a directory.
+ *
+ * @param[in] first File state compared
+ * @param[in] second File state compared with
+ * @return true if first comes before second
+ */
+bool IsBeforeInKeyOrder(const FileStateUpdate& first, const FileStateUpdate& second)
+{
+    const std::string_view firstPath = first.path;
+    const std::string_view secondPath = second.path;
+    const std::size_t firstSplit = firstPath.find_last_of(PathSeparators);
+    const std::size_t secondSplit = secondPath.find_last_of(PathSeparators);
+    const std::string_view firstDirectory = (std::string_view::npos == firstSplit) ? std::string_view() : firstPath.substr(0, firstSplit);
+    const std::string_view secondDirectory = (std::string_view::npos == secondSplit) ? std::string_view() : secondPath.substr(0, secondSplit);
+    if (firstDirectory != secondDirectory)
+    {
+        return firstDirectory < secondDirectory;
+    }
+    return firstPath.substr(firstSplit + 1) < secondPath.substr(secondSplit + 1);
+}
+
+/**
+ * @brief Sort a batch into key order for a bulk import, which appends rows without a conflict clause.
+ *
+ * @param[in] updates File states of one batch
+ * @return The file states in strictly ascending key order; a file stored twice keeps its later state, as an upsert would
+ */
+std::vector<FileStateUpdate> SortForAppend(const std::vector<FileStateUpdate>& updates)
+{
+    std::vector<FileStateUpdate> sorted(updates);
+    std::stable_sort(sorted.begin(), sorted.end(), IsBeforeInKeyOrder);
+    std::vector<FileStateUpdate> unique;
+    unique.reserve(sorted.size());
+    for (auto& update : sorted)
+    {
+        if ((false == unique.empty()) && (unique.back().path == update.path))
+        {
+            unique.back() = std::move(update);
+            continue;
+        }
+        unique.push_back(std::move(update));
+    }
+    return unique;
+}
+
+/**
+ * @brief Insert or update one file state using the connection's cached upsert statement.
+ *
+ * @param[in] connection Connection to write through
+ * @param[in] key Directory id and name of the file
+ * @param[in] record File state to store
+ * @param[in] generation Run generation that saw the file
+ * @param[in] append Insert without a conflict clause, as a bulk import does; fails if the file has a row
+ * @return true on success, false on error
+ */
+bool UpsertFileState(SQLiteConnection& connection, const FileKey& key, const FileStateRecord& record, std::int64_t generation, bool append)
+{
+    std::int64_t lastUpdated = 0;
+    if (false == TimestampProvider::ParseWallClockSeconds(record.timestamp, lastUpdated))
+    {
+        return false;
+    }
+    auto cachedStatement = connection.PrepareCached((true == append) ? SqlAppendFileState : SqlUpsertFileState);
+    SQLiteStatement& statement = *cachedStatement;
+
+    statement.BindInt64(1, key.dirId);
+    statement.BindText(2, key.name);
+    BindDigest(statement, 3, record.hash);
+    statement.BindInt64(4, static_cast<std::int64_t>(record.status));
+    statement.BindInt64(5, lastUpdated);
+    statement.BindText(6, HashAlgorithmToString(record.hashAlgorithm));
+    statement.BindInt64(7, static_cast<std::int64_t>(record.metadata.size));
+    statement.BindInt64(8, record.metadata.modificationTimeNs);
+    statement.BindInt64(9, static_cast<std::int64_t>(record.metadata.inode));
+    statement.BindInt64(10, static_cast<std::int64_t>(record.metadata.device));
+    statement.BindInt64(11, generation);
+    statement.BindInt64(12, static_cast<std::int64_t>(record.metadata.mode));
+    statement.BindInt64(13, static_cast<std::int64_t>(record.metadata.userId));
+    statement.BindInt64(14, static_cast<std::int64_t>(record.metadata.groupId));
+    statement.BindInt64(15, record.metadata.accessTimeNs);
+    statement.BindBlob(16, record.extendedAttributes.data(), record.extendedAttributes.size());
+    statement.BindText(17, DigestSchemeToString(record.digestScheme));
+    BindDigest(statement, 18, record.sampleDigest);
+    statement.BindInt64(19, static_cast<std::int64_t>(record.sampledRuns));
+
+    return SQLiteStepResult::Done == statement.TryStep();
+}
+
+/**
+ * @brief Add one reference to a content object, recording the object on first use.
+ *
+ * @param[in] connection Connection to write through
+ * @param[in] record File state whose content is referenced
+ * @return true on success, false on error
+ */
+bool AddObjectReference(SQLiteConnection& connection, const FileStateRecord& record)
+{
+    auto cachedStatement = connection.PrepareCached("INSERT INTO objects(digest, size, refcount) VALUES(?1, ?2, 1) "
+                                                    "ON CONFLICT(digest) DO UPDATE SET refcount=refcount+1;");
+    SQLiteStatement& statement = *cachedStatement;
+
+    BindDigest(statement, 1, record.hash);
+    statement.BindInt64(2, static_cast<std::int64_t>(record.metadata.size));
+
+    return SQLiteStepResult::Done == statement.TryStep();
+}
+
+/**
+ * @brief Check whether a stored file state starts a new version of its file.
+ */
+bool IsNewVersion(const FileStateRecord& record)
+{
+    return (ChangeType::Added == record.status) || (ChangeType::Modified == record.status);
+}
+
+/**
+ * @brief Get the id of a file in the paths table, adding the file on first use.
+ *
+ * @param[in] connection Connection to write through
+ * @param[in] key Directory id and name of the file
+ * @param[out] outputId Path id
+ * @return true on success, false on error
+ */
+bool InternPath(SQLiteConnection& connection, const FileKey& key, std::int64_t& outputId)
+{
+    auto insertStatement = connection.PrepareCached("INSERT OR IGNORE INTO paths(dir_id, name) VALUES(?1, ?2);");
+    insertStatement->BindInt64(1, key.dirId);
+    insertStatement->BindText(2, key.name);
+    if (SQLiteStepResult::Done != insertStatement->TryStep())
+    {
+        return false;
+    }
+    auto selectStatement = connection.PrepareCached("SELECT id FROM paths WHERE dir_id=?1 AND name=?2;");
+    selectStatement->BindInt64(1, key.dirId);
+    selectStatement->BindText(2, key.name);
+    if (SQLiteStepResult::Row != selectStatement->TryStep())
+    {
+        return false;
+    }
+    outputId = selectStatement->ColumnInt64(0);
+    return true;
+}
+
+/**
+ * @brief Record that the current version of a file moved into the snapshot of a run.
+ *
+ * @param[in] connection Connection to write through
+ * @param[in] pathId Path id of the file
+ * @param[in] generation Run generation, which is also the id of its snapshot
+ * @return true on success, false on error
+ */
+bool ArchiveCurrentVersion(SQLiteConnection& connection, std::int64_t pathId, std::int64_t generation)
+{
+    auto cachedStatement = connection.PrepareCached("UPDATE file_versions SET snapshot_id=?1 WHERE path_id=?2 AND snapshot_id IS NULL;");
+    SQLiteStatement& statement = *cachedStatement;
+    statement.BindInt64(1, generation);
+    statement.BindInt64(2, pathId);
+    return SQLiteStepResult::Done == statement.TryStep();
+}
+
+/**
+ * @brief Add a new current version of a file, archiving the previous one when the file was modified.
+ *
+ * A current version added earlier by the same run, before it was interrupted and resumed, carries the run's
+ * timestamp. It was never part of a snapshot, so the new version replaces it instead of archiving it.
+ *
+ * @param[in] connection Connection to write through
+ * @param[in] key Directory id and name of the file
+ * @param[in] record Added or modified file state
+ * @param[in] generation Run generation that saw the file
+ * @return true on success, false on error
+ */
+bool AddFileVersion(SQLiteConnection& connection, const FileKey& key, const FileStateRecord& record, std::int64_t generation)
+{
+    std::int64_t pathId = 0;
+    if (false == InternPath(connection, key, pathId))
+    {
+        return false;
+    }
+    auto supersededStatement = connection.PrepareCached("DELETE FROM file_versions WHERE path_id=?1 AND snapshot_id IS NULL AND version=?2;");
+    supersededStatement->BindInt64(1, pathId);
+    supersededStatement->BindText(2, record.timestamp);
+    if ((SQLiteStepResult::Done != supersededStatement->TryStep()) ||
+        ((ChangeType::Modified == record.status) && (false == ArchiveCurrentVersion(connection, pathId, generation))))
+    {
+        return false;
+    }
+    auto cachedStatement = connection.PrepareCached("INSERT INTO file_versions(path_id, version, hash, hash_algorithm, size, snapshot_id) "
+                                                    "VALUES(?1, ?2, ?3, ?4, ?5, NULL);");
+    SQLiteStatement& statement = *cachedStatement;
+    statement.BindInt64(1, pathId);
+    statement.BindText(2, record.timestamp);
+    BindDigest(statement, 3, record.hash);
+    statement.BindText(4, HashAlgorithmToString(record.hashAlgorithm));
+    statement.BindInt64(5, static_cast<std::int64_t>(record.metadata.size));
+    return SQLiteStepResult::Done == statement.TryStep();
+}
+
+/**
+ * @brief Upsert a file state and, when counting references, reference its object if it is a new version.
+ *
+ * New versions are also added to the version history.
+ *
+ * @param[in] connection Connection to write through
+ * @param[in] key Directory id and name of the file
+ * @param[in] record File state to store
+ * @param[in] generation Run generation that saw the file
+ * @param[in] countObjectReferences Whether object references are counted
+ * @param[in] append Insert the file row without a conflict clause, as a bulk import does
+ * @return true on success, false on error
+ */
+bool StoreFileState(SQLiteConnection& connection, const FileKey& key, const FileStateRecord& record, std::int64_t generation,
+                    bool countObjectReferences, bool append)
+{
+    if (false == UpsertFileState(connection, key, record, generation, append))
+    {
+        return false;
+    }
+    if (false == IsNewVersion(record))
+    {
+        return true;
+    }
+    return (true == AddFileVersion(connection, key, record, generation)) &&
+           ((false == countObjectReferences) || (true == AddObjectReference(connection, record)));
+}
+
+/**
+ * @brief Mark one file row as deleted.
+ *
+ * @param[in] connection Connection to write through
+ * @param[in] key Directory id and name of the file
+ * @param[in] deletedAt Time of the deletion, as encoded by TimestampProvider::ParseWallClockSeconds
+ * @return true on success, false on error
+ */
+bool MarkFileRowDeleted(SQLiteConnection& connection, const FileKey& key, std::int64_t deletedAt)
+{
+    auto cachedStatement = connection.PrepareCached("UPDATE files SET status=?1, last_updated=?2 WHERE dir_id=?3 AND name=?4;");
+    SQLiteStatement& statement = *cachedStatement;
+
+    statement.BindInt64(1, DeletedStatus);
+    statement.BindInt64(2, deletedAt);
+    statement.BindInt64(3, key.dirId);
+    statement.BindText(4, key.name);
+    return SQLiteStepResult::Done == statement.TryStep();
+}
+
+/**
+ * @brief Delete the rows of files deleted before a cutoff, counting them in the same transaction.
+ *
+ * @param[in] connection Connection to the database holding the rows
+ * @param[in] cutoffTimestamp Rows deleted before this time are removed
+ * @param[out] outputPurged Number of rows removed
+ * @return true on success, false on error
+ * @throws std::runtime_error on SQLite errors
+ */
+bool PurgeDeletedRows(SQLiteConnection& connection, const std::string& cutoffTimestamp, std::uint64_t& outputPurged)
+{
+    outputPurged = 0;
+    std::int64_t cutoff = 0;
+    if (false == TimestampProvider::ParseWallClockSeconds(cutoffTimestamp, cutoff))
+    {
+        return false;
+    }
+    // The count must describe exactly the rows deleted.
+    connection.Execute("BEGIN IMMEDIATE;");
+    try
+    {
+        auto countRows = connection.Prepare("SELECT COUNT(*) FROM files WHERE status=?1 AND last_updated<?2;");
+        countRows.BindInt64(1, DeletedStatus);
+        countRows.BindInt64(2, cutoff);
+        if (true == countRows.FetchRow())
+        {
+            outputPurged = static_cast<std::uint64_t>(countRows.ColumnInt64(0));
+        }
+        countRows.Reset();
+        auto deleteRows = connection.Prepare("DELETE FROM files WHERE status=?1 AND last_updated<?2;");
+        deleteRows.BindInt64(1, DeletedStatus);
+        deleteRows.BindInt64(2, cutoff);
+        if (false == deleteRows.ExecuteStatement())
+        {
+            connection.Execute("ROLLBACK;");
+            outputPurged = 0;
+            return false;
+        }
+        connection.Execute("COMMIT;");
+    }
+    catch (const std::runtime_error&)
+    {
+        connection.Execute("ROLLBACK;");
+        outputPurged = 0;
+        throw;
+    }
+    return true;
+}
+
+/**
+ * @brief Run a write transaction, rolling it back when the body fails.
+ *
+ * @param[in] connection Connection to write through
+ * @param[in] body Writes of the transaction, returns false to roll back
+ * @return true if the transaction committed, false if it could not start or was rolled back
+ * @throws std::runtime_error on SQLite errors the body throws, after rolling back
+ */
+bool RunInTransaction(SQLiteConnection& connection, const std::function<bool()>& body)
+{
+    // A write lock still held elsewhere past the busy timeout is the common failure, so it costs no exception.
+    if (SQLiteStepResult::Done != connection.PrepareCached("BEGIN IMMEDIATE;")->TryStep())
+    {
+        return false;
+    }
+    try
+    {
+        if ((true == body()) && (SQLiteStepResult::Done == connection.PrepareCached("COMMIT;")->TryStep()))
+        {
+            return true;
+        }
+        connection.Execute("ROLLBACK;");
+        return false;
+    }
+    catch (const std::runtime_error&)
+    {
+        connection.Execute("ROLLBACK;");
+        throw;
+    }
+}
+
+/**
+ * @brief Get the schema name a shard is attached under.
+ */
+std::string ShardSchemaName(std::size_t shard)
+{
+    return "shard" + std::to_string(shard);
+}
+
+/**
+ * @brief Pick the shard of the files of a directory from the hash of its top-level directory.
+ *
+ * Files directly in the source root share the shard of the empty name.
+ *
+ * @param[in] directoryPath Repository-relative directory path
+ * @param[in] shardCount Number of shards
+ * @return Shard index below shardCount
+ */
+std::size_t ShardOfDirectory(const std::string& directoryPath, std::size_t shardCount)
+{
+    const std::size_t separator = directoryPath.find_first_of(PathSeparators);
+    const std::size_t length = (std::string::npos == separator) ? directoryPath.size() : separator;
+    return static_cast<std::size_t>(XXH3_64bits(directoryPath.data(), length) % shardCount);
+}
+
+/**
+ * @brief Read how many databases hold the file rows.
+ *
+ * @param[in] connection Connection to the main database
+ * @return Recorded shard count, 1 if none is recorded or the database predates shards
+ */
+std::size_t ReadShardCount(SQLiteConnection& connection)
+{
+    {
+        auto table = connection.Prepare("SELECT 1 FROM sqlite_master WHERE type='table' AND name='file_shards';");
+        if (false == table.FetchRow())
+        {
+            return 1;
+        }
+    }
+    auto statement = connection.Prepare("SELECT count FROM file_shards WHERE id=1;");
+    return (true == statement.FetchRow()) ? static_cast<std::size_t>(std::max<std::int64_t>(1, statement.ColumnInt64(0))) : 1;
+}
+
+/**
+ * @brief Record how many databases hold the file rows.
+ *
+ * @param[in] connection Connection to the main database, inside a transaction
+ * @param[in] shardCount Shard count, 1 for the main database alone
+ * @return true on success, false on error
+ */
+bool WriteShardCount(SQLiteConnection& connection, std::size_t shardCount)
+{
+    auto statement = connection.Prepare("INSERT OR REPLACE INTO file_shards (id, count) VALUES (1, ?1);");
+    statement.BindInt64(1, static_cast<std::int64_t>(shardCount));
+    return statement.ExecuteStatement();
+}
+
+/**
+ * @brief Delete a shard database together with its WAL and shared-memory files.
+ *
+ * @param[in] shardPath Shard database file
+ */
+void RemoveShardFiles(const std::filesystem::path& shardPath)
+{
+    std::error_code ec;
+    for (const char* suffix : {"", "-wal", "-shm"})
+    {
+        std::filesystem::path path = shardPath;
+        path += suffix;
+        std::filesystem::remove(path, ec);
+    }
+}
+
+/**
+ * @brief Create the tables and triggers of a shard database.
+ *
+ * @param[in] connection Connection to the shard
+ * @return true if stored names were re-encoded, which moves files between shards, false otherwise
+ */
+bool CreateShardSchema(SQLiteConnection& connection)
+{
+    // Shards written before schema version 18 still hold text statuses and timestamps.
+    auto textStatus = connection.Prepare("SELECT 1 FROM pragma_table_info('files') WHERE name='status' AND type='TEXT';");
+    const bool compact = textStatus.FetchRow();
+    textStatus.Reset();
+    if (true == compact)
+    {
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            CompactFileRows(connection);
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+    }
+    connection.Execute(std::string("CREATE TABLE IF NOT EXISTS files") + SqlFilesColumns);
+    connection.Execute(SqlCreateContentIndex);
+    std::vector<std::string> outdatedTriggers;
+    auto statement = connection.Prepare("SELECT name FROM sqlite_master WHERE type='trigger' AND sql LIKE '%OR IGNORE INTO stale_dirs%';");
+    while (true == statement.FetchRow())
+    {
+        outdatedTriggers.emplace_back(statement.ColumnView(0));
+    }
+    statement.Reset();
+    for (const auto& trigger : outdatedTriggers)
+    {
+        connection.Execute("DROP TRIGGER " + trigger + ";");
+    }
+    connection.Execute(SqlCreateShardTables);
+
+    // Shards written before schema version 21 hold the names of a Windows build in the ANSI code page.
+    std::int64_t renamed = 0;
+    if (Utf8NamesSchemaVersion > ReadSchemaVersion(connection))
+    {
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+#ifdef _WIN32
+            renamed = ReencodeAnsiNames(connection, "files", "dir_id");
+#endif
+            connection.Execute("PRAGMA user_version = " + std::to_string(Utf8NamesSchemaVersion) + ";");
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+    }
+    return 0 != renamed;
+}
+}
+
+FileStateRepository::FileStateRepository(SQLiteSession& databaseSession)
+    : _databaseSession(databaseSession), _generation(0), _countObjectReferences(false), _bulkImport(false)
+{
+}
+
+FileStateRepository::~FileStateRepository()
+{
+    if (true == _shardSessions.empty())
+    {
+        return;
+    }
+    // The shards' own sessions close last, so their final connection checkpoints and removes the WAL.
+    const std::vector<std::unique_ptr<SQLiteSession>> shardSessions = std::move(_shardSessions);
+    _shardSessions.clear();
+    try
+    {
+        AttachShards();
+    }
+    catch (const std::runtime_error&)
+    {
+        // A connection still attached only leaves the shard's WAL behind for the next open.
+    }
+}
+
+bool FileStateRepository::InitializeSchema()
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        int schemaVersion = ReadSchemaVersion(connection);
+
+        if ((0 == schemaVersion) && (false == FilesTableExists(connection)))
+        {
+            connection.Execute(SqlCreateDirsTable);
+            connection.Execute(std::string("CREATE TABLE IF NOT EXISTS files") + SqlFilesColumns);
+            connection.Execute(SqlCreateObjectsTable);
+            connection.Execute(SqlCreateChunksTable);
+            connection.Execute(std::string("CREATE TABLE IF NOT EXISTS paths") + SqlPathsColumns);
+            CreateVersionHistory(connection);
+            connection.Execute(SqlCreateRunsTable);
+            connection.Execute(SqlCreateRunMembersTable);
+            connection.Execute(SqlCreateColdSnapshotsTable);
+            connection.Execute(SqlCreateDirectoryDigests);
+            connection.Execute(SqlCreateContentIndex);
+            connection.Execute(SqlCreateStateSnapshot);
+            connection.Execute(SqlCreateFileShards);
+            connection.Execute(SqlCreatePathSearch);
+            connection.Execute("PRAGMA user_version = " + std::to_string(CurrentSchemaVersion) + ";");
+            return true;
+        }
+
+        if (CurrentSchemaVersion < schemaVersion)
+        {
+            return false;
+        }
+
+        for (const auto& migration : SchemaMigrations)
+        {
+            if (schemaVersion < migration.targetVersion)
+            {
+                ApplyMigration(connection, migration);
+                schemaVersion = migration.targetVersion;
+            }
+        }
+        // A bulk import interrupted before its end left its deferred indexes dropped.
+        connection.Execute(SqlCreateVersionIndexes);
+        connection.Execute(SqlCreateContentIndex);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+    return OpenShards();
+}
+
+bool FileStateRepository::OpenShards()
+{
+    try
+    {
+        const std::size_t shardCount = ReadShardCount(_databaseSession.Acquire());
+        if (ShardCount() == shardCount)
+        {
+            return true;
+        }
+        std::vector<std::unique_ptr<SQLiteSession>> shardSessions;
+        bool renamed = false;
+        for (std::size_t shard = 0; (1 < shardCount) && (shard < shardCount); ++shard)
+        {
+            // Opening a missing shard would create it empty and lose its rows silently.
+            std::error_code ec;
+            if (false == std::filesystem::is_regular_file(ShardPath(shard), ec))
+            {
+                return false;
+            }
+            shardSessions.push_back(std::make_unique<SQLiteSession>(ShardPath(shard), _databaseSession.Profile(), SQLiteSession::DefaultMaxConnections,
+                                                                    _databaseSession.OpenMode()));
+            if (SQLiteOpenMode::ReadWrite == _databaseSession.OpenMode())
+            {
+                renamed = (true == CreateShardSchema(shardSessions.back()->Acquire())) || (true == renamed);
+            }
+        }
+        _shardSessions = std::move(shardSessions);
+        AttachShards();
+        // A renamed top-level directory hashes to another shard, so the files are dealt out again.
+        return (false == renamed) || ((true == SetShardCount(1)) && (true == SetShardCount(shardCount)));
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::SetShardCount(std::size_t shardCount)
+{
+    if ((0 == shardCount) || (ShardCount() == shardCount))
+    {
+        return true;
+    }
+    if (MaxShards < shardCount)
+    {
+        return false;
+    }
+
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        const std::size_t previousCount = ShardCount();
+        if (1 < previousCount)
+        {
+            _shardSessions.clear();
+            AttachShards();
+            for (std::size_t shard = 0; shard < previousCount; ++shard)
+            {
+                auto attach = connection.Prepare("ATTACH DATABASE ?1 AS " + ShardSchemaName(shard) + ";");
+                attach.BindText(1, ShardPath(shard).string());
+                attach.ExecuteStatement();
+            }
+            const bool merged = RunInTransaction(connection,
+                                                 [&]()
+                                                 {
+                                                     for (std::size_t shard = 0; shard < previousCount; ++shard)
+                                                     {
+                                                         connection.Execute("INSERT OR REPLACE INTO main.files SELECT * FROM " + ShardSchemaName(shard) +
+                                                                            ".files;");
+                                                     }
+                                                     return WriteShardCount(connection, 1);
+                                                 });
+            connection.DetachAll();
+            if (false == merged)
+            {
+                return false;
+            }
+            for (std::size_t shard = 0; shard < previousCount; ++shard)
+            {
+                RemoveShardFiles(ShardPath(shard));
+            }
+        }
+        if (1 == shardCount)
+        {
+            return true;
+        }
+
+        std::unordered_map<std::int64_t, std::string> directoryPaths;
+        LoadDirectoryPaths(connection, directoryPaths);
+        std::vector<std::unique_ptr<SQLiteSession>> shardSessions;
+        std::uint64_t shardedRows = 0;
+        for (std::size_t shard = 0; shard < shardCount; ++shard)
+        {
+            // A shard left by an interrupted change holds rows the main database still has.
+            RemoveShardFiles(ShardPath(shard));
+            shardSessions.push_back(std::make_unique<SQLiteSession>(ShardPath(shard), _databaseSession.Profile()));
+            auto& shardConnection = shardSessions.back()->Acquire();
+            CreateShardSchema(shardConnection);
+            // The shard copies its rows from a read-only view of the main database, which stays untouched until every shard is filled.
+            shardConnection.AttachReadOnly(_databaseSession.DatabasePath(), "source");
+            shardConnection.Execute("CREATE TEMP TABLE shard_dirs (dir_id INTEGER PRIMARY KEY);");
+            const bool filled = RunInTransaction(shardConnection,
+                                                 [&]()
+                                                 {
+                                                     auto addDirectory = shardConnection.Prepare("INSERT INTO temp.shard_dirs (dir_id) VALUES (?1);");
+                                                     for (const auto& directory : directoryPaths)
+                                                     {
+                                                         if (shard == ShardOfDirectory(directory.second, shardCount))
+                                                         {
+                                                             addDirectory.Reset();
+                                                             addDirectory.BindInt64(1, directory.first);
+                                                             addDirectory.ExecuteStatement();
+                                                         }
+                                                     }
+                                                     shardConnection.Execute("INSERT INTO files SELECT * FROM source.files "
+                                                                             "WHERE dir_id IN (SELECT dir_id FROM temp.shard_dirs);"
+                                                                             "DELETE FROM stale_dirs;");
+                                                     return true;
+                                                 });
+            shardConnection.Execute("DROP TABLE temp.shard_dirs;");
+            shardConnection.DetachAll();
+            auto countRows = shardConnection.Prepare("SELECT COUNT(*) FROM files;");
+            if ((false == filled) || (false == countRows.FetchRow()))
+            {
+                return false;
+            }
+            shardedRows += static_cast<std::uint64_t>(countRows.ColumnInt64(0));
+        }
+
+        // Rows of a directory the dirs table lacks would be lost, so the change only commits when every row found a shard.
+        const bool moved = RunInTransaction(connection,
+                                            [&]()
+                                            {
+                                                auto countRows = connection.Prepare("SELECT COUNT(*) FROM main.files;");
+                                                if ((false == countRows.FetchRow()) || (shardedRows != static_cast<std::uint64_t>(countRows.ColumnInt64(0))))
+                                                {
+                                                    return false;
+                                                }
+                                                countRows.Reset();
+                                                connection.Execute("DELETE FROM main.files;");
+                                                return WriteShardCount(connection, shardCount);
+                                            });
+        if (false == moved)
+        {
+            return false;
+        }
+        _shardSessions = std::move(shardSessions);
+        AttachShards();
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+std::size_t FileStateRepository::ShardCount() const
+{
+    return std::max<std::size_t>(1, _shardSessions.size());
+}
+
+bool FileStateRepository::UpdateFileState(const std::string& filePath, const FileStateRecord& record)
+{
+    RDEMO_SCOPE("state.update");
+    const CommitProbe probe(1);
+    if (false == _shardSessions.empty())
+    {
+        return UpdateShardedFileStates({FileStateUpdate{filePath, record}});
+    }
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        FileKey key{};
+        if ((false == _countObjectReferences) && (false == IsNewVersion(record)))
+        {
+            return (true == ResolveFileKey(connection, filePath, true, nullptr, key)) && (true == UpsertFileState(connection, key, record, _generation, _bulkImport));
+        }
+
+        // The file row, its version history and its object reference must not diverge.
+        DirectoryIds addedDirectories;
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            if ((false == ResolveFileKey(connection, filePath, true, &addedDirectories, key)) ||
+                (false == StoreFileState(connection, key, record, _generation, _countObjectReferences, _bulkImport)))
+            {
+                connection.Execute("ROLLBACK;");
+                return false;
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        PublishDirectories(addedDirectories);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::UpdateFileStates(const std::vector<FileStateUpdate>& updates)
+{
+    RDEMO_SCOPE("state.update.batch");
+    RDEMO_COUNT("state.update.batch.files", updates.size());
+    if (true == updates.empty())
+    {
+        return true;
+    }
+    // Rows appended in key order fill B-tree pages left to right instead of splitting pages all over the table.
+    const auto outOfOrder = [](const FileStateUpdate& first, const FileStateUpdate& second) { return false == IsBeforeInKeyOrder(first, second); };
+    if ((true == _bulkImport) && (updates.end() != std::adjacent_find(updates.begin(), updates.end(), outOfOrder)))
+    {
+        return UpdateFileStates(SortForAppend(updates));
+    }
+    const CommitProbe probe(updates.size());
+    if (false == _shardSessions.empty())
+    {
+        return UpdateShardedFileStates(updates);
+    }
+
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        DirectoryIds addedDirectories;
+        FileKey key{};
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            for (const auto& update : updates)
+            {
+                if ((false == ResolveFileKey(connection, update.path, true, &addedDirectories, key)) ||
+                    (false == StoreFileState(connection, key, update.record, _generation, _countObjectReferences, _bulkImport)))
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        PublishDirectories(addedDirectories);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::GetFileState(const std::string& filePath, FileStateRecord& outputRecord)
+{
+    RDEMO_SCOPE("state.get");
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        FileKey key{};
+        if (false == ResolveFileKey(connection, filePath, false, nullptr, key))
+        {
+            return false;
+        }
+
+        auto cachedStatement = connection.PrepareCached(
+            "SELECT hash, status, last_updated, hash_algorithm, size, mtime_ns, inode, device, generation, mode, uid, gid, atime_ns, xattrs, "
+            "digest_scheme, sample_digest, sampled_runs FROM files WHERE dir_id=?1 AND name=?2;");
+        SQLiteStatement& statement = *cachedStatement;
+
+        statement.BindInt64(1, key.dirId);
+        statement.BindText(2, key.name);
+
+        if (SQLiteStepResult::Row != statement.TryStep())
+        {
+            return false;
+        }
+
+        return ReadFileStateColumns(statement, 0, _generation, outputRecord);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::ForEachFileState(const std::function<bool(const std::string&, const FileStateRecord&)>& onRecord)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::unordered_map<std::int64_t, std::string> directoryPaths;
+        LoadDirectoryPaths(connection, directoryPaths);
+        auto statement =
+            connection.Prepare("SELECT dir_id, name, hash, status, last_updated, hash_algorithm, size, mtime_ns, inode, device, generation, "
+                               "mode, uid, gid, atime_ns, xattrs, digest_scheme, sample_digest, sampled_runs FROM files;");
+
+        FileStateRecord record{};
+        std::string filePath;
+        return statement.ForEachRow(
+            [&](const SQLiteStatement& row)
+            {
+                const auto directory = directoryPaths.find(row.ColumnInt64(0));
+                const std::string_view nameText = row.ColumnView(1);
+                if ((directoryPaths.end() == directory) || (true == nameText.empty()) || (false == ReadFileStateColumns(row, 2, _generation, record)))
+                {
+                    return true;
+                }
+                JoinPath(directory->second, nameText, filePath);
+                return onRecord(filePath, record);
+            });
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::CountFiles(std::uint64_t& outputCount)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT COUNT(*) FROM files;");
+        if (false == statement.FetchRow())
+        {
+            return false;
+        }
+        outputCount = static_cast<std::uint64_t>(statement.ColumnInt64(0));
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::HasFileStates(bool& outputHas)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT 1 FROM files LIMIT 1;");
+        outputHas = statement.FetchRow();
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::BeginBulkImport()
+{
+    try
+    {
+        _databaseSession.Acquire().Execute(SqlDropDeferredIndexes);
+        for (auto& shardSession : _shardSessions)
+        {
+            shardSession->Acquire().Execute("DROP INDEX IF EXISTS files_by_size_hash;");
+            shardSession->SetSyncDeferred(true);
+        }
+        _bulkImport = true;
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::FinishBulkImport()
+{
+    _bulkImport = false;
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute(SqlCreateVersionIndexes);
+        // Qualified, since an unqualified files is the temporary view over the shards, which cannot be indexed.
+        connection.Execute("CREATE INDEX IF NOT EXISTS main.files_by_size_hash ON files(size, hash);");
+        for (auto& shardSession : _shardSessions)
+        {
+            shardSession->Acquire().Execute(SqlCreateContentIndex);
+            shardSession->SetSyncDeferred(false);
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::ReadStateSnapshotToken(std::uint64_t& outputToken)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT token FROM state_snapshot WHERE id=1;");
+        if (false == statement.FetchRow())
+        {
+            return false;
+        }
+        outputToken = static_cast<std::uint64_t>(statement.ColumnInt64(0));
+        // Each shard drops its own copy when its rows change, so every copy must still be there.
+        for (std::size_t shard = 0; shard < _shardSessions.size(); ++shard)
+        {
+            auto shardToken = connection.Prepare("SELECT token FROM " + ShardSchemaName(shard) + ".state_snapshot WHERE id=1;");
+            if ((false == shardToken.FetchRow()) || (outputToken != static_cast<std::uint64_t>(shardToken.ColumnInt64(0))))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::WriteStateSnapshotToken(std::uint64_t token)
+{
+    try
+    {
+        // The main database vouches for the file last, once every shard holds the token.
+        for (const auto& shardSession : _shardSessions)
+        {
+            auto shardStatement = shardSession->Acquire().Prepare(SqlWriteStateSnapshotToken);
+            shardStatement.BindInt64(1, static_cast<std::int64_t>(token));
+            if (false == shardStatement.ExecuteStatement())
+            {
+                return false;
+            }
+        }
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare(SqlWriteStateSnapshotToken);
+        statement.BindInt64(1, static_cast<std::int64_t>(token));
+        return statement.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::ForEachFilePath(const std::function<bool(const std::string&)>& onPath)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::unordered_map<std::int64_t, std::string> directoryPaths;
+        LoadDirectoryPaths(connection, directoryPaths);
+        auto statement = connection.Prepare("SELECT dir_id, name FROM files;");
+
+        std::string filePath;
+        return statement.ForEachRow(
+            [&](const SQLiteStatement& row)
+            {
+                const auto directory = directoryPaths.find(row.ColumnInt64(0));
+                const std::string_view nameText = row.ColumnView(1);
+                if ((directoryPaths.end() == directory) || (true == nameText.empty()))
+                {
+                    return true;
+                }
+                JoinPath(directory->second, nameText, filePath);
+                return onPath(filePath);
+            });
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::BeginGeneration(const std::string& timestamp, bool resume, BackupRunRecord& outputRun)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        if (true == resume)
+        {
+            auto interrupted = connection.Prepare("SELECT id, started FROM runs WHERE state=?1 ORDER BY id DESC LIMIT 1;");
+            interrupted.BindText(1, RunStateRunning);
+            if (true == interrupted.FetchRow())
+            {
+                _generation = interrupted.ColumnInt64(0);
+                outputRun = BackupRunRecord{_generation, std::string(interrupted.ColumnView(1)), true};
+                return true;
+            }
+        }
+
+        auto abandon = connection.Prepare("UPDATE runs SET state=?1 WHERE state=?2;");
+        abandon.BindText(1, RunStateAbandoned);
+        abandon.BindText(2, RunStateRunning);
+        // A run that only deletes files writes no rows but still names a snapshot after its generation.
+        auto statement = connection.Prepare("SELECT MAX((SELECT COALESCE(MAX(generation), 0) FROM files), "
+                                            "(SELECT COALESCE(MAX(id), 0) FROM snapshots), (SELECT COALESCE(MAX(id), 0) FROM runs)) + 1;");
+        if ((false == abandon.ExecuteStatement()) || (false == statement.FetchRow()))
+        {
+            return false;
+        }
+        _generation = statement.ColumnInt64(0);
+
+        auto insert = connection.Prepare("INSERT INTO runs(id, started, state) VALUES(?1, ?2, ?3);");
+        insert.BindInt64(1, _generation);
+        insert.BindText(2, timestamp);
+        insert.BindText(3, RunStateRunning);
+        outputRun = BackupRunRecord{_generation, timestamp, false};
+        return insert.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::FinishGeneration(bool succeeded)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("UPDATE runs SET state=?1 WHERE id=?2;");
+        statement.BindText(1, (true == succeeded) ? RunStateCompleted : RunStateFailed);
+        statement.BindInt64(2, _generation);
+        if (false == succeeded)
+        {
+            return statement.ExecuteStatement();
+        }
+        // The bitmap is stored with the state, so no completed run is seen without the bitmap it would have had.
+        return RunInTransaction(connection, [&]() { return (true == statement.ExecuteStatement()) && (true == RecordRunMembers(connection, _generation)); });
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::GetLatestRun(BackupRunRecord& outputRun, bool& outputCompleted)
+{
+    outputRun = BackupRunRecord{0, std::string(), false};
+    outputCompleted = false;
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT id, started, state FROM runs ORDER BY id DESC LIMIT 1;");
+        if (true == statement.FetchRow())
+        {
+            outputRun.id = statement.ColumnInt64(0);
+            outputRun.started = std::string(statement.ColumnView(1));
+            outputCompleted = (RunStateCompleted == statement.ColumnView(2));
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::GetRuns(std::vector<BackupRunRecord>& outputRuns)
+{
+    outputRuns.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT id, started FROM runs ORDER BY id;");
+        while (true == statement.FetchRow())
+        {
+            outputRuns.push_back(BackupRunRecord{statement.ColumnInt64(0), std::string(statement.ColumnView(1)), false});
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::IsRunInProgress(bool& outputRunning)
+{
+    outputRunning = false;
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT EXISTS(SELECT 1 FROM runs WHERE state=?1);");
+        statement.BindText(1, RunStateRunning);
+        outputRunning = (true == statement.FetchRow()) && (0 != statement.ColumnInt64(0));
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::ForEachUnseenFilePath(const std::function<bool(const std::string&)>& onPath)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::unordered_map<std::int64_t, std::string> directoryPaths;
+        LoadDirectoryPaths(connection, directoryPaths);
+
+        std::string filePath;
+        return ScanFilePages(
+            connection,
+            "SELECT dir_id, name, status FROM files WHERE (dir_id, name) > (?1, ?2) AND generation < ?4 AND status != ?5 "
+            "ORDER BY dir_id, name LIMIT ?3;",
+            [this](SQLiteStatement& statement)
+            {
+                statement.BindInt64(4, _generation);
+                statement.BindInt64(5, DeletedStatus);
+            },
+            [&](const ScannedFileRow& row)
+            {
+                const auto directory = directoryPaths.find(row.dirId);
+                if (directoryPaths.end() == directory)
+                {
+                    return true;
+                }
+                JoinPath(directory->second, row.name, filePath);
+                return onPath(filePath);
+            });
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::ForEachUnseenFilePathIn(const std::string& directoryPath, bool recursive,
+                                                  const std::function<bool(const std::string&)>& onPath)
+{
+    std::vector<std::string> filePaths;
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::unordered_map<std::int64_t, std::string> directoryPaths;
+        LoadDirectoryPaths(connection, directoryPaths);
+
+        const std::string prefix = directoryPath + static_cast<char>(std::filesystem::path::preferred_separator);
+        for (const auto& directory : directoryPaths)
+        {
+            const bool inside = (directoryPath == directory.second) ||
+                                ((true == recursive) && ((true == directoryPath.empty()) || (0 == directory.second.compare(0, prefix.size(), prefix))));
+            if (false == inside)
+            {
+                continue;
+            }
+            auto statement = connection.PrepareCached("SELECT name FROM files WHERE dir_id=?1 AND generation < ?2 AND status != ?3;");
+            statement->BindInt64(1, directory.first);
+            statement->BindInt64(2, _generation);
+            statement->BindInt64(3, DeletedStatus);
+            statement->ForEachRow(
+                [&](const SQLiteStatement& row)
+                {
+                    filePaths.push_back(JoinPath(directory.second, row.ColumnView(0)));
+                    return true;
+                });
+        }
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+    for (const auto& filePath : filePaths)
+    {
+        if (false == onPath(filePath))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FileStateRepository::GetDirectoryFileStates(const std::string& directoryPath, std::vector<NamedFileState>& outputStates)
+{
+    outputStates.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::int64_t directoryId = RootDirectoryId;
+        if (false == ResolveDirectory(connection, directoryPath, false, nullptr, directoryId))
+        {
+            return true;
+        }
+        auto statement = connection.PrepareCached(
+            "SELECT name, hash, status, last_updated, hash_algorithm, size, mtime_ns, inode, device, generation, mode, uid, gid, atime_ns, xattrs, "
+            "digest_scheme, sample_digest, sampled_runs FROM files WHERE dir_id=?1 ORDER BY name;");
+        statement->BindInt64(1, directoryId);
+        NamedFileState state{};
+        statement->ForEachRow(
+            [&](const SQLiteStatement& row)
+            {
+                if (true == ReadFileStateColumns(row, 1, _generation, state.record))
+                {
+                    state.name.assign(row.ColumnView(0));
+                    outputStates.push_back(state);
+                }
+                return true;
+            });
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::GetFileStates(const std::string& directoryPath, const std::vector<std::string>& names,
+                                        std::vector<NamedFileState>& outputStates)
+{
+    RDEMO_SCOPE("state.get.batch");
+    outputStates.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::int64_t directoryId = RootDirectoryId;
+        if ((true == names.empty()) || (false == ResolveDirectory(connection, directoryPath, false, nullptr, directoryId)))
+        {
+            return true;
+        }
+        // Unused placeholders of the last chunk stay NULL, which no name equals.
+        static const std::string sql = []()
+        {
+            std::string text = "SELECT name, hash, status, last_updated, hash_algorithm, size, mtime_ns, inode, device, generation, mode, uid, gid, "
+                               "atime_ns, xattrs, digest_scheme, sample_digest, sampled_runs FROM files WHERE dir_id=?1 AND name IN (";
+            for (std::size_t index = 0; index < PrefetchChunkSize; ++index)
+            {
+                text += ((0 == index) ? "?" : ",?") + std::to_string(index + 2);
+            }
+            return text + ") ORDER BY name;";
+        }();
+        auto statement = connection.PrepareCached(sql);
+        NamedFileState state{};
+        for (std::size_t first = 0; first < names.size(); first += PrefetchChunkSize)
+        {
+            statement->ClearBindings();
+            statement->BindInt64(1, directoryId);
+            const std::size_t count = std::min(PrefetchChunkSize, names.size() - first);
+            for (std::size_t index = 0; index < count; ++index)
+            {
+                statement->BindText(static_cast<int>(index + 2), names[first + index]);
+            }
+            statement->ForEachRow(
+                [&](const SQLiteStatement& row)
+                {
+                    if (true == ReadFileStateColumns(row, 1, _generation, state.record))
+                    {
+                        state.name.assign(row.ColumnView(0));
+                        outputStates.push_back(state);
+                    }
+                    return true;
+                });
+            statement->Reset();
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::GetLiveFileNames(const std::string& directoryPath, std::vector<std::string>& outputNames)
+{
+    outputNames.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::int64_t directoryId = RootDirectoryId;
+        if (false == ResolveDirectory(connection, directoryPath, false, nullptr, directoryId))
+        {
+            return true;
+        }
+        auto statement = connection.PrepareCached("SELECT name FROM files WHERE dir_id=?1 AND status != ?2;");
+        statement->BindInt64(1, directoryId);
+        statement->BindInt64(2, DeletedStatus);
+        statement->ForEachRow(
+            [&outputNames](const SQLiteStatement& row)
+            {
+                outputNames.emplace_back(row.ColumnView(0));
+                return true;
+            });
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::RefreshDirectoryDigests(std::uint64_t& outputRefreshed)
+{
+    outputRefreshed = 0;
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        if (false == MergeShardedDirectories(connection))
+        {
+            return false;
+        }
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            std::unordered_map<std::int64_t, std::int64_t> parentIds;
+            std::vector<std::int64_t> directoryIds;
+            {
+                auto stale = connection.Prepare("SELECT id, parent_id FROM dirs WHERE digest IS NULL;");
+                while (true == stale.FetchRow())
+                {
+                    parentIds.emplace(stale.ColumnInt64(0), stale.ColumnInt64(1));
+                    directoryIds.push_back(stale.ColumnInt64(0));
+                }
+            }
+            // Every ancestor of a stale directory is stale too; the walk up stops at one already known.
+            auto parentOf = connection.PrepareCached("SELECT parent_id FROM dirs WHERE id=?1;");
+            for (std::size_t index = 0; index < directoryIds.size(); ++index)
+            {
+                const std::int64_t parentId = parentIds[directoryIds[index]];
+                if ((RootDirectoryId == parentId) || (parentIds.end() != parentIds.find(parentId)))
+                {
+                    continue;
+                }
+                parentOf->Reset();
+                parentOf->BindInt64(1, parentId);
+                if (false == parentOf->FetchRow())
+                {
+                    continue;
+                }
+                parentIds.emplace(parentId, parentOf->ColumnInt64(0));
+                directoryIds.push_back(parentId);
+            }
+            parentOf->Reset();
+
+            std::unordered_map<std::int64_t, std::size_t> depths;
+            const std::function<std::size_t(std::int64_t)> depthOf = [&](std::int64_t directoryId) -> std::size_t
+            {
+                const auto parent = parentIds.find(directoryId);
+                if (parentIds.end() == parent)
+                {
+                    return 0;
+                }
+                const auto known = depths.find(directoryId);
+                if (depths.end() != known)
+                {
+                    return known->second;
+                }
+                const std::size_t depth = depthOf(parent->second) + 1;
+                depths.emplace(directoryId, depth);
+                return depth;
+            };
+            for (const std::int64_t directoryId : directoryIds)
+            {
+                depthOf(directoryId);
+            }
+            std::sort(directoryIds.begin(), directoryIds.end(),
+                      [&depths](std::int64_t left, std::int64_t right) { return depths[left] > depths[right]; });
+
+            auto storeDigest = connection.PrepareCached("UPDATE dirs SET digest=?2 WHERE id=?1;");
+            for (const std::int64_t directoryId : directoryIds)
+            {
+                HashDigest digest{};
+                if (false == ComputeDirectoryDigest(connection, directoryId, digest))
+                {
+                    connection.Execute("ROLLBACK;");
+                    outputRefreshed = 0;
+                    return false;
+                }
+                storeDigest->Reset();
+                storeDigest->BindInt64(1, directoryId);
+                storeDigest->BindBlob(2, digest.bytes.data(), digest.size);
+                storeDigest->ExecuteStatement();
+                ++outputRefreshed;
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        outputRefreshed = 0;
+        return false;
+    }
+}
+
+bool FileStateRepository::GetDirectoryDigest(const std::string& directoryPath, HashDigest& outputDigest)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::int64_t directoryId = RootDirectoryId;
+        if (false == ResolveDirectory(connection, directoryPath, false, nullptr, directoryId))
+        {
+            return false;
+        }
+        if (RootDirectoryId == directoryId)
+        {
+            return ComputeDirectoryDigest(connection, directoryId, outputDigest);
+        }
+        auto statement = connection.PrepareCached("SELECT digest FROM dirs WHERE id=?1;");
+        statement->BindInt64(1, directoryId);
+        bool found = false;
+        statement->ForEachRow(
+            [&](const SQLiteStatement& row)
+            {
+                const SQLiteBlob digest = row.ColumnBlob(0);
+                found = HashDigest::FromBytes(digest.data, digest.size, outputDigest);
+                return false;
+            });
+        return found;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::GetSubdirectoryDigests(const std::string& directoryPath, std::vector<NamedDirectoryDigest>& outputDigests)
+{
+    outputDigests.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::int64_t directoryId = RootDirectoryId;
+        if (false == ResolveDirectory(connection, directoryPath, false, nullptr, directoryId))
+        {
+            return true;
+        }
+        auto statement = connection.PrepareCached("SELECT name, digest FROM dirs WHERE parent_id=?1 ORDER BY name;");
+        statement->BindInt64(1, directoryId);
+        bool complete = true;
+        NamedDirectoryDigest entry{};
+        statement->ForEachRow(
+            [&](const SQLiteStatement& row)
+            {
+                const SQLiteBlob digest = row.ColumnBlob(1);
+                if (false == HashDigest::FromBytes(digest.data, digest.size, entry.digest))
+                {
+                    complete = false;
+                    return false;
+                }
+                if (EmptyTreeDigest() != entry.digest)
+                {
+                    entry.name.assign(row.ColumnView(0));
+                    outputDigests.push_back(entry);
+                }
+                return true;
+            });
+        return complete;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::ForEachFileStatus(const std::function<bool(const FileStatusEntry&)>& onEntry)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::unordered_map<std::int64_t, std::string> directoryPaths;
+        LoadDirectoryPaths(connection, directoryPaths);
+
+        FileStatusEntry entry{};
+        return ScanFilePages(connection, "SELECT dir_id, name, status FROM files WHERE (dir_id, name) > (?1, ?2) ORDER BY dir_id, name LIMIT ?3;",
+                             {},
+                             [&](const ScannedFileRow& row)
+                             {
+                                 const auto directory = directoryPaths.find(row.dirId);
+                                 if (directoryPaths.end() == directory)
+                                 {
+                                     return true;
+                                 }
+                                 JoinPath(directory->second, row.name, entry.path);
+                                 entry.status = row.status;
+                                 return onEntry(entry);
+                             });
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::HasMoveSourceOfSize(std::uint64_t size, const std::string& timestamp, bool& outputFound)
+{
+    outputFound = false;
+    std::int64_t runTime = 0;
+    if (false == TimestampProvider::ParseWallClockSeconds(timestamp, runTime))
+    {
+        return false;
+    }
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        // The files view over the shards takes no index hint; each shard's part of it uses its own index.
+        auto statement = connection.PrepareCached(
+            (true == _shardSessions.empty()) ? "SELECT 1 FROM files INDEXED BY files_by_size_hash WHERE size=?1 AND (status<>?2 OR last_updated=?3) LIMIT 1;"
+                                             : "SELECT 1 FROM files WHERE size=?1 AND (status<>?2 OR last_updated=?3) LIMIT 1;");
+        statement->BindInt64(1, static_cast<std::int64_t>(size));
+        statement->BindInt64(2, DeletedStatus);
+        statement->BindInt64(3, runTime);
+        const SQLiteStepResult result = statement->TryStep();
+        outputFound = (SQLiteStepResult::Row == result);
+        return (SQLiteStepResult::Row == result) || (SQLiteStepResult::Done == result);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::FindMoveSources(std::uint64_t size, const HashDigest& hash, HashAlgorithm hashAlgorithm, const std::string& timestamp,
+                                          std::vector<ContentMatch>& outputMatches)
+{
+    outputMatches.clear();
+    std::int64_t runTime = 0;
+    if (false == TimestampProvider::ParseWallClockSeconds(timestamp, runTime))
+    {
+        return false;
+    }
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::vector<std::pair<std::int64_t, ContentMatch>> rows;
+        {
+            auto statement = connection.PrepareCached(std::string("SELECT dir_id, name, status FROM files ") +
+                                                      ((true == _shardSessions.empty()) ? "INDEXED BY files_by_size_hash " : "") +
+                                                      "WHERE size=?1 AND hash=?2 AND hash_algorithm=?3 AND (status<>?4 OR last_updated=?5);");
+            statement->BindInt64(1, static_cast<std::int64_t>(size));
+            BindDigest(*statement, 2, hash);
+            statement->BindText(3, HashAlgorithmToString(hashAlgorithm));
+            statement->BindInt64(4, DeletedStatus);
+            statement->BindInt64(5, runTime);
+            while (true == statement->FetchRow())
+            {
+                rows.emplace_back(statement->ColumnInt64(0),
+                                  ContentMatch{std::string(statement->ColumnView(1)), DeletedStatus == statement->ColumnInt64(2)});
+            }
+        }
+        // Matches are rare and few, so each directory path is walked up on its own rather than loading every path.
+        std::string directoryPath;
+        for (auto& row : rows)
+        {
+            if (true == LoadDirectoryPath(connection, row.first, directoryPath))
+            {
+                row.second.path = JoinPath(directoryPath, row.second.path);
+                outputMatches.push_back(std::move(row.second));
+            }
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::MarkFileAsDeleted(const std::string& filePath, const std::string& timestamp)
+{
+    return MarkFilesAsDeleted({filePath}, timestamp);
+}
+
+bool FileStateRepository::MarkFilesAsDeleted(const std::vector<std::string>& filePaths, const std::string& timestamp)
+{
+    RDEMO_SCOPE("state.delete.batch");
+    std::int64_t deletedAt = 0;
+    if (true == filePaths.empty())
+    {
+        return true;
+    }
+    if (false == TimestampProvider::ParseWallClockSeconds(timestamp, deletedAt))
+    {
+        return false;
+    }
+
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        // Keys are resolved before the transaction starts, so it only holds the write lock for the updates.
+        std::vector<FileKey> keys;
+        std::vector<std::size_t> shards;
+        keys.reserve(filePaths.size());
+        for (const auto& filePath : filePaths)
+        {
+            FileKey key{};
+            // A file under an unknown directory has no row to mark.
+            if (true == ResolveFileKey(connection, filePath, false, nullptr, key))
+            {
+                keys.push_back(std::move(key));
+                shards.push_back((true == _shardSessions.empty()) ? 0 : ShardOf(filePath));
+            }
+        }
+        if (true == keys.empty())
+        {
+            return true;
+        }
 
-namespace
+        // The file rows and their version history must not diverge; with shards the history commits first.
+        const bool sharded = (false == _shardSessions.empty());
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            for (const auto& key : keys)
+            {
+                std::int64_t pathId = 0;
+                if (((false == sharded) && (false == MarkFileRowDeleted(connection, key, deletedAt))) || (false == InternPath(connection, key, pathId)) ||
+                    (false == ArchiveCurrentVersion(connection, pathId, _generation)))
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        return (false == sharded) ||
+               (true == WriteShards(shards, [&](SQLiteConnection& shardConnection, std::size_t index)
+                                    { return MarkFileRowDeleted(shardConnection, keys[index], deletedAt); }));
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::RecordSnapshot(const std::string& name)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("INSERT OR REPLACE INTO snapshots(id, name) VALUES(?1, ?2);");
+        statement.BindInt64(1, _generation);
+        statement.BindText(2, name);
+        return statement.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::GetSnapshotNames(std::vector<std::string>& outputNames)
 {
-constexpr const char* SqlCreateFilesTable = "CREATE TABLE IF NOT EXISTS files ("
-                                            "path TEXT PRIMARY KEY,"
-                                            "hash TEXT NOT NULL,"
-                                            "last_updated TEXT NOT NULL,"
-                                            "status TEXT NOT NULL);";
+    outputNames.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT name FROM snapshots ORDER BY name;");
+        while (true == statement.FetchRow())
+        {
+            outputNames.push_back(statement.ColumnText(0));
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
 }
 
-FileStateRepository::FileStateRepository(SQLiteSession& databaseSession) : _databaseSession(databaseSession)
+bool FileStateRepository::RecordColdSnapshot(const std::string& name, const std::filesystem::path& root)
 {
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("INSERT OR REPLACE INTO cold_snapshots(snapshot_id, root) SELECT id, ?2 FROM snapshots WHERE name=?1;");
+        statement.BindText(1, name);
+        statement.BindText(2, root.string());
+        return statement.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
 }
 
-bool FileStateRepository::InitializeSchema()
+bool FileStateRepository::GetColdSnapshots(std::unordered_map<std::string, std::filesystem::path>& outputRoots)
+{
+    outputRoots.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement =
+            connection.Prepare("SELECT snapshots.name, cold_snapshots.root FROM cold_snapshots JOIN snapshots ON snapshots.id = cold_snapshots.snapshot_id;");
+        while (true == statement.FetchRow())
+        {
+            outputRoots.emplace(statement.ColumnText(0), std::filesystem::path(statement.ColumnText(1)));
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::ForEachVersionAsOf(const std::string& asOf, const std::function<bool(const FileVersionRecord&)>& onVersion)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::unordered_map<std::int64_t, std::string> directoryPaths;
+        LoadDirectoryPaths(connection, directoryPaths);
+        // A version is current from its own timestamp until the run whose snapshot received it.
+        auto statement = connection.Prepare(
+            "SELECT paths.dir_id, paths.name, file_versions.version, file_versions.hash, file_versions.hash_algorithm, file_versions.size, "
+            "COALESCE(snapshots.name, '') FROM file_versions JOIN paths ON paths.id = file_versions.path_id "
+            "LEFT JOIN snapshots ON snapshots.id = file_versions.snapshot_id "
+            "WHERE (?1 = '' AND file_versions.snapshot_id IS NULL) OR "
+            "(?1 != '' AND file_versions.version <= ?1 AND (file_versions.snapshot_id IS NULL OR snapshots.name > ?1)) "
+            "ORDER BY file_versions.version;");
+        statement.BindText(1, asOf);
+        return ReadFileVersions(statement, directoryPaths, onVersion);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::ForEachArchivedVersion(const std::function<bool(const FileVersionRecord&)>& onVersion)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::unordered_map<std::int64_t, std::string> directoryPaths;
+        LoadDirectoryPaths(connection, directoryPaths);
+        auto statement = connection.Prepare(
+            "SELECT paths.dir_id, paths.name, file_versions.version, file_versions.hash, file_versions.hash_algorithm, file_versions.size, "
+            "snapshots.name FROM file_versions JOIN paths ON paths.id = file_versions.path_id "
+            "JOIN snapshots ON snapshots.id = file_versions.snapshot_id;");
+        return ReadFileVersions(statement, directoryPaths, onVersion);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::GetFileVersions(const std::string& filePath, std::vector<FileVersionRecord>& outputVersions)
+{
+    outputVersions.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        FileKey key{};
+        if (false == ResolveFileKey(connection, filePath, false, nullptr, key))
+        {
+            return true;
+        }
+
+        std::string directoryPath;
+        std::string name;
+        SplitPath(filePath, directoryPath, name);
+        auto statement = connection.Prepare(
+            "SELECT paths.dir_id, paths.name, file_versions.version, file_versions.hash, file_versions.hash_algorithm, file_versions.size, "
+            "COALESCE(snapshots.name, '') FROM paths JOIN file_versions ON file_versions.path_id = paths.id "
+            "LEFT JOIN snapshots ON snapshots.id = file_versions.snapshot_id WHERE paths.dir_id = ?1 AND paths.name = ?2 "
+            "ORDER BY file_versions.version;");
+        statement.BindInt64(1, key.dirId);
+        statement.BindText(2, key.name);
+        return ReadFileVersions(statement, {{key.dirId, directoryPath}},
+                                [&](const FileVersionRecord& version)
+                                {
+                                    outputVersions.push_back(version);
+                                    return true;
+                                });
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool FileStateRepository::RefreshPathSearch(std::uint64_t& outputIndexed)
 {
+    outputIndexed = 0;
     try
     {
-        _databaseSession.Acquire().Execute(SqlCreateFilesTable);
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            std::int64_t indexedId = 0;
+            {
+                auto lastIndexed = connection.Prepare("SELECT rowid FROM path_search ORDER BY rowid DESC LIMIT 1;");
+                if (true == lastIndexed.FetchRow())
+                {
+                    indexedId = lastIndexed.ColumnInt64(0);
+                }
+            }
+            std::unordered_map<std::int64_t, std::string> directoryPaths{{RootDirectoryId, std::string()}};
+            auto newPaths = connection.Prepare("SELECT id, dir_id, name FROM paths WHERE id > ?1 ORDER BY id;");
+            newPaths.BindInt64(1, indexedId);
+            auto insertPath = connection.Prepare("INSERT INTO path_search(rowid, path) VALUES(?1, ?2);");
+            std::string filePath;
+            while (true == newPaths.FetchRow())
+            {
+                const std::int64_t directoryId = newPaths.ColumnInt64(1);
+                auto directory = directoryPaths.find(directoryId);
+                if (directoryPaths.end() == directory)
+                {
+                    std::string directoryPath;
+                    if (false == LoadDirectoryPath(connection, directoryId, directoryPath))
+                    {
+                        continue;
+                    }
+                    directory = directoryPaths.emplace(directoryId, std::move(directoryPath)).first;
+                }
+                JoinPath(directory->second, newPaths.ColumnView(2), filePath);
+                insertPath.Reset();
+                insertPath.BindInt64(1, newPaths.ColumnInt64(0));
+                insertPath.BindText(2, filePath);
+                if (false == insertPath.ExecuteStatement())
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+                ++outputIndexed;
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
         return true;
     }
     catch (const std::runtime_error&)
@@ -32,23 +3368,116 @@ bool FileStateRepository::InitializeSchema()
     }
 }
 
-bool FileStateRepository::UpdateFileState(const std::string& filePath, const std::string& fileHash, ChangeType changeStatus,
-                                          const std::string& timestamp)
+bool FileStateRepository::ForEachVersionMatching(const std::string& pattern, const std::function<bool(const FileVersionRecord&)>& onVersion)
 {
     try
     {
         auto& connection = _databaseSession.Acquire();
-        auto statement = connection.Prepare("INSERT INTO files(path, hash, status, last_updated) "
-                                            "VALUES(?1, ?2, ?3, ?4) "
-                                            "ON CONFLICT(path) DO UPDATE SET "
-                                            "hash=excluded.hash, status=excluded.status, last_updated=excluded.last_updated;");
+        // The index holds whole paths, so no directory paths need to be loaded to report a match.
+        auto statement = connection.Prepare(
+            "SELECT path_search.path, file_versions.version, file_versions.hash, file_versions.hash_algorithm, file_versions.size, "
+            "COALESCE(snapshots.name, '') FROM path_search JOIN file_versions ON file_versions.path_id = path_search.rowid "
+            "LEFT JOIN snapshots ON snapshots.id = file_versions.snapshot_id WHERE path_search.path GLOB ?1 "
+            "ORDER BY path_search.path, file_versions.version;");
+        statement.BindText(1, pattern);
+        FileVersionRecord version{};
+        return statement.ForEachRow(
+            [&](const SQLiteStatement& row)
+            {
+                const SQLiteBlob hashBlob = row.ColumnBlob(2);
+                if ((false == HashDigest::FromBytes(hashBlob.data, hashBlob.size, version.hash)) ||
+                    (false == StringToHashAlgorithm(row.ColumnView(3), version.hashAlgorithm)))
+                {
+                    return true;
+                }
+                version.path.assign(row.ColumnView(0));
+                version.version.assign(row.ColumnView(1));
+                version.size = static_cast<std::uint64_t>(row.ColumnInt64(4));
+                version.snapshot.assign(row.ColumnView(5));
+                return onVersion(version);
+            });
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
 
-        statement.BindText(1, filePath);
-        statement.BindText(2, fileHash);
-        statement.BindText(3, ChangeTypeToString(changeStatus));
-        statement.BindText(4, timestamp);
+bool FileStateRepository::ForEachChangeBetween(const std::string& from, const std::string& to,
+                                               const std::function<bool(const DiffEntry&)>& onEntry)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        std::unordered_map<std::int64_t, std::string> directoryPaths;
+        LoadDirectoryPaths(connection, directoryPaths);
+        // A path changed between the two points only if one of its versions started or was archived in between.
+        // The first arm takes each path's earliest start in range; the second its archiving only when nothing
+        // started in range, which leaves one row per path without a temporary table. The indexes are named, so
+        // a database without statistics does not fall back to scanning the whole history.
+        auto changedPaths = connection.Prepare(
+            "SELECT paths.id, paths.dir_id, paths.name FROM ("
+            "SELECT v.path_id AS path_id FROM file_versions v INDEXED BY file_versions_by_version WHERE v.version > ?1 AND v.version <= ?2 AND NOT EXISTS ("
+            "SELECT 1 FROM file_versions e WHERE e.path_id = v.path_id AND e.version > ?1 AND "
+            "(e.version < v.version OR (e.version = v.version AND e.rowid < v.rowid))) "
+            "UNION ALL "
+            "SELECT v.path_id FROM snapshots s INDEXED BY snapshots_by_name CROSS JOIN file_versions v INDEXED BY file_versions_by_snapshot "
+            "ON v.snapshot_id = s.id WHERE s.name > ?1 AND s.name <= ?2 AND NOT EXISTS ("
+            "SELECT 1 FROM file_versions e WHERE e.path_id = v.path_id AND e.version > ?1 AND e.version <= ?2)"
+            ") AS changed JOIN paths ON paths.id = changed.path_id;");
+        changedPaths.BindText(1, std::min(from, to));
+        changedPaths.BindText(2, std::max(from, to));
+        auto versionAsOf = connection.PrepareCached(
+            "SELECT v.hash, v.hash_algorithm FROM file_versions v LEFT JOIN snapshots s ON s.id = v.snapshot_id "
+            "WHERE v.path_id = ?1 AND v.version <= ?2 AND (v.snapshot_id IS NULL OR s.name > ?2) ORDER BY v.version DESC LIMIT 1;");
+        // With the membership bitmaps of both ends, a version is only looked up at an end the path is live at,
+        // so added and deleted paths cost no history query on the side they are missing from.
+        PathIdBitmap fromMembers;
+        PathIdBitmap toMembers;
+        const bool membersKnown = (true == LoadRunMembers(connection, from, fromMembers)) && (true == LoadRunMembers(connection, to, toMembers));
 
-        return statement.ExecuteStatement();
+        DiffEntry entry{};
+        HashDigest fromHash{};
+        HashDigest toHash{};
+        HashAlgorithm fromAlgorithm{};
+        HashAlgorithm toAlgorithm{};
+        return changedPaths.ForEachRow(
+            [&](const SQLiteStatement& row)
+            {
+                const auto directory = directoryPaths.find(row.ColumnInt64(1));
+                if (directoryPaths.end() == directory)
+                {
+                    return true;
+                }
+                const std::int64_t pathId = row.ColumnInt64(0);
+                const bool existedBefore = ((false == membersKnown) || (true == IsRunMember(fromMembers, pathId))) &&
+                                           (true == ReadVersionAsOf(*versionAsOf, pathId, from, fromHash, fromAlgorithm));
+                const bool existsAfter = ((false == membersKnown) || (true == IsRunMember(toMembers, pathId))) &&
+                                         (true == ReadVersionAsOf(*versionAsOf, pathId, to, toHash, toAlgorithm));
+                if ((true == existedBefore) && (true == existsAfter))
+                {
+                    if ((fromHash == toHash) && (fromAlgorithm == toAlgorithm))
+                    {
+                        return true;
+                    }
+                    entry.change = ChangeType::Modified;
+                }
+                else if (true == existedBefore)
+                {
+                    entry.change = ChangeType::Deleted;
+                }
+                else if (true == existsAfter)
+                {
+                    entry.change = ChangeType::Added;
+                }
+                else
+                {
+                    // Added and deleted again in between.
+                    return true;
+                }
+                JoinPath(directory->second, row.ColumnView(2), entry.path);
+                return onEntry(entry);
+            });
     }
     catch (const std::runtime_error&)
     {
@@ -56,33 +3485,68 @@ bool FileStateRepository::UpdateFileState(const std::string& filePath, const std
     }
 }
 
-bool FileStateRepository::GetFileState(const std::string& filePath, std::string& outputHash, ChangeType& outputStatus,
-                                      std::string& outputTimestamp)
+void FileStateRepository::EnableObjectReferenceCounting()
+{
+    _countObjectReferences = true;
+}
+
+bool FileStateRepository::GetObjectReferenceCount(const HashDigest& digest, std::int64_t& outputCount)
 {
     try
     {
         auto& connection = _databaseSession.Acquire();
-        auto statement = connection.Prepare("SELECT hash, status, last_updated FROM files WHERE path=?1;");
+        auto cachedStatement = connection.PrepareCached("SELECT refcount FROM objects WHERE digest=?1;");
+        SQLiteStatement& statement = *cachedStatement;
 
-        statement.BindText(1, filePath);
+        BindDigest(statement, 1, digest);
 
         if (false == statement.FetchRow())
         {
             return false;
         }
+        outputCount = statement.ColumnInt64(0);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
 
-        const std::string hashText = statement.ColumnText(0);
-        const std::string statusText = statement.ColumnText(1);
-        const std::string timestampText = statement.ColumnText(2);
+bool FileStateRepository::AddChunkReferences(const std::vector<FileChunk>& chunks)
+{
+    if (true == chunks.empty())
+    {
+        return true;
+    }
 
-        if ((true == hashText.empty()) || (true == statusText.empty()) || (true == timestampText.empty()))
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
         {
-            return false;
+            auto cachedStatement = connection.PrepareCached("INSERT INTO chunks(digest, size, refcount) VALUES(?1, ?2, 1) "
+                                                            "ON CONFLICT(digest) DO UPDATE SET refcount=refcount+1;");
+            SQLiteStatement& statement = *cachedStatement;
+            for (const auto& chunk : chunks)
+            {
+                statement.Reset();
+                BindDigest(statement, 1, chunk.digest);
+                statement.BindInt64(2, static_cast<std::int64_t>(chunk.length));
+                if (false == statement.ExecuteStatement())
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
         }
-
-        outputHash = hashText;
-        outputStatus = StringToChangeType(statusText);
-        outputTimestamp = timestampText;
         return true;
     }
     catch (const std::runtime_error&)
@@ -91,40 +3555,483 @@ bool FileStateRepository::GetFileState(const std::string& filePath, std::string&
     }
 }
 
-std::vector<FileStatusEntry> FileStateRepository::GetAllFileStatuses()
+bool FileStateRepository::PruneSnapshots(const std::vector<std::string>& names, const std::vector<HashDigest>& releasedObjects,
+                                         const std::vector<HashDigest>& releasedChunks, std::vector<HashDigest>& outputUnreferencedObjects,
+                                         std::vector<HashDigest>& outputUnreferencedChunks, std::uint64_t& outputVersionsRemoved)
 {
-    auto& connection = _databaseSession.Acquire();
-    auto statement = connection.Prepare("SELECT path, status FROM files;");
+    outputUnreferencedObjects.clear();
+    outputUnreferencedChunks.clear();
+    outputVersionsRemoved = 0;
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        // Drops one reference per listed digest, then collects and forgets the digests left without any.
+        const auto release = [&](const std::string& table, const std::vector<HashDigest>& digests, std::vector<HashDigest>& outputUnreferenced)
+        {
+            auto decrement = connection.Prepare("UPDATE " + table + " SET refcount=refcount-1 WHERE digest=?1;");
+            for (const HashDigest& digest : digests)
+            {
+                decrement.Reset();
+                BindDigest(decrement, 1, digest);
+                if (false == decrement.ExecuteStatement())
+                {
+                    return false;
+                }
+            }
+            {
+                auto unreferenced = connection.Prepare("SELECT digest FROM " + table + " WHERE refcount<=0;");
+                while (true == unreferenced.FetchRow())
+                {
+                    const SQLiteBlob digestBlob = unreferenced.ColumnBlob(0);
+                    HashDigest digest{};
+                    if (true == HashDigest::FromBytes(digestBlob.data, digestBlob.size, digest))
+                    {
+                        outputUnreferenced.push_back(digest);
+                    }
+                }
+            }
+            connection.Execute("DELETE FROM " + table + " WHERE refcount<=0;");
+            return true;
+        };
 
-    std::vector<FileStatusEntry> results;
-    while (true == statement.FetchRow())
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            // The removed versions are read first, since the membership bitmaps of the runs they were live after must drop them.
+            auto prunedRows = connection.Prepare("SELECT file_versions.path_id, file_versions.version FROM file_versions "
+                                                 "JOIN snapshots ON snapshots.id = file_versions.snapshot_id WHERE snapshots.name=?1;");
+            auto deleteVersions = connection.Prepare("DELETE FROM file_versions WHERE snapshot_id IN (SELECT id FROM snapshots WHERE name=?1);");
+            auto deleteLocation = connection.Prepare("DELETE FROM cold_snapshots WHERE snapshot_id IN (SELECT id FROM snapshots WHERE name=?1);");
+            auto deleteSnapshot = connection.Prepare("DELETE FROM snapshots WHERE name=?1;");
+            std::vector<PrunedVersion> prunedVersions;
+            for (const std::string& name : names)
+            {
+                prunedRows.Reset();
+                prunedRows.BindText(1, name);
+                while (true == prunedRows.FetchRow())
+                {
+                    prunedVersions.push_back(PrunedVersion{prunedRows.ColumnInt64(0), std::string(prunedRows.ColumnView(1)), name});
+                }
+                prunedRows.Reset();
+                deleteVersions.Reset();
+                deleteVersions.BindText(1, name);
+                deleteLocation.Reset();
+                deleteLocation.BindText(1, name);
+                deleteSnapshot.Reset();
+                deleteSnapshot.BindText(1, name);
+                if ((false == deleteVersions.ExecuteStatement()) || (false == deleteLocation.ExecuteStatement()) ||
+                    (false == deleteSnapshot.ExecuteStatement()))
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+            }
+            outputVersionsRemoved = prunedVersions.size();
+            if ((false == RemovePrunedRunMembers(connection, prunedVersions)) ||
+                (false == release("objects", releasedObjects, outputUnreferencedObjects)) ||
+                (false == release("chunks", releasedChunks, outputUnreferencedChunks)))
+            {
+                connection.Execute("ROLLBACK;");
+                return false;
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
     {
-        const std::string pathText = statement.ColumnText(0);
-        const std::string statusText = statement.ColumnText(1);
+        return false;
+    }
+}
 
-        if ((true == pathText.empty()) || (true == statusText.empty()))
+/**
+ * @brief Get the id of a directory, resolving its parents first.
+ *
+ * Directories found in the cache need no query. Directories added inside an open transaction go to
+ * pendingIds rather than the cache, so a rolled-back id never reaches other workers.
+ *
+ * @param[in] connection Connection to query and write through
+ * @param[in] directoryPath Repository-relative directory path, empty for the source root
+ * @param[in] create Add missing directories
+ * @param[in,out] pendingIds Directories added by the open transaction, nullptr outside a transaction
+ * @param[out] outputId Directory id
+ * @return true if the directory exists, false otherwise
+ */
+bool FileStateRepository::ResolveDirectory(SQLiteConnection& connection, const std::string& directoryPath, bool create,
+                                           DirectoryIds* pendingIds, std::int64_t& outputId)
+{
+    if (true == directoryPath.empty())
+    {
+        outputId = RootDirectoryId;
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_directoryIdsMutex);
+        const auto cached = _directoryIds.find(directoryPath);
+        if (_directoryIds.end() != cached)
         {
-            continue;
+            outputId = cached->second;
+            return true;
         }
+    }
+    if (nullptr != pendingIds)
+    {
+        const auto pending = pendingIds->find(directoryPath);
+        if (pendingIds->end() != pending)
+        {
+            outputId = pending->second;
+            return true;
+        }
+    }
 
-        results.push_back({pathText, StringToChangeType(statusText)});
+    std::string parentPath;
+    std::string name;
+    SplitPath(directoryPath, parentPath, name);
+    std::int64_t parentId = RootDirectoryId;
+    bool added = false;
+    if ((false == ResolveDirectory(connection, parentPath, create, pendingIds, parentId)) ||
+        (false == FindDirectory(connection, parentId, name, create, outputId, added)))
+    {
+        return false;
+    }
+    if ((true == added) && (nullptr != pendingIds))
+    {
+        pendingIds->emplace(directoryPath, outputId);
+        return true;
     }
+    std::lock_guard<std::mutex> lock(_directoryIdsMutex);
+    _directoryIds.emplace(directoryPath, outputId);
+    return true;
+}
+
+/**
+ * @brief Get the database file of a shard, named after the main database.
+ *
+ * @param[in] shard Shard index
+ * @return Path of the shard's database file
+ */
+std::filesystem::path FileStateRepository::ShardPath(std::size_t shard) const
+{
+    std::filesystem::path shardPath = _databaseSession.DatabasePath();
+    shardPath += ".shard" + std::to_string(shard);
+    return shardPath;
+}
 
-    return results;
+/**
+ * @brief Get the shard holding the row of a file.
+ *
+ * @param[in] filePath Repository-relative file path
+ * @return Shard index
+ */
+std::size_t FileStateRepository::ShardOf(const std::string& filePath) const
+{
+    std::string directoryPath;
+    std::string name;
+    SplitPath(filePath, directoryPath, name);
+    return ShardOfDirectory(directoryPath, _shardSessions.size());
 }
 
-bool FileStateRepository::MarkFileAsDeleted(const std::string& filePath, const std::string& timestamp)
+/**
+ * @brief Attach the open shards read-only to every main connection behind a temporary files view.
+ *
+ * The view shadows the main database's own files table, which holds no rows while there are shards.
+ * Without shards the step detaches them again.
+ *
+ * @throws std::runtime_error if a shard cannot be attached
+ */
+void FileStateRepository::AttachShards()
+{
+    std::vector<std::filesystem::path> shardPaths;
+    std::string createView = "CREATE TEMP VIEW files AS ";
+    for (std::size_t shard = 0; shard < _shardSessions.size(); ++shard)
+    {
+        shardPaths.push_back(ShardPath(shard));
+        createView += ((0 == shard) ? "SELECT * FROM " : " UNION ALL SELECT * FROM ") + ShardSchemaName(shard) + ".files";
+    }
+    createView += ";";
+    _databaseSession.SetConnectionInitializer(
+        [shardPaths, createView](SQLiteConnection& connection)
+        {
+            connection.Execute("DROP VIEW IF EXISTS temp.files;");
+            connection.DetachAll();
+            if (true == shardPaths.empty())
+            {
+                return;
+            }
+            for (std::size_t shard = 0; shard < shardPaths.size(); ++shard)
+            {
+                connection.AttachReadOnly(shardPaths[shard], ShardSchemaName(shard));
+            }
+            connection.Execute(createView);
+        });
+}
+
+/**
+ * @brief Commit items to their shards, one transaction per shard on the shard's own connection.
+ *
+ * @param[in] shards Shard of each item
+ * @param[in] writeItem Writes one item through the connection of its shard, returns false to roll the shard back
+ * @return true if every shard committed, false on the first shard that did not
+ * @throws std::runtime_error on SQLite errors
+ */
+bool FileStateRepository::WriteShards(const std::vector<std::size_t>& shards, const std::function<bool(SQLiteConnection&, std::size_t)>& writeItem)
+{
+    std::vector<std::vector<std::size_t>> shardItems(_shardSessions.size());
+    for (std::size_t index = 0; index < shards.size(); ++index)
+    {
+        shardItems[shards[index]].push_back(index);
+    }
+    for (std::size_t shard = 0; shard < shardItems.size(); ++shard)
+    {
+        if (true == shardItems[shard].empty())
+        {
+            continue;
+        }
+        auto& connection = _shardSessions[shard]->Acquire();
+        const bool committed = RunInTransaction(connection,
+                                                [&]()
+                                                {
+                                                    for (const std::size_t index : shardItems[shard])
+                                                    {
+                                                        if (false == writeItem(connection, index))
+                                                        {
+                                                            return false;
+                                                        }
+                                                    }
+                                                    return true;
+                                                });
+        if (false == committed)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Store file states whose rows live in shards.
+ *
+ * Keys of known directories resolve without the main database's write lock, so a batch of unchanged
+ * files only locks its shards. New directories and versions commit in the main database first.
+ *
+ * @param[in] updates File states to store
+ * @return true on success, false on error
+ */
+bool FileStateRepository::UpdateShardedFileStates(const std::vector<FileStateUpdate>& updates)
 {
     try
     {
         auto& connection = _databaseSession.Acquire();
-        auto statement = connection.Prepare("UPDATE files SET status=?1, last_updated=?2 WHERE path=?3;");
+        std::vector<FileKey> keys(updates.size());
+        std::vector<std::size_t> shards(updates.size());
+        bool writesMain = false;
+        for (std::size_t index = 0; index < updates.size(); ++index)
+        {
+            shards[index] = ShardOf(updates[index].path);
+            writesMain = (true == writesMain) || (true == IsNewVersion(updates[index].record)) ||
+                         (false == ResolveFileKey(connection, updates[index].path, false, nullptr, keys[index]));
+        }
 
-        statement.BindText(1, ChangeTypeToString(ChangeType::Deleted));
-        statement.BindText(2, timestamp);
-        statement.BindText(3, filePath);
+        if (true == writesMain)
+        {
+            DirectoryIds addedDirectories;
+            const bool committed = RunInTransaction(connection,
+                                                    [&]()
+                                                    {
+                                                        for (std::size_t index = 0; index < updates.size(); ++index)
+                                                        {
+                                                            const FileStateRecord& record = updates[index].record;
+                                                            if ((false == ResolveFileKey(connection, updates[index].path, true, &addedDirectories, keys[index])) ||
+                                                                ((true == IsNewVersion(record)) &&
+                                                                 ((false == AddFileVersion(connection, keys[index], record, _generation)) ||
+                                                                  ((true == _countObjectReferences) && (false == AddObjectReference(connection, record))))))
+                                                            {
+                                                                return false;
+                                                            }
+                                                        }
+                                                        return true;
+                                                    });
+            if (false == committed)
+            {
+                return false;
+            }
+            PublishDirectories(addedDirectories);
+        }
 
-        return statement.ExecuteStatement();
+        return WriteShards(shards, [&](SQLiteConnection& shardConnection, std::size_t index)
+                           { return UpsertFileState(shardConnection, keys[index], updates[index].record, _generation, _bulkImport); });
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+/**
+ * @brief Clear the digests of the directories the shards collected, then drop them from the shards.
+ *
+ * @param[in] connection Connection to the main database, outside a transaction
+ * @return true on success or without shards, false on error
+ * @throws std::runtime_error on SQLite errors
+ */
+bool FileStateRepository::MergeShardedDirectories(SQLiteConnection& connection)
+{
+    for (std::size_t shard = 0; shard < _shardSessions.size(); ++shard)
+    {
+        std::vector<std::int64_t> directoryIds;
+        {
+            auto stale = connection.Prepare("SELECT dir_id FROM " + ShardSchemaName(shard) + ".stale_dirs;");
+            while (true == stale.FetchRow())
+            {
+                directoryIds.push_back(stale.ColumnInt64(0));
+            }
+        }
+        if (true == directoryIds.empty())
+        {
+            continue;
+        }
+        auto forEachDirectory = [&directoryIds](SQLiteConnection& target, const char* sql)
+        {
+            auto statement = target.PrepareCached(sql);
+            for (const std::int64_t directoryId : directoryIds)
+            {
+                statement->Reset();
+                statement->BindInt64(1, directoryId);
+                if (false == statement->ExecuteStatement())
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+        // A directory a shard marks again meanwhile is dropped only after its digest was cleared, and RefreshDirectoryDigests reads rows as they are now.
+        if ((false == RunInTransaction(connection, [&]() { return forEachDirectory(connection, "UPDATE dirs SET digest=NULL WHERE id=?1 AND digest IS NOT NULL;"); })) ||
+            (false == RunInTransaction(_shardSessions[shard]->Acquire(),
+                                       [&]() { return forEachDirectory(_shardSessions[shard]->Acquire(), "DELETE FROM stale_dirs WHERE dir_id=?1;"); })))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Split a file path into the id of its directory and its name.
+ *
+ * @param[in] connection Connection to query and write through
+ * @param[in] filePath Repository-relative file path
+ * @param[in] create Add missing directories
+ * @param[in,out] pendingIds Directories added by the open transaction, nullptr outside a transaction
+ * @param[out] outputKey Directory id and name of the file
+ * @return true if the file's directory exists, false otherwise
+ */
+bool FileStateRepository::ResolveFileKey(SQLiteConnection& connection, const std::string& filePath, bool create, DirectoryIds* pendingIds,
+                                         FileKey& outputKey)
+{
+    std::string directoryPath;
+    SplitPath(filePath, directoryPath, outputKey.name);
+    return ResolveDirectory(connection, directoryPath, create, pendingIds, outputKey.dirId);
+}
+
+/**
+ * @brief Add committed directories to the cache.
+ *
+ * @param[in] ids Directory ids keyed by repository-relative path
+ */
+void FileStateRepository::PublishDirectories(const DirectoryIds& ids)
+{
+    if (true == ids.empty())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_directoryIdsMutex);
+    _directoryIds.insert(ids.begin(), ids.end());
+}
+
+/**
+ * @brief Rebuild the path of every directory with a single query and add them all to the cache.
+ *
+ * @param[in] connection Connection to query, outside a transaction
+ * @param[out] outputPaths Repository-relative directory paths keyed by id, including the source root
+ */
+void FileStateRepository::LoadDirectoryPaths(SQLiteConnection& connection, std::unordered_map<std::int64_t, std::string>& outputPaths)
+{
+    outputPaths.clear();
+    outputPaths.emplace(RootDirectoryId, std::string());
+    // Parents are added before their children, so ascending ids visit every parent first.
+    auto statement = connection.Prepare("SELECT id, parent_id, name FROM dirs ORDER BY id;");
+    DirectoryIds loadedIds;
+    while (true == statement.FetchRow())
+    {
+        const auto parent = outputPaths.find(statement.ColumnInt64(1));
+        if (outputPaths.end() == parent)
+        {
+            continue;
+        }
+        const std::int64_t directoryId = statement.ColumnInt64(0);
+        std::string directoryPath = JoinPath(parent->second, statement.ColumnView(2));
+        loadedIds.emplace(directoryPath, directoryId);
+        outputPaths.emplace(directoryId, std::move(directoryPath));
+    }
+    PublishDirectories(loadedIds);
+}
+
+/**
+ * @brief Build the repository-relative path of one directory by walking up its parents.
+ *
+ * @param[in] connection Connection to read from
+ * @param[in] directoryId Directory id, RootDirectoryId for the source root
+ * @param[out] outputPath Directory path, empty for the source root
+ * @return true on success, false if a directory on the way up has no row
+ */
+bool FileStateRepository::LoadDirectoryPath(SQLiteConnection& connection, std::int64_t directoryId, std::string& outputPath)
+{
+    outputPath.clear();
+    std::vector<std::string> names;
+    auto statement = connection.PrepareCached("SELECT parent_id, name FROM dirs WHERE id=?1;");
+    while (RootDirectoryId != directoryId)
+    {
+        statement->Reset();
+        statement->BindInt64(1, directoryId);
+        if (false == statement->FetchRow())
+        {
+            return false;
+        }
+        directoryId = statement->ColumnInt64(0);
+        names.emplace_back(statement->ColumnView(1));
+    }
+    for (auto name = names.rbegin(); names.rend() != name; ++name)
+    {
+        outputPath = JoinPath(outputPath, *name);
+    }
+    return true;
+}
+
+bool FileStateRepository::PurgeDeletedFiles(const std::string& cutoffTimestamp, std::uint64_t& outputPurged)
+{
+    outputPurged = 0;
+    try
+    {
+        if (true == _shardSessions.empty())
+        {
+            return PurgeDeletedRows(_databaseSession.Acquire(), cutoffTimestamp, outputPurged);
+        }
+        // Each shard purges on its own; the count covers the shards that committed.
+        for (const auto& shardSession : _shardSessions)
+        {
+            std::uint64_t purged = 0;
+            if (false == PurgeDeletedRows(shardSession->Acquire(), cutoffTimestamp, purged))
+            {
+                return false;
+            }
+            outputPurged += purged;
+        }
+        return true;
     }
     catch (const std::runtime_error&)
     {
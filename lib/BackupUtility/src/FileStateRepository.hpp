@@ -3,11 +3,24 @@
 #pragma once
 
 #include "BackupUtility/BackupUtility.hpp"
+#include "FileHasher/FileChunker.hpp"
+#include "FileHasher/FileHasher.hpp"
+#include "FileIterator/FileMetadata.hpp"
 #include "SQLite/SQLiteSession.hpp"
 
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+class SQLiteConnection;
+
 /**
  * @brief Lightweight file status entry for repository iteration.
  */
@@ -17,12 +30,154 @@ struct FileStatusEntry
   ChangeType status; /**< Stored change status for the file */
 };
 
+/**
+ * @brief How the stored digest of a file was last confirmed against its content.
+ */
+enum class DigestScheme
+{
+    Full,   /**< The whole file was hashed */
+    Sampled /**< Only a sample of a large file was checked; the digest is the one of its last full hash */
+};
+
+/**
+ * @brief Convert a DigestScheme enumeration value to its string representation.
+ *
+ * @param[in] scheme The scheme to convert
+ * @return String representation of the scheme
+ */
+inline const char* DigestSchemeToString(DigestScheme scheme)
+{
+    return (DigestScheme::Sampled == scheme) ? "sampled" : "full";
+}
+
+/**
+ * @brief Convert a string to its corresponding DigestScheme enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @return Corresponding scheme, Full for anything but "sampled"
+ */
+inline DigestScheme StringToDigestScheme(std::string_view stringValue)
+{
+    return ("sampled" == stringValue) ? DigestScheme::Sampled : DigestScheme::Full;
+}
+
+/**
+ * @brief Persisted state of a single tracked file.
+ */
+struct FileStateRecord
+{
+    HashDigest hash;                /**< Binary content digest */
+    HashAlgorithm hashAlgorithm;    /**< Algorithm that produced the digest */
+    ChangeType status;              /**< Change status from the last run that touched the file */
+    std::string timestamp;          /**< Timestamp string for last update */
+    FileMetadata metadata;          /**< Size, times, identity, mode and owner captured when the file was inspected */
+    std::string extendedAttributes; /**< Extended attributes in the ReadExtendedAttributes encoding, empty if none or not captured */
+    DigestScheme digestScheme;      /**< How the digest was last confirmed against the content */
+    HashDigest sampleDigest;        /**< FileHasher::ComputeSample digest with hashAlgorithm, size 0 if none is kept */
+    std::uint32_t sampledRuns;      /**< Runs that confirmed the file by its sample since its last full hash */
+    bool committedInRun;            /**< Read back only: the row was written by the current run, before it was interrupted */
+};
+
+/**
+ * @brief Run started by BeginGeneration.
+ */
+struct BackupRunRecord
+{
+    std::int64_t id;     /**< Run generation, also the id of the run's snapshot */
+    std::string started; /**< Timestamp of the run's start, also the name of its snapshot */
+    bool resumed;        /**< The run was interrupted before and continues where it stopped */
+};
+
+/**
+ * @brief One version of a tracked file from the version history.
+ */
+struct FileVersionRecord
+{
+    std::string path;            /**< Repository-relative file path */
+    std::string version;         /**< Timestamp from which the version was current */
+    HashDigest hash;             /**< Binary content digest */
+    HashAlgorithm hashAlgorithm; /**< Algorithm that produced the digest */
+    std::uint64_t size;          /**< Size in bytes */
+    std::string snapshot;        /**< Snapshot directory the version was archived into, empty while it is current */
+};
+
+/**
+ * @brief Key of a file row: the id of its directory in the dirs table and its name within it.
+ */
+struct FileKey
+{
+    std::int64_t dirId; /**< Directory id, 0 for the source root */
+    std::string name;   /**< Last path component */
+};
+
+/**
+ * @brief Stored state of a file named within its directory.
+ */
+struct NamedFileState
+{
+    std::string name;       /**< Last path component */
+    FileStateRecord record; /**< Stored file state */
+};
+
+/**
+ * @brief Digest of a subdirectory's subtree, named within its parent.
+ */
+struct NamedDirectoryDigest
+{
+    std::string name;  /**< Last path component */
+    HashDigest digest; /**< Digest over the names and digests of the live files below it */
+};
+
+/**
+ * @brief Stored file holding the same content as a new file, a candidate for where the new file was moved from.
+ */
+struct ContentMatch
+{
+    std::string path; /**< Repository-relative file path */
+    bool deleted;     /**< Marked deleted by the current run; live otherwise */
+};
+
+/**
+ * @brief Pending upsert of a single file state.
+ */
+struct FileStateUpdate
+{
+    std::string path;       /**< Repository-relative file path */
+    FileStateRecord record; /**< File state to store */
+};
+
 /**
  * @brief Adapter for persisting file state using SQLite.
+ *
+ * Files are keyed by directory id and name, and every directory is stored once in the dirs table. The
+ * ids of known directories are cached and shared by all workers, so resolving a path needs no query
+ * once its directory has been seen.
+ *
+ * Each directory row also holds a Merkle digest of its subtree: a hash of the names and digests of its
+ * live files and of its subdirectories' digests. Triggers clear the digest of a directory when one of its
+ * live files is added, changes content, is deleted or comes back; rewriting a file with the same digest
+ * leaves it alone. RefreshDirectoryDigests then recomputes only the cleared directories and their ancestors.
+ *
+ * The file rows can be split across shard databases next to the main one, by a hash of each file's
+ * top-level directory. Every shard has its own session, WAL and write lock, so threads committing
+ * files of different shards do not wait for each other; the directory, version and object tables stay
+ * in the main database. Main connections attach the shards read-only behind a temporary files view, so
+ * every query that reads files sees all of them. A shard collects the directories its changes made
+ * stale, and RefreshDirectoryDigests carries them over to the main database first.
  */
 class FileStateRepository
 {
   public:
+    /**
+     * @brief Names looked up per query by GetFileStates.
+     */
+    static constexpr std::size_t PrefetchChunkSize = 64;
+
+    /**
+     * @brief Most shard databases the file rows can be split across.
+     */
+    static constexpr std::size_t MaxShards = 16;
+
     /**
      * @brief Create a repository bound to a SQLite session.
      *
@@ -30,44 +185,340 @@ class FileStateRepository
      */
     explicit FileStateRepository(SQLiteSession& databaseSession);
 
+    /**
+     * @brief Detach the shards from the session's connections and close them.
+     */
+    ~FileStateRepository();
+
+    FileStateRepository(const FileStateRepository&) = delete;
+    FileStateRepository& operator=(const FileStateRepository&) = delete;
+
     /**
      * @brief Create required database schema if it does not exist.
      *
+     * Existing databases are upgraded step by step to the current schema version recorded in
+     * PRAGMA user_version. Each step runs in its own transaction. The shard databases the main
+     * database records are opened afterwards, in the open mode of the main session. On a read-only
+     * session it only succeeds for a database already at the current version.
+     *
      * @return true on success, false on error
      */
     bool InitializeSchema();
 
+    /**
+     * @brief Open the shard databases the main database records and attach them to its connections.
+     *
+     * InitializeSchema calls it; a reader that does not initialize the schema calls it before reading.
+     * Call while no other thread uses the session.
+     *
+     * @return true if the shards are open or there are none, false if a shard is missing or on error
+     */
+    bool OpenShards();
+
+    /**
+     * @brief Split the file rows across a number of shard databases, moving the existing rows.
+     *
+     * Rows move back into the main database first and are then distributed by the hash of their
+     * top-level directory. Both steps commit on their own, so an interrupted change leaves every row in
+     * the old layout or in the main database. Call while no other thread uses the session.
+     *
+     * @param[in] shardCount Number of databases holding file rows, 1 for the main database alone, 0 keeps the current layout
+     * @return true on success, false if the count exceeds MaxShards or on error
+     */
+    bool SetShardCount(std::size_t shardCount);
+
+    /**
+     * @brief Get the number of databases holding file rows.
+     *
+     * @return 1 when every row is in the main database
+     */
+    std::size_t ShardCount() const;
+
+    /**
+     * @brief Start a run generation; every later upsert marks its file as seen by this run.
+     *
+     * Each run is recorded in the runs table while it goes on. If the latest run never finished and resume
+     * is set, its generation and start time are taken over, so files it already committed read back as
+     * committedInRun and its snapshot is continued. Otherwise unfinished runs are marked abandoned and a
+     * new generation starts. Must be called before workers start writing.
+     *
+     * @param[in] timestamp Start time of a new run
+     * @param[in] resume Continue an interrupted run instead of starting a new one
+     * @param[out] outputRun Run that was started or resumed
+     * @return true on success, false on error
+     */
+    bool BeginGeneration(const std::string& timestamp, bool resume, BackupRunRecord& outputRun);
+
+    /**
+     * @brief Record that the current run reached its end, so the next run starts a new generation.
+     *
+     * A successful run also stores the ids of the paths it left current as a compressed bitmap, in the
+     * same transaction, which ForEachChangeBetween reads instead of probing the version history.
+     *
+     * @param[in] succeeded Whether every file of the run was backed up
+     * @return true on success, false on error
+     */
+    bool FinishGeneration(bool succeeded);
+
+    /**
+     * @brief Get the newest run recorded in the runs table.
+     *
+     * @param[out] outputRun Newest run, id 0 when no run was recorded
+     * @param[out] outputCompleted The run reached its end with every file backed up
+     * @return true on success, false on error
+     */
+    bool GetLatestRun(BackupRunRecord& outputRun, bool& outputCompleted);
+
+    /**
+     * @brief Get every run recorded in the runs table, whatever its state.
+     *
+     * @param[out] outputRuns Runs in generation order, which is age order
+     * @return true on success, false on error
+     */
+    bool GetRuns(std::vector<BackupRunRecord>& outputRuns);
+
+    /**
+     * @brief Check whether a run is recorded as running, so another process may be writing the database.
+     *
+     * A run that crashed stays running until the next run marks it abandoned.
+     *
+     * @param[out] outputRunning A run is recorded as running
+     * @return true on success, false on error
+     */
+    bool IsRunInProgress(bool& outputRunning);
+
     /**
      * @brief Insert or update file state in the database.
      *
+     * An added or modified state also starts a new version in the version history; a modified state first
+     * archives the previous version into this run's snapshot.
+     *
      * @param[in] filePath Repository-relative file path
-     * @param[in] fileHash Content hash for the file
-     * @param[in] changeStatus Change status to store
-     * @param[in] timestamp Timestamp string for last update
+     * @param[in] record File state to store
+     * @return true on success, false on error
+     */
+    bool UpdateFileState(const std::string& filePath, const FileStateRecord& record);
+
+    /**
+     * @brief Insert or update several file states in a single transaction.
+     *
+     * Either all updates are committed or none are. With shards, the main database commits the new
+     * directories and versions first and each shard then commits its rows on its own; a failure in
+     * between leaves versions whose file rows the next run updates again.
+     *
+     * @param[in] updates File states to store
      * @return true on success, false on error
      */
-    bool UpdateFileState(const std::string& filePath, const std::string& fileHash, ChangeType changeStatus, const std::string& timestamp);
+    bool UpdateFileStates(const std::vector<FileStateUpdate>& updates);
 
     /**
      * @brief Retrieve file state from the database.
      *
      * @param[in] filePath Repository-relative file path
-     * @param[out] outputHash Stored file hash
-     * @param[out] outputStatus Stored change status
-     * @param[out] outputTimestamp Stored timestamp string
+     * @param[out] outputRecord Stored file state
      * @return true if a record is found, false otherwise
      */
-    bool GetFileState(const std::string& filePath, std::string& outputHash, ChangeType& outputStatus, std::string& outputTimestamp);
+    bool GetFileState(const std::string& filePath, FileStateRecord& outputRecord);
+
+    /**
+     * @brief Stream every stored file state through a callback with a single query.
+     *
+     * Malformed rows are skipped.
+     *
+     * @param[in] onRecord Callback receiving the path and state, returns false to stop early
+     * @return true if every row was visited, false on error or when stopped early
+     */
+    bool ForEachFileState(const std::function<bool(const std::string&, const FileStateRecord&)>& onRecord);
 
     /**
-     * @brief Retrieve all stored file status entries.
+     * @brief Count the stored file rows, deleted files included.
      *
-     * @return Collection of file status entries
+     * @param[out] outputCount Number of rows
+     * @return true on success, false on error
      */
-    std::vector<FileStatusEntry> GetAllFileStatuses();
+    bool CountFiles(std::uint64_t& outputCount);
 
     /**
-     * @brief Mark a file as deleted in the database.
+     * @brief Check whether any file row is stored, deleted files included.
+     *
+     * @param[out] outputHas true if at least one row is stored
+     * @return true on success, false on error
+     */
+    bool HasFileStates(bool& outputHas);
+
+    /**
+     * @brief Switch to bulk import for a first run into an empty database.
+     *
+     * File rows are appended with a plain INSERT in key order instead of upserted, and the secondary
+     * indexes are dropped so they are built once by FinishBulkImport instead of row by row. Shard
+     * databases also stop syncing until then. Move detection must not run meanwhile, since the content
+     * index is gone. Must be called before workers start writing.
+     *
+     * @return true on success, false on error
+     */
+    bool BeginBulkImport();
+
+    /**
+     * @brief Build the indexes dropped by BeginBulkImport and return to upserts and normal syncing.
+     *
+     * InitializeSchema also builds them, so an import interrupted before this call leaves nothing behind.
+     * Call after the workers finished.
+     *
+     * @return true on success, false on error
+     */
+    bool FinishBulkImport();
+
+    /**
+     * @brief Read the token of the state snapshot file that matches the stored file rows.
+     *
+     * The token is dropped by triggers as soon as a file row or a directory's path changes.
+     *
+     * @param[out] outputToken Token written by WriteStateSnapshotToken
+     * @return true if a token is stored, false if there is none or on error
+     */
+    bool ReadStateSnapshotToken(std::uint64_t& outputToken);
+
+    /**
+     * @brief Record that a state snapshot file with this token matches the stored file rows.
+     *
+     * @param[in] token Token stored in the snapshot file's header
+     * @return true on success, false on error
+     */
+    bool WriteStateSnapshotToken(std::uint64_t token);
+
+    /**
+     * @brief Stream the path of every stored file row, deleted files included, with a single query.
+     *
+     * @param[in] onPath Callback receiving each repository-relative path, returns false to stop early
+     * @return true if every row was visited, false on error or when stopped early
+     */
+    bool ForEachFilePath(const std::function<bool(const std::string&)>& onPath);
+
+    /**
+     * @brief Stream every stored file status through a callback in constant memory.
+     *
+     * Rows are read in pages, and no statement is active while the callback runs, so it may write to
+     * the repository, e.g. to mark the file deleted.
+     *
+     * @param[in] onEntry Callback receiving each path and status, returns false to stop early
+     * @return true if every row was visited, false on error or when stopped early
+     */
+    bool ForEachFileStatus(const std::function<bool(const FileStatusEntry&)>& onEntry);
+
+    /**
+     * @brief Stream the paths of live files that the current generation has not written, in constant memory.
+     *
+     * After a complete walk these are exactly the files deleted from the source. As with ForEachFileStatus(),
+     * the callback may write to the repository.
+     *
+     * @param[in] onPath Callback receiving each repository-relative path, returns false to stop early
+     * @return true if every row was visited, false on error or when stopped early
+     */
+    bool ForEachUnseenFilePath(const std::function<bool(const std::string&)>& onPath);
+
+    /**
+     * @brief List the live files below one directory that the current generation has not written.
+     *
+     * After a complete listing of the directory, or of its whole subtree when recursive, these are the
+     * files deleted from it. The paths are collected before the first callback, which may write to the repository.
+     *
+     * @param[in] directoryPath Repository-relative directory path, empty for the source root
+     * @param[in] recursive Include the files of every directory below it
+     * @param[in] onPath Callback receiving each repository-relative path, returns false to stop early
+     * @return true if every file was visited, false on error or when stopped early
+     */
+    bool ForEachUnseenFilePathIn(const std::string& directoryPath, bool recursive, const std::function<bool(const std::string&)>& onPath);
+
+    /**
+     * @brief Retrieve every file state stored for one directory, deleted files included, in one ordered scan.
+     *
+     * The rows are read along the primary key, so the scan is sequential in the B-tree instead of one probe per file.
+     *
+     * @param[in] directoryPath Repository-relative directory path, empty for the source root
+     * @param[out] outputStates States in ascending byte order of their names; empty for an unknown directory
+     * @return true on success, false on error
+     */
+    bool GetDirectoryFileStates(const std::string& directoryPath, std::vector<NamedFileState>& outputStates);
+
+    /**
+     * @brief Retrieve the stored states of some files of one directory, deleted files included, with few queries.
+     *
+     * The names are looked up PrefetchChunkSize at a time, each chunk with one IN query on the primary key.
+     *
+     * @param[in] directoryPath Repository-relative directory path, empty for the source root
+     * @param[in] names Names of the files, in ascending byte order
+     * @param[out] outputStates States of the stored files among them, in ascending byte order of their names
+     * @return true on success, false on error
+     */
+    bool GetFileStates(const std::string& directoryPath, const std::vector<std::string>& names, std::vector<NamedFileState>& outputStates);
+
+    /**
+     * @brief Retrieve the names of the live files stored for one directory.
+     *
+     * @param[in] directoryPath Repository-relative directory path, empty for the source root
+     * @param[out] outputNames Names of the directory's files that are not marked deleted; empty for an unknown directory
+     * @return true on success, false on error
+     */
+    bool GetLiveFileNames(const std::string& directoryPath, std::vector<std::string>& outputNames);
+
+    /**
+     * @brief Recompute the digests cleared since the last refresh, and those of their ancestors, in one transaction.
+     *
+     * Directories are recomputed deepest first, so each reads the fresh digests of its subdirectories.
+     *
+     * @param[out] outputRefreshed Number of directories recomputed
+     * @return true on success, false on error
+     */
+    bool RefreshDirectoryDigests(std::uint64_t& outputRefreshed);
+
+    /**
+     * @brief Retrieve the digest of the subtree below one directory.
+     *
+     * The source root has no row, so its digest is computed from its files and subdirectories on each call.
+     * Two subtrees with equal digests hold the same live files with the same digests.
+     *
+     * @param[in] directoryPath Repository-relative directory path, empty for the source root
+     * @param[out] outputDigest Digest of the subtree
+     * @return true on success, false for an unknown directory, a stale digest or on error
+     */
+    bool GetDirectoryDigest(const std::string& directoryPath, HashDigest& outputDigest);
+
+    /**
+     * @brief Retrieve the digests of the subdirectories of one directory that hold live files.
+     *
+     * @param[in] directoryPath Repository-relative directory path, empty for the source root
+     * @param[out] outputDigests Subdirectories in ascending byte order of their names; empty for an unknown directory
+     * @return true on success, false if a digest is stale or on error
+     */
+    bool GetSubdirectoryDigests(const std::string& directoryPath, std::vector<NamedDirectoryDigest>& outputDigests);
+
+    /**
+     * @brief Check whether a file of a given size is live, or was deleted by a given run, so a new file of that size may have been moved from it.
+     *
+     * @param[in] size File size in bytes
+     * @param[in] timestamp Timestamp of the current run
+     * @param[out] outputFound Whether such a file is stored
+     * @return true on success, false on error
+     */
+    bool HasMoveSourceOfSize(std::uint64_t size, const std::string& timestamp, bool& outputFound);
+
+    /**
+     * @brief List the files with a given size and digest that are live, or were deleted by a given run.
+     *
+     * The lookup is a probe of the size and digest index, not a scan.
+     *
+     * @param[in] size File size in bytes
+     * @param[in] hash Content digest
+     * @param[in] hashAlgorithm Algorithm that produced the digest; files hashed with another one do not match
+     * @param[in] timestamp Timestamp of the current run
+     * @param[out] outputMatches Matching files
+     * @return true on success, false on error
+     */
+    bool FindMoveSources(std::uint64_t size, const HashDigest& hash, HashAlgorithm hashAlgorithm, const std::string& timestamp,
+                         std::vector<ContentMatch>& outputMatches);
+
+    /**
+     * @brief Mark a file as deleted in the database and archive its current version into this run's snapshot.
      *
      * @param[in] filePath Repository-relative file path
      * @param[in] timestamp Timestamp string for deletion
@@ -75,6 +526,196 @@ class FileStateRepository
      */
     bool MarkFileAsDeleted(const std::string& filePath, const std::string& timestamp);
 
+    /**
+     * @brief Mark several files as deleted in a single transaction and archive their current versions into this run's snapshot.
+     *
+     * Either all files are marked or none are. Files under unknown directories have no row and are skipped.
+     *
+     * @param[in] filePaths Repository-relative file paths
+     * @param[in] timestamp Timestamp string for deletion
+     * @return true on success, false on error
+     */
+    bool MarkFilesAsDeleted(const std::vector<std::string>& filePaths, const std::string& timestamp);
+
+    /**
+     * @brief Record the snapshot directory of the current generation.
+     *
+     * The snapshot id is the generation, so versions archived by this run refer to it before it is recorded.
+     *
+     * @param[in] name Snapshot directory name, the timestamp of the run
+     * @return true on success, false on error
+     */
+    bool RecordSnapshot(const std::string& name);
+
+    /**
+     * @brief Retrieve the names of all recorded snapshot directories.
+     *
+     * @param[out] outputNames Names in ascending order, which is age order
+     * @return true on success, false on error
+     */
+    bool GetSnapshotNames(std::vector<std::string>& outputNames);
+
+    /**
+     * @brief Record that a snapshot directory now lives on a cold tier.
+     *
+     * @param[in] name Snapshot directory name
+     * @param[in] root Root of the cold tier, whose deleted/ directory holds the snapshot
+     * @return true on success, false on error
+     */
+    bool RecordColdSnapshot(const std::string& name, const std::filesystem::path& root);
+
+    /**
+     * @brief Retrieve the snapshots that live on a cold tier.
+     *
+     * @param[out] outputRoots Root of the cold tier of each such snapshot, by name; other snapshots are below the backup root
+     * @return true on success, false on error
+     */
+    bool GetColdSnapshots(std::unordered_map<std::string, std::filesystem::path>& outputRoots);
+
+    /**
+     * @brief Stream the versions that were current at a point in time through a callback.
+     *
+     * A version is current from its timestamp until the run whose snapshot received it, so the point in
+     * time compares against both as strings; a prefix of a timestamp stands for the start of that period.
+     * Versions are visited in ascending version order.
+     *
+     * @param[in] asOf Timestamp or prefix, empty selects the versions that are current now
+     * @param[in] onVersion Callback receiving each version, returns false to stop early
+     * @return true if every row was visited, false on error or when stopped early
+     */
+    bool ForEachVersionAsOf(const std::string& asOf, const std::function<bool(const FileVersionRecord&)>& onVersion);
+
+    /**
+     * @brief Stream every version archived into a snapshot through a callback.
+     *
+     * @param[in] onVersion Callback receiving each version, returns false to stop early
+     * @return true if every row was visited, false on error or when stopped early
+     */
+    bool ForEachArchivedVersion(const std::function<bool(const FileVersionRecord&)>& onVersion);
+
+    /**
+     * @brief Retrieve the recorded versions of one file.
+     *
+     * @param[in] filePath Repository-relative file path
+     * @param[out] outputVersions Versions in ascending version order
+     * @return true on success, false on error
+     */
+    bool GetFileVersions(const std::string& filePath, std::vector<FileVersionRecord>& outputVersions);
+
+    /**
+     * @brief Add the paths recorded since the last refresh to the path search index, in one transaction.
+     *
+     * Path ids only grow and paths are never renamed, so the paths above the highest indexed id are
+     * exactly the new ones.
+     *
+     * @param[out] outputIndexed Number of paths added to the index
+     * @return true on success, false on error
+     */
+    bool RefreshPathSearch(std::uint64_t& outputIndexed);
+
+    /**
+     * @brief Stream the recorded versions of the files whose path matches a pattern.
+     *
+     * The patterns are matched by the trigram index, which RefreshPathSearch must have brought up to date.
+     *
+     * @param[in] pattern SQLite GLOB pattern matched against the whole repository-relative path
+     * @param[in] onVersion Callback receiving each version, in ascending path and version order; returns false to stop early
+     * @return true if every version was visited, false on error or when stopped early
+     */
+    bool ForEachVersionMatching(const std::string& pattern, const std::function<bool(const FileVersionRecord&)>& onVersion);
+
+    /**
+     * @brief Stream the files whose current version differs between two points in time.
+     *
+     * Points in time compare as in ForEachVersionAsOf. Only paths with a version that started, or was
+     * archived, between the two are read, each once, through range queries on the version and snapshot
+     * indexes; two probes on the path index then find the version current at either point. When both points
+     * fall after a completed run with a membership bitmap, a path is only probed at the points it is live at.
+     * The paths are visited as the query yields them, and memory does not grow with the number of changes.
+     *
+     * @param[in] from Point in time compared from, whose extra files are reported deleted
+     * @param[in] to Point in time compared to, whose extra files are reported added; may be earlier than from
+     * @param[in] onEntry Callback receiving each differing file, returns false to stop early
+     * @return true if every change was visited, false on error or when stopped early
+     */
+    bool ForEachChangeBetween(const std::string& from, const std::string& to, const std::function<bool(const DiffEntry&)>& onEntry);
+
+    /**
+     * @brief Count a content object reference for every added or modified file state stored from now on.
+     *
+     * Each new version installed from the content store adds one hardlink to its object; archiving moves
+     * that link into a snapshot without adding one. Must be called before workers start writing.
+     */
+    void EnableObjectReferenceCounting();
+
+    /**
+     * @brief Retrieve the number of recorded references to a content object.
+     *
+     * @param[in] digest Object digest
+     * @param[out] outputCount Recorded reference count
+     * @return true if the object is recorded, false otherwise
+     */
+    bool GetObjectReferenceCount(const HashDigest& digest, std::int64_t& outputCount);
+
+    /**
+     * @brief Add one reference per listed chunk in a single transaction, recording chunks on first use.
+     *
+     * @param[in] chunks Chunks of one archived file version; repeated chunks are counted repeatedly
+     * @return true on success, false on error
+     */
+    bool AddChunkReferences(const std::vector<FileChunk>& chunks);
+
+    /**
+     * @brief Forget pruned snapshots and release what their versions referenced, in one transaction.
+     *
+     * The snapshots and the versions archived into them are removed, the membership bitmaps of the runs
+     * those versions were live after drop them, every listed object and chunk loses one reference, and objects and chunks left without references are removed from their tables.
+     *
+     * @param[in] names Snapshot names to forget; unrecorded names are skipped
+     * @param[in] releasedObjects Content objects linked by the pruned versions, one entry per link
+     * @param[in] releasedChunks Chunks listed by the pruned manifests, one entry per listing
+     * @param[out] outputUnreferencedObjects Objects left without references, whose files can be removed
+     * @param[out] outputUnreferencedChunks Chunks left without references, whose files can be removed
+     * @param[out] outputVersionsRemoved Number of archived versions forgotten
+     * @return true on success, false on error, in which case nothing changed
+     */
+    bool PruneSnapshots(const std::vector<std::string>& names, const std::vector<HashDigest>& releasedObjects,
+                        const std::vector<HashDigest>& releasedChunks, std::vector<HashDigest>& outputUnreferencedObjects,
+                        std::vector<HashDigest>& outputUnreferencedChunks, std::uint64_t& outputVersionsRemoved);
+
+    /**
+     * @brief Forget files deleted before a cutoff.
+     *
+     * Their archived versions stay in the history; a file that comes back is backed up as new.
+     *
+     * @param[in] cutoffTimestamp Run timestamp; rows marked deleted earlier are removed
+     * @param[out] outputPurged Rows removed
+     * @return true on success, false on error
+     */
+    bool PurgeDeletedFiles(const std::string& cutoffTimestamp, std::uint64_t& outputPurged);
+
   private:
+    using DirectoryIds = std::unordered_map<std::string, std::int64_t>;
+
+    std::filesystem::path ShardPath(std::size_t shard) const;
+    std::size_t ShardOf(const std::string& filePath) const;
+    void AttachShards();
+    bool WriteShards(const std::vector<std::size_t>& shards, const std::function<bool(SQLiteConnection&, std::size_t)>& writeItem);
+    bool UpdateShardedFileStates(const std::vector<FileStateUpdate>& updates);
+    bool MergeShardedDirectories(SQLiteConnection& connection);
+
+    bool ResolveDirectory(SQLiteConnection& connection, const std::string& directoryPath, bool create, DirectoryIds* pendingIds,
+                          std::int64_t& outputId);
+    bool ResolveFileKey(SQLiteConnection& connection, const std::string& filePath, bool create, DirectoryIds* pendingIds, FileKey& outputKey);
+    void PublishDirectories(const DirectoryIds& ids);
+    void LoadDirectoryPaths(SQLiteConnection& connection, std::unordered_map<std::int64_t, std::string>& outputPaths);
+    bool LoadDirectoryPath(SQLiteConnection& connection, std::int64_t directoryId, std::string& outputPath);
+
     SQLiteSession& _databaseSession;
+    std::int64_t _generation;
+    bool _countObjectReferences;
+    bool _bulkImport;
+    std::mutex _directoryIdsMutex;
+    DirectoryIds _directoryIds;
+    std::vector<std::unique_ptr<SQLiteSession>> _shardSessions; /**< Empty when every row is in the main database */
 };
@@ -0,0 +1,117 @@
+// file FileStateWriterThread.cpp
+
+#include "FileStateWriterThread.hpp"
+
+#include <algorithm>
+#include <vector>
+
+FileStateWriterThread::FileStateWriterThread(FileStateRepository& fileStateRepository, std::size_t batchSize,
+                                             std::chrono::milliseconds flushInterval, BackupStatsCollector* statsCollector,
+                                             DurabilityBarrier* durabilityBarrier)
+    : _fileStateRepository(fileStateRepository), _batchSize(std::max<std::size_t>(1, batchSize)), _flushInterval(flushInterval),
+      _statsCollector(statsCollector), _durabilityBarrier(durabilityBarrier),
+      _wakeRequested(false), _sleeping(false), _stopping(false), _failed(false)
+{
+    _writer = std::thread([this]() { WriterLoop(); });
+}
+
+FileStateWriterThread::~FileStateWriterThread()
+{
+    Stop();
+}
+
+bool FileStateWriterThread::Add(const std::string& filePath, const FileStateRecord& record)
+{
+    _updateQueue.Push({filePath, record});
+    if (true == _sleeping.load())
+    {
+        Wake();
+    }
+    return false == _failed.load();
+}
+
+bool FileStateWriterThread::Stop()
+{
+    if (true == _writer.joinable())
+    {
+        _stopping.store(true);
+        Wake();
+        _writer.join();
+    }
+    return false == _failed.load();
+}
+
+/**
+ * @brief Wake the writer thread if it is waiting for work.
+ */
+void FileStateWriterThread::Wake()
+{
+    std::lock_guard<std::mutex> lock(_wakeMutex);
+    _wakeRequested = true;
+    _wakeCv.notify_one();
+}
+
+/**
+ * @brief Writer thread loop: drain the queue and commit full or expired batches.
+ */
+void FileStateWriterThread::WriterLoop()
+{
+    std::vector<FileStateUpdate> pending;
+    pending.reserve(_batchSize);
+    auto batchStart = std::chrono::steady_clock::now();
+    BackupStatsCollector::ThreadCounters* counters = (nullptr != _statsCollector) ? &_statsCollector->Current() : nullptr;
+
+    auto commit = [&]()
+    {
+        StageTimer databaseTimer(counters, BackupStage::Database);
+        TraceSpan commitSpan(counters, "UpdateFileStates");
+        if (true == pending.empty())
+        {
+            return;
+        }
+        // The copies the rows refer to reach the disk before the rows do.
+        if (((nullptr != _durabilityBarrier) && (false == _durabilityBarrier->Sync())) || (false == _fileStateRepository.UpdateFileStates(pending)))
+        {
+            _failed.store(true);
+        }
+        pending.clear();
+    };
+
+    while (true)
+    {
+        // Read the flag before draining so nothing pushed before Stop is left behind.
+        const bool stopping = _stopping.load();
+
+        FileStateUpdate update;
+        while ((pending.size() < _batchSize) && (true == _updateQueue.TryPop(update)))
+        {
+            if (true == pending.empty())
+            {
+                batchStart = std::chrono::steady_clock::now();
+            }
+            pending.push_back(std::move(update));
+        }
+
+        const bool expired = (false == pending.empty()) && (_flushInterval <= (std::chrono::steady_clock::now() - batchStart));
+        if ((_batchSize <= pending.size()) || (true == expired))
+        {
+            commit();
+            continue;
+        }
+        // Below the batch size the drain stopped because the queue was empty.
+        if (true == stopping)
+        {
+            commit();
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(_wakeMutex);
+        _sleeping.store(true);
+        if (true == _updateQueue.IsEmpty())
+        {
+            _wakeCv.wait_for(lock, _flushInterval, [&]() { return (true == _wakeRequested) || (true == _stopping.load()); });
+        }
+        _wakeRequested = false;
+        _sleeping.store(false);
+    }
+}
@@ -0,0 +1,82 @@
+// file FileStateWriterThread.hpp:
+
+#pragma once
+
+#include "BackupStatsCollector.hpp"
+#include "DurabilityBarrier.hpp"
+#include "FileStateRepository.hpp"
+#include "ThreadedFileQueue/MpscQueue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Single database writer fed by a lock-free multi-producer queue.
+ *
+ * Workers push file state updates without touching SQLite. One writer thread drains the
+ * queue and commits the updates in large transactions, so workers never compete for the
+ * WAL write lock. Worker connections are then only used for reads.
+ */
+class FileStateWriterThread
+{
+  public:
+    /**
+     * @brief Start the writer thread.
+     *
+     * @param[in] fileStateRepository Repository that commits the updates
+     * @param[in] batchSize Maximum number of rows per transaction
+     * @param[in] flushInterval Maximum time a queued row waits before it is committed
+     * @param[in] statsCollector Collector the commit time is counted in, nullptr without stats
+     * @param[in] durabilityBarrier Barrier synced before each commit so rows only refer to durable copies, nullptr commits without syncing
+     */
+    FileStateWriterThread(FileStateRepository& fileStateRepository, std::size_t batchSize, std::chrono::milliseconds flushInterval,
+                          BackupStatsCollector* statsCollector = nullptr, DurabilityBarrier* durabilityBarrier = nullptr);
+    /**
+     * @brief Stop the writer thread, committing anything still queued.
+     */
+    ~FileStateWriterThread();
+
+    FileStateWriterThread(const FileStateWriterThread&) = delete;
+    FileStateWriterThread& operator=(const FileStateWriterThread&) = delete;
+
+    /**
+     * @brief Queue an upsert for the writer thread; never blocks on the database.
+     *
+     * @param[in] filePath Repository-relative file path
+     * @param[in] record File state to store
+     * @return false if an earlier commit has failed, true otherwise
+     */
+    bool Add(const std::string& filePath, const FileStateRecord& record);
+
+    /**
+     * @brief Commit everything queued so far and join the writer thread.
+     *
+     * Producers must have stopped adding before this is called.
+     *
+     * @return true if every commit succeeded, false on error
+     */
+    bool Stop();
+
+  private:
+    void WriterLoop();
+    void Wake();
+
+    FileStateRepository& _fileStateRepository;
+    std::size_t _batchSize;
+    std::chrono::milliseconds _flushInterval;
+    BackupStatsCollector* _statsCollector;
+    DurabilityBarrier* _durabilityBarrier;
+    MpscQueue<FileStateUpdate> _updateQueue;
+    std::mutex _wakeMutex;
+    std::condition_variable _wakeCv;
+    bool _wakeRequested;
+    std::atomic<bool> _sleeping;
+    std::atomic<bool> _stopping;
+    std::atomic<bool> _failed;
+    std::thread _writer;
+};
@@ -0,0 +1,130 @@
+// file FuseMount.cpp:
+
+#include "FuseMount.hpp"
+
+// 3.1 is the oldest API this builds against; newer libfuse 3 releases keep it behind compatibility names.
+#define FUSE_USE_VERSION 31
+#include <fuse3/fuse.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+constexpr std::int64_t NanosecondsPerSecond = 1000000000;
+
+HistoryMount& CurrentMount()
+{
+    return *static_cast<HistoryMount*>(fuse_get_context()->private_data);
+}
+
+int GetAttributes(const char* path, struct stat* output, struct fuse_file_info*)
+{
+    HistoryMountEntry entry{};
+    if (false == CurrentMount().Stat(path, entry))
+    {
+        return -ENOENT;
+    }
+    std::memset(output, 0, sizeof(*output));
+    output->st_mode = static_cast<mode_t>(((true == entry.directory) ? S_IFDIR : S_IFREG) | entry.mode);
+    output->st_nlink = (true == entry.directory) ? 2 : 1;
+    output->st_size = static_cast<off_t>(entry.size);
+    output->st_mtim.tv_sec = static_cast<time_t>(entry.modificationTimeNs / NanosecondsPerSecond);
+    output->st_mtim.tv_nsec = static_cast<long>(entry.modificationTimeNs % NanosecondsPerSecond);
+    // Whoever mounted the history owns it; recorded owners may not exist on this machine.
+    output->st_uid = getuid();
+    output->st_gid = getgid();
+    return 0;
+}
+
+int ReadDirectory(const char* path, void* buffer, fuse_fill_dir_t fill, off_t, struct fuse_file_info*, enum fuse_readdir_flags)
+{
+    std::vector<std::string> names;
+    if (false == CurrentMount().List(path, names))
+    {
+        return -ENOENT;
+    }
+    const auto noFlags = static_cast<enum fuse_fill_dir_flags>(0);
+    fill(buffer, ".", nullptr, 0, noFlags);
+    fill(buffer, "..", nullptr, 0, noFlags);
+    for (const std::string& name : names)
+    {
+        if (0 != fill(buffer, name.c_str(), nullptr, 0, noFlags))
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+int OpenFile(const char* path, struct fuse_file_info* info)
+{
+    if (O_RDONLY != (info->flags & O_ACCMODE))
+    {
+        return -EROFS;
+    }
+    HistoryMountEntry entry{};
+    if (false == CurrentMount().Stat(path, entry))
+    {
+        return -ENOENT;
+    }
+    if (true == entry.directory)
+    {
+        return -EISDIR;
+    }
+    info->keep_cache = 1;
+    return 0;
+}
+
+int ReadFile(const char* path, char* buffer, size_t size, off_t offset, struct fuse_file_info*)
+{
+    std::size_t read = 0;
+    if ((0 > offset) || (false == CurrentMount().Read(path, static_cast<std::uint64_t>(offset), size, buffer, read)))
+    {
+        return -EIO;
+    }
+    return static_cast<int>(read);
+}
+}
+
+bool ServeFuseMount(HistoryMount& historyMount, const std::filesystem::path& mountPoint)
+{
+    struct fuse_operations operations{};
+    operations.getattr = GetAttributes;
+    operations.readdir = ReadDirectory;
+    operations.open = OpenFile;
+    operations.read = ReadFile;
+
+    char program[] = "rdemo-backup";
+    char optionFlag[] = "-o";
+    char mountOptions[] = "ro,default_permissions,fsname=rdemo-backup,subtype=rdemo";
+    char* arguments[] = {program, optionFlag, mountOptions};
+    struct fuse_args fuseArguments = FUSE_ARGS_INIT(3, arguments);
+    struct fuse* fuse = fuse_new(&fuseArguments, &operations, sizeof(operations), &historyMount);
+    fuse_opt_free_args(&fuseArguments);
+    if (nullptr == fuse)
+    {
+        return false;
+    }
+    bool served = false;
+    if (0 == fuse_mount(fuse, mountPoint.c_str()))
+    {
+        // SIGINT and SIGTERM end the loop like fusermount -u does, so the filesystem is unmounted below;
+        // the loop then returns the signal number, which is no error.
+        struct fuse_session* session = fuse_get_session(fuse);
+        const bool handlersSet = (0 == fuse_set_signal_handlers(session));
+        served = (true == handlersSet) && (0 <= fuse_loop_mt(fuse, 0));
+        if (true == handlersSet)
+        {
+            fuse_remove_signal_handlers(session);
+        }
+        fuse_unmount(fuse);
+    }
+    fuse_destroy(fuse);
+    return served;
+}
@@ -0,0 +1,20 @@
+// file FuseMount.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+
+#include <filesystem>
+
+/**
+ * @brief Serve a history view as a read-only FUSE filesystem until it is unmounted.
+ *
+ * Only built with FUSE 3. Requests are served by several threads, each calling into the view, which
+ * is safe for concurrent use. Opening a file for writing fails with EROFS, and the kernel is told to
+ * keep cached pages of a file across opens, since no content of the view ever changes.
+ *
+ * @param[in,out] historyMount Opened view to serve
+ * @param[in] mountPoint Existing empty directory to mount on
+ * @return true if the filesystem was mounted and later unmounted, false if it could not be mounted
+ */
+bool ServeFuseMount(HistoryMount& historyMount, const std::filesystem::path& mountPoint);
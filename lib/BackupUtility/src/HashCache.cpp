@@ -0,0 +1,171 @@
+// file HashCache.cpp:
+
+#include "HashCache.hpp"
+
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+constexpr const char* SqlCreateHashCacheTable = "CREATE TABLE IF NOT EXISTS hash_cache ("
+                                                "device INTEGER NOT NULL,"
+                                                "inode INTEGER NOT NULL,"
+                                                "algorithm TEXT NOT NULL,"
+                                                "size INTEGER NOT NULL,"
+                                                "mtime_ns INTEGER NOT NULL,"
+                                                "ctime_ns INTEGER NOT NULL,"
+                                                "hash BLOB NOT NULL,"
+                                                "PRIMARY KEY (device, inode, algorithm)) WITHOUT ROWID;";
+
+// A file keeps its identity while it grows, so its resume point outlives the size and times the digests are checked against.
+constexpr const char* SqlCreateResumeTable = "CREATE TABLE IF NOT EXISTS hash_resume ("
+                                             "device INTEGER NOT NULL,"
+                                             "inode INTEGER NOT NULL,"
+                                             "algorithm TEXT NOT NULL,"
+                                             "size INTEGER NOT NULL,"
+                                             "tail_hash INTEGER NOT NULL,"
+                                             "state BLOB NOT NULL,"
+                                             "PRIMARY KEY (device, inode, algorithm)) WITHOUT ROWID;";
+}
+
+HashCache::HashCache(SQLiteSession& databaseSession) : _databaseSession(databaseSession)
+{
+}
+
+bool HashCache::InitializeSchema()
+{
+    try
+    {
+        auto& connection = AcquireConnection();
+        connection.Execute(SqlCreateHashCacheTable);
+        connection.Execute(SqlCreateResumeTable);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool HashCache::Lookup(const FileMetadata& metadata, HashAlgorithm algorithm, HashDigest& outputDigest)
+{
+    try
+    {
+        auto& connection = AcquireConnection();
+        auto cachedStatement = connection.PrepareCached("SELECT hash FROM hash_cache WHERE device=?1 AND inode=?2 AND algorithm=?3 "
+                                                        "AND size=?4 AND mtime_ns=?5 AND ctime_ns=?6;");
+        SQLiteStatement& statement = *cachedStatement;
+
+        statement.BindInt64(1, static_cast<std::int64_t>(metadata.device));
+        statement.BindInt64(2, static_cast<std::int64_t>(metadata.inode));
+        statement.BindText(3, HashAlgorithmToString(algorithm));
+        statement.BindInt64(4, static_cast<std::int64_t>(metadata.size));
+        statement.BindInt64(5, metadata.modificationTimeNs);
+        statement.BindInt64(6, metadata.changeTimeNs);
+
+        if (false == statement.FetchRow())
+        {
+            return false;
+        }
+        const SQLiteBlob hashBlob = statement.ColumnBlob(0);
+        return HashDigest::FromBytes(hashBlob.data, hashBlob.size, outputDigest);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool HashCache::Store(const FileMetadata& metadata, HashAlgorithm algorithm, const HashDigest& digest)
+{
+    try
+    {
+        auto& connection = AcquireConnection();
+        auto cachedStatement = connection.PrepareCached("INSERT OR REPLACE INTO hash_cache (device, inode, algorithm, size, mtime_ns, ctime_ns, hash) "
+                                                        "VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7);");
+        SQLiteStatement& statement = *cachedStatement;
+
+        statement.BindInt64(1, static_cast<std::int64_t>(metadata.device));
+        statement.BindInt64(2, static_cast<std::int64_t>(metadata.inode));
+        statement.BindText(3, HashAlgorithmToString(algorithm));
+        statement.BindInt64(4, static_cast<std::int64_t>(metadata.size));
+        statement.BindInt64(5, metadata.modificationTimeNs);
+        statement.BindInt64(6, metadata.changeTimeNs);
+        statement.BindBlob(7, digest.bytes.data(), digest.size);
+        return statement.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool HashCache::LookupResumePoint(const FileMetadata& metadata, HashAlgorithm algorithm, HashResumePoint& outputResumePoint)
+{
+    try
+    {
+        auto& connection = AcquireConnection();
+        auto cachedStatement = connection.PrepareCached("SELECT size, tail_hash, state FROM hash_resume WHERE device=?1 AND inode=?2 AND algorithm=?3;");
+        SQLiteStatement& statement = *cachedStatement;
+
+        statement.BindInt64(1, static_cast<std::int64_t>(metadata.device));
+        statement.BindInt64(2, static_cast<std::int64_t>(metadata.inode));
+        statement.BindText(3, HashAlgorithmToString(algorithm));
+
+        if (false == statement.FetchRow())
+        {
+            return false;
+        }
+        const SQLiteBlob stateBlob = statement.ColumnBlob(2);
+        const std::uint8_t* stateBytes = static_cast<const std::uint8_t*>(stateBlob.data);
+        outputResumePoint.algorithm = algorithm;
+        outputResumePoint.size = static_cast<std::uintmax_t>(statement.ColumnInt64(0));
+        outputResumePoint.tailHash = static_cast<std::uint64_t>(statement.ColumnInt64(1));
+        outputResumePoint.state.assign(stateBytes, stateBytes + stateBlob.size);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool HashCache::StoreResumePoint(const FileMetadata& metadata, const HashResumePoint& resumePoint)
+{
+    try
+    {
+        auto& connection = AcquireConnection();
+        auto cachedStatement = connection.PrepareCached("INSERT OR REPLACE INTO hash_resume (device, inode, algorithm, size, tail_hash, state) "
+                                                        "VALUES (?1, ?2, ?3, ?4, ?5, ?6);");
+        SQLiteStatement& statement = *cachedStatement;
+
+        statement.BindInt64(1, static_cast<std::int64_t>(metadata.device));
+        statement.BindInt64(2, static_cast<std::int64_t>(metadata.inode));
+        statement.BindText(3, HashAlgorithmToString(resumePoint.algorithm));
+        statement.BindInt64(4, static_cast<std::int64_t>(resumePoint.size));
+        statement.BindInt64(5, static_cast<std::int64_t>(resumePoint.tailHash));
+        statement.BindBlob(6, resumePoint.state.data(), resumePoint.state.size());
+        return statement.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+/**
+ * @brief Acquire the calling thread's connection, relaxing its sync mode on first use.
+ *
+ * @return Connection bound to the current thread
+ */
+SQLiteConnection& HashCache::AcquireConnection()
+{
+    SQLiteConnection& connection = _databaseSession.Acquire();
+    std::lock_guard<std::mutex> lock(_connectionsMutex);
+    if (true == _tunedConnections.insert(&connection).second)
+    {
+        connection.Execute("PRAGMA synchronous=NORMAL;");
+    }
+    return connection;
+}
@@ -0,0 +1,87 @@
+// file HashCache.hpp:
+
+#pragma once
+
+#include "FileHasher/FileHasher.hpp"
+#include "FileIterator/FileMetadata.hpp"
+#include "SQLite/SQLiteSession.hpp"
+
+#include <mutex>
+#include <unordered_set>
+
+class SQLiteConnection;
+
+/**
+ * @brief Persistent digest cache keyed by file identity, shared by backup jobs over overlapping trees.
+ *
+ * Entries live in their own SQLite database, keyed by device, inode and algorithm, and are valid only while
+ * size, mtime and ctime still match. The database runs in WAL mode with a busy timeout, so several
+ * processes can read and write it at the same time. Commits are not synced individually: a crash can lose
+ * recent entries, which only costs rehashing. The same database keeps resume points, from which files
+ * that only grew are hashed without reading their first bytes again.
+ */
+class HashCache
+{
+  public:
+    /**
+     * @brief Create a cache bound to a SQLite session on the cache database.
+     *
+     * @param[in] databaseSession Active SQLite session for the cache database
+     */
+    explicit HashCache(SQLiteSession& databaseSession);
+
+    /**
+     * @brief Create the cache table if it does not exist.
+     *
+     * @return true on success, false on error
+     */
+    bool InitializeSchema();
+
+    /**
+     * @brief Look up the digest of a file whose identity and timestamps are unchanged.
+     *
+     * @param[in] metadata Metadata of the file, captured before the lookup
+     * @param[in] algorithm Algorithm of the wanted digest
+     * @param[out] outputDigest Cached digest
+     * @return true on a hit, false on a miss or error
+     */
+    bool Lookup(const FileMetadata& metadata, HashAlgorithm algorithm, HashDigest& outputDigest);
+
+    /**
+     * @brief Record the digest of a file.
+     *
+     * @param[in] metadata Metadata of the file, captured before it was hashed
+     * @param[in] algorithm Algorithm that produced the digest
+     * @param[in] digest Digest to record
+     * @return true on success, false on error
+     */
+    bool Store(const FileMetadata& metadata, HashAlgorithm algorithm, const HashDigest& digest);
+
+    /**
+     * @brief Look up the resume point saved for a file identity, whatever the file's size and times are now.
+     *
+     * The caller checks that the point still describes the file, see FileHasher::ComputeAndAppend.
+     *
+     * @param[in] metadata Metadata of the file; only device and inode are used
+     * @param[in] algorithm Algorithm of the wanted state
+     * @param[out] outputResumePoint Saved point
+     * @return true on a hit, false on a miss or error
+     */
+    bool LookupResumePoint(const FileMetadata& metadata, HashAlgorithm algorithm, HashResumePoint& outputResumePoint);
+
+    /**
+     * @brief Save the resume point of a file identity, replacing the one saved before.
+     *
+     * @param[in] metadata Metadata of the file; only device and inode are used
+     * @param[in] resumePoint Point to save
+     * @return true on success, false on error
+     */
+    bool StoreResumePoint(const FileMetadata& metadata, const HashResumePoint& resumePoint);
+
+  private:
+    SQLiteConnection& AcquireConnection();
+
+    SQLiteSession& _databaseSession;
+    std::mutex _connectionsMutex;
+    std::unordered_set<const SQLiteConnection*> _tunedConnections;
+};
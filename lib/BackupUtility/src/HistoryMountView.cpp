@@ -0,0 +1,383 @@
+// file HistoryMountView.cpp:
+
+#include "HistoryMountView.hpp"
+
+#include "FileEncryptor/FileEncryptor.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <system_error>
+
+namespace
+{
+constexpr std::uint32_t DirectoryMode = 0555;
+constexpr std::uint32_t DefaultFileMode = 0444;
+constexpr std::uint32_t ReadAndExecuteBits = 0555;
+}
+
+HistoryMountView::HistoryMountView(const std::filesystem::path& backupRoot, FileStateRepository& fileStateRepository, PackStore& packStore,
+                                   const ProcessRestoreFile& processRestoreFile, const std::filesystem::path& stagingDir, std::size_t cacheBlocks)
+    : _backupRoot(backupRoot), _fileStateRepository(fileStateRepository), _packStore(packStore), _processRestoreFile(processRestoreFile),
+      _stagingDir(stagingDir), _cacheBlocks(std::max<std::size_t>(1, cacheBlocks)), _blockHits(0), _blockMisses(0), _filesRebuilt(0)
+{
+}
+
+bool HistoryMountView::LoadPoints()
+{
+    std::vector<BackupRunRecord> runs;
+    std::vector<std::string> snapshots;
+    if ((false == _fileStateRepository.GetRuns(runs)) || (false == _fileStateRepository.GetSnapshotNames(snapshots)))
+    {
+        return false;
+    }
+    // A resumed run keeps its start, and the snapshot of a run is named after it, so names repeat.
+    std::set<std::string> points(snapshots.begin(), snapshots.end());
+    for (const BackupRunRecord& run : runs)
+    {
+        points.insert(run.started);
+    }
+    points.erase(HistoryMount::LatestName);
+    _points.assign(points.begin(), points.end());
+    return true;
+}
+
+bool HistoryMountView::Stat(const std::string& path, HistoryMountEntry& outputEntry)
+{
+    outputEntry = HistoryMountEntry{true, 0, 0, DirectoryMode};
+    ViewPath viewPath;
+    if (false == SplitPath(path, viewPath))
+    {
+        return false;
+    }
+    if (true == viewPath.point.empty())
+    {
+        return true;
+    }
+    if (false == HasPoint(viewPath.point))
+    {
+        return false;
+    }
+    if (true == viewPath.relative.empty())
+    {
+        return true;
+    }
+
+    std::shared_ptr<const PlannedTree> tree;
+    if (false == GetTree(viewPath.point, tree))
+    {
+        return false;
+    }
+    const auto item = tree->items.find(viewPath.relative);
+    if (tree->items.end() == item)
+    {
+        return tree->directories.end() != tree->directories.find(viewPath.relative);
+    }
+
+    outputEntry.directory = false;
+    outputEntry.size = item->second.size;
+    outputEntry.mode = DefaultFileMode;
+    if (true == item->second.hasMetadata)
+    {
+        outputEntry.modificationTimeNs = item->second.metadata.modificationTimeNs;
+        if (0 != item->second.metadata.mode)
+        {
+            outputEntry.mode = item->second.metadata.mode & ReadAndExecuteBits;
+        }
+    }
+    // The history records the content size of its versions; a plain copy has it as its own size.
+    const bool storedInPlain = (RestoreSource::Backup == item->second.source) || (RestoreSource::Plain == item->second.source);
+    if ((true == item->second.hasDigest) || ((true == storedInPlain) && (false == FileEncryptor::IsEncrypted(item->second.storedPath))))
+    {
+        return true;
+    }
+    std::filesystem::path content;
+    std::error_code ec;
+    if (false == ResolveContent(viewPath.point, viewPath.relative, item->second, content))
+    {
+        return false;
+    }
+    const std::uintmax_t size = std::filesystem::file_size(content, ec);
+    outputEntry.size = (0 == ec.value()) ? static_cast<std::uint64_t>(size) : 0;
+    return 0 == ec.value();
+}
+
+bool HistoryMountView::List(const std::string& path, std::vector<std::string>& outputNames)
+{
+    outputNames.clear();
+    ViewPath viewPath;
+    if (false == SplitPath(path, viewPath))
+    {
+        return false;
+    }
+    if (true == viewPath.point.empty())
+    {
+        outputNames = _points;
+        outputNames.insert(std::upper_bound(outputNames.begin(), outputNames.end(), HistoryMount::LatestName), HistoryMount::LatestName);
+        return true;
+    }
+    if (false == HasPoint(viewPath.point))
+    {
+        return false;
+    }
+
+    std::shared_ptr<const PlannedTree> tree;
+    if (false == GetTree(viewPath.point, tree))
+    {
+        return false;
+    }
+    const auto directory = tree->directories.find(viewPath.relative);
+    if (tree->directories.end() != directory)
+    {
+        outputNames = directory->second;
+        return true;
+    }
+    // An empty tree still has its root.
+    return true == viewPath.relative.empty();
+}
+
+bool HistoryMountView::Read(const std::string& path, std::uint64_t offset, std::size_t size, char* buffer, std::size_t& outputRead)
+{
+    outputRead = 0;
+    ViewPath viewPath;
+    std::shared_ptr<const PlannedTree> tree;
+    if ((false == SplitPath(path, viewPath)) || (true == viewPath.point.empty()) || (true == viewPath.relative.empty()) ||
+        (false == HasPoint(viewPath.point)) || (false == GetTree(viewPath.point, tree)))
+    {
+        return false;
+    }
+    const auto item = tree->items.find(viewPath.relative);
+    std::filesystem::path content;
+    if ((tree->items.end() == item) || (false == ResolveContent(viewPath.point, viewPath.relative, item->second, content)))
+    {
+        return false;
+    }
+
+    while (outputRead < size)
+    {
+        const std::uint64_t position = offset + outputRead;
+        const std::size_t within = static_cast<std::size_t>(position % HistoryMount::BlockSize);
+        std::shared_ptr<const std::string> block;
+        if (false == ReadBlock(content, position / HistoryMount::BlockSize, block))
+        {
+            return false;
+        }
+        if (within >= block->size())
+        {
+            break;
+        }
+        const std::size_t copied = std::min(size - outputRead, block->size() - within);
+        std::memcpy(buffer + outputRead, block->data() + within, copied);
+        outputRead += copied;
+        // Only the last block of a file is short.
+        if (HistoryMount::BlockSize > block->size())
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+HistoryMountCounters HistoryMountView::Counters() const
+{
+    return HistoryMountCounters{_blockHits.load(), _blockMisses.load(), _filesRebuilt.load()};
+}
+
+/**
+ * @brief Split an absolute path of the view into its point in time and the path within that tree.
+ *
+ * @param[in] path Absolute path, `/` being the root of the view; a trailing `/` is ignored
+ * @param[out] outputPath Point in time and relative path
+ * @return true if the path is absolute, false otherwise
+ */
+bool HistoryMountView::SplitPath(const std::string& path, ViewPath& outputPath)
+{
+    outputPath = ViewPath{};
+    if ((true == path.empty()) || ('/' != path.front()))
+    {
+        return false;
+    }
+    std::string trimmed = path.substr(1);
+    while ((false == trimmed.empty()) && ('/' == trimmed.back()))
+    {
+        trimmed.pop_back();
+    }
+    const std::size_t separator = trimmed.find('/');
+    outputPath.point = trimmed.substr(0, separator);
+    if (std::string::npos != separator)
+    {
+        outputPath.relative = trimmed.substr(separator + 1);
+    }
+    return true;
+}
+
+/**
+ * @brief Check whether a name is one of the points in time.
+ *
+ * @param[in] point Name of a directory in the root of the view
+ * @return true for a listed point or LatestName, false otherwise
+ */
+bool HistoryMountView::HasPoint(const std::string& point) const
+{
+    return (HistoryMount::LatestName == point) || (true == std::binary_search(_points.begin(), _points.end(), point));
+}
+
+/**
+ * @brief Get the tree of a point in time, planning it if it is not among the recently used ones.
+ *
+ * @param[in] point Name of the point in time
+ * @param[out] outputTree Planned tree, shared so evicting it does not pull it from under a reader
+ * @return true on success, false if the tree cannot be planned
+ */
+bool HistoryMountView::GetTree(const std::string& point, std::shared_ptr<const PlannedTree>& outputTree)
+{
+    // Planning holds the lock, so concurrent first lookups of one point plan it once.
+    std::lock_guard<std::mutex> lock(_treeMutex);
+    for (auto tree = _trees.begin(); _trees.end() != tree; ++tree)
+    {
+        if (point == tree->first)
+        {
+            _trees.splice(_trees.begin(), _trees, tree);
+            outputTree = _trees.front().second;
+            return true;
+        }
+    }
+
+    auto planned = std::make_shared<PlannedTree>();
+    RestorePlanner planner(_backupRoot, _fileStateRepository, _packStore);
+    if (false == planner.Build((HistoryMount::LatestName == point) ? std::string() : point, planned->items))
+    {
+        return false;
+    }
+    for (const auto& entry : planned->items)
+    {
+        std::size_t start = 0;
+        for (std::size_t separator = entry.first.find('/'); std::string::npos != separator; separator = entry.first.find('/', start))
+        {
+            planned->directories[entry.first.substr(0, (0 == start) ? 0 : start - 1)].push_back(entry.first.substr(start, separator - start));
+            start = separator + 1;
+        }
+        planned->directories[entry.first.substr(0, (0 == start) ? 0 : start - 1)].push_back(entry.first.substr(start));
+    }
+    for (auto& directory : planned->directories)
+    {
+        std::sort(directory.second.begin(), directory.second.end());
+        directory.second.erase(std::unique(directory.second.begin(), directory.second.end()), directory.second.end());
+    }
+
+    _trees.emplace_front(point, std::move(planned));
+    if (MaxPlannedTrees < _trees.size())
+    {
+        _trees.pop_back();
+    }
+    outputTree = _trees.front().second;
+    return true;
+}
+
+/**
+ * @brief Get the file holding the content of a version, rebuilding it on first use.
+ *
+ * @param[in] point Name of the point in time
+ * @param[in] relativeKey Path of the file relative to the source root
+ * @param[in] item Stored version of the file
+ * @param[out] outputContent Stored copy or staging file holding the content
+ * @return true on success, false if the version cannot be rebuilt or fails its check
+ */
+bool HistoryMountView::ResolveContent(const std::string& point, const std::string& relativeKey, const RestoreItem& item,
+                                      std::filesystem::path& outputContent)
+{
+    if (((RestoreSource::Backup == item.source) || (RestoreSource::Plain == item.source)) && (false == FileEncryptor::IsEncrypted(item.storedPath)))
+    {
+        outputContent = item.storedPath;
+        return true;
+    }
+
+    std::shared_ptr<RebuiltFile> rebuilt;
+    {
+        std::lock_guard<std::mutex> lock(_rebuildMutex);
+        std::shared_ptr<RebuiltFile>& slot = _rebuilt[point + '/' + relativeKey];
+        if (nullptr == slot)
+        {
+            slot = std::make_shared<RebuiltFile>();
+            slot->path = _stagingDir / point / relativeKey;
+        }
+        rebuilt = slot;
+    }
+    // Other files rebuild in parallel; readers of this one wait for its rebuild.
+    std::lock_guard<std::mutex> lock(rebuilt->mutex);
+    if (false == rebuilt->rebuilt)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(rebuilt->path.parent_path(), ec);
+        if (false == _processRestoreFile.Stage(item, rebuilt->path))
+        {
+            std::filesystem::remove(rebuilt->path, ec);
+            return false;
+        }
+        rebuilt->rebuilt = true;
+        _filesRebuilt.fetch_add(1, std::memory_order_relaxed);
+    }
+    outputContent = rebuilt->path;
+    return true;
+}
+
+/**
+ * @brief Get one block of a file from the cache, reading it on a miss.
+ *
+ * @param[in] content File to read
+ * @param[in] block Index of the block
+ * @param[out] outputBlock Bytes of the block, shorter than a block at the end of the file and empty past it
+ * @return true on success, false if the file cannot be read
+ */
+bool HistoryMountView::ReadBlock(const std::filesystem::path& content, std::uint64_t block, std::shared_ptr<const std::string>& outputBlock)
+{
+    const std::string key = content.string() + '\n' + std::to_string(block);
+    {
+        std::lock_guard<std::mutex> lock(_cacheMutex);
+        const auto cached = _blockIndex.find(key);
+        if (_blockIndex.end() != cached)
+        {
+            _blocks.splice(_blocks.begin(), _blocks, cached->second);
+            outputBlock = cached->second->second;
+            _blockHits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Read without the lock, so a slow read does not hold up hits on other blocks.
+    std::ifstream input(content, std::ios::binary);
+    if (false == input.is_open())
+    {
+        return false;
+    }
+    auto bytes = std::make_shared<std::string>(HistoryMount::BlockSize, '\0');
+    input.seekg(static_cast<std::streamoff>(block * HistoryMount::BlockSize));
+    if (true == input.good())
+    {
+        input.read(&(*bytes)[0], static_cast<std::streamsize>(bytes->size()));
+    }
+    bytes->resize(static_cast<std::size_t>(std::max<std::streamsize>(0, input.gcount())));
+    if (true == input.bad())
+    {
+        return false;
+    }
+    _blockMisses.fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(_cacheMutex);
+    const auto cached = _blockIndex.find(key);
+    if (_blockIndex.end() != cached)
+    {
+        outputBlock = cached->second->second;
+        return true;
+    }
+    _blocks.emplace_front(key, std::move(bytes));
+    _blockIndex.emplace(key, _blocks.begin());
+    if (_cacheBlocks < _blocks.size())
+    {
+        _blockIndex.erase(_blocks.back().first);
+        _blocks.pop_back();
+    }
+    outputBlock = _blocks.front().second;
+    return true;
+}
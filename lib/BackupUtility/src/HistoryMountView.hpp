@@ -0,0 +1,154 @@
+// file HistoryMountView.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "FileStateRepository.hpp"
+#include "PackStore.hpp"
+#include "ProcessRestoreFile.hpp"
+#include "RestorePlanner.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Application component mapping paths of the mounted history to planned trees and their content.
+ *
+ * The tree of a point in time is planned on first access and kept with the directory listing built
+ * from its paths; only the most recently used trees stay planned. A file whose version is a plain,
+ * unencrypted copy is read where it is stored. Any other version is rebuilt and checked into a staging
+ * file once, on its first read or when its size is not recorded, and read from there afterwards. Blocks
+ * read from either go through an LRU cache shared by all files.
+ */
+class HistoryMountView
+{
+  public:
+    /**
+     * @brief Trees kept planned at once.
+     */
+    static constexpr std::size_t MaxPlannedTrees = 4;
+
+    /**
+     * @brief Construct a view.
+     *
+     * @param[in] backupRoot Root directory of the backup storage
+     * @param[in] fileStateRepository Repository of the backup's file states
+     * @param[in] packStore Index of the pack segments
+     * @param[in] processRestoreFile Rebuilds and checks versions that are not stored in plain
+     * @param[in] stagingDir Directory rebuilt versions are kept in, created on demand
+     * @param[in] cacheBlocks Blocks of HistoryMount::BlockSize the cache keeps, at least 1
+     */
+    HistoryMountView(const std::filesystem::path& backupRoot, FileStateRepository& fileStateRepository, PackStore& packStore,
+                     const ProcessRestoreFile& processRestoreFile, const std::filesystem::path& stagingDir, std::size_t cacheBlocks);
+
+    /**
+     * @brief List the points in time: every run and every recorded snapshot.
+     *
+     * @return true on success, false if the runs or snapshots cannot be read
+     */
+    bool LoadPoints();
+
+    /**
+     * @brief Get the attributes of a path.
+     *
+     * @param[in] path Absolute path within the view
+     * @param[out] outputEntry Attributes of the path
+     * @return true if the path exists, false otherwise
+     */
+    bool Stat(const std::string& path, HistoryMountEntry& outputEntry);
+
+    /**
+     * @brief List a directory.
+     *
+     * @param[in] path Absolute path of a directory within the view
+     * @param[out] outputNames Names of its entries in ascending order
+     * @return true if the path is a directory, false otherwise
+     */
+    bool List(const std::string& path, std::vector<std::string>& outputNames);
+
+    /**
+     * @brief Read part of a file.
+     *
+     * @param[in] path Absolute path of a file within the view
+     * @param[in] offset First byte to read
+     * @param[in] size Bytes to read at most
+     * @param[out] buffer Receives the bytes, at least size long
+     * @param[out] outputRead Bytes read, fewer than size only at the end of the file
+     * @return true on success, false if the path is not a file or its version cannot be read or rebuilt
+     */
+    bool Read(const std::string& path, std::uint64_t offset, std::size_t size, char* buffer, std::size_t& outputRead);
+
+    /**
+     * @brief Get the counters of the reads served so far.
+     *
+     * @return Counters since construction
+     */
+    HistoryMountCounters Counters() const;
+
+  private:
+    /**
+     * @brief Tree of one point in time.
+     */
+    struct PlannedTree
+    {
+        std::unordered_map<std::string, RestoreItem> items;                    /**< Files keyed by their path relative to the source root */
+        std::unordered_map<std::string, std::vector<std::string>> directories; /**< Sorted entry names keyed by directory, "" for the root */
+    };
+
+    /**
+     * @brief A path of the view split into its point in time and the path within that tree.
+     */
+    struct ViewPath
+    {
+        std::string point;    /**< Name of the point in time, empty for the root of the view */
+        std::string relative; /**< Path relative to the source root, empty for the root of the tree */
+    };
+
+    /**
+     * @brief Staging file of one rebuilt version; its mutex makes concurrent first reads rebuild it once.
+     */
+    struct RebuiltFile
+    {
+        std::mutex mutex;           /**< Held while the version is rebuilt */
+        bool rebuilt = false;       /**< path holds the checked content */
+        std::filesystem::path path; /**< Staging file */
+    };
+
+    static bool SplitPath(const std::string& path, ViewPath& outputPath);
+    bool HasPoint(const std::string& point) const;
+    bool GetTree(const std::string& point, std::shared_ptr<const PlannedTree>& outputTree);
+    bool ResolveContent(const std::string& point, const std::string& relativeKey, const RestoreItem& item, std::filesystem::path& outputContent);
+    bool ReadBlock(const std::filesystem::path& content, std::uint64_t block, std::shared_ptr<const std::string>& outputBlock);
+
+    const std::filesystem::path& _backupRoot;
+    FileStateRepository& _fileStateRepository;
+    PackStore& _packStore;
+    const ProcessRestoreFile& _processRestoreFile;
+    std::filesystem::path _stagingDir;
+    std::vector<std::string> _points;
+
+    std::mutex _treeMutex;
+    std::list<std::pair<std::string, std::shared_ptr<const PlannedTree>>> _trees;
+
+    std::mutex _rebuildMutex;
+    std::map<std::string, std::shared_ptr<RebuiltFile>> _rebuilt;
+
+    std::mutex _cacheMutex;
+    std::size_t _cacheBlocks;
+    std::list<std::pair<std::string, std::shared_ptr<const std::string>>> _blocks;
+    std::unordered_map<std::string, std::list<std::pair<std::string, std::shared_ptr<const std::string>>>::iterator> _blockIndex;
+
+    std::atomic<std::uint64_t> _blockHits;
+    std::atomic<std::uint64_t> _blockMisses;
+    std::atomic<std::uint64_t> _filesRebuilt;
+};
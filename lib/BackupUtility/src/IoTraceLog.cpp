@@ -0,0 +1,228 @@
+// file IoTraceLog.cpp:
+
+#include "IoTraceLog.hpp"
+
+#include <sstream>
+
+namespace
+{
+constexpr const char* TraceHeader = "rdemo-io-trace\t1";
+constexpr std::size_t FlushThreshold = 64 * 1024; /**< Buffered bytes at which a thread appends its lines to the file */
+constexpr char KeySeparator = static_cast<char>(std::filesystem::path::preferred_separator);
+
+std::uint64_t ElapsedNs(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    return (start < end) ? static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) : 0;
+}
+} // namespace
+
+IoTraceLog::ThreadLog::ThreadLog(IoTraceLog& log, std::size_t threadIndex) : _log(log), _threadIndex(threadIndex), _lastFileId(0)
+{
+}
+
+void IoTraceLog::ThreadLog::Record(const char* name, const std::filesystem::path* file, std::chrono::steady_clock::time_point start,
+                                   std::chrono::steady_clock::time_point end)
+{
+    const std::uint64_t fileId = (nullptr != file) ? FileId(*file) : 0;
+    _buffer += "E\t";
+    _buffer += std::to_string(_threadIndex);
+    _buffer += '\t';
+    _buffer += std::to_string(ElapsedNs(_log._start, start));
+    _buffer += '\t';
+    _buffer += std::to_string(ElapsedNs(start, end));
+    _buffer += '\t';
+    _buffer += std::to_string(fileId);
+    _buffer += '\t';
+    _buffer += name;
+    _buffer += '\n';
+    if (FlushThreshold <= _buffer.size())
+    {
+        _log.Append(_buffer);
+    }
+}
+
+void IoTraceLog::ThreadLog::RecordFile(const std::filesystem::path& file, const std::string& relativeKey, std::uint64_t size, ChangeType status)
+{
+    const std::uint64_t fileId = FileId(file);
+    const std::size_t separator = relativeKey.rfind(KeySeparator);
+    const std::uint64_t directoryId =
+        (std::string::npos == separator) ? 0 : _log.DirectoryId(std::string_view(relativeKey).substr(0, separator), _buffer);
+    _buffer += "F\t";
+    _buffer += std::to_string(fileId);
+    _buffer += '\t';
+    _buffer += std::to_string(directoryId);
+    _buffer += '\t';
+    _buffer += std::to_string(size);
+    _buffer += '\t';
+    _buffer += ChangeTypeToString(status);
+    _buffer += '\n';
+    if (FlushThreshold <= _buffer.size())
+    {
+        _log.Append(_buffer);
+    }
+}
+
+/**
+ * @brief Get the number of a file, asking the shared table only when the thread moved on to another file.
+ *
+ * @param[in] file Source file
+ * @return Number of the file, from 1
+ */
+std::uint64_t IoTraceLog::ThreadLog::FileId(const std::filesystem::path& file)
+{
+    if ((0 == _lastFileId) || (_lastFile != file.native()))
+    {
+        _lastFile = file.native();
+        _lastFileId = _log.FileId(file);
+    }
+    return _lastFileId;
+}
+
+IoTraceLog::IoTraceLog(const std::filesystem::path& traceFile) : _start(std::chrono::steady_clock::now()), _stream(traceFile, std::ios::trunc)
+{
+    _stream << TraceHeader << '\n';
+}
+
+bool IoTraceLog::IsOpen() const
+{
+    return _stream.is_open();
+}
+
+IoTraceLog::ThreadLog& IoTraceLog::Current()
+{
+    std::lock_guard<std::mutex> lock(_threadsMutex);
+    std::unique_ptr<ThreadLog>& thread = _threads[std::this_thread::get_id()];
+    if (nullptr == thread)
+    {
+        // The map already holds the new entry, so the first thread is numbered 1.
+        thread = std::make_unique<ThreadLog>(*this, _threads.size());
+    }
+    return *thread;
+}
+
+bool IoTraceLog::Close()
+{
+    {
+        std::lock_guard<std::mutex> lock(_threadsMutex);
+        for (auto& entry : _threads)
+        {
+            Append(entry.second->_buffer);
+        }
+    }
+    std::lock_guard<std::mutex> lock(_streamMutex);
+    if (false == _stream.is_open())
+    {
+        return false;
+    }
+    _stream.close();
+    return false == _stream.fail();
+}
+
+bool IoTraceLog::Read(const std::filesystem::path& traceFile, IoTrace& outputTrace)
+{
+    outputTrace = IoTrace{};
+    std::ifstream inputStream(traceFile);
+    std::string line;
+    if ((false == static_cast<bool>(std::getline(inputStream, line))) || (TraceHeader != line))
+    {
+        return false;
+    }
+    while (true == static_cast<bool>(std::getline(inputStream, line)))
+    {
+        if (true == line.empty())
+        {
+            continue;
+        }
+        std::istringstream fields(line.substr(1));
+        if ('D' == line.front())
+        {
+            std::uint64_t id = 0;
+            std::uint64_t parent = 0;
+            if (false == static_cast<bool>(fields >> id >> parent))
+            {
+                return false;
+            }
+            outputTrace.directories[id] = parent;
+        }
+        else if ('F' == line.front())
+        {
+            std::uint64_t id = 0;
+            IoTrace::File file{};
+            std::string status;
+            if (false == static_cast<bool>(fields >> id >> file.directory >> file.size >> status))
+            {
+                return false;
+            }
+            file.status = StringToChangeType(status);
+            outputTrace.files[id] = file;
+        }
+        else if ('E' == line.front())
+        {
+            IoTrace::Event event{};
+            if (false == static_cast<bool>(fields >> event.thread >> event.startNs >> event.durationNs >> event.file >> event.name))
+            {
+                return false;
+            }
+            outputTrace.events.push_back(std::move(event));
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Get the number of a file from the shared table, numbering it on first use.
+ *
+ * @param[in] file Source file
+ * @return Number of the file, from 1
+ */
+std::uint64_t IoTraceLog::FileId(const std::filesystem::path& file)
+{
+    std::lock_guard<std::mutex> lock(_idsMutex);
+    return _fileIds.emplace(file.native(), _fileIds.size() + 1).first->second;
+}
+
+/**
+ * @brief Get the number of a directory, numbering it and the directories above it on first use.
+ *
+ * @param[in] relativeDirectory Directory relative to the source root, not empty
+ * @param[in,out] outputLines Buffer the `D` lines of newly numbered directories are appended to
+ * @return Number of the directory, from 1
+ */
+std::uint64_t IoTraceLog::DirectoryId(std::string_view relativeDirectory, std::string& outputLines)
+{
+    std::lock_guard<std::mutex> lock(_idsMutex);
+    std::uint64_t parentId = 0;
+    std::size_t end = 0;
+    while (end < relativeDirectory.size())
+    {
+        end = relativeDirectory.find(KeySeparator, end + 1);
+        end = (std::string_view::npos == end) ? relativeDirectory.size() : end;
+        const auto inserted = _directoryIds.emplace(std::string(relativeDirectory.substr(0, end)), _directoryIds.size() + 1);
+        if (true == inserted.second)
+        {
+            outputLines += "D\t";
+            outputLines += std::to_string(inserted.first->second);
+            outputLines += '\t';
+            outputLines += std::to_string(parentId);
+            outputLines += '\n';
+        }
+        parentId = inserted.first->second;
+    }
+    return parentId;
+}
+
+/**
+ * @brief Append a thread's buffered lines to the file and empty the buffer.
+ *
+ * @param[in,out] buffer Buffered lines
+ */
+void IoTraceLog::Append(std::string& buffer)
+{
+    std::lock_guard<std::mutex> lock(_streamMutex);
+    _stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    buffer.clear();
+}
@@ -0,0 +1,172 @@
+// file IoTraceLog.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Content of an I/O trace file, as read back by IoTraceLog::Read.
+ */
+struct IoTrace
+{
+    /**
+     * @brief One file the run processed.
+     */
+    struct File
+    {
+        std::uint64_t directory; /**< Id of the directory holding it, 0 for the source root */
+        std::uint64_t size;      /**< Size in bytes */
+        ChangeType status;       /**< Outcome of the file in the run */
+    };
+
+    /**
+     * @brief One timed operation.
+     */
+    struct Event
+    {
+        std::uint64_t thread;     /**< Number of the thread that did it, from 1 */
+        std::uint64_t startNs;    /**< Start, relative to the start of the trace */
+        std::uint64_t durationNs; /**< Length of the operation */
+        std::uint64_t file;       /**< Id of the file it was done for, 0 for none */
+        std::string name;         /**< Operation name */
+    };
+
+    std::unordered_map<std::uint64_t, std::uint64_t> directories; /**< Parent id of each directory id; the source root, id 0, is not listed */
+    std::unordered_map<std::uint64_t, File> files;                /**< Files by id */
+    std::vector<Event> events;                                    /**< Operations in the order they were written, not sorted by time */
+};
+
+/**
+ * @brief Records every timed file system and database operation of a backup run to a text file, for replay in the lab.
+ *
+ * Paths are not written: each file and directory gets a number, and the trace only keeps the shape of the
+ * tree, the size and outcome of every file and the name, thread, start and duration of every operation.
+ * It can therefore leave a customer's machine without their data. Each thread formats its lines into its
+ * own buffer and appends the buffer to the file under a lock once it is full, so unlike BackupTrace no
+ * event is dropped. Numbering a file takes a lock, once per file and thread.
+ *
+ * The file starts with the line `rdemo-io-trace<TAB>1`. The lines after it are tab separated:
+ * `D id parent` for a directory, `F id directory size status` for a processed file and
+ * `E thread startNs durationNs file name` for an operation, with file 0 for operations not done for one file.
+ */
+class IoTraceLog
+{
+  public:
+    /**
+     * @brief Buffer of the lines recorded by one thread.
+     */
+    class ThreadLog
+    {
+      public:
+        /**
+         * @brief Construct an empty buffer.
+         *
+         * @param[in,out] log Trace the buffer is appended to
+         * @param[in] threadIndex Number the thread is written under
+         */
+        ThreadLog(IoTraceLog& log, std::size_t threadIndex);
+
+        /**
+         * @brief Record an operation.
+         *
+         * @param[in] name Static operation name
+         * @param[in] file Source file the operation was done for, nullptr for none
+         * @param[in] start Start of the operation
+         * @param[in] end End of the operation
+         */
+        void Record(const char* name, const std::filesystem::path* file, std::chrono::steady_clock::time_point start,
+                    std::chrono::steady_clock::time_point end);
+
+        /**
+         * @brief Record the size and outcome of a processed file.
+         *
+         * @param[in] file Source file
+         * @param[in] relativeKey State key of the file, whose directories give the shape of the tree
+         * @param[in] size Size in bytes
+         * @param[in] status Outcome of the file
+         */
+        void RecordFile(const std::filesystem::path& file, const std::string& relativeKey, std::uint64_t size, ChangeType status);
+
+      private:
+        friend class IoTraceLog;
+
+        std::uint64_t FileId(const std::filesystem::path& file);
+
+        IoTraceLog& _log;
+        std::size_t _threadIndex;
+        std::string _buffer;
+        std::string _lastFile;
+        std::uint64_t _lastFileId;
+    };
+
+    /**
+     * @brief Create or truncate the trace file and write its header.
+     *
+     * @param[in] traceFile File to write
+     */
+    explicit IoTraceLog(const std::filesystem::path& traceFile);
+
+    IoTraceLog(const IoTraceLog&) = delete;
+    IoTraceLog& operator=(const IoTraceLog&) = delete;
+
+    /**
+     * @brief Check whether the trace file could be created.
+     *
+     * @return true if operations can be recorded
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Get the buffer of the calling thread, creating it on first use.
+     *
+     * Looking it up takes a lock, so callers fetch it once per thread.
+     *
+     * @return Buffer only written by the calling thread
+     */
+    ThreadLog& Current();
+
+    /**
+     * @brief Append what every thread still buffers, then flush and close the file.
+     *
+     * Only valid once the recording threads have stopped.
+     *
+     * @return true if every line was written, false otherwise
+     */
+    bool Close();
+
+    /**
+     * @brief Read a trace file.
+     *
+     * @param[in] traceFile File written by an IoTraceLog
+     * @param[out] outputTrace Directories, files and operations of the trace
+     * @return true on success, false if the file cannot be read or is not an I/O trace
+     */
+    static bool Read(const std::filesystem::path& traceFile, IoTrace& outputTrace);
+
+  private:
+    std::uint64_t FileId(const std::filesystem::path& file);
+    std::uint64_t DirectoryId(std::string_view relativeDirectory, std::string& outputLines);
+    void Append(std::string& buffer);
+
+    std::chrono::steady_clock::time_point _start;
+    std::mutex _streamMutex;
+    std::ofstream _stream;
+    std::mutex _idsMutex;
+    std::unordered_map<std::string, std::uint64_t> _fileIds;
+    std::unordered_map<std::string, std::uint64_t> _directoryIds;
+    std::mutex _threadsMutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadLog>> _threads;
+};
@@ -0,0 +1,200 @@
+// file IoTraceReplay.cpp:
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "IoTraceLog.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace
+{
+constexpr std::size_t FillBufferSize = 1024 * 1024;
+constexpr const char* ReplayTraceName = "replay.iotrace";
+
+/**
+ * @brief Build the generated path of a directory of the trace, naming each directory d<id>.
+ *
+ * @param[in] trace Trace holding the directory
+ * @param[in] directory Directory id, 0 for the source root
+ * @param[in] root Root of the generated tree
+ * @param[in,out] paths Paths built so far, by directory id
+ * @param[out] outputPath Path of the directory
+ * @return true on success, false if the directory or one above it is missing from the trace or the parents form a loop
+ */
+bool BuildDirectoryPath(const IoTrace& trace, std::uint64_t directory, const std::filesystem::path& root,
+                        std::map<std::uint64_t, std::filesystem::path>& paths, std::filesystem::path& outputPath)
+{
+    std::vector<std::uint64_t> chain;
+    std::uint64_t current = directory;
+    while ((0 != current) && (paths.end() == paths.find(current)))
+    {
+        const auto parent = trace.directories.find(current);
+        if ((trace.directories.end() == parent) || (trace.directories.size() < chain.size()))
+        {
+            return false;
+        }
+        chain.push_back(current);
+        current = parent->second;
+    }
+    std::filesystem::path path = (0 == current) ? root : paths[current];
+    for (auto id = chain.rbegin(); chain.rend() != id; ++id)
+    {
+        path /= "d" + std::to_string(*id);
+        paths[*id] = path;
+    }
+    outputPath = path;
+    return true;
+}
+
+/**
+ * @brief Write a file of pseudo-random bytes, different for every seed.
+ *
+ * @param[in] file File to create or replace
+ * @param[in] size Size in bytes
+ * @param[in] seed Seed of the content
+ * @param[in,out] buffer Buffer the content is generated in
+ * @return true on success, false on a write error
+ */
+bool WriteGeneratedFile(const std::filesystem::path& file, std::uint64_t size, std::uint64_t seed, std::vector<std::uint64_t>& buffer)
+{
+    std::ofstream outputStream(file, std::ios::binary | std::ios::trunc);
+    std::uint64_t state = seed;
+    std::uint64_t written = 0;
+    while ((true == outputStream.good()) && (written < size))
+    {
+        for (std::uint64_t& word : buffer)
+        {
+            // splitmix64
+            std::uint64_t value = (state += 0x9E3779B97F4A7C15ULL);
+            value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+            word = value ^ (value >> 31);
+        }
+        const std::uint64_t length = std::min<std::uint64_t>(size - written, buffer.size() * sizeof(std::uint64_t));
+        outputStream.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(length));
+        written += length;
+    }
+    outputStream.close();
+    return false == outputStream.fail();
+}
+
+/**
+ * @brief Add the operations of a trace to the per-name totals.
+ *
+ * @param[in] trace Trace to add
+ * @param[in] replayed Whether the trace is the replay's, counted in the replayed columns
+ * @param[in,out] operations Totals by name
+ */
+void AddOperations(const IoTrace& trace, bool replayed, std::map<std::string, IoTraceOperation>& operations)
+{
+    for (const IoTrace::Event& event : trace.events)
+    {
+        IoTraceOperation& operation = operations[event.name];
+        operation.name = event.name;
+        if (true == replayed)
+        {
+            ++operation.replayedCount;
+            operation.replayedNs += event.durationNs;
+        }
+        else
+        {
+            ++operation.recordedCount;
+            operation.recordedNs += event.durationNs;
+        }
+    }
+}
+} // namespace
+
+bool ReplayIoTrace(const std::filesystem::path& traceFile, const BackupConfig& configuration, IoTraceReplayReport& outputReport)
+{
+    outputReport = IoTraceReplayReport{};
+    std::error_code ec;
+    IoTrace recorded;
+    if ((false == IoTraceLog::Read(traceFile, recorded)) || (true == configuration.sourceDir.empty()) ||
+        (false == std::filesystem::is_directory(configuration.sourceDir, ec)) || (false == std::filesystem::is_empty(configuration.sourceDir, ec)))
+    {
+        return false;
+    }
+
+    std::set<std::uint64_t> threads;
+    std::uint64_t firstNs = UINT64_MAX;
+    std::uint64_t lastNs = 0;
+    for (const IoTrace::Event& event : recorded.events)
+    {
+        threads.insert(event.thread);
+        firstNs = std::min(firstNs, event.startNs);
+        lastNs = std::max(lastNs, event.startNs + event.durationNs);
+    }
+    outputReport.recordedThreads = threads.size();
+    outputReport.recordedSeconds = (firstNs < lastNs) ? (static_cast<double>(lastNs - firstNs) / 1e9) : 0.0;
+
+    // The tree holds what the recorded run found before it started: every file except the added ones.
+    std::map<std::uint64_t, std::filesystem::path> directoryPaths;
+    std::map<std::uint64_t, std::filesystem::path> filePaths;
+    std::vector<std::uint64_t> buffer(FillBufferSize / sizeof(std::uint64_t));
+    for (const auto& entry : std::map<std::uint64_t, IoTrace::File>(recorded.files.begin(), recorded.files.end()))
+    {
+        std::filesystem::path directory;
+        if (false == BuildDirectoryPath(recorded, entry.second.directory, configuration.sourceDir, directoryPaths, directory))
+        {
+            return false;
+        }
+        std::filesystem::create_directories(directory, ec);
+        filePaths[entry.first] = directory / ("f" + std::to_string(entry.first));
+        if ((ChangeType::Added != entry.second.status) && (false == WriteGeneratedFile(filePaths[entry.first], entry.second.size, entry.first * 2, buffer)))
+        {
+            return false;
+        }
+        outputReport.bytes += entry.second.size;
+    }
+    outputReport.directories = directoryPaths.size();
+    outputReport.files = filePaths.size();
+
+    BackupConfig seedConfiguration = configuration;
+    seedConfiguration.ioTraceFile.clear();
+    seedConfiguration.traceFile.clear();
+    seedConfiguration.metricsFile.clear();
+    seedConfiguration.slowOperationLog.clear();
+    seedConfiguration.statusSegment.clear();
+    seedConfiguration.onProgress = nullptr;
+    BackupStats seedStats{};
+    if (false == RunBackup(seedConfiguration, seedStats))
+    {
+        return false;
+    }
+
+    for (const auto& entry : recorded.files)
+    {
+        const bool modified = (ChangeType::Modified == entry.second.status);
+        if (((true == modified) || (ChangeType::Added == entry.second.status)) &&
+            (false == WriteGeneratedFile(filePaths[entry.first], entry.second.size, (entry.first * 2) + ((true == modified) ? 1 : 0), buffer)))
+        {
+            return false;
+        }
+    }
+
+    BackupConfig replayConfiguration = configuration;
+    if (true == replayConfiguration.ioTraceFile.empty())
+    {
+        replayConfiguration.ioTraceFile = configuration.backupRoot / ReplayTraceName;
+    }
+    const bool replayed = RunBackup(replayConfiguration, outputReport.stats);
+    IoTrace replay;
+    if ((false == replayed) || (false == IoTraceLog::Read(replayConfiguration.ioTraceFile, replay)))
+    {
+        return false;
+    }
+
+    std::map<std::string, IoTraceOperation> operations;
+    AddOperations(recorded, false, operations);
+    AddOperations(replay, true, operations);
+    for (auto& entry : operations)
+    {
+        outputReport.operations.push_back(std::move(entry.second));
+    }
+    return true;
+}
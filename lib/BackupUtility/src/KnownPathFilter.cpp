@@ -0,0 +1,124 @@
+// file KnownPathFilter.cpp:
+
+#include "KnownPathFilter.hpp"
+
+#include <functional>
+#include <string>
+
+namespace
+{
+constexpr std::size_t BlockWords = 8;
+constexpr std::size_t BlockBits = BlockWords * 64;
+constexpr unsigned int BlockIndexShift = 32;
+constexpr unsigned int BitIndexShift = 26;
+
+/**
+ * @brief Odd multipliers picking one bit per word, as in the Parquet split-block Bloom filter.
+ */
+constexpr std::uint64_t Salts[BlockWords] = {0x47b6137bULL, 0x44974d91ULL, 0x8824ad5bULL, 0xa2b7289dULL,
+                                             0x705495c7ULL, 0x2df1424bULL, 0x9efc4947ULL, 0x5c6bfb31ULL};
+
+/**
+ * @brief Hash a path; the high half picks the block and the low half the bits.
+ *
+ * std::hash only mixes well enough on 64-bit platforms, so the result is finalized with splitmix64.
+ */
+std::uint64_t HashPath(std::string_view filePath)
+{
+    std::uint64_t hash = static_cast<std::uint64_t>(std::hash<std::string_view>{}(filePath));
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+/**
+ * @brief Get the bit a hash sets in one word of its block, from the top six bits of a 32-bit product.
+ */
+std::uint64_t BitOf(std::uint64_t hash, std::size_t word)
+{
+    const std::uint64_t product = ((hash & 0xffffffffULL) * Salts[word]) & 0xffffffffULL;
+    return 1ULL << (product >> BitIndexShift);
+}
+}
+
+KnownPathFilter::KnownPathFilter() : _blockMask(0), _loaded(false)
+{
+}
+
+bool KnownPathFilter::Load(FileStateRepository& fileStateRepository, std::size_t memoryLimit)
+{
+    _words.clear();
+    _blockMask = 0;
+    _loaded = false;
+
+    std::uint64_t pathCount = 0;
+    if (false == fileStateRepository.CountFiles(pathCount))
+    {
+        return false;
+    }
+    std::uint64_t blockCount = 1;
+    while ((blockCount * BlockBits) < (pathCount * BitsPerPath))
+    {
+        blockCount <<= 1;
+    }
+    if ((memoryLimit / (BlockWords * sizeof(std::uint64_t))) < blockCount)
+    {
+        return false;
+    }
+
+    _words.assign(static_cast<std::size_t>(blockCount) * BlockWords, 0);
+    _blockMask = blockCount - 1;
+    // Rows added after the count only raise the false positive rate.
+    if (false == fileStateRepository.ForEachFilePath(
+                     [this](const std::string& filePath)
+                     {
+                         Insert(filePath);
+                         return true;
+                     }))
+    {
+        _words.clear();
+        _blockMask = 0;
+        return false;
+    }
+    _loaded = true;
+    return true;
+}
+
+bool KnownPathFilter::IsLoaded() const
+{
+    return _loaded;
+}
+
+bool KnownPathFilter::MayContain(std::string_view filePath) const
+{
+    if (false == _loaded)
+    {
+        return true;
+    }
+    const std::uint64_t hash = HashPath(filePath);
+    const std::uint64_t* block = _words.data() + ((hash >> BlockIndexShift) & _blockMask) * BlockWords;
+    for (std::size_t word = 0; word < BlockWords; ++word)
+    {
+        const std::uint64_t bit = BitOf(hash, word);
+        if (bit != (block[word] & bit))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::size_t KnownPathFilter::MemoryUsage() const
+{
+    return _words.capacity() * sizeof(std::uint64_t);
+}
+
+void KnownPathFilter::Insert(std::string_view filePath)
+{
+    const std::uint64_t hash = HashPath(filePath);
+    std::uint64_t* block = _words.data() + ((hash >> BlockIndexShift) & _blockMask) * BlockWords;
+    for (std::size_t word = 0; word < BlockWords; ++word)
+    {
+        block[word] |= BitOf(hash, word);
+    }
+}
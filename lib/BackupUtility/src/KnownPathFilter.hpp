@@ -0,0 +1,74 @@
+// file KnownPathFilter.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Split-block Bloom filter of the paths stored in the state database, loaded with a single query.
+ *
+ * Used when the full FileStateIndex does not fit its memory cap: at about ten bits per path the filter
+ * answers "definitely not stored" for new files, which then skip the database read, while stored paths
+ * and the rare false positive still go to the database. Each path sets eight bits within one 64-byte
+ * block, so a lookup touches a single cache line. Once loaded the filter is never modified, so any
+ * number of threads may call MayContain without locking.
+ */
+class KnownPathFilter
+{
+  public:
+    /**
+     * @brief Filter bits per stored path, for a false positive rate of about one percent.
+     */
+    static constexpr std::size_t BitsPerPath = 10;
+
+    /**
+     * @brief Create an empty filter.
+     */
+    KnownPathFilter();
+
+    KnownPathFilter(const KnownPathFilter&) = delete;
+    KnownPathFilter& operator=(const KnownPathFilter&) = delete;
+
+    /**
+     * @brief Add every stored path, deleted files included.
+     *
+     * @param[in] fileStateRepository Repository to read from
+     * @param[in] memoryLimit Maximum number of bytes the filter may use
+     * @return true if every path was added, false on error or when the filter would exceed the cap
+     */
+    bool Load(FileStateRepository& fileStateRepository, std::size_t memoryLimit);
+
+    /**
+     * @brief Check whether Load completed successfully.
+     *
+     * @return true if MayContain reflects the whole table
+     */
+    bool IsLoaded() const;
+
+    /**
+     * @brief Check whether a path may be stored.
+     *
+     * @param[in] filePath Repository-relative file path
+     * @return false if the path is certainly not stored, true if it may be or the filter is not loaded
+     */
+    bool MayContain(std::string_view filePath) const;
+
+    /**
+     * @brief Get the number of bytes held by the filter.
+     *
+     * @return Memory use in bytes
+     */
+    std::size_t MemoryUsage() const;
+
+  private:
+    void Insert(std::string_view filePath);
+
+    std::vector<std::uint64_t> _words; /**< Blocks of BlockWords words, each word holding one bit of every path in the block */
+    std::uint64_t _blockMask;          /**< Block count minus one, the count being a power of two */
+    bool _loaded;
+};
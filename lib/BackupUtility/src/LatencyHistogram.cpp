@@ -0,0 +1,72 @@
+#include "LatencyHistogram.hpp"
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+    for (std::size_t bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        const std::uint64_t count = other._buckets[bucket].load(std::memory_order_relaxed);
+        if (0 < count)
+        {
+            _buckets[bucket].store(_buckets[bucket].load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+        }
+    }
+    _count.store(_count.load(std::memory_order_relaxed) + other.Count(), std::memory_order_relaxed);
+    if (Max() < other.Max())
+    {
+        _maxNs.store(other.Max(), std::memory_order_relaxed);
+    }
+}
+
+std::uint64_t LatencyHistogram::ValueAtQuantile(double quantile) const
+{
+    const std::uint64_t count = Count();
+    if (0 == count)
+    {
+        return 0;
+    }
+    const double clamped = (quantile < 0.0) ? 0.0 : ((1.0 < quantile) ? 1.0 : quantile);
+    // The rank of the value asked for, counting from 1, as an HDR histogram does.
+    std::uint64_t rank = static_cast<std::uint64_t>(clamped * static_cast<double>(count) + 0.5);
+    rank = (0 == rank) ? 1 : ((count < rank) ? count : rank);
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < BucketCount; ++bucket)
+    {
+        seen += _buckets[bucket].load(std::memory_order_relaxed);
+        if (rank <= seen)
+        {
+            const std::uint64_t upper = BucketUpperNs(bucket);
+            return (Max() < upper) ? Max() : upper;
+        }
+    }
+    return Max();
+}
+
+std::size_t LatencyHistogram::BucketOf(std::uint64_t valueNs)
+{
+    constexpr std::uint64_t Limit = (std::uint64_t{1} << MaxExponent) - 1;
+    const std::uint64_t value = (Limit < valueNs) ? Limit : valueNs;
+    if (value < SubBucketCount)
+    {
+        return static_cast<std::size_t>(value);
+    }
+    std::size_t exponent = SubBucketBits;
+    while (0 != (value >> (exponent + 1)))
+    {
+        ++exponent;
+    }
+    const std::size_t shift = exponent - SubBucketBits;
+    const std::size_t subBucket = static_cast<std::size_t>(value >> shift) - SubBucketCount;
+    return SubBucketCount + (shift * SubBucketCount) + subBucket;
+}
+
+std::uint64_t LatencyHistogram::BucketUpperNs(std::size_t bucket)
+{
+    if (bucket < SubBucketCount)
+    {
+        return bucket;
+    }
+    const std::size_t shift = (bucket - SubBucketCount) / SubBucketCount;
+    const std::uint64_t subBucket = (bucket - SubBucketCount) % SubBucketCount;
+    const std::uint64_t lower = (SubBucketCount + subBucket) << shift;
+    return lower + (std::uint64_t{1} << shift) - 1;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Log-linear histogram of durations, in the style of an HDR histogram.
+ *
+ * Every power of two is split into SubBucketCount equal buckets, so any recorded value is known to within
+ * 1 / SubBucketCount of itself, from nanoseconds up to several hours, in a fixed array. Recording is a
+ * relaxed load and store like the other per-thread counters: a histogram is written by one thread only
+ * and read once that thread is done.
+ */
+class LatencyHistogram
+{
+  public:
+    /**
+     * @brief Bits of a value kept below its leading bit.
+     */
+    static constexpr std::size_t SubBucketBits = 5;
+
+    /**
+     * @brief Buckets per power of two; values below it get one bucket each.
+     */
+    static constexpr std::size_t SubBucketCount = std::size_t{1} << SubBucketBits;
+
+    /**
+     * @brief Values are clamped below 2^MaxExponent nanoseconds, about 4.9 hours.
+     */
+    static constexpr std::size_t MaxExponent = 44;
+
+    /**
+     * @brief Number of buckets.
+     */
+    static constexpr std::size_t BucketCount = SubBucketCount * (MaxExponent - SubBucketBits + 1);
+
+    /**
+     * @brief Count a duration. Only called by the thread owning the histogram.
+     *
+     * @param[in] valueNs Duration in nanoseconds
+     */
+    void Record(std::uint64_t valueNs)
+    {
+        std::atomic<std::uint64_t>& bucket = _buckets[BucketOf(valueNs)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        _count.store(_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (_maxNs.load(std::memory_order_relaxed) < valueNs)
+        {
+            _maxNs.store(valueNs, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Add the counts of another histogram whose thread is done.
+     *
+     * @param[in] other Histogram to add
+     */
+    void Merge(const LatencyHistogram& other);
+
+    /**
+     * @brief Get the number of recorded durations.
+     *
+     * @return Recorded durations
+     */
+    std::uint64_t Count() const
+    {
+        return _count.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the longest recorded duration.
+     *
+     * @return Duration in nanoseconds, 0 if none was recorded
+     */
+    std::uint64_t Max() const
+    {
+        return _maxNs.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the duration that the given share of recorded durations do not exceed.
+     *
+     * @param[in] quantile Share between 0 and 1, such as 0.99 for the 99th percentile
+     * @return Upper end of the bucket holding that duration, at most Max, in nanoseconds; 0 if none was recorded
+     */
+    std::uint64_t ValueAtQuantile(double quantile) const;
+
+    /**
+     * @brief Get the bucket of a duration.
+     *
+     * @param[in] valueNs Duration in nanoseconds
+     * @return Bucket index below BucketCount
+     */
+    static std::size_t BucketOf(std::uint64_t valueNs);
+
+    /**
+     * @brief Get the largest duration counted in a bucket.
+     *
+     * @param[in] bucket Bucket index below BucketCount
+     * @return Duration in nanoseconds
+     */
+    static std::uint64_t BucketUpperNs(std::size_t bucket);
+
+  private:
+    std::array<std::atomic<std::uint64_t>, BucketCount> _buckets{};
+    std::atomic<std::uint64_t> _count{0};
+    std::atomic<std::uint64_t> _maxNs{0};
+};
@@ -0,0 +1,366 @@
+// file LiveStatusSegment.cpp:
+
+#include "LiveStatusSegment.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+constexpr char SegmentMagic[8] = {'R', 'D', 'S', 'T', 'A', 'T', 'U', 'S'};
+constexpr std::uint32_t SegmentFormatVersion = 1;
+constexpr std::size_t PathWords = 32;
+constexpr std::size_t PathBytes = PathWords * sizeof(std::uint64_t);
+constexpr std::size_t CacheLineSize = 64;
+constexpr int PathReadAttempts = 16;
+constexpr const char* StageNames[] = {"starting", "scanning", "collecting", "deleted", "finishing", "finished", "failed"};
+constexpr std::uint32_t FinishedStage = 5;
+constexpr std::uint32_t FailedStage = 6;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared counters must not need a lock");
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "shared counters must not need a lock");
+
+std::atomic<std::uint64_t> NextGeneration{1};
+
+#ifdef _WIN32
+std::wstring MappingName(const std::string& name)
+{
+    return L"Local\\" + std::wstring(name.begin(), name.end());
+}
+#else
+std::string SharedMemoryName(const std::string& name)
+{
+    return "/" + name;
+}
+#endif
+}
+
+struct LiveStatusSegment::WorkerSlot
+{
+    alignas(CacheLineSize) std::atomic<std::uint32_t> used; /**< Non-zero once a thread owns the slot */
+    std::atomic<std::uint32_t> pathLength;                  /**< Bytes of the current file in path */
+    std::atomic<std::uint64_t> sequence;                    /**< Odd while the current file is being written */
+    std::atomic<std::uint64_t> files;                       /**< Files the thread finished */
+    std::atomic<std::uint64_t> bytes;                       /**< Bytes of those files */
+    std::atomic<std::uint64_t> path[PathWords];             /**< End of the current file's path */
+};
+
+struct LiveStatusSegment::Layout
+{
+    char magic[8];                             /**< SegmentMagic */
+    std::atomic<std::uint32_t> formatVersion;  /**< SegmentFormatVersion once the segment is ready, 0 while it is reset */
+    std::uint32_t workerSlots;                 /**< WorkerSlots */
+    std::atomic<std::uint64_t> processId;      /**< Process of the run */
+    std::atomic<std::uint32_t> stage;          /**< Index into StageNames */
+    std::atomic<std::uint32_t> totalFinal;     /**< Non-zero once the pre-scan has finished */
+    std::atomic<std::uint64_t> filesQueued;    /**< Files handed to the workers */
+    std::atomic<std::uint64_t> totalFiles;     /**< Files found by the pre-scan */
+    std::atomic<std::uint64_t> totalBytes;     /**< Their total size */
+    WorkerSlot slots[WorkerSlots + 1];         /**< One per worker, the last one shared by the rest */
+};
+
+LiveStatusSegment::LiveStatusSegment() : _layout(nullptr), _mappingHandle(nullptr), _generation(0), _assignedSlots(0)
+{
+}
+
+LiveStatusSegment::~LiveStatusSegment()
+{
+    if (nullptr == _layout)
+    {
+        return;
+    }
+    if (FinishedStage != _layout->stage.load(std::memory_order_relaxed))
+    {
+        _layout->stage.store(FailedStage, std::memory_order_relaxed);
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(_layout);
+    CloseHandle(_mappingHandle);
+#else
+    munmap(_layout, sizeof(Layout));
+#endif
+}
+
+bool LiveStatusSegment::Open(const std::string& name)
+{
+    if ((nullptr != _layout) || (true == name.empty()) || (std::string::npos != name.find_first_of("/\\")))
+    {
+        return false;
+    }
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, static_cast<DWORD>(sizeof(Layout)), MappingName(name).c_str());
+    if (nullptr == mapping)
+    {
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, sizeof(Layout));
+    if (nullptr == view)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    _mappingHandle = mapping;
+    const std::uint64_t processId = GetCurrentProcessId();
+#else
+    const int fileDescriptor = shm_open(SharedMemoryName(name).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (0 > fileDescriptor)
+    {
+        return false;
+    }
+    // Never shrink: a monitor still mapping the previous run's segment would fault on the cut-off pages.
+    struct stat fileStatus{};
+    void* view = MAP_FAILED;
+    if ((0 == fstat(fileDescriptor, &fileStatus)) &&
+        ((static_cast<off_t>(sizeof(Layout)) <= fileStatus.st_size) || (0 == ftruncate(fileDescriptor, static_cast<off_t>(sizeof(Layout))))))
+    {
+        view = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fileDescriptor, 0);
+    }
+    close(fileDescriptor);
+    if (MAP_FAILED == view)
+    {
+        return false;
+    }
+    const std::uint64_t processId = static_cast<std::uint64_t>(getpid());
+#endif
+    _layout = static_cast<Layout*>(view);
+
+    // A segment left by a previous run is reset field by field, so monitors reading it never see torn values.
+    _layout->formatVersion.store(0, std::memory_order_relaxed);
+    std::memcpy(_layout->magic, SegmentMagic, sizeof(SegmentMagic));
+    _layout->workerSlots = static_cast<std::uint32_t>(WorkerSlots);
+    _layout->processId.store(processId, std::memory_order_relaxed);
+    _layout->stage.store(0, std::memory_order_relaxed);
+    _layout->totalFinal.store(0, std::memory_order_relaxed);
+    _layout->filesQueued.store(0, std::memory_order_relaxed);
+    _layout->totalFiles.store(0, std::memory_order_relaxed);
+    _layout->totalBytes.store(0, std::memory_order_relaxed);
+    for (WorkerSlot& slot : _layout->slots)
+    {
+        slot.used.store(0, std::memory_order_relaxed);
+        slot.pathLength.store(0, std::memory_order_relaxed);
+        slot.sequence.store(0, std::memory_order_relaxed);
+        slot.files.store(0, std::memory_order_relaxed);
+        slot.bytes.store(0, std::memory_order_relaxed);
+    }
+    _layout->formatVersion.store(SegmentFormatVersion, std::memory_order_release);
+    _generation = NextGeneration.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void LiveStatusSegment::SetStage(const char* stage)
+{
+    if (nullptr == _layout)
+    {
+        return;
+    }
+    for (std::uint32_t index = 0; index < static_cast<std::uint32_t>(std::size(StageNames)); ++index)
+    {
+        if (0 == std::strcmp(StageNames[index], stage))
+        {
+            _layout->stage.store(index, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+void LiveStatusSegment::AddQueued(std::size_t files)
+{
+    if (nullptr != _layout)
+    {
+        _layout->filesQueued.fetch_add(files, std::memory_order_relaxed);
+    }
+}
+
+void LiveStatusSegment::AddToTotal(std::size_t files, std::uint64_t bytes)
+{
+    if (nullptr != _layout)
+    {
+        _layout->totalFiles.fetch_add(files, std::memory_order_relaxed);
+        _layout->totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+void LiveStatusSegment::MarkTotalFinal()
+{
+    if (nullptr != _layout)
+    {
+        _layout->totalFinal.store(1, std::memory_order_relaxed);
+    }
+}
+
+void LiveStatusSegment::BeginFile(const std::filesystem::path& file)
+{
+    if (nullptr == _layout)
+    {
+        return;
+    }
+    WorkerSlot* slot = CurrentSlot();
+    if (&_layout->slots[WorkerSlots] == slot)
+    {
+        // Threads sharing the overflow slot would tear each other's paths; they only count.
+        return;
+    }
+    // Long paths keep their end, which names the file.
+    const std::string text = file.string();
+    const std::size_t length = std::min(text.size(), PathBytes);
+    std::uint64_t words[PathWords] = {};
+    std::memcpy(words, text.data() + (text.size() - length), length);
+
+    const std::uint64_t sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t word = 0; word < (length + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t); ++word)
+    {
+        slot->path[word].store(words[word], std::memory_order_relaxed);
+    }
+    slot->pathLength.store(static_cast<std::uint32_t>(length), std::memory_order_relaxed);
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void LiveStatusSegment::FinishFile(std::uint64_t bytes)
+{
+    if (nullptr == _layout)
+    {
+        return;
+    }
+    WorkerSlot* slot = CurrentSlot();
+    if (&_layout->slots[WorkerSlots] == slot)
+    {
+        slot->files.fetch_add(1, std::memory_order_relaxed);
+        slot->bytes.fetch_add(bytes, std::memory_order_relaxed);
+        return;
+    }
+    // The owning thread is the only writer, so a load and a store replace the locked add.
+    slot->files.store(slot->files.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    slot->bytes.store(slot->bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+}
+
+bool LiveStatusSegment::Read(const std::string& name, LiveStatus& outputStatus)
+{
+    if ((true == name.empty()) || (std::string::npos != name.find_first_of("/\\")))
+    {
+        return false;
+    }
+#ifdef _WIN32
+    HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, MappingName(name).c_str());
+    if (nullptr == mapping)
+    {
+        return false;
+    }
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, sizeof(Layout));
+    if (nullptr == view)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+#else
+    const int fileDescriptor = shm_open(SharedMemoryName(name).c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (0 > fileDescriptor)
+    {
+        return false;
+    }
+    struct stat fileStatus{};
+    void* view = MAP_FAILED;
+    if ((0 == fstat(fileDescriptor, &fileStatus)) && (static_cast<off_t>(sizeof(Layout)) <= fileStatus.st_size))
+    {
+        view = mmap(nullptr, sizeof(Layout), PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    }
+    close(fileDescriptor);
+    if (MAP_FAILED == view)
+    {
+        return false;
+    }
+#endif
+    const Layout& layout = *static_cast<const Layout*>(view);
+
+    const bool ready = (SegmentFormatVersion == layout.formatVersion.load(std::memory_order_acquire)) &&
+                       (0 == std::memcmp(layout.magic, SegmentMagic, sizeof(SegmentMagic))) && (WorkerSlots == layout.workerSlots);
+    if (true == ready)
+    {
+        LiveStatus status;
+        status.processId = layout.processId.load(std::memory_order_relaxed);
+        const std::uint32_t stage = layout.stage.load(std::memory_order_relaxed);
+        status.stage = (stage < std::size(StageNames)) ? StageNames[stage] : "";
+        status.filesQueued = layout.filesQueued.load(std::memory_order_relaxed);
+        status.totalFiles = layout.totalFiles.load(std::memory_order_relaxed);
+        status.totalBytes = layout.totalBytes.load(std::memory_order_relaxed);
+        status.totalFinal = (0 != layout.totalFinal.load(std::memory_order_relaxed));
+        for (const WorkerSlot& slot : layout.slots)
+        {
+            if (0 == slot.used.load(std::memory_order_relaxed))
+            {
+                continue;
+            }
+            LiveWorkerStatus worker{slot.files.load(std::memory_order_relaxed), slot.bytes.load(std::memory_order_relaxed), {}};
+            for (int attempt = 0; attempt < PathReadAttempts; ++attempt)
+            {
+                const std::uint64_t before = slot.sequence.load(std::memory_order_acquire);
+                if (0 != (before & 1))
+                {
+                    continue;
+                }
+                std::uint64_t words[PathWords] = {};
+                const std::size_t length = std::min<std::size_t>(slot.pathLength.load(std::memory_order_relaxed), PathBytes);
+                for (std::size_t word = 0; word < (length + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t); ++word)
+                {
+                    words[word] = slot.path[word].load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (before == slot.sequence.load(std::memory_order_relaxed))
+                {
+                    worker.currentFile.assign(reinterpret_cast<const char*>(words), length);
+                    break;
+                }
+            }
+            status.filesProcessed += worker.files;
+            status.bytesProcessed += worker.bytes;
+            status.workers.push_back(std::move(worker));
+        }
+        status.queueDepth = (status.filesQueued > status.filesProcessed) ? (status.filesQueued - status.filesProcessed) : 0;
+        outputStatus = std::move(status);
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(view);
+    CloseHandle(mapping);
+#else
+    munmap(view, sizeof(Layout));
+#endif
+    return ready;
+}
+
+/**
+ * @brief Get the slot of the calling thread, assigning the next free one on first use.
+ *
+ * @return Slot owned by the calling thread, or the shared overflow slot
+ */
+LiveStatusSegment::WorkerSlot* LiveStatusSegment::CurrentSlot()
+{
+    // Cached per thread and tagged with the open segment, so a thread reused by a later run takes a new slot.
+    thread_local std::uint64_t cachedGeneration = 0;
+    thread_local WorkerSlot* cachedSlot = nullptr;
+    if (_generation != cachedGeneration)
+    {
+        const std::size_t index = std::min(_assignedSlots.fetch_add(1, std::memory_order_relaxed), WorkerSlots);
+        cachedSlot = &_layout->slots[index];
+        cachedSlot->used.store(1, std::memory_order_relaxed);
+        cachedGeneration = _generation;
+    }
+    return cachedSlot;
+}
@@ -0,0 +1,114 @@
+// file LiveStatusSegment.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/**
+ * @brief Live counters of a backup run in a named shared-memory segment that monitors map read-only.
+ *
+ * Each worker thread gets its own cache-line aligned slot on first use and is the only writer of it, so
+ * publishing a file is a few relaxed stores and never contends with other workers. Totals are the sums
+ * of the slots, formed by the reader. The current file of a slot is guarded by a sequence counter, so a
+ * reader retries instead of seeing a half-written path. The segment lives in /dev/shm, or in the
+ * session's named objects on Windows, and is left behind when the run ends so monitors see the result.
+ */
+class LiveStatusSegment
+{
+  public:
+    /**
+     * @brief Worker slots in a segment; threads beyond them share one overflow slot.
+     */
+    static constexpr std::size_t WorkerSlots = 64;
+
+    /**
+     * @brief Slot of one worker thread.
+     */
+    struct WorkerSlot;
+
+    /**
+     * @brief Construct a segment that is not open; every update is ignored until Open succeeds.
+     */
+    LiveStatusSegment();
+    /**
+     * @brief Unmap the segment, leaving it for monitors; a run not marked finished is published as failed.
+     */
+    ~LiveStatusSegment();
+
+    LiveStatusSegment(const LiveStatusSegment&) = delete;
+    LiveStatusSegment& operator=(const LiveStatusSegment&) = delete;
+
+    /**
+     * @brief Create the segment, or reset the one a previous run left behind.
+     *
+     * @param[in] name Segment name, without slashes or backslashes
+     * @return true on success, false if the name is invalid or the segment cannot be created
+     */
+    bool Open(const std::string& name);
+
+    /**
+     * @brief Publish the stage of the run.
+     *
+     * @param[in] stage One of the stages listed for LiveStatus::stage; other names are ignored
+     */
+    void SetStage(const char* stage);
+
+    /**
+     * @brief Add files handed to the workers.
+     *
+     * @param[in] files Files enqueued
+     */
+    void AddQueued(std::size_t files);
+
+    /**
+     * @brief Add files found by the pre-scan to the totals.
+     *
+     * @param[in] files Files found
+     * @param[in] bytes Their total size
+     */
+    void AddToTotal(std::size_t files, std::uint64_t bytes);
+
+    /**
+     * @brief Note that the pre-scan has finished, so the totals are exact.
+     */
+    void MarkTotalFinal();
+
+    /**
+     * @brief Publish the file the calling thread starts on.
+     *
+     * @param[in] file File being processed
+     */
+    void BeginFile(const std::filesystem::path& file);
+
+    /**
+     * @brief Count a file the calling thread finished.
+     *
+     * @param[in] bytes Size of the file
+     */
+    void FinishFile(std::uint64_t bytes);
+
+    /**
+     * @brief Read the segment of a run.
+     *
+     * @param[in] name Segment name passed to Open
+     * @param[out] outputStatus Counters at the time of the call
+     * @return true on success, false if there is no complete segment of that name
+     */
+    static bool Read(const std::string& name, LiveStatus& outputStatus);
+
+  private:
+    struct Layout;
+
+    WorkerSlot* CurrentSlot();
+
+    Layout* _layout;
+    void* _mappingHandle;
+    std::uint64_t _generation;
+    std::atomic<std::size_t> _assignedSlots;
+};
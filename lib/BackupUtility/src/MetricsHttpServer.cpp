@@ -0,0 +1,103 @@
+#include "MetricsHttpServer.hpp"
+
+#include <array>
+
+namespace
+{
+/**
+ * @brief Longest a scrape may take to send its request or read the answer.
+ */
+constexpr unsigned int ScrapeTimeoutSeconds = 5;
+
+/**
+ * @brief Largest request read; the request line is all that is looked at.
+ */
+constexpr std::size_t MaxRequestSize = 8192;
+
+/**
+ * @brief Content type of the Prometheus text exposition format.
+ */
+constexpr const char* MetricsContentType = "text/plain; version=0.0.4; charset=utf-8";
+}
+
+MetricsHttpServer::MetricsHttpServer(const std::function<std::string()>& render) : _render(render)
+{
+}
+
+MetricsHttpServer::~MetricsHttpServer()
+{
+    Stop();
+}
+
+bool MetricsHttpServer::Start(const std::string& address, std::uint16_t port)
+{
+    if (false == _listener.Listen(address, port))
+    {
+        return false;
+    }
+    _thread = std::thread([this]() { Serve(); });
+    return true;
+}
+
+std::uint16_t MetricsHttpServer::Port() const
+{
+    return _listener.Port();
+}
+
+void MetricsHttpServer::Stop()
+{
+    _listener.Close();
+    if (true == _thread.joinable())
+    {
+        _thread.join();
+    }
+}
+
+/**
+ * @brief Server thread: answer scrapes until the listener is closed.
+ */
+void MetricsHttpServer::Serve()
+{
+    while (true)
+    {
+        TcpSocket socket = _listener.Accept(ScrapeTimeoutSeconds);
+        if (false == socket.IsOpen())
+        {
+            break;
+        }
+        Answer(socket);
+        socket.Shutdown();
+    }
+}
+
+/**
+ * @brief Read one request and send the metrics or a 404.
+ *
+ * @param[in,out] socket Accepted connection
+ */
+void MetricsHttpServer::Answer(TcpSocket& socket)
+{
+    std::string request;
+    std::array<char, 1024> buffer{};
+    while ((std::string::npos == request.find("\r\n\r\n")) && (request.size() < MaxRequestSize))
+    {
+        const std::size_t received = socket.ReceiveSome(buffer.data(), buffer.size());
+        if (0 == received)
+        {
+            return;
+        }
+        request.append(buffer.data(), received);
+    }
+
+    const std::size_t lineEnd = request.find("\r\n");
+    const std::string requestLine = request.substr(0, lineEnd);
+    const bool isScrape = (0 == requestLine.rfind("GET /metrics ", 0)) || (0 == requestLine.rfind("GET /metrics?", 0));
+    const std::string body = (true == isScrape) ? _render() : std::string("Not found\n");
+    const std::string header = std::string((true == isScrape) ? "HTTP/1.0 200 OK\r\n" : "HTTP/1.0 404 Not Found\r\n") + "Content-Type: " +
+                               ((true == isScrape) ? MetricsContentType : "text/plain") + "\r\nContent-Length: " + std::to_string(body.size()) +
+                               "\r\nConnection: close\r\n\r\n";
+    if (true == socket.SendAll(header.data(), header.size()))
+    {
+        socket.SendAll(body.data(), body.size());
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "TcpSocket/TcpSocket.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Infrastructure component answering Prometheus scrapes of `GET /metrics` over HTTP/1.0.
+ *
+ * One thread accepts the scrapes and answers them one at a time with the text of a render callback;
+ * any other request gets 404. Scrapes are rare, so the metrics are only gathered when one arrives.
+ */
+class MetricsHttpServer
+{
+  public:
+    /**
+     * @brief Construct a server that is not listening yet.
+     *
+     * @param[in] render Returns the exposition text; called on the server thread
+     */
+    explicit MetricsHttpServer(const std::function<std::string()>& render);
+
+    /**
+     * @brief Stop the server.
+     */
+    ~MetricsHttpServer();
+
+    MetricsHttpServer(const MetricsHttpServer&) = delete;
+    MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+
+    /**
+     * @brief Listen and start answering scrapes.
+     *
+     * @param[in] address Local address to bind
+     * @param[in] port Port, 0 picks a free one
+     * @return true on success, false if the address cannot be bound
+     */
+    bool Start(const std::string& address, std::uint16_t port);
+
+    /**
+     * @brief Get the port the server listens on.
+     *
+     * @return Bound port, 0 when not listening
+     */
+    std::uint16_t Port() const;
+
+    /**
+     * @brief Stop accepting scrapes and wait for the server thread.
+     */
+    void Stop();
+
+  private:
+    void Serve();
+    void Answer(TcpSocket& socket);
+
+    std::function<std::string()> _render;
+    TcpListener _listener;
+    std::thread _thread;
+};
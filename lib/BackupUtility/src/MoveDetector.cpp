@@ -0,0 +1,95 @@
+// file MoveDetector.cpp:
+
+#include "MoveDetector.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+MoveDetector::MoveDetector(const RelativePathBuilder& sourceKeys, const std::filesystem::path& backupRoot, SnapshotDirectoryProvider& snapshotDirectory,
+                           FileStateRepository& fileStateRepository, const FileCopier& fileCopier, DirectoryCache& directoryCache,
+                           const RunContext& runContext)
+    : _sourceKeys(sourceKeys), _backupRoot(backupRoot), _snapshotDirectory(snapshotDirectory), _fileStateRepository(fileStateRepository),
+      _fileCopier(fileCopier), _directoryCache(directoryCache), _runContext(runContext)
+{
+}
+
+bool MoveDetector::MayMatch(std::uint64_t size) const
+{
+    bool found = false;
+    return (0 != size) && (true == _fileStateRepository.HasMoveSourceOfSize(size, _runContext.Timestamp(), found)) && (true == found);
+}
+
+bool MoveDetector::TryMove(const std::string& relativeKey, const FileStateRecord& record, const std::filesystem::path& backupFile) const
+{
+    std::vector<ContentMatch> matches;
+    if ((0 == record.metadata.size) ||
+        (false == _fileStateRepository.FindMoveSources(record.metadata.size, record.hash, record.hashAlgorithm, _runContext.Timestamp(), matches)))
+    {
+        return false;
+    }
+
+    std::error_code errorCode;
+    for (const auto& match : matches)
+    {
+        // A live file still in the source was copied, not moved, and keeps its backup copy.
+        if ((relativeKey == match.path) || ((false == match.deleted) && (true == SourceExists(match.path))))
+        {
+            continue;
+        }
+        std::filesystem::path archivedFile;
+        try
+        {
+            RelativePathBuilder::BuildLocation(_snapshotDirectory.GetOrCreate(), match.path, archivedFile);
+        }
+        catch (const std::runtime_error&)
+        {
+            return false;
+        }
+
+        if (false == match.deleted)
+        {
+            std::filesystem::path previousFile;
+            RelativePathBuilder::BuildLocation(_backupRoot, match.path, previousFile);
+            std::filesystem::rename(previousFile, backupFile, errorCode);
+            if (0 == errorCode.value())
+            {
+                // The deletion pass finds no backup copy left and only marks the old path deleted; its version stays here.
+                _directoryCache.Ensure(archivedFile.parent_path());
+                std::filesystem::create_hard_link(backupFile, archivedFile, errorCode);
+                if ((0 == errorCode.value()) || (true == _fileCopier.Copy(backupFile, archivedFile)))
+                {
+                    return true;
+                }
+                std::filesystem::rename(backupFile, previousFile, errorCode);
+                return false;
+            }
+        }
+
+        // The deletion pass archived the old copy first, so the archived copy is linked back.
+        std::filesystem::remove(backupFile, errorCode);
+        std::filesystem::create_hard_link(archivedFile, backupFile, errorCode);
+        if (0 == errorCode.value())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Check whether a stored file is still in the source.
+ *
+ * @param[in] relativeKey State key of the file
+ * @return true if it exists or cannot be checked, false if it is gone or its source root is no longer backed up
+ */
+bool MoveDetector::SourceExists(const std::string& relativeKey) const
+{
+    std::filesystem::path sourceFile;
+    if (false == _sourceKeys.BuildSourceLocation(relativeKey, sourceFile))
+    {
+        return false;
+    }
+    std::error_code errorCode;
+    const bool exists = std::filesystem::exists(sourceFile, errorCode);
+    return (0 != errorCode.value()) || (true == exists);
+}
@@ -0,0 +1,76 @@
+// file MoveDetector.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+#include "RelativePathBuilder.hpp"
+#include "FileCopier/DirectoryCache.hpp"
+#include "FileCopier/FileCopier.hpp"
+#include "SnapshotDirectoryProvider/SnapshotDirectoryProvider.hpp"
+#include "TimestampProvider/RunContext.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/**
+ * @brief Application component recognising new files as stored files that were moved or renamed in the source.
+ *
+ * A new file whose size and digest match a stored file that is gone from the source takes over that
+ * file's backup copy with a rename inside the backup root, instead of being copied in full. The old
+ * path keeps its history: the copy is hard linked into the run's snapshot under the old path, where the
+ * deletion pass would have archived it, and the old path is then marked deleted as usual. When the
+ * deletion pass archived the old copy first, the archived copy is linked back instead. No file data is
+ * copied either way, unless the filesystem refuses the link.
+ *
+ * Only plain backup copies are taken over; with a content store or a storage backend the run copies as before.
+ */
+class MoveDetector
+{
+  public:
+    /**
+     * @brief Construct a detector for one run.
+     *
+     * @param[in] sourceKeys Mapping of state keys to source locations for file existence checks
+     * @param[in] backupRoot Root path of the backup directory
+     * @param[in] snapshotDirectory Provider for the run's snapshot directory
+     * @param[in] fileStateRepository Repository looked up by size and digest
+     * @param[in] fileCopier Copies a moved file into the snapshot where it cannot be linked
+     * @param[in,out] directoryCache Directories of the run known to exist, shared with the other workers
+     * @param[in] runContext Run whose deletions count as moved-away files
+     */
+    MoveDetector(const RelativePathBuilder& sourceKeys, const std::filesystem::path& backupRoot, SnapshotDirectoryProvider& snapshotDirectory,
+                 FileStateRepository& fileStateRepository, const FileCopier& fileCopier, DirectoryCache& directoryCache,
+                 const RunContext& runContext);
+
+    /**
+     * @brief Check whether a new file of a given size may have been moved from a stored file.
+     *
+     * Used to hash such a file before deciding to copy it. Empty files are never moved.
+     *
+     * @param[in] size File size in bytes
+     * @return true if a live file, or one deleted by this run, has that size; false otherwise or on error
+     */
+    bool MayMatch(std::uint64_t size) const;
+
+    /**
+     * @brief Take over the backup copy of a stored file with the same content that is gone from the source.
+     *
+     * @param[in] relativeKey State key of the new file
+     * @param[in] record New state of the file, with its size and digest
+     * @param[in] backupFile Backup location of the new file, whose directory exists
+     * @return true if the backup file now holds the content, false if nothing matched and the file must be copied
+     */
+    bool TryMove(const std::string& relativeKey, const FileStateRecord& record, const std::filesystem::path& backupFile) const;
+
+  private:
+    bool SourceExists(const std::string& relativeKey) const;
+
+    const RelativePathBuilder& _sourceKeys;
+    const std::filesystem::path& _backupRoot;
+    SnapshotDirectoryProvider& _snapshotDirectory;
+    FileStateRepository& _fileStateRepository;
+    const FileCopier& _fileCopier;
+    DirectoryCache& _directoryCache;
+    const RunContext& _runContext;
+};
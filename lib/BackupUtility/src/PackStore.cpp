@@ -0,0 +1,223 @@
+// file PackStore.cpp:
+
+#include "PackStore.hpp"
+
+#include "IoThrottle/IoThrottle.hpp"
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace
+{
+constexpr const char* SqlCreatePackEntriesTable = "CREATE TABLE IF NOT EXISTS pack_entries ("
+                                                  "digest BLOB NOT NULL,"
+                                                  "hash_algorithm TEXT NOT NULL,"
+                                                  "segment INTEGER NOT NULL,"
+                                                  "position INTEGER NOT NULL,"
+                                                  "length INTEGER NOT NULL,"
+                                                  "content BLOB,"
+                                                  "PRIMARY KEY(digest, hash_algorithm)) WITHOUT ROWID;";
+
+constexpr const char* SqlCreatePackSegmentsTable = "CREATE TABLE IF NOT EXISTS pack_segments ("
+                                                   "id INTEGER PRIMARY KEY,"
+                                                   "size INTEGER NOT NULL);";
+
+constexpr int SegmentNameDigits = 8;
+constexpr int TableInfoNameColumn = 1;
+
+/**
+ * @brief Check whether the pack index has the column for inline contents, which older indexes lack.
+ *
+ * @param[in] connection Connection to query
+ * @return true if the column exists, false otherwise
+ */
+bool HasContentColumn(SQLiteConnection& connection)
+{
+    auto statement = connection.Prepare("PRAGMA table_info(pack_entries);");
+    while (true == statement.FetchRow())
+    {
+        if ("content" == statement.ColumnText(TableInfoNameColumn))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+PackStore::PackStore(const std::filesystem::path& packRoot, SQLiteSession& databaseSession)
+    : _packRoot(packRoot), _databaseSession(databaseSession)
+{
+}
+
+bool PackStore::InitializeSchema()
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute(SqlCreatePackEntriesTable);
+        connection.Execute(SqlCreatePackSegmentsTable);
+        if (false == HasContentColumn(connection))
+        {
+            connection.Execute("ALTER TABLE pack_entries ADD COLUMN content BLOB;");
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool PackStore::Find(const HashDigest& hash, HashAlgorithm hashAlgorithm, PackLocation& outputLocation)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto cachedStatement = connection.PrepareCached("SELECT segment, position, length, content FROM pack_entries WHERE digest=?1 AND hash_algorithm=?2;");
+        SQLiteStatement& statement = *cachedStatement;
+        statement.BindBlob(1, hash.bytes.data(), hash.size);
+        statement.BindText(2, HashAlgorithmToString(hashAlgorithm));
+        if (false == statement.FetchRow())
+        {
+            return false;
+        }
+        outputLocation.segment = statement.ColumnInt64(0);
+        outputLocation.offset = static_cast<std::uint64_t>(statement.ColumnInt64(1));
+        outputLocation.length = static_cast<std::uint64_t>(statement.ColumnInt64(2));
+        const SQLiteBlob content = statement.ColumnBlob(3);
+        const auto* contentBytes = static_cast<const std::uint8_t*>(content.data);
+        outputLocation.content.assign(contentBytes, contentBytes + content.size);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool PackStore::LastSegment(std::int64_t& outputSegment, std::uint64_t& outputSize)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT id, size FROM pack_segments ORDER BY id DESC LIMIT 1;");
+        outputSegment = 0;
+        outputSize = 0;
+        if (true == statement.FetchRow())
+        {
+            outputSegment = statement.ColumnInt64(0);
+            outputSize = static_cast<std::uint64_t>(statement.ColumnInt64(1));
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool PackStore::Commit(std::int64_t segment, std::uint64_t segmentSize, const std::vector<PackEntry>& entries)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        // The index never names bytes the committed size does not cover, and the other way round.
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            for (const PackEntry& entry : entries)
+            {
+                auto cachedStatement = connection.PrepareCached("INSERT OR IGNORE INTO pack_entries VALUES (?1, ?2, ?3, ?4, ?5, ?6);");
+                SQLiteStatement& statement = *cachedStatement;
+                statement.BindBlob(1, entry.hash.bytes.data(), entry.hash.size);
+                statement.BindText(2, HashAlgorithmToString(entry.hashAlgorithm));
+                statement.BindInt64(3, entry.location.segment);
+                statement.BindInt64(4, static_cast<std::int64_t>(entry.location.offset));
+                statement.BindInt64(5, static_cast<std::int64_t>(entry.location.length));
+                // Cached statements keep their bindings, so segment entries bind NULL explicitly.
+                statement.BindBlob(6, (true == entry.location.content.empty()) ? nullptr : entry.location.content.data(), entry.location.content.size());
+                if (false == statement.ExecuteStatement())
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+            }
+            if (InlineSegment != segment)
+            {
+                auto cachedStatement = connection.PrepareCached("INSERT INTO pack_segments (id, size) VALUES (?1, ?2) "
+                                                                "ON CONFLICT(id) DO UPDATE SET size=excluded.size;");
+                cachedStatement->BindInt64(1, segment);
+                cachedStatement->BindInt64(2, static_cast<std::int64_t>(segmentSize));
+                if (false == cachedStatement->ExecuteStatement())
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+const std::filesystem::path& PackStore::Root() const
+{
+    return _packRoot;
+}
+
+std::filesystem::path PackStore::SegmentPath(const std::filesystem::path& packRoot, std::int64_t segment)
+{
+    char name[32] = {};
+    std::snprintf(name, sizeof(name), "%0*lld%s", SegmentNameDigits, static_cast<long long>(segment), SegmentSuffix);
+    return packRoot / name;
+}
+
+bool PackStore::Read(const std::filesystem::path& packRoot, const PackLocation& location, std::vector<std::uint8_t>& outputContent,
+                     IoThrottle* throttle)
+{
+    if (InlineSegment == location.segment)
+    {
+        outputContent = location.content;
+        return location.length == outputContent.size();
+    }
+    std::ifstream segmentStream(SegmentPath(packRoot, location.segment), std::ios::binary);
+    if (false == segmentStream.is_open())
+    {
+        return false;
+    }
+    outputContent.resize(static_cast<std::size_t>(location.length));
+    segmentStream.seekg(static_cast<std::streamoff>(location.offset));
+    if (false == static_cast<bool>(segmentStream.read(reinterpret_cast<char*>(outputContent.data()), static_cast<std::streamsize>(location.length))))
+    {
+        return false;
+    }
+    if (nullptr != throttle)
+    {
+        throttle->AcquireRead(location.length);
+    }
+    return true;
+}
+
+bool PackStore::Extract(const std::filesystem::path& packRoot, const PackLocation& location, const std::filesystem::path& outputPath)
+{
+    std::vector<std::uint8_t> content;
+    if (false == Read(packRoot, location, content))
+    {
+        return false;
+    }
+    std::ofstream outputStream(outputPath, std::ios::binary | std::ios::trunc);
+    return (true == static_cast<bool>(outputStream.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size())))) &&
+           (true == static_cast<bool>(outputStream.flush()));
+}
@@ -0,0 +1,146 @@
+// file PackStore.hpp:
+
+#pragma once
+
+#include "FileHasher/FileHasher.hpp"
+#include "SQLite/SQLiteSession.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+class IoThrottle;
+
+/**
+ * @brief Place of one packed content in the pack segments.
+ */
+struct PackLocation
+{
+    std::int64_t segment;              /**< Segment number, 1 for the first segment, PackStore::InlineSegment for a content held by the index */
+    std::uint64_t offset;              /**< Offset in bytes of the content in the segment */
+    std::uint64_t length;              /**< Content length in bytes */
+    std::vector<std::uint8_t> content; /**< Bytes of an inline content, empty for contents in a segment */
+};
+
+/**
+ * @brief Content appended to a segment, recorded in the index once it is written.
+ */
+struct PackEntry
+{
+    HashDigest hash;             /**< Digest of the content */
+    HashAlgorithm hashAlgorithm; /**< Algorithm of hash */
+    PackLocation location;       /**< Where the content was written */
+};
+
+/**
+ * @brief Index and reader of the append-only pack segments holding small files.
+ *
+ * Small file contents are appended back to back to segment files `<root>/<segment>.pack` instead of being
+ * stored one file each. The index in the state database maps every content digest to its segment, offset
+ * and length, and records how many bytes of each segment are committed. Bytes past the committed size of
+ * a segment were written by a run that stopped before indexing them; the next writer cuts them off. A
+ * content is packed once however many files or versions have it. Segments are never rewritten, so
+ * versions dropped from the history keep their bytes. Tiny contents can instead be held inline, as a
+ * BLOB in their index row, so they cost no segment bytes and no file read to restore.
+ */
+class PackStore
+{
+  public:
+    /**
+     * @brief Suffix of the segment files.
+     */
+    static constexpr const char* SegmentSuffix = ".pack";
+
+    /**
+     * @brief Segment number of contents held inline in the index.
+     */
+    static constexpr std::int64_t InlineSegment = 0;
+
+    /**
+     * @brief Create a store bound to a directory and a SQLite session on the state database.
+     *
+     * @param[in] packRoot Directory holding the segments
+     * @param[in] databaseSession Active SQLite session for the state database
+     */
+    PackStore(const std::filesystem::path& packRoot, SQLiteSession& databaseSession);
+
+    /**
+     * @brief Create the index tables if they do not exist.
+     *
+     * @return true on success, false on error
+     */
+    bool InitializeSchema();
+
+    /**
+     * @brief Look up where a content is packed.
+     *
+     * @param[in] hash Digest of the content
+     * @param[in] hashAlgorithm Algorithm of hash
+     * @param[out] outputLocation Location of the content
+     * @return true if the content is packed, false if it is not or on error
+     */
+    bool Find(const HashDigest& hash, HashAlgorithm hashAlgorithm, PackLocation& outputLocation);
+
+    /**
+     * @brief Get the newest segment and its committed size.
+     *
+     * @param[out] outputSegment Newest segment number, 0 when there is none yet
+     * @param[out] outputSize Committed size in bytes of that segment
+     * @return true on success, false on error
+     */
+    bool LastSegment(std::int64_t& outputSegment, std::uint64_t& outputSize);
+
+    /**
+     * @brief Index written contents and move the committed size of their segment, in one transaction.
+     *
+     * Contents already indexed keep their first location. Inline entries are stored with their bytes.
+     *
+     * @param[in] segment Segment the contents were appended to, InlineSegment when only inline contents are committed
+     * @param[in] segmentSize Size in bytes of the segment including the contents
+     * @param[in] entries Written contents and inline contents
+     * @return true on success, false on error
+     */
+    bool Commit(std::int64_t segment, std::uint64_t segmentSize, const std::vector<PackEntry>& entries);
+
+    /**
+     * @brief Get the directory holding the segments.
+     *
+     * @return Pack root
+     */
+    const std::filesystem::path& Root() const;
+
+    /**
+     * @brief Get the location of a segment file.
+     *
+     * @param[in] packRoot Directory holding the segments
+     * @param[in] segment Segment number
+     * @return Path of the segment
+     */
+    static std::filesystem::path SegmentPath(const std::filesystem::path& packRoot, std::int64_t segment);
+
+    /**
+     * @brief Read a packed content; an inline content is taken from its location without a read.
+     *
+     * @param[in] packRoot Directory holding the segments
+     * @param[in] location Location of the content, as returned by Find
+     * @param[out] outputContent Content bytes
+     * @param[in] throttle Rate limiter the read is charged to, nullptr reads at full speed
+     * @return true on success, false on error or a short segment
+     */
+    static bool Read(const std::filesystem::path& packRoot, const PackLocation& location, std::vector<std::uint8_t>& outputContent,
+                     IoThrottle* throttle = nullptr);
+
+    /**
+     * @brief Write a packed content to a file.
+     *
+     * @param[in] packRoot Directory holding the segments
+     * @param[in] location Location of the content
+     * @param[in] outputPath File to create or replace
+     * @return true on success, false on error
+     */
+    static bool Extract(const std::filesystem::path& packRoot, const PackLocation& location, const std::filesystem::path& outputPath);
+
+  private:
+    std::filesystem::path _packRoot;
+    SQLiteSession& _databaseSession;
+};
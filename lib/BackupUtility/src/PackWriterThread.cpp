@@ -0,0 +1,290 @@
+// file PackWriterThread.cpp:
+
+#include "PackWriterThread.hpp"
+
+#include "ParityFile.hpp"
+
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <unordered_set>
+
+namespace
+{
+/**
+ * @brief Build the index key of a content, the same for equal digests of the same algorithm.
+ */
+std::string ContentKey(const HashDigest& hash, HashAlgorithm hashAlgorithm)
+{
+    std::string key(reinterpret_cast<const char*>(hash.bytes.data()), hash.size);
+    key += HashAlgorithmToString(hashAlgorithm);
+    return key;
+}
+}
+
+PackWriterThread::PackWriterThread(PackStore& packStore, std::uint64_t threshold, std::uint64_t inlineThreshold, std::uint64_t segmentSize, std::size_t queueBytes,
+                                   IoThrottle* throttle, const ReedSolomon* parityCode, const std::filesystem::path& parityRoot,
+                                   const std::function<void()>& onThreadExit)
+    : _packStore(packStore), _threshold(threshold), _inlineThreshold(inlineThreshold), _segmentSize(std::max<std::uint64_t>(1, segmentSize)), _queueBytes(std::max<std::size_t>(WriteSize, queueBytes)),
+      _throttle(throttle), _parityCode(parityCode), _parityRoot(parityRoot), _onThreadExit(onThreadExit), _queuedBytes(0), _stopping(false), _failed(false), _segment(0), _segmentFill(0)
+{
+    _packer = std::thread([this]() { PackerLoop(); });
+}
+
+PackWriterThread::~PackWriterThread()
+{
+    Stop();
+}
+
+bool PackWriterThread::IsPackable(std::uint64_t size) const
+{
+    return size < _threshold;
+}
+
+bool PackWriterThread::Append(const HashDigest& hash, HashAlgorithm hashAlgorithm, std::vector<std::uint8_t>&& content,
+                              std::function<void()> onStored)
+{
+    const std::size_t bytes = content.size();
+    bool wake = false;
+    {
+        std::unique_lock<std::mutex> lock(_queueMutex);
+        // A content larger than the bound still goes in once the queue has drained.
+        _queueNotFullCv.wait(lock, [&]() { return (true == _failed) || (true == _queue.empty()) || ((_queuedBytes + bytes) <= _queueBytes); });
+        if (true == _failed)
+        {
+            return false;
+        }
+        // The packer only needs waking for the first content and once a write is full.
+        wake = (true == _queue.empty()) || ((_queuedBytes < WriteSize) && (WriteSize <= (_queuedBytes + bytes)));
+        _queue.push_back(QueuedContent{hash, hashAlgorithm, std::move(content), std::move(onStored)});
+        _queuedBytes += bytes;
+    }
+    if (true == wake)
+    {
+        _queueNotEmptyCv.notify_one();
+    }
+    return true;
+}
+
+bool PackWriterThread::Stop()
+{
+    if (true == _packer.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_queueMutex);
+            _stopping = true;
+        }
+        _queueNotEmptyCv.notify_one();
+        _packer.join();
+    }
+    std::lock_guard<std::mutex> lock(_queueMutex);
+    return false == _failed;
+}
+
+/**
+ * @brief Packer thread loop: gather queued contents into full writes, or whatever arrived within FlushInterval.
+ */
+void PackWriterThread::PackerLoop()
+{
+    std::vector<QueuedContent> batch;
+    while (true)
+    {
+        bool stopping = false;
+        bool drained = false;
+        bool failed = false;
+        {
+            std::unique_lock<std::mutex> lock(_queueMutex);
+            _queueNotEmptyCv.wait(lock, [&]() { return (true == _stopping) || (false == _queue.empty()); });
+            // A trickle of small files gets a moment to fill a write before it goes out.
+            _queueNotEmptyCv.wait_for(lock, FlushInterval, [&]() { return (true == _stopping) || (WriteSize <= _queuedBytes); });
+            std::size_t batchBytes = 0;
+            while ((false == _queue.empty()) && (batchBytes < WriteSize))
+            {
+                batchBytes += _queue.front().content.size();
+                batch.push_back(std::move(_queue.front()));
+                _queue.pop_front();
+            }
+            _queuedBytes -= batchBytes;
+            stopping = _stopping;
+            drained = _queue.empty();
+            failed = _failed;
+        }
+        _queueNotFullCv.notify_all();
+
+        // After a failure the queue is still drained, so no producer waits for room forever.
+        if ((false == failed) && (false == batch.empty()) && (false == WriteBatch(batch)))
+        {
+            {
+                std::lock_guard<std::mutex> lock(_queueMutex);
+                _failed = true;
+            }
+            _queueNotFullCv.notify_all();
+        }
+        batch.clear();
+        _completions.clear();
+        if ((true == stopping) && (true == drained))
+        {
+            break;
+        }
+    }
+    if (nullptr != _onThreadExit)
+    {
+        _onThreadExit();
+    }
+}
+
+/**
+ * @brief Continue the newest segment unless it is full, cutting off bytes a stopped run wrote past its committed size.
+ *
+ * A full segment left by an earlier run is closed first; a continued one loses any parity it had.
+ *
+ * @return true on success, false on error
+ */
+bool PackWriterThread::OpenSegment()
+{
+    if (false == _packStore.LastSegment(_segment, _segmentFill))
+    {
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(_packStore.Root(), ec);
+    const std::filesystem::path segmentPath = PackStore::SegmentPath(_packStore.Root(), _segment);
+    if ((0 == _segment) || (_segmentSize <= _segmentFill) || (false == std::filesystem::exists(segmentPath, ec)))
+    {
+        if ((0 < _segment) && (false == SealSegment(_segment)))
+        {
+            return false;
+        }
+        ++_segment;
+        _segmentFill = 0;
+        std::filesystem::remove(PackStore::SegmentPath(_packStore.Root(), _segment), ec);
+        return true;
+    }
+    if (nullptr != _parityCode)
+    {
+        std::filesystem::remove(ParityFile::SegmentPath(_parityRoot, segmentPath), ec);
+    }
+    std::filesystem::resize_file(segmentPath, _segmentFill, ec);
+    return 0 == ec.value();
+}
+
+/**
+ * @brief Write the parity of a segment that is no longer appended to, unless it has parity already.
+ *
+ * @param[in] segment Closed segment
+ * @return true on success or without a parity code, false on error
+ */
+bool PackWriterThread::SealSegment(std::int64_t segment)
+{
+    std::error_code ec;
+    const std::filesystem::path segmentPath = PackStore::SegmentPath(_packStore.Root(), segment);
+    if ((nullptr == _parityCode) || (false == std::filesystem::exists(segmentPath, ec)))
+    {
+        return true;
+    }
+    const std::filesystem::path parityPath = ParityFile::SegmentPath(_parityRoot, segmentPath);
+    return (true == std::filesystem::exists(parityPath, ec)) || (true == ParityFile::Write(segmentPath, parityPath, *_parityCode));
+}
+
+/**
+ * @brief Pack a batch of contents, starting a new segment whenever the current one would grow past its size.
+ *
+ * @param[in,out] batch Contents to pack; their completions are taken
+ * @return true on success, false on error
+ */
+bool PackWriterThread::WriteBatch(std::vector<QueuedContent>& batch)
+{
+    std::vector<PackEntry> entries;
+    std::vector<std::uint8_t> buffer;
+    buffer.reserve(WriteSize);
+    std::unordered_set<std::string> batchKeys;
+    for (QueuedContent& item : batch)
+    {
+        PackLocation location{};
+        const bool known = (0 != batchKeys.count(ContentKey(item.hash, item.hashAlgorithm))) ||
+                           (true == _packStore.Find(item.hash, item.hashAlgorithm, location));
+        if ((false == known) && (item.content.size() < _inlineThreshold))
+        {
+            const std::uint64_t length = item.content.size();
+            entries.push_back(PackEntry{item.hash, item.hashAlgorithm, PackLocation{PackStore::InlineSegment, 0, length, std::move(item.content)}});
+            batchKeys.insert(ContentKey(item.hash, item.hashAlgorithm));
+        }
+        else if (false == known)
+        {
+            // A run that only holds contents inline never opens a segment.
+            if ((0 == _segment) && (false == OpenSegment()))
+            {
+                return false;
+            }
+            const std::uint64_t pending = _segmentFill + buffer.size();
+            if ((0 < pending) && (_segmentSize < (pending + item.content.size())))
+            {
+                if ((false == Flush(entries, buffer)) || (false == SealSegment(_segment)))
+                {
+                    return false;
+                }
+                ++_segment;
+                _segmentFill = 0;
+                std::error_code ec;
+                std::filesystem::remove(PackStore::SegmentPath(_packStore.Root(), _segment), ec);
+            }
+            entries.push_back(PackEntry{item.hash, item.hashAlgorithm, PackLocation{_segment, _segmentFill + buffer.size(), item.content.size(), {}}});
+            buffer.insert(buffer.end(), item.content.begin(), item.content.end());
+            batchKeys.insert(ContentKey(item.hash, item.hashAlgorithm));
+        }
+        if (nullptr != item.onStored)
+        {
+            _completions.push_back(std::move(item.onStored));
+        }
+    }
+    return Flush(entries, buffer);
+}
+
+/**
+ * @brief Append the gathered bytes to the current segment, index them, then run the waiting completions.
+ *
+ * @param[in,out] entries Contents in the buffer, emptied
+ * @param[in,out] buffer Bytes to append, emptied
+ * @return true on success, false on error
+ */
+bool PackWriterThread::Flush(std::vector<PackEntry>& entries, std::vector<std::uint8_t>& buffer)
+{
+    if (false == buffer.empty())
+    {
+        std::ofstream segmentStream(PackStore::SegmentPath(_packStore.Root(), _segment), std::ios::binary | std::ios::app);
+        for (std::size_t written = 0; written < buffer.size();)
+        {
+            const std::size_t length = std::min(buffer.size() - written, IoThrottle::RequestSize);
+            if (false == static_cast<bool>(segmentStream.write(reinterpret_cast<const char*>(buffer.data() + written),
+                                                               static_cast<std::streamsize>(length))))
+            {
+                return false;
+            }
+            written += length;
+            if (nullptr != _throttle)
+            {
+                _throttle->AcquireWrite(length);
+            }
+        }
+        if (false == static_cast<bool>(segmentStream.flush()))
+        {
+            return false;
+        }
+        _segmentFill += buffer.size();
+    }
+    if ((false == entries.empty()) && (false == _packStore.Commit(_segment, _segmentFill, entries)))
+    {
+        return false;
+    }
+    entries.clear();
+    buffer.clear();
+    for (const auto& completion : _completions)
+    {
+        completion();
+    }
+    _completions.clear();
+    return true;
+}
@@ -0,0 +1,143 @@
+// file PackWriterThread.hpp:
+
+#pragma once
+
+#include "PackStore.hpp"
+#include "ErasureCode/ReedSolomon.hpp"
+#include "FileHasher/FileHasher.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class IoThrottle;
+
+/**
+ * @brief Single packer thread appending small file contents to the pack segments.
+ *
+ * Workers hand over the content they read while hashing; the packer gathers it into large writes at the
+ * end of the current segment, indexes the written contents in one transaction and only then runs each
+ * file's completion, which records its state. A file state therefore never names a content the index
+ * does not have. Contents the index already has are not written again. Workers block while the queued
+ * contents exceed the queue bound, so a slow target holds the readers back instead of filling memory.
+ * Contents below the inline threshold skip the segment and are committed as BLOBs in the same index
+ * transaction, so a tiny file costs one row and no bytes on the target's filesystem. With a parity code, a
+ * segment gets its parity file once it is closed and never appended to again; the open segment has none.
+ */
+class PackWriterThread
+{
+  public:
+    /**
+     * @brief Bytes gathered into one write.
+     */
+    static constexpr std::size_t WriteSize = 4 * 1024 * 1024;
+
+    /**
+     * @brief Default bound in bytes of the contents waiting for the packer.
+     */
+    static constexpr std::size_t DefaultQueueBytes = 64 * 1024 * 1024;
+
+    /**
+     * @brief Longest time a queued content waits for a write to fill up.
+     */
+    static constexpr std::chrono::milliseconds FlushInterval{100};
+
+    /**
+     * @brief Start the packer thread.
+     *
+     * @param[in] packStore Index of the segments, also naming their directory
+     * @param[in] threshold Size in bytes below which files are packed
+     * @param[in] inlineThreshold Size in bytes below which contents are held inline in the index, 0 for none
+     * @param[in] segmentSize Size in bytes at which a segment is closed and the next one started
+     * @param[in] queueBytes Bound in bytes of the contents waiting for the packer
+     * @param[in] throttle Rate limiter the writes are charged to, nullptr writes at full speed
+     * @param[in] parityCode Code the parity of closed segments is computed with, nullptr writes no parity
+     * @param[in] parityRoot Directory holding the parity files, unused without a parity code
+     * @param[in] onThreadExit Called on the packer thread before it ends, after the last completion, may be nullptr
+     */
+    PackWriterThread(PackStore& packStore, std::uint64_t threshold, std::uint64_t inlineThreshold, std::uint64_t segmentSize, std::size_t queueBytes,
+                     IoThrottle* throttle, const ReedSolomon* parityCode, const std::filesystem::path& parityRoot,
+                     const std::function<void()>& onThreadExit);
+    /**
+     * @brief Stop the packer thread, writing anything still queued.
+     */
+    ~PackWriterThread();
+
+    PackWriterThread(const PackWriterThread&) = delete;
+    PackWriterThread& operator=(const PackWriterThread&) = delete;
+
+    /**
+     * @brief Check whether a file is small enough to be packed.
+     *
+     * @param[in] size File size in bytes
+     * @return true if the file belongs in the pack segments
+     */
+    bool IsPackable(std::uint64_t size) const;
+
+    /**
+     * @brief Queue a content for packing, waiting while the queue is full.
+     *
+     * @param[in] hash Digest of the content
+     * @param[in] hashAlgorithm Algorithm of hash
+     * @param[in] content Content bytes
+     * @param[in] onStored Called on the packer thread once the content is packed and indexed; not called on error
+     * @return false if an earlier write has failed, true otherwise
+     */
+    bool Append(const HashDigest& hash, HashAlgorithm hashAlgorithm, std::vector<std::uint8_t>&& content, std::function<void()> onStored);
+
+    /**
+     * @brief Write everything queued so far and join the packer thread.
+     *
+     * Producers must have stopped appending before this is called.
+     *
+     * @return true if every write and commit succeeded, false on error
+     */
+    bool Stop();
+
+  private:
+    /**
+     * @brief Content waiting for the packer.
+     */
+    struct QueuedContent
+    {
+        HashDigest hash;                   /**< Digest of the content */
+        HashAlgorithm hashAlgorithm;       /**< Algorithm of hash */
+        std::vector<std::uint8_t> content; /**< Content bytes */
+        std::function<void()> onStored;    /**< Completion run once the content is indexed */
+    };
+
+    void PackerLoop();
+    bool OpenSegment();
+    bool SealSegment(std::int64_t segment);
+    bool WriteBatch(std::vector<QueuedContent>& batch);
+    bool Flush(std::vector<PackEntry>& entries, std::vector<std::uint8_t>& buffer);
+
+    PackStore& _packStore;
+    std::uint64_t _threshold;
+    std::uint64_t _inlineThreshold;
+    std::uint64_t _segmentSize;
+    std::size_t _queueBytes;
+    IoThrottle* _throttle;
+    const ReedSolomon* _parityCode;
+    std::filesystem::path _parityRoot;
+    std::function<void()> _onThreadExit;
+
+    std::mutex _queueMutex;
+    std::condition_variable _queueNotEmptyCv;
+    std::condition_variable _queueNotFullCv;
+    std::deque<QueuedContent> _queue;
+    std::size_t _queuedBytes;
+    bool _stopping;
+    bool _failed;
+
+    std::int64_t _segment;         /**< Segment appended to, only used by the packer thread */
+    std::uint64_t _segmentFill;    /**< Bytes in the segment, only used by the packer thread */
+    std::vector<std::function<void()>> _completions; /**< Completions waiting for the next commit, only used by the packer thread */
+    std::thread _packer;
+};
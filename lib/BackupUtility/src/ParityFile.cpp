@@ -0,0 +1,330 @@
+// file ParityFile.cpp:
+
+#include "ParityFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <xxhash.h>
+
+namespace
+{
+constexpr char ParityMagic[8] = {'R', 'D', 'P', 'A', 'R', 'I', 'T', 'Y'};
+constexpr std::uint32_t ParityFormatVersion = 1;
+constexpr std::uint64_t BlockAlignment = 4096;
+const std::string PartialSuffix = ".partial.";
+
+/**
+ * @brief Fixed-size header at the start of a parity file, followed by the block checksums and the parity blocks.
+ */
+struct ParityHeader
+{
+    char magic[8];              /**< ParityMagic */
+    std::uint32_t formatVersion; /**< ParityFormatVersion */
+    std::uint32_t dataShards;   /**< k */
+    std::uint32_t parityShards; /**< m */
+    std::uint32_t blockSize;    /**< Bytes per block */
+    std::uint64_t fileSize;     /**< Size of the protected file */
+    std::uint64_t stripeCount;  /**< Stripes of k data and m parity blocks */
+    std::uint64_t checksum;     /**< XXH3-64 of this header with the field zero, followed by the block checksums */
+};
+
+static_assert(48 == sizeof(ParityHeader), "The parity header layout is part of the file format");
+
+/**
+ * @brief Pick the block size of a file: a single stripe for a small file, MaxBlockSize blocks for a large one.
+ *
+ * @param[in] fileSize Size of the file
+ * @param[in] dataShards k
+ * @return Block size in bytes
+ */
+std::uint32_t ChooseBlockSize(std::uint64_t fileSize, std::uint64_t dataShards)
+{
+    const std::uint64_t perShard = (fileSize + dataShards - 1) / dataShards;
+    const std::uint64_t aligned = ((perShard + BlockAlignment - 1) / BlockAlignment) * BlockAlignment;
+    return static_cast<std::uint32_t>(std::clamp<std::uint64_t>(aligned, BlockAlignment, ParityFile::MaxBlockSize));
+}
+
+std::uint64_t HeaderChecksum(ParityHeader header, const std::vector<std::uint64_t>& blockChecksums)
+{
+    header.checksum = 0;
+    XXH3_state_t* state = XXH3_createState();
+    if (nullptr == state)
+    {
+        return 0;
+    }
+    XXH3_64bits_reset(state);
+    XXH3_64bits_update(state, &header, sizeof(header));
+    XXH3_64bits_update(state, blockChecksums.data(), blockChecksums.size() * sizeof(std::uint64_t));
+    const std::uint64_t checksum = XXH3_64bits_digest(state);
+    XXH3_freeState(state);
+    return checksum;
+}
+
+std::uint64_t TableOffset()
+{
+    return sizeof(ParityHeader);
+}
+
+std::uint64_t ParityOffset(const ParityHeader& header, std::uint64_t stripe)
+{
+    const std::uint64_t shards = std::uint64_t{header.dataShards} + header.parityShards;
+    return TableOffset() + (header.stripeCount * shards * sizeof(std::uint64_t)) + (stripe * header.parityShards * header.blockSize);
+}
+
+bool ReadAt(std::fstream& stream, std::uint64_t offset, void* buffer, std::uint64_t length)
+{
+    stream.clear();
+    stream.seekg(static_cast<std::streamoff>(offset));
+    stream.read(static_cast<char*>(buffer), static_cast<std::streamsize>(length));
+    return static_cast<std::uint64_t>(stream.gcount()) == length;
+}
+
+bool WriteAt(std::fstream& stream, std::uint64_t offset, const void* buffer, std::uint64_t length)
+{
+    stream.clear();
+    stream.seekp(static_cast<std::streamoff>(offset));
+    return static_cast<bool>(stream.write(static_cast<const char*>(buffer), static_cast<std::streamsize>(length)));
+}
+
+/**
+ * @brief Read the data blocks of one stripe, padding past the end of the file with zeros.
+ *
+ * @param[in,out] stream Open protected file
+ * @param[in] header Parity header
+ * @param[in] stripe Stripe index
+ * @param[out] outputData k blocks
+ * @return true on success, false on a short read
+ */
+bool ReadStripe(std::fstream& stream, const ParityHeader& header, std::uint64_t stripe, std::vector<std::uint8_t>& outputData)
+{
+    const std::uint64_t stripeBytes = std::uint64_t{header.dataShards} * header.blockSize;
+    const std::uint64_t offset = stripe * stripeBytes;
+    const std::uint64_t length = std::min(stripeBytes, header.fileSize - offset);
+    std::fill(outputData.begin() + static_cast<std::ptrdiff_t>(length), outputData.end(), static_cast<std::uint8_t>(0));
+    return ReadAt(stream, offset, outputData.data(), length);
+}
+} // namespace
+
+std::filesystem::path ParityFile::ContentPath(const std::filesystem::path& parityRoot, const HashDigest& digest)
+{
+    const std::string hex = digest.ToHex();
+    return parityRoot / "objects" / hex.substr(0, 2) / hex.substr(2);
+}
+
+std::filesystem::path ParityFile::SegmentPath(const std::filesystem::path& parityRoot, const std::filesystem::path& segmentFile)
+{
+    return parityRoot / "packs" / segmentFile.filename();
+}
+
+bool ParityFile::Write(const std::filesystem::path& file, const std::filesystem::path& parityFile, const ReedSolomon& code)
+{
+    std::error_code ec;
+    const std::uintmax_t fileSize = std::filesystem::file_size(file, ec);
+    if (0 != ec.value())
+    {
+        return false;
+    }
+
+    ParityHeader header{};
+    std::memcpy(header.magic, ParityMagic, sizeof(ParityMagic));
+    header.formatVersion = ParityFormatVersion;
+    header.dataShards = static_cast<std::uint32_t>(code.DataShards());
+    header.parityShards = static_cast<std::uint32_t>(code.ParityShards());
+    header.blockSize = ChooseBlockSize(fileSize, header.dataShards);
+    header.fileSize = fileSize;
+    const std::uint64_t stripeBytes = std::uint64_t{header.dataShards} * header.blockSize;
+    header.stripeCount = (fileSize + stripeBytes - 1) / stripeBytes;
+
+    std::filesystem::create_directories(parityFile.parent_path(), ec);
+    // Workers writing the parity of equal contents at once each write their own partial file.
+    std::filesystem::path partialFile = parityFile;
+    partialFile += PartialSuffix + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    std::fstream source(file, std::ios::binary | std::ios::in);
+    std::fstream output(partialFile, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+    if ((false == source.is_open()) || (false == output.is_open()))
+    {
+        return false;
+    }
+
+    const std::size_t shards = code.DataShards() + code.ParityShards();
+    std::vector<std::uint64_t> blockChecksums(header.stripeCount * shards);
+    std::vector<std::uint8_t> data(stripeBytes);
+    std::vector<std::uint8_t> parity(code.ParityShards() * std::size_t{header.blockSize});
+    std::vector<const std::uint8_t*> dataBlocks(code.DataShards());
+    std::vector<std::uint8_t*> parityBlocks(code.ParityShards());
+    for (std::size_t index = 0; index < dataBlocks.size(); ++index)
+    {
+        dataBlocks[index] = data.data() + index * header.blockSize;
+    }
+    for (std::size_t index = 0; index < parityBlocks.size(); ++index)
+    {
+        parityBlocks[index] = parity.data() + index * header.blockSize;
+    }
+
+    bool success = true;
+    for (std::uint64_t stripe = 0; (true == success) && (stripe < header.stripeCount); ++stripe)
+    {
+        if (false == ReadStripe(source, header, stripe, data))
+        {
+            success = false;
+            continue;
+        }
+        code.Encode(dataBlocks.data(), parityBlocks.data(), header.blockSize);
+        for (std::size_t index = 0; index < shards; ++index)
+        {
+            const std::uint8_t* block = (index < dataBlocks.size()) ? dataBlocks[index] : parityBlocks[index - dataBlocks.size()];
+            blockChecksums[stripe * shards + index] = XXH3_64bits(block, header.blockSize);
+        }
+        success = WriteAt(output, ParityOffset(header, stripe), parity.data(), parity.size());
+    }
+
+    header.checksum = HeaderChecksum(header, blockChecksums);
+    success = (true == success) && (true == WriteAt(output, 0, &header, sizeof(header))) &&
+              (true == WriteAt(output, TableOffset(), blockChecksums.data(), blockChecksums.size() * sizeof(std::uint64_t))) &&
+              (true == static_cast<bool>(output.flush()));
+    output.close();
+    if (true == success)
+    {
+        std::filesystem::rename(partialFile, parityFile, ec);
+        success = (0 == ec.value());
+    }
+    if (false == success)
+    {
+        std::filesystem::remove(partialFile, ec);
+    }
+    return success;
+}
+
+bool ParityFile::Repair(const std::filesystem::path& file, const std::filesystem::path& parityFile, std::uint64_t& outputRepairedBlocks)
+{
+    outputRepairedBlocks = 0;
+    std::fstream parityStream(parityFile, std::ios::binary | std::ios::in | std::ios::out);
+    ParityHeader header{};
+    if ((false == parityStream.is_open()) || (false == ReadAt(parityStream, 0, &header, sizeof(header))) ||
+        (0 != std::memcmp(header.magic, ParityMagic, sizeof(ParityMagic))) || (ParityFormatVersion != header.formatVersion) ||
+        (0 == header.blockSize) || (MaxBlockSize < header.blockSize))
+    {
+        return false;
+    }
+    std::unique_ptr<ReedSolomon> code;
+    try
+    {
+        code = std::make_unique<ReedSolomon>(header.dataShards, header.parityShards);
+    }
+    catch (const std::invalid_argument&)
+    {
+        return false;
+    }
+    const std::uint64_t stripeBytes = std::uint64_t{header.dataShards} * header.blockSize;
+    if (header.stripeCount != (header.fileSize + stripeBytes - 1) / stripeBytes)
+    {
+        return false;
+    }
+    const std::size_t shards = code->DataShards() + code->ParityShards();
+    std::vector<std::uint64_t> blockChecksums(header.stripeCount * shards);
+    if ((false == ReadAt(parityStream, TableOffset(), blockChecksums.data(), blockChecksums.size() * sizeof(std::uint64_t))) ||
+        (header.checksum != HeaderChecksum(header, blockChecksums)))
+    {
+        return false;
+    }
+
+    std::error_code ec;
+    if (header.fileSize != std::filesystem::file_size(file, ec))
+    {
+        return false;
+    }
+    // Backup copies keep the permissions of their source, so a read-only one is made writable for the repair.
+    const std::filesystem::perms permissions = std::filesystem::status(file, ec).permissions();
+    const bool grantWrite = (0 == ec.value()) && (std::filesystem::perms::none == (permissions & std::filesystem::perms::owner_write));
+    if (true == grantWrite)
+    {
+        std::filesystem::permissions(file, std::filesystem::perms::owner_write, std::filesystem::perm_options::add, ec);
+    }
+    std::fstream fileStream(file, std::ios::binary | std::ios::in | std::ios::out);
+    if (true == grantWrite)
+    {
+        std::filesystem::permissions(file, permissions, std::filesystem::perm_options::replace, ec);
+    }
+    if (false == fileStream.is_open())
+    {
+        return false;
+    }
+
+    std::vector<std::uint8_t> data(stripeBytes);
+    std::vector<std::uint8_t> parity(code->ParityShards() * std::size_t{header.blockSize});
+    std::vector<std::uint8_t*> blocks(shards);
+    for (std::size_t index = 0; index < shards; ++index)
+    {
+        blocks[index] = (index < code->DataShards()) ? data.data() + index * header.blockSize
+                                                     : parity.data() + (index - code->DataShards()) * header.blockSize;
+    }
+
+    bool success = true;
+    std::vector<bool> present(shards);
+    for (std::uint64_t stripe = 0; stripe < header.stripeCount; ++stripe)
+    {
+        if ((false == ReadStripe(fileStream, header, stripe, data)) ||
+            (false == ReadAt(parityStream, ParityOffset(header, stripe), parity.data(), parity.size())))
+        {
+            return false;
+        }
+        std::size_t damaged = 0;
+        for (std::size_t index = 0; index < shards; ++index)
+        {
+            present[index] = (blockChecksums[stripe * shards + index] == XXH3_64bits(blocks[index], header.blockSize));
+            damaged += (true == present[index]) ? 0 : 1;
+        }
+        if (0 == damaged)
+        {
+            continue;
+        }
+        if ((damaged > code->ParityShards()) || (false == code->Reconstruct(blocks.data(), present, header.blockSize)))
+        {
+            success = false;
+            continue;
+        }
+        // A rebuilt block that misses its checksum means the checksums themselves are wrong; nothing is written then.
+        bool rebuilt = true;
+        for (std::size_t index = 0; index < shards; ++index)
+        {
+            rebuilt = (true == rebuilt) && ((true == present[index]) || (blockChecksums[stripe * shards + index] == XXH3_64bits(blocks[index], header.blockSize)));
+        }
+        if (false == rebuilt)
+        {
+            success = false;
+            continue;
+        }
+        for (std::size_t index = 0; index < shards; ++index)
+        {
+            if (true == present[index])
+            {
+                continue;
+            }
+            if (index < code->DataShards())
+            {
+                const std::uint64_t offset = stripe * stripeBytes + index * std::uint64_t{header.blockSize};
+                const std::uint64_t length = std::min<std::uint64_t>(header.blockSize, header.fileSize - std::min(header.fileSize, offset));
+                if ((0 < length) && (false == WriteAt(fileStream, offset, blocks[index], length)))
+                {
+                    return false;
+                }
+                ++outputRepairedBlocks;
+            }
+            else if (false == WriteAt(parityStream, ParityOffset(header, stripe) + (index - code->DataShards()) * std::uint64_t{header.blockSize}, blocks[index],
+                                      header.blockSize))
+            {
+                return false;
+            }
+        }
+    }
+    return (true == static_cast<bool>(fileStream.flush())) && (true == static_cast<bool>(parityStream.flush())) && (true == success);
+}
@@ -0,0 +1,78 @@
+// file ParityFile.hpp:
+
+#pragma once
+
+#include "ErasureCode/ReedSolomon.hpp"
+#include "FileHasher/FileHasher.hpp"
+
+#include <cstdint>
+#include <filesystem>
+
+/**
+ * @brief Reed-Solomon parity of one stored file, from which damaged blocks of the file are rebuilt in place.
+ *
+ * The file is cut into blocks, and every k consecutive blocks form a stripe with m parity blocks; the last
+ * stripe is padded with zeros. Blocks are aligned to 4 KiB so a bad sector damages one block, and small
+ * files get smaller blocks so that one stripe covers them and the parity stays m/k of their size. The
+ * parity file holds a header, an XXH3 checksum of every data and parity block, which tells the damaged
+ * blocks apart from the intact ones, and the parity blocks. A stripe with at most m damaged blocks is
+ * rebuilt, and a rebuilt block is written back only when it matches its checksum, so a repair never
+ * writes anything but the original content. The layout follows the host's byte order.
+ *
+ * Parity of a backup copy is keyed by its digest, so it follows the content through moves, archiving and
+ * hardlinks; parity of a pack segment is keyed by the segment's file name.
+ */
+class ParityFile
+{
+  public:
+    /**
+     * @brief Directory below the backup root the parity files are kept in.
+     */
+    static constexpr const char* Area = "parity";
+
+    /**
+     * @brief Largest block; larger files get more stripes instead.
+     */
+    static constexpr std::uint32_t MaxBlockSize = 256 * 1024;
+
+    /**
+     * @brief Get the location of the parity of a content.
+     *
+     * @param[in] parityRoot Directory holding the parity files
+     * @param[in] digest Content digest
+     * @return Path of the parity file
+     */
+    static std::filesystem::path ContentPath(const std::filesystem::path& parityRoot, const HashDigest& digest);
+
+    /**
+     * @brief Get the location of the parity of a pack segment.
+     *
+     * @param[in] parityRoot Directory holding the parity files
+     * @param[in] segmentFile Path of the segment
+     * @return Path of the parity file
+     */
+    static std::filesystem::path SegmentPath(const std::filesystem::path& parityRoot, const std::filesystem::path& segmentFile);
+
+    /**
+     * @brief Compute the parity of a file and write it, replacing an older parity file.
+     *
+     * The parity is written beside its final path and renamed into place once complete.
+     *
+     * @param[in] file File to protect; it must not change while it is read
+     * @param[in] parityFile Path of the parity file
+     * @param[in] code Shard counts and kernel
+     * @return true on success, false on error
+     */
+    static bool Write(const std::filesystem::path& file, const std::filesystem::path& parityFile, const ReedSolomon& code);
+
+    /**
+     * @brief Rebuild the damaged blocks of a file and of its parity in place.
+     *
+     * @param[in] file File to repair, of the size it had when its parity was written
+     * @param[in] parityFile Its parity file
+     * @param[out] outputRepairedBlocks Blocks of the file that were rewritten
+     * @return true if every block of the file now matches its checksum, false if the parity is missing or
+     *         damaged, the file changed size or a stripe has more damaged blocks than parity blocks
+     */
+    static bool Repair(const std::filesystem::path& file, const std::filesystem::path& parityFile, std::uint64_t& outputRepairedBlocks);
+};
@@ -0,0 +1,152 @@
+// file PartitionCatalog.cpp:
+
+#include "PartitionCatalog.hpp"
+
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+constexpr const char* SqlCreatePartitionSnapshotsTable = "CREATE TABLE IF NOT EXISTS partition_snapshots ("
+                                                         "id INTEGER PRIMARY KEY,"
+                                                         "name TEXT NOT NULL UNIQUE,"
+                                                         "partitions INTEGER NOT NULL);";
+
+constexpr const char* SqlCreatePartitionPartsTable = "CREATE TABLE IF NOT EXISTS partition_parts ("
+                                                     "snapshot_id INTEGER NOT NULL,"
+                                                     "partition_index INTEGER NOT NULL,"
+                                                     "snapshot TEXT NOT NULL,"
+                                                     "files INTEGER NOT NULL,"
+                                                     "bytes INTEGER NOT NULL,"
+                                                     "PRIMARY KEY (snapshot_id, partition_index));";
+
+constexpr const char* SqlCreatePartitionCostsTable = "CREATE TABLE IF NOT EXISTS partition_costs ("
+                                                     "entry TEXT PRIMARY KEY,"
+                                                     "files INTEGER NOT NULL,"
+                                                     "bytes INTEGER NOT NULL);";
+}
+
+PartitionCatalog::PartitionCatalog(SQLiteSession& databaseSession) : _databaseSession(databaseSession)
+{
+}
+
+bool PartitionCatalog::InitializeSchema()
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute(SqlCreatePartitionSnapshotsTable);
+        connection.Execute(SqlCreatePartitionPartsTable);
+        connection.Execute(SqlCreatePartitionCostsTable);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool PartitionCatalog::GetEntryCosts(std::map<std::string, PartitionEntryCost>& outputCosts)
+{
+    outputCosts.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT entry, files, bytes FROM partition_costs;");
+        while (true == statement.FetchRow())
+        {
+            outputCosts[std::string(statement.ColumnView(0))] =
+                PartitionEntryCost{static_cast<std::uint64_t>(statement.ColumnInt64(1)), static_cast<std::uint64_t>(statement.ColumnInt64(2))};
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool PartitionCatalog::RecordSnapshot(const std::string& name, const std::vector<PartitionSnapshotPart>& parts,
+                                      const std::map<std::string, PartitionEntryCost>& costs)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            auto removeParts = connection.Prepare("DELETE FROM partition_parts WHERE snapshot_id IN (SELECT id FROM partition_snapshots WHERE name=?1);");
+            removeParts.BindText(1, name);
+            auto removeSnapshot = connection.Prepare("DELETE FROM partition_snapshots WHERE name=?1;");
+            removeSnapshot.BindText(1, name);
+            auto insertSnapshot = connection.Prepare("INSERT INTO partition_snapshots(name, partitions) VALUES(?1, ?2) RETURNING id;");
+            insertSnapshot.BindText(1, name);
+            insertSnapshot.BindInt64(2, static_cast<std::int64_t>(parts.size()));
+            if ((false == removeParts.ExecuteStatement()) || (false == removeSnapshot.ExecuteStatement()) || (false == insertSnapshot.FetchRow()))
+            {
+                connection.Execute("ROLLBACK;");
+                return false;
+            }
+            const std::int64_t snapshotId = insertSnapshot.ColumnInt64(0);
+            insertSnapshot.Reset();
+            for (const auto& part : parts)
+            {
+                auto cachedStatement = connection.PrepareCached("INSERT INTO partition_parts VALUES (?1, ?2, ?3, ?4, ?5);");
+                cachedStatement->BindInt64(1, snapshotId);
+                cachedStatement->BindInt64(2, part.partition);
+                cachedStatement->BindText(3, part.snapshot);
+                cachedStatement->BindInt64(4, static_cast<std::int64_t>(part.files));
+                cachedStatement->BindInt64(5, static_cast<std::int64_t>(part.bytes));
+                if (false == cachedStatement->ExecuteStatement())
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+            }
+            connection.Execute("DELETE FROM partition_costs;");
+            for (const auto& [entry, cost] : costs)
+            {
+                auto cachedStatement = connection.PrepareCached("INSERT INTO partition_costs VALUES (?1, ?2, ?3);");
+                cachedStatement->BindText(1, entry);
+                cachedStatement->BindInt64(2, static_cast<std::int64_t>(cost.files));
+                cachedStatement->BindInt64(3, static_cast<std::int64_t>(cost.bytes));
+                if (false == cachedStatement->ExecuteStatement())
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool PartitionCatalog::GetSnapshotNames(std::vector<std::string>& outputNames)
+{
+    outputNames.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT name FROM partition_snapshots ORDER BY id;");
+        while (true == statement.FetchRow())
+        {
+            outputNames.emplace_back(statement.ColumnView(0));
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
@@ -0,0 +1,83 @@
+// file PartitionCatalog.hpp:
+
+#pragma once
+
+#include "SQLite/SQLiteSession.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Stored files and bytes below one top-level entry of the source tree.
+ */
+struct PartitionEntryCost
+{
+    std::uint64_t files; /**< Live files below the entry */
+    std::uint64_t bytes; /**< Bytes of those files */
+};
+
+/**
+ * @brief Run of one partition that a merged snapshot is made of.
+ */
+struct PartitionSnapshotPart
+{
+    unsigned int partition; /**< Partition the run backed up */
+    std::string snapshot;   /**< Name of the run's snapshot in the partition's store */
+    std::uint64_t files;    /**< Live files the partition holds after the run */
+    std::uint64_t bytes;    /**< Bytes of those files */
+};
+
+/**
+ * @brief Coordinator database of a distributed backup: the snapshots merged from the partitions' runs
+ *        and the per-entry costs the next plan is weighted by.
+ */
+class PartitionCatalog
+{
+  public:
+    /**
+     * @brief Create a catalog bound to a SQLite session on the coordinator database.
+     *
+     * @param[in] databaseSession Active SQLite session for the coordinator database
+     */
+    explicit PartitionCatalog(SQLiteSession& databaseSession);
+
+    /**
+     * @brief Create the catalog tables if they do not exist.
+     *
+     * @return true on success, false on error
+     */
+    bool InitializeSchema();
+
+    /**
+     * @brief Get the costs recorded by the latest merge.
+     *
+     * @param[out] outputCosts Cost per top-level entry name
+     * @return true on success, false on error
+     */
+    bool GetEntryCosts(std::map<std::string, PartitionEntryCost>& outputCosts);
+
+    /**
+     * @brief Record a merged snapshot and replace the entry costs, in one transaction.
+     *
+     * Merging the same snapshot again replaces its record.
+     *
+     * @param[in] name Snapshot name, the creation timestamp of the plan the runs followed
+     * @param[in] parts One run per partition
+     * @param[in] costs Cost per top-level entry name measured from the partitions' databases
+     * @return true on success, false on error
+     */
+    bool RecordSnapshot(const std::string& name, const std::vector<PartitionSnapshotPart>& parts, const std::map<std::string, PartitionEntryCost>& costs);
+
+    /**
+     * @brief Get the names of the merged snapshots.
+     *
+     * @param[out] outputNames Snapshot names, oldest first
+     * @return true on success, false on error
+     */
+    bool GetSnapshotNames(std::vector<std::string>& outputNames);
+
+  private:
+    SQLiteSession& _databaseSession;
+};
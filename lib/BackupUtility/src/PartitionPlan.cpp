@@ -0,0 +1,343 @@
+// file PartitionPlan.cpp:
+
+#include "PartitionPlan.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+
+namespace
+{
+constexpr const char* PlanMagic = "rdemo-partition-plan";
+constexpr const char* PlanFormatVersion = "1";
+
+/**
+ * @brief Escape the characters that would break a plan line.
+ *
+ * @param[in] text Entry name
+ * @return Name with `%`, tab, CR and LF written as `%` and two hex digits
+ */
+std::string EscapeField(const std::string& text)
+{
+    static constexpr char HexDigits[] = "0123456789ABCDEF";
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (const char c : text)
+    {
+        if (('%' == c) || ('\t' == c) || ('\r' == c) || ('\n' == c))
+        {
+            escaped += '%';
+            escaped += HexDigits[static_cast<unsigned char>(c) >> 4];
+            escaped += HexDigits[static_cast<unsigned char>(c) & 0x0F];
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * @brief Get the value of one hex digit.
+ *
+ * @param[in] c Character to decode
+ * @return Value of the digit, -1 if the character is not a hex digit
+ */
+int HexValue(char c)
+{
+    if (('0' <= c) && ('9' >= c))
+    {
+        return c - '0';
+    }
+    if (('A' <= c) && ('F' >= c))
+    {
+        return c - 'A' + 10;
+    }
+    if (('a' <= c) && ('f' >= c))
+    {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @brief Undo EscapeField.
+ *
+ * @param[in] text Escaped name
+ * @param[out] outputText Entry name
+ * @return true on success, false on a malformed escape
+ */
+bool UnescapeField(const std::string& text, std::string& outputText)
+{
+    outputText.clear();
+    for (std::size_t i = 0; i < text.size(); ++i)
+    {
+        if ('%' != text[i])
+        {
+            outputText += text[i];
+            continue;
+        }
+        const int high = (i + 2 < text.size()) ? HexValue(text[i + 1]) : -1;
+        const int low = (i + 2 < text.size()) ? HexValue(text[i + 2]) : -1;
+        if ((0 > high) || (0 > low))
+        {
+            return false;
+        }
+        outputText += static_cast<char>((high << 4) | low);
+        i += 2;
+    }
+    return true;
+}
+
+/**
+ * @brief Escape the characters a filter pattern treats specially, so the name matches only itself.
+ *
+ * @param[in] name Entry name
+ * @return Name with wildcards, classes, backslashes and spaces escaped with a backslash
+ */
+std::string EscapeGlob(const std::string& name)
+{
+    std::string escaped;
+    escaped.reserve(name.size());
+    for (const char c : name)
+    {
+        if (('*' == c) || ('?' == c) || ('[' == c) || ('\\' == c) || (' ' == c))
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+/**
+ * @brief Split a line at its tabs.
+ *
+ * @param[in] line Line without its line break
+ * @return Fields of the line
+ */
+std::vector<std::string> SplitFields(const std::string& line)
+{
+    std::vector<std::string> fields;
+    std::size_t start = 0;
+    while (true)
+    {
+        const std::size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab - start));
+        if (std::string::npos == tab)
+        {
+            return fields;
+        }
+        start = tab + 1;
+    }
+}
+
+/**
+ * @brief Parse an unsigned decimal number.
+ *
+ * @param[in] text Digits only
+ * @param[out] outputValue Parsed number
+ * @return true on success, false if the text is empty, not a number or too large
+ */
+bool ParseUnsigned(const std::string& text, unsigned int& outputValue)
+{
+    if ((true == text.empty()) || (9 < text.size()) || (false == std::all_of(text.begin(), text.end(), [](char c) { return ('0' <= c) && ('9' >= c); })))
+    {
+        return false;
+    }
+    outputValue = static_cast<unsigned int>(std::stoul(text));
+    return true;
+}
+}
+
+PartitionPlan::PartitionPlan() : _partitions(1)
+{
+}
+
+bool PartitionPlan::Read(const std::filesystem::path& planFile)
+{
+    std::ifstream input(planFile, std::ios::binary);
+    if (false == input.is_open())
+    {
+        return false;
+    }
+    std::string created;
+    unsigned int partitions = 0;
+    std::vector<PartitionPlanEntry> entries;
+    std::string line;
+    bool headerSeen = false;
+    while (std::getline(input, line))
+    {
+        const std::vector<std::string> fields = SplitFields(line);
+        if (false == headerSeen)
+        {
+            if ((2 != fields.size()) || (PlanMagic != fields[0]) || (PlanFormatVersion != fields[1]))
+            {
+                return false;
+            }
+            headerSeen = true;
+        }
+        else if ((2 == fields.size()) && ("created" == fields[0]))
+        {
+            created = fields[1];
+        }
+        else if ((2 == fields.size()) && ("partitions" == fields[0]))
+        {
+            if (false == ParseUnsigned(fields[1], partitions))
+            {
+                return false;
+            }
+        }
+        else if ((3 == fields.size()) && ("entry" == fields[0]))
+        {
+            PartitionPlanEntry entry;
+            if ((false == ParseUnsigned(fields[1], entry.partition)) || (false == UnescapeField(fields[2], entry.name)))
+            {
+                return false;
+            }
+            entries.push_back(std::move(entry));
+        }
+        else
+        {
+            return false;
+        }
+    }
+    if ((true == input.bad()) || (false == headerSeen) || (true == created.empty()) || (0 == partitions))
+    {
+        return false;
+    }
+    for (const auto& entry : entries)
+    {
+        if ((entry.partition >= partitions) || (true == entry.name.empty()))
+        {
+            return false;
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const PartitionPlanEntry& left, const PartitionPlanEntry& right) { return left.name < right.name; });
+    _created = created;
+    _partitions = partitions;
+    _entries = std::move(entries);
+    return true;
+}
+
+bool PartitionPlan::Write(const std::filesystem::path& planFile) const
+{
+    std::filesystem::path temporaryPath = planFile;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+        output << PlanMagic << '\t' << PlanFormatVersion << '\n';
+        output << "created\t" << _created << '\n';
+        output << "partitions\t" << _partitions << '\n';
+        for (const auto& entry : _entries)
+        {
+            output << "entry\t" << entry.partition << '\t' << EscapeField(entry.name) << '\n';
+        }
+        output.flush();
+        if (false == output.good())
+        {
+            return false;
+        }
+    }
+    std::error_code errorCode;
+    std::filesystem::rename(temporaryPath, planFile, errorCode);
+    if (0 != errorCode.value())
+    {
+        std::filesystem::remove(temporaryPath, errorCode);
+        return false;
+    }
+    return true;
+}
+
+void PartitionPlan::Assign(const std::vector<PartitionCandidate>& candidates, unsigned int partitions, bool rebalance, const std::string& created)
+{
+    partitions = std::max(1U, partitions);
+    std::unordered_map<std::string, unsigned int> previous;
+    if ((false == rebalance) && (partitions == _partitions))
+    {
+        for (const auto& entry : _entries)
+        {
+            previous.emplace(entry.name, entry.partition);
+        }
+    }
+
+    std::vector<const PartitionCandidate*> ordered;
+    ordered.reserve(candidates.size());
+    for (const auto& candidate : candidates)
+    {
+        ordered.push_back(&candidate);
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const PartitionCandidate* left, const PartitionCandidate* right)
+              { return (left->cost != right->cost) ? (left->cost > right->cost) : (left->name < right->name); });
+
+    std::vector<std::uint64_t> loads(partitions, 0);
+    std::vector<PartitionPlanEntry> entries;
+    entries.reserve(ordered.size());
+    for (const PartitionCandidate* candidate : ordered)
+    {
+        const auto known = previous.find(candidate->name);
+        if (previous.end() != known)
+        {
+            loads[known->second] += candidate->cost;
+            entries.push_back(PartitionPlanEntry{candidate->name, known->second});
+        }
+    }
+    for (const PartitionCandidate* candidate : ordered)
+    {
+        if (previous.end() != previous.find(candidate->name))
+        {
+            continue;
+        }
+        const auto lightest = static_cast<unsigned int>(std::min_element(loads.begin(), loads.end()) - loads.begin());
+        loads[lightest] += candidate->cost;
+        entries.push_back(PartitionPlanEntry{candidate->name, lightest});
+    }
+    std::sort(entries.begin(), entries.end(), [](const PartitionPlanEntry& left, const PartitionPlanEntry& right) { return left.name < right.name; });
+    _created = created;
+    _partitions = partitions;
+    _entries = std::move(entries);
+}
+
+std::vector<std::string> PartitionPlan::FilterPatterns(unsigned int partition) const
+{
+    std::vector<std::string> patterns;
+    if (0 == partition)
+    {
+        // The first partition takes everything the others do not, including entries created after planning.
+        for (const auto& entry : _entries)
+        {
+            if (0 != entry.partition)
+            {
+                patterns.push_back("/" + EscapeGlob(entry.name));
+            }
+        }
+        return patterns;
+    }
+    patterns.push_back("/*");
+    for (const auto& entry : _entries)
+    {
+        if (partition == entry.partition)
+        {
+            patterns.push_back("!/" + EscapeGlob(entry.name));
+        }
+    }
+    return patterns;
+}
+
+const std::string& PartitionPlan::Created() const
+{
+    return _created;
+}
+
+unsigned int PartitionPlan::Partitions() const
+{
+    return _partitions;
+}
+
+const std::vector<PartitionPlanEntry>& PartitionPlan::Entries() const
+{
+    return _entries;
+}
@@ -0,0 +1,106 @@
+// file PartitionPlan.hpp:
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Top-level entry of the source tree with the cost of backing it up.
+ */
+struct PartitionCandidate
+{
+    std::string name;   /**< Name of the entry directly below the source directory */
+    std::uint64_t cost; /**< Estimated cost of backing the entry up */
+};
+
+/**
+ * @brief Top-level entry of the source tree assigned to a partition.
+ */
+struct PartitionPlanEntry
+{
+    std::string name;       /**< Name of the entry directly below the source directory */
+    unsigned int partition; /**< Partition backing the entry up */
+};
+
+/**
+ * @brief Assignment of the top-level entries of a source tree to the partitions of a distributed backup.
+ *
+ * The plan is a text file of tab-separated lines that the coordinator writes and every node reads, so
+ * it can be copied to nodes that do not share the backup root. Partition 0 also backs up every entry
+ * the plan does not name, so entries created after planning are never missed.
+ */
+class PartitionPlan
+{
+  public:
+    /**
+     * @brief Create an empty plan with one partition.
+     */
+    PartitionPlan();
+
+    /**
+     * @brief Read a plan file.
+     *
+     * @param[in] planFile File written by Write
+     * @return true on success, false if the file is missing or malformed
+     */
+    bool Read(const std::filesystem::path& planFile);
+
+    /**
+     * @brief Write the plan under a temporary name and rename it over the previous one.
+     *
+     * @param[in] planFile File to create or replace
+     * @return true on success, false on error
+     */
+    bool Write(const std::filesystem::path& planFile) const;
+
+    /**
+     * @brief Assign entries to partitions, costliest first, each to the least loaded partition.
+     *
+     * Unless rebalance is set, entries the plan already assigns keep their partition when the number of
+     * partitions is unchanged, since moving an entry makes its old partition archive it as deleted and its
+     * new one copy it again. Entries no longer in the candidates are dropped.
+     *
+     * @param[in] candidates Top-level entries of the source tree
+     * @param[in] partitions Number of partitions, at least 1
+     * @param[in] rebalance Reassign every entry
+     * @param[in] created Timestamp of the plan, in the run timestamp format
+     */
+    void Assign(const std::vector<PartitionCandidate>& candidates, unsigned int partitions, bool rebalance, const std::string& created);
+
+    /**
+     * @brief Get the filter patterns limiting a run to the entries of one partition.
+     *
+     * @param[in] partition Partition below Partitions()
+     * @return gitignore-style patterns to put before any other patterns of the run
+     */
+    std::vector<std::string> FilterPatterns(unsigned int partition) const;
+
+    /**
+     * @brief Get the timestamp the plan was made at.
+     *
+     * @return Timestamp in the run timestamp format
+     */
+    const std::string& Created() const;
+
+    /**
+     * @brief Get the number of partitions.
+     *
+     * @return Number of partitions, at least 1
+     */
+    unsigned int Partitions() const;
+
+    /**
+     * @brief Get the assigned entries.
+     *
+     * @return Entries sorted by name
+     */
+    const std::vector<PartitionPlanEntry>& Entries() const;
+
+  private:
+    std::string _created;
+    unsigned int _partitions;
+    std::vector<PartitionPlanEntry> _entries;
+};
@@ -0,0 +1,360 @@
+// file PathIdBitmap.cpp:
+
+#include "PathIdBitmap.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+constexpr std::size_t BitmapWords = 65536 / 64;
+constexpr std::uint32_t SerializedMagic = 0x31424950U; // "PIB1"
+constexpr std::uint8_t ArrayKind = 0;
+constexpr std::uint8_t BitmapKind = 1;
+/**
+ * @brief Bytes of a container header: key, kind and cardinality.
+ */
+constexpr std::size_t ContainerHeaderBytes = 2 + 1 + 4;
+
+/**
+ * @brief Count the set bits of a word; the compiler turns this into a popcnt where the target has one.
+ *
+ * @param[in] word Word to count
+ * @return Number of set bits
+ */
+std::uint32_t CountBits(std::uint64_t word)
+{
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<std::uint32_t>((word * 0x0101010101010101ULL) >> 56);
+}
+
+/**
+ * @brief Count the set bits of a bitmap container.
+ *
+ * @param[in] words Bitmap words
+ * @return Number of set bits
+ */
+std::uint32_t CountBits(const std::vector<std::uint64_t>& words)
+{
+    std::uint32_t count = 0;
+    for (std::uint64_t word : words)
+    {
+        count += CountBits(word);
+    }
+    return count;
+}
+
+/**
+ * @brief Check whether a bitmap container holds a value.
+ *
+ * @param[in] words Bitmap words
+ * @param[in] value Low 16 bits of an id
+ * @return true if the value's bit is set
+ */
+bool TestBit(const std::vector<std::uint64_t>& words, std::uint16_t value)
+{
+    return 0 != (words[value / 64] & (1ULL << (value % 64)));
+}
+
+/**
+ * @brief Append the low bytes of a value, least significant first.
+ *
+ * @param[in,out] output Buffer to append to
+ * @param[in] value Value to write
+ * @param[in] bytes Number of bytes to write
+ */
+void PutLittleEndian(std::vector<std::uint8_t>& output, std::uint64_t value, std::size_t bytes)
+{
+    for (std::size_t index = 0; index < bytes; ++index)
+    {
+        output.push_back(static_cast<std::uint8_t>(value >> (8 * index)));
+    }
+}
+
+/**
+ * @brief Read a value written by PutLittleEndian.
+ *
+ * @param[in] data First byte of the value
+ * @param[in] bytes Number of bytes to read
+ * @return Value read
+ */
+std::uint64_t GetLittleEndian(const std::uint8_t* data, std::size_t bytes)
+{
+    std::uint64_t value = 0;
+    for (std::size_t index = 0; index < bytes; ++index)
+    {
+        value |= static_cast<std::uint64_t>(data[index]) << (8 * index);
+    }
+    return value;
+}
+} // namespace
+
+std::size_t PathIdBitmap::FindContainer(std::uint16_t key) const
+{
+    // Ids are usually added in ascending order, which always lands on the last container.
+    if ((false == _containers.empty()) && (_containers.back().key <= key))
+    {
+        return (_containers.back().key == key) ? _containers.size() - 1 : _containers.size();
+    }
+    const auto position = std::lower_bound(_containers.begin(), _containers.end(), key,
+                                           [](const Container& container, std::uint16_t searchKey) { return container.key < searchKey; });
+    return static_cast<std::size_t>(std::distance(_containers.begin(), position));
+}
+
+void PathIdBitmap::Add(std::uint32_t id)
+{
+    const auto key = static_cast<std::uint16_t>(id >> 16);
+    const auto value = static_cast<std::uint16_t>(id & 0xFFFFU);
+    const std::size_t index = FindContainer(key);
+    if ((_containers.size() == index) || (_containers[index].key != key))
+    {
+        _containers.insert(_containers.begin() + static_cast<std::ptrdiff_t>(index), Container{key, 1, {value}, {}});
+        return;
+    }
+    Container& container = _containers[index];
+    if (false == container.words.empty())
+    {
+        std::uint64_t& word = container.words[value / 64];
+        const std::uint64_t bit = 1ULL << (value % 64);
+        container.cardinality += (0 == (word & bit)) ? 1 : 0;
+        word |= bit;
+        return;
+    }
+    const auto position = ((false == container.values.empty()) && (container.values.back() < value))
+                              ? container.values.end()
+                              : std::lower_bound(container.values.begin(), container.values.end(), value);
+    if ((container.values.end() != position) && (*position == value))
+    {
+        return;
+    }
+    container.values.insert(position, value);
+    ++container.cardinality;
+    if (ArrayLimit < container.values.size())
+    {
+        container.words.assign(BitmapWords, 0);
+        for (std::uint16_t arrayValue : container.values)
+        {
+            container.words[arrayValue / 64] |= 1ULL << (arrayValue % 64);
+        }
+        container.values.clear();
+        container.values.shrink_to_fit();
+    }
+}
+
+bool PathIdBitmap::Contains(std::uint32_t id) const
+{
+    const auto key = static_cast<std::uint16_t>(id >> 16);
+    const auto value = static_cast<std::uint16_t>(id & 0xFFFFU);
+    const std::size_t index = FindContainer(key);
+    if ((_containers.size() == index) || (_containers[index].key != key))
+    {
+        return false;
+    }
+    const Container& container = _containers[index];
+    if (false == container.words.empty())
+    {
+        return TestBit(container.words, value);
+    }
+    return std::binary_search(container.values.begin(), container.values.end(), value);
+}
+
+std::uint64_t PathIdBitmap::Cardinality() const
+{
+    std::uint64_t count = 0;
+    for (const Container& container : _containers)
+    {
+        count += container.cardinality;
+    }
+    return count;
+}
+
+void PathIdBitmap::AndNot(const PathIdBitmap& other)
+{
+    std::size_t otherIndex = 0;
+    for (Container& container : _containers)
+    {
+        while ((other._containers.size() > otherIndex) && (other._containers[otherIndex].key < container.key))
+        {
+            ++otherIndex;
+        }
+        if ((other._containers.size() == otherIndex) || (other._containers[otherIndex].key != container.key))
+        {
+            continue;
+        }
+        const Container& removed = other._containers[otherIndex];
+        if ((false == container.words.empty()) && (false == removed.words.empty()))
+        {
+            for (std::size_t word = 0; word < BitmapWords; ++word)
+            {
+                container.words[word] &= ~removed.words[word];
+            }
+        }
+        else if (false == container.words.empty())
+        {
+            for (std::uint16_t value : removed.values)
+            {
+                container.words[value / 64] &= ~(1ULL << (value % 64));
+            }
+        }
+        else if (false == removed.words.empty())
+        {
+            container.values.erase(std::remove_if(container.values.begin(), container.values.end(),
+                                                  [&removed](std::uint16_t value) { return TestBit(removed.words, value); }),
+                                   container.values.end());
+        }
+        else
+        {
+            std::vector<std::uint16_t> kept;
+            std::set_difference(container.values.begin(), container.values.end(), removed.values.begin(), removed.values.end(),
+                                std::back_inserter(kept));
+            container.values = std::move(kept);
+        }
+
+        if (true == container.words.empty())
+        {
+            container.cardinality = static_cast<std::uint32_t>(container.values.size());
+            continue;
+        }
+        container.cardinality = CountBits(container.words);
+        if (ArrayLimit >= container.cardinality)
+        {
+            container.values.clear();
+            container.values.reserve(container.cardinality);
+            for (std::size_t word = 0; word < BitmapWords; ++word)
+            {
+                for (std::uint64_t bits = container.words[word]; 0 != bits; bits &= bits - 1)
+                {
+                    container.values.push_back(static_cast<std::uint16_t>((word * 64) + CountBits((bits & (0 - bits)) - 1)));
+                }
+            }
+            container.words.clear();
+            container.words.shrink_to_fit();
+        }
+    }
+    _containers.erase(std::remove_if(_containers.begin(), _containers.end(), [](const Container& container) { return 0 == container.cardinality; }),
+                      _containers.end());
+}
+
+bool PathIdBitmap::ForEach(const std::function<bool(std::uint32_t)>& onId) const
+{
+    for (const Container& container : _containers)
+    {
+        const std::uint32_t high = static_cast<std::uint32_t>(container.key) << 16;
+        if (true == container.words.empty())
+        {
+            for (std::uint16_t value : container.values)
+            {
+                if (false == onId(high | value))
+                {
+                    return false;
+                }
+            }
+            continue;
+        }
+        for (std::size_t word = 0; word < BitmapWords; ++word)
+        {
+            for (std::uint64_t bits = container.words[word]; 0 != bits; bits &= bits - 1)
+            {
+                if (false == onId(high | static_cast<std::uint32_t>((word * 64) + CountBits((bits & (0 - bits)) - 1))))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+std::vector<std::uint8_t> PathIdBitmap::Serialize() const
+{
+    std::vector<std::uint8_t> output;
+    PutLittleEndian(output, SerializedMagic, 4);
+    PutLittleEndian(output, _containers.size(), 4);
+    for (const Container& container : _containers)
+    {
+        PutLittleEndian(output, container.key, 2);
+        output.push_back((true == container.words.empty()) ? ArrayKind : BitmapKind);
+        PutLittleEndian(output, container.cardinality, 4);
+        for (std::uint16_t value : container.values)
+        {
+            PutLittleEndian(output, value, 2);
+        }
+        for (std::uint64_t word : container.words)
+        {
+            PutLittleEndian(output, word, 8);
+        }
+    }
+    return output;
+}
+
+bool PathIdBitmap::Deserialize(const std::uint8_t* data, std::size_t size, PathIdBitmap& outputBitmap)
+{
+    outputBitmap._containers.clear();
+    if ((8 > size) || (SerializedMagic != GetLittleEndian(data, 4)))
+    {
+        return false;
+    }
+    const std::uint64_t containerCount = GetLittleEndian(data + 4, 4);
+    std::size_t offset = 8;
+    std::vector<Container> containers;
+    for (std::uint64_t index = 0; index < containerCount; ++index)
+    {
+        if (ContainerHeaderBytes > size - offset)
+        {
+            return false;
+        }
+        Container container{static_cast<std::uint16_t>(GetLittleEndian(data + offset, 2)), 0, {}, {}};
+        const std::uint8_t kind = data[offset + 2];
+        container.cardinality = static_cast<std::uint32_t>(GetLittleEndian(data + offset + 3, 4));
+        offset += ContainerHeaderBytes;
+        if (((false == containers.empty()) && (containers.back().key >= container.key)) || (0 == container.cardinality))
+        {
+            return false;
+        }
+        if (ArrayKind == kind)
+        {
+            if ((ArrayLimit < container.cardinality) || ((container.cardinality * std::size_t{2}) > size - offset))
+            {
+                return false;
+            }
+            container.values.reserve(container.cardinality);
+            for (std::uint32_t value = 0; value < container.cardinality; ++value, offset += 2)
+            {
+                container.values.push_back(static_cast<std::uint16_t>(GetLittleEndian(data + offset, 2)));
+                if ((1 < container.values.size()) && (container.values[container.values.size() - 2] >= container.values.back()))
+                {
+                    return false;
+                }
+            }
+        }
+        else if (BitmapKind == kind)
+        {
+            if ((BitmapWords * 8) > size - offset)
+            {
+                return false;
+            }
+            container.words.reserve(BitmapWords);
+            for (std::size_t word = 0; word < BitmapWords; ++word, offset += 8)
+            {
+                container.words.push_back(GetLittleEndian(data + offset, 8));
+            }
+            if ((ArrayLimit >= container.cardinality) || (CountBits(container.words) != container.cardinality))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+        containers.push_back(std::move(container));
+    }
+    if (size != offset)
+    {
+        return false;
+    }
+    outputBitmap._containers = std::move(containers);
+    return true;
+}
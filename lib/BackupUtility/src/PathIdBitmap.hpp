@@ -0,0 +1,102 @@
+// file PathIdBitmap.hpp:
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/**
+ * @brief Compressed set of 32-bit path ids, laid out like a Roaring bitmap.
+ *
+ * Ids are split by their high 16 bits into containers. A container holding few ids keeps them as a
+ * sorted array of their low 16 bits; one holding more than ArrayLimit switches to a fixed bitmap of
+ * 65536 bits, so dense id ranges cost one bit per id and sparse ones two bytes. Set operations work
+ * container by container, and on two bitmap containers they are plain loops over 64-bit words the
+ * compiler vectorizes. The serialized form is little-endian and independent of the host.
+ */
+class PathIdBitmap
+{
+  public:
+    /**
+     * @brief Most ids an array container holds before it becomes a bitmap container.
+     */
+    static constexpr std::size_t ArrayLimit = 4096;
+
+    /**
+     * @brief Add an id; ids may be added in any order, though ascending order is cheapest.
+     *
+     * @param[in] id Id to add
+     */
+    void Add(std::uint32_t id);
+
+    /**
+     * @brief Check whether an id is in the set.
+     *
+     * @param[in] id Id to look up
+     * @return true if the id was added and not removed since
+     */
+    bool Contains(std::uint32_t id) const;
+
+    /**
+     * @brief Count the ids in the set.
+     *
+     * @return Number of ids
+     */
+    std::uint64_t Cardinality() const;
+
+    /**
+     * @brief Remove every id of another set from this one.
+     *
+     * @param[in] other Ids to remove
+     */
+    void AndNot(const PathIdBitmap& other);
+
+    /**
+     * @brief Call a function for each id in ascending order.
+     *
+     * @param[in] onId Called per id; returning false stops the iteration
+     * @return true if every id was visited, false if onId stopped it
+     */
+    bool ForEach(const std::function<bool(std::uint32_t)>& onId) const;
+
+    /**
+     * @brief Encode the set for storage.
+     *
+     * @return Serialized set
+     */
+    std::vector<std::uint8_t> Serialize() const;
+
+    /**
+     * @brief Decode a set written by Serialize.
+     *
+     * @param[in] data Serialized set
+     * @param[in] size Size of data in bytes
+     * @param[out] outputBitmap Decoded set, empty on failure
+     * @return true on success, false if the data is truncated or not a well-formed set
+     */
+    static bool Deserialize(const std::uint8_t* data, std::size_t size, PathIdBitmap& outputBitmap);
+
+  private:
+    /**
+     * @brief Ids sharing their high 16 bits.
+     */
+    struct Container
+    {
+        std::uint16_t key;                 /**< High 16 bits of the ids */
+        std::uint32_t cardinality;         /**< Number of ids held */
+        std::vector<std::uint16_t> values; /**< Sorted low bits, while an array container */
+        std::vector<std::uint64_t> words;  /**< Bitmap of the low bits, once a bitmap container */
+    };
+
+    /**
+     * @brief Find the container of a key.
+     *
+     * @param[in] key High 16 bits of an id
+     * @return Index of the container, or of the position it would be inserted at
+     */
+    std::size_t FindContainer(std::uint16_t key) const;
+
+    std::vector<Container> _containers; /**< Containers in ascending key order, none empty */
+};
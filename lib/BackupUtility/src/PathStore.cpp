@@ -0,0 +1,223 @@
+// file PathStore.cpp:
+
+#include "PathStore.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <limits>
+
+namespace
+{
+constexpr std::size_t MinSlotCount = 16;
+constexpr std::size_t SlotLoadFactorInverse = 2;
+
+constexpr char PathSeparator = static_cast<char>(std::filesystem::path::preferred_separator);
+#ifdef _WIN32
+constexpr const char* PathSeparators = "\\/";
+#else
+constexpr const char* PathSeparators = "/";
+#endif
+
+/**
+ * @brief Hash a child name under its parent for slot selection.
+ *
+ * @param[in] parent ID of the parent node
+ * @param[in] name Name of the child
+ * @return Hash value
+ */
+std::size_t HashChild(PathStore::PathId parent, std::string_view name)
+{
+    return std::hash<std::string_view>{}(name) ^ (static_cast<std::size_t>(parent) * 0x9E3779B97F4A7C15ULL);
+}
+
+/**
+ * @brief Cut the next component off a path.
+ *
+ * @param[in,out] remaining Path still to split; the component and its separator are removed
+ * @return Next component, possibly empty
+ */
+std::string_view NextComponent(std::string_view& remaining)
+{
+    const std::size_t separator = remaining.find_first_of(PathSeparators);
+    const std::string_view component = remaining.substr(0, separator);
+    remaining = (std::string_view::npos == separator) ? std::string_view() : remaining.substr(separator + 1);
+    return component;
+}
+}
+
+PathStore::PathStore()
+{
+    Clear();
+}
+
+PathStore::PathId PathStore::Intern(std::string_view relativePath)
+{
+    PathId id = RootId;
+    while (false == relativePath.empty())
+    {
+        const std::string_view name = NextComponent(relativePath);
+        if (true == name.empty())
+        {
+            continue;
+        }
+        const PathId child = FindChild(id, name);
+        id = (InvalidId != child) ? child : AddChild(id, name);
+        if (InvalidId == id)
+        {
+            return InvalidId;
+        }
+    }
+    return id;
+}
+
+PathStore::PathId PathStore::Find(std::string_view relativePath) const
+{
+    PathId id = RootId;
+    while ((false == relativePath.empty()) && (InvalidId != id))
+    {
+        const std::string_view name = NextComponent(relativePath);
+        if (false == name.empty())
+        {
+            id = FindChild(id, name);
+        }
+    }
+    return id;
+}
+
+PathStore::PathId PathStore::Parent(PathId id) const
+{
+    return _nodes[id].parent;
+}
+
+std::string_view PathStore::Name(PathId id) const
+{
+    const Node& node = _nodes[id];
+    return std::string_view(_nameArena.data() + node.nameOffset, node.nameLength);
+}
+
+bool PathStore::Materialize(PathId id, PathId ancestor, std::string& outputPath) const
+{
+    outputPath.clear();
+    std::size_t length = 0;
+    std::size_t depth = 0;
+    for (PathId current = id; ancestor != current; current = _nodes[current].parent)
+    {
+        if (RootId == current)
+        {
+            return false;
+        }
+        length += _nodes[current].nameLength + 1;
+        ++depth;
+    }
+    if (0 == depth)
+    {
+        return true;
+    }
+
+    // Names are written back to front into a string sized once, so building a path allocates at most once.
+    outputPath.resize(length - 1);
+    std::size_t end = outputPath.size();
+    for (PathId current = id; ancestor != current; current = _nodes[current].parent)
+    {
+        const std::string_view name = Name(current);
+        end -= name.size();
+        outputPath.replace(end, name.size(), name);
+        if (0 != end)
+        {
+            outputPath[--end] = PathSeparator;
+        }
+    }
+    return true;
+}
+
+std::size_t PathStore::Size() const
+{
+    return _nodes.size();
+}
+
+std::size_t PathStore::MemoryUsage() const
+{
+    return _nameArena.capacity() + (_nodes.capacity() * sizeof(Node)) + (_slots.capacity() * sizeof(PathId));
+}
+
+void PathStore::Clear()
+{
+    _nameArena.clear();
+    _nameArena.shrink_to_fit();
+    _nodes.clear();
+    _nodes.shrink_to_fit();
+    _nodes.push_back(Node{RootId, 0, 0});
+    _slots.assign(MinSlotCount, InvalidId);
+    _slots.shrink_to_fit();
+}
+
+/**
+ * @brief Look up a child of a node by name.
+ *
+ * @param[in] parent ID of the parent node
+ * @param[in] name Name of the child
+ * @return ID of the child, InvalidId if it is not stored
+ */
+PathStore::PathId PathStore::FindChild(PathId parent, std::string_view name) const
+{
+    const std::size_t mask = _slots.size() - 1;
+    for (std::size_t slot = HashChild(parent, name) & mask;; slot = (slot + 1) & mask)
+    {
+        const PathId id = _slots[slot];
+        if ((InvalidId == id) || ((parent == _nodes[id].parent) && (Name(id) == name)))
+        {
+            return id;
+        }
+    }
+}
+
+/**
+ * @brief Add a child the store does not hold yet, growing the table to keep it at most half full.
+ *
+ * @param[in] parent ID of the parent node
+ * @param[in] name Name of the child
+ * @return ID of the new child, InvalidId once IDs or arena offsets would no longer fit 32 bits
+ */
+PathStore::PathId PathStore::AddChild(PathId parent, std::string_view name)
+{
+    if ((InvalidId <= _nodes.size()) || (std::numeric_limits<std::uint32_t>::max() - name.size() < _nameArena.size()))
+    {
+        return InvalidId;
+    }
+    if (_slots.size() < (_nodes.size() + 1) * SlotLoadFactorInverse)
+    {
+        Rehash(_slots.size() * 2);
+    }
+
+    const PathId id = static_cast<PathId>(_nodes.size());
+    _nodes.push_back(Node{parent, static_cast<std::uint32_t>(_nameArena.size()), static_cast<std::uint32_t>(name.size())});
+    _nameArena.append(name);
+    const std::size_t mask = _slots.size() - 1;
+    std::size_t slot = HashChild(parent, name) & mask;
+    while (InvalidId != _slots[slot])
+    {
+        slot = (slot + 1) & mask;
+    }
+    _slots[slot] = id;
+    return id;
+}
+
+/**
+ * @brief Rebuild the lookup table with a new number of slots.
+ *
+ * @param[in] slotCount Power-of-two slot count
+ */
+void PathStore::Rehash(std::size_t slotCount)
+{
+    _slots.assign(slotCount, InvalidId);
+    const std::size_t mask = slotCount - 1;
+    for (PathId id = RootId + 1; id < _nodes.size(); ++id)
+    {
+        std::size_t slot = HashChild(_nodes[id].parent, Name(id)) & mask;
+        while (InvalidId != _slots[slot])
+        {
+            slot = (slot + 1) & mask;
+        }
+        _slots[slot] = id;
+    }
+}
@@ -0,0 +1,129 @@
+// file PathStore.hpp:
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Compact store of relative paths as a tree of nodes, each holding one path component.
+ *
+ * A node is its parent's ID plus its name in a shared string arena, so the components two paths
+ * have in common are stored once: a file in a deep directory costs its own name and twelve bytes,
+ * not a copy of the whole prefix. Nodes are referenced by a 32-bit ID and found through an
+ * open-addressing table keyed by parent and name. Full paths are materialized only when a
+ * syscall needs them, and a caller holding an open descriptor of a directory materializes just
+ * the part below it for openat. Interning is not thread-safe; once filled, the store may be read
+ * by any number of threads without locking.
+ */
+class PathStore
+{
+  public:
+    /**
+     * @brief ID of a node; IDs are dense, in interning order.
+     */
+    using PathId = std::uint32_t;
+
+    /**
+     * @brief ID of the root the stored paths are relative to.
+     */
+    static constexpr PathId RootId = 0;
+
+    /**
+     * @brief ID returned for a path that is not stored or does not fit.
+     */
+    static constexpr PathId InvalidId = 0xFFFFFFFFU;
+
+    /**
+     * @brief Create a store holding only the root.
+     */
+    PathStore();
+
+    /**
+     * @brief Store a path, adding the nodes it does not share with stored paths.
+     *
+     * Empty components, as from doubled separators, are skipped.
+     *
+     * @param[in] relativePath Path relative to the root
+     * @return ID of the path's last component, RootId for an empty path, InvalidId once 32-bit IDs are exhausted
+     */
+    PathId Intern(std::string_view relativePath);
+
+    /**
+     * @brief Look up a stored path.
+     *
+     * @param[in] relativePath Path relative to the root
+     * @return ID of the path, InvalidId if it is not stored
+     */
+    PathId Find(std::string_view relativePath) const;
+
+    /**
+     * @brief Get the parent of a node.
+     *
+     * @param[in] id Stored node other than the root
+     * @return ID of the parent
+     */
+    PathId Parent(PathId id) const;
+
+    /**
+     * @brief Get the name of a node.
+     *
+     * @param[in] id Stored node
+     * @return Last component of the node's path, empty for the root; valid until the next Intern
+     */
+    std::string_view Name(PathId id) const;
+
+    /**
+     * @brief Build the path of a node relative to one of its ancestors.
+     *
+     * With the root as ancestor this is the full relative path. With the ID of a directory the
+     * caller has open, it is the name to pass to openat along with that directory's descriptor.
+     *
+     * @param[in] id Stored node
+     * @param[in] ancestor Node the path is relative to
+     * @param[out] outputPath Path from the ancestor to the node, joined with the preferred separator
+     * @return true on success, false if the ancestor is not one of the node's ancestors or the node itself
+     */
+    bool Materialize(PathId id, PathId ancestor, std::string& outputPath) const;
+
+    /**
+     * @brief Get the number of stored nodes, the root included.
+     *
+     * @return Node count; every ID below it is stored
+     */
+    std::size_t Size() const;
+
+    /**
+     * @brief Get the approximate number of bytes held by the store.
+     *
+     * @return Memory use in bytes
+     */
+    std::size_t MemoryUsage() const;
+
+    /**
+     * @brief Remove every path and release the memory, leaving only the root.
+     */
+    void Clear();
+
+  private:
+    /**
+     * @brief One path component.
+     */
+    struct Node
+    {
+        PathId parent;           /**< ID of the parent node */
+        std::uint32_t nameOffset; /**< Offset of the name in the arena */
+        std::uint32_t nameLength; /**< Name length in bytes */
+    };
+
+    PathId FindChild(PathId parent, std::string_view name) const;
+    PathId AddChild(PathId parent, std::string_view name);
+    void Rehash(std::size_t slotCount);
+
+    std::string _nameArena;
+    std::vector<Node> _nodes;
+    std::vector<PathId> _slots;
+};
@@ -0,0 +1,161 @@
+// file PipelineStage.hpp:
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief One stage of the backup pipeline: a bounded queue served by its own worker pool.
+ *
+ * Submit blocks while the queue holds queueDepth items, so a slow stage throttles the stage
+ * feeding it instead of buffering without limit.
+ *
+ * @tparam T Work item type, must be movable
+ */
+template <typename T>
+class PipelineStage
+{
+  public:
+    /**
+     * @brief Start the stage's workers.
+     *
+     * @param[in] threadCount Number of worker threads, at least 1
+     * @param[in] queueDepth Maximum queued items before Submit blocks, at least 1
+     * @param[in] work Callback run on a worker thread for each item
+     * @param[in] onWorkerExit Optional callback run on each worker thread after the queue is drained in Finalize
+     * @param[in] onWorkerStart Optional callback run on each worker thread before its first item
+     */
+    PipelineStage(unsigned int threadCount, std::size_t queueDepth, const std::function<void(T&)>& work,
+                  const std::function<void()>& onWorkerExit = nullptr, const std::function<void()>& onWorkerStart = nullptr)
+        : _queueDepth(std::max<std::size_t>(1, queueDepth)), _work(work), _onWorkerExit(onWorkerExit), _onWorkerStart(onWorkerStart),
+          _waitingProducers(0), _waitingConsumers(0), _done(false)
+    {
+        _workers.reserve(std::max(1u, threadCount));
+        for (unsigned int i = 0; i < std::max(1u, threadCount); ++i)
+        {
+            _workers.emplace_back([this]() { WorkerLoop(); });
+        }
+    }
+
+    /**
+     * @brief Drain the queue and join the workers.
+     */
+    ~PipelineStage()
+    {
+        Finalize();
+    }
+
+    PipelineStage(const PipelineStage&) = delete;
+    PipelineStage& operator=(const PipelineStage&) = delete;
+
+    /**
+     * @brief Queue an item, blocking while the stage is at its queue depth.
+     *
+     * @param[in] item Item to queue; moved from
+     */
+    void Submit(T&& item)
+    {
+        bool wakeConsumer = false;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_items.size() >= _queueDepth)
+            {
+                ++_waitingProducers;
+                _notFullCv.wait(lock, [&]() { return _items.size() < _queueDepth; });
+                --_waitingProducers;
+            }
+            _items.push_back(std::move(item));
+            wakeConsumer = (0 < _waitingConsumers);
+        }
+        if (true == wakeConsumer)
+        {
+            _notEmptyCv.notify_one();
+        }
+    }
+
+    /**
+     * @brief Signal the end of input and wait until every queued item has been processed.
+     */
+    void Finalize()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (true == _done)
+            {
+                return;
+            }
+            _done = true;
+        }
+        _notEmptyCv.notify_all();
+        for (auto& worker : _workers)
+        {
+            if (true == worker.joinable())
+            {
+                worker.join();
+            }
+        }
+    }
+
+  private:
+    /**
+     * @brief Worker loop: process items until the stage is finalized and drained.
+     */
+    void WorkerLoop()
+    {
+        if (nullptr != _onWorkerStart)
+        {
+            _onWorkerStart();
+        }
+        while (true)
+        {
+            T item;
+            bool wakeProducer = false;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if ((false == _done) && (true == _items.empty()))
+                {
+                    ++_waitingConsumers;
+                    _notEmptyCv.wait(lock, [&]() { return (true == _done) || (false == _items.empty()); });
+                    --_waitingConsumers;
+                }
+                if (true == _items.empty())
+                {
+                    break;
+                }
+                item = std::move(_items.front());
+                _items.pop_front();
+                wakeProducer = (0 < _waitingProducers);
+            }
+            if (true == wakeProducer)
+            {
+                _notFullCv.notify_one();
+            }
+            _work(item);
+        }
+
+        if (nullptr != _onWorkerExit)
+        {
+            _onWorkerExit();
+        }
+    }
+
+    std::size_t _queueDepth;
+    std::function<void(T&)> _work;
+    std::function<void()> _onWorkerExit;
+    std::function<void()> _onWorkerStart;
+    std::mutex _mutex;
+    std::condition_variable _notFullCv;
+    std::condition_variable _notEmptyCv;
+    std::deque<T> _items;
+    std::size_t _waitingProducers;
+    std::size_t _waitingConsumers;
+    bool _done;
+    std::vector<std::thread> _workers;
+};
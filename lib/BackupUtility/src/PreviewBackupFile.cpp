@@ -0,0 +1,104 @@
+#include "PreviewBackupFile.hpp"
+
+#include "FileIterator/FileMetadata.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+PreviewBackupFile::PreviewBackupFile(const RelativePathBuilder& sourceKeys,
+                                     const std::function<bool(const std::string&, FileStateRecord&)>& loadFileState,
+                                     const FileHasher* fileHasher, bool paranoid, const PathFilter* limits)
+    : _sourceKeys(sourceKeys), _loadFileState(loadFileState), _fileHasher(fileHasher), _paranoid(paranoid), _limits(limits), _files{}, _bytes{}
+{
+}
+
+bool PreviewBackupFile::Execute(const std::filesystem::path& file)
+{
+    std::string relativeKey;
+    FileMetadata metadata{};
+    if ((false == _sourceKeys.BuildKey(file, relativeKey)) || (false == ReadFileMetadata(file, metadata)))
+    {
+        return false;
+    }
+
+    FileStateRecord storedRecord{};
+    bool hasRecord = false;
+    try
+    {
+        hasRecord = _loadFileState(relativeKey, storedRecord) && (ChangeType::Deleted != storedRecord.status);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_seenMutex);
+        _seenKeys.insert(std::move(relativeKey));
+    }
+    // A backup keeps the stored state of a file outside the limits and reads nothing.
+    if ((nullptr != _limits) && (true == _limits->ExcludesBySizeOrTime(metadata.size, metadata.modificationTimeNs)))
+    {
+        return true;
+    }
+
+    if (false == hasRecord)
+    {
+        Count(ChangeType::Added, metadata.size);
+        return true;
+    }
+    const bool metadataUnchanged = (storedRecord.metadata == metadata) && ((nullptr == _fileHasher) || (false == _paranoid));
+    if (true == metadataUnchanged)
+    {
+        Count(ChangeType::Unchanged, 0);
+        return true;
+    }
+    if (nullptr == _fileHasher)
+    {
+        Count(ChangeType::Modified, metadata.size);
+        return true;
+    }
+
+    // The stored digest is compared using the algorithm that produced it, as a backup run would.
+    HashDigest digest{};
+    if (false == _fileHasher->Compute(file, storedRecord.hashAlgorithm, digest))
+    {
+        return false;
+    }
+    const bool changed = (digest != storedRecord.hash);
+    Count((true == changed) ? ChangeType::Modified : ChangeType::Unchanged, (true == changed) ? metadata.size : 0);
+    return true;
+}
+
+bool PreviewBackupFile::CountUnseen(FileStateRepository& fileStateRepository)
+{
+    return fileStateRepository.ForEachFileState(
+        [&](const std::string& filePath, const FileStateRecord& record)
+        {
+            if ((ChangeType::Deleted != record.status) && (0 == _seenKeys.count(filePath)))
+            {
+                Count(ChangeType::Deleted, record.metadata.size);
+            }
+            return true;
+        });
+}
+
+void PreviewBackupFile::Collect(BackupPreview& outputPreview) const
+{
+    for (std::size_t changeType = 0; changeType < ChangeTypeCount; ++changeType)
+    {
+        outputPreview.filesByChange[changeType] = _files[changeType].load(std::memory_order_relaxed);
+        outputPreview.bytesByChange[changeType] = _bytes[changeType].load(std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Add one file to the counts of a change type.
+ *
+ * @param[in] changeType Expected outcome of the file
+ * @param[in] bytes Bytes the outcome moves: copied for added and modified files, archived for deleted ones
+ */
+void PreviewBackupFile::Count(ChangeType changeType, std::uint64_t bytes)
+{
+    _files[static_cast<std::size_t>(changeType)].fetch_add(1, std::memory_order_relaxed);
+    _bytes[static_cast<std::size_t>(changeType)].fetch_add(bytes, std::memory_order_relaxed);
+}
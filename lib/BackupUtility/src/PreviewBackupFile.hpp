@@ -0,0 +1,83 @@
+// file PreviewBackupFile.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "FileStateRepository.hpp"
+#include "RelativePathBuilder.hpp"
+#include "FileHasher/FileHasher.hpp"
+#include "FileIterator/PathFilter.hpp"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+/**
+ * @brief Classifies source files against their stored state without writing anything.
+ *
+ * Takes the same metadata fast path as ProcessBackupFile: a file whose size, mtime and identity match its
+ * stored state is unchanged. Without a hasher every other known file counts as modified, which is an upper
+ * bound; with one it is hashed and compared. Files are counted with the bytes a backup would copy. The
+ * keys of all files seen are kept, so the stored files missing from the source can be counted afterwards.
+ */
+class PreviewBackupFile
+{
+  public:
+    /**
+     * @brief Construct a preview.
+     *
+     * @param[in] sourceKeys Mapping of source files to their state keys
+     * @param[in] loadFileState Lookup for the stored state of a file, returns false if none is stored
+     * @param[in] fileHasher Hasher deciding metadata changes by content, nullptr counts them as modified
+     * @param[in] paranoid Hash files with unchanged metadata too; only used with a hasher
+     * @param[in] limits Filter whose size and mtime limits leave files uncounted but seen, nullptr counts every file
+     */
+    PreviewBackupFile(const RelativePathBuilder& sourceKeys, const std::function<bool(const std::string&, FileStateRecord&)>& loadFileState,
+                      const FileHasher* fileHasher, bool paranoid, const PathFilter* limits = nullptr);
+
+    PreviewBackupFile(const PreviewBackupFile&) = delete;
+    PreviewBackupFile& operator=(const PreviewBackupFile&) = delete;
+
+    /**
+     * @brief Classify one source file; called concurrently from walker or worker threads.
+     *
+     * @param[in] file Source file
+     * @return true on success, false if the file could not be read
+     */
+    bool Execute(const std::filesystem::path& file);
+
+    /**
+     * @brief Count the live stored files that no Execute call has seen as deleted.
+     *
+     * Only meaningful after a complete walk of every source.
+     *
+     * @param[in] fileStateRepository Repository holding the stored states
+     * @return true on success, false on error
+     */
+    bool CountUnseen(FileStateRepository& fileStateRepository);
+
+    /**
+     * @brief Copy the counts into a preview; call once no thread runs Execute anymore.
+     *
+     * @param[out] outputPreview Files and bytes per expected change type
+     */
+    void Collect(BackupPreview& outputPreview) const;
+
+  private:
+    void Count(ChangeType changeType, std::uint64_t bytes);
+
+    const RelativePathBuilder& _sourceKeys;
+    std::function<bool(const std::string&, FileStateRecord&)> _loadFileState;
+    const FileHasher* _fileHasher;
+    bool _paranoid;
+    const PathFilter* _limits;
+    std::array<std::atomic<std::size_t>, ChangeTypeCount> _files;
+    std::array<std::atomic<std::uint64_t>, ChangeTypeCount> _bytes;
+    std::mutex _seenMutex;
+    std::unordered_set<std::string> _seenKeys;
+};
@@ -1,91 +1,913 @@
 #include "ProcessBackupFile.hpp"
 
+#include "ParityFile.hpp"
+#include "Instrumentation/Instrumentation.hpp"
+#include "Instrumentation/Probes.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <iterator>
+#include <vector>
 
 namespace
 {
-constexpr std::size_t UnknownTotalCount = 0;
+constexpr const char* StagedFileSuffix = ".rdemo-partial";
+constexpr std::int64_t MigratedModificationTimeNs = -1; /**< Stored mtime of rows migrated without metadata */
+constexpr std::uint64_t ResumePointMinimumSize = 1024 * 1024; /**< Smaller files are read again faster than a resume point is kept */
+
+/**
+ * @brief Get the states prefetched for a work item's walker batch.
+ *
+ * @param[in] file Dequeued work item
+ * @return Prefetched states, nullptr if none were attached
+ */
+const FileStatePrefetch* PrefetchOf(const FileWorkItem& file)
+{
+    return dynamic_cast<const FileStatePrefetch*>(file.attachment.get());
+}
 }
 
-ProcessBackupFile::ProcessBackupFile(const std::filesystem::path& sourceRoot, const std::filesystem::path& backupRoot,
-                                     SnapshotDirectoryProvider& snapshotDirectory, FileStateRepository& fileStateRepository,
-                                     const FileHasher& fileHasher, const TimestampProvider& timestampProvider,
-                                     const std::function<void(const BackupProgress&)>& onProgress, std::atomic<bool>& success,
-                                     std::atomic<std::size_t>& processedCount)
-    : _sourceRoot(sourceRoot), _backupRoot(backupRoot), _snapshotDirectory(snapshotDirectory), _fileStateRepository(fileStateRepository),
-      _fileHasher(fileHasher), _timestampProvider(timestampProvider), _onProgress(onProgress), _success(success),
-      _processedCount(processedCount)
+template <typename StateLookup>
+ProcessBackupFile<StateLookup>::ProcessBackupFile(const RelativePathBuilder& sourceKeys, const std::filesystem::path& backupRoot,
+                                                  SnapshotDirectoryProvider& snapshotDirectory, const StateLookup& stateLookup, FileStateSink& stateSink,
+                                                  const FileHasher& fileHasher, HashCache* hashCache, const FileCopier& fileCopier, DirectoryCache& directoryCache,
+                                                  const ContentObjectStore* contentStore, const ChunkStore* chunkStore, const FileDelta* fileDelta,
+                                                  const FileCompressor* fileCompressor, const FileEncryptor* fileEncryptor, PackWriterThread* packWriter,
+                                                  const MoveDetector* moveDetector, StorageBackend* storage, const RunContext& runContext,
+                                                  ProgressReporter* progressReporter, BackupStatsCollector* statsCollector,
+                                                  std::atomic<bool>& success, bool paranoid, bool extendedAttributes, bool resumeAppends,
+                                                  const DigestAttributeCache* digestAttributes, const SampledCheckPolicy& sampledCheck,
+                                                  CopyCheckpointStore* copyCheckpoints, std::uint64_t copyCheckpointInterval, TrashQueue* trashQueue,
+                                                  const ParityPolicy& parity, const PathFilter* limits)
+    : _backupRoot(backupRoot), _snapshotDirectory(snapshotDirectory), _stateLookup(stateLookup),
+      _stateSink(stateSink), _fileHasher(fileHasher), _hashCache(hashCache), _digestAttributes(digestAttributes), _fileCopier(fileCopier), _directoryCache(directoryCache), _contentStore(contentStore), _chunkStore(chunkStore), _fileDelta(fileDelta), _fileCompressor(fileCompressor),
+      _fileEncryptor(fileEncryptor), _packWriter(packWriter), _moveDetector(moveDetector), _storage(storage), _runContext(runContext), _progressReporter(progressReporter), _statsCollector(statsCollector),
+      _success(success), _paranoid(paranoid), _extendedAttributes(extendedAttributes), _resumeAppends(resumeAppends), _sampledCheck(sampledCheck), _copyCheckpoints(copyCheckpoints),
+      _copyCheckpointInterval(copyCheckpointInterval), _trashQueue(trashQueue), _parity(parity), _limits(limits), _pathBuilder(sourceKeys)
 {
 }
 
-void ProcessBackupFile::Execute(const std::filesystem::path& file)
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::Execute(const FileWorkItem& file, PipelineStage<BackupFilePlan>* copyStage)
 {
-    std::error_code ec;
-    std::filesystem::path relativePath = std::filesystem::relative(file, _sourceRoot, ec);
-    if (0 != ec.value())
+    RDEMO_SCOPE("backup.file");
+    WorkerScratch& scratch = CurrentScratch();
+    BackupStatsCollector::ThreadCounters* counters = scratch.counters;
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::MarkBusy(*counters);
+    }
+    FileScope fileScope(counters, file.path);
+    RDEMO_PROBE1(file_begin, file.path.c_str());
+    if (nullptr != _progressReporter)
+    {
+        _progressReporter->Begin(file.path);
+    }
+    if (true == Plan(file.path, (true == file.hasMetadata) ? &file.metadata : nullptr, PrefetchOf(file), scratch.storedRecord, scratch.plan,
+                     counters))
+    {
+        Complete(scratch.plan, copyStage, counters);
+    }
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::MarkIdle(*counters);
+    }
+}
+
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::ExecuteBatch(const std::vector<FileWorkItem>& files, PipelineStage<BackupFilePlan>* copyStage)
+{
+    RDEMO_SCOPE("backup.batch");
+    RDEMO_COUNT("backup.batch.files", files.size());
+    WorkerScratch& scratch = CurrentScratch();
+    BackupStatsCollector::ThreadCounters* counters = scratch.counters;
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::MarkBusy(*counters);
+    }
+    if (scratch.batch.size() < files.size())
+    {
+        scratch.batch.resize(files.size());
+    }
+    scratch.hashJobs.clear();
+    scratch.hashJobEntries.clear();
+    {
+        StageTimer hashTimer(counters, BackupStage::Hash);
+        for (std::size_t index = 0; index < files.size(); ++index)
+        {
+            BatchEntry& entry = scratch.batch[index];
+            FileScope fileScope(counters, files[index].path);
+            RDEMO_PROBE1(file_begin, files[index].path.c_str());
+            if (nullptr != _progressReporter)
+            {
+                _progressReporter->Begin(files[index].path);
+            }
+            const FileMetadata* walkedMetadata = (true == files[index].hasMetadata) ? &files[index].metadata : nullptr;
+            entry.inspected = Inspect(files[index].path, walkedMetadata, PrefetchOf(files[index]), entry.storedRecord, entry.plan, entry.metadata,
+                                      entry.hasRecord, counters);
+            entry.hasDigest = false;
+            if ((false == entry.inspected) || (true == entry.plan.alreadyCommitted) || (true == entry.plan.outsideLimits) ||
+                (ReadPath::Hash != ChooseReadPath(entry.storedRecord, entry.metadata, entry.hasRecord)))
+            {
+                continue;
+            }
+            entry.hasDigest = (false == _paranoid) && (true == LookupCachedDigest(files[index].path, entry.metadata, entry.digest, counters));
+            if (false == entry.hasDigest)
+            {
+                scratch.hashJobs.push_back(HashJob{files[index].path, HashDigest{}, false});
+                scratch.hashJobEntries.push_back(index);
+            }
+        }
+
+        if (false == scratch.hashJobs.empty())
+        {
+            {
+                TraceSpan hashSpan(counters, "FileHasher::ComputeMany");
+                _fileHasher.ComputeMany(scratch.hashJobs);
+            }
+            // A file that failed is left to Decide, which hashes it once more and reports the error.
+            for (std::size_t job = 0; job < scratch.hashJobs.size(); ++job)
+            {
+                BatchEntry& entry = scratch.batch[scratch.hashJobEntries[job]];
+                if (true == scratch.hashJobs[job].hashed)
+                {
+                    CountHashedFile(entry.metadata, counters);
+                    RememberDigest(scratch.hashJobs[job].filePath, entry.metadata, scratch.hashJobs[job].digest, counters);
+                    entry.digest = scratch.hashJobs[job].digest;
+                    entry.hasDigest = true;
+                }
+            }
+        }
+    }
+
+    for (std::size_t index = 0; index < files.size(); ++index)
+    {
+        BatchEntry& entry = scratch.batch[index];
+        if (false == entry.inspected)
+        {
+            continue;
+        }
+        FileScope fileScope(counters, files[index].path);
+        bool planned = true;
+        if ((false == entry.plan.alreadyCommitted) && (false == entry.plan.outsideLimits))
+        {
+            StageTimer hashTimer(counters, BackupStage::Hash);
+            planned = Decide(files[index].path, entry.storedRecord, entry.metadata, entry.hasRecord,
+                             (true == entry.hasDigest) ? &entry.digest : nullptr, entry.plan, counters);
+        }
+        if (true == planned)
+        {
+            Complete(entry.plan, copyStage, counters);
+        }
+    }
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::MarkIdle(*counters);
+    }
+}
+
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::Plan(const std::filesystem::path& file, BackupFilePlan& outputPlan)
+{
+    FileStateRecord storedRecord{};
+    return Plan(file, nullptr, nullptr, storedRecord, outputPlan, CurrentCounters());
+}
+
+/**
+ * @brief Read/hash step writing into reused buffers.
+ *
+ * @param[in] file File path to process
+ * @param[in] walkedMetadata Metadata the walk read for the file, nullptr stats it here
+ * @param[in] prefetched States read for the file's walker batch, nullptr looks the state up here
+ * @param[out] storedRecord Scratch for the stored state of the file
+ * @param[out] outputPlan New state for the file, every field is overwritten
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true on success, false on error
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::Plan(const std::filesystem::path& file, const FileMetadata* walkedMetadata, const FileStatePrefetch* prefetched,
+                                          FileStateRecord& storedRecord, BackupFilePlan& outputPlan, BackupStatsCollector::ThreadCounters* counters)
+{
+    StageTimer hashTimer(counters, BackupStage::Hash);
+    FileMetadata metadata{};
+    bool hasRecord = false;
+    if (false == Inspect(file, walkedMetadata, prefetched, storedRecord, outputPlan, metadata, hasRecord, counters))
+    {
+        return false;
+    }
+    return (true == outputPlan.alreadyCommitted) || (true == outputPlan.outsideLimits) || (true == Decide(file, storedRecord, metadata, hasRecord, nullptr, outputPlan, counters));
+}
+
+/**
+ * @brief First half of Plan: stat a file, load its stored state and settle files the resumed run already committed.
+ *
+ * @param[in] file File path to process
+ * @param[in] walkedMetadata Metadata the walk read for the file, nullptr stats it here
+ * @param[in] prefetched States read for the file's walker batch, nullptr looks the state up here
+ * @param[out] storedRecord Stored state of the file
+ * @param[out] outputPlan Plan of the file; complete when alreadyCommitted or outsideLimits is set, otherwise finished by Decide
+ * @param[out] outputMetadata Metadata of the file, captured before it is read
+ * @param[out] outputHasRecord Whether a live state is stored for the file
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true on success, false on error
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::Inspect(const std::filesystem::path& file, const FileMetadata* walkedMetadata, const FileStatePrefetch* prefetched,
+                                             FileStateRecord& storedRecord, BackupFilePlan& outputPlan, FileMetadata& outputMetadata, bool& outputHasRecord,
+                                             BackupStatsCollector::ThreadCounters* counters)
+{
+    std::string& relativeKey = outputPlan.relativeKey;
+    if (false == _pathBuilder.BuildKey(file, relativeKey))
     {
         _success.store(false);
+        return false;
+    }
+
+    // Metadata is captured before hashing so a concurrent modification shows up as a mismatch next run.
+    // The walk's stat already was, so the file is only stat'ed here when the walk could not.
+    bool statted = (nullptr != walkedMetadata);
+    if (true == statted)
+    {
+        outputMetadata = *walkedMetadata;
+    }
+    else
+    {
+        TraceSpan statSpan(counters, "stat");
+        statted = ReadFileMetadata(file, outputMetadata);
+    }
+    if (false == statted)
+    {
+        _success.store(false);
+        return false;
+    }
+
+    outputHasRecord = false;
+    bool stored = false;
+    if ((nullptr != prefetched) && (true == prefetched->Find(relativeKey, storedRecord, stored)))
+    {
+        outputHasRecord = (true == stored) && (ChangeType::Deleted != storedRecord.status);
+    }
+    else
+    {
+        try
+        {
+            StageTimer databaseTimer(counters, BackupStage::Database);
+            TraceSpan loadSpan(counters, "GetFileState");
+            outputHasRecord = _stateLookup.Load(relativeKey, storedRecord) && (ChangeType::Deleted != storedRecord.status);
+        }
+        catch (const std::runtime_error&)
+        {
+            _success.store(false);
+            return false;
+        }
+    }
+
+    outputPlan.stagedFile.clear();
+    outputPlan.packed = false;
+    // A file outside the size and mtime limits is not read. Its stored state is stored again as it is, which
+    // marks the file seen, so the deletion pass does not take it for deleted, and a file without one is skipped.
+    outputPlan.outsideLimits = (nullptr != _limits) && (true == _limits->ExcludesBySizeOrTime(outputMetadata.size, outputMetadata.modificationTimeNs));
+    if (true == outputPlan.outsideLimits)
+    {
+        outputPlan.replacesRunVersion = false;
+        outputPlan.alreadyCommitted = false;
+        outputPlan.record = storedRecord;
+        outputPlan.record.status = (true == outputHasRecord) ? ChangeType::Unchanged : ChangeType::Deleted;
+        outputPlan.file = file;
+        return true;
+    }
+
+    // A file the interrupted run committed is done unless it changed since, even for paranoid runs.
+    outputPlan.replacesRunVersion = (true == outputHasRecord) && (true == storedRecord.committedInRun);
+    outputPlan.alreadyCommitted = (true == outputPlan.replacesRunVersion) && (storedRecord.hashAlgorithm == _fileHasher.Algorithm()) &&
+                                  (storedRecord.metadata == outputMetadata);
+    if (true == outputPlan.alreadyCommitted)
+    {
+        outputPlan.record = storedRecord;
+        outputPlan.record.status = ChangeType::Unchanged;
+        outputPlan.file = file;
+    }
+    return true;
+}
+
+/**
+ * @brief Pick how a file that is not already committed has to be read.
+ *
+ * @param[in] storedRecord Stored state of the file
+ * @param[in] metadata Current metadata of the file
+ * @param[in] hasRecord Whether storedRecord holds a live state
+ * @return Read path of the file
+ */
+template <typename StateLookup>
+typename ProcessBackupFile<StateLookup>::ReadPath ProcessBackupFile<StateLookup>::ChooseReadPath(const FileStateRecord& storedRecord,
+                                                                                                  const FileMetadata& metadata, bool hasRecord) const
+{
+    const bool metadataUnchanged = (true == hasRecord) && (storedRecord.hashAlgorithm == _fileHasher.Algorithm()) && (storedRecord.metadata == metadata);
+    if ((true == metadataUnchanged) && (false == _paranoid))
+    {
+        return ReadPath::None;
+    }
+    // A paranoid run samples a large unchanged file that has a stored sample, until its full-hash run is due.
+    const bool sampleDue = (0 != _sampledCheck.threshold) && (_sampledCheck.threshold <= metadata.size) && (0 != storedRecord.sampleDigest.size) &&
+                           ((0 == _sampledCheck.fullEvery) || (storedRecord.sampledRuns + 1 < _sampledCheck.fullEvery));
+    if ((true == metadataUnchanged) && (true == sampleDue))
+    {
+        return ReadPath::Sample;
+    }
+    if ((nullptr != _packWriter) && (true == _packWriter->IsPackable(metadata.size)))
+    {
+        return ReadPath::Packed;
+    }
+
+    // A new file or a size change must be copied whatever the hash says, so it is hashed while copying.
+    // Records migrated from older databases carry no metadata and always take the hash-only path.
+    // A storage backend uploads from the source file, so nothing is staged and every file is only hashed here.
+    // A new file that may have been moved is only hashed too, so Apply can take over the moved backup copy instead of copying.
+    const bool hasStoredMetadata = (true == hasRecord) && (MigratedModificationTimeNs != storedRecord.metadata.modificationTimeNs);
+    const bool mayBeMoved = (false == hasRecord) && (nullptr != _moveDetector) && (true == _moveDetector->MayMatch(metadata.size));
+    const bool mustCopy = ((false == hasRecord) && (false == mayBeMoved)) || ((true == hasStoredMetadata) && (storedRecord.metadata.size != metadata.size));
+    return ((true == mustCopy) && (nullptr == _storage)) ? ReadPath::Copy : ReadPath::Hash;
+}
+
+/**
+ * @brief Second half of Plan: read the file as its read path needs and fill in its new state.
+ *
+ * @param[in] file File path to process
+ * @param[in] storedRecord Stored state of the file, from Inspect
+ * @param[in] metadata Metadata of the file, from Inspect
+ * @param[in] hasRecord Whether a live state is stored, from Inspect
+ * @param[in] precomputedDigest Digest of a hash-only file already looked up or hashed, nullptr looks it up and hashes here
+ * @param[in,out] outputPlan Plan started by Inspect
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true on success, false on error
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::Decide(const std::filesystem::path& file, const FileStateRecord& storedRecord, const FileMetadata& metadata, bool hasRecord,
+                                            const HashDigest* precomputedDigest, BackupFilePlan& outputPlan, BackupStatsCollector::ThreadCounters* counters)
+{
+    std::error_code ec;
+    std::string& relativeKey = outputPlan.relativeKey;
+    std::filesystem::path& stagedFile = outputPlan.stagedFile;
+    ReadPath readPath = ChooseReadPath(storedRecord, metadata, hasRecord);
+    // A record the lookup did not find may leave the last file's values in the reused scratch.
+    HashDigest newHash = (true == hasRecord) ? storedRecord.hash : HashDigest{};
+    bool changed = false;
+    if (ReadPath::Sample == readPath)
+    {
+        // A sample that differs says nothing about what changed, so the file is hashed whole as without sampling.
+        bool matches = false;
+        if (false == CheckSample(file, storedRecord, metadata, counters, matches))
+        {
+            _success.store(false);
+            return false;
+        }
+        if (false == matches)
+        {
+            readPath = ReadPath::Hash;
+        }
+    }
+    if (ReadPath::Packed == readPath)
+    {
+        // A small file is read whole; its content goes to the packer if it changed, so it is never read twice.
+        CountHashedFile(metadata, counters);
+        bool read = false;
+        {
+            TraceSpan readSpan(counters, "FileHasher::ComputeAndRead");
+            read = _fileHasher.ComputeAndRead(file, outputPlan.packedContent, newHash);
+        }
+        if (false == read)
+        {
+            _success.store(false);
+            return false;
+        }
+        RememberDigest(file, metadata, newHash, counters);
+        const HashDigest comparisonHash = ((true == hasRecord) && (storedRecord.hashAlgorithm != _fileHasher.Algorithm()))
+                                              ? FileHasher::ComputeBuffer(storedRecord.hashAlgorithm, outputPlan.packedContent.data(),
+                                                                          outputPlan.packedContent.size())
+                                              : newHash;
+        changed = (false == hasRecord) || (comparisonHash != storedRecord.hash);
+        outputPlan.packed = true;
+    }
+    else if (ReadPath::Copy == readPath)
+    {
+        RelativePathBuilder::BuildLocation(_backupRoot, relativeKey, stagedFile);
+        stagedFile += StagedFileSuffix;
+        _directoryCache.Ensure(stagedFile.parent_path());
+        // With a cached digest the copy needs no userspace pass and can use a clone or in-kernel copy.
+        const bool cached = (false == _paranoid) && (true == LookupCachedDigest(file, metadata, newHash, counters));
+        // A copy larger than a checkpoint interval commits its progress, so the staging file an interrupted run left is continued.
+        const bool checkpointed = (nullptr != _copyCheckpoints) && (0 < _copyCheckpointInterval) && (nullptr == _fileEncryptor) && (false == cached) &&
+                                  (_copyCheckpointInterval < metadata.size) && (true == FileHasher::SupportsResume(_fileHasher.Algorithm()));
+        bool staged = (true == checkpointed) && (true == StageWithCheckpoints(file, relativeKey, metadata, stagedFile, newHash, counters));
+        if (false == staged)
+        {
+            // A leftover staging file may be a hardlink into the content store; never write through it.
+            std::filesystem::remove(stagedFile, ec);
+        }
+        // A large file that only grew since its stored version is hashed and copied from where that version ends.
+        const bool resumable = (false == staged) && (true == _resumeAppends) && (nullptr != _hashCache) && (nullptr == _fileEncryptor) &&
+                               (false == cached) && (ResumePointMinimumSize <= metadata.size) && (true == FileHasher::SupportsResume(_fileHasher.Algorithm()));
+        staged = (true == staged) ||
+                 ((true == resumable) && (true == StageFromResumePoint(file, relativeKey, storedRecord, hasRecord, metadata, stagedFile, newHash, counters)));
+        if (false == staged)
+        {
+            {
+                TraceSpan copySpan(counters, (true == cached) ? "copy_file" : "FileHasher::ComputeAndCopy");
+                staged = WriteBackupCopy(file, stagedFile, (true == cached) ? nullptr : &newHash);
+            }
+            if (nullptr != counters)
+            {
+                BackupStatsCollector::Add(counters->bytesRead, metadata.size);
+                BackupStatsCollector::Add(counters->bytesWritten, metadata.size);
+                BackupStatsCollector::Add(counters->bytesHashed, (true == cached) ? 0 : metadata.size);
+            }
+        }
+        if (false == staged)
+        {
+            std::filesystem::remove(stagedFile, ec);
+            stagedFile.clear();
+            _success.store(false);
+            return false;
+        }
+        if (false == cached)
+        {
+            RememberDigest(file, metadata, newHash, counters);
+        }
+        changed = true;
+    }
+    else if (ReadPath::Hash == readPath)
+    {
+        const bool cached = (nullptr != precomputedDigest) ||
+                            ((false == _paranoid) && (true == LookupCachedDigest(file, metadata, newHash, counters)));
+        if (nullptr != precomputedDigest)
+        {
+            newHash = *precomputedDigest;
+        }
+        else if (false == cached)
+        {
+            CountHashedFile(metadata, counters);
+            bool hashed = false;
+            {
+                TraceSpan hashSpan(counters, "FileHasher::Compute");
+                hashed = _fileHasher.Compute(file, newHash);
+            }
+            if (false == hashed)
+            {
+                _success.store(false);
+                return false;
+            }
+            RememberDigest(file, metadata, newHash, counters);
+        }
+
+        // A record written with another algorithm is compared using that algorithm, then upgraded below.
+        HashDigest comparisonHash = newHash;
+        if ((true == hasRecord) && (storedRecord.hashAlgorithm != _fileHasher.Algorithm()))
+        {
+            CountHashedFile(metadata, counters);
+            TraceSpan hashSpan(counters, "FileHasher::Compute");
+            if (false == _fileHasher.Compute(file, storedRecord.hashAlgorithm, comparisonHash))
+            {
+                _success.store(false);
+                return false;
+            }
+        }
+
+        changed = (false == hasRecord) || (comparisonHash != storedRecord.hash);
+    }
+
+    FileStateRecord& record = outputPlan.record;
+    record.hash = newHash;
+    record.hashAlgorithm = _fileHasher.Algorithm();
+    record.metadata = metadata;
+    if (ReadPath::Sample == readPath)
+    {
+        record.digestScheme = DigestScheme::Sampled;
+        record.sampleDigest = storedRecord.sampleDigest;
+        record.sampledRuns = storedRecord.sampledRuns + 1;
+    }
+    else if (ReadPath::None == readPath)
+    {
+        record.digestScheme = storedRecord.digestScheme;
+        record.sampleDigest = storedRecord.sampleDigest;
+        record.sampledRuns = storedRecord.sampledRuns;
+    }
+    else
+    {
+        record.digestScheme = DigestScheme::Full;
+        record.sampledRuns = 0;
+        KeepSample(file, metadata, record, counters);
+    }
+    // Attributes are best effort: a file whose attributes cannot be read is still backed up, without them.
+    if ((false == _extendedAttributes) || (false == ReadExtendedAttributes(file, record.extendedAttributes)))
+    {
+        record.extendedAttributes.clear();
+    }
+    if ((false == hasRecord) || (true == changed))
+    {
+        record.status = (false == hasRecord) ? ChangeType::Added : ChangeType::Modified;
+        record.timestamp = _runContext.Timestamp();
+    }
+    else
+    {
+        record.status = ChangeType::Unchanged;
+        record.timestamp.assign(storedRecord.timestamp);
+    }
+    outputPlan.file = file;
+    return true;
+}
+
+/**
+ * @brief Compare a sample of a file's blocks against the sample stored with its state.
+ *
+ * @param[in] file File to sample
+ * @param[in] storedRecord Stored state of the file, with a sample digest
+ * @param[in] metadata Metadata of the file
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @param[out] outputMatches Whether the sample matches the stored one
+ * @return true on success, false if the file cannot be read
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::CheckSample(const std::filesystem::path& file, const FileStateRecord& storedRecord, const FileMetadata& metadata,
+                                                 BackupStatsCollector::ThreadCounters* counters, bool& outputMatches)
+{
+    HashDigest sample{};
+    {
+        TraceSpan sampleSpan(counters, "FileHasher::ComputeSample");
+        if (false == _fileHasher.ComputeSample(file, _sampledCheck.blockSize, _sampledCheck.randomBlocks, sample))
+        {
+            return false;
+        }
+    }
+    const std::uint64_t sampledBytes = std::min<std::uint64_t>(metadata.size, static_cast<std::uint64_t>(_sampledCheck.randomBlocks + 2) * _sampledCheck.blockSize);
+    outputMatches = (sample == storedRecord.sampleDigest);
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::Add(counters->bytesRead, sampledBytes);
+        BackupStatsCollector::Add(counters->bytesHashed, sampledBytes);
+        BackupStatsCollector::Add(counters->filesSampled, (true == outputMatches) ? 1 : 0);
+    }
+    return true;
+}
+
+/**
+ * @brief Store the sample of a large file just read whole, so later paranoid runs can check it by the sample.
+ *
+ * Sampling costs a few more reads of blocks the full read has just brought into the page cache. A file that
+ * cannot be sampled, or is too small to be, keeps no sample and is hashed whole in every paranoid run.
+ *
+ * @param[in] file File read whole
+ * @param[in] metadata Metadata of the file
+ * @param[in,out] record New state of the file, whose sample digest is set
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ */
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::KeepSample(const std::filesystem::path& file, const FileMetadata& metadata, FileStateRecord& record,
+                                                BackupStatsCollector::ThreadCounters* counters)
+{
+    record.sampleDigest = HashDigest{};
+    if ((0 == _sampledCheck.threshold) || (metadata.size < _sampledCheck.threshold))
+    {
+        return;
+    }
+    TraceSpan sampleSpan(counters, "FileHasher::ComputeSample");
+    if (false == _fileHasher.ComputeSample(file, _sampledCheck.blockSize, _sampledCheck.randomBlocks, record.sampleDigest))
+    {
+        record.sampleDigest = HashDigest{};
+    }
+}
+
+/**
+ * @brief Hand a planned file to the copy stage, or apply it here when there is no copy stage or nothing to copy.
+ *
+ * @param[in,out] plan Result of Plan, moved out when handed off
+ * @param[in] copyStage Stage receiving the plans of added and modified files, nullptr applies them here
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ */
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::Complete(BackupFilePlan& plan, PipelineStage<BackupFilePlan>* copyStage,
+                                              BackupStatsCollector::ThreadCounters* counters)
+{
+    if ((nullptr != copyStage) && (ChangeType::Unchanged != plan.record.status) && (false == plan.alreadyCommitted) && (false == plan.outsideLimits))
+    {
+        WaitTimer handOffTimer(counters);
+        copyStage->Submit(std::move(plan));
+        plan = BackupFilePlan{};
+    }
+    else
+    {
+        Apply(plan, counters);
+    }
+}
+
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::Apply(const BackupFilePlan& plan)
+{
+    BackupStatsCollector::ThreadCounters* counters = CurrentCounters();
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::MarkBusy(*counters);
+    }
+    Apply(plan, counters);
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::MarkIdle(*counters);
+    }
+}
+
+/**
+ * @brief Copy step measured into the counters of the calling thread.
+ *
+ * @param[in] plan Result of Plan
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ */
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::Apply(const BackupFilePlan& plan, BackupStatsCollector::ThreadCounters* counters)
+{
+    FileScope fileScope(counters, plan.file);
+    StageTimer copyTimer(counters, BackupStage::Copy);
+    std::error_code ec;
+    if (true == plan.alreadyCommitted)
+    {
+        CountAndReport(plan, counters);
+        return;
+    }
+    if (true == plan.outsideLimits)
+    {
+        if (ChangeType::Unchanged == plan.record.status)
+        {
+            StoreFileState(plan, counters);
+        }
+        return;
+    }
+    if ((true == plan.packed) && (ChangeType::Unchanged != plan.record.status))
+    {
+        ApplyPacked(plan, counters);
         return;
     }
-    if (std::string(".") == relativePath.string())
-        relativePath = file.filename();
+    if (nullptr != _storage)
+    {
+        if ((ChangeType::Unchanged != plan.record.status) && (false == UploadToStorage(plan, counters)))
+        {
+            _success.store(false);
+            return;
+        }
+        if (true == StoreFileState(plan, counters))
+        {
+            CountAndReport(plan, counters);
+        }
+        return;
+    }
+    // Unchanged files are only recorded, so they never build a backup path.
+    std::filesystem::path backupFile;
+    if (ChangeType::Unchanged != plan.record.status)
+    {
+        RelativePathBuilder::BuildLocation(_backupRoot, plan.relativeKey, backupFile);
+    }
+
+    if (ChangeType::Added == plan.record.status)
+    {
+        _directoryCache.Ensure(backupFile.parent_path());
+        std::filesystem::path stagedFile;
+        const bool moved = (nullptr != _moveDetector) && (true == plan.stagedFile.empty()) &&
+                           (true == _moveDetector->TryMove(plan.relativeKey, plan.record, backupFile));
+        if ((true == moved) && (nullptr != counters))
+        {
+            BackupStatsCollector::Add(counters->filesMoved, 1);
+        }
+        if ((false == moved) &&
+            ((false == StageBackupCopy(plan, backupFile, stagedFile, counters)) || (false == LinkFromContentStore(plan, stagedFile)) ||
+             (false == _fileCopier.Move(stagedFile, backupFile))))
+        {
+            _success.store(false);
+            return;
+        }
+    }
+    else if ((ChangeType::Modified == plan.record.status) && (true == plan.replacesRunVersion))
+    {
+        // The snapshot already holds the version from before the run; the one this run wrote is just replaced.
+        std::filesystem::path stagedFile;
+        if ((false == StageBackupCopy(plan, backupFile, stagedFile, counters)) || (false == LinkFromContentStore(plan, stagedFile)) ||
+            (false == _fileCopier.Move(stagedFile, backupFile)))
+        {
+            _success.store(false);
+            return;
+        }
+    }
+    else if (ChangeType::Modified == plan.record.status)
+    {
+        std::filesystem::path snapshotFile;
+        try
+        {
+            RelativePathBuilder::BuildLocation(_snapshotDirectory.GetOrCreate(), plan.relativeKey, snapshotFile);
+        }
+        catch (const std::runtime_error&)
+        {
+            _success.store(false);
+            return;
+        }
 
-    std::filesystem::path backupFile = _backupRoot / relativePath;
-    std::string newHash;
-    if (false == _fileHasher.Compute(file, newHash))
+        // The new content is complete before the old copy moves, so the backup never lacks the file.
+        std::filesystem::path stagedFile;
+        if ((false == StageBackupCopy(plan, backupFile, stagedFile, counters)) || (false == LinkFromContentStore(plan, stagedFile)))
+        {
+            _success.store(false);
+            return;
+        }
+        _directoryCache.Ensure(snapshotFile.parent_path());
+        std::filesystem::path manifestFile = snapshotFile;
+        manifestFile += ChunkStore::ManifestSuffix;
+        std::filesystem::path deltaFile = snapshotFile;
+        deltaFile += FileDelta::DeltaSuffix;
+        std::filesystem::path compressedFile = snapshotFile;
+        compressedFile += FileCompressor::CompressedSuffix;
+        // The delta rebuilds the old version from the new one, so only the newest version is stored in full.
+        const bool archived = ((nullptr != _chunkStore) && (true == _chunkStore->Archive(backupFile, manifestFile))) ||
+                              ((nullptr != _fileDelta) && (true == _fileDelta->Encode(stagedFile, backupFile, deltaFile))) ||
+                              ((nullptr != _fileCompressor) && (true == _fileCompressor->Compress(backupFile, compressedFile)));
+        if (false == archived)
+        {
+            _fileCopier.Move(backupFile, snapshotFile);
+        }
+        if (false == _fileCopier.Move(stagedFile, backupFile))
+        {
+            _success.store(false);
+            return;
+        }
+    }
+
+    if ((ChangeType::Unchanged != plan.record.status) && (false == ProtectCopy(plan, backupFile)))
     {
         _success.store(false);
         return;
     }
+    if (true == StoreFileState(plan, counters))
+    {
+        CountAndReport(plan, counters);
+    }
+}
 
-    std::string storedHash;
-    std::string storedTimestamp;
-    ChangeType storedStatus;
-    bool hasRecord = false;
-    try
+/**
+ * @brief Copy step of a packed file: hand its content to the packer, which completes the file once the content is indexed.
+ *
+ * @param[in] plan Result of Plan
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ */
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::ApplyPacked(const BackupFilePlan& plan, BackupStatsCollector::ThreadCounters* counters)
+{
+    if (nullptr != counters)
     {
-        hasRecord = _fileStateRepository.GetFileState(relativePath.string(), storedHash, storedStatus, storedTimestamp)
-                && (ChangeType::Deleted != storedStatus);
+        BackupStatsCollector::Add(counters->bytesWritten, plan.packedContent.size());
     }
-    catch (const std::runtime_error&)
+    // The completion outlives the plan, which is reused for the next file; it keeps everything but the content.
+    auto packedPlan = std::make_shared<BackupFilePlan>();
+    packedPlan->file = plan.file;
+    packedPlan->relativeKey = plan.relativeKey;
+    packedPlan->record = plan.record;
+    packedPlan->alreadyCommitted = false;
+    packedPlan->outsideLimits = false;
+    packedPlan->replacesRunVersion = plan.replacesRunVersion;
+    packedPlan->packed = true;
+    WaitTimer appendTimer(counters);
+    if (false == _packWriter->Append(plan.record.hash, plan.record.hashAlgorithm, std::vector<std::uint8_t>(plan.packedContent),
+                                     [this, packedPlan]() { CompletePacked(*packedPlan); }))
+    {
+        _success.store(false);
+    }
+}
+
+/**
+ * @brief Finish a packed file on the packer thread: archive a plain copy of its previous version and store its state.
+ *
+ * @param[in] plan Packed plan without its content
+ */
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::CompletePacked(const BackupFilePlan& plan)
+{
+    BackupStatsCollector::ThreadCounters* counters = CurrentCounters();
+    std::filesystem::path backupFile;
+    RelativePathBuilder::BuildLocation(_backupRoot, plan.relativeKey, backupFile);
+    if ((ChangeType::Modified == plan.record.status) && (false == ArchivePlainVersion(plan, backupFile)))
     {
         _success.store(false);
         return;
     }
+    if (true == StoreFileState(plan, counters))
+    {
+        CountAndReport(plan, counters);
+    }
+}
 
-    bool changed = (false == hasRecord) || (newHash != storedHash);
-    ChangeType newStatus = ChangeType::Unchanged;
-    std::string timestampValue = storedTimestamp;
+/**
+ * @brief Move a plain backup copy of a file's previous version out of the way of its packed new version.
+ *
+ * The copy goes to the snapshot like any replaced version, unless this run wrote it. A previous version
+ * that was packed as well has no plain copy and stays in the pack segments.
+ *
+ * @param[in] plan Packed plan of the new version
+ * @param[in] backupFile Backup location of the file
+ * @return true on success, false on error
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::ArchivePlainVersion(const BackupFilePlan& plan, const std::filesystem::path& backupFile)
+{
+    std::error_code ec;
+    if (false == std::filesystem::exists(backupFile, ec))
+    {
+        return true;
+    }
+    // The replaced copy may be large, so with a trash queue its blocks are freed off the worker thread.
+    const auto discard = [this, &backupFile, &ec]()
+    { return (nullptr != _trashQueue) ? _trashQueue->Discard(backupFile) : std::filesystem::remove(backupFile, ec); };
+    if (true == plan.replacesRunVersion)
+    {
+        return discard();
+    }
 
-    if (false == hasRecord)
+    std::filesystem::path snapshotFile;
+    try
+    {
+        RelativePathBuilder::BuildLocation(_snapshotDirectory.GetOrCreate(), plan.relativeKey, snapshotFile);
+    }
+    catch (const std::runtime_error&)
     {
-        newStatus = ChangeType::Added;
-        timestampValue = _timestampProvider.NowFilesystemSafe();
-        std::filesystem::create_directories(backupFile.parent_path(), ec);
-        std::filesystem::copy_file(file, backupFile, std::filesystem::copy_options::overwrite_existing, ec);
+        return false;
     }
-    else if (true == changed)
+    _directoryCache.Ensure(snapshotFile.parent_path());
+    std::filesystem::path manifestFile = snapshotFile;
+    manifestFile += ChunkStore::ManifestSuffix;
+    std::filesystem::path compressedFile = snapshotFile;
+    compressedFile += FileCompressor::CompressedSuffix;
+    // A delta needs the new version as a file, so with delta history the old one is kept whole.
+    if (((nullptr != _chunkStore) && (true == _chunkStore->Archive(backupFile, manifestFile))) ||
+        ((nullptr != _fileCompressor) && (true == _fileCompressor->Compress(backupFile, compressedFile))))
+    {
+        return discard();
+    }
+    return _fileCopier.Move(backupFile, snapshotFile);
+}
+
+/**
+ * @brief Copy step with a storage backend: upload an added or modified file under its backup key.
+ *
+ * An object store cannot swap two objects, so the previous version is moved to the snapshot before
+ * the upload rather than after it; a failed upload leaves the key empty until the next run.
+ *
+ * @param[in] plan Result of Plan
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true on success, false on error
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::UploadToStorage(const BackupFilePlan& plan, BackupStatsCollector::ThreadCounters* counters)
+{
+    std::filesystem::path backupFile;
+    RelativePathBuilder::BuildLocation(_backupRoot, plan.relativeKey, backupFile);
+    const std::string backupKey = backupFile.generic_string();
+    if ((ChangeType::Modified == plan.record.status) && (false == plan.replacesRunVersion))
     {
-        newStatus = ChangeType::Modified;
-        timestampValue = _timestampProvider.NowFilesystemSafe();
         std::filesystem::path snapshotFile;
         try
         {
-            snapshotFile = _snapshotDirectory.GetOrCreate() / relativePath;
+            RelativePathBuilder::BuildLocation(_snapshotDirectory.GetOrCreate(), plan.relativeKey, snapshotFile);
         }
         catch (const std::runtime_error&)
         {
-            _success.store(false);
-            return;
+            return false;
+        }
+        bool exists = false;
+        if ((false == _storage->Exists(backupKey, exists)) ||
+            ((true == exists) && (false == _storage->Rename(backupKey, snapshotFile.generic_string()))))
+        {
+            return false;
         }
-        std::filesystem::create_directories(snapshotFile.parent_path(), ec);
-        std::filesystem::copy_file(backupFile, snapshotFile, std::filesystem::copy_options::overwrite_existing, ec);
-        std::filesystem::copy_file(file, backupFile, std::filesystem::copy_options::overwrite_existing, ec);
     }
 
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::Add(counters->bytesRead, plan.record.metadata.size);
+        BackupStatsCollector::Add(counters->bytesWritten, plan.record.metadata.size);
+    }
+    TraceSpan putSpan(counters, "StorageBackend::Put");
+    return _storage->Put(plan.file, backupKey);
+}
+
+/**
+ * @brief Store the new state of a file, timed as database work.
+ *
+ * @param[in] plan Result of Plan
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true on success, false on error, which also clears the shared success flag
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::StoreFileState(const BackupFilePlan& plan, BackupStatsCollector::ThreadCounters* counters)
+{
     try
     {
-        if (false == _fileStateRepository.UpdateFileState(relativePath.string(), newHash, newStatus, timestampValue))
+        StageTimer databaseTimer(counters, BackupStage::Database);
+        TraceSpan storeSpan(counters, "UpdateFileState");
+        if (false == _stateSink.Store(plan.relativeKey, plan.record))
         {
             _success.store(false);
         }
@@ -93,11 +915,437 @@ void ProcessBackupFile::Execute(const std::filesystem::path& file)
     catch (const std::runtime_error&)
     {
         _success.store(false);
-        return;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Count a processed file by its change type and report it as progress.
+ *
+ * @param[in] plan Result of Plan
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ */
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::CountAndReport(const BackupFilePlan& plan, BackupStatsCollector::ThreadCounters* counters)
+{
+    RDEMO_PROBE2(file_done, plan.file.c_str(), static_cast<int>(plan.record.status));
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::Add(counters->filesByChange[static_cast<std::size_t>(plan.record.status)], 1);
+        if (nullptr != counters->ioTrace)
+        {
+            counters->ioTrace->RecordFile(plan.file, plan.relativeKey, plan.record.metadata.size, plan.record.status);
+        }
+        if (nullptr != counters->changeLog)
+        {
+            counters->changeLog->Record(plan.record.status, plan.relativeKey, plan.record.metadata.size);
+        }
     }
+    if (nullptr != _progressReporter)
+    {
+        _progressReporter->Report("collecting", plan.file, plan.record.metadata.size);
+    }
+}
+
+/**
+ * @brief Get the scratch buffers of the calling thread, creating them on first use.
+ *
+ * @return Scratch only used by the calling thread
+ */
+template <typename StateLookup>
+typename ProcessBackupFile<StateLookup>::WorkerScratch& ProcessBackupFile<StateLookup>::CurrentScratch()
+{
+    std::lock_guard<std::mutex> lock(_scratchMutex);
+    std::unique_ptr<WorkerScratch>& scratch = _scratch[std::this_thread::get_id()];
+    if (nullptr == scratch)
+    {
+        scratch = std::make_unique<WorkerScratch>();
+        scratch->counters = CurrentCounters();
+    }
+    return *scratch;
+}
+
+/**
+ * @brief Get the stats counters of the calling thread.
+ *
+ * @return Counters of the calling thread, nullptr without stats
+ */
+template <typename StateLookup>
+BackupStatsCollector::ThreadCounters* ProcessBackupFile<StateLookup>::CurrentCounters()
+{
+    return (nullptr != _statsCollector) ? &_statsCollector->Current() : nullptr;
+}
 
-    if (nullptr != _onProgress)
+/**
+ * @brief Count a file about to be read and hashed in full.
+ *
+ * @param[in] metadata Metadata of the file
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ */
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::CountHashedFile(const FileMetadata& metadata, BackupStatsCollector::ThreadCounters* counters)
+{
+    if (nullptr != counters)
     {
-        _onProgress({"collecting", ++_processedCount, UnknownTotalCount, file});
+        BackupStatsCollector::Add(counters->bytesRead, metadata.size);
+        BackupStatsCollector::Add(counters->bytesHashed, metadata.size);
     }
 }
+
+/**
+ * @brief Look a file up in the digest attribute on the file and then in the hash cache, timed as database work.
+ *
+ * @param[in] file File to look up
+ * @param[in] metadata Metadata of the file
+ * @param[out] outputDigest Cached digest
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true if either cache holds a digest for the file, false otherwise
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::LookupCachedDigest(const std::filesystem::path& file, const FileMetadata& metadata, HashDigest& outputDigest,
+                                                        BackupStatsCollector::ThreadCounters* counters)
+{
+    if ((nullptr == _digestAttributes) && (nullptr == _hashCache))
+    {
+        return false;
+    }
+    StageTimer databaseTimer(counters, BackupStage::Database);
+    return ((nullptr != _digestAttributes) && (true == _digestAttributes->Lookup(file, metadata, _fileHasher.Algorithm(), outputDigest))) ||
+           ((nullptr != _hashCache) && (true == _hashCache->Lookup(metadata, _fileHasher.Algorithm(), outputDigest)));
+}
+
+/**
+ * @brief Get a complete copy of the new file content next to its backup location.
+ *
+ * Uses the copy staged by Plan, or copies the source to a staging path when nothing was staged.
+ *
+ * @param[in] plan Result of Plan
+ * @param[in] backupFile Backup location of the file
+ * @param[out] outputStagedFile Staged copy, to be renamed over the backup location
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true on success, false on error
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::StageBackupCopy(const BackupFilePlan& plan, const std::filesystem::path& backupFile,
+                                                     std::filesystem::path& outputStagedFile, BackupStatsCollector::ThreadCounters* counters)
+{
+    if (false == plan.stagedFile.empty())
+    {
+        outputStagedFile = plan.stagedFile;
+        return true;
+    }
+
+    outputStagedFile = backupFile;
+    outputStagedFile += StagedFileSuffix;
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::Add(counters->bytesRead, plan.record.metadata.size);
+        BackupStatsCollector::Add(counters->bytesWritten, plan.record.metadata.size);
+    }
+    TraceSpan copySpan(counters, "copy_file");
+    if (false == WriteBackupCopy(plan.file, outputStagedFile, nullptr))
+    {
+        std::error_code ec;
+        std::filesystem::remove(outputStagedFile, ec);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Write the backup copy of a file, encrypted when an encryptor is set.
+ *
+ * Encrypted copies are fed from the hasher's read buffer, so they are read once and paced like plain ones.
+ *
+ * @param[in] file Source file
+ * @param[in] stagedFile Staging file to write
+ * @param[out] outputDigest Digest of the source computed in the same pass, nullptr when the digest is known
+ * @return true on success, false on error; the staging file may be left partially written
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::WriteBackupCopy(const std::filesystem::path& file, const std::filesystem::path& stagedFile, HashDigest* outputDigest) const
+{
+    if (nullptr == _fileEncryptor)
+    {
+        return (nullptr == outputDigest) ? _fileCopier.Copy(file, stagedFile) : _fileHasher.ComputeAndCopy(file, stagedFile, *outputDigest);
+    }
+    FileEncryptor::Writer writer(*_fileEncryptor, stagedFile);
+    HashDigest digest{};
+    const bool written = (true == writer.IsOpen()) &&
+                         (true == _fileHasher.ComputeAndStream(
+                                      file, [&writer](const std::uint8_t* data, std::size_t length) { return writer.Write(data, length); }, digest)) &&
+                         (true == writer.Finish());
+    if ((true == written) && (nullptr != outputDigest))
+    {
+        *outputDigest = digest;
+    }
+    return written;
+}
+
+/**
+ * @brief Stage the backup copy of a large file through a resume point, so a file that only grew is read from where its stored version ends.
+ *
+ * The hash cache's resume point applies when it covers exactly the stored version, which its digest proves. The backup copy of that
+ * version is then copied, as a clone where the filesystem can, and only the new bytes of the source are hashed and appended. Otherwise,
+ * or if the source's bytes before the point were rewritten, the whole file is copied. Either way the point after the whole file is
+ * saved for the next run, unless the file changed while it was read.
+ *
+ * @param[in] file Source file
+ * @param[in] relativeKey State key of the file
+ * @param[in] storedRecord Stored state of the file
+ * @param[in] hasRecord Whether a live state is stored
+ * @param[in] metadata Metadata of the file, captured before it is read
+ * @param[in] stagedFile Staging file to write
+ * @param[out] outputDigest Digest of the source
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true if the file was staged, false if it must be copied the usual way; the staging file may be left partially written
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::StageFromResumePoint(const std::filesystem::path& file, const std::string& relativeKey, const FileStateRecord& storedRecord,
+                                                          bool hasRecord, const FileMetadata& metadata, const std::filesystem::path& stagedFile,
+                                                          HashDigest& outputDigest, BackupStatsCollector::ThreadCounters* counters)
+{
+    HashResumePoint resumePoint{};
+    HashDigest resumeDigest{};
+    bool resuming = false;
+    if (true == hasRecord)
+    {
+        StageTimer databaseTimer(counters, BackupStage::Database);
+        resuming = (true == _hashCache->LookupResumePoint(metadata, _fileHasher.Algorithm(), resumePoint)) &&
+                   (resumePoint.size == storedRecord.metadata.size) && (resumePoint.size < metadata.size) &&
+                   (storedRecord.hashAlgorithm == resumePoint.algorithm) && (true == _fileHasher.ResumePointDigest(resumePoint, resumeDigest)) &&
+                   (resumeDigest == storedRecord.hash);
+    }
+    if (true == resuming)
+    {
+        std::filesystem::path backupFile;
+        RelativePathBuilder::BuildLocation(_backupRoot, relativeKey, backupFile);
+        TraceSpan copySpan(counters, "copy_file");
+        resuming = _fileCopier.Copy(backupFile, stagedFile);
+    }
+    if (false == resuming)
+    {
+        resumePoint = HashResumePoint{};
+    }
+
+    std::uintmax_t resumedSize = resumePoint.size;
+    bool staged = false;
+    {
+        TraceSpan appendSpan(counters, "FileHasher::ComputeAndAppend");
+        staged = _fileHasher.ComputeAndAppend(file, stagedFile, resumePoint, outputDigest);
+        if ((false == staged) && (true == resuming))
+        {
+            // The bytes before the point were rewritten rather than appended to.
+            resumePoint = HashResumePoint{};
+            resumedSize = 0;
+            staged = _fileHasher.ComputeAndAppend(file, stagedFile, resumePoint, outputDigest);
+        }
+    }
+    if (false == staged)
+    {
+        return false;
+    }
+    const std::uintmax_t readSize = resumePoint.size - resumedSize;
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::Add(counters->bytesRead, readSize);
+        BackupStatsCollector::Add(counters->bytesWritten, readSize);
+        BackupStatsCollector::Add(counters->bytesHashed, readSize);
+    }
+
+    // Like a digest, a point is only kept for the content the captured metadata describes.
+    FileMetadata currentMetadata{};
+    if ((resumePoint.size == metadata.size) && (true == ReadFileMetadata(file, currentMetadata)) && (metadata == currentMetadata) &&
+        (metadata.changeTimeNs == currentMetadata.changeTimeNs))
+    {
+        StageTimer databaseTimer(counters, BackupStage::Database);
+        _hashCache->StoreResumePoint(metadata, resumePoint);
+    }
+    return true;
+}
+
+/**
+ * @brief Stage the copy of a large file with checkpoints, continuing the staging file an interrupted run left behind.
+ *
+ * Every checkpoint interval the staging file is synced and the hash state after it recorded with the XXH3_64 of the chunk
+ * before it. A later run continues from the last checkpoint whose chunk the staging file still holds, as long as the source's
+ * size and times are unchanged and the staging file is no hardlink, since a finished copy may have been linked into the content
+ * store. The checkpoints are dropped once the file is staged.
+ *
+ * @param[in] file Source file
+ * @param[in] relativeKey State key of the file
+ * @param[in] metadata Metadata of the file, captured before it is read
+ * @param[in] stagedFile Staging file to write
+ * @param[out] outputDigest Digest of the source
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true if the file was staged, false if it must be copied the usual way; the staging file may be left partially written
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::StageWithCheckpoints(const std::filesystem::path& file, const std::string& relativeKey, const FileMetadata& metadata,
+                                                          const std::filesystem::path& stagedFile, HashDigest& outputDigest,
+                                                          BackupStatsCollector::ThreadCounters* counters)
+{
+    std::vector<CopyCheckpoint> checkpoints;
+    {
+        StageTimer databaseTimer(counters, BackupStage::Database);
+        if (false == _copyCheckpoints->Load(relativeKey, metadata, _fileHasher.Algorithm(), checkpoints))
+        {
+            return false;
+        }
+    }
+    std::error_code ec;
+    HashResumePoint resumePoint{};
+    const bool leftover = (false == checkpoints.empty()) && (true == std::filesystem::is_regular_file(stagedFile, ec)) &&
+                          (1 == std::filesystem::hard_link_count(stagedFile, ec));
+    const std::uintmax_t stagedSize = (true == leftover) ? std::filesystem::file_size(stagedFile, ec) : 0;
+    // The newest checkpoint whose chunk is intact wins; a chunk torn by the interruption falls back to the one before.
+    for (auto checkpoint = checkpoints.rbegin(); (true == leftover) && (checkpoints.rend() != checkpoint); ++checkpoint)
+    {
+        const auto previous = std::next(checkpoint);
+        const std::uintmax_t chunkStart = (checkpoints.rend() == previous) ? 0 : previous->point.size;
+        std::uint64_t chunkHash = 0;
+        if ((checkpoint->point.size <= stagedSize) &&
+            (true == _fileHasher.ComputeRangeHash(stagedFile, chunkStart, checkpoint->point.size - chunkStart, chunkHash)) &&
+            (checkpoint->chunkHash == chunkHash))
+        {
+            resumePoint = checkpoint->point;
+            break;
+        }
+    }
+    if (0 < resumePoint.size)
+    {
+        std::filesystem::resize_file(stagedFile, resumePoint.size, ec);
+        if (ec)
+        {
+            resumePoint = HashResumePoint{};
+        }
+    }
+    if (0 == resumePoint.size)
+    {
+        // Never write through a leftover that may be a hardlink into the content store.
+        std::filesystem::remove(stagedFile, ec);
+    }
+    {
+        StageTimer databaseTimer(counters, BackupStage::Database);
+        _copyCheckpoints->Truncate(relativeKey, resumePoint.size);
+    }
+
+    const auto recordCheckpoint = [this, &relativeKey, &metadata, counters](const HashResumePoint& point, std::uint64_t chunkHash) {
+        StageTimer databaseTimer(counters, BackupStage::Database);
+        _copyCheckpoints->Record(relativeKey, metadata, CopyCheckpoint{point, chunkHash});
+    };
+    std::uintmax_t resumedSize = resumePoint.size;
+    bool staged = false;
+    {
+        TraceSpan appendSpan(counters, "FileHasher::ComputeAndAppend");
+        staged = _fileHasher.ComputeAndAppend(file, stagedFile, resumePoint, outputDigest, _copyCheckpointInterval, recordCheckpoint);
+        if ((false == staged) && (0 < resumedSize))
+        {
+            // The source's bytes before the checkpoint were rewritten without changing its size or times.
+            std::filesystem::remove(stagedFile, ec);
+            {
+                StageTimer databaseTimer(counters, BackupStage::Database);
+                _copyCheckpoints->Truncate(relativeKey, 0);
+            }
+            resumePoint = HashResumePoint{};
+            resumedSize = 0;
+            staged = _fileHasher.ComputeAndAppend(file, stagedFile, resumePoint, outputDigest, _copyCheckpointInterval, recordCheckpoint);
+        }
+    }
+    {
+        StageTimer databaseTimer(counters, BackupStage::Database);
+        _copyCheckpoints->Truncate(relativeKey, 0);
+    }
+    if (false == staged)
+    {
+        return false;
+    }
+    const std::uintmax_t readSize = resumePoint.size - resumedSize;
+    if (nullptr != counters)
+    {
+        BackupStatsCollector::Add(counters->bytesRead, readSize);
+        BackupStatsCollector::Add(counters->bytesWritten, readSize);
+        BackupStatsCollector::Add(counters->bytesHashed, readSize);
+    }
+    return true;
+}
+
+/**
+ * @brief Turn a staged copy into a hardlink to its content object, adding the object if it is new.
+ *
+ * If the store rejects the content the staged copy is kept as a plain file.
+ *
+ * @param[in] plan Result of Plan
+ * @param[in] stagedFile Staged copy of the new content
+ * @return true if a file with the new content is at the staging path, false on error
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::LinkFromContentStore(const BackupFilePlan& plan, const std::filesystem::path& stagedFile)
+{
+    if ((nullptr == _contentStore) || (false == _contentStore->Insert(stagedFile, plan.record.hash)))
+    {
+        return true;
+    }
+    return _contentStore->Link(plan.record.hash, stagedFile);
+}
+
+/**
+ * @brief Write the parity of a new backup copy large enough for it, unless its content has parity already.
+ *
+ * The copy was just written, so it is read back from the page cache. A copy taken over from a moved file
+ * or linked from the content store keeps the parity its content already has.
+ *
+ * @param[in] plan Result of Plan
+ * @param[in] backupFile Backup copy in its final place
+ * @return true on success or when no parity is due, false on error
+ */
+template <typename StateLookup>
+bool ProcessBackupFile<StateLookup>::ProtectCopy(const BackupFilePlan& plan, const std::filesystem::path& backupFile) const
+{
+    if ((nullptr == _parity.code) || (plan.record.metadata.size < _parity.threshold))
+    {
+        return true;
+    }
+    std::error_code ec;
+    const std::filesystem::path parityFile = ParityFile::ContentPath(_parity.root, plan.record.hash);
+    return (true == std::filesystem::exists(parityFile, ec)) || (true == ParityFile::Write(backupFile, parityFile, *_parity.code));
+}
+
+/**
+ * @brief Add a freshly computed digest to the digest attribute on the file and to the hash cache.
+ *
+ * The file is stat'ed again and the digest is dropped if anything changed while it was read, so other
+ * jobs never get a digest of content the recorded identity does not describe. Setting the attribute
+ * moves the file's ctime, so the hash cache entry takes the metadata read after it. Cache errors are ignored.
+ *
+ * @param[in] file Hashed file
+ * @param[in] metadata Metadata captured before hashing
+ * @param[in] digest Digest of the file
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ */
+template <typename StateLookup>
+void ProcessBackupFile<StateLookup>::RememberDigest(const std::filesystem::path& file, const FileMetadata& metadata, const HashDigest& digest,
+                                                    BackupStatsCollector::ThreadCounters* counters)
+{
+    FileMetadata currentMetadata{};
+    if (((nullptr == _hashCache) && (nullptr == _digestAttributes)) || (false == ReadFileMetadata(file, currentMetadata)) || (metadata != currentMetadata) ||
+        (metadata.changeTimeNs != currentMetadata.changeTimeNs))
+    {
+        return;
+    }
+    StageTimer databaseTimer(counters, BackupStage::Database);
+    if ((nullptr != _digestAttributes) && (true == _digestAttributes->Store(file, metadata, _fileHasher.Algorithm(), digest)) &&
+        ((false == ReadFileMetadata(file, currentMetadata)) || (metadata != currentMetadata)))
+    {
+        return;
+    }
+    if (nullptr != _hashCache)
+    {
+        _hashCache->Store(currentMetadata, _fileHasher.Algorithm(), digest);
+    }
+}
+
+// The lookups RunBackup chooses between; other instantiations would need their own line here.
+template class ProcessBackupFile<IndexedStateLookup>;
+template class ProcessBackupFile<RepositoryStateLookup>;
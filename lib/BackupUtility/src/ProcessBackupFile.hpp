@@ -1,55 +1,309 @@
 #pragma once
 
 #include "BackupUtility/BackupUtility.hpp"
+#include "BackupStatsCollector.hpp"
+#include "ChunkStore.hpp"
+#include "ContentObjectStore.hpp"
+#include "CopyCheckpointStore.hpp"
+#include "DigestAttributeCache.hpp"
+#include "FileDelta.hpp"
+#include "FileStateAccess.hpp"
+#include "FileStatePrefetch.hpp"
 #include "FileStateRepository.hpp"
+#include "HashCache.hpp"
+#include "MoveDetector.hpp"
+#include "PackWriterThread.hpp"
+#include "PipelineStage.hpp"
+#include "ProgressReporter.hpp"
+#include "RelativePathBuilder.hpp"
+#include "ErasureCode/ReedSolomon.hpp"
+#include "FileCompressor/FileCompressor.hpp"
+#include "FileEncryptor/FileEncryptor.hpp"
+#include "FileCopier/DirectoryCache.hpp"
+#include "FileCopier/FileCopier.hpp"
 #include "FileHasher/FileHasher.hpp"
+#include "FileIterator/PathFilter.hpp"
 #include "SnapshotDirectoryProvider/SnapshotDirectoryProvider.hpp"
-#include "TimestampProvider/TimestampProvider.hpp"
+#include "StorageBackend/StorageBackend.hpp"
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+#include "TimestampProvider/RunContext.hpp"
+#include "TrashQueue.hpp"
 
 #include <atomic>
+#include <cstddef>
 #include <filesystem>
-#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Outcome of the read/hash step for one file, consumed by the copy step.
+ */
+struct BackupFilePlan
+{
+    std::filesystem::path file;       /**< Source file */
+    std::string relativeKey;          /**< State key: path relative to the source root */
+    FileStateRecord record;             /**< New state; its status says whether the file must be copied */
+    std::filesystem::path stagedFile;   /**< Copy written while hashing, empty when Apply still has to copy the source */
+    bool alreadyCommitted;              /**< Committed unchanged by the interrupted run being resumed; Apply only counts it */
+    bool outsideLimits;                 /**< Outside the size and mtime limits; Apply only stores the kept state again, if there is one */
+    bool replacesRunVersion;            /**< The stored version was written by this run, so the snapshot already holds the one from before it */
+    bool packed;                        /**< Small enough for the pack segments; the content was read while hashing */
+    std::vector<std::uint8_t> packedContent; /**< Content of a packed file, empty unless packed */
+};
+
+/**
+ * @brief When a paranoid run confirms a large file with unchanged metadata by a sample of its blocks instead of a full hash.
+ */
+struct SampledCheckPolicy
+{
+    std::uint64_t threshold;   /**< Smallest file size in bytes sampled, 0 disables sampling */
+    std::size_t blockSize;     /**< Bytes per sampled block */
+    unsigned int randomBlocks; /**< Blocks sampled between the first and the last */
+    unsigned int fullEvery;    /**< Every this many runs a sampled file is hashed whole, 0 never while its metadata is unchanged */
+};
+
+/**
+ * @brief Which backup copies get Reed-Solomon parity, and where it is kept.
+ */
+struct ParityPolicy
+{
+    const ReedSolomon* code;    /**< Code the parity is computed with, nullptr writes no parity */
+    std::filesystem::path root; /**< Directory holding the parity files */
+    std::uint64_t threshold;    /**< Smallest backup copy in bytes that gets parity */
+};
 
 /**
  * @brief Application component for processing a single file during backup.
+ *
+ * The way stored states are looked up is a template parameter rather than a callback, so the per-file
+ * path calls it directly. The member functions are defined in ProcessBackupFile.cpp, which instantiates
+ * the class for IndexedStateLookup and RepositoryStateLookup; RunBackup picks one of them once per run.
+ *
+ * @tparam StateLookup Lookup of stored states, with `bool Load(const std::string&, FileStateRecord&) const`
  */
+template <typename StateLookup>
 class ProcessBackupFile
 {
   public:
     /**
      * @brief Construct a processor for individual backup files.
      *
-     * @param[in] sourceRoot Root path of the source directory
+     * @param[in] sourceKeys Mapping of source files to their state keys
      * @param[in] backupRoot Root path of the backup directory
      * @param[in] snapshotDirectory Provider for snapshot directories
-     * @param[in] fileStateRepository Repository for file state tracking
+     * @param[in] stateLookup Lookup for the stored state of a file, copied
+     * @param[in,out] stateSink Sink for updated file states
      * @param[in] fileHasher File hashing utility
-     * @param[in] timestampProvider Timestamp provider
-     * @param[in] onProgress Progress callback
+     * @param[in] hashCache Digest cache consulted before hashing and updated after, nullptr always hashes
+     * @param[in] fileCopier File copying utility
+     * @param[in,out] directoryCache Directories of the run known to exist, shared with the other workers
+     * @param[in] contentStore Object store new versions are added to and linked from, nullptr stores plain copies
+     * @param[in] chunkStore Store previous versions are archived into as chunk manifests, nullptr archives plain files
+     * @param[in] fileDelta Encoder storing previous versions as deltas against the new version, nullptr archives plain files
+     * @param[in] fileCompressor Compressor for previous versions archived whole, nullptr archives them uncompressed
+     * @param[in] fileEncryptor Encryptor new backup copies are written through, nullptr writes them in plain
+     * @param[in] packWriter Packer small files are handed to instead of being copied, nullptr copies every file
+     * @param[in] moveDetector Detector taking over the backup copies of moved files, nullptr copies every new file
+     * @param[in] storage Backend changed files are uploaded to, backupRoot then being a key prefix; nullptr copies them below backupRoot
+     * @param[in] runContext Run whose timestamp is recorded for every file it changes
+     * @param[in] progressReporter Reporter processed files are counted in, nullptr reports nothing
+     * @param[in] statsCollector Collector of per-stage times and counts, nullptr measures nothing
      * @param[in/out] success Shared success flag for the operation
-     * @param[in/out] processedCount Shared processed counter
+     * @param[in] paranoid Rehash every file even when its size, mtime and identity are unchanged
+     * @param[in] extendedAttributes Record the extended attributes of every file with its state
+     * @param[in] resumeAppends Keep resume points in the hash cache, so a large file that only grew is hashed and copied from where its
+     *            stored version ends
+     * @param[in] digestAttributes Digest cache on the source files themselves, looked up before the hash cache; nullptr disables it
+     * @param[in] sampledCheck Sampled checks of large unchanged files in paranoid runs; the default disables them
+     * @param[in] copyCheckpoints Checkpoints of large copies, so a copy an interrupted run left staged is continued; nullptr disables them
+     * @param[in] copyCheckpointInterval Bytes copied between two checkpoints; copies no larger than that take none
+     * @param[in] trashQueue Queue replaced backup copies are discarded through, nullptr removes them on the worker thread
+     * @param[in] parity Parity written for new backup copies; the default writes none
+     * @param[in] limits Filter whose size and mtime limits leave files unread while keeping their stored states, nullptr reads every file
      */
-    ProcessBackupFile(const std::filesystem::path& sourceRoot, const std::filesystem::path& backupRoot,
+    ProcessBackupFile(const RelativePathBuilder& sourceKeys, const std::filesystem::path& backupRoot,
               SnapshotDirectoryProvider& snapshotDirectory,
-                      FileStateRepository& fileStateRepository, const FileHasher& fileHasher,
-                      const TimestampProvider& timestampProvider, const std::function<void(const BackupProgress&)>& onProgress,
-                      std::atomic<bool>& success, std::atomic<std::size_t>& processedCount);
+                      const StateLookup& stateLookup, FileStateSink& stateSink, const FileHasher& fileHasher,
+                      HashCache* hashCache, const FileCopier& fileCopier, DirectoryCache& directoryCache, const ContentObjectStore* contentStore,
+                      const ChunkStore* chunkStore, const FileDelta* fileDelta, const FileCompressor* fileCompressor,
+                      const FileEncryptor* fileEncryptor, PackWriterThread* packWriter, const MoveDetector* moveDetector, StorageBackend* storage,
+                      const RunContext& runContext,
+                      ProgressReporter* progressReporter, BackupStatsCollector* statsCollector, std::atomic<bool>& success,
+                      bool paranoid, bool extendedAttributes, bool resumeAppends = false,
+                      const DigestAttributeCache* digestAttributes = nullptr, const SampledCheckPolicy& sampledCheck = SampledCheckPolicy{},
+                      CopyCheckpointStore* copyCheckpoints = nullptr, std::uint64_t copyCheckpointInterval = 0, TrashQueue* trashQueue = nullptr,
+                      const ParityPolicy& parity = ParityPolicy{}, const PathFilter* limits = nullptr);
 
     /**
      * @brief Process a single file for backup and state tracking.
      *
+     * When the stored size, mtime, inode and device all match the file, the stored digest is trusted
+     * and the file is not read. A paranoid run reads a large such file only by a sample of its blocks, if the
+     * sampled check policy allows it, and hashes it whole when the sample differs or its full-hash run is due. New files and files whose size changed are hashed while they are copied,
+     * so their source is read only once, unless a move detector knows a file of the same size; such a new file
+     * is hashed first, so a moved file is found before it is copied. Other files are looked up in the hash cache before they are read.
+     *
+     * The plan and stored record live in per-thread scratch whose buffers are reused, so an unchanged
+     * file costs no allocations once a worker has warmed up.
+     *
+     * @param[in] file File to process, with the metadata the walk read if it has any; without it the file is stat'ed here
+     * @param[in] copyStage Stage receiving the plans of added and modified files instead of applying them here, nullptr applies them
+     */
+    void Execute(const FileWorkItem& file, PipelineStage<BackupFilePlan>* copyStage = nullptr);
+
+    /**
+     * @brief Process a dequeued batch of files, hashing the ones that need a full hash together.
+     *
+     * Every file is looked up first, and stat'ed unless the walk already did. The files taking the hash-only path that the hash cache
+     * does not know are then hashed with one FileHasher::ComputeMany call, which keeps them in flight
+     * together where the hasher supports it; after that each file is finished as by Execute.
+     *
+     * @param[in] files Files to process
+     * @param[in] copyStage Stage receiving the plans of added and modified files instead of applying them here, nullptr applies them
+     */
+    void ExecuteBatch(const std::vector<FileWorkItem>& files, PipelineStage<BackupFilePlan>* copyStage = nullptr);
+
+    /**
+     * @brief Read/hash step: compare a file against its stored state and decide what to do with it.
+     *
+     * A file the resumed run already committed is not hashed again while its metadata still matches. On
+     * failure the shared success flag is cleared.
+     *
      * @param[in] file File path to process
+     * @param[out] outputPlan New state for the file
+     * @return true on success, false on error
      */
-    void Execute(const std::filesystem::path& file);
+    bool Plan(const std::filesystem::path& file, BackupFilePlan& outputPlan);
+
+    /**
+     * @brief Copy step: copy an added or modified file into the backup, then store its new state.
+     *
+     * The new content is written to a staging file and renamed into place. An added file the move detector matches
+     * takes over the backup copy of the file it was moved from instead. A modified file's previous
+     * backup copy is renamed into the snapshot directory, or replaced there by a chunk manifest or a reverse
+     * delta when those are enabled, compressed when it is kept whole. With a content store the staged content becomes
+     * an object and the backup file a hardlink to it. A version written earlier by the same resumed run is
+     * replaced without archiving it. Unchanged files are only recorded, files the resumed run already committed not even that.
+     * A packed file is handed to the packer, which records its state once the content is indexed; a plain
+     * copy of an earlier version is archived at that point.
+     *
+     * @param[in] plan Result of Plan
+     */
+    void Apply(const BackupFilePlan& plan);
 
   private:
-    const std::filesystem::path& _sourceRoot;
+    /**
+     * @brief How a file that is not already committed is read.
+     */
+    enum class ReadPath
+    {
+        None,   /**< Metadata unchanged; the stored digest is trusted */
+        Sample, /**< Metadata unchanged in a paranoid run; a sample of the blocks is checked against the stored one */
+        Packed, /**< Read whole for the pack segments */
+        Copy,   /**< Hashed while it is copied */
+        Hash    /**< Hashed only, unless the hash cache knows it */
+    };
+
+    /**
+     * @brief File of a batch between Inspect and Decide.
+     */
+    struct BatchEntry
+    {
+        BackupFilePlan plan;          /**< Plan of the file */
+        FileStateRecord storedRecord; /**< Stored state of the file */
+        FileMetadata metadata;        /**< Metadata captured by Inspect */
+        bool hasRecord;               /**< A live state is stored */
+        bool inspected;               /**< Inspect succeeded */
+        bool hasDigest;               /**< digest holds the cached or batch-hashed digest */
+        HashDigest digest;            /**< Digest for the hash-only path */
+    };
+
+    /**
+     * @brief Buffers a worker thread reuses from file to file.
+     */
+    struct WorkerScratch
+    {
+        BackupFilePlan plan;                           /**< Plan of the file being processed */
+        FileStateRecord storedRecord;                  /**< Stored state of the file being processed */
+        BackupStatsCollector::ThreadCounters* counters; /**< Stats counters of the thread, nullptr without stats */
+        std::vector<BatchEntry> batch;                 /**< Files of the batch being processed */
+        std::vector<HashJob> hashJobs;                 /**< Files of the batch hashed together */
+        std::vector<std::size_t> hashJobEntries;       /**< Batch index of each hash job */
+    };
+
+    bool Plan(const std::filesystem::path& file, const FileMetadata* walkedMetadata, const FileStatePrefetch* prefetched,
+              FileStateRecord& storedRecord, BackupFilePlan& outputPlan, BackupStatsCollector::ThreadCounters* counters);
+    bool Inspect(const std::filesystem::path& file, const FileMetadata* walkedMetadata, const FileStatePrefetch* prefetched,
+                 FileStateRecord& storedRecord, BackupFilePlan& outputPlan, FileMetadata& outputMetadata, bool& outputHasRecord,
+                 BackupStatsCollector::ThreadCounters* counters);
+    ReadPath ChooseReadPath(const FileStateRecord& storedRecord, const FileMetadata& metadata, bool hasRecord) const;
+    bool Decide(const std::filesystem::path& file, const FileStateRecord& storedRecord, const FileMetadata& metadata, bool hasRecord,
+                const HashDigest* precomputedDigest, BackupFilePlan& outputPlan, BackupStatsCollector::ThreadCounters* counters);
+    void Complete(BackupFilePlan& plan, PipelineStage<BackupFilePlan>* copyStage, BackupStatsCollector::ThreadCounters* counters);
+    void Apply(const BackupFilePlan& plan, BackupStatsCollector::ThreadCounters* counters);
+    void ApplyPacked(const BackupFilePlan& plan, BackupStatsCollector::ThreadCounters* counters);
+    void CompletePacked(const BackupFilePlan& plan);
+    bool ArchivePlainVersion(const BackupFilePlan& plan, const std::filesystem::path& backupFile);
+    bool StoreFileState(const BackupFilePlan& plan, BackupStatsCollector::ThreadCounters* counters);
+    void CountAndReport(const BackupFilePlan& plan, BackupStatsCollector::ThreadCounters* counters);
+    WorkerScratch& CurrentScratch();
+    BackupStatsCollector::ThreadCounters* CurrentCounters();
+    bool CheckSample(const std::filesystem::path& file, const FileStateRecord& storedRecord, const FileMetadata& metadata,
+                     BackupStatsCollector::ThreadCounters* counters, bool& outputMatches);
+    void KeepSample(const std::filesystem::path& file, const FileMetadata& metadata, FileStateRecord& record,
+                    BackupStatsCollector::ThreadCounters* counters);
+    static void CountHashedFile(const FileMetadata& metadata, BackupStatsCollector::ThreadCounters* counters);
+    bool LookupCachedDigest(const std::filesystem::path& file, const FileMetadata& metadata, HashDigest& outputDigest, BackupStatsCollector::ThreadCounters* counters);
+    bool StageBackupCopy(const BackupFilePlan& plan, const std::filesystem::path& backupFile, std::filesystem::path& outputStagedFile,
+                         BackupStatsCollector::ThreadCounters* counters);
+    bool WriteBackupCopy(const std::filesystem::path& file, const std::filesystem::path& stagedFile, HashDigest* outputDigest) const;
+    bool StageFromResumePoint(const std::filesystem::path& file, const std::string& relativeKey, const FileStateRecord& storedRecord, bool hasRecord,
+                              const FileMetadata& metadata, const std::filesystem::path& stagedFile, HashDigest& outputDigest,
+                              BackupStatsCollector::ThreadCounters* counters);
+    bool StageWithCheckpoints(const std::filesystem::path& file, const std::string& relativeKey, const FileMetadata& metadata,
+                              const std::filesystem::path& stagedFile, HashDigest& outputDigest, BackupStatsCollector::ThreadCounters* counters);
+    bool LinkFromContentStore(const BackupFilePlan& plan, const std::filesystem::path& stagedFile);
+    bool ProtectCopy(const BackupFilePlan& plan, const std::filesystem::path& backupFile) const;
+    bool UploadToStorage(const BackupFilePlan& plan, BackupStatsCollector::ThreadCounters* counters);
+    void RememberDigest(const std::filesystem::path& file, const FileMetadata& metadata, const HashDigest& digest,
+                        BackupStatsCollector::ThreadCounters* counters);
+
     const std::filesystem::path& _backupRoot;
     SnapshotDirectoryProvider& _snapshotDirectory;
-    FileStateRepository& _fileStateRepository;
+    StateLookup _stateLookup;
+    FileStateSink& _stateSink;
     const FileHasher& _fileHasher;
-    const TimestampProvider& _timestampProvider;
-    std::function<void(const BackupProgress&)> _onProgress;
+    HashCache* _hashCache;
+    const DigestAttributeCache* _digestAttributes;
+    const FileCopier& _fileCopier;
+    DirectoryCache& _directoryCache;
+    const ContentObjectStore* _contentStore;
+    const ChunkStore* _chunkStore;
+    const FileDelta* _fileDelta;
+    const FileCompressor* _fileCompressor;
+    const FileEncryptor* _fileEncryptor;
+    PackWriterThread* _packWriter;
+    const MoveDetector* _moveDetector;
+    StorageBackend* _storage;
+    const RunContext& _runContext;
+    ProgressReporter* _progressReporter;
+    BackupStatsCollector* _statsCollector;
     std::atomic<bool>& _success;
-    std::atomic<std::size_t>& _processedCount;
+    bool _paranoid;
+    bool _extendedAttributes;
+    bool _resumeAppends;
+    SampledCheckPolicy _sampledCheck;
+    CopyCheckpointStore* _copyCheckpoints;
+    std::uint64_t _copyCheckpointInterval;
+    TrashQueue* _trashQueue;
+    ParityPolicy _parity;
+    const PathFilter* _limits;
+    RelativePathBuilder _pathBuilder;
+
+    std::mutex _scratchMutex;
+    std::unordered_map<std::thread::id, std::unique_ptr<WorkerScratch>> _scratch;
 };
@@ -1,103 +1,376 @@
 #include "ProcessDeletedFiles.hpp"
 
-#include <vector>
+#include "Instrumentation/Instrumentation.hpp"
+
+#include <algorithm>
+#include <string>
+#include <utility>
 
 namespace
 {
-constexpr std::size_t UnknownProcessedCount = 0;
-constexpr std::size_t UnknownTotalCount = 0;
+/**
+ * @brief Candidates queued ahead of the deletion workers before the scan blocks.
+ */
+constexpr std::size_t DeletionQueueDepth = 4096;
+/**
+ * @brief Known deletions whose snapshot directories are created together before they are queued.
+ */
+constexpr std::size_t PrecreatedBatchFiles = 256;
 }
 
-ProcessDeletedFiles::ProcessDeletedFiles(const std::filesystem::path& sourceFolderPath, const std::filesystem::path& backupFolderPath,
+ProcessDeletedFiles::ProcessDeletedFiles(const RelativePathBuilder& sourceKeys, const std::filesystem::path& backupFolderPath,
                                          SnapshotDirectoryProvider& snapshotDirectory, FileStateRepository& fileStateRepository,
-                                         const TimestampProvider& timestampProvider,
-                                         const std::function<void(const BackupProgress&)>& onProgress)
-    : _sourceFolderPath(sourceFolderPath), _backupFolderPath(backupFolderPath), _snapshotDirectory(snapshotDirectory),
-      _fileStateRepository(fileStateRepository), _timestampProvider(timestampProvider), _onProgress(onProgress)
+                                         const FileCopier& fileCopier, DirectoryCache& directoryCache, const ChunkStore* chunkStore,
+                                         const FileCompressor* fileCompressor, StorageBackend* storage,
+                                         const RunContext& runContext,
+                                         ProgressReporter* progressReporter, BackupStatsCollector* statsCollector,
+                                         unsigned int threadCount, std::size_t batchSize, DurabilityBarrier* durabilityBarrier,
+                                         TrashQueue* trashQueue)
+    : _sourceKeys(sourceKeys), _backupFolderPath(backupFolderPath), _snapshotDirectory(snapshotDirectory),
+      _fileStateRepository(fileStateRepository), _fileCopier(fileCopier), _directoryCache(directoryCache), _chunkStore(chunkStore),
+      _fileCompressor(fileCompressor), _storage(storage), _runContext(runContext), _progressReporter(progressReporter),
+      _statsCollector(statsCollector), _threadCount(std::max(1U, threadCount)), _batchSize(batchSize),
+      _durabilityBarrier(durabilityBarrier), _trashQueue(trashQueue),
+      _submissionsSucceeded(true)
 {
 }
 
 bool ProcessDeletedFiles::Execute()
 {
+    return ArchiveInParallel(true,
+                             [this](const std::function<bool(const std::string&)>& submit)
+                             {
+                                 return _fileStateRepository.ForEachFileStatus([&submit](const FileStatusEntry& entry)
+                                                                               { return (ChangeType::Deleted == entry.status) || submit(entry.path); });
+                             });
+}
+
+bool ProcessDeletedFiles::ExecuteUnseen()
+{
+    return ArchiveInParallel(false, [this](const std::function<bool(const std::string&)>& submit)
+                             { return _fileStateRepository.ForEachUnseenFilePath(submit); });
+}
+
+bool ProcessDeletedFiles::ExecuteUnseenIn(const std::vector<ChangedDirectory>& directories)
+{
+    return ArchiveInParallel(false,
+                             [&](const std::function<bool(const std::string&)>& submit)
+                             {
+                                 for (const auto& directory : directories)
+                                 {
+                                     if (false == _fileStateRepository.ForEachUnseenFilePathIn(directory.path, directory.recursive, submit))
+                                     {
+                                         return false;
+                                     }
+                                 }
+                                 return true;
+                             });
+}
+
+/**
+ * @brief Stream candidates onto the worker pool and wait until every one is archived and committed.
+ *
+ * The scan stops early once a worker has failed.
+ *
+ * @param[in] probeSource Archive only candidates missing from the source, instead of all of them
+ * @param[in] scan Lists the candidates
+ * @return true on success, false on error
+ */
+bool ProcessDeletedFiles::ArchiveInParallel(bool probeSource, const CandidateScan& scan)
+{
+    RDEMO_SCOPE("deleted.scan");
+    BackupStatsCollector::ThreadCounters* counters = (nullptr != _statsCollector) ? &_statsCollector->Current() : nullptr;
+    StageTimer scanTimer(counters, BackupStage::DeletionScan);
+    std::atomic<bool> success{true};
+    bool scanned = false;
     try
     {
-        std::error_code errorCode;
+        const std::unique_ptr<ThreadedFileQueue> workers = CreateWorkers(probeSource, success);
+        // Probed candidates may all still exist, so only known deletions get their directories ahead of time.
+        std::vector<std::string> pending;
+        scanned = scan(
+            [&](const std::string& databasePath)
+            {
+                if (true == probeSource)
+                {
+                    workers->Enqueue(databasePath);
+                    return success.load(std::memory_order_relaxed);
+                }
+                pending.push_back(databasePath);
+                if ((PrecreatedBatchFiles <= pending.size()) && (false == EnqueueBatch(*workers, pending)))
+                {
+                    success.store(false);
+                }
+                return success.load(std::memory_order_relaxed);
+            });
+        if ((true == scanned) && (false == EnqueueBatch(*workers, pending)))
+        {
+            success.store(false);
+        }
+        workers->Finalize();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+    return (true == scanned) && (true == success.load());
+}
+
+void ProcessDeletedFiles::StartSubmissions()
+{
+    _submissionsSucceeded.store(true);
+    _submissions = CreateWorkers(false, _submissionsSucceeded);
+}
+
+void ProcessDeletedFiles::Submit(std::vector<std::string> databasePaths)
+{
+    if ((true == _submissionsSucceeded.load(std::memory_order_relaxed)) && (false == EnqueueBatch(*_submissions, databasePaths)))
+    {
+        _submissionsSucceeded.store(false);
+    }
+}
 
-        std::vector<FileStatusEntry> fileEntries;
-        try
+bool ProcessDeletedFiles::FinishSubmissions()
+{
+    if (nullptr == _submissions)
+    {
+        return true;
+    }
+    _submissions->Finalize();
+    _submissions.reset();
+    return _submissionsSucceeded.load();
+}
+
+/**
+ * @brief Create the snapshot directories of a batch of known deletions, then queue the batch and clear it.
+ *
+ * @param[in] workers Worker pool created without source probing
+ * @param[in,out] databasePaths Repository-relative file paths; empty on return
+ * @return true on success, false if the snapshot directories could not be created
+ */
+bool ProcessDeletedFiles::EnqueueBatch(ThreadedFileQueue& workers, std::vector<std::string>& databasePaths)
+{
+    if (false == _snapshotDirectory.CreateParentDirectories(databasePaths, _directoryCache))
+    {
+        return false;
+    }
+    for (const auto& databasePath : databasePaths)
+    {
+        workers.Enqueue(databasePath);
+    }
+    databasePaths.clear();
+    return true;
+}
+
+/**
+ * @brief Start a worker pool that archives candidates and commits each worker's batch when it exits.
+ *
+ * @param[in] probeSource Archive only candidates missing from the source, instead of all of them
+ * @param[in,out] success Cleared by the first failing worker; later candidates are then skipped
+ * @return Worker pool to enqueue candidates on
+ */
+std::unique_ptr<ThreadedFileQueue> ProcessDeletedFiles::CreateWorkers(bool probeSource, std::atomic<bool>& success)
+{
+    return std::make_unique<ThreadedFileQueue>(
+        _threadCount, DeletionQueueDepth,
+        [this, probeSource, &success](const std::filesystem::path& file)
+        {
+            if ((true == success.load(std::memory_order_relaxed)) && (false == ProcessCandidate(file.string(), probeSource)))
+            {
+                success.store(false);
+            }
+        },
+        [this, &success]()
+        {
+            if (false == FlushCurrentThread())
+            {
+                success.store(false);
+            }
+        });
+}
+
+/**
+ * @brief Archive one candidate on the calling worker, unless probing finds it still in the source.
+ *
+ * @param[in] databasePath Repository-relative file path
+ * @param[in] probeSource Check the source for the file first
+ * @return true on success, false on error
+ */
+bool ProcessDeletedFiles::ProcessCandidate(const std::string& databasePath, bool probeSource)
+{
+    RDEMO_SCOPE("deleted.candidate");
+    BackupStatsCollector::ThreadCounters* counters = (nullptr != _statsCollector) ? &_statsCollector->Current() : nullptr;
+    StageTimer scanTimer(counters, BackupStage::DeletionScan);
+    if (true == probeSource)
+    {
+        // A key of a source root no longer backed up counts as deleted.
+        std::filesystem::path sourceFile;
+        std::error_code errorCode;
+        const bool sourceExists = (true == _sourceKeys.BuildSourceLocation(databasePath, sourceFile)) &&
+                                  (true == std::filesystem::exists(sourceFile, errorCode));
+        if ((0 == errorCode.value()) && (true == sourceExists))
         {
-            fileEntries = _fileStateRepository.GetAllFileStatuses();
+            return true;
         }
-        catch (const std::runtime_error&)
+    }
+    return ArchiveDeletedFile(databasePath, probeSource, counters);
+}
+
+/**
+ * @brief Move the current backup of a deleted file into the snapshot and queue it to be marked deleted.
+ *
+ * With a storage backend the move is only queued, and runs as one batch of renames when the batch is flushed.
+ *
+ * @param[in] databasePath Repository-relative file path
+ * @param[in] createParent Create the file's snapshot directory, which was not created with its batch
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true on success, false on error
+ */
+bool ProcessDeletedFiles::ArchiveDeletedFile(const std::string& databasePath, bool createParent, BackupStatsCollector::ThreadCounters* counters)
+{
+    std::error_code errorCode;
+    std::filesystem::path currentFilePath = _backupFolderPath / databasePath;
+
+    const std::filesystem::path* snapshotPath = nullptr;
+    try
+    {
+        snapshotPath = &_snapshotDirectory.GetOrCreate();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+
+    PendingDeletions& batch = CurrentBatch();
+    if (nullptr != _storage)
+    {
+        const std::string backupKey = currentFilePath.generic_string();
+        bool exists = false;
+        if (false == _storage->Exists(backupKey, exists))
         {
             return false;
         }
-
-        bool operationSucceeded = true;
-        for (const auto& entry : fileEntries)
+        if (true == exists)
         {
-            const std::string& databasePath = entry.path;
-            ChangeType fileStatus = entry.status;
+            batch.renames.push_back(StorageRename{backupKey, (*snapshotPath / databasePath).generic_string()});
+        }
+        batch.paths.push_back(databasePath);
+        return (batch.paths.size() < _batchSize) || (true == Flush(batch, counters));
+    }
 
-            if (ChangeType::Deleted == fileStatus)
+    const bool currentExists = std::filesystem::exists(currentFilePath, errorCode);
+    if ((0 == errorCode.value()) && (true == currentExists))
+    {
+        std::filesystem::path archivedPath = *snapshotPath / databasePath;
+        if (true == createParent)
+        {
+            _directoryCache.Ensure(archivedPath.parent_path());
+        }
+        std::filesystem::path manifestPath = archivedPath;
+        manifestPath += ChunkStore::ManifestSuffix;
+        std::filesystem::path compressedPath = archivedPath;
+        compressedPath += FileCompressor::CompressedSuffix;
+        // A copy that vanishes meanwhile was taken over by the file it moved to, which archived it itself.
+        if (((nullptr != _chunkStore) && (true == _chunkStore->Archive(currentFilePath, manifestPath))) ||
+            ((nullptr != _fileCompressor) && (true == _fileCompressor->Compress(currentFilePath, compressedPath))))
+        {
+            if (nullptr != _trashQueue)
             {
-                continue;
+                _trashQueue->Discard(currentFilePath);
             }
-
-            std::filesystem::path sourceFilePath = _sourceFolderPath / databasePath;
-            std::filesystem::path currentFilePath = _backupFolderPath / databasePath;
-
-            errorCode.clear();
-            const bool sourceExists = std::filesystem::exists(sourceFilePath, errorCode);
-            if ((0 != errorCode.value()) || (false == sourceExists))
+            else
             {
-                std::filesystem::path snapshotPath;
-                try
-                {
-                    snapshotPath = _snapshotDirectory.GetOrCreate();
-                }
-                catch (const std::runtime_error&)
-                {
-                    operationSucceeded = false;
-                    break;
-                }
+                std::filesystem::remove(currentFilePath, errorCode);
+            }
+        }
+        else if ((false == _fileCopier.Move(currentFilePath, archivedPath)) && (true == std::filesystem::exists(currentFilePath, errorCode)))
+        {
+            return false;
+        }
+    }
 
-                errorCode.clear();
-                const bool currentExists = std::filesystem::exists(currentFilePath, errorCode);
-                if ((0 == errorCode.value()) && (true == currentExists))
-                {
-                    std::filesystem::path archivedPath = snapshotPath / databasePath;
-                    std::filesystem::create_directories(archivedPath.parent_path(), errorCode);
-                    std::filesystem::copy_file(currentFilePath, archivedPath, std::filesystem::copy_options::overwrite_existing, errorCode);
-                }
+    batch.paths.push_back(databasePath);
+    return (batch.paths.size() < _batchSize) || (true == Flush(batch, counters));
+}
 
-                std::filesystem::remove(currentFilePath, errorCode);
+/**
+ * @brief Commit the calling thread's pending deletions.
+ *
+ * @return true on success, false on error
+ */
+bool ProcessDeletedFiles::FlushCurrentThread()
+{
+    BackupStatsCollector::ThreadCounters* counters = (nullptr != _statsCollector) ? &_statsCollector->Current() : nullptr;
+    return Flush(CurrentBatch(), counters);
+}
 
-                try
-                {
-                    if (false == _fileStateRepository.MarkFileAsDeleted(databasePath, _timestampProvider.NowFilesystemSafe()))
-                    {
-                        operationSucceeded = false;
-                        break;
-                    }
-                }
-                catch (const std::runtime_error&)
-                {
-                    operationSucceeded = false;
-                    break;
-                }
+/**
+ * @brief Get the pending deletions owned by the calling thread, creating them on first use.
+ *
+ * @return Pending deletions of the calling thread
+ */
+ProcessDeletedFiles::PendingDeletions& ProcessDeletedFiles::CurrentBatch()
+{
+    std::lock_guard<std::mutex> lock(_batchesMutex);
+    return _pendingDeletions[std::this_thread::get_id()];
+}
 
-                if (nullptr != _onProgress)
+/**
+ * @brief Mark a batch of archived files deleted in one transaction, count and report them, and empty the batch.
+ *
+ * Queued storage renames run first, side by side, so no file is marked deleted before its copy is archived.
+ *
+ * @param[in,out] batch Archived files and their queued renames
+ * @param[in,out] counters Stats counters of the calling thread, nullptr without stats
+ * @return true on success, false on error
+ */
+bool ProcessDeletedFiles::Flush(PendingDeletions& batch, BackupStatsCollector::ThreadCounters* counters)
+{
+    RDEMO_SCOPE("deleted.flush");
+    RDEMO_COUNT("deleted.flush.files", batch.paths.size());
+    if (true == batch.paths.empty())
+    {
+        return true;
+    }
+    if ((false == batch.renames.empty()) && (false == _storage->RenameBatch(std::move(batch.renames)).get()))
+    {
+        batch.paths.clear();
+        batch.renames.clear();
+        return false;
+    }
+    batch.renames.clear();
+    bool marked = false;
+    try
+    {
+        StageTimer databaseTimer(counters, BackupStage::Database);
+        marked = ((nullptr == _durabilityBarrier) || (true == _durabilityBarrier->Sync())) &&
+                 (true == _fileStateRepository.MarkFilesAsDeleted(batch.paths, _runContext.Timestamp()));
+    }
+    catch (const std::runtime_error&)
+    {
+        marked = false;
+    }
+    if (true == marked)
+    {
+        if (nullptr != counters)
+        {
+            BackupStatsCollector::Add(counters->filesByChange[static_cast<std::size_t>(ChangeType::Deleted)], batch.paths.size());
+            if (nullptr != counters->changeLog)
+            {
+                for (const auto& databasePath : batch.paths)
                 {
-                    _onProgress({"deleted", UnknownProcessedCount, UnknownTotalCount, databasePath});
+                    counters->changeLog->Record(ChangeType::Deleted, databasePath, 0);
                 }
             }
         }
-
-        return operationSucceeded;
-    }
-    catch (const std::runtime_error&)
-    {
-        return false;
+        if (nullptr != _progressReporter)
+        {
+            for (const auto& databasePath : batch.paths)
+            {
+                _progressReporter->Report("deleted", databasePath, 0);
+            }
+        }
     }
+    batch.paths.clear();
+    return marked;
 }
@@ -1,15 +1,41 @@
 #pragma once
 
+#include "BackupStatsCollector.hpp"
 #include "BackupUtility/BackupUtility.hpp"
+#include "ChangeJournal.hpp"
+#include "ChunkStore.hpp"
+#include "DurabilityBarrier.hpp"
+#include "FileCompressor/FileCompressor.hpp"
+#include "FileCopier/DirectoryCache.hpp"
+#include "FileCopier/FileCopier.hpp"
 #include "FileStateRepository.hpp"
+#include "ProgressReporter.hpp"
+#include "RelativePathBuilder.hpp"
 #include "SnapshotDirectoryProvider/SnapshotDirectoryProvider.hpp"
-#include "TimestampProvider/TimestampProvider.hpp"
+#include "StorageBackend/StorageBackend.hpp"
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+#include "TimestampProvider/RunContext.hpp"
+#include "TrashQueue.hpp"
 
+#include <atomic>
+#include <cstddef>
 #include <filesystem>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 /**
  * @brief Application component for handling files deleted from the source directory.
+ *
+ * Candidates are streamed from the repository onto a pool of worker threads, which probe the source,
+ * archive the backup copy and queue the file on their own pending batch. Each batch is marked deleted in
+ * one transaction once it holds the batch size, and when its worker exits. Files found deleted during the
+ * walk are submitted to a second pool of the same kind, which runs alongside the backup. Where every
+ * candidate is known to be deleted, the snapshot directories of a batch are created before it is queued.
  */
 class ProcessDeletedFiles
 {
@@ -17,30 +43,125 @@ class ProcessDeletedFiles
     /**
      * @brief Construct a processor for deleted files.
      *
-     * @param[in] sourceFolderPath Source root for file existence checks
+     * @param[in] sourceKeys Mapping of state keys to source locations for file existence checks
      * @param[in] backupFolderPath Backup root for current file versions
      * @param[in] snapshotDirectory Provider for snapshot directories
      * @param[in] fileStateRepository Repository for file state tracking
-     * @param[in] timestampProvider Timestamp provider
-     * @param[in] onProgress Progress callback
+     * @param[in] fileCopier File copying utility
+     * @param[in,out] directoryCache Directories of the run known to exist, shared with the other workers
+     * @param[in] chunkStore Store deleted files are archived into as chunk manifests, nullptr archives plain files
+     * @param[in] fileCompressor Compressor for deleted files archived whole, nullptr archives them uncompressed
+     * @param[in] storage Backend the backup copies are renamed in, the roots then being key prefixes; nullptr moves files on disk
+     * @param[in] runContext Run whose timestamp is recorded for every file it changes
+     * @param[in] progressReporter Reporter archived files are counted in, nullptr reports nothing
+     * @param[in] statsCollector Collector of run measurements, nullptr without stats
+     * @param[in] threadCount Worker threads probing and archiving candidates, 0 uses one
+     * @param[in] batchSize Files marked deleted per transaction, 0 or 1 commits each file
+     * @param[in] durabilityBarrier Barrier synced before each batch is marked deleted so rows only refer to durable archives, nullptr marks without syncing
+     * @param[in] trashQueue Queue the backup copies of archived files are discarded through, nullptr removes them on the worker thread
      */
-    ProcessDeletedFiles(const std::filesystem::path& sourceFolderPath, const std::filesystem::path& backupFolderPath,
+    ProcessDeletedFiles(const RelativePathBuilder& sourceKeys, const std::filesystem::path& backupFolderPath,
               SnapshotDirectoryProvider& snapshotDirectory,
-                        FileStateRepository& fileStateRepository, const TimestampProvider& timestampProvider,
-                        const std::function<void(const BackupProgress&)>& onProgress);
+                        FileStateRepository& fileStateRepository, const FileCopier& fileCopier, DirectoryCache& directoryCache,
+                        const ChunkStore* chunkStore,
+                        const FileCompressor* fileCompressor, StorageBackend* storage,
+                        const RunContext& runContext,
+                        ProgressReporter* progressReporter, BackupStatsCollector* statsCollector, unsigned int threadCount,
+                        std::size_t batchSize, DurabilityBarrier* durabilityBarrier, TrashQueue* trashQueue = nullptr);
 
     /**
      * @brief Process files that no longer exist in the source directory.
      *
+     * Probes the filesystem for every live entry; used when the walk did not visit the whole tree.
+     *
      * @return true on success, false on error
      */
     bool Execute();
 
+    /**
+     * @brief Process files that the current run generation did not see.
+     *
+     * Only valid after a complete walk of the source directory; no filesystem probing is done.
+     *
+     * @return true on success, false on error
+     */
+    bool ExecuteUnseen();
+
+    /**
+     * @brief Process files below the changed directories that the current run generation did not see.
+     *
+     * Only valid after every existing directory of the list was listed completely, recursively where marked.
+     *
+     * @param[in] directories Directories taken from the change journal
+     * @return true on success, false on error
+     */
+    bool ExecuteUnseenIn(const std::vector<ChangedDirectory>& directories);
+
+    /**
+     * @brief Start the worker pool for files found deleted while the backup is still running.
+     */
+    void StartSubmissions();
+
+    /**
+     * @brief Queue a batch of files known to be deleted from the source for archiving; thread-safe.
+     *
+     * Only valid between StartSubmissions() and FinishSubmissions(). Nothing is queued once a submitted file failed.
+     *
+     * @param[in] databasePaths Repository-relative file paths
+     */
+    void Submit(std::vector<std::string> databasePaths);
+
+    /**
+     * @brief Wait until every submitted file is archived and marked deleted, then stop the pool.
+     *
+     * @return true if every submitted file was processed, false on error
+     */
+    bool FinishSubmissions();
+
   private:
-    const std::filesystem::path& _sourceFolderPath;
+    /**
+     * @brief Lists candidates, handing each repository-relative path to a submit function that returns false to stop.
+     */
+    using CandidateScan = std::function<bool(const std::function<bool(const std::string&)>&)>;
+
+    /**
+     * @brief Archived files of one worker not yet marked deleted.
+     */
+    struct PendingDeletions
+    {
+        std::vector<std::string> paths;      /**< Repository-relative file paths */
+        std::vector<StorageRename> renames;  /**< Backup copies still to be moved into the snapshot, with a storage backend */
+    };
+
+    bool ArchiveInParallel(bool probeSource, const CandidateScan& scan);
+    bool EnqueueBatch(ThreadedFileQueue& workers, std::vector<std::string>& databasePaths);
+    std::unique_ptr<ThreadedFileQueue> CreateWorkers(bool probeSource, std::atomic<bool>& success);
+    bool ProcessCandidate(const std::string& databasePath, bool probeSource);
+    bool ArchiveDeletedFile(const std::string& databasePath, bool createParent, BackupStatsCollector::ThreadCounters* counters);
+    bool FlushCurrentThread();
+    PendingDeletions& CurrentBatch();
+    bool Flush(PendingDeletions& batch, BackupStatsCollector::ThreadCounters* counters);
+
+    const RelativePathBuilder& _sourceKeys;
     const std::filesystem::path& _backupFolderPath;
     SnapshotDirectoryProvider& _snapshotDirectory;
     FileStateRepository& _fileStateRepository;
-    const TimestampProvider& _timestampProvider;
-    std::function<void(const BackupProgress&)> _onProgress;
+    const FileCopier& _fileCopier;
+    DirectoryCache& _directoryCache;
+    const ChunkStore* _chunkStore;
+    const FileCompressor* _fileCompressor;
+    StorageBackend* _storage;
+    const RunContext& _runContext;
+    ProgressReporter* _progressReporter;
+    BackupStatsCollector* _statsCollector;
+    unsigned int _threadCount;
+    std::size_t _batchSize;
+    DurabilityBarrier* _durabilityBarrier;
+    TrashQueue* _trashQueue;
+
+    std::mutex _batchesMutex;
+    std::unordered_map<std::thread::id, PendingDeletions> _pendingDeletions;
+
+    std::atomic<bool> _submissionsSucceeded;
+    std::unique_ptr<ThreadedFileQueue> _submissions;
 };
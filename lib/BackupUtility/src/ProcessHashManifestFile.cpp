@@ -0,0 +1,148 @@
+// file ProcessHashManifestFile.cpp:
+
+#include "ProcessHashManifestFile.hpp"
+#include "DigestAttributeCache.hpp"
+#include "HashCache.hpp"
+
+#include "FileHasher/FileHasher.hpp"
+
+#include <utility>
+
+ProcessHashManifestFile::ProcessHashManifestFile(const RelativePathBuilder& sourceKeys, const FileHasher& fileHasher, HashCache* hashCache,
+                                                 const DigestAttributeCache* digestAttributes, std::ostream& output)
+    : _sourceKeys(sourceKeys), _fileHasher(fileHasher), _hashCache(hashCache), _digestAttributes(digestAttributes), _output(output), _files(0),
+      _bytes(0), _cacheHits(0), _failed(0), _nextSequence(0)
+{
+}
+
+bool ProcessHashManifestFile::Execute(const FileWorkItem& item)
+{
+    // The walk stats every file, so the caches are consulted without another syscall.
+    FileMetadata metadata = item.metadata;
+    bool hasMetadata = item.hasMetadata;
+    if ((false == hasMetadata) && ((nullptr != _hashCache) || (nullptr != _digestAttributes)))
+    {
+        hasMetadata = ReadFileMetadata(item.path, metadata);
+    }
+
+    std::string key;
+    HashDigest digest{};
+    bool listed = _sourceKeys.BuildKey(item.path, key);
+    if (true == listed)
+    {
+        if ((true == hasMetadata) && (true == LookupCachedDigest(item.path, metadata, digest)))
+        {
+            _cacheHits.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            listed = _fileHasher.Compute(item.path, digest);
+            if ((true == listed) && (true == hasMetadata))
+            {
+                RememberDigest(item.path, metadata, digest);
+            }
+        }
+    }
+
+    std::string line;
+    if (true == listed)
+    {
+        const std::uint64_t size = (true == hasMetadata) ? metadata.size : item.costHint;
+        line = std::to_string(size);
+        line += ',';
+        line += digest.ToHex();
+        line += ',';
+        line += key;
+        line += '\n';
+        _files.fetch_add(1, std::memory_order_relaxed);
+        _bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    else
+    {
+        _failed.fetch_add(1, std::memory_order_relaxed);
+    }
+    Write(item.attachment.get(), std::move(line));
+    return listed;
+}
+
+bool ProcessHashManifestFile::Collect(HashManifestReport& outputReport)
+{
+    outputReport.files = _files.load();
+    outputReport.bytes = _bytes.load();
+    outputReport.cacheHits = _cacheHits.load();
+    outputReport.failed = _failed.load();
+    _output.flush();
+    return (true == _pending.empty()) && (true == _output.good());
+}
+
+/**
+ * @brief Look a file up in the digest attribute on the file and then in the hash cache.
+ *
+ * @param[in] file File to look up
+ * @param[in] metadata Metadata of the file
+ * @param[out] outputDigest Cached digest
+ * @return true if either cache holds a digest for the file, false otherwise
+ */
+bool ProcessHashManifestFile::LookupCachedDigest(const std::filesystem::path& file, const FileMetadata& metadata, HashDigest& outputDigest) const
+{
+    return ((nullptr != _digestAttributes) && (true == _digestAttributes->Lookup(file, metadata, _fileHasher.Algorithm(), outputDigest))) ||
+           ((nullptr != _hashCache) && (true == _hashCache->Lookup(metadata, _fileHasher.Algorithm(), outputDigest)));
+}
+
+/**
+ * @brief Cache the digest of a file that did not change while it was hashed, as ProcessBackupFile does.
+ *
+ * Setting the attribute moves the file's ctime, so the hash cache entry takes the metadata read after it.
+ * Cache errors are ignored.
+ *
+ * @param[in] file Hashed file
+ * @param[in] metadata Metadata captured before hashing
+ * @param[in] digest Digest of the file
+ */
+void ProcessHashManifestFile::RememberDigest(const std::filesystem::path& file, const FileMetadata& metadata, const HashDigest& digest) const
+{
+    FileMetadata currentMetadata{};
+    if (((nullptr == _hashCache) && (nullptr == _digestAttributes)) || (false == ReadFileMetadata(file, currentMetadata)) || (metadata != currentMetadata) ||
+        (metadata.changeTimeNs != currentMetadata.changeTimeNs))
+    {
+        return;
+    }
+    if ((nullptr != _digestAttributes) && (true == _digestAttributes->Store(file, metadata, _fileHasher.Algorithm(), digest)) &&
+        ((false == ReadFileMetadata(file, currentMetadata)) || (metadata != currentMetadata)))
+    {
+        return;
+    }
+    if (nullptr != _hashCache)
+    {
+        _hashCache->Store(currentMetadata, _fileHasher.Algorithm(), digest);
+    }
+}
+
+/**
+ * @brief Write a line, or hold it back until the lines before it in a sorted manifest are written.
+ *
+ * @param[in] attachment ManifestSequence of the file in a sorted manifest, nullptr otherwise
+ * @param[in] line Line to write, empty for a file left out
+ */
+void ProcessHashManifestFile::Write(const WorkItemAttachment* attachment, std::string&& line)
+{
+    const auto* sequence = dynamic_cast<const ManifestSequence*>(attachment);
+    std::lock_guard<std::mutex> lock(_outputMutex);
+    if (nullptr == sequence)
+    {
+        _output.write(line.data(), static_cast<std::streamsize>(line.size()));
+        return;
+    }
+    if (sequence->Value() != _nextSequence)
+    {
+        _pending.emplace(sequence->Value(), std::move(line));
+        return;
+    }
+    _output.write(line.data(), static_cast<std::streamsize>(line.size()));
+    ++_nextSequence;
+    for (auto next = _pending.begin(); (_pending.end() != next) && (next->first == _nextSequence); next = _pending.erase(next))
+    {
+        _output.write(next->second.data(), static_cast<std::streamsize>(next->second.size()));
+        ++_nextSequence;
+    }
+}
@@ -0,0 +1,106 @@
+// file ProcessHashManifestFile.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "RelativePathBuilder.hpp"
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+class DigestAttributeCache;
+class FileHasher;
+class HashCache;
+
+/**
+ * @brief Position of a file in the walk, attached to its work item when the manifest is sorted.
+ */
+class ManifestSequence final : public WorkItemAttachment
+{
+  public:
+    /**
+     * @brief Construct the position of a file.
+     *
+     * @param[in] value Files reported before this one by the ordered walk
+     */
+    explicit ManifestSequence(std::uint64_t value) : _value(value)
+    {
+    }
+
+    /**
+     * @brief Get the position of the file.
+     *
+     * @return Files reported before this one by the ordered walk
+     */
+    std::uint64_t Value() const
+    {
+        return _value;
+    }
+
+  private:
+    std::uint64_t _value;
+};
+
+/**
+ * @brief Application component hashing a single file and writing its manifest line.
+ *
+ * Unordered lines go out as soon as their file is hashed. Sorted lines wait in a reorder buffer until
+ * every file before them in the walk is written; the buffer only grows while a large file holds up the lines behind it.
+ */
+class ProcessHashManifestFile
+{
+  public:
+    /**
+     * @brief Construct a processor writing to an open manifest.
+     *
+     * @param[in] sourceKeys Builds the manifest path of each file
+     * @param[in] fileHasher Hasher of the manifest's algorithm
+     * @param[in] hashCache Digest cache consulted before hashing and refreshed after it, nullptr for none
+     * @param[in] digestAttributes Digest cache on the files themselves, nullptr for none
+     * @param[in,out] output Manifest stream, with the header already written
+     */
+    ProcessHashManifestFile(const RelativePathBuilder& sourceKeys, const FileHasher& fileHasher, HashCache* hashCache,
+                            const DigestAttributeCache* digestAttributes, std::ostream& output);
+
+    ProcessHashManifestFile(const ProcessHashManifestFile&) = delete;
+    ProcessHashManifestFile& operator=(const ProcessHashManifestFile&) = delete;
+
+    /**
+     * @brief Hash one file and write or buffer its line; called concurrently from worker threads.
+     *
+     * @param[in] item Queued file, with a ManifestSequence attachment when the manifest is sorted
+     * @return true if the file was listed, false if it could not be hashed
+     */
+    bool Execute(const FileWorkItem& item);
+
+    /**
+     * @brief Copy the counts into a report; call once no thread runs Execute anymore.
+     *
+     * @param[in,out] outputReport Report whose counts are set
+     * @return true if every line was written, false on a write error
+     */
+    bool Collect(HashManifestReport& outputReport);
+
+  private:
+    bool LookupCachedDigest(const std::filesystem::path& file, const FileMetadata& metadata, HashDigest& outputDigest) const;
+    void RememberDigest(const std::filesystem::path& file, const FileMetadata& metadata, const HashDigest& digest) const;
+    void Write(const WorkItemAttachment* attachment, std::string&& line);
+
+    const RelativePathBuilder& _sourceKeys;
+    const FileHasher& _fileHasher;
+    HashCache* _hashCache;
+    const DigestAttributeCache* _digestAttributes;
+    std::ostream& _output;
+    std::atomic<std::uint64_t> _files;
+    std::atomic<std::uint64_t> _bytes;
+    std::atomic<std::uint64_t> _cacheHits;
+    std::atomic<std::uint64_t> _failed;
+    std::mutex _outputMutex;
+    std::uint64_t _nextSequence;                  /**< Sequence of the next sorted line to write */
+    std::map<std::uint64_t, std::string> _pending; /**< Sorted lines that finished ahead of their turn, empty for failed files */
+};
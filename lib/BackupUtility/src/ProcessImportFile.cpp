@@ -0,0 +1,120 @@
+// file ProcessImportFile.cpp:
+
+#include "ProcessImportFile.hpp"
+
+#include <system_error>
+
+namespace
+{
+constexpr std::int64_t NanosecondsPerSecond = 1000000000;
+}
+
+ProcessImportFile::ProcessImportFile(const std::filesystem::path& importRoot, const std::filesystem::path& backupDirectory,
+                                     const std::filesystem::path& sourceRoot, ImportMethod method, const FileCopier& fileCopier,
+                                     const FileHasher& fileHasher, FileStateBatchWriter& batchWriter, const std::string& timestamp)
+    : _pathBuilder(importRoot), _backupDirectory(backupDirectory), _sourceRoot(sourceRoot), _method(method), _fileCopier(fileCopier),
+      _fileHasher(fileHasher), _batchWriter(batchWriter), _timestamp(timestamp), _files(0), _bytes(0), _matched(0), _skipped(0), _failed(0)
+{
+}
+
+bool ProcessImportFile::Execute(const std::filesystem::path& file)
+{
+    std::string relativeKey;
+    std::filesystem::path destination;
+    if (true == _pathBuilder.BuildKey(file, relativeKey))
+    {
+        RelativePathBuilder::BuildLocation(_backupDirectory, relativeKey, destination);
+    }
+    FileStateRecord record{};
+    // A tar member was unpacked in place, so only mirror files are placed.
+    const bool placed = (false == destination.empty()) && ((destination == file) || (true == Place(file, destination)));
+    if ((false == placed) || (false == ReadFileMetadata(destination, record.metadata)) || (false == _fileHasher.Compute(destination, record.hash)))
+    {
+        _failed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    record.hashAlgorithm = _fileHasher.Algorithm();
+    record.status = ChangeType::Added;
+    record.timestamp = _timestamp;
+    const std::uint64_t size = record.metadata.size;
+    if (true == MatchSource(relativeKey, record.metadata))
+    {
+        _matched.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (false == _batchWriter.Add(relativeKey, record))
+    {
+        _failed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    _files.fetch_add(1, std::memory_order_relaxed);
+    _bytes.fetch_add(size, std::memory_order_relaxed);
+    return true;
+}
+
+void ProcessImportFile::Skip()
+{
+    _skipped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ProcessImportFile::Collect(ImportReport& outputReport) const
+{
+    outputReport.files = _files.load();
+    outputReport.bytes = _bytes.load();
+    outputReport.matched = _matched.load();
+    outputReport.skipped = _skipped.load();
+    outputReport.failed = _failed.load();
+}
+
+/**
+ * @brief Put a mirror file at its place in the backup directory.
+ *
+ * @param[in] file File in the mirror
+ * @param[in] destination Location below the backup directory
+ * @return true on success, false on error
+ */
+bool ProcessImportFile::Place(const std::filesystem::path& file, const std::filesystem::path& destination) const
+{
+    std::error_code ec;
+    std::filesystem::create_directories(destination.parent_path(), ec);
+    switch (_method)
+    {
+    case ImportMethod::Rename:
+        return _fileCopier.Move(file, destination);
+    case ImportMethod::Hardlink:
+        // Across filesystems there is nothing to link to, so the file is cloned or copied like LinkBatch does.
+        std::filesystem::create_hard_link(file, destination, ec);
+        return (0 == ec.value()) || (true == _fileCopier.Copy(file, destination));
+    case ImportMethod::Reflink:
+        return _fileCopier.Copy(file, destination);
+    }
+    return false;
+}
+
+/**
+ * @brief Take over the metadata of the file's source counterpart when it passes rsync's quick check.
+ *
+ * Imported copies have their own identity, so their metadata never equals the source's. A counterpart of
+ * the same size and the same modification time to the second is taken to hold the same content, and its
+ * metadata is recorded instead, which makes the first backup find it unchanged without reading it.
+ *
+ * @param[in] relativeKey Key of the file
+ * @param[in,out] metadata Metadata of the placed file, replaced by the counterpart's on a match
+ * @return true if the counterpart matched, false otherwise
+ */
+bool ProcessImportFile::MatchSource(const std::string& relativeKey, FileMetadata& metadata) const
+{
+    if (true == _sourceRoot.empty())
+    {
+        return false;
+    }
+    std::filesystem::path sourceFile;
+    RelativePathBuilder::BuildLocation(_sourceRoot, relativeKey, sourceFile);
+    FileMetadata sourceMetadata{};
+    if ((false == ReadFileMetadata(sourceFile, sourceMetadata)) || (sourceMetadata.size != metadata.size) ||
+        (sourceMetadata.modificationTimeNs / NanosecondsPerSecond != metadata.modificationTimeNs / NanosecondsPerSecond))
+    {
+        return false;
+    }
+    metadata = sourceMetadata;
+    return true;
+}
@@ -0,0 +1,82 @@
+// file ProcessImportFile.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "FileStateBatchWriter.hpp"
+#include "RelativePathBuilder.hpp"
+#include "FileCopier/FileCopier.hpp"
+#include "FileHasher/FileHasher.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/**
+ * @brief Application component adopting one file of an imported tree into the backup store.
+ *
+ * A file is placed under the backup directory unless it already is there, hashed once and recorded as
+ * added by the import run. Workers call Execute concurrently; each records through its own batch of the
+ * shared batch writer.
+ */
+class ProcessImportFile
+{
+  public:
+    /**
+     * @brief Construct a processor for imported files.
+     *
+     * @param[in] importRoot Root the imported files are keyed relative to, the mirror or the backup directory
+     * @param[in] backupDirectory Directory receiving the files, `backup/` of the store
+     * @param[in] sourceRoot Source the backups will run on, empty records the placed files' own metadata
+     * @param[in] method How files outside the backup directory are placed
+     * @param[in] fileCopier Copier cloning files and copying where a link or rename cannot be made
+     * @param[in] fileHasher Hasher with the algorithm later backups use
+     * @param[in] batchWriter Writer recording the file states
+     * @param[in] timestamp Start of the import run, stamped on every record
+     */
+    ProcessImportFile(const std::filesystem::path& importRoot, const std::filesystem::path& backupDirectory, const std::filesystem::path& sourceRoot,
+                      ImportMethod method, const FileCopier& fileCopier, const FileHasher& fileHasher, FileStateBatchWriter& batchWriter,
+                      const std::string& timestamp);
+
+    ProcessImportFile(const ProcessImportFile&) = delete;
+    ProcessImportFile& operator=(const ProcessImportFile&) = delete;
+
+    /**
+     * @brief Place, hash and record one file; called concurrently from worker threads.
+     *
+     * @param[in] file Regular file below the import root
+     * @return true on success, false if the file could not be placed, hashed or recorded
+     */
+    bool Execute(const std::filesystem::path& file);
+
+    /**
+     * @brief Count an entry that is not a regular file and is left out.
+     */
+    void Skip();
+
+    /**
+     * @brief Copy the counts into a report; call once no thread runs Execute anymore.
+     *
+     * @param[in,out] outputReport Report whose counts are set
+     */
+    void Collect(ImportReport& outputReport) const;
+
+  private:
+    bool Place(const std::filesystem::path& file, const std::filesystem::path& destination) const;
+    bool MatchSource(const std::string& relativeKey, FileMetadata& metadata) const;
+
+    RelativePathBuilder _pathBuilder;
+    std::filesystem::path _backupDirectory;
+    std::filesystem::path _sourceRoot;
+    ImportMethod _method;
+    const FileCopier& _fileCopier;
+    const FileHasher& _fileHasher;
+    FileStateBatchWriter& _batchWriter;
+    std::string _timestamp;
+    std::atomic<std::uint64_t> _files;
+    std::atomic<std::uint64_t> _bytes;
+    std::atomic<std::uint64_t> _matched;
+    std::atomic<std::uint64_t> _skipped;
+    std::atomic<std::uint64_t> _failed;
+};
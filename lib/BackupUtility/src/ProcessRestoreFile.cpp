@@ -0,0 +1,82 @@
+// file ProcessRestoreFile.cpp:
+
+#include "ProcessRestoreFile.hpp"
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "ChunkStore.hpp"
+#include "PackStore.hpp"
+
+#include <system_error>
+
+namespace
+{
+constexpr const char* StagedFileSuffix = ".rdemo-partial";
+}
+
+ProcessRestoreFile::ProcessRestoreFile(const std::filesystem::path& backupRoot, const std::filesystem::path& targetRoot,
+                                       const FileCopier& fileCopier, const FileHasher& fileHasher, const FileEncryptor* fileEncryptor,
+                                       const CompressionDictionaries& dictionaries, const std::filesystem::path& databaseFile, bool verify,
+                                       std::atomic<bool>& success)
+    : _backupRoot(backupRoot), _targetRoot(targetRoot), _fileCopier(fileCopier), _fileHasher(fileHasher), _fileEncryptor(fileEncryptor),
+      _dictionaries(dictionaries), _databaseFile(databaseFile), _verify(verify), _success(success)
+{
+}
+
+bool ProcessRestoreFile::Execute(const std::string& relativeKey, const RestoreItem& item) const
+{
+    std::error_code ec;
+    const std::filesystem::path targetFile = _targetRoot / relativeKey;
+    std::filesystem::path stagedFile = targetFile;
+    stagedFile += StagedFileSuffix;
+    std::filesystem::create_directories(targetFile.parent_path(), ec);
+    std::filesystem::remove(stagedFile, ec);
+
+    if ((false == Stage(item, stagedFile)) || (false == _fileCopier.Move(stagedFile, targetFile)))
+    {
+        std::filesystem::remove(stagedFile, ec);
+        _success.store(false);
+        return false;
+    }
+    return true;
+}
+
+bool ProcessRestoreFile::Stage(const RestoreItem& item, const std::filesystem::path& outputPath) const
+{
+    bool restored = Rebuild(item, outputPath);
+    if ((true == restored) && (true == _verify) && (true == item.hasDigest))
+    {
+        HashDigest restoredHash{};
+        restored = (true == _fileHasher.Compute(outputPath, item.hashAlgorithm, restoredHash)) && (restoredHash == item.hash);
+    }
+    return restored;
+}
+
+/**
+ * @brief Write the content of a stored version to a file.
+ *
+ * @param[in] item Stored version
+ * @param[in] outputPath File to create
+ * @return true on success, false on error
+ */
+bool ProcessRestoreFile::Rebuild(const RestoreItem& item, const std::filesystem::path& outputPath) const
+{
+    switch (item.source)
+    {
+    case RestoreSource::Backup:
+    case RestoreSource::Plain:
+        if (true == FileEncryptor::IsEncrypted(item.storedPath))
+        {
+            return (nullptr != _fileEncryptor) && (true == _fileEncryptor->Decrypt(item.storedPath, outputPath));
+        }
+        return _fileCopier.Copy(item.storedPath, outputPath);
+    case RestoreSource::Chunked:
+        return ChunkStore::Restore(_backupRoot / "chunks", item.storedPath, outputPath);
+    case RestoreSource::Compressed:
+        return FileCompressor::Decompress(item.storedPath, outputPath, &_dictionaries);
+    case RestoreSource::Delta:
+        return RestoreDeltaFile(_backupRoot, item.storedPath, outputPath, _databaseFile);
+    case RestoreSource::Packed:
+        return PackStore::Extract(_backupRoot / "packs", item.packLocation, outputPath);
+    }
+    return false;
+}
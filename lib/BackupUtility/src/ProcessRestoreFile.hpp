@@ -0,0 +1,71 @@
+// file ProcessRestoreFile.hpp:
+
+#pragma once
+
+#include "RestorePlanner.hpp"
+#include "FileCompressor/FileCompressor.hpp"
+#include "FileCopier/FileCopier.hpp"
+#include "FileEncryptor/FileEncryptor.hpp"
+#include "FileHasher/FileHasher.hpp"
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+
+/**
+ * @brief Application component restoring a single file of a planned tree.
+ */
+class ProcessRestoreFile
+{
+  public:
+    /**
+     * @brief Construct a processor for restored files.
+     *
+     * @param[in] backupRoot Root directory of the backup storage, holding backup/, deleted/, chunks/ and packs/
+     * @param[in] targetRoot Directory the tree is restored into
+     * @param[in] fileCopier Copies plain versions, cloning them where the filesystem supports it
+     * @param[in] fileHasher Rehashes restored files that have a stored digest
+     * @param[in] fileEncryptor Decrypts encrypted backup copies, nullptr fails them instead of restoring ciphertext
+     * @param[in] dictionaries Dictionaries of compressed versions, loaded from databaseFile
+     * @param[in] databaseFile Backup database, for the dictionaries of compressed delta bases
+     * @param[in] verify Compare restored files with their stored digest
+     * @param[in,out] success Shared success flag, cleared when a file fails
+     */
+    ProcessRestoreFile(const std::filesystem::path& backupRoot, const std::filesystem::path& targetRoot, const FileCopier& fileCopier,
+                       const FileHasher& fileHasher, const FileEncryptor* fileEncryptor, const CompressionDictionaries& dictionaries,
+                       const std::filesystem::path& databaseFile, bool verify, std::atomic<bool>& success);
+
+    /**
+     * @brief Restore one file.
+     *
+     * The version is rebuilt into a staging file next to its target and renamed into place once it is
+     * complete and verified, so an interrupted or failed restore never leaves a partial file at the target.
+     *
+     * @param[in] relativeKey Path of the file relative to the source root
+     * @param[in] item Stored version of the file
+     * @return true on success, false on error
+     */
+    bool Execute(const std::string& relativeKey, const RestoreItem& item) const;
+
+    /**
+     * @brief Rebuild one version into a file and check it against its stored digest, leaving it there.
+     *
+     * @param[in] item Stored version of the file
+     * @param[in] outputPath File to create or replace
+     * @return true if the version was rebuilt and, when verifying, matches its digest, false otherwise
+     */
+    bool Stage(const RestoreItem& item, const std::filesystem::path& outputPath) const;
+
+  private:
+    bool Rebuild(const RestoreItem& item, const std::filesystem::path& outputPath) const;
+
+    const std::filesystem::path& _backupRoot;
+    const std::filesystem::path& _targetRoot;
+    const FileCopier& _fileCopier;
+    const FileHasher& _fileHasher;
+    const FileEncryptor* _fileEncryptor;
+    const CompressionDictionaries& _dictionaries;
+    const std::filesystem::path& _databaseFile;
+    bool _verify;
+    std::atomic<bool>& _success;
+};
@@ -0,0 +1,184 @@
+// file ProcessVerifyFile.cpp:
+
+#include "ProcessVerifyFile.hpp"
+
+#include "ParityFile.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+ProcessVerifyFile::ProcessVerifyFile(const FileHasher& fileHasher, const std::filesystem::path& packRoot, const FileEncryptor* fileEncryptor,
+                                     IoThrottle* throttle, const std::filesystem::path& parityRoot)
+    : _fileHasher(fileHasher), _packRoot(packRoot), _fileEncryptor(fileEncryptor), _throttle(throttle), _parityRoot(parityRoot), _files(0), _bytes(0)
+{
+}
+
+bool ProcessVerifyFile::Execute(const std::string& reportedPath, const VerifyItem& item)
+{
+    _files.fetch_add(1, std::memory_order_relaxed);
+    if (true == item.packed)
+    {
+        return ExecutePacked(reportedPath, item);
+    }
+    std::error_code ec;
+    const std::uintmax_t size = std::filesystem::file_size(item.storedPath, ec);
+    if (0 != ec.value())
+    {
+        Report(reportedPath, (true == std::filesystem::exists(item.storedPath, ec)) ? VerifyIssueType::Unreadable : VerifyIssueType::Missing);
+        return false;
+    }
+
+    HashDigest storedHash{};
+    if (true == FileEncryptor::IsEncrypted(item.storedPath))
+    {
+        // A segment failing authentication was modified, which is reported like a digest mismatch.
+        bool authentic = true;
+        if (false == HashEncrypted(item, storedHash, authentic))
+        {
+            Report(reportedPath, (true == authentic) ? VerifyIssueType::Unreadable : VerifyIssueType::Mismatch);
+            return false;
+        }
+    }
+    else if (false == _fileHasher.Compute(item.storedPath, item.hashAlgorithm, storedHash))
+    {
+        Report(reportedPath, VerifyIssueType::Unreadable);
+        return false;
+    }
+    _bytes.fetch_add(size, std::memory_order_relaxed);
+    if (storedHash != item.hash)
+    {
+        // Encrypted copies have no parity, since equal contents differ in their stored bytes.
+        const auto matches = [&]() { return (true == _fileHasher.Compute(item.storedPath, item.hashAlgorithm, storedHash)) && (storedHash == item.hash); };
+        if ((false == FileEncryptor::IsEncrypted(item.storedPath)) &&
+            (true == Repair(reportedPath, item.storedPath, ParityFile::ContentPath(_parityRoot, item.hash), matches)))
+        {
+            return true;
+        }
+        Report(reportedPath, VerifyIssueType::Mismatch);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Verify a content stored in a pack segment or inline in the pack index.
+ *
+ * @param[in] reportedPath Path of the file relative to the backup root
+ * @param[in] item Packed content and its recorded digest
+ * @return true if the content matches its digest, false otherwise
+ */
+bool ProcessVerifyFile::ExecutePacked(const std::string& reportedPath, const VerifyItem& item)
+{
+    std::error_code ec;
+    if ((PackStore::InlineSegment != item.packLocation.segment) && (false == std::filesystem::exists(PackStore::SegmentPath(_packRoot, item.packLocation.segment), ec)))
+    {
+        Report(reportedPath, VerifyIssueType::Missing);
+        return false;
+    }
+    std::vector<std::uint8_t> content;
+    if (false == PackStore::Read(_packRoot, item.packLocation, content, _throttle))
+    {
+        Report(reportedPath, VerifyIssueType::Unreadable);
+        return false;
+    }
+    _bytes.fetch_add(content.size(), std::memory_order_relaxed);
+    if (FileHasher::ComputeBuffer(item.hashAlgorithm, content.data(), content.size()) != item.hash)
+    {
+        // The segment is repaired as a whole; every other damaged content in it is found intact afterwards.
+        const std::filesystem::path segmentPath = PackStore::SegmentPath(_packRoot, item.packLocation.segment);
+        const auto matches = [&]()
+        {
+            return (true == PackStore::Read(_packRoot, item.packLocation, content, _throttle)) &&
+                   (FileHasher::ComputeBuffer(item.hashAlgorithm, content.data(), content.size()) == item.hash);
+        };
+        if ((PackStore::InlineSegment != item.packLocation.segment) &&
+            (true == Repair(reportedPath, segmentPath, ParityFile::SegmentPath(_parityRoot, segmentPath), matches)))
+        {
+            return true;
+        }
+        Report(reportedPath, VerifyIssueType::Mismatch);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Hash the decrypted content of an encrypted stored file.
+ *
+ * @param[in] item Stored file and its recorded digest
+ * @param[out] outputDigest Digest of the decrypted content
+ * @param[out] outputAuthentic Cleared when the file opened but a segment failed authentication
+ * @return true on success, false without an encryptor, on a read error or on a failed segment
+ */
+bool ProcessVerifyFile::HashEncrypted(const VerifyItem& item, HashDigest& outputDigest, bool& outputAuthentic) const
+{
+    outputAuthentic = true;
+    if (nullptr == _fileEncryptor)
+    {
+        return false;
+    }
+    FileEncryptor::Reader reader(*_fileEncryptor, item.storedPath);
+    if (false == reader.IsOpen())
+    {
+        return false;
+    }
+    outputAuthentic = _fileHasher.ComputeStream(
+        item.hashAlgorithm, [&reader](std::uint8_t* buffer, std::size_t capacity, std::size_t& bytesRead) { return reader.Read(buffer, capacity, bytesRead); },
+        outputDigest);
+    return outputAuthentic;
+}
+
+/**
+ * @brief Rebuild a damaged stored file from its parity and check the content again.
+ *
+ * Repairs run one at a time, so a file several items live in, such as a pack segment, is rebuilt once;
+ * the next item waiting for it finds its content intact on the first check.
+ *
+ * @param[in] reportedPath Path of the file relative to the backup root
+ * @param[in] storedFile File to rebuild in place
+ * @param[in] parityFile Its parity
+ * @param[in] matches Reads the content again and compares it with the recorded digest
+ * @return true if the content matches afterwards, false without parity or when the repair fails
+ */
+bool ProcessVerifyFile::Repair(const std::string& reportedPath, const std::filesystem::path& storedFile, const std::filesystem::path& parityFile,
+                               const std::function<bool()>& matches)
+{
+    std::error_code ec;
+    if ((true == _parityRoot.empty()) || (false == std::filesystem::exists(parityFile, ec)))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> repairLock(_repairMutex);
+    std::uint64_t repairedBlocks = 0;
+    if ((false == matches()) && ((false == ParityFile::Repair(storedFile, parityFile, repairedBlocks)) || (false == matches())))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_issuesMutex);
+    _repaired.push_back(reportedPath);
+    return true;
+}
+
+void ProcessVerifyFile::Collect(VerifyReport& outputReport)
+{
+    outputReport.filesVerified = _files.load();
+    outputReport.bytesVerified = _bytes.load();
+    std::lock_guard<std::mutex> lock(_issuesMutex);
+    outputReport.issues = _issues;
+    std::sort(outputReport.issues.begin(), outputReport.issues.end(),
+              [](const VerifyIssue& left, const VerifyIssue& right) { return left.path < right.path; });
+    outputReport.repaired = _repaired;
+    std::sort(outputReport.repaired.begin(), outputReport.repaired.end());
+}
+
+/**
+ * @brief Record a file that failed verification.
+ *
+ * @param[in] reportedPath Path of the file relative to the backup root
+ * @param[in] type What is wrong with it
+ */
+void ProcessVerifyFile::Report(const std::string& reportedPath, VerifyIssueType type)
+{
+    std::lock_guard<std::mutex> lock(_issuesMutex);
+    _issues.push_back(VerifyIssue{reportedPath, type});
+}
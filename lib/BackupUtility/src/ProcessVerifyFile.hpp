@@ -0,0 +1,89 @@
+// file ProcessVerifyFile.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "PackStore.hpp"
+#include "FileEncryptor/FileEncryptor.hpp"
+#include "FileHasher/FileHasher.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class IoThrottle;
+
+/**
+ * @brief One stored file to verify.
+ */
+struct VerifyItem
+{
+    std::filesystem::path storedPath; /**< Stored file under backup/ or deleted/ */
+    std::uint64_t size;               /**< Recorded size in bytes, used as the cost hint */
+    HashDigest hash;                  /**< Recorded digest */
+    HashAlgorithm hashAlgorithm;      /**< Algorithm of hash */
+    bool packed;                      /**< The content is in a pack segment instead of at storedPath */
+    PackLocation packLocation;        /**< Where the packed content is, only set when packed */
+};
+
+/**
+ * @brief Application component rehashing a single stored file against its recorded digest.
+ */
+class ProcessVerifyFile
+{
+  public:
+    /**
+     * @brief Construct a processor for verified files.
+     *
+     * @param[in] fileHasher Hasher reading the stored files, with the verify run's throttle
+     * @param[in] packRoot Directory holding the pack segments
+     * @param[in] fileEncryptor Decrypts encrypted stored files before they are hashed, nullptr reports them as unreadable
+     * @param[in] throttle Rate limiter packed reads are charged to, nullptr reads at full speed
+     * @param[in] parityRoot Directory holding the parity damaged plain copies and pack segments are rebuilt from, empty repairs nothing
+     */
+    ProcessVerifyFile(const FileHasher& fileHasher, const std::filesystem::path& packRoot, const FileEncryptor* fileEncryptor, IoThrottle* throttle,
+                      const std::filesystem::path& parityRoot);
+
+    ProcessVerifyFile(const ProcessVerifyFile&) = delete;
+    ProcessVerifyFile& operator=(const ProcessVerifyFile&) = delete;
+
+    /**
+     * @brief Verify one file; called concurrently from worker threads.
+     *
+     * @param[in] reportedPath Path of the file relative to the backup root, as reported on a problem
+     * @param[in] item Stored file and its recorded digest
+     * @return true if the file matches its digest, after a repair from its parity if it needed one, false otherwise
+     */
+    bool Execute(const std::string& reportedPath, const VerifyItem& item);
+
+    /**
+     * @brief Copy the counts and problems into a report; call once no thread runs Execute anymore.
+     *
+     * @param[in,out] outputReport Report whose counts, issues and repaired files are set
+     */
+    void Collect(VerifyReport& outputReport);
+
+  private:
+    bool ExecutePacked(const std::string& reportedPath, const VerifyItem& item);
+    bool HashEncrypted(const VerifyItem& item, HashDigest& outputDigest, bool& outputAuthentic) const;
+    bool Repair(const std::string& reportedPath, const std::filesystem::path& storedFile, const std::filesystem::path& parityFile,
+                const std::function<bool()>& matches);
+    void Report(const std::string& reportedPath, VerifyIssueType type);
+
+    const FileHasher& _fileHasher;
+    std::filesystem::path _packRoot;
+    const FileEncryptor* _fileEncryptor;
+    IoThrottle* _throttle;
+    std::filesystem::path _parityRoot;
+    std::atomic<std::size_t> _files;
+    std::atomic<std::uint64_t> _bytes;
+    std::mutex _issuesMutex;
+    std::vector<VerifyIssue> _issues;
+    std::vector<std::string> _repaired;
+    std::mutex _repairMutex;
+};
@@ -0,0 +1,151 @@
+// file ProgressReporter.cpp:
+
+#include "ProgressReporter.hpp"
+
+#include <algorithm>
+
+ProgressReporter::ProgressReporter(const std::function<void(const BackupProgress&)>& onProgress, std::chrono::milliseconds interval,
+                                   std::size_t eventCapacity, LiveStatusSegment* statusSegment)
+    : _onProgress(onProgress), _statusSegment(statusSegment), _interval(std::max(std::chrono::milliseconds(1), interval)),
+      _events(((nullptr != onProgress) && (0 != eventCapacity)) ? std::make_unique<BoundedMpscQueue<BackupProgress>>(eventCapacity) : nullptr), _processed(0),
+      _stage(nullptr), _dropped(0), _totalFiles(0), _totalBytes(0), _totalFinal(false), _deliveredProcessed(0), _deliveredTotal(0),
+      _deliveredTotalFinal(false), _stopping(false)
+{
+    if (nullptr != _onProgress)
+    {
+        _reporter = std::thread([this]() { ReporterLoop(); });
+    }
+}
+
+ProgressReporter::~ProgressReporter()
+{
+    Stop();
+}
+
+void ProgressReporter::Begin(const std::filesystem::path& file)
+{
+    if (nullptr != _statusSegment)
+    {
+        _statusSegment->BeginFile(file);
+    }
+}
+
+void ProgressReporter::Report(const char* stage, const std::filesystem::path& file, std::uint64_t bytes)
+{
+    // Stages change a few times per run, so workers mostly only read the shared stage.
+    if (stage != _stage.load(std::memory_order_relaxed))
+    {
+        _stage.store(stage, std::memory_order_relaxed);
+        if (nullptr != _statusSegment)
+        {
+            _statusSegment->SetStage(stage);
+        }
+    }
+    if (nullptr != _statusSegment)
+    {
+        _statusSegment->FinishFile(bytes);
+    }
+    if (nullptr == _onProgress)
+    {
+        return;
+    }
+    const std::size_t processed = _processed.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (nullptr != _events)
+    {
+        // Totals are filled in on delivery, when the reporter thread reads them anyway.
+        BackupProgress event{stage, processed, 0, file, 0, 0, false};
+        if (false == _events->TryPush(event))
+        {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+void ProgressReporter::AddQueued(std::size_t files)
+{
+    if (nullptr != _statusSegment)
+    {
+        _statusSegment->AddQueued(files);
+    }
+}
+
+void ProgressReporter::AddToTotal(std::size_t files, std::uint64_t bytes)
+{
+    _totalFiles.fetch_add(files, std::memory_order_relaxed);
+    _totalBytes.fetch_add(bytes, std::memory_order_relaxed);
+    if (nullptr != _statusSegment)
+    {
+        _statusSegment->AddToTotal(files, bytes);
+    }
+}
+
+void ProgressReporter::MarkTotalFinal()
+{
+    _totalFinal.store(true, std::memory_order_release);
+    if (nullptr != _statusSegment)
+    {
+        _statusSegment->MarkTotalFinal();
+    }
+}
+
+void ProgressReporter::Stop()
+{
+    if (true == _reporter.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_stopMutex);
+            _stopping = true;
+        }
+        _stopCv.notify_one();
+        _reporter.join();
+    }
+}
+
+/**
+ * @brief Reporter thread loop: deliver once per interval, and a last time when stopped.
+ */
+void ProgressReporter::ReporterLoop()
+{
+    std::unique_lock<std::mutex> lock(_stopMutex);
+    while (false == _stopping)
+    {
+        _stopCv.wait_for(lock, _interval, [this]() { return _stopping; });
+        lock.unlock();
+        Deliver();
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Hand the buffered events, or a sample of the counters if they changed, to the callback.
+ */
+void ProgressReporter::Deliver()
+{
+    // Read the final flag first, so totals read after it include everything the pre-scan added.
+    const bool totalFinal = _totalFinal.load(std::memory_order_acquire);
+    const std::size_t total = _totalFiles.load(std::memory_order_relaxed);
+    const std::uint64_t totalBytes = _totalBytes.load(std::memory_order_relaxed);
+    if (nullptr != _events)
+    {
+        BackupProgress event;
+        while (true == _events->TryPop(event))
+        {
+            event.total = total;
+            event.dropped = _dropped.load(std::memory_order_relaxed);
+            event.totalBytes = totalBytes;
+            event.totalFinal = totalFinal;
+            _onProgress(event);
+        }
+        return;
+    }
+
+    const std::size_t processed = _processed.load(std::memory_order_relaxed);
+    if ((processed != _deliveredProcessed) || (total != _deliveredTotal) || (totalFinal != _deliveredTotalFinal))
+    {
+        _deliveredProcessed = processed;
+        _deliveredTotal = total;
+        _deliveredTotalFinal = totalFinal;
+        const char* stage = _stage.load(std::memory_order_relaxed);
+        _onProgress({(nullptr != stage) ? stage : "scanning", processed, total, {}, 0, totalBytes, totalFinal});
+    }
+}
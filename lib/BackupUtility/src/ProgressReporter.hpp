@@ -0,0 +1,115 @@
+// file ProgressReporter.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "LiveStatusSegment.hpp"
+#include "ThreadedFileQueue/BoundedMpscQueue.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Delivers backup progress from a reporter thread so workers never wait on the progress callback.
+ *
+ * Workers only bump atomic counters. The reporter thread samples them at a fixed interval and calls the
+ * callback when they changed. Consumers that need every file get an event ring instead: workers push one
+ * event per file without waiting, the reporter thread drains the ring into the callback, and events that
+ * find the ring full are counted as dropped. Either way the callback runs on the reporter thread only.
+ * Workers also publish into a live status segment when there is one; without a callback no reporter
+ * thread runs.
+ */
+class ProgressReporter
+{
+  public:
+    /**
+     * @brief Start the reporter thread.
+     *
+     * @param[in] onProgress Callback, only ever called from the reporter thread; nullptr only publishes into the segment
+     * @param[in] interval Time between two samples or drains, at least one millisecond
+     * @param[in] eventCapacity Per-file events buffered between drains, 0 reports sampled counters only
+     * @param[in,out] statusSegment Segment the workers publish into, nullptr for none; must outlive the reporter
+     */
+    ProgressReporter(const std::function<void(const BackupProgress&)>& onProgress, std::chrono::milliseconds interval,
+                     std::size_t eventCapacity, LiveStatusSegment* statusSegment);
+    /**
+     * @brief Stop the reporter thread, delivering what is still pending.
+     */
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+    /**
+     * @brief Publish the file the calling worker starts on; never blocks.
+     *
+     * @param[in] file File being processed, only read with a status segment
+     */
+    void Begin(const std::filesystem::path& file);
+
+    /**
+     * @brief Count a processed file; never blocks.
+     *
+     * @param[in] stage Static stage name
+     * @param[in] file Processed file, only copied when per-file events are enabled
+     * @param[in] bytes Size of the file
+     */
+    void Report(const char* stage, const std::filesystem::path& file, std::uint64_t bytes);
+
+    /**
+     * @brief Count files handed to the workers; never blocks.
+     *
+     * @param[in] files Files enqueued
+     */
+    void AddQueued(std::size_t files);
+
+    /**
+     * @brief Add files found by the pre-scan to the reported totals; never blocks.
+     *
+     * @param[in] files Files found
+     * @param[in] bytes Their total size
+     */
+    void AddToTotal(std::size_t files, std::uint64_t bytes);
+
+    /**
+     * @brief Note that the pre-scan has finished, so the totals are exact.
+     */
+    void MarkTotalFinal();
+
+    /**
+     * @brief Deliver what is still pending and join the reporter thread.
+     *
+     * Workers must have stopped reporting before this is called.
+     */
+    void Stop();
+
+  private:
+    void ReporterLoop();
+    void Deliver();
+
+    std::function<void(const BackupProgress&)> _onProgress;
+    LiveStatusSegment* _statusSegment;
+    std::chrono::milliseconds _interval;
+    std::unique_ptr<BoundedMpscQueue<BackupProgress>> _events;
+    std::atomic<std::size_t> _processed;
+    std::atomic<const char*> _stage;
+    std::atomic<std::size_t> _dropped;
+    std::atomic<std::size_t> _totalFiles;
+    std::atomic<std::uint64_t> _totalBytes;
+    std::atomic<bool> _totalFinal;
+    std::size_t _deliveredProcessed;
+    std::size_t _deliveredTotal;
+    bool _deliveredTotalFinal;
+    std::mutex _stopMutex;
+    std::condition_variable _stopCv;
+    bool _stopping;
+    std::thread _reporter;
+};
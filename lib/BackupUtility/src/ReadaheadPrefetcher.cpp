@@ -0,0 +1,137 @@
+// file ReadaheadPrefetcher.cpp:
+
+#include "ReadaheadPrefetcher.hpp"
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+/**
+ * @brief Part of a file counted against the readahead window.
+ *
+ * @param[in] costHint Cost hint of the file's work item
+ * @return Bytes the file occupies in the window
+ */
+std::uint64_t WindowShare(std::uint64_t costHint)
+{
+    return std::min(costHint, ReadaheadPrefetcher::MaxBytesPerFile);
+}
+
+/**
+ * @brief Ask the kernel to read the start of a file into the page cache.
+ *
+ * @param[in] path File to read ahead
+ * @param[in] length Bytes to read ahead
+ */
+void AdviseWillNeed(const std::filesystem::path& path, std::uint64_t length)
+{
+#if defined(POSIX_FADV_WILLNEED)
+    const int fileDescriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (0 <= fileDescriptor)
+    {
+        posix_fadvise(fileDescriptor, 0, static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+        close(fileDescriptor);
+    }
+#else
+    (void)path;
+    (void)length;
+#endif
+}
+}
+
+ReadaheadPrefetcher::ReadaheadPrefetcher(std::uint64_t budgetBytes)
+    : _budgetBytes(budgetBytes), _consumedBytes(0), _waiting(false), _stopRequested(false)
+{
+    _thread = std::thread([this]() { Run(); });
+}
+
+ReadaheadPrefetcher::~ReadaheadPrefetcher()
+{
+    Stop();
+}
+
+void ReadaheadPrefetcher::Submit(std::vector<ReadaheadRequest>&& requests)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& request : requests)
+        {
+            _pending.push_back(std::move(request));
+        }
+    }
+    _condition.notify_one();
+}
+
+void ReadaheadPrefetcher::Consumed(std::uint64_t costHint)
+{
+    const std::uint64_t share = WindowShare(costHint);
+    if (0 == share)
+    {
+        return;
+    }
+    _consumedBytes.fetch_add(share);
+    // Workers take the lock only while the thread waits for room in the window.
+    if (true == _waiting.load())
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _condition.notify_one();
+    }
+}
+
+void ReadaheadPrefetcher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopRequested = true;
+    }
+    _condition.notify_one();
+    if (true == _thread.joinable())
+    {
+        _thread.join();
+    }
+}
+
+/**
+ * @brief Readahead thread: walk the submitted files, keeping the advised bytes within the budget ahead of the workers.
+ */
+void ReadaheadPrefetcher::Run()
+{
+    // Window position of the next file, the shares of every file before it in queue order.
+    std::uint64_t position = 0;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _condition.wait(lock, [this]() { return (true == _stopRequested) || (false == _pending.empty()); });
+        if (true == _stopRequested)
+        {
+            return;
+        }
+        ReadaheadRequest request = std::move(_pending.front());
+        _pending.pop_front();
+
+        const std::uint64_t share = WindowShare(request.costHint);
+        if ((true == request.advise) && (0 != share))
+        {
+            _waiting.store(true);
+            _condition.wait(lock, [&]() { return (true == _stopRequested) || (position + share <= _consumedBytes.load() + _budgetBytes); });
+            _waiting.store(false);
+            if (true == _stopRequested)
+            {
+                return;
+            }
+            // A file the workers have already reached is being read, so advising it would only add a syscall.
+            if (_consumedBytes.load() <= position)
+            {
+                lock.unlock();
+                AdviseWillNeed(request.path, share);
+                lock.lock();
+            }
+        }
+        position += share;
+    }
+}
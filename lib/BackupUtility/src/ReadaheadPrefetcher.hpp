@@ -0,0 +1,87 @@
+// file ReadaheadPrefetcher.hpp:
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief File queued for the workers, as seen by the readahead thread.
+ */
+struct ReadaheadRequest
+{
+    std::filesystem::path path; /**< File to read ahead, empty if it is only counted */
+    std::uint64_t costHint = 0; /**< Cost hint of the file's work item, the file size when it is known */
+    bool advise = false;        /**< The file will be read, so its data is worth fetching */
+};
+
+/**
+ * @brief Thread asking the kernel to read queued files into the page cache before a worker dequeues them.
+ *
+ * The walker hands over every file in the order it queues them, and the workers report each file they
+ * dequeue. The thread follows the queue a bounded number of bytes ahead of the workers: it advises the
+ * first MaxBytesPerFile bytes of each file with POSIX_FADV_WILLNEED, waits while the bytes advised but
+ * not yet dequeued would exceed the budget, and skips files the workers have already passed. Files the
+ * run will not read, such as unchanged ones, are only counted. On platforms without posix_fadvise the
+ * thread counts files without reading anything.
+ */
+class ReadaheadPrefetcher
+{
+  public:
+    /**
+     * @brief Most bytes read ahead of one file; the reader's own sequential readahead takes over from there.
+     */
+    static constexpr std::uint64_t MaxBytesPerFile = 8 * 1024 * 1024;
+
+    /**
+     * @brief Start the readahead thread.
+     *
+     * @param[in] budgetBytes Most bytes advised ahead of the workers
+     */
+    explicit ReadaheadPrefetcher(std::uint64_t budgetBytes);
+
+    /**
+     * @brief Stop the readahead thread, dropping files not advised yet.
+     */
+    ~ReadaheadPrefetcher();
+
+    ReadaheadPrefetcher(const ReadaheadPrefetcher&) = delete;
+    ReadaheadPrefetcher& operator=(const ReadaheadPrefetcher&) = delete;
+
+    /**
+     * @brief Hand over files just queued for the workers; never waits for the readahead thread.
+     *
+     * @param[in,out] requests Files in queue order, moved from
+     */
+    void Submit(std::vector<ReadaheadRequest>&& requests);
+
+    /**
+     * @brief Report a file a worker dequeued, moving the readahead window along.
+     *
+     * @param[in] costHint Cost hint of the dequeued work item
+     */
+    void Consumed(std::uint64_t costHint);
+
+    /**
+     * @brief Stop the readahead thread; later calls do nothing.
+     */
+    void Stop();
+
+  private:
+    void Run();
+
+    const std::uint64_t _budgetBytes;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<ReadaheadRequest> _pending;
+    std::atomic<std::uint64_t> _consumedBytes; /**< Window share of every file dequeued so far */
+    std::atomic<bool> _waiting;                /**< The thread waits for the workers to catch up */
+    bool _stopRequested;
+    std::thread _thread;
+};
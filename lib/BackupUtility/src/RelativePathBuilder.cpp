@@ -0,0 +1,231 @@
+// file RelativePathBuilder.cpp:
+
+#include "RelativePathBuilder.hpp"
+
+#include "SQLite/SQLiteText.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+namespace
+{
+constexpr char KeySeparator = static_cast<char>(std::filesystem::path::preferred_separator);
+
+/**
+ * @brief Check whether a path has a `..` component, which only the filesystem can resolve.
+ *
+ * @param[in] path Path to check
+ * @return true if a component is `..`, false otherwise
+ */
+bool HasParentComponent(const std::filesystem::path& path)
+{
+    const std::filesystem::path parent("..");
+    return std::any_of(path.begin(), path.end(), [&parent](const std::filesystem::path& component) { return parent == component; });
+}
+}
+
+RelativePathBuilder::RelativePathBuilder(const std::filesystem::path& sourceRoot) : _roots{MakeRoot(sourceRoot, std::string())}
+{
+}
+
+RelativePathBuilder::RelativePathBuilder(const std::vector<NamedSourceRoot>& sourceRoots)
+{
+    _roots.reserve(sourceRoots.size());
+    for (const auto& sourceRoot : sourceRoots)
+    {
+        _roots.push_back(MakeRoot(sourceRoot.path, sourceRoot.name));
+    }
+}
+
+bool RelativePathBuilder::BuildKey(const std::filesystem::path& file, std::string& outputKey) const
+{
+    const std::filesystem::path::string_type& filePath = file.native();
+    for (const Root& root : _roots)
+    {
+        const std::size_t prefixLength = root.prefix.size();
+        const bool rootIsSeparator = (1 == prefixLength) && (std::filesystem::path::preferred_separator == root.prefix.front());
+        const std::size_t keyStart = (true == rootIsSeparator) ? prefixLength : (prefixLength + 1);
+        if ((false == root.prefix.empty()) && (keyStart < filePath.size()) && (0 == filePath.compare(0, prefixLength, root.prefix)) &&
+            (std::filesystem::path::preferred_separator == filePath[keyStart - 1]) &&
+            (std::filesystem::path::preferred_separator != filePath[keyStart]))
+        {
+            outputKey.assign(root.name);
+            if (false == root.name.empty())
+            {
+                outputKey.push_back(KeySeparator);
+            }
+            // The tail is converted straight into the key's buffer; a name with no UTF-8 spelling has no key.
+            return SQLiteText::AppendNative(filePath, keyStart, outputKey);
+        }
+    }
+    return BuildKeyFallback(file, outputKey);
+}
+
+bool RelativePathBuilder::BuildDirectoryKey(const std::filesystem::path& directory, std::string& outputKey) const
+{
+    for (const Root& root : _roots)
+    {
+        if (directory.native() == root.path.native())
+        {
+            outputKey = root.name;
+            return true;
+        }
+    }
+    return BuildKey(directory, outputKey);
+}
+
+bool RelativePathBuilder::BuildSourceLocation(const std::string& relativeKey, std::filesystem::path& outputPath) const
+{
+    try
+    {
+        if ((1 == _roots.size()) && (true == _roots.front().name.empty()))
+        {
+            BuildLocation(_roots.front().path, relativeKey, outputPath);
+            return true;
+        }
+        const std::size_t separator = relativeKey.find(KeySeparator);
+        const std::string_view name = std::string_view(relativeKey).substr(0, separator);
+        for (const Root& root : _roots)
+        {
+            if (name == root.name)
+            {
+                outputPath = root.path;
+                if (std::string::npos != separator)
+                {
+                    outputPath /= PathOf(relativeKey.substr(separator + 1));
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+    catch (const std::runtime_error&)
+    {
+        // The key is not valid UTF-8.
+        return false;
+    }
+}
+
+void RelativePathBuilder::BuildLocation(const std::filesystem::path& root, const std::string& relativeKey, std::filesystem::path& outputPath)
+{
+    // Each worker keeps its conversion buffer, so the native spelling of a key costs no allocation per file.
+    thread_local std::filesystem::path::string_type nativeKey;
+    if (false == SQLiteText::AssignNative(relativeKey, nativeKey))
+    {
+        throw std::runtime_error("Key is not valid UTF-8: " + relativeKey);
+    }
+    outputPath = root;
+    outputPath /= nativeKey;
+}
+
+std::string RelativePathBuilder::KeyOf(const std::filesystem::path& relativePath)
+{
+    std::string key;
+    if (false == SQLiteText::AppendNative(relativePath.native(), 0, key))
+    {
+        throw std::runtime_error("Path has no UTF-8 spelling");
+    }
+    return key;
+}
+
+std::filesystem::path RelativePathBuilder::PathOf(const std::string& relativeKey)
+{
+    std::filesystem::path::string_type nativeKey;
+    if (false == SQLiteText::AssignNative(relativeKey, nativeKey))
+    {
+        throw std::runtime_error("Key is not valid UTF-8: " + relativeKey);
+    }
+    return std::filesystem::path(std::move(nativeKey));
+}
+
+/**
+ * @brief Precompute the prefix a root's files start with.
+ *
+ * @param[in] path Root directory
+ * @param[in] name Key namespace of the root, empty for none
+ * @return Root with its prefix
+ */
+RelativePathBuilder::Root RelativePathBuilder::MakeRoot(const std::filesystem::path& path, const std::string& name)
+{
+    Root root{path, path.native(), (true == HasParentComponent(path)) ? std::filesystem::path() : path.lexically_normal(), name};
+    while ((1 < root.prefix.size()) && (std::filesystem::path::preferred_separator == root.prefix.back()))
+    {
+        root.prefix.pop_back();
+    }
+    return root;
+}
+
+/**
+ * @brief Compute a key for a file not spelled below the root.
+ *
+ * Spellings that differ from the root's only in `.` components or repeated separators are related
+ * lexically. Only paths with `..` components, a mix of absolute and relative spellings or a file outside
+ * every root take std::filesystem::relative, which stats every component of both paths to resolve symlinks.
+ * With several roots the file belongs to the first root it is not outside of.
+ *
+ * @param[in] file File to key
+ * @param[out] outputKey Key
+ * @return true on success, false if the file cannot be related to a root
+ */
+bool RelativePathBuilder::BuildKeyFallback(const std::filesystem::path& file, std::string& outputKey) const
+{
+    if (false == HasParentComponent(file))
+    {
+        const std::filesystem::path normalFile = file.lexically_normal();
+        for (const Root& root : _roots)
+        {
+            if ((true == root.normalPath.empty()) || (normalFile.is_absolute() != root.normalPath.is_absolute()))
+            {
+                continue;
+            }
+            const std::filesystem::path relativePath = normalFile.lexically_relative(root.normalPath);
+            if ((false == relativePath.empty()) && (std::filesystem::path("..") != *relativePath.begin()) &&
+                (true == AssignKey(root, file, relativePath, outputKey)))
+            {
+                return true;
+            }
+        }
+    }
+    for (const Root& root : _roots)
+    {
+        std::error_code ec;
+        const std::filesystem::path relativePath = std::filesystem::relative(file, root.path, ec);
+        if ((0 == ec.value()) && (true == AssignKey(root, file, relativePath, outputKey)))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Build a key from a file's path relative to a root.
+ *
+ * @param[in] root Root the path is relative to
+ * @param[in] file File being keyed, whose name keys it when it is the root of a single-root run
+ * @param[in] relativePath Path of the file relative to the root
+ * @param[out] outputKey Key
+ * @return true on success, false if a named root does not contain the file
+ */
+bool RelativePathBuilder::AssignKey(const Root& root, const std::filesystem::path& file, const std::filesystem::path& relativePath, std::string& outputKey)
+{
+    if (true == root.name.empty())
+    {
+        outputKey.clear();
+        return SQLiteText::AppendNative(((std::filesystem::path(".") == relativePath) ? file.filename() : relativePath).native(), 0, outputKey);
+    }
+    const auto firstComponent = relativePath.begin();
+    if ((relativePath.end() != firstComponent) && (std::filesystem::path("..") == *firstComponent))
+    {
+        return false;
+    }
+    outputKey = root.name;
+    if (std::filesystem::path(".") != relativePath)
+    {
+        outputKey.push_back(KeySeparator);
+        return SQLiteText::AppendNative(relativePath.native(), 0, outputKey);
+    }
+    return true;
+}
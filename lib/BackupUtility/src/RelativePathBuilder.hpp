@@ -0,0 +1,123 @@
+// file RelativePathBuilder.hpp:
+
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Source root of a run whose files are keyed under a namespace.
+ */
+struct NamedSourceRoot
+{
+    std::filesystem::path path; /**< Root directory, spelled as the walk starts from it */
+    std::string name;           /**< First key component of the root's files */
+};
+
+/**
+ * @brief Builds state keys and backup locations of source files into caller-owned, reused buffers.
+ *
+ * The walker spells every file below the source root, so a key is a suffix of the file's own path and
+ * is copied out without building temporary paths or touching the filesystem. Files spelled any other way
+ * are related lexically where that is exact, and take the std::filesystem::relative fallback otherwise. Output buffers keep their capacity, so a worker reusing
+ * them reaches a steady state without allocating per file. A run over several roots keys each root's
+ * files below the root's name, so the roots share one key space without colliding.
+ *
+ * Keys are UTF-8 with native separators. On Windows a key is converted from the wide path once, when it
+ * is built, and back once per location; path::string would convert through the ANSI code page on every
+ * call and lose the characters outside it. A wide name with no UTF-8 spelling, such as one holding an
+ * unpaired surrogate, gets no key rather than one that could alias another file's.
+ */
+class RelativePathBuilder
+{
+  public:
+    /**
+     * @brief Construct a builder for files below a source root.
+     *
+     * @param[in] sourceRoot Root path of the source directory
+     */
+    explicit RelativePathBuilder(const std::filesystem::path& sourceRoot);
+
+    /**
+     * @brief Construct a builder for files below several source roots, each keyed below its name.
+     *
+     * @param[in] sourceRoots Roots with distinct names, none of them below another
+     */
+    explicit RelativePathBuilder(const std::vector<NamedSourceRoot>& sourceRoots);
+
+    /**
+     * @brief Compute the state key of a file, its path relative to the source root.
+     *
+     * A file that is the source root itself is keyed by its file name, or by the root's name.
+     *
+     * @param[in] file File below the source root
+     * @param[out] outputKey Key, assigned in place
+     * @return true on success, false if the fallback cannot relate the file to the root or its name has no UTF-8 spelling
+     */
+    bool BuildKey(const std::filesystem::path& file, std::string& outputKey) const;
+
+    /**
+     * @brief Compute the key a directory's files are recorded under.
+     *
+     * @param[in] directory Directory spelled as the walk reached it
+     * @param[out] outputKey Key, empty for the root of a single-root run
+     * @return true on success, false if the directory cannot be related to a root
+     */
+    bool BuildDirectoryKey(const std::filesystem::path& directory, std::string& outputKey) const;
+
+    /**
+     * @brief Compute the source location of a key, the inverse of BuildKey.
+     *
+     * @param[in] relativeKey Key from BuildKey
+     * @param[out] outputPath Location of the file in the source
+     * @return true on success, false if the key names no root of the run or is not valid UTF-8
+     */
+    bool BuildSourceLocation(const std::string& relativeKey, std::filesystem::path& outputPath) const;
+
+    /**
+     * @brief Compute the location of a file below another root from its key.
+     *
+     * @param[in] root Root to place the file under
+     * @param[in] relativeKey Key from BuildKey
+     * @param[out] outputPath root / relativeKey, assigned in place
+     * @throws std::runtime_error if the key is not valid UTF-8
+     */
+    static void BuildLocation(const std::filesystem::path& root, const std::string& relativeKey, std::filesystem::path& outputPath);
+
+    /**
+     * @brief Spell a relative path as a key.
+     *
+     * @param[in] relativePath Path relative to a root
+     * @return UTF-8 key
+     * @throws std::runtime_error if the path has no UTF-8 spelling
+     */
+    static std::string KeyOf(const std::filesystem::path& relativePath);
+
+    /**
+     * @brief Spell a key as a relative path, the inverse of KeyOf.
+     *
+     * @param[in] relativeKey UTF-8 key
+     * @return Relative path
+     * @throws std::runtime_error if the key is not valid UTF-8
+     */
+    static std::filesystem::path PathOf(const std::string& relativeKey);
+
+  private:
+    /**
+     * @brief One source root with its precomputed prefix.
+     */
+    struct Root
+    {
+        std::filesystem::path path;                    /**< Root as passed in */
+        std::filesystem::path::string_type prefix;     /**< Native root without trailing separators */
+        std::filesystem::path normalPath;              /**< Lexically normal root, empty if it has `..` components */
+        std::string name;                              /**< Key namespace, empty for a single-root run */
+    };
+
+    static Root MakeRoot(const std::filesystem::path& path, const std::string& name);
+    bool BuildKeyFallback(const std::filesystem::path& file, std::string& outputKey) const;
+    static bool AssignKey(const Root& root, const std::filesystem::path& file, const std::filesystem::path& relativePath, std::string& outputKey);
+
+    std::vector<Root> _roots;
+};
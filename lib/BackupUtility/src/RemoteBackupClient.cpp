@@ -0,0 +1,572 @@
+#include "RemoteBackupClient.hpp"
+
+#include "FileCompressor/FileCompressor.hpp"
+#include "FileIterator/FileIterator.hpp"
+#include "FileIterator/PathFilter.hpp"
+#include "RelativePathBuilder.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+namespace
+{
+/**
+ * @brief Bytes of framing SendRemoteMessage puts in front of every payload.
+ */
+constexpr std::uint64_t FrameOverhead = 5;
+}
+
+RemoteBackupClient::RemoteBackupClient(const RemoteBackupConfig& config)
+    : _config(config), _hashAlgorithm(FileHasher::DefaultAlgorithm), _compressContent(false), _nextBatchId(0), _finished(false), _failed(false),
+      _filesFailed(false), _bytesHashed(0), _contentBytes(0), _bytesSent(0), _serverReport{}
+{
+}
+
+bool RemoteBackupClient::Run(RemoteBackupReport& outputReport)
+{
+    outputReport = RemoteBackupReport{};
+    std::error_code ec;
+    PathFilter pathFilter;
+    if ((false == std::filesystem::is_directory(_config.sourceDir, ec)) || (false == PathFilter::Compile(_config.filterRules, pathFilter)))
+    {
+        outputReport.error = "Invalid source directory or filter rules";
+        return false;
+    }
+    if (false == _config.hashCacheFile.empty())
+    {
+        _hashCacheSession = std::make_unique<SQLiteSession>(_config.hashCacheFile, SQLitePerformanceProfile::Balanced);
+        _hashCache = std::make_unique<HashCache>(*_hashCacheSession);
+        if (false == _hashCache->InitializeSchema())
+        {
+            outputReport.error = "Failed to open the hash cache";
+            return false;
+        }
+    }
+    if (false == Connect())
+    {
+        outputReport.error = _error;
+        return false;
+    }
+
+    // Every batch has at most one hashing job and its files at most one upload each, so the receiver never
+    // blocks on a full queue; a blocked receiver would stop draining answers while the server waits to send.
+    const unsigned int threadCount = (0 != _config.hashThreads) ? _config.hashThreads : std::max(1u, std::thread::hardware_concurrency());
+    const std::size_t batchSize = std::clamp<std::size_t>(_config.batchSize, 1, RemoteMaxBatchFiles);
+    const std::size_t batchesInFlight = std::max<std::size_t>(1, _config.batchesInFlight);
+    _fileHasher = std::make_unique<FileHasher>(_hashAlgorithm);
+    _hashStage = std::make_unique<PipelineStage<BatchWork>>(threadCount, batchesInFlight, [this](BatchWork& work) { Hash(work); });
+    _uploadStage = std::make_unique<PipelineStage<BatchWork>>(threadCount, batchesInFlight * batchSize, [this](BatchWork& work) { Upload(work); });
+    std::thread receiver([this]() { Receive(); });
+
+    const PathFilter* walkFilter = (true == pathFilter.IsEmpty()) ? nullptr : &pathFilter;
+    const FileIterator iterator(1, false, true, walkFilter, _config.sourceDir);
+    std::vector<ClientFile> batch;
+    bool sending = true;
+    const bool walkComplete = iterator.IterateBatchesWithInfo(_config.sourceDir,
+                                                              [&](std::vector<FileEntry>&& files)
+                                                              {
+                                                                  for (auto& entry : files)
+                                                                  {
+                                                                      if (false == sending)
+                                                                      {
+                                                                          return;
+                                                                      }
+                                                                      ClientFile file{std::move(entry.path), entry.info.metadata};
+                                                                      if ((false == entry.info.hasMetadata) && (false == ReadFileMetadata(file.path, file.metadata)))
+                                                                      {
+                                                                          _filesFailed.store(true);
+                                                                          continue;
+                                                                      }
+                                                                      batch.push_back(std::move(file));
+                                                                      if (batch.size() >= batchSize)
+                                                                      {
+                                                                          sending = SendBatch(batch);
+                                                                      }
+                                                                  }
+                                                              });
+    if ((true == sending) && (false == batch.empty()))
+    {
+        SendBatch(batch);
+    }
+
+    bool failed = false;
+    {
+        std::unique_lock<std::mutex> lock(_batchesMutex);
+        _batchesChanged.wait(lock, [this]() { return (true == _failed) || (true == _batches.empty()); });
+        failed = _failed;
+    }
+    if (false == failed)
+    {
+        _hashStage->Finalize();
+        _uploadStage->Finalize();
+        // The server takes every file a complete walk did not send for deleted, which a file outside the size
+        // and mtime limits is not, so a walk with limits never counts as complete.
+        const bool listedEverything = (true == walkComplete) && (false == pathFilter.NeedsSizeAndTime());
+        RemoteMessageWriter done;
+        done.U8(static_cast<std::uint8_t>(((true == listedEverything) ? RemoteDoneWalkComplete : 0) |
+                                          ((false == _filesFailed.load()) ? RemoteDoneSucceeded : 0)));
+        if (false == Send(RemoteMessage::Done, done.Payload()))
+        {
+            Abort("Connection to the server was lost");
+        }
+        std::unique_lock<std::mutex> lock(_batchesMutex);
+        _batchesChanged.wait(lock, [this]() { return (true == _failed) || (true == _finished); });
+        failed = _failed;
+    }
+    // The receiver is gone before the stages stop, so nothing is queued into a stopped stage.
+    _socket.Shutdown();
+    receiver.join();
+    _hashStage->Finalize();
+    _uploadStage->Finalize();
+
+    outputReport = _serverReport;
+    outputReport.bytesHashed = _bytesHashed.load();
+    outputReport.contentBytes = _contentBytes.load();
+    outputReport.bytesSent = _bytesSent.load();
+    outputReport.error = _error;
+    return (false == failed) && (true == _serverReport.succeeded) && (false == _filesFailed.load());
+}
+
+/**
+ * @brief Connect to the server, say Hello and take the hash algorithm and compression from its Welcome.
+ *
+ * @return true on success, false with _error set otherwise
+ */
+bool RemoteBackupClient::Connect()
+{
+    _socket = TcpSocket::Connect(_config.host, _config.port, 0);
+    if (false == _socket.IsOpen())
+    {
+        _error = "Failed to connect to " + _config.host + ":" + std::to_string(_config.port);
+        return false;
+    }
+    const bool canDecompress = (true == _config.compress) && (true == FileCompressor::IsAvailable());
+    RemoteMessageWriter hello;
+    hello.U32(RemoteProtocolMagic);
+    hello.U16(RemoteProtocolVersion);
+    hello.String(_config.name);
+    hello.U8((true == canDecompress) ? RemoteHelloCompression : 0);
+    RemoteMessage type = RemoteMessage::Error;
+    std::string payload;
+    if ((false == Send(RemoteMessage::Hello, hello.Payload())) || (false == ReceiveRemoteMessage(_socket, type, payload)))
+    {
+        _error = "Connection to the server was lost";
+        return false;
+    }
+
+    RemoteMessageReader reader(payload);
+    if (RemoteMessage::Error == type)
+    {
+        reader.String(_error);
+        return false;
+    }
+    std::uint8_t algorithm = 0;
+    std::uint8_t flags = 0;
+    std::string timestamp;
+    if ((RemoteMessage::Welcome != type) || (false == reader.U8(algorithm)) || (false == reader.U8(flags)) || (false == reader.String(timestamp)) ||
+        (algorithm > static_cast<std::uint8_t>(HashAlgorithm::BLAKE3)))
+    {
+        _error = "Unexpected answer to Hello";
+        return false;
+    }
+    _hashAlgorithm = static_cast<HashAlgorithm>(algorithm);
+    _compressContent = (true == canDecompress) && (0 != (flags & RemoteHelloCompression));
+    return true;
+}
+
+/**
+ * @brief Wait for room in the window of batches in flight, then send a batch and remember its files.
+ *
+ * @param[in,out] files Files of the batch; emptied
+ * @return true on success, false once the run failed
+ */
+bool RemoteBackupClient::SendBatch(std::vector<ClientFile>& files)
+{
+    const RelativePathBuilder sourceKeys(_config.sourceDir);
+    std::vector<ClientFile> listed;
+    std::vector<std::string> keys;
+    listed.reserve(files.size());
+    keys.reserve(files.size());
+    for (auto& file : files)
+    {
+        std::string key;
+        if (false == sourceKeys.BuildKey(file.path, key))
+        {
+            _filesFailed.store(true);
+            continue;
+        }
+        keys.push_back(std::move(key));
+        listed.push_back(std::move(file));
+    }
+    files.clear();
+
+    std::uint32_t batchId = 0;
+    {
+        std::unique_lock<std::mutex> lock(_batchesMutex);
+        const std::size_t batchesInFlight = std::max<std::size_t>(1, _config.batchesInFlight);
+        _batchesChanged.wait(lock, [&]() { return (true == _failed) || (_batches.size() < batchesInFlight); });
+        if (true == _failed)
+        {
+            return false;
+        }
+        batchId = _nextBatchId++;
+    }
+
+    RemoteMessageWriter message;
+    message.U32(batchId);
+    message.U32(static_cast<std::uint32_t>(listed.size()));
+    for (std::size_t index = 0; index < listed.size(); ++index)
+    {
+        const FileMetadata& metadata = listed[index].metadata;
+        message.String(keys[index]);
+        message.U64(metadata.size);
+        message.I64(metadata.modificationTimeNs);
+        message.U64(metadata.inode);
+        message.U64(metadata.device);
+        message.U32(metadata.mode);
+        message.U32(metadata.userId);
+        message.U32(metadata.groupId);
+        message.I64(metadata.accessTimeNs);
+    }
+    // Registered before sending, so the answer always finds its batch; it stays until its Check arrives.
+    {
+        std::lock_guard<std::mutex> lock(_batchesMutex);
+        _batches.emplace(batchId, std::move(listed));
+        _pendingWork[batchId] = 1;
+    }
+    if (false == Send(RemoteMessage::Files, message.Payload()))
+    {
+        Abort("Connection to the server was lost");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Send one message; sends from the walk, the receiver and the workers are serialized here.
+ *
+ * @param[in] type Message type
+ * @param[in] payload Message payload
+ * @return true on success, false once the connection failed
+ */
+bool RemoteBackupClient::Send(RemoteMessage type, const std::string& payload)
+{
+    std::lock_guard<std::mutex> lock(_sendMutex);
+    if (false == SendRemoteMessage(_socket, type, payload))
+    {
+        return false;
+    }
+    _bytesSent.fetch_add(FrameOverhead + payload.size(), std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Receiver thread: dispatch the server's answers until it finished the run or the connection ended.
+ */
+void RemoteBackupClient::Receive()
+{
+    RemoteMessage type = RemoteMessage::Error;
+    std::string payload;
+    while (true == ReceiveRemoteMessage(_socket, type, payload))
+    {
+        RemoteMessageReader reader(payload);
+        if (RemoteMessage::Check == type)
+        {
+            if (false == OnCheck(reader))
+            {
+                return;
+            }
+        }
+        else if (RemoteMessage::Need == type)
+        {
+            if (false == OnNeed(reader))
+            {
+                return;
+            }
+        }
+        else if (RemoteMessage::Finished == type)
+        {
+            std::uint8_t succeeded = 0;
+            RemoteBackupReport report{};
+            bool parsed = reader.U8(succeeded);
+            for (auto& files : report.filesByChange)
+            {
+                std::uint64_t count = 0;
+                parsed = (true == parsed) && (true == reader.U64(count));
+                files = static_cast<std::size_t>(count);
+            }
+            if (false == parsed)
+            {
+                Abort("Malformed Finished message");
+                return;
+            }
+            report.succeeded = (0 != succeeded);
+            std::lock_guard<std::mutex> lock(_batchesMutex);
+            _serverReport = report;
+            _finished = true;
+            _batchesChanged.notify_all();
+            return;
+        }
+        else
+        {
+            std::string message = "Unexpected message from the server";
+            if (RemoteMessage::Error == type)
+            {
+                reader.String(message);
+            }
+            Abort(message);
+            return;
+        }
+    }
+    Abort("Connection to the server was lost");
+}
+
+/**
+ * @brief Queue the hashing of the files the server checks, or complete a batch it needs nothing of.
+ *
+ * @param[in,out] reader Payload of the Check message
+ * @return true on success, false once the run failed
+ */
+bool RemoteBackupClient::OnCheck(RemoteMessageReader& reader)
+{
+    BatchWork work{0, {}, 0};
+    std::uint32_t count = 0;
+    bool known = false;
+    if ((true == reader.U32(work.batchId)) && (true == reader.U32(count)) && (true == reader.Bitmap(count, work.selected)))
+    {
+        std::lock_guard<std::mutex> lock(_batchesMutex);
+        const auto batch = _batches.find(work.batchId);
+        known = (_batches.end() != batch) && (batch->second.size() == count);
+        if ((true == known) && (true == std::any_of(work.selected.begin(), work.selected.end(), [](bool selected) { return selected; })))
+        {
+            ++_pendingWork[work.batchId];
+        }
+        else
+        {
+            work.selected.clear();
+        }
+    }
+    if (false == known)
+    {
+        Abort("Malformed Check message");
+        return false;
+    }
+    if (false == work.selected.empty())
+    {
+        const std::uint32_t batchId = work.batchId;
+        _hashStage->Submit(std::move(work));
+        CompleteWork(batchId, 1);
+        return true;
+    }
+    CompleteWork(work.batchId, 1);
+    return true;
+}
+
+/**
+ * @brief Queue the upload of each file the server needs.
+ *
+ * @param[in,out] reader Payload of the Need message
+ * @return true on success, false once the run failed
+ */
+bool RemoteBackupClient::OnNeed(RemoteMessageReader& reader)
+{
+    std::uint32_t batchId = 0;
+    std::uint32_t count = 0;
+    std::vector<bool> needed;
+    std::size_t neededCount = 0;
+    bool known = false;
+    if ((true == reader.U32(batchId)) && (true == reader.U32(count)) && (true == reader.Bitmap(count, needed)))
+    {
+        std::lock_guard<std::mutex> lock(_batchesMutex);
+        const auto batch = _batches.find(batchId);
+        known = (_batches.end() != batch) && (batch->second.size() == count);
+        neededCount = static_cast<std::size_t>(std::count(needed.begin(), needed.end(), true));
+        _pendingWork[batchId] += (true == known) ? neededCount : 0;
+    }
+    if (false == known)
+    {
+        Abort("Malformed Need message");
+        return false;
+    }
+    for (std::uint32_t index = 0; index < count; ++index)
+    {
+        if (true == needed[index])
+        {
+            _uploadStage->Submit(BatchWork{batchId, {}, index});
+        }
+    }
+    CompleteWork(batchId, 1);
+    return true;
+}
+
+/**
+ * @brief Hashing worker: hash the checked files of a batch and send their digests.
+ *
+ * A file that cannot be read is left out; the server then neither stores nor deletes it, and the run fails.
+ *
+ * @param[in,out] work Batch and the files to hash
+ */
+void RemoteBackupClient::Hash(BatchWork& work)
+{
+    const std::vector<ClientFile>* files = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(_batchesMutex);
+        if (true == _failed)
+        {
+            return;
+        }
+        // The batch is not erased while this work is pending, and map nodes never move.
+        files = &_batches.at(work.batchId);
+    }
+
+    RemoteMessageWriter digests;
+    std::uint32_t count = 0;
+    const std::size_t digestSize = HashAlgorithmDigestSize(_hashAlgorithm);
+    for (std::uint32_t index = 0; index < work.selected.size(); ++index)
+    {
+        if (false == work.selected[index])
+        {
+            continue;
+        }
+        const ClientFile& file = (*files)[index];
+        HashDigest digest{};
+        const bool cached = (nullptr != _hashCache) && (true == _hashCache->Lookup(file.metadata, _hashAlgorithm, digest));
+        if ((false == cached) && (false == _fileHasher->Compute(file.path, digest)))
+        {
+            _filesFailed.store(true);
+            continue;
+        }
+        if (false == cached)
+        {
+            _bytesHashed.fetch_add(file.metadata.size, std::memory_order_relaxed);
+            if (nullptr != _hashCache)
+            {
+                _hashCache->Store(file.metadata, _hashAlgorithm, digest);
+            }
+        }
+        digests.U32(index);
+        digests.U8(static_cast<std::uint8_t>(digestSize));
+        digests.Bytes(digest.bytes.data(), digestSize);
+        ++count;
+    }
+
+    RemoteMessageWriter message;
+    message.U32(work.batchId);
+    message.U32(count);
+    message.Bytes(digests.Payload().data(), digests.Payload().size());
+    {
+        std::lock_guard<std::mutex> lock(_batchesMutex);
+        ++_pendingWork[work.batchId];
+    }
+    if (false == Send(RemoteMessage::Digests, message.Payload()))
+    {
+        Abort("Connection to the server was lost");
+        return;
+    }
+    CompleteWork(work.batchId, 1);
+}
+
+/**
+ * @brief Upload worker: send a needed file in chunks, each compressed when that makes it smaller.
+ *
+ * @param[in,out] work Batch and index of the file
+ */
+void RemoteBackupClient::Upload(BatchWork& work)
+{
+    std::filesystem::path path;
+    {
+        std::lock_guard<std::mutex> lock(_batchesMutex);
+        if (true == _failed)
+        {
+            return;
+        }
+        path = _batches.at(work.batchId)[work.index].path;
+    }
+
+    std::ifstream input(path, std::ios::binary);
+    std::vector<char> chunk(RemoteContentChunkSize);
+    std::vector<std::uint8_t> frame;
+    bool last = false;
+    while (false == last)
+    {
+        std::size_t size = 0;
+        if (true == input.is_open())
+        {
+            input.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            size = static_cast<std::size_t>(input.gcount());
+        }
+        const bool failed = (false == input.is_open()) || (true == input.bad());
+        last = (true == failed) || (true == input.eof());
+
+        RemoteMessageWriter message;
+        message.U32(work.batchId);
+        message.U32(work.index);
+        std::uint8_t flags = (true == last) ? RemoteContentLast : 0;
+        if (true == failed)
+        {
+            // The server drops what it received of the file.
+            _filesFailed.store(true);
+            message.U8(static_cast<std::uint8_t>(flags | RemoteContentFailed));
+            message.U32(0);
+        }
+        else if ((true == _compressContent) && (true == FileCompressor::CompressBuffer(chunk.data(), size, FileCompressorOptions::DefaultLevel, frame)))
+        {
+            message.U8(static_cast<std::uint8_t>(flags | RemoteContentCompressed));
+            message.U32(static_cast<std::uint32_t>(size));
+            message.Bytes(frame.data(), frame.size());
+        }
+        else
+        {
+            message.U8(flags);
+            message.U32(static_cast<std::uint32_t>(size));
+            message.Bytes(chunk.data(), size);
+        }
+        if (false == Send(RemoteMessage::Content, message.Payload()))
+        {
+            Abort("Connection to the server was lost");
+            return;
+        }
+        _contentBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    CompleteWork(work.batchId, 1);
+}
+
+/**
+ * @brief Count off work of a batch; the batch is done, and leaves the window, once none is left.
+ *
+ * @param[in] batchId Batch the work belongs to
+ * @param[in] count Number of pieces of work completed
+ */
+void RemoteBackupClient::CompleteWork(std::uint32_t batchId, std::size_t count)
+{
+    std::lock_guard<std::mutex> lock(_batchesMutex);
+    std::size_t& pending = _pendingWork[batchId];
+    pending -= std::min(pending, count);
+    if (0 == pending)
+    {
+        _pendingWork.erase(batchId);
+        _batches.erase(batchId);
+        _batchesChanged.notify_all();
+    }
+}
+
+/**
+ * @brief Fail the run, keeping the first reason, and end the connection so every thread stops waiting on it.
+ *
+ * @param[in] message Reason of the failure
+ */
+void RemoteBackupClient::Abort(const std::string& message)
+{
+    {
+        std::lock_guard<std::mutex> lock(_batchesMutex);
+        if (true == _failed)
+        {
+            return;
+        }
+        _failed = true;
+        _error = message;
+        _batchesChanged.notify_all();
+    }
+    _socket.Shutdown();
+}
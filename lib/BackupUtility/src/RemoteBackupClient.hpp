@@ -0,0 +1,105 @@
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "FileHasher/FileHasher.hpp"
+#include "FileIterator/FileMetadata.hpp"
+#include "HashCache.hpp"
+#include "PipelineStage.hpp"
+#include "RemoteProtocol.hpp"
+#include "SQLite/SQLiteSession.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Application component pushing a source tree to a remote backup server.
+ *
+ * The walk lists files into batches and sends each batch as soon as it is full, as long as fewer than
+ * the configured number of batches are in flight; it never waits for an answer otherwise. A receiver
+ * thread reads the server's answers and queues the work they ask for: hashing the files whose metadata
+ * changed, then uploading the files whose digest changed. All sends share the connection under one mutex.
+ */
+class RemoteBackupClient
+{
+  public:
+    /**
+     * @brief Construct a client for a configuration.
+     *
+     * @param[in] config Source, server and pipeline settings
+     */
+    explicit RemoteBackupClient(const RemoteBackupConfig& config);
+
+    RemoteBackupClient(const RemoteBackupClient&) = delete;
+    RemoteBackupClient& operator=(const RemoteBackupClient&) = delete;
+
+    /**
+     * @brief Connect, push the source and wait for the server to complete the run.
+     *
+     * @param[out] outputReport Files per change type as counted by the server, and bytes hashed and sent
+     * @return true if the server completed the run successfully, false on error
+     */
+    bool Run(RemoteBackupReport& outputReport);
+
+  private:
+    /**
+     * @brief A listed file of a batch in flight.
+     */
+    struct ClientFile
+    {
+        std::filesystem::path path; /**< Source file */
+        FileMetadata metadata;      /**< Metadata sent with the batch */
+    };
+
+    /**
+     * @brief Work the server asked for: hash the flagged files of a batch, or upload one file.
+     */
+    struct BatchWork
+    {
+        std::uint32_t batchId;      /**< Batch the work belongs to */
+        std::vector<bool> selected; /**< Files to hash, for hashing work */
+        std::uint32_t index;        /**< File to upload, for upload work */
+    };
+
+    bool Connect();
+    bool SendBatch(std::vector<ClientFile>& files);
+    bool Send(RemoteMessage type, const std::string& payload);
+    void Receive();
+    bool OnCheck(RemoteMessageReader& reader);
+    bool OnNeed(RemoteMessageReader& reader);
+    void Hash(BatchWork& work);
+    void Upload(BatchWork& work);
+    void CompleteWork(std::uint32_t batchId, std::size_t count);
+    void Abort(const std::string& message);
+
+    const RemoteBackupConfig& _config;
+    TcpSocket _socket;
+    std::mutex _sendMutex;
+    HashAlgorithm _hashAlgorithm;
+    bool _compressContent;
+    std::unique_ptr<FileHasher> _fileHasher;
+    std::unique_ptr<SQLiteSession> _hashCacheSession;
+    std::unique_ptr<HashCache> _hashCache;
+    std::unique_ptr<PipelineStage<BatchWork>> _hashStage;
+    std::unique_ptr<PipelineStage<BatchWork>> _uploadStage;
+    std::mutex _batchesMutex;
+    std::condition_variable _batchesChanged;
+    std::unordered_map<std::uint32_t, std::vector<ClientFile>> _batches;
+    std::unordered_map<std::uint32_t, std::size_t> _pendingWork;
+    std::uint32_t _nextBatchId;
+    bool _finished;
+    bool _failed;
+    std::atomic<bool> _filesFailed;
+    std::atomic<std::uint64_t> _bytesHashed;
+    std::atomic<std::uint64_t> _contentBytes;
+    std::atomic<std::uint64_t> _bytesSent;
+    RemoteBackupReport _serverReport;
+    std::string _error;
+};
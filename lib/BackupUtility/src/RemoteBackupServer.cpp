@@ -0,0 +1,271 @@
+#include "RemoteBackupServer.hpp"
+
+#include "BackupMetrics.hpp"
+#include "MetricsHttpServer.hpp"
+#include "RemoteBackupSession.hpp"
+#include "RemoteProtocol.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+/**
+ * @brief Longest a session waits for the next message; a client hashing a huge file stays quiet for a while.
+ */
+constexpr unsigned int SessionTimeoutSeconds = 600;
+
+/**
+ * @brief Time between two checks whether a stop was requested.
+ */
+constexpr std::chrono::milliseconds StopPollInterval(100);
+
+/**
+ * @brief Report a refused Hello to the client.
+ *
+ * @param[in,out] socket Connection to the client
+ * @param[in] message Reason
+ */
+void Refuse(TcpSocket& socket, const std::string& message)
+{
+    RemoteMessageWriter error;
+    error.String(message);
+    SendRemoteMessage(socket, RemoteMessage::Error, error.Payload());
+}
+}
+
+RemoteBackupServer::RemoteBackupServer(const ServeConfig& config) : _config(config)
+{
+}
+
+bool RemoteBackupServer::Run(const std::atomic<bool>& stopRequested)
+{
+    if (false == _listener.Listen(_config.listenAddress, _config.port))
+    {
+        return false;
+    }
+    MetricsHttpServer metricsServer([this]() { return RenderMetrics(); });
+    if (false == _config.metricsAddress.empty())
+    {
+        if (false == metricsServer.Start(_config.metricsAddress, _config.metricsPort))
+        {
+            _listener.Close();
+            return false;
+        }
+        if (nullptr != _config.onMetricsListening)
+        {
+            _config.onMetricsListening(metricsServer.Port());
+        }
+    }
+    if (nullptr != _config.onListening)
+    {
+        _config.onListening(_listener.Port());
+    }
+
+    std::atomic<bool> serving{true};
+    std::thread stopWatcher(
+        [&]()
+        {
+            while ((true == serving.load()) && (false == stopRequested.load()))
+            {
+                std::this_thread::sleep_for(StopPollInterval);
+            }
+            _listener.Close();
+        });
+    while (true)
+    {
+        TcpSocket socket = _listener.Accept(SessionTimeoutSeconds);
+        if (false == socket.IsOpen())
+        {
+            break;
+        }
+        JoinFinished(false);
+        auto connection = std::make_unique<Connection>();
+        connection->socket = std::move(socket);
+        connection->done = false;
+        Connection* served = connection.get();
+        connection->thread = std::thread([this, served]() { Serve(*served); });
+        std::lock_guard<std::mutex> lock(_mutex);
+        _connections.push_back(std::move(connection));
+    }
+    const bool stopped = stopRequested.load();
+    serving.store(false);
+    stopWatcher.join();
+
+    // Open sessions see their connection end and record their runs as failed.
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& connection : _connections)
+        {
+            connection->socket.Shutdown();
+        }
+    }
+    JoinFinished(true);
+    return stopped;
+}
+
+/**
+ * @brief Connection thread: read the client's Hello and run its session.
+ *
+ * @param[in,out] connection Connection to serve
+ */
+void RemoteBackupServer::Serve(Connection& connection)
+{
+    RemoteMessage type = RemoteMessage::Error;
+    std::string payload;
+    std::uint32_t magic = 0;
+    std::uint16_t version = 0;
+    std::string name;
+    std::uint8_t flags = 0;
+    if ((true == ReceiveRemoteMessage(connection.socket, type, payload)) && (RemoteMessage::Hello == type))
+    {
+        RemoteMessageReader reader(payload);
+        const bool parsed = (true == reader.U32(magic)) && (true == reader.U16(version)) && (true == reader.String(name)) &&
+                            (true == reader.U8(flags)) && (true == reader.AtEnd());
+        if ((false == parsed) || (RemoteProtocolMagic != magic) || (RemoteProtocolVersion != version))
+        {
+            Refuse(connection.socket, "Unsupported protocol version");
+        }
+        // A name is one directory under the backup root.
+        else if ((false == IsValidRemoteKey(name)) || (std::string::npos != name.find('/')))
+        {
+            Refuse(connection.socket, "Invalid backup name " + name);
+        }
+        else if (false == Reserve(name))
+        {
+            Refuse(connection.socket, "A backup of " + name + " is already running");
+        }
+        else
+        {
+            const unsigned int threadCount = (0 != _config.threads) ? _config.threads : std::max(1u, std::thread::hardware_concurrency());
+            // The name is free again before the client hears the run is over, so it can push again at once.
+            bool released = false;
+            const auto release = [&]()
+            {
+                if (false == released)
+                {
+                    released = true;
+                    RecordRun(name);
+                    Release(name);
+                }
+            };
+            RemoteBackupSession session(connection.socket, _config.backupRoot / name, _config.hashAlgorithm, _config.databaseProfile,
+                                        threadCount, 0 != (flags & RemoteHelloCompression), release);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _metrics[name].session = &session;
+            }
+            session.Run();
+            release();
+        }
+    }
+    connection.socket.Shutdown();
+    std::lock_guard<std::mutex> lock(_mutex);
+    connection.done = true;
+}
+
+/**
+ * @brief Claim a backup name for a session.
+ *
+ * @param[in] name Backup name
+ * @return true if no other session holds the name
+ */
+bool RemoteBackupServer::Reserve(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _activeNames.insert(name).second;
+}
+
+/**
+ * @brief Hand back a name claimed by Reserve.
+ *
+ * @param[in] name Backup name
+ */
+void RemoteBackupServer::Release(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _activeNames.erase(name);
+}
+
+/**
+ * @brief Keep the measurements of a finished run for the metrics endpoint and stop sampling its session.
+ *
+ * Called when the run is recorded, before the client is told, so a scrape after the client finished sees the run.
+ *
+ * @param[in] name Backup name
+ */
+void RemoteBackupServer::RecordRun(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    NameMetrics& metrics = _metrics[name];
+    if (nullptr == metrics.session)
+    {
+        return;
+    }
+    std::uint64_t queuedFiles = 0;
+    metrics.session->Sample(metrics.lastStats, queuedFiles);
+    metrics.lastSucceeded = metrics.session->Succeeded();
+    metrics.session = nullptr;
+    metrics.finished = true;
+    metrics.finishedAt = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Join the threads of finished connections and drop them.
+ *
+ * @param[in] all Wait for every connection, not only the finished ones
+ */
+void RemoteBackupServer::JoinFinished(bool all)
+{
+    std::vector<std::unique_ptr<Connection>> finished;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto it = _connections.begin(); it != _connections.end();)
+        {
+            if ((true == all) || (true == (*it)->done))
+            {
+                finished.push_back(std::move(*it));
+                it = _connections.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+    for (auto& connection : finished)
+    {
+        connection->thread.join();
+    }
+}
+
+/**
+ * @brief Metrics thread: gather the measurements of every backup name seen since the server started.
+ *
+ * @return Exposition text
+ */
+std::string RemoteBackupServer::RenderMetrics()
+{
+    std::vector<BackupMetricsEntry> entries;
+    std::lock_guard<std::mutex> lock(_mutex);
+    entries.reserve(_metrics.size());
+    for (const auto& [name, metrics] : _metrics)
+    {
+        BackupMetricsEntry entry{};
+        entry.backup = name;
+        entry.finished = metrics.finished;
+        entry.lastSucceeded = metrics.lastSucceeded;
+        entry.finishedAt = metrics.finishedAt;
+        entry.running = (nullptr != metrics.session);
+        if (true == entry.running)
+        {
+            metrics.session->Sample(entry.stats, entry.queuedFiles);
+        }
+        else
+        {
+            entry.stats = metrics.lastStats;
+        }
+        entries.push_back(std::move(entry));
+    }
+    return FormatBackupMetrics(entries);
+}
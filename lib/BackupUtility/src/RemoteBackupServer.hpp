@@ -0,0 +1,82 @@
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "TcpSocket/TcpSocket.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+class RemoteBackupSession;
+
+/**
+ * @brief Application component accepting remote backup clients and running a session for each.
+ *
+ * Every connection gets its own thread. A client names the backup it pushes in its Hello; each name
+ * is a directory under the backup root, and only one client at a time may push to it. Each name also
+ * keeps the measurements of its last run for the optional metrics endpoint.
+ */
+class RemoteBackupServer
+{
+  public:
+    /**
+     * @brief Construct a server for a configuration.
+     *
+     * @param[in] config Backup root, listen address and session settings
+     */
+    explicit RemoteBackupServer(const ServeConfig& config);
+
+    RemoteBackupServer(const RemoteBackupServer&) = delete;
+    RemoteBackupServer& operator=(const RemoteBackupServer&) = delete;
+
+    /**
+     * @brief Listen and serve clients until a stop is requested, then end the open sessions.
+     *
+     * @param[in] stopRequested Set to stop serving
+     * @return true if the server stopped on request, false if it could not listen or accept
+     */
+    bool Run(const std::atomic<bool>& stopRequested);
+
+  private:
+    /**
+     * @brief A connection and the thread serving it.
+     */
+    struct Connection
+    {
+        TcpSocket socket;   /**< Connection to the client */
+        std::thread thread; /**< Thread running Serve */
+        bool done;          /**< Serve returned, so the thread can be joined */
+    };
+
+    /**
+     * @brief What the metrics endpoint reports for one backup name.
+     */
+    struct NameMetrics
+    {
+        RemoteBackupSession* session = nullptr; /**< Session running now, sampled on each scrape */
+        BackupStats lastStats{};                /**< Measurements of the last finished run */
+        bool finished = false;                  /**< A run has finished */
+        bool lastSucceeded = false;             /**< The last finished run succeeded */
+        std::int64_t finishedAt = 0;            /**< Unix time the last run finished */
+    };
+
+    void Serve(Connection& connection);
+    bool Reserve(const std::string& name);
+    void Release(const std::string& name);
+    void RecordRun(const std::string& name);
+    void JoinFinished(bool all);
+    std::string RenderMetrics();
+
+    const ServeConfig& _config;
+    TcpListener _listener;
+    std::mutex _mutex;
+    std::set<std::string> _activeNames;
+    std::vector<std::unique_ptr<Connection>> _connections;
+    std::map<std::string, NameMetrics> _metrics;
+};
@@ -0,0 +1,590 @@
+#include "RemoteBackupSession.hpp"
+
+#include "FileCompressor/FileCompressor.hpp"
+#include "ProcessDeletedFiles.hpp"
+#include "RelativePathBuilder.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+constexpr const char* StagedFileSuffix = ".rdemo-partial";
+
+/**
+ * @brief Most batches a client may have between Files and the end of their uploads.
+ */
+constexpr std::size_t MaxOpenBatches = 1024;
+
+/**
+ * @brief Most files a client may upload at the same time.
+ */
+constexpr std::size_t MaxOpenUploads = 256;
+}
+
+RemoteBackupSession::RemoteBackupSession(TcpSocket& socket, const std::filesystem::path& backupRoot, HashAlgorithm hashAlgorithm,
+                                         SQLitePerformanceProfile databaseProfile, unsigned int threadCount, bool compressedContent,
+                                         const std::function<void()>& onRunRecorded)
+    : _socket(socket), _backupRoot(backupRoot), _backupFolder(backupRoot / "backup"), _historyFolder(backupRoot / "deleted"),
+      _databaseProfile(databaseProfile), _threadCount(std::max(1u, threadCount)),
+      _compressedContent((true == compressedContent) && (true == FileCompressor::IsAvailable())), _onRunRecorded(onRunRecorded), _fileHasher(hashAlgorithm), _success(true), _queuedFiles(0)
+{
+}
+
+bool RemoteBackupSession::Run()
+{
+    BackupRunRecord run{};
+    if (false == OpenBackup(run))
+    {
+        return Fail("Failed to open the backup");
+    }
+    RemoteMessageWriter welcome;
+    welcome.U8(static_cast<std::uint8_t>(_fileHasher.Algorithm()));
+    welcome.U8((true == _compressedContent) ? RemoteHelloCompression : 0);
+    welcome.String(run.started);
+    if (false == SendRemoteMessage(_socket, RemoteMessage::Welcome, welcome.Payload()))
+    {
+        _fileStateRepository->FinishGeneration(false);
+        return false;
+    }
+
+    // Workers rehash and move what arrived while this thread keeps reading, so the queue only smooths bursts.
+    _applyStage = std::make_unique<PipelineStage<ReceivedFile>>(
+        _threadCount, 2 * static_cast<std::size_t>(_threadCount), [this](ReceivedFile& received) { Apply(received); },
+        [this]()
+        {
+            if (false == _batchWriter->FlushCurrentThread())
+            {
+                _success.store(false);
+            }
+        });
+
+    bool handled = true;
+    bool finished = false;
+    RemoteMessage type = RemoteMessage::Error;
+    std::string payload;
+    while ((true == handled) && (false == finished) && (true == ReceiveRemoteMessage(_socket, type, payload)))
+    {
+        RemoteMessageReader reader(payload);
+        switch (type)
+        {
+        case RemoteMessage::Files:
+            handled = OnFiles(reader);
+            break;
+        case RemoteMessage::Digests:
+            handled = OnDigests(reader);
+            break;
+        case RemoteMessage::Content:
+            handled = OnContent(reader);
+            break;
+        case RemoteMessage::Done:
+            handled = Finish(reader);
+            finished = handled;
+            break;
+        default:
+            handled = Fail("Unexpected message");
+            break;
+        }
+    }
+    if (true == finished)
+    {
+        return _success.load();
+    }
+
+    // The client went away mid-run: what was applied is kept, and the run is recorded as failed.
+    for (auto& [id, upload] : _uploads)
+    {
+        std::error_code ec;
+        upload.stream.close();
+        std::filesystem::remove(upload.stagedFile, ec);
+    }
+    _uploads.clear();
+    _applyStage->Finalize();
+    _batchWriter->FlushAll();
+    _fileStateRepository->FinishGeneration(false);
+    return false;
+}
+
+void RemoteBackupSession::Sample(BackupStats& outputStats, std::uint64_t& outputQueuedFiles)
+{
+    _statsCollector.Collect(outputStats);
+    outputQueuedFiles = _queuedFiles.load(std::memory_order_relaxed);
+}
+
+bool RemoteBackupSession::Succeeded() const
+{
+    return _success.load();
+}
+
+/**
+ * @brief Open or create the state database and begin this run's generation.
+ *
+ * @param[out] outputRun Run that was started
+ * @return true on success, false on error
+ */
+bool RemoteBackupSession::OpenBackup(BackupRunRecord& outputRun)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(_backupFolder, ec);
+    std::filesystem::create_directories(_historyFolder, ec);
+    if (0 != ec.value())
+    {
+        return false;
+    }
+    _databaseSession = std::make_unique<SQLiteSession>(_backupRoot / "backup.db", _databaseProfile);
+    _fileStateRepository = std::make_unique<FileStateRepository>(*_databaseSession);
+    // A remote run starts over instead of resuming: the client walks again anyway and nothing it sent is lost.
+    if ((false == _fileStateRepository->InitializeSchema()) || (false == _fileStateRepository->BeginGeneration(RunContext().Timestamp(), false, outputRun)))
+    {
+        return false;
+    }
+    _batchWriter = std::make_unique<FileStateBatchWriter>(*_fileStateRepository, BackupConfig::DefaultStateBatchSize,
+                                                          std::chrono::milliseconds(BackupConfig::DefaultStateBatchIntervalMs), nullptr);
+    _runContext = std::make_unique<RunContext>(outputRun.started);
+    _snapshotDirectory = std::make_unique<SnapshotDirectoryProvider>(_historyFolder, *_runContext,
+                                                                     [this](const std::filesystem::path& snapshotPath)
+                                                                     {
+                                                                         if (false == _fileStateRepository->RecordSnapshot(snapshotPath.filename().string()))
+                                                                         {
+                                                                             throw std::runtime_error("Failed to record snapshot " + snapshotPath.string());
+                                                                         }
+                                                                     });
+    return true;
+}
+
+/**
+ * @brief Look up a batch of listed files and answer which ones the client has to hash.
+ *
+ * Files whose metadata matches their stored state are recorded as unchanged right away.
+ *
+ * @param[in,out] reader Payload of the Files message
+ * @return true on success, false after a protocol error was reported
+ */
+bool RemoteBackupSession::OnFiles(RemoteMessageReader& reader)
+{
+    std::uint32_t batchId = 0;
+    std::uint32_t count = 0;
+    if ((false == reader.U32(batchId)) || (false == reader.U32(count)) || (count > RemoteMaxBatchFiles))
+    {
+        return Fail("Malformed Files message");
+    }
+    if ((_batches.size() >= MaxOpenBatches) || (_batches.end() != _batches.find(batchId)))
+    {
+        return Fail("Too many batches in flight or a batch id reused");
+    }
+
+    RemoteBatch batch;
+    batch.files.resize(count);
+    batch.expected.assign(count, false);
+    batch.pending = 0;
+    batch.digestsReceived = false;
+    std::size_t checked = 0;
+    for (std::uint32_t index = 0; index < count; ++index)
+    {
+        RemoteFile& file = batch.files[index];
+        if ((false == reader.String(file.key)) || (false == reader.U64(file.metadata.size)) || (false == reader.I64(file.metadata.modificationTimeNs)) ||
+            (false == reader.U64(file.metadata.inode)) || (false == reader.U64(file.metadata.device)) || (false == reader.U32(file.metadata.mode)) ||
+            (false == reader.U32(file.metadata.userId)) || (false == reader.U32(file.metadata.groupId)) || (false == reader.I64(file.metadata.accessTimeNs)))
+        {
+            return Fail("Malformed Files message");
+        }
+        if (false == IsValidRemoteKey(file.key))
+        {
+            return Fail("Invalid file key " + file.key);
+        }
+        file.metadata.changeTimeNs = 0;
+        try
+        {
+            file.hasRecord = (true == _fileStateRepository->GetFileState(file.key, file.storedRecord)) && (ChangeType::Deleted != file.storedRecord.status);
+        }
+        catch (const std::runtime_error&)
+        {
+            return Fail("Failed to read the state of " + file.key);
+        }
+        const bool metadataUnchanged = (true == file.hasRecord) && (file.storedRecord.hashAlgorithm == _fileHasher.Algorithm()) &&
+                                       (file.storedRecord.metadata == file.metadata);
+        if (true == metadataUnchanged)
+        {
+            StoreUnchanged(file, file.storedRecord.hash, file.storedRecord.hashAlgorithm);
+        }
+        else
+        {
+            batch.expected[index] = true;
+            ++checked;
+        }
+    }
+    if (false == reader.AtEnd())
+    {
+        return Fail("Malformed Files message");
+    }
+
+    RemoteMessageWriter check;
+    check.U32(batchId);
+    check.U32(count);
+    check.Bitmap(batch.expected);
+    if (0 != checked)
+    {
+        _batches.emplace(batchId, std::move(batch));
+    }
+    return SendRemoteMessage(_socket, RemoteMessage::Check, check.Payload());
+}
+
+/**
+ * @brief Compare the digests of a batch's checked files and answer which ones the client has to send.
+ *
+ * @param[in,out] reader Payload of the Digests message
+ * @return true on success, false after a protocol error was reported
+ */
+bool RemoteBackupSession::OnDigests(RemoteMessageReader& reader)
+{
+    std::uint32_t batchId = 0;
+    std::uint32_t count = 0;
+    if ((false == reader.U32(batchId)) || (false == reader.U32(count)))
+    {
+        return Fail("Malformed Digests message");
+    }
+    const auto found = _batches.find(batchId);
+    if ((_batches.end() == found) || (true == found->second.digestsReceived))
+    {
+        return Fail("Digests for an unknown batch");
+    }
+    RemoteBatch& batch = found->second;
+
+    // A checked file without a digest could not be read by the client; it is neither needed nor seen.
+    std::vector<bool> needed(batch.files.size(), false);
+    for (std::uint32_t item = 0; item < count; ++item)
+    {
+        std::uint32_t index = 0;
+        std::uint8_t size = 0;
+        const char* bytes = nullptr;
+        HashDigest digest{};
+        if ((false == reader.U32(index)) || (false == reader.U8(size)) || (size != HashAlgorithmDigestSize(_fileHasher.Algorithm())) ||
+            (false == reader.Bytes(size, bytes)) || (false == HashDigest::FromBytes(bytes, size, digest)))
+        {
+            return Fail("Malformed Digests message");
+        }
+        if ((index >= batch.files.size()) || (false == batch.expected[index]))
+        {
+            return Fail("Digest for a file that was not checked");
+        }
+        batch.expected[index] = false;
+        const RemoteFile& file = batch.files[index];
+        // A digest of another algorithm cannot be compared here, so the worker compares the received content.
+        if ((true == file.hasRecord) && (file.storedRecord.hashAlgorithm == _fileHasher.Algorithm()) && (file.storedRecord.hash == digest))
+        {
+            StoreUnchanged(file, digest, _fileHasher.Algorithm());
+            continue;
+        }
+        needed[index] = true;
+        ++batch.pending;
+    }
+    if (false == reader.AtEnd())
+    {
+        return Fail("Malformed Digests message");
+    }
+
+    RemoteMessageWriter need;
+    need.U32(batchId);
+    need.U32(static_cast<std::uint32_t>(needed.size()));
+    need.Bitmap(needed);
+    batch.expected = std::move(needed);
+    batch.digestsReceived = true;
+    if (0 == batch.pending)
+    {
+        _batches.erase(found);
+    }
+    return SendRemoteMessage(_socket, RemoteMessage::Need, need.Payload());
+}
+
+/**
+ * @brief Append one chunk to the staged copy of a needed file, and hand the file to a worker after its last chunk.
+ *
+ * @param[in,out] reader Payload of the Content message
+ * @return true on success, false after a protocol error was reported
+ */
+bool RemoteBackupSession::OnContent(RemoteMessageReader& reader)
+{
+    std::uint32_t batchId = 0;
+    std::uint32_t index = 0;
+    std::uint8_t flags = 0;
+    std::uint32_t rawSize = 0;
+    if ((false == reader.U32(batchId)) || (false == reader.U32(index)) || (false == reader.U8(flags)) || (false == reader.U32(rawSize)) ||
+        (rawSize > RemoteContentChunkSize))
+    {
+        return Fail("Malformed Content message");
+    }
+    const std::size_t chunkSize = reader.Remaining();
+    const char* chunk = nullptr;
+    reader.Bytes(chunkSize, chunk);
+    const auto found = _batches.find(batchId);
+    if ((_batches.end() == found) || (false == found->second.digestsReceived) || (index >= found->second.files.size()) ||
+        (false == found->second.expected[index]))
+    {
+        return Fail("Content for a file that was not needed");
+    }
+    RemoteBatch& batch = found->second;
+    const UploadId uploadId(batchId, index);
+
+    auto upload = _uploads.find(uploadId);
+    if (_uploads.end() == upload)
+    {
+        if (_uploads.size() >= MaxOpenUploads)
+        {
+            return Fail("Too many uploads in flight");
+        }
+        OpenUpload opened;
+        RelativePathBuilder::BuildLocation(_backupFolder, batch.files[index].key, opened.stagedFile);
+        opened.stagedFile += StagedFileSuffix;
+        std::error_code ec;
+        _directoryCache.Ensure(opened.stagedFile.parent_path());
+        std::filesystem::remove(opened.stagedFile, ec);
+        opened.stream.open(opened.stagedFile, std::ios::binary | std::ios::trunc);
+        upload = _uploads.emplace(uploadId, std::move(opened)).first;
+    }
+
+    bool written = true;
+    if (0 != (flags & RemoteContentCompressed))
+    {
+        std::vector<std::uint8_t> data;
+        written = (true == _compressedContent) && (true == FileCompressor::DecompressBuffer(chunk, chunkSize, rawSize, data)) &&
+                  (data.size() == rawSize) && (true == static_cast<bool>(upload->second.stream.write(reinterpret_cast<const char*>(data.data()),
+                                                                                                      static_cast<std::streamsize>(data.size()))));
+    }
+    else
+    {
+        written = (chunkSize == rawSize) && (true == static_cast<bool>(upload->second.stream.write(chunk, static_cast<std::streamsize>(chunkSize))));
+    }
+    if ((false == written) && (0 == (flags & RemoteContentFailed)))
+    {
+        return Fail("Failed to store content of " + batch.files[index].key);
+    }
+    if (0 == (flags & (RemoteContentLast | RemoteContentFailed)))
+    {
+        return true;
+    }
+
+    ReceivedFile received{batch.files[index], upload->second.stagedFile};
+    upload->second.stream.close();
+    const bool complete = (0 == (flags & RemoteContentFailed)) && (false == upload->second.stream.fail());
+    _uploads.erase(upload);
+    batch.expected[index] = false;
+    if (0 == --batch.pending)
+    {
+        _batches.erase(found);
+    }
+    if (false == complete)
+    {
+        // The client could not read the file, so it is not seen and this run deletes nothing.
+        std::error_code ec;
+        std::filesystem::remove(received.stagedFile, ec);
+        _success.store(false);
+        return true;
+    }
+    _queuedFiles.fetch_add(1, std::memory_order_relaxed);
+    _applyStage->Submit(std::move(received));
+    return true;
+}
+
+/**
+ * @brief Complete the run once the client sent every batch: apply the rest, archive deletions and report.
+ *
+ * @param[in,out] reader Payload of the Done message
+ * @return true if the run was completed and reported, false after a protocol error was reported
+ */
+bool RemoteBackupSession::Finish(RemoteMessageReader& reader)
+{
+    std::uint8_t flags = 0;
+    if ((false == reader.U8(flags)) || (false == reader.AtEnd()))
+    {
+        return Fail("Malformed Done message");
+    }
+    if ((false == _batches.empty()) || (false == _uploads.empty()))
+    {
+        return Fail("Done before every batch was sent");
+    }
+    _applyStage->Finalize();
+    if (false == _batchWriter->FlushAll())
+    {
+        _success.store(false);
+    }
+    if (0 == (flags & RemoteDoneSucceeded))
+    {
+        _success.store(false);
+    }
+
+    // Only a complete listing saw every live file, so only then are the unseen ones deletions.
+    if ((true == _success.load()) && (0 != (flags & RemoteDoneWalkComplete)))
+    {
+        // ExecuteUnseen trusts the run's generation and never asks where a key lives in the source.
+        const RelativePathBuilder noSource{std::filesystem::path()};
+        ProcessDeletedFiles processDeletedFiles(noSource, _backupFolder, *_snapshotDirectory, *_fileStateRepository, _fileCopier, _directoryCache,
+                                                nullptr, nullptr, nullptr, *_runContext, nullptr, &_statsCollector, _threadCount,
+                                                BackupConfig::DefaultStateBatchSize, nullptr);
+        _success.store(processDeletedFiles.ExecuteUnseen());
+    }
+    if (false == _fileStateRepository->FinishGeneration(_success.load()))
+    {
+        _success.store(false);
+    }
+
+    if (nullptr != _onRunRecorded)
+    {
+        _onRunRecorded();
+    }
+
+    BackupStats stats{};
+    _statsCollector.Collect(stats);
+    RemoteMessageWriter finished;
+    finished.U8((true == _success.load()) ? 1 : 0);
+    for (const std::size_t files : stats.filesByChange)
+    {
+        finished.U64(files);
+    }
+    SendRemoteMessage(_socket, RemoteMessage::Finished, finished.Payload());
+    return true;
+}
+
+/**
+ * @brief Worker step: rehash a received file, archive the version it replaces and store its state.
+ *
+ * The stored digest is the one computed here, so a file that changed while the client read it is
+ * recorded with the content actually received.
+ *
+ * @param[in,out] received File to apply
+ */
+void RemoteBackupSession::Apply(ReceivedFile& received)
+{
+    _queuedFiles.fetch_sub(1, std::memory_order_relaxed);
+    BackupStatsCollector::ThreadCounters& counters = _statsCollector.Current();
+    BackupStatsCollector::MarkBusy(counters);
+    Apply(received, counters);
+    BackupStatsCollector::MarkIdle(counters);
+}
+
+/**
+ * @brief Apply step measured into the counters of the calling thread.
+ *
+ * @param[in,out] received File to apply; its staged file is moved or removed
+ * @param[in,out] counters Stats counters of the calling thread
+ */
+void RemoteBackupSession::Apply(ReceivedFile& received, BackupStatsCollector::ThreadCounters& counters)
+{
+    std::error_code ec;
+    const RemoteFile& file = received.file;
+    FileStateRecord record{};
+    record.hashAlgorithm = _fileHasher.Algorithm();
+    record.metadata = file.metadata;
+    record.committedInRun = false;
+    HashDigest comparisonHash{};
+    {
+        StageTimer hashTimer(&counters, BackupStage::Hash);
+        if (false == _fileHasher.Compute(received.stagedFile, record.hash))
+        {
+            std::filesystem::remove(received.stagedFile, ec);
+            _success.store(false);
+            return;
+        }
+        BackupStatsCollector::Add(counters.bytesRead, file.metadata.size);
+        BackupStatsCollector::Add(counters.bytesHashed, file.metadata.size);
+        comparisonHash = record.hash;
+        if ((true == file.hasRecord) && (file.storedRecord.hashAlgorithm != record.hashAlgorithm) &&
+            (false == _fileHasher.Compute(received.stagedFile, file.storedRecord.hashAlgorithm, comparisonHash)))
+        {
+            std::filesystem::remove(received.stagedFile, ec);
+            _success.store(false);
+            return;
+        }
+    }
+    if ((true == file.hasRecord) && (comparisonHash == file.storedRecord.hash))
+    {
+        std::filesystem::remove(received.stagedFile, ec);
+        StoreUnchanged(file, record.hash, record.hashAlgorithm);
+        return;
+    }
+
+    StageTimer copyTimer(&counters, BackupStage::Copy);
+
+    std::filesystem::path backupFile;
+    RelativePathBuilder::BuildLocation(_backupFolder, file.key, backupFile);
+    record.status = (true == file.hasRecord) ? ChangeType::Modified : ChangeType::Added;
+    record.timestamp = _runContext->Timestamp();
+    if (ChangeType::Modified == record.status)
+    {
+        std::filesystem::path snapshotFile;
+        try
+        {
+            RelativePathBuilder::BuildLocation(_snapshotDirectory->GetOrCreate(), file.key, snapshotFile);
+        }
+        catch (const std::runtime_error&)
+        {
+            std::filesystem::remove(received.stagedFile, ec);
+            _success.store(false);
+            return;
+        }
+        _directoryCache.Ensure(snapshotFile.parent_path());
+        _fileCopier.Move(backupFile, snapshotFile);
+    }
+    if (false == _fileCopier.Move(received.stagedFile, backupFile))
+    {
+        _success.store(false);
+        return;
+    }
+    BackupStatsCollector::Add(counters.bytesWritten, file.metadata.size);
+    StageTimer databaseTimer(&counters, BackupStage::Database);
+    if (false == _batchWriter->Add(file.key, record))
+    {
+        _success.store(false);
+        return;
+    }
+    Count(record.status);
+}
+
+/**
+ * @brief Record a file whose content matches its stored state, with its current metadata.
+ *
+ * @param[in] file File to record
+ * @param[in] digest Digest of its content
+ * @param[in] algorithm Algorithm of digest
+ */
+void RemoteBackupSession::StoreUnchanged(const RemoteFile& file, const HashDigest& digest, HashAlgorithm algorithm)
+{
+    FileStateRecord record = file.storedRecord;
+    record.hash = digest;
+    record.hashAlgorithm = algorithm;
+    record.status = ChangeType::Unchanged;
+    record.metadata = file.metadata;
+    record.digestScheme = DigestScheme::Full;
+    record.sampledRuns = 0;
+    record.committedInRun = false;
+    if (false == _batchWriter->Add(file.key, record))
+    {
+        _success.store(false);
+        return;
+    }
+    Count(ChangeType::Unchanged);
+}
+
+/**
+ * @brief Count a stored file by its change type.
+ *
+ * @param[in] changeType Outcome of the file
+ */
+void RemoteBackupSession::Count(ChangeType changeType)
+{
+    BackupStatsCollector::Add(_statsCollector.Current().filesByChange[static_cast<std::size_t>(changeType)], 1);
+}
+
+/**
+ * @brief Tell the client why the session ends.
+ *
+ * @param[in] message Reason sent in the Error message
+ * @return false, so protocol errors can be returned directly
+ */
+bool RemoteBackupSession::Fail(const std::string& message)
+{
+    RemoteMessageWriter error;
+    error.String(message);
+    SendRemoteMessage(_socket, RemoteMessage::Error, error.Payload());
+    _success.store(false);
+    return false;
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "BackupStatsCollector.hpp"
+#include "BackupUtility/BackupUtility.hpp"
+#include "FileCopier/DirectoryCache.hpp"
+#include "FileCopier/FileCopier.hpp"
+#include "FileHasher/FileHasher.hpp"
+#include "FileStateBatchWriter.hpp"
+#include "FileStateRepository.hpp"
+#include "PipelineStage.hpp"
+#include "RemoteProtocol.hpp"
+#include "SnapshotDirectoryProvider/SnapshotDirectoryProvider.hpp"
+#include "SQLite/SQLiteSession.hpp"
+#include "TimestampProvider/RunContext.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Application component running one backup a remote client pushes over a connection.
+ *
+ * The backup lives under its own root, laid out like a local one: `backup.db`, `backup/` and `deleted/`.
+ * Messages are handled in arrival order on the calling thread, which looks up stored states and answers
+ * each batch as soon as it is complete, so the client never waits for a batch to be applied. Received
+ * files are staged next to their backup copy and handed to worker threads, which rehash them, archive
+ * the version they replace and store their state.
+ */
+class RemoteBackupSession
+{
+  public:
+    /**
+     * @brief Construct a session on an accepted connection whose Hello was read.
+     *
+     * @param[in,out] socket Connection to the client
+     * @param[in] backupRoot Root of this client's backup
+     * @param[in] hashAlgorithm Digest algorithm the client and the workers hash with
+     * @param[in] databaseProfile Durability and caching of the state database
+     * @param[in] threadCount Worker threads applying received files, 0 uses one
+     * @param[in] compressedContent The client can send zstd compressed chunks
+     * @param[in] onRunRecorded Called once the run is finished in the database, before the client is told, so the client may start the next run right away
+     */
+    RemoteBackupSession(TcpSocket& socket, const std::filesystem::path& backupRoot, HashAlgorithm hashAlgorithm,
+                        SQLitePerformanceProfile databaseProfile, unsigned int threadCount, bool compressedContent,
+                        const std::function<void()>& onRunRecorded);
+
+    RemoteBackupSession(const RemoteBackupSession&) = delete;
+    RemoteBackupSession& operator=(const RemoteBackupSession&) = delete;
+
+    /**
+     * @brief Answer Hello with Welcome and serve the backup until the client is done or the connection ends.
+     *
+     * @return true if the run completed and succeeded, false otherwise
+     */
+    bool Run();
+
+    /**
+     * @brief Sample the measurements of the run while it goes on; thread-safe.
+     *
+     * @param[out] outputStats Measurements so far
+     * @param[out] outputQueuedFiles Received files waiting for a worker
+     */
+    void Sample(BackupStats& outputStats, std::uint64_t& outputQueuedFiles);
+
+    /**
+     * @brief Check whether nothing went wrong so far; final once the run is recorded.
+     *
+     * @return true while the run succeeds
+     */
+    bool Succeeded() const;
+
+  private:
+    /**
+     * @brief A file of a batch between Files and the end of its upload.
+     */
+    struct RemoteFile
+    {
+        std::string key;              /**< State key sent by the client */
+        FileMetadata metadata;        /**< Metadata sent by the client */
+        FileStateRecord storedRecord; /**< Stored state, meaningful if hasRecord */
+        bool hasRecord;               /**< A live state is stored */
+    };
+
+    /**
+     * @brief A batch of files the client still sends digests or content for.
+     */
+    struct RemoteBatch
+    {
+        std::vector<RemoteFile> files; /**< Files in the client's order */
+        std::vector<bool> expected;    /**< Files checked until the digests arrive, then files needed until their content arrived */
+        std::size_t pending;           /**< Needed files whose content has not arrived */
+        bool digestsReceived;          /**< The batch got its Digests and is waiting for content */
+    };
+
+    /**
+     * @brief A received file ready to be applied by a worker.
+     */
+    struct ReceivedFile
+    {
+        RemoteFile file;                  /**< File the content belongs to */
+        std::filesystem::path stagedFile; /**< Complete content next to the backup copy */
+    };
+
+    /**
+     * @brief An upload that has not received its last chunk.
+     */
+    struct OpenUpload
+    {
+        std::filesystem::path stagedFile; /**< File the chunks are appended to */
+        std::ofstream stream;             /**< Open stream of stagedFile */
+    };
+
+    using UploadId = std::pair<std::uint32_t, std::uint32_t>;
+
+    bool OpenBackup(BackupRunRecord& outputRun);
+    bool OnFiles(RemoteMessageReader& reader);
+    bool OnDigests(RemoteMessageReader& reader);
+    bool OnContent(RemoteMessageReader& reader);
+    bool Finish(RemoteMessageReader& reader);
+    void Apply(ReceivedFile& received);
+    void Apply(ReceivedFile& received, BackupStatsCollector::ThreadCounters& counters);
+    void StoreUnchanged(const RemoteFile& file, const HashDigest& digest, HashAlgorithm algorithm);
+    void Count(ChangeType changeType);
+    bool Fail(const std::string& message);
+
+    TcpSocket& _socket;
+    std::filesystem::path _backupRoot;
+    std::filesystem::path _backupFolder;
+    std::filesystem::path _historyFolder;
+    SQLitePerformanceProfile _databaseProfile;
+    unsigned int _threadCount;
+    bool _compressedContent;
+    std::function<void()> _onRunRecorded;
+    FileHasher _fileHasher;
+    FileCopier _fileCopier;
+    DirectoryCache _directoryCache;
+    BackupStatsCollector _statsCollector;
+    std::atomic<bool> _success;
+    std::atomic<std::uint64_t> _queuedFiles;
+    std::unique_ptr<SQLiteSession> _databaseSession;
+    std::unique_ptr<FileStateRepository> _fileStateRepository;
+    std::unique_ptr<FileStateBatchWriter> _batchWriter;
+    std::unique_ptr<RunContext> _runContext;
+    std::unique_ptr<SnapshotDirectoryProvider> _snapshotDirectory;
+    std::unique_ptr<PipelineStage<ReceivedFile>> _applyStage;
+    std::unordered_map<std::uint32_t, RemoteBatch> _batches;
+    std::map<UploadId, OpenUpload> _uploads;
+};
@@ -0,0 +1,271 @@
+#include "RemoteProtocol.hpp"
+
+#include <algorithm>
+#include <string_view>
+
+namespace
+{
+/**
+ * @brief Bytes in front of every payload: the u32 length and the u8 type.
+ */
+constexpr std::size_t FrameHeaderSize = 5;
+
+/**
+ * @brief Suffix of the file a received file is staged in until it is complete.
+ */
+constexpr std::string_view StagedFileSuffix = ".rdemo-partial";
+}
+
+void RemoteMessageWriter::U8(std::uint8_t value)
+{
+    _payload.push_back(static_cast<char>(value));
+}
+
+void RemoteMessageWriter::U16(std::uint16_t value)
+{
+    for (int shift = 0; shift < 16; shift += 8)
+    {
+        _payload.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+void RemoteMessageWriter::U32(std::uint32_t value)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        _payload.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+void RemoteMessageWriter::U64(std::uint64_t value)
+{
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        _payload.push_back(static_cast<char>((value >> shift) & 0xFF));
+    }
+}
+
+void RemoteMessageWriter::I64(std::int64_t value)
+{
+    U64(static_cast<std::uint64_t>(value));
+}
+
+void RemoteMessageWriter::String(const std::string& value)
+{
+    U32(static_cast<std::uint32_t>(value.size()));
+    _payload.append(value);
+}
+
+void RemoteMessageWriter::Bytes(const void* data, std::size_t size)
+{
+    _payload.append(static_cast<const char*>(data), size);
+}
+
+void RemoteMessageWriter::Bitmap(const std::vector<bool>& flags)
+{
+    std::string bytes((flags.size() + 7) / 8, '\0');
+    for (std::size_t index = 0; index < flags.size(); ++index)
+    {
+        if (true == flags[index])
+        {
+            bytes[index / 8] = static_cast<char>(static_cast<unsigned char>(bytes[index / 8]) | (1u << (index % 8)));
+        }
+    }
+    _payload.append(bytes);
+}
+
+const std::string& RemoteMessageWriter::Payload() const
+{
+    return _payload;
+}
+
+RemoteMessageReader::RemoteMessageReader(const std::string& payload) : _payload(payload), _offset(0)
+{
+}
+
+bool RemoteMessageReader::Take(std::size_t size, const unsigned char*& outputData)
+{
+    if (size > _payload.size() - _offset)
+    {
+        return false;
+    }
+    outputData = reinterpret_cast<const unsigned char*>(_payload.data()) + _offset;
+    _offset += size;
+    return true;
+}
+
+bool RemoteMessageReader::U8(std::uint8_t& outputValue)
+{
+    const unsigned char* data = nullptr;
+    if (false == Take(1, data))
+    {
+        return false;
+    }
+    outputValue = data[0];
+    return true;
+}
+
+bool RemoteMessageReader::U16(std::uint16_t& outputValue)
+{
+    const unsigned char* data = nullptr;
+    if (false == Take(2, data))
+    {
+        return false;
+    }
+    outputValue = static_cast<std::uint16_t>(data[0] | (data[1] << 8));
+    return true;
+}
+
+bool RemoteMessageReader::U32(std::uint32_t& outputValue)
+{
+    const unsigned char* data = nullptr;
+    if (false == Take(4, data))
+    {
+        return false;
+    }
+    outputValue = 0;
+    for (int index = 3; index >= 0; --index)
+    {
+        outputValue = (outputValue << 8) | data[index];
+    }
+    return true;
+}
+
+bool RemoteMessageReader::U64(std::uint64_t& outputValue)
+{
+    const unsigned char* data = nullptr;
+    if (false == Take(8, data))
+    {
+        return false;
+    }
+    outputValue = 0;
+    for (int index = 7; index >= 0; --index)
+    {
+        outputValue = (outputValue << 8) | data[index];
+    }
+    return true;
+}
+
+bool RemoteMessageReader::I64(std::int64_t& outputValue)
+{
+    std::uint64_t value = 0;
+    if (false == U64(value))
+    {
+        return false;
+    }
+    outputValue = static_cast<std::int64_t>(value);
+    return true;
+}
+
+bool RemoteMessageReader::String(std::string& outputValue)
+{
+    std::uint32_t size = 0;
+    const unsigned char* data = nullptr;
+    if ((false == U32(size)) || (false == Take(size, data)))
+    {
+        return false;
+    }
+    outputValue.assign(reinterpret_cast<const char*>(data), size);
+    return true;
+}
+
+bool RemoteMessageReader::Bytes(std::size_t size, const char*& outputData)
+{
+    const unsigned char* data = nullptr;
+    if (false == Take(size, data))
+    {
+        return false;
+    }
+    outputData = reinterpret_cast<const char*>(data);
+    return true;
+}
+
+bool RemoteMessageReader::Bitmap(std::size_t count, std::vector<bool>& outputFlags)
+{
+    const unsigned char* data = nullptr;
+    if (false == Take((count + 7) / 8, data))
+    {
+        return false;
+    }
+    outputFlags.assign(count, false);
+    for (std::size_t index = 0; index < count; ++index)
+    {
+        outputFlags[index] = 0 != (data[index / 8] & (1u << (index % 8)));
+    }
+    return true;
+}
+
+std::size_t RemoteMessageReader::Remaining() const
+{
+    return _payload.size() - _offset;
+}
+
+bool RemoteMessageReader::AtEnd() const
+{
+    return _offset == _payload.size();
+}
+
+bool IsValidRemoteKey(const std::string& key)
+{
+    if ((true == key.empty()) || (std::string::npos != key.find('\0')) ||
+        ((key.size() >= StagedFileSuffix.size()) && (0 == key.compare(key.size() - StagedFileSuffix.size(), StagedFileSuffix.size(), StagedFileSuffix))))
+    {
+        return false;
+    }
+#ifdef _WIN32
+    // Windows also splits at backslashes and reads drive letters and stream names from colons.
+    if (std::string::npos != key.find_first_of("\\:"))
+    {
+        return false;
+    }
+#endif
+    std::size_t start = 0;
+    while (start <= key.size())
+    {
+        const std::size_t end = std::min(key.find('/', start), key.size());
+        const std::string_view component(key.data() + start, end - start);
+        if ((true == component.empty()) || ("." == component) || (".." == component))
+        {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+bool SendRemoteMessage(TcpSocket& socket, RemoteMessage type, const std::string& payload)
+{
+    if (payload.size() > RemoteMaxMessageSize)
+    {
+        return false;
+    }
+    // Header and payload go out in one send so small messages fill one segment with Nagle off.
+    std::string frame;
+    frame.reserve(FrameHeaderSize + payload.size());
+    const std::uint32_t size = static_cast<std::uint32_t>(payload.size());
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        frame.push_back(static_cast<char>((size >> shift) & 0xFF));
+    }
+    frame.push_back(static_cast<char>(type));
+    frame.append(payload);
+    return socket.SendAll(frame.data(), frame.size());
+}
+
+bool ReceiveRemoteMessage(TcpSocket& socket, RemoteMessage& outputType, std::string& outputPayload)
+{
+    unsigned char header[FrameHeaderSize];
+    if (false == socket.ReceiveAll(header, sizeof(header)))
+    {
+        return false;
+    }
+    const std::uint32_t size = static_cast<std::uint32_t>(header[0]) | (static_cast<std::uint32_t>(header[1]) << 8) |
+                               (static_cast<std::uint32_t>(header[2]) << 16) | (static_cast<std::uint32_t>(header[3]) << 24);
+    if (size > RemoteMaxMessageSize)
+    {
+        return false;
+    }
+    outputType = static_cast<RemoteMessage>(header[4]);
+    outputPayload.resize(size);
+    return (0 == size) || socket.ReceiveAll(outputPayload.data(), size);
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include "TcpSocket/TcpSocket.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief First field of a Hello message, "RDBK" in little-endian order.
+ */
+constexpr std::uint32_t RemoteProtocolMagic = 0x4B424452;
+
+/**
+ * @brief Version of the message layout; a server refuses clients of another version.
+ */
+constexpr std::uint16_t RemoteProtocolVersion = 2;
+
+/**
+ * @brief Most files a client may put into one Files message.
+ */
+constexpr std::uint32_t RemoteMaxBatchFiles = 4096;
+
+/**
+ * @brief Bytes of file content a client reads and sends per Content message, before compression.
+ */
+constexpr std::size_t RemoteContentChunkSize = 1024 * 1024;
+
+/**
+ * @brief Largest payload a receiver accepts; anything longer is a protocol error.
+ */
+constexpr std::size_t RemoteMaxMessageSize = 16 * 1024 * 1024;
+
+/**
+ * @brief Type of a message of the remote backup protocol.
+ *
+ * Every message is framed as a little-endian u32 payload length, a u8 type and the payload. A client
+ * says Hello and waits for Welcome; from then on both sides send without waiting, so many batches are
+ * in flight at once. Every batch goes through Files, Check, Digests, Need and Content in that order.
+ */
+enum class RemoteMessage : std::uint8_t
+{
+    Hello = 1,    /**< Client: magic, version, backup name, flags (RemoteHelloCompression) */
+    Welcome = 2,  /**< Server: hash algorithm, flags, run timestamp */
+    Files = 3,    /**< Client: batch id and the key, size, mtime, inode, device, mode, uid, gid and atime of each file */
+    Check = 4,    /**< Server: batch id and a bitmap of the files whose metadata changed, which the client hashes */
+    Digests = 5,  /**< Client: batch id and the index and digest of each checked file */
+    Need = 6,     /**< Server: batch id and a bitmap of the files whose content the server needs */
+    Content = 7,  /**< Client: batch id, file index, flags (RemoteContent*), raw size and one chunk of a needed file */
+    Done = 8,     /**< Client: every batch was sent; flags (RemoteDone*) */
+    Finished = 9, /**< Server: success and the number of files per ChangeType */
+    Error = 10    /**< Either side: message explaining why the connection is closed */
+};
+
+constexpr std::uint8_t RemoteHelloCompression = 1;   /**< Hello, Welcome: the sender can decompress zstd chunks */
+constexpr std::uint8_t RemoteContentCompressed = 1;  /**< Content: the chunk is one zstd frame */
+constexpr std::uint8_t RemoteContentLast = 2;        /**< Content: the last chunk of the file */
+constexpr std::uint8_t RemoteContentFailed = 4;      /**< Content: reading the file failed, the chunks so far are discarded */
+constexpr std::uint8_t RemoteDoneWalkComplete = 1;   /**< Done: the whole source was listed, so unseen files count as deleted */
+constexpr std::uint8_t RemoteDoneSucceeded = 2;      /**< Done: the client met no error */
+
+/**
+ * @brief Builder of a message payload in the protocol's little-endian layout.
+ */
+class RemoteMessageWriter
+{
+  public:
+    void U8(std::uint8_t value);
+    void U16(std::uint16_t value);
+    void U32(std::uint32_t value);
+    void U64(std::uint64_t value);
+    void I64(std::int64_t value);
+
+    /**
+     * @brief Append a u32 length and the bytes of a string.
+     *
+     * @param[in] value String to append
+     */
+    void String(const std::string& value);
+
+    /**
+     * @brief Append raw bytes without a length.
+     *
+     * @param[in] data Bytes to append
+     * @param[in] size Number of bytes
+     */
+    void Bytes(const void* data, std::size_t size);
+
+    /**
+     * @brief Append one bit per flag, lowest bit first, padded to whole bytes.
+     *
+     * @param[in] flags Flags to append
+     */
+    void Bitmap(const std::vector<bool>& flags);
+
+    /**
+     * @brief Get the payload built so far.
+     *
+     * @return Payload bytes
+     */
+    const std::string& Payload() const;
+
+  private:
+    std::string _payload;
+};
+
+/**
+ * @brief Bounds-checked reader of a message payload; every read fails once the payload is exhausted.
+ */
+class RemoteMessageReader
+{
+  public:
+    /**
+     * @brief Read from a payload, which must outlive the reader.
+     *
+     * @param[in] payload Received payload
+     */
+    explicit RemoteMessageReader(const std::string& payload);
+
+    bool U8(std::uint8_t& outputValue);
+    bool U16(std::uint16_t& outputValue);
+    bool U32(std::uint32_t& outputValue);
+    bool U64(std::uint64_t& outputValue);
+    bool I64(std::int64_t& outputValue);
+
+    /**
+     * @brief Read a string written by RemoteMessageWriter::String.
+     *
+     * @param[out] outputValue String read
+     * @return true on success, false if the payload is too short
+     */
+    bool String(std::string& outputValue);
+
+    /**
+     * @brief Point at the next bytes without copying them.
+     *
+     * @param[in] size Number of bytes
+     * @param[out] outputData Start of the bytes inside the payload
+     * @return true on success, false if the payload is too short
+     */
+    bool Bytes(std::size_t size, const char*& outputData);
+
+    /**
+     * @brief Read a bitmap written by RemoteMessageWriter::Bitmap.
+     *
+     * @param[in] count Number of flags
+     * @param[out] outputFlags Flags read
+     * @return true on success, false if the payload is too short
+     */
+    bool Bitmap(std::size_t count, std::vector<bool>& outputFlags);
+
+    /**
+     * @brief Get the number of bytes not read yet.
+     *
+     * @return Unread bytes
+     */
+    std::size_t Remaining() const;
+
+    /**
+     * @brief Check that the whole payload was read, so trailing garbage is caught.
+     *
+     * @return true if nothing is left
+     */
+    bool AtEnd() const;
+
+  private:
+    bool Take(std::size_t size, const unsigned char*& outputData);
+
+    const std::string& _payload;
+    std::size_t _offset;
+};
+
+/**
+ * @brief Check that a key sent by a client names a file inside the backup.
+ *
+ * A key is a relative, `/` separated path without empty, `.` or `..` components, so joining it to the
+ * backup root cannot leave the root. Keys ending in the staging suffix are refused as well, since they
+ * would collide with the staged content of another file.
+ *
+ * @param[in] key Key to check
+ * @return true if the key can be stored
+ */
+bool IsValidRemoteKey(const std::string& key);
+
+/**
+ * @brief Send one framed message. Callers sending from several threads serialize the calls.
+ *
+ * @param[in,out] socket Connection
+ * @param[in] type Message type
+ * @param[in] payload Message payload
+ * @return true on success, false once the connection failed
+ */
+bool SendRemoteMessage(TcpSocket& socket, RemoteMessage type, const std::string& payload);
+
+/**
+ * @brief Receive one framed message.
+ *
+ * @param[in,out] socket Connection
+ * @param[out] outputType Message type
+ * @param[out] outputPayload Message payload
+ * @return true on success, false once the connection ended or on a frame larger than RemoteMaxMessageSize
+ */
+bool ReceiveRemoteMessage(TcpSocket& socket, RemoteMessage& outputType, std::string& outputPayload);
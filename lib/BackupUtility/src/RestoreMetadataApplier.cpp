@@ -0,0 +1,162 @@
+// file RestoreMetadataApplier.cpp:
+
+#include "RestoreMetadataApplier.hpp"
+
+#include "FileIterator/FileMetadata.hpp"
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <atomic>
+#include <cstddef>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifndef _WIN32
+constexpr long NanosecondsPerSecond = 1000000000L;
+
+/**
+ * @brief Permission, set-id and sticky bits of a recorded mode; the file type bits are not settable.
+ */
+constexpr std::uint32_t SettableModeBits = 07777;
+
+/**
+ * @brief Directories queued per applying thread.
+ */
+constexpr std::size_t QueuedDirectoriesPerThread = 4;
+
+/**
+ * @brief Convert nanoseconds since the Unix epoch to a timespec.
+ */
+struct timespec ToTimespec(std::int64_t timeNs)
+{
+    struct timespec time{};
+    time.tv_sec = static_cast<time_t>(timeNs / NanosecondsPerSecond);
+    time.tv_nsec = static_cast<long>(timeNs % NanosecondsPerSecond);
+    if (0 > time.tv_nsec)
+    {
+        time.tv_sec -= 1;
+        time.tv_nsec += NanosecondsPerSecond;
+    }
+    return time;
+}
+#endif
+}
+
+RestoreMetadataApplier::RestoreMetadataApplier(const std::filesystem::path& targetRoot, const std::unordered_map<std::string, RestoreItem>& items)
+    : _targetRoot(targetRoot)
+{
+    for (const auto& entry : items)
+    {
+        if (true == entry.second.hasMetadata)
+        {
+            _directories[std::filesystem::path(entry.first).parent_path().string()].push_back(&entry);
+        }
+    }
+}
+
+bool RestoreMetadataApplier::IsSupported()
+{
+#ifdef _WIN32
+    return false;
+#else
+    return true;
+#endif
+}
+
+bool RestoreMetadataApplier::Apply(unsigned int threadCount) const
+{
+    if ((false == IsSupported()) || (true == _directories.empty()))
+    {
+        return true;
+    }
+
+    std::atomic<bool> success{true};
+    ThreadedFileQueue directoryQueue(
+        threadCount, static_cast<std::size_t>(threadCount) * QueuedDirectoriesPerThread,
+        [&](const std::filesystem::path& directoryKey)
+        {
+            const std::string key = directoryKey.string();
+            if (false == ApplyDirectory(key, _directories.at(key)))
+            {
+                success.store(false);
+            }
+        },
+        nullptr, ThreadedFileQueueOptions{});
+    std::vector<FileWorkItem> workItems;
+    workItems.reserve(_directories.size());
+    for (const auto& directory : _directories)
+    {
+        workItems.push_back(FileWorkItem{directory.first, directory.second.size()});
+    }
+    directoryQueue.EnqueueBatch(std::move(workItems));
+    directoryQueue.Finalize();
+    return success.load();
+}
+
+/**
+ * @brief Apply the metadata of the files of one directory through a single directory handle.
+ *
+ * @param[in] directoryKey Directory relative to the target root, empty for the root itself
+ * @param[in] files Files of the directory
+ * @return true on success, false if a file's metadata could not be applied
+ */
+bool RestoreMetadataApplier::ApplyDirectory(const std::string& directoryKey, const std::vector<const PlannedFile*>& files) const
+{
+#ifdef _WIN32
+    static_cast<void>(directoryKey);
+    static_cast<void>(files);
+    return true;
+#else
+    const std::filesystem::path directory = _targetRoot / directoryKey;
+    const int directoryDescriptor = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (0 > directoryDescriptor)
+    {
+        // Nothing of the directory was restored.
+        return ENOENT == errno;
+    }
+
+    bool success = true;
+    for (const PlannedFile* file : files)
+    {
+        const std::string name = std::filesystem::path(file->first).filename().string();
+        const FileMetadata& metadata = file->second.metadata;
+        if (0 != fchownat(directoryDescriptor, name.c_str(), metadata.userId, metadata.groupId, AT_SYMLINK_NOFOLLOW))
+        {
+            if (ENOENT == errno)
+            {
+                continue;
+            }
+            if (EPERM != errno)
+            {
+                success = false;
+                continue;
+            }
+        }
+        if (0 != fchmodat(directoryDescriptor, name.c_str(), static_cast<mode_t>(metadata.mode & SettableModeBits), 0))
+        {
+            success = false;
+            continue;
+        }
+        // Attributes the target filesystem or the process may not set are dropped like a foreign owner.
+        if ((false == file->second.extendedAttributes.empty()) &&
+            (false == WriteExtendedAttributes(directory / name, file->second.extendedAttributes)) && (ENOTSUP != errno) && (EPERM != errno))
+        {
+            success = false;
+            continue;
+        }
+        const struct timespec times[2] = {ToTimespec(metadata.accessTimeNs), ToTimespec(metadata.modificationTimeNs)};
+        if (0 != utimensat(directoryDescriptor, name.c_str(), times, AT_SYMLINK_NOFOLLOW))
+        {
+            success = false;
+        }
+    }
+    close(directoryDescriptor);
+    return success;
+#endif
+}
@@ -0,0 +1,56 @@
+// file RestoreMetadataApplier.hpp:
+
+#pragma once
+
+#include "RestorePlanner.hpp"
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Application component applying the recorded mode, owner, times and extended attributes to restored files.
+ *
+ * Files are grouped by directory. Each directory is opened once and its files are changed through the
+ * directory handle, so every call resolves a single name instead of the whole path, and directories are
+ * spread over threads. The owner is set before the mode, because changing it clears the set-id bits, and
+ * the times last. An owner the process may not give is kept; everything else failing fails the restore.
+ * Metadata is applied on POSIX only, see IsSupported.
+ */
+class RestoreMetadataApplier
+{
+  public:
+    /**
+     * @brief Collect the restored files that carry metadata.
+     *
+     * @param[in] targetRoot Directory the tree was restored into
+     * @param[in] items Planned files keyed by their path relative to the source root; must outlive the applier
+     */
+    RestoreMetadataApplier(const std::filesystem::path& targetRoot, const std::unordered_map<std::string, RestoreItem>& items);
+
+    /**
+     * @brief Check whether this platform can apply metadata.
+     *
+     * @return true on POSIX, false on Windows
+     */
+    static bool IsSupported();
+
+    /**
+     * @brief Apply the metadata of every collected file; call once every file is restored.
+     *
+     * Files missing from the target, whose restore failed, are skipped.
+     *
+     * @param[in] threadCount Threads applying directories in parallel
+     * @return true on success, false if a file's metadata could not be applied
+     */
+    bool Apply(unsigned int threadCount) const;
+
+  private:
+    using PlannedFile = std::unordered_map<std::string, RestoreItem>::value_type;
+
+    bool ApplyDirectory(const std::string& directoryKey, const std::vector<const PlannedFile*>& files) const;
+
+    std::filesystem::path _targetRoot;
+    std::unordered_map<std::string, std::vector<const PlannedFile*>> _directories;
+};
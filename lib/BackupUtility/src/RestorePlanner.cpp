@@ -0,0 +1,268 @@
+// file RestorePlanner.cpp:
+
+#include "RestorePlanner.hpp"
+
+#include "ChunkStore.hpp"
+#include "FileDelta.hpp"
+#include "RelativePathBuilder.hpp"
+#include "SnapshotTierMover.hpp"
+#include "FileCompressor/FileCompressor.hpp"
+
+#include <algorithm>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+/**
+ * @brief Suffixes naming the archived forms other than a plain copy.
+ */
+struct ArchivedSuffix
+{
+    const char* suffix;   /**< Suffix appended to the archived path */
+    RestoreSource source; /**< Form it stands for */
+};
+
+constexpr ArchivedSuffix ArchivedSuffixes[] = {{ChunkStore::ManifestSuffix, RestoreSource::Chunked},
+                                               {FileCompressor::CompressedSuffix, RestoreSource::Compressed},
+                                               {FileDelta::DeltaSuffix, RestoreSource::Delta}};
+
+/**
+ * @brief Check whether a string ends with a suffix.
+ */
+bool EndsWith(const std::string& value, const std::string& suffix)
+{
+    return (suffix.size() < value.size()) && (0 == value.compare(value.size() - suffix.size(), suffix.size(), suffix));
+}
+}
+
+RestorePlanner::RestorePlanner(const std::filesystem::path& backupRoot, FileStateRepository& fileStateRepository, PackStore& packStore)
+    : _backupRoot(backupRoot), _fileStateRepository(fileStateRepository), _packStore(packStore)
+{
+}
+
+bool RestorePlanner::Build(const std::string& asOf, std::unordered_map<std::string, RestoreItem>& outputItems)
+{
+    outputItems.clear();
+    if (false == _fileStateRepository.GetColdSnapshots(_coldRoots))
+    {
+        return false;
+    }
+    // Versions arrive oldest first, so a later version of the same path replaces an earlier one.
+    std::unordered_set<std::string> currentPaths;
+    const bool listed = _fileStateRepository.ForEachVersionAsOf(asOf,
+                                                                [&](const FileVersionRecord& version)
+                                                                {
+                                                                    outputItems[version.path] = ResolveVersion(version);
+                                                                    if (true == version.snapshot.empty())
+                                                                    {
+                                                                        currentPaths.insert(version.path);
+                                                                    }
+                                                                    else
+                                                                    {
+                                                                        currentPaths.erase(version.path);
+                                                                    }
+                                                                    return true;
+                                                                });
+    if ((false == listed) || (false == AttachMetadata(currentPaths, outputItems)))
+    {
+        return false;
+    }
+    return (true == asOf.empty()) || (true == AddUntrackedVersions(asOf, outputItems));
+}
+
+/**
+ * @brief Attach the recorded mode, owner, times and extended attributes to the planned current versions.
+ *
+ * A row whose digest differs from the planned version, or that was recorded before modes were, is left out.
+ *
+ * @param[in] currentPaths Paths whose planned version is the current one
+ * @param[in,out] outputItems Files to restore
+ * @return true on success, false if the file states cannot be read
+ */
+bool RestorePlanner::AttachMetadata(const std::unordered_set<std::string>& currentPaths, std::unordered_map<std::string, RestoreItem>& outputItems)
+{
+    if (true == currentPaths.empty())
+    {
+        return true;
+    }
+    return _fileStateRepository.ForEachFileState(
+        [&](const std::string& filePath, const FileStateRecord& record)
+        {
+            if ((ChangeType::Deleted == record.status) || (0 == record.metadata.mode) || (0 == currentPaths.count(filePath)))
+            {
+                return true;
+            }
+            RestoreItem& item = outputItems.at(filePath);
+            if ((item.hash == record.hash) && (item.hashAlgorithm == record.hashAlgorithm))
+            {
+                item.hasMetadata = true;
+                item.metadata = record.metadata;
+                item.extendedAttributes = record.extendedAttributes;
+            }
+            return true;
+        });
+}
+
+/**
+ * @brief Locate the stored form of a version from the version history.
+ *
+ * An archived version is a plain copy unless only a manifest, compressed file or delta of it exists. A
+ * version without a file of its own is packed if the pack index has its digest.
+ *
+ * @param[in] version Version to locate
+ * @return Stored version with its digest
+ */
+RestoreItem RestorePlanner::ResolveVersion(const FileVersionRecord& version) const
+{
+    RestoreItem item{_backupRoot / "backup" / version.path, RestoreSource::Backup, version.size, true, version.hash, version.hashAlgorithm,
+                     PackLocation{}, false, FileMetadata{}, std::string()};
+    std::error_code ec;
+    if (true == version.snapshot.empty())
+    {
+        if (false == std::filesystem::exists(item.storedPath, ec))
+        {
+            ResolvePacked(item);
+        }
+        return item;
+    }
+    item.storedPath = SnapshotTierMover::SnapshotDirectory(_backupRoot, _coldRoots, version.snapshot) / version.path;
+    item.source = RestoreSource::Plain;
+    if (true == std::filesystem::exists(item.storedPath, ec))
+    {
+        return item;
+    }
+    for (const ArchivedSuffix& archived : ArchivedSuffixes)
+    {
+        std::filesystem::path candidate = item.storedPath;
+        candidate += archived.suffix;
+        if (true == std::filesystem::exists(candidate, ec))
+        {
+            item.storedPath = candidate;
+            item.source = archived.source;
+            return item;
+        }
+    }
+    ResolvePacked(item);
+    return item;
+}
+
+/**
+ * @brief Point a version without a file of its own at its packed content, if the pack index has its digest.
+ *
+ * @param[in,out] item Stored version, left unchanged when its content is not packed
+ */
+void RestorePlanner::ResolvePacked(RestoreItem& item) const
+{
+    if (true == _packStore.Find(item.hash, item.hashAlgorithm, item.packLocation))
+    {
+        // An inline content has no file; its bytes came with the location.
+        item.storedPath = (PackStore::InlineSegment == item.packLocation.segment) ? std::filesystem::path()
+                                                                                  : PackStore::SegmentPath(_packStore.Root(), item.packLocation.segment);
+        item.source = RestoreSource::Packed;
+    }
+}
+
+/**
+ * @brief Add versions from snapshot directories newer than a point in time that the snapshots table lacks.
+ *
+ * Such snapshots were written before the version history existed. The oldest one holding a file wins,
+ * unless the version history already has the file's version at that time. An archived name with a form
+ * suffix is taken as that form only when the file state rows know the name without the suffix and not
+ * with it, so a source file that happens to end in `.zst` stays a plain copy.
+ *
+ * @param[in] asOf Point in time
+ * @param[in,out] outputItems Files to restore
+ * @return true on success, false if the snapshots cannot be listed
+ */
+bool RestorePlanner::AddUntrackedVersions(const std::string& asOf, std::unordered_map<std::string, RestoreItem>& outputItems)
+{
+    const std::filesystem::path historyRoot = _backupRoot / "deleted";
+    std::error_code ec;
+    if (false == std::filesystem::exists(historyRoot, ec))
+    {
+        return true;
+    }
+
+    std::vector<std::string> trackedNames;
+    if (false == _fileStateRepository.GetSnapshotNames(trackedNames))
+    {
+        return false;
+    }
+    const std::unordered_set<std::string> tracked(trackedNames.begin(), trackedNames.end());
+    std::vector<std::string> snapshots;
+    for (const auto& entry : std::filesystem::directory_iterator(historyRoot, ec))
+    {
+        const std::string name = entry.path().filename().string();
+        if ((true == entry.is_directory(ec)) && (asOf < name) && (0 == tracked.count(name)))
+        {
+            snapshots.push_back(name);
+        }
+    }
+    if (0 != ec.value())
+    {
+        return false;
+    }
+    if (true == snapshots.empty())
+    {
+        return true;
+    }
+    // Oldest first, so the first snapshot holding a file wins.
+    std::sort(snapshots.begin(), snapshots.end());
+
+    std::unordered_set<std::string> knownPaths;
+    const bool loaded = _fileStateRepository.ForEachFileState(
+        [&](const std::string& filePath, const FileStateRecord&)
+        {
+            knownPaths.insert(filePath);
+            return true;
+        });
+    if (false == loaded)
+    {
+        return false;
+    }
+
+    for (const auto& name : snapshots)
+    {
+        const std::filesystem::path snapshotRoot = historyRoot / name;
+        for (auto iterator = std::filesystem::recursive_directory_iterator(snapshotRoot, ec);
+             (0 == ec.value()) && (std::filesystem::recursive_directory_iterator() != iterator); iterator.increment(ec))
+        {
+            if (false == iterator->is_regular_file(ec))
+            {
+                continue;
+            }
+            std::string relativeKey = RelativePathBuilder::KeyOf(iterator->path().lexically_relative(snapshotRoot));
+            RestoreSource source = RestoreSource::Plain;
+            for (const ArchivedSuffix& archived : ArchivedSuffixes)
+            {
+                const std::string suffix = archived.suffix;
+                if ((false == EndsWith(relativeKey, suffix)) || (0 != knownPaths.count(relativeKey)))
+                {
+                    continue;
+                }
+                const std::string strippedKey = relativeKey.substr(0, relativeKey.size() - suffix.size());
+                if (0 != knownPaths.count(strippedKey))
+                {
+                    relativeKey = strippedKey;
+                    source = archived.source;
+                    break;
+                }
+            }
+            if (0 != outputItems.count(relativeKey))
+            {
+                continue;
+            }
+            const std::uintmax_t size = iterator->file_size(ec);
+            outputItems.emplace(relativeKey, RestoreItem{iterator->path(), source, (0 == ec.value()) ? size : 0, false, HashDigest{},
+                                                         HashAlgorithm{}, PackLocation{}, false, FileMetadata{}, std::string()});
+            ec.clear();
+        }
+        if (0 != ec.value())
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+// file RestorePlanner.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+#include "PackStore.hpp"
+#include "FileHasher/FileHasher.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * @brief Form in which the version of a file to restore is stored.
+ */
+enum class RestoreSource
+{
+    Backup,     /**< Current version under backup/ */
+    Plain,      /**< Archived copy under deleted/<timestamp>/, possibly a content store link */
+    Chunked,    /**< Chunk manifest under deleted/<timestamp>/ */
+    Compressed, /**< zstd file under deleted/<timestamp>/ */
+    Delta,      /**< Reverse delta under deleted/<timestamp>/ */
+    Packed      /**< Content in a pack segment under packs/ */
+};
+
+/**
+ * @brief One file of the tree to restore.
+ */
+struct RestoreItem
+{
+    std::filesystem::path storedPath; /**< Stored version: backup copy, archived copy, manifest, compressed file or delta */
+    RestoreSource source;             /**< Form of storedPath */
+    std::uint64_t size;               /**< Stored size in bytes, used as the cost hint */
+    bool hasDigest;                   /**< hash and hashAlgorithm describe the restored content */
+    HashDigest hash;                  /**< Digest of the version from the version history */
+    HashAlgorithm hashAlgorithm;      /**< Algorithm of hash */
+    PackLocation packLocation;        /**< Where a packed version is, only set for Packed */
+    bool hasMetadata;                 /**< metadata and extendedAttributes were recorded for this version */
+    FileMetadata metadata;            /**< Recorded mode, owner and times, meaningful if hasMetadata */
+    std::string extendedAttributes;   /**< Recorded extended attributes in the ReadExtendedAttributes encoding */
+};
+
+/**
+ * @brief Decides which stored version of every tracked file makes up the tree as of a point in time.
+ *
+ * The version history names, for every version, when it became current and which snapshot received it,
+ * so the tree at a point in time is one query. Snapshot directories older than the version history are
+ * not in the snapshots table; they are walked instead. The snapshot of a run holds the versions that run
+ * replaced or deleted, so the oldest such snapshot newer than the point in time holding a file has the
+ * version that was current then. Those versions have no stored digest. A version with no file of its own
+ * in any form is looked up by its digest in the pack segments. Mode, owner, times and extended attributes
+ * are only recorded for the current version of a file, so only versions that are still current carry them.
+ */
+class RestorePlanner
+{
+  public:
+    /**
+     * @brief Construct a planner.
+     *
+     * @param[in] backupRoot Root directory of the backup storage, holding backup/ and deleted/
+     * @param[in] fileStateRepository Repository of the backup's file states
+     * @param[in] packStore Index of the pack segments
+     */
+    RestorePlanner(const std::filesystem::path& backupRoot, FileStateRepository& fileStateRepository, PackStore& packStore);
+
+    /**
+     * @brief Plan the tree as of a point in time.
+     *
+     * @param[in] asOf Timestamp or a prefix of one, which stands for the start of that period; empty plans the latest run
+     * @param[out] outputItems Files to restore keyed by their path relative to the source root
+     * @return true on success, false if the file states or snapshots cannot be read
+     */
+    bool Build(const std::string& asOf, std::unordered_map<std::string, RestoreItem>& outputItems);
+
+  private:
+    RestoreItem ResolveVersion(const FileVersionRecord& version) const;
+    void ResolvePacked(RestoreItem& item) const;
+    bool AttachMetadata(const std::unordered_set<std::string>& currentPaths, std::unordered_map<std::string, RestoreItem>& outputItems);
+    bool AddUntrackedVersions(const std::string& asOf, std::unordered_map<std::string, RestoreItem>& outputItems);
+
+    std::filesystem::path _backupRoot;
+    FileStateRepository& _fileStateRepository;
+    PackStore& _packStore;
+    std::unordered_map<std::string, std::filesystem::path> _coldRoots; /**< Cold tier root of each snapshot moved there */
+};
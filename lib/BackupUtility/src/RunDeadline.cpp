@@ -0,0 +1,53 @@
+#include "RunDeadline.hpp"
+
+RunDeadline::RunDeadline(std::atomic<bool>* stopRequested, std::chrono::seconds timeLimit)
+    : _ownFlag(false), _stopFlag(stopRequested), _stopping(false)
+{
+    if (std::chrono::seconds::zero() >= timeLimit)
+    {
+        return;
+    }
+    if (nullptr == _stopFlag)
+    {
+        _stopFlag = &_ownFlag;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + timeLimit;
+    _timer = std::thread([this, deadline]() { TimerLoop(deadline); });
+}
+
+RunDeadline::~RunDeadline()
+{
+    {
+        std::lock_guard<std::mutex> lock(_stopMutex);
+        _stopping = true;
+    }
+    _stopCv.notify_one();
+    if (true == _timer.joinable())
+    {
+        _timer.join();
+    }
+}
+
+const std::atomic<bool>* RunDeadline::StopFlag() const
+{
+    return _stopFlag;
+}
+
+bool RunDeadline::IsStopRequested() const
+{
+    return (nullptr != _stopFlag) && (true == _stopFlag->load());
+}
+
+/**
+ * @brief Timer thread: raise the stop flag at the deadline unless the run ended first.
+ *
+ * @param[in] deadline Time the run is stopped at
+ */
+void RunDeadline::TimerLoop(std::chrono::steady_clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> lock(_stopMutex);
+    if (false == _stopCv.wait_until(lock, deadline, [this]() { return _stopping; }))
+    {
+        _stopFlag->store(true);
+    }
+}
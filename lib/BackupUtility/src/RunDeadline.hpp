@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Stop flag of a backup run, raised by the caller or once the run's time limit has passed.
+ *
+ * A timer thread sleeps until the deadline or until the run ends, whichever comes first, so the workers
+ * and the walker check for a stop with one relaxed load and never read the clock.
+ */
+class RunDeadline
+{
+  public:
+    /**
+     * @brief Start the timer if the run has a time limit.
+     *
+     * @param[in,out] stopRequested Flag the caller sets to stop the run, also set at the deadline; nullptr uses a flag of its own
+     * @param[in] timeLimit Time from construction until the run is stopped, 0 for no limit
+     */
+    RunDeadline(std::atomic<bool>* stopRequested, std::chrono::seconds timeLimit);
+
+    /**
+     * @brief Stop the timer thread.
+     */
+    ~RunDeadline();
+
+    RunDeadline(const RunDeadline&) = delete;
+    RunDeadline& operator=(const RunDeadline&) = delete;
+
+    /**
+     * @brief Get the flag to hand to the walker and the queues.
+     *
+     * @return Stop flag, nullptr if the run can neither be stopped nor time out
+     */
+    const std::atomic<bool>* StopFlag() const;
+
+    /**
+     * @brief Check whether the run was asked to stop.
+     *
+     * @return true once the flag is set
+     */
+    bool IsStopRequested() const;
+
+  private:
+    void TimerLoop(std::chrono::steady_clock::time_point deadline);
+
+    std::atomic<bool> _ownFlag;
+    std::atomic<bool>* _stopFlag;
+    std::mutex _stopMutex;
+    std::condition_variable _stopCv;
+    bool _stopping;
+    std::thread _timer;
+};
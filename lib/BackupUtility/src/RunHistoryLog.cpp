@@ -0,0 +1,200 @@
+// file RunHistoryLog.cpp:
+
+#include "RunHistoryLog.hpp"
+
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace
+{
+// Times are stored in whole microseconds, as SQLite statements here bind integers only.
+constexpr const char* SqlCreateRunHistoryTable = "CREATE TABLE IF NOT EXISTS run_history ("
+                                                 "id INTEGER PRIMARY KEY,"
+                                                 "run_id INTEGER,"
+                                                 "started TEXT NOT NULL,"
+                                                 "finished INTEGER NOT NULL,"
+                                                 "elapsed_us INTEGER NOT NULL,"
+                                                 "outcome TEXT NOT NULL,"
+                                                 "files_unchanged INTEGER NOT NULL,"
+                                                 "files_added INTEGER NOT NULL,"
+                                                 "files_modified INTEGER NOT NULL,"
+                                                 "files_deleted INTEGER NOT NULL,"
+                                                 "files_moved INTEGER NOT NULL,"
+                                                 "bytes_read INTEGER NOT NULL,"
+                                                 "bytes_written INTEGER NOT NULL,"
+                                                 "bytes_hashed INTEGER NOT NULL,"
+                                                 "walk_threads INTEGER NOT NULL,"
+                                                 "hash_threads INTEGER NOT NULL,"
+                                                 "copy_threads INTEGER NOT NULL);";
+
+constexpr const char* SqlCreateRunHistoryStagesTable = "CREATE TABLE IF NOT EXISTS run_history_stages ("
+                                                       "history_id INTEGER NOT NULL,"
+                                                       "stage TEXT NOT NULL,"
+                                                       "wall_us INTEGER NOT NULL,"
+                                                       "cpu_us INTEGER NOT NULL,"
+                                                       "PRIMARY KEY (history_id, stage));";
+
+/**
+ * @brief Convert seconds to whole microseconds.
+ *
+ * @param[in] seconds Duration in seconds
+ * @return Duration in microseconds, rounded to the nearest
+ */
+std::int64_t ToMicroseconds(double seconds)
+{
+    return static_cast<std::int64_t>(std::llround(seconds * 1e6));
+}
+
+/**
+ * @brief Convert whole microseconds to seconds.
+ *
+ * @param[in] microseconds Duration in microseconds
+ * @return Duration in seconds
+ */
+double ToSeconds(std::int64_t microseconds)
+{
+    return static_cast<double>(microseconds) / 1e6;
+}
+}
+
+RunHistoryLog::RunHistoryLog(SQLiteSession& databaseSession) : _databaseSession(databaseSession)
+{
+}
+
+bool RunHistoryLog::InitializeSchema()
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute(SqlCreateRunHistoryTable);
+        connection.Execute(SqlCreateRunHistoryStagesTable);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool RunHistoryLog::Record(const BackupStats& stats, RunOutcome outcome, std::int64_t finishedAt)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            auto insertEntry = connection.Prepare("INSERT INTO run_history(run_id, started, finished, elapsed_us, outcome, files_unchanged, files_added, "
+                                                  "files_modified, files_deleted, files_moved, bytes_read, bytes_written, bytes_hashed, walk_threads, "
+                                                  "hash_threads, copy_threads) VALUES((SELECT max(id) FROM runs WHERE started=?1), ?1, ?2, ?3, ?4, "
+                                                  "?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14, ?15) RETURNING id;");
+            insertEntry.BindText(1, stats.runTimestamp);
+            insertEntry.BindInt64(2, finishedAt);
+            insertEntry.BindInt64(3, ToMicroseconds(stats.elapsedSeconds));
+            insertEntry.BindText(4, RunOutcomeToString(outcome));
+            for (std::size_t change = 0; change < ChangeTypeCount; ++change)
+            {
+                insertEntry.BindInt64(5 + static_cast<int>(change), static_cast<std::int64_t>(stats.filesByChange[change]));
+            }
+            insertEntry.BindInt64(9, static_cast<std::int64_t>(stats.filesMoved));
+            insertEntry.BindInt64(10, static_cast<std::int64_t>(stats.bytesRead));
+            insertEntry.BindInt64(11, static_cast<std::int64_t>(stats.bytesWritten));
+            insertEntry.BindInt64(12, static_cast<std::int64_t>(stats.bytesHashed));
+            insertEntry.BindInt64(13, stats.walkThreads);
+            insertEntry.BindInt64(14, stats.hashThreads);
+            insertEntry.BindInt64(15, stats.copyThreads);
+            if (false == insertEntry.FetchRow())
+            {
+                connection.Execute("ROLLBACK;");
+                return false;
+            }
+            const std::int64_t historyId = insertEntry.ColumnInt64(0);
+            insertEntry.Reset();
+            for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+            {
+                auto cachedStatement = connection.PrepareCached("INSERT INTO run_history_stages VALUES (?1, ?2, ?3, ?4);");
+                cachedStatement->BindInt64(1, historyId);
+                cachedStatement->BindText(2, BackupStageToString(static_cast<BackupStage>(stage)));
+                cachedStatement->BindInt64(3, ToMicroseconds(stats.stages[stage].wallSeconds));
+                cachedStatement->BindInt64(4, ToMicroseconds(stats.stages[stage].cpuSeconds));
+                if (false == cachedStatement->ExecuteStatement())
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool RunHistoryLog::GetLatest(std::size_t limit, std::vector<RunHistoryEntry>& outputEntries)
+{
+    outputEntries.clear();
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT id, run_id, started, finished, elapsed_us, outcome, files_unchanged, files_added, files_modified, "
+                                            "files_deleted, files_moved, bytes_read, bytes_written, bytes_hashed, walk_threads, hash_threads, "
+                                            "copy_threads FROM run_history ORDER BY id DESC LIMIT ?1;");
+        // A negative limit is no limit to SQLite.
+        statement.BindInt64(1, (0 == limit) ? -1 : static_cast<std::int64_t>(limit));
+        std::vector<std::int64_t> historyIds;
+        while (true == statement.FetchRow())
+        {
+            RunHistoryEntry entry{};
+            historyIds.push_back(statement.ColumnInt64(0));
+            entry.runId = statement.ColumnInt64(1);
+            entry.started = statement.ColumnText(2);
+            entry.finishedAt = statement.ColumnInt64(3);
+            entry.elapsedSeconds = ToSeconds(statement.ColumnInt64(4));
+            entry.outcome = StringToRunOutcome(statement.ColumnView(5));
+            for (std::size_t change = 0; change < ChangeTypeCount; ++change)
+            {
+                entry.filesByChange[change] = static_cast<std::size_t>(statement.ColumnInt64(6 + static_cast<int>(change)));
+            }
+            entry.filesMoved = static_cast<std::size_t>(statement.ColumnInt64(10));
+            entry.bytesRead = static_cast<std::uint64_t>(statement.ColumnInt64(11));
+            entry.bytesWritten = static_cast<std::uint64_t>(statement.ColumnInt64(12));
+            entry.bytesHashed = static_cast<std::uint64_t>(statement.ColumnInt64(13));
+            entry.walkThreads = static_cast<unsigned int>(statement.ColumnInt64(14));
+            entry.hashThreads = static_cast<unsigned int>(statement.ColumnInt64(15));
+            entry.copyThreads = static_cast<unsigned int>(statement.ColumnInt64(16));
+            outputEntries.push_back(std::move(entry));
+        }
+        for (std::size_t index = 0; index < historyIds.size(); ++index)
+        {
+            auto cachedStatement = connection.PrepareCached("SELECT stage, wall_us, cpu_us FROM run_history_stages WHERE history_id=?1;");
+            cachedStatement->BindInt64(1, historyIds[index]);
+            while (true == cachedStatement->FetchRow())
+            {
+                for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+                {
+                    if (cachedStatement->ColumnView(0) == BackupStageToString(static_cast<BackupStage>(stage)))
+                    {
+                        outputEntries[index].stages[stage] = BackupStageTime{ToSeconds(cachedStatement->ColumnInt64(1)), ToSeconds(cachedStatement->ColumnInt64(2))};
+                    }
+                }
+            }
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
@@ -0,0 +1,56 @@
+// file RunHistoryLog.hpp:
+
+#pragma once
+
+#include "BackupUtility/BackupUtility.hpp"
+#include "SQLite/SQLiteSession.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Measurements of past backup runs in the state database, one row per attempt.
+ *
+ * A stopped run that the next one resumes keeps its entry in the runs table, so both attempts are
+ * recorded against the same run.
+ */
+class RunHistoryLog
+{
+  public:
+    /**
+     * @brief Create a log bound to a SQLite session on the state database.
+     *
+     * @param[in] databaseSession Active SQLite session for the state database
+     */
+    explicit RunHistoryLog(SQLiteSession& databaseSession);
+
+    /**
+     * @brief Create the history tables if they do not exist.
+     *
+     * @return true on success, false on error
+     */
+    bool InitializeSchema();
+
+    /**
+     * @brief Record the measurements of an attempt, in one transaction.
+     *
+     * @param[in] stats Measurements of the attempt; runTimestamp ties it to its entry in the runs table
+     * @param[in] outcome How the attempt ended
+     * @param[in] finishedAt End of the attempt in seconds since the Unix epoch
+     * @return true on success, false on error
+     */
+    bool Record(const BackupStats& stats, RunOutcome outcome, std::int64_t finishedAt);
+
+    /**
+     * @brief Get the latest recorded attempts.
+     *
+     * @param[in] limit Most attempts returned, 0 for all
+     * @param[out] outputEntries Attempts, newest first
+     * @return true on success, false on error
+     */
+    bool GetLatest(std::size_t limit, std::vector<RunHistoryEntry>& outputEntries);
+
+  private:
+    SQLiteSession& _databaseSession;
+};
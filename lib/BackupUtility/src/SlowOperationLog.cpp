@@ -0,0 +1,38 @@
+#include "SlowOperationLog.hpp"
+
+#include <iomanip>
+#include <string>
+
+namespace
+{
+constexpr double NanosecondsPerMillisecond = 1e6;
+}
+
+SlowOperationLog::SlowOperationLog(const std::filesystem::path& logFile, std::uint64_t thresholdNs)
+    : _thresholdNs(thresholdNs), _stream(logFile, std::ios::trunc)
+{
+    _stream << std::fixed << std::setprecision(3);
+}
+
+bool SlowOperationLog::IsOpen() const
+{
+    return _stream.is_open();
+}
+
+void SlowOperationLog::Record(const char* stage, const std::filesystem::path* file, std::uint64_t durationNs)
+{
+    std::lock_guard<std::mutex> lock(_streamMutex);
+    _stream << (static_cast<double>(durationNs) / NanosecondsPerMillisecond) << '\t' << stage << '\t'
+            << ((nullptr != file) ? file->string() : std::string("-")) << '\n';
+}
+
+bool SlowOperationLog::Close()
+{
+    std::lock_guard<std::mutex> lock(_streamMutex);
+    if (false == _stream.is_open())
+    {
+        return false;
+    }
+    _stream.close();
+    return false == _stream.fail();
+}
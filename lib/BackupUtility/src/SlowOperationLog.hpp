@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+
+/**
+ * @brief Appends the operations of a backup run that took longer than a threshold to a text file.
+ *
+ * Each line holds the duration in milliseconds, the stage and the source file, separated by tabs; the
+ * file is "-" for operations not done for one file, such as handing over a batch of the walk. Slow
+ * operations are rare, so the threads share one stream under a lock, and each line is written as it
+ * happens, so the log is useful while the run is still going.
+ */
+class SlowOperationLog
+{
+  public:
+    /**
+     * @brief Create or truncate the log file.
+     *
+     * @param[in] logFile File to write
+     * @param[in] thresholdNs Operations taking at least this long are logged
+     */
+    SlowOperationLog(const std::filesystem::path& logFile, std::uint64_t thresholdNs);
+
+    SlowOperationLog(const SlowOperationLog&) = delete;
+    SlowOperationLog& operator=(const SlowOperationLog&) = delete;
+
+    /**
+     * @brief Check whether the log file could be created.
+     *
+     * @return true if operations can be logged
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Check whether an operation is slow enough to be logged.
+     *
+     * @param[in] durationNs Duration of the operation in nanoseconds
+     * @return true if Record should be called for it
+     */
+    bool IsSlow(std::uint64_t durationNs) const
+    {
+        return _thresholdNs <= durationNs;
+    }
+
+    /**
+     * @brief Append an operation to the log.
+     *
+     * @param[in] stage Static stage name
+     * @param[in] file Source file the operation was done for, nullptr for none
+     * @param[in] durationNs Duration of the operation in nanoseconds
+     */
+    void Record(const char* stage, const std::filesystem::path* file, std::uint64_t durationNs);
+
+    /**
+     * @brief Flush and close the log file.
+     *
+     * @return true if every line was written, false otherwise
+     */
+    bool Close();
+
+  private:
+    std::uint64_t _thresholdNs;
+    std::mutex _streamMutex;
+    std::ofstream _stream;
+};
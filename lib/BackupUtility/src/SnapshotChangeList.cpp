@@ -0,0 +1,200 @@
+// file SnapshotChangeList.cpp:
+
+#include "SnapshotChangeList.hpp"
+#include "RelativePathBuilder.hpp"
+
+#include <cstddef>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+constexpr const char* FindNewPrefix = "inode ";
+constexpr const char* FindNewMarker = "transid marker was ";
+/**
+ * @brief Fields of a find-new line before its path: inode, file offset, len, disk start, offset, gen and flags with their values.
+ */
+constexpr std::size_t FindNewFieldsBeforePath = 16;
+constexpr std::size_t ZfsEscapeDigits = 4;
+constexpr int OctalBase = 8;
+
+/**
+ * @brief Decode the `\0ooo` octal escapes zfs diff writes for spaces and unprintable bytes.
+ *
+ * @param[in] text Escaped path
+ * @return Path with each escape replaced by its byte
+ */
+std::string DecodeEscapes(const std::string& text)
+{
+    std::string decoded;
+    decoded.reserve(text.size());
+    for (std::size_t index = 0; index < text.size(); ++index)
+    {
+        bool escape = ('\\' == text[index]) && (index + ZfsEscapeDigits < text.size());
+        int value = 0;
+        for (std::size_t digit = 1; (true == escape) && (digit <= ZfsEscapeDigits); ++digit)
+        {
+            const char character = text[index + digit];
+            escape = ('0' <= character) && ('7' >= character);
+            value = (value * OctalBase) + (character - '0');
+        }
+        if (true == escape)
+        {
+            decoded.push_back(static_cast<char>(value));
+            index += ZfsEscapeDigits;
+            continue;
+        }
+        decoded.push_back(text[index]);
+    }
+    return decoded;
+}
+
+/**
+ * @brief Mark a listed path and its parent as changed.
+ *
+ * @param[in] path Path from the list
+ * @param[in] listRoot Directory absolute paths are relative to
+ * @param[in] subtree Whether the path's own subtree changed as a whole
+ * @param[in,out] directories Changed directories by key, with whether their subtree changed
+ */
+void AddChange(const std::filesystem::path& path, const std::filesystem::path& listRoot, bool subtree, std::map<std::string, bool>& directories)
+{
+    std::filesystem::path relative = (true == path.is_absolute()) ? path.lexically_relative(listRoot) : path.lexically_normal();
+    if ((true == relative.empty()) || (".." == *relative.begin()))
+    {
+        return;
+    }
+    if (std::filesystem::path(".") == relative)
+    {
+        relative.clear();
+    }
+    // A directory that vanished or appeared is searched or walked below, which covers its own entries too.
+    const std::string key = RelativePathBuilder::KeyOf(relative);
+    directories[key] = (true == directories[key]) || (true == subtree);
+    if (false == key.empty())
+    {
+        const std::string parent = RelativePathBuilder::KeyOf(relative.parent_path());
+        directories.emplace(parent, false);
+    }
+}
+
+/**
+ * @brief Parse a line of `zfs diff -H`, with or without the file type column of -F.
+ *
+ * @param[in] line Line without its end
+ * @param[in] listRoot Directory absolute paths are relative to
+ * @param[in,out] directories Changed directories by key
+ * @return true if the line is a zfs diff line, false otherwise
+ */
+bool ParseZfsDiffLine(const std::string& line, const std::filesystem::path& listRoot, std::map<std::string, bool>& directories)
+{
+    std::vector<std::string> fields;
+    for (std::size_t start = 0;;)
+    {
+        const std::size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab - start));
+        if (std::string::npos == tab)
+        {
+            break;
+        }
+        start = tab + 1;
+    }
+    std::size_t firstPath = 1;
+    if ((3 <= fields.size()) && (1 == fields[1].size()))
+    {
+        firstPath = 2;
+    }
+    const std::size_t paths = fields.size() - firstPath;
+    if ((1 != fields[0].size()) || (0 == paths))
+    {
+        return false;
+    }
+    // Created, removed and renamed paths may be whole directories; a modified one changed only its own entries.
+    switch (fields[0][0])
+    {
+        case '+':
+        case '-':
+        case 'M':
+            if (1 != paths)
+            {
+                return false;
+            }
+            AddChange(DecodeEscapes(fields[firstPath]), listRoot, 'M' != fields[0][0], directories);
+            return true;
+        case 'R':
+            if (2 != paths)
+            {
+                return false;
+            }
+            AddChange(DecodeEscapes(fields[firstPath]), listRoot, true, directories);
+            AddChange(DecodeEscapes(fields[firstPath + 1]), listRoot, true, directories);
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief Parse a line of `btrfs subvolume find-new`, whose path follows sixteen space-separated fields.
+ *
+ * @param[in] line Line without its end
+ * @param[in] listRoot Directory absolute paths are relative to
+ * @param[in,out] directories Changed directories by key
+ * @return true if the line names a file, false otherwise
+ */
+bool ParseFindNewLine(const std::string& line, const std::filesystem::path& listRoot, std::map<std::string, bool>& directories)
+{
+    std::size_t position = 0;
+    for (std::size_t field = 0; (std::string::npos != position) && (field < FindNewFieldsBeforePath); ++field)
+    {
+        position = line.find(' ', position);
+        position = (std::string::npos == position) ? position : position + 1;
+    }
+    if ((std::string::npos == position) || (line.size() == position))
+    {
+        return false;
+    }
+    AddChange(line.substr(position), listRoot, false, directories);
+    return true;
+}
+} // namespace
+
+bool SnapshotChangeList::Read(const std::filesystem::path& listFile, const std::filesystem::path& listRoot, std::vector<ChangedDirectory>& outputDirectories)
+{
+    outputDirectories.clear();
+    std::ifstream input(listFile, std::ios::binary);
+    if (false == input.is_open())
+    {
+        return false;
+    }
+    std::map<std::string, bool> directories;
+    const std::filesystem::path root = listRoot.lexically_normal();
+    std::string line;
+    while (true == static_cast<bool>(std::getline(input, line)))
+    {
+        if ((false == line.empty()) && ('\r' == line.back()))
+        {
+            line.pop_back();
+        }
+        if ((true == line.empty()) || (0 == line.rfind(FindNewMarker, 0)))
+        {
+            continue;
+        }
+        const bool parsed = (0 == line.rfind(FindNewPrefix, 0)) ? ParseFindNewLine(line, root, directories) : ParseZfsDiffLine(line, root, directories);
+        if (false == parsed)
+        {
+            return false;
+        }
+    }
+    if (true == input.bad())
+    {
+        return false;
+    }
+    for (const auto& directory : directories)
+    {
+        outputDirectories.push_back(ChangedDirectory{directory.first, directory.second});
+    }
+    return true;
+}
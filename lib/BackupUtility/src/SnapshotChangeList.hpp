@@ -0,0 +1,34 @@
+// file SnapshotChangeList.hpp:
+
+#pragma once
+
+#include "ChangeJournal.hpp"
+
+#include <filesystem>
+#include <vector>
+
+/**
+ * @brief Changed-file list of a copy-on-write file system, turned into the directories a run lists.
+ *
+ * Reads the output of `zfs diff -H [-F] <previous> <current>` and of
+ * `btrfs subvolume find-new <subvolume> <generation>`. Each changed path dirties its parent directory;
+ * created, removed and renamed paths also dirty their own subtree, so a new or vanished directory is
+ * walked or searched for deletions as a whole. The lists say nothing about files they do not name, so a
+ * run is only as complete as the list: find-new reports files with new data extents only, and misses
+ * deletions, renames and metadata-only changes.
+ */
+class SnapshotChangeList
+{
+  public:
+    /**
+     * @brief Read a changed-file list.
+     *
+     * @param[in] listFile Output of `zfs diff -H` or `btrfs subvolume find-new`
+     * @param[in] listRoot Directory absolute paths of the list are relative to, usually the dataset's mountpoint;
+     *                     relative paths are taken as relative to the source directory already
+     * @param[out] outputDirectories Changed directories as keys relative to the source directory, each once;
+     *                               paths outside listRoot are left out
+     * @return true on success, false if the file cannot be read or a line is in neither format
+     */
+    static bool Read(const std::filesystem::path& listFile, const std::filesystem::path& listRoot, std::vector<ChangedDirectory>& outputDirectories);
+};
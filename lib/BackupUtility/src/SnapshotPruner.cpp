@@ -0,0 +1,346 @@
+// file SnapshotPruner.cpp:
+
+#include "SnapshotPruner.hpp"
+
+#include "ChunkStore.hpp"
+#include "ContentObjectStore.hpp"
+#include "FileDelta.hpp"
+#include "ParityFile.hpp"
+#include "SnapshotTierMover.hpp"
+#include "SnapshotTreeBuilder.hpp"
+#include "StateDatabaseCopy.hpp"
+#include "FileCopier/FileCopier.hpp"
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <set>
+#include <system_error>
+#include <unordered_set>
+
+SnapshotPruner::SnapshotPruner(const std::filesystem::path& backupRoot, FileStateRepository& fileStateRepository)
+    : _backupRoot(backupRoot), _fileStateRepository(fileStateRepository)
+{
+}
+
+bool SnapshotPruner::Plan(const RetentionPolicy& policy, PruneReport& outputReport)
+{
+    const std::vector<std::string> names = ListSnapshots();
+    if (false == _fileStateRepository.GetColdSnapshots(_coldRoots))
+    {
+        return false;
+    }
+    std::vector<std::string> kept = SelectSnapshotsToKeep(names, policy);
+
+    std::vector<ArchivedVersion> versions;
+    const bool listed = _fileStateRepository.ForEachArchivedVersion(
+        [&](const FileVersionRecord& version)
+        {
+            std::filesystem::path deltaPath = _backupRoot / "deleted" / version.snapshot / version.path;
+            deltaPath += FileDelta::DeltaSuffix;
+            std::error_code ec;
+            versions.push_back(ArchivedVersion{version.path, version.snapshot, version.hash, std::filesystem::exists(deltaPath, ec)});
+            return true;
+        });
+    if (false == listed)
+    {
+        return false;
+    }
+    outputReport.keptAsDeltaBasis = KeepDeltaBases(versions, kept);
+
+    const std::set<std::string> keptSet(kept.begin(), kept.end());
+    _pruned.clear();
+    for (const std::string& name : names)
+    {
+        if (0 == keptSet.count(name))
+        {
+            _pruned.push_back(name);
+        }
+    }
+    outputReport.kept.assign(keptSet.begin(), keptSet.end());
+    outputReport.pruned = _pruned;
+
+    const std::set<std::string> prunedSet(_pruned.begin(), _pruned.end());
+    std::vector<ArchivedVersion> prunedVersions;
+    for (ArchivedVersion& version : versions)
+    {
+        if (0 != prunedSet.count(version.snapshot))
+        {
+            prunedVersions.push_back(std::move(version));
+        }
+    }
+    outputReport.versionsRemoved = prunedVersions.size();
+    return CollectReferences(prunedVersions);
+}
+
+bool SnapshotPruner::Execute(unsigned int threads, std::size_t queueDepth, PruneReport& outputReport)
+{
+    if (true == _pruned.empty())
+    {
+        return true;
+    }
+    std::vector<HashDigest> unreferencedObjects;
+    std::vector<HashDigest> unreferencedChunks;
+    if (false == _fileStateRepository.PruneSnapshots(_pruned, _releasedObjects, _releasedChunks, unreferencedObjects, unreferencedChunks,
+                                                     outputReport.versionsRemoved))
+    {
+        return false;
+    }
+
+    // The entries of every pruned directory are the work items, so one large snapshot is still deleted in parallel.
+    std::vector<std::filesystem::path> snapshotDirectories;
+    std::vector<std::filesystem::path> entries;
+    std::error_code ec;
+    for (const std::string& name : _pruned)
+    {
+        for (const char* area : {"deleted", "snapshots", StateDatabaseCopy::Area})
+        {
+            const std::filesystem::path directory = (0 == std::strcmp(area, "deleted")) ? SnapshotTierMover::SnapshotDirectory(_backupRoot, _coldRoots, name)
+                                                                                       : _backupRoot / area / name;
+            if (false == std::filesystem::is_directory(directory, ec))
+            {
+                continue;
+            }
+            snapshotDirectories.push_back(directory);
+            for (const auto& entry : std::filesystem::directory_iterator(directory, ec))
+            {
+                entries.push_back(entry.path());
+            }
+        }
+    }
+    bool success = RemoveInParallel(entries, threads, queueDepth);
+    for (const auto& directory : snapshotDirectories)
+    {
+        std::filesystem::remove_all(directory, ec);
+        success = (0 == ec.value()) && (true == success);
+    }
+
+    // Objects go only once the links in the pruned directories are gone; one still linked from elsewhere stays.
+    const FileCopier fileCopier;
+    const ContentObjectStore contentStore(_backupRoot / "objects", fileCopier);
+    std::vector<std::filesystem::path> reclaimed;
+    for (const HashDigest& digest : unreferencedObjects)
+    {
+        const std::filesystem::path objectPath = contentStore.ObjectPath(digest);
+        if (1 == std::filesystem::hard_link_count(objectPath, ec))
+        {
+            reclaimed.push_back(objectPath);
+            ++outputReport.objectsReclaimed;
+        }
+    }
+    for (const HashDigest& digest : unreferencedChunks)
+    {
+        reclaimed.push_back(ChunkStore::ChunkPath(_backupRoot / "chunks", digest));
+        ++outputReport.chunksReclaimed;
+    }
+    success = (true == RemoveInParallel(reclaimed, threads, queueDepth)) && (true == success);
+    return (true == ReclaimParity(threads, queueDepth, outputReport)) && (true == success);
+}
+
+/**
+ * @brief Delete the parity of the contents the pruned versions had that no file state and no remaining version has.
+ *
+ * @param[in] threads Deleting threads
+ * @param[in] queueDepth Bound of the deletion queue
+ * @param[in,out] outputReport Report the reclaimed parity files are counted in
+ * @return true on success, false if the repository cannot be read or a file cannot be deleted
+ */
+bool SnapshotPruner::ReclaimParity(unsigned int threads, std::size_t queueDepth, PruneReport& outputReport)
+{
+    if (true == _releasedParity.empty())
+    {
+        return true;
+    }
+    std::unordered_set<std::string> unreferenced;
+    for (const HashDigest& digest : _releasedParity)
+    {
+        unreferenced.insert(digest.ToHex());
+    }
+    const bool listed =
+        (true == _fileStateRepository.ForEachFileState(
+                     [&unreferenced](const std::string&, const FileStateRecord& record)
+                     {
+                         unreferenced.erase(record.hash.ToHex());
+                         return true;
+                     })) &&
+        (true == _fileStateRepository.ForEachArchivedVersion(
+                     [&unreferenced](const FileVersionRecord& version)
+                     {
+                         unreferenced.erase(version.hash.ToHex());
+                         return true;
+                     }));
+    if (false == listed)
+    {
+        return false;
+    }
+    const std::filesystem::path parityRoot = _backupRoot / ParityFile::Area;
+    std::vector<std::filesystem::path> reclaimed;
+    for (const HashDigest& digest : _releasedParity)
+    {
+        // Erased as it is taken, so a content several pruned versions had is deleted once.
+        if (0 != unreferenced.erase(digest.ToHex()))
+        {
+            reclaimed.push_back(ParityFile::ContentPath(parityRoot, digest));
+            ++outputReport.parityReclaimed;
+        }
+    }
+    return RemoveInParallel(reclaimed, threads, queueDepth);
+}
+
+/**
+ * @brief List the snapshots recorded in the state database or present as a directory under deleted/, snapshots/ or state/.
+ *
+ * Directories whose snapshot was already forgotten by an interrupted prune are listed too, so they are deleted.
+ *
+ * @return Names, oldest first
+ */
+std::vector<std::string> SnapshotPruner::ListSnapshots()
+{
+    std::set<std::string> names;
+    std::vector<std::string> recorded;
+    if (true == _fileStateRepository.GetSnapshotNames(recorded))
+    {
+        names.insert(recorded.begin(), recorded.end());
+    }
+    const std::string partialSuffix(SnapshotTreeBuilder::PartialSuffix);
+    std::error_code ec;
+    for (const char* area : {"deleted", "snapshots", StateDatabaseCopy::Area})
+    {
+        for (const auto& entry : std::filesystem::directory_iterator(_backupRoot / area, ec))
+        {
+            const std::string name = entry.path().filename().string();
+            const bool partial = (partialSuffix.size() < name.size()) && (0 == name.compare(name.size() - partialSuffix.size(), partialSuffix.size(), partialSuffix));
+            if ((false == partial) && (true == entry.is_directory(ec)))
+            {
+                names.insert(name);
+            }
+        }
+    }
+    return std::vector<std::string>(names.begin(), names.end());
+}
+
+/**
+ * @brief Keep every expired snapshot a kept delta chain reaches.
+ *
+ * A delta is applied to the next newer version of its file, wherever that is stored, so the snapshot
+ * holding that version stays, and so does the next one while that version is a delta as well. Keeping a
+ * snapshot for one file may start a chain for another, so the scan repeats until nothing changes.
+ *
+ * @param[in,out] versions Archived versions, sorted by path and snapshot
+ * @param[in,out] kept Kept snapshot names, extended and sorted
+ * @return Number of snapshots added to kept
+ */
+std::size_t SnapshotPruner::KeepDeltaBases(std::vector<ArchivedVersion>& versions, std::vector<std::string>& kept) const
+{
+    std::sort(versions.begin(), versions.end(),
+              [](const ArchivedVersion& left, const ArchivedVersion& right)
+              { return (left.path != right.path) ? (left.path < right.path) : (left.snapshot < right.snapshot); });
+    std::unordered_set<std::string> keptSet(kept.begin(), kept.end());
+    std::size_t added = 0;
+    bool changed = true;
+    while (true == changed)
+    {
+        changed = false;
+        bool basisNeeded = false;
+        for (std::size_t i = 0; i < versions.size(); ++i)
+        {
+            if ((0 < i) && (versions[i - 1].path != versions[i].path))
+            {
+                basisNeeded = false;
+            }
+            if ((true == basisNeeded) && (true == keptSet.insert(versions[i].snapshot).second))
+            {
+                kept.push_back(versions[i].snapshot);
+                ++added;
+                changed = true;
+            }
+            basisNeeded = (0 != keptSet.count(versions[i].snapshot)) && (true == versions[i].delta);
+        }
+    }
+    std::sort(kept.begin(), kept.end());
+    return added;
+}
+
+/**
+ * @brief Gather the content objects linked, the chunks listed and the parity kept for the versions of the pruned snapshots.
+ *
+ * A plain version counts as an object reference only when it is a link to its object, since versions
+ * archived without the content store were never counted.
+ *
+ * @param[in] versions Versions of the pruned snapshots
+ * @return true on success, false if a manifest cannot be read
+ */
+bool SnapshotPruner::CollectReferences(const std::vector<ArchivedVersion>& versions)
+{
+    _releasedObjects.clear();
+    _releasedChunks.clear();
+    _releasedParity.clear();
+    const FileCopier fileCopier;
+    const ContentObjectStore contentStore(_backupRoot / "objects", fileCopier);
+    std::error_code ec;
+    const bool objectsExist = std::filesystem::is_directory(_backupRoot / "objects", ec);
+    const std::filesystem::path parityRoot = _backupRoot / ParityFile::Area;
+    const bool parityExists = std::filesystem::is_directory(parityRoot, ec);
+    for (const ArchivedVersion& version : versions)
+    {
+        if ((true == parityExists) && (true == std::filesystem::exists(ParityFile::ContentPath(parityRoot, version.hash), ec)))
+        {
+            _releasedParity.push_back(version.hash);
+        }
+        const std::filesystem::path plainPath = SnapshotTierMover::SnapshotDirectory(_backupRoot, _coldRoots, version.snapshot) / version.path;
+        if ((true == objectsExist) && (true == std::filesystem::equivalent(plainPath, contentStore.ObjectPath(version.hash), ec)))
+        {
+            _releasedObjects.push_back(version.hash);
+            continue;
+        }
+        std::filesystem::path manifestPath = plainPath;
+        manifestPath += ChunkStore::ManifestSuffix;
+        if (false == std::filesystem::exists(manifestPath, ec))
+        {
+            continue;
+        }
+        std::uint64_t fileSize = 0;
+        HashDigest fileDigest{};
+        std::vector<FileChunk> chunks;
+        if (false == ChunkStore::ReadManifest(manifestPath, fileSize, fileDigest, chunks))
+        {
+            return false;
+        }
+        for (const FileChunk& chunk : chunks)
+        {
+            _releasedChunks.push_back(chunk.digest);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Delete files and directory trees on a pool of threads.
+ *
+ * @param[in] paths Files or directories to delete; missing ones count as deleted
+ * @param[in] threads Deleting threads
+ * @param[in] queueDepth Bound of the deletion queue
+ * @return true if every path is gone, false otherwise
+ */
+bool SnapshotPruner::RemoveInParallel(const std::vector<std::filesystem::path>& paths, unsigned int threads, std::size_t queueDepth)
+{
+    if (true == paths.empty())
+    {
+        return true;
+    }
+    std::atomic<bool> success{true};
+    ThreadedFileQueue removalQueue(threads, queueDepth,
+                                   [&](const std::filesystem::path& path)
+                                   {
+                                       std::error_code ec;
+                                       std::filesystem::remove_all(path, ec);
+                                       if (0 != ec.value())
+                                       {
+                                           success.store(false);
+                                       }
+                                   });
+    removalQueue.EnqueueBatch(std::vector<std::filesystem::path>(paths));
+    removalQueue.Finalize();
+    return success.load();
+}
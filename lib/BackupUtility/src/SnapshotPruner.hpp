@@ -0,0 +1,78 @@
+// file SnapshotPruner.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+#include "BackupUtility/BackupUtility.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Expires snapshots by a retention policy and reclaims what only they referenced.
+ *
+ * Plan() lists the snapshots recorded in the state database or present on disk, applies the policy, keeps
+ * the snapshots kept deltas are based on, and gathers the content objects linked and the chunks listed by
+ * the versions in the expired ones. Execute() forgets those snapshots and releases those references in one
+ * transaction, then deletes the snapshot directories and the objects and chunks left without references.
+ * Parity of a content in an expired snapshot goes once no file state and no remaining version has that content.
+ */
+class SnapshotPruner
+{
+  public:
+    /**
+     * @brief Create a pruner over a backup root.
+     *
+     * @param[in] backupRoot Backup root holding deleted/, snapshots/, state/, objects/, chunks/ and parity/
+     * @param[in] fileStateRepository Repository of the snapshots and their versions
+     */
+    SnapshotPruner(const std::filesystem::path& backupRoot, FileStateRepository& fileStateRepository);
+
+    /**
+     * @brief Decide which snapshots go and what they release.
+     *
+     * @param[in] policy Snapshots to keep
+     * @param[out] outputReport Kept and pruned snapshots and the versions they hold
+     * @return true on success, false if the store cannot be read
+     */
+    bool Plan(const RetentionPolicy& policy, PruneReport& outputReport);
+
+    /**
+     * @brief Prune the planned snapshots.
+     *
+     * @param[in] threads Deleting threads
+     * @param[in] queueDepth Bound of the deletion queue
+     * @param[in,out] outputReport Completed with the versions forgotten and the objects, chunks and parity files reclaimed
+     * @return true on success, false on error
+     */
+    bool Execute(unsigned int threads, std::size_t queueDepth, PruneReport& outputReport);
+
+  private:
+    /**
+     * @brief Archived version as far as pruning is concerned.
+     */
+    struct ArchivedVersion
+    {
+        std::string path;     /**< Repository-relative file path */
+        std::string snapshot; /**< Snapshot holding the version */
+        HashDigest hash;      /**< Content digest */
+        bool delta;           /**< Stored as a delta against the next newer version */
+    };
+
+    std::vector<std::string> ListSnapshots();
+    std::size_t KeepDeltaBases(std::vector<ArchivedVersion>& versions, std::vector<std::string>& kept) const;
+    bool CollectReferences(const std::vector<ArchivedVersion>& versions);
+    bool ReclaimParity(unsigned int threads, std::size_t queueDepth, PruneReport& outputReport);
+    static bool RemoveInParallel(const std::vector<std::filesystem::path>& paths, unsigned int threads, std::size_t queueDepth);
+
+    std::filesystem::path _backupRoot;
+    FileStateRepository& _fileStateRepository;
+    std::vector<std::string> _pruned;
+    std::unordered_map<std::string, std::filesystem::path> _coldRoots; /**< Cold tier root of each snapshot moved there */
+    std::vector<HashDigest> _releasedObjects;
+    std::vector<HashDigest> _releasedChunks;
+    std::vector<HashDigest> _releasedParity; /**< Contents of the pruned versions that have parity */
+};
@@ -0,0 +1,144 @@
+// file SnapshotTierMover.cpp:
+
+#include "SnapshotTierMover.hpp"
+
+#include "FileDelta.hpp"
+#include "FileCopier/FileCopier.hpp"
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <algorithm>
+#include <system_error>
+#include <thread>
+
+std::filesystem::path SnapshotTierMover::SnapshotDirectory(const std::filesystem::path& backupRoot,
+                                                           const std::unordered_map<std::string, std::filesystem::path>& coldRoots, const std::string& name)
+{
+    const auto found = coldRoots.find(name);
+    return ((coldRoots.end() == found) ? backupRoot : found->second) / "deleted" / name;
+}
+
+SnapshotTierMover::SnapshotTierMover(const TierConfig& configuration, FileStateRepository& fileStateRepository)
+    : _configuration(configuration), _fileStateRepository(fileStateRepository), _ioThrottle(configuration.ioLimits)
+{
+}
+
+bool SnapshotTierMover::Plan(const std::string& cutoff)
+{
+    std::vector<std::string> names;
+    if ((false == _fileStateRepository.GetSnapshotNames(names)) || (false == _fileStateRepository.GetColdSnapshots(_coldRoots)))
+    {
+        return false;
+    }
+    // Names are timestamps, so the oldest move first and a delta's newer basis has not moved yet when it is rebuilt.
+    _moves.clear();
+    for (const std::string& name : names)
+    {
+        if ((name < cutoff) && (0 == _coldRoots.count(name)))
+        {
+            _moves.push_back(name);
+        }
+    }
+    return true;
+}
+
+bool SnapshotTierMover::Execute(TierReport& outputReport)
+{
+    bool success = true;
+    std::thread mover(
+        [&]()
+        {
+            SetIdlePriority();
+            // A move interrupted after its snapshot was recorded cold left the hot directory behind.
+            std::error_code ec;
+            for (const auto& entry : _coldRoots)
+            {
+                std::filesystem::remove_all(_configuration.backupRoot / "deleted" / entry.first, ec);
+            }
+            for (const std::string& name : _moves)
+            {
+                if (false == MoveSnapshot(name, outputReport))
+                {
+                    success = false;
+                    return;
+                }
+            }
+        });
+    mover.join();
+    return success;
+}
+
+/**
+ * @brief Copy one snapshot to the cold tier, record it there, then remove it from the hot tier.
+ *
+ * @param[in] name Snapshot directory name
+ * @param[in,out] outputReport Counts of what was moved
+ * @return true if the snapshot is on the cold tier, false otherwise
+ */
+bool SnapshotTierMover::MoveSnapshot(const std::string& name, TierReport& outputReport)
+{
+    const std::filesystem::path hotDirectory = _configuration.backupRoot / "deleted" / name;
+    const std::filesystem::path coldDirectory = _configuration.coldRoot / "deleted" / name;
+    std::filesystem::path stagingDirectory = coldDirectory;
+    stagingDirectory += MigratingSuffix;
+    std::error_code ec;
+    std::filesystem::remove_all(stagingDirectory, ec);
+    std::filesystem::remove_all(coldDirectory, ec);
+
+    std::vector<std::filesystem::path> files;
+    for (std::filesystem::recursive_directory_iterator entry(hotDirectory, ec), end; (0 == ec.value()) && (end != entry); entry.increment(ec))
+    {
+        std::error_code typeEc;
+        if (true == entry->is_regular_file(typeEc))
+        {
+            files.push_back(entry->path().lexically_relative(hotDirectory));
+        }
+    }
+    if ((0 != ec.value()) && (std::errc::no_such_file_or_directory != ec))
+    {
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+
+    const FileCopier fileCopier;
+    TierReport snapshotReport{};
+    for (const std::filesystem::path& relative : files)
+    {
+        const std::filesystem::path source = hotDirectory / relative;
+        std::filesystem::path destination = stagingDirectory / relative;
+        std::filesystem::create_directories(destination.parent_path(), ec);
+        const bool delta = (FileDelta::DeltaSuffix == relative.extension());
+        bool copied = false;
+        if (true == delta)
+        {
+            destination.replace_extension();
+            copied = RestoreDeltaFile(_configuration.backupRoot, source, destination, _configuration.databaseFile);
+        }
+        else
+        {
+            copied = fileCopier.Copy(source, destination);
+        }
+        const std::uintmax_t size = std::filesystem::file_size(destination, ec);
+        if ((false == copied) || (0 != ec.value()))
+        {
+            return false;
+        }
+        _ioThrottle.AcquireRead(size);
+        _ioThrottle.AcquireWrite(size);
+        ++snapshotReport.filesMoved;
+        snapshotReport.bytesMoved += size;
+        snapshotReport.deltasRebuilt += (true == delta) ? 1 : 0;
+    }
+
+    std::filesystem::create_directories(stagingDirectory, ec);
+    std::filesystem::rename(stagingDirectory, coldDirectory, ec);
+    if ((0 != ec.value()) || (false == _fileStateRepository.RecordColdSnapshot(name, _configuration.coldRoot)))
+    {
+        return false;
+    }
+    std::filesystem::remove_all(hotDirectory, ec);
+    ++outputReport.snapshotsMoved;
+    outputReport.filesMoved += snapshotReport.filesMoved;
+    outputReport.bytesMoved += snapshotReport.bytesMoved;
+    outputReport.deltasRebuilt += snapshotReport.deltasRebuilt;
+    return 0 == ec.value();
+}
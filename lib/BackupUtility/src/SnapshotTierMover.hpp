@@ -0,0 +1,76 @@
+// file SnapshotTierMover.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+#include "BackupUtility/BackupUtility.hpp"
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Moves snapshot directories past an age from the hot tier, the backup root, to a cold tier.
+ *
+ * New runs always archive into deleted/ below the backup root. The mover copies each snapshot old enough,
+ * oldest first, into deleted/ below the cold root: one snapshot at a time, its files in path order, so the
+ * cold device sees long sequential writes. A delta is rebuilt in full on the way, since the version it is
+ * based on stays behind on the hot tier; the cold tier never depends on the hot one. The copy is staged
+ * under a `.migrating` name and renamed once complete, the state database then records the snapshot as
+ * cold, and only then is the hot directory removed. A move interrupted before the record is repeated; one
+ * interrupted after it only has its hot directory removed by the next run.
+ */
+class SnapshotTierMover
+{
+  public:
+    /**
+     * @brief Suffix of a snapshot directory being copied to the cold tier.
+     */
+    static constexpr const char* MigratingSuffix = ".migrating";
+
+    /**
+     * @brief Get the directory a snapshot lives in, on whichever tier holds it.
+     *
+     * @param[in] backupRoot Backup root, the hot tier
+     * @param[in] coldRoots Cold tier root of each snapshot moved there, as read by FileStateRepository::GetColdSnapshots
+     * @param[in] name Snapshot directory name
+     * @return Snapshot directory
+     */
+    static std::filesystem::path SnapshotDirectory(const std::filesystem::path& backupRoot,
+                                                   const std::unordered_map<std::string, std::filesystem::path>& coldRoots, const std::string& name);
+
+    /**
+     * @brief Create a mover.
+     *
+     * @param[in] configuration Backup root, cold root, database and bandwidth limits
+     * @param[in] fileStateRepository Repository of the snapshots and their tiers
+     */
+    SnapshotTierMover(const TierConfig& configuration, FileStateRepository& fileStateRepository);
+
+    /**
+     * @brief Pick the hot snapshots started before a point in time.
+     *
+     * @param[in] cutoff Timestamp; snapshots named before it move
+     * @return true on success, false if the snapshots cannot be read
+     */
+    bool Plan(const std::string& cutoff);
+
+    /**
+     * @brief Move the planned snapshots on a thread at idle CPU and I/O priority and wait for it.
+     *
+     * @param[in,out] outputReport Snapshots, files and bytes moved and deltas rebuilt are added
+     * @return true if every planned snapshot is on the cold tier, false otherwise
+     */
+    bool Execute(TierReport& outputReport);
+
+  private:
+    bool MoveSnapshot(const std::string& name, TierReport& outputReport);
+
+    TierConfig _configuration;
+    FileStateRepository& _fileStateRepository;
+    IoThrottle _ioThrottle;
+    std::unordered_map<std::string, std::filesystem::path> _coldRoots;
+    std::vector<std::string> _moves; /**< Snapshots to move, oldest first */
+};
@@ -0,0 +1,181 @@
+// file SnapshotTreeBuilder.cpp:
+
+#include "SnapshotTreeBuilder.hpp"
+
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <atomic>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+
+SnapshotTreeBuilder::SnapshotTreeBuilder(const std::filesystem::path& backupRoot, const FileCopier& fileCopier, PackStore* packStore)
+    : _backupRoot(backupRoot), _fileCopier(fileCopier), _packStore(packStore)
+{
+}
+
+bool SnapshotTreeBuilder::Build(FileStateRepository& fileStateRepository, const std::string& name, unsigned int threads, std::size_t queueDepth)
+{
+    const std::filesystem::path snapshotsRoot = _backupRoot / "snapshots";
+    const std::string previous = PreviousTree(snapshotsRoot, name);
+
+    std::unordered_map<std::string, std::vector<TreeFile>> directories;
+    const bool listed = fileStateRepository.ForEachFileState(
+        [&](const std::string& filePath, const FileStateRecord& record)
+        {
+            if (ChangeType::Deleted != record.status)
+            {
+                const std::filesystem::path relativePath(filePath);
+                std::string directory = relativePath.parent_path().generic_string();
+                if (true == directory.empty())
+                {
+                    directory = ".";
+                }
+                // Timestamps sort like snapshot names, so a file last changed by then is in the previous tree unchanged.
+                const bool unchanged = (false == previous.empty()) && (record.timestamp <= previous);
+                directories[directory].push_back(TreeFile{relativePath.filename().string(), record.hash, record.hashAlgorithm, unchanged});
+            }
+            return true;
+        });
+    if (false == listed)
+    {
+        return false;
+    }
+
+    std::error_code ec;
+    const std::filesystem::path treeRoot = snapshotsRoot / (name + PartialSuffix);
+    std::filesystem::remove_all(treeRoot, ec);
+    if (false == std::filesystem::create_directories(treeRoot, ec))
+    {
+        return false;
+    }
+    const std::filesystem::path previousRoot = (true == previous.empty()) ? std::filesystem::path() : snapshotsRoot / previous;
+
+    std::atomic<bool> success{true};
+    {
+        // Directories with the most files go first so a large one does not trail the build on its own.
+        ThreadedFileQueueOptions queueOptions;
+        queueOptions.scheduling = SchedulingPolicy::LargestFirst;
+        // The directory map is only read while the workers run, so it needs no lock.
+        ThreadedFileQueue directoryQueue(
+            threads, queueDepth,
+            [&](const std::filesystem::path& directory)
+            {
+                if (false == BuildDirectory(directory.string(), directories.at(directory.string()), treeRoot, previousRoot))
+                {
+                    success.store(false);
+                }
+            },
+            nullptr, queueOptions);
+        std::vector<FileWorkItem> workItems;
+        workItems.reserve(directories.size());
+        for (const auto& entry : directories)
+        {
+            workItems.push_back(FileWorkItem{entry.first, entry.second.size()});
+        }
+        directoryQueue.EnqueueBatch(std::move(workItems));
+        directoryQueue.Finalize();
+    }
+    if (false == success.load())
+    {
+        return false;
+    }
+
+    // A resumed run may have completed its tree before it stopped; the new one replaces it.
+    const std::filesystem::path finalRoot = snapshotsRoot / name;
+    std::filesystem::remove_all(finalRoot, ec);
+    std::filesystem::rename(treeRoot, finalRoot, ec);
+    return 0 == ec.value();
+}
+
+std::string SnapshotTreeBuilder::PreviousTree(const std::filesystem::path& snapshotsRoot, const std::string& name)
+{
+    std::string previous;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(snapshotsRoot, ec))
+    {
+        const std::string entryName = entry.path().filename().string();
+        const std::string suffix(PartialSuffix);
+        const bool partial = (suffix.size() < entryName.size()) && (0 == entryName.compare(entryName.size() - suffix.size(), suffix.size(), suffix));
+        if ((false == partial) && (entryName < name) && (previous < entryName) && (true == entry.is_directory(ec)))
+        {
+            previous = entryName;
+        }
+    }
+    return previous;
+}
+
+/**
+ * @brief Link one directory of the tree: plain copies first, then packed files from the previous tree or their pack.
+ *
+ * @param[in] directory Directory relative to the backup root's backup/, "." for the top
+ * @param[in] files Live files of the directory
+ * @param[in] treeRoot Tree being built
+ * @param[in] previousRoot Previous complete tree, empty if there is none
+ * @return true on success, false on error
+ */
+bool SnapshotTreeBuilder::BuildDirectory(const std::string& directory, const std::vector<TreeFile>& files, const std::filesystem::path& treeRoot,
+                                         const std::filesystem::path& previousRoot)
+{
+    const std::filesystem::path targetDirectory = treeRoot / directory;
+    std::error_code ec;
+    std::filesystem::create_directories(targetDirectory, ec);
+    if (0 != ec.value())
+    {
+        return false;
+    }
+
+    std::vector<std::string> names;
+    names.reserve(files.size());
+    for (const TreeFile& file : files)
+    {
+        names.push_back(file.name);
+    }
+    std::vector<std::string> missing;
+    if (false == _fileCopier.LinkBatch(_backupRoot / "backup" / directory, targetDirectory, names, missing))
+    {
+        return false;
+    }
+    if (true == missing.empty())
+    {
+        return true;
+    }
+
+    // Files without a plain copy are packed.
+    std::unordered_map<std::string, const TreeFile*> filesByName;
+    for (const TreeFile& file : files)
+    {
+        filesByName.emplace(file.name, &file);
+    }
+    std::vector<std::string> unpacked;
+    if (false == previousRoot.empty())
+    {
+        std::vector<std::string> unchanged;
+        for (const std::string& name : missing)
+        {
+            ((true == filesByName.at(name)->unchangedSincePrevious) ? unchanged : unpacked).push_back(name);
+        }
+        std::vector<std::string> notInPrevious;
+        if (false == _fileCopier.LinkBatch(previousRoot / directory, targetDirectory, unchanged, notInPrevious))
+        {
+            return false;
+        }
+        unpacked.insert(unpacked.end(), notInPrevious.begin(), notInPrevious.end());
+    }
+    else
+    {
+        unpacked = std::move(missing);
+    }
+
+    for (const std::string& name : unpacked)
+    {
+        const TreeFile& file = *filesByName.at(name);
+        PackLocation location{};
+        if ((nullptr == _packStore) || (false == _packStore->Find(file.hash, file.hashAlgorithm, location)) ||
+            (false == PackStore::Extract(_packStore->Root(), location, targetDirectory / name)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
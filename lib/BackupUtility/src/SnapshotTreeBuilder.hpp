@@ -0,0 +1,79 @@
+// file SnapshotTreeBuilder.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+#include "PackStore.hpp"
+#include "FileCopier/FileCopier.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Materializes a run as a complete, browsable tree `snapshots/<timestamp>/` of hard links.
+ *
+ * Every live file is linked from its plain copy under `backup/`, which later runs replace rather than
+ * rewrite, so an unchanged file shares one inode with the same file in every earlier tree and a tree
+ * costs directory entries, not data. Packed files have no plain copy: one unchanged since the previous
+ * tree is linked from there, anything else is written out of its pack segment. Each directory is one
+ * batch of links relative to open directory handles, and directories are built in parallel. A tree is
+ * built under a `.partial` name and renamed into place, so a tree without the suffix is complete.
+ */
+class SnapshotTreeBuilder
+{
+  public:
+    /**
+     * @brief Suffix of a tree still being built.
+     */
+    static constexpr const char* PartialSuffix = ".partial";
+
+    /**
+     * @brief Create a builder over a backup root.
+     *
+     * @param[in] backupRoot Backup root holding backup/ and snapshots/
+     * @param[in] fileCopier Copier linking the files, and copying them where links are impossible
+     * @param[in] packStore Index of the packed contents, nullptr when nothing is packed
+     */
+    SnapshotTreeBuilder(const std::filesystem::path& backupRoot, const FileCopier& fileCopier, PackStore* packStore);
+
+    /**
+     * @brief Build the tree of the live files recorded in the state database.
+     *
+     * @param[in] fileStateRepository Repository listing the live files
+     * @param[in] name Snapshot name, the run timestamp
+     * @param[in] threads Worker threads building directories
+     * @param[in] queueDepth Bound of the directory queue
+     * @return true on success, false on error
+     */
+    bool Build(FileStateRepository& fileStateRepository, const std::string& name, unsigned int threads, std::size_t queueDepth);
+
+    /**
+     * @brief Get the newest complete tree older than a snapshot name.
+     *
+     * @param[in] snapshotsRoot Directory holding the trees
+     * @param[in] name Snapshot name
+     * @return Name of the previous tree, empty if there is none
+     */
+    static std::string PreviousTree(const std::filesystem::path& snapshotsRoot, const std::string& name);
+
+  private:
+    /**
+     * @brief Live file of one directory.
+     */
+    struct TreeFile
+    {
+        std::string name;              /**< File name without directory */
+        HashDigest hash;               /**< Content digest */
+        HashAlgorithm hashAlgorithm;   /**< Algorithm of hash */
+        bool unchangedSincePrevious;   /**< Last changed no later than the previous tree was taken */
+    };
+
+    bool BuildDirectory(const std::string& directory, const std::vector<TreeFile>& files, const std::filesystem::path& treeRoot,
+                        const std::filesystem::path& previousRoot);
+
+    std::filesystem::path _backupRoot;
+    const FileCopier& _fileCopier;
+    PackStore* _packStore;
+};
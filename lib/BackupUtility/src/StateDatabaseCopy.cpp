@@ -0,0 +1,55 @@
+// file StateDatabaseCopy.cpp:
+
+#include "StateDatabaseCopy.hpp"
+
+#include "SnapshotTreeBuilder.hpp"
+#include "FileCompressor/FileCompressor.hpp"
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <stdexcept>
+#include <system_error>
+
+bool StateDatabaseCopy::Write(SQLiteSession& databaseSession, const std::filesystem::path& backupRoot, const std::string& name)
+{
+    const std::filesystem::path areaDirectory = backupRoot / Area;
+    const std::filesystem::path directory = areaDirectory / name;
+    std::filesystem::path partialDirectory = directory;
+    partialDirectory += SnapshotTreeBuilder::PartialSuffix;
+    const std::filesystem::path databaseName = databaseSession.DatabasePath().filename();
+    const std::filesystem::path plainCopy = partialDirectory / databaseName;
+    std::error_code ec;
+    std::filesystem::remove_all(partialDirectory, ec);
+    std::filesystem::remove_all(directory, ec);
+    if (false == std::filesystem::create_directories(partialDirectory, ec))
+    {
+        return false;
+    }
+
+    try
+    {
+        if (false == databaseSession.Acquire().BackupTo(plainCopy, PagesPerStep, StepPause))
+        {
+            return false;
+        }
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+
+    if (true == FileCompressor::IsAvailable())
+    {
+        // A database always shrinks, so the sample that decides whether to compress is skipped.
+        FileCompressorOptions options;
+        options.sampleSize = 0;
+        std::filesystem::path compressedCopy = plainCopy;
+        compressedCopy += FileCompressor::CompressedSuffix;
+        if (false == FileCompressor(options).Compress(plainCopy, compressedCopy))
+        {
+            return false;
+        }
+        std::filesystem::remove(plainCopy, ec);
+    }
+    std::filesystem::rename(partialDirectory, directory, ec);
+    return 0 == ec.value();
+}
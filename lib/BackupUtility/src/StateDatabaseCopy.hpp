@@ -0,0 +1,48 @@
+// file StateDatabaseCopy.hpp:
+
+#pragma once
+
+#include "SQLite/SQLiteSession.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+
+/**
+ * @brief Writes a consistent copy of the state database into the store, below state/<snapshot>/.
+ *
+ * A plain file copy of a database in WAL mode can miss committed pages or mix two versions, and stopping
+ * every writer to take one would take the store offline. The copy is made with SQLite's online backup API
+ * from a connection of the run's session, a few pages per step with a pause in between, so readers of the
+ * database are never blocked. It is then compressed into one zstd frame, or kept as it is in builds
+ * without zstd. The copy is built in a `.partial` directory renamed into place once complete, and the
+ * state/ directory of a snapshot is pruned together with the snapshot.
+ */
+class StateDatabaseCopy
+{
+  public:
+    /**
+     * @brief Area below the backup root holding one directory of copies per snapshot.
+     */
+    static constexpr const char* Area = "state";
+
+    /**
+     * @brief Pages copied per backup step, 4 MiB at the default page size.
+     */
+    static constexpr int PagesPerStep = 1024;
+
+    /**
+     * @brief Pause between two backup steps.
+     */
+    static constexpr std::chrono::milliseconds StepPause{1};
+
+    /**
+     * @brief Copy the database of a session into the state area of a snapshot.
+     *
+     * @param[in] databaseSession Session of the database to copy
+     * @param[in] backupRoot Backup root holding the state area
+     * @param[in] name Snapshot directory name, the run's timestamp
+     * @return true if the copy is in place, false on error
+     */
+    static bool Write(SQLiteSession& databaseSession, const std::filesystem::path& backupRoot, const std::string& name);
+};
@@ -0,0 +1,571 @@
+// file StateSnapshotFile.cpp:
+
+#include "StateSnapshotFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <xxhash.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+constexpr char SnapshotMagic[8] = {'R', 'D', 'S', 'T', 'A', 'T', 'E', '\0'};
+constexpr std::uint32_t SnapshotFormatVersion = 3;
+
+/**
+ * @brief Fixed-size header at the start of a snapshot file; offsets are from the start of the file.
+ */
+struct SnapshotHeader
+{
+    char magic[8];                    /**< SnapshotMagic */
+    std::uint32_t formatVersion;      /**< SnapshotFormatVersion */
+    std::uint32_t restartInterval;    /**< Paths per front-coded run */
+    std::uint64_t token;              /**< Random value the database must store for the file to be used */
+    std::uint64_t checksum;           /**< XXH3-64 of everything after the header */
+    std::uint64_t entryCount;         /**< Number of paths and entries */
+    std::uint64_t timestampCount;     /**< Number of distinct timestamps */
+    std::uint64_t timestampsOffset;   /**< timestampCount + 1 offsets into the timestamp text */
+    std::uint64_t timestampTextOffset; /**< Timestamp characters, back to back */
+    std::uint64_t entriesOffset;      /**< entryCount SnapshotEntry records in path order */
+    std::uint64_t restartsOffset;     /**< Offset into the path section of every RestartInterval-th path */
+    std::uint64_t pathsOffset;        /**< Front-coded paths */
+    std::uint64_t fileSize;           /**< Size of the whole file */
+};
+
+/**
+ * @brief Fixed-width state of one path.
+ */
+struct SnapshotEntry
+{
+    std::uint64_t size;
+    std::int64_t modificationTimeNs;
+    std::uint64_t inode;
+    std::uint64_t device;
+    std::int64_t changeTimeNs;
+    std::int64_t accessTimeNs;
+    std::uint32_t mode;
+    std::uint32_t userId;
+    std::uint32_t groupId;
+    std::uint32_t timestampId;
+    std::uint8_t hash[HashDigest::MaxSize];
+    std::uint8_t hashSize;
+    std::uint8_t hashAlgorithm;
+    std::uint8_t status;
+    std::uint8_t digestScheme;
+    std::uint8_t sampleSize;
+    std::uint8_t reserved[3];
+    std::uint32_t sampledRuns;
+    std::uint8_t sample[HashDigest::MaxSize];
+    std::uint8_t reservedTail[4];
+};
+
+static_assert(96 == sizeof(SnapshotHeader), "The snapshot header layout is part of the file format");
+static_assert(144 == sizeof(SnapshotEntry), "The snapshot entry layout is part of the file format");
+
+/**
+ * @brief State of one path while the file is assembled.
+ */
+struct PendingState
+{
+    std::string path;
+    SnapshotEntry entry;
+};
+
+/**
+ * @brief Append a value's bytes to a buffer.
+ *
+ * @param[in,out] buffer Buffer to extend
+ * @param[in] value Value to append
+ */
+template <typename T>
+void AppendValue(std::vector<std::uint8_t>& buffer, const T& value)
+{
+    const auto* bytes = reinterpret_cast<const std::uint8_t*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+/**
+ * @brief Append an unsigned LEB128 varint.
+ *
+ * @param[in,out] buffer Buffer to extend
+ * @param[in] value Value to encode
+ */
+void AppendVarint(std::vector<std::uint8_t>& buffer, std::uint64_t value)
+{
+    while (0x80 <= value)
+    {
+        buffer.push_back(static_cast<std::uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<std::uint8_t>(value));
+}
+
+/**
+ * @brief Decode an unsigned LEB128 varint.
+ *
+ * @param[in] data Mapped file
+ * @param[in] size Size of the mapped file
+ * @param[in,out] position Offset of the varint, moved past it
+ * @param[out] outputValue Decoded value
+ * @return true on success, false if the varint runs past the end of the file
+ */
+bool ReadVarint(const std::uint8_t* data, std::size_t size, std::size_t& position, std::uint64_t& outputValue)
+{
+    outputValue = 0;
+    for (unsigned int shift = 0; (position < size) && (shift < 64); shift += 7)
+    {
+        const std::uint8_t byte = data[position++];
+        outputValue |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if (0 == (byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Read a value from an unaligned position of the mapped file.
+ *
+ * @param[in] data Mapped file
+ * @param[in] offset Offset of the value
+ * @return Value
+ */
+template <typename T>
+T ReadValue(const std::uint8_t* data, std::uint64_t offset)
+{
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    return value;
+}
+
+/**
+ * @brief Draw a random non-zero token.
+ *
+ * @return Token
+ */
+std::uint64_t NewToken()
+{
+    std::random_device device;
+    std::uint64_t token = 0;
+    while (0 == token)
+    {
+        token = (static_cast<std::uint64_t>(device()) << 32) ^ static_cast<std::uint64_t>(device());
+    }
+    return token;
+}
+}
+
+StateSnapshotFile::StateSnapshotFile()
+    : _data(nullptr), _size(0)
+#ifdef _WIN32
+      ,
+      _mappingHandle(nullptr)
+#endif
+{
+}
+
+StateSnapshotFile::~StateSnapshotFile()
+{
+    Close();
+}
+
+bool StateSnapshotFile::Write(const std::filesystem::path& snapshotPath, FileStateRepository& fileStateRepository, std::size_t memoryLimit)
+{
+    std::vector<PendingState> states;
+    std::vector<std::string> timestamps;
+    std::size_t usedBytes = 0;
+    bool withinLimit = true;
+    const bool visited = fileStateRepository.ForEachFileState(
+        [&](const std::string& filePath, const FileStateRecord& record)
+        {
+            // Rows carry the timestamp of the run that last changed them, so the pool is short and recent runs are at its end.
+            const auto timestamp = std::find(timestamps.rbegin(), timestamps.rend(), record.timestamp);
+            std::uint32_t timestampId = static_cast<std::uint32_t>(timestamps.size());
+            if (timestamps.rend() != timestamp)
+            {
+                timestampId = static_cast<std::uint32_t>(timestamps.rend() - timestamp) - 1;
+            }
+            else
+            {
+                timestamps.push_back(record.timestamp);
+            }
+
+            PendingState state{filePath, SnapshotEntry{}};
+            SnapshotEntry& entry = state.entry;
+            entry.size = record.metadata.size;
+            entry.modificationTimeNs = record.metadata.modificationTimeNs;
+            entry.inode = record.metadata.inode;
+            entry.device = record.metadata.device;
+            entry.changeTimeNs = record.metadata.changeTimeNs;
+            entry.accessTimeNs = record.metadata.accessTimeNs;
+            entry.mode = record.metadata.mode;
+            entry.userId = record.metadata.userId;
+            entry.groupId = record.metadata.groupId;
+            entry.timestampId = timestampId;
+            std::memcpy(entry.hash, record.hash.bytes.data(), record.hash.size);
+            entry.hashSize = record.hash.size;
+            entry.hashAlgorithm = static_cast<std::uint8_t>(record.hashAlgorithm);
+            entry.status = static_cast<std::uint8_t>(record.status);
+            entry.digestScheme = static_cast<std::uint8_t>(record.digestScheme);
+            std::memcpy(entry.sample, record.sampleDigest.bytes.data(), record.sampleDigest.size);
+            entry.sampleSize = record.sampleDigest.size;
+            entry.sampledRuns = record.sampledRuns;
+            usedBytes += sizeof(PendingState) + filePath.size();
+            states.push_back(std::move(state));
+            withinLimit = (usedBytes <= memoryLimit);
+            return withinLimit;
+        });
+    if ((false == visited) || (false == withinLimit) || (std::numeric_limits<std::uint32_t>::max() < timestamps.size()))
+    {
+        return false;
+    }
+    std::sort(states.begin(), states.end(), [](const PendingState& left, const PendingState& right) { return left.path < right.path; });
+    for (std::size_t index = 1; index < states.size(); ++index)
+    {
+        // A path stored twice cannot be told apart, so no snapshot is written.
+        if (states[index - 1].path == states[index].path)
+        {
+            return false;
+        }
+    }
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SnapshotMagic, sizeof(header.magic));
+    header.formatVersion = SnapshotFormatVersion;
+    header.restartInterval = RestartInterval;
+    header.token = NewToken();
+    header.entryCount = states.size();
+    header.timestampCount = timestamps.size();
+
+    std::vector<std::uint8_t> buffer(sizeof(SnapshotHeader), 0);
+    header.timestampsOffset = buffer.size();
+    std::uint64_t textOffset = 0;
+    for (const auto& timestamp : timestamps)
+    {
+        AppendValue(buffer, textOffset);
+        textOffset += timestamp.size();
+    }
+    AppendValue(buffer, textOffset);
+    header.timestampTextOffset = buffer.size();
+    for (const auto& timestamp : timestamps)
+    {
+        buffer.insert(buffer.end(), timestamp.begin(), timestamp.end());
+    }
+    // Entries start on an 8-byte boundary, as their widest fields are 64-bit.
+    buffer.resize((buffer.size() + 7) & ~static_cast<std::size_t>(7), 0);
+    header.entriesOffset = buffer.size();
+    for (const auto& state : states)
+    {
+        AppendValue(buffer, state.entry);
+    }
+
+    std::vector<std::uint8_t> paths;
+    std::vector<std::uint64_t> restarts;
+    for (std::size_t index = 0; index < states.size(); ++index)
+    {
+        const std::string& path = states[index].path;
+        std::size_t shared = 0;
+        if (0 == index % RestartInterval)
+        {
+            restarts.push_back(paths.size());
+        }
+        else
+        {
+            const std::string& previous = states[index - 1].path;
+            const std::size_t limit = std::min(previous.size(), path.size());
+            while ((shared < limit) && (previous[shared] == path[shared]))
+            {
+                ++shared;
+            }
+        }
+        AppendVarint(paths, shared);
+        AppendVarint(paths, path.size() - shared);
+        paths.insert(paths.end(), path.begin() + static_cast<std::ptrdiff_t>(shared), path.end());
+    }
+    header.restartsOffset = buffer.size();
+    for (const std::uint64_t restart : restarts)
+    {
+        AppendValue(buffer, restart);
+    }
+    header.pathsOffset = buffer.size();
+    buffer.insert(buffer.end(), paths.begin(), paths.end());
+    header.fileSize = buffer.size();
+    header.checksum = XXH3_64bits(buffer.data() + sizeof(SnapshotHeader), buffer.size() - sizeof(SnapshotHeader));
+    std::memcpy(buffer.data(), &header, sizeof(SnapshotHeader));
+
+    std::filesystem::path temporaryPath = snapshotPath;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream output(temporaryPath, std::ios::binary | std::ios::trunc);
+        output.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        if (false == output.good())
+        {
+            return false;
+        }
+    }
+    std::error_code errorCode;
+    std::filesystem::rename(temporaryPath, snapshotPath, errorCode);
+    if (0 != errorCode.value())
+    {
+        std::filesystem::remove(temporaryPath, errorCode);
+        return false;
+    }
+    return fileStateRepository.WriteStateSnapshotToken(header.token);
+}
+
+bool StateSnapshotFile::Open(const std::filesystem::path& snapshotPath, FileStateRepository& fileStateRepository)
+{
+    Close();
+    std::uint64_t expectedToken = 0;
+    if (false == fileStateRepository.ReadStateSnapshotToken(expectedToken))
+    {
+        return false;
+    }
+
+#ifdef _WIN32
+    HANDLE file = CreateFileW(snapshotPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        return false;
+    }
+    LARGE_INTEGER fileSize{};
+    HANDLE mapping = nullptr;
+    if ((FALSE != GetFileSizeEx(file, &fileSize)) && (static_cast<LONGLONG>(sizeof(SnapshotHeader)) <= fileSize.QuadPart))
+    {
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    }
+    CloseHandle(file);
+    if (nullptr == mapping)
+    {
+        return false;
+    }
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (nullptr == view)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    _mappingHandle = mapping;
+    _data = static_cast<const std::uint8_t*>(view);
+    _size = static_cast<std::size_t>(fileSize.QuadPart);
+#else
+    const int fileDescriptor = open(snapshotPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (0 > fileDescriptor)
+    {
+        return false;
+    }
+    struct stat fileStatus{};
+    void* view = MAP_FAILED;
+    if ((0 == fstat(fileDescriptor, &fileStatus)) && (static_cast<off_t>(sizeof(SnapshotHeader)) <= fileStatus.st_size))
+    {
+        view = mmap(nullptr, static_cast<std::size_t>(fileStatus.st_size), PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    }
+    close(fileDescriptor);
+    if (MAP_FAILED == view)
+    {
+        return false;
+    }
+    _data = static_cast<const std::uint8_t*>(view);
+    _size = static_cast<std::size_t>(fileStatus.st_size);
+#endif
+
+    if (false == Validate(expectedToken))
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+std::uint64_t StateSnapshotFile::Token() const
+{
+    return (nullptr != _data) ? ReadValue<SnapshotHeader>(_data, 0).token : 0;
+}
+
+bool StateSnapshotFile::Find(std::string_view filePath, FileStateRecord& outputRecord) const
+{
+    if (nullptr == _data)
+    {
+        return false;
+    }
+    const SnapshotHeader header = ReadValue<SnapshotHeader>(_data, 0);
+    const std::uint64_t blockCount = (header.entryCount + RestartInterval - 1) / RestartInterval;
+
+    // The last run whose first path is not after the wanted one is the only run that can hold it.
+    std::uint64_t low = 0;
+    std::uint64_t high = blockCount;
+    while (low < high)
+    {
+        const std::uint64_t middle = low + ((high - low) / 2);
+        if (RestartPath(middle) <= filePath)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (0 == low)
+    {
+        return false;
+    }
+    const std::uint64_t block = low - 1;
+
+    std::size_t position = static_cast<std::size_t>(header.pathsOffset + ReadValue<std::uint64_t>(_data, header.restartsOffset + (block * sizeof(std::uint64_t))));
+    std::string path;
+    const std::uint64_t end = std::min(header.entryCount, (block + 1) * RestartInterval);
+    for (std::uint64_t index = block * RestartInterval; index < end; ++index)
+    {
+        std::uint64_t shared = 0;
+        std::uint64_t suffixLength = 0;
+        if ((false == ReadVarint(_data, _size, position, shared)) || (false == ReadVarint(_data, _size, position, suffixLength)) ||
+            (path.size() < shared) || (_size - position < suffixLength))
+        {
+            return false;
+        }
+        path.resize(static_cast<std::size_t>(shared));
+        path.append(reinterpret_cast<const char*>(_data + position), static_cast<std::size_t>(suffixLength));
+        position += static_cast<std::size_t>(suffixLength);
+        if (filePath < path)
+        {
+            return false;
+        }
+        if (filePath != path)
+        {
+            continue;
+        }
+
+        const SnapshotEntry entry = ReadValue<SnapshotEntry>(_data, header.entriesOffset + (index * sizeof(SnapshotEntry)));
+        if ((header.timestampCount <= entry.timestampId) || (HashDigest::MaxSize < entry.hashSize) || (HashDigest::MaxSize < entry.sampleSize))
+        {
+            return false;
+        }
+        const std::uint64_t textStart = ReadValue<std::uint64_t>(_data, header.timestampsOffset + (entry.timestampId * sizeof(std::uint64_t)));
+        const std::uint64_t textEnd = ReadValue<std::uint64_t>(_data, header.timestampsOffset + ((entry.timestampId + 1) * sizeof(std::uint64_t)));
+        if ((textEnd < textStart) || (header.entriesOffset - header.timestampTextOffset < textEnd))
+        {
+            return false;
+        }
+
+        FileStateRecord record{};
+        HashDigest::FromBytes(entry.hash, entry.hashSize, record.hash);
+        record.hashAlgorithm = static_cast<HashAlgorithm>(entry.hashAlgorithm);
+        record.status = static_cast<ChangeType>(entry.status);
+        record.timestamp.assign(reinterpret_cast<const char*>(_data + header.timestampTextOffset + textStart), textEnd - textStart);
+        record.metadata.size = entry.size;
+        record.metadata.modificationTimeNs = entry.modificationTimeNs;
+        record.metadata.inode = entry.inode;
+        record.metadata.device = entry.device;
+        record.metadata.changeTimeNs = entry.changeTimeNs;
+        record.metadata.accessTimeNs = entry.accessTimeNs;
+        record.metadata.mode = entry.mode;
+        record.metadata.userId = entry.userId;
+        record.metadata.groupId = entry.groupId;
+        record.digestScheme = static_cast<DigestScheme>(entry.digestScheme);
+        HashDigest::FromBytes(entry.sample, entry.sampleSize, record.sampleDigest);
+        record.sampledRuns = entry.sampledRuns;
+        // The snapshot is written after its run finished, so no later run has committed any of its rows.
+        record.committedInRun = false;
+        outputRecord = std::move(record);
+        return true;
+    }
+    return false;
+}
+
+void StateSnapshotFile::Close()
+{
+    if (nullptr == _data)
+    {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(_mappingHandle);
+    _mappingHandle = nullptr;
+#else
+    munmap(const_cast<std::uint8_t*>(_data), _size);
+#endif
+    _data = nullptr;
+    _size = 0;
+}
+
+/**
+ * @brief Check the mapped file's header, section bounds, token and checksum.
+ *
+ * @param[in] expectedToken Token the database stores
+ * @return true if the file may be used
+ */
+bool StateSnapshotFile::Validate(std::uint64_t expectedToken) const
+{
+    const SnapshotHeader header = ReadValue<SnapshotHeader>(_data, 0);
+    if ((0 != std::memcmp(header.magic, SnapshotMagic, sizeof(header.magic))) || (SnapshotFormatVersion != header.formatVersion) ||
+        (RestartInterval != header.restartInterval) || (expectedToken != header.token) || (_size != header.fileSize))
+    {
+        return false;
+    }
+    // Each section must fit between its offset and the next one, so lookups never read outside the mapping.
+    const std::uint64_t blockCount = (header.entryCount + RestartInterval - 1) / RestartInterval;
+    if ((header.timestampsOffset < sizeof(SnapshotHeader)) || (header.timestampCount >= (_size / sizeof(std::uint64_t))) ||
+        (header.timestampTextOffset - header.timestampsOffset != (header.timestampCount + 1) * sizeof(std::uint64_t)) ||
+        (header.entriesOffset < header.timestampTextOffset) || (header.entryCount > (_size / sizeof(SnapshotEntry))) ||
+        (header.restartsOffset < header.entriesOffset + (header.entryCount * sizeof(SnapshotEntry))) ||
+        (header.pathsOffset != header.restartsOffset + (blockCount * sizeof(std::uint64_t))) || (_size < header.pathsOffset))
+    {
+        return false;
+    }
+    const std::uint64_t textSize = ReadValue<std::uint64_t>(_data, header.timestampsOffset + (header.timestampCount * sizeof(std::uint64_t)));
+    if (header.entriesOffset - header.timestampTextOffset < textSize)
+    {
+        return false;
+    }
+    for (std::uint64_t block = 0; block < blockCount; ++block)
+    {
+        if (_size - header.pathsOffset <= ReadValue<std::uint64_t>(_data, header.restartsOffset + (block * sizeof(std::uint64_t))))
+        {
+            return false;
+        }
+    }
+    return header.checksum == XXH3_64bits(_data + sizeof(SnapshotHeader), _size - sizeof(SnapshotHeader));
+}
+
+/**
+ * @brief Get the full path stored at the start of a front-coded run.
+ *
+ * @param[in] block Index of the run
+ * @return Path pointing into the mapping, empty if it cannot be decoded
+ */
+std::string_view StateSnapshotFile::RestartPath(std::uint64_t block) const
+{
+    const SnapshotHeader header = ReadValue<SnapshotHeader>(_data, 0);
+    std::size_t position = static_cast<std::size_t>(header.pathsOffset + ReadValue<std::uint64_t>(_data, header.restartsOffset + (block * sizeof(std::uint64_t))));
+    std::uint64_t shared = 0;
+    std::uint64_t length = 0;
+    if ((false == ReadVarint(_data, _size, position, shared)) || (false == ReadVarint(_data, _size, position, length)) || (_size - position < length))
+    {
+        return std::string_view();
+    }
+    return std::string_view(reinterpret_cast<const char*>(_data + position), static_cast<std::size_t>(length));
+}
@@ -0,0 +1,96 @@
+// file StateSnapshotFile.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+/**
+ * @brief Compact binary copy of every stored file state, read through a memory mapping without a parse step.
+ *
+ * The file holds the paths in sorted order, front-coded against the previous path with a full path
+ * every RestartInterval entries, one fixed-width entry per path with its metadata and digest, and the
+ * distinct timestamps. A lookup binary-searches the full paths at the restart points and decodes at
+ * most one run of front-coded paths. A checksum covers everything after the header, and a random token
+ * in the header must match the one the database stores, which triggers drop whenever a file row
+ * changes; a file that fails either check is not used. The layout follows the host's byte order,
+ * so a file written on one architecture is rejected on another.
+ */
+class StateSnapshotFile
+{
+  public:
+    /**
+     * @brief Paths between two paths stored in full.
+     */
+    static constexpr std::uint32_t RestartInterval = 16;
+
+    /**
+     * @brief Create an unmapped snapshot.
+     */
+    StateSnapshotFile();
+
+    /**
+     * @brief Unmap the file.
+     */
+    ~StateSnapshotFile();
+
+    StateSnapshotFile(const StateSnapshotFile&) = delete;
+    StateSnapshotFile& operator=(const StateSnapshotFile&) = delete;
+
+    /**
+     * @brief Write the stored file states to a snapshot file and record its token in the database.
+     *
+     * The file is written under a temporary name and renamed over the previous one, and the token is
+     * stored last, so a crash in between leaves at worst a file the database does not vouch for.
+     *
+     * @param[in] snapshotPath File to create or replace
+     * @param[in] fileStateRepository Repository whose file states are written
+     * @param[in] memoryLimit Most bytes the sorted states may use while writing; larger tables are not written
+     * @return true if the file was written and its token stored, false on error or when over the limit
+     */
+    static bool Write(const std::filesystem::path& snapshotPath, FileStateRepository& fileStateRepository, std::size_t memoryLimit);
+
+    /**
+     * @brief Map a snapshot file if it matches the stored file states.
+     *
+     * @param[in] snapshotPath File written by Write
+     * @param[in] fileStateRepository Repository holding the token of the current snapshot
+     * @return true if the file is mapped and valid, false if it is missing, stale or corrupt
+     */
+    bool Open(const std::filesystem::path& snapshotPath, FileStateRepository& fileStateRepository);
+
+    /**
+     * @brief Get the token of the mapped file.
+     *
+     * @return Token from the header, 0 if nothing is mapped
+     */
+    std::uint64_t Token() const;
+
+    /**
+     * @brief Look up the state of a path; safe to call from any number of threads.
+     *
+     * @param[in] filePath Repository-relative file path
+     * @param[out] outputRecord Stored file state
+     * @return true if the path is present, false otherwise
+     */
+    bool Find(std::string_view filePath, FileStateRecord& outputRecord) const;
+
+    /**
+     * @brief Unmap the file; later lookups find nothing.
+     */
+    void Close();
+
+  private:
+    bool Validate(std::uint64_t expectedToken) const;
+    std::string_view RestartPath(std::uint64_t block) const;
+
+    const std::uint8_t* _data;
+    std::size_t _size;
+#ifdef _WIN32
+    void* _mappingHandle;
+#endif
+};
@@ -0,0 +1,180 @@
+// file StateTreeDiff.cpp:
+
+#include "StateTreeDiff.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+
+namespace
+{
+constexpr char PathSeparator = static_cast<char>(std::filesystem::path::preferred_separator);
+
+/**
+ * @brief Append a component to a repository-relative directory path.
+ */
+std::string JoinPath(const std::string& parent, const std::string& name)
+{
+    return (true == parent.empty()) ? name : parent + PathSeparator + name;
+}
+
+/**
+ * @brief Keep only the states of files that are not marked deleted.
+ *
+ * @param[in,out] states States of one directory
+ */
+void DropDeleted(std::vector<NamedFileState>& states)
+{
+    states.erase(std::remove_if(states.begin(), states.end(),
+                                [](const NamedFileState& state) { return ChangeType::Deleted == state.record.status; }),
+                 states.end());
+}
+}
+
+StateTreeDiff::StateTreeDiff(FileStateRepository& fromRepository, FileStateRepository& toRepository)
+    : _fromRepository(fromRepository), _toRepository(toRepository)
+{
+}
+
+bool StateTreeDiff::Compare(DiffReport& outputReport)
+{
+    HashDigest fromDigest{};
+    HashDigest toDigest{};
+    if ((false == _fromRepository.GetDirectoryDigest(std::string(), fromDigest)) ||
+        (false == _toRepository.GetDirectoryDigest(std::string(), toDigest)))
+    {
+        return false;
+    }
+    if (fromDigest == toDigest)
+    {
+        ++outputReport.directoriesSkipped;
+        return true;
+    }
+    if (false == CompareDirectory(std::string(), outputReport))
+    {
+        return false;
+    }
+    std::sort(outputReport.entries.begin(), outputReport.entries.end(),
+              [](const DiffEntry& left, const DiffEntry& right) { return left.path < right.path; });
+    return true;
+}
+
+/**
+ * @brief Compare the files of a directory present in both repositories, then its subdirectories.
+ *
+ * @param[in] directoryPath Repository-relative directory path, empty for the source root
+ * @param[in,out] outputReport Receives the differing files and the directory counts
+ * @return true on success, false on error
+ */
+bool StateTreeDiff::CompareDirectory(const std::string& directoryPath, DiffReport& outputReport)
+{
+    ++outputReport.directoriesCompared;
+
+    std::vector<NamedFileState> fromFiles;
+    std::vector<NamedFileState> toFiles;
+    if ((false == _fromRepository.GetDirectoryFileStates(directoryPath, fromFiles)) ||
+        (false == _toRepository.GetDirectoryFileStates(directoryPath, toFiles)))
+    {
+        return false;
+    }
+    DropDeleted(fromFiles);
+    DropDeleted(toFiles);
+    auto fromFile = fromFiles.begin();
+    auto toFile = toFiles.begin();
+    while ((fromFiles.end() != fromFile) || (toFiles.end() != toFile))
+    {
+        if ((toFiles.end() == toFile) || ((fromFiles.end() != fromFile) && (fromFile->name < toFile->name)))
+        {
+            outputReport.entries.push_back({JoinPath(directoryPath, fromFile->name), ChangeType::Deleted});
+            ++fromFile;
+        }
+        else if ((fromFiles.end() == fromFile) || (toFile->name < fromFile->name))
+        {
+            outputReport.entries.push_back({JoinPath(directoryPath, toFile->name), ChangeType::Added});
+            ++toFile;
+        }
+        else
+        {
+            if ((fromFile->record.hash != toFile->record.hash) || (fromFile->record.hashAlgorithm != toFile->record.hashAlgorithm))
+            {
+                outputReport.entries.push_back({JoinPath(directoryPath, fromFile->name), ChangeType::Modified});
+            }
+            ++fromFile;
+            ++toFile;
+        }
+    }
+
+    std::vector<NamedDirectoryDigest> fromDirectories;
+    std::vector<NamedDirectoryDigest> toDirectories;
+    if ((false == _fromRepository.GetSubdirectoryDigests(directoryPath, fromDirectories)) ||
+        (false == _toRepository.GetSubdirectoryDigests(directoryPath, toDirectories)))
+    {
+        return false;
+    }
+    auto fromDirectory = fromDirectories.begin();
+    auto toDirectory = toDirectories.begin();
+    while ((fromDirectories.end() != fromDirectory) || (toDirectories.end() != toDirectory))
+    {
+        bool listed = true;
+        if ((toDirectories.end() == toDirectory) || ((fromDirectories.end() != fromDirectory) && (fromDirectory->name < toDirectory->name)))
+        {
+            listed = ListSubtree(_fromRepository, JoinPath(directoryPath, fromDirectory->name), ChangeType::Deleted, outputReport);
+            ++fromDirectory;
+        }
+        else if ((fromDirectories.end() == fromDirectory) || (toDirectory->name < fromDirectory->name))
+        {
+            listed = ListSubtree(_toRepository, JoinPath(directoryPath, toDirectory->name), ChangeType::Added, outputReport);
+            ++toDirectory;
+        }
+        else
+        {
+            if (fromDirectory->digest == toDirectory->digest)
+            {
+                ++outputReport.directoriesSkipped;
+            }
+            else
+            {
+                listed = CompareDirectory(JoinPath(directoryPath, fromDirectory->name), outputReport);
+            }
+            ++fromDirectory;
+            ++toDirectory;
+        }
+        if (false == listed)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Report every live file below a directory that only one repository has.
+ *
+ * @param[in] repository Repository holding the directory
+ * @param[in] directoryPath Repository-relative directory path
+ * @param[in] change Added or Deleted, depending on the side
+ * @param[in,out] outputReport Receives the files
+ * @return true on success, false on error
+ */
+bool StateTreeDiff::ListSubtree(FileStateRepository& repository, const std::string& directoryPath, ChangeType change, DiffReport& outputReport)
+{
+    std::vector<NamedFileState> files;
+    std::vector<NamedDirectoryDigest> directories;
+    if ((false == repository.GetDirectoryFileStates(directoryPath, files)) || (false == repository.GetSubdirectoryDigests(directoryPath, directories)))
+    {
+        return false;
+    }
+    DropDeleted(files);
+    for (const auto& file : files)
+    {
+        outputReport.entries.push_back({JoinPath(directoryPath, file.name), change});
+    }
+    for (const auto& directory : directories)
+    {
+        if (false == ListSubtree(repository, JoinPath(directoryPath, directory.name), change, outputReport))
+        {
+            return false;
+        }
+    }
+    return true;
+}
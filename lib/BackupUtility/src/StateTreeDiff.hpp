@@ -0,0 +1,44 @@
+// file StateTreeDiff.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+
+#include <string>
+
+/**
+ * @brief Compares the file trees of two state databases, skipping the subtrees whose digests match.
+ *
+ * The walk starts at the source root and descends only into directories present in both databases
+ * whose digests differ; their files are merged by name, as are their subdirectories. A subtree present
+ * on one side only is listed in full. Both repositories must have refreshed their directory digests.
+ */
+class StateTreeDiff
+{
+  public:
+    /**
+     * @brief Construct a diff between two repositories.
+     *
+     * @param[in] fromRepository Repository compared from, whose extra files are reported deleted
+     * @param[in] toRepository Repository compared to, whose extra files are reported added
+     */
+    StateTreeDiff(FileStateRepository& fromRepository, FileStateRepository& toRepository);
+
+    StateTreeDiff(const StateTreeDiff&) = delete;
+    StateTreeDiff& operator=(const StateTreeDiff&) = delete;
+
+    /**
+     * @brief Collect the differing files.
+     *
+     * @param[in,out] outputReport Receives the differing files in ascending path order and the directory counts
+     * @return true on success, false if a directory cannot be read or its digest is stale
+     */
+    bool Compare(DiffReport& outputReport);
+
+  private:
+    bool CompareDirectory(const std::string& directoryPath, DiffReport& outputReport);
+    bool ListSubtree(FileStateRepository& repository, const std::string& directoryPath, ChangeType change, DiffReport& outputReport);
+
+    FileStateRepository& _fromRepository;
+    FileStateRepository& _toRepository;
+};
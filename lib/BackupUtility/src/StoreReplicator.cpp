@@ -0,0 +1,298 @@
+// file StoreReplicator.cpp:
+
+#include "StoreReplicator.hpp"
+
+#include "RelativePathBuilder.hpp"
+#include "FileCopier/FileCopier.hpp"
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+namespace
+{
+constexpr const char* MarkHeader = "rdemo-replication\t1";
+constexpr const char* StagingSuffix = ".replicating";
+constexpr std::size_t CopyBatchSize = 64;
+
+// Areas whose files are named after their content or only grow, so a name and a size tell whether the replica holds them.
+constexpr const char* ContentAreas[] = {"objects", "chunks", "packs"};
+} // namespace
+
+StoreReplicator::StoreReplicator(const std::filesystem::path& backupRoot, const std::filesystem::path& target, FileStateRepository& fileStateRepository)
+    : _backupRoot(backupRoot), _target(target), _fileStateRepository(fileStateRepository)
+{
+}
+
+bool StoreReplicator::Plan(ReplicateReport& outputReport)
+{
+    // A running backup moves files between backup/ and its snapshot while they would be sent.
+    bool running = false;
+    std::vector<BackupRunRecord> runs;
+    if ((false == _fileStateRepository.IsRunInProgress(running)) || (true == running) || (false == _fileStateRepository.GetRuns(runs)) ||
+        (true == runs.empty()))
+    {
+        return false;
+    }
+    BackupRunRecord latest{};
+    bool completed = false;
+    if (false == _fileStateRepository.GetLatestRun(latest, completed))
+    {
+        return false;
+    }
+    // A run that did not complete can be resumed under its own start time, so its changes are read again next time.
+    _next.runId = latest.id;
+    _next.changesAfter = (true == completed) ? latest.started : ((1 < runs.size()) ? runs[runs.size() - 2].started : std::string());
+    outputReport.runId = latest.id;
+
+    Mark mark;
+    outputReport.full = (false == ReadMark(mark)) || (true == mark.changesAfter.empty());
+    if (true == outputReport.full)
+    {
+        AddTree("backup");
+        AddTree("deleted");
+    }
+    else
+    {
+        const std::filesystem::path backupArea("backup");
+        std::filesystem::path relative;
+        std::error_code ec;
+        const bool listed = _fileStateRepository.ForEachChangeBetween(mark.changesAfter, latest.started,
+                                                                      [&](const DiffEntry& entry)
+                                                                      {
+                                                                          RelativePathBuilder::BuildLocation(backupArea, entry.path, relative);
+                                                                          if (ChangeType::Deleted == entry.change)
+                                                                          {
+                                                                              _removals.push_back(relative);
+                                                                          }
+                                                                          else if (true == std::filesystem::is_regular_file(_backupRoot / relative, ec))
+                                                                          {
+                                                                              // A packed file has no plain copy; its pack segment is sent instead.
+                                                                              _copies.push_back(relative);
+                                                                          }
+                                                                          return true;
+                                                                      });
+        std::vector<std::string> names;
+        if ((false == listed) || (false == _fileStateRepository.GetSnapshotNames(names)))
+        {
+            return false;
+        }
+        const std::set<std::string> snapshots(names.begin(), names.end());
+        for (const std::string& name : snapshots)
+        {
+            if (mark.changesAfter < name)
+            {
+                AddTree(std::filesystem::path("deleted") / name);
+            }
+        }
+        for (const auto& entry : std::filesystem::directory_iterator(_target / "deleted", ec))
+        {
+            if (0 == snapshots.count(entry.path().filename().string()))
+            {
+                _removals.push_back(std::filesystem::path("deleted") / entry.path().filename());
+            }
+        }
+    }
+    for (const char* area : ContentAreas)
+    {
+        SyncArea(area);
+    }
+    return true;
+}
+
+bool StoreReplicator::Execute(SQLiteConnection& connection, const std::filesystem::path& databaseFile, unsigned int threads, std::size_t queueDepth,
+                              ReplicateReport& outputReport)
+{
+    std::atomic<bool> success{true};
+    std::atomic<std::uint64_t> filesCopied{0};
+    std::atomic<std::uint64_t> bytesCopied{0};
+    const FileCopier fileCopier;
+    if (false == _copies.empty())
+    {
+        // A dequeued batch is copied together, so its small files go through one ring with many copies in flight.
+        ThreadedFileQueueOptions options;
+        options.dequeueBatchSize = CopyBatchSize;
+        options.batchWorkItem = [&](const std::vector<FileWorkItem>& batch)
+        {
+            std::vector<std::pair<std::filesystem::path, std::filesystem::path>> copies;
+            std::uint64_t batchBytes = 0;
+            copies.reserve(batch.size());
+            for (const FileWorkItem& item : batch)
+            {
+                const std::filesystem::path destination = _target / item.path;
+                std::error_code ec;
+                std::filesystem::create_directories(destination.parent_path(), ec);
+                const std::uintmax_t size = std::filesystem::file_size(_backupRoot / item.path, ec);
+                if (0 != ec.value())
+                {
+                    success.store(false);
+                    continue;
+                }
+                batchBytes += size;
+                copies.emplace_back(_backupRoot / item.path, destination);
+            }
+            std::vector<std::size_t> failed;
+            if (false == fileCopier.CopyBatch(copies, failed))
+            {
+                success.store(false);
+            }
+            filesCopied.fetch_add(copies.size() - failed.size());
+            bytesCopied.fetch_add(batchBytes);
+        };
+        ThreadedFileQueue copyQueue(threads, queueDepth, nullptr, nullptr, options);
+        copyQueue.EnqueueBatch(std::move(_copies));
+        copyQueue.Finalize();
+        _copies.clear();
+    }
+    outputReport.filesCopied += filesCopied.load();
+    outputReport.bytesCopied += bytesCopied.load();
+
+    for (const auto& relative : _removals)
+    {
+        std::error_code ec;
+        if (0 < std::filesystem::remove_all(_target / relative, ec))
+        {
+            ++outputReport.entriesRemoved;
+        }
+        if (0 != ec.value())
+        {
+            success.store(false);
+        }
+    }
+    if (false == success.load())
+    {
+        return false;
+    }
+
+    // VACUUM INTO writes a consistent copy from one read transaction, without the WAL of the original.
+    const std::filesystem::path databaseCopy = _target / databaseFile.filename();
+    std::filesystem::path stagedCopy = databaseCopy;
+    stagedCopy += StagingSuffix;
+    std::error_code ec;
+    std::filesystem::remove(stagedCopy, ec);
+    try
+    {
+        auto vacuum = connection.Prepare("VACUUM INTO ?1;");
+        vacuum.BindText(1, stagedCopy.string());
+        vacuum.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+    std::filesystem::rename(stagedCopy, databaseCopy, ec);
+    return (0 == ec.value()) && (true == WriteMark(_next));
+}
+
+/**
+ * @brief Read the mark of the replica.
+ *
+ * @param[out] outputMark Run held and point in time changes are read after
+ * @return true if the replica has a valid mark, false for a new replica
+ */
+bool StoreReplicator::ReadMark(Mark& outputMark) const
+{
+    std::ifstream inputStream(_target / MarkFileName);
+    std::string line;
+    if ((false == static_cast<bool>(std::getline(inputStream, line))) || (MarkHeader != line) ||
+        (false == static_cast<bool>(std::getline(inputStream, line))))
+    {
+        return false;
+    }
+    const std::size_t separator = line.find('\t');
+    if (std::string::npos == separator)
+    {
+        return false;
+    }
+    try
+    {
+        outputMark.runId = std::stoll(line.substr(0, separator));
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+    outputMark.changesAfter = line.substr(separator + 1);
+    return true;
+}
+
+/**
+ * @brief Replace the mark of the replica in one rename.
+ *
+ * @param[in] mark Run held and point in time the next replication reads changes after
+ * @return true on success, false on error
+ */
+bool StoreReplicator::WriteMark(const Mark& mark) const
+{
+    const std::filesystem::path markFile = _target / MarkFileName;
+    std::filesystem::path stagedMark = markFile;
+    stagedMark += StagingSuffix;
+    {
+        std::ofstream outputStream(stagedMark, std::ios::trunc);
+        outputStream << MarkHeader << '\n' << mark.runId << '\t' << mark.changesAfter << '\n';
+        outputStream.close();
+        if (true == outputStream.fail())
+        {
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(stagedMark, markFile, ec);
+    return 0 == ec.value();
+}
+
+/**
+ * @brief Plan to send every file below a directory of the store.
+ *
+ * @param[in] relativeDirectory Directory relative to the backup root; a missing one adds nothing
+ */
+void StoreReplicator::AddTree(const std::filesystem::path& relativeDirectory)
+{
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator entry(_backupRoot / relativeDirectory, ec), end; (0 == ec.value()) && (end != entry);
+         entry.increment(ec))
+    {
+        if (true == entry->is_regular_file(ec))
+        {
+            _copies.push_back(relativeDirectory / entry->path().lexically_relative(_backupRoot / relativeDirectory));
+        }
+    }
+}
+
+/**
+ * @brief Plan to send the files of a content area the replica lacks or holds at another size, and to remove those gone from the store.
+ *
+ * @param[in] area Directory below the backup root
+ */
+void StoreReplicator::SyncArea(const char* area)
+{
+    const std::filesystem::path localArea = _backupRoot / area;
+    const std::filesystem::path replicaArea = _target / area;
+    std::error_code ec;
+    std::error_code sizeEc;
+    for (std::filesystem::recursive_directory_iterator entry(localArea, ec), end; (0 == ec.value()) && (end != entry); entry.increment(ec))
+    {
+        if (false == entry->is_regular_file(sizeEc))
+        {
+            continue;
+        }
+        const std::filesystem::path relative = entry->path().lexically_relative(localArea);
+        const std::uintmax_t replicaSize = std::filesystem::file_size(replicaArea / relative, sizeEc);
+        if ((0 != sizeEc.value()) || (replicaSize != entry->file_size(sizeEc)))
+        {
+            _copies.push_back(area / relative);
+        }
+    }
+    for (std::filesystem::recursive_directory_iterator entry(replicaArea, ec), end; (0 == ec.value()) && (end != entry); entry.increment(ec))
+    {
+        const std::filesystem::path relative = entry->path().lexically_relative(replicaArea);
+        if ((true == entry->is_regular_file(sizeEc)) && (false == std::filesystem::exists(localArea / relative, sizeEc)))
+        {
+            _removals.push_back(area / relative);
+        }
+    }
+}
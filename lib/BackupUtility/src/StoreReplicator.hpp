@@ -0,0 +1,86 @@
+// file StoreReplicator.hpp:
+
+#pragma once
+
+#include "FileStateRepository.hpp"
+#include "BackupUtility/BackupUtility.hpp"
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Keeps a copy of a backup store in another directory up to date, sending only what changed since the last copy.
+ *
+ * The replica holds backup/, deleted/, objects/, chunks/ and packs/ under the same names, a consistent
+ * copy of the state database, and a mark naming the run the replica holds and the point in time the next
+ * replication reads changes after. Without a mark, everything is copied. With one, only these are sent:
+ * the current copies of the paths the version history reports changed since that point, the snapshot
+ * directories started since then, and the content-addressed and pack files the replica lacks or holds
+ * at another size. Paths deleted since then, snapshots pruned since then, and content files that are gone
+ * from the store are removed from the replica. The mark is written last, so an interrupted replication
+ * repeats the same window.
+ */
+class StoreReplicator
+{
+  public:
+    /**
+     * @brief Name of the mark file in the replica.
+     */
+    static constexpr const char* MarkFileName = "replication.state";
+
+    /**
+     * @brief Create a replicator.
+     *
+     * @param[in] backupRoot Backup root replicated
+     * @param[in] target Directory the replica is kept in, created on first use
+     * @param[in] fileStateRepository Repository of the runs, snapshots and versions of the store
+     */
+    StoreReplicator(const std::filesystem::path& backupRoot, const std::filesystem::path& target, FileStateRepository& fileStateRepository);
+
+    /**
+     * @brief Decide what to send and remove.
+     *
+     * @param[out] outputReport Run replicated up to and whether the whole store is sent
+     * @return true on success, false if a run is in progress, no run was recorded or the store cannot be read
+     */
+    bool Plan(ReplicateReport& outputReport);
+
+    /**
+     * @brief Send the planned files on a pool of threads, remove what is gone, copy the database, then write the mark.
+     *
+     * @param[in,out] connection Connection to the state database the copy is taken from
+     * @param[in] databaseFile State database, whose file name the copy gets in the replica
+     * @param[in] threads Copying threads
+     * @param[in] queueDepth Bound of the copy queue
+     * @param[in,out] outputReport Files and bytes sent and entries removed are added
+     * @return true if the replica is complete, false otherwise
+     */
+    bool Execute(SQLiteConnection& connection, const std::filesystem::path& databaseFile, unsigned int threads, std::size_t queueDepth,
+                 ReplicateReport& outputReport);
+
+  private:
+    /**
+     * @brief Content of the mark file.
+     */
+    struct Mark
+    {
+        std::int64_t runId = 0; /**< Newest run the replica holds */
+        std::string changesAfter; /**< Point in time the next replication reads changes after */
+    };
+
+    bool ReadMark(Mark& outputMark) const;
+    bool WriteMark(const Mark& mark) const;
+    void AddTree(const std::filesystem::path& relativeDirectory);
+    void SyncArea(const char* area);
+
+    std::filesystem::path _backupRoot;
+    std::filesystem::path _target;
+    FileStateRepository& _fileStateRepository;
+    std::vector<std::filesystem::path> _copies;  /**< Files to send, relative to the backup root */
+    std::vector<std::filesystem::path> _removals; /**< Entries to remove, relative to the replica */
+    Mark _next;
+};
@@ -0,0 +1,373 @@
+// file TarArchive.cpp:
+
+#include "TarArchive.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+constexpr std::size_t NameLength = 100;
+constexpr std::size_t PrefixLength = 155;
+constexpr std::size_t ModeOffset = 100;
+constexpr std::size_t UserIdOffset = 108;
+constexpr std::size_t GroupIdOffset = 116;
+constexpr std::size_t SizeOffset = 124;
+constexpr std::size_t TimeOffset = 136;
+constexpr std::size_t ChecksumOffset = 148;
+constexpr std::size_t ChecksumLength = 8;
+constexpr std::size_t TypeOffset = 156;
+constexpr std::size_t MagicOffset = 257;
+constexpr std::size_t PrefixOffset = 345;
+constexpr std::size_t IdFieldLength = 8;
+constexpr std::size_t NumberFieldLength = 12;
+constexpr std::uint64_t MaximumIdValue = 07777777;
+constexpr std::uint64_t MaximumNumberValue = 077777777777;
+constexpr char RegularFileType = '0';
+constexpr char OldRegularFileType = '\0';
+constexpr char ContiguousFileType = '7';
+constexpr char DirectoryType = '5';
+constexpr char ExtendedHeaderType = 'x';
+constexpr char GlobalHeaderType = 'g';
+constexpr char LongNameType = 'L';
+constexpr const char* PaxHeaderDirectory = "PaxHeaders/";
+
+/**
+ * @brief Write a number as zero-padded octal followed by a NUL.
+ *
+ * @param[in,out] block Header block
+ * @param[in] offset Offset of the field
+ * @param[in] length Length of the field including the NUL
+ * @param[in] value Value that fits the field
+ */
+void WriteOctal(std::string& block, std::size_t offset, std::size_t length, std::uint64_t value)
+{
+    for (std::size_t i = length - 1; 0 < i; --i)
+    {
+        block[offset + i - 1] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+    block[offset + length - 1] = '\0';
+}
+
+/**
+ * @brief Read a numeric field: octal digits padded with spaces or NULs, or a GNU base-256 number.
+ *
+ * @param[in] block Header block
+ * @param[in] offset Offset of the field
+ * @param[in] length Length of the field
+ * @param[out] outputValue Value of the field, 0 for an empty field
+ * @return true if the field is well formed, false otherwise
+ */
+bool ReadNumber(const char* block, std::size_t offset, std::size_t length, std::uint64_t& outputValue)
+{
+    const unsigned char* field = reinterpret_cast<const unsigned char*>(block + offset);
+    outputValue = 0;
+    // Base-256 numbers set the top bit of the first byte; negative ones are not valid here.
+    if (0 != (field[0] & 0x80))
+    {
+        if (0 != (field[0] & 0x40))
+        {
+            return false;
+        }
+        outputValue = field[0] & 0x3F;
+        for (std::size_t i = 1; i < length; ++i)
+        {
+            if (0 != (outputValue >> 56))
+            {
+                return false;
+            }
+            outputValue = (outputValue << 8) | field[i];
+        }
+        return true;
+    }
+    std::size_t i = 0;
+    while ((i < length) && (' ' == field[i]))
+    {
+        ++i;
+    }
+    for (; (i < length) && ('0' <= field[i]) && ('7' >= field[i]); ++i)
+    {
+        outputValue = (outputValue << 3) | static_cast<std::uint64_t>(field[i] - '0');
+    }
+    for (; i < length; ++i)
+    {
+        if ((' ' != field[i]) && ('\0' != field[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Read a text field that is NUL-terminated unless it fills the field.
+ *
+ * @param[in] block Header block
+ * @param[in] offset Offset of the field
+ * @param[in] length Length of the field
+ * @return Text of the field
+ */
+std::string ReadText(const char* block, std::size_t offset, std::size_t length)
+{
+    const char* field = block + offset;
+    return std::string(field, std::find(field, field + length, '\0'));
+}
+
+/**
+ * @brief Split a name into the ustar prefix and name fields at a slash.
+ *
+ * @param[in] name Member name
+ * @param[out] outputPrefix Part before the slash, empty when the name fits alone
+ * @param[out] outputName Part after the slash
+ * @return true if the name fits the two fields, false if it needs a pax path record
+ */
+bool SplitName(const std::string& name, std::string& outputPrefix, std::string& outputName)
+{
+    if (name.size() <= NameLength)
+    {
+        outputPrefix.clear();
+        outputName = name;
+        return true;
+    }
+    // The last slash that leaves a name short enough gives the longest usable prefix.
+    for (std::size_t slash = name.find('/', name.size() - NameLength - 1); std::string::npos != slash; slash = name.find('/', slash + 1))
+    {
+        if ((slash <= PrefixLength) && (0 < slash) && (slash + 1 < name.size()))
+        {
+            outputPrefix = name.substr(0, slash);
+            outputName = name.substr(slash + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Append one pax record, `<length> <key>=<value>\n`, whose length counts its own digits.
+ *
+ * @param[in,out] records Records of the extended header
+ * @param[in] key Record key
+ * @param[in] value Record value
+ */
+void AppendPaxRecord(std::string& records, const std::string& key, const std::string& value)
+{
+    const std::size_t payload = key.size() + value.size() + 3;
+    std::size_t length = payload + 1;
+    while (length != payload + std::to_string(length).size())
+    {
+        length = payload + std::to_string(length).size();
+    }
+    records += std::to_string(length) + " " + key + "=" + value + "\n";
+}
+
+/**
+ * @brief Format one header block with its checksum.
+ *
+ * @param[in] prefix ustar prefix field
+ * @param[in] name ustar name field
+ * @param[in] type Type flag
+ * @param[in] member Attributes; values that do not fit their field are written as 0 and carried by pax
+ * @return One block
+ */
+std::string HeaderBlock(const std::string& prefix, const std::string& name, char type, const TarMember& member)
+{
+    std::string block(TarArchive::BlockSize, '\0');
+    std::memcpy(&block[0], name.data(), std::min(name.size(), NameLength));
+    std::memcpy(&block[PrefixOffset], prefix.data(), std::min(prefix.size(), PrefixLength));
+    WriteOctal(block, ModeOffset, IdFieldLength, member.mode & 07777);
+    WriteOctal(block, UserIdOffset, IdFieldLength, (member.userId <= MaximumIdValue) ? member.userId : 0);
+    WriteOctal(block, GroupIdOffset, IdFieldLength, (member.groupId <= MaximumIdValue) ? member.groupId : 0);
+    WriteOctal(block, SizeOffset, NumberFieldLength, (member.size <= MaximumNumberValue) ? member.size : 0);
+    const std::uint64_t time = (0 < member.modificationTime) ? static_cast<std::uint64_t>(member.modificationTime) : 0;
+    WriteOctal(block, TimeOffset, NumberFieldLength, std::min(time, MaximumNumberValue));
+    block[TypeOffset] = type;
+    std::memcpy(&block[MagicOffset], "ustar\0" "00", 8);
+
+    // The checksum is taken with its own field read as spaces, and written as six digits, a NUL and a space.
+    std::memset(&block[ChecksumOffset], ' ', ChecksumLength);
+    std::uint64_t checksum = 0;
+    for (const char byte : block)
+    {
+        checksum += static_cast<unsigned char>(byte);
+    }
+    WriteOctal(block, ChecksumOffset, ChecksumLength - 1, checksum);
+    return block;
+}
+}
+
+std::string TarArchive::MemberHeader(const TarMember& member)
+{
+    std::string prefix;
+    std::string name;
+    std::string records;
+    if (false == SplitName(member.name, prefix, name))
+    {
+        AppendPaxRecord(records, "path", member.name);
+        prefix.clear();
+        name = member.name.substr(0, NameLength);
+    }
+    if (MaximumNumberValue < member.size)
+    {
+        AppendPaxRecord(records, "size", std::to_string(member.size));
+    }
+    if (MaximumIdValue < member.userId)
+    {
+        AppendPaxRecord(records, "uid", std::to_string(member.userId));
+    }
+    if (MaximumIdValue < member.groupId)
+    {
+        AppendPaxRecord(records, "gid", std::to_string(member.groupId));
+    }
+
+    std::string header;
+    if (false == records.empty())
+    {
+        TarMember extended{};
+        extended.size = records.size();
+        extended.mode = 0644;
+        extended.modificationTime = member.modificationTime;
+        const std::string baseName = member.name.substr(member.name.rfind('/') + 1);
+        header = HeaderBlock("", (PaxHeaderDirectory + baseName).substr(0, NameLength), ExtendedHeaderType, extended);
+        header += records;
+        header.append(PaddingSize(records.size()), '\0');
+    }
+    header += HeaderBlock(prefix, name, RegularFileType, member);
+    return header;
+}
+
+std::size_t TarArchive::PaddingSize(std::uint64_t size)
+{
+    return static_cast<std::size_t>((BlockSize - (size % BlockSize)) % BlockSize);
+}
+
+std::string TarArchive::EndOfArchive()
+{
+    return std::string(2 * BlockSize, '\0');
+}
+
+bool TarArchive::ParseHeader(const char* block, TarMember& outputMember, TarEntryType& outputType)
+{
+    std::uint64_t storedChecksum = 0;
+    if (false == ReadNumber(block, ChecksumOffset, ChecksumLength, storedChecksum))
+    {
+        return false;
+    }
+    std::uint64_t checksum = 0;
+    for (std::size_t i = 0; i < BlockSize; ++i)
+    {
+        const bool inChecksum = (ChecksumOffset <= i) && (ChecksumOffset + ChecksumLength > i);
+        checksum += (true == inChecksum) ? static_cast<unsigned char>(' ') : static_cast<unsigned char>(block[i]);
+    }
+    if (checksum != storedChecksum)
+    {
+        return false;
+    }
+
+    std::uint64_t mode = 0;
+    std::uint64_t userId = 0;
+    std::uint64_t groupId = 0;
+    std::uint64_t size = 0;
+    std::uint64_t time = 0;
+    if ((false == ReadNumber(block, ModeOffset, IdFieldLength, mode)) || (false == ReadNumber(block, UserIdOffset, IdFieldLength, userId)) ||
+        (false == ReadNumber(block, GroupIdOffset, IdFieldLength, groupId)) || (false == ReadNumber(block, SizeOffset, NumberFieldLength, size)) ||
+        (false == ReadNumber(block, TimeOffset, NumberFieldLength, time)))
+    {
+        return false;
+    }
+    outputMember.name = ReadText(block, 0, NameLength);
+    // Only ustar headers have a prefix field; older formats keep other data there.
+    const std::string prefix = (0 == std::memcmp(block + MagicOffset, "ustar", 5)) ? ReadText(block, PrefixOffset, PrefixLength) : std::string();
+    if (false == prefix.empty())
+    {
+        outputMember.name = prefix + "/" + outputMember.name;
+    }
+    outputMember.size = size;
+    outputMember.mode = static_cast<std::uint32_t>(mode & 07777);
+    outputMember.userId = static_cast<std::uint32_t>(userId);
+    outputMember.groupId = static_cast<std::uint32_t>(groupId);
+    outputMember.modificationTime = static_cast<std::int64_t>(time);
+
+    switch (block[TypeOffset])
+    {
+    case RegularFileType:
+    case OldRegularFileType:
+    case ContiguousFileType:
+        // Old archives mark directories only with a trailing slash.
+        outputType = ((false == outputMember.name.empty()) && ('/' == outputMember.name.back())) ? TarEntryType::Directory : TarEntryType::RegularFile;
+        break;
+    case DirectoryType:
+        outputType = TarEntryType::Directory;
+        break;
+    case ExtendedHeaderType:
+        outputType = TarEntryType::ExtendedHeader;
+        break;
+    case GlobalHeaderType:
+        outputType = TarEntryType::GlobalHeader;
+        break;
+    case LongNameType:
+        outputType = TarEntryType::LongName;
+        break;
+    default:
+        outputType = TarEntryType::Other;
+        break;
+    }
+    return true;
+}
+
+bool TarArchive::ApplyPaxRecords(const std::string& records, TarMember& member)
+{
+    std::size_t position = 0;
+    while (position < records.size())
+    {
+        // Each record is `<length> <key>=<value>\n`, its length counting the whole record.
+        const std::size_t space = records.find(' ', position);
+        if (std::string::npos == space)
+        {
+            return false;
+        }
+        char* end = nullptr;
+        const unsigned long long length = std::strtoull(records.c_str() + position, &end, 10);
+        const std::size_t recordEnd = position + static_cast<std::size_t>(length);
+        if ((records.c_str() + space != end) || (recordEnd <= space) || (records.size() < recordEnd) || ('\n' != records[recordEnd - 1]))
+        {
+            return false;
+        }
+        const std::size_t equals = records.find('=', space + 1);
+        if ((std::string::npos == equals) || (recordEnd <= equals))
+        {
+            return false;
+        }
+        const std::string key = records.substr(space + 1, equals - space - 1);
+        const std::string value = records.substr(equals + 1, recordEnd - equals - 2);
+        if ("path" == key)
+        {
+            member.name = value;
+        }
+        else if ("size" == key)
+        {
+            member.size = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if ("uid" == key)
+        {
+            member.userId = static_cast<std::uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if ("gid" == key)
+        {
+            member.groupId = static_cast<std::uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if ("mtime" == key)
+        {
+            // Fractional seconds are dropped, as the member only carries whole seconds.
+            member.modificationTime = std::strtoll(value.c_str(), nullptr, 10);
+        }
+        position = recordEnd;
+    }
+    return true;
+}
+
+bool TarArchive::IsZeroBlock(const char* block)
+{
+    return std::all_of(block, block + BlockSize, [](char byte) { return '\0' == byte; });
+}
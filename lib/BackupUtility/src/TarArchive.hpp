@@ -0,0 +1,99 @@
+// file TarArchive.hpp:
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Attributes of one regular file in a tar archive.
+ */
+struct TarMember
+{
+    std::string name;          /**< Path inside the archive, `/`-separated and relative */
+    std::uint64_t size;        /**< Content size in bytes */
+    std::uint32_t mode;        /**< Permission bits */
+    std::uint32_t userId;      /**< Owning user id */
+    std::uint32_t groupId;     /**< Owning group id */
+    std::int64_t modificationTime; /**< Modification time in seconds since the Unix epoch */
+};
+
+/**
+ * @brief Kind of entry a tar header block describes.
+ */
+enum class TarEntryType
+{
+    RegularFile,    /**< File content follows the header */
+    Directory,      /**< Directory, no content */
+    ExtendedHeader, /**< pax records for the next entry */
+    GlobalHeader,   /**< pax records for all later entries */
+    LongName,       /**< GNU long name of the next entry */
+    Other           /**< Links, devices and anything else */
+};
+
+/**
+ * @brief Domain component formatting and parsing POSIX tar (pax interchange format) headers.
+ *
+ * Each member is a ustar header block followed by its content padded to whole blocks. Names, sizes and
+ * ids that do not fit the ustar fields are carried by a pax extended header placed before the member.
+ * Parsing also accepts the GNU base-256 numbers and long names written by GNU tar.
+ */
+class TarArchive
+{
+  public:
+    /**
+     * @brief Size in bytes of a tar block; headers and padded contents are whole blocks.
+     */
+    static constexpr std::size_t BlockSize = 512;
+
+    /**
+     * @brief Format the header blocks of a member.
+     *
+     * @param[in] member Member attributes
+     * @return Header bytes, a whole number of blocks
+     */
+    static std::string MemberHeader(const TarMember& member);
+
+    /**
+     * @brief Get the zero bytes that pad a content to whole blocks.
+     *
+     * @param[in] size Content size in bytes
+     * @return Number of padding bytes, less than BlockSize
+     */
+    static std::size_t PaddingSize(std::uint64_t size);
+
+    /**
+     * @brief Get the end-of-archive marker.
+     *
+     * @return Two zero blocks
+     */
+    static std::string EndOfArchive();
+
+    /**
+     * @brief Parse one header block.
+     *
+     * @param[in] block BlockSize header bytes
+     * @param[out] outputMember Attributes of the entry; the size is that of the content following the block
+     * @param[out] outputType Kind of entry
+     * @return true if the block is a header with a valid checksum, false otherwise
+     */
+    static bool ParseHeader(const char* block, TarMember& outputMember, TarEntryType& outputType);
+
+    /**
+     * @brief Apply the path, size, uid, gid and mtime records of a pax extended header to a member.
+     *
+     * @param[in] records Content of the extended header
+     * @param[in,out] member Member the header precedes
+     * @return true if the records are well formed, false otherwise
+     */
+    static bool ApplyPaxRecords(const std::string& records, TarMember& member);
+
+    /**
+     * @brief Check whether a block is all zero, as the end-of-archive marker is.
+     *
+     * @param[in] block BlockSize bytes
+     * @return true if every byte is zero, false otherwise
+     */
+    static bool IsZeroBlock(const char* block);
+};
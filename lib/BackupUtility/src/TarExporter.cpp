@@ -0,0 +1,193 @@
+// file TarExporter.cpp:
+
+#include "TarExporter.hpp"
+
+#include "FileEncryptor/FileEncryptor.hpp"
+
+#include <algorithm>
+#include <system_error>
+#include <thread>
+
+namespace
+{
+constexpr std::uint32_t DefaultMemberMode = 0644;
+constexpr std::int64_t NanosecondsPerSecond = 1000000000;
+}
+
+TarExporter::TarExporter(const ProcessRestoreFile& processRestoreFile, const std::filesystem::path& stagingDir, ExportStream& stream,
+                         unsigned int threads, std::size_t slots)
+    : _processRestoreFile(processRestoreFile), _stagingDir(stagingDir), _stream(stream), _threads(std::max(1U, threads)),
+      _slots(std::max<std::size_t>(1, slots)), _nextToPrepare(0), _nextToWrite(0), _stopped(false), _members(0), _contentBytes(0)
+{
+}
+
+bool TarExporter::Export(const std::vector<std::pair<std::string, const RestoreItem*>>& members)
+{
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < std::min<std::size_t>(_threads, members.size()); ++i)
+    {
+        workers.emplace_back([this, &members]() { RunWorker(members); });
+    }
+
+    bool complete = true;
+    bool written = true;
+    for (std::size_t index = 0; (true == written) && (index < members.size()); ++index)
+    {
+        PreparedMember* prepared = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            prepared = &_slots[index % _slots.size()];
+            _memberReady.wait(lock, [&]() { return (true == prepared->ready) && (index == prepared->index); });
+        }
+        // The slot is the writer's until it is released, so it is read without the lock.
+        complete = (true == complete) && (true == prepared->prepared);
+        written = (false == prepared->prepared) || (true == WriteMember(*prepared));
+        if (true == prepared->staged)
+        {
+            std::error_code ec;
+            std::filesystem::remove(prepared->contentPath, ec);
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            prepared->ready = false;
+            _nextToWrite = index + 1;
+            _stopped = (false == written);
+        }
+        _slotFreed.notify_all();
+    }
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    // Members left in their slots after a write error still hold staging files.
+    for (auto& slot : _slots)
+    {
+        if ((true == slot.ready) && (true == slot.staged))
+        {
+            std::error_code ec;
+            std::filesystem::remove(slot.contentPath, ec);
+        }
+    }
+    if (true == written)
+    {
+        const std::string endOfArchive = TarArchive::EndOfArchive();
+        written = (true == _stream.Write(endOfArchive.data(), endOfArchive.size())) && (true == _stream.Finish());
+    }
+    return (true == written) && (true == complete);
+}
+
+std::uint64_t TarExporter::Members() const
+{
+    return _members;
+}
+
+std::uint64_t TarExporter::ContentBytes() const
+{
+    return _contentBytes;
+}
+
+/**
+ * @brief Prepare members in turn until all are taken or the export stops, waiting for a free slot before each.
+ *
+ * @param[in] members Files in archive order
+ */
+void TarExporter::RunWorker(const std::vector<std::pair<std::string, const RestoreItem*>>& members)
+{
+    while (true)
+    {
+        std::size_t index = 0;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if ((true == _stopped) || (members.size() <= _nextToPrepare))
+            {
+                return;
+            }
+            index = _nextToPrepare++;
+            _slotFreed.wait(lock, [&]() { return (true == _stopped) || (index < _nextToWrite + _slots.size()); });
+            if (true == _stopped)
+            {
+                return;
+            }
+        }
+        PreparedMember prepared;
+        Prepare(members[index].first, *members[index].second, index, prepared);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            prepared.ready = true;
+            _slots[index % _slots.size()] = std::move(prepared);
+        }
+        _memberReady.notify_all();
+    }
+}
+
+/**
+ * @brief Find or rebuild the content of a member and fill in its header attributes.
+ *
+ * @param[in] relativeKey Path of the file relative to the source root
+ * @param[in] item Stored version of the file
+ * @param[in] index Position of the member in the archive
+ * @param[out] outputMember Prepared member; prepared is false when the content cannot be had
+ */
+void TarExporter::Prepare(const std::string& relativeKey, const RestoreItem& item, std::size_t index, PreparedMember& outputMember) const
+{
+    outputMember.index = index;
+    const bool storedPlain = ((RestoreSource::Backup == item.source) || (RestoreSource::Plain == item.source)) &&
+                             (false == FileEncryptor::IsEncrypted(item.storedPath));
+    if (true == storedPlain)
+    {
+        outputMember.contentPath = item.storedPath;
+    }
+    else
+    {
+        outputMember.contentPath = _stagingDir / ("member-" + std::to_string(index));
+        outputMember.staged = true;
+        if (false == _processRestoreFile.Stage(item, outputMember.contentPath))
+        {
+            std::error_code ec;
+            std::filesystem::remove(outputMember.contentPath, ec);
+            outputMember.staged = false;
+            return;
+        }
+    }
+
+    std::error_code ec;
+    const std::uintmax_t size = std::filesystem::file_size(outputMember.contentPath, ec);
+    if (0 != ec.value())
+    {
+        return;
+    }
+    outputMember.member.name = std::filesystem::path(relativeKey).generic_string();
+    outputMember.member.size = size;
+    outputMember.member.mode = DefaultMemberMode;
+    if (true == item.hasMetadata)
+    {
+        outputMember.member.mode = (0 != (item.metadata.mode & 07777)) ? (item.metadata.mode & 07777) : DefaultMemberMode;
+        outputMember.member.userId = item.metadata.userId;
+        outputMember.member.groupId = item.metadata.groupId;
+        // Floor division, so times before the epoch round down like the whole seconds of a stat.
+        const std::int64_t time = item.metadata.modificationTimeNs;
+        outputMember.member.modificationTime = (time / NanosecondsPerSecond) - (((0 > time) && (0 != (time % NanosecondsPerSecond))) ? 1 : 0);
+    }
+    outputMember.prepared = true;
+}
+
+/**
+ * @brief Write the header, content and padding of one member.
+ *
+ * @param[in] prepared Prepared member
+ * @return true on success, false on a read or write error
+ */
+bool TarExporter::WriteMember(const PreparedMember& prepared)
+{
+    static const char Padding[TarArchive::BlockSize] = {};
+    const std::string header = TarArchive::MemberHeader(prepared.member);
+    if ((false == _stream.Write(header.data(), header.size())) || (false == _stream.WriteFile(prepared.contentPath, prepared.member.size)) ||
+        (false == _stream.Write(Padding, TarArchive::PaddingSize(prepared.member.size))))
+    {
+        return false;
+    }
+    ++_members;
+    _contentBytes += prepared.member.size;
+    return true;
+}
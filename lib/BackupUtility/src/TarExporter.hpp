@@ -0,0 +1,105 @@
+// file TarExporter.hpp:
+
+#pragma once
+
+#include "ExportStream.hpp"
+#include "ProcessRestoreFile.hpp"
+#include "RestorePlanner.hpp"
+#include "TarArchive.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Application component writing the files of a planned tree as one tar stream.
+ *
+ * Worker threads prepare members ahead of the writer: a plain, unencrypted copy is used as stored, any
+ * other version is rebuilt and checked into a staging file. Prepared members wait in a reorder buffer of
+ * a fixed number of slots, which the writer drains in path order, so the stream is deterministic while
+ * the rebuilds run in parallel, and the staging space in use is bounded by the slots.
+ */
+class TarExporter
+{
+  public:
+    /**
+     * @brief Default number of members prepared ahead of the writer, per worker.
+     */
+    static constexpr std::size_t DefaultSlotsPerThread = 4;
+
+    /**
+     * @brief Construct an exporter.
+     *
+     * @param[in] processRestoreFile Rebuilds and checks versions that are not stored in plain
+     * @param[in] stagingDir Existing directory rebuilt versions are written to until streamed
+     * @param[in,out] stream Stream the archive is written to
+     * @param[in] threads Preparing threads
+     * @param[in] slots Members prepared ahead of the writer, at least 1
+     */
+    TarExporter(const ProcessRestoreFile& processRestoreFile, const std::filesystem::path& stagingDir, ExportStream& stream, unsigned int threads,
+                std::size_t slots);
+
+    /**
+     * @brief Write members followed by the end-of-archive marker.
+     *
+     * A member that cannot be prepared is left out and fails the export once the stream is complete; a
+     * write error stops it at once.
+     *
+     * @param[in] members Files keyed by their path relative to the source root, in archive order
+     * @return true if every member was written, false otherwise
+     */
+    bool Export(const std::vector<std::pair<std::string, const RestoreItem*>>& members);
+
+    /**
+     * @brief Get the members written.
+     *
+     * @return Number of members
+     */
+    std::uint64_t Members() const;
+
+    /**
+     * @brief Get the content bytes written, before compression.
+     *
+     * @return Content bytes of the members
+     */
+    std::uint64_t ContentBytes() const;
+
+  private:
+    /**
+     * @brief One slot of the reorder buffer.
+     */
+    struct PreparedMember
+    {
+        std::size_t index = 0;              /**< Position of the member in the archive */
+        bool ready = false;                 /**< Prepared and waiting for the writer */
+        bool prepared = false;              /**< contentPath holds the content */
+        bool staged = false;                /**< contentPath is a staging file to remove once written */
+        std::filesystem::path contentPath;  /**< File holding the content */
+        TarMember member{};                 /**< Header attributes */
+    };
+
+    void Prepare(const std::string& relativeKey, const RestoreItem& item, std::size_t index, PreparedMember& outputMember) const;
+    void RunWorker(const std::vector<std::pair<std::string, const RestoreItem*>>& members);
+    bool WriteMember(const PreparedMember& prepared);
+
+    const ProcessRestoreFile& _processRestoreFile;
+    const std::filesystem::path& _stagingDir;
+    ExportStream& _stream;
+    unsigned int _threads;
+    std::vector<PreparedMember> _slots;
+
+    std::mutex _mutex;
+    std::condition_variable _slotFreed;
+    std::condition_variable _memberReady;
+    std::size_t _nextToPrepare;
+    std::size_t _nextToWrite;
+    bool _stopped;
+
+    std::uint64_t _members;
+    std::uint64_t _contentBytes;
+};
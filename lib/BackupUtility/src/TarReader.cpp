@@ -0,0 +1,220 @@
+// file TarReader.cpp:
+
+#include "TarReader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+constexpr std::size_t ReadBufferSize = 1024 * 1024;
+constexpr std::uint64_t MaximumHeaderContentSize = 1024 * 1024;
+constexpr int StandardInput = 0;
+
+#ifdef _WIN32
+int ReadDescriptor(int descriptor, void* data, std::size_t size)
+{
+    return _read(descriptor, data, static_cast<unsigned int>(std::min<std::size_t>(size, 1U << 30)));
+}
+#else
+ssize_t ReadDescriptor(int descriptor, void* data, std::size_t size)
+{
+    return ::read(descriptor, data, size);
+}
+#endif
+}
+
+TarReader::TarReader(int descriptor) : _descriptor(descriptor), _contentLeft(0), _paddingLeft(0), _failed(false), _buffer(ReadBufferSize)
+{
+}
+
+int TarReader::OpenInput(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+    if ("-" == path.native())
+    {
+        _setmode(StandardInput, _O_BINARY);
+        return StandardInput;
+    }
+    return _wopen(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    return ("-" == path.native()) ? StandardInput : ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+}
+
+void TarReader::CloseInput(int descriptor)
+{
+    if ((0 > descriptor) || (StandardInput == descriptor))
+    {
+        return;
+    }
+#ifdef _WIN32
+    _close(descriptor);
+#else
+    ::close(descriptor);
+#endif
+}
+
+bool TarReader::Next(TarMember& outputMember, TarEntryType& outputType)
+{
+    if ((true == _failed) || (false == Skip(_contentLeft + _paddingLeft)))
+    {
+        return false;
+    }
+    _contentLeft = 0;
+    _paddingLeft = 0;
+
+    // Overrides collected from the extended headers and long names before the entry.
+    std::string paxRecords;
+    std::string longName;
+    bool hasLongName = false;
+    char block[TarArchive::BlockSize];
+    while (true)
+    {
+        if (false == ReadExact(block, sizeof(block)))
+        {
+            return false;
+        }
+        if (true == TarArchive::IsZeroBlock(block))
+        {
+            return false;
+        }
+        if (false == TarArchive::ParseHeader(block, outputMember, outputType))
+        {
+            _failed = true;
+            return false;
+        }
+        if ((TarEntryType::ExtendedHeader == outputType) || (TarEntryType::GlobalHeader == outputType) || (TarEntryType::LongName == outputType))
+        {
+            std::string content;
+            if (false == ReadContent(outputMember.size, content))
+            {
+                return false;
+            }
+            if (TarEntryType::ExtendedHeader == outputType)
+            {
+                paxRecords += content;
+            }
+            else if (TarEntryType::LongName == outputType)
+            {
+                longName.assign(content.c_str());
+                hasLongName = true;
+            }
+            continue;
+        }
+        break;
+    }
+    if (true == hasLongName)
+    {
+        outputMember.name = longName;
+    }
+    // pax records take precedence over the header fields and a GNU long name.
+    if (false == TarArchive::ApplyPaxRecords(paxRecords, outputMember))
+    {
+        _failed = true;
+        return false;
+    }
+    _contentLeft = outputMember.size;
+    _paddingLeft = TarArchive::PaddingSize(outputMember.size);
+    return true;
+}
+
+bool TarReader::ExtractTo(const std::filesystem::path& destinationPath, const TarMember& member)
+{
+    std::ofstream output(destinationPath, std::ios::binary | std::ios::trunc);
+    bool written = output.is_open();
+    while ((0 < _contentLeft) && (false == _failed))
+    {
+        const std::size_t pieceSize = static_cast<std::size_t>(std::min<std::uint64_t>(_contentLeft, _buffer.size()));
+        if (false == ReadExact(_buffer.data(), pieceSize))
+        {
+            return false;
+        }
+        _contentLeft -= pieceSize;
+        // A file that cannot be written still has its content consumed, so the next entry can be read.
+        if (true == written)
+        {
+            written = static_cast<bool>(output.write(_buffer.data(), static_cast<std::streamsize>(pieceSize)));
+        }
+    }
+    if (true == output.is_open())
+    {
+        output.close();
+        written = (true == written) && (false == output.fail());
+    }
+    return (true == written) && (false == _failed) && (true == ApplyAttributes(destinationPath, member));
+}
+
+bool TarReader::Failed() const
+{
+    return _failed;
+}
+
+bool TarReader::ReadExact(char* data, std::size_t size)
+{
+    while (0 < size)
+    {
+        const auto readSize = ReadDescriptor(_descriptor, data, size);
+        if (0 >= readSize)
+        {
+            // An archive ending before its end-of-archive marker or inside an entry is truncated.
+            _failed = true;
+            return false;
+        }
+        data += readSize;
+        size -= static_cast<std::size_t>(readSize);
+    }
+    return true;
+}
+
+bool TarReader::Skip(std::uint64_t size)
+{
+    while (0 < size)
+    {
+        const std::size_t pieceSize = static_cast<std::size_t>(std::min<std::uint64_t>(size, _buffer.size()));
+        if (false == ReadExact(_buffer.data(), pieceSize))
+        {
+            return false;
+        }
+        size -= pieceSize;
+    }
+    return true;
+}
+
+bool TarReader::ApplyAttributes(const std::filesystem::path& destinationPath, const TarMember& member)
+{
+#ifdef _WIN32
+    (void)destinationPath;
+    (void)member;
+    return true;
+#else
+    // The owner goes first, because changing it clears the set-id bits; an owner the process may not give is kept.
+    if ((0 != ::chown(destinationPath.c_str(), member.userId, member.groupId)) && (EPERM != errno))
+    {
+        return false;
+    }
+    // The stored copy stays readable by the owner, so it can be hashed and restored.
+    const struct timespec times[2] = {{member.modificationTime, 0}, {member.modificationTime, 0}};
+    return (0 == ::chmod(destinationPath.c_str(), static_cast<mode_t>(member.mode | S_IRUSR))) && (0 == ::utimensat(AT_FDCWD, destinationPath.c_str(), times, 0));
+#endif
+}
+
+bool TarReader::ReadContent(std::uint64_t size, std::string& outputContent)
+{
+    if (MaximumHeaderContentSize < size)
+    {
+        _failed = true;
+        return false;
+    }
+    outputContent.resize(static_cast<std::size_t>(size));
+    return (true == ReadExact(&outputContent[0], outputContent.size())) && (true == Skip(TarArchive::PaddingSize(size)));
+}
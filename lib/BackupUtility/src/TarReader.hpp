@@ -0,0 +1,85 @@
+// file TarReader.hpp:
+
+#pragma once
+
+#include "TarArchive.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Infrastructure component reading the entries of a tar stream in order from a file descriptor.
+ *
+ * The stream is only read forward, so it may be a pipe. pax extended headers and GNU long names are
+ * applied to the entry they precede and never returned themselves; global pax headers are skipped.
+ */
+class TarReader
+{
+  public:
+    /**
+     * @brief Construct a reader of an open descriptor.
+     *
+     * @param[in] descriptor Descriptor positioned at the start of the archive; not closed by the reader
+     */
+    explicit TarReader(int descriptor);
+
+    TarReader(const TarReader&) = delete;
+    TarReader& operator=(const TarReader&) = delete;
+
+    /**
+     * @brief Open the archive to read.
+     *
+     * @param[in] path Archive file, `-` reads standard input
+     * @return Descriptor, negative on error
+     */
+    static int OpenInput(const std::filesystem::path& path);
+
+    /**
+     * @brief Close a descriptor from OpenInput, leaving standard input open.
+     *
+     * @param[in] descriptor Descriptor from OpenInput, negative is ignored
+     */
+    static void CloseInput(int descriptor);
+
+    /**
+     * @brief Read the header of the next entry, skipping whatever of the current entry was not read.
+     *
+     * @param[out] outputMember Attributes of the entry
+     * @param[out] outputType Kind of entry: RegularFile, Directory or Other
+     * @return true if an entry was read, false at the end of the archive or on error, see Failed
+     */
+    bool Next(TarMember& outputMember, TarEntryType& outputType);
+
+    /**
+     * @brief Write the content of the current entry into a file, creating or replacing it.
+     *
+     * On POSIX the file then gets the member's permission bits and modification time, and its owner where
+     * the process may give it.
+     *
+     * @param[in] destinationPath File to write
+     * @param[in] member Attributes of the current entry, as returned by Next
+     * @return true on success, false if the stream or the file failed; the reader fails too if the stream did
+     */
+    bool ExtractTo(const std::filesystem::path& destinationPath, const TarMember& member);
+
+    /**
+     * @brief Check whether the stream ended early or held a malformed header.
+     *
+     * @return true after a read error, a truncated archive or a bad header, false otherwise
+     */
+    bool Failed() const;
+
+  private:
+    bool ReadExact(char* data, std::size_t size);
+    bool Skip(std::uint64_t size);
+    bool ReadContent(std::uint64_t size, std::string& outputContent);
+    static bool ApplyAttributes(const std::filesystem::path& destinationPath, const TarMember& member);
+
+    int _descriptor;
+    std::uint64_t _contentLeft;
+    std::uint64_t _paddingLeft;
+    bool _failed;
+    std::vector<char> _buffer;
+};
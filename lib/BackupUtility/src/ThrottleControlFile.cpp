@@ -0,0 +1,67 @@
+// file ThrottleControlFile.cpp:
+
+#include "ThrottleControlFile.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <system_error>
+
+ThrottleControlFile::ThrottleControlFile(const std::filesystem::path& controlFile, const IoLimits& baseLimits, IoThrottle& throttle,
+                                         std::chrono::milliseconds pollInterval)
+    : _controlFile(controlFile), _baseLimits(baseLimits), _throttle(throttle),
+      _pollInterval(std::max(std::chrono::milliseconds(1), pollInterval)), _applied(false), _stopping(false)
+{
+    ApplyIfChanged();
+    _poller = std::thread([this]() { PollLoop(); });
+}
+
+ThrottleControlFile::~ThrottleControlFile()
+{
+    {
+        std::lock_guard<std::mutex> lock(_stopMutex);
+        _stopping = true;
+    }
+    _stopCv.notify_one();
+    _poller.join();
+}
+
+/**
+ * @brief Poller thread loop: check the file once per interval until stopped.
+ */
+void ThrottleControlFile::PollLoop()
+{
+    std::unique_lock<std::mutex> lock(_stopMutex);
+    while (false == _stopCv.wait_for(lock, _pollInterval, [this]() { return _stopping; }))
+    {
+        lock.unlock();
+        ApplyIfChanged();
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Parse the control file and apply its limits if it was modified since the last successful parse.
+ */
+void ThrottleControlFile::ApplyIfChanged()
+{
+    std::error_code errorCode;
+    const std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(_controlFile, errorCode);
+    if ((0 != errorCode.value()) || ((true == _applied) && (writeTime == _appliedWriteTime)))
+    {
+        return;
+    }
+
+    std::ifstream input(_controlFile, std::ios::binary);
+    const std::string text((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    IoLimits limits = _baseLimits;
+    // A file caught halfway through being rewritten fails to parse and is read again on the next check.
+    if ((true == input.bad()) || (false == ParseIoLimits(text, limits)))
+    {
+        return;
+    }
+    _throttle.SetLimits(limits);
+    _appliedWriteTime = writeTime;
+    _applied = true;
+}
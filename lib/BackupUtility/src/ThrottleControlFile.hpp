@@ -0,0 +1,62 @@
+// file ThrottleControlFile.hpp:
+
+#pragma once
+
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Applies the limits written to a control file to a running throttle.
+ *
+ * A poller thread checks the modification time of the file once per interval and parses it again when
+ * it changed, so an operator can tighten or lift the limits of a backup that is already running. Each
+ * parse starts from the limits given on the command line; a key removed from the file therefore reverts to
+ * them. A missing or malformed file leaves the limits in effect unchanged.
+ */
+class ThrottleControlFile
+{
+  public:
+    /**
+     * @brief Default time between two checks of the control file.
+     */
+    static constexpr std::chrono::milliseconds DefaultPollInterval{500};
+
+    /**
+     * @brief Apply the file once, then start the poller thread.
+     *
+     * @param[in] controlFile File holding the limits in the format of ParseIoLimits
+     * @param[in] baseLimits Limits that keys missing from the file keep
+     * @param[in,out] throttle Throttle the limits are applied to; must outlive this object
+     * @param[in] pollInterval Time between two checks, at least one millisecond
+     */
+    ThrottleControlFile(const std::filesystem::path& controlFile, const IoLimits& baseLimits, IoThrottle& throttle,
+                        std::chrono::milliseconds pollInterval = DefaultPollInterval);
+
+    /**
+     * @brief Stop the poller thread.
+     */
+    ~ThrottleControlFile();
+
+    ThrottleControlFile(const ThrottleControlFile&) = delete;
+    ThrottleControlFile& operator=(const ThrottleControlFile&) = delete;
+
+  private:
+    void PollLoop();
+    void ApplyIfChanged();
+
+    std::filesystem::path _controlFile;
+    IoLimits _baseLimits;
+    IoThrottle& _throttle;
+    std::chrono::milliseconds _pollInterval;
+    std::filesystem::file_time_type _appliedWriteTime;
+    bool _applied;
+    std::mutex _stopMutex;
+    std::condition_variable _stopCv;
+    bool _stopping;
+    std::thread _poller;
+};
@@ -0,0 +1,89 @@
+// file TrashQueue.cpp:
+
+#include "TrashQueue.hpp"
+
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <chrono>
+#include <string>
+#include <system_error>
+
+TrashQueue::TrashQueue(const std::filesystem::path& trashDirectory)
+    : _trashDirectory(trashDirectory), _namePrefix(static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())),
+      _nextEntry(0), _directoryCreated(false), _stopping(false)
+{
+    _remover = std::thread([this]() { RemovalLoop(); });
+}
+
+TrashQueue::~TrashQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _wakeCv.notify_one();
+    _remover.join();
+    // Only an empty directory is removed, so entries that could not be removed wait for the next run.
+    std::error_code ec;
+    std::filesystem::remove(_trashDirectory, ec);
+}
+
+bool TrashQueue::Discard(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (false == _directoryCreated)
+        {
+            std::filesystem::create_directories(_trashDirectory, ec);
+            _directoryCreated = (0 == ec.value());
+        }
+    }
+    const std::filesystem::path entry = _trashDirectory / (std::to_string(_namePrefix) + "-" + std::to_string(_nextEntry.fetch_add(1)));
+    std::filesystem::rename(path, entry, ec);
+    if (0 != ec.value())
+    {
+        // A missing entry fails here too, and is reported as nothing removed, as std::filesystem::remove does.
+        const std::uintmax_t removed = std::filesystem::remove_all(path, ec);
+        return (0 == ec.value()) && (0 < removed);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending.push_back(entry);
+    }
+    _wakeCv.notify_one();
+    return true;
+}
+
+/**
+ * @brief Removal thread loop: empty what earlier runs left in the trash, then remove queued entries until stopped.
+ */
+void TrashQueue::RemovalLoop()
+{
+    SetIdlePriority();
+    std::error_code ec;
+    std::error_code removeEc;
+    for (std::filesystem::directory_iterator entry(_trashDirectory, ec), end; (0 == ec.value()) && (end != entry); entry.increment(ec))
+    {
+        std::filesystem::remove_all(entry->path(), removeEc);
+    }
+
+    std::vector<std::filesystem::path> batch;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _wakeCv.wait(lock, [this]() { return (true == _stopping) || (false == _pending.empty()); });
+            if (true == _pending.empty())
+            {
+                return;
+            }
+            batch.swap(_pending);
+        }
+        for (const std::filesystem::path& entry : batch)
+        {
+            std::filesystem::remove_all(entry, removeEc);
+        }
+        batch.clear();
+    }
+}
@@ -0,0 +1,61 @@
+// file TrashQueue.hpp:
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Removes files and directories on a background thread at idle priority.
+ *
+ * Unlinking a large file frees its extents before the call returns, which on ext4 and XFS can take a
+ * long time. Discard only renames the entry into the trash directory, a metadata change on the same
+ * volume, and hands the removal to one thread that runs at idle CPU and I/O priority. Entries an
+ * interrupted run left in the trash are removed once the thread starts. The trash directory must be
+ * on the same volume as the discarded paths; a path that cannot be renamed into it is removed on the
+ * caller's thread.
+ */
+class TrashQueue
+{
+  public:
+    /**
+     * @brief Start the removal thread.
+     *
+     * @param[in] trashDirectory Directory discarded entries are renamed into, created on first use
+     */
+    explicit TrashQueue(const std::filesystem::path& trashDirectory);
+
+    /**
+     * @brief Remove everything still queued, then stop the thread and remove the empty trash directory.
+     */
+    ~TrashQueue();
+
+    TrashQueue(const TrashQueue&) = delete;
+    TrashQueue& operator=(const TrashQueue&) = delete;
+
+    /**
+     * @brief Take a file or directory out of its place and queue its removal; thread-safe.
+     *
+     * @param[in] path Entry to remove
+     * @return true if the entry was moved into the trash or removed, false if it did not exist or could not be removed
+     */
+    bool Discard(const std::filesystem::path& path);
+
+  private:
+    void RemovalLoop();
+
+    std::filesystem::path _trashDirectory;
+    std::uint64_t _namePrefix;             /**< Start of the queue in steady clock ticks, so names never repeat those left by earlier runs */
+    std::atomic<std::uint64_t> _nextEntry; /**< Number of the next discarded entry */
+    std::mutex _mutex;
+    std::condition_variable _wakeCv;
+    std::vector<std::filesystem::path> _pending; /**< Trash entries not yet removed */
+    bool _directoryCreated;
+    bool _stopping;
+    std::thread _remover;
+};
@@ -0,0 +1,92 @@
+// file VerifySchedule.cpp:
+
+#include "VerifySchedule.hpp"
+
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace
+{
+constexpr const char* SqlCreateVerifyStateTable = "CREATE TABLE IF NOT EXISTS verify_state ("
+                                                  "id INTEGER PRIMARY KEY CHECK (id = 1),"
+                                                  "slices INTEGER NOT NULL,"
+                                                  "next_slice INTEGER NOT NULL);";
+
+constexpr const char* SqlInsertVerifyState = "INSERT OR IGNORE INTO verify_state VALUES (1, 1, 0);";
+
+constexpr std::uint64_t FnvOffsetBasis = 14695981039346656037ULL;
+constexpr std::uint64_t FnvPrime = 1099511628211ULL;
+}
+
+VerifySchedule::VerifySchedule(SQLiteSession& databaseSession) : _databaseSession(databaseSession)
+{
+}
+
+bool VerifySchedule::InitializeSchema()
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        connection.Execute(SqlCreateVerifyStateTable);
+        connection.Execute(SqlInsertVerifyState);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool VerifySchedule::NextSlice(unsigned int slices, unsigned int& outputSlice)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("SELECT slices, next_slice FROM verify_state WHERE id=1;");
+        if (false == statement.FetchRow())
+        {
+            return false;
+        }
+        const std::int64_t storedSlices = statement.ColumnInt64(0);
+        const std::int64_t nextSlice = statement.ColumnInt64(1);
+        // A schedule kept for another slice count says nothing about this one.
+        outputSlice = ((static_cast<std::int64_t>(slices) == storedSlices) && (0 <= nextSlice) && (storedSlices > nextSlice))
+                          ? static_cast<unsigned int>(nextSlice)
+                          : 0;
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool VerifySchedule::Advance(unsigned int slices, unsigned int slice)
+{
+    try
+    {
+        auto& connection = _databaseSession.Acquire();
+        auto statement = connection.Prepare("UPDATE verify_state SET slices=?1, next_slice=?2 WHERE id=1;");
+        statement.BindInt64(1, slices);
+        statement.BindInt64(2, (slice + 1) % slices);
+        return statement.ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+unsigned int VerifySchedule::SliceOf(const std::string& filePath, unsigned int slices)
+{
+    // FNV-1a keeps slices stable across builds and platforms, which std::hash does not promise.
+    std::uint64_t hash = FnvOffsetBasis;
+    for (const char character : filePath)
+    {
+        hash ^= static_cast<unsigned char>(character);
+        hash *= FnvPrime;
+    }
+    return static_cast<unsigned int>(hash % slices);
+}
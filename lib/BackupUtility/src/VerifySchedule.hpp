@@ -0,0 +1,63 @@
+// file VerifySchedule.hpp:
+
+#pragma once
+
+#include "SQLite/SQLiteSession.hpp"
+
+#include <string>
+
+/**
+ * @brief Remembers which slice of the backup store the next verify run covers.
+ *
+ * Every stored file belongs to one of a fixed number of slices, picked by a hash of its path, so a slice
+ * keeps its files from run to run while files come and go. Each run verifies one slice and moves the
+ * schedule on to the next, so the given number of runs covers the whole store. Changing the number of
+ * slices starts over at the first slice.
+ */
+class VerifySchedule
+{
+  public:
+    /**
+     * @brief Create a schedule bound to a SQLite session on the state database.
+     *
+     * @param[in] databaseSession Active SQLite session for the state database
+     */
+    explicit VerifySchedule(SQLiteSession& databaseSession);
+
+    /**
+     * @brief Create the schedule table if it does not exist.
+     *
+     * @return true on success, false on error
+     */
+    bool InitializeSchema();
+
+    /**
+     * @brief Get the slice the next run covers.
+     *
+     * @param[in] slices Number of slices the store is split into, at least 1
+     * @param[out] outputSlice Slice to verify, below slices
+     * @return true on success, false on error
+     */
+    bool NextSlice(unsigned int slices, unsigned int& outputSlice);
+
+    /**
+     * @brief Record that a slice was verified, so the next run covers the one after it.
+     *
+     * @param[in] slices Number of slices the store is split into, at least 1
+     * @param[in] slice Slice that was verified
+     * @return true on success, false on error
+     */
+    bool Advance(unsigned int slices, unsigned int slice);
+
+    /**
+     * @brief Get the slice a stored file belongs to.
+     *
+     * @param[in] filePath Repository-relative file path
+     * @param[in] slices Number of slices the store is split into, at least 1
+     * @return Slice of the file, below slices
+     */
+    static unsigned int SliceOf(const std::string& filePath, unsigned int slices);
+
+  private:
+    SQLiteSession& _databaseSession;
+};
@@ -0,0 +1,131 @@
+// file WalkAhead.cpp:
+
+#include "WalkAhead.hpp"
+
+#include <utility>
+
+WalkAhead::WalkAhead(const std::atomic<bool>* runStopRequested, std::size_t maxHeldFiles)
+    : _runStopRequested(runStopRequested), _maxHeldFiles(maxHeldFiles)
+{
+}
+
+WalkAhead::~WalkAhead()
+{
+    if (false == _thread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _mode = Mode::Dropping;
+        _held.clear();
+        _heldFiles = 0;
+    }
+    _stopRequested.store(true);
+    _modeChanged.notify_all();
+    _thread.join();
+}
+
+const std::atomic<bool>* WalkAhead::StopFlag() const
+{
+    return &_stopRequested;
+}
+
+void WalkAhead::Start(Walk walk)
+{
+    _thread = std::thread(
+        [this, walk = std::move(walk)]()
+        {
+            MirrorRunStop();
+            _walkResult = walk(
+                [this](std::vector<FileEntry>&& files)
+                {
+                    HeldReport report;
+                    report.files = std::move(files);
+                    Admit(std::move(report));
+                },
+                [this](const std::filesystem::path& directory, bool listed)
+                {
+                    HeldReport report;
+                    report.directory = directory;
+                    report.listed = listed;
+                    report.isDirectory = true;
+                    Admit(std::move(report));
+                });
+        });
+}
+
+bool WalkAhead::Finish(const std::function<void(std::vector<FileEntry>&&)>& onBatch, const FileIterator::DirectoryCallback& onDirectory)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _onBatch = onBatch;
+        _onDirectory = onDirectory;
+        _mode = Mode::Replaying;
+    }
+    // Walker threads wait while the mode is Replaying, so the held reports are this thread's alone.
+    for (HeldReport& report : _held)
+    {
+        Deliver(std::move(report));
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _held.clear();
+        _heldFiles = 0;
+        _mode = Mode::Forwarding;
+    }
+    _modeChanged.notify_all();
+    _thread.join();
+    // A stop the walk never saw between two reports still leaves the run's view of the tree incomplete.
+    MirrorRunStop();
+    return (true == _walkResult) && (false == _stopRequested.load());
+}
+
+/**
+ * @brief Hold, forward or drop one report of a walker thread, waiting while the holding bound is reached or a replay runs.
+ *
+ * @param[in,out] report Batch or directory completion, moved from
+ */
+void WalkAhead::Admit(HeldReport&& report)
+{
+    MirrorRunStop();
+    std::unique_lock<std::mutex> lock(_mutex);
+    _modeChanged.wait(lock, [this]() { return (Mode::Replaying != _mode) && ((Mode::Holding != _mode) || (_maxHeldFiles > _heldFiles)); });
+    if (Mode::Holding == _mode)
+    {
+        _heldFiles += report.files.size();
+        _held.push_back(std::move(report));
+        return;
+    }
+    if (Mode::Forwarding == _mode)
+    {
+        lock.unlock();
+        Deliver(std::move(report));
+    }
+}
+
+/**
+ * @brief Hand one report to the real callbacks.
+ *
+ * @param[in,out] report Batch or directory completion, moved from
+ */
+void WalkAhead::Deliver(HeldReport&& report)
+{
+    if (true == report.isDirectory)
+    {
+        _onDirectory(report.directory, report.listed);
+        return;
+    }
+    _onBatch(std::move(report.files));
+}
+
+/**
+ * @brief Stop the walk once the run is asked to stop; checked at every report, since the iterator watches only one flag.
+ */
+void WalkAhead::MirrorRunStop()
+{
+    if ((nullptr != _runStopRequested) && (true == _runStopRequested->load()))
+    {
+        _stopRequested.store(true);
+    }
+}
@@ -0,0 +1,113 @@
+// file WalkAhead.hpp:
+
+#pragma once
+
+#include "FileIterator/FileIterator.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Runs the walk of a backup on a thread of its own while the rest of the run is still being set up.
+ *
+ * A full walk needs nothing from the database, so it starts before the state database is opened, its
+ * schema checked and the state index preloaded. Until the pipeline behind it exists, the batches and
+ * directory completions it reports are held in the order they arrive; walker threads wait once a bound
+ * of files is held. Finish replays what is held through the real callbacks on the calling thread, hands
+ * every later report straight to them, and waits for the walk. A run that fails before Finish stops the
+ * walk and drops what it listed.
+ */
+class WalkAhead
+{
+  public:
+    /**
+     * @brief Walk to run, reporting to the callbacks it is given.
+     */
+    using Walk = std::function<bool(const std::function<void(std::vector<FileEntry>&&)>&, const FileIterator::DirectoryCallback&)>;
+
+    /**
+     * @brief Prepare a walk ahead; the walk begins with Start.
+     *
+     * @param[in] runStopRequested Stop flag of the run, nullptr if it cannot be stopped; must outlive the walk
+     * @param[in] maxHeldFiles Files held before walker threads wait for Finish
+     */
+    WalkAhead(const std::atomic<bool>* runStopRequested, std::size_t maxHeldFiles);
+
+    /**
+     * @brief Stop a walk that was not finished, drop what it listed and wait for it.
+     */
+    ~WalkAhead();
+
+    WalkAhead(const WalkAhead&) = delete;
+    WalkAhead& operator=(const WalkAhead&) = delete;
+
+    /**
+     * @brief Get the flag the walk's iterator stops on: set once the run stops or the walk is abandoned.
+     *
+     * @return Stop flag living as long as this object
+     */
+    const std::atomic<bool>* StopFlag() const;
+
+    /**
+     * @brief Start the walk on its thread.
+     *
+     * @param[in] walk Walk to run
+     */
+    void Start(Walk walk);
+
+    /**
+     * @brief Replay the held reports, forward the rest as they come and wait for the walk to end.
+     *
+     * @param[in] onBatch Receives each batch of files
+     * @param[in] onDirectory Receives each directory completion
+     * @return true if the walk was complete and the run was not asked to stop, false otherwise
+     */
+    bool Finish(const std::function<void(std::vector<FileEntry>&&)>& onBatch, const FileIterator::DirectoryCallback& onDirectory);
+
+  private:
+    /**
+     * @brief Report held until Finish.
+     */
+    struct HeldReport
+    {
+        std::vector<FileEntry> files;    /**< Batch of files, empty for a directory completion */
+        std::filesystem::path directory; /**< Completed directory */
+        bool listed = false;             /**< The directory was listed completely */
+        bool isDirectory = false;        /**< The report is a directory completion */
+    };
+
+    /**
+     * @brief What happens to a report.
+     */
+    enum class Mode
+    {
+        Holding,    /**< Held until Finish */
+        Replaying,  /**< Finish is replaying the held reports; new ones wait */
+        Forwarding, /**< Handed straight to the real callbacks */
+        Dropping    /**< The run gave up; reports are discarded */
+    };
+
+    void Admit(HeldReport&& report);
+    void Deliver(HeldReport&& report);
+    void MirrorRunStop();
+
+    const std::atomic<bool>* _runStopRequested;
+    const std::size_t _maxHeldFiles;
+    std::atomic<bool> _stopRequested{false};
+    std::mutex _mutex;
+    std::condition_variable _modeChanged;
+    Mode _mode = Mode::Holding;
+    std::deque<HeldReport> _held;
+    std::size_t _heldFiles = 0;
+    std::function<void(std::vector<FileEntry>&&)> _onBatch;
+    FileIterator::DirectoryCallback _onDirectory;
+    std::thread _thread;
+    bool _walkResult = false;
+};
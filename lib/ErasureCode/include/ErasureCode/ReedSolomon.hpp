@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Instruction set a ReedSolomon code multiplies over GF(2^8) with.
+ */
+enum class ErasureKernel
+{
+    Scalar, /**< Portable table lookups, one byte at a time */
+    Avx2,   /**< Two 16-entry nibble tables looked up 32 bytes at a time with vpshufb */
+    Gfni,   /**< One affine transform per 32 bytes with vgf2p8affineqb */
+    Neon    /**< Two 16-entry nibble tables looked up 16 bytes at a time with tbl */
+};
+
+/**
+ * @brief Convert an ErasureKernel enumeration value to its string representation.
+ *
+ * @param[in] kernel The kernel to convert
+ * @return String representation of the kernel
+ */
+inline const char* ErasureKernelToString(ErasureKernel kernel)
+{
+    switch (kernel)
+    {
+    case ErasureKernel::Scalar:
+        return "scalar";
+    case ErasureKernel::Avx2:
+        return "avx2";
+    case ErasureKernel::Gfni:
+        return "gfni";
+    case ErasureKernel::Neon:
+        return "neon";
+    }
+    return "Unknown";
+}
+
+/**
+ * @brief Systematic Reed-Solomon erasure code over GF(2^8) with k data shards and m parity shards.
+ *
+ * Parity shard i is the sum over the data shards j of C[i][j] * data[j], where C is the Cauchy matrix
+ * 1 / ((k + i) xor j) over the field with polynomial x^8 + x^4 + x^3 + x^2 + 1. Every square submatrix of
+ * a Cauchy matrix is invertible, so any k of the k + m shards recover all of them. Shards are equally long
+ * byte buffers. The multiply-and-add inner loop runs on the fastest kernel the processor has unless one
+ * is named; every kernel produces the same bytes. A code is immutable and may be shared between threads.
+ */
+class ReedSolomon
+{
+  public:
+    static constexpr std::size_t MaxShards = 256; /**< Largest k + m the field allows */
+
+    /**
+     * @brief Set up a code.
+     *
+     * @param[in] dataShards k, at least 1
+     * @param[in] parityShards m, at least 1, with k + m at most MaxShards
+     * @throws std::invalid_argument if the shard counts are out of range
+     */
+    ReedSolomon(std::size_t dataShards, std::size_t parityShards);
+
+    /**
+     * @brief Set up a code that uses a given kernel.
+     *
+     * @param[in] dataShards k, at least 1
+     * @param[in] parityShards m, at least 1, with k + m at most MaxShards
+     * @param[in] kernel Kernel to use, one of SupportedKernels
+     * @throws std::invalid_argument if the shard counts are out of range or the kernel is not supported
+     */
+    ReedSolomon(std::size_t dataShards, std::size_t parityShards, ErasureKernel kernel);
+
+    /**
+     * @brief Get the kernels this processor can run, the portable one first and the fastest last.
+     *
+     * @return Supported kernels
+     */
+    static std::vector<ErasureKernel> SupportedKernels();
+
+    /**
+     * @brief Parse "k+m" as used on the command line.
+     *
+     * @param[in] text Shard counts such as "10+2"
+     * @param[out] outputDataShards k
+     * @param[out] outputParityShards m
+     * @return true if the text names valid shard counts, false otherwise
+     */
+    static bool ParseShards(const std::string& text, std::size_t& outputDataShards, std::size_t& outputParityShards);
+
+    /**
+     * @brief Get k.
+     *
+     * @return Data shards per stripe
+     */
+    std::size_t DataShards() const;
+
+    /**
+     * @brief Get m.
+     *
+     * @return Parity shards per stripe
+     */
+    std::size_t ParityShards() const;
+
+    /**
+     * @brief Get the kernel the code multiplies with.
+     *
+     * @return Kernel
+     */
+    ErasureKernel Kernel() const;
+
+    /**
+     * @brief Compute the parity shards of k data shards.
+     *
+     * @param[in] data k data shards of length bytes each
+     * @param[out] parity m parity shards of length bytes each
+     * @param[in] length Bytes per shard
+     */
+    void Encode(const std::uint8_t* const* data, std::uint8_t* const* parity, std::size_t length) const;
+
+    /**
+     * @brief Rebuild the missing shards from the present ones.
+     *
+     * @param[in,out] shards k data shards followed by m parity shards, length bytes each; missing ones are overwritten
+     * @param[in] present Whether each of the k + m shards holds intact content
+     * @param[in] length Bytes per shard
+     * @return true if at least k shards were present and the missing ones were rebuilt, false otherwise
+     */
+    bool Reconstruct(std::uint8_t* const* shards, const std::vector<bool>& present, std::size_t length) const;
+
+  private:
+    void MultiplyRows(const std::vector<std::uint8_t>& matrix, const std::uint8_t* const* inputs, std::size_t inputCount,
+                      std::uint8_t* const* outputs, std::size_t outputCount, std::size_t length) const;
+
+    std::size_t _dataShards;
+    std::size_t _parityShards;
+    ErasureKernel _kernel;
+    std::vector<std::uint8_t> _parityMatrix; /**< m rows of k coefficients */
+};
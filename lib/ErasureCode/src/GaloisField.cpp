@@ -0,0 +1,290 @@
+#include "GaloisField.hpp"
+
+#include <array>
+#include <utility>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define RDEMO_ERASURE_X86
+#define RDEMO_TARGET(features) __attribute__((target(features)))
+#elif (defined(_M_X64) || defined(_M_IX86)) && defined(_MSC_VER)
+#include <immintrin.h>
+#include <intrin.h>
+#define RDEMO_ERASURE_X86
+#define RDEMO_TARGET(features)
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define RDEMO_ERASURE_NEON
+#endif
+
+namespace
+{
+constexpr unsigned int Polynomial = 0x11D;
+
+/**
+ * @brief Lookup tables every kernel reads, built once.
+ */
+struct FieldTables
+{
+    std::array<std::uint8_t, 512> exponent{};                      /**< 2^i, doubled so sums of logarithms need no modulo */
+    std::array<std::uint8_t, 256> logarithm{};                     /**< log2 of each non-zero element */
+    std::array<std::array<std::uint8_t, 256>, 256> product{};      /**< product[c][x] = c * x */
+    std::array<std::array<std::uint8_t, 16>, 256> lowNibble{};     /**< c * x for x in 0..15 */
+    std::array<std::array<std::uint8_t, 16>, 256> highNibble{};    /**< c * (x << 4) for x in 0..15 */
+    std::array<std::uint64_t, 256> affineMatrix{};                 /**< Multiplication by c as a vgf2p8affineqb matrix */
+
+    FieldTables()
+    {
+        unsigned int value = 1;
+        for (std::size_t index = 0; index < 255; ++index)
+        {
+            exponent[index] = static_cast<std::uint8_t>(value);
+            exponent[index + 255] = static_cast<std::uint8_t>(value);
+            logarithm[value] = static_cast<std::uint8_t>(index);
+            value <<= 1;
+            if (0 != (value & 0x100))
+            {
+                value ^= Polynomial;
+            }
+        }
+        exponent[510] = exponent[0];
+        exponent[511] = exponent[1];
+
+        for (unsigned int constant = 0; constant < 256; ++constant)
+        {
+            for (unsigned int operand = 0; operand < 256; ++operand)
+            {
+                product[constant][operand] = ((0 == constant) || (0 == operand))
+                                                 ? 0
+                                                 : exponent[logarithm[constant] + logarithm[operand]];
+            }
+            for (unsigned int nibble = 0; nibble < 16; ++nibble)
+            {
+                lowNibble[constant][nibble] = product[constant][nibble];
+                highNibble[constant][nibble] = product[constant][nibble << 4];
+            }
+            // Output bit i of the product is the parity of the input bits selected by byte 7 - i of the matrix
+            std::uint64_t matrix = 0;
+            for (unsigned int outputBit = 0; outputBit < 8; ++outputBit)
+            {
+                std::uint64_t row = 0;
+                for (unsigned int inputBit = 0; inputBit < 8; ++inputBit)
+                {
+                    if (0 != ((product[constant][1u << inputBit] >> outputBit) & 1u))
+                    {
+                        row |= std::uint64_t{1} << inputBit;
+                    }
+                }
+                matrix |= row << (8 * (7 - outputBit));
+            }
+            affineMatrix[constant] = matrix;
+        }
+    }
+};
+
+const FieldTables& Tables()
+{
+    static const FieldTables tables;
+    return tables;
+}
+
+void MultiplyAddScalar(std::uint8_t constant, const std::uint8_t* source, std::uint8_t* destination, std::size_t length)
+{
+    const std::array<std::uint8_t, 256>& row = Tables().product[constant];
+    for (std::size_t index = 0; index < length; ++index)
+    {
+        destination[index] ^= row[source[index]];
+    }
+}
+
+#ifdef RDEMO_ERASURE_X86
+RDEMO_TARGET("avx2")
+void MultiplyAddAvx2(std::uint8_t constant, const std::uint8_t* source, std::uint8_t* destination, std::size_t length)
+{
+    const FieldTables& tables = Tables();
+    const __m256i lowTable =
+        _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tables.lowNibble[constant].data())));
+    const __m256i highTable =
+        _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(tables.highNibble[constant].data())));
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+
+    std::size_t index = 0;
+    for (; index + 32 <= length; index += 32)
+    {
+        const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + index));
+        const __m256i low = _mm256_and_si256(input, nibbleMask);
+        const __m256i high = _mm256_and_si256(_mm256_srli_epi64(input, 4), nibbleMask);
+        const __m256i productBytes = _mm256_xor_si256(_mm256_shuffle_epi8(lowTable, low), _mm256_shuffle_epi8(highTable, high));
+        __m256i* output = reinterpret_cast<__m256i*>(destination + index);
+        _mm256_storeu_si256(output, _mm256_xor_si256(_mm256_loadu_si256(output), productBytes));
+    }
+    MultiplyAddScalar(constant, source + index, destination + index, length - index);
+}
+
+RDEMO_TARGET("avx2,gfni")
+void MultiplyAddGfni(std::uint8_t constant, const std::uint8_t* source, std::uint8_t* destination, std::size_t length)
+{
+    const __m256i matrix = _mm256_set1_epi64x(static_cast<long long>(Tables().affineMatrix[constant]));
+
+    std::size_t index = 0;
+    for (; index + 32 <= length; index += 32)
+    {
+        const __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + index));
+        __m256i* output = reinterpret_cast<__m256i*>(destination + index);
+        _mm256_storeu_si256(output, _mm256_xor_si256(_mm256_loadu_si256(output), _mm256_gf2p8affine_epi64_epi8(input, matrix, 0)));
+    }
+    MultiplyAddScalar(constant, source + index, destination + index, length - index);
+}
+#endif
+
+#ifdef RDEMO_ERASURE_NEON
+void MultiplyAddNeon(std::uint8_t constant, const std::uint8_t* source, std::uint8_t* destination, std::size_t length)
+{
+    const FieldTables& tables = Tables();
+    const uint8x16_t lowTable = vld1q_u8(tables.lowNibble[constant].data());
+    const uint8x16_t highTable = vld1q_u8(tables.highNibble[constant].data());
+    const uint8x16_t nibbleMask = vdupq_n_u8(0x0F);
+
+    std::size_t index = 0;
+    for (; index + 16 <= length; index += 16)
+    {
+        const uint8x16_t input = vld1q_u8(source + index);
+        const uint8x16_t productBytes =
+            veorq_u8(vqtbl1q_u8(lowTable, vandq_u8(input, nibbleMask)), vqtbl1q_u8(highTable, vshrq_n_u8(input, 4)));
+        vst1q_u8(destination + index, veorq_u8(vld1q_u8(destination + index), productBytes));
+    }
+    MultiplyAddScalar(constant, source + index, destination + index, length - index);
+}
+#endif
+
+#if defined(RDEMO_ERASURE_X86) && defined(_MSC_VER) && !defined(__clang__)
+bool HasCpuFeature(int leaf, int registerIndex, int bit)
+{
+    int registers[4] = {};
+    __cpuid(registers, 1);
+    // AVX state must be enabled by the operating system before any 256-bit instruction may run
+    if ((0 == (registers[2] & (1 << 27))) || (6 != (_xgetbv(0) & 6)))
+    {
+        return false;
+    }
+    __cpuidex(registers, leaf, 0);
+    return 0 != (registers[registerIndex] & (1 << bit));
+}
+#endif
+} // namespace
+
+std::uint8_t GaloisField::Multiply(std::uint8_t left, std::uint8_t right)
+{
+    return Tables().product[left][right];
+}
+
+std::uint8_t GaloisField::Inverse(std::uint8_t value)
+{
+    const FieldTables& tables = Tables();
+    return tables.exponent[255 - tables.logarithm[value]];
+}
+
+bool GaloisField::Invert(std::vector<std::uint8_t>& matrix, std::size_t size)
+{
+    std::vector<std::uint8_t> inverse(size * size, 0);
+    for (std::size_t index = 0; index < size; ++index)
+    {
+        inverse[index * size + index] = 1;
+    }
+
+    for (std::size_t column = 0; column < size; ++column)
+    {
+        std::size_t pivot = column;
+        while ((pivot < size) && (0 == matrix[pivot * size + column]))
+        {
+            ++pivot;
+        }
+        if (pivot == size)
+        {
+            return false;
+        }
+        if (pivot != column)
+        {
+            for (std::size_t index = 0; index < size; ++index)
+            {
+                std::swap(matrix[pivot * size + index], matrix[column * size + index]);
+                std::swap(inverse[pivot * size + index], inverse[column * size + index]);
+            }
+        }
+
+        const std::uint8_t scale = Inverse(matrix[column * size + column]);
+        for (std::size_t index = 0; index < size; ++index)
+        {
+            matrix[column * size + index] = Multiply(matrix[column * size + index], scale);
+            inverse[column * size + index] = Multiply(inverse[column * size + index], scale);
+        }
+
+        for (std::size_t row = 0; row < size; ++row)
+        {
+            const std::uint8_t factor = matrix[row * size + column];
+            if ((row == column) || (0 == factor))
+            {
+                continue;
+            }
+            for (std::size_t index = 0; index < size; ++index)
+            {
+                matrix[row * size + index] ^= Multiply(factor, matrix[column * size + index]);
+                inverse[row * size + index] ^= Multiply(factor, inverse[column * size + index]);
+            }
+        }
+    }
+
+    matrix.swap(inverse);
+    return true;
+}
+
+bool GaloisField::IsSupported(ErasureKernel kernel)
+{
+    switch (kernel)
+    {
+    case ErasureKernel::Scalar:
+        return true;
+    case ErasureKernel::Avx2:
+#if defined(RDEMO_ERASURE_X86) && (defined(__GNUC__) || defined(__clang__))
+        return 0 != __builtin_cpu_supports("avx2");
+#elif defined(RDEMO_ERASURE_X86)
+        return HasCpuFeature(7, 1, 5);
+#else
+        return false;
+#endif
+    case ErasureKernel::Gfni:
+#if defined(RDEMO_ERASURE_X86) && (defined(__GNUC__) || defined(__clang__))
+        return (0 != __builtin_cpu_supports("avx2")) && (0 != __builtin_cpu_supports("gfni"));
+#elif defined(RDEMO_ERASURE_X86)
+        return HasCpuFeature(7, 1, 5) && HasCpuFeature(7, 2, 8);
+#else
+        return false;
+#endif
+    case ErasureKernel::Neon:
+#ifdef RDEMO_ERASURE_NEON
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+GaloisField::MultiplyAddFunction GaloisField::MultiplyAddFor(ErasureKernel kernel)
+{
+    switch (kernel)
+    {
+#ifdef RDEMO_ERASURE_X86
+    case ErasureKernel::Avx2:
+        return &MultiplyAddAvx2;
+    case ErasureKernel::Gfni:
+        return &MultiplyAddGfni;
+#endif
+#ifdef RDEMO_ERASURE_NEON
+    case ErasureKernel::Neon:
+        return &MultiplyAddNeon;
+#endif
+    default:
+        return &MultiplyAddScalar;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ErasureCode/ReedSolomon.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Arithmetic in GF(2^8) with polynomial 0x11D, and the multiply-and-add kernels built on it.
+ *
+ * Each kernel computes destination ^= constant * source over a buffer. The scalar kernel reads a 64 KiB
+ * product table; the AVX2 and NEON kernels split each byte into nibbles and look both up in 16-entry
+ * tables of the constant's products; the GFNI kernel applies the constant as an 8x8 bit matrix, which
+ * vgf2p8affineqb evaluates for any field polynomial. The vector kernels are compiled for their
+ * instruction sets function by function, so the library itself needs no architecture flags.
+ */
+class GaloisField
+{
+  public:
+    /**
+     * @brief Kernel computing destination ^= constant * source.
+     */
+    using MultiplyAddFunction = void (*)(std::uint8_t constant, const std::uint8_t* source, std::uint8_t* destination,
+                                         std::size_t length);
+
+    /**
+     * @brief Multiply two field elements.
+     *
+     * @param[in] left First factor
+     * @param[in] right Second factor
+     * @return Product
+     */
+    static std::uint8_t Multiply(std::uint8_t left, std::uint8_t right);
+
+    /**
+     * @brief Get the multiplicative inverse of a non-zero element.
+     *
+     * @param[in] value Element other than 0
+     * @return Inverse
+     */
+    static std::uint8_t Inverse(std::uint8_t value);
+
+    /**
+     * @brief Invert a square matrix in place by Gauss-Jordan elimination.
+     *
+     * @param[in,out] matrix size x size elements, row by row
+     * @param[in] size Rows and columns
+     * @return true if the matrix was invertible, false otherwise
+     */
+    static bool Invert(std::vector<std::uint8_t>& matrix, std::size_t size);
+
+    /**
+     * @brief Check whether this processor and build can run a kernel.
+     *
+     * @param[in] kernel Kernel to check
+     * @return true if it can
+     */
+    static bool IsSupported(ErasureKernel kernel);
+
+    /**
+     * @brief Get the multiply-and-add function of a supported kernel.
+     *
+     * @param[in] kernel Kernel
+     * @return Function, the scalar one for a kernel this build has no code for
+     */
+    static MultiplyAddFunction MultiplyAddFor(ErasureKernel kernel);
+};
@@ -0,0 +1,220 @@
+#include "ErasureCode/ReedSolomon.hpp"
+
+#include "GaloisField.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+// Shards are multiplied this many bytes at a time, so the outputs of a slice stay in the first-level cache
+constexpr std::size_t SliceBytes = 16 * 1024;
+
+bool ParseCount(const std::string& text, std::size_t& outputCount)
+{
+    if ((true == text.empty()) || (3 < text.size()))
+    {
+        return false;
+    }
+    std::size_t count = 0;
+    for (const char character : text)
+    {
+        if ((character < '0') || (character > '9'))
+        {
+            return false;
+        }
+        count = count * 10 + static_cast<std::size_t>(character - '0');
+    }
+    outputCount = count;
+    return true;
+}
+
+bool ValidShards(std::size_t dataShards, std::size_t parityShards)
+{
+    return (0 < dataShards) && (0 < parityShards) && (ReedSolomon::MaxShards >= dataShards + parityShards);
+}
+} // namespace
+
+ReedSolomon::ReedSolomon(std::size_t dataShards, std::size_t parityShards)
+    : ReedSolomon(dataShards, parityShards, SupportedKernels().back())
+{
+}
+
+ReedSolomon::ReedSolomon(std::size_t dataShards, std::size_t parityShards, ErasureKernel kernel)
+    : _dataShards(dataShards), _parityShards(parityShards), _kernel(kernel)
+{
+    if (false == ValidShards(dataShards, parityShards))
+    {
+        throw std::invalid_argument("Reed-Solomon shard counts out of range");
+    }
+    if (false == GaloisField::IsSupported(kernel))
+    {
+        throw std::invalid_argument(std::string("Erasure kernel not supported: ") + ErasureKernelToString(kernel));
+    }
+
+    _parityMatrix.resize(parityShards * dataShards);
+    for (std::size_t row = 0; row < parityShards; ++row)
+    {
+        for (std::size_t column = 0; column < dataShards; ++column)
+        {
+            _parityMatrix[row * dataShards + column] =
+                GaloisField::Inverse(static_cast<std::uint8_t>((dataShards + row) ^ column));
+        }
+    }
+}
+
+std::vector<ErasureKernel> ReedSolomon::SupportedKernels()
+{
+    std::vector<ErasureKernel> kernels;
+    for (const ErasureKernel kernel : {ErasureKernel::Scalar, ErasureKernel::Neon, ErasureKernel::Avx2, ErasureKernel::Gfni})
+    {
+        if (true == GaloisField::IsSupported(kernel))
+        {
+            kernels.push_back(kernel);
+        }
+    }
+    return kernels;
+}
+
+bool ReedSolomon::ParseShards(const std::string& text, std::size_t& outputDataShards, std::size_t& outputParityShards)
+{
+    const std::string::size_type plus = text.find('+');
+    std::size_t dataShards = 0;
+    std::size_t parityShards = 0;
+    if ((std::string::npos == plus) || (false == ParseCount(text.substr(0, plus), dataShards)) ||
+        (false == ParseCount(text.substr(plus + 1), parityShards)) || (false == ValidShards(dataShards, parityShards)))
+    {
+        return false;
+    }
+    outputDataShards = dataShards;
+    outputParityShards = parityShards;
+    return true;
+}
+
+std::size_t ReedSolomon::DataShards() const
+{
+    return _dataShards;
+}
+
+std::size_t ReedSolomon::ParityShards() const
+{
+    return _parityShards;
+}
+
+ErasureKernel ReedSolomon::Kernel() const
+{
+    return _kernel;
+}
+
+void ReedSolomon::Encode(const std::uint8_t* const* data, std::uint8_t* const* parity, std::size_t length) const
+{
+    MultiplyRows(_parityMatrix, data, _dataShards, parity, _parityShards, length);
+}
+
+bool ReedSolomon::Reconstruct(std::uint8_t* const* shards, const std::vector<bool>& present, std::size_t length) const
+{
+    const std::size_t totalShards = _dataShards + _parityShards;
+    if (present.size() != totalShards)
+    {
+        return false;
+    }
+
+    // The first k present shards, and the rows of the generator matrix that produced them
+    std::vector<std::size_t> chosen;
+    for (std::size_t index = 0; (index < totalShards) && (chosen.size() < _dataShards); ++index)
+    {
+        if (true == present[index])
+        {
+            chosen.push_back(index);
+        }
+    }
+    if (chosen.size() < _dataShards)
+    {
+        return false;
+    }
+
+    std::vector<std::size_t> missingData;
+    for (std::size_t index = 0; index < _dataShards; ++index)
+    {
+        if (false == present[index])
+        {
+            missingData.push_back(index);
+        }
+    }
+
+    if (false == missingData.empty())
+    {
+        std::vector<std::uint8_t> decode(_dataShards * _dataShards, 0);
+        for (std::size_t row = 0; row < _dataShards; ++row)
+        {
+            const std::size_t shard = chosen[row];
+            if (shard < _dataShards)
+            {
+                decode[row * _dataShards + shard] = 1;
+            }
+            else
+            {
+                std::copy_n(&_parityMatrix[(shard - _dataShards) * _dataShards], _dataShards, &decode[row * _dataShards]);
+            }
+        }
+        if (false == GaloisField::Invert(decode, _dataShards))
+        {
+            return false;
+        }
+
+        // Row j of the inverse turns the chosen shards back into data shard j
+        std::vector<std::uint8_t> rows(missingData.size() * _dataShards);
+        std::vector<const std::uint8_t*> inputs(_dataShards);
+        std::vector<std::uint8_t*> outputs(missingData.size());
+        for (std::size_t index = 0; index < missingData.size(); ++index)
+        {
+            std::copy_n(&decode[missingData[index] * _dataShards], _dataShards, &rows[index * _dataShards]);
+            outputs[index] = shards[missingData[index]];
+        }
+        for (std::size_t index = 0; index < _dataShards; ++index)
+        {
+            inputs[index] = shards[chosen[index]];
+        }
+        MultiplyRows(rows, inputs.data(), _dataShards, outputs.data(), outputs.size(), length);
+    }
+
+    std::vector<std::uint8_t> rows;
+    std::vector<std::uint8_t*> outputs;
+    for (std::size_t index = 0; index < _parityShards; ++index)
+    {
+        if (false == present[_dataShards + index])
+        {
+            rows.insert(rows.end(), &_parityMatrix[index * _dataShards], &_parityMatrix[index * _dataShards] + _dataShards);
+            outputs.push_back(shards[_dataShards + index]);
+        }
+    }
+    if (false == outputs.empty())
+    {
+        MultiplyRows(rows, shards, _dataShards, outputs.data(), outputs.size(), length);
+    }
+    return true;
+}
+
+void ReedSolomon::MultiplyRows(const std::vector<std::uint8_t>& matrix, const std::uint8_t* const* inputs, std::size_t inputCount,
+                               std::uint8_t* const* outputs, std::size_t outputCount, std::size_t length) const
+{
+    const GaloisField::MultiplyAddFunction multiplyAdd = GaloisField::MultiplyAddFor(_kernel);
+    for (std::size_t offset = 0; offset < length; offset += SliceBytes)
+    {
+        const std::size_t sliceLength = std::min(SliceBytes, length - offset);
+        for (std::size_t output = 0; output < outputCount; ++output)
+        {
+            std::uint8_t* destination = outputs[output] + offset;
+            std::memset(destination, 0, sliceLength);
+            for (std::size_t input = 0; input < inputCount; ++input)
+            {
+                const std::uint8_t coefficient = matrix[output * inputCount + input];
+                if (0 != coefficient)
+                {
+                    multiplyAdd(coefficient, inputs[input] + offset, destination, sliceLength);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Trained zstd dictionaries by extension class, for compressing small files.
+ *
+ * Small files share little within themselves but a lot with other files of their kind, so one dictionary
+ * trained from a sample of each kind lets them compress like one large file. Frames name their dictionary
+ * by its zstd ID, so the same dictionaries must be supplied to decompress them. Prepared zstd dictionary
+ * objects are built lazily and kept per thread.
+ */
+class CompressionDictionaries
+{
+  public:
+    /**
+     * @brief Default size in bytes of a trained dictionary.
+     */
+    static constexpr std::size_t DefaultDictionarySize = 112 * 1024;
+
+    /**
+     * @brief Create an empty set.
+     */
+    CompressionDictionaries();
+
+    /**
+     * @brief Get the class a file is compressed with: its lowercase extension.
+     *
+     * @param[in] path File path
+     * @return Extension including the dot, empty for a file without one
+     */
+    static std::string ExtensionClass(const std::filesystem::path& path);
+
+    /**
+     * @brief Train a dictionary from sample files.
+     *
+     * @param[in] samples Sample contents, concatenated
+     * @param[in] sampleSizes Size of each sample in order
+     * @param[in] dictionarySize Largest dictionary size in bytes
+     * @param[out] outputDictionary Trained dictionary
+     * @return true on success, false on error, too few samples or when unavailable
+     */
+    static bool Train(const std::vector<std::uint8_t>& samples, const std::vector<std::size_t>& sampleSizes, std::size_t dictionarySize,
+                      std::vector<std::uint8_t>& outputDictionary);
+
+    /**
+     * @brief Get the zstd ID of a dictionary.
+     *
+     * @param[in] dictionary Dictionary written by Train
+     * @return Dictionary ID, 0 when it is not a zstd dictionary or when unavailable
+     */
+    static std::uint32_t DictionaryId(const std::vector<std::uint8_t>& dictionary);
+
+    /**
+     * @brief Add the dictionary of an extension class.
+     *
+     * @param[in] extensionClass Class as returned by ExtensionClass
+     * @param[in] dictionary Dictionary written by Train
+     * @return true on success, false when the dictionary has no ID or its ID is already taken
+     */
+    bool Add(const std::string& extensionClass, std::vector<std::uint8_t> dictionary);
+
+    /**
+     * @brief Get the dictionary a file is compressed with.
+     *
+     * @param[in] path File path
+     * @return Dictionary ID of the file's class, 0 when the class has none
+     */
+    std::uint32_t IdFor(const std::filesystem::path& path) const;
+
+    /**
+     * @brief Get a dictionary by ID.
+     *
+     * @param[in] id Dictionary ID
+     * @return Dictionary, nullptr when unknown
+     */
+    const std::vector<std::uint8_t>* Find(std::uint32_t id) const;
+
+    /**
+     * @brief Check whether the given class has a dictionary.
+     *
+     * @param[in] extensionClass Class as returned by ExtensionClass
+     * @return true if it has one, false otherwise
+     */
+    bool HasClass(const std::string& extensionClass) const;
+
+    /**
+     * @brief Check whether the set holds no dictionary.
+     *
+     * @return true if empty, false otherwise
+     */
+    bool IsEmpty() const;
+
+    /**
+     * @brief Get the number unique to this set, keying the per-thread prepared dictionaries.
+     *
+     * @return Instance number
+     */
+    std::uint64_t Instance() const;
+
+  private:
+    std::uint64_t _instance;
+    std::unordered_map<std::string, std::uint32_t> _classIds;
+    std::unordered_map<std::uint32_t, std::vector<std::uint8_t>> _dictionaries;
+};
+
+/**
+ * @brief Tuning for FileCompressor.
+ */
+struct FileCompressorOptions
+{
+    /**
+     * @brief Default zstd compression level.
+     */
+    static constexpr int DefaultLevel = 3;
+
+    /**
+     * @brief Default minimum file size in bytes for multithreaded frames.
+     */
+    static constexpr std::uintmax_t DefaultMultithreadThreshold = 64 * 1024 * 1024;
+
+    /**
+     * @brief Default number of leading bytes compressed to decide whether a file is worth compressing.
+     */
+    static constexpr std::size_t DefaultSampleSize = 128 * 1024;
+
+    /**
+     * @brief Default largest compressed-to-original size ratio of the sample, in percent, that still counts as compressible.
+     */
+    static constexpr unsigned int DefaultMaximumSampleRatioPercent = 90;
+
+    /**
+     * @brief Default largest file size in bytes compressed with a dictionary.
+     */
+    static constexpr std::uintmax_t DefaultDictionaryFileSize = 64 * 1024;
+
+    int level = DefaultLevel;                                       /**< zstd compression level */
+    unsigned int workerThreads = 0;                                 /**< zstd worker threads for large files, 0 compresses on the calling thread */
+    std::uintmax_t multithreadThreshold = DefaultMultithreadThreshold; /**< Files of at least this many bytes use the worker threads */
+    std::size_t sampleSize = DefaultSampleSize;                     /**< Prefix compressed to detect incompressible files, 0 always compresses */
+    unsigned int maximumSampleRatioPercent = DefaultMaximumSampleRatioPercent; /**< Sample ratio above which a file is stored as is */
+    const CompressionDictionaries* dictionaries = nullptr;          /**< Dictionaries for small files, nullptr compresses without; must outlive the compressor */
+    std::uintmax_t dictionaryFileSize = DefaultDictionaryFileSize;  /**< Files of at most this many bytes use their class's dictionary */
+};
+
+/**
+ * @brief Infrastructure component compressing files into zstd frames and back.
+ *
+ * Files are streamed, so memory use does not depend on file size. Before compressing, a prefix of the file
+ * is compressed at the fastest level; when it does not shrink enough the file is left alone. Small files
+ * whose class has a dictionary are compressed in one call with it instead, and kept only when the whole
+ * file shrinks enough. zstd support is optional at build time, see IsAvailable.
+ */
+class FileCompressor
+{
+  public:
+    /**
+     * @brief Suffix appended to the path of a compressed file.
+     */
+    static constexpr const char* CompressedSuffix = ".zst";
+
+    /**
+     * @brief Construct a compressor.
+     *
+     * @param[in] options Level, threading and sampling settings
+     */
+    explicit FileCompressor(const FileCompressorOptions& options = FileCompressorOptions());
+
+    /**
+     * @brief Check whether this build can compress.
+     *
+     * @return true if zstd was found when building, false otherwise
+     */
+    static bool IsAvailable();
+
+    /**
+     * @brief Compress a file into a new zstd file.
+     *
+     * Gives up, writing nothing, when the sampled prefix is incompressible.
+     *
+     * @param[in] sourcePath File to compress
+     * @param[in] compressedPath File to create or replace
+     * @return true if the compressed file was written, false on error, when unavailable or when not worthwhile
+     */
+    bool Compress(const std::filesystem::path& sourcePath, const std::filesystem::path& compressedPath) const;
+
+    /**
+     * @brief Decompress a zstd file.
+     *
+     * @param[in] compressedPath File written by Compress
+     * @param[in] outputPath File to create or replace
+     * @param[in] dictionaries Dictionaries the file may have been compressed with, nullptr for none
+     * @return true on success, false on error, corrupt input, a missing dictionary or when unavailable
+     */
+    static bool Decompress(const std::filesystem::path& compressedPath, const std::filesystem::path& outputPath,
+                           const CompressionDictionaries* dictionaries = nullptr);
+
+    /**
+     * @brief Get the dictionary a zstd file was compressed with.
+     *
+     * @param[in] compressedPath File written by Compress
+     * @return Dictionary ID, 0 when none, on error or when unavailable
+     */
+    static std::uint32_t FrameDictionaryId(const std::filesystem::path& compressedPath);
+
+    /**
+     * @brief Compress a buffer into a single zstd frame, for content sent over the network.
+     *
+     * @param[in] data Bytes to compress
+     * @param[in] size Number of bytes
+     * @param[in] level zstd compression level
+     * @param[out] outputFrame Compressed frame
+     * @return true if the frame is smaller than the input, false on error, when unavailable or when not worthwhile
+     */
+    static bool CompressBuffer(const void* data, std::size_t size, int level, std::vector<std::uint8_t>& outputFrame);
+
+    /**
+     * @brief Decompress a single zstd frame written by CompressBuffer.
+     *
+     * @param[in] frame Compressed frame
+     * @param[in] size Size of the frame in bytes
+     * @param[in] maxSize Largest decompressed size accepted; a frame claiming more is rejected
+     * @param[out] outputData Decompressed bytes
+     * @return true on success, false on error, corrupt or oversized input or when unavailable
+     */
+    static bool DecompressBuffer(const void* frame, std::size_t size, std::size_t maxSize, std::vector<std::uint8_t>& outputData);
+
+  private:
+    bool IsWorthCompressing(const std::filesystem::path& sourcePath) const;
+    bool CompressWithDictionary(const std::filesystem::path& sourcePath, std::uintmax_t sourceSize, std::uint32_t dictionaryId,
+                                const std::filesystem::path& compressedPath) const;
+
+    FileCompressorOptions _options;
+};
+
+/**
+ * @brief Infrastructure component compressing a stream of unknown length into one zstd frame.
+ *
+ * Input is fed in pieces of any size and the compressed bytes come back as they are produced, so a
+ * producer can write an archive to a pipe without holding it in memory.
+ */
+class StreamCompressor
+{
+  public:
+    /**
+     * @brief Start a frame.
+     *
+     * @param[in] level zstd compression level
+     * @param[in] workerThreads zstd worker threads, 0 compresses on the calling thread
+     */
+    explicit StreamCompressor(int level = FileCompressorOptions::DefaultLevel, unsigned int workerThreads = 0);
+
+    ~StreamCompressor();
+
+    StreamCompressor(const StreamCompressor&) = delete;
+    StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+    /**
+     * @brief Check whether the frame could be started.
+     *
+     * @return true if ready, false on error or when zstd is unavailable
+     */
+    bool IsValid() const;
+
+    /**
+     * @brief Compress the next piece of input.
+     *
+     * @param[in] data Input bytes
+     * @param[in] size Number of bytes
+     * @param[out] outputFrame Compressed bytes produced so far, possibly none
+     * @return true on success, false on error
+     */
+    bool Write(const void* data, std::size_t size, std::vector<std::uint8_t>& outputFrame);
+
+    /**
+     * @brief End the frame.
+     *
+     * @param[out] outputFrame Remaining compressed bytes
+     * @return true on success, false on error
+     */
+    bool Finish(std::vector<std::uint8_t>& outputFrame);
+
+  private:
+    struct Context;
+
+    std::unique_ptr<Context> _context;
+};
@@ -0,0 +1,662 @@
+#include "FileCompressor/FileCompressor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#ifdef RDEMO_HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+namespace
+{
+std::atomic<std::uint64_t> NextDictionariesInstance{1};
+
+#ifdef RDEMO_HAVE_ZSTD
+constexpr int SampleLevel = 1;
+constexpr unsigned int PercentScale = 100;
+constexpr std::size_t MaximumFrameHeaderSize = 18;
+
+/**
+ * @brief Free a zstd compression context when leaving scope.
+ */
+struct CompressionContextDeleter
+{
+    void operator()(ZSTD_CCtx* context) const
+    {
+        ZSTD_freeCCtx(context);
+    }
+};
+
+/**
+ * @brief Free a zstd decompression context when leaving scope.
+ */
+struct DecompressionContextDeleter
+{
+    void operator()(ZSTD_DCtx* context) const
+    {
+        ZSTD_freeDCtx(context);
+    }
+};
+
+/**
+ * @brief Free a prepared compression dictionary.
+ */
+struct CompressionDictionaryDeleter
+{
+    void operator()(ZSTD_CDict* dictionary) const
+    {
+        ZSTD_freeCDict(dictionary);
+    }
+};
+
+/**
+ * @brief Free a prepared decompression dictionary.
+ */
+struct DecompressionDictionaryDeleter
+{
+    void operator()(ZSTD_DDict* dictionary) const
+    {
+        ZSTD_freeDDict(dictionary);
+    }
+};
+
+/**
+ * @brief Dictionaries of one CompressionDictionaries set prepared by the current thread.
+ *
+ * Preparing digests a dictionary for a level, which costs far more than compressing a small file, so each
+ * worker keeps what it prepared for as long as it uses the same set.
+ */
+struct PreparedDictionaries
+{
+    std::uint64_t instance = 0;
+    std::map<std::pair<std::uint32_t, int>, std::unique_ptr<ZSTD_CDict, CompressionDictionaryDeleter>> compression;
+    std::map<std::uint32_t, std::unique_ptr<ZSTD_DDict, DecompressionDictionaryDeleter>> decompression;
+};
+
+/**
+ * @brief Get the current thread's prepared dictionaries, dropping those of a previous set.
+ *
+ * @param[in] dictionaries Set being used
+ * @return Prepared dictionaries of the set
+ */
+PreparedDictionaries& ThreadDictionaries(const CompressionDictionaries& dictionaries)
+{
+    thread_local PreparedDictionaries prepared;
+    if (prepared.instance != dictionaries.Instance())
+    {
+        prepared.compression.clear();
+        prepared.decompression.clear();
+        prepared.instance = dictionaries.Instance();
+    }
+    return prepared;
+}
+
+/**
+ * @brief Get a dictionary prepared for compressing at a level.
+ *
+ * @param[in] dictionaries Set holding the dictionary
+ * @param[in] id Dictionary ID
+ * @param[in] level zstd compression level
+ * @return Prepared dictionary owned by the thread, nullptr when unknown or on error
+ */
+const ZSTD_CDict* PreparedCompressionDictionary(const CompressionDictionaries& dictionaries, std::uint32_t id, int level)
+{
+    auto& prepared = ThreadDictionaries(dictionaries).compression[std::make_pair(id, level)];
+    const std::vector<std::uint8_t>* dictionary = dictionaries.Find(id);
+    if ((nullptr == prepared) && (nullptr != dictionary))
+    {
+        prepared.reset(ZSTD_createCDict(dictionary->data(), dictionary->size(), level));
+    }
+    return prepared.get();
+}
+
+/**
+ * @brief Get a dictionary prepared for decompressing.
+ *
+ * @param[in] dictionaries Set holding the dictionary
+ * @param[in] id Dictionary ID
+ * @return Prepared dictionary owned by the thread, nullptr when unknown or on error
+ */
+const ZSTD_DDict* PreparedDecompressionDictionary(const CompressionDictionaries& dictionaries, std::uint32_t id)
+{
+    auto& prepared = ThreadDictionaries(dictionaries).decompression[id];
+    const std::vector<std::uint8_t>* dictionary = dictionaries.Find(id);
+    if ((nullptr == prepared) && (nullptr != dictionary))
+    {
+        prepared.reset(ZSTD_createDDict(dictionary->data(), dictionary->size()));
+    }
+    return prepared.get();
+}
+
+/**
+ * @brief Remove a partially written output file.
+ *
+ * @param[in,out] outputStream Stream writing the file, closed first
+ * @param[in] outputPath File to remove
+ * @return Always false, for use as the error result
+ */
+bool DiscardOutput(std::ofstream& outputStream, const std::filesystem::path& outputPath)
+{
+    std::error_code errorCode;
+    outputStream.close();
+    std::filesystem::remove(outputPath, errorCode);
+    return false;
+}
+#endif
+}
+
+CompressionDictionaries::CompressionDictionaries() : _instance(NextDictionariesInstance.fetch_add(1))
+{
+}
+
+std::string CompressionDictionaries::ExtensionClass(const std::filesystem::path& path)
+{
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char character) { return static_cast<char>(std::tolower(character)); });
+    return extension;
+}
+
+bool CompressionDictionaries::Train(const std::vector<std::uint8_t>& samples, const std::vector<std::size_t>& sampleSizes, std::size_t dictionarySize,
+                                    std::vector<std::uint8_t>& outputDictionary)
+{
+#ifdef RDEMO_HAVE_ZSTD
+    outputDictionary.resize(dictionarySize);
+    const std::size_t trainedSize = ZDICT_trainFromBuffer(outputDictionary.data(), outputDictionary.size(), samples.data(), sampleSizes.data(),
+                                                          static_cast<unsigned int>(sampleSizes.size()));
+    if (0 != ZDICT_isError(trainedSize))
+    {
+        outputDictionary.clear();
+        return false;
+    }
+    outputDictionary.resize(trainedSize);
+    return true;
+#else
+    static_cast<void>(samples);
+    static_cast<void>(sampleSizes);
+    static_cast<void>(dictionarySize);
+    outputDictionary.clear();
+    return false;
+#endif
+}
+
+std::uint32_t CompressionDictionaries::DictionaryId(const std::vector<std::uint8_t>& dictionary)
+{
+#ifdef RDEMO_HAVE_ZSTD
+    return ZDICT_getDictID(dictionary.data(), dictionary.size());
+#else
+    static_cast<void>(dictionary);
+    return 0;
+#endif
+}
+
+bool CompressionDictionaries::Add(const std::string& extensionClass, std::vector<std::uint8_t> dictionary)
+{
+    const std::uint32_t id = DictionaryId(dictionary);
+    if ((0 == id) || (0 != _dictionaries.count(id)))
+    {
+        return false;
+    }
+    _dictionaries.emplace(id, std::move(dictionary));
+    _classIds[extensionClass] = id;
+    return true;
+}
+
+std::uint32_t CompressionDictionaries::IdFor(const std::filesystem::path& path) const
+{
+    const auto found = _classIds.find(ExtensionClass(path));
+    return (_classIds.end() != found) ? found->second : 0;
+}
+
+const std::vector<std::uint8_t>* CompressionDictionaries::Find(std::uint32_t id) const
+{
+    const auto found = _dictionaries.find(id);
+    return (_dictionaries.end() != found) ? &found->second : nullptr;
+}
+
+bool CompressionDictionaries::HasClass(const std::string& extensionClass) const
+{
+    return 0 != _classIds.count(extensionClass);
+}
+
+bool CompressionDictionaries::IsEmpty() const
+{
+    return true == _dictionaries.empty();
+}
+
+std::uint64_t CompressionDictionaries::Instance() const
+{
+    return _instance;
+}
+
+FileCompressor::FileCompressor(const FileCompressorOptions& options) : _options(options)
+{
+}
+
+bool FileCompressor::IsAvailable()
+{
+#ifdef RDEMO_HAVE_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool FileCompressor::Compress(const std::filesystem::path& sourcePath, const std::filesystem::path& compressedPath) const
+{
+#ifdef RDEMO_HAVE_ZSTD
+    std::error_code errorCode;
+    const std::uintmax_t sourceSize = std::filesystem::file_size(sourcePath, errorCode);
+    if (0 != errorCode.value())
+    {
+        return false;
+    }
+    if ((nullptr != _options.dictionaries) && (0 < sourceSize) && (sourceSize <= _options.dictionaryFileSize))
+    {
+        const std::uint32_t dictionaryId = _options.dictionaries->IdFor(sourcePath);
+        if (0 != dictionaryId)
+        {
+            return CompressWithDictionary(sourcePath, sourceSize, dictionaryId, compressedPath);
+        }
+    }
+    if (false == IsWorthCompressing(sourcePath))
+    {
+        return false;
+    }
+
+    std::unique_ptr<ZSTD_CCtx, CompressionContextDeleter> context(ZSTD_createCCtx());
+    std::ifstream inputStream(sourcePath, std::ios::binary);
+    if ((nullptr == context) || (false == inputStream.is_open()) ||
+        (0 != ZSTD_isError(ZSTD_CCtx_setParameter(context.get(), ZSTD_c_compressionLevel, _options.level))) ||
+        (0 != ZSTD_isError(ZSTD_CCtx_setParameter(context.get(), ZSTD_c_checksumFlag, 1))) ||
+        (0 != ZSTD_isError(ZSTD_CCtx_setPledgedSrcSize(context.get(), sourceSize))))
+    {
+        return false;
+    }
+    if ((0 != _options.workerThreads) && (_options.multithreadThreshold <= sourceSize))
+    {
+        // Fails harmlessly when libzstd was built without threads; the frame is then compressed inline.
+        ZSTD_CCtx_setParameter(context.get(), ZSTD_c_nbWorkers, static_cast<int>(_options.workerThreads));
+    }
+
+    std::ofstream outputStream(compressedPath, std::ios::binary | std::ios::trunc);
+    if (false == outputStream.is_open())
+    {
+        return false;
+    }
+
+    std::vector<char> inputBuffer(ZSTD_CStreamInSize());
+    std::vector<char> outputBuffer(ZSTD_CStreamOutSize());
+    bool lastChunk = false;
+    while (false == lastChunk)
+    {
+        inputStream.read(inputBuffer.data(), static_cast<std::streamsize>(inputBuffer.size()));
+        if (true == inputStream.bad())
+        {
+            return DiscardOutput(outputStream, compressedPath);
+        }
+        const std::size_t bytesRead = static_cast<std::size_t>(inputStream.gcount());
+        lastChunk = (bytesRead < inputBuffer.size());
+        const ZSTD_EndDirective mode = (true == lastChunk) ? ZSTD_e_end : ZSTD_e_continue;
+
+        ZSTD_inBuffer input = {inputBuffer.data(), bytesRead, 0};
+        bool finished = false;
+        while (false == finished)
+        {
+            ZSTD_outBuffer output = {outputBuffer.data(), outputBuffer.size(), 0};
+            const std::size_t remaining = ZSTD_compressStream2(context.get(), &output, &input, mode);
+            if ((0 != ZSTD_isError(remaining)) ||
+                (false == static_cast<bool>(outputStream.write(outputBuffer.data(), static_cast<std::streamsize>(output.pos)))))
+            {
+                return DiscardOutput(outputStream, compressedPath);
+            }
+            finished = (true == lastChunk) ? (0 == remaining) : (input.pos == input.size);
+        }
+    }
+
+    if (false == static_cast<bool>(outputStream.flush()))
+    {
+        return DiscardOutput(outputStream, compressedPath);
+    }
+    return true;
+#else
+    static_cast<void>(sourcePath);
+    static_cast<void>(compressedPath);
+    return false;
+#endif
+}
+
+bool FileCompressor::Decompress(const std::filesystem::path& compressedPath, const std::filesystem::path& outputPath,
+                                const CompressionDictionaries* dictionaries)
+{
+#ifdef RDEMO_HAVE_ZSTD
+    std::unique_ptr<ZSTD_DCtx, DecompressionContextDeleter> context(ZSTD_createDCtx());
+    std::ifstream inputStream(compressedPath, std::ios::binary);
+    if ((nullptr == context) || (false == inputStream.is_open()))
+    {
+        return false;
+    }
+    std::ofstream outputStream(outputPath, std::ios::binary | std::ios::trunc);
+    if (false == outputStream.is_open())
+    {
+        return false;
+    }
+
+    std::vector<char> inputBuffer(ZSTD_DStreamInSize());
+    std::vector<char> outputBuffer(ZSTD_DStreamOutSize());
+    std::size_t frameRemaining = 0;
+    bool anyInput = false;
+    while (true)
+    {
+        inputStream.read(inputBuffer.data(), static_cast<std::streamsize>(inputBuffer.size()));
+        if (true == inputStream.bad())
+        {
+            return DiscardOutput(outputStream, outputPath);
+        }
+        const std::size_t bytesRead = static_cast<std::size_t>(inputStream.gcount());
+        if (0 == bytesRead)
+        {
+            break;
+        }
+        if (false == anyInput)
+        {
+            // Compress writes a single frame, so the dictionary named by the first header serves the whole file.
+            const std::uint32_t dictionaryId = ZSTD_getDictID_fromFrame(inputBuffer.data(), bytesRead);
+            const ZSTD_DDict* dictionary = ((0 != dictionaryId) && (nullptr != dictionaries)) ? PreparedDecompressionDictionary(*dictionaries, dictionaryId) : nullptr;
+            if ((0 != dictionaryId) && ((nullptr == dictionary) || (0 != ZSTD_isError(ZSTD_DCtx_refDDict(context.get(), dictionary)))))
+            {
+                return DiscardOutput(outputStream, outputPath);
+            }
+        }
+        anyInput = true;
+
+        ZSTD_inBuffer input = {inputBuffer.data(), bytesRead, 0};
+        while (input.pos < input.size)
+        {
+            ZSTD_outBuffer output = {outputBuffer.data(), outputBuffer.size(), 0};
+            frameRemaining = ZSTD_decompressStream(context.get(), &output, &input);
+            if ((0 != ZSTD_isError(frameRemaining)) ||
+                (false == static_cast<bool>(outputStream.write(outputBuffer.data(), static_cast<std::streamsize>(output.pos)))))
+            {
+                return DiscardOutput(outputStream, outputPath);
+            }
+        }
+    }
+
+    // A non-zero hint at end of input means the last frame is truncated.
+    if ((false == anyInput) || (0 != frameRemaining) || (false == static_cast<bool>(outputStream.flush())))
+    {
+        return DiscardOutput(outputStream, outputPath);
+    }
+    return true;
+#else
+    static_cast<void>(compressedPath);
+    static_cast<void>(outputPath);
+    static_cast<void>(dictionaries);
+    return false;
+#endif
+}
+
+std::uint32_t FileCompressor::FrameDictionaryId(const std::filesystem::path& compressedPath)
+{
+#ifdef RDEMO_HAVE_ZSTD
+    std::ifstream inputStream(compressedPath, std::ios::binary);
+    char header[MaximumFrameHeaderSize];
+    inputStream.read(header, static_cast<std::streamsize>(sizeof(header)));
+    return ZSTD_getDictID_fromFrame(header, static_cast<std::size_t>(inputStream.gcount()));
+#else
+    static_cast<void>(compressedPath);
+    return 0;
+#endif
+}
+
+/**
+ * @brief Compress a whole small file in one call with its class's prepared dictionary.
+ *
+ * The file is read into memory, so this is only used up to dictionaryFileSize; the whole result takes the
+ * place of the sample check.
+ *
+ * @param[in] sourcePath File to compress
+ * @param[in] sourceSize Size of the file in bytes
+ * @param[in] dictionaryId Dictionary of the file's class
+ * @param[in] compressedPath File to create or replace
+ * @return true if the compressed file was written, false on error or when not worthwhile
+ */
+bool FileCompressor::CompressWithDictionary(const std::filesystem::path& sourcePath, std::uintmax_t sourceSize, std::uint32_t dictionaryId,
+                                            const std::filesystem::path& compressedPath) const
+{
+#ifdef RDEMO_HAVE_ZSTD
+    std::ifstream inputStream(sourcePath, std::ios::binary);
+    std::vector<char> source(static_cast<std::size_t>(sourceSize));
+    inputStream.read(source.data(), static_cast<std::streamsize>(source.size()));
+    if (static_cast<std::size_t>(inputStream.gcount()) != source.size())
+    {
+        return false;
+    }
+
+    thread_local std::unique_ptr<ZSTD_CCtx, CompressionContextDeleter> context(ZSTD_createCCtx());
+    const ZSTD_CDict* dictionary = PreparedCompressionDictionary(*_options.dictionaries, dictionaryId, _options.level);
+    if ((nullptr == context) || (nullptr == dictionary) || (0 != ZSTD_isError(ZSTD_CCtx_reset(context.get(), ZSTD_reset_session_and_parameters))) ||
+        (0 != ZSTD_isError(ZSTD_CCtx_setParameter(context.get(), ZSTD_c_checksumFlag, 1))) ||
+        (0 != ZSTD_isError(ZSTD_CCtx_refCDict(context.get(), dictionary))))
+    {
+        return false;
+    }
+    std::vector<char> frame(ZSTD_compressBound(source.size()));
+    const std::size_t compressedSize = ZSTD_compress2(context.get(), frame.data(), frame.size(), source.data(), source.size());
+    if ((0 != ZSTD_isError(compressedSize)) ||
+        ((0 != _options.sampleSize) && ((source.size() * _options.maximumSampleRatioPercent) < (compressedSize * PercentScale))))
+    {
+        return false;
+    }
+
+    std::ofstream outputStream(compressedPath, std::ios::binary | std::ios::trunc);
+    if ((false == outputStream.is_open()) || (false == static_cast<bool>(outputStream.write(frame.data(), static_cast<std::streamsize>(compressedSize)))) ||
+        (false == static_cast<bool>(outputStream.flush())))
+    {
+        return DiscardOutput(outputStream, compressedPath);
+    }
+    return true;
+#else
+    static_cast<void>(sourcePath);
+    static_cast<void>(sourceSize);
+    static_cast<void>(dictionaryId);
+    static_cast<void>(compressedPath);
+    return false;
+#endif
+}
+
+/**
+ * @brief Compress a prefix of a file at the fastest level and check that it shrinks enough.
+ *
+ * @param[in] sourcePath File to sample
+ * @return true if the file should be compressed, false if it looks incompressible or cannot be read
+ */
+bool FileCompressor::IsWorthCompressing(const std::filesystem::path& sourcePath) const
+{
+#ifdef RDEMO_HAVE_ZSTD
+    if (0 == _options.sampleSize)
+    {
+        return true;
+    }
+
+    std::ifstream inputStream(sourcePath, std::ios::binary);
+    if (false == inputStream.is_open())
+    {
+        return false;
+    }
+    std::vector<char> sample(_options.sampleSize);
+    inputStream.read(sample.data(), static_cast<std::streamsize>(sample.size()));
+    if (true == inputStream.bad())
+    {
+        return false;
+    }
+    sample.resize(static_cast<std::size_t>(inputStream.gcount()));
+    if (true == sample.empty())
+    {
+        return true;
+    }
+
+    std::vector<char> compressedSample(ZSTD_compressBound(sample.size()));
+    const std::size_t compressedSize = ZSTD_compress(compressedSample.data(), compressedSample.size(), sample.data(), sample.size(), SampleLevel);
+    return (0 == ZSTD_isError(compressedSize)) &&
+           ((compressedSize * PercentScale) <= (sample.size() * _options.maximumSampleRatioPercent));
+#else
+    static_cast<void>(sourcePath);
+    return false;
+#endif
+}
+
+bool FileCompressor::CompressBuffer(const void* data, std::size_t size, int level, std::vector<std::uint8_t>& outputFrame)
+{
+#ifdef RDEMO_HAVE_ZSTD
+    // One context per thread is reused for every buffer, since senders compress many small chunks.
+    thread_local std::unique_ptr<ZSTD_CCtx, CompressionContextDeleter> context(ZSTD_createCCtx());
+    if (nullptr == context)
+    {
+        return false;
+    }
+    outputFrame.resize(ZSTD_compressBound(size));
+    const std::size_t compressedSize = ZSTD_compressCCtx(context.get(), outputFrame.data(), outputFrame.size(), data, size, level);
+    if ((0 != ZSTD_isError(compressedSize)) || (size <= compressedSize))
+    {
+        outputFrame.clear();
+        return false;
+    }
+    outputFrame.resize(compressedSize);
+    return true;
+#else
+    static_cast<void>(data);
+    static_cast<void>(size);
+    static_cast<void>(level);
+    outputFrame.clear();
+    return false;
+#endif
+}
+
+bool FileCompressor::DecompressBuffer(const void* frame, std::size_t size, std::size_t maxSize, std::vector<std::uint8_t>& outputData)
+{
+#ifdef RDEMO_HAVE_ZSTD
+    const unsigned long long contentSize = ZSTD_getFrameContentSize(frame, size);
+    if ((ZSTD_CONTENTSIZE_ERROR == contentSize) || (ZSTD_CONTENTSIZE_UNKNOWN == contentSize) || (maxSize < contentSize))
+    {
+        return false;
+    }
+    thread_local std::unique_ptr<ZSTD_DCtx, DecompressionContextDeleter> context(ZSTD_createDCtx());
+    if (nullptr == context)
+    {
+        return false;
+    }
+    outputData.resize(static_cast<std::size_t>(contentSize));
+    const std::size_t decompressedSize = ZSTD_decompressDCtx(context.get(), outputData.data(), outputData.size(), frame, size);
+    return (0 == ZSTD_isError(decompressedSize)) && (decompressedSize == outputData.size());
+#else
+    static_cast<void>(frame);
+    static_cast<void>(size);
+    static_cast<void>(maxSize);
+    outputData.clear();
+    return false;
+#endif
+}
+
+/**
+ * @brief zstd context of a StreamCompressor.
+ */
+struct StreamCompressor::Context
+{
+#ifdef RDEMO_HAVE_ZSTD
+    std::unique_ptr<ZSTD_CCtx, CompressionContextDeleter> context;
+    std::vector<std::uint8_t> outputBuffer;
+
+    /**
+     * @brief Run one compression step over the whole input.
+     *
+     * @param[in] data Input bytes
+     * @param[in] size Number of bytes
+     * @param[in] mode ZSTD_e_continue, or ZSTD_e_end to close the frame
+     * @param[out] outputFrame Compressed bytes produced
+     * @return true on success, false on error
+     */
+    bool Step(const void* data, std::size_t size, ZSTD_EndDirective mode, std::vector<std::uint8_t>& outputFrame)
+    {
+        outputFrame.clear();
+        ZSTD_inBuffer input = {data, size, 0};
+        bool finished = false;
+        while (false == finished)
+        {
+            ZSTD_outBuffer output = {outputBuffer.data(), outputBuffer.size(), 0};
+            const std::size_t remaining = ZSTD_compressStream2(context.get(), &output, &input, mode);
+            if (0 != ZSTD_isError(remaining))
+            {
+                return false;
+            }
+            outputFrame.insert(outputFrame.end(), outputBuffer.data(), outputBuffer.data() + output.pos);
+            finished = (ZSTD_e_end == mode) ? (0 == remaining) : (input.pos == input.size);
+        }
+        return true;
+    }
+#endif
+};
+
+StreamCompressor::StreamCompressor(int level, unsigned int workerThreads) : _context(std::make_unique<Context>())
+{
+#ifdef RDEMO_HAVE_ZSTD
+    _context->context.reset(ZSTD_createCCtx());
+    if ((nullptr == _context->context) || (0 != ZSTD_isError(ZSTD_CCtx_setParameter(_context->context.get(), ZSTD_c_compressionLevel, level))) ||
+        (0 != ZSTD_isError(ZSTD_CCtx_setParameter(_context->context.get(), ZSTD_c_checksumFlag, 1))))
+    {
+        _context->context.reset();
+        return;
+    }
+    if (0 != workerThreads)
+    {
+        // Fails harmlessly when libzstd was built without threads; the frame is then compressed inline.
+        ZSTD_CCtx_setParameter(_context->context.get(), ZSTD_c_nbWorkers, static_cast<int>(workerThreads));
+    }
+    _context->outputBuffer.resize(ZSTD_CStreamOutSize());
+#else
+    static_cast<void>(level);
+    static_cast<void>(workerThreads);
+#endif
+}
+
+StreamCompressor::~StreamCompressor() = default;
+
+bool StreamCompressor::IsValid() const
+{
+#ifdef RDEMO_HAVE_ZSTD
+    return nullptr != _context->context;
+#else
+    return false;
+#endif
+}
+
+bool StreamCompressor::Write(const void* data, std::size_t size, std::vector<std::uint8_t>& outputFrame)
+{
+#ifdef RDEMO_HAVE_ZSTD
+    return (true == IsValid()) && (true == _context->Step(data, size, ZSTD_e_continue, outputFrame));
+#else
+    static_cast<void>(data);
+    static_cast<void>(size);
+    outputFrame.clear();
+    return false;
+#endif
+}
+
+bool StreamCompressor::Finish(std::vector<std::uint8_t>& outputFrame)
+{
+#ifdef RDEMO_HAVE_ZSTD
+    return (true == IsValid()) && (true == _context->Step(nullptr, 0, ZSTD_e_end, outputFrame));
+#else
+    outputFrame.clear();
+    return false;
+#endif
+}
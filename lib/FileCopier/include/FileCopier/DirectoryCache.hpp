@@ -0,0 +1,29 @@
+#pragma once
+
+#include <filesystem>
+#include <shared_mutex>
+#include <string>
+#include <unordered_set>
+
+/**
+ * @brief Directories known to exist, shared by the workers of one run so each is created at most once.
+ *
+ * A cached directory is assumed to stay in place for the lifetime of the cache; nothing rechecks it.
+ */
+class DirectoryCache
+{
+  public:
+    /**
+     * @brief Make sure a directory and its parents exist; thread-safe.
+     *
+     * A directory ensured before costs a shared lookup and no system call.
+     *
+     * @param[in] directory Directory to create
+     * @return true if the directory exists, false if it could not be created
+     */
+    bool Ensure(const std::filesystem::path& directory);
+
+  private:
+    std::shared_mutex _mutex;
+    std::unordered_set<std::filesystem::path::string_type> _known;
+};
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+class IoThrottle;
+
+/**
+ * @brief Copy mechanisms tried by FileCopier, from cheapest to most expensive.
+ */
+enum class CopyMethod
+{
+    Clone,         /**< Reflink clone sharing extents with the source (FICLONE, FSCTL_DUPLICATE_EXTENTS_TO_FILE on ReFS, clonefile on APFS), no data is moved */
+    CopyFileRange, /**< In-kernel copy, offloaded to the filesystem or storage where supported */
+    SendFile,      /**< In-kernel copy through the page cache */
+    Native,        /**< Overlapped reads and writes on an I/O completion port (Windows) */
+    Buffered       /**< Userspace read/write loop */
+};
+
+/**
+ * @brief Convert a CopyMethod enumeration value to its string representation.
+ *
+ * @param[in] method The method to convert
+ * @return String representation of the method
+ */
+inline const char* CopyMethodToString(CopyMethod method)
+{
+    switch (method)
+    {
+    case CopyMethod::Clone:
+        return "clone";
+    case CopyMethod::CopyFileRange:
+        return "copy-file-range";
+    case CopyMethod::SendFile:
+        return "sendfile";
+    case CopyMethod::Native:
+        return "native";
+    case CopyMethod::Buffered:
+        return "buffered";
+    }
+    return "Unknown";
+}
+
+/**
+ * @brief Convert a string to its corresponding CopyMethod enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @param[out] outputMethod Parsed method
+ * @return true if the string names a known method, false otherwise
+ */
+inline bool StringToCopyMethod(const std::string& stringValue, CopyMethod& outputMethod)
+{
+    for (CopyMethod method : {CopyMethod::Clone, CopyMethod::CopyFileRange, CopyMethod::SendFile, CopyMethod::Native, CopyMethod::Buffered})
+    {
+        if (CopyMethodToString(method) == stringValue)
+        {
+            outputMethod = method;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Infrastructure component copying files with the cheapest mechanism the platform and filesystem support.
+ *
+ * On Linux a copy first tries a reflink clone, then copy_file_range, then sendfile, and finally a buffered
+ * loop. Each fallback continues from where the previous mechanism stopped. On Windows a copy first tries a
+ * block clone on volumes that count block references (ReFS, Dev Drive), then overlapped reads and writes with
+ * several requests in flight on one I/O completion port, and finally std::filesystem::copy_file.
+ * On macOS a copy first tries an APFS clone with fclonefileat, then the buffered loop. Other platforms use
+ * the buffered loop.
+ *
+ * A sparse source that cannot be cloned has only its data extents copied, found with SEEK_DATA and
+ * SEEK_HOLE, with copy_file_range or the buffered loop; its holes stay holes in the destination.
+ *
+ * A dense copy that moves data reserves the destination's blocks up to the source size first (fallocate
+ * on Linux, F_PREALLOCATE on macOS, the allocation size on Windows), so copies running side by side do not
+ * interleave their extents. The buffered loop writes 1 MiB at a time.
+ *
+ * Files at or above the unbuffered threshold do not stay in the page cache: Windows copies them with
+ * FILE_FLAG_NO_BUFFERING, Linux writes back and drops the copied range of both files every few MiB.
+ *
+ * With a throttle, kernel copies move IoThrottle::RequestSize bytes per call and every chunk is charged to
+ * the read and the write budget. Clones move no data and are not charged. Opening the source and the
+ * destination is charged as one metadata request each.
+ */
+class FileCopier
+{
+  public:
+    /**
+     * @brief Suggested minimum file size in bytes for unbuffered copies.
+     */
+    static constexpr std::uintmax_t DefaultUnbufferedThreshold = 64 * 1024 * 1024;
+
+    /**
+     * @brief Largest file CopyBatch copies in one io_uring chain.
+     */
+    static constexpr std::uintmax_t SmallCopySize = 64 * 1024;
+
+    /**
+     * @brief Construct a file copier.
+     *
+     * @param[in] firstMethod Cheapest mechanism to try; earlier ones are skipped
+     * @param[in] unbufferedThreshold Files of at least this many bytes do not stay in the page cache; 0 disables
+     * @param[in] throttle Rate limiter the copied bytes are charged to, nullptr copies at full speed; must outlive the copier
+     */
+    explicit FileCopier(CopyMethod firstMethod = CopyMethod::Clone, std::uintmax_t unbufferedThreshold = 0, IoThrottle* throttle = nullptr);
+
+    /**
+     * @brief Copy a file, replacing the destination if it exists.
+     *
+     * The destination gets the permissions of the source. An existing destination is unlinked rather than
+     * overwritten, so other hard links to it keep their content.
+     *
+     * @param[in] sourcePath File to copy
+     * @param[in] destinationPath File to create or replace
+     * @return true on success, false on error
+     */
+    bool Copy(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath) const;
+
+    /**
+     * @brief Copy a file and report the mechanism that completed it.
+     *
+     * @param[in] sourcePath File to copy
+     * @param[in] destinationPath File to create or replace
+     * @param[out] outputMethod Mechanism that copied the final bytes
+     * @return true on success, false on error
+     */
+    bool Copy(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath, CopyMethod& outputMethod) const;
+
+    /**
+     * @brief Move a file, replacing the destination if it exists.
+     *
+     * Within one filesystem this is a single atomic rename and no data is copied. When the rename fails,
+     * for example across devices, the file is copied and the source removed.
+     *
+     * @param[in] sourcePath File to move
+     * @param[in] destinationPath New location of the file
+     * @return true on success, false on error
+     */
+    bool Move(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath) const;
+
+    /**
+     * @brief Hard link files of one directory into another under the same names.
+     *
+     * Both directories are opened once and every name is linked relative to them, so a batch resolves no
+     * path per file. An existing destination name is replaced. Names that cannot be linked, for example
+     * across filesystems or past the link count limit, are copied instead, as a clone where the
+     * filesystem supports it.
+     *
+     * @param[in] sourceDirectory Directory holding the files
+     * @param[in] destinationDirectory Existing directory receiving the links
+     * @param[in] names File names, without directory
+     * @param[out] outputMissing Names the source directory does not have, left for the caller
+     * @return true if every other name was linked or copied, false on error
+     */
+    bool LinkBatch(const std::filesystem::path& sourceDirectory, const std::filesystem::path& destinationDirectory,
+                   const std::vector<std::string>& names, std::vector<std::string>& outputMissing) const;
+
+    /**
+     * @brief Copy many files, each replacing its destination as Copy does.
+     *
+     * On Linux, regular files of at most SmallCopySize bytes are copied through an io_uring owned by the
+     * calling thread, each as one linked chain that unlinks the destination, opens, reads, creates, writes
+     * and closes, with many chains in flight; the bytes go through a registered buffer and are not cloned.
+     * Larger files, files whose permissions the umask would change, and copies whose chain failed are
+     * copied with Copy, as is everything where io_uring is unavailable.
+     *
+     * @param[in] copies Source and destination of each copy; destination directories must exist
+     * @param[out] outputFailed Indexes into copies of the copies that failed, in order
+     * @return true if every file was copied, false otherwise
+     */
+    bool CopyBatch(const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& copies, std::vector<std::size_t>& outputFailed) const;
+
+  private:
+    CopyMethod _firstMethod;
+    std::uintmax_t _unbufferedThreshold;
+    IoThrottle* _throttle;
+};
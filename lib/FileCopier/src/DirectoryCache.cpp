@@ -0,0 +1,26 @@
+#include "FileCopier/DirectoryCache.hpp"
+
+#include <mutex>
+#include <system_error>
+
+bool DirectoryCache::Ensure(const std::filesystem::path& directory)
+{
+    {
+        std::shared_lock<std::shared_mutex> lock(_mutex);
+        if (0 != _known.count(directory.native()))
+        {
+            return true;
+        }
+    }
+
+    // Two workers may race here; create_directories succeeds for both when the directory already exists.
+    std::error_code errorCode;
+    std::filesystem::create_directories(directory, errorCode);
+    if (0 != errorCode.value())
+    {
+        return false;
+    }
+    std::unique_lock<std::shared_mutex> lock(_mutex);
+    _known.insert(directory.native());
+    return true;
+}
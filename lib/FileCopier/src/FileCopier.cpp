@@ -0,0 +1,1157 @@
+#include "FileCopier/FileCopier.hpp"
+
+#include "UringCopier.hpp"
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+#ifdef __APPLE__
+#include <sys/attr.h>
+#include <sys/clonefile.h>
+#endif
+#endif
+
+namespace
+{
+/**
+ * @brief Outcome of one copy mechanism.
+ */
+enum class CopyStepResult
+{
+    Done,        /**< Destination holds the complete source */
+    Unsupported, /**< Mechanism is not available here; the next one continues from the current file offsets */
+    Failed       /**< I/O error; the copy is abandoned */
+};
+
+/**
+ * @brief Charge copied bytes to the read and the write budget of a throttle.
+ *
+ * @param[in] throttle Rate limiter, nullptr charges nothing
+ * @param[in] copiedBytes Bytes copied by one request
+ */
+void ChargeCopy(IoThrottle* throttle, std::uintmax_t copiedBytes)
+{
+    if (nullptr != throttle)
+    {
+        throttle->AcquireRead(copiedBytes);
+        throttle->AcquireWrite(copiedBytes);
+    }
+}
+
+/**
+ * @brief Charge one open or stat to a throttle.
+ *
+ * @param[in] throttle Rate limiter, nullptr charges nothing
+ */
+void ChargeMetadata(IoThrottle* throttle)
+{
+    if (nullptr != throttle)
+    {
+        throttle->AcquireMetadata();
+    }
+}
+
+#ifdef _WIN32
+constexpr std::uint64_t CloneChunkSize = 1024ULL * 1024 * 1024;
+constexpr DWORD OverlappedChunkSize = 1024 * 1024;
+constexpr std::size_t OverlappedRequestCount = 4;
+constexpr std::uint64_t UnbufferedAlignment = 64 * 1024;
+constexpr ULONG_PTR ReadCompletionKey = 1;
+constexpr ULONG_PTR WriteCompletionKey = 2;
+
+/**
+ * @brief Close a handle when leaving scope.
+ */
+class ScopedHandle
+{
+  public:
+    explicit ScopedHandle(HANDLE handle) : _handle(handle)
+    {
+    }
+
+    ~ScopedHandle()
+    {
+        if ((nullptr != _handle) && (INVALID_HANDLE_VALUE != _handle))
+        {
+            CloseHandle(_handle);
+        }
+    }
+
+    ScopedHandle(const ScopedHandle&) = delete;
+    ScopedHandle& operator=(const ScopedHandle&) = delete;
+
+    HANDLE Get() const
+    {
+        return _handle;
+    }
+
+    bool IsValid() const
+    {
+        return (nullptr != _handle) && (INVALID_HANDLE_VALUE != _handle);
+    }
+
+  private:
+    HANDLE _handle;
+};
+
+/**
+ * @brief Round a byte count up to a multiple of a power-of-two alignment.
+ *
+ * @param[in] value Byte count
+ * @param[in] alignment Power-of-two alignment
+ * @return Smallest multiple of the alignment not below the value
+ */
+std::uint64_t AlignUp(std::uint64_t value, std::uint64_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * @brief Set the end of file of an open handle.
+ *
+ * @param[in] handle File opened for writing
+ * @param[in] size New file size in bytes
+ * @return true on success, false on error
+ */
+bool SetEndOfFileAt(HANDLE handle, std::uint64_t size)
+{
+    FILE_END_OF_FILE_INFO endOfFile{};
+    endOfFile.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+    return FALSE != SetFileInformationByHandle(handle, FileEndOfFileInfo, &endOfFile, sizeof(endOfFile));
+}
+
+/**
+ * @brief Reserve the clusters of a destination in one request, so copies written side by side get contiguous runs.
+ *
+ * @param[in] handle File opened for writing
+ * @param[in] size Bytes to reserve
+ */
+void ReserveAllocation(HANDLE handle, std::uint64_t size)
+{
+    FILE_ALLOCATION_INFO allocation{};
+    allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    SetFileInformationByHandle(handle, FileAllocationInfo, &allocation, sizeof(allocation));
+}
+
+/**
+ * @brief Clone a file by sharing its clusters with FSCTL_DUPLICATE_EXTENTS_TO_FILE.
+ *
+ * Block cloning needs a volume that counts block references, ReFS or a Dev Drive, holding both files.
+ * The destination takes the source's integrity stream setting and sparseness first, as ReFS refuses
+ * to clone between files that differ in them. Ranges are whole clusters; the last one may run past
+ * the end of file, which the destination's size then cuts off.
+ *
+ * @param[in] sourcePath File to clone
+ * @param[in] destinationPath File to create
+ * @param[in] sourceSize Size of the source in bytes, not zero
+ * @return Done, Unsupported where the volume or the pair of files cannot share clusters, Failed on an error after cloning started
+ */
+CopyStepResult CopyByBlockClone(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath, std::uint64_t sourceSize)
+{
+    const ScopedHandle source(CreateFileW(sourcePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (false == source.IsValid())
+    {
+        return CopyStepResult::Unsupported;
+    }
+    DWORD fileSystemFlags = 0;
+    if ((FALSE == GetVolumeInformationByHandleW(source.Get(), nullptr, 0, nullptr, nullptr, &fileSystemFlags, nullptr, 0)) ||
+        (0 == (fileSystemFlags & FILE_SUPPORTS_BLOCK_REFCOUNTING)))
+    {
+        return CopyStepResult::Unsupported;
+    }
+    FSCTL_GET_INTEGRITY_INFORMATION_BUFFER integrity{};
+    DWORD returnedBytes = 0;
+    if (FALSE == DeviceIoControl(source.Get(), FSCTL_GET_INTEGRITY_INFORMATION, nullptr, 0, &integrity, sizeof(integrity), &returnedBytes, nullptr))
+    {
+        return CopyStepResult::Unsupported;
+    }
+    BY_HANDLE_FILE_INFORMATION sourceInformation{};
+    if (FALSE == GetFileInformationByHandle(source.Get(), &sourceInformation))
+    {
+        return CopyStepResult::Unsupported;
+    }
+
+    const ScopedHandle destination(CreateFileW(destinationPath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (false == destination.IsValid())
+    {
+        return CopyStepResult::Unsupported;
+    }
+    FSCTL_SET_INTEGRITY_INFORMATION_BUFFER destinationIntegrity{};
+    destinationIntegrity.ChecksumAlgorithm = integrity.ChecksumAlgorithm;
+    destinationIntegrity.Flags = integrity.Flags;
+    if (FALSE == DeviceIoControl(destination.Get(), FSCTL_SET_INTEGRITY_INFORMATION, &destinationIntegrity, sizeof(destinationIntegrity), nullptr, 0,
+                                 &returnedBytes, nullptr))
+    {
+        return CopyStepResult::Unsupported;
+    }
+    if ((0 != (sourceInformation.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE)) &&
+        (FALSE == DeviceIoControl(destination.Get(), FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returnedBytes, nullptr)))
+    {
+        return CopyStepResult::Unsupported;
+    }
+    if (false == SetEndOfFileAt(destination.Get(), sourceSize))
+    {
+        return CopyStepResult::Unsupported;
+    }
+
+    const std::uint64_t clusterSize = (0 != integrity.ClusterSizeInBytes) ? integrity.ClusterSizeInBytes : UnbufferedAlignment;
+    const std::uint64_t cloneEnd = AlignUp(sourceSize, clusterSize);
+    for (std::uint64_t offset = 0; offset < cloneEnd; offset += CloneChunkSize)
+    {
+        DUPLICATE_EXTENTS_DATA extents{};
+        extents.FileHandle = source.Get();
+        extents.SourceFileOffset.QuadPart = static_cast<LONGLONG>(offset);
+        extents.TargetFileOffset.QuadPart = static_cast<LONGLONG>(offset);
+        extents.ByteCount.QuadPart = static_cast<LONGLONG>(std::min(CloneChunkSize, cloneEnd - offset));
+        if (FALSE == DeviceIoControl(destination.Get(), FSCTL_DUPLICATE_EXTENTS_TO_FILE, &extents, sizeof(extents), nullptr, 0, &returnedBytes, nullptr))
+        {
+            // A refusal of the first range means the files cannot share clusters; later ones are real errors.
+            return (0 == offset) ? CopyStepResult::Unsupported : CopyStepResult::Failed;
+        }
+    }
+    return CopyStepResult::Done;
+}
+
+/**
+ * @brief One read-then-write request of an overlapped copy.
+ */
+struct OverlappedRequest
+{
+    OVERLAPPED overlapped; /**< First member, so completions map back to the request */
+    void* buffer;          /**< Page-aligned buffer of OverlappedChunkSize bytes */
+    std::uint64_t offset;  /**< Offset of the chunk in both files */
+    DWORD length;          /**< Bytes read into the buffer */
+};
+
+/**
+ * @brief Start an overlapped read or write of a request.
+ *
+ * @param[in] handle File associated with the completion port
+ * @param[in,out] request Request whose offset and buffer are used
+ * @param[in] length Bytes to transfer
+ * @param[in] write Write the buffer instead of reading into it
+ * @return true if a completion will be queued, false if the request failed to start
+ */
+bool StartOverlapped(HANDLE handle, OverlappedRequest& request, DWORD length, bool write)
+{
+    request.overlapped = OVERLAPPED{};
+    request.overlapped.Offset = static_cast<DWORD>(request.offset & 0xFFFFFFFFULL);
+    request.overlapped.OffsetHigh = static_cast<DWORD>(request.offset >> 32);
+    const BOOL started = (true == write) ? WriteFile(handle, request.buffer, length, nullptr, &request.overlapped)
+                                         : ReadFile(handle, request.buffer, length, nullptr, &request.overlapped);
+    // Requests that finish at once queue their completion too, as the handles do not skip the port on success.
+    return (FALSE != started) || (ERROR_IO_PENDING == GetLastError());
+}
+
+/**
+ * @brief Copy a file with overlapped reads and writes completed on one I/O completion port.
+ *
+ * Every request reads a chunk and writes it to the same offset before moving on to the next unread
+ * chunk, so OverlappedRequestCount chunks are in flight at any time. The destination is sized up
+ * front, because Windows completes writes that extend a file synchronously. Unbuffered copies open
+ * both files with FILE_FLAG_NO_BUFFERING; their last write is padded to the alignment and the
+ * padding is cut off by the final end of file.
+ *
+ * @param[in] sourcePath File to copy
+ * @param[in] destinationPath File to create
+ * @param[in] sourceSize Size of the source in bytes
+ * @param[in] unbuffered Bypass the system cache
+ * @param[in] throttle Rate limiter every chunk is charged to, nullptr copies at full speed
+ * @return Done, Unsupported if the files cannot be opened for overlapped I/O, Failed on an I/O error
+ */
+CopyStepResult CopyByOverlappedIo(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath, std::uint64_t sourceSize,
+                                  bool unbuffered, IoThrottle* throttle)
+{
+    const DWORD cacheFlags = (true == unbuffered) ? FILE_FLAG_NO_BUFFERING : 0;
+    const ScopedHandle source(CreateFileW(sourcePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                          OPEN_EXISTING, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN | cacheFlags, nullptr));
+    if (false == source.IsValid())
+    {
+        return CopyStepResult::Failed;
+    }
+    const ScopedHandle destination(
+        CreateFileW(destinationPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | cacheFlags, nullptr));
+    if (false == destination.IsValid())
+    {
+        return CopyStepResult::Failed;
+    }
+    const std::uint64_t paddedSize = (true == unbuffered) ? AlignUp(sourceSize, UnbufferedAlignment) : sourceSize;
+    ReserveAllocation(destination.Get(), paddedSize);
+    if (false == SetEndOfFileAt(destination.Get(), paddedSize))
+    {
+        return CopyStepResult::Failed;
+    }
+
+    const ScopedHandle port(CreateIoCompletionPort(source.Get(), nullptr, ReadCompletionKey, 1));
+    if ((false == port.IsValid()) || (nullptr == CreateIoCompletionPort(destination.Get(), port.Get(), WriteCompletionKey, 0)))
+    {
+        return CopyStepResult::Unsupported;
+    }
+
+    std::vector<OverlappedRequest> requests(OverlappedRequestCount);
+    for (auto& request : requests)
+    {
+        request.buffer = VirtualAlloc(nullptr, OverlappedChunkSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    }
+    std::uint64_t nextOffset = 0;
+    std::uint64_t copiedEnd = 0;
+    std::size_t outstanding = 0;
+    bool failed = false;
+
+    // Starts the read of the next chunk on a request, or leaves the request idle once the source is read.
+    auto startNextRead = [&](OverlappedRequest& request)
+    {
+        if ((true == failed) || (nextOffset >= sourceSize))
+        {
+            return;
+        }
+        request.offset = nextOffset;
+        const DWORD length = static_cast<DWORD>(std::min<std::uint64_t>(OverlappedChunkSize, AlignUp(sourceSize - nextOffset, UnbufferedAlignment)));
+        nextOffset += OverlappedChunkSize;
+        ChargeCopy(throttle, std::min<std::uint64_t>(OverlappedChunkSize, sourceSize - request.offset));
+        if (true == StartOverlapped(source.Get(), request, length, false))
+        {
+            ++outstanding;
+            return;
+        }
+        failed = true;
+    };
+
+    for (auto& request : requests)
+    {
+        if (nullptr == request.buffer)
+        {
+            failed = true;
+        }
+        startNextRead(request);
+    }
+    while (0 < outstanding)
+    {
+        DWORD transferredBytes = 0;
+        ULONG_PTR completionKey = 0;
+        LPOVERLAPPED completed = nullptr;
+        const BOOL succeeded = GetQueuedCompletionStatus(port.Get(), &transferredBytes, &completionKey, &completed, INFINITE);
+        if (nullptr == completed)
+        {
+            failed = true;
+            break;
+        }
+        --outstanding;
+        OverlappedRequest& request = *reinterpret_cast<OverlappedRequest*>(completed);
+        if ((FALSE == succeeded) && (ERROR_HANDLE_EOF != GetLastError()))
+        {
+            failed = true;
+            continue;
+        }
+        if (ReadCompletionKey == completionKey)
+        {
+            // A source that shrank since it was measured ends the copy at its new size.
+            if (0 == transferredBytes)
+            {
+                continue;
+            }
+            request.length = transferredBytes;
+            const DWORD writeLength = (true == unbuffered) ? static_cast<DWORD>(AlignUp(transferredBytes, UnbufferedAlignment)) : transferredBytes;
+            if ((false == failed) && (true == StartOverlapped(destination.Get(), request, writeLength, true)))
+            {
+                ++outstanding;
+                continue;
+            }
+            failed = true;
+            continue;
+        }
+        copiedEnd = std::max(copiedEnd, request.offset + request.length);
+        startNextRead(request);
+    }
+    // Pending requests may still write into the buffers after a port failure, so those are left allocated.
+    if (0 == outstanding)
+    {
+        for (auto& request : requests)
+        {
+            if (nullptr != request.buffer)
+            {
+                VirtualFree(request.buffer, 0, MEM_RELEASE);
+            }
+        }
+    }
+    if ((true == failed) || (false == SetEndOfFileAt(destination.Get(), copiedEnd)))
+    {
+        return CopyStepResult::Failed;
+    }
+    return CopyStepResult::Done;
+}
+#else
+constexpr std::size_t CopyBufferSize = 1024 * 1024;
+constexpr std::size_t KernelCopyChunkSize = 64 * 1024 * 1024;
+constexpr mode_t PermissionBitsMask = 07777;
+constexpr mode_t InitialDestinationMode = 0600;
+constexpr std::uintmax_t DropBehindInterval = 8 * 1024 * 1024;
+constexpr std::uintmax_t StatBlockSize = 512;
+
+/**
+ * @brief Close a file descriptor when leaving scope.
+ */
+class ScopedDescriptor
+{
+  public:
+    explicit ScopedDescriptor(int descriptor) : _descriptor(descriptor)
+    {
+    }
+
+    ~ScopedDescriptor()
+    {
+        if (0 <= _descriptor)
+        {
+            close(_descriptor);
+        }
+    }
+
+    ScopedDescriptor(const ScopedDescriptor&) = delete;
+    ScopedDescriptor& operator=(const ScopedDescriptor&) = delete;
+
+    int Get() const
+    {
+        return _descriptor;
+    }
+
+  private:
+    int _descriptor;
+};
+
+/**
+ * @brief Open a file to copy without updating its access time where the kernel allows it.
+ *
+ * Linux refuses O_NOATIME with EPERM on files the process does not own; those are opened again without it.
+ *
+ * @param[in] filePath File to open
+ * @return Open descriptor, negative on error
+ */
+int OpenForReading(const std::filesystem::path& filePath)
+{
+#ifdef O_NOATIME
+    const int fileDescriptor = open(filePath.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if ((0 <= fileDescriptor) || (EPERM != errno))
+    {
+        return fileDescriptor;
+    }
+#endif
+    return open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+/**
+ * @brief Evicts the copied range of both files from the page cache as a copy advances.
+ *
+ * Source and destination are written at the same offsets, so one position covers both. Dirty destination
+ * pages are written back first, because the kernel keeps dirty pages cached. Linux only; elsewhere this
+ * does nothing.
+ */
+class PageCacheDropper
+{
+  public:
+    PageCacheDropper(int sourceDescriptor, int destinationDescriptor, bool enabled)
+        : _sourceDescriptor(sourceDescriptor), _destinationDescriptor(destinationDescriptor), _enabled(enabled)
+    {
+    }
+
+    /**
+     * @brief Account for copied bytes, evicting once enough have accumulated.
+     *
+     * @param[in] copiedBytes Bytes copied since the last call
+     */
+    void Advance(std::uintmax_t copiedBytes)
+    {
+        _position += copiedBytes;
+        if ((true == _enabled) && (DropBehindInterval <= (_position - _dropped)))
+        {
+            Drop(_dropped, _position - _dropped);
+            _dropped = _position;
+        }
+    }
+
+    /**
+     * @brief Evict everything that is left once the copy is complete.
+     */
+    void Finish()
+    {
+        if (true == _enabled)
+        {
+            Drop(0, 0);
+        }
+    }
+
+  private:
+    void Drop(std::uintmax_t offset, std::uintmax_t length)
+    {
+#ifdef __linux__
+        sync_file_range(_destinationDescriptor, static_cast<off_t>(offset), static_cast<off_t>(length),
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(_destinationDescriptor, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+        posix_fadvise(_sourceDescriptor, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#else
+        static_cast<void>(offset);
+        static_cast<void>(length);
+#endif
+    }
+
+    int _sourceDescriptor;
+    int _destinationDescriptor;
+    bool _enabled;
+    std::uintmax_t _position = 0;
+    std::uintmax_t _dropped = 0;
+};
+
+#ifdef __linux__
+/**
+ * @brief Check whether an errno value means the kernel copy is not possible between these files.
+ *
+ * @param[in] errorNumber errno after a failed call
+ * @return true if a slower mechanism should be tried
+ */
+bool IsUnsupportedError(int errorNumber)
+{
+    return (EXDEV == errorNumber) || (ENOSYS == errorNumber) || (EINVAL == errorNumber) || (EOPNOTSUPP == errorNumber) ||
+           (ENOTTY == errorNumber) || (EPERM == errorNumber);
+}
+
+/**
+ * @brief Make the destination share the source extents (btrfs, XFS, bcachefs reflinks).
+ *
+ * @param[in] sourceDescriptor Source file
+ * @param[in] destinationDescriptor Empty destination file
+ * @return Outcome of the clone
+ */
+CopyStepResult CopyByClone(int sourceDescriptor, int destinationDescriptor)
+{
+#ifdef FICLONE
+    if (0 == ioctl(destinationDescriptor, FICLONE, sourceDescriptor))
+    {
+        return CopyStepResult::Done;
+    }
+#endif
+    return CopyStepResult::Unsupported;
+}
+
+/**
+ * @brief Copy with a kernel copy system call, continuing from the current file offsets.
+ *
+ * Some pseudo filesystems report end of file before any data is copied, so a short copy against the
+ * expected size counts as unsupported.
+ *
+ * @param[in] sourceDescriptor Source file
+ * @param[in] destinationDescriptor Destination file
+ * @param[in] sourceSize Size of the source from fstat
+ * @param[in,out] copiedBytes Bytes already in the destination, advanced by this step
+ * @param[in,out] dropper Page cache eviction of the copied range
+ * @param[in] throttle Rate limiter charged per chunk, nullptr copies in large chunks at full speed
+ * @param[in] copyChunk System call copying up to the given count between the current offsets
+ * @return Outcome of the step
+ */
+template <typename CopyChunk>
+CopyStepResult CopyByKernel(int sourceDescriptor, int destinationDescriptor, std::uintmax_t sourceSize, std::uintmax_t& copiedBytes,
+                            PageCacheDropper& dropper, IoThrottle* throttle, CopyChunk copyChunk)
+{
+    const std::size_t chunkSize = (nullptr != throttle) ? IoThrottle::RequestSize : KernelCopyChunkSize;
+    while (true)
+    {
+        const ssize_t chunkBytes = copyChunk(sourceDescriptor, destinationDescriptor, chunkSize);
+        if (0 < chunkBytes)
+        {
+            copiedBytes += static_cast<std::uintmax_t>(chunkBytes);
+            dropper.Advance(static_cast<std::uintmax_t>(chunkBytes));
+            ChargeCopy(throttle, static_cast<std::uintmax_t>(chunkBytes));
+            continue;
+        }
+        if (0 == chunkBytes)
+        {
+            return (copiedBytes < sourceSize) ? CopyStepResult::Unsupported : CopyStepResult::Done;
+        }
+        if (EINTR == errno)
+        {
+            continue;
+        }
+        return (true == IsUnsupportedError(errno)) ? CopyStepResult::Unsupported : CopyStepResult::Failed;
+    }
+}
+#endif
+
+#ifdef __APPLE__
+/**
+ * @brief Create the destination as an APFS clone sharing the source's blocks.
+ *
+ * fclonefileat creates the destination itself, with the source's mode and extended attributes,
+ * so it runs before anything else opens the destination path.
+ *
+ * @param[in] sourceDescriptor Source file
+ * @param[in] destinationPath Destination that does not exist
+ * @return Done, Unsupported on volumes other than APFS or across volumes, Failed on other errors
+ */
+CopyStepResult CopyByCloneFile(int sourceDescriptor, const std::filesystem::path& destinationPath)
+{
+    if (0 == fclonefileat(sourceDescriptor, AT_FDCWD, destinationPath.c_str(), 0))
+    {
+        return CopyStepResult::Done;
+    }
+    return ((ENOTSUP == errno) || (EXDEV == errno) || (EINVAL == errno)) ? CopyStepResult::Unsupported : CopyStepResult::Failed;
+}
+#endif
+
+/**
+ * @brief Reserve the blocks of a dense destination before the first write, without changing its size.
+ *
+ * Copies running side by side then get contiguous extents instead of interleaved ones. Where the
+ * filesystem cannot preallocate, blocks are allocated as the writes arrive.
+ *
+ * @param[in] destinationDescriptor Empty destination file
+ * @param[in] size Bytes to reserve
+ * @return true if blocks were reserved, which the copy must cut back to its final size
+ */
+bool ReserveBlocks(int destinationDescriptor, std::uintmax_t size)
+{
+#if defined(__linux__)
+    return 0 == fallocate(destinationDescriptor, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+#elif defined(__APPLE__)
+    fstore_t store{F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0};
+    if (-1 != fcntl(destinationDescriptor, F_PREALLOCATE, &store))
+    {
+        return true;
+    }
+    store.fst_flags = F_ALLOCATEALL;
+    return -1 != fcntl(destinationDescriptor, F_PREALLOCATE, &store);
+#else
+    static_cast<void>(destinationDescriptor);
+    static_cast<void>(size);
+    return false;
+#endif
+}
+
+#ifdef SEEK_HOLE
+/**
+ * @brief Check whether a file has fewer blocks allocated than its size needs, so it has holes.
+ *
+ * @param[in] fileStatus Status of the file from fstat
+ * @return true if the file is sparse
+ */
+bool IsSparse(const struct stat& fileStatus)
+{
+    return (0 < fileStatus.st_size) && ((static_cast<std::uintmax_t>(fileStatus.st_blocks) * StatBlockSize) < static_cast<std::uintmax_t>(fileStatus.st_size));
+}
+
+/**
+ * @brief Copy one data extent of a sparse file at explicit offsets, in the kernel where possible.
+ *
+ * @param[in] sourceDescriptor Source file
+ * @param[in] destinationDescriptor Destination file
+ * @param[in] extentStart Offset of the first byte of the extent
+ * @param[in] extentEnd Offset just past the extent
+ * @param[in,out] kernelCopy Use copy_file_range; cleared when the kernel refuses it
+ * @param[in,out] buffer Buffer of the userspace fallback, allocated on first use
+ * @param[in,out] dropper Page cache eviction of the copied range
+ * @param[in] throttle Rate limiter charged per chunk, nullptr copies at full speed
+ * @param[out] outputEnd Offset the copy reached; short of extentEnd when the source shrank
+ * @return Done or Failed
+ */
+CopyStepResult CopyExtent(int sourceDescriptor, int destinationDescriptor, off_t extentStart, off_t extentEnd, bool& kernelCopy,
+                          std::vector<char>& buffer, PageCacheDropper& dropper, IoThrottle* throttle, off_t& outputEnd)
+{
+#ifndef __linux__
+    static_cast<void>(kernelCopy);
+#endif
+    off_t position = extentStart;
+    while (position < extentEnd)
+    {
+        const std::uintmax_t remaining = static_cast<std::uintmax_t>(extentEnd - position);
+        ssize_t chunkBytes = 0;
+#ifdef __linux__
+        if (true == kernelCopy)
+        {
+            const std::size_t chunkSize = (nullptr != throttle) ? IoThrottle::RequestSize : KernelCopyChunkSize;
+            off_t sourceOffset = position;
+            off_t destinationOffset = position;
+            chunkBytes = copy_file_range(sourceDescriptor, &sourceOffset, destinationDescriptor, &destinationOffset,
+                                         static_cast<std::size_t>(std::min<std::uintmax_t>(remaining, chunkSize)), 0);
+            if ((0 > chunkBytes) && (EINTR != errno) && (false == IsUnsupportedError(errno)))
+            {
+                return CopyStepResult::Failed;
+            }
+            if (0 >= chunkBytes)
+            {
+                // Refused or short: the buffered loop finds out whether the source really ended.
+                kernelCopy = (0 > chunkBytes) && (EINTR == errno);
+                continue;
+            }
+        }
+        else
+#endif
+        {
+            buffer.resize(CopyBufferSize);
+            chunkBytes = pread(sourceDescriptor, buffer.data(), static_cast<std::size_t>(std::min<std::uintmax_t>(remaining, buffer.size())), position);
+            if (0 > chunkBytes)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                return CopyStepResult::Failed;
+            }
+            if (0 == chunkBytes)
+            {
+                break;
+            }
+            for (ssize_t bytesWritten = 0; bytesWritten < chunkBytes;)
+            {
+                const ssize_t writeResult = pwrite(destinationDescriptor, buffer.data() + bytesWritten, static_cast<std::size_t>(chunkBytes - bytesWritten),
+                                                   position + bytesWritten);
+                if (0 > writeResult)
+                {
+                    if (EINTR == errno)
+                    {
+                        continue;
+                    }
+                    return CopyStepResult::Failed;
+                }
+                bytesWritten += writeResult;
+            }
+        }
+        position += chunkBytes;
+        dropper.Advance(static_cast<std::uintmax_t>(chunkBytes));
+        ChargeCopy(throttle, static_cast<std::uintmax_t>(chunkBytes));
+    }
+    outputEnd = position;
+    return CopyStepResult::Done;
+}
+
+/**
+ * @brief Copy only the data extents of a sparse file and leave its holes as holes in the destination.
+ *
+ * The extents are found with SEEK_DATA and SEEK_HOLE; the destination is extended to the source size
+ * at the end, so a trailing hole costs nothing either. Only the copied data is charged to the throttle.
+ *
+ * @param[in] sourceDescriptor Source file at offset 0
+ * @param[in] destinationDescriptor Empty destination file
+ * @param[in] sourceSize Size of the source from fstat
+ * @param[in] kernelCopy Copy the extents with copy_file_range where the kernel accepts it
+ * @param[in,out] dropper Page cache eviction of the copied range
+ * @param[in] throttle Rate limiter charged per chunk, nullptr copies at full speed
+ * @param[out] outputMethod Mechanism that copied the last extent
+ * @return Unsupported with both offsets untouched when the filesystem cannot report holes, otherwise Done or Failed
+ */
+CopyStepResult CopyDataExtents(int sourceDescriptor, int destinationDescriptor, std::uintmax_t sourceSize, bool kernelCopy,
+                               PageCacheDropper& dropper, IoThrottle* throttle, CopyMethod& outputMethod)
+{
+    std::vector<char> buffer;
+    off_t fileEnd = static_cast<off_t>(sourceSize);
+    off_t position = 0;
+    while (position < fileEnd)
+    {
+        const off_t dataStart = lseek(sourceDescriptor, position, SEEK_DATA);
+        if (0 > dataStart)
+        {
+            if (ENXIO == errno)
+            {
+                // No data past the position: the rest of the file is one hole.
+                break;
+            }
+            if ((0 == position) && ((EINVAL == errno) || (EOPNOTSUPP == errno)))
+            {
+                lseek(sourceDescriptor, 0, SEEK_SET);
+                return CopyStepResult::Unsupported;
+            }
+            return CopyStepResult::Failed;
+        }
+        const off_t holeStart = lseek(sourceDescriptor, dataStart, SEEK_HOLE);
+        if (0 > holeStart)
+        {
+            return CopyStepResult::Failed;
+        }
+
+        const off_t extentEnd = std::min(holeStart, fileEnd);
+        if (extentEnd <= dataStart)
+        {
+            break;
+        }
+        dropper.Advance(static_cast<std::uintmax_t>(dataStart - position));
+        outputMethod = (true == kernelCopy) ? CopyMethod::CopyFileRange : CopyMethod::Buffered;
+        off_t copiedEnd = dataStart;
+        if (CopyStepResult::Done !=
+            CopyExtent(sourceDescriptor, destinationDescriptor, dataStart, extentEnd, kernelCopy, buffer, dropper, throttle, copiedEnd))
+        {
+            return CopyStepResult::Failed;
+        }
+        if (copiedEnd < extentEnd)
+        {
+            // The source shrank while it was copied; the copy ends where its data ended.
+            fileEnd = copiedEnd;
+        }
+        position = copiedEnd;
+    }
+
+    return (0 == ftruncate(destinationDescriptor, fileEnd)) ? CopyStepResult::Done : CopyStepResult::Failed;
+}
+#endif
+
+/**
+ * @brief Copy through a userspace buffer, continuing from the current file offsets.
+ *
+ * @param[in] sourceDescriptor Source file
+ * @param[in] destinationDescriptor Destination file
+ * @param[in,out] dropper Page cache eviction of the copied range
+ * @param[in] throttle Rate limiter charged per buffer, nullptr copies at full speed
+ * @return Outcome of the step
+ */
+CopyStepResult CopyByBuffer(int sourceDescriptor, int destinationDescriptor, PageCacheDropper& dropper, IoThrottle* throttle)
+{
+    std::vector<char> buffer(CopyBufferSize);
+    while (true)
+    {
+        const ssize_t bytesRead = read(sourceDescriptor, buffer.data(), buffer.size());
+        if (0 == bytesRead)
+        {
+            return CopyStepResult::Done;
+        }
+        if (0 > bytesRead)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+            return CopyStepResult::Failed;
+        }
+
+        std::size_t bytesWritten = 0;
+        while (bytesWritten < static_cast<std::size_t>(bytesRead))
+        {
+            const ssize_t writeResult = write(destinationDescriptor, buffer.data() + bytesWritten, static_cast<std::size_t>(bytesRead) - bytesWritten);
+            if (0 > writeResult)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                return CopyStepResult::Failed;
+            }
+            bytesWritten += static_cast<std::size_t>(writeResult);
+        }
+        dropper.Advance(bytesWritten);
+        ChargeCopy(throttle, bytesWritten);
+    }
+}
+#endif
+}
+
+#ifdef __linux__
+namespace
+{
+constexpr unsigned int UringChainsInFlight = 32;
+
+/**
+ * @brief Get the io_uring copier of the calling thread, set up on its first batch.
+ *
+ * @return Copier, nullptr where io_uring is unavailable or the kernel lacks descriptor slots for opens
+ */
+UringCopier* ThreadUringCopier()
+{
+    thread_local bool attempted = false;
+    thread_local std::unique_ptr<UringCopier> copier;
+    if (false == attempted)
+    {
+        attempted = true;
+        copier = UringCopier::Create(UringChainsInFlight, static_cast<std::size_t>(FileCopier::SmallCopySize));
+    }
+    return ((nullptr != copier) && (true == copier->IsUsable())) ? copier.get() : nullptr;
+}
+} // namespace
+#endif
+
+FileCopier::FileCopier(CopyMethod firstMethod, std::uintmax_t unbufferedThreshold, IoThrottle* throttle)
+    : _firstMethod(firstMethod), _unbufferedThreshold(unbufferedThreshold), _throttle(throttle)
+{
+}
+
+bool FileCopier::Copy(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath) const
+{
+    CopyMethod method = CopyMethod::Buffered;
+    return Copy(sourcePath, destinationPath, method);
+}
+
+bool FileCopier::Copy(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath, CopyMethod& outputMethod) const
+{
+    std::error_code removeError;
+    std::filesystem::remove(destinationPath, removeError);
+
+#ifdef _WIN32
+    std::error_code errorCode;
+    const std::uintmax_t sourceSize = std::filesystem::file_size(sourcePath, errorCode);
+    ChargeMetadata(_throttle);
+    if (0 != errorCode.value())
+    {
+        return false;
+    }
+    CopyStepResult result = CopyStepResult::Unsupported;
+    if ((CopyMethod::Clone == _firstMethod) && (0 < sourceSize))
+    {
+        result = CopyByBlockClone(sourcePath, destinationPath, sourceSize);
+        outputMethod = CopyMethod::Clone;
+    }
+    if ((CopyStepResult::Unsupported == result) && (CopyMethod::Native >= _firstMethod))
+    {
+        const bool unbuffered = (0 != _unbufferedThreshold) && (_unbufferedThreshold <= sourceSize);
+        result = CopyByOverlappedIo(sourcePath, destinationPath, sourceSize, unbuffered, _throttle);
+        outputMethod = CopyMethod::Native;
+    }
+    if (CopyStepResult::Unsupported == result)
+    {
+        std::filesystem::copy_file(sourcePath, destinationPath, std::filesystem::copy_options::overwrite_existing, errorCode);
+        outputMethod = CopyMethod::Buffered;
+        return 0 == errorCode.value();
+    }
+    return CopyStepResult::Done == result;
+#else
+    const ScopedDescriptor source(OpenForReading(sourcePath));
+    ChargeMetadata(_throttle);
+    if (0 > source.Get())
+    {
+        return false;
+    }
+
+    struct stat sourceStatus{};
+    if ((0 != fstat(source.Get(), &sourceStatus)) || (false == S_ISREG(sourceStatus.st_mode)))
+    {
+        return false;
+    }
+#ifdef __APPLE__
+    if ((CopyMethod::Clone == _firstMethod) && (0 < sourceStatus.st_size))
+    {
+        const CopyStepResult cloneResult = CopyByCloneFile(source.Get(), destinationPath);
+        if (CopyStepResult::Unsupported != cloneResult)
+        {
+            outputMethod = CopyMethod::Clone;
+            return CopyStepResult::Done == cloneResult;
+        }
+    }
+#endif
+
+    const ScopedDescriptor destination(open(destinationPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, InitialDestinationMode));
+    ChargeMetadata(_throttle);
+    if (0 > destination.Get())
+    {
+        return false;
+    }
+
+    const std::uintmax_t sourceSize = static_cast<std::uintmax_t>(sourceStatus.st_size);
+    PageCacheDropper dropper(source.Get(), destination.Get(), (0 != _unbufferedThreshold) && (_unbufferedThreshold <= sourceSize));
+    CopyStepResult result = CopyStepResult::Unsupported;
+#ifdef __linux__
+    std::uintmax_t copiedBytes = 0;
+    if ((CopyMethod::Clone == _firstMethod) && (0 < sourceSize))
+    {
+        result = CopyByClone(source.Get(), destination.Get());
+        outputMethod = CopyMethod::Clone;
+    }
+#endif
+    // Holes stay holes, so only a dense copy that moves data reserves its blocks up front.
+    bool reserved = (CopyStepResult::Unsupported == result) && (0 < sourceSize);
+#ifdef SEEK_HOLE
+    reserved = (true == reserved) && (false == IsSparse(sourceStatus));
+#endif
+    reserved = (true == reserved) && (true == ReserveBlocks(destination.Get(), sourceSize));
+#ifdef SEEK_HOLE
+    if ((CopyStepResult::Unsupported == result) && (true == IsSparse(sourceStatus)))
+    {
+        result = CopyDataExtents(source.Get(), destination.Get(), sourceSize, CopyMethod::CopyFileRange >= _firstMethod, dropper, _throttle,
+                                 outputMethod);
+    }
+#endif
+#ifdef __linux__
+    if ((CopyStepResult::Unsupported == result) && (CopyMethod::CopyFileRange >= _firstMethod))
+    {
+        result = CopyByKernel(source.Get(), destination.Get(), sourceSize, copiedBytes, dropper, _throttle, [](int in, int out, std::size_t count) {
+            return copy_file_range(in, nullptr, out, nullptr, count, 0);
+        });
+        outputMethod = CopyMethod::CopyFileRange;
+    }
+    if ((CopyStepResult::Unsupported == result) && (CopyMethod::SendFile >= _firstMethod))
+    {
+        result = CopyByKernel(source.Get(), destination.Get(), sourceSize, copiedBytes, dropper, _throttle,
+                              [](int in, int out, std::size_t count) { return sendfile(out, in, nullptr, count); });
+        outputMethod = CopyMethod::SendFile;
+    }
+#endif
+    if (CopyStepResult::Unsupported == result)
+    {
+        result = CopyByBuffer(source.Get(), destination.Get(), dropper, _throttle);
+        outputMethod = CopyMethod::Buffered;
+    }
+
+    if (CopyStepResult::Done != result)
+    {
+        return false;
+    }
+    // A source that shrank while it was copied leaves reserved blocks past the end of the copy.
+    struct stat destinationStatus{};
+    if ((true == reserved) &&
+        ((0 != fstat(destination.Get(), &destinationStatus)) || (0 != ftruncate(destination.Get(), destinationStatus.st_size))))
+    {
+        return false;
+    }
+    dropper.Finish();
+    return 0 == fchmod(destination.Get(), sourceStatus.st_mode & PermissionBitsMask);
+#endif
+}
+
+bool FileCopier::Move(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath) const
+{
+    std::error_code errorCode;
+    std::filesystem::rename(sourcePath, destinationPath, errorCode);
+    if (0 == errorCode.value())
+    {
+        return true;
+    }
+
+    if (false == Copy(sourcePath, destinationPath))
+    {
+        return false;
+    }
+    return std::filesystem::remove(sourcePath, errorCode);
+}
+
+bool FileCopier::LinkBatch(const std::filesystem::path& sourceDirectory, const std::filesystem::path& destinationDirectory,
+                           const std::vector<std::string>& names, std::vector<std::string>& outputMissing) const
+{
+    outputMissing.clear();
+#ifdef _WIN32
+    for (const std::string& name : names)
+    {
+        const std::filesystem::path sourcePath = sourceDirectory / name;
+        const std::filesystem::path destinationPath = destinationDirectory / name;
+        std::error_code errorCode;
+        std::filesystem::remove(destinationPath, errorCode);
+        std::filesystem::create_hard_link(sourcePath, destinationPath, errorCode);
+        if (0 == errorCode.value())
+        {
+            continue;
+        }
+        if (false == std::filesystem::exists(sourcePath, errorCode))
+        {
+            outputMissing.push_back(name);
+            continue;
+        }
+        if (false == Copy(sourcePath, destinationPath))
+        {
+            return false;
+        }
+    }
+    return true;
+#else
+    const ScopedDescriptor source(open(sourceDirectory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (0 > source.Get())
+    {
+        if (ENOENT != errno)
+        {
+            return false;
+        }
+        outputMissing = names;
+        return true;
+    }
+    const ScopedDescriptor destination(open(destinationDirectory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (0 > destination.Get())
+    {
+        return false;
+    }
+
+    for (const std::string& name : names)
+    {
+        int result = linkat(source.Get(), name.c_str(), destination.Get(), name.c_str(), 0);
+        if ((0 != result) && (EEXIST == errno))
+        {
+            unlinkat(destination.Get(), name.c_str(), 0);
+            result = linkat(source.Get(), name.c_str(), destination.Get(), name.c_str(), 0);
+        }
+        if (0 == result)
+        {
+            continue;
+        }
+        if (ENOENT == errno)
+        {
+            outputMissing.push_back(name);
+            continue;
+        }
+        // EXDEV and EMLINK leave a copy as the only way; Copy still tries a clone first.
+        if (false == Copy(sourceDirectory / name, destinationDirectory / name))
+        {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+bool FileCopier::CopyBatch(const std::vector<std::pair<std::filesystem::path, std::filesystem::path>>& copies,
+                           std::vector<std::size_t>& outputFailed) const
+{
+    outputFailed.clear();
+    std::vector<bool> copied(copies.size(), false);
+#ifdef __linux__
+    UringCopier* uringCopier = ThreadUringCopier();
+    if (nullptr != uringCopier)
+    {
+        std::vector<UringCopier::SmallCopy> smallCopies;
+        std::vector<std::size_t> smallIndexes;
+        const uid_t user = geteuid();
+        for (std::size_t i = 0; i < copies.size(); ++i)
+        {
+            struct stat sourceStatus{};
+            if ((0 != stat(copies[i].first.c_str(), &sourceStatus)) || (false == S_ISREG(sourceStatus.st_mode)) ||
+                (SmallCopySize < static_cast<std::uintmax_t>(sourceStatus.st_size)) ||
+                (false == uringCopier->CreatesMode(sourceStatus.st_mode & PermissionBitsMask)))
+            {
+                continue;
+            }
+            // Opening a file of another user without updating its access time needs ownership or CAP_FOWNER.
+            smallCopies.push_back(UringCopier::SmallCopy{&copies[i].first, &copies[i].second, static_cast<std::uint32_t>(sourceStatus.st_size),
+                                                         static_cast<unsigned int>(sourceStatus.st_mode & PermissionBitsMask),
+                                                         (0 == user) || (sourceStatus.st_uid == user)});
+            smallIndexes.push_back(i);
+            ChargeMetadata(_throttle);
+            ChargeMetadata(_throttle);
+            ChargeCopy(_throttle, static_cast<std::uintmax_t>(sourceStatus.st_size));
+        }
+        std::vector<bool> smallCopied;
+        uringCopier->CopyAll(smallCopies, smallCopied);
+        for (std::size_t i = 0; i < smallIndexes.size(); ++i)
+        {
+            copied[smallIndexes[i]] = smallCopied[i];
+        }
+    }
+#endif
+    for (std::size_t i = 0; i < copies.size(); ++i)
+    {
+        if ((false == copied[i]) && (false == Copy(copies[i].first, copies[i].second)))
+        {
+            outputFailed.push_back(i);
+        }
+    }
+    return true == outputFailed.empty();
+}
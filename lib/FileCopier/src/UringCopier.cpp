@@ -0,0 +1,442 @@
+#include "UringCopier.hpp"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <linux/io_uring.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+namespace
+{
+constexpr std::size_t BufferAlignment = 4096;
+constexpr unsigned int OperationBits = 4;
+constexpr unsigned int OperationsPerChain = 9; /**< Seven chained operations and two closes after a failure */
+constexpr unsigned int PermissionBits = 0777;
+
+/**
+ * @brief Operations of one copy, kept in the low bits of the user data of each entry.
+ */
+enum Operation : std::uint32_t
+{
+    UnlinkDestination,
+    OpenSource,
+    ReadSource,
+    OpenDestination,
+    WriteDestination,
+    CloseSource,
+    CloseDestination,
+    CleanUpSource,
+    CleanUpDestination
+};
+
+/**
+ * @brief Progress of the copy a chain slot is running.
+ */
+struct ChainState
+{
+    std::size_t copy;        /**< Index of the copy */
+    std::uint32_t size;      /**< Bytes the read and the write must move */
+    unsigned int remaining;  /**< Completions still to come */
+    bool failed;             /**< An operation failed or was cancelled */
+    bool cleaningUp;         /**< The closes after a failure are in flight */
+};
+
+int SetupRing(unsigned int entries, io_uring_params& params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int EnterRing(int ringDescriptor, unsigned int toSubmit, unsigned int minimumCompletions, unsigned int flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringDescriptor, toSubmit, minimumCompletions, flags, nullptr, 0));
+}
+
+int RegisterWithRing(int ringDescriptor, unsigned int opcode, const void* argument, unsigned int count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, ringDescriptor, opcode, argument, count));
+}
+
+/**
+ * @brief Read the umask of the process without changing it, as Linux 4.7 and later report it.
+ *
+ * @param[out] outputUmask Permission bits cleared from created files
+ * @return true if the umask was found
+ */
+bool ReadUmask(unsigned int& outputUmask)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (true == static_cast<bool>(std::getline(status, line)))
+    {
+        if (0 == line.rfind("Umask:", 0))
+        {
+            try
+            {
+                outputUmask = static_cast<unsigned int>(std::stoul(line.substr(6), nullptr, 8));
+                return true;
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        }
+    }
+    return false;
+}
+}
+#endif
+
+std::unique_ptr<UringCopier> UringCopier::Create(unsigned int chains, std::size_t bufferSize)
+{
+#ifdef __linux__
+    std::unique_ptr<UringCopier> copier(new UringCopier());
+    if ((0 == chains) || (0 == bufferSize) || (false == ReadUmask(copier->_umask)))
+    {
+        return nullptr;
+    }
+
+    io_uring_params params{};
+    copier->_ringDescriptor = SetupRing(chains * OperationsPerChain, params);
+    if (0 > copier->_ringDescriptor)
+    {
+        return nullptr;
+    }
+
+    copier->_submissionRingSize = params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+    copier->_completionRingSize = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+    const bool singleMapping = (0 != (params.features & IORING_FEAT_SINGLE_MMAP));
+    if (true == singleMapping)
+    {
+        copier->_submissionRingSize = std::max(copier->_submissionRingSize, copier->_completionRingSize);
+    }
+
+    copier->_submissionRing = mmap(nullptr, copier->_submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                   copier->_ringDescriptor, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == copier->_submissionRing)
+    {
+        copier->_submissionRing = nullptr;
+        return nullptr;
+    }
+    if (true == singleMapping)
+    {
+        copier->_completionRing = copier->_submissionRing;
+    }
+    else
+    {
+        copier->_completionRing = mmap(nullptr, copier->_completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                       copier->_ringDescriptor, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == copier->_completionRing)
+        {
+            copier->_completionRing = nullptr;
+            return nullptr;
+        }
+    }
+    copier->_submissionEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+    copier->_submissionEntries = mmap(nullptr, copier->_submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                      copier->_ringDescriptor, IORING_OFF_SQES);
+    if (MAP_FAILED == copier->_submissionEntries)
+    {
+        copier->_submissionEntries = nullptr;
+        return nullptr;
+    }
+
+    auto* submissionBase = static_cast<std::uint8_t*>(copier->_submissionRing);
+    auto* completionBase = static_cast<std::uint8_t*>(copier->_completionRing);
+    copier->_submissionTail = reinterpret_cast<unsigned int*>(submissionBase + params.sq_off.tail);
+    copier->_submissionMask = reinterpret_cast<unsigned int*>(submissionBase + params.sq_off.ring_mask);
+    copier->_submissionArray = reinterpret_cast<unsigned int*>(submissionBase + params.sq_off.array);
+    copier->_completionHead = reinterpret_cast<unsigned int*>(completionBase + params.cq_off.head);
+    copier->_completionTail = reinterpret_cast<unsigned int*>(completionBase + params.cq_off.tail);
+    copier->_completionMask = reinterpret_cast<unsigned int*>(completionBase + params.cq_off.ring_mask);
+    copier->_completionEntries = completionBase + params.cq_off.cqes;
+
+    // Every operation of every chain must fit the submission ring at once, and all their completions the completion ring.
+    copier->_chains = std::min(chains, params.sq_entries / OperationsPerChain);
+    copier->_bufferSize = bufferSize;
+    copier->_bufferStorage.resize((copier->_chains * bufferSize) + BufferAlignment);
+    const std::uintptr_t storageAddress = reinterpret_cast<std::uintptr_t>(copier->_bufferStorage.data());
+    copier->_buffers = copier->_bufferStorage.data() + ((BufferAlignment - (storageAddress % BufferAlignment)) % BufferAlignment);
+
+    std::vector<iovec> bufferVectors(copier->_chains);
+    for (unsigned int i = 0; i < copier->_chains; ++i)
+    {
+        bufferVectors[i].iov_base = copier->_buffers + (static_cast<std::size_t>(i) * bufferSize);
+        bufferVectors[i].iov_len = bufferSize;
+    }
+    // Two empty descriptor slots per chain, filled by its opens and emptied by its closes.
+    const std::vector<int> emptySlots(static_cast<std::size_t>(copier->_chains) * 2, -1);
+    if ((0 == copier->_chains) ||
+        (0 != RegisterWithRing(copier->_ringDescriptor, IORING_REGISTER_BUFFERS, bufferVectors.data(), copier->_chains)) ||
+        (0 != RegisterWithRing(copier->_ringDescriptor, IORING_REGISTER_FILES, emptySlots.data(), static_cast<unsigned int>(emptySlots.size()))))
+    {
+        return nullptr;
+    }
+    return copier;
+#else
+    static_cast<void>(chains);
+    static_cast<void>(bufferSize);
+    return nullptr;
+#endif
+}
+
+UringCopier::~UringCopier()
+{
+#ifdef __linux__
+    if (nullptr != _submissionEntries)
+    {
+        munmap(_submissionEntries, _submissionEntriesSize);
+    }
+    if ((nullptr != _completionRing) && (_completionRing != _submissionRing))
+    {
+        munmap(_completionRing, _completionRingSize);
+    }
+    if (nullptr != _submissionRing)
+    {
+        munmap(_submissionRing, _submissionRingSize);
+    }
+    if (0 <= _ringDescriptor)
+    {
+        close(_ringDescriptor);
+    }
+#endif
+}
+
+bool UringCopier::IsUsable() const
+{
+    return _directDescriptors;
+}
+
+bool UringCopier::CreatesMode(unsigned int mode) const
+{
+    return (0 == (mode & ~PermissionBits)) && (0 == (mode & _umask));
+}
+
+void UringCopier::CopyAll(const std::vector<SmallCopy>& copies, std::vector<bool>& outputCopied)
+{
+    outputCopied.assign(copies.size(), false);
+#ifdef __linux__
+    std::vector<ChainState> chains(_chains);
+    std::vector<std::uint32_t> freeChains;
+    for (std::uint32_t chain = _chains; 0 < chain; --chain)
+    {
+        freeChains.push_back(chain - 1);
+    }
+
+    std::size_t nextCopy = 0;
+    while (true)
+    {
+        // A kernel without direct descriptors fails every open alike, so the rest is left to the caller.
+        while ((true == _directDescriptors) && (copies.size() > nextCopy) && (false == freeChains.empty()))
+        {
+            const std::uint32_t chain = freeChains.back();
+            freeChains.pop_back();
+            const SmallCopy& copy = copies[nextCopy];
+            chains[chain] = ChainState{nextCopy, copy.size, (0 == copy.size) ? 5U : 7U, false, false};
+            QueueChain(chain, copy);
+            ++nextCopy;
+        }
+        if (_chains == freeChains.size())
+        {
+            return;
+        }
+        if (false == Submit(1))
+        {
+            // The ring is unusable; chains already sent still land in buffers this copier owns until it is destroyed.
+            _directDescriptors = false;
+            return;
+        }
+
+        unsigned int head = __atomic_load_n(_completionHead, __ATOMIC_RELAXED);
+        const unsigned int tail = __atomic_load_n(_completionTail, __ATOMIC_ACQUIRE);
+        const auto* completions = static_cast<const io_uring_cqe*>(_completionEntries);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& completion = completions[head & *_completionMask];
+            const std::uint32_t chain = static_cast<std::uint32_t>(completion.user_data >> OperationBits);
+            const std::uint32_t operation = static_cast<std::uint32_t>(completion.user_data & ((1U << OperationBits) - 1));
+            ChainState& state = chains[chain];
+            switch (operation)
+            {
+            case OpenSource:
+            case OpenDestination:
+                _directDescriptors = (true == _directDescriptors) && (-EINVAL != completion.res);
+                state.failed = (true == state.failed) || (0 > completion.res);
+                break;
+            case ReadSource:
+            case WriteDestination:
+                // A linked read or write that moves fewer bytes than asked also cuts the chain.
+                state.failed = (true == state.failed) || (static_cast<std::int64_t>(state.size) != completion.res);
+                break;
+            case CloseSource:
+            case CloseDestination:
+                state.failed = (true == state.failed) || (0 > completion.res);
+                break;
+            default:
+                // A destination that did not exist, and closes of slots a failed chain never filled, are expected.
+                break;
+            }
+            if (0 < --state.remaining)
+            {
+                continue;
+            }
+            if ((true == state.failed) && (false == state.cleaningUp))
+            {
+                // The slots are reused only once whatever the chain left open is closed.
+                state.cleaningUp = true;
+                state.remaining = 2;
+                QueueClose(chain, chain * 2, CleanUpSource, false);
+                QueueClose(chain, (chain * 2) + 1, CleanUpDestination, false);
+                continue;
+            }
+            outputCopied[state.copy] = (false == state.failed);
+            freeChains.push_back(chain);
+        }
+        __atomic_store_n(_completionHead, head, __ATOMIC_RELEASE);
+    }
+#else
+    static_cast<void>(copies);
+#endif
+}
+
+/**
+ * @brief Submit queued entries and optionally wait for completions.
+ *
+ * @param[in] minimumCompletions Completions to wait for, 0 returns immediately
+ * @return true on success, false if the kernel rejected the call
+ */
+bool UringCopier::Submit(unsigned int minimumCompletions)
+{
+#ifdef __linux__
+    const unsigned int flags = (0 < minimumCompletions) ? IORING_ENTER_GETEVENTS : 0;
+    while (true)
+    {
+        const int submitted = EnterRing(_ringDescriptor, _pendingSubmissions, minimumCompletions, flags);
+        if (0 <= submitted)
+        {
+            _pendingSubmissions -= std::min(_pendingSubmissions, static_cast<unsigned int>(submitted));
+            return true;
+        }
+        if (EINTR != errno)
+        {
+            return false;
+        }
+    }
+#else
+    static_cast<void>(minimumCompletions);
+    return false;
+#endif
+}
+
+/**
+ * @brief Queue the linked operations of one copy; they are sent with the next Submit.
+ *
+ * The unlink is hard-linked to the rest, so a destination that did not exist does not cut the chain.
+ * Descriptor slots are 2 * chain for the source and 2 * chain + 1 for the destination.
+ *
+ * @param[in] chain Chain slot, whose buffer and descriptor slots the copy uses
+ * @param[in] copy Copy to run
+ */
+void UringCopier::QueueChain(std::uint32_t chain, const SmallCopy& copy)
+{
+#ifdef __linux__
+    const std::uint32_t sourceSlot = chain * 2;
+    const std::uint32_t destinationSlot = sourceSlot + 1;
+    std::uint8_t* buffer = _buffers + (static_cast<std::size_t>(chain) * _bufferSize);
+    auto nextEntry = [&](std::uint32_t operation, std::uint8_t opcode, std::uint8_t flags)
+    {
+        const unsigned int tail = *_submissionTail;
+        const unsigned int index = tail & *_submissionMask;
+        auto* entry = static_cast<io_uring_sqe*>(_submissionEntries) + index;
+        std::memset(entry, 0, sizeof(*entry));
+        entry->opcode = opcode;
+        entry->flags = flags;
+        entry->user_data = (static_cast<std::uint64_t>(chain) << OperationBits) | operation;
+        _submissionArray[index] = index;
+        __atomic_store_n(_submissionTail, tail + 1, __ATOMIC_RELEASE);
+        ++_pendingSubmissions;
+        return entry;
+    };
+
+    io_uring_sqe* entry = nextEntry(UnlinkDestination, IORING_OP_UNLINKAT, IOSQE_IO_HARDLINK);
+    entry->fd = AT_FDCWD;
+    entry->addr = reinterpret_cast<std::uint64_t>(copy.destinationPath->c_str());
+
+    // Opens into a descriptor slot take no O_CLOEXEC; the slot is never visible to a child process anyway.
+    entry = nextEntry(OpenSource, IORING_OP_OPENAT, IOSQE_IO_LINK);
+    entry->fd = AT_FDCWD;
+    entry->addr = reinterpret_cast<std::uint64_t>(copy.sourcePath->c_str());
+    entry->open_flags = O_RDONLY | ((true == copy.noAccessTime) ? O_NOATIME : 0);
+    entry->file_index = sourceSlot + 1;
+
+    if (0 < copy.size)
+    {
+        entry = nextEntry(ReadSource, IORING_OP_READ_FIXED, IOSQE_IO_LINK | IOSQE_FIXED_FILE);
+        entry->fd = static_cast<std::int32_t>(sourceSlot);
+        entry->addr = reinterpret_cast<std::uint64_t>(buffer);
+        entry->len = copy.size;
+        entry->buf_index = static_cast<std::uint16_t>(chain);
+    }
+
+    entry = nextEntry(OpenDestination, IORING_OP_OPENAT, IOSQE_IO_LINK);
+    entry->fd = AT_FDCWD;
+    entry->addr = reinterpret_cast<std::uint64_t>(copy.destinationPath->c_str());
+    entry->open_flags = O_WRONLY | O_CREAT | O_EXCL;
+    entry->len = copy.mode & PermissionBits;
+    entry->file_index = destinationSlot + 1;
+
+    if (0 < copy.size)
+    {
+        entry = nextEntry(WriteDestination, IORING_OP_WRITE_FIXED, IOSQE_IO_LINK | IOSQE_FIXED_FILE);
+        entry->fd = static_cast<std::int32_t>(destinationSlot);
+        entry->addr = reinterpret_cast<std::uint64_t>(buffer);
+        entry->len = copy.size;
+        entry->buf_index = static_cast<std::uint16_t>(chain);
+    }
+
+    QueueClose(chain, sourceSlot, CloseSource, true);
+    QueueClose(chain, destinationSlot, CloseDestination, false);
+#else
+    static_cast<void>(chain);
+    static_cast<void>(copy);
+#endif
+}
+
+/**
+ * @brief Queue the close of a descriptor slot; it is sent with the next Submit.
+ *
+ * @param[in] chain Chain slot the close belongs to
+ * @param[in] fileSlot Descriptor slot to empty
+ * @param[in] operation Operation reported with the completion
+ * @param[in] link Link the next entry queued to this one
+ */
+void UringCopier::QueueClose(std::uint32_t chain, std::uint32_t fileSlot, std::uint32_t operation, bool link)
+{
+#ifdef __linux__
+    const unsigned int tail = *_submissionTail;
+    const unsigned int index = tail & *_submissionMask;
+    auto* entry = static_cast<io_uring_sqe*>(_submissionEntries) + index;
+    std::memset(entry, 0, sizeof(*entry));
+    entry->opcode = IORING_OP_CLOSE;
+    entry->flags = (true == link) ? IOSQE_IO_LINK : 0;
+    entry->file_index = fileSlot + 1;
+    entry->user_data = (static_cast<std::uint64_t>(chain) << OperationBits) | operation;
+    _submissionArray[index] = index;
+    __atomic_store_n(_submissionTail, tail + 1, __ATOMIC_RELEASE);
+    ++_pendingSubmissions;
+#else
+    static_cast<void>(chain);
+    static_cast<void>(fileSlot);
+    static_cast<void>(operation);
+    static_cast<void>(link);
+#endif
+}
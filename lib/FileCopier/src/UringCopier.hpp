@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Copies small files through one io_uring, each copy submitted as one linked chain of operations.
+ *
+ * A chain unlinks the destination, opens the source into a direct descriptor, reads the whole file into a
+ * registered buffer, creates the destination into another direct descriptor, writes the buffer and closes
+ * both descriptors: seven operations that need no system call of their own. Many chains are in flight at
+ * once, each with its own buffer and pair of descriptor slots, and the thread only enters the kernel to
+ * submit them and wait. A chain that fails anywhere is cut short by the kernel; its descriptors are closed
+ * and the copy is reported as not done, for the caller to repeat another way. A copier belongs to one thread.
+ * Only Linux has io_uring; elsewhere Create always fails.
+ */
+class UringCopier
+{
+  public:
+    /**
+     * @brief One copy handed to CopyAll.
+     */
+    struct SmallCopy
+    {
+        const std::filesystem::path* sourcePath;      /**< File to copy */
+        const std::filesystem::path* destinationPath; /**< File to create or replace */
+        std::uint32_t size;                           /**< Size of the source at most the buffer size */
+        unsigned int mode;                            /**< Permission bits the destination is created with */
+        bool noAccessTime;                            /**< Open the source without updating its access time */
+    };
+
+    /**
+     * @brief Set up a ring with its buffers and descriptor slots.
+     *
+     * @param[in] chains Copies kept in flight
+     * @param[in] bufferSize Bytes per buffer, the largest file copied
+     * @return Copier, or nullptr when io_uring is unavailable or refused (old kernel, seccomp, memory limits)
+     */
+    static std::unique_ptr<UringCopier> Create(unsigned int chains, std::size_t bufferSize);
+
+    ~UringCopier();
+
+    UringCopier(const UringCopier&) = delete;
+    UringCopier& operator=(const UringCopier&) = delete;
+
+    /**
+     * @brief Check whether chains can still run, which stops once the kernel refuses an open into a descriptor slot.
+     *
+     * @return true while copies are worth handing to CopyAll
+     */
+    bool IsUsable() const;
+
+    /**
+     * @brief Check whether a chain creates a file with exactly the given permissions.
+     *
+     * The destination is created with its final mode, which the umask would clear bits of and which cannot
+     * carry the set-user-ID, set-group-ID or sticky bits.
+     *
+     * @param[in] mode Permission bits of the source
+     * @return true if a chain reproduces them
+     */
+    bool CreatesMode(unsigned int mode) const;
+
+    /**
+     * @brief Copy the files, keeping up to the chain count in flight.
+     *
+     * @param[in] copies Files to copy, each no larger than the buffer size
+     * @param[out] outputCopied Whether each copy completed, in the order of copies
+     */
+    void CopyAll(const std::vector<SmallCopy>& copies, std::vector<bool>& outputCopied);
+
+  private:
+    UringCopier() = default;
+
+    bool Submit(unsigned int minimumCompletions);
+    void QueueChain(std::uint32_t chain, const SmallCopy& copy);
+    void QueueClose(std::uint32_t chain, std::uint32_t fileSlot, std::uint32_t operation, bool link);
+
+    int _ringDescriptor = -1;
+    void* _submissionRing = nullptr;
+    std::size_t _submissionRingSize = 0;
+    void* _completionRing = nullptr;
+    std::size_t _completionRingSize = 0;
+    void* _submissionEntries = nullptr;
+    std::size_t _submissionEntriesSize = 0;
+
+    unsigned int* _submissionTail = nullptr;
+    unsigned int* _submissionMask = nullptr;
+    unsigned int* _submissionArray = nullptr;
+    unsigned int* _completionHead = nullptr;
+    unsigned int* _completionTail = nullptr;
+    unsigned int* _completionMask = nullptr;
+    void* _completionEntries = nullptr;
+
+    unsigned int _chains = 0;
+    std::size_t _bufferSize = 0;
+    unsigned int _umask = 0;
+    bool _directDescriptors = true; /**< Cleared once the kernel refuses an open into a descriptor slot */
+    unsigned int _pendingSubmissions = 0;
+    std::vector<std::uint8_t> _bufferStorage;
+    std::uint8_t* _buffers = nullptr;
+};
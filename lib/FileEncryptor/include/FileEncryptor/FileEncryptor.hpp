@@ -0,0 +1,237 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Authenticated cipher protecting encrypted files.
+ */
+enum class EncryptionAlgorithm
+{
+    Auto,            /**< AES-256-GCM where the CPU has AES instructions, ChaCha20-Poly1305 otherwise */
+    Aes256Gcm,       /**< AES-256 in Galois/counter mode */
+    ChaCha20Poly1305 /**< ChaCha20 stream cipher with a Poly1305 authenticator */
+};
+
+/**
+ * @brief Infrastructure component encrypting files with an authenticated cipher and decrypting them back.
+ *
+ * An encrypted file is a header followed by the content cut into segments of SegmentSize bytes, each
+ * sealed on its own with a nonce derived from a random per-file nonce and the segment number. The header
+ * and whether a segment is the last one are authenticated with every segment, so a file that was
+ * modified, reordered, truncated or extended fails to decrypt. Files are streamed, so memory use does
+ * not depend on file size. Encryption is optional at build time, see IsAvailable.
+ */
+class FileEncryptor
+{
+  public:
+    /**
+     * @brief Size in bytes of a key.
+     */
+    static constexpr std::size_t KeySize = 32;
+
+    /**
+     * @brief Content bytes per sealed segment.
+     */
+    static constexpr std::size_t SegmentSize = 64 * 1024;
+
+    /**
+     * @brief Size in bytes of the authentication tag following each segment.
+     */
+    static constexpr std::size_t TagSize = 16;
+
+    /**
+     * @brief Size in bytes of the header of an encrypted file.
+     */
+    static constexpr std::size_t HeaderSize = 24;
+
+    using Key = std::array<std::uint8_t, KeySize>;
+
+    /**
+     * @brief Streams content into a new encrypted file.
+     */
+    class Writer
+    {
+      public:
+        /**
+         * @brief Create or truncate the file and write its header.
+         *
+         * @param[in] encryptor Key and algorithm to encrypt with; must outlive the writer
+         * @param[in] encryptedPath File to write
+         */
+        Writer(const FileEncryptor& encryptor, const std::filesystem::path& encryptedPath);
+
+        ~Writer();
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        /**
+         * @brief Check whether the file was created and the cipher set up.
+         *
+         * @return true if content can be written
+         */
+        bool IsOpen() const;
+
+        /**
+         * @brief Encrypt and append content.
+         *
+         * @param[in] data Content bytes
+         * @param[in] length Number of bytes
+         * @return true on success, false on error
+         */
+        bool Write(const void* data, std::size_t length);
+
+        /**
+         * @brief Seal the last segment and close the file; without it the file does not decrypt.
+         *
+         * @return true on success, false on error
+         */
+        bool Finish();
+
+      private:
+        struct Cipher;
+
+        bool Seal(bool last);
+
+        std::unique_ptr<Cipher> _cipher;
+        std::ofstream _stream;
+        std::array<std::uint8_t, HeaderSize> _header;
+        std::vector<std::uint8_t> _segment;
+        std::vector<std::uint8_t> _sealed;
+        std::size_t _segmentFill;
+        std::uint64_t _segmentIndex;
+    };
+
+    /**
+     * @brief Streams the content of an encrypted file, authenticating each segment before handing it out.
+     */
+    class Reader
+    {
+      public:
+        /**
+         * @brief Open the file and read its header.
+         *
+         * @param[in] encryptor Key to decrypt with; must outlive the reader
+         * @param[in] encryptedPath File written by a Writer
+         */
+        Reader(const FileEncryptor& encryptor, const std::filesystem::path& encryptedPath);
+
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        /**
+         * @brief Check whether the file was opened and has a valid header.
+         *
+         * @return true if content can be read
+         */
+        bool IsOpen() const;
+
+        /**
+         * @brief Read decrypted content.
+         *
+         * @param[out] buffer Buffer to fill
+         * @param[in] capacity Size of the buffer in bytes
+         * @param[out] outputBytesRead Bytes written to the buffer, 0 at the end of the content
+         * @return true on success, false on error or when a segment fails authentication
+         */
+        bool Read(void* buffer, std::size_t capacity, std::size_t& outputBytesRead);
+
+      private:
+        struct Cipher;
+
+        bool Open(const std::filesystem::path& encryptedPath);
+        bool Unseal();
+
+        std::unique_ptr<Cipher> _cipher;
+        std::ifstream _stream;
+        std::array<std::uint8_t, HeaderSize> _header;
+        std::vector<std::uint8_t> _segment;
+        std::vector<std::uint8_t> _sealed;
+        std::size_t _segmentSize;
+        std::size_t _segmentFill;
+        std::size_t _segmentOffset;
+        std::uint64_t _segmentIndex;
+        std::uint64_t _segmentCount;
+    };
+
+    /**
+     * @brief Construct an encryptor for a key.
+     *
+     * @param[in] key Key files are encrypted and decrypted with
+     * @param[in] algorithm Cipher new files are encrypted with; Decrypt takes it from the file
+     */
+    explicit FileEncryptor(const Key& key, EncryptionAlgorithm algorithm = EncryptionAlgorithm::Auto);
+
+    ~FileEncryptor();
+
+    FileEncryptor(const FileEncryptor&) = delete;
+    FileEncryptor& operator=(const FileEncryptor&) = delete;
+
+    /**
+     * @brief Check whether this build can encrypt.
+     *
+     * @return true if OpenSSL was found when building, false otherwise
+     */
+    static bool IsAvailable();
+
+    /**
+     * @brief Check whether the CPU has AES instructions, which makes AES-256-GCM the faster cipher.
+     *
+     * @return true on x86 with AES-NI and on ARM with the cryptography extension, false otherwise
+     */
+    static bool HasAesInstructions();
+
+    /**
+     * @brief Read a key file: exactly KeySize raw bytes, or 2 * KeySize hex digits optionally followed by whitespace.
+     *
+     * @param[in] keyFile File holding the key
+     * @param[out] outputKey Key read from the file
+     * @return true on success, false if the file is unreadable or not a key
+     */
+    static bool LoadKey(const std::filesystem::path& keyFile, Key& outputKey);
+
+    /**
+     * @brief Check whether a file starts with the header of an encrypted file.
+     *
+     * @param[in] filePath File to check
+     * @return true if the file looks encrypted, false otherwise or when it cannot be read
+     */
+    static bool IsEncrypted(const std::filesystem::path& filePath);
+
+    /**
+     * @brief Get the cipher new files are encrypted with.
+     *
+     * @return Aes256Gcm or ChaCha20Poly1305, never Auto
+     */
+    EncryptionAlgorithm Algorithm() const;
+
+    /**
+     * @brief Encrypt a file into a new file.
+     *
+     * @param[in] sourcePath File to encrypt
+     * @param[in] encryptedPath File to create or replace; removed again on failure
+     * @return true on success, false on error or when unavailable
+     */
+    bool Encrypt(const std::filesystem::path& sourcePath, const std::filesystem::path& encryptedPath) const;
+
+    /**
+     * @brief Decrypt a file written by Encrypt or a Writer.
+     *
+     * @param[in] encryptedPath Encrypted file
+     * @param[in] outputPath File to create or replace; removed again on failure
+     * @return true on success, false on error, a wrong key, tampered input or when unavailable
+     */
+    bool Decrypt(const std::filesystem::path& encryptedPath, const std::filesystem::path& outputPath) const;
+
+  private:
+    Key _key;
+    EncryptionAlgorithm _algorithm;
+};
@@ -0,0 +1,543 @@
+#include "FileEncryptor/FileEncryptor.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <system_error>
+
+#ifdef RDEMO_HAVE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__aarch64__) && defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+namespace
+{
+constexpr std::uint8_t FileMagic[4] = {'R', 'D', 'E', 'C'};
+constexpr std::uint8_t FileVersion = 1;
+constexpr std::uint8_t Aes256GcmId = 1;
+constexpr std::uint8_t ChaCha20Poly1305Id = 2;
+constexpr std::size_t NonceSize = 12;
+constexpr std::size_t NonceOffset = FileEncryptor::HeaderSize - NonceSize;
+constexpr std::size_t SegmentSizeOffset = 8;
+constexpr std::size_t MaximumSegmentSize = 16 * 1024 * 1024;
+constexpr std::size_t CopyBufferSize = 1024 * 1024;
+
+/**
+ * @brief Parse one hex digit.
+ *
+ * @param[in] digit Character to parse
+ * @param[out] outputValue Value of the digit
+ * @return true for 0-9, a-f and A-F, false otherwise
+ */
+bool ParseHexDigit(char digit, std::uint8_t& outputValue)
+{
+    if (('0' <= digit) && ('9' >= digit))
+    {
+        outputValue = static_cast<std::uint8_t>(digit - '0');
+        return true;
+    }
+    if (('a' <= digit) && ('f' >= digit))
+    {
+        outputValue = static_cast<std::uint8_t>(digit - 'a' + 10);
+        return true;
+    }
+    if (('A' <= digit) && ('F' >= digit))
+    {
+        outputValue = static_cast<std::uint8_t>(digit - 'A' + 10);
+        return true;
+    }
+    return false;
+}
+
+#ifdef RDEMO_HAVE_OPENSSL
+/**
+ * @brief Get the OpenSSL cipher for an algorithm id stored in a header.
+ *
+ * @param[in] algorithmId Aes256GcmId or ChaCha20Poly1305Id
+ * @return Cipher, nullptr for an unknown id
+ */
+const EVP_CIPHER* CipherFor(std::uint8_t algorithmId)
+{
+    switch (algorithmId)
+    {
+    case Aes256GcmId:
+        return EVP_aes_256_gcm();
+    case ChaCha20Poly1305Id:
+        return EVP_chacha20_poly1305();
+    default:
+        return nullptr;
+    }
+}
+
+/**
+ * @brief Derive the nonce of a segment from the file nonce in the header.
+ *
+ * @param[in] header Header of the file
+ * @param[in] segmentIndex Number of the segment, from 0
+ * @param[out] outputNonce Nonce of the segment
+ */
+void SegmentNonce(const std::array<std::uint8_t, FileEncryptor::HeaderSize>& header, std::uint64_t segmentIndex,
+                  std::array<std::uint8_t, NonceSize>& outputNonce)
+{
+    std::copy(header.begin() + NonceOffset, header.end(), outputNonce.begin());
+    for (std::size_t byte = 0; byte < sizeof(segmentIndex); ++byte)
+    {
+        outputNonce[NonceSize - sizeof(segmentIndex) + byte] ^= static_cast<std::uint8_t>(segmentIndex >> (8 * byte));
+    }
+}
+#endif
+
+/**
+ * @brief Remove a partially written output file.
+ *
+ * @param[in] outputPath File to remove
+ * @return Always false, for use as the error result
+ */
+bool DiscardOutput(const std::filesystem::path& outputPath)
+{
+    std::error_code errorCode;
+    std::filesystem::remove(outputPath, errorCode);
+    return false;
+}
+}
+
+/**
+ * @brief OpenSSL cipher context of a writer or reader, empty without OpenSSL.
+ */
+struct FileEncryptor::Writer::Cipher
+{
+#ifdef RDEMO_HAVE_OPENSSL
+    ~Cipher()
+    {
+        EVP_CIPHER_CTX_free(context);
+    }
+
+    EVP_CIPHER_CTX* context = nullptr;
+#endif
+};
+
+struct FileEncryptor::Reader::Cipher
+{
+#ifdef RDEMO_HAVE_OPENSSL
+    ~Cipher()
+    {
+        EVP_CIPHER_CTX_free(context);
+    }
+
+    EVP_CIPHER_CTX* context = nullptr;
+#endif
+};
+
+FileEncryptor::Writer::Writer(const FileEncryptor& encryptor, const std::filesystem::path& encryptedPath)
+    : _cipher(std::make_unique<Cipher>()), _header{}, _segmentFill(0), _segmentIndex(0)
+{
+#ifdef RDEMO_HAVE_OPENSSL
+    const std::uint8_t algorithmId = (EncryptionAlgorithm::Aes256Gcm == encryptor.Algorithm()) ? Aes256GcmId : ChaCha20Poly1305Id;
+    std::copy(std::begin(FileMagic), std::end(FileMagic), _header.begin());
+    _header[sizeof(FileMagic)] = FileVersion;
+    _header[sizeof(FileMagic) + 1] = algorithmId;
+    for (std::size_t byte = 0; byte < sizeof(std::uint32_t); ++byte)
+    {
+        _header[SegmentSizeOffset + byte] = static_cast<std::uint8_t>(SegmentSize >> (8 * byte));
+    }
+    _cipher->context = EVP_CIPHER_CTX_new();
+    if ((nullptr == _cipher->context) || (1 != RAND_bytes(_header.data() + NonceOffset, static_cast<int>(NonceSize))) ||
+        (1 != EVP_EncryptInit_ex(_cipher->context, CipherFor(algorithmId), nullptr, encryptor._key.data(), nullptr)))
+    {
+        EVP_CIPHER_CTX_free(_cipher->context);
+        _cipher->context = nullptr;
+        return;
+    }
+    _segment.resize(SegmentSize);
+    _sealed.resize(SegmentSize + TagSize);
+    _stream.open(encryptedPath, std::ios::binary | std::ios::trunc);
+    _stream.write(reinterpret_cast<const char*>(_header.data()), static_cast<std::streamsize>(_header.size()));
+#else
+    static_cast<void>(encryptor);
+    static_cast<void>(encryptedPath);
+#endif
+}
+
+FileEncryptor::Writer::~Writer() = default;
+
+bool FileEncryptor::Writer::IsOpen() const
+{
+#ifdef RDEMO_HAVE_OPENSSL
+    return (nullptr != _cipher->context) && (true == _stream.good());
+#else
+    return false;
+#endif
+}
+
+bool FileEncryptor::Writer::Write(const void* data, std::size_t length)
+{
+    if (false == IsOpen())
+    {
+        return false;
+    }
+    const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+    while (0 < length)
+    {
+        // A full segment is only sealed once more content follows, since the last one is sealed differently.
+        if (SegmentSize == _segmentFill)
+        {
+            if (false == Seal(false))
+            {
+                return false;
+            }
+        }
+        const std::size_t count = std::min(SegmentSize - _segmentFill, length);
+        std::memcpy(_segment.data() + _segmentFill, bytes, count);
+        _segmentFill += count;
+        bytes += count;
+        length -= count;
+    }
+    return true;
+}
+
+bool FileEncryptor::Writer::Finish()
+{
+    if ((false == IsOpen()) || (false == Seal(true)))
+    {
+        return false;
+    }
+    _stream.close();
+    return false == _stream.fail();
+}
+
+/**
+ * @brief Encrypt the buffered segment and append it with its tag.
+ *
+ * @param[in] last The segment ends the content
+ * @return true on success, false on error
+ */
+bool FileEncryptor::Writer::Seal(bool last)
+{
+#ifdef RDEMO_HAVE_OPENSSL
+    std::array<std::uint8_t, NonceSize> nonce{};
+    SegmentNonce(_header, _segmentIndex, nonce);
+    const std::uint8_t lastFlag = (true == last) ? 1 : 0;
+    int length = 0;
+    int finalLength = 0;
+    if ((1 != EVP_EncryptInit_ex(_cipher->context, nullptr, nullptr, nullptr, nonce.data())) ||
+        (1 != EVP_EncryptUpdate(_cipher->context, nullptr, &length, _header.data(), static_cast<int>(_header.size()))) ||
+        (1 != EVP_EncryptUpdate(_cipher->context, nullptr, &length, &lastFlag, 1)) ||
+        (1 != EVP_EncryptUpdate(_cipher->context, _sealed.data(), &length, _segment.data(), static_cast<int>(_segmentFill))) ||
+        (1 != EVP_EncryptFinal_ex(_cipher->context, _sealed.data() + length, &finalLength)) ||
+        (1 != EVP_CIPHER_CTX_ctrl(_cipher->context, EVP_CTRL_AEAD_GET_TAG, static_cast<int>(TagSize), _sealed.data() + _segmentFill)))
+    {
+        return false;
+    }
+    _stream.write(reinterpret_cast<const char*>(_sealed.data()), static_cast<std::streamsize>(_segmentFill + TagSize));
+    _segmentFill = 0;
+    ++_segmentIndex;
+    return true == _stream.good();
+#else
+    static_cast<void>(last);
+    return false;
+#endif
+}
+
+FileEncryptor::Reader::Reader(const FileEncryptor& encryptor, const std::filesystem::path& encryptedPath)
+    : _cipher(std::make_unique<Cipher>()), _header{}, _segmentSize(0), _segmentFill(0), _segmentOffset(0), _segmentIndex(0), _segmentCount(0)
+{
+#ifdef RDEMO_HAVE_OPENSSL
+    if (false == Open(encryptedPath))
+    {
+        return;
+    }
+    _cipher->context = EVP_CIPHER_CTX_new();
+    if ((nullptr == _cipher->context) ||
+        (1 != EVP_DecryptInit_ex(_cipher->context, CipherFor(_header[sizeof(FileMagic) + 1]), nullptr, encryptor._key.data(), nullptr)))
+    {
+        EVP_CIPHER_CTX_free(_cipher->context);
+        _cipher->context = nullptr;
+    }
+#else
+    static_cast<void>(encryptor);
+    static_cast<void>(encryptedPath);
+#endif
+}
+
+FileEncryptor::Reader::~Reader() = default;
+
+bool FileEncryptor::Reader::IsOpen() const
+{
+#ifdef RDEMO_HAVE_OPENSSL
+    return (nullptr != _cipher->context) && (true == _stream.good());
+#else
+    return false;
+#endif
+}
+
+bool FileEncryptor::Reader::Read(void* buffer, std::size_t capacity, std::size_t& outputBytesRead)
+{
+    outputBytesRead = 0;
+    if (false == IsOpen())
+    {
+        return false;
+    }
+    std::uint8_t* bytes = static_cast<std::uint8_t*>(buffer);
+    while (outputBytesRead < capacity)
+    {
+        if (_segmentOffset == _segmentFill)
+        {
+            if (_segmentIndex == _segmentCount)
+            {
+                break;
+            }
+            if (false == Unseal())
+            {
+                return false;
+            }
+            continue;
+        }
+        const std::size_t count = std::min(_segmentFill - _segmentOffset, capacity - outputBytesRead);
+        std::memcpy(bytes + outputBytesRead, _segment.data() + _segmentOffset, count);
+        _segmentOffset += count;
+        outputBytesRead += count;
+    }
+    return true;
+}
+
+/**
+ * @brief Open the file, check its header and derive the number of segments from its size.
+ *
+ * @param[in] encryptedPath Encrypted file
+ * @return true if the header is valid and the size fits whole segments, false otherwise
+ */
+bool FileEncryptor::Reader::Open(const std::filesystem::path& encryptedPath)
+{
+    std::error_code errorCode;
+    const std::uintmax_t fileSize = std::filesystem::file_size(encryptedPath, errorCode);
+    if ((0 != errorCode.value()) || (HeaderSize + TagSize > fileSize))
+    {
+        return false;
+    }
+    _stream.open(encryptedPath, std::ios::binary);
+    _stream.read(reinterpret_cast<char*>(_header.data()), static_cast<std::streamsize>(_header.size()));
+    if ((false == _stream.good()) || (false == std::equal(std::begin(FileMagic), std::end(FileMagic), _header.begin())) ||
+        (FileVersion != _header[sizeof(FileMagic)]))
+    {
+        return false;
+    }
+    for (std::size_t byte = 0; byte < sizeof(std::uint32_t); ++byte)
+    {
+        _segmentSize |= static_cast<std::size_t>(_header[SegmentSizeOffset + byte]) << (8 * byte);
+    }
+    if ((0 == _segmentSize) || (MaximumSegmentSize < _segmentSize))
+    {
+        return false;
+    }
+    const std::uintmax_t sealedSize = _segmentSize + TagSize;
+    const std::uintmax_t bodySize = fileSize - HeaderSize;
+    _segmentCount = static_cast<std::uint64_t>((bodySize + sealedSize - 1) / sealedSize);
+    if (TagSize > bodySize - ((_segmentCount - 1) * sealedSize))
+    {
+        return false;
+    }
+    _segment.resize(_segmentSize);
+    _sealed.resize(sealedSize);
+    return true;
+}
+
+/**
+ * @brief Read, authenticate and decrypt the next segment.
+ *
+ * @return true on success, false on a read error or when the segment fails authentication
+ */
+bool FileEncryptor::Reader::Unseal()
+{
+#ifdef RDEMO_HAVE_OPENSSL
+    const bool last = (_segmentIndex + 1 == _segmentCount);
+    std::size_t sealedSize = _sealed.size();
+    if (true == last)
+    {
+        _stream.read(reinterpret_cast<char*>(_sealed.data()), static_cast<std::streamsize>(_sealed.size()));
+        sealedSize = static_cast<std::size_t>(_stream.gcount());
+        _stream.clear();
+    }
+    else
+    {
+        _stream.read(reinterpret_cast<char*>(_sealed.data()), static_cast<std::streamsize>(sealedSize));
+    }
+    if ((false == _stream.good()) || (TagSize > sealedSize))
+    {
+        return false;
+    }
+
+    const std::size_t contentSize = sealedSize - TagSize;
+    std::array<std::uint8_t, NonceSize> nonce{};
+    SegmentNonce(_header, _segmentIndex, nonce);
+    const std::uint8_t lastFlag = (true == last) ? 1 : 0;
+    int length = 0;
+    int finalLength = 0;
+    if ((1 != EVP_DecryptInit_ex(_cipher->context, nullptr, nullptr, nullptr, nonce.data())) ||
+        (1 != EVP_DecryptUpdate(_cipher->context, nullptr, &length, _header.data(), static_cast<int>(_header.size()))) ||
+        (1 != EVP_DecryptUpdate(_cipher->context, nullptr, &length, &lastFlag, 1)) ||
+        (1 != EVP_DecryptUpdate(_cipher->context, _segment.data(), &length, _sealed.data(), static_cast<int>(contentSize))) ||
+        (1 != EVP_CIPHER_CTX_ctrl(_cipher->context, EVP_CTRL_AEAD_SET_TAG, static_cast<int>(TagSize), _sealed.data() + contentSize)) ||
+        (1 != EVP_DecryptFinal_ex(_cipher->context, _segment.data() + length, &finalLength)))
+    {
+        return false;
+    }
+    _segmentFill = contentSize;
+    _segmentOffset = 0;
+    ++_segmentIndex;
+    return true;
+#else
+    return false;
+#endif
+}
+
+FileEncryptor::FileEncryptor(const Key& key, EncryptionAlgorithm algorithm) : _key(key), _algorithm(algorithm)
+{
+    if (EncryptionAlgorithm::Auto == _algorithm)
+    {
+        _algorithm = (true == HasAesInstructions()) ? EncryptionAlgorithm::Aes256Gcm : EncryptionAlgorithm::ChaCha20Poly1305;
+    }
+}
+
+FileEncryptor::~FileEncryptor()
+{
+    std::fill(_key.begin(), _key.end(), static_cast<std::uint8_t>(0));
+}
+
+bool FileEncryptor::IsAvailable()
+{
+#ifdef RDEMO_HAVE_OPENSSL
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool FileEncryptor::HasAesInstructions()
+{
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+    return 0 != __builtin_cpu_supports("aes");
+#elif (defined(_M_X64) || defined(_M_IX86)) && defined(_MSC_VER)
+    int registers[4] = {};
+    __cpuid(registers, 1);
+    return 0 != (registers[2] & (1 << 25));
+#elif defined(__aarch64__) && defined(__linux__)
+    return 0 != (getauxval(AT_HWCAP) & HWCAP_AES);
+#elif defined(__aarch64__) && defined(__APPLE__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool FileEncryptor::LoadKey(const std::filesystem::path& keyFile, Key& outputKey)
+{
+    std::ifstream stream(keyFile, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    if ((false == stream.is_open()) || (true == stream.bad()))
+    {
+        return false;
+    }
+    if (KeySize == content.size())
+    {
+        std::copy(content.begin(), content.end(), outputKey.begin());
+        return true;
+    }
+
+    const std::string::size_type end = content.find_last_not_of(" \t\r\n");
+    content.erase((std::string::npos == end) ? 0 : end + 1);
+    if (2 * KeySize != content.size())
+    {
+        return false;
+    }
+    for (std::size_t index = 0; index < KeySize; ++index)
+    {
+        std::uint8_t high = 0;
+        std::uint8_t low = 0;
+        if ((false == ParseHexDigit(content[2 * index], high)) || (false == ParseHexDigit(content[(2 * index) + 1], low)))
+        {
+            return false;
+        }
+        outputKey[index] = static_cast<std::uint8_t>((high << 4) | low);
+    }
+    return true;
+}
+
+bool FileEncryptor::IsEncrypted(const std::filesystem::path& filePath)
+{
+    std::ifstream stream(filePath, std::ios::binary);
+    std::uint8_t prefix[sizeof(FileMagic) + 1] = {};
+    stream.read(reinterpret_cast<char*>(prefix), sizeof(prefix));
+    return (true == stream.good()) && (true == std::equal(std::begin(FileMagic), std::end(FileMagic), prefix)) &&
+           (FileVersion == prefix[sizeof(FileMagic)]);
+}
+
+EncryptionAlgorithm FileEncryptor::Algorithm() const
+{
+    return _algorithm;
+}
+
+bool FileEncryptor::Encrypt(const std::filesystem::path& sourcePath, const std::filesystem::path& encryptedPath) const
+{
+    std::ifstream sourceStream(sourcePath, std::ios::binary);
+    if (false == sourceStream.is_open())
+    {
+        return false;
+    }
+    Writer writer(*this, encryptedPath);
+    if (false == writer.IsOpen())
+    {
+        return DiscardOutput(encryptedPath);
+    }
+    std::vector<char> buffer(CopyBufferSize);
+    while (true)
+    {
+        sourceStream.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        const std::size_t bytesRead = static_cast<std::size_t>(sourceStream.gcount());
+        if ((true == sourceStream.bad()) || (false == writer.Write(buffer.data(), bytesRead)))
+        {
+            return DiscardOutput(encryptedPath);
+        }
+        if (true == sourceStream.eof())
+        {
+            break;
+        }
+    }
+    return (true == writer.Finish()) || (true == DiscardOutput(encryptedPath));
+}
+
+bool FileEncryptor::Decrypt(const std::filesystem::path& encryptedPath, const std::filesystem::path& outputPath) const
+{
+    Reader reader(*this, encryptedPath);
+    if (false == reader.IsOpen())
+    {
+        return false;
+    }
+    std::ofstream outputStream(outputPath, std::ios::binary | std::ios::trunc);
+    std::vector<char> buffer(CopyBufferSize);
+    while (true == outputStream.good())
+    {
+        std::size_t bytesRead = 0;
+        if (false == reader.Read(buffer.data(), buffer.size(), bytesRead))
+        {
+            outputStream.close();
+            return DiscardOutput(outputPath);
+        }
+        if (0 == bytesRead)
+        {
+            outputStream.close();
+            return (false == outputStream.fail()) || (true == DiscardOutput(outputPath));
+        }
+        outputStream.write(buffer.data(), static_cast<std::streamsize>(bytesRead));
+    }
+    outputStream.close();
+    return DiscardOutput(outputPath);
+}
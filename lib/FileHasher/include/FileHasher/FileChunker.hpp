@@ -0,0 +1,92 @@
+#pragma once
+
+#include "FileHasher/FileHasher.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+/**
+ * @brief One content-defined chunk of a file.
+ */
+struct FileChunk
+{
+    std::uint64_t offset; /**< Position of the chunk in the file */
+    std::uint32_t length; /**< Chunk length in bytes */
+    HashDigest digest;    /**< XXH3_128 digest of the chunk content */
+};
+
+/**
+ * @brief Chunk size limits for content-defined chunking.
+ */
+struct FileChunkerOptions
+{
+    static constexpr std::uint32_t DefaultAverageSize = 64 * 1024; /**< Default target chunk size */
+
+    std::uint32_t averageSize = DefaultAverageSize; /**< Target chunk size, rounded down to a power of two */
+    std::uint32_t minimumSize = 0;                  /**< Smallest chunk except at end of file, 0 uses averageSize / 4 */
+    std::uint32_t maximumSize = 0;                  /**< Largest chunk, 0 uses averageSize * 4 */
+};
+
+/**
+ * @brief Infrastructure component splitting files into content-defined chunks (FastCDC).
+ *
+ * Cut points are found with a Gear rolling hash over the last 64 bytes, so an insertion or deletion
+ * only moves the boundaries next to it and the other chunks keep their digests. Normalized chunking
+ * uses a stricter mask before the average size and a looser one after it, which keeps chunk sizes
+ * close to the average. The first minimumSize bytes of each chunk are skipped without hashing.
+ */
+class FileChunker
+{
+  public:
+    /**
+     * @brief Construct a chunker.
+     *
+     * @param[in] options Chunk size limits
+     */
+    explicit FileChunker(const FileChunkerOptions& options = FileChunkerOptions());
+
+    /**
+     * @brief Find the length of the next chunk at the start of a buffer.
+     *
+     * @param[in] data Unchunked content
+     * @param[in] length Bytes available; must be at least the maximum chunk size unless the buffer ends the file
+     * @return Length of the next chunk, at most length
+     */
+    std::size_t NextCutPoint(const std::uint8_t* data, std::size_t length) const;
+
+    /**
+     * @brief Stream a file once, splitting it into chunks and hashing each chunk and the whole file.
+     *
+     * @param[in] filePath File to chunk
+     * @param[in] onChunk Receives each chunk and its bytes, which stay valid only during the call; returns false to abort
+     * @param[out] outputFileDigest XXH3_128 digest of the whole file
+     * @return true on success, false on read error or when aborted
+     */
+    bool Chunk(const std::filesystem::path& filePath, const std::function<bool(const FileChunk&, const std::uint8_t*)>& onChunk,
+               HashDigest& outputFileDigest) const;
+
+    /**
+     * @brief Compute the digest identifying a chunk.
+     *
+     * @param[in] data Chunk content
+     * @param[in] length Chunk length in bytes
+     * @return XXH3_128 digest of the content
+     */
+    static HashDigest ChunkDigest(const std::uint8_t* data, std::size_t length);
+
+    /**
+     * @brief Get the largest chunk this chunker produces.
+     *
+     * @return Maximum chunk size in bytes
+     */
+    std::uint32_t MaximumSize() const;
+
+  private:
+    std::uint32_t _minimumSize;
+    std::uint32_t _averageSize;
+    std::uint32_t _maximumSize;
+    std::uint64_t _strictMask;
+    std::uint64_t _looseMask;
+};
@@ -1,20 +1,595 @@
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct Blake3State;
+class IoThrottle;
+class UringReader;
+struct XXH64_state_s;
+struct XXH3_state_s;
+
+/**
+ * @brief Content hash algorithms supported by FileHasher.
+ */
+enum class HashAlgorithm
+{
+    XXH64,   /**< Legacy 64-bit xxHash, streaming scalar implementation */
+    XXH3_64, /**< 64-bit XXH3 with SIMD kernels */
+    XXH3_128, /**< 128-bit XXH3 with SIMD kernels */
+    XXH3_128_Tree, /**< XXH3_128 over the XXH3_128 digests of fixed segments, hashed in parallel; small files keep the XXH3_128 digest */
+    BLAKE3         /**< 256-bit BLAKE3 cryptographic digest; large files are hashed as subtrees on several threads */
+};
+
+/**
+ * @brief Convert a HashAlgorithm enumeration value to its string representation.
+ *
+ * @param[in] algorithm The algorithm to convert
+ * @return String representation of the algorithm
+ */
+inline const char* HashAlgorithmToString(HashAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case HashAlgorithm::XXH64:
+        return "XXH64";
+    case HashAlgorithm::XXH3_64:
+        return "XXH3_64";
+    case HashAlgorithm::XXH3_128:
+        return "XXH3_128";
+    case HashAlgorithm::XXH3_128_Tree:
+        return "XXH3_128_TREE";
+    case HashAlgorithm::BLAKE3:
+        return "BLAKE3";
+    }
+    return "Unknown";
+}
+
+/**
+ * @brief Convert a string to its corresponding HashAlgorithm enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @param[out] outputAlgorithm Parsed algorithm
+ * @return true if the string names a known algorithm, false otherwise
+ */
+inline bool StringToHashAlgorithm(std::string_view stringValue, HashAlgorithm& outputAlgorithm)
+{
+    if ("XXH64" == stringValue)
+    {
+        outputAlgorithm = HashAlgorithm::XXH64;
+        return true;
+    }
+    if ("XXH3_64" == stringValue)
+    {
+        outputAlgorithm = HashAlgorithm::XXH3_64;
+        return true;
+    }
+    if ("XXH3_128" == stringValue)
+    {
+        outputAlgorithm = HashAlgorithm::XXH3_128;
+        return true;
+    }
+    if ("XXH3_128_TREE" == stringValue)
+    {
+        outputAlgorithm = HashAlgorithm::XXH3_128_Tree;
+        return true;
+    }
+    if ("BLAKE3" == stringValue)
+    {
+        outputAlgorithm = HashAlgorithm::BLAKE3;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief How FileHasher reads file content.
+ */
+enum class ReadEngine
+{
+    Blocking, /**< Memory mapping or buffered reads, one read at a time per thread */
+    IoUring   /**< Many fixed-buffer reads in flight through an io_uring per thread, Linux only */
+};
+
+/**
+ * @brief Convert a ReadEngine enumeration value to its string representation.
+ *
+ * @param[in] engine The engine to convert
+ * @return String representation of the engine
+ */
+inline const char* ReadEngineToString(ReadEngine engine)
+{
+    switch (engine)
+    {
+    case ReadEngine::Blocking:
+        return "blocking";
+    case ReadEngine::IoUring:
+        return "io_uring";
+    }
+    return "Unknown";
+}
 
 /**
- * @brief Infrastructure component for hashing files using xxHash.
+ * @brief Convert a string to its corresponding ReadEngine enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @param[out] outputEngine Parsed engine
+ * @return true if the string names a known engine, false otherwise
+ */
+inline bool StringToReadEngine(const std::string& stringValue, ReadEngine& outputEngine)
+{
+    if ("blocking" == stringValue)
+    {
+        outputEngine = ReadEngine::Blocking;
+        return true;
+    }
+    if ("io_uring" == stringValue)
+    {
+        outputEngine = ReadEngine::IoUring;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Fixed-size, trivially copyable binary content digest.
+ *
+ * Bytes are stored in canonical (big-endian) order, so a digest compares and persists identically on every platform.
+ */
+struct HashDigest
+{
+    static constexpr std::size_t MaxSize = 32; /**< Largest supported digest size in bytes */
+
+    std::array<std::uint8_t, MaxSize> bytes; /**< Canonical digest bytes, only the first size bytes are meaningful */
+    std::uint8_t size;                       /**< Number of meaningful bytes */
+
+    /**
+     * @brief Build a digest from raw canonical bytes.
+     *
+     * @param[in] data Digest bytes
+     * @param[in] length Number of bytes, at most MaxSize
+     * @param[out] outputDigest Resulting digest
+     * @return true on success, false if the length is invalid
+     */
+    static bool FromBytes(const void* data, std::size_t length, HashDigest& outputDigest);
+
+    /**
+     * @brief Format the digest as a lowercase hex string.
+     *
+     * @return Hex-encoded digest
+     */
+    std::string ToHex() const;
+
+    bool operator==(const HashDigest& other) const;
+    bool operator!=(const HashDigest& other) const;
+};
+
+/**
+ * @brief Get the digest size in bytes produced by an algorithm.
+ *
+ * @param[in] algorithm Hash algorithm
+ * @return Digest size in bytes
+ */
+inline std::size_t HashAlgorithmDigestSize(HashAlgorithm algorithm)
+{
+    if (HashAlgorithm::BLAKE3 == algorithm)
+    {
+        return 32;
+    }
+    return ((HashAlgorithm::XXH3_128 == algorithm) || (HashAlgorithm::XXH3_128_Tree == algorithm)) ? 16 : 8;
+}
+
+/**
+ * @brief One file of a FileHasher::ComputeMany batch.
+ */
+struct HashJob
+{
+    std::filesystem::path filePath; /**< File to hash */
+    HashDigest digest;              /**< Digest with the hasher's algorithm, set when hashed */
+    bool hashed;                    /**< true once the file was hashed, false on error */
+};
+
+/**
+ * @brief Streaming hash state after the first bytes of a file, from which a file that only grew is hashed
+ *        without reading those bytes again.
+ *
+ * The state is in the memory layout of the build that saved it; another build rejects it.
+ */
+struct HashResumePoint
+{
+    HashAlgorithm algorithm;         /**< Algorithm of the state */
+    std::uintmax_t size;             /**< Bytes of the file the state covers, 0 for no state */
+    std::uint64_t tailHash;          /**< XXH3_64 of the last bytes before size, up to 4 KiB, to tell whether they were rewritten */
+    std::vector<std::uint8_t> state; /**< Saved streaming state */
+};
+
+/**
+ * @brief Infrastructure component for hashing files using xxHash or BLAKE3.
+ *
+ * The tree algorithm cuts files into TreeSegmentSize segments and hashes the segments on several threads.
+ * The segment size is part of the digest definition and therefore fixed. BLAKE3 is a tree hash by
+ * definition, so large files are hashed as subtrees on the same threads and still get the standard digest.
+ *
+ * Each calling thread gets its own Context on first use, so hashing makes no per-file allocations. With the
+ * io_uring read engine the thread also gets its own ring; when a ring cannot be set up, that thread keeps
+ * using the blocking path.
+ *
+ * With a throttle, every read and every write of ComputeAndCopy is charged to it, and files are streamed
+ * rather than memory mapped so that their reads can be paced.
+
+ *
+ * Sparse files are always streamed, and their holes are never read: they are hashed from a constant zero
+ * block, a whole tree segment of zeros takes a precomputed digest, and ComputeAndCopy leaves them as holes
+ * in the copy. The digest is the same as that of the dense file. A dense copy reserves its blocks up to the
+ * source size before the first write, so parallel writers and side-by-side copies get contiguous extents.
  */
 class FileHasher
 {
   public:
     /**
-     * @brief Compute a content hash for the specified file.
+     * @brief Default algorithm for newly computed hashes.
+     */
+    static constexpr HashAlgorithm DefaultAlgorithm = HashAlgorithm::XXH3_128;
+
+    /**
+     * @brief Default minimum file size in bytes for the memory-mapped hashing path.
+     */
+    static constexpr std::uintmax_t DefaultMemoryMapThreshold = 1024 * 1024;
+
+    /**
+     * @brief Segment size in bytes of the tree algorithm; files up to this size get their plain XXH3_128 digest.
+     */
+    static constexpr std::uintmax_t TreeSegmentSize = 64 * 1024 * 1024;
+
+    /**
+     * @brief Default number of reads the io_uring engine keeps in flight per thread.
+     */
+    static constexpr unsigned int DefaultReadQueueDepth = 128;
+
+    /**
+     * @brief Bytes per read of the io_uring engine.
+     */
+    static constexpr std::size_t ReadBlockSize = 128 * 1024;
+
+    /**
+     * @brief Largest file in bytes read in one call and hashed in one shot, skipping the streaming state.
+     */
+    static constexpr std::uintmax_t SmallFileSize = 64 * 1024;
+
+    /**
+     * @brief Default size in bytes of the read buffer of a Context.
+     */
+    static constexpr std::size_t DefaultReadBufferSize = 1024 * 1024;
+
+    /**
+     * @brief Smallest dense file in bytes ComputeAndCopy writes on a second thread while it reads and hashes.
+     */
+    static constexpr std::uintmax_t OverlappedCopyThreshold = 8 * 1024 * 1024;
+
+    /**
+     * @brief Reusable per-thread hashing state: a page-aligned read buffer and the xxHash and BLAKE3 states.
+     *
+     * Creating a context allocates, hashing through it does not. The buffer is rounded up to whole pages
+     * and backed by huge pages where the platform provides them. A context is used by one thread at a time.
+     */
+    class Context
+    {
+      public:
+        /**
+         * @brief Allocate the read buffer and hash states.
+         *
+         * @param[in] bufferSize Read buffer size in bytes, rounded up to whole pages; 0 uses DefaultReadBufferSize
+         */
+        explicit Context(std::size_t bufferSize = DefaultReadBufferSize);
+
+        ~Context();
+
+        Context(const Context&) = delete;
+        Context& operator=(const Context&) = delete;
+
+        /**
+         * @brief Check whether the allocations succeeded.
+         *
+         * @return true if the context can be used for hashing
+         */
+        bool IsValid() const;
+
+        /**
+         * @brief Get the size of the read buffer.
+         *
+         * @return Buffer size in bytes after rounding
+         */
+        std::size_t BufferSize() const;
+
+      private:
+        friend class FileHasher;
+
+        std::uint8_t* _buffer = nullptr;
+        std::size_t _bufferSize = 0;
+        XXH64_state_s* _xxh64State = nullptr;
+        XXH3_state_s* _xxh3State = nullptr;
+        Blake3State* _blake3State = nullptr;
+    };
+
+    /**
+     * @brief Construct a file hasher.
+     *
+     * @param[in] algorithm Hash algorithm used by Compute
+     * @param[in] memoryMapThreshold Files of at least this many bytes are hashed through a memory mapping; 0 disables mapping
+     * @param[in] treeThreads Threads hashing one large file with the tree algorithm or BLAKE3, 0 uses the hardware concurrency
+     * @param[in] readEngine How Compute reads files
+     * @param[in] readQueueDepth Reads in flight per thread with the io_uring engine
+     * @param[in] unbufferedThreshold Files of at least this many bytes are read without leaving them in the page cache; 0 disables
+     * @param[in] readBufferSize Read buffer size of the per-thread contexts used by the overloads without a Context
+     * @param[in] throttle Rate limiter reads, writes and file opens are charged to, nullptr runs at full speed; must outlive the hasher
+     */
+    explicit FileHasher(HashAlgorithm algorithm = DefaultAlgorithm, std::uintmax_t memoryMapThreshold = DefaultMemoryMapThreshold,
+                        unsigned int treeThreads = 0, ReadEngine readEngine = ReadEngine::Blocking,
+                        unsigned int readQueueDepth = DefaultReadQueueDepth, std::uintmax_t unbufferedThreshold = 0,
+                        std::size_t readBufferSize = DefaultReadBufferSize, IoThrottle* throttle = nullptr);
+
+    ~FileHasher();
+
+    FileHasher(const FileHasher&) = delete;
+    FileHasher& operator=(const FileHasher&) = delete;
+
+    /**
+     * @brief Get the algorithm used by Compute.
+     *
+     * @return Configured hash algorithm
+     */
+    HashAlgorithm Algorithm() const;
+
+    /**
+     * @brief Compute a content hash for the specified file with the configured algorithm.
+     *
+     * Files at or above the memory-map threshold are mapped and hashed in a single call. Files that
+     * cannot be mapped (pipes, some FUSE filesystems), and files truncated while they are mapped, fall
+     * back to buffered reads. With the tree
+     * algorithm, files of more than one segment are read by several threads at once, as are large files
+     * with BLAKE3. With the io_uring engine, other files are read through the calling thread's ring.
+     * Files at or above the unbuffered threshold bypass the page cache (Windows) or have their pages
+     * dropped behind the read (Linux).
+     *
+     * @param[in] filePath Path to the file to hash
+     * @param[out] outputDigest Output binary digest
+     * @return true on success, false on error
+     */
+    bool Compute(const std::filesystem::path& filePath, HashDigest& outputDigest) const;
+
+    /**
+     * @brief Compute a content hash with the configured algorithm through a caller-owned context.
+     *
+     * The overloads without a context use one the hasher keeps per calling thread.
+     *
+     * @param[in] filePath Path to the file to hash
+     * @param[in,out] context Buffer and hash states to use
+     * @param[out] outputDigest Output binary digest
+     * @return true on success, false on error or an invalid context
+     */
+    bool Compute(const std::filesystem::path& filePath, Context& context, HashDigest& outputDigest) const;
+
+    /**
+     * @brief Compute a content hash for the specified file with an explicit algorithm.
+     *
+     * Used to compare against hashes recorded by an earlier run with a different algorithm.
      *
      * @param[in] filePath Path to the file to hash
-     * @param[out] outputHash Output hex-encoded hash string
+     * @param[in] algorithm Hash algorithm to use
+     * @param[out] outputDigest Output binary digest
      * @return true on success, false on error
      */
-    bool Compute(const std::filesystem::path& filePath, std::string& outputHash) const;
+    bool Compute(const std::filesystem::path& filePath, HashAlgorithm algorithm, HashDigest& outputDigest) const;
+
+    /**
+     * @brief Compute a content hash with an explicit algorithm through a caller-owned context.
+     *
+     * @param[in] filePath Path to the file to hash
+     * @param[in] algorithm Hash algorithm to use
+     * @param[in,out] context Buffer and hash states to use
+     * @param[out] outputDigest Output binary digest
+     * @return true on success, false on error or an invalid context
+     */
+    bool Compute(const std::filesystem::path& filePath, HashAlgorithm algorithm, Context& context, HashDigest& outputDigest) const;
+
+    /**
+     * @brief Compute the content hashes of several files with the configured algorithm.
+     *
+     * In a build with RDEMO_CXX20_COROUTINES on Linux and with the io_uring engine, every file is hashed by a
+     * coroutine of its own and the calling thread keeps one block read of up to readQueueDepth files in
+     * flight through its ring, resuming each coroutine when its read completes. Files the concurrent pass
+     * leaves out (tree-parallel and unbuffered files) or fails on go through Compute one by one, which is
+     * also all this does in other builds. Digests equal those of Compute.
+     *
+     * @param[in,out] jobs Files to hash; digest and hashed are set for each
+     */
+    void ComputeMany(std::vector<HashJob>& jobs) const;
+
+    /**
+     * @brief Check whether ComputeMany keeps the files of a batch in flight together.
+     *
+     * @param[in] readEngine Read engine of the hasher
+     * @return true in a coroutine build on Linux with the io_uring engine
+     */
+    static bool HashesConcurrently(ReadEngine readEngine);
+
+    /**
+     * @brief Copy a file and compute its content hash from the same read.
+     *
+     * The source is streamed once; each buffer is fed to the hash and written to the destination, which
+     * is created or truncated. Files the tree algorithm or BLAKE3 hash on several threads are read in
+     * concurrent positioned ranges instead, one in flight per thread, and each range is written to the
+     * same offset of the destination, which keeps a high-latency network share busy from a single file.
+     * A streamed dense file of at least OverlappedCopyThreshold bytes is read and hashed into one half of
+     * the context buffer while a writer thread writes the other half, so both devices stay busy.
+     * On failure the destination may be left partially written. Above the unbuffered threshold both files
+     * are flushed and evicted from the page cache afterwards on Linux.
+     *
+     * @param[in] sourcePath File to hash and copy
+     * @param[in] destinationPath File to write
+     * @param[out] outputDigest Digest of the source content with the configured algorithm
+     * @return true on success, false on error
+     */
+    bool ComputeAndCopy(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath, HashDigest& outputDigest) const;
+
+    /**
+     * @brief Copy a file and compute its content hash through a caller-owned context.
+     *
+     * @param[in] sourcePath File to hash and copy
+     * @param[in] destinationPath File to write
+     * @param[in,out] context Buffer and hash states to use
+     * @param[out] outputDigest Digest of the source content with the configured algorithm
+     * @return true on success, false on error or an invalid context
+     */
+    bool ComputeAndCopy(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath, Context& context,
+                        HashDigest& outputDigest) const;
+
+    /**
+     * @brief Check whether the streaming state of an algorithm can be saved in a HashResumePoint.
+     *
+     * @param[in] algorithm Algorithm to check
+     * @return true for every algorithm but the tree algorithm
+     */
+    static bool SupportsResume(HashAlgorithm algorithm);
+
+    /**
+     * @brief Hash a file and append it to a copy, resuming from a saved state when the copy already holds its first bytes.
+     *
+     * With a point of size 0 the whole file is copied, the destination being created or truncated. Otherwise
+     * the destination must hold exactly the first resumePoint.size bytes, and the source must still end those
+     * bytes with the tail the point describes; only the bytes after them are read, hashed and appended. A file
+     * that was rewritten before its tail, rather than only appended to, is not detected.
+     *
+     * With a checkpoint interval, the destination is flushed to stable storage whenever that many more bytes
+     * were appended, and onCheckpoint then gets the point after them and the XXH3_64 of the bytes appended
+     * since the previous checkpoint, so an interrupted copy can continue from the last one.
+     *
+     * @param[in] sourcePath File to hash and copy
+     * @param[in] destinationPath Copy to append to
+     * @param[in,out] resumePoint State to resume from; on success, the state after the whole file
+     * @param[out] outputDigest Digest of the source content with the configured algorithm
+     * @param[in] checkpointInterval Bytes between two checkpoints, 0 for none
+     * @param[in] onCheckpoint Called from the calling thread at every checkpoint, may be empty
+     * @return true on success; false on error, for the tree algorithm, a sparse source, or when the source shrank,
+     *         its tail changed or the destination has another size, in which case the destination may be partially written
+     */
+    bool ComputeAndAppend(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath, HashResumePoint& resumePoint,
+                          HashDigest& outputDigest, std::uintmax_t checkpointInterval = 0,
+                          const std::function<void(const HashResumePoint&, std::uint64_t)>& onCheckpoint = nullptr) const;
+
+    /**
+     * @brief Compute the XXH3_64 of a byte range of a file, as ComputeAndAppend reports it for the bytes between two checkpoints.
+     *
+     * @param[in] filePath File to read
+     * @param[in] offset Offset of the first byte
+     * @param[in] length Number of bytes
+     * @param[out] outputHash Hash of the range
+     * @return true on success, false on error or if the file ends before the range does
+     */
+    bool ComputeRangeHash(const std::filesystem::path& filePath, std::uintmax_t offset, std::uintmax_t length, std::uint64_t& outputHash) const;
+
+    /**
+     * @brief Get the digest of the bytes a resume point covers.
+     *
+     * @param[in] resumePoint Point saved by ComputeAndAppend
+     * @param[out] outputDigest Digest of the first resumePoint.size bytes
+     * @return true on success, false if the state cannot be restored by this build
+     */
+    bool ResumePointDigest(const HashResumePoint& resumePoint, HashDigest& outputDigest) const;
+
+    /**
+     * @brief Read a whole file into memory and compute its content hash with the configured algorithm.
+     *
+     * Meant for small files whose content is stored from memory. Every read is charged to the throttle.
+     *
+     * @param[in] filePath File to read
+     * @param[out] outputContent File content, resized to the bytes read
+     * @param[out] outputDigest Digest of the content
+     * @return true on success, false on error
+     */
+    bool ComputeAndRead(const std::filesystem::path& filePath, std::vector<std::uint8_t>& outputContent, HashDigest& outputDigest) const;
+
+    /**
+     * @brief Compute a digest of a sample of a file's blocks with the configured algorithm, for a quick check of a large file.
+     *
+     * The sample is the file's size, its first and last block and randomBlocks blocks in between, picked by a
+     * generator seeded with the size; a file of at most randomBlocks + 2 blocks is read whole. The digest is not a
+     * content digest: it only equals the sample digest of a file of the same size and the same sampled bytes,
+     * so a change outside the sampled blocks goes unnoticed. Every read is charged to the throttle.
+     *
+     * @param[in] filePath File to sample
+     * @param[in] blockSize Bytes per sampled block
+     * @param[in] randomBlocks Blocks sampled between the first and the last
+     * @param[out] outputDigest Digest of the sample
+     * @return true on success, false on error or for a file whose size is unknown
+     */
+    bool ComputeSample(const std::filesystem::path& filePath, std::size_t blockSize, unsigned int randomBlocks, HashDigest& outputDigest) const;
+
+    /**
+     * @brief Compute a file's content hash and hand each buffer read to a consumer, such as an encrypting writer.
+     *
+     * Like ComputeAndCopy, but the consumer decides what is written. Every read is charged to the throttle.
+     *
+     * @param[in] sourcePath File to hash
+     * @param[in] consumer Called with each buffer after it is hashed; returning false stops with an error
+     * @param[out] outputDigest Digest of the source content with the configured algorithm
+     * @return true on success, false on error or when the consumer failed
+     */
+    bool ComputeAndStream(const std::filesystem::path& sourcePath, const std::function<bool(const std::uint8_t*, std::size_t)>& consumer,
+                          HashDigest& outputDigest) const;
+
+    /**
+     * @brief Compute the content hash of a stream that is not a plain file, such as a decrypting reader.
+     *
+     * @param[in] algorithm Hash algorithm to use
+     * @param[in] producer Fills the buffer it is given and sets the byte count, 0 at the end; returning false stops with an error
+     * @param[out] outputDigest Digest of the content
+     * @return true on success, false on error or when the producer failed
+     */
+    bool ComputeStream(HashAlgorithm algorithm, const std::function<bool(std::uint8_t*, std::size_t, std::size_t&)>& producer,
+                       HashDigest& outputDigest) const;
+
+    /**
+     * @brief Compute the content hash of a buffer.
+     *
+     * Gives the same digest as hashing a file with that content.
+     *
+     * @param[in] algorithm Hash algorithm to use
+     * @param[in] data Start of the content
+     * @param[in] length Content length in bytes
+     * @return Binary digest
+     */
+    static HashDigest ComputeBuffer(HashAlgorithm algorithm, const void* data, std::size_t length);
+
+  private:
+    struct ThreadState;
+
+    bool Compute(const std::filesystem::path& filePath, HashAlgorithm algorithm, Context& context, ThreadState* threadState,
+                 HashDigest& outputDigest) const;
+    bool IsUnbuffered(std::uintmax_t fileSize) const;
+    ThreadState& AcquireThreadState() const;
+    Context& AcquireContext(ThreadState& threadState) const;
+    UringReader* AcquireReader(ThreadState& threadState) const;
+
+    HashAlgorithm _algorithm;
+    std::uintmax_t _memoryMapThreshold;
+    unsigned int _treeThreads;
+    ReadEngine _readEngine;
+    unsigned int _readQueueDepth;
+    std::uintmax_t _unbufferedThreshold;
+    std::size_t _readBufferSize;
+    IoThrottle* _throttle;
+
+    mutable std::mutex _threadStatesMutex;
+    mutable std::unordered_map<std::thread::id, std::unique_ptr<ThreadState>> _threadStates; /**< Context and io_uring reader per calling thread */
 };
@@ -0,0 +1,82 @@
+#include "Blake3Tree.h"
+
+#include "blake3_impl.h"
+
+#include <string.h>
+
+/* Chunks or parents passed to blake3_hash_many at a time, a multiple of every SIMD degree. */
+#define HASH_MANY_BATCH 64
+
+void rdemo_blake3_subtree(const uint8_t* input, size_t chunkCount, uint64_t firstChunk, uint8_t* scratch, uint8_t* chainingValue)
+{
+    const uint8_t* inputs[HASH_MANY_BATCH];
+    uint8_t parents[HASH_MANY_BATCH * BLAKE3_OUT_LEN];
+    size_t done = 0;
+    size_t count = chunkCount;
+
+    while (done < chunkCount)
+    {
+        size_t batch = (chunkCount - done < HASH_MANY_BATCH) ? (chunkCount - done) : HASH_MANY_BATCH;
+        for (size_t i = 0; i < batch; ++i)
+        {
+            inputs[i] = input + (done + i) * BLAKE3_CHUNK_LEN;
+        }
+        blake3_hash_many(inputs, batch, BLAKE3_CHUNK_LEN / BLAKE3_BLOCK_LEN, IV, firstChunk + done, true, 0, CHUNK_START,
+                         CHUNK_END, scratch + done * BLAKE3_OUT_LEN);
+        done += batch;
+    }
+
+    /* Each level halves the chaining values in place. Parent i overwrites slot i, which only holds inputs
+       of parents up to i, already hashed into the batch buffer before it is copied back. */
+    while (1 < count)
+    {
+        const size_t parentCount = count / 2;
+        for (done = 0; done < parentCount;)
+        {
+            size_t batch = (parentCount - done < HASH_MANY_BATCH) ? (parentCount - done) : HASH_MANY_BATCH;
+            for (size_t i = 0; i < batch; ++i)
+            {
+                inputs[i] = scratch + 2 * (done + i) * BLAKE3_OUT_LEN;
+            }
+            blake3_hash_many(inputs, batch, 1, IV, 0, false, PARENT, 0, 0, parents);
+            memcpy(scratch + done * BLAKE3_OUT_LEN, parents, batch * BLAKE3_OUT_LEN);
+            done += batch;
+        }
+        count = parentCount;
+    }
+    memcpy(chainingValue, scratch, BLAKE3_OUT_LEN);
+}
+
+void rdemo_blake3_chunk(const uint8_t* input, size_t length, uint64_t chunkIndex, uint8_t* chainingValue)
+{
+    uint32_t words[8];
+    size_t offset = 0;
+
+    memcpy(words, IV, sizeof(words));
+    do
+    {
+        uint8_t block[BLAKE3_BLOCK_LEN] = {0};
+        const size_t blockLength = (length - offset < BLAKE3_BLOCK_LEN) ? (length - offset) : BLAKE3_BLOCK_LEN;
+        uint8_t flags = (0 == offset) ? CHUNK_START : 0;
+        memcpy(block, input + offset, blockLength);
+        offset += blockLength;
+        if (offset == length)
+        {
+            flags |= CHUNK_END;
+        }
+        blake3_compress_in_place(words, block, (uint8_t)blockLength, chunkIndex, flags);
+    } while (offset < length);
+    store_cv_words(chainingValue, words);
+}
+
+void rdemo_blake3_parent(const uint8_t* left, const uint8_t* right, int isRoot, uint8_t* output)
+{
+    uint32_t words[8];
+    uint8_t block[BLAKE3_BLOCK_LEN];
+
+    memcpy(words, IV, sizeof(words));
+    memcpy(block, left, BLAKE3_OUT_LEN);
+    memcpy(block + BLAKE3_OUT_LEN, right, BLAKE3_OUT_LEN);
+    blake3_compress_in_place(words, block, BLAKE3_BLOCK_LEN, 0, (uint8_t)(PARENT | ((0 != isRoot) ? ROOT : 0)));
+    store_cv_words(output, words);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Subtree hashing on top of the vendored BLAKE3, which only exposes a sequential hasher.
+ *
+ * BLAKE3 merges the chaining values of its 1 KiB chunks in a binary tree whose shape depends only on the
+ * input length, so aligned power-of-two runs of chunks can be hashed on separate threads and their chaining
+ * values merged afterwards; the root is the same as that of one sequential pass. These functions use
+ * BLAKE3's internal compression and SIMD hash_many kernels, which the public header does not declare.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Hash a run of whole chunks as a subtree that is not the root.
+ *
+ * @param[in] input chunkCount * BLAKE3_CHUNK_LEN input bytes
+ * @param[in] chunkCount Chunks in the run, a power of two
+ * @param[in] firstChunk Index of the first chunk in the whole input, a multiple of chunkCount
+ * @param[out] scratch Room for chunkCount chaining values of BLAKE3_OUT_LEN bytes, overwritten
+ * @param[out] chainingValue BLAKE3_OUT_LEN bytes of the subtree's chaining value
+ */
+void rdemo_blake3_subtree(const uint8_t* input, size_t chunkCount, uint64_t firstChunk, uint8_t* scratch, uint8_t* chainingValue);
+
+/**
+ * @brief Hash one chunk, possibly partial, that is not the root.
+ *
+ * @param[in] input Chunk bytes
+ * @param[in] length Number of bytes, 1 to BLAKE3_CHUNK_LEN
+ * @param[in] chunkIndex Index of the chunk in the whole input
+ * @param[out] chainingValue BLAKE3_OUT_LEN bytes of the chunk's chaining value
+ */
+void rdemo_blake3_chunk(const uint8_t* input, size_t length, uint64_t chunkIndex, uint8_t* chainingValue);
+
+/**
+ * @brief Merge the chaining values of two sibling subtrees.
+ *
+ * @param[in] left BLAKE3_OUT_LEN bytes of the left subtree's chaining value
+ * @param[in] right BLAKE3_OUT_LEN bytes of the right subtree's chaining value
+ * @param[in] isRoot Non-zero if the parent is the root, whose chaining value is the digest
+ * @param[out] output BLAKE3_OUT_LEN bytes of the parent's chaining value, or the digest for the root; may be left or right
+ */
+void rdemo_blake3_parent(const uint8_t* left, const uint8_t* right, int isRoot, uint8_t* output);
+
+#ifdef __cplusplus
+}
+#endif
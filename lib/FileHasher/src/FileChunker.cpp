@@ -0,0 +1,234 @@
+#include "FileHasher/FileChunker.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+#include <xxhash.h>
+
+namespace
+{
+constexpr std::uint32_t MinimumAverageSize = 256;
+constexpr std::uint32_t MinimumSizeDivisor = 4;
+constexpr std::uint32_t MaximumSizeMultiplier = 4;
+constexpr unsigned int NormalizationBits = 2;
+constexpr std::size_t MinimumReadBufferSize = 1024 * 1024;
+constexpr std::size_t GearTableSize = 256;
+constexpr std::uint64_t GearTableSeed = 0x6a09e667f3bcc909ULL;
+
+/**
+ * @brief Generate the Gear table with splitmix64 so every build cuts at the same positions.
+ *
+ * @return Pseudo-random 64-bit value per byte value
+ */
+constexpr std::array<std::uint64_t, GearTableSize> MakeGearTable()
+{
+    std::array<std::uint64_t, GearTableSize> table{};
+    std::uint64_t state = GearTableSeed;
+    for (std::size_t i = 0; i < GearTableSize; ++i)
+    {
+        state += 0x9e3779b97f4a7c15ULL;
+        std::uint64_t value = state;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        table[i] = value ^ (value >> 31);
+    }
+    return table;
+}
+
+constexpr std::array<std::uint64_t, GearTableSize> GearTable = MakeGearTable();
+
+/**
+ * @brief Build a mask selecting the top bits of the Gear hash, which depend on the most recent 64 bytes.
+ *
+ * @param[in] bitCount Number of bits that must be zero at a cut point
+ * @return Mask with the top bitCount bits set
+ */
+std::uint64_t TopBitsMask(unsigned int bitCount)
+{
+    return (0 == bitCount) ? 0 : (~0ULL << (64 - bitCount));
+}
+
+/**
+ * @brief Round a value down to a power of two.
+ *
+ * @param[in] value Value to round, at least 1
+ * @return Largest power of two not above value
+ */
+std::uint32_t FloorPowerOfTwo(std::uint32_t value)
+{
+    std::uint32_t power = 1;
+    while ((power << 1) <= value)
+    {
+        power <<= 1;
+    }
+    return power;
+}
+
+/**
+ * @brief Count the bits below a power of two.
+ *
+ * @param[in] power Power of two
+ * @return log2 of power
+ */
+unsigned int Log2(std::uint32_t power)
+{
+    unsigned int bits = 0;
+    while (1U < power)
+    {
+        power >>= 1;
+        ++bits;
+    }
+    return bits;
+}
+
+/**
+ * @brief Convert a 128-bit hash value to a canonical digest.
+ *
+ * @param[in] hashValue Hash value to convert
+ * @return Canonical digest
+ */
+HashDigest MakeDigest(const XXH128_hash_t& hashValue)
+{
+    XXH128_canonical_t canonical;
+    XXH128_canonicalFromHash(&canonical, hashValue);
+    HashDigest digest{};
+    HashDigest::FromBytes(canonical.digest, sizeof(canonical.digest), digest);
+    return digest;
+}
+
+/**
+ * @brief Free an XXH3 state when leaving scope.
+ */
+struct XXH3StateDeleter
+{
+    void operator()(XXH3_state_t* state) const
+    {
+        XXH3_freeState(state);
+    }
+};
+}
+
+FileChunker::FileChunker(const FileChunkerOptions& options)
+{
+    _averageSize = FloorPowerOfTwo(std::max(MinimumAverageSize, options.averageSize));
+    _minimumSize = (0 != options.minimumSize) ? std::min(options.minimumSize, _averageSize) : (_averageSize / MinimumSizeDivisor);
+    _maximumSize = (0 != options.maximumSize) ? std::max(options.maximumSize, _averageSize) : (_averageSize * MaximumSizeMultiplier);
+
+    const unsigned int averageBits = Log2(_averageSize);
+    _strictMask = TopBitsMask(averageBits + NormalizationBits);
+    _looseMask = TopBitsMask(averageBits - NormalizationBits);
+}
+
+HashDigest FileChunker::ChunkDigest(const std::uint8_t* data, std::size_t length)
+{
+    return MakeDigest(XXH3_128bits(data, length));
+}
+
+std::uint32_t FileChunker::MaximumSize() const
+{
+    return _maximumSize;
+}
+
+std::size_t FileChunker::NextCutPoint(const std::uint8_t* data, std::size_t length) const
+{
+    if (length <= _minimumSize)
+    {
+        return length;
+    }
+
+    const std::size_t limit = std::min<std::size_t>(length, _maximumSize);
+    const std::size_t normalSize = std::min<std::size_t>(limit, _averageSize);
+
+    // Bytes before the minimum size cannot be cut points; the hash warms up over its 64-byte window
+    // only from the minimum onwards, as in FastCDC.
+    std::uint64_t hash = 0;
+    std::size_t position = _minimumSize;
+    for (; position < normalSize; ++position)
+    {
+        hash = (hash << 1) + GearTable[data[position]];
+        if (0 == (hash & _strictMask))
+        {
+            return position + 1;
+        }
+    }
+    for (; position < limit; ++position)
+    {
+        hash = (hash << 1) + GearTable[data[position]];
+        if (0 == (hash & _looseMask))
+        {
+            return position + 1;
+        }
+    }
+    return limit;
+}
+
+bool FileChunker::Chunk(const std::filesystem::path& filePath, const std::function<bool(const FileChunk&, const std::uint8_t*)>& onChunk,
+                        HashDigest& outputFileDigest) const
+{
+    std::ifstream inputStream(filePath, std::ios::binary);
+    if (false == inputStream.is_open())
+    {
+        return false;
+    }
+
+    std::unique_ptr<XXH3_state_t, XXH3StateDeleter> fileState(XXH3_createState());
+    if ((nullptr == fileState) || (XXH_OK != XXH3_128bits_reset(fileState.get())))
+    {
+        return false;
+    }
+
+    std::vector<std::uint8_t> buffer(std::max<std::size_t>(MinimumReadBufferSize, static_cast<std::size_t>(_maximumSize) * 4));
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    bool endOfFile = false;
+    std::uint64_t offset = 0;
+
+    while (true)
+    {
+        // Keep at least one maximum-size chunk buffered so every cut point sees its full search range.
+        if ((false == endOfFile) && ((end - begin) < _maximumSize))
+        {
+            std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+            while ((false == endOfFile) && (end < buffer.size()))
+            {
+                inputStream.read(reinterpret_cast<char*>(buffer.data() + end), static_cast<std::streamsize>(buffer.size() - end));
+                const std::streamsize bytesRead = inputStream.gcount();
+                end += static_cast<std::size_t>(bytesRead);
+                if (false == inputStream.good())
+                {
+                    if (true == inputStream.bad())
+                    {
+                        return false;
+                    }
+                    endOfFile = true;
+                }
+            }
+        }
+
+        if (begin == end)
+        {
+            break;
+        }
+
+        const std::uint8_t* chunkData = buffer.data() + begin;
+        const std::size_t chunkLength = NextCutPoint(chunkData, end - begin);
+        XXH3_128bits_update(fileState.get(), chunkData, chunkLength);
+
+        const FileChunk chunk{offset, static_cast<std::uint32_t>(chunkLength), ChunkDigest(chunkData, chunkLength)};
+        if (false == onChunk(chunk, chunkData))
+        {
+            return false;
+        }
+        begin += chunkLength;
+        offset += chunkLength;
+    }
+
+    outputFileDigest = MakeDigest(XXH3_128bits_digest(fileState.get()));
+    return true;
+}
@@ -1,54 +1,3056 @@
 #include "FileHasher/FileHasher.hpp"
 
-#include <fstream>
-#include <sstream>
+#include "Blake3Tree.h"
+#include "UringReader.hpp"
 
+#include "Instrumentation/Instrumentation.hpp"
+#include "Instrumentation/Probes.hpp"
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(RDEMO_HAVE_COROUTINES) && defined(__linux__)
+#include <coroutine>
+#include <exception>
+#endif
+
+#include <blake3.h>
+
+// The state types are complete, so resume points can save them.
+#define XXH_STATIC_LINKING_ONLY
 #include <xxhash.h>
+#ifdef RDEMO_XXHASH_DISPATCH
+// Replaces the XXH3 one-shot and update functions with their XXH3_*_dispatch counterparts.
+#include <xxh_x86dispatch.h>
+#endif
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <cerrno>
+#include <csetjmp>
+#include <csignal>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief BLAKE3 hasher of a FileHasher::Context; blake3_hasher is an unnamed struct, so the header cannot declare it.
+ */
+struct Blake3State
+{
+    blake3_hasher hasher;
+};
+
+namespace
+{
+constexpr std::size_t SegmentReadBufferSize = 1024 * 1024;
+constexpr std::size_t HugePageSize = 2 * 1024 * 1024;
+constexpr std::uintmax_t DropBehindInterval = 8 * 1024 * 1024;
+constexpr std::uintmax_t TreeSegmentSize = FileHasher::TreeSegmentSize;
+constexpr std::uintmax_t Blake3SegmentSize = 4 * 1024 * 1024;
+constexpr XXH64_hash_t HashSeed = 0;
+constexpr const char* HexDigits = "0123456789abcdef";
+constexpr unsigned int HexNibbleBits = 4;
+constexpr std::uint8_t HexNibbleMask = 0x0F;
+constexpr std::size_t ZeroBlockSize = 64 * 1024;
+constexpr std::size_t ResumeTailSize = 4096;
+// Saved BLAKE3 states are blake3_hasher as is; bump this when an update of the vendored BLAKE3 changes it.
+constexpr std::uint32_t Blake3StateLayout = 2;
+#ifndef _WIN32
+constexpr mode_t NewFileMode = 0666;
+constexpr std::uintmax_t StatBlockSize = 512;
+#endif
+
+static_assert(std::is_trivially_copyable<blake3_hasher>::value, "resume points save BLAKE3 states as bytes");
+
+/**
+ * @brief Zeros the holes of sparse files are hashed from.
+ */
+alignas(64) const std::uint8_t ZeroBlock[ZeroBlockSize] = {};
+
+/**
+ * @brief Get the virtual memory page size.
+ *
+ * @return Page size in bytes
+ */
+std::size_t SystemPageSize()
+{
+#ifdef _WIN32
+    SYSTEM_INFO systemInfo{};
+    GetSystemInfo(&systemInfo);
+    return systemInfo.dwPageSize;
+#else
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    return (0 < pageSize) ? static_cast<std::size_t>(pageSize) : 4096;
+#endif
+}
+
+/**
+ * @brief Convert a 64-bit hash value to a canonical digest.
+ *
+ * @param[in] hashValue Hash value to convert
+ * @return Canonical digest
+ */
+HashDigest MakeDigest(XXH64_hash_t hashValue)
+{
+    XXH64_canonical_t canonical;
+    XXH64_canonicalFromHash(&canonical, hashValue);
+    HashDigest digest{};
+    HashDigest::FromBytes(canonical.digest, sizeof(canonical.digest), digest);
+    return digest;
+}
+
+/**
+ * @brief Convert a 128-bit hash value to a canonical digest.
+ *
+ * @param[in] hashValue Hash value to convert
+ * @return Canonical digest
+ */
+HashDigest MakeDigest(const XXH128_hash_t& hashValue)
+{
+    XXH128_canonical_t canonical;
+    XXH128_canonicalFromHash(&canonical, hashValue);
+    HashDigest digest{};
+    HashDigest::FromBytes(canonical.digest, sizeof(canonical.digest), digest);
+    return digest;
+}
+
+/**
+ * @brief Convert the BLAKE3 output of the input fed so far to a digest.
+ *
+ * @param[in] hasher Hasher fed with the whole content
+ * @return Digest
+ */
+HashDigest MakeDigest(const blake3_hasher& hasher)
+{
+    std::uint8_t output[BLAKE3_OUT_LEN];
+    blake3_hasher_finalize(&hasher, output, sizeof(output));
+    HashDigest digest{};
+    HashDigest::FromBytes(output, sizeof(output), digest);
+    return digest;
+}
+
+/**
+ * @brief Combine the segment digests of the tree algorithm into the file digest.
+ *
+ * A single segment is the whole file, whose digest is its plain XXH3_128 digest.
+ *
+ * @param[in] segmentDigests Canonical XXH3_128 digests of the segments in file order
+ * @return File digest
+ */
+HashDigest CombineSegmentDigests(const std::vector<XXH128_canonical_t>& segmentDigests)
+{
+    HashDigest digest{};
+    if (1 == segmentDigests.size())
+    {
+        HashDigest::FromBytes(segmentDigests.front().digest, sizeof(segmentDigests.front().digest), digest);
+        return digest;
+    }
+    return MakeDigest(XXH3_128bits(segmentDigests.data(), segmentDigests.size() * sizeof(XXH128_canonical_t)));
+}
+
+/**
+ * @brief Get the tree algorithm digest of a segment of zeros, computed on first use.
+ *
+ * @return Canonical XXH3_128 digest of TreeSegmentSize zero bytes
+ */
+const XXH128_canonical_t& ZeroSegmentDigest()
+{
+    static const XXH128_canonical_t digest = []()
+    {
+        XXH3_state_t* state = XXH3_createState();
+        XXH3_128bits_reset(state);
+        for (std::uintmax_t offset = 0; offset < TreeSegmentSize; offset += ZeroBlockSize)
+        {
+            XXH3_128bits_update(state, ZeroBlock, ZeroBlockSize);
+        }
+        XXH128_canonical_t canonical;
+        XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(state));
+        XXH3_freeState(state);
+        return canonical;
+    }();
+    return digest;
+}
+
+#ifndef _WIN32
+/**
+ * @brief Open a source file for reading without updating its access time where the kernel allows it.
+ *
+ * Linux refuses O_NOATIME with EPERM on files the process neither owns nor has CAP_FOWNER over;
+ * those are opened again without it.
+ *
+ * @param[in] filePath File to open
+ * @return Open descriptor, negative on error
+ */
+int OpenForReading(const std::filesystem::path& filePath)
+{
+#ifdef O_NOATIME
+    const int fileDescriptor = open(filePath.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+    if ((0 <= fileDescriptor) || (EPERM != errno))
+    {
+        return fileDescriptor;
+    }
+#endif
+    return open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+}
+#endif
+
+#if defined(RDEMO_HAVE_COROUTINES) && defined(__linux__)
+/**
+ * @brief Get the size of a file and whether it has holes, from a single status call.
+ *
+ * @param[in] filePath File to examine
+ * @param[out] outputSize Size of the file in bytes
+ * @param[out] outputSparse The file has fewer bytes allocated than its size
+ * @return true on success, false if the file cannot be examined
+ */
+bool StatFile(const std::filesystem::path& filePath, std::uintmax_t& outputSize, bool& outputSparse)
+{
+    struct stat fileStatus{};
+    if ((0 != stat(filePath.c_str(), &fileStatus)) || (false == S_ISREG(fileStatus.st_mode)))
+    {
+        return false;
+    }
+    outputSize = static_cast<std::uintmax_t>(fileStatus.st_size);
+    outputSparse = (0 < outputSize) && ((static_cast<std::uintmax_t>(fileStatus.st_blocks) * StatBlockSize) < outputSize);
+    return true;
+}
+#endif
+
+/**
+ * @brief Streaming hash dispatching to the selected xxHash variant or BLAKE3, over states owned by a FileHasher::Context.
+ */
+class StreamingHash
+{
+  public:
+    StreamingHash(HashAlgorithm algorithm, XXH64_state_t* xxh64State, XXH3_state_t* xxh3State, Blake3State* blake3State)
+        : _algorithm(algorithm), _xxh64State(xxh64State), _xxh3State(xxh3State), _blake3State(blake3State)
+    {
+        if (HashAlgorithm::BLAKE3 == _algorithm)
+        {
+            if (nullptr != _blake3State)
+            {
+                blake3_hasher_init(&_blake3State->hasher);
+            }
+            return;
+        }
+        if (HashAlgorithm::XXH64 == _algorithm)
+        {
+            if (nullptr != _xxh64State)
+            {
+                XXH64_reset(_xxh64State, HashSeed);
+            }
+            return;
+        }
+
+        if (nullptr == _xxh3State)
+        {
+            return;
+        }
+        if (HashAlgorithm::XXH3_64 == _algorithm)
+        {
+            XXH3_64bits_reset(_xxh3State);
+        }
+        else
+        {
+            XXH3_128bits_reset(_xxh3State);
+        }
+    }
+
+    StreamingHash(const StreamingHash&) = delete;
+    StreamingHash& operator=(const StreamingHash&) = delete;
+
+    bool IsValid() const
+    {
+        switch (_algorithm)
+        {
+        case HashAlgorithm::XXH64:
+            return nullptr != _xxh64State;
+        case HashAlgorithm::BLAKE3:
+            return nullptr != _blake3State;
+        default:
+            return nullptr != _xxh3State;
+        }
+    }
+
+    void Update(const void* data, std::size_t length)
+    {
+        switch (_algorithm)
+        {
+        case HashAlgorithm::XXH64:
+            XXH64_update(_xxh64State, data, length);
+            break;
+        case HashAlgorithm::XXH3_64:
+            XXH3_64bits_update(_xxh3State, data, length);
+            break;
+        case HashAlgorithm::XXH3_128:
+            XXH3_128bits_update(_xxh3State, data, length);
+            break;
+        case HashAlgorithm::XXH3_128_Tree:
+            UpdateTree(static_cast<const std::uint8_t*>(data), length);
+            break;
+        case HashAlgorithm::BLAKE3:
+            blake3_hasher_update(&_blake3State->hasher, data, length);
+            break;
+        }
+    }
+
+    /**
+     * @brief Feed a run of zero bytes, such as a hole of a sparse file, without reading it.
+     *
+     * Whole tree segments of zeros all share one digest, so they are not hashed at all.
+     */
+    void UpdateZeros(std::uintmax_t length)
+    {
+        while (0 < length)
+        {
+            if ((HashAlgorithm::XXH3_128_Tree == _algorithm) && (0 == _segmentFill) && (TreeSegmentSize <= length))
+            {
+                _segmentDigests.push_back(ZeroSegmentDigest());
+                length -= TreeSegmentSize;
+                continue;
+            }
+            const std::size_t pieceLength = static_cast<std::size_t>(std::min<std::uintmax_t>(length, ZeroBlockSize));
+            Update(ZeroBlock, pieceLength);
+            length -= pieceLength;
+        }
+    }
+
+    HashDigest Digest() const
+    {
+        switch (_algorithm)
+        {
+        case HashAlgorithm::XXH64:
+            return MakeDigest(XXH64_digest(_xxh64State));
+        case HashAlgorithm::XXH3_64:
+            return MakeDigest(XXH3_64bits_digest(_xxh3State));
+        case HashAlgorithm::XXH3_128:
+            return MakeDigest(XXH3_128bits_digest(_xxh3State));
+        case HashAlgorithm::XXH3_128_Tree:
+        {
+            if (true == _segmentDigests.empty())
+            {
+                // A single segment is the whole file; no need to collect digests.
+                return MakeDigest(XXH3_128bits_digest(_xxh3State));
+            }
+            std::vector<XXH128_canonical_t> segmentDigests = _segmentDigests;
+            if (0 != _segmentFill)
+            {
+                segmentDigests.emplace_back();
+                XXH128_canonicalFromHash(&segmentDigests.back(), XXH3_128bits_digest(_xxh3State));
+            }
+            return CombineSegmentDigests(segmentDigests);
+        }
+        case HashAlgorithm::BLAKE3:
+            return MakeDigest(_blake3State->hasher);
+        }
+        return {};
+    }
+
+    /**
+     * @brief Save the state after the input fed so far, tagged with the layout it was saved in.
+     *
+     * @param[out] outputState Saved state
+     * @return true on success, false for the tree algorithm
+     */
+    bool Save(std::vector<std::uint8_t>& outputState) const
+    {
+        switch (_algorithm)
+        {
+        case HashAlgorithm::XXH64:
+            return SaveBytes(XXH_VERSION_NUMBER, _xxh64State, sizeof(XXH64_state_t), outputState);
+        case HashAlgorithm::XXH3_64:
+        case HashAlgorithm::XXH3_128:
+            return SaveXxh3(outputState);
+        case HashAlgorithm::BLAKE3:
+            return SaveBytes(Blake3StateLayout, &_blake3State->hasher, sizeof(blake3_hasher), outputState);
+        case HashAlgorithm::XXH3_128_Tree:
+            break;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Replace the state with one saved by Save for the same algorithm.
+     *
+     * @param[in] state Saved state
+     * @return true on success, false if the state was saved in another layout
+     */
+    bool Restore(const std::vector<std::uint8_t>& state)
+    {
+        switch (_algorithm)
+        {
+        case HashAlgorithm::XXH64:
+            return RestoreBytes(XXH_VERSION_NUMBER, state, _xxh64State, sizeof(XXH64_state_t));
+        case HashAlgorithm::XXH3_64:
+        case HashAlgorithm::XXH3_128:
+            return RestoreXxh3(state);
+        case HashAlgorithm::BLAKE3:
+            return RestoreBytes(Blake3StateLayout, state, &_blake3State->hasher, sizeof(blake3_hasher));
+        case HashAlgorithm::XXH3_128_Tree:
+            break;
+        }
+        return false;
+    }
+
+  private:
+    static bool SaveBytes(std::uint32_t layout, const void* source, std::size_t size, std::vector<std::uint8_t>& outputState)
+    {
+        outputState.resize(sizeof(layout) + size);
+        std::memcpy(outputState.data(), &layout, sizeof(layout));
+        std::memcpy(outputState.data() + sizeof(layout), source, size);
+        return true;
+    }
+
+    static bool RestoreBytes(std::uint32_t layout, const std::vector<std::uint8_t>& state, void* destination, std::size_t size)
+    {
+        std::uint32_t savedLayout = 0;
+        if ((sizeof(layout) + size) != state.size())
+        {
+            return false;
+        }
+        std::memcpy(&savedLayout, state.data(), sizeof(savedLayout));
+        if (layout != savedLayout)
+        {
+            return false;
+        }
+        std::memcpy(destination, state.data() + sizeof(layout), size);
+        return true;
+    }
+
+    /**
+     * @brief Bytes of an XXH3 state saved by SaveXxh3: the layout, accumulators, buffer, buffered size, stripe count and total length.
+     */
+    static constexpr std::size_t Xxh3SavedSize = sizeof(std::uint32_t) + sizeof(XXH3_state_t::acc) + sizeof(XXH3_state_t::buffer) +
+                                                 sizeof(std::uint32_t) + sizeof(std::uint64_t) + sizeof(std::uint64_t);
+
+    /**
+     * @brief Save the fields of the XXH3 state that depend on the input fed so far.
+     *
+     * The rest of the state is what the reset sets, including a pointer to the default secret that is
+     * only valid in this process, so it is left out and restored by resetting.
+     */
+    bool SaveXxh3(std::vector<std::uint8_t>& outputState) const
+    {
+        const std::uint32_t layout = XXH_VERSION_NUMBER;
+        const std::uint32_t bufferedSize = _xxh3State->bufferedSize;
+        const std::uint64_t stripes = _xxh3State->nbStripesSoFar;
+        const std::uint64_t totalLength = _xxh3State->totalLen;
+        outputState.clear();
+        outputState.reserve(Xxh3SavedSize);
+        AppendBytes(&layout, sizeof(layout), outputState);
+        AppendBytes(_xxh3State->acc, sizeof(_xxh3State->acc), outputState);
+        AppendBytes(_xxh3State->buffer, sizeof(_xxh3State->buffer), outputState);
+        AppendBytes(&bufferedSize, sizeof(bufferedSize), outputState);
+        AppendBytes(&stripes, sizeof(stripes), outputState);
+        AppendBytes(&totalLength, sizeof(totalLength), outputState);
+        return true;
+    }
+
+    /**
+     * @brief Reset the XXH3 state and replace its input-dependent fields with ones saved by SaveXxh3.
+     *
+     * States saved whole by earlier releases have another size and are refused, as are counts that do
+     * not fit the state, so a damaged checkpoint cannot make the next update read out of bounds.
+     */
+    bool RestoreXxh3(const std::vector<std::uint8_t>& state)
+    {
+        std::uint32_t layout = 0;
+        if (Xxh3SavedSize != state.size())
+        {
+            return false;
+        }
+        const std::uint8_t* cursor = ReadBytes(state.data(), &layout, sizeof(layout));
+        if (XXH_VERSION_NUMBER != layout)
+        {
+            return false;
+        }
+        XXH64_hash_t accumulators[sizeof(XXH3_state_t::acc) / sizeof(XXH64_hash_t)];
+        std::uint32_t bufferedSize = 0;
+        std::uint64_t stripes = 0;
+        std::uint64_t totalLength = 0;
+        cursor = ReadBytes(cursor, accumulators, sizeof(accumulators));
+        const std::uint8_t* buffer = cursor;
+        cursor += sizeof(XXH3_state_t::buffer);
+        cursor = ReadBytes(cursor, &bufferedSize, sizeof(bufferedSize));
+        cursor = ReadBytes(cursor, &stripes, sizeof(stripes));
+        ReadBytes(cursor, &totalLength, sizeof(totalLength));
+
+        if (HashAlgorithm::XXH3_64 == _algorithm)
+        {
+            XXH3_64bits_reset(_xxh3State);
+        }
+        else
+        {
+            XXH3_128bits_reset(_xxh3State);
+        }
+        if ((sizeof(_xxh3State->buffer) < bufferedSize) || (_xxh3State->nbStripesPerBlock <= stripes))
+        {
+            return false;
+        }
+        std::memcpy(_xxh3State->acc, accumulators, sizeof(accumulators));
+        std::memcpy(_xxh3State->buffer, buffer, sizeof(_xxh3State->buffer));
+        _xxh3State->bufferedSize = bufferedSize;
+        _xxh3State->nbStripesSoFar = static_cast<std::size_t>(stripes);
+        _xxh3State->totalLen = totalLength;
+        return true;
+    }
+
+    /**
+     * @brief Append the bytes of a field to a saved state.
+     */
+    static void AppendBytes(const void* source, std::size_t size, std::vector<std::uint8_t>& output)
+    {
+        const auto* bytes = static_cast<const std::uint8_t*>(source);
+        output.insert(output.end(), bytes, bytes + size);
+    }
+
+    /**
+     * @brief Copy a field out of a saved state.
+     *
+     * @return Position after the field
+     */
+    static const std::uint8_t* ReadBytes(const std::uint8_t* cursor, void* destination, std::size_t size)
+    {
+        std::memcpy(destination, cursor, size);
+        return cursor + size;
+    }
+
+    /**
+     * @brief Feed the tree hash, closing a segment whenever TreeSegmentSize bytes went into it.
+     */
+    void UpdateTree(const std::uint8_t* data, std::size_t length)
+    {
+        while (0 < length)
+        {
+            const std::size_t pieceLength = static_cast<std::size_t>(std::min<std::uintmax_t>(length, TreeSegmentSize - _segmentFill));
+            XXH3_128bits_update(_xxh3State, data, pieceLength);
+            _segmentFill += pieceLength;
+            data += pieceLength;
+            length -= pieceLength;
+            if (TreeSegmentSize == _segmentFill)
+            {
+                _segmentDigests.emplace_back();
+                XXH128_canonicalFromHash(&_segmentDigests.back(), XXH3_128bits_digest(_xxh3State));
+                XXH3_128bits_reset(_xxh3State);
+                _segmentFill = 0;
+            }
+        }
+    }
+
+    HashAlgorithm _algorithm;
+    XXH64_state_t* _xxh64State;
+    XXH3_state_t* _xxh3State;
+    Blake3State* _blake3State;
+    std::uintmax_t _segmentFill = 0;
+    std::vector<XXH128_canonical_t> _segmentDigests;
+};
+
+/**
+ * @brief Hash a contiguous memory region in a single call.
+ *
+ * @param[in] algorithm Hash algorithm to use
+ * @param[in] data Start of the region
+ * @param[in] length Region length in bytes
+ * @return Binary digest
+ */
+HashDigest HashRegion(HashAlgorithm algorithm, const void* data, std::size_t length)
+{
+    switch (algorithm)
+    {
+    case HashAlgorithm::XXH64:
+        return MakeDigest(XXH64(data, length, HashSeed));
+    case HashAlgorithm::XXH3_64:
+        return MakeDigest(XXH3_64bits(data, length));
+    case HashAlgorithm::XXH3_128:
+        return MakeDigest(XXH3_128bits(data, length));
+    case HashAlgorithm::XXH3_128_Tree:
+    {
+        if (TreeSegmentSize >= length)
+        {
+            return MakeDigest(XXH3_128bits(data, length));
+        }
+        const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+        std::vector<XXH128_canonical_t> segmentDigests;
+        std::size_t offset = 0;
+        do
+        {
+            const std::size_t segmentLength = static_cast<std::size_t>(std::min<std::uintmax_t>(length - offset, TreeSegmentSize));
+            segmentDigests.emplace_back();
+            XXH128_canonicalFromHash(&segmentDigests.back(), XXH3_128bits(bytes + offset, segmentLength));
+            offset += segmentLength;
+        } while (offset < length);
+        return CombineSegmentDigests(segmentDigests);
+    }
+    case HashAlgorithm::BLAKE3:
+    {
+        blake3_hasher hasher;
+        blake3_hasher_init(&hasher);
+        blake3_hasher_update(&hasher, data, length);
+        return MakeDigest(hasher);
+    }
+    }
+    return {};
+}
+
+/**
+ * @brief Reader over a platform file handle, without a stream buffer of its own.
+ *
+ * A source file is opened once, with O_NOATIME where permitted, and everything a hash or copy needs
+ * comes from that handle: the size and sparseness from fstat, sequential reads, positioned reads for
+ * the tree threads, the memory mapping and the io_uring reads. Every read is charged to the throttle,
+ * if there is one.
+ *
+ * In unbuffered mode Windows reopens the handle with FILE_FLAG_NO_BUFFERING, which needs page-aligned
+ * reads whose length is a multiple of the page size. Linux instead drops the pages behind the read position.
+ *
+ * The holes of a sparse file are not read: SkipHole steps over them (SEEK_DATA on POSIX,
+ * FSCTL_QUERY_ALLOCATED_RANGES on Windows) and Read stops at the end of each data extent.
+ */
+class InputFile
+{
+  public:
+    InputFile(const std::filesystem::path& filePath, IoThrottle* throttle) : _unbuffered(false), _throttle(throttle)
+    {
+#ifdef _WIN32
+        _fileHandle = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                  FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        BY_HANDLE_FILE_INFORMATION fileInformation{};
+        _sizeKnown = (INVALID_HANDLE_VALUE != _fileHandle) && (FALSE != GetFileInformationByHandle(_fileHandle, &fileInformation)) &&
+                     (0 == (fileInformation.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY));
+        if (true == _sizeKnown)
+        {
+            _size = (static_cast<std::uintmax_t>(fileInformation.nFileSizeHigh) << 32) | fileInformation.nFileSizeLow;
+            _sparse = (0 != (fileInformation.dwFileAttributes & FILE_ATTRIBUTE_SPARSE_FILE));
+        }
+#else
+        _fileDescriptor = OpenForReading(filePath);
+        struct stat fileStatus{};
+        _sizeKnown = (0 <= _fileDescriptor) && (0 == fstat(_fileDescriptor, &fileStatus)) && (S_ISREG(fileStatus.st_mode));
+        if (true == _sizeKnown)
+        {
+            _size = static_cast<std::uintmax_t>(fileStatus.st_size);
+#ifdef SEEK_HOLE
+            _sparse = (0 < _size) && ((static_cast<std::uintmax_t>(fileStatus.st_blocks) * StatBlockSize) < _size);
+#endif
+        }
+#endif
+        if (nullptr != _throttle)
+        {
+            _throttle->AcquireMetadata();
+        }
+    }
+
+    ~InputFile()
+    {
+#ifdef _WIN32
+        if (INVALID_HANDLE_VALUE != _fileHandle)
+        {
+            CloseHandle(_fileHandle);
+        }
+#else
+        if (0 <= _fileDescriptor)
+        {
+#ifdef __linux__
+            if (true == _unbuffered)
+            {
+                posix_fadvise(_fileDescriptor, 0, 0, POSIX_FADV_DONTNEED);
+            }
+#endif
+            close(_fileDescriptor);
+        }
+#endif
+    }
+
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+
+    bool IsOpen() const
+    {
+#ifdef _WIN32
+        return INVALID_HANDLE_VALUE != _fileHandle;
+#else
+        return 0 <= _fileDescriptor;
+#endif
+    }
+
+#ifdef _WIN32
+    HANDLE Handle() const
+    {
+        return _fileHandle;
+    }
+#else
+    int Descriptor() const
+    {
+        return _fileDescriptor;
+    }
+#endif
+
+    /**
+     * @brief Get the size the file had when it was opened.
+     *
+     * @param[out] outputSize Size in bytes
+     * @return true for a regular file, false if the size is unknown, as for pipes and devices
+     */
+    bool Size(std::uintmax_t& outputSize) const
+    {
+        outputSize = _size;
+        return _sizeKnown;
+    }
+
+    /**
+     * @brief Check whether the file has fewer bytes allocated than its size, so its holes can be skipped.
+     *
+     * @return true for a sparse file on a platform that can find its holes
+     */
+    bool IsSparse() const
+    {
+        return _sparse;
+    }
+
+    /**
+     * @brief Get the size of the file now, to tell whether it changed while it was read.
+     *
+     * @param[out] outputSize Size in bytes
+     * @return true on success, false on error
+     */
+    bool CurrentSize(std::uintmax_t& outputSize) const
+    {
+#ifdef _WIN32
+        LARGE_INTEGER fileSize{};
+        if (FALSE == GetFileSizeEx(_fileHandle, &fileSize))
+        {
+            return false;
+        }
+        outputSize = static_cast<std::uintmax_t>(fileSize.QuadPart);
+#else
+        struct stat fileStatus{};
+        if (0 != fstat(_fileDescriptor, &fileStatus))
+        {
+            return false;
+        }
+        outputSize = static_cast<std::uintmax_t>(fileStatus.st_size);
+#endif
+        return true;
+    }
+
+    /**
+     * @brief Keep the file out of the page cache from here on; call before the first read.
+     *
+     * Where Windows cannot reopen the handle without buffering, reads stay buffered.
+     */
+    void SetUnbuffered()
+    {
+#ifdef _WIN32
+        const HANDLE reopened = ReOpenFile(_fileHandle, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                           FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_NO_BUFFERING);
+        if (INVALID_HANDLE_VALUE == reopened)
+        {
+            return;
+        }
+        CloseHandle(_fileHandle);
+        _fileHandle = reopened;
+#elif defined(__linux__)
+        posix_fadvise(_fileDescriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        _unbuffered = true;
+    }
+
+    /**
+     * @brief Evict the file from the page cache after a read that bypassed SetUnbuffered. Linux only; elsewhere this does nothing.
+     */
+    void DropCachedPages() const
+    {
+#ifdef __linux__
+        posix_fadvise(_fileDescriptor, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    }
+
+    /**
+     * @brief Step over the hole at the read position of a sparse file.
+     *
+     * A hole reads as zeros, so the caller accounts for its length instead of reading it. Nothing is
+     * charged to the throttle.
+     *
+     * @return Bytes skipped, 0 when the read position is in data or at the end, or the file is not sparse
+     */
+    std::uintmax_t SkipHole()
+    {
+        if ((false == _sparse) || (_position < _dataEnd))
+        {
+            return 0;
+        }
+
+        std::uintmax_t dataStart = 0;
+        if (false == FindData(dataStart))
+        {
+            // The filesystem cannot tell; the rest of the file is read as it is.
+            _sparse = false;
+            return 0;
+        }
+        if (dataStart <= _position)
+        {
+            return 0;
+        }
+
+        const std::uintmax_t holeBytes = dataStart - _position;
+#ifdef _WIN32
+        LARGE_INTEGER distance{};
+        distance.QuadPart = static_cast<LONGLONG>(dataStart);
+        if (FALSE == SetFilePointerEx(_fileHandle, distance, nullptr, FILE_BEGIN))
+        {
+            return 0;
+        }
+        _position = dataStart;
+#else
+        if (0 > lseek(_fileDescriptor, static_cast<off_t>(dataStart), SEEK_SET))
+        {
+            return 0;
+        }
+        Advance(holeBytes);
+#endif
+        return holeBytes;
+    }
+
+    /**
+     * @brief Read the next bytes of the file.
+     *
+     * @param[out] data Buffer to fill
+     * @param[in] length Buffer size in bytes
+     * @param[out] bytesRead Bytes read, 0 at end of file
+     * @return true on success, false on error
+     */
+    bool Read(void* data, std::size_t length, std::size_t& bytesRead)
+    {
+        if ((true == _sparse) && (_position < _dataEnd))
+        {
+            length = static_cast<std::size_t>(std::min<std::uintmax_t>(length, _dataEnd - _position));
+        }
+#ifdef _WIN32
+        DWORD chunkBytes = 0;
+        const DWORD requestBytes = static_cast<DWORD>(std::min<std::size_t>(length, MAXDWORD - (MAXDWORD % 4096)));
+        if (FALSE == ReadFile(_fileHandle, data, requestBytes, &chunkBytes, nullptr))
+        {
+            return false;
+        }
+        bytesRead = chunkBytes;
+        _position += bytesRead;
+        Charge(bytesRead);
+        return true;
+#else
+        while (true)
+        {
+            const ssize_t chunkBytes = read(_fileDescriptor, data, length);
+            if (0 <= chunkBytes)
+            {
+                bytesRead = static_cast<std::size_t>(chunkBytes);
+                Advance(bytesRead);
+                Charge(bytesRead);
+                return true;
+            }
+            if (EINTR != errno)
+            {
+                return false;
+            }
+        }
+#endif
+    }
+
+    /**
+     * @brief Move the read position of a file that is not sparse.
+     *
+     * @param[in] offset New read position
+     * @return true on success, false on error
+     */
+    bool Seek(std::uintmax_t offset)
+    {
+#ifdef _WIN32
+        LARGE_INTEGER distance{};
+        distance.QuadPart = static_cast<LONGLONG>(offset);
+        if (FALSE == SetFilePointerEx(_fileHandle, distance, nullptr, FILE_BEGIN))
+        {
+            return false;
+        }
+#else
+        if (0 > lseek(_fileDescriptor, static_cast<off_t>(offset), SEEK_SET))
+        {
+            return false;
+        }
+        _dropped = offset;
+#endif
+        _position = offset;
+        return true;
+    }
+
+    /**
+     * @brief Read bytes at an offset without moving the read position; several threads may call this at once.
+     *
+     * @param[in] offset File offset of the first byte
+     * @param[out] data Buffer to fill
+     * @param[in] length Buffer size in bytes
+     * @param[out] bytesRead Bytes read, 0 at end of file
+     * @return true on success, false on error
+     */
+    bool ReadAt(std::uintmax_t offset, void* data, std::size_t length, std::size_t& bytesRead)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFU);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD chunkBytes = 0;
+        const DWORD requestBytes = static_cast<DWORD>(std::min<std::size_t>(length, MAXDWORD - (MAXDWORD % 4096)));
+        if ((FALSE == ReadFile(_fileHandle, data, requestBytes, &chunkBytes, &overlapped)) && (ERROR_HANDLE_EOF != GetLastError()))
+        {
+            return false;
+        }
+        bytesRead = chunkBytes;
+#else
+        while (true)
+        {
+            const ssize_t chunkBytes = pread(_fileDescriptor, data, length, static_cast<off_t>(offset));
+            if (0 <= chunkBytes)
+            {
+                bytesRead = static_cast<std::size_t>(chunkBytes);
+                break;
+            }
+            if (EINTR != errno)
+            {
+                return false;
+            }
+        }
+#endif
+        Charge(bytesRead);
+        return true;
+    }
+
+  private:
+    void Charge(std::size_t bytesRead)
+    {
+        if ((nullptr != _throttle) && (0 < bytesRead))
+        {
+            _throttle->AcquireRead(bytesRead);
+        }
+    }
+
+    /**
+     * @brief Find the next data at or after the read position and remember where that data extent ends.
+     *
+     * @param[out] outputDataStart Offset of the next data, the end of the file when only a hole follows
+     * @return true on success, false if the filesystem cannot report holes
+     */
+    bool FindData(std::uintmax_t& outputDataStart)
+    {
+#ifdef _WIN32
+        LARGE_INTEGER fileSize{};
+        if ((FALSE == GetFileSizeEx(_fileHandle, &fileSize)) || (static_cast<std::uintmax_t>(fileSize.QuadPart) <= _position))
+        {
+            return false;
+        }
+        FILE_ALLOCATED_RANGE_BUFFER query{};
+        query.FileOffset.QuadPart = static_cast<LONGLONG>(_position);
+        query.Length.QuadPart = fileSize.QuadPart - query.FileOffset.QuadPart;
+        FILE_ALLOCATED_RANGE_BUFFER range{};
+        DWORD returnedBytes = 0;
+        // Only the first range is needed; the ones after it are asked for when the read gets there.
+        if ((FALSE == DeviceIoControl(_fileHandle, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), &range, sizeof(range), &returnedBytes,
+                                      nullptr)) &&
+            (ERROR_MORE_DATA != GetLastError()))
+        {
+            return false;
+        }
+        if (0 == returnedBytes)
+        {
+            outputDataStart = static_cast<std::uintmax_t>(fileSize.QuadPart);
+            _dataEnd = outputDataStart;
+            return true;
+        }
+        outputDataStart = std::max<std::uintmax_t>(static_cast<std::uintmax_t>(range.FileOffset.QuadPart), _position);
+        _dataEnd = static_cast<std::uintmax_t>(range.FileOffset.QuadPart + range.Length.QuadPart);
+        return true;
+#elif defined(SEEK_HOLE)
+        off_t dataStart = lseek(_fileDescriptor, static_cast<off_t>(_position), SEEK_DATA);
+        off_t holeStart = -1;
+        if (0 <= dataStart)
+        {
+            holeStart = lseek(_fileDescriptor, dataStart, SEEK_HOLE);
+        }
+        else if (ENXIO == errno)
+        {
+            // No data past the read position: the rest of the file is one hole.
+            dataStart = lseek(_fileDescriptor, 0, SEEK_END);
+            holeStart = dataStart;
+        }
+        const bool found = (0 <= holeStart);
+        if ((0 > lseek(_fileDescriptor, static_cast<off_t>(_position), SEEK_SET)) || (false == found))
+        {
+            return false;
+        }
+        outputDataStart = static_cast<std::uintmax_t>(dataStart);
+        _dataEnd = static_cast<std::uintmax_t>(holeStart);
+        return true;
+#else
+        static_cast<void>(outputDataStart);
+        return false;
+#endif
+    }
+
+#ifndef _WIN32
+    /**
+     * @brief Move the read position forward, dropping the pages behind it in unbuffered mode.
+     */
+    void Advance(std::uintmax_t bytes)
+    {
+        _position += bytes;
+#ifdef __linux__
+        if ((true == _unbuffered) && (DropBehindInterval <= (_position - _dropped)))
+        {
+            posix_fadvise(_fileDescriptor, static_cast<off_t>(_dropped), static_cast<off_t>(_position - _dropped), POSIX_FADV_DONTNEED);
+            _dropped = _position;
+        }
+#endif
+    }
+#endif
+
+    bool _unbuffered;
+    IoThrottle* _throttle;
+    bool _sizeKnown = false;
+    std::uintmax_t _size = 0;
+    bool _sparse = false;
+    std::uintmax_t _position = 0;
+    std::uintmax_t _dataEnd = 0;
+#ifdef _WIN32
+    HANDLE _fileHandle = INVALID_HANDLE_VALUE;
+#else
+    int _fileDescriptor = -1;
+    std::uintmax_t _dropped = 0;
+#endif
+};
+
+/**
+ * @brief Receives each range a parallel hash read, with its file offset, so a copy can be reassembled from positioned writes.
+ */
+using RangeSink = std::function<bool(std::uintmax_t offset, const void* data, std::size_t length)>;
+
+/**
+ * @brief Hash the segments of a file with the tree algorithm on several threads.
+ *
+ * The threads share the caller's handle and claim segments in order, reading each with positioned
+ * reads, so reads stay sequential within a segment and as many are in flight as there are threads.
+ *
+ * @param[in,out] inputFile Open file to hash, charged with every read
+ * @param[in] fileSize Size of the file in bytes, more than one segment
+ * @param[in] threadCount Number of threads to use
+ * @param[in] copyRange Called from the reading thread with every range read, empty for none; false fails the hash
+ * @param[out] outputDigest Resulting digest
+ * @return true on success, false on error or if the file changed size while hashing
+ */
+bool ComputeTreeParallel(InputFile& inputFile, std::uintmax_t fileSize, unsigned int threadCount, const RangeSink& copyRange, HashDigest& outputDigest)
+{
+    const std::size_t segmentCount = static_cast<std::size_t>((fileSize + TreeSegmentSize - 1) / TreeSegmentSize);
+    std::vector<XXH128_canonical_t> segmentDigests(segmentCount);
+    std::atomic<std::size_t> nextSegment{0};
+    std::atomic<bool> failed{false};
+
+    auto hashSegments = [&]()
+    {
+        XXH3_state_t* state = XXH3_createState();
+        std::vector<char> buffer(SegmentReadBufferSize);
+        if (nullptr == state)
+        {
+            failed.store(true);
+        }
+
+        for (std::size_t segment = nextSegment++; (false == failed.load()) && (segment < segmentCount); segment = nextSegment++)
+        {
+            std::uintmax_t offset = segment * TreeSegmentSize;
+            std::uintmax_t remaining = std::min<std::uintmax_t>(TreeSegmentSize, fileSize - offset);
+            XXH3_128bits_reset(state);
+            while ((0 < remaining) && (false == failed.load()))
+            {
+                std::size_t bytesRead = 0;
+                // A file that shrank ends before the segment does.
+                if ((false == inputFile.ReadAt(offset, buffer.data(), static_cast<std::size_t>(std::min<std::uintmax_t>(remaining, buffer.size())), bytesRead)) ||
+                    (0 == bytesRead) || ((copyRange) && (false == copyRange(offset, buffer.data(), bytesRead))))
+                {
+                    failed.store(true);
+                    break;
+                }
+                XXH3_128bits_update(state, buffer.data(), bytesRead);
+                offset += bytesRead;
+                remaining -= bytesRead;
+            }
+            XXH128_canonicalFromHash(&segmentDigests[segment], XXH3_128bits_digest(state));
+        }
+
+        if (nullptr != state)
+        {
+            XXH3_freeState(state);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const unsigned int helperCount = static_cast<unsigned int>(std::min<std::size_t>(threadCount, segmentCount)) - 1;
+    threads.reserve(helperCount);
+    for (unsigned int i = 0; i < helperCount; ++i)
+    {
+        threads.emplace_back(hashSegments);
+    }
+    hashSegments();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    std::uintmax_t currentSize = 0;
+    if ((true == failed.load()) || (false == inputFile.CurrentSize(currentSize)) || (fileSize != currentSize))
+    {
+        return false;
+    }
+    outputDigest = CombineSegmentDigests(segmentDigests);
+    return true;
+}
+
+/**
+ * @brief Hash a file with BLAKE3 on several threads.
+ *
+ * Everything before the last chunk is cut into aligned power-of-two runs of chunks of at most
+ * Blake3SegmentSize, which are whole subtrees of the BLAKE3 tree. The threads claim the runs in order
+ * and hash each with positioned reads; the calling thread then merges their chaining values with that of
+ * the last chunk the way a sequential hasher does, so the digest is that of a sequential pass.
+ *
+ * @param[in,out] inputFile Open file to hash, charged with every read
+ * @param[in] fileSize Size of the file in bytes, more than one segment
+ * @param[in] threadCount Number of threads to use
+ * @param[in] copyRange Called from the reading thread with every range read, empty for none; false fails the hash
+ * @param[out] outputDigest Resulting digest
+ * @return true on success, false on error or if the file changed size while hashing
+ */
+bool ComputeBlake3Parallel(InputFile& inputFile, std::uintmax_t fileSize, unsigned int threadCount, const RangeSink& copyRange, HashDigest& outputDigest)
+{
+    using ChainValue = std::array<std::uint8_t, BLAKE3_OUT_LEN>;
+    struct Subtree
+    {
+        std::uintmax_t offset;
+        std::uint64_t chunkCount;
+        ChainValue chainingValue;
+    };
+    std::vector<Subtree> subtrees;
+    std::uint64_t remainingChunks = (fileSize - 1) / BLAKE3_CHUNK_LEN;
+    std::uintmax_t offset = 0;
+    while (0 < remainingChunks)
+    {
+        std::uint64_t chunkCount = Blake3SegmentSize / BLAKE3_CHUNK_LEN;
+        while (remainingChunks < chunkCount)
+        {
+            chunkCount /= 2;
+        }
+        subtrees.push_back(Subtree{offset, chunkCount, {}});
+        offset += chunkCount * BLAKE3_CHUNK_LEN;
+        remainingChunks -= chunkCount;
+    }
+    std::atomic<std::size_t> nextSubtree{0};
+    std::atomic<bool> failed{false};
+
+    const auto readInto = [&inputFile, &copyRange, &failed](std::uintmax_t readOffset, std::uintmax_t length, std::uint8_t* buffer)
+    {
+        std::uintmax_t filled = 0;
+        while ((filled < length) && (false == failed.load()))
+        {
+            std::size_t bytesRead = 0;
+            const std::size_t readLength = static_cast<std::size_t>(std::min<std::uintmax_t>(length - filled, SegmentReadBufferSize));
+            // A file that shrank ends before the subtree does.
+            if ((false == inputFile.ReadAt(readOffset + filled, buffer + filled, readLength, bytesRead)) || (0 == bytesRead) ||
+                ((copyRange) && (false == copyRange(readOffset + filled, buffer + filled, bytesRead))))
+            {
+                failed.store(true);
+                break;
+            }
+            filled += bytesRead;
+        }
+    };
+    auto hashSubtrees = [&]()
+    {
+        std::vector<std::uint8_t> buffer(Blake3SegmentSize);
+        std::vector<std::uint8_t> scratch(Blake3SegmentSize / BLAKE3_CHUNK_LEN * BLAKE3_OUT_LEN);
+        for (std::size_t index = nextSubtree++; (false == failed.load()) && (index < subtrees.size()); index = nextSubtree++)
+        {
+            Subtree& subtree = subtrees[index];
+            readInto(subtree.offset, subtree.chunkCount * BLAKE3_CHUNK_LEN, buffer.data());
+            if (false == failed.load())
+            {
+                rdemo_blake3_subtree(buffer.data(), static_cast<std::size_t>(subtree.chunkCount), subtree.offset / BLAKE3_CHUNK_LEN, scratch.data(),
+                                     subtree.chainingValue.data());
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const unsigned int helperCount = static_cast<unsigned int>(std::min<std::size_t>(threadCount, subtrees.size())) - 1;
+    threads.reserve(helperCount);
+    for (unsigned int i = 0; i < helperCount; ++i)
+    {
+        threads.emplace_back(hashSubtrees);
+    }
+    hashSubtrees();
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    std::uint8_t lastChunk[BLAKE3_CHUNK_LEN];
+    const std::size_t lastChunkLength = static_cast<std::size_t>(fileSize - offset);
+    readInto(offset, lastChunkLength, lastChunk);
+
+    std::uintmax_t currentSize = 0;
+    if ((true == failed.load()) || (false == inputFile.CurrentSize(currentSize)) || (fileSize != currentSize))
+    {
+        return false;
+    }
+
+    // Neighbours of equal size form the next larger subtree. What is left, one subtree per set bit of the
+    // chunk count, is folded into the last chunk from the right; the outermost parent is the root.
+    std::vector<std::pair<ChainValue, std::uint64_t>> stack;
+    for (const Subtree& subtree : subtrees)
+    {
+        ChainValue chainingValue = subtree.chainingValue;
+        std::uint64_t chunkCount = subtree.chunkCount;
+        while ((false == stack.empty()) && (chunkCount == stack.back().second))
+        {
+            rdemo_blake3_parent(stack.back().first.data(), chainingValue.data(), 0, chainingValue.data());
+            chunkCount *= 2;
+            stack.pop_back();
+        }
+        stack.emplace_back(chainingValue, chunkCount);
+    }
+    ChainValue rootValue{};
+    rdemo_blake3_chunk(lastChunk, lastChunkLength, offset / BLAKE3_CHUNK_LEN, rootValue.data());
+    for (std::size_t i = stack.size(); 0 < i; --i)
+    {
+        rdemo_blake3_parent(stack[i - 1].first.data(), rootValue.data(), (1 == i) ? 1 : 0, rootValue.data());
+    }
+    HashDigest::FromBytes(rootValue.data(), rootValue.size(), outputDigest);
+    return true;
+}
+
+/**
+ * @brief Sequential writer over a platform file handle creating or truncating the file, or appending to it.
+ *
+ * In unbuffered mode Linux writes back and drops the written pages every few MiB, like FileCopier.
+ * Every write is charged to the throttle, if there is one.
+ */
+class OutputFile
+{
+  public:
+    OutputFile(const std::filesystem::path& filePath, bool unbuffered, IoThrottle* throttle, bool append = false)
+        : _unbuffered(unbuffered), _throttle(throttle)
+    {
+#ifdef _WIN32
+        static_cast<void>(_unbuffered);
+        _fileHandle = CreateFileW(filePath.c_str(), GENERIC_WRITE, 0, nullptr, (true == append) ? OPEN_EXISTING : CREATE_ALWAYS,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER fileSize{};
+        if ((true == append) && (INVALID_HANDLE_VALUE != _fileHandle) &&
+            ((FALSE == GetFileSizeEx(_fileHandle, &fileSize)) || (FALSE == SetFilePointerEx(_fileHandle, fileSize, nullptr, FILE_BEGIN))))
+        {
+            CloseHandle(_fileHandle);
+            _fileHandle = INVALID_HANDLE_VALUE;
+        }
+        _size = static_cast<std::uintmax_t>(fileSize.QuadPart);
+#else
+        _fileDescriptor = open(filePath.c_str(), (true == append) ? (O_WRONLY | O_APPEND | O_CLOEXEC) : (O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC),
+                               NewFileMode);
+        struct stat fileStatus{};
+        if ((true == append) && (0 <= _fileDescriptor) && (0 != fstat(_fileDescriptor, &fileStatus)))
+        {
+            close(_fileDescriptor);
+            _fileDescriptor = -1;
+        }
+        _size = static_cast<std::uintmax_t>(fileStatus.st_size);
+        _position = _size;
+        _dropped = _size;
+#endif
+    }
+
+    ~OutputFile()
+    {
+#ifdef _WIN32
+        if (INVALID_HANDLE_VALUE != _fileHandle)
+        {
+            CloseHandle(_fileHandle);
+        }
+#else
+        if (0 <= _fileDescriptor)
+        {
+            close(_fileDescriptor);
+        }
+#endif
+    }
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    bool IsOpen() const
+    {
+#ifdef _WIN32
+        return INVALID_HANDLE_VALUE != _fileHandle;
+#else
+        return 0 <= _fileDescriptor;
+#endif
+    }
+
+    /**
+     * @brief Get the size of the file as written so far, including what it held before an append.
+     */
+    std::uintmax_t Size() const
+    {
+        return _size;
+    }
+
+    /**
+     * @brief Append bytes to the file.
+     *
+     * @param[in] data Bytes to write
+     * @param[in] length Number of bytes
+     * @return true if all bytes were written, false on error
+     */
+    bool Write(const void* data, std::size_t length)
+    {
+        const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+        std::size_t bytesWritten = 0;
+        while (bytesWritten < length)
+        {
+#ifdef _WIN32
+            DWORD chunkBytes = 0;
+            const DWORD requestBytes = static_cast<DWORD>(std::min<std::size_t>(length - bytesWritten, MAXDWORD));
+            if (FALSE == WriteFile(_fileHandle, bytes + bytesWritten, requestBytes, &chunkBytes, nullptr))
+            {
+                return false;
+            }
+#else
+            const ssize_t chunkBytes = write(_fileDescriptor, bytes + bytesWritten, length - bytesWritten);
+            if (0 > chunkBytes)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                return false;
+            }
+#endif
+            bytesWritten += static_cast<std::size_t>(chunkBytes);
+        }
+        _size += length;
+        DropBehind(length);
+        if (nullptr != _throttle)
+        {
+            _throttle->AcquireWrite(length);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Write bytes at an offset without moving the write position; several threads may call this at once.
+     *
+     * Unbuffered mode drops the pages only in Finish.
+     *
+     * @param[in] offset File offset of the first byte
+     * @param[in] data Bytes to write
+     * @param[in] length Number of bytes
+     * @return true if all bytes were written, false on error
+     */
+    bool WriteAt(std::uintmax_t offset, const void* data, std::size_t length)
+    {
+        const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+        std::size_t bytesWritten = 0;
+        while (bytesWritten < length)
+        {
+#ifdef _WIN32
+            OVERLAPPED overlapped{};
+            overlapped.Offset = static_cast<DWORD>((offset + bytesWritten) & 0xFFFFFFFFU);
+            overlapped.OffsetHigh = static_cast<DWORD>((offset + bytesWritten) >> 32);
+            DWORD chunkBytes = 0;
+            const DWORD requestBytes = static_cast<DWORD>(std::min<std::size_t>(length - bytesWritten, MAXDWORD));
+            if (FALSE == WriteFile(_fileHandle, bytes + bytesWritten, requestBytes, &chunkBytes, &overlapped))
+            {
+                return false;
+            }
+#else
+            const ssize_t chunkBytes = pwrite(_fileDescriptor, bytes + bytesWritten, length - bytesWritten, static_cast<off_t>(offset + bytesWritten));
+            if (0 > chunkBytes)
+            {
+                if (EINTR == errno)
+                {
+                    continue;
+                }
+                return false;
+            }
+#endif
+            bytesWritten += static_cast<std::size_t>(chunkBytes);
+        }
+        if (nullptr != _throttle)
+        {
+            _throttle->AcquireWrite(length);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Leave a hole instead of writing zeros; Finish sets the size if the file ends in one.
+     *
+     * @param[in] length Number of zero bytes the hole stands for
+     * @return true on success, false on error
+     */
+    bool Skip(std::uintmax_t length)
+    {
+#ifdef _WIN32
+        DWORD returnedBytes = 0;
+        if ((false == _holes) &&
+            (FALSE == DeviceIoControl(_fileHandle, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returnedBytes, nullptr)))
+        {
+            return false;
+        }
+        LARGE_INTEGER distance{};
+        distance.QuadPart = static_cast<LONGLONG>(length);
+        if (FALSE == SetFilePointerEx(_fileHandle, distance, nullptr, FILE_CURRENT))
+        {
+            return false;
+        }
+#else
+        if (0 > lseek(_fileDescriptor, static_cast<off_t>(length), SEEK_CUR))
+        {
+            return false;
+        }
+#endif
+        _holes = true;
+        _size += length;
+        DropBehind(length);
+        return true;
+    }
+
+    /**
+     * @brief Reserve the blocks up to the final size before the first write, without changing the size.
+     *
+     * Copies written side by side, or one copy written at several offsets, then get contiguous extents instead
+     * of interleaved ones. Where the filesystem cannot preallocate, blocks are allocated as the writes arrive.
+     *
+     * @param[in] finalSize Size the file will have once written
+     */
+    void Preallocate(std::uintmax_t finalSize)
+    {
+        if (finalSize <= _size)
+        {
+            return;
+        }
+#ifdef _WIN32
+        FILE_ALLOCATION_INFO allocation{};
+        allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(finalSize);
+        SetFileInformationByHandle(_fileHandle, FileAllocationInfo, &allocation, sizeof(allocation));
+#elif defined(__linux__)
+        _reserved = (0 == fallocate(_fileDescriptor, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(_size), static_cast<off_t>(finalSize - _size)));
+#elif defined(__APPLE__)
+        fstore_t store{F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, static_cast<off_t>(finalSize - _size), 0};
+        _reserved = (-1 != fcntl(_fileDescriptor, F_PREALLOCATE, &store));
+        if (false == _reserved)
+        {
+            store.fst_flags = F_ALLOCATEALL;
+            _reserved = (-1 != fcntl(_fileDescriptor, F_PREALLOCATE, &store));
+        }
+#else
+        static_cast<void>(finalSize);
+#endif
+    }
+
+    /**
+     * @brief Flush the bytes written so far to stable storage.
+     *
+     * @return true on success, false on error
+     */
+    bool Sync()
+    {
+#ifdef _WIN32
+        return FALSE != FlushFileBuffers(_fileHandle);
+#elif defined(__linux__)
+        return 0 == fdatasync(_fileDescriptor);
+#else
+        return 0 == fsync(_fileDescriptor);
+#endif
+    }
+
+    /**
+     * @brief Set the final size after holes and write back and drop whatever unbuffered mode still left in the cache.
+     *
+     * Blocks reserved past the final size, because the source shrank while it was copied, are released.
+     *
+     * @return true on success, false if the size could not be set
+     */
+    bool Finish()
+    {
+#ifdef _WIN32
+        const bool sized = (false == _holes) || (FALSE != SetEndOfFile(_fileHandle));
+#else
+        // Ranges written at offsets leave _size behind, so without holes the reservation is cut at the end of what was written.
+        struct stat fileStatus{};
+        const bool sized = (true == _holes) ? (0 == ftruncate(_fileDescriptor, static_cast<off_t>(_size)))
+                                            : ((false == _reserved) ||
+                                               ((0 == fstat(_fileDescriptor, &fileStatus)) && (0 == ftruncate(_fileDescriptor, fileStatus.st_size))));
+#endif
+        DropBehind(0, true);
+        return sized;
+    }
+
+  private:
+    void DropBehind(std::uintmax_t bytesWritten, bool everything = false)
+    {
+#ifdef __linux__
+        _position += bytesWritten;
+        if ((true == _unbuffered) && ((true == everything) || (DropBehindInterval <= (_position - _dropped))))
+        {
+            const off_t offset = static_cast<off_t>(_dropped);
+            const off_t length = static_cast<off_t>(_position - _dropped);
+            sync_file_range(_fileDescriptor, offset, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            posix_fadvise(_fileDescriptor, offset, length, POSIX_FADV_DONTNEED);
+            _dropped = _position;
+        }
+#else
+        static_cast<void>(bytesWritten);
+        static_cast<void>(everything);
+#endif
+    }
+
+    bool _unbuffered;
+    IoThrottle* _throttle;
+    bool _holes = false;
+    std::uintmax_t _size = 0;
+#ifdef _WIN32
+    HANDLE _fileHandle = INVALID_HANDLE_VALUE;
+#else
+    int _fileDescriptor = -1;
+    bool _reserved = false;
+    std::uintmax_t _position = 0;
+    std::uintmax_t _dropped = 0;
+#endif
+};
+
+/**
+ * @brief Writes the buffers a reading thread filled on a thread of its own, so the source and the destination are busy at once.
+ *
+ * One buffer is written while the reader fills and hashes the other. Hand passes a filled buffer over
+ * once the previous one is written, so the reader only waits when the destination is the slower side.
+ */
+class OverlappedWriter
+{
+  public:
+    explicit OverlappedWriter(OutputFile& outputFile) : _outputFile(outputFile)
+    {
+        _writer = std::thread([this]() { WriterLoop(); });
+    }
+
+    ~OverlappedWriter()
+    {
+        Finish();
+    }
+
+    OverlappedWriter(const OverlappedWriter&) = delete;
+    OverlappedWriter& operator=(const OverlappedWriter&) = delete;
+
+    /**
+     * @brief Queue a filled buffer for writing, after the previous one is written.
+     *
+     * @param[in] data Bytes to append; must stay untouched until the next Hand or Finish returns
+     * @param[in] length Number of bytes
+     * @return false once a write failed, true otherwise
+     */
+    bool Hand(const std::uint8_t* data, std::size_t length)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _written.wait(lock, [this]() { return nullptr == _pending; });
+        if (true == _failed)
+        {
+            return false;
+        }
+        _pending = data;
+        _pendingLength = length;
+        _handed.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Wait for the last buffer to be written and stop the thread.
+     *
+     * @return true if every write succeeded, false otherwise
+     */
+    bool Finish()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _written.wait(lock, [this]() { return nullptr == _pending; });
+            _stopping = true;
+        }
+        _handed.notify_one();
+        if (true == _writer.joinable())
+        {
+            _writer.join();
+        }
+        return false == _failed;
+    }
+
+  private:
+    void WriterLoop()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            _handed.wait(lock, [this]() { return (nullptr != _pending) || (true == _stopping); });
+            if (nullptr == _pending)
+            {
+                return;
+            }
+            const std::uint8_t* data = _pending;
+            const std::size_t length = _pendingLength;
+            lock.unlock();
+            const bool written = (false == _failed) && (true == _outputFile.Write(data, length));
+            lock.lock();
+            _failed = (true == _failed) || (false == written);
+            _pending = nullptr;
+            _written.notify_one();
+        }
+    }
+
+    OutputFile& _outputFile;
+    std::mutex _mutex;
+    std::condition_variable _handed;
+    std::condition_variable _written;
+    const std::uint8_t* _pending = nullptr;
+    std::size_t _pendingLength = 0;
+    bool _failed = false;
+    bool _stopping = false;
+    std::thread _writer;
+};
+
+/**
+ * @brief Copy a dense file through two halves of one buffer, hashing each half on the reading thread while the other is written.
+ *
+ * @param[in,out] inputFile Source positioned at its start
+ * @param[in,out] outputFile Destination
+ * @param[in] buffer Buffer of the hashing context
+ * @param[in] bufferSize Size of the buffer, at least two pages
+ * @param[in,out] hashState Hash the content is fed to
+ * @return true on success, false on a read or write error
+ */
+bool CopyOverlapped(InputFile& inputFile, OutputFile& outputFile, std::uint8_t* buffer, std::size_t bufferSize, StreamingHash& hashState)
+{
+    // Halves stay page-aligned, which unbuffered reads need.
+    const std::size_t pageSize = SystemPageSize();
+    const std::size_t halfSize = std::max(pageSize, ((bufferSize / 2) / pageSize) * pageSize);
+    std::uint8_t* const halves[2] = {buffer, buffer + halfSize};
+    OverlappedWriter writer(outputFile);
+    for (std::size_t half = 0;; half ^= 1)
+    {
+        std::size_t bytesRead = 0;
+        if (false == inputFile.Read(halves[half], halfSize, bytesRead))
+        {
+            writer.Finish();
+            return false;
+        }
+        if (0 == bytesRead)
+        {
+            break;
+        }
+        hashState.Update(halves[half], bytesRead);
+        if (false == writer.Hand(halves[half], bytesRead))
+        {
+            return false;
+        }
+    }
+    return writer.Finish();
+}
+
+/**
+ * @brief Hash a file by streaming it through a caller-provided buffer.
+ *
+ * @param[in,out] inputFile Open file to hash from its read position to its end
+ * @param[in,out] hashState Hash fed with the file content
+ * @param[in] buffer Page-aligned read buffer
+ * @param[in] bufferSize Buffer size in bytes, a multiple of the page size
+ * @return true on success, false on error
+ */
+bool HashStream(InputFile& inputFile, StreamingHash& hashState, std::uint8_t* buffer, std::size_t bufferSize)
+{
+    while (true)
+    {
+        const std::uintmax_t holeBytes = inputFile.SkipHole();
+        if (0 < holeBytes)
+        {
+            hashState.UpdateZeros(holeBytes);
+            continue;
+        }
+        std::size_t bytesRead = 0;
+        if (false == inputFile.Read(buffer, bufferSize, bytesRead))
+        {
+            return false;
+        }
+        if (0 == bytesRead)
+        {
+            return true;
+        }
+        hashState.Update(buffer, bytesRead);
+    }
+}
+
+/**
+ * @brief Read a small file whole into a buffer, asking for one byte more than its size.
+ *
+ * A file that did not grow is then known to be complete without a second read to find its end.
+ *
+ * @param[in,out] inputFile Open file positioned at its start
+ * @param[in] fileSize Size of the file when it was opened
+ * @param[out] buffer Buffer of at least fileSize + 1 bytes
+ * @param[out] outputSize Bytes read; more than fileSize if the file grew, in which case the rest is still unread
+ * @return true on success, false on error
+ */
+bool ReadSmallFile(InputFile& inputFile, std::size_t fileSize, std::uint8_t* buffer, std::size_t& outputSize)
+{
+    outputSize = 0;
+    std::size_t bytesRead = 0;
+    do
+    {
+        if (false == inputFile.Read(buffer + outputSize, fileSize + 1 - outputSize, bytesRead))
+        {
+            return false;
+        }
+        outputSize += bytesRead;
+    } while ((0 < bytesRead) && (outputSize <= fileSize));
+    return true;
+}
+
+/**
+ * @brief Hash the last bytes before an offset, which a resume point keeps to tell whether they were rewritten.
+ *
+ * @param[in,out] inputFile Open file; its read position is not moved
+ * @param[in] end Offset after the last byte
+ * @param[out] buffer Buffer of at least ResumeTailSize bytes
+ * @param[out] outputHash XXH3_64 of the up to ResumeTailSize bytes before end
+ * @return true on success, false on error or if the file ends before end
+ */
+bool HashTail(InputFile& inputFile, std::uintmax_t end, std::uint8_t* buffer, std::uint64_t& outputHash)
+{
+    const std::size_t length = static_cast<std::size_t>(std::min<std::uintmax_t>(end, ResumeTailSize));
+    std::size_t tailSize = 0;
+    while (tailSize < length)
+    {
+        std::size_t bytesRead = 0;
+        if ((false == inputFile.ReadAt(end - length + tailSize, buffer + tailSize, length - tailSize, bytesRead)) || (0 == bytesRead))
+        {
+            return false;
+        }
+        tailSize += bytesRead;
+    }
+    outputHash = XXH3_64bits(buffer, length);
+    return true;
+}
+
+#ifdef _WIN32
+/**
+ * @brief Feed a mapped view to a hash, surviving the view's pages becoming unreadable.
+ *
+ * A page that cannot be read in, such as one of a file on a network share that went away, raises
+ * EXCEPTION_IN_PAGE_ERROR instead of returning an error. The function has no objects to unwind, as
+ * structured exception handling requires.
+ *
+ * @param[in,out] hashState Hash to feed
+ * @param[in] view Mapped view
+ * @param[in] length View length in bytes
+ * @return true if the whole view was hashed, false if a page could not be read
+ */
+bool HashMappedView(StreamingHash& hashState, const void* view, std::size_t length)
+{
+#ifdef _MSC_VER
+    __try
+    {
+        hashState.Update(view, length);
+    }
+    __except ((EXCEPTION_IN_PAGE_ERROR == GetExceptionCode()) ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+    {
+        return false;
+    }
+#else
+    hashState.Update(view, length);
+#endif
+    return true;
+}
+#else
+/**
+ * @brief Recovery point and range of the mapped hash running on this thread; recovery is nullptr while none runs.
+ */
+thread_local sigjmp_buf* MappedHashRecovery = nullptr;
+thread_local const std::uint8_t* MappedHashBegin = nullptr;
+thread_local const std::uint8_t* MappedHashEnd = nullptr;
+
+/**
+ * @brief SIGBUS disposition before OnBusError was installed, to which other faults are handed.
+ */
+struct sigaction PreviousBusAction;
+std::once_flag BusHandlerInstalled;
+
+/**
+ * @brief SIGBUS handler that abandons a mapped hash whose file was truncated under it.
+ *
+ * A fault inside the range this thread is hashing jumps back to HashMappedView. Any other SIGBUS
+ * goes to the handler installed before, and with none the default action ends the process as before.
+ *
+ * @param[in] signalNumber SIGBUS
+ * @param[in] info Fault details, with the faulting address
+ * @param[in] context Interrupted context
+ */
+void OnBusError(int signalNumber, siginfo_t* info, void* context)
+{
+    const std::uint8_t* address = static_cast<const std::uint8_t*>(info->si_addr);
+    sigjmp_buf* recovery = MappedHashRecovery;
+    if ((nullptr != recovery) && (MappedHashBegin <= address) && (address < MappedHashEnd))
+    {
+        siglongjmp(*recovery, 1);
+    }
+    if (0 != (PreviousBusAction.sa_flags & SA_SIGINFO))
+    {
+        PreviousBusAction.sa_sigaction(signalNumber, info, context);
+        return;
+    }
+    if ((SIG_DFL == PreviousBusAction.sa_handler) || (SIG_IGN == PreviousBusAction.sa_handler))
+    {
+        // A fault cannot be ignored; the default action ends the process once the handler returns.
+        signal(SIGBUS, SIG_DFL);
+        raise(SIGBUS);
+        return;
+    }
+    PreviousBusAction.sa_handler(signalNumber);
+}
+
+/**
+ * @brief Install OnBusError for the whole process, once.
+ */
+void InstallBusHandler()
+{
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_sigaction = &OnBusError;
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGBUS, &action, &PreviousBusAction);
+}
+
+/**
+ * @brief Feed a mapped view to a hash, surviving the file being truncated meanwhile.
+ *
+ * Reading a page of a mapping past the end of a file raises SIGBUS, which would otherwise end the
+ * process. The hash is fed by C code and StreamingHash::Update, which hold nothing to destroy, so
+ * jumping out of them abandons the hash cleanly; the caller starts over with buffered reads.
+ *
+ * @param[in,out] hashState Hash to feed
+ * @param[in] view Mapped view
+ * @param[in] length View length in bytes
+ * @return true if the whole view was hashed, false if the file shrank under the mapping
+ */
+bool HashMappedView(StreamingHash& hashState, const void* view, std::size_t length)
+{
+    std::call_once(BusHandlerInstalled, &InstallBusHandler);
+    sigjmp_buf recovery;
+    MappedHashBegin = static_cast<const std::uint8_t*>(view);
+    MappedHashEnd = MappedHashBegin + length;
+    // The signal mask is saved so that the jump out of the handler unblocks SIGBUS again.
+    if (0 != sigsetjmp(recovery, 1))
+    {
+        MappedHashRecovery = nullptr;
+        return false;
+    }
+    MappedHashRecovery = &recovery;
+    hashState.Update(view, length);
+    MappedHashRecovery = nullptr;
+    return true;
+}
+#endif
+
+/**
+ * @brief Hash a file by mapping it into memory and feeding the whole region at once.
+ *
+ * A file that shrinks while it is hashed, such as a live log rotated meanwhile, fails the mapped hash
+ * instead of ending the process, and the caller hashes it with buffered reads like any other file.
+ *
+ * @param[in] inputFile Open file to hash
+ * @param[in] fileSize Size of the file in bytes
+ * @param[in,out] hashState Fresh hash to feed
+ * @return true on success, false if the file cannot be mapped, changed size or shrank while it was hashed
+ */
+bool ComputeMapped(const InputFile& inputFile, std::uintmax_t fileSize, StreamingHash& hashState)
+{
+    if ((0 == fileSize) || (static_cast<std::uintmax_t>(SIZE_MAX) < fileSize) || (false == hashState.IsValid()))
+    {
+        return false;
+    }
+    const std::size_t mappingSize = static_cast<std::size_t>(fileSize);
+#ifdef _WIN32
+    bool mapped = false;
+    HANDLE mappingHandle = CreateFileMappingW(inputFile.Handle(), nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (nullptr != mappingHandle)
+    {
+        const void* view = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, mappingSize);
+        if (nullptr != view)
+        {
+            mapped = HashMappedView(hashState, view, mappingSize);
+            UnmapViewOfFile(view);
+        }
+        CloseHandle(mappingHandle);
+    }
+    return mapped;
+#else
+    // A file that already changed size since it was opened is not mapped at all.
+    struct stat fileStatus;
+    if ((0 != fstat(inputFile.Descriptor(), &fileStatus)) || (static_cast<std::uintmax_t>(fileStatus.st_size) != fileSize))
+    {
+        return false;
+    }
+    void* view = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, inputFile.Descriptor(), 0);
+    if (MAP_FAILED == view)
+    {
+        return false;
+    }
+    madvise(view, mappingSize, MADV_SEQUENTIAL);
+    const bool hashed = HashMappedView(hashState, view, mappingSize);
+    munmap(view, mappingSize);
+    return hashed;
+#endif
+}
+
+#if defined(RDEMO_HAVE_COROUTINES) && defined(__linux__)
+/**
+ * @brief Hash states of one ComputeMany slot, kept by the thread across batches.
+ */
+struct SlotHashStates
+{
+    std::unique_ptr<XXH64_state_t, decltype(&XXH64_freeState)> xxh64State{XXH64_createState(), &XXH64_freeState};
+    std::unique_ptr<XXH3_state_t, decltype(&XXH3_freeState)> xxh3State{XXH3_createState(), &XXH3_freeState};
+    std::unique_ptr<Blake3State> blake3State{std::make_unique<Blake3State>()};
+};
+
+/**
+ * @brief Coroutine hashing one file of a ComputeMany batch.
+ *
+ * It starts suspended; the batch loop resumes it once to start it and then whenever its read completes.
+ * Destroying the task destroys the coroutine with its locals, closing its file.
+ */
+class HashTask
+{
+  public:
+    struct promise_type
+    {
+        HashTask get_return_object()
+        {
+            return HashTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+        std::suspend_always final_suspend() noexcept
+        {
+            return {};
+        }
+        void return_void() noexcept
+        {
+        }
+        void unhandled_exception() noexcept
+        {
+            std::terminate();
+        }
+    };
+
+    HashTask() = default;
+    explicit HashTask(std::coroutine_handle<promise_type> handle) : _handle(handle)
+    {
+    }
+    HashTask(HashTask&& other) noexcept : _handle(std::exchange(other._handle, nullptr))
+    {
+    }
+    HashTask& operator=(HashTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            _handle = std::exchange(other._handle, nullptr);
+        }
+        return *this;
+    }
+    ~HashTask()
+    {
+        Reset();
+    }
+
+    HashTask(const HashTask&) = delete;
+    HashTask& operator=(const HashTask&) = delete;
+
+    /**
+     * @brief Run the coroutine up to its next read or its end.
+     *
+     * @return true once the coroutine has finished
+     */
+    bool Resume()
+    {
+        _handle.resume();
+        return _handle.done();
+    }
+
+  private:
+    void Reset()
+    {
+        if (nullptr != _handle)
+        {
+            _handle.destroy();
+            _handle = nullptr;
+        }
+    }
+
+    std::coroutine_handle<promise_type> _handle;
+};
+
+/**
+ * @brief Awaitable read of one block into a slot; the batch loop stores the result and resumes the reader.
+ */
+struct SlotRead
+{
+    UringReader& reader;
+    int fileDescriptor;
+    std::uint32_t slot;
+    std::uint64_t offset;
+    const int& result; /**< Where the batch loop stores the completion of the slot */
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<>)
+    {
+        reader.QueueFileRead(fileDescriptor, slot, offset, slot);
+    }
+    int await_resume() const noexcept
+    {
+        return result;
+    }
+};
+
+/**
+ * @brief Open file descriptor closed when the owning coroutine ends or is destroyed.
+ */
+class ScopedDescriptor
+{
+  public:
+    explicit ScopedDescriptor(int fileDescriptor) : _fileDescriptor(fileDescriptor)
+    {
+    }
+    ~ScopedDescriptor()
+    {
+        if (0 <= _fileDescriptor)
+        {
+            close(_fileDescriptor);
+        }
+    }
+
+    ScopedDescriptor(const ScopedDescriptor&) = delete;
+    ScopedDescriptor& operator=(const ScopedDescriptor&) = delete;
+
+    int Get() const
+    {
+        return _fileDescriptor;
+    }
+
+  private:
+    int _fileDescriptor;
+};
+
+/**
+ * @brief Hash one file through a slot, reading it block by block to its end.
+ *
+ * On success the job's digest is set and hashed becomes true; on any error the job is left unhashed.
+ */
+HashTask HashThroughSlot(UringReader& reader, std::uint32_t slot, const int& result, HashAlgorithm algorithm, SlotHashStates& states,
+                         IoThrottle* throttle, HashJob& job)
+{
+    const ScopedDescriptor file(OpenForReading(job.filePath));
+    StreamingHash hashState(algorithm, states.xxh64State.get(), states.xxh3State.get(), states.blake3State.get());
+    if ((0 > file.Get()) || (false == hashState.IsValid()))
+    {
+        co_return;
+    }
+    std::uint64_t offset = 0;
+    while (true)
+    {
+        const int bytesRead = co_await SlotRead{reader, file.Get(), slot, offset, result};
+        if ((-EINTR == bytesRead) || (-EAGAIN == bytesRead))
+        {
+            continue;
+        }
+        if (0 > bytesRead)
+        {
+            co_return;
+        }
+        if (0 == bytesRead)
+        {
+            break;
+        }
+        hashState.Update(reader.SlotBuffer(slot), static_cast<std::size_t>(bytesRead));
+        if (nullptr != throttle)
+        {
+            throttle->AcquireRead(static_cast<std::size_t>(bytesRead));
+        }
+        offset += static_cast<std::uint64_t>(bytesRead);
+    }
+    job.digest = hashState.Digest();
+    job.hashed = true;
+}
+
+/**
+ * @brief Hash files with one coroutine per file, keeping a read of up to one file per slot in flight.
+ *
+ * A finished coroutine hands its slot to the next file, so the ring stays full until the batch runs out.
+ *
+ * @param[in,out] jobs Files to hash
+ * @param[in,out] reader Ring of the calling thread, with no reads in flight
+ * @param[in] algorithm Hash algorithm to use
+ * @param[in,out] slotStates Hash states per slot, grown as needed
+ * @param[in] throttle Rate limiter the reads are charged to, may be nullptr
+ * @return true on success, false if the ring failed; the reader must not be used again then
+ */
+bool HashConcurrently(const std::vector<HashJob*>& jobs, UringReader& reader, HashAlgorithm algorithm, std::vector<SlotHashStates>& slotStates,
+                      IoThrottle* throttle)
+{
+    const std::uint32_t slotCount = static_cast<std::uint32_t>(std::min<std::size_t>(reader.QueueDepth(), jobs.size()));
+    if (slotStates.size() < slotCount)
+    {
+        slotStates.resize(slotCount);
+    }
+    std::vector<int> results(slotCount, 0);
+    std::vector<HashTask> tasks(slotCount);
+    std::vector<std::uint32_t> readySlots;
+    std::size_t nextJob = 0;
+    std::size_t running = 0;
+    const auto startNext = [&](std::uint32_t slot)
+    {
+        while (nextJob < jobs.size())
+        {
+            tasks[slot] = HashThroughSlot(reader, slot, results[slot], algorithm, slotStates[slot], throttle, *jobs[nextJob++]);
+            if (false == tasks[slot].Resume())
+            {
+                ++running;
+                return;
+            }
+        }
+        tasks[slot] = HashTask();
+    };
+
+    for (std::uint32_t slot = 0; slot < slotCount; ++slot)
+    {
+        startNext(slot);
+    }
+    while (0 < running)
+    {
+        readySlots.clear();
+        const auto onCompletion = [&results, &readySlots](std::uint64_t userData, int result)
+        {
+            results[static_cast<std::size_t>(userData)] = result;
+            readySlots.push_back(static_cast<std::uint32_t>(userData));
+        };
+        if (false == reader.WaitForCompletions(onCompletion))
+        {
+            return false;
+        }
+        // Resumed only after reaping, so the reads they queue go out together with the next wait.
+        for (const std::uint32_t slot : readySlots)
+        {
+            if (true == tasks[slot].Resume())
+            {
+                --running;
+                startNext(slot);
+            }
+        }
+    }
+    return true;
+}
+#endif
+
+/**
+ * @brief Fires the hash_begin and hash_done probes around the reading and hashing of one file.
+ */
+class HashProbe
+{
+  public:
+    explicit HashProbe(const std::filesystem::path& filePath) : _filePath(filePath)
+    {
+        RDEMO_PROBE1(hash_begin, _filePath.c_str());
+    }
+
+    ~HashProbe()
+    {
+        RDEMO_PROBE1(hash_done, _filePath.c_str());
+    }
+
+    HashProbe(const HashProbe&) = delete;
+    HashProbe& operator=(const HashProbe&) = delete;
+
+  private:
+    const std::filesystem::path& _filePath;
+};
+}
+
+bool HashDigest::FromBytes(const void* data, std::size_t length, HashDigest& outputDigest)
+{
+    if ((nullptr == data) || (0 == length) || (MaxSize < length))
+    {
+        return false;
+    }
+    outputDigest.bytes.fill(0);
+    std::memcpy(outputDigest.bytes.data(), data, length);
+    outputDigest.size = static_cast<std::uint8_t>(length);
+    return true;
+}
+
+std::string HashDigest::ToHex() const
+{
+    std::string hexText;
+    hexText.reserve(static_cast<std::size_t>(size) * 2);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hexText.push_back(HexDigits[bytes[i] >> HexNibbleBits]);
+        hexText.push_back(HexDigits[bytes[i] & HexNibbleMask]);
+    }
+    return hexText;
+}
+
+bool HashDigest::operator==(const HashDigest& other) const
+{
+    return (size == other.size) && (0 == std::memcmp(bytes.data(), other.bytes.data(), size));
+}
+
+bool HashDigest::operator!=(const HashDigest& other) const
+{
+    return !(*this == other);
+}
+
+FileHasher::Context::Context(std::size_t bufferSize)
+{
+    const std::size_t pageSize = SystemPageSize();
+    const std::size_t requestedSize = (0 != bufferSize) ? bufferSize : DefaultReadBufferSize;
+    _bufferSize = ((requestedSize + pageSize - 1) / pageSize) * pageSize;
+
+#ifdef _WIN32
+    _buffer = static_cast<std::uint8_t*>(VirtualAlloc(nullptr, _bufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+    void* mapping = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // Only succeeds when huge pages are reserved; transparent huge pages are requested below otherwise.
+    if (0 == (_bufferSize % HugePageSize))
+    {
+        mapping = mmap(nullptr, _bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (MAP_FAILED == mapping)
+    {
+        mapping = mmap(nullptr, _bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+        if (MAP_FAILED != mapping)
+        {
+            madvise(mapping, _bufferSize, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    _buffer = (MAP_FAILED != mapping) ? static_cast<std::uint8_t*>(mapping) : nullptr;
+#endif
+
+    _xxh64State = XXH64_createState();
+    _xxh3State = XXH3_createState();
+    _blake3State = new Blake3State();
+}
+
+FileHasher::Context::~Context()
+{
+    if (nullptr != _buffer)
+    {
+#ifdef _WIN32
+        VirtualFree(_buffer, 0, MEM_RELEASE);
+#else
+        munmap(_buffer, _bufferSize);
+#endif
+    }
+    if (nullptr != _xxh64State)
+    {
+        XXH64_freeState(_xxh64State);
+    }
+    if (nullptr != _xxh3State)
+    {
+        XXH3_freeState(_xxh3State);
+    }
+    delete _blake3State;
+}
+
+bool FileHasher::Context::IsValid() const
+{
+    return (nullptr != _buffer) && (nullptr != _xxh64State) && (nullptr != _xxh3State) && (nullptr != _blake3State);
+}
+
+std::size_t FileHasher::Context::BufferSize() const
+{
+    return _bufferSize;
+}
+
+/**
+ * @brief Resources the hasher keeps for one calling thread.
+ */
+struct FileHasher::ThreadState
+{
+    std::unique_ptr<Context> context;    /**< Buffer and hash states of the thread, allocated on first use */
+    std::unique_ptr<UringReader> reader; /**< io_uring reader, set up on first use */
+    bool readerTried = false;            /**< Reader setup was attempted; a failed setup is not retried */
+#if defined(RDEMO_HAVE_COROUTINES) && defined(__linux__)
+    std::vector<SlotHashStates> slotStates; /**< Hash states of the ComputeMany slots, allocated on first use */
+#endif
+};
+
+FileHasher::FileHasher(HashAlgorithm algorithm, std::uintmax_t memoryMapThreshold, unsigned int treeThreads, ReadEngine readEngine,
+                       unsigned int readQueueDepth, std::uintmax_t unbufferedThreshold, std::size_t readBufferSize, IoThrottle* throttle)
+    : _algorithm(algorithm), _memoryMapThreshold(memoryMapThreshold),
+      _treeThreads((0 != treeThreads) ? treeThreads : std::max(1U, std::thread::hardware_concurrency())), _readEngine(readEngine),
+      _readQueueDepth((0 != readQueueDepth) ? readQueueDepth : DefaultReadQueueDepth), _unbufferedThreshold(unbufferedThreshold),
+      _readBufferSize(readBufferSize), _throttle(throttle)
+{
+}
+
+FileHasher::~FileHasher() = default;
+
+HashAlgorithm FileHasher::Algorithm() const
+{
+    return _algorithm;
+}
+
+bool FileHasher::Compute(const std::filesystem::path& filePath, HashDigest& outputDigest) const
+{
+    return Compute(filePath, _algorithm, outputDigest);
+}
+
+bool FileHasher::Compute(const std::filesystem::path& filePath, HashAlgorithm algorithm, HashDigest& outputDigest) const
+{
+    ThreadState& threadState = AcquireThreadState();
+    return Compute(filePath, algorithm, AcquireContext(threadState), &threadState, outputDigest);
+}
+
+bool FileHasher::Compute(const std::filesystem::path& filePath, Context& context, HashDigest& outputDigest) const
+{
+    return Compute(filePath, _algorithm, context, outputDigest);
+}
+
+bool FileHasher::Compute(const std::filesystem::path& filePath, HashAlgorithm algorithm, Context& context, HashDigest& outputDigest) const
+{
+    ThreadState* threadState = (ReadEngine::IoUring == _readEngine) ? &AcquireThreadState() : nullptr;
+    return Compute(filePath, algorithm, context, threadState, outputDigest);
+}
+
+void FileHasher::ComputeMany(std::vector<HashJob>& jobs) const
+{
+    RDEMO_SCOPE("hash.batch");
+    RDEMO_COUNT("hash.batch.files", jobs.size());
+    for (HashJob& job : jobs)
+    {
+        job.hashed = false;
+    }
+#if defined(RDEMO_HAVE_COROUTINES) && defined(__linux__)
+    ThreadState* threadState = (ReadEngine::IoUring == _readEngine) ? &AcquireThreadState() : nullptr;
+    UringReader* reader = (nullptr != threadState) ? AcquireReader(*threadState) : nullptr;
+    if (nullptr != reader)
+    {
+        // Sparse files, and files Compute would split across threads or read past the page cache, keep that path.
+        std::vector<HashJob*> concurrentJobs;
+        for (HashJob& job : jobs)
+        {
+            std::uintmax_t fileSize = 0;
+            bool sparse = false;
+            const bool sizeKnown = StatFile(job.filePath, fileSize, sparse);
+            const bool treeParallel = (1 < _treeThreads) && (((HashAlgorithm::XXH3_128_Tree == _algorithm) && (TreeSegmentSize < fileSize)) ||
+                                                             ((HashAlgorithm::BLAKE3 == _algorithm) && (Blake3SegmentSize < fileSize)));
+            if ((true == sizeKnown) && (false == sparse) && (false == treeParallel) && (false == IsUnbuffered(fileSize)))
+            {
+                concurrentJobs.push_back(&job);
+            }
+        }
+        if (false == HashConcurrently(concurrentJobs, *reader, _algorithm, threadState->slotStates, _throttle))
+        {
+            threadState->reader.reset();
+        }
+    }
+#endif
+    // The context is looked up once for the batch rather than once per file.
+    ThreadState& batchThreadState = AcquireThreadState();
+    Context& context = AcquireContext(batchThreadState);
+    ThreadState* readerThreadState = (ReadEngine::IoUring == _readEngine) ? &batchThreadState : nullptr;
+    for (HashJob& job : jobs)
+    {
+        if (false == job.hashed)
+        {
+            job.hashed = Compute(job.filePath, _algorithm, context, readerThreadState, job.digest);
+        }
+    }
+}
 
-namespace
+bool FileHasher::HashesConcurrently(ReadEngine readEngine)
 {
-constexpr std::size_t FileReadBufferSize = 8192;
-constexpr XXH64_hash_t HashSeed = 0;
+#if defined(RDEMO_HAVE_COROUTINES) && defined(__linux__)
+    return ReadEngine::IoUring == readEngine;
+#else
+    static_cast<void>(readEngine);
+    return false;
+#endif
+}
+
+bool FileHasher::ComputeAndCopy(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath,
+                                HashDigest& outputDigest) const
+{
+    return ComputeAndCopy(sourcePath, destinationPath, AcquireContext(AcquireThreadState()), outputDigest);
+}
+
+bool FileHasher::ComputeAndCopy(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath, Context& context,
+                                HashDigest& outputDigest) const
+{
+    RDEMO_SCOPE("hash.copy");
+    const HashProbe probe(sourcePath);
+    if (false == context.IsValid())
+    {
+        return false;
+    }
+
+    InputFile inputFile(sourcePath, _throttle);
+    if (false == inputFile.IsOpen())
+    {
+        return false;
+    }
+    std::uintmax_t fileSize = 0;
+    const bool unbuffered = (true == inputFile.Size(fileSize)) && (true == IsUnbuffered(fileSize));
+    if (true == unbuffered)
+    {
+        inputFile.SetUnbuffered();
+    }
+    OutputFile outputFile(destinationPath, unbuffered, _throttle);
+    if (false == outputFile.IsOpen())
+    {
+        return false;
+    }
+    // Holes stay holes, so only dense copies reserve their blocks up front.
+    if (false == inputFile.IsSparse())
+    {
+        outputFile.Preallocate(fileSize);
+    }
+
+    // A parallel hash reads several ranges at once; each thread writes what it read at the same offset of the copy.
+    const bool treeParallel = (false == inputFile.IsSparse()) && (true == inputFile.Size(fileSize)) && (1 < _treeThreads) &&
+                              (((HashAlgorithm::XXH3_128_Tree == _algorithm) && (TreeSegmentSize < fileSize)) ||
+                               ((HashAlgorithm::BLAKE3 == _algorithm) && (Blake3SegmentSize < fileSize)));
+    if (true == treeParallel)
+    {
+        const RangeSink copyRange = [&outputFile](std::uintmax_t offset, const void* data, std::size_t length)
+        { return outputFile.WriteAt(offset, data, length); };
+        const bool computed = (HashAlgorithm::XXH3_128_Tree == _algorithm) ? ComputeTreeParallel(inputFile, fileSize, _treeThreads, copyRange, outputDigest)
+                                                                           : ComputeBlake3Parallel(inputFile, fileSize, _treeThreads, copyRange, outputDigest);
+        if (true == unbuffered)
+        {
+            inputFile.DropCachedPages();
+        }
+        return (true == computed) && (true == outputFile.Finish());
+    }
+
+    StreamingHash hashState(_algorithm, context._xxh64State, context._xxh3State, context._blake3State);
+    // A large dense file is read and hashed into one half of the buffer while the other half is written.
+    const bool overlapped = (false == inputFile.IsSparse()) && (OverlappedCopyThreshold <= fileSize) &&
+                            ((2 * SystemPageSize()) <= context._bufferSize);
+    if ((true == overlapped) && (false == CopyOverlapped(inputFile, outputFile, context._buffer, context._bufferSize, hashState)))
+    {
+        return false;
+    }
+    while (false == overlapped)
+    {
+        const std::uintmax_t holeBytes = inputFile.SkipHole();
+        if (0 < holeBytes)
+        {
+            hashState.UpdateZeros(holeBytes);
+            if (false == outputFile.Skip(holeBytes))
+            {
+                return false;
+            }
+            continue;
+        }
+        std::size_t bytesRead = 0;
+        if (false == inputFile.Read(context._buffer, context._bufferSize, bytesRead))
+        {
+            return false;
+        }
+        if (0 == bytesRead)
+        {
+            break;
+        }
+        hashState.Update(context._buffer, bytesRead);
+        if (false == outputFile.Write(context._buffer, bytesRead))
+        {
+            return false;
+        }
+    }
+
+    if (false == outputFile.Finish())
+    {
+        return false;
+    }
+    outputDigest = hashState.Digest();
+    return true;
+}
+
+bool FileHasher::SupportsResume(HashAlgorithm algorithm)
+{
+    return HashAlgorithm::XXH3_128_Tree != algorithm;
 }
 
-bool FileHasher::Compute(const std::filesystem::path& filePath, std::string& outputHash) const
+bool FileHasher::ComputeAndAppend(const std::filesystem::path& sourcePath, const std::filesystem::path& destinationPath, HashResumePoint& resumePoint,
+                                  HashDigest& outputDigest, std::uintmax_t checkpointInterval,
+                                  const std::function<void(const HashResumePoint&, std::uint64_t)>& onCheckpoint) const
 {
-    std::ifstream inputStream(filePath, std::ios::binary);
-    if (false == inputStream.is_open())
+    RDEMO_SCOPE("hash.append");
+    const HashProbe probe(sourcePath);
+    Context& context = AcquireContext(AcquireThreadState());
+    const bool resuming = (0 < resumePoint.size);
+    if ((false == context.IsValid()) || (false == SupportsResume(_algorithm)) || ((true == resuming) && (resumePoint.algorithm != _algorithm)))
     {
         return false;
     }
 
-    XXH64_state_t* hashState = XXH64_createState();
-    if (nullptr == hashState)
+    // Holes would be appended as data, so sparse files are copied whole by ComputeAndCopy instead.
+    InputFile inputFile(sourcePath, _throttle);
+    std::uintmax_t fileSize = 0;
+    if ((false == inputFile.IsOpen()) || (false == inputFile.Size(fileSize)) || (true == inputFile.IsSparse()) || (fileSize < resumePoint.size))
     {
         return false;
     }
+    StreamingHash hashState(_algorithm, context._xxh64State, context._xxh3State, context._blake3State);
+    std::uint64_t tailHash = 0;
+    if ((true == resuming) &&
+        ((false == hashState.Restore(resumePoint.state)) || (false == HashTail(inputFile, resumePoint.size, context._buffer, tailHash)) ||
+         (resumePoint.tailHash != tailHash) || (false == inputFile.Seek(resumePoint.size))))
+    {
+        return false;
+    }
+    const bool unbuffered = IsUnbuffered(fileSize - resumePoint.size);
+    if (true == unbuffered)
+    {
+        inputFile.SetUnbuffered();
+    }
+    OutputFile outputFile(destinationPath, unbuffered, _throttle, resuming);
+    if ((false == outputFile.IsOpen()) || (resumePoint.size != outputFile.Size()))
+    {
+        return false;
+    }
+    outputFile.Preallocate(fileSize);
+
+    // The bytes of the current chunk are hashed on the side, so a resumed copy can check the chunk it continues after.
+    const bool checkpointing = (0 < checkpointInterval) && (onCheckpoint);
+    const std::unique_ptr<XXH3_state_t, decltype(&XXH3_freeState)> chunkState((true == checkpointing) ? XXH3_createState() : nullptr,
+                                                                                     &XXH3_freeState);
+    if ((true == checkpointing) && ((nullptr == chunkState) || (XXH_OK != XXH3_64bits_reset(chunkState.get()))))
+    {
+        return false;
+    }
+    std::uintmax_t chunkFill = 0;
+    HashResumePoint checkpoint{};
+    while (true)
+    {
+        std::size_t bytesRead = 0;
+        if (false == inputFile.Read(context._buffer, context._bufferSize, bytesRead))
+        {
+            return false;
+        }
+        if (0 == bytesRead)
+        {
+            break;
+        }
+        hashState.Update(context._buffer, bytesRead);
+        if (false == outputFile.Write(context._buffer, bytesRead))
+        {
+            return false;
+        }
+        if (false == checkpointing)
+        {
+            continue;
+        }
+        XXH3_64bits_update(chunkState.get(), context._buffer, bytesRead);
+        chunkFill += bytesRead;
+        if (checkpointInterval > chunkFill)
+        {
+            continue;
+        }
+        // A checkpoint is only reported once the bytes it covers are durable.
+        checkpoint.algorithm = _algorithm;
+        checkpoint.size = outputFile.Size();
+        if ((false == outputFile.Sync()) || (false == HashTail(inputFile, checkpoint.size, context._buffer, checkpoint.tailHash)) ||
+            (false == hashState.Save(checkpoint.state)))
+        {
+            return false;
+        }
+        onCheckpoint(checkpoint, XXH3_64bits_digest(chunkState.get()));
+        XXH3_64bits_reset(chunkState.get());
+        chunkFill = 0;
+    }
+    const std::uintmax_t copiedSize = outputFile.Size();
+    if ((false == outputFile.Finish()) || (false == HashTail(inputFile, copiedSize, context._buffer, tailHash)) ||
+        (false == hashState.Save(resumePoint.state)))
+    {
+        return false;
+    }
+    resumePoint.algorithm = _algorithm;
+    resumePoint.size = copiedSize;
+    resumePoint.tailHash = tailHash;
+    outputDigest = hashState.Digest();
+    return true;
+}
+
+bool FileHasher::ComputeRangeHash(const std::filesystem::path& filePath, std::uintmax_t offset, std::uintmax_t length, std::uint64_t& outputHash) const
+{
+    Context& context = AcquireContext(AcquireThreadState());
+    InputFile inputFile(filePath, _throttle);
+    const std::unique_ptr<XXH3_state_t, decltype(&XXH3_freeState)> rangeState(XXH3_createState(), &XXH3_freeState);
+    if ((false == context.IsValid()) || (false == inputFile.IsOpen()) || (nullptr == rangeState) || (XXH_OK != XXH3_64bits_reset(rangeState.get())))
+    {
+        return false;
+    }
+    while (0 < length)
+    {
+        std::size_t bytesRead = 0;
+        if ((false == inputFile.ReadAt(offset, context._buffer, static_cast<std::size_t>(std::min<std::uintmax_t>(length, context._bufferSize)), bytesRead)) ||
+            (0 == bytesRead))
+        {
+            return false;
+        }
+        XXH3_64bits_update(rangeState.get(), context._buffer, bytesRead);
+        offset += bytesRead;
+        length -= bytesRead;
+    }
+    outputHash = XXH3_64bits_digest(rangeState.get());
+    return true;
+}
+
+bool FileHasher::ResumePointDigest(const HashResumePoint& resumePoint, HashDigest& outputDigest) const
+{
+    Context& context = AcquireContext(AcquireThreadState());
+    if ((false == context.IsValid()) || (false == SupportsResume(resumePoint.algorithm)))
+    {
+        return false;
+    }
+    StreamingHash hashState(resumePoint.algorithm, context._xxh64State, context._xxh3State, context._blake3State);
+    if ((0 < resumePoint.size) && (false == hashState.Restore(resumePoint.state)))
+    {
+        return false;
+    }
+    outputDigest = hashState.Digest();
+    return true;
+}
+
+bool FileHasher::ComputeAndStream(const std::filesystem::path& sourcePath,
+                                  const std::function<bool(const std::uint8_t*, std::size_t)>& consumer, HashDigest& outputDigest) const
+{
+    RDEMO_SCOPE("hash.stream");
+    const HashProbe probe(sourcePath);
+    Context& context = AcquireContext(AcquireThreadState());
+    if (false == context.IsValid())
+    {
+        return false;
+    }
+    InputFile inputFile(sourcePath, _throttle);
+    if (false == inputFile.IsOpen())
+    {
+        return false;
+    }
+    std::uintmax_t fileSize = 0;
+    if ((true == inputFile.Size(fileSize)) && (true == IsUnbuffered(fileSize)))
+    {
+        inputFile.SetUnbuffered();
+    }
 
-    XXH64_reset(hashState, HashSeed);
+    StreamingHash hashState(_algorithm, context._xxh64State, context._xxh3State, context._blake3State);
+    while (true)
+    {
+        std::uintmax_t holeBytes = inputFile.SkipHole();
+        if (0 < holeBytes)
+        {
+            // The consumer gets the zeros of a hole, but they are never read.
+            hashState.UpdateZeros(holeBytes);
+            for (; 0 < holeBytes; holeBytes -= std::min<std::uintmax_t>(holeBytes, ZeroBlockSize))
+            {
+                if (false == consumer(ZeroBlock, static_cast<std::size_t>(std::min<std::uintmax_t>(holeBytes, ZeroBlockSize))))
+                {
+                    return false;
+                }
+            }
+            continue;
+        }
+        std::size_t bytesRead = 0;
+        if (false == inputFile.Read(context._buffer, context._bufferSize, bytesRead))
+        {
+            return false;
+        }
+        if (0 == bytesRead)
+        {
+            break;
+        }
+        hashState.Update(context._buffer, bytesRead);
+        if (false == consumer(context._buffer, bytesRead))
+        {
+            return false;
+        }
+    }
+    outputDigest = hashState.Digest();
+    return true;
+}
 
-    char buffer[FileReadBufferSize];
-    const std::streamsize bufferSize = static_cast<std::streamsize>(sizeof(buffer));
+bool FileHasher::ComputeStream(HashAlgorithm algorithm, const std::function<bool(std::uint8_t*, std::size_t, std::size_t&)>& producer,
+                               HashDigest& outputDigest) const
+{
+    Context& context = AcquireContext(AcquireThreadState());
+    if (false == context.IsValid())
+    {
+        return false;
+    }
+    StreamingHash hashState(algorithm, context._xxh64State, context._xxh3State, context._blake3State);
     while (true)
     {
-        inputStream.read(buffer, bufferSize);
-        const std::streamsize bytesRead = inputStream.gcount();
+        std::size_t bytesRead = 0;
+        if (false == producer(context._buffer, context._bufferSize, bytesRead))
+        {
+            return false;
+        }
         if (0 == bytesRead)
         {
             break;
         }
-        XXH64_update(hashState, buffer, static_cast<size_t>(bytesRead));
-        if (bufferSize > bytesRead)
+        hashState.Update(context._buffer, bytesRead);
+    }
+    outputDigest = hashState.Digest();
+    return true;
+}
+
+bool FileHasher::ComputeAndRead(const std::filesystem::path& filePath, std::vector<std::uint8_t>& outputContent, HashDigest& outputDigest) const
+{
+    RDEMO_SCOPE("hash.read");
+    const HashProbe probe(filePath);
+    InputFile inputFile(filePath, _throttle);
+    if (false == inputFile.IsOpen())
+    {
+        return false;
+    }
+
+    // The size is only a hint; a file that grows while it is read is read to its end.
+    std::uintmax_t fileSize = 0;
+    outputContent.resize((true == inputFile.Size(fileSize)) ? static_cast<std::size_t>(fileSize) + 1 : ReadBlockSize);
+    std::size_t contentSize = 0;
+    while (true)
+    {
+        if (outputContent.size() == contentSize)
+        {
+            outputContent.resize(contentSize * 2);
+        }
+        std::size_t bytesRead = 0;
+        if (false == inputFile.Read(outputContent.data() + contentSize, outputContent.size() - contentSize, bytesRead))
+        {
+            return false;
+        }
+        if (0 == bytesRead)
         {
             break;
         }
+        contentSize += bytesRead;
+    }
+    outputContent.resize(contentSize);
+    outputDigest = HashRegion(_algorithm, outputContent.data(), outputContent.size());
+    return true;
+}
+
+bool FileHasher::ComputeSample(const std::filesystem::path& filePath, std::size_t blockSize, unsigned int randomBlocks, HashDigest& outputDigest) const
+{
+    RDEMO_SCOPE("hash.sample");
+    const HashProbe probe(filePath);
+    Context& context = AcquireContext(AcquireThreadState());
+    InputFile inputFile(filePath, _throttle);
+    std::uintmax_t fileSize = 0;
+    if ((false == context.IsValid()) || (0 == blockSize) || (false == inputFile.IsOpen()) || (false == inputFile.Size(fileSize)))
+    {
+        return false;
+    }
+
+    // Block indices: the first, the last and randomBlocks drawn from the ones between. The generator is seeded
+    // with the size, so every run samples the same blocks of an unchanged file.
+    const std::uintmax_t blockCount = (fileSize + blockSize - 1) / blockSize;
+    std::vector<std::uintmax_t> blocks;
+    if (blockCount <= static_cast<std::uintmax_t>(randomBlocks) + 2)
+    {
+        for (std::uintmax_t block = 0; block < blockCount; ++block)
+        {
+            blocks.push_back(block);
+        }
+    }
+    else
+    {
+        blocks.push_back(0);
+        blocks.push_back(blockCount - 1);
+        std::uint64_t state = static_cast<std::uint64_t>(fileSize);
+        for (unsigned int drawn = 0; drawn < randomBlocks; ++drawn)
+        {
+            // splitmix64
+            std::uint64_t value = (state += 0x9E3779B97F4A7C15ULL);
+            value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+            value ^= value >> 31;
+            blocks.push_back(1 + value % (blockCount - 2));
+        }
+        std::sort(blocks.begin(), blocks.end());
+        blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+    }
+
+    // The size leads the digest, so files that differ only in length past the last sampled byte still differ.
+    StreamingHash hashState(_algorithm, context._xxh64State, context._xxh3State, context._blake3State);
+    const std::uint64_t sizeBytes = static_cast<std::uint64_t>(fileSize);
+    hashState.Update(reinterpret_cast<const std::uint8_t*>(&sizeBytes), sizeof(sizeBytes));
+    for (const std::uintmax_t block : blocks)
+    {
+        std::uintmax_t offset = block * blockSize;
+        const std::uintmax_t end = std::min<std::uintmax_t>(offset + blockSize, fileSize);
+        while (offset < end)
+        {
+            std::size_t bytesRead = 0;
+            const std::size_t length = static_cast<std::size_t>(std::min<std::uintmax_t>(end - offset, context._bufferSize));
+            if ((false == inputFile.ReadAt(offset, context._buffer, length, bytesRead)) || (0 == bytesRead))
+            {
+                return false;
+            }
+            hashState.Update(context._buffer, bytesRead);
+            offset += bytesRead;
+        }
+    }
+    outputDigest = hashState.Digest();
+    return true;
+}
+
+HashDigest FileHasher::ComputeBuffer(HashAlgorithm algorithm, const void* data, std::size_t length)
+{
+    return HashRegion(algorithm, data, length);
+}
+
+/**
+ * @brief Compute a content hash, reading through the given context.
+ *
+ * @param[in] filePath Path to the file to hash
+ * @param[in] algorithm Hash algorithm to use
+ * @param[in,out] context Buffer and hash states to use
+ * @param[in,out] threadState Resources of the calling thread for the io_uring engine, nullptr skips the ring
+ * @param[out] outputDigest Output binary digest
+ * @return true on success, false on error
+ */
+bool FileHasher::Compute(const std::filesystem::path& filePath, HashAlgorithm algorithm, Context& context, ThreadState* threadState,
+                         HashDigest& outputDigest) const
+{
+    RDEMO_SCOPE("hash");
+    const HashProbe probe(filePath);
+    if (false == context.IsValid())
+    {
+        return false;
+    }
+
+    // Every path below reads through this one handle, so the file is opened and stat'ed once.
+    InputFile inputFile(filePath, _throttle);
+    if (false == inputFile.IsOpen())
+    {
+        return false;
+    }
+    std::uintmax_t fileSize = 0;
+    const bool sizeKnown = inputFile.Size(fileSize);
+    const bool unbuffered = (true == sizeKnown) && (true == IsUnbuffered(fileSize));
+
+    if ((false == inputFile.IsSparse()) && (true == sizeKnown) && (SmallFileSize >= fileSize) && (fileSize < context._bufferSize) &&
+        (false == unbuffered))
+    {
+        // A small file is hashed from one read in one call, without the streaming state.
+        std::size_t contentSize = 0;
+        if (false == ReadSmallFile(inputFile, static_cast<std::size_t>(fileSize), context._buffer, contentSize))
+        {
+            return false;
+        }
+        if (contentSize <= fileSize)
+        {
+            outputDigest = HashRegion(algorithm, context._buffer, contentSize);
+            return true;
+        }
+        StreamingHash hashState(algorithm, context._xxh64State, context._xxh3State, context._blake3State);
+        hashState.Update(context._buffer, contentSize);
+        if (false == HashStream(inputFile, hashState, context._buffer, context._bufferSize))
+        {
+            return false;
+        }
+        outputDigest = hashState.Digest();
+        return true;
+    }
+    if ((false == inputFile.IsSparse()) && (true == sizeKnown) && (HashAlgorithm::XXH3_128_Tree == algorithm) && (1 < _treeThreads) &&
+        (TreeSegmentSize < fileSize))
+    {
+        const bool computed = ComputeTreeParallel(inputFile, fileSize, _treeThreads, RangeSink(), outputDigest);
+        if (true == unbuffered)
+        {
+            inputFile.DropCachedPages();
+        }
+        return computed;
+    }
+    if ((false == inputFile.IsSparse()) && (true == sizeKnown) && (HashAlgorithm::BLAKE3 == algorithm) && (1 < _treeThreads) &&
+        (Blake3SegmentSize < fileSize))
+    {
+        const bool computed = ComputeBlake3Parallel(inputFile, fileSize, _treeThreads, RangeSink(), outputDigest);
+        if (true == unbuffered)
+        {
+            inputFile.DropCachedPages();
+        }
+        return computed;
+    }
+
+    // Mapping, the ring and the tree threads would all read the holes of a sparse file; the stream skips them.
+    if ((true == inputFile.IsSparse()) || (true == unbuffered))
+    {
+        if (true == unbuffered)
+        {
+            inputFile.SetUnbuffered();
+        }
+        StreamingHash hashState(algorithm, context._xxh64State, context._xxh3State, context._blake3State);
+        if (false == HashStream(inputFile, hashState, context._buffer, context._bufferSize))
+        {
+            return false;
+        }
+        outputDigest = hashState.Digest();
+        return true;
+    }
+
+#ifdef _WIN32
+    static_cast<void>(threadState);
+#else
+    UringReader* reader = ((nullptr != threadState) && (true == sizeKnown)) ? AcquireReader(*threadState) : nullptr;
+    if (nullptr != reader)
+    {
+        StreamingHash hashState(algorithm, context._xxh64State, context._xxh3State, context._blake3State);
+        // Some files (procfs, pipes, some FUSE filesystems) refuse fixed reads; they take the blocking path,
+        // which starts over at the beginning since the ring never moves the read position.
+        const auto onData = [&hashState, this](const void* data, std::size_t length)
+        {
+            hashState.Update(data, length);
+            if (nullptr != _throttle)
+            {
+                _throttle->AcquireRead(length);
+            }
+        };
+        if (true == reader->Read(inputFile.Descriptor(), fileSize, onData))
+        {
+            outputDigest = hashState.Digest();
+            return true;
+        }
     }
+#endif
 
-    uint64_t hashValue = XXH64_digest(hashState);
-    XXH64_freeState(hashState);
+    // A mapping is hashed in one call, which leaves nothing to pace, so a throttled hasher streams instead.
+    if ((nullptr == _throttle) && (0 != _memoryMapThreshold) && (true == sizeKnown) && (_memoryMapThreshold <= fileSize))
+    {
+        StreamingHash mappedState(algorithm, context._xxh64State, context._xxh3State, context._blake3State);
+        if (true == ComputeMapped(inputFile, fileSize, mappedState))
+        {
+            outputDigest = mappedState.Digest();
+            return true;
+        }
+    }
 
-    std::ostringstream outputStream;
-    outputStream << std::hex << hashValue;
-    outputHash = outputStream.str();
+    StreamingHash hashState(algorithm, context._xxh64State, context._xxh3State, context._blake3State);
+    if (false == HashStream(inputFile, hashState, context._buffer, context._bufferSize))
+    {
+        return false;
+    }
+    outputDigest = hashState.Digest();
     return true;
 }
+
+/**
+ * @brief Check whether a file is large enough to be read without leaving it in the page cache.
+ *
+ * @param[in] fileSize Size of the file in bytes
+ * @return true if the unbuffered mode applies
+ */
+bool FileHasher::IsUnbuffered(std::uintmax_t fileSize) const
+{
+    return (0 != _unbufferedThreshold) && (_unbufferedThreshold <= fileSize);
+}
+
+/**
+ * @brief Get the resources of the calling thread, creating them on first use.
+ *
+ * @return Thread state, only to be used by the calling thread
+ */
+FileHasher::ThreadState& FileHasher::AcquireThreadState() const
+{
+    const std::thread::id threadId = std::this_thread::get_id();
+    std::lock_guard<std::mutex> lock(_threadStatesMutex);
+    std::unique_ptr<ThreadState>& threadState = _threadStates[threadId];
+    if (nullptr == threadState)
+    {
+        threadState = std::make_unique<ThreadState>();
+    }
+    return *threadState;
+}
+
+/**
+ * @brief Get the context of a thread, allocating it on first use.
+ *
+ * @param[in,out] threadState Resources of the calling thread
+ * @return Context of the thread
+ */
+FileHasher::Context& FileHasher::AcquireContext(ThreadState& threadState) const
+{
+    if (nullptr == threadState.context)
+    {
+        threadState.context = std::make_unique<Context>(_readBufferSize);
+    }
+    return *threadState.context;
+}
+
+/**
+ * @brief Get the io_uring reader of a thread, setting it up on first use.
+ *
+ * @param[in,out] threadState Resources of the calling thread
+ * @return Reader, or nullptr when this thread cannot use io_uring
+ */
+UringReader* FileHasher::AcquireReader(ThreadState& threadState) const
+{
+    if (false == threadState.readerTried)
+    {
+        threadState.reader = UringReader::Create(_readQueueDepth, ReadBlockSize);
+        threadState.readerTried = true;
+    }
+    return threadState.reader.get();
+}
@@ -0,0 +1,400 @@
+#include "UringReader.hpp"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+namespace
+{
+constexpr std::size_t BufferAlignment = 4096;
+constexpr int FixedFileSlot = 0;
+
+/**
+ * @brief Per-slot progress of one block read.
+ */
+struct BlockRead
+{
+    std::uint64_t offset; /**< File offset of the block */
+    std::uint32_t length; /**< Bytes the block should hold */
+    std::uint32_t filled; /**< Bytes read so far */
+    bool complete;        /**< All bytes are in the buffer */
+};
+
+int SetupRing(unsigned int entries, io_uring_params& params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int EnterRing(int ringDescriptor, unsigned int toSubmit, unsigned int minimumCompletions, unsigned int flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringDescriptor, toSubmit, minimumCompletions, flags, nullptr, 0));
+}
+
+int RegisterWithRing(int ringDescriptor, unsigned int opcode, const void* argument, unsigned int count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, ringDescriptor, opcode, argument, count));
+}
+}
+#endif
+
+std::unique_ptr<UringReader> UringReader::Create(unsigned int queueDepth, std::size_t blockSize)
+{
+#ifdef __linux__
+    if ((0 == queueDepth) || (0 == blockSize))
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<UringReader> reader(new UringReader());
+    io_uring_params params{};
+    reader->_ringDescriptor = SetupRing(queueDepth, params);
+    if (0 > reader->_ringDescriptor)
+    {
+        return nullptr;
+    }
+
+    reader->_submissionRingSize = params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+    reader->_completionRingSize = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+    const bool singleMapping = (0 != (params.features & IORING_FEAT_SINGLE_MMAP));
+    if (true == singleMapping)
+    {
+        reader->_submissionRingSize = std::max(reader->_submissionRingSize, reader->_completionRingSize);
+    }
+
+    reader->_submissionRing = mmap(nullptr, reader->_submissionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                   reader->_ringDescriptor, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == reader->_submissionRing)
+    {
+        reader->_submissionRing = nullptr;
+        return nullptr;
+    }
+    if (true == singleMapping)
+    {
+        reader->_completionRing = reader->_submissionRing;
+    }
+    else
+    {
+        reader->_completionRing = mmap(nullptr, reader->_completionRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                       reader->_ringDescriptor, IORING_OFF_CQ_RING);
+        if (MAP_FAILED == reader->_completionRing)
+        {
+            reader->_completionRing = nullptr;
+            return nullptr;
+        }
+    }
+    reader->_submissionEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+    reader->_submissionEntries = mmap(nullptr, reader->_submissionEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                      reader->_ringDescriptor, IORING_OFF_SQES);
+    if (MAP_FAILED == reader->_submissionEntries)
+    {
+        reader->_submissionEntries = nullptr;
+        return nullptr;
+    }
+
+    auto* submissionBase = static_cast<std::uint8_t*>(reader->_submissionRing);
+    auto* completionBase = static_cast<std::uint8_t*>(reader->_completionRing);
+    reader->_submissionTail = reinterpret_cast<unsigned int*>(submissionBase + params.sq_off.tail);
+    reader->_submissionMask = reinterpret_cast<unsigned int*>(submissionBase + params.sq_off.ring_mask);
+    reader->_submissionArray = reinterpret_cast<unsigned int*>(submissionBase + params.sq_off.array);
+    reader->_completionHead = reinterpret_cast<unsigned int*>(completionBase + params.cq_off.head);
+    reader->_completionTail = reinterpret_cast<unsigned int*>(completionBase + params.cq_off.tail);
+    reader->_completionMask = reinterpret_cast<unsigned int*>(completionBase + params.cq_off.ring_mask);
+    reader->_completionEntries = completionBase + params.cq_off.cqes;
+
+    // The kernel may round the ring up; never keep more reads in flight than it has entries for.
+    reader->_queueDepth = std::min(queueDepth, params.sq_entries);
+    reader->_blockSize = blockSize;
+    reader->_bufferStorage.resize((reader->_queueDepth * blockSize) + BufferAlignment);
+    const std::uintptr_t storageAddress = reinterpret_cast<std::uintptr_t>(reader->_bufferStorage.data());
+    reader->_buffers = reader->_bufferStorage.data() + ((BufferAlignment - (storageAddress % BufferAlignment)) % BufferAlignment);
+
+    std::vector<iovec> bufferVectors(reader->_queueDepth);
+    for (unsigned int i = 0; i < reader->_queueDepth; ++i)
+    {
+        bufferVectors[i].iov_base = reader->_buffers + (static_cast<std::size_t>(i) * blockSize);
+        bufferVectors[i].iov_len = blockSize;
+    }
+    const int placeholderFile = -1;
+    if ((0 != RegisterWithRing(reader->_ringDescriptor, IORING_REGISTER_BUFFERS, bufferVectors.data(), reader->_queueDepth)) ||
+        (0 != RegisterWithRing(reader->_ringDescriptor, IORING_REGISTER_FILES, &placeholderFile, 1)))
+    {
+        return nullptr;
+    }
+    return reader;
+#else
+    static_cast<void>(queueDepth);
+    static_cast<void>(blockSize);
+    return nullptr;
+#endif
+}
+
+UringReader::~UringReader()
+{
+#ifdef __linux__
+    if (nullptr != _submissionEntries)
+    {
+        munmap(_submissionEntries, _submissionEntriesSize);
+    }
+    if ((nullptr != _completionRing) && (_completionRing != _submissionRing))
+    {
+        munmap(_completionRing, _completionRingSize);
+    }
+    if (nullptr != _submissionRing)
+    {
+        munmap(_submissionRing, _submissionRingSize);
+    }
+    if (0 <= _ringDescriptor)
+    {
+        close(_ringDescriptor);
+    }
+#endif
+}
+
+bool UringReader::Read(int fileDescriptor, std::uint64_t fileSize, const std::function<void(const void*, std::size_t)>& onData)
+{
+#ifdef __linux__
+    int descriptor = fileDescriptor;
+    io_uring_files_update update{};
+    update.offset = FixedFileSlot;
+    update.fds = reinterpret_cast<std::uint64_t>(&descriptor);
+    if (1 != RegisterWithRing(_ringDescriptor, IORING_REGISTER_FILES_UPDATE, &update, 1))
+    {
+        return false;
+    }
+
+    const std::uint64_t blockCount = (fileSize + _blockSize - 1) / _blockSize;
+    std::vector<BlockRead> blocks(_queueDepth);
+    unsigned int readsInFlight = 0;
+    bool failed = false;
+
+    auto queueBlock = [&](std::uint64_t blockIndex)
+    {
+        if (blockCount <= blockIndex)
+        {
+            return;
+        }
+        const std::uint32_t slot = static_cast<std::uint32_t>(blockIndex % _queueDepth);
+        const std::uint64_t offset = blockIndex * _blockSize;
+        blocks[slot] = BlockRead{offset, static_cast<std::uint32_t>(std::min<std::uint64_t>(_blockSize, fileSize - offset)), 0, false};
+        QueueRead(slot, offset, blocks[slot].length);
+        ++readsInFlight;
+    };
+
+    auto reapCompletions = [&]()
+    {
+        unsigned int head = __atomic_load_n(_completionHead, __ATOMIC_RELAXED);
+        const unsigned int tail = __atomic_load_n(_completionTail, __ATOMIC_ACQUIRE);
+        const auto* completions = static_cast<const io_uring_cqe*>(_completionEntries);
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& completion = completions[head & *_completionMask];
+            const std::uint32_t slot = static_cast<std::uint32_t>(completion.user_data);
+            BlockRead& block = blocks[slot];
+            --readsInFlight;
+            if ((-EINTR == completion.res) || (-EAGAIN == completion.res))
+            {
+                QueueRead(slot, block.offset + block.filled, block.length - block.filled);
+                ++readsInFlight;
+            }
+            else if (0 >= completion.res)
+            {
+                // An error, or end of file before the size seen at open time.
+                failed = true;
+            }
+            else if (block.length > (block.filled + static_cast<std::uint32_t>(completion.res)))
+            {
+                block.filled += static_cast<std::uint32_t>(completion.res);
+                QueueRead(slot, block.offset + block.filled, block.length - block.filled);
+                ++readsInFlight;
+            }
+            else
+            {
+                block.filled = block.length;
+                block.complete = true;
+            }
+        }
+        __atomic_store_n(_completionHead, head, __ATOMIC_RELEASE);
+    };
+
+    for (std::uint64_t blockIndex = 0; blockIndex < _queueDepth; ++blockIndex)
+    {
+        queueBlock(blockIndex);
+    }
+
+    for (std::uint64_t nextBlock = 0; (false == failed) && (nextBlock < blockCount); ++nextBlock)
+    {
+        BlockRead& block = blocks[nextBlock % _queueDepth];
+        while ((false == failed) && (false == block.complete))
+        {
+            if (false == Submit(_pendingSubmissions, 1))
+            {
+                failed = true;
+                break;
+            }
+            reapCompletions();
+        }
+        if (true == failed)
+        {
+            break;
+        }
+        onData(_buffers + ((nextBlock % _queueDepth) * _blockSize), block.length);
+        block.complete = false;
+        queueBlock(nextBlock + _queueDepth);
+    }
+
+    // Buffers are reused by the next file, so every read still in flight has to land first.
+    while (0 < readsInFlight)
+    {
+        if (false == Submit(_pendingSubmissions, 1))
+        {
+            return false;
+        }
+        reapCompletions();
+    }
+    return false == failed;
+#else
+    static_cast<void>(fileDescriptor);
+    static_cast<void>(fileSize);
+    static_cast<void>(onData);
+    return false;
+#endif
+}
+
+unsigned int UringReader::QueueDepth() const
+{
+    return _queueDepth;
+}
+
+const std::uint8_t* UringReader::SlotBuffer(std::uint32_t slot) const
+{
+    return _buffers + (static_cast<std::size_t>(slot) * _blockSize);
+}
+
+void UringReader::QueueFileRead(int fileDescriptor, std::uint32_t slot, std::uint64_t offset, std::uint64_t userData)
+{
+#ifdef __linux__
+    const unsigned int tail = *_submissionTail;
+    const unsigned int index = tail & *_submissionMask;
+    auto* entry = static_cast<io_uring_sqe*>(_submissionEntries) + index;
+
+    // The buffers stay registered, so the read needs no page pinning even though the file is not a fixed one.
+    std::memset(entry, 0, sizeof(*entry));
+    entry->opcode = IORING_OP_READ_FIXED;
+    entry->fd = fileDescriptor;
+    entry->off = offset;
+    entry->addr = reinterpret_cast<std::uint64_t>(_buffers + (static_cast<std::size_t>(slot) * _blockSize));
+    entry->len = static_cast<std::uint32_t>(_blockSize);
+    entry->buf_index = static_cast<std::uint16_t>(slot);
+    entry->user_data = userData;
+
+    _submissionArray[index] = index;
+    __atomic_store_n(_submissionTail, tail + 1, __ATOMIC_RELEASE);
+    ++_pendingSubmissions;
+#else
+    static_cast<void>(fileDescriptor);
+    static_cast<void>(slot);
+    static_cast<void>(offset);
+    static_cast<void>(userData);
+#endif
+}
+
+bool UringReader::WaitForCompletions(const std::function<void(std::uint64_t, int)>& onCompletion)
+{
+#ifdef __linux__
+    if (false == Submit(_pendingSubmissions, 1))
+    {
+        return false;
+    }
+    unsigned int head = __atomic_load_n(_completionHead, __ATOMIC_RELAXED);
+    const unsigned int tail = __atomic_load_n(_completionTail, __ATOMIC_ACQUIRE);
+    const auto* completions = static_cast<const io_uring_cqe*>(_completionEntries);
+    for (; head != tail; ++head)
+    {
+        const io_uring_cqe& completion = completions[head & *_completionMask];
+        onCompletion(completion.user_data, completion.res);
+    }
+    __atomic_store_n(_completionHead, head, __ATOMIC_RELEASE);
+    return true;
+#else
+    static_cast<void>(onCompletion);
+    return false;
+#endif
+}
+
+/**
+ * @brief Submit queued entries and optionally wait for completions.
+ *
+ * @param[in] toSubmit Entries queued since the last submission
+ * @param[in] minimumCompletions Completions to wait for, 0 returns immediately
+ * @return true on success, false if the kernel rejected the call
+ */
+bool UringReader::Submit(unsigned int toSubmit, unsigned int minimumCompletions)
+{
+#ifdef __linux__
+    const unsigned int flags = (0 < minimumCompletions) ? IORING_ENTER_GETEVENTS : 0;
+    while (true)
+    {
+        const int submitted = EnterRing(_ringDescriptor, toSubmit, minimumCompletions, flags);
+        if (0 <= submitted)
+        {
+            _pendingSubmissions -= std::min(_pendingSubmissions, static_cast<unsigned int>(submitted));
+            return true;
+        }
+        if (EINTR != errno)
+        {
+            return false;
+        }
+    }
+#else
+    static_cast<void>(toSubmit);
+    static_cast<void>(minimumCompletions);
+    return false;
+#endif
+}
+
+/**
+ * @brief Queue a fixed-buffer read of a block slot; it is sent with the next Submit.
+ *
+ * @param[in] slot Buffer slot and user data of the read
+ * @param[in] offset File offset to read from
+ * @param[in] length Bytes to read; lands after the bytes the slot already holds
+ */
+void UringReader::QueueRead(std::uint32_t slot, std::uint64_t offset, std::uint32_t length)
+{
+#ifdef __linux__
+    const unsigned int tail = *_submissionTail;
+    const unsigned int index = tail & *_submissionMask;
+    auto* entry = static_cast<io_uring_sqe*>(_submissionEntries) + index;
+    std::uint8_t* slotBuffer = _buffers + (static_cast<std::size_t>(slot) * _blockSize);
+    const std::uint32_t alreadyFilled = static_cast<std::uint32_t>(offset % _blockSize);
+
+    std::memset(entry, 0, sizeof(*entry));
+    entry->opcode = IORING_OP_READ_FIXED;
+    entry->flags = IOSQE_FIXED_FILE;
+    entry->fd = FixedFileSlot;
+    entry->off = offset;
+    entry->addr = reinterpret_cast<std::uint64_t>(slotBuffer + alreadyFilled);
+    entry->len = length;
+    entry->buf_index = static_cast<std::uint16_t>(slot);
+    entry->user_data = slot;
+
+    _submissionArray[index] = index;
+    __atomic_store_n(_submissionTail, tail + 1, __ATOMIC_RELEASE);
+    ++_pendingSubmissions;
+#else
+    static_cast<void>(slot);
+    static_cast<void>(offset);
+    static_cast<void>(length);
+#endif
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Sequential file reader keeping many block reads in flight through one io_uring.
+ *
+ * The ring owns a pool of registered buffers and one registered file slot, so reads are submitted as
+ * IORING_OP_READ_FIXED against a fixed file and need no per-read page pinning or file lookup. Reads are
+ * submitted in batches and handed back in file order. A reader belongs to one thread. Only Linux has
+ * io_uring; elsewhere Create always fails.
+ */
+class UringReader
+{
+  public:
+    /**
+     * @brief Set up a ring with its buffers.
+     *
+     * @param[in] queueDepth Block reads kept in flight
+     * @param[in] blockSize Bytes per read
+     * @return Reader, or nullptr when io_uring is unavailable or refused (old kernel, seccomp, memory limits)
+     */
+    static std::unique_ptr<UringReader> Create(unsigned int queueDepth, std::size_t blockSize);
+
+    ~UringReader();
+
+    UringReader(const UringReader&) = delete;
+    UringReader& operator=(const UringReader&) = delete;
+
+    /**
+     * @brief Read a whole open file and pass its content on in order, leaving its read position untouched.
+     *
+     * @param[in] fileDescriptor Descriptor of the file, opened by the caller
+     * @param[in] fileSize Size of the file in bytes
+     * @param[in] onData Receives each block of the file in file order
+     * @return true on success, false on error or if the file shrank while being read
+     */
+    bool Read(int fileDescriptor, std::uint64_t fileSize, const std::function<void(const void*, std::size_t)>& onData);
+
+    /**
+     * @brief Get the number of buffer slots, the most reads QueueFileRead may keep in flight.
+     *
+     * @return Slot count
+     */
+    unsigned int QueueDepth() const;
+
+    /**
+     * @brief Get the buffer of a slot, one block long.
+     *
+     * @param[in] slot Slot below QueueDepth
+     * @return Start of the buffer
+     */
+    const std::uint8_t* SlotBuffer(std::uint32_t slot) const;
+
+    /**
+     * @brief Queue a read of up to one block of any open file into a slot; it is sent by the next WaitForCompletions.
+     *
+     * Lets a caller keep reads of many files in flight at once, each file with a slot of its own. The slot must
+     * have no other read in flight, and Read must not be used until every queued read has completed.
+     *
+     * @param[in] fileDescriptor Open file to read
+     * @param[in] slot Slot whose buffer receives the bytes
+     * @param[in] offset File offset to read from
+     * @param[in] userData Value handed back with the completion
+     */
+    void QueueFileRead(int fileDescriptor, std::uint32_t slot, std::uint64_t offset, std::uint64_t userData);
+
+    /**
+     * @brief Send the queued reads, wait for at least one completion and pass on every completion available.
+     *
+     * @param[in] onCompletion Receives the user data of each read and its result, the bytes read or a negative errno
+     * @return true on success, false if the kernel rejected the call
+     */
+    bool WaitForCompletions(const std::function<void(std::uint64_t, int)>& onCompletion);
+
+  private:
+    UringReader() = default;
+
+    bool Submit(unsigned int toSubmit, unsigned int minimumCompletions);
+    void QueueRead(std::uint32_t slot, std::uint64_t offset, std::uint32_t length);
+
+    int _ringDescriptor = -1;
+    void* _submissionRing = nullptr;
+    std::size_t _submissionRingSize = 0;
+    void* _completionRing = nullptr;
+    std::size_t _completionRingSize = 0;
+    void* _submissionEntries = nullptr;
+    std::size_t _submissionEntriesSize = 0;
+
+    unsigned int* _submissionTail = nullptr;
+    unsigned int* _submissionMask = nullptr;
+    unsigned int* _submissionArray = nullptr;
+    unsigned int* _completionHead = nullptr;
+    unsigned int* _completionTail = nullptr;
+    unsigned int* _completionMask = nullptr;
+    void* _completionEntries = nullptr;
+
+    unsigned int _queueDepth = 0;
+    std::size_t _blockSize = 0;
+    unsigned int _pendingSubmissions = 0;
+    std::vector<std::uint8_t> _bufferStorage;
+    std::uint8_t* _buffers = nullptr;
+};
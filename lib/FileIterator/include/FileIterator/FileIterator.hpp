@@ -1,7 +1,38 @@
 #pragma once
 
+#include "FileIterator/FileMetadata.hpp"
+
+#include <atomic>
+#include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <vector>
+
+class IoThrottle;
+class PathFilter;
+
+/**
+ * @brief Metadata taken from the directory record of an enumerated file, without extra syscalls.
+ */
+struct FileEntryInfo
+{
+    std::uint64_t inode = 0;             /**< Inode from the directory record, 0 where the platform does not report it */
+    bool hasSizeAndTime = false;         /**< true if size and modificationTimeNs were reported */
+    std::uint64_t size = 0;              /**< File size in bytes */
+    std::int64_t modificationTimeNs = 0; /**< Last modification time in nanoseconds since the Unix epoch */
+    std::uint64_t device = 0;            /**< Device the file is stored on, reported along with size and mtime on POSIX; 0 if unknown */
+    bool hasMetadata = false;            /**< true if metadata holds everything ReadFileMetadata would report, from a stat during the walk */
+    FileMetadata metadata{};             /**< Complete metadata of the file, meaningful if hasMetadata */
+};
+
+/**
+ * @brief Enumerated file with its directory record metadata.
+ */
+struct FileEntry
+{
+    std::filesystem::path path; /**< Path of the file */
+    FileEntryInfo info;         /**< Directory record metadata */
+};
 
 /**
  * @brief Infrastructure component for enumerating files on the filesystem.
@@ -9,12 +40,125 @@
 class FileIterator
 {
   public:
+    /**
+     * @brief Largest batch reported by IterateBatches; bigger directories are split.
+     */
+    static constexpr std::size_t MaxBatchSize = 1024;
+
+    /**
+     * @brief Callback run once every file of a directory listing has been reported.
+     *
+     * Receives the directory, spelled as the walk reached it, and whether it was listed completely.
+     */
+    using DirectoryCallback = std::function<void(const std::filesystem::path&, bool)>;
+
+    /**
+     * @brief Construct a file iterator.
+     *
+     * @param[in] threadCount Number of threads enumerating directories; 1 walks on the calling thread
+     * @param[in] ordered Report files in sorted depth-first order instead of discovery order
+     * @param[in] reportSizes Always report size and mtime, at the cost of a stat per file where the directory record lacks them; on POSIX that stat also reports the complete metadata
+     * @param[in] filter Rules that drop files and prune directories during the walk, nullptr walks everything; must outlive the iterator
+     * @param[in] filterRoot Directory the filter's relative paths start from, empty for the path each walk starts at
+     * @param[in] stopRequested Once set, no further directory is listed and the walk returns as incomplete; nullptr never stops; must outlive the iterator
+     * @param[in] throttle Charged one metadata request per directory opened and per stat, nullptr charges nothing; must outlive the iterator
+     * @param[in] volumeIndex On NTFS, list a tree from the volume's master file table in one pass on the calling thread instead of
+     *                        listing each directory; needs an elevated process and falls back to listing directories wherever it cannot be read.
+     *                        Files with several hard links are reported under one of their names only
+     */
+    explicit FileIterator(unsigned int threadCount = 1, bool ordered = false, bool reportSizes = false, const PathFilter* filter = nullptr,
+                          const std::filesystem::path& filterRoot = std::filesystem::path(), const std::atomic<bool>* stopRequested = nullptr,
+                          IoThrottle* throttle = nullptr, bool volumeIndex = false);
+
     /**
      * @brief Iterate files under the provided path.
      *
+     * With more than one thread and unordered output, onFile is called concurrently from the
+     * walker threads and must be thread-safe. Ordered output is always reported on the calling thread.
+     *
      * @param[in] path Root file or directory to enumerate
      * @param[in] onFile Callback invoked for each file
+     * @return true if the whole tree was enumerated, false if enumeration stopped on an error
      */
-    void Iterate(const std::filesystem::path& path,
+    bool Iterate(const std::filesystem::path& path,
            const std::function<void(const std::filesystem::path&)>& onFile) const;
+
+    /**
+     * @brief Iterate files under the provided path, passing along directory record metadata.
+     *
+     * Linux reports the inode, Windows reports size and mtime; other fields are left zero unless
+     * the iterator was constructed with reportSizes.
+     * Threading rules are the same as for Iterate.
+     *
+     * @param[in] path Root file or directory to enumerate
+     * @param[in] onFile Callback invoked for each file with its directory record metadata
+     * @return true if the whole tree was enumerated, false if enumeration stopped on an error
+     */
+    bool IterateWithInfo(const std::filesystem::path& path,
+                         const std::function<void(const std::filesystem::path&, const FileEntryInfo&)>& onFile) const;
+
+    /**
+     * @brief Iterate files under the provided path, one batch per directory listing.
+     *
+     * Each batch holds files from a single directory, at most MaxBatchSize of them. Threading
+     * rules are the same as for Iterate.
+     *
+     * @param[in] path Root file or directory to enumerate
+     * @param[in] onBatch Callback invoked for each batch of files
+     * @return true if the whole tree was enumerated, false if enumeration stopped on an error
+     */
+    bool IterateBatches(const std::filesystem::path& path,
+                        const std::function<void(std::vector<std::filesystem::path>&&)>& onBatch) const;
+
+    /**
+     * @brief Iterate files under the provided path in per-directory batches, with directory record metadata.
+     *
+     * Batching follows IterateBatches and metadata follows IterateWithInfo.
+     *
+     * @param[in] path Root file or directory to enumerate
+     * @param[in] onBatch Callback invoked for each batch of files
+     * @return true if the whole tree was enumerated, false if enumeration stopped on an error
+     */
+    bool IterateBatchesWithInfo(const std::filesystem::path& path, const std::function<void(std::vector<FileEntry>&&)>& onBatch) const;
+
+    /**
+     * @brief Iterate files in per-directory batches with directory record metadata, and report each finished directory.
+     *
+     * onDirectory runs on the thread that reported the directory's batches, right after the last of them,
+     * also for directories without files. A single-file root reports no directory. Threading rules are
+     * the same as for Iterate.
+     *
+     * @param[in] path Root file or directory to enumerate
+     * @param[in] onBatch Callback invoked for each batch of files
+     * @param[in] onDirectory Callback invoked once per directory after its files
+     * @return true if the whole tree was enumerated, false if enumeration stopped on an error
+     */
+    bool IterateBatchesWithInfo(const std::filesystem::path& path, const std::function<void(std::vector<FileEntry>&&)>& onBatch,
+                                const DirectoryCallback& onDirectory) const;
+
+    /**
+     * @brief List the files of one directory in batches, without descending into its subdirectories.
+     *
+     * Batches, metadata and onDirectory follow IterateBatchesWithInfo; everything runs on the calling thread.
+     *
+     * @param[in] directory Directory to list
+     * @param[in] onBatch Callback invoked for each batch of files
+     * @param[in] onDirectory Callback invoked once after the directory's files, may be empty
+     * @return true if the directory was listed completely, false on an error
+     */
+    bool ListDirectoryWithInfo(const std::filesystem::path& directory, const std::function<void(std::vector<FileEntry>&&)>& onBatch,
+                               const DirectoryCallback& onDirectory) const;
+
+  private:
+    bool Walk(const std::filesystem::path& path, const std::function<void(std::vector<FileEntry>&&)>& onBatch,
+              const DirectoryCallback& onDirectory) const;
+
+    unsigned int _threadCount;
+    bool _ordered;
+    bool _reportSizes;
+    const PathFilter* _filter;
+    std::filesystem::path _filterRoot;
+    const std::atomic<bool>* _stopRequested;
+    IoThrottle* _throttle;
+    bool _volumeIndex;
 };
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/**
+ * @brief File identity and change-detection metadata captured from the filesystem.
+ */
+struct FileMetadata
+{
+    std::uint64_t size;              /**< File size in bytes */
+    std::int64_t modificationTimeNs; /**< Last modification time in nanoseconds since the Unix epoch */
+    std::uint64_t inode;             /**< Inode number, or NTFS file index on Windows */
+    std::uint64_t device;            /**< Device ID, or volume serial number on Windows */
+    std::int64_t changeTimeNs;       /**< Last status change time in nanoseconds, the write time on Windows; not stored with file state */
+    std::int64_t accessTimeNs;       /**< Last access time in nanoseconds since the Unix epoch */
+    std::uint32_t mode;              /**< File type and permission bits as in st_mode, 0 where the platform has none */
+    std::uint32_t userId;            /**< Owning user id, 0 on Windows */
+    std::uint32_t groupId;           /**< Owning group id, 0 on Windows */
+
+    /**
+     * @brief Compare the change-detection fields: size, mtime and identity; other times, mode and owner are ignored.
+     */
+    bool operator==(const FileMetadata& other) const
+    {
+        return (size == other.size) && (modificationTimeNs == other.modificationTimeNs) && (inode == other.inode) &&
+               (device == other.device);
+    }
+
+    bool operator!=(const FileMetadata& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+/**
+ * @brief Read change-detection, permission and ownership metadata for a file with a single status query.
+ *
+ * Linux asks statx for exactly the fields FileMetadata holds, elsewhere POSIX uses stat.
+ *
+ * @param[in] filePath Path to the file
+ * @param[out] outputMetadata Captured metadata
+ * @return true on success, false on error
+ */
+bool ReadFileMetadata(const std::filesystem::path& filePath, FileMetadata& outputMetadata);
+
+#ifndef _WIN32
+/**
+ * @brief Read the metadata of a name relative to an open directory with a single status query.
+ *
+ * The directory walk uses this so a listed file costs one statx that resolves only its name.
+ *
+ * @param[in] directoryDescriptor Directory the name is resolved in, or AT_FDCWD
+ * @param[in] name Entry name, or a path relative to the directory
+ * @param[in] followLinks Describe the target of a symlink instead of the link itself
+ * @param[in] cachedOnly Accept the attributes a network filesystem client has cached (AT_STATX_DONT_SYNC) instead of asking the server
+ * @param[out] outputMetadata Captured metadata
+ * @return true on success, false on error with errno set
+ */
+bool ReadFileMetadataAt(int directoryDescriptor, const char* name, bool followLinks, bool cachedOnly, FileMetadata& outputMetadata);
+#endif
+
+/**
+ * @brief Read the extended attributes of a file into a compact encoding.
+ *
+ * Each attribute is its name and value, each preceded by its length as a 32-bit little-endian number.
+ * Linux only; elsewhere a file has no attributes.
+ *
+ * @param[in] filePath Path to the file
+ * @param[out] outputEncoded Encoded attributes, empty when the file has none
+ * @return true on success, false on error
+ */
+bool ReadExtendedAttributes(const std::filesystem::path& filePath, std::string& outputEncoded);
+
+/**
+ * @brief Set the extended attributes read by ReadExtendedAttributes on a file.
+ *
+ * Attributes the file already has and the encoding lacks are kept.
+ *
+ * @param[in] filePath Path to the file
+ * @param[in] encoded Encoded attributes
+ * @return true on success, false if the encoding is malformed or an attribute cannot be set
+ */
+bool WriteExtendedAttributes(const std::filesystem::path& filePath, const std::string& encoded);
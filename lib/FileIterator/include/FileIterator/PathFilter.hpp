@@ -0,0 +1,189 @@
+#pragma once
+
+#include "FileIterator/FileIterator.hpp"
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Include and exclude rules of a walk, before compilation.
+ */
+struct PathFilterRules
+{
+    std::vector<std::string> patterns;  /**< gitignore-style lines, later lines win; `!` re-includes, a trailing `/` matches directories only */
+    std::uint64_t minSize;              /**< Smallest file size in bytes that is included */
+    std::uint64_t maxSize;              /**< Largest file size in bytes that is included, 0 for no limit */
+    std::int64_t modifiedAfterNs;       /**< Only include files modified at or after this time in ns since the epoch, 0 for no bound */
+    std::int64_t modifiedBeforeNs;      /**< Only include files modified before this time in ns since the epoch, 0 for no bound */
+
+    /**
+     * @brief Initialize rules that include everything.
+     */
+    PathFilterRules() : minSize(0), maxSize(0), modifiedAfterNs(0), modifiedBeforeNs(0)
+    {
+    }
+};
+
+/**
+ * @brief Include and exclude rules compiled once into a matcher that walker threads share.
+ *
+ * Patterns follow gitignore: a pattern without a slash matches the name at any depth, one with a
+ * leading or inner slash matches the path from the root, `*` and `?` stay within one component, `**`
+ * spans components and `[...]` matches one character of a class. The last matching pattern decides.
+ * Patterns naming a plain component are looked up in a hash table, `*.ext` patterns by suffix, and all
+ * others run as a small automaton over the path, linear in its length. Size and mtime limits apply to
+ * files only. Paths are relative to the walk root and separated by `/`. Matching is thread-safe.
+ */
+class PathFilter
+{
+  public:
+    /**
+     * @brief Longest pattern in matcher steps that Compile accepts.
+     */
+    static constexpr std::size_t MaxPatternTokens = 255;
+
+    /**
+     * @brief Construct a filter that includes everything.
+     */
+    PathFilter();
+
+    /**
+     * @brief Compile rules into a filter.
+     *
+     * @param[in] rules Rules to compile
+     * @param[out] outputFilter Compiled filter
+     * @return true on success, false if a pattern is malformed or too long
+     */
+    static bool Compile(const PathFilterRules& rules, PathFilter& outputFilter);
+
+    /**
+     * @brief Check whether the filter includes everything, so walks can skip it.
+     *
+     * @return true if there are no patterns and no limits
+     */
+    bool IsEmpty() const;
+
+    /**
+     * @brief Check whether matching needs the size and mtime of every file.
+     *
+     * @return true if a size or mtime limit is set
+     */
+    bool NeedsSizeAndTime() const;
+
+    /**
+     * @brief Check whether a directory is excluded, so the walk does not descend into it.
+     *
+     * @param[in] relativePath Path of the directory relative to the walk root
+     * @return true if the directory is excluded
+     */
+    bool ExcludesDirectory(std::string_view relativePath) const;
+
+    /**
+     * @brief Check whether a directory or any directory above it is excluded.
+     *
+     * @param[in] relativePath Path of the directory relative to the walk root, empty for the root
+     * @return true if a walk from the root would not reach the directory
+     */
+    bool ExcludesDirectoryTree(std::string_view relativePath) const;
+
+    /**
+     * @brief Check whether a file is excluded.
+     *
+     * @param[in] relativePath Path of the file relative to the walk root
+     * @param[in] info Directory record metadata of the file; files without size and time pass the limits
+     * @return true if the file is excluded
+     */
+    bool ExcludesFile(std::string_view relativePath, const FileEntryInfo& info) const;
+
+    /**
+     * @brief Check whether a file is excluded by the size and mtime limits alone.
+     *
+     * @param[in] size File size in bytes
+     * @param[in] modificationTimeNs Last modification time in nanoseconds since the epoch
+     * @return true if the file is outside the limits
+     */
+    bool ExcludesBySizeOrTime(std::uint64_t size, std::int64_t modificationTimeNs) const;
+
+    /**
+     * @brief Get a copy of the filter that keeps its patterns and drops the size and mtime limits.
+     *
+     * @return Filter matching the same paths without limits
+     */
+    PathFilter WithoutLimits() const;
+
+  private:
+    /**
+     * @brief Kind of one matcher step.
+     */
+    enum class TokenType
+    {
+        Literal,    /**< One given character */
+        AnyChar,    /**< `?`: one character other than `/` */
+        CharClass,  /**< `[...]`: one character of a set, never `/` */
+        Star,       /**< `*`: any run of characters other than `/` */
+        Globstar,   /**< Trailing `**`: any run of characters */
+        GlobstarDir /**< Leading or inner `**` followed by `/`: nothing, or any run of characters ending in `/` */
+    };
+
+    /**
+     * @brief One step of a compiled pattern.
+     */
+    struct Token
+    {
+        TokenType type;         /**< Kind of the step */
+        char literal;           /**< Character of a Literal step */
+        std::bitset<256> chars; /**< Characters of a CharClass step */
+    };
+
+    /**
+     * @brief How a pattern is matched.
+     */
+    enum class RuleKind
+    {
+        Name,      /**< Plain name at any depth, in the name table */
+        Suffix,    /**< `*` and a plain suffix at any depth */
+        Path,      /**< Plain path from the root */
+        Automaton  /**< Anything else */
+    };
+
+    /**
+     * @brief One compiled pattern.
+     */
+    struct Rule
+    {
+        RuleKind kind;             /**< How the pattern is matched */
+        bool negated;              /**< The pattern re-includes what it matches */
+        bool directoryOnly;        /**< The pattern only matches directories */
+        bool anchored;             /**< The pattern matches the path from the root instead of the name */
+        std::string text;          /**< Name, suffix or path of the non-automaton kinds */
+        std::vector<Token> tokens; /**< Steps of an Automaton rule */
+        std::size_t order;         /**< Position among the patterns; the highest matching one decides */
+    };
+
+    /**
+     * @brief Last patterns naming one plain component.
+     */
+    struct NameRules
+    {
+        std::ptrdiff_t any = -1;       /**< Rule index matching files and directories, -1 for none */
+        std::ptrdiff_t directory = -1; /**< Rule index matching directories only, -1 for none */
+    };
+
+    static bool CompileRule(std::string_view pattern, std::size_t order, Rule& outputRule);
+    static bool CompileTokens(std::string_view glob, std::vector<Token>& outputTokens);
+    static bool MatchTokens(const std::vector<Token>& tokens, std::string_view text);
+    bool Excludes(std::string_view relativePath, bool isDirectory) const;
+
+    std::vector<Rule> _rules;                           /**< Compiled patterns in order */
+    std::vector<std::size_t> _scannedRules;             /**< Indices of the rules not in the name table, in order */
+    std::unordered_map<std::string, NameRules> _names; /**< Name rules by name */
+    std::uint64_t _minSize;
+    std::uint64_t _maxSize;
+    std::int64_t _modifiedAfterNs;
+    std::int64_t _modifiedBeforeNs;
+};
@@ -0,0 +1,427 @@
+#include "DirectoryReader.hpp"
+
+#include "IoThrottle/IoThrottle.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#endif
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+/**
+ * @brief Charge one metadata request to a throttle.
+ *
+ * @param[in] throttle Rate limiter, nullptr charges nothing
+ */
+void ChargeMetadata(IoThrottle* throttle)
+{
+    if (nullptr != throttle)
+    {
+        throttle->AcquireMetadata();
+    }
+}
+
+#ifdef _WIN32
+constexpr std::size_t DirectoryBufferSize = 0;
+// FILETIME counts 100 ns intervals since 1601-01-01.
+constexpr std::int64_t FileTimeToUnixEpochIntervals = 116444736000000000LL;
+constexpr std::int64_t NanosecondsPerFileTimeInterval = 100;
+constexpr unsigned int HighWordShift = 32;
+
+/**
+ * @brief Check whether a wide entry name is "." or "..".
+ *
+ * @param[in] name Null-terminated entry name
+ * @return true for the self and parent entries
+ */
+bool IsDotEntry(const wchar_t* name)
+{
+    return (L'.' == name[0]) && ((L'\0' == name[1]) || ((L'.' == name[1]) && (L'\0' == name[2])));
+}
+#else
+constexpr std::size_t DirectoryBufferSize = 128 * 1024;
+/**
+ * @brief Directory handles retained at once across all readers, well below common descriptor limits.
+ */
+constexpr std::size_t MaxRetainedDirectoryHandles = 256;
+
+std::atomic<std::size_t> RetainedDirectoryHandles{0};
+
+/**
+ * @brief Open a directory for listing, relative to its parent's descriptor when there is one.
+ *
+ * @param[in] directory Directory to open
+ * @param[in] parent Handle of the directory's parent, nullptr opens the directory by full path
+ * @return Open descriptor, or a negative value on error
+ */
+int OpenDirectory(const std::filesystem::path& directory, const DirectoryHandle* parent)
+{
+    constexpr int OpenFlags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    if (nullptr != parent)
+    {
+        // The entry was listed as a real directory; O_NOFOLLOW refuses a symlink swapped in since.
+        return openat(parent->Descriptor(), directory.filename().c_str(), OpenFlags | O_NOFOLLOW);
+    }
+    return open(directory.c_str(), OpenFlags);
+}
+
+/**
+ * @brief Check whether an entry name is "." or "..".
+ *
+ * @param[in] name Null-terminated entry name
+ * @return true for the self and parent entries
+ */
+bool IsDotEntry(const char* name)
+{
+    return ('.' == name[0]) && (('\0' == name[1]) || (('.' == name[1]) && ('\0' == name[2])));
+}
+
+/**
+ * @brief Copy the metadata of a stat into entry info.
+ *
+ * @param[in] metadata Metadata read for the entry
+ * @param[in/out] info Entry info to fill
+ */
+void FillInfoFromMetadata(const FileMetadata& metadata, FileEntryInfo& info)
+{
+    info.inode = metadata.inode;
+    info.hasSizeAndTime = true;
+    info.size = metadata.size;
+    info.modificationTimeNs = metadata.modificationTimeNs;
+    info.device = metadata.device;
+    info.hasMetadata = true;
+    info.metadata = metadata;
+}
+
+/**
+ * @brief Check whether a directory is on a network filesystem, whose attributes the client may serve from its cache.
+ *
+ * @param[in] directoryDescriptor Open directory
+ * @return true for NFS, SMB/CIFS, Ceph and FUSE mounts, false otherwise or where unknown
+ */
+bool IsNetworkFilesystem(int directoryDescriptor)
+{
+#ifdef __linux__
+    constexpr long NfsMagic = 0x6969;
+    constexpr long SmbMagic = 0x517B;
+    constexpr long CifsMagic = 0xFF534D42;
+    constexpr long Smb2Magic = 0xFE534D42;
+    constexpr long CephMagic = 0x00C36400;
+    constexpr long FuseMagic = 0x65735546;
+    struct statfs filesystemStatus{};
+    if (0 != fstatfs(directoryDescriptor, &filesystemStatus))
+    {
+        return false;
+    }
+    const long type = static_cast<long>(filesystemStatus.f_type);
+    return (NfsMagic == type) || (SmbMagic == type) || (CifsMagic == type) || (Smb2Magic == type) || (CephMagic == type) || (FuseMagic == type);
+#else
+    static_cast<void>(directoryDescriptor);
+    return false;
+#endif
+}
+
+/**
+ * @brief Classify an entry from its d_type, falling back to a stat when the type is unknown.
+ *
+ * Symlinks are resolved so that links to regular files count as files while directory links
+ * are never followed, matching recursive_directory_iterator. Every stat is one statx relative to the
+ * listed directory and reports the complete metadata, so the file's consumers need not stat it again.
+ *
+ * @param[in] directoryDescriptor Descriptor of the directory being listed
+ * @param[in] name Entry name
+ * @param[in] directoryType d_type value from the directory record
+ * @param[in] statFiles Stat regular files whose record carries no size, so that size and mtime are always reported
+ * @param[in] cachedOnly The directory is on a network filesystem whose cached attributes are good enough
+ * @param[in] throttle Charged one metadata request per stat, nullptr charges nothing
+ * @param[in/out] entry Entry whose type and info are filled
+ * @return true on success, false if the entry could not be classified
+ */
+bool ClassifyEntry(int directoryDescriptor, const char* name, unsigned char directoryType, bool statFiles, bool cachedOnly, IoThrottle* throttle,
+                   DirectoryEntry& entry)
+{
+    FileMetadata metadata{};
+    const auto statEntry = [&](bool followSymlink)
+    {
+        const bool read = ReadFileMetadataAt(directoryDescriptor, name, followSymlink, cachedOnly, metadata);
+        ChargeMetadata(throttle);
+        return read;
+    };
+    if (DT_UNKNOWN == directoryType)
+    {
+        if (false == statEntry(false))
+        {
+            return false;
+        }
+        directoryType = S_ISREG(metadata.mode) ? DT_REG : (S_ISDIR(metadata.mode) ? DT_DIR : (S_ISLNK(metadata.mode) ? DT_LNK : DT_UNKNOWN));
+        if ((DT_REG == directoryType) || (DT_DIR == directoryType))
+        {
+            FillInfoFromMetadata(metadata, entry.info);
+        }
+    }
+
+    switch (directoryType)
+    {
+    case DT_REG:
+        entry.type = DirectoryEntryType::File;
+        // A file that vanished since the listing is still reported, just without size; the worker handles it.
+        if ((true == statFiles) && (false == entry.info.hasMetadata) && (true == statEntry(false)))
+        {
+            FillInfoFromMetadata(metadata, entry.info);
+        }
+        return true;
+    case DT_DIR:
+        entry.type = DirectoryEntryType::Directory;
+        return true;
+    case DT_LNK:
+        // A dangling link is simply not a file, which matches is_regular_file.
+        entry.type = ((true == statEntry(true)) && S_ISREG(metadata.mode))
+                         ? DirectoryEntryType::File
+                         : DirectoryEntryType::Other;
+        if (DirectoryEntryType::File == entry.type)
+        {
+            FillInfoFromMetadata(metadata, entry.info);
+        }
+        return true;
+    default:
+        entry.type = DirectoryEntryType::Other;
+        return true;
+    }
+}
+#endif
+
+#ifdef __linux__
+/**
+ * @brief Record layout returned by the getdents64 system call.
+ */
+struct LinuxDirent64
+{
+    std::uint64_t d_ino;
+    std::int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+#endif
+}
+
+#ifdef _WIN32
+std::shared_ptr<DirectoryHandle> DirectoryHandle::TryRetain(int)
+{
+    return nullptr;
+}
+
+DirectoryHandle::~DirectoryHandle() = default;
+#else
+std::shared_ptr<DirectoryHandle> DirectoryHandle::TryRetain(int descriptor)
+{
+    if (MaxRetainedDirectoryHandles <= RetainedDirectoryHandles.fetch_add(1))
+    {
+        RetainedDirectoryHandles.fetch_sub(1);
+        return nullptr;
+    }
+    return std::shared_ptr<DirectoryHandle>(new DirectoryHandle(descriptor));
+}
+
+DirectoryHandle::~DirectoryHandle()
+{
+    close(_descriptor);
+    RetainedDirectoryHandles.fetch_sub(1);
+}
+#endif
+
+DirectoryHandle::DirectoryHandle(int descriptor) : _descriptor(descriptor)
+{
+}
+
+int DirectoryHandle::Descriptor() const
+{
+    return _descriptor;
+}
+
+DirectoryReader::DirectoryReader(bool statFiles, IoThrottle* throttle) : _buffer(DirectoryBufferSize), _statFiles(statFiles), _throttle(throttle)
+{
+}
+
+bool DirectoryReader::Read(const std::filesystem::path& directory, const DirectoryHandle* parent, std::shared_ptr<DirectoryHandle>& outputHandle,
+                           const std::function<void(const DirectoryEntry&)>& onEntry)
+{
+    outputHandle.reset();
+#ifdef _WIN32
+    (void)parent;
+    const std::filesystem::path pattern = directory / L"*";
+    WIN32_FIND_DATAW findData{};
+    HANDLE findHandle = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &findData, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+    ChargeMetadata(_throttle);
+    if (INVALID_HANDLE_VALUE == findHandle)
+    {
+        return false;
+    }
+
+    do
+    {
+        if (true == IsDotEntry(findData.cFileName))
+        {
+            continue;
+        }
+
+        DirectoryEntry entry{};
+        entry.name = findData.cFileName;
+        entry.nameLength = wcslen(findData.cFileName);
+
+        const bool isReparsePoint = (0 != (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT));
+        if (0 != (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            entry.type = (true == isReparsePoint) ? DirectoryEntryType::Other : DirectoryEntryType::Directory;
+        }
+        else
+        {
+            entry.type = DirectoryEntryType::File;
+            // For reparse points the record describes the link, not its target.
+            if (false == isReparsePoint)
+            {
+                const std::int64_t writeTime =
+                    static_cast<std::int64_t>((static_cast<std::uint64_t>(findData.ftLastWriteTime.dwHighDateTime) << HighWordShift) |
+                                              findData.ftLastWriteTime.dwLowDateTime);
+                entry.info.hasSizeAndTime = true;
+                entry.info.size = (static_cast<std::uint64_t>(findData.nFileSizeHigh) << HighWordShift) | findData.nFileSizeLow;
+                entry.info.modificationTimeNs = (writeTime - FileTimeToUnixEpochIntervals) * NanosecondsPerFileTimeInterval;
+            }
+        }
+        onEntry(entry);
+    } while (FALSE != FindNextFileW(findHandle, &findData));
+
+    const bool complete = (ERROR_NO_MORE_FILES == GetLastError());
+    FindClose(findHandle);
+    return complete;
+#elif defined(__linux__)
+    const int directoryDescriptor = OpenDirectory(directory, parent);
+    ChargeMetadata(_throttle);
+    if (0 > directoryDescriptor)
+    {
+        return false;
+    }
+
+    bool complete = true;
+    bool hasSubdirectory = false;
+    const bool cachedOnly = (true == _statFiles) && (true == IsNetworkFilesystem(directoryDescriptor));
+    while (true)
+    {
+        const long bytesRead = syscall(SYS_getdents64, directoryDescriptor, _buffer.data(), _buffer.size());
+        if (0 >= bytesRead)
+        {
+            complete = complete && (0 == bytesRead);
+            break;
+        }
+
+        for (long offset = 0; offset < bytesRead;)
+        {
+            const auto* record = reinterpret_cast<const LinuxDirent64*>(_buffer.data() + offset);
+            offset += record->d_reclen;
+            if (true == IsDotEntry(record->d_name))
+            {
+                continue;
+            }
+
+            DirectoryEntry entry{};
+            entry.name = record->d_name;
+            entry.nameLength = std::strlen(record->d_name);
+            entry.info.inode = record->d_ino;
+            if (false == ClassifyEntry(directoryDescriptor, record->d_name, record->d_type, _statFiles, cachedOnly, _throttle, entry))
+            {
+                complete = false;
+                continue;
+            }
+            hasSubdirectory = hasSubdirectory || (DirectoryEntryType::Directory == entry.type);
+            onEntry(entry);
+        }
+    }
+
+    if (true == hasSubdirectory)
+    {
+        outputHandle = DirectoryHandle::TryRetain(directoryDescriptor);
+    }
+    if (nullptr == outputHandle)
+    {
+        close(directoryDescriptor);
+    }
+    return complete;
+#else
+    const int directoryDescriptor = OpenDirectory(directory, parent);
+    ChargeMetadata(_throttle);
+    if (0 > directoryDescriptor)
+    {
+        return false;
+    }
+    DIR* directoryStream = fdopendir(directoryDescriptor);
+    if (nullptr == directoryStream)
+    {
+        close(directoryDescriptor);
+        return false;
+    }
+
+    bool complete = true;
+    bool hasSubdirectory = false;
+    const bool cachedOnly = (true == _statFiles) && (true == IsNetworkFilesystem(directoryDescriptor));
+    while (true)
+    {
+        // readdir signals both end of stream and errors with nullptr; only errno tells them apart.
+        errno = 0;
+        const struct dirent* record = readdir(directoryStream);
+        if (nullptr == record)
+        {
+            complete = complete && (0 == errno);
+            break;
+        }
+        if (true == IsDotEntry(record->d_name))
+        {
+            continue;
+        }
+
+        DirectoryEntry entry{};
+        entry.name = record->d_name;
+        entry.nameLength = std::strlen(record->d_name);
+        entry.info.inode = static_cast<std::uint64_t>(record->d_ino);
+        if (false == ClassifyEntry(directoryDescriptor, record->d_name, record->d_type, _statFiles, cachedOnly, _throttle, entry))
+        {
+            complete = false;
+            continue;
+        }
+        hasSubdirectory = hasSubdirectory || (DirectoryEntryType::Directory == entry.type);
+        onEntry(entry);
+    }
+
+    // closedir closes the stream's descriptor, so a retained handle gets its own.
+    const int retainedDescriptor = (true == hasSubdirectory) ? fcntl(directoryDescriptor, F_DUPFD_CLOEXEC, 0) : -1;
+    if (0 <= retainedDescriptor)
+    {
+        outputHandle = DirectoryHandle::TryRetain(retainedDescriptor);
+        if (nullptr == outputHandle)
+        {
+            close(retainedDescriptor);
+        }
+    }
+    closedir(directoryStream);
+    return complete;
+#endif
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include "FileIterator/FileIterator.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class IoThrottle;
+
+/**
+ * @brief Kind of a directory entry after resolving file symlinks.
+ */
+enum class DirectoryEntryType
+{
+    File,      /**< Regular file, or a symlink to one */
+    Directory, /**< Real directory; directory symlinks are reported as Other */
+    Other      /**< Anything that is neither reported nor descended into */
+};
+
+/**
+ * @brief Directory entry as reported by the platform enumeration call.
+ */
+struct DirectoryEntry
+{
+    const std::filesystem::path::value_type* name; /**< Entry name, not null-terminated on every platform */
+    std::size_t nameLength;                        /**< Name length in characters */
+    DirectoryEntryType type;                       /**< Resolved entry type */
+    FileEntryInfo info;                            /**< Metadata carried by the directory record */
+};
+
+/**
+ * @brief Open directory descriptor kept so that its subdirectories are opened relative to it.
+ *
+ * A subdirectory opened with openat skips resolving every component of its path again. Pending
+ * subdirectories share their parent's handle; the descriptor is closed when the last of them has been
+ * opened. Only a bounded number of handles is retained process-wide, past which directories are opened
+ * by full path. Never created on Windows.
+ */
+class DirectoryHandle
+{
+  public:
+    /**
+     * @brief Take ownership of a directory descriptor unless the retained handles are at their bound.
+     *
+     * @param[in] descriptor Open directory descriptor
+     * @return Handle owning the descriptor, or nullptr if the caller keeps ownership
+     */
+    static std::shared_ptr<DirectoryHandle> TryRetain(int descriptor);
+
+    /**
+     * @brief Close the descriptor.
+     */
+    ~DirectoryHandle();
+
+    DirectoryHandle(const DirectoryHandle&) = delete;
+    DirectoryHandle& operator=(const DirectoryHandle&) = delete;
+
+    /**
+     * @brief Get the descriptor subdirectories are opened relative to.
+     *
+     * @return Open directory descriptor
+     */
+    int Descriptor() const;
+
+  private:
+    explicit DirectoryHandle(int descriptor);
+
+    int _descriptor;
+};
+
+/**
+ * @brief Platform-native single-directory enumeration.
+ *
+ * Uses getdents64 into a reusable buffer on Linux, readdir elsewhere on POSIX, and
+ * FindFirstFileExW with FIND_FIRST_EX_LARGE_FETCH on Windows. The entry type comes from the
+ * directory record whenever the filesystem provides it, so most entries need no stat call, and any
+ * stat is a single statx relative to the listed directory that reports the file's complete metadata.
+ * On network filesystems statFiles accepts the attributes the client has cached. On POSIX a directory is opened relative to its
+ * parent's retained handle when there is one. With a throttle, opening the directory and every stat is charged as one
+ * metadata request. One reader is not thread-safe; use one per thread.
+ */
+class DirectoryReader
+{
+  public:
+    /**
+     * @brief Create a reader with its own enumeration buffer.
+     *
+     * @param[in] statFiles Stat regular files whose directory record carries no size, so every file reports size and mtime
+     * @param[in] throttle Charged for every metadata request, nullptr charges nothing
+     */
+    explicit DirectoryReader(bool statFiles = false, IoThrottle* throttle = nullptr);
+
+    /**
+     * @brief Enumerate the entries of one directory, excluding "." and "..".
+     *
+     * @param[in] directory Directory to list
+     * @param[in] parent Handle of the directory's parent to open it relative to, nullptr opens it by full path
+     * @param[out] outputHandle Handle of the directory if it has subdirectories and a handle could be retained, else nullptr
+     * @param[in] onEntry Callback invoked for each entry
+     * @return true if the whole listing was read and classified, false on any error
+     */
+    bool Read(const std::filesystem::path& directory, const DirectoryHandle* parent, std::shared_ptr<DirectoryHandle>& outputHandle,
+              const std::function<void(const DirectoryEntry&)>& onEntry);
+
+  private:
+    std::vector<char> _buffer;
+    bool _statFiles;
+    IoThrottle* _throttle;
+};
@@ -0,0 +1,72 @@
+#include "EntryFilter.hpp"
+
+#include <system_error>
+
+EntryFilter::EntryFilter(const PathFilter* filter, const std::filesystem::path& root)
+    : _filter(((nullptr != filter) && (false == filter->IsEmpty())) ? filter : nullptr), _root(root), _rootPrefix(root.native()),
+      _directoryLength(0)
+{
+    while ((1 < _rootPrefix.size()) && (std::filesystem::path::preferred_separator == _rootPrefix.back()))
+    {
+        _rootPrefix.pop_back();
+    }
+}
+
+bool EntryFilter::IsActive() const
+{
+    return nullptr != _filter;
+}
+
+void EntryFilter::BeginDirectory(const std::filesystem::path& directory)
+{
+    if (nullptr == _filter)
+    {
+        return;
+    }
+    const auto& native = directory.native();
+    std::filesystem::path::string_type relative;
+    if (native == _rootPrefix)
+    {
+        relative.clear();
+    }
+    else if ((native.size() > _rootPrefix.size()) && (0 == native.compare(0, _rootPrefix.size(), _rootPrefix)) &&
+             (std::filesystem::path::preferred_separator == native[_rootPrefix.size()]))
+    {
+        relative = native.substr(_rootPrefix.size() + 1);
+    }
+    else
+    {
+        std::error_code ec;
+        relative = std::filesystem::relative(directory, _root, ec).native();
+        if ((0 != ec.value()) || (std::filesystem::path::string_type(1, '.') == relative))
+        {
+            relative.clear();
+        }
+    }
+#ifdef _WIN32
+    _relativePath = std::filesystem::path(relative).generic_string();
+#else
+    _relativePath = std::move(relative);
+#endif
+    if (false == _relativePath.empty())
+    {
+        _relativePath.push_back('/');
+    }
+    _directoryLength = _relativePath.size();
+}
+
+bool EntryFilter::Accepts(const DirectoryEntry& entry)
+{
+    if (nullptr == _filter)
+    {
+        return true;
+    }
+    _relativePath.resize(_directoryLength);
+#ifdef _WIN32
+    _relativePath += std::filesystem::path(entry.name, entry.name + entry.nameLength).generic_string();
+#else
+    _relativePath.append(entry.name, entry.nameLength);
+#endif
+    return (DirectoryEntryType::Directory == entry.type) ? (false == _filter->ExcludesDirectory(_relativePath))
+                                                         : (false == _filter->ExcludesFile(_relativePath, entry.info));
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "DirectoryReader.hpp"
+
+#include "FileIterator/PathFilter.hpp"
+
+#include <filesystem>
+#include <string>
+
+/**
+ * @brief Applies a PathFilter to the entries of the directories one walker thread lists.
+ *
+ * The path of the listed directory relative to the filter root is built once per directory, and each
+ * entry only appends its name to it, into a buffer that keeps its capacity. One instance per thread.
+ */
+class EntryFilter
+{
+  public:
+    /**
+     * @brief Construct a filter for directories below a root.
+     *
+     * @param[in] filter Compiled filter, nullptr accepts every entry
+     * @param[in] root Directory the filter's relative paths start from
+     */
+    EntryFilter(const PathFilter* filter, const std::filesystem::path& root);
+
+    /**
+     * @brief Check whether there is a filter to apply.
+     *
+     * @return true if entries may be rejected
+     */
+    bool IsActive() const;
+
+    /**
+     * @brief Prepare for the entries of one directory.
+     *
+     * @param[in] directory Directory about to be listed, at or below the root
+     */
+    void BeginDirectory(const std::filesystem::path& directory);
+
+    /**
+     * @brief Check whether an entry of the current directory is reported or descended into.
+     *
+     * @param[in] entry File or directory entry
+     * @return true if the entry is included
+     */
+    bool Accepts(const DirectoryEntry& entry);
+
+  private:
+    const PathFilter* _filter;
+    std::filesystem::path _root;
+    std::filesystem::path::string_type _rootPrefix; /**< Native root without trailing separators */
+    std::string _relativePath;                      /**< Current directory and, after Accepts, the entry name */
+    std::size_t _directoryLength;                   /**< Length of the directory part of _relativePath */
+};
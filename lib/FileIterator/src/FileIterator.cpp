@@ -1,37 +1,339 @@
 #include "FileIterator/FileIterator.hpp"
 
+#include "DirectoryReader.hpp"
+#include "EntryFilter.hpp"
+#include "FileIterator/PathFilter.hpp"
+#include "ParallelDirectoryWalker.hpp"
+#include "VolumeIndex.hpp"
+
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace
+{
+/**
+ * @brief Directory waiting to be listed by the sequential walk.
+ */
+struct PendingDirectory
+{
+    std::filesystem::path path;              /**< Directory to list */
+    std::shared_ptr<DirectoryHandle> parent; /**< Parent handle to open it relative to, may be empty */
+};
+
+/**
+ * @brief List one directory, reporting its files in batches and collecting its subdirectories.
+ *
+ * @param[in] reader Directory reader of the calling thread
+ * @param[in] directory Directory to list
+ * @param[in] parent Handle of the directory's parent, nullptr opens it by full path
+ * @param[out] outputHandle Handle retained for opening the subdirectories, nullptr if none was kept
+ * @param[out] outputSubdirectories Subdirectories of the listing, nullptr ignores them
+ * @param[in,out] entryFilter Filter of the calling thread dropping excluded entries
+ * @param[in] onBatch Callback invoked for each batch of files
+ * @return true if the directory was listed completely, false on an error
+ */
+bool ListDirectory(DirectoryReader& reader, const std::filesystem::path& directory, const DirectoryHandle* parent,
+                   std::shared_ptr<DirectoryHandle>& outputHandle, std::vector<std::filesystem::path>* outputSubdirectories,
+                   EntryFilter& entryFilter, const std::function<void(std::vector<FileEntry>&&)>& onBatch)
+{
+    std::vector<FileEntry> batch;
+    entryFilter.BeginDirectory(directory);
+    const bool listed = reader.Read(directory, parent, outputHandle,
+                                    [&](const DirectoryEntry& entry)
+                                    {
+                                        if ((DirectoryEntryType::Other == entry.type) ||
+                                            ((DirectoryEntryType::Directory == entry.type) && (nullptr == outputSubdirectories)) ||
+                                            (false == entryFilter.Accepts(entry)))
+                                        {
+                                            return;
+                                        }
+                                        std::filesystem::path entryPath = directory / std::filesystem::path(entry.name, entry.name + entry.nameLength);
+                                        if (DirectoryEntryType::Directory == entry.type)
+                                        {
+                                            outputSubdirectories->push_back(std::move(entryPath));
+                                            return;
+                                        }
+                                        batch.push_back(FileEntry{std::move(entryPath), entry.info});
+                                        if (FileIterator::MaxBatchSize <= batch.size())
+                                        {
+                                            onBatch(std::move(batch));
+                                            batch.clear();
+                                        }
+                                    });
+    if (false == batch.empty())
+    {
+        onBatch(std::move(batch));
+    }
+    return listed;
+}
+
+/**
+ * @brief Report the tree below a directory from a volume index, in the batches a directory walk reports.
+ *
+ * Runs on the calling thread; the index already holds every listing. Ordered walks sort each
+ * directory's entries by name, which gives the sorted depth-first order of the directory walk.
+ *
+ * @param[in] index Index of the volume holding the root
+ * @param[in] root Directory the index was loaded for
+ * @param[in] ordered Report files in sorted depth-first order
+ * @param[in] reportSizes Read the size and mtime of every file, which the index does not hold
+ * @param[in,out] entryFilter Filter dropping excluded entries
+ * @param[in] stopRequested Once set, the walk returns as incomplete; nullptr never stops
+ * @param[in] throttle Charged one metadata request per size read, nullptr charges nothing
+ * @param[in] onBatch Callback invoked for each batch of files
+ * @param[in] onDirectory Callback invoked once per directory after its files, may be empty
+ * @return true if every file could be reported, false if a size could not be read or the walk was stopped
+ */
+bool WalkVolumeIndex(const VolumeIndex& index, const std::filesystem::path& root, bool ordered, bool reportSizes, EntryFilter& entryFilter,
+                     const std::atomic<bool>* stopRequested, IoThrottle* throttle, const std::function<void(std::vector<FileEntry>&&)>& onBatch,
+                     const FileIterator::DirectoryCallback& onDirectory)
+{
+    bool complete = true;
+    std::vector<std::pair<std::filesystem::path, std::uint64_t>> pendingDirectories;
+    pendingDirectories.emplace_back(root, index.Root());
+    std::vector<std::size_t> children;
+    std::vector<FileEntry> batch;
+    while (false == pendingDirectories.empty())
+    {
+        if ((nullptr != stopRequested) && (true == stopRequested->load(std::memory_order_relaxed)))
+        {
+            return false;
+        }
+        const std::filesystem::path directory = std::move(pendingDirectories.back().first);
+        const std::uint64_t reference = pendingDirectories.back().second;
+        pendingDirectories.pop_back();
+
+        children = index.Children(reference);
+        if (true == ordered)
+        {
+            std::sort(children.begin(), children.end(),
+                      [&index](std::size_t left, std::size_t right) { return index.Entries()[left].name < index.Entries()[right].name; });
+        }
+        bool listed = true;
+        const std::size_t firstSubdirectory = pendingDirectories.size();
+        entryFilter.BeginDirectory(directory);
+        for (const std::size_t child : children)
+        {
+            const VolumeIndex::Entry& record = index.Entries()[child];
+            DirectoryEntry entry{record.name.c_str(), record.name.size(), record.type, FileEntryInfo{}};
+            if (DirectoryEntryType::Other == entry.type)
+            {
+                continue;
+            }
+            std::filesystem::path entryPath = directory / record.name;
+            if ((DirectoryEntryType::File == entry.type) && (true == reportSizes))
+            {
+                if (nullptr != throttle)
+                {
+                    throttle->AcquireMetadata();
+                }
+                if (false == VolumeIndex::ReadSizeAndTime(entryPath, entry.info))
+                {
+                    listed = false;
+                    continue;
+                }
+            }
+            if (false == entryFilter.Accepts(entry))
+            {
+                continue;
+            }
+            if (DirectoryEntryType::Directory == entry.type)
+            {
+                pendingDirectories.emplace_back(std::move(entryPath), index.Reference(child));
+                continue;
+            }
+            batch.push_back(FileEntry{std::move(entryPath), entry.info});
+            if (FileIterator::MaxBatchSize <= batch.size())
+            {
+                onBatch(std::move(batch));
+                batch.clear();
+            }
+        }
+        if (false == batch.empty())
+        {
+            onBatch(std::move(batch));
+            batch.clear();
+        }
+        // The last pending directory is visited first, so the sorted subdirectories are reversed.
+        std::reverse(pendingDirectories.begin() + static_cast<std::ptrdiff_t>(firstSubdirectory), pendingDirectories.end());
+        complete = complete && listed;
+        if (onDirectory)
+        {
+            onDirectory(directory, listed);
+        }
+    }
+    return complete;
+}
+}
+
+FileIterator::FileIterator(unsigned int threadCount, bool ordered, bool reportSizes, const PathFilter* filter,
+                           const std::filesystem::path& filterRoot, const std::atomic<bool>* stopRequested, IoThrottle* throttle,
+                           bool volumeIndex)
+    : _threadCount(threadCount), _ordered(ordered),
+      _reportSizes((true == reportSizes) || ((nullptr != filter) && (true == filter->NeedsSizeAndTime()))), _filter(filter),
+      _filterRoot(filterRoot), _stopRequested(stopRequested), _throttle(throttle), _volumeIndex(volumeIndex)
+{
+}
 
-void FileIterator::Iterate(const std::filesystem::path& path,
+bool FileIterator::Iterate(const std::filesystem::path& path,
                            const std::function<void(const std::filesystem::path&)>& onFile) const
+{
+    return Walk(path,
+                [&](std::vector<FileEntry>&& batch)
+                {
+                    for (const auto& file : batch)
+                    {
+                        onFile(file.path);
+                    }
+                },
+                nullptr);
+}
+
+bool FileIterator::IterateWithInfo(const std::filesystem::path& path,
+                                   const std::function<void(const std::filesystem::path&, const FileEntryInfo&)>& onFile) const
+{
+    return Walk(path,
+                [&](std::vector<FileEntry>&& batch)
+                {
+                    for (const auto& file : batch)
+                    {
+                        onFile(file.path, file.info);
+                    }
+                },
+                nullptr);
+}
+
+bool FileIterator::IterateBatches(const std::filesystem::path& path,
+                                  const std::function<void(std::vector<std::filesystem::path>&&)>& onBatch) const
+{
+    return Walk(path,
+                [&](std::vector<FileEntry>&& batch)
+                {
+                    std::vector<std::filesystem::path> paths;
+                    paths.reserve(batch.size());
+                    for (auto& file : batch)
+                    {
+                        paths.push_back(std::move(file.path));
+                    }
+                    onBatch(std::move(paths));
+                },
+                nullptr);
+}
+
+bool FileIterator::IterateBatchesWithInfo(const std::filesystem::path& path,
+                                          const std::function<void(std::vector<FileEntry>&&)>& onBatch) const
+{
+    return Walk(path, onBatch, nullptr);
+}
+
+bool FileIterator::IterateBatchesWithInfo(const std::filesystem::path& path, const std::function<void(std::vector<FileEntry>&&)>& onBatch,
+                                          const DirectoryCallback& onDirectory) const
+{
+    return Walk(path, onBatch, onDirectory);
+}
+
+bool FileIterator::ListDirectoryWithInfo(const std::filesystem::path& directory, const std::function<void(std::vector<FileEntry>&&)>& onBatch,
+                                         const DirectoryCallback& onDirectory) const
+{
+    if ((nullptr != _stopRequested) && (true == _stopRequested->load(std::memory_order_relaxed)))
+    {
+        return false;
+    }
+    DirectoryReader reader(_reportSizes, _throttle);
+    EntryFilter entryFilter(_filter, (true == _filterRoot.empty()) ? directory : _filterRoot);
+    std::shared_ptr<DirectoryHandle> handle;
+    const bool listed = ListDirectory(reader, directory, nullptr, handle, nullptr, entryFilter, onBatch);
+    if (onDirectory)
+    {
+        onDirectory(directory, listed);
+    }
+    return listed;
+}
+
+/**
+ * @brief Enumerate files under a path and report them in per-directory batches.
+ *
+ * @param[in] path Root file or directory to enumerate
+ * @param[in] onBatch Callback invoked for each batch of files
+ * @param[in] onDirectory Callback invoked once per directory after its files, may be empty
+ * @return true if the whole tree was enumerated, false if enumeration stopped on an error
+ */
+bool FileIterator::Walk(const std::filesystem::path& path, const std::function<void(std::vector<FileEntry>&&)>& onBatch,
+                        const DirectoryCallback& onDirectory) const
 {
     std::error_code errorCode;
     const bool isRegularFile = std::filesystem::is_regular_file(path, errorCode);
     if ((0 == errorCode.value()) && (true == isRegularFile))
     {
-        onFile(path);
-        return;
+        onBatch(std::vector<FileEntry>{FileEntry{path, FileEntryInfo{}}});
+        return true;
     }
 
     errorCode.clear();
     const bool isDirectory = std::filesystem::is_directory(path, errorCode);
     if ((0 != errorCode.value()) || (false == isDirectory))
     {
-        return;
+        return false;
     }
 
-    errorCode.clear();
-    for (auto& entry : std::filesystem::recursive_directory_iterator(path, errorCode))
+    // Without the volume index the walk falls back to listing every directory.
+    if (true == _volumeIndex)
+    {
+        VolumeIndex index;
+        if (true == VolumeIndex::Load(path, _throttle, index))
+        {
+            EntryFilter entryFilter(_filter, (true == _filterRoot.empty()) ? path : _filterRoot);
+            return WalkVolumeIndex(index, path, _ordered, _reportSizes, entryFilter, _stopRequested, _throttle, onBatch, onDirectory);
+        }
+    }
+
+    if ((1 < _threadCount) || (true == _ordered))
+    {
+        ParallelDirectoryWalker walker(_threadCount, _ordered, _reportSizes, onBatch, onDirectory, _filter,
+                                       (true == _filterRoot.empty()) ? path : _filterRoot, _stopRequested, _throttle);
+        return walker.Run(path);
+    }
+
+    // A directory that cannot be listed, or an entry whose type cannot be read, might hide files,
+    // so the walk counts as incomplete but carries on with the rest of the tree.
+    bool complete = true;
+    DirectoryReader reader(_reportSizes, _throttle);
+    EntryFilter entryFilter(_filter, (true == _filterRoot.empty()) ? path : _filterRoot);
+    std::vector<PendingDirectory> pendingDirectories;
+    pendingDirectories.push_back(PendingDirectory{path, nullptr});
+    std::shared_ptr<DirectoryHandle> handle;
+    std::vector<std::filesystem::path> subdirectories;
+    while (false == pendingDirectories.empty())
     {
-        if (0 != errorCode.value())
+        // A stopped walk leaves the pending directories unreported, like directories that failed to list.
+        if ((nullptr != _stopRequested) && (true == _stopRequested->load(std::memory_order_relaxed)))
         {
-            break;
+            return false;
         }
+        PendingDirectory pending = std::move(pendingDirectories.back());
+        pendingDirectories.pop_back();
+        const std::filesystem::path& directory = pending.path;
 
-        const bool entryIsFile = entry.is_regular_file(errorCode);
-        if ((0 == errorCode.value()) && (true == entryIsFile))
+        subdirectories.clear();
+        const bool listed = ListDirectory(reader, directory, pending.parent.get(), handle, &subdirectories, entryFilter, onBatch);
+        complete = complete && listed;
+        // The parent's handle is released with the last child opened, so at most one per level stays open.
+        pending.parent.reset();
+        for (auto& subdirectory : subdirectories)
+        {
+            pendingDirectories.push_back(PendingDirectory{std::move(subdirectory), handle});
+        }
+        if (onDirectory)
         {
-            onFile(entry.path());
+            onDirectory(directory, listed);
         }
     }
+
+    return complete;
 }
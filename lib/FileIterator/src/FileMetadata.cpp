@@ -0,0 +1,276 @@
+#include "FileIterator/FileMetadata.hpp"
+
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#endif
+#endif
+
+namespace
+{
+#ifdef _WIN32
+// FILETIME counts 100 ns intervals since 1601-01-01.
+constexpr std::int64_t FileTimeToUnixEpochIntervals = 116444736000000000LL;
+constexpr std::int64_t NanosecondsPerFileTimeInterval = 100;
+constexpr unsigned int HighWordShift = 32;
+
+/**
+ * @brief Convert a FILETIME to nanoseconds since the Unix epoch.
+ */
+std::int64_t FileTimeToUnixNs(const FILETIME& fileTime)
+{
+    const std::int64_t intervals =
+        static_cast<std::int64_t>((static_cast<std::uint64_t>(fileTime.dwHighDateTime) << HighWordShift) | fileTime.dwLowDateTime);
+    return (intervals - FileTimeToUnixEpochIntervals) * NanosecondsPerFileTimeInterval;
+}
+#else
+constexpr std::int64_t NanosecondsPerSecond = 1000000000LL;
+#endif
+
+#ifdef __linux__
+/**
+ * @brief Fields requested from statx: everything FileMetadata holds and nothing more.
+ */
+constexpr unsigned int MetadataStatxMask =
+    STATX_TYPE | STATX_MODE | STATX_UID | STATX_GID | STATX_ATIME | STATX_MTIME | STATX_CTIME | STATX_INO | STATX_SIZE;
+
+constexpr std::size_t EncodedLengthSize = 4;
+
+/**
+ * @brief Append a length-prefixed byte string to an attribute encoding.
+ */
+void AppendField(std::string& encoded, const char* data, std::size_t length)
+{
+    for (std::size_t shift = 0; shift < EncodedLengthSize; ++shift)
+    {
+        encoded += static_cast<char>((length >> (8 * shift)) & 0xFF);
+    }
+    encoded.append(data, length);
+}
+
+/**
+ * @brief Read the next length-prefixed byte string of an attribute encoding.
+ *
+ * @param[in] encoded Attribute encoding
+ * @param[in,out] offset Position of the field, moved past it
+ * @param[out] outputField The field's bytes
+ * @return true on success, false if the encoding ends early
+ */
+bool ReadField(const std::string& encoded, std::size_t& offset, std::string& outputField)
+{
+    if ((encoded.size() - offset) < EncodedLengthSize)
+    {
+        return false;
+    }
+    std::size_t length = 0;
+    for (std::size_t shift = 0; shift < EncodedLengthSize; ++shift)
+    {
+        length |= static_cast<std::size_t>(static_cast<unsigned char>(encoded[offset + shift])) << (8 * shift);
+    }
+    offset += EncodedLengthSize;
+    if ((encoded.size() - offset) < length)
+    {
+        return false;
+    }
+    outputField.assign(encoded, offset, length);
+    offset += length;
+    return true;
+}
+#endif
+}
+
+bool ReadFileMetadata(const std::filesystem::path& filePath, FileMetadata& outputMetadata)
+{
+#ifdef _WIN32
+    HANDLE fileHandle = CreateFileW(filePath.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                    OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (INVALID_HANDLE_VALUE == fileHandle)
+    {
+        return false;
+    }
+
+    BY_HANDLE_FILE_INFORMATION information{};
+    const BOOL queried = GetFileInformationByHandle(fileHandle, &information);
+    CloseHandle(fileHandle);
+    if (FALSE == queried)
+    {
+        return false;
+    }
+
+    outputMetadata.size = (static_cast<std::uint64_t>(information.nFileSizeHigh) << HighWordShift) | information.nFileSizeLow;
+    outputMetadata.modificationTimeNs = FileTimeToUnixNs(information.ftLastWriteTime);
+    outputMetadata.inode = (static_cast<std::uint64_t>(information.nFileIndexHigh) << HighWordShift) | information.nFileIndexLow;
+    outputMetadata.device = information.dwVolumeSerialNumber;
+    outputMetadata.changeTimeNs = outputMetadata.modificationTimeNs;
+    outputMetadata.accessTimeNs = FileTimeToUnixNs(information.ftLastAccessTime);
+    outputMetadata.mode = 0;
+    outputMetadata.userId = 0;
+    outputMetadata.groupId = 0;
+    return true;
+#else
+    return ReadFileMetadataAt(AT_FDCWD, filePath.c_str(), true, false, outputMetadata);
+#endif
+}
+
+#ifndef _WIN32
+bool ReadFileMetadataAt(int directoryDescriptor, const char* name, bool followLinks, bool cachedOnly, FileMetadata& outputMetadata)
+{
+    const int linkFlags = (true == followLinks) ? 0 : AT_SYMLINK_NOFOLLOW;
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+    struct statx extendedStatus{};
+    const int syncFlags = (true == cachedOnly) ? AT_STATX_DONT_SYNC : AT_STATX_SYNC_AS_STAT;
+    if (0 == statx(directoryDescriptor, name, linkFlags | syncFlags, MetadataStatxMask, &extendedStatus))
+    {
+        outputMetadata.size = extendedStatus.stx_size;
+        outputMetadata.modificationTimeNs =
+            static_cast<std::int64_t>(extendedStatus.stx_mtime.tv_sec) * NanosecondsPerSecond + extendedStatus.stx_mtime.tv_nsec;
+        outputMetadata.inode = extendedStatus.stx_ino;
+        outputMetadata.device = static_cast<std::uint64_t>(makedev(extendedStatus.stx_dev_major, extendedStatus.stx_dev_minor));
+        outputMetadata.changeTimeNs = static_cast<std::int64_t>(extendedStatus.stx_ctime.tv_sec) * NanosecondsPerSecond + extendedStatus.stx_ctime.tv_nsec;
+        outputMetadata.accessTimeNs = static_cast<std::int64_t>(extendedStatus.stx_atime.tv_sec) * NanosecondsPerSecond + extendedStatus.stx_atime.tv_nsec;
+        outputMetadata.mode = extendedStatus.stx_mode;
+        outputMetadata.userId = extendedStatus.stx_uid;
+        outputMetadata.groupId = extendedStatus.stx_gid;
+        return true;
+    }
+    if (ENOSYS != errno)
+    {
+        return false;
+    }
+#else
+    static_cast<void>(cachedOnly);
+#endif
+    struct stat fileStatus{};
+    if (0 != fstatat(directoryDescriptor, name, &fileStatus, linkFlags))
+    {
+        return false;
+    }
+
+#ifdef __APPLE__
+    const struct timespec& modificationTime = fileStatus.st_mtimespec;
+    const struct timespec& changeTime = fileStatus.st_ctimespec;
+    const struct timespec& accessTime = fileStatus.st_atimespec;
+#else
+    const struct timespec& modificationTime = fileStatus.st_mtim;
+    const struct timespec& changeTime = fileStatus.st_ctim;
+    const struct timespec& accessTime = fileStatus.st_atim;
+#endif
+    outputMetadata.size = static_cast<std::uint64_t>(fileStatus.st_size);
+    outputMetadata.modificationTimeNs = static_cast<std::int64_t>(modificationTime.tv_sec) * NanosecondsPerSecond + modificationTime.tv_nsec;
+    outputMetadata.inode = static_cast<std::uint64_t>(fileStatus.st_ino);
+    outputMetadata.device = static_cast<std::uint64_t>(fileStatus.st_dev);
+    outputMetadata.changeTimeNs = static_cast<std::int64_t>(changeTime.tv_sec) * NanosecondsPerSecond + changeTime.tv_nsec;
+    outputMetadata.accessTimeNs = static_cast<std::int64_t>(accessTime.tv_sec) * NanosecondsPerSecond + accessTime.tv_nsec;
+    outputMetadata.mode = static_cast<std::uint32_t>(fileStatus.st_mode);
+    outputMetadata.userId = static_cast<std::uint32_t>(fileStatus.st_uid);
+    outputMetadata.groupId = static_cast<std::uint32_t>(fileStatus.st_gid);
+    return true;
+}
+#endif
+
+bool ReadExtendedAttributes(const std::filesystem::path& filePath, std::string& outputEncoded)
+{
+    outputEncoded.clear();
+#ifdef __linux__
+    // Most files have no attributes, which costs this one call.
+    std::vector<char> names(256);
+    ssize_t namesLength = 0;
+    while (true)
+    {
+        namesLength = llistxattr(filePath.c_str(), names.data(), names.size());
+        if (0 <= namesLength)
+        {
+            break;
+        }
+        if (ERANGE != errno)
+        {
+            return (ENOTSUP == errno);
+        }
+        const ssize_t needed = llistxattr(filePath.c_str(), nullptr, 0);
+        if (0 > needed)
+        {
+            return false;
+        }
+        names.resize(static_cast<std::size_t>(needed) + 1);
+    }
+
+    std::vector<char> value(256);
+    for (ssize_t offset = 0; offset < namesLength;)
+    {
+        const char* name = names.data() + offset;
+        const std::size_t nameLength = std::strlen(name);
+        offset += static_cast<ssize_t>(nameLength) + 1;
+        ssize_t valueLength = 0;
+        while (true)
+        {
+            valueLength = lgetxattr(filePath.c_str(), name, value.data(), value.size());
+            if (0 <= valueLength)
+            {
+                break;
+            }
+            if (ENODATA == errno)
+            {
+                // Removed since it was listed.
+                break;
+            }
+            if (ERANGE != errno)
+            {
+                return false;
+            }
+            const ssize_t needed = lgetxattr(filePath.c_str(), name, nullptr, 0);
+            if (0 > needed)
+            {
+                return false;
+            }
+            value.resize(static_cast<std::size_t>(needed) + 1);
+        }
+        if (0 <= valueLength)
+        {
+            AppendField(outputEncoded, name, nameLength);
+            AppendField(outputEncoded, value.data(), static_cast<std::size_t>(valueLength));
+        }
+    }
+    return true;
+#else
+    static_cast<void>(filePath);
+    return true;
+#endif
+}
+
+bool WriteExtendedAttributes(const std::filesystem::path& filePath, const std::string& encoded)
+{
+#ifdef __linux__
+    std::string name;
+    std::string value;
+    for (std::size_t offset = 0; offset < encoded.size();)
+    {
+        if ((false == ReadField(encoded, offset, name)) || (false == ReadField(encoded, offset, value)))
+        {
+            return false;
+        }
+        if (0 != lsetxattr(filePath.c_str(), name.c_str(), value.data(), value.size(), 0))
+        {
+            return false;
+        }
+    }
+    return true;
+#else
+    static_cast<void>(filePath);
+    return true == encoded.empty();
+#endif
+}
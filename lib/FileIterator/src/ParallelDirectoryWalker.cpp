@@ -0,0 +1,298 @@
+#include "ParallelDirectoryWalker.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <thread>
+
+ParallelDirectoryWalker::ParallelDirectoryWalker(unsigned int threadCount, bool ordered, bool reportSizes,
+                                                 const std::function<void(std::vector<FileEntry>&&)>& onBatch,
+                                                 const FileIterator::DirectoryCallback& onDirectory, const PathFilter* filter,
+                                                 const std::filesystem::path& filterRoot, const std::atomic<bool>* stopRequested,
+                                                 IoThrottle* throttle)
+    : _threadCount(std::max(1u, threadCount)), _ordered(ordered), _reportSizes(reportSizes), _onBatch(onBatch), _onDirectory(onDirectory),
+      _filter(filter), _filterRoot(filterRoot), _stopRequested(stopRequested), _throttle(throttle),
+      _pendingDirectories(0), _queuedDirectories(0),
+      _complete(true)
+{
+    _deques.reserve(_threadCount);
+    for (unsigned int i = 0; i < _threadCount; ++i)
+    {
+        _deques.push_back(std::make_unique<WorkDeque>());
+    }
+}
+
+bool ParallelDirectoryWalker::Run(const std::filesystem::path& root)
+{
+    auto rootNode = std::make_unique<DirectoryNode>();
+    rootNode->path = root;
+    // Unordered walks free each node right after scanning it; ordered walks keep the tree until it is reported.
+    Push(0, (true == _ordered) ? rootNode.get() : rootNode.release());
+
+    std::vector<std::thread> workers;
+    workers.reserve(_threadCount);
+    for (unsigned int i = 0; i < _threadCount; ++i)
+    {
+        workers.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+
+    if (true == _ordered)
+    {
+        EmitOrdered(*rootNode);
+    }
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+    return _complete.load();
+}
+
+/**
+ * @brief Walker thread loop: scan local work, steal when empty, exit when the tree is done.
+ *
+ * @param[in] workerIndex Index of the calling thread's deque
+ */
+void ParallelDirectoryWalker::WorkerLoop(std::size_t workerIndex)
+{
+    DirectoryReader reader(_reportSizes, _throttle);
+    EntryFilter entryFilter(_filter, _filterRoot);
+    while (true)
+    {
+        DirectoryNode* node = nullptr;
+        if (true == TryTake(workerIndex, node))
+        {
+            if ((nullptr != _stopRequested) && (true == _stopRequested->load(std::memory_order_relaxed)))
+            {
+                Abandon(*node);
+            }
+            else
+            {
+                Scan(workerIndex, reader, entryFilter, *node);
+            }
+            if (false == _ordered)
+            {
+                delete node;
+            }
+            if (1 == _pendingDirectories.fetch_sub(1))
+            {
+                std::lock_guard<std::mutex> lock(_idleMutex);
+                _idleCv.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_idleMutex);
+        _idleCv.wait(lock, [&]() { return (0 == _pendingDirectories.load()) || (0 < _queuedDirectories.load()); });
+        if (0 == _pendingDirectories.load())
+        {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Take a directory from the thread's own deque, or steal one from another thread.
+ *
+ * @param[in] workerIndex Index of the calling thread's deque
+ * @param[out] outputNode Directory to scan
+ * @return true if a directory was taken, false if every deque was empty
+ */
+bool ParallelDirectoryWalker::TryTake(std::size_t workerIndex, DirectoryNode*& outputNode)
+{
+    for (std::size_t offset = 0; offset < _deques.size(); ++offset)
+    {
+        WorkDeque& workDeque = *_deques[(workerIndex + offset) % _deques.size()];
+        std::lock_guard<std::mutex> lock(workDeque.mutex);
+        if (true == workDeque.items.empty())
+        {
+            continue;
+        }
+        if (0 == offset)
+        {
+            outputNode = workDeque.items.back();
+            workDeque.items.pop_back();
+        }
+        else
+        {
+            outputNode = workDeque.items.front();
+            workDeque.items.pop_front();
+        }
+        _queuedDirectories.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Schedule a directory on a thread's deque and wake an idle thread.
+ *
+ * @param[in] workerIndex Index of the deque to push to
+ * @param[in] node Directory to schedule
+ */
+void ParallelDirectoryWalker::Push(std::size_t workerIndex, DirectoryNode* node)
+{
+    _pendingDirectories.fetch_add(1);
+    {
+        WorkDeque& workDeque = *_deques[workerIndex];
+        std::lock_guard<std::mutex> lock(workDeque.mutex);
+        workDeque.items.push_back(node);
+        _queuedDirectories.fetch_add(1);
+    }
+    std::lock_guard<std::mutex> lock(_idleMutex);
+    _idleCv.notify_one();
+}
+
+/**
+ * @brief List one directory, reporting or recording its files and scheduling its subdirectories.
+ *
+ * Directory symlinks are not followed; symlinks to regular files are reported like files.
+ *
+ * @param[in] workerIndex Index of the calling thread's deque
+ * @param[in] reader Calling thread's directory reader
+ * @param[in,out] entryFilter Calling thread's filter dropping excluded entries
+ * @param[in/out] node Directory to scan
+ */
+void ParallelDirectoryWalker::Scan(std::size_t workerIndex, DirectoryReader& reader, EntryFilter& entryFilter, DirectoryNode& node)
+{
+    std::vector<FileEntry> files;
+    std::vector<std::filesystem::path> subdirectories;
+    entryFilter.BeginDirectory(node.path);
+
+    std::shared_ptr<DirectoryHandle> handle;
+    const bool listed = reader.Read(node.path, node.parent.get(), handle,
+                                    [&](const DirectoryEntry& entry)
+                                    {
+                                        if ((DirectoryEntryType::Other == entry.type) || (false == entryFilter.Accepts(entry)))
+                                        {
+                                            return;
+                                        }
+                                        std::filesystem::path entryPath = node.path / std::filesystem::path(entry.name, entry.name + entry.nameLength);
+                                        if (DirectoryEntryType::Directory == entry.type)
+                                        {
+                                            subdirectories.push_back(std::move(entryPath));
+                                            return;
+                                        }
+                                        files.push_back(FileEntry{std::move(entryPath), entry.info});
+                                        if ((false == _ordered) && (FileIterator::MaxBatchSize <= files.size()))
+                                        {
+                                            _onBatch(std::move(files));
+                                            files.clear();
+                                        }
+                                    });
+    if (false == listed)
+    {
+        _complete.store(false);
+    }
+    node.parent.reset();
+
+    if (false == _ordered)
+    {
+        if (false == files.empty())
+        {
+            _onBatch(std::move(files));
+        }
+        // Subdirectories are scheduled first, so other threads can take them while the callback runs.
+        for (auto& subdirectory : subdirectories)
+        {
+            auto child = std::make_unique<DirectoryNode>();
+            child->path = std::move(subdirectory);
+            child->parent = handle;
+            Push(workerIndex, child.release());
+        }
+        if (_onDirectory)
+        {
+            _onDirectory(node.path, listed);
+        }
+        return;
+    }
+
+    std::sort(files.begin(), files.end(), [](const auto& left, const auto& right) { return left.path < right.path; });
+    std::sort(subdirectories.begin(), subdirectories.end());
+
+    std::vector<std::unique_ptr<DirectoryNode>> children;
+    children.reserve(subdirectories.size());
+    for (auto& subdirectory : subdirectories)
+    {
+        children.push_back(std::make_unique<DirectoryNode>());
+        children.back()->path = std::move(subdirectory);
+        children.back()->parent = handle;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_readyMutex);
+        node.files = std::move(files);
+        node.children = std::move(children);
+        node.listed = listed;
+        for (auto& child : node.children)
+        {
+            Push(workerIndex, child.get());
+        }
+        node.ready = true;
+    }
+    _readyCv.notify_all();
+}
+
+/**
+ * @brief Pass over a directory of a stopped walk without listing it.
+ *
+ * The directory counts as not listed; in ordered mode it is marked ready with no files or children,
+ * so the calling thread reports it and finishes.
+ *
+ * @param[in/out] node Directory to pass over
+ */
+void ParallelDirectoryWalker::Abandon(DirectoryNode& node)
+{
+    _complete.store(false);
+    node.parent.reset();
+    if (false == _ordered)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_readyMutex);
+        node.ready = true;
+    }
+    _readyCv.notify_all();
+}
+
+/**
+ * @brief Report a subtree in sorted depth-first order, waiting for listings as needed.
+ *
+ * Runs on the calling thread and releases each subtree once it has been reported.
+ *
+ * @param[in/out] node Root of the subtree to report
+ */
+void ParallelDirectoryWalker::EmitOrdered(DirectoryNode& node)
+{
+    {
+        std::unique_lock<std::mutex> lock(_readyMutex);
+        _readyCv.wait(lock, [&]() { return true == node.ready; });
+    }
+
+    if (FileIterator::MaxBatchSize >= node.files.size())
+    {
+        if (false == node.files.empty())
+        {
+            _onBatch(std::move(node.files));
+        }
+    }
+    else
+    {
+        for (std::size_t first = 0; first < node.files.size(); first += FileIterator::MaxBatchSize)
+        {
+            const std::size_t last = std::min(node.files.size(), first + FileIterator::MaxBatchSize);
+            _onBatch(std::vector<FileEntry>(std::make_move_iterator(node.files.begin() + first), std::make_move_iterator(node.files.begin() + last)));
+        }
+    }
+    node.files = std::vector<FileEntry>();
+    if (_onDirectory)
+    {
+        _onDirectory(node.path, node.listed);
+    }
+
+    for (auto& child : node.children)
+    {
+        EmitOrdered(*child);
+        child.reset();
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "DirectoryReader.hpp"
+#include "EntryFilter.hpp"
+
+#include "FileIterator/FileIterator.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Multi-threaded directory tree walker with per-thread work-stealing deques.
+ *
+ * Each thread scans directories taken from the back of its own deque and steals from the front
+ * of the other threads' deques when it runs dry. Files are reported in per-directory batches of at
+ * most FileIterator::MaxBatchSize. In unordered mode batches are reported from the walker threads
+ * as each listing completes. In ordered mode listings are sorted and kept until the
+ * calling thread reports them in depth-first order.
+ */
+class ParallelDirectoryWalker
+{
+  public:
+    /**
+     * @brief Construct a walker.
+     *
+     * @param[in] threadCount Number of walker threads, at least 1
+     * @param[in] ordered Report files in sorted depth-first order on the calling thread
+     * @param[in] reportSizes Stat files whose directory record carries no size
+     * @param[in] onBatch Callback invoked for each batch of files
+     * @param[in] onDirectory Callback invoked once per directory after its files, may be empty
+     * @param[in] filter Rules dropping files and pruning directories, nullptr walks everything
+     * @param[in] filterRoot Directory the filter's relative paths start from
+     * @param[in] stopRequested Once set, directories are no longer listed and count as failed; nullptr never stops
+     * @param[in] throttle Charged for the metadata requests of the listings, nullptr charges nothing
+     */
+    ParallelDirectoryWalker(unsigned int threadCount, bool ordered, bool reportSizes,
+                            const std::function<void(std::vector<FileEntry>&&)>& onBatch,
+                            const FileIterator::DirectoryCallback& onDirectory = nullptr, const PathFilter* filter = nullptr,
+                            const std::filesystem::path& filterRoot = std::filesystem::path(), const std::atomic<bool>* stopRequested = nullptr,
+                            IoThrottle* throttle = nullptr);
+
+    ParallelDirectoryWalker(const ParallelDirectoryWalker&) = delete;
+    ParallelDirectoryWalker& operator=(const ParallelDirectoryWalker&) = delete;
+
+    /**
+     * @brief Walk a directory tree and return once every directory has been scanned.
+     *
+     * @param[in] root Directory to enumerate
+     * @return true if every directory was enumerated, false if any listing failed
+     */
+    bool Run(const std::filesystem::path& root);
+
+  private:
+    /**
+     * @brief Directory scheduled for scanning, with its listing in ordered mode.
+     */
+    struct DirectoryNode
+    {
+        std::filesystem::path path;                          /**< Directory to scan */
+        std::shared_ptr<DirectoryHandle> parent;             /**< Parent handle to open it relative to, released once scanned */
+        std::vector<FileEntry> files;                                       /**< Sorted files, ordered mode only */
+        std::vector<std::unique_ptr<DirectoryNode>> children;               /**< Sorted subdirectories, ordered mode only */
+        bool ready = false;                                                 /**< Set once the listing is complete */
+        bool listed = false;                                                /**< The directory was listed without errors, ordered mode only */
+    };
+
+    /**
+     * @brief Per-thread deque of directories waiting to be scanned.
+     */
+    struct WorkDeque
+    {
+        std::mutex mutex;                 /**< Guards items */
+        std::deque<DirectoryNode*> items; /**< Owner takes from the back, thieves from the front */
+    };
+
+    void WorkerLoop(std::size_t workerIndex);
+    bool TryTake(std::size_t workerIndex, DirectoryNode*& outputNode);
+    void Push(std::size_t workerIndex, DirectoryNode* node);
+    void Scan(std::size_t workerIndex, DirectoryReader& reader, EntryFilter& entryFilter, DirectoryNode& node);
+    void Abandon(DirectoryNode& node);
+    void EmitOrdered(DirectoryNode& node);
+
+    unsigned int _threadCount;
+    bool _ordered;
+    bool _reportSizes;
+    std::function<void(std::vector<FileEntry>&&)> _onBatch;
+    FileIterator::DirectoryCallback _onDirectory;
+    const PathFilter* _filter;
+    std::filesystem::path _filterRoot;
+    const std::atomic<bool>* _stopRequested;
+    IoThrottle* _throttle;
+    std::vector<std::unique_ptr<WorkDeque>> _deques;
+    std::atomic<std::size_t> _pendingDirectories;
+    std::atomic<std::size_t> _queuedDirectories;
+    std::atomic<bool> _complete;
+    std::mutex _idleMutex;
+    std::condition_variable _idleCv;
+    std::mutex _readyMutex;
+    std::condition_variable _readyCv;
+};
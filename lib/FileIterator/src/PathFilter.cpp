@@ -0,0 +1,436 @@
+#include "FileIterator/PathFilter.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+/**
+ * @brief Check whether a pattern needs the matcher rather than a plain comparison.
+ *
+ * @param[in] text Pattern text
+ * @return true if the text holds a wildcard, a class or an escape
+ */
+bool HasGlobSyntax(std::string_view text)
+{
+    return std::string_view::npos != text.find_first_of("*?[\\");
+}
+
+/**
+ * @brief Remove trailing spaces that are not escaped with a backslash.
+ *
+ * @param[in] line Pattern line
+ * @return Line without its unescaped trailing spaces
+ */
+std::string_view TrimTrailingSpaces(std::string_view line)
+{
+    while ((false == line.empty()) && (('\r' == line.back()) || (' ' == line.back())))
+    {
+        if ((' ' == line.back()) && (2 <= line.size()) && ('\\' == line[line.size() - 2]))
+        {
+            break;
+        }
+        line.remove_suffix(1);
+    }
+    return line;
+}
+}
+
+PathFilter::PathFilter() : _minSize(0), _maxSize(0), _modifiedAfterNs(0), _modifiedBeforeNs(0)
+{
+}
+
+bool PathFilter::Compile(const PathFilterRules& rules, PathFilter& outputFilter)
+{
+    PathFilter filter;
+    filter._minSize = rules.minSize;
+    filter._maxSize = rules.maxSize;
+    filter._modifiedAfterNs = rules.modifiedAfterNs;
+    filter._modifiedBeforeNs = rules.modifiedBeforeNs;
+    for (const auto& line : rules.patterns)
+    {
+        const std::string_view pattern = TrimTrailingSpaces(line);
+        if ((true == pattern.empty()) || ('#' == pattern.front()))
+        {
+            continue;
+        }
+        Rule rule{};
+        if (false == CompileRule(pattern, filter._rules.size(), rule))
+        {
+            return false;
+        }
+        filter._rules.push_back(std::move(rule));
+    }
+
+    // Rules are visited in order, so a later rule for the same name replaces an earlier one.
+    for (const auto& rule : filter._rules)
+    {
+        if (RuleKind::Name != rule.kind)
+        {
+            filter._scannedRules.push_back(rule.order);
+            continue;
+        }
+        NameRules& names = filter._names[rule.text];
+        ((true == rule.directoryOnly) ? names.directory : names.any) = static_cast<std::ptrdiff_t>(rule.order);
+    }
+    outputFilter = std::move(filter);
+    return true;
+}
+
+bool PathFilter::IsEmpty() const
+{
+    return (true == _rules.empty()) && (false == NeedsSizeAndTime());
+}
+
+bool PathFilter::NeedsSizeAndTime() const
+{
+    return (0 != _minSize) || (0 != _maxSize) || (0 != _modifiedAfterNs) || (0 != _modifiedBeforeNs);
+}
+
+bool PathFilter::ExcludesDirectory(std::string_view relativePath) const
+{
+    return Excludes(relativePath, true);
+}
+
+bool PathFilter::ExcludesDirectoryTree(std::string_view relativePath) const
+{
+    if ((true == relativePath.empty()) || (true == _rules.empty()))
+    {
+        return false;
+    }
+    for (std::size_t separator = relativePath.find('/'); std::string_view::npos != separator; separator = relativePath.find('/', separator + 1))
+    {
+        if (true == Excludes(relativePath.substr(0, separator), true))
+        {
+            return true;
+        }
+    }
+    return Excludes(relativePath, true);
+}
+
+bool PathFilter::ExcludesFile(std::string_view relativePath, const FileEntryInfo& info) const
+{
+    if ((true == info.hasSizeAndTime) && (true == ExcludesBySizeOrTime(info.size, info.modificationTimeNs)))
+    {
+        return true;
+    }
+    return Excludes(relativePath, false);
+}
+
+bool PathFilter::ExcludesBySizeOrTime(std::uint64_t size, std::int64_t modificationTimeNs) const
+{
+    return (size < _minSize) || ((0 != _maxSize) && (size > _maxSize)) || ((0 != _modifiedAfterNs) && (modificationTimeNs < _modifiedAfterNs)) ||
+           ((0 != _modifiedBeforeNs) && (modificationTimeNs >= _modifiedBeforeNs));
+}
+
+PathFilter PathFilter::WithoutLimits() const
+{
+    PathFilter filter = *this;
+    filter._minSize = 0;
+    filter._maxSize = 0;
+    filter._modifiedAfterNs = 0;
+    filter._modifiedBeforeNs = 0;
+    return filter;
+}
+
+/**
+ * @brief Compile one pattern line that is neither blank nor a comment.
+ *
+ * @param[in] pattern Pattern line without trailing spaces
+ * @param[in] order Position of the pattern among the compiled ones
+ * @param[out] outputRule Compiled pattern
+ * @return true on success, false if the pattern is malformed
+ */
+bool PathFilter::CompileRule(std::string_view pattern, std::size_t order, Rule& outputRule)
+{
+    outputRule.order = order;
+    outputRule.negated = ('!' == pattern.front());
+    if (true == outputRule.negated)
+    {
+        pattern.remove_prefix(1);
+    }
+    outputRule.directoryOnly = (false == pattern.empty()) && ('/' == pattern.back());
+    if (true == outputRule.directoryOnly)
+    {
+        pattern.remove_suffix(1);
+    }
+    // A slash anywhere but at the end ties the pattern to the root; a leading one is only the marker.
+    outputRule.anchored = (std::string_view::npos != pattern.find('/'));
+    if ((false == pattern.empty()) && ('/' == pattern.front()))
+    {
+        pattern.remove_prefix(1);
+    }
+    if (true == pattern.empty())
+    {
+        return false;
+    }
+
+    const bool hasGlob = HasGlobSyntax(pattern);
+    if (false == hasGlob)
+    {
+        outputRule.kind = (true == outputRule.anchored) ? RuleKind::Path : RuleKind::Name;
+        outputRule.text.assign(pattern);
+        return true;
+    }
+    if ((false == outputRule.anchored) && ('*' == pattern.front()) && (false == HasGlobSyntax(pattern.substr(1))))
+    {
+        outputRule.kind = RuleKind::Suffix;
+        outputRule.text.assign(pattern.substr(1));
+        return true;
+    }
+    outputRule.kind = RuleKind::Automaton;
+    return CompileTokens(pattern, outputRule.tokens);
+}
+
+/**
+ * @brief Translate a glob into matcher steps.
+ *
+ * @param[in] glob Pattern without its negation, anchor and directory markers
+ * @param[out] outputTokens Matcher steps
+ * @return true on success, false on an unterminated class, a dangling escape or too many steps
+ */
+bool PathFilter::CompileTokens(std::string_view glob, std::vector<Token>& outputTokens)
+{
+    outputTokens.clear();
+    auto addToken = [&outputTokens](TokenType type, char literal)
+    {
+        Token token{};
+        token.type = type;
+        token.literal = literal;
+        outputTokens.push_back(token);
+    };
+
+    for (std::size_t i = 0; i < glob.size();)
+    {
+        const char c = glob[i];
+        if ('\\' == c)
+        {
+            if (i + 1 >= glob.size())
+            {
+                return false;
+            }
+            addToken(TokenType::Literal, glob[i + 1]);
+            i += 2;
+        }
+        else if ('*' == c)
+        {
+            std::size_t end = i;
+            while ((end < glob.size()) && ('*' == glob[end]))
+            {
+                ++end;
+            }
+            // `**` is special only as a whole path component; elsewhere it is a plain star.
+            const bool wholeComponent = (2 == end - i) && ((0 == i) || ('/' == glob[i - 1])) && ((end == glob.size()) || ('/' == glob[end]));
+            if ((true == wholeComponent) && (end == glob.size()))
+            {
+                addToken(TokenType::Globstar, 0);
+                i = end;
+            }
+            else if (true == wholeComponent)
+            {
+                addToken(TokenType::GlobstarDir, 0);
+                i = end + 1;
+            }
+            else
+            {
+                addToken(TokenType::Star, 0);
+                i = end;
+            }
+        }
+        else if ('?' == c)
+        {
+            addToken(TokenType::AnyChar, 0);
+            ++i;
+        }
+        else if ('[' == c)
+        {
+            std::size_t j = i + 1;
+            const bool negate = (j < glob.size()) && (('!' == glob[j]) || ('^' == glob[j]));
+            if (true == negate)
+            {
+                ++j;
+            }
+            Token token{};
+            token.type = TokenType::CharClass;
+            bool closed = false;
+            for (bool first = true; j < glob.size(); first = false)
+            {
+                if ((']' == glob[j]) && (false == first))
+                {
+                    closed = true;
+                    ++j;
+                    break;
+                }
+                unsigned char low = static_cast<unsigned char>(glob[j]);
+                if (('\\' == glob[j]) && (j + 1 < glob.size()))
+                {
+                    low = static_cast<unsigned char>(glob[++j]);
+                }
+                ++j;
+                unsigned char high = low;
+                if ((j + 1 < glob.size()) && ('-' == glob[j]) && (']' != glob[j + 1]))
+                {
+                    high = static_cast<unsigned char>(glob[j + 1]);
+                    j += 2;
+                }
+                for (unsigned int value = low; value <= high; ++value)
+                {
+                    token.chars.set(value);
+                }
+            }
+            if (false == closed)
+            {
+                return false;
+            }
+            if (true == negate)
+            {
+                token.chars.flip();
+            }
+            token.chars.reset(static_cast<unsigned char>('/'));
+            outputTokens.push_back(token);
+            i = j;
+        }
+        else
+        {
+            addToken(TokenType::Literal, c);
+            ++i;
+        }
+    }
+    return outputTokens.size() <= MaxPatternTokens;
+}
+
+/**
+ * @brief Run compiled steps over a text as a set of active states, one pass per character.
+ *
+ * @param[in] tokens Matcher steps
+ * @param[in] text Name or relative path to match
+ * @return true if the whole text matches
+ */
+bool PathFilter::MatchTokens(const std::vector<Token>& tokens, std::string_view text)
+{
+    const std::size_t tokenCount = tokens.size();
+    // States are "before step i"; the repeating steps may also be skipped without consuming anything,
+    // except a `**/` that has started consuming, which must go on up to a slash.
+    auto closeOver = [&](std::bitset<MaxPatternTokens + 1>& states)
+    {
+        for (std::size_t i = 0; i < tokenCount; ++i)
+        {
+            const TokenType type = tokens[i].type;
+            if ((true == states[i]) && ((TokenType::Star == type) || (TokenType::Globstar == type) || (TokenType::GlobstarDir == type)))
+            {
+                states.set(i + 1);
+            }
+        }
+    };
+
+    std::bitset<MaxPatternTokens + 1> states;
+    states.set(0);
+    closeOver(states);
+    for (const char c : text)
+    {
+        std::bitset<MaxPatternTokens + 1> next;
+        std::bitset<MaxPatternTokens + 1> directoryLoops;
+        for (std::size_t i = 0; i < tokenCount; ++i)
+        {
+            if (false == states[i])
+            {
+                continue;
+            }
+            const Token& token = tokens[i];
+            switch (token.type)
+            {
+            case TokenType::Literal:
+                next[i + 1] = next[i + 1] || (token.literal == c);
+                break;
+            case TokenType::AnyChar:
+                next[i + 1] = next[i + 1] || ('/' != c);
+                break;
+            case TokenType::CharClass:
+                next[i + 1] = next[i + 1] || token.chars[static_cast<unsigned char>(c)];
+                break;
+            case TokenType::Star:
+                next[i] = next[i] || ('/' != c);
+                break;
+            case TokenType::Globstar:
+                next.set(i);
+                break;
+            case TokenType::GlobstarDir:
+                directoryLoops.set(i);
+                next[i + 1] = next[i + 1] || ('/' == c);
+                break;
+            }
+        }
+        closeOver(next);
+        next |= directoryLoops;
+        if (true == next.none())
+        {
+            return false;
+        }
+        states = next;
+    }
+    return states[tokenCount];
+}
+
+/**
+ * @brief Find the last pattern matching a path and report whether it excludes it.
+ *
+ * @param[in] relativePath Path relative to the walk root
+ * @param[in] isDirectory The path is a directory
+ * @return true if the deciding pattern excludes the path
+ */
+bool PathFilter::Excludes(std::string_view relativePath, bool isDirectory) const
+{
+    if (true == _rules.empty())
+    {
+        return false;
+    }
+    const std::size_t separator = relativePath.rfind('/');
+    const std::string_view name = (std::string_view::npos == separator) ? relativePath : relativePath.substr(separator + 1);
+
+    std::ptrdiff_t deciding = -1;
+    if (false == _names.empty())
+    {
+        // The key buffer keeps its capacity, so name lookups do not allocate once it has grown.
+        thread_local std::string lookupKey;
+        lookupKey.assign(name);
+        const auto names = _names.find(lookupKey);
+        if (_names.end() != names)
+        {
+            deciding = std::max(names->second.any, (true == isDirectory) ? names->second.directory : -1);
+        }
+    }
+    for (auto index = _scannedRules.rbegin(); _scannedRules.rend() != index; ++index)
+    {
+        if (static_cast<std::ptrdiff_t>(*index) < deciding)
+        {
+            break;
+        }
+        const Rule& rule = _rules[*index];
+        if ((true == rule.directoryOnly) && (false == isDirectory))
+        {
+            continue;
+        }
+        const std::string_view subject = (true == rule.anchored) ? relativePath : name;
+        bool matched = false;
+        switch (rule.kind)
+        {
+        case RuleKind::Suffix:
+            matched = (subject.size() >= rule.text.size()) && (0 == subject.compare(subject.size() - rule.text.size(), rule.text.size(), rule.text));
+            break;
+        case RuleKind::Path:
+            matched = (subject == rule.text);
+            break;
+        case RuleKind::Automaton:
+            matched = MatchTokens(rule.tokens, subject);
+            break;
+        case RuleKind::Name:
+            break;
+        }
+        if (true == matched)
+        {
+            deciding = static_cast<std::ptrdiff_t>(*index);
+            break;
+        }
+    }
+    return (0 <= deciding) && (false == _rules[static_cast<std::size_t>(deciding)].negated);
+}
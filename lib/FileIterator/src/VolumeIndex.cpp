@@ -0,0 +1,256 @@
+#include "VolumeIndex.hpp"
+
+#include "IoThrottle/IoThrottle.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <winioctl.h>
+#endif
+
+#include <climits>
+#include <cstring>
+#include <string>
+
+namespace
+{
+#ifdef _WIN32
+constexpr DWORD EnumerationBufferSize = 1024 * 1024;
+// FILETIME counts 100 ns intervals since 1601-01-01.
+constexpr std::int64_t FileTimeToUnixEpochIntervals = 116444736000000000LL;
+constexpr std::int64_t NanosecondsPerFileTimeInterval = 100;
+constexpr unsigned int HighWordShift = 32;
+/**
+ * @brief Records below this index are the volume's own metadata files, such as $MFT, which directory listings never show.
+ */
+constexpr std::uint64_t FirstUserRecord = 24;
+constexpr std::uint64_t RecordIndexMask = 0x0000FFFFFFFFFFFFULL;
+
+/**
+ * @brief Closes a handle when it goes out of scope.
+ */
+class ScopedHandle
+{
+  public:
+    explicit ScopedHandle(HANDLE handle) : _handle(handle)
+    {
+    }
+
+    ~ScopedHandle()
+    {
+        if (INVALID_HANDLE_VALUE != _handle)
+        {
+            CloseHandle(_handle);
+        }
+    }
+
+    ScopedHandle(const ScopedHandle&) = delete;
+    ScopedHandle& operator=(const ScopedHandle&) = delete;
+
+    HANDLE Get() const
+    {
+        return _handle;
+    }
+
+  private:
+    HANDLE _handle;
+};
+
+/**
+ * @brief Read the file reference number of a directory.
+ *
+ * @param[in] directory Directory to query
+ * @param[out] outputReference Reference number, as the records of its entries name their parent
+ * @return true on success, false on error
+ */
+bool ReadFileReference(const std::filesystem::path& directory, std::uint64_t& outputReference)
+{
+    const ScopedHandle handle(CreateFileW(directory.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                          FILE_FLAG_BACKUP_SEMANTICS, nullptr));
+    BY_HANDLE_FILE_INFORMATION information{};
+    if ((INVALID_HANDLE_VALUE == handle.Get()) || (FALSE == GetFileInformationByHandle(handle.Get(), &information)))
+    {
+        return false;
+    }
+    outputReference = (static_cast<std::uint64_t>(information.nFileIndexHigh) << HighWordShift) | information.nFileIndexLow;
+    return true;
+}
+
+/**
+ * @brief Open the NTFS volume holding a path for enumeration.
+ *
+ * @param[in] path Path on the volume
+ * @return Volume handle, INVALID_HANDLE_VALUE if the volume is not NTFS or the process may not open it
+ */
+HANDLE OpenNtfsVolume(const std::filesystem::path& path)
+{
+    wchar_t mountPoint[MAX_PATH + 1] = {};
+    wchar_t volumeName[MAX_PATH + 1] = {};
+    wchar_t fileSystem[MAX_PATH + 1] = {};
+    if ((FALSE == GetVolumePathNameW(path.c_str(), mountPoint, MAX_PATH)) ||
+        (FALSE == GetVolumeInformationW(mountPoint, nullptr, 0, nullptr, nullptr, nullptr, fileSystem, MAX_PATH)) || (0 != wcscmp(fileSystem, L"NTFS")) ||
+        (FALSE == GetVolumeNameForVolumeMountPointW(mountPoint, volumeName, MAX_PATH)))
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+    // The volume itself is opened without the trailing separator of its name.
+    std::wstring volume(volumeName);
+    if ((false == volume.empty()) && (L'\\' == volume.back()))
+    {
+        volume.pop_back();
+    }
+    return CreateFileW(volume.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+}
+#endif
+} // namespace
+
+VolumeIndex::VolumeIndex() : _root(0)
+{
+}
+
+bool VolumeIndex::Load(const std::filesystem::path& root, IoThrottle* throttle, VolumeIndex& outputIndex)
+{
+    outputIndex = VolumeIndex();
+#ifdef _WIN32
+    const ScopedHandle volume(OpenNtfsVolume(root));
+    if ((INVALID_HANDLE_VALUE == volume.Get()) || (false == ReadFileReference(root, outputIndex._root)))
+    {
+        return false;
+    }
+
+    // Without an active change journal every record is older than the highest possible USN.
+    USN_JOURNAL_DATA_V0 journal{};
+    DWORD returnedBytes = 0;
+    const USN highUsn = (FALSE != DeviceIoControl(volume.Get(), FSCTL_QUERY_USN_JOURNAL, nullptr, 0, &journal, sizeof(journal), &returnedBytes, nullptr))
+                            ? journal.NextUsn
+                            : LLONG_MAX;
+
+    MFT_ENUM_DATA_V0 request{};
+    request.StartFileReferenceNumber = 0;
+    request.LowUsn = 0;
+    request.HighUsn = highUsn;
+    std::vector<std::uint8_t> buffer(EnumerationBufferSize);
+    while (true)
+    {
+        if (nullptr != throttle)
+        {
+            throttle->AcquireMetadata();
+        }
+        if (FALSE == DeviceIoControl(volume.Get(), FSCTL_ENUM_USN_DATA, &request, sizeof(request), buffer.data(), EnumerationBufferSize, &returnedBytes,
+                                     nullptr))
+        {
+            if (ERROR_HANDLE_EOF != GetLastError())
+            {
+                return false;
+            }
+            break;
+        }
+        if (returnedBytes < sizeof(USN))
+        {
+            break;
+        }
+        // Each reply starts with the reference number the next request continues from.
+        std::memcpy(&request.StartFileReferenceNumber, buffer.data(), sizeof(USN));
+        DWORD offset = sizeof(USN);
+        while (offset + sizeof(USN_RECORD_V2) <= returnedBytes)
+        {
+            const auto* record = reinterpret_cast<const USN_RECORD_V2*>(buffer.data() + offset);
+            if ((0 == record->RecordLength) || (returnedBytes < offset + record->RecordLength))
+            {
+                return false;
+            }
+            offset += record->RecordLength;
+            if ((2 != record->MajorVersion) || ((record->FileReferenceNumber & RecordIndexMask) < FirstUserRecord))
+            {
+                continue;
+            }
+            const auto* name = reinterpret_cast<const wchar_t*>(reinterpret_cast<const std::uint8_t*>(record) + record->FileNameOffset);
+            Entry entry{};
+            entry.parent = record->ParentFileReferenceNumber;
+            entry.name.assign(name, record->FileNameLength / sizeof(wchar_t));
+            const bool isReparsePoint = (0 != (record->FileAttributes & FILE_ATTRIBUTE_REPARSE_POINT));
+            if (0 != (record->FileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            {
+                entry.type = (true == isReparsePoint) ? DirectoryEntryType::Other : DirectoryEntryType::Directory;
+            }
+            else
+            {
+                entry.type = DirectoryEntryType::File;
+            }
+            outputIndex._entries.push_back(std::move(entry));
+            outputIndex._references.push_back(record->FileReferenceNumber);
+        }
+    }
+    outputIndex.Link();
+    return true;
+#else
+    (void)root;
+    (void)throttle;
+    return false;
+#endif
+}
+
+bool VolumeIndex::ReadSizeAndTime(const std::filesystem::path& file, FileEntryInfo& info)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes{};
+    if (FALSE == GetFileAttributesExW(file.c_str(), GetFileExInfoStandard, &attributes))
+    {
+        return false;
+    }
+    // For reparse points the attributes describe the link, not its target, as in a directory listing.
+    if (0 != (attributes.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+    {
+        return true;
+    }
+    const std::int64_t writeTime = static_cast<std::int64_t>((static_cast<std::uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << HighWordShift) |
+                                                             attributes.ftLastWriteTime.dwLowDateTime);
+    info.hasSizeAndTime = true;
+    info.size = (static_cast<std::uint64_t>(attributes.nFileSizeHigh) << HighWordShift) | attributes.nFileSizeLow;
+    info.modificationTimeNs = (writeTime - FileTimeToUnixEpochIntervals) * NanosecondsPerFileTimeInterval;
+    return true;
+#else
+    (void)file;
+    (void)info;
+    return false;
+#endif
+}
+
+std::uint64_t VolumeIndex::Root() const
+{
+    return _root;
+}
+
+const std::vector<std::size_t>& VolumeIndex::Children(std::uint64_t directory) const
+{
+    static const std::vector<std::size_t> none;
+    const auto children = _children.find(directory);
+    return (_children.end() == children) ? none : children->second;
+}
+
+const std::vector<VolumeIndex::Entry>& VolumeIndex::Entries() const
+{
+    return _entries;
+}
+
+std::uint64_t VolumeIndex::Reference(std::size_t index) const
+{
+    return _references[index];
+}
+
+/**
+ * @brief Group the entries by parent once every record has been read.
+ */
+void VolumeIndex::Link()
+{
+    _children.clear();
+    for (std::size_t index = 0; index < _entries.size(); ++index)
+    {
+        _children[_entries[index].parent].push_back(index);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "DirectoryReader.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+class IoThrottle;
+
+/**
+ * @brief Names and parent links of every file and directory on an NTFS volume, read from its master file table.
+ *
+ * Load enumerates the table with FSCTL_ENUM_USN_DATA, a few large requests for the whole volume
+ * instead of one listing per directory, and links each record to its parent by file reference number.
+ * It needs a process allowed to open the volume, an elevated one, and fails everywhere else: on
+ * other platforms and file systems, and without the privilege. The records carry no size or
+ * modification time. A file with several hard links is listed under one of its names only.
+ */
+class VolumeIndex
+{
+  public:
+    /**
+     * @brief One file or directory of the volume.
+     */
+    struct Entry
+    {
+        std::uint64_t parent;                    /**< File reference number of the parent directory */
+        std::filesystem::path::string_type name; /**< Name within the parent */
+        DirectoryEntryType type;                 /**< File, real directory, or a reparse point directory reported as Other */
+    };
+
+    /**
+     * @brief Construct an empty index.
+     */
+    VolumeIndex();
+
+    /**
+     * @brief Read the master file table of the volume holding a directory.
+     *
+     * @param[in] root Directory the walk starts at; the index holds the whole volume
+     * @param[in] throttle Charged one metadata request per enumeration request, nullptr charges nothing
+     * @param[out] outputIndex Index of the volume
+     * @return true on success, false if the volume cannot be enumerated this way
+     */
+    static bool Load(const std::filesystem::path& root, IoThrottle* throttle, VolumeIndex& outputIndex);
+
+    /**
+     * @brief Read the size and modification time of a file the records do not carry.
+     *
+     * @param[in] file File to query
+     * @param[in,out] info Entry info whose size and time are filled
+     * @return true on success, false on an error or where the platform has no volume index
+     */
+    static bool ReadSizeAndTime(const std::filesystem::path& file, FileEntryInfo& info);
+
+    /**
+     * @brief Get the file reference number of the directory Load was called for.
+     *
+     * @return Reference number of the root
+     */
+    std::uint64_t Root() const;
+
+    /**
+     * @brief Get the entries directly inside a directory.
+     *
+     * @param[in] directory File reference number of the directory
+     * @return Indexes into Entries, empty for a directory without entries
+     */
+    const std::vector<std::size_t>& Children(std::uint64_t directory) const;
+
+    /**
+     * @brief Get the entries of the volume.
+     *
+     * @return Every entry read, in table order
+     */
+    const std::vector<Entry>& Entries() const;
+
+    /**
+     * @brief Get the file reference number of an entry.
+     *
+     * @param[in] index Index into Entries
+     * @return Reference number of the entry
+     */
+    std::uint64_t Reference(std::size_t index) const;
+
+  private:
+    void Link();
+
+    std::uint64_t _root;
+    std::vector<Entry> _entries;
+    std::vector<std::uint64_t> _references;
+    std::unordered_map<std::uint64_t, std::vector<std::size_t>> _children;
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef RDEMO_INSTRUMENTATION
+#define RDEMO_INSTRUMENTATION 0
+#endif
+#ifndef RDEMO_HAVE_ITT
+#define RDEMO_HAVE_ITT 0
+#endif
+
+/**
+ * @brief Calls and time of one named scope, or calls and sum of one named counter, summed over threads.
+ */
+struct InstrumentationTotal
+{
+    std::string name;      /**< Name given to RDEMO_SCOPE or RDEMO_COUNT */
+    std::uint64_t calls;   /**< Times the scope was left or the counter was added to */
+    std::uint64_t totalNs; /**< Time spent in the scope, 0 for a counter */
+    std::uint64_t value;   /**< Sum of the values added to the counter, 0 for a scope */
+};
+
+/**
+ * @brief One recorded pass through a scope.
+ */
+struct InstrumentationSpan
+{
+    const char* name;         /**< Static scope name */
+    std::size_t threadIndex;  /**< Buffer the span was recorded into; a buffer serves one thread at a time */
+    std::uint64_t startNs;    /**< Start on the steady clock */
+    std::uint64_t durationNs; /**< Length of the span */
+};
+
+/**
+ * @brief Process-wide recorder behind RDEMO_SCOPE and RDEMO_COUNT.
+ *
+ * Every thread records into its own buffer: a table of up to MaxNamesPerThread names with their calls,
+ * time and values, and a ring of the last SpansPerThread spans. Only the owning thread writes a buffer,
+ * with relaxed loads and stores instead of read-modify-write operations, so recording takes no lock and
+ * no locked instruction. A thread that exits hands its buffer to the next new thread, totals included,
+ * so the number of buffers stays at the most threads alive at once. Names must be string literals;
+ * a name beyond the table of a thread is dropped.
+ *
+ * Built without RDEMO_INSTRUMENTATION, the macros expand to nothing and leave their arguments
+ * unevaluated, and Totals and Spans report nothing.
+ *
+ * Built with the VTune ITT API (-DRDEMO_WITH_ITT=ON), every scope is also an ITT task of the "rdemo"
+ * domain, so VTune attributes its samples to the scope, and callers mark tasks and frames of their own
+ * with BeginTask and BeginFrame. Without it, those are empty inline functions.
+ */
+class Instrumentation
+{
+  public:
+    static constexpr bool Enabled = (0 != RDEMO_INSTRUMENTATION); /**< The macros record */
+    static constexpr bool Annotates = (0 != RDEMO_HAVE_ITT);       /**< Tasks and frames reach VTune */
+    static constexpr std::size_t MaxNamesPerThread = 64;           /**< Distinct names one buffer counts */
+    static constexpr std::size_t SpansPerThread = 4096;            /**< Spans one buffer keeps before the oldest are overwritten */
+
+    /**
+     * @brief Read the clock scopes are timed with.
+     *
+     * @return Nanoseconds on the steady clock
+     */
+    static std::uint64_t NowNs()
+    {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    /**
+     * @brief Record a pass through a scope into the calling thread's buffer.
+     *
+     * @param[in] name Static scope name
+     * @param[in] startNs Start, from NowNs
+     * @param[in] endNs End, from NowNs
+     */
+    static void RecordScope(const char* name, std::uint64_t startNs, std::uint64_t endNs);
+
+    /**
+     * @brief Add to a counter in the calling thread's buffer.
+     *
+     * @param[in] name Static counter name
+     * @param[in] value Amount to add
+     */
+    static void AddCount(const char* name, std::uint64_t value);
+
+    /**
+     * @brief Sum every buffer, including those of threads that have exited.
+     *
+     * @return One total per name, sorted by name
+     */
+    static std::vector<InstrumentationTotal> Totals();
+
+    /**
+     * @brief Get what was recorded since an earlier call of Totals.
+     *
+     * Recordings of other threads in the meantime, such as those of a concurrent backup, are included.
+     *
+     * @param[in] baseline Totals taken before
+     * @return One total per name recorded since, sorted by name
+     */
+    static std::vector<InstrumentationTotal> Since(const std::vector<InstrumentationTotal>& baseline);
+
+    /**
+     * @brief Get the spans still held by the rings that started at or after a time.
+     *
+     * A span recorded while this runs may be reported torn; read once the recording threads are done.
+     *
+     * @param[in] sinceNs Earliest start, from NowNs
+     * @return Spans ordered by buffer, then oldest first
+     */
+    static std::vector<InstrumentationSpan> Spans(std::uint64_t sinceNs);
+
+#if RDEMO_HAVE_ITT
+    /**
+     * @brief Begin an ITT task on the calling thread; tasks of one thread nest.
+     *
+     * @param[in] name Static task name
+     */
+    static void BeginTask(const char* name);
+
+    /**
+     * @brief End the innermost ITT task of the calling thread.
+     */
+    static void EndTask();
+
+    /**
+     * @brief Begin an ITT frame, such as one backup run; frames of concurrent runs may overlap.
+     *
+     * @return Frame ID for EndFrame
+     */
+    static std::uint64_t BeginFrame();
+
+    /**
+     * @brief End a frame.
+     *
+     * @param[in] frame Frame ID from BeginFrame
+     */
+    static void EndFrame(std::uint64_t frame);
+#else
+    static void BeginTask(const char*)
+    {
+    }
+
+    static void EndTask()
+    {
+    }
+
+    static std::uint64_t BeginFrame()
+    {
+        return 0;
+    }
+
+    static void EndFrame(std::uint64_t)
+    {
+    }
+#endif
+};
+
+/**
+ * @brief Times the enclosing scope into the calling thread's buffer; use through RDEMO_SCOPE.
+ */
+class InstrumentationScope
+{
+  public:
+    /**
+     * @brief Start timing.
+     *
+     * @param[in] name Static scope name
+     */
+    explicit InstrumentationScope(const char* name) : _name(name), _startNs(Instrumentation::NowNs())
+    {
+        Instrumentation::BeginTask(name);
+    }
+
+    ~InstrumentationScope()
+    {
+        Instrumentation::EndTask();
+        Instrumentation::RecordScope(_name, _startNs, Instrumentation::NowNs());
+    }
+
+    InstrumentationScope(const InstrumentationScope&) = delete;
+    InstrumentationScope& operator=(const InstrumentationScope&) = delete;
+
+  private:
+    const char* _name;
+    std::uint64_t _startNs;
+};
+
+#define RDEMO_INSTRUMENTATION_CONCAT_INNER(left, right) left##right
+#define RDEMO_INSTRUMENTATION_CONCAT(left, right) RDEMO_INSTRUMENTATION_CONCAT_INNER(left, right)
+
+#if RDEMO_INSTRUMENTATION
+/**
+ * @brief Time the rest of the enclosing block under a static name.
+ */
+#define RDEMO_SCOPE(name) const InstrumentationScope RDEMO_INSTRUMENTATION_CONCAT(rdemoScope, __LINE__)(name)
+/**
+ * @brief Add a value to a counter under a static name.
+ */
+#define RDEMO_COUNT(name, value) Instrumentation::AddCount((name), static_cast<std::uint64_t>(value))
+#else
+#define RDEMO_SCOPE(name) static_cast<void>(0)
+#define RDEMO_COUNT(name, value) static_cast<void>(0)
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#ifndef RDEMO_HAVE_USDT
+#define RDEMO_HAVE_USDT 0
+#endif
+
+// USDT probes of the rdemo provider, for perf, bpftrace and SystemTap.
+//
+// A probe compiles to one nop instruction plus a note in the ELF file naming it and where its arguments
+// live, so a release binary carries every probe at no measurable cost. A tracer attaching to the running
+// process patches the nop with a breakpoint; only then are the arguments read. Probe names are plain
+// identifiers and arguments are integers or pointers, a path being passed as its C string.
+//
+// Built where sys/sdt.h is not found, or with -DRDEMO_WITH_USDT=OFF, the macros expand to nothing and
+// leave their arguments unevaluated.
+#if RDEMO_HAVE_USDT
+#include <sys/sdt.h>
+
+#define RDEMO_PROBE1(name, first) DTRACE_PROBE1(rdemo, name, first)
+#define RDEMO_PROBE2(name, first, second) DTRACE_PROBE2(rdemo, name, first, second)
+#define RDEMO_PROBE3(name, first, second, third) DTRACE_PROBE3(rdemo, name, first, second, third)
+#else
+#define RDEMO_PROBE1(name, first) static_cast<void>(0)
+#define RDEMO_PROBE2(name, first, second) static_cast<void>(0)
+#define RDEMO_PROBE3(name, first, second, third) static_cast<void>(0)
+#endif
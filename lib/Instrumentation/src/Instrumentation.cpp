@@ -0,0 +1,319 @@
+#include "Instrumentation/Instrumentation.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#if RDEMO_HAVE_ITT
+#include <ittnotify.h>
+
+#include <unordered_map>
+#endif
+
+namespace
+{
+/**
+ * @brief Calls, time and value of one name in one buffer.
+ */
+struct NameSlot
+{
+    std::atomic<const char*> name{nullptr};
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> totalNs{0};
+    std::atomic<std::uint64_t> value{0};
+};
+
+/**
+ * @brief One span in a ring; fields are atomic so a concurrent reader sees a torn span at worst.
+ */
+struct SpanSlot
+{
+    std::atomic<const char*> name{nullptr};
+    std::atomic<std::uint64_t> startNs{0};
+    std::atomic<std::uint64_t> durationNs{0};
+};
+
+/**
+ * @brief Buffer written by one thread at a time.
+ */
+struct ThreadBuffer
+{
+    explicit ThreadBuffer(std::size_t index) : threadIndex(index), spans(Instrumentation::SpansPerThread)
+    {
+    }
+
+    std::size_t threadIndex;
+    std::array<NameSlot, Instrumentation::MaxNamesPerThread> names;
+    std::vector<SpanSlot> spans;
+    std::atomic<std::uint64_t> recordedSpans{0};
+};
+
+/**
+ * @brief Every buffer ever created, and those whose thread has exited.
+ */
+struct Registry
+{
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::vector<ThreadBuffer*> freeBuffers;
+};
+
+Registry& GetRegistry()
+{
+    // Never destroyed, so threads exiting during static destruction can still return their buffer.
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+/**
+ * @brief Buffer of the calling thread, taken on first use and returned when the thread exits.
+ */
+class BufferLease
+{
+  public:
+    BufferLease()
+    {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (false == registry.freeBuffers.empty())
+        {
+            _buffer = registry.freeBuffers.back();
+            registry.freeBuffers.pop_back();
+            return;
+        }
+        registry.buffers.push_back(std::make_unique<ThreadBuffer>(registry.buffers.size()));
+        _buffer = registry.buffers.back().get();
+    }
+
+    ~BufferLease()
+    {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.freeBuffers.push_back(_buffer);
+    }
+
+    BufferLease(const BufferLease&) = delete;
+    BufferLease& operator=(const BufferLease&) = delete;
+
+    ThreadBuffer& Buffer()
+    {
+        return *_buffer;
+    }
+
+  private:
+    ThreadBuffer* _buffer;
+};
+
+ThreadBuffer& CurrentBuffer()
+{
+    thread_local BufferLease lease;
+    return lease.Buffer();
+}
+
+/**
+ * @brief Find the slot of a name in a buffer, claiming a free one on first use.
+ *
+ * Names are compared by pointer first; the same literal may have another address in another
+ * translation unit, which the second pass finds by content.
+ *
+ * @param[in,out] buffer Buffer of the calling thread
+ * @param[in] name Static name
+ * @return Slot of the name, nullptr if the table is full
+ */
+NameSlot* FindSlot(ThreadBuffer& buffer, const char* name)
+{
+    for (NameSlot& slot : buffer.names)
+    {
+        const char* slotName = slot.name.load(std::memory_order_relaxed);
+        if (name == slotName)
+        {
+            return &slot;
+        }
+        if (nullptr == slotName)
+        {
+            break;
+        }
+    }
+    for (NameSlot& slot : buffer.names)
+    {
+        const char* slotName = slot.name.load(std::memory_order_relaxed);
+        if (nullptr == slotName)
+        {
+            slot.name.store(name, std::memory_order_release);
+            return &slot;
+        }
+        if (0 == std::strcmp(slotName, name))
+        {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+void Add(std::atomic<std::uint64_t>& counter, std::uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+#if RDEMO_HAVE_ITT
+__itt_domain* Domain()
+{
+    static __itt_domain* const domain = __itt_domain_create("rdemo");
+    return domain;
+}
+
+/**
+ * @brief Get the ITT handle of a task name.
+ *
+ * ittnotify creates handles under a global lock, so each thread keeps the ones it looked up, keyed by
+ * the address of the static name.
+ *
+ * @param[in] name Static task name
+ * @return Handle of the name
+ */
+__itt_string_handle* TaskHandle(const char* name)
+{
+    thread_local std::unordered_map<const char*, __itt_string_handle*> handles;
+    __itt_string_handle*& handle = handles[name];
+    if (nullptr == handle)
+    {
+        handle = __itt_string_handle_create(name);
+    }
+    return handle;
+}
+#endif
+}
+
+void Instrumentation::RecordScope(const char* name, std::uint64_t startNs, std::uint64_t endNs)
+{
+    ThreadBuffer& buffer = CurrentBuffer();
+    const std::uint64_t durationNs = (endNs > startNs) ? (endNs - startNs) : 0;
+    NameSlot* slot = FindSlot(buffer, name);
+    if (nullptr != slot)
+    {
+        Add(slot->calls, 1);
+        Add(slot->totalNs, durationNs);
+    }
+    const std::uint64_t recorded = buffer.recordedSpans.load(std::memory_order_relaxed);
+    SpanSlot& span = buffer.spans[static_cast<std::size_t>(recorded % SpansPerThread)];
+    span.name.store(name, std::memory_order_relaxed);
+    span.startNs.store(startNs, std::memory_order_relaxed);
+    span.durationNs.store(durationNs, std::memory_order_relaxed);
+    buffer.recordedSpans.store(recorded + 1, std::memory_order_release);
+}
+
+void Instrumentation::AddCount(const char* name, std::uint64_t value)
+{
+    NameSlot* slot = FindSlot(CurrentBuffer(), name);
+    if (nullptr != slot)
+    {
+        Add(slot->calls, 1);
+        Add(slot->value, value);
+    }
+}
+
+std::vector<InstrumentationTotal> Instrumentation::Totals()
+{
+    std::map<std::string, InstrumentationTotal> totals;
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto& buffer : registry.buffers)
+    {
+        for (const NameSlot& slot : buffer->names)
+        {
+            const char* name = slot.name.load(std::memory_order_acquire);
+            if (nullptr == name)
+            {
+                break;
+            }
+            InstrumentationTotal& total = totals.emplace(name, InstrumentationTotal{name, 0, 0, 0}).first->second;
+            total.calls += slot.calls.load(std::memory_order_relaxed);
+            total.totalNs += slot.totalNs.load(std::memory_order_relaxed);
+            total.value += slot.value.load(std::memory_order_relaxed);
+        }
+    }
+    std::vector<InstrumentationTotal> output;
+    output.reserve(totals.size());
+    for (auto& entry : totals)
+    {
+        output.push_back(std::move(entry.second));
+    }
+    return output;
+}
+
+std::vector<InstrumentationTotal> Instrumentation::Since(const std::vector<InstrumentationTotal>& baseline)
+{
+    std::vector<InstrumentationTotal> output;
+    for (InstrumentationTotal& total : Totals())
+    {
+        // Both lists are sorted by name.
+        const auto before = std::lower_bound(baseline.begin(), baseline.end(), total.name,
+                                             [](const InstrumentationTotal& entry, const std::string& name) { return entry.name < name; });
+        if ((baseline.end() != before) && (before->name == total.name))
+        {
+            total.calls -= before->calls;
+            total.totalNs -= before->totalNs;
+            total.value -= before->value;
+        }
+        if (0 != total.calls)
+        {
+            output.push_back(std::move(total));
+        }
+    }
+    return output;
+}
+
+std::vector<InstrumentationSpan> Instrumentation::Spans(std::uint64_t sinceNs)
+{
+    std::vector<InstrumentationSpan> output;
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto& buffer : registry.buffers)
+    {
+        // Oldest first: once the ring wrapped, the slot after the newest span holds the oldest one.
+        const std::uint64_t recorded = buffer->recordedSpans.load(std::memory_order_acquire);
+        const std::uint64_t kept = std::min<std::uint64_t>(recorded, SpansPerThread);
+        for (std::uint64_t i = recorded - kept; i < recorded; ++i)
+        {
+            const SpanSlot& span = buffer->spans[static_cast<std::size_t>(i % SpansPerThread)];
+            const std::uint64_t startNs = span.startNs.load(std::memory_order_relaxed);
+            if (sinceNs <= startNs)
+            {
+                output.push_back(InstrumentationSpan{span.name.load(std::memory_order_relaxed), buffer->threadIndex, startNs,
+                                                     span.durationNs.load(std::memory_order_relaxed)});
+            }
+        }
+    }
+    return output;
+}
+
+#if RDEMO_HAVE_ITT
+void Instrumentation::BeginTask(const char* name)
+{
+    __itt_task_begin(Domain(), __itt_null, __itt_null, TaskHandle(name));
+}
+
+void Instrumentation::EndTask()
+{
+    __itt_task_end(Domain());
+}
+
+std::uint64_t Instrumentation::BeginFrame()
+{
+    static std::atomic<std::uint64_t> nextFrame{1};
+    const std::uint64_t frame = nextFrame.fetch_add(1, std::memory_order_relaxed);
+    __itt_id id = __itt_id_make(Domain(), frame);
+    __itt_frame_begin_v3(Domain(), &id);
+    return frame;
+}
+
+void Instrumentation::EndFrame(std::uint64_t frame)
+{
+    __itt_id id = __itt_id_make(Domain(), frame);
+    __itt_frame_end_v3(Domain(), &id);
+}
+#endif
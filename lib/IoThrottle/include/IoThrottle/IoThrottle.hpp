@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief Read and write budgets of an IoThrottle, and latency it injects; 0 leaves a budget unlimited and adds no latency.
+ *
+ * The latencies do not limit anything on real storage. They make a local directory behave like a
+ * network mount, so that prefetching, batching and adaptive concurrency can be measured without one.
+ */
+struct IoLimits
+{
+    std::uint64_t readBytesPerSecond = 0;  /**< Bytes read per second */
+    std::uint64_t readOpsPerSecond = 0;    /**< Read requests per second */
+    std::uint64_t writeBytesPerSecond = 0; /**< Bytes written per second */
+    std::uint64_t writeOpsPerSecond = 0;   /**< Write requests per second */
+    std::uint64_t readLatencyUs = 0;       /**< Microseconds added to every read */
+    std::uint64_t writeLatencyUs = 0;      /**< Microseconds added to every write */
+    std::uint64_t metadataLatencyUs = 0;   /**< Microseconds added to every open, stat and directory listing */
+
+    /**
+     * @brief Check whether any budget is limited.
+     *
+     * @return true if at least one budget or latency is set
+     */
+    bool IsLimited() const
+    {
+        return (0 != readBytesPerSecond) || (0 != readOpsPerSecond) || (0 != writeBytesPerSecond) || (0 != writeOpsPerSecond) ||
+               (0 != readLatencyUs) || (0 != writeLatencyUs) || (0 != metadataLatencyUs);
+    }
+};
+
+/**
+ * @brief Parse limits from the text of a throttle control file.
+ *
+ * The text holds one `key = value` pair per line: `read-bandwidth` and `write-bandwidth` in MiB/s, fractions
+ * allowed, `read-iops` and `write-iops` in requests per second, and `read-latency`, `write-latency` and
+ * `metadata-latency` in milliseconds, fractions allowed. A value of 0 lifts the limit. Blank lines
+ * and lines starting with `#` are ignored; keys that do not appear keep their value.
+ *
+ * @param[in] text Control file content
+ * @param[in,out] limits Limits updated with the values found
+ * @return true if every line was understood, false otherwise, in which case limits is left unchanged
+ */
+bool ParseIoLimits(const std::string& text, IoLimits& limits);
+
+/**
+ * @brief Token-bucket rate limiter shared by every thread reading or writing file content.
+ *
+ * Each budget is a bucket refilled at its rate and holding at most BurstWindow worth of tokens. Callers
+ * report a request once it is done; the request takes its tokens even when that leaves the bucket in
+ * debt, and the caller then sleeps until the debt is paid off. Requests from all threads are thereby
+ * paced evenly instead of running at full speed and stalling once per second, as rsync's `--bwlimit`
+ * does between writes. Limits can be changed at any time; sleeping threads wake up and continue under
+ * the new limits.
+ *
+ * A latency is added to the sleep of each request after its budgets are paid. Unlike the budgets it is
+ * not shared, so requests from several threads wait out their latencies at the same time, as round
+ * trips to a file server do. Metadata requests only have a latency.
+ */
+class IoThrottle
+{
+  public:
+    /**
+     * @brief Longest idle time a bucket saves tokens for, and so the largest burst it lets through at once.
+     */
+    static constexpr std::chrono::milliseconds BurstWindow{50};
+
+    /**
+     * @brief Suggested largest request, in bytes, for callers that choose their own request size.
+     *
+     * Keeps the sleep after one request short at low limits.
+     */
+    static constexpr std::size_t RequestSize = 1024 * 1024;
+
+    /**
+     * @brief Create a throttle.
+     *
+     * @param[in] limits Initial limits
+     */
+    explicit IoThrottle(const IoLimits& limits = IoLimits());
+
+    IoThrottle(const IoThrottle&) = delete;
+    IoThrottle& operator=(const IoThrottle&) = delete;
+
+    /**
+     * @brief Replace the limits and wake every throttled thread.
+     *
+     * @param[in] limits New limits
+     */
+    void SetLimits(const IoLimits& limits);
+
+    /**
+     * @brief Get the current limits.
+     *
+     * @return Limits in effect
+     */
+    IoLimits Limits() const;
+
+    /**
+     * @brief Account for one completed read and wait until the read budgets allow the next one.
+     *
+     * @param[in] bytes Bytes read
+     */
+    void AcquireRead(std::uint64_t bytes);
+
+    /**
+     * @brief Account for one completed write and wait until the write budgets allow the next one.
+     *
+     * @param[in] bytes Bytes written
+     */
+    void AcquireWrite(std::uint64_t bytes);
+
+    /**
+     * @brief Account for one completed open, stat or directory listing and wait out the metadata latency.
+     */
+    void AcquireMetadata();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @brief Token bucket tracked as the time at which its debt will have been paid off.
+     */
+    struct Bucket
+    {
+        std::uint64_t rate = 0;      /**< Tokens per second, 0 for unlimited */
+        Clock::time_point paidUntil; /**< Time the tokens taken so far are refilled */
+
+        Clock::time_point Take(std::uint64_t tokens, Clock::time_point now);
+    };
+
+    void Acquire(Bucket& bytesBucket, Bucket& opsBucket, std::uint64_t bytes, const std::chrono::microseconds& latency);
+    void SleepUntil(std::unique_lock<std::mutex>& lock, Clock::time_point resume);
+
+    mutable std::mutex _mutex;
+    std::condition_variable _limitsChangedCv;
+    std::atomic<bool> _limited;
+    std::uint64_t _generation; /**< Bumped on every SetLimits, so sleepers notice the change */
+    Bucket _readBytes;
+    Bucket _readOps;
+    Bucket _writeBytes;
+    Bucket _writeOps;
+    std::chrono::microseconds _readLatency;
+    std::chrono::microseconds _writeLatency;
+    std::chrono::microseconds _metadataLatency;
+};
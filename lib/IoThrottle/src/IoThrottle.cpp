@@ -0,0 +1,221 @@
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <string_view>
+
+namespace
+{
+constexpr double BytesPerMebibyte = 1024.0 * 1024.0;
+constexpr double MicrosecondsPerMillisecond = 1000.0;
+
+/**
+ * @brief Remove leading and trailing blanks.
+ *
+ * @param[in] text Text to trim
+ * @return Text without surrounding spaces, tabs and carriage returns
+ */
+std::string_view Trim(std::string_view text)
+{
+    const std::size_t first = text.find_first_not_of(" \t\r");
+    if (std::string_view::npos == first)
+    {
+        return std::string_view();
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+/**
+ * @brief Parse a non-negative number that spans the whole text.
+ *
+ * @param[in] text Number text
+ * @param[out] outputValue Parsed value
+ * @return true if the text is a finite non-negative number, false otherwise
+ */
+bool ParseNumber(std::string_view text, double& outputValue)
+{
+    const std::string number(text);
+    char* end = nullptr;
+    errno = 0;
+    const double value = std::strtod(number.c_str(), &end);
+    if ((true == number.empty()) || (number.c_str() + number.size() != end) || (0 != errno) || (false == std::isfinite(value)) || (0.0 > value))
+    {
+        return false;
+    }
+    outputValue = value;
+    return true;
+}
+}
+
+bool ParseIoLimits(const std::string& text, IoLimits& limits)
+{
+    IoLimits parsed = limits;
+    std::string_view remaining = text;
+    while (false == remaining.empty())
+    {
+        const std::size_t lineEnd = remaining.find('\n');
+        const std::string_view line = Trim(remaining.substr(0, lineEnd));
+        remaining = (std::string_view::npos == lineEnd) ? std::string_view() : remaining.substr(lineEnd + 1);
+        if ((true == line.empty()) || ('#' == line.front()))
+        {
+            continue;
+        }
+
+        const std::size_t separator = line.find('=');
+        double value = 0.0;
+        if ((std::string_view::npos == separator) || (false == ParseNumber(Trim(line.substr(separator + 1)), value)))
+        {
+            return false;
+        }
+        const std::string_view key = Trim(line.substr(0, separator));
+        if ("read-bandwidth" == key)
+        {
+            parsed.readBytesPerSecond = static_cast<std::uint64_t>(std::llround(value * BytesPerMebibyte));
+        }
+        else if ("write-bandwidth" == key)
+        {
+            parsed.writeBytesPerSecond = static_cast<std::uint64_t>(std::llround(value * BytesPerMebibyte));
+        }
+        else if ("read-iops" == key)
+        {
+            parsed.readOpsPerSecond = static_cast<std::uint64_t>(std::llround(value));
+        }
+        else if ("write-iops" == key)
+        {
+            parsed.writeOpsPerSecond = static_cast<std::uint64_t>(std::llround(value));
+        }
+        else if ("read-latency" == key)
+        {
+            parsed.readLatencyUs = static_cast<std::uint64_t>(std::llround(value * MicrosecondsPerMillisecond));
+        }
+        else if ("write-latency" == key)
+        {
+            parsed.writeLatencyUs = static_cast<std::uint64_t>(std::llround(value * MicrosecondsPerMillisecond));
+        }
+        else if ("metadata-latency" == key)
+        {
+            parsed.metadataLatencyUs = static_cast<std::uint64_t>(std::llround(value * MicrosecondsPerMillisecond));
+        }
+        else
+        {
+            return false;
+        }
+    }
+    limits = parsed;
+    return true;
+}
+
+IoThrottle::IoThrottle(const IoLimits& limits)
+    : _limited(false), _generation(0), _readLatency(0), _writeLatency(0), _metadataLatency(0)
+{
+    SetLimits(limits);
+}
+
+void IoThrottle::SetLimits(const IoLimits& limits)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // Debt run up under the old limits is forgiven; the buckets start empty under the new ones.
+        const Clock::time_point now = Clock::now();
+        _readBytes = Bucket{limits.readBytesPerSecond, now};
+        _readOps = Bucket{limits.readOpsPerSecond, now};
+        _writeBytes = Bucket{limits.writeBytesPerSecond, now};
+        _writeOps = Bucket{limits.writeOpsPerSecond, now};
+        _readLatency = std::chrono::microseconds(limits.readLatencyUs);
+        _writeLatency = std::chrono::microseconds(limits.writeLatencyUs);
+        _metadataLatency = std::chrono::microseconds(limits.metadataLatencyUs);
+        ++_generation;
+        _limited.store(limits.IsLimited(), std::memory_order_relaxed);
+    }
+    _limitsChangedCv.notify_all();
+}
+
+IoLimits IoThrottle::Limits() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    IoLimits limits;
+    limits.readBytesPerSecond = _readBytes.rate;
+    limits.readOpsPerSecond = _readOps.rate;
+    limits.writeBytesPerSecond = _writeBytes.rate;
+    limits.writeOpsPerSecond = _writeOps.rate;
+    limits.readLatencyUs = static_cast<std::uint64_t>(_readLatency.count());
+    limits.writeLatencyUs = static_cast<std::uint64_t>(_writeLatency.count());
+    limits.metadataLatencyUs = static_cast<std::uint64_t>(_metadataLatency.count());
+    return limits;
+}
+
+void IoThrottle::AcquireRead(std::uint64_t bytes)
+{
+    Acquire(_readBytes, _readOps, bytes, _readLatency);
+}
+
+void IoThrottle::AcquireWrite(std::uint64_t bytes)
+{
+    Acquire(_writeBytes, _writeOps, bytes, _writeLatency);
+}
+
+void IoThrottle::AcquireMetadata()
+{
+    if (false == _limited.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    SleepUntil(lock, Clock::now() + _metadataLatency);
+}
+
+/**
+ * @brief Take tokens from a bucket.
+ *
+ * A bucket that was idle for longer than BurstWindow only keeps BurstWindow worth of tokens.
+ *
+ * @param[in] tokens Tokens to take
+ * @param[in] now Current time
+ * @return Time from which the caller may continue
+ */
+IoThrottle::Clock::time_point IoThrottle::Bucket::Take(std::uint64_t tokens, Clock::time_point now)
+{
+    if (0 == rate)
+    {
+        return now;
+    }
+    paidUntil = std::max(paidUntil, now - BurstWindow);
+    paidUntil += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(static_cast<double>(tokens) / static_cast<double>(rate)));
+    return paidUntil - BurstWindow;
+}
+
+/**
+ * @brief Charge one request to a byte and a request bucket and sleep off the larger debt plus the latency.
+ *
+ * @param[in,out] bytesBucket Byte budget of the direction
+ * @param[in,out] opsBucket Request budget of the direction
+ * @param[in] bytes Bytes moved by the request
+ * @param[in] latency Latency member of the direction, only read under the lock
+ */
+void IoThrottle::Acquire(Bucket& bytesBucket, Bucket& opsBucket, std::uint64_t bytes, const std::chrono::microseconds& latency)
+{
+    if (false == _limited.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    const Clock::time_point now = Clock::now();
+    const Clock::time_point paid = std::max(bytesBucket.Take(bytes, now), opsBucket.Take(1, now));
+    SleepUntil(lock, std::max(paid, now) + latency);
+}
+
+/**
+ * @brief Sleep until a point in time or until the limits change, with the lock released meanwhile.
+ *
+ * @param[in,out] lock Held lock on _mutex
+ * @param[in] resume Time to continue at
+ */
+void IoThrottle::SleepUntil(std::unique_lock<std::mutex>& lock, Clock::time_point resume)
+{
+    const std::uint64_t generation = _generation;
+    _limitsChangedCv.wait_until(lock, resume, [&]() { return generation != _generation; });
+}
@@ -2,26 +2,57 @@
 
 #pragma once
 
+#include "SQLite/SQLiteOpenMode.hpp"
+#include "SQLite/SQLitePerformanceProfile.hpp"
 #include "SQLite/SQLiteStatement.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <memory>
 #include <string>
+#include <unordered_map>
 
 struct sqlite3;
 
+/**
+ * @brief How a WAL checkpoint treats concurrent connections.
+ */
+enum class SQLiteCheckpointMode
+{
+    Passive, /**< Copy as many frames as possible without waiting for readers or writers */
+    Truncate /**< Wait for readers and writers, copy every frame and truncate the WAL file to zero bytes */
+};
+
 /**
  * @brief RAII wrapper for a SQLite database connection.
  */
 class SQLiteConnection
 {
   public:
+    /**
+     * @brief Smallest memory map of a read-only connection.
+     */
+    static constexpr long long ReadOnlyMmapSizeBytes = 256LL * 1024 * 1024;
+
     /**
      * @brief Open a SQLite connection to the specified database file.
      *
-     * @param[in] databasePath Path to the SQLite database file
+     * The page size of the profile, and incremental auto-vacuum, only take effect on a database that has no pages yet.
+     * A read-only connection leaves the file as it is: it only applies the cache and memory map of the profile, the
+     * memory map at least ReadOnlyMmapSizeBytes, so query connections share the mapped pages of the OS page cache
+     * instead of copying them into a private cache each.
+     *
+     * @param[in] databasePath Path to the SQLite database file, which must exist when opening read-only
      * @param[in] busyTimeoutMs Busy timeout in milliseconds
+     * @param[in] busyRetries Counter incremented each time a locked database is retried, nullptr counts nothing
+     * @param[in] profile Synchronous mode, cache, memory map, page size and checkpoint interval to apply
+     * @param[in] openMode Open for writing, or read-only for queries that must not wait for or block a writer
      */
-    SQLiteConnection(const std::filesystem::path& databasePath, int busyTimeoutMs);
+    SQLiteConnection(const std::filesystem::path& databasePath, int busyTimeoutMs, std::atomic<std::uint64_t>* busyRetries = nullptr,
+                     SQLitePerformanceProfile profile = SQLitePerformanceProfile::Safe, SQLiteOpenMode openMode = SQLiteOpenMode::ReadWrite);
     /**
      * @brief Close the SQLite connection.
      */
@@ -57,9 +88,117 @@ class SQLiteConnection
      * @return Prepared SQLite statement
      */
     SQLiteStatement Prepare(const std::string& sqlStatement);
+    /**
+     * @brief Lease a cached prepared statement, compiling it on first use.
+     *
+     * The statement is keyed by its SQL text and reset when the lease is released. If the cached
+     * statement is already leased (nested use), a temporary statement is prepared instead.
+     *
+     * @param[in] sqlStatement SQL statement to prepare
+     * @return Lease on a ready-to-bind statement
+     */
+    SQLiteStatementLease PrepareCached(const std::string& sqlStatement);
+    /**
+     * @brief Copy frames from the WAL back into the database file.
+     *
+     * @param[in] mode Checkpoint mode
+     * @return true if the checkpoint ran, false if it failed or, in Truncate mode, could not get exclusive access in time
+     */
+    bool Checkpoint(SQLiteCheckpointMode mode);
+    /**
+     * @brief Copy the main database into a new file with SQLite's online backup API, a few pages at a time.
+     *
+     * Each step reads its pages in a short read transaction and the connection sleeps between steps, so
+     * readers are never blocked and a writer waits at most one step. A write by another connection restarts
+     * the copy from its first page; one through this connection is carried into it. The copy is a consistent
+     * database without a WAL, so it can be moved or compressed as a single file.
+     *
+     * @param[in] destinationPath File to create; an existing file is overwritten
+     * @param[in] pagesPerStep Pages copied per step
+     * @param[in] pause Sleep between two steps
+     * @return true if the whole database was copied, false on error
+     */
+    bool BackupTo(const std::filesystem::path& destinationPath, int pagesPerStep, std::chrono::milliseconds pause);
+
+    /**
+     * @brief Enable or disable the checkpoints a commit runs once the WAL exceeds the profile's wal_autocheckpoint.
+     *
+     * Does nothing on a read-only connection, which never commits.
+     *
+     * @param[in] enabled Restore the profile's interval when true, run no automatic checkpoints when false
+     */
+    void SetAutomaticCheckpoints(bool enabled);
+    /**
+     * @brief Skip or restore the syncs of commits and checkpoints.
+     *
+     * Does nothing on a read-only connection.
+     *
+     * @param[in] deferred Run with synchronous=OFF when true, restore the profile's synchronous mode when false
+     */
+    void SetSyncDeferred(bool deferred);
+    /**
+     * @brief Attach another database file read-only under a schema name.
+     *
+     * A write transaction of this connection never locks the attached file, so other connections
+     * keep writing it meanwhile. Cached statements are dropped, since they may name a table the
+     * attached schema now shadows. Call outside a transaction and while no statement is leased.
+     *
+     * @param[in] databasePath Existing database file
+     * @param[in] schemaName Name that qualifies the attached tables; a plain identifier
+     */
+    void AttachReadOnly(const std::filesystem::path& databasePath, const std::string& schemaName);
+    /**
+     * @brief Detach every attached database and drop the cached statements.
+     *
+     * Call outside a transaction and while no statement is leased.
+     */
+    void DetachAll();
+    /**
+     * @brief Run a setup step that may create temporary views or tables.
+     *
+     * query_only would refuse those on a read-only connection, so it is lifted for the step; the database
+     * file itself stays read-only through the open flags.
+     *
+     * @param[in] setup Setup step; it throws std::runtime_error on failure
+     */
+    void RunSetup(const std::function<void(SQLiteConnection&)>& setup);
+    /**
+     * @brief Check whether the connection was opened read-only.
+     *
+     * @return true for SQLiteOpenMode::ReadOnly
+     */
+    bool IsReadOnly() const;
 
   private:
+    /**
+     * @brief Cached statement together with its lease flag.
+     */
+    struct CachedStatement
+    {
+        std::unique_ptr<SQLiteStatement> statement;
+        bool inUse;
+    };
+
+    /**
+     * @brief Busy handler settings, kept at a stable address for SQLite across moves.
+     */
+    struct BusyHandlerState
+    {
+        int timeoutMs;
+        std::atomic<std::uint64_t>* retries;
+        std::int64_t waitedUs;     /**< Time slept for the lock being waited on */
+        std::uint64_t jitterState; /**< Random state spreading the retries of this connection */
+    };
+
+    static int OnBusy(void* context, int priorCalls);
     void EnableWriteAheadLoggingMode();
+    void ApplyPerformanceProfile(SQLitePerformanceProfile profile);
+    void ApplyReadOnlyProfile(SQLitePerformanceProfile profile);
+    void Close() noexcept;
 
     sqlite3* _database;
+    SQLitePerformanceProfile _profile;
+    SQLiteOpenMode _openMode;
+    std::unique_ptr<BusyHandlerState> _busyHandlerState;
+    std::unordered_map<std::string, CachedStatement> _statementCache;
 };
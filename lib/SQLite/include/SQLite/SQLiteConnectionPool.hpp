@@ -0,0 +1,123 @@
+// file SQLiteConnectionPool.hpp:
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class SQLiteConnection;
+
+/**
+ * @brief Bounded set of open connections to one database, reused by whichever thread needs one next.
+ *
+ * Connections are opened on demand up to the bound. A taker finds an idle connection first, opens a
+ * new one below the bound, and otherwise waits for one to be returned.
+ */
+class SQLiteConnectionPool
+{
+  public:
+    /**
+     * @brief Opens a new connection for the pool.
+     */
+    using Factory = std::function<std::unique_ptr<SQLiteConnection>()>;
+
+    /**
+     * @brief Construct an empty pool.
+     *
+     * @param[in] factory Opens a connection when no idle one is left
+     * @param[in] maxConnections Most connections open at once
+     * @param[in] waitTimeout Longest wait for a returned connection once the bound is reached
+     */
+    SQLiteConnectionPool(Factory factory, std::size_t maxConnections, std::chrono::milliseconds waitTimeout);
+    /**
+     * @brief Close every connection of the pool.
+     */
+    ~SQLiteConnectionPool();
+
+    SQLiteConnectionPool(const SQLiteConnectionPool&) = delete;
+    SQLiteConnectionPool& operator=(const SQLiteConnectionPool&) = delete;
+
+    /**
+     * @brief Take a connection for exclusive use until it is returned.
+     *
+     * @return Idle or newly opened connection
+     * @throws std::runtime_error if no connection was returned within the wait timeout or opening one failed
+     */
+    SQLiteConnection& Take();
+
+    /**
+     * @brief Return a taken connection for reuse.
+     *
+     * @param[in] connection Connection obtained from Take()
+     */
+    void Return(SQLiteConnection& connection);
+
+    /**
+     * @brief Call a function on every open connection, idle or taken.
+     *
+     * Taken connections may be in use by their thread; callers must make sure they are not.
+     *
+     * @param[in] visit Function to call
+     */
+    void ForEachConnection(const std::function<void(SQLiteConnection&)>& visit);
+
+    /**
+     * @brief Get the number of open connections.
+     *
+     * @return Connections opened and not yet closed
+     */
+    std::size_t OpenConnections() const;
+
+  private:
+    Factory _factory;
+    std::size_t _maxConnections;
+    std::chrono::milliseconds _waitTimeout;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _returned;
+    std::vector<std::unique_ptr<SQLiteConnection>> _connections;
+    std::vector<SQLiteConnection*> _idle;
+    std::size_t _opening;
+};
+
+/**
+ * @brief RAII lease of a pooled connection, returned to the pool when the lease ends.
+ */
+class SQLiteConnectionLease
+{
+  public:
+    /**
+     * @brief Take a connection from a pool.
+     *
+     * @param[in] pool Pool to take from; must outlive the lease
+     * @throws std::runtime_error if no connection becomes available
+     */
+    explicit SQLiteConnectionLease(SQLiteConnectionPool& pool);
+    /**
+     * @brief Return the connection to its pool.
+     */
+    ~SQLiteConnectionLease();
+
+    SQLiteConnectionLease(const SQLiteConnectionLease&) = delete;
+    SQLiteConnectionLease& operator=(const SQLiteConnectionLease&) = delete;
+
+    /**
+     * @brief Move-construct a connection lease.
+     *
+     * @param[in] other Lease to move from
+     */
+    SQLiteConnectionLease(SQLiteConnectionLease&& other) noexcept;
+    SQLiteConnectionLease& operator=(SQLiteConnectionLease&& other) = delete;
+
+    SQLiteConnection& operator*() const;
+    SQLiteConnection* operator->() const;
+
+  private:
+    SQLiteConnectionPool* _pool;
+    SQLiteConnection* _connection;
+};
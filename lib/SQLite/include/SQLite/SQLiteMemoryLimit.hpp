@@ -0,0 +1,46 @@
+// file SQLiteMemoryLimit.hpp:
+
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Caps the heap memory of every SQLite connection of the process for a scope.
+ *
+ * Sets SQLite's soft heap limit, so page caches recycle their pages once the connections together reach the
+ * limit instead of each growing to its cache_size. Allocations still succeed above the limit; queries get
+ * slower, never fail. The previous limit is restored when the scope ends.
+ *
+ * SQLite is built without memory accounting, which the limit depends on, because it takes a global mutex
+ * on every allocation. A limit turns accounting on if it is the first use of SQLite in the process, as in
+ * a backup run; a limit applied after that is recorded but not enforced.
+ */
+class SQLiteMemoryLimit
+{
+  public:
+    /**
+     * @brief Apply a soft heap limit.
+     *
+     * @param[in] limitBytes Bytes SQLite should stay within, 0 leaves the current limit in place
+     */
+    explicit SQLiteMemoryLimit(std::uint64_t limitBytes);
+
+    /**
+     * @brief Restore the limit in effect before construction.
+     */
+    ~SQLiteMemoryLimit();
+
+    SQLiteMemoryLimit(const SQLiteMemoryLimit&) = delete;
+    SQLiteMemoryLimit& operator=(const SQLiteMemoryLimit&) = delete;
+
+    /**
+     * @brief Get the soft heap limit currently in effect.
+     *
+     * @return Limit in bytes, 0 if SQLite memory is unlimited
+     */
+    static std::uint64_t Current();
+
+  private:
+    bool _applied;
+    std::int64_t _previousLimit;
+};
@@ -0,0 +1,12 @@
+// file SQLiteOpenMode.hpp:
+
+#pragma once
+
+/**
+ * @brief Whether the connections of a session may write their database.
+ */
+enum class SQLiteOpenMode
+{
+    ReadWrite, /**< Create the file if missing, switch it to WAL and apply the whole performance profile */
+    ReadOnly   /**< Open an existing file read-only with query_only set: reads see a WAL snapshot and never take the write lock */
+};
@@ -0,0 +1,55 @@
+// file SQLitePerformanceProfile.hpp:
+
+#pragma once
+
+#include <string>
+
+/**
+ * @brief Durability and caching trade-off applied to every connection of a session.
+ */
+enum class SQLitePerformanceProfile
+{
+    Safe,     /**< synchronous=FULL and SQLite's default caches: every commit survives a power loss */
+    Balanced, /**< synchronous=NORMAL with a larger cache and a memory map: a power loss may drop the last commits, never corrupts */
+    Bulk      /**< synchronous=OFF, large pages and rare checkpoints for initial loads: a power loss may corrupt the database */
+};
+
+/**
+ * @brief Convert a SQLitePerformanceProfile enumeration value to its string representation.
+ *
+ * @param[in] profile The profile to convert
+ * @return String representation of the profile
+ */
+inline const char* SQLitePerformanceProfileToString(SQLitePerformanceProfile profile)
+{
+    switch (profile)
+    {
+    case SQLitePerformanceProfile::Safe:
+        return "safe";
+    case SQLitePerformanceProfile::Balanced:
+        return "balanced";
+    case SQLitePerformanceProfile::Bulk:
+        return "bulk";
+    }
+    return "safe";
+}
+
+/**
+ * @brief Convert a string to its corresponding SQLitePerformanceProfile enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @param[out] outputProfile Parsed profile
+ * @return true if the string names a known profile, false otherwise
+ */
+inline bool StringToSQLitePerformanceProfile(const std::string& stringValue, SQLitePerformanceProfile& outputProfile)
+{
+    for (SQLitePerformanceProfile profile : {SQLitePerformanceProfile::Safe, SQLitePerformanceProfile::Balanced, SQLitePerformanceProfile::Bulk})
+    {
+        if (SQLitePerformanceProfileToString(profile) == stringValue)
+        {
+            outputProfile = profile;
+            return true;
+        }
+    }
+    return false;
+}
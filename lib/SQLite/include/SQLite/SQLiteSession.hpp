@@ -2,16 +2,29 @@
 
 #pragma once
 
+#include "SQLite/SQLiteConnectionPool.hpp"
+#include "SQLite/SQLiteOpenMode.hpp"
+#include "SQLite/SQLitePerformanceProfile.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <thread>
-#include <unordered_map>
 
 class SQLiteConnection;
 
 /**
  * @brief Manages per-thread SQLite connections for a database file.
+ *
+ * Connections come from a bounded pool. A thread keeps the connection it acquired, found again through
+ * a thread-local binding without taking a lock, and returns it to the pool when it exits, so thread
+ * pools that are torn down and recreated reuse the same connections.
  */
 class SQLiteSession
 {
@@ -21,12 +34,21 @@ class SQLiteSession
      */
     static constexpr int SqliteBusyTimeoutMs = 5000;
 
+    /**
+     * @brief Default bound on the connections open at once.
+     */
+    static constexpr std::size_t DefaultMaxConnections = 256;
+
     /**
      * @brief Construct a SQLite session for the specified database file.
      *
      * @param[in] databasePath Path to the SQLite database file
+     * @param[in] profile Performance profile applied to every connection of the session
+     * @param[in] maxConnections Most connections open at once; acquiring beyond it waits up to the busy timeout for a returned one
+     * @param[in] openMode Mode every connection of the session opens in
      */
-    explicit SQLiteSession(const std::filesystem::path& databasePath);
+    explicit SQLiteSession(const std::filesystem::path& databasePath, SQLitePerformanceProfile profile = SQLitePerformanceProfile::Safe,
+                           std::size_t maxConnections = DefaultMaxConnections, SQLiteOpenMode openMode = SQLiteOpenMode::ReadWrite);
     /**
      * @brief Destroy the SQLite session.
      */
@@ -38,14 +60,122 @@ class SQLiteSession
     /**
      * @brief Acquire a SQLite connection for the current thread.
      *
+     * The first call on a thread takes a connection from the pool and binds it to the thread until the
+     * thread exits; later calls return it without locking.
+     *
      * @return SQLiteConnection reference bound to the current thread
+     * @throws std::runtime_error if the pool stays exhausted for the busy timeout
      */
     SQLiteConnection& Acquire();
 
+    /**
+     * @brief Lease a pooled connection for a scope instead of binding one to the thread.
+     *
+     * @return Lease returning the connection to the pool when it ends
+     * @throws std::runtime_error if the pool stays exhausted for the busy timeout
+     */
+    SQLiteConnectionLease Lease();
+
+    /**
+     * @brief Get the number of open connections of the session.
+     *
+     * @return Connections open in the pool, bound, leased or idle
+     */
+    std::size_t OpenConnections() const;
+
+    /**
+     * @brief Get how often connections of this session retried a locked database.
+     *
+     * @return Busy handler retries summed over all connections so far
+     */
+    std::uint64_t BusyRetries() const;
+
+    /**
+     * @brief Get the database file of the session.
+     *
+     * @return Path the session's connections open
+     */
+    const std::filesystem::path& DatabasePath() const;
+
+    /**
+     * @brief Get the performance profile of the session.
+     *
+     * @return Profile applied to every connection
+     */
+    SQLitePerformanceProfile Profile() const;
+
+    /**
+     * @brief Get the open mode of the session.
+     *
+     * @return Mode every connection opens in
+     */
+    SQLiteOpenMode OpenMode() const;
+
+    /**
+     * @brief Run a setup step on every open connection now and on each connection opened later.
+     *
+     * The step replaces any earlier one, typically to attach other databases or create temporary
+     * views, which read-only connections may create too. Call while no other thread uses the session's
+     * connections.
+     *
+     * @param[in] initializer Setup step, empty for none; it throws std::runtime_error on failure
+     * @throws std::runtime_error if the step fails on an open connection
+     */
+    void SetConnectionInitializer(std::function<void(SQLiteConnection&)> initializer);
+
+    /**
+     * @brief Move WAL checkpoints from committing threads to a background thread.
+     *
+     * Connections stop running automatic checkpoints, so no commit pays for one inline. A background
+     * thread with its own connection runs a passive checkpoint every interval instead. Call while no
+     * other thread uses the session's connections. Does nothing on a read-only session, which leaves
+     * checkpoints to the writer.
+     *
+     * @param[in] interval Time between two passive checkpoints
+     */
+    void StartCheckpointing(std::chrono::milliseconds interval);
+
+    /**
+     * @brief Stop the background checkpoints with a final truncating checkpoint.
+     *
+     * Connections run automatic checkpoints again afterwards. Call while no other thread uses the
+     * session's connections; does nothing if checkpointing was not started.
+     *
+     * @return true if the final checkpoint emptied the WAL or checkpointing was not started, false otherwise
+     */
+    bool StopCheckpointing();
+
+    /**
+     * @brief Skip the syncs of every connection's commits and checkpoints, or restore them.
+     *
+     * Meant for loading a new database, which a power loss while syncs are skipped may corrupt. Applies
+     * to the open connections now and to each connection opened later. Call while no other thread uses
+     * the session's connections, and with background checkpoints stopped; restoring does not flush what
+     * was written meanwhile.
+     *
+     * @param[in] deferred Skip syncs when true, restore the profile's synchronous mode when false
+     * @throws std::runtime_error if an open connection cannot be switched
+     */
+    void SetSyncDeferred(bool deferred);
+
   private:
-    SQLiteConnection CreateConnection();
+    std::unique_ptr<SQLiteConnection> CreateConnection();
+    void RunCheckpoints(std::chrono::milliseconds interval);
 
+    std::uint64_t _sessionId;
     std::filesystem::path _databasePath;
-    std::mutex _connectionsMutex;
-    std::unordered_map<std::thread::id, std::unique_ptr<SQLiteConnection>> _connections;
+    SQLitePerformanceProfile _profile;
+    SQLiteOpenMode _openMode;
+    std::atomic<std::uint64_t> _busyRetries;
+    std::atomic<bool> _backgroundCheckpoints;
+    std::atomic<bool> _syncDeferred;
+    std::shared_ptr<SQLiteConnectionPool> _pool;
+    std::mutex _initializerMutex;
+    std::function<void(SQLiteConnection&)> _connectionInitializer;
+
+    std::thread _checkpointThread;
+    std::mutex _checkpointMutex;
+    std::condition_variable _checkpointWake;
+    bool _checkpointStopRequested;
+    bool _finalCheckpointSucceeded;
 };
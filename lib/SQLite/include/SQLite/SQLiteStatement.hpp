@@ -2,10 +2,37 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 
 struct sqlite3_stmt;
 
+/**
+ * @brief Non-owning view of a BLOB column value.
+ *
+ * The view is valid until the statement is stepped, reset or finalized.
+ */
+struct SQLiteBlob
+{
+    const void* data; /**< Start of the BLOB bytes, nullptr for NULL or empty values */
+    std::size_t size; /**< BLOB length in bytes */
+};
+
+/**
+ * @brief Outcome of one step of a statement through the non-throwing API.
+ */
+enum class SQLiteStepResult
+{
+    Row,  /**< A row is available */
+    Done, /**< The statement ran to completion */
+    Busy, /**< The database stayed locked past the busy timeout */
+    Error /**< Any other failure, described by ErrorMessage */
+};
+
 /**
  * @brief RAII wrapper for a prepared SQLite statement.
  */
@@ -54,6 +81,21 @@ class SQLiteStatement
      * @param[in] value C-string value to bind
      */
     void BindText(int index, const char* value);
+    /**
+     * @brief Bind a 64-bit integer parameter.
+     *
+     * @param[in] index 1-based parameter index
+     * @param[in] value Integer value to bind
+     */
+    void BindInt64(int index, std::int64_t value);
+    /**
+     * @brief Bind a BLOB parameter.
+     *
+     * @param[in] index 1-based parameter index
+     * @param[in] data BLOB bytes to bind
+     * @param[in] size Number of bytes to bind
+     */
+    void BindBlob(int index, const void* data, std::size_t size);
 
     /**
      * @brief Fetch the next row from the statement.
@@ -67,6 +109,30 @@ class SQLiteStatement
      * @return true if execution completes, false if a row is returned
      */
     bool ExecuteStatement();
+    /**
+     * @brief Step through the remaining rows, handing each one to a visitor.
+     *
+     * Column views read inside the visitor are valid only until it returns.
+     *
+     * @param[in] onRow Visitor receiving the statement positioned on each row, returns false to stop early
+     * @return true if every row was visited, false when stopped early
+     */
+    bool ForEachRow(const std::function<bool(const SQLiteStatement&)>& onRow);
+    /**
+     * @brief Step the statement once without throwing.
+     *
+     * For hot paths that turn every failure into a status anyway, so lock contention costs no throw and
+     * unwind. The message of a failure is only formatted if ErrorMessage is called.
+     *
+     * @return Row or Done on success, Busy or Error on failure
+     */
+    SQLiteStepResult TryStep() noexcept;
+    /**
+     * @brief Describe the latest failure on the statement's connection.
+     *
+     * @return SQLite's message for the failure
+     */
+    std::string ErrorMessage() const;
 
     /**
      * @brief Read a text column value from the current row.
@@ -75,9 +141,88 @@ class SQLiteStatement
      * @return Column text value or empty string if null
      */
     std::string ColumnText(int index) const;
+    /**
+     * @brief Read a text column value from the current row without copying it.
+     *
+     * @param[in] index Zero-based column index
+     * @return View of the column text, empty if null; valid until the next step
+     */
+    std::string_view ColumnView(int index) const;
+    /**
+     * @brief Read a 64-bit integer column value from the current row.
+     *
+     * @param[in] index Zero-based column index
+     * @return Column integer value or 0 if null
+     */
+    std::int64_t ColumnInt64(int index) const;
+    /**
+     * @brief Read a BLOB column value from the current row.
+     *
+     * @param[in] index Zero-based column index
+     * @return View of the column bytes, valid until the next step
+     */
+    SQLiteBlob ColumnBlob(int index) const;
+
+    /**
+     * @brief Reset the statement so it can be stepped again; bindings are kept.
+     */
+    void Reset() noexcept;
+    /**
+     * @brief Reset all bound parameters to NULL.
+     */
+    void ClearBindings() noexcept;
 
   private:
     void Finalize();
 
     sqlite3_stmt* _statement;
 };
+
+/**
+ * @brief Lease on a prepared statement handed out by a statement cache.
+ *
+ * The statement is reset and its bindings cleared when the lease is released, so the next lease
+ * starts from a clean state without recompiling the SQL.
+ */
+class SQLiteStatementLease
+{
+  public:
+    /**
+     * @brief Lease a cached statement.
+     *
+     * @param[in] statement Cached statement to lease
+     * @param[in/out] inUse Cache flag marking the statement as leased
+     */
+    SQLiteStatementLease(SQLiteStatement& statement, bool& inUse);
+    /**
+     * @brief Lease a statement that is owned by the lease itself.
+     *
+     * @param[in] statement Statement to own, used when the cached copy is already leased
+     */
+    explicit SQLiteStatementLease(std::unique_ptr<SQLiteStatement> statement);
+    /**
+     * @brief Reset the statement and return it to the cache.
+     */
+    ~SQLiteStatementLease();
+
+    SQLiteStatementLease(const SQLiteStatementLease&) = delete;
+    SQLiteStatementLease& operator=(const SQLiteStatementLease&) = delete;
+
+    /**
+     * @brief Move-construct a statement lease.
+     *
+     * @param[in] other Lease to move from
+     */
+    SQLiteStatementLease(SQLiteStatementLease&& other) noexcept;
+    SQLiteStatementLease& operator=(SQLiteStatementLease&& other) = delete;
+
+    SQLiteStatement& operator*() const;
+    SQLiteStatement* operator->() const;
+
+  private:
+    void Release() noexcept;
+
+    std::unique_ptr<SQLiteStatement> _ownedStatement;
+    SQLiteStatement* _statement;
+    bool* _inUse;
+};
@@ -0,0 +1,58 @@
+// file SQLiteText.hpp:
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief Conversions between native path spellings and the UTF-8 text SQLite stores.
+ *
+ * On POSIX systems native spellings are bytes and are copied unchanged. On Windows they are UTF-16 and
+ * are converted; a spelling that has no UTF-8 form, such as one with an unpaired surrogate, fails the
+ * conversion instead of being stored with replacement characters that would alias another file.
+ */
+class SQLiteText
+{
+  public:
+    /**
+     * @brief Append the UTF-8 spelling of the tail of a native path.
+     *
+     * @param[in] native Native path spelling
+     * @param[in] start Offset of the tail
+     * @param[in,out] output Text to append to, unchanged on failure
+     * @return true on success, false if the tail has no UTF-8 spelling
+     */
+    static bool AppendNative(const std::filesystem::path::string_type& native, std::size_t start, std::string& output);
+
+    /**
+     * @brief Spell UTF-8 text as a native path, assigned in place.
+     *
+     * @param[in] text UTF-8 text
+     * @param[out] output Native spelling, empty on failure
+     * @return true on success, false if the text is not valid UTF-8
+     */
+    static bool AssignNative(std::string_view text, std::filesystem::path::string_type& output);
+
+    /**
+     * @brief Get the UTF-8 spelling of a path, as SQLite expects file names.
+     *
+     * @param[in] path Path to spell
+     * @return UTF-8 path with native separators
+     * @throws std::runtime_error if the path has no UTF-8 spelling
+     */
+    static std::string FromPath(const std::filesystem::path& path);
+
+#ifdef _WIN32
+    /**
+     * @brief Convert text in the ANSI code page, which path::string spells Windows paths in, to UTF-8.
+     *
+     * @param[in] text Text in the ANSI code page
+     * @param[out] output UTF-8 text, empty on failure
+     * @return true on success, false if the text is not valid in the ANSI code page
+     */
+    static bool FromAnsi(std::string_view text, std::string& output);
+#endif
+};
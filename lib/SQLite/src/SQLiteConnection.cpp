@@ -1,41 +1,177 @@
 // file SQLiteConnection.cpp
 
 #include "SQLite/SQLiteConnection.hpp"
+#include "SQLite/SQLiteText.hpp"
 
 #include <sqlite3.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <stdexcept>
+#include <string>
+#include <thread>
 #include <utility>
+#include <vector>
 
 namespace
 {
 constexpr int SqlTextLengthAuto = -1;
+
+/**
+ * @brief Backoff before the retries of a locked database: the first step, the doublings after it and the cap.
+ */
+constexpr std::int64_t BusyInitialDelayUs = 500;
+constexpr int BusyMaxDoublings = 8;
+constexpr std::int64_t BusyMaxDelayUs = 100000;
+
+/**
+ * @brief Advance a splitmix64 generator.
+ *
+ * @param[in,out] state Generator state
+ * @return Next random value
+ */
+std::uint64_t NextRandom(std::uint64_t& state)
+{
+    state += 0x9E3779B97F4A7C15ULL;
+    std::uint64_t value = state;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
 }
 
-SQLiteConnection::SQLiteConnection(const std::filesystem::path& databasePath, int busyTimeoutMs) : _database(nullptr)
+/**
+ * @brief Pragma values of one performance profile.
+ */
+struct PerformanceSettings
+{
+    const char* synchronous;          /**< synchronous mode */
+    long long cacheSize;              /**< cache_size, negative values are KiB */
+    long long mmapSizeBytes;          /**< mmap_size, 0 disables the memory map */
+    long long pageSizeBytes;          /**< page_size for new databases */
+    long long walAutocheckpointPages; /**< wal_autocheckpoint in pages */
+};
+
+constexpr PerformanceSettings SafeSettings{"FULL", -2000, 0, 4096, 1000};
+constexpr PerformanceSettings BalancedSettings{"NORMAL", -65536, 256LL * 1024 * 1024, 4096, 1000};
+constexpr PerformanceSettings BulkSettings{"OFF", -262144, 1024LL * 1024 * 1024, 16384, 10000};
+
+/**
+ * @brief Build the URI that opens a database file read-only.
+ *
+ * @param[in] databasePath Database file
+ * @return file: URI with mode=ro, the characters URIs reserve escaped
+ */
+std::string ReadOnlyUri(const std::filesystem::path& databasePath)
 {
-    if (SQLITE_OK != sqlite3_open(databasePath.string().c_str(), &_database))
+    std::string path = SQLiteText::FromPath(databasePath);
+#ifdef _WIN32
+    std::replace(path.begin(), path.end(), '\\', '/');
+#endif
+    std::string uri = "file:";
+    // A drive letter must follow a slash, or SQLite reads it as the URI authority.
+    if ((2 <= path.size()) && (':' == path[1]))
     {
-        throw std::runtime_error("Failed to open SQLite DB: " + databasePath.string());
+        uri += '/';
     }
-
-    if (SQLITE_OK != sqlite3_busy_timeout(_database, busyTimeoutMs))
+    constexpr char HexDigits[] = "0123456789ABCDEF";
+    for (const char character : path)
     {
-        throw std::runtime_error("Failed to set SQLite busy timeout.");
+        if (('%' == character) || ('?' == character) || ('#' == character))
+        {
+            const unsigned char byte = static_cast<unsigned char>(character);
+            uri += '%';
+            uri += HexDigits[byte >> 4];
+            uri += HexDigits[byte & 0x0F];
+            continue;
+        }
+        uri += character;
     }
+    return uri + "?mode=ro";
+}
 
-    EnableWriteAheadLoggingMode();
+/**
+ * @brief Get the pragma values of a performance profile.
+ */
+const PerformanceSettings& SettingsFor(SQLitePerformanceProfile profile)
+{
+    switch (profile)
+    {
+    case SQLitePerformanceProfile::Safe:
+        return SafeSettings;
+    case SQLitePerformanceProfile::Balanced:
+        return BalancedSettings;
+    case SQLitePerformanceProfile::Bulk:
+        return BulkSettings;
+    }
+    return SafeSettings;
+}
 }
 
-SQLiteConnection::~SQLiteConnection()
+SQLiteConnection::SQLiteConnection(const std::filesystem::path& databasePath, int busyTimeoutMs, std::atomic<std::uint64_t>* busyRetries,
+                                   SQLitePerformanceProfile profile, SQLiteOpenMode openMode)
+    : _database(nullptr), _profile(profile), _openMode(openMode),
+      _busyHandlerState(std::make_unique<BusyHandlerState>(BusyHandlerState{busyTimeoutMs, busyRetries, 0, 0}))
 {
-    if (nullptr != _database)
+    // Connections of one process live at different addresses, so each retries on its own random schedule.
+    _busyHandlerState->jitterState = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(_busyHandlerState.get()));
+    // URI names are only needed to attach other files read-only; a plain path opens as before. A read-only
+    // connection is only ever used by the thread holding it, so it also goes without SQLite's mutex.
+    const int flags = (SQLiteOpenMode::ReadOnly == openMode) ? (SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX | SQLITE_OPEN_URI)
+                                                             : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI);
+    const std::string path = SQLiteText::FromPath(databasePath);
+    if (SQLITE_OK != sqlite3_open_v2(path.c_str(), &_database, flags, nullptr))
+    {
+        // sqlite3_open_v2 allocates a handle even when it fails.
+        Close();
+        throw std::runtime_error("Failed to open SQLite DB: " + path);
+    }
+
+    // A handler of our own replaces sqlite3_busy_timeout so that retries can be counted.
+    if (SQLITE_OK != sqlite3_busy_handler(_database, &SQLiteConnection::OnBusy, _busyHandlerState.get()))
     {
         sqlite3_close(_database);
+        throw std::runtime_error("Failed to set SQLite busy timeout.");
+    }
+
+    try
+    {
+        if (SQLiteOpenMode::ReadOnly == openMode)
+        {
+            ApplyReadOnlyProfile(profile);
+            return;
+        }
+        // page_size must be set before WAL mode, which fixes the page size of a new database.
+        Execute("PRAGMA page_size=" + std::to_string(SettingsFor(profile).pageSizeBytes) + ";");
+        // A new database starts in incremental auto-vacuum, so free pages can be returned without a full VACUUM.
+        // On an existing database the pragma takes the write lock, so it is only issued while there are no pages.
+        bool empty = false;
+        {
+            auto pageCount = Prepare("PRAGMA page_count;");
+            empty = (true == pageCount.FetchRow()) && (0 == pageCount.ColumnInt64(0));
+        }
+        if (true == empty)
+        {
+            Execute("PRAGMA auto_vacuum=INCREMENTAL;");
+        }
+        EnableWriteAheadLoggingMode();
+        ApplyPerformanceProfile(profile);
+    }
+    catch (const std::runtime_error&)
+    {
+        Close();
+        throw;
     }
 }
 
-SQLiteConnection::SQLiteConnection(SQLiteConnection&& other) noexcept : _database(std::exchange(other._database, nullptr))
+SQLiteConnection::~SQLiteConnection()
+{
+    Close();
+}
+
+SQLiteConnection::SQLiteConnection(SQLiteConnection&& other) noexcept
+    : _database(std::exchange(other._database, nullptr)), _profile(other._profile), _openMode(other._openMode),
+      _busyHandlerState(std::move(other._busyHandlerState)), _statementCache(std::move(other._statementCache))
 {
 }
 
@@ -43,11 +179,12 @@ SQLiteConnection& SQLiteConnection::operator=(SQLiteConnection&& other) noexcept
 {
     if (this != &other)
     {
-        if (nullptr != _database)
-        {
-            sqlite3_close(_database);
-        }
+        Close();
         _database = std::exchange(other._database, nullptr);
+        _profile = other._profile;
+        _openMode = other._openMode;
+        _busyHandlerState = std::move(other._busyHandlerState);
+        _statementCache = std::move(other._statementCache);
     }
     return *this;
 }
@@ -73,6 +210,190 @@ SQLiteStatement SQLiteConnection::Prepare(const std::string& sqlStatement)
     return SQLiteStatement(statement);
 }
 
+SQLiteStatementLease SQLiteConnection::PrepareCached(const std::string& sqlStatement)
+{
+    auto iterator = _statementCache.find(sqlStatement);
+    if (_statementCache.end() == iterator)
+    {
+        auto statement = std::make_unique<SQLiteStatement>(Prepare(sqlStatement));
+        iterator = _statementCache.emplace(sqlStatement, CachedStatement{std::move(statement), false}).first;
+    }
+
+    CachedStatement& cached = iterator->second;
+    if (true == cached.inUse)
+    {
+        return SQLiteStatementLease(std::make_unique<SQLiteStatement>(Prepare(sqlStatement)));
+    }
+    return SQLiteStatementLease(*cached.statement, cached.inUse);
+}
+
+bool SQLiteConnection::Checkpoint(SQLiteCheckpointMode mode)
+{
+    const int sqliteMode = (SQLiteCheckpointMode::Truncate == mode) ? SQLITE_CHECKPOINT_TRUNCATE : SQLITE_CHECKPOINT_PASSIVE;
+    return SQLITE_OK == sqlite3_wal_checkpoint_v2(_database, nullptr, sqliteMode, nullptr, nullptr);
+}
+
+bool SQLiteConnection::BackupTo(const std::filesystem::path& destinationPath, int pagesPerStep, std::chrono::milliseconds pause)
+{
+    std::string path;
+    if (false == SQLiteText::AppendNative(destinationPath.native(), 0, path))
+    {
+        return false;
+    }
+    sqlite3* destination = nullptr;
+    if (SQLITE_OK != sqlite3_open_v2(path.c_str(), &destination, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr))
+    {
+        sqlite3_close(destination);
+        return false;
+    }
+    sqlite3_backup* backup = sqlite3_backup_init(destination, "main", _database, "main");
+    if (nullptr == backup)
+    {
+        sqlite3_close(destination);
+        return false;
+    }
+    int result = SQLITE_OK;
+    do
+    {
+        result = sqlite3_backup_step(backup, pagesPerStep);
+        // Busy and locked leave the step to be repeated; the source lock is not held while sleeping.
+        if ((SQLITE_OK == result) || (SQLITE_BUSY == result) || (SQLITE_LOCKED == result))
+        {
+            std::this_thread::sleep_for(pause);
+        }
+    } while ((SQLITE_OK == result) || (SQLITE_BUSY == result) || (SQLITE_LOCKED == result));
+    sqlite3_backup_finish(backup);
+    const int closeResult = sqlite3_close(destination);
+    return (SQLITE_DONE == result) && (SQLITE_OK == closeResult);
+}
+
+void SQLiteConnection::SetAutomaticCheckpoints(bool enabled)
+{
+    if (true == IsReadOnly())
+    {
+        return;
+    }
+    const long long pages = (true == enabled) ? SettingsFor(_profile).walAutocheckpointPages : 0;
+    Execute("PRAGMA wal_autocheckpoint=" + std::to_string(pages) + ";");
+}
+
+void SQLiteConnection::SetSyncDeferred(bool deferred)
+{
+    if (true == IsReadOnly())
+    {
+        return;
+    }
+    const std::string synchronous = (true == deferred) ? "OFF" : SettingsFor(_profile).synchronous;
+    Execute("PRAGMA synchronous=" + synchronous + ";");
+}
+
+void SQLiteConnection::AttachReadOnly(const std::filesystem::path& databasePath, const std::string& schemaName)
+{
+    _statementCache.clear();
+    auto statement = Prepare("ATTACH DATABASE ?1 AS " + schemaName + ";");
+    statement.BindText(1, ReadOnlyUri(databasePath));
+    if (false == statement.ExecuteStatement())
+    {
+        throw std::runtime_error("Failed to attach SQLite DB: " + SQLiteText::FromPath(databasePath));
+    }
+}
+
+void SQLiteConnection::DetachAll()
+{
+    _statementCache.clear();
+    std::vector<std::string> schemaNames;
+    {
+        auto databases = Prepare("PRAGMA database_list;");
+        while (true == databases.FetchRow())
+        {
+            std::string schemaName(databases.ColumnView(1));
+            if (("main" != schemaName) && ("temp" != schemaName))
+            {
+                schemaNames.push_back(std::move(schemaName));
+            }
+        }
+    }
+    for (const auto& schemaName : schemaNames)
+    {
+        Execute("DETACH DATABASE " + schemaName + ";");
+    }
+}
+
+void SQLiteConnection::RunSetup(const std::function<void(SQLiteConnection&)>& setup)
+{
+    if (false == IsReadOnly())
+    {
+        setup(*this);
+        return;
+    }
+    Execute("PRAGMA query_only=OFF;");
+    try
+    {
+        setup(*this);
+    }
+    catch (const std::runtime_error&)
+    {
+        Execute("PRAGMA query_only=ON;");
+        throw;
+    }
+    Execute("PRAGMA query_only=ON;");
+}
+
+bool SQLiteConnection::IsReadOnly() const
+{
+    return SQLiteOpenMode::ReadOnly == _openMode;
+}
+
+/**
+ * @brief Wait before SQLite retries a locked database, giving up once the busy timeout is spent.
+ *
+ * The steps double from half a millisecond up to 100 ms. Each sleep is a random point in the upper half
+ * of its step, so workers that found the lock taken at the same moment wake apart instead of colliding
+ * again together.
+ *
+ * @param[in] context BusyHandlerState of the connection
+ * @param[in] priorCalls Times the handler was already called for this lock
+ * @return Non-zero to retry, 0 to fail with SQLITE_BUSY
+ */
+int SQLiteConnection::OnBusy(void* context, int priorCalls)
+{
+    BusyHandlerState* state = static_cast<BusyHandlerState*>(context);
+    if (0 == priorCalls)
+    {
+        state->waitedUs = 0;
+    }
+    const std::int64_t remainingUs = static_cast<std::int64_t>(state->timeoutMs) * 1000 - state->waitedUs;
+    if (0 >= remainingUs)
+    {
+        return 0;
+    }
+
+    const std::int64_t stepUs = std::min(BusyInitialDelayUs << std::min(priorCalls, BusyMaxDoublings), BusyMaxDelayUs);
+    const std::int64_t jitterUs = static_cast<std::int64_t>(NextRandom(state->jitterState) % static_cast<std::uint64_t>(stepUs / 2 + 1));
+    const std::int64_t delayUs = std::min(stepUs / 2 + jitterUs, remainingUs);
+    if (nullptr != state->retries)
+    {
+        state->retries->fetch_add(1, std::memory_order_relaxed);
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(delayUs));
+    state->waitedUs += delayUs;
+    return 1;
+}
+
+/**
+ * @brief Finalize cached statements and close the database handle.
+ */
+void SQLiteConnection::Close() noexcept
+{
+    // Statements must be finalized before the connection can be closed.
+    _statementCache.clear();
+    if (nullptr != _database)
+    {
+        sqlite3_close(_database);
+        _database = nullptr;
+    }
+}
+
 /**
  * @brief Enable write-ahead logging for the connection.
  */
@@ -86,3 +407,36 @@ void SQLiteConnection::EnableWriteAheadLoggingMode()
         throw std::runtime_error(error);
     }
 }
+
+/**
+ * @brief Apply the per-connection pragmas of a performance profile.
+ *
+ * @param[in] profile Profile to apply
+ */
+void SQLiteConnection::ApplyPerformanceProfile(SQLitePerformanceProfile profile)
+{
+    const PerformanceSettings& settings = SettingsFor(profile);
+    Execute(std::string("PRAGMA synchronous=") + settings.synchronous + ";"
+            "PRAGMA cache_size=" + std::to_string(settings.cacheSize) + ";"
+            "PRAGMA mmap_size=" + std::to_string(settings.mmapSizeBytes) + ";"
+            "PRAGMA temp_store=MEMORY;"
+            "PRAGMA wal_autocheckpoint=" + std::to_string(settings.walAutocheckpointPages) + ";");
+}
+
+/**
+ * @brief Apply the pragmas of a performance profile that concern reading, and forbid changes.
+ *
+ * In WAL mode every read transaction sees the snapshot of the last commit before it started, so a
+ * reader neither waits for the writer nor makes it wait; only a checkpoint that truncates the WAL
+ * waits for readers to finish.
+ *
+ * @param[in] profile Profile whose cache and memory map to apply
+ */
+void SQLiteConnection::ApplyReadOnlyProfile(SQLitePerformanceProfile profile)
+{
+    const PerformanceSettings& settings = SettingsFor(profile);
+    Execute("PRAGMA cache_size=" + std::to_string(settings.cacheSize) + ";"
+            "PRAGMA mmap_size=" + std::to_string(std::max(settings.mmapSizeBytes, ReadOnlyMmapSizeBytes)) + ";"
+            "PRAGMA temp_store=MEMORY;"
+            "PRAGMA query_only=ON;");
+}
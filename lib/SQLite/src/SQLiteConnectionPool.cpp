@@ -0,0 +1,104 @@
+// file SQLiteConnectionPool.cpp
+
+#include "SQLite/SQLiteConnectionPool.hpp"
+
+#include "SQLite/SQLiteConnection.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+SQLiteConnectionPool::SQLiteConnectionPool(Factory factory, std::size_t maxConnections, std::chrono::milliseconds waitTimeout)
+    : _factory(std::move(factory)), _maxConnections(maxConnections), _waitTimeout(waitTimeout), _opening(0)
+{
+}
+
+SQLiteConnectionPool::~SQLiteConnectionPool() = default;
+
+SQLiteConnection& SQLiteConnectionPool::Take()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    const bool available = _returned.wait_for(lock, _waitTimeout,
+                                              [this]() { return (false == _idle.empty()) || (_connections.size() + _opening < _maxConnections); });
+    if (false == available)
+    {
+        throw std::runtime_error("No SQLite connection was returned to the pool in time.");
+    }
+    if (false == _idle.empty())
+    {
+        SQLiteConnection* connection = _idle.back();
+        _idle.pop_back();
+        return *connection;
+    }
+
+    // Opening runs the connection's pragmas, so it happens outside the lock with its slot reserved.
+    ++_opening;
+    lock.unlock();
+    std::unique_ptr<SQLiteConnection> connection;
+    try
+    {
+        connection = _factory();
+    }
+    catch (const std::runtime_error&)
+    {
+        lock.lock();
+        --_opening;
+        lock.unlock();
+        _returned.notify_one();
+        throw;
+    }
+    lock.lock();
+    --_opening;
+    _connections.push_back(std::move(connection));
+    return *_connections.back();
+}
+
+void SQLiteConnectionPool::Return(SQLiteConnection& connection)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _idle.push_back(&connection);
+    }
+    _returned.notify_one();
+}
+
+void SQLiteConnectionPool::ForEachConnection(const std::function<void(SQLiteConnection&)>& visit)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& connection : _connections)
+    {
+        visit(*connection);
+    }
+}
+
+std::size_t SQLiteConnectionPool::OpenConnections() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _connections.size();
+}
+
+SQLiteConnectionLease::SQLiteConnectionLease(SQLiteConnectionPool& pool) : _pool(&pool), _connection(&pool.Take())
+{
+}
+
+SQLiteConnectionLease::~SQLiteConnectionLease()
+{
+    if (nullptr != _connection)
+    {
+        _pool->Return(*_connection);
+    }
+}
+
+SQLiteConnectionLease::SQLiteConnectionLease(SQLiteConnectionLease&& other) noexcept
+    : _pool(other._pool), _connection(std::exchange(other._connection, nullptr))
+{
+}
+
+SQLiteConnection& SQLiteConnectionLease::operator*() const
+{
+    return *_connection;
+}
+
+SQLiteConnection* SQLiteConnectionLease::operator->() const
+{
+    return _connection;
+}
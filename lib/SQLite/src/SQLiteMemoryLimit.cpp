@@ -0,0 +1,33 @@
+// file SQLiteMemoryLimit.cpp
+
+#include "SQLite/SQLiteMemoryLimit.hpp"
+
+#include <sqlite3.h>
+
+#include <limits>
+
+SQLiteMemoryLimit::SQLiteMemoryLimit(std::uint64_t limitBytes) : _applied(0 != limitBytes), _previousLimit(0)
+{
+    if (true == _applied)
+    {
+        // The limit needs memory accounting, which can only be turned on before SQLite is initialized.
+        sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 1);
+        constexpr std::uint64_t MaxLimit = static_cast<std::uint64_t>(std::numeric_limits<sqlite3_int64>::max());
+        _previousLimit = sqlite3_soft_heap_limit64((MaxLimit < limitBytes) ? static_cast<sqlite3_int64>(MaxLimit) : static_cast<sqlite3_int64>(limitBytes));
+    }
+}
+
+SQLiteMemoryLimit::~SQLiteMemoryLimit()
+{
+    if (true == _applied)
+    {
+        sqlite3_soft_heap_limit64(_previousLimit);
+    }
+}
+
+std::uint64_t SQLiteMemoryLimit::Current()
+{
+    // A negative argument only queries the limit.
+    const sqlite3_int64 limit = sqlite3_soft_heap_limit64(-1);
+    return (0 < limit) ? static_cast<std::uint64_t>(limit) : 0;
+}
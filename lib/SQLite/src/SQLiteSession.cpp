@@ -6,30 +6,220 @@
 
 #include <sqlite3.h>
 
-SQLiteSession::SQLiteSession(const std::filesystem::path& databasePath) : _databasePath(databasePath)
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace
+{
+/**
+ * @brief Connection the current thread acquired from one session.
+ */
+struct ThreadBinding
+{
+    std::uint64_t sessionId;                  /**< Session the connection belongs to */
+    SQLiteConnection* connection;             /**< Connection taken from the session's pool */
+    std::weak_ptr<SQLiteConnectionPool> pool; /**< Pool to return the connection to, expired once the session is gone */
+};
+
+/**
+ * @brief Connections bound to the current thread, returned to their pools when the thread exits.
+ */
+struct ThreadBindings
+{
+    std::vector<ThreadBinding> bindings;
+
+    ~ThreadBindings()
+    {
+        for (const auto& binding : bindings)
+        {
+            if (auto pool = binding.pool.lock())
+            {
+                pool->Return(*binding.connection);
+            }
+        }
+    }
+};
+
+thread_local ThreadBindings CurrentThreadBindings;
+
+/**
+ * @brief Source of session ids, which tell bindings of a destroyed session from those of a new one at the same address.
+ */
+std::atomic<std::uint64_t> NextSessionId{1};
+}
+
+SQLiteSession::SQLiteSession(const std::filesystem::path& databasePath, SQLitePerformanceProfile profile, std::size_t maxConnections,
+                             SQLiteOpenMode openMode)
+    : _sessionId(NextSessionId.fetch_add(1, std::memory_order_relaxed)), _databasePath(databasePath), _profile(profile), _openMode(openMode),
+      _busyRetries(0),
+      _backgroundCheckpoints(false), _syncDeferred(false), _checkpointStopRequested(false), _finalCheckpointSucceeded(false)
 {
-    sqlite3_config(SQLITE_CONFIG_SERIALIZED);
+    // Connections are never used by two threads at once, so SQLite needs no mutex of its own around them.
+    // The call only takes effect before SQLite is initialized; the build makes multi-thread the default.
+    sqlite3_config(SQLITE_CONFIG_MULTITHREAD);
+    _pool = std::make_shared<SQLiteConnectionPool>(
+        [this]()
+        {
+            auto connection = CreateConnection();
+            if (true == _backgroundCheckpoints.load())
+            {
+                connection->SetAutomaticCheckpoints(false);
+            }
+            if (true == _syncDeferred.load())
+            {
+                connection->SetSyncDeferred(true);
+            }
+            std::lock_guard<std::mutex> lock(_initializerMutex);
+            if (_connectionInitializer)
+            {
+                connection->RunSetup(_connectionInitializer);
+            }
+            return connection;
+        },
+        maxConnections, std::chrono::milliseconds(SqliteBusyTimeoutMs));
 }
 
-SQLiteSession::~SQLiteSession() = default;
+SQLiteSession::~SQLiteSession()
+{
+    StopCheckpointing();
+}
 
 SQLiteConnection& SQLiteSession::Acquire()
 {
-    std::thread::id threadId = std::this_thread::get_id();
+    std::vector<ThreadBinding>& bindings = CurrentThreadBindings.bindings;
+    for (const auto& binding : bindings)
+    {
+        if (_sessionId == binding.sessionId)
+        {
+            return *binding.connection;
+        }
+    }
+
+    // Bindings of destroyed sessions are dropped on the slow path.
+    bindings.erase(std::remove_if(bindings.begin(), bindings.end(), [](const ThreadBinding& binding) { return binding.pool.expired(); }),
+                   bindings.end());
+    SQLiteConnection& connection = _pool->Take();
+    bindings.push_back(ThreadBinding{_sessionId, &connection, _pool});
+    return connection;
+}
+
+SQLiteConnectionLease SQLiteSession::Lease()
+{
+    return SQLiteConnectionLease(*_pool);
+}
+
+std::size_t SQLiteSession::OpenConnections() const
+{
+    return _pool->OpenConnections();
+}
+
+std::uint64_t SQLiteSession::BusyRetries() const
+{
+    return _busyRetries.load(std::memory_order_relaxed);
+}
+
+const std::filesystem::path& SQLiteSession::DatabasePath() const
+{
+    return _databasePath;
+}
+
+SQLitePerformanceProfile SQLiteSession::Profile() const
+{
+    return _profile;
+}
+
+SQLiteOpenMode SQLiteSession::OpenMode() const
+{
+    return _openMode;
+}
+
+void SQLiteSession::SetConnectionInitializer(std::function<void(SQLiteConnection&)> initializer)
+{
+    std::lock_guard<std::mutex> lock(_initializerMutex);
+    _connectionInitializer = std::move(initializer);
+    if (_connectionInitializer)
+    {
+        _pool->ForEachConnection([this](SQLiteConnection& connection) { connection.RunSetup(_connectionInitializer); });
+    }
+}
+
+void SQLiteSession::SetSyncDeferred(bool deferred)
+{
+    _syncDeferred.store(deferred);
+    _pool->ForEachConnection([deferred](SQLiteConnection& connection) { connection.SetSyncDeferred(deferred); });
+}
+
+void SQLiteSession::StartCheckpointing(std::chrono::milliseconds interval)
+{
+    if ((true == _checkpointThread.joinable()) || (SQLiteOpenMode::ReadOnly == _openMode))
+    {
+        return;
+    }
+    _backgroundCheckpoints.store(true);
+    _pool->ForEachConnection([](SQLiteConnection& connection) { connection.SetAutomaticCheckpoints(false); });
+    _checkpointStopRequested = false;
+    _checkpointThread = std::thread(&SQLiteSession::RunCheckpoints, this, interval);
+}
 
+bool SQLiteSession::StopCheckpointing()
+{
+    if (false == _checkpointThread.joinable())
+    {
+        return true;
+    }
     {
-        std::lock_guard<std::mutex> lock(_connectionsMutex);
+        std::lock_guard<std::mutex> lock(_checkpointMutex);
+        _checkpointStopRequested = true;
+    }
+    _checkpointWake.notify_one();
+    _checkpointThread.join();
 
-        auto iterator = _connections.find(threadId);
-        if ((_connections.end() != iterator) && (nullptr != iterator->second))
+    _backgroundCheckpoints.store(false);
+    _pool->ForEachConnection(
+        [](SQLiteConnection& connection)
         {
-            return *iterator->second;
-        }
+            try
+            {
+                connection.SetAutomaticCheckpoints(true);
+            }
+            catch (const std::runtime_error&)
+            {
+                // A connection left without automatic checkpoints only lets the WAL grow.
+            }
+        });
+    return _finalCheckpointSucceeded;
+}
 
-        auto connection = std::make_unique<SQLiteConnection>(CreateConnection());
-        auto result = _connections.emplace(threadId, std::move(connection));
-        return *result.first->second;
+/**
+ * @brief Background checkpoint loop: a passive checkpoint every interval, a truncating one on stop.
+ *
+ * @param[in] interval Time between two passive checkpoints
+ */
+void SQLiteSession::RunCheckpoints(std::chrono::milliseconds interval)
+{
+    std::unique_ptr<SQLiteConnectionLease> connection;
+    try
+    {
+        connection = std::make_unique<SQLiteConnectionLease>(*_pool);
+    }
+    catch (const std::runtime_error&)
+    {
+        _finalCheckpointSucceeded = false;
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_checkpointMutex);
+    while (false == _checkpointWake.wait_for(lock, interval, [this]() { return _checkpointStopRequested; }))
+    {
+        lock.unlock();
+        // A passive checkpoint that cannot copy every frame leaves the rest for the next one.
+        (*connection)->Checkpoint(SQLiteCheckpointMode::Passive);
+        lock.lock();
     }
+    lock.unlock();
+    _finalCheckpointSucceeded = (*connection)->Checkpoint(SQLiteCheckpointMode::Truncate);
 }
 
 /**
@@ -37,7 +227,7 @@ SQLiteConnection& SQLiteSession::Acquire()
  *
  * @return New SQLiteConnection instance
  */
-SQLiteConnection SQLiteSession::CreateConnection()
+std::unique_ptr<SQLiteConnection> SQLiteSession::CreateConnection()
 {
-    return SQLiteConnection(_databasePath, SqliteBusyTimeoutMs);
+    return std::make_unique<SQLiteConnection>(_databasePath, SqliteBusyTimeoutMs, &_busyRetries, _profile, _openMode);
 }
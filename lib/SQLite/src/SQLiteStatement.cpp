@@ -10,6 +10,7 @@
 namespace
 {
 constexpr int SqlTextLengthAuto = -1;
+constexpr int PrimaryResultCodeMask = 0xff;
 
 /**
  * @brief Build a SQLite error with context prefix.
@@ -69,6 +70,22 @@ void SQLiteStatement::BindText(int index, const char* value)
     }
 }
 
+void SQLiteStatement::BindInt64(int index, std::int64_t value)
+{
+    if (SQLITE_OK != sqlite3_bind_int64(_statement, index, static_cast<sqlite3_int64>(value)))
+    {
+        throw MakeSqliteError(_statement, "Failed to bind integer parameter: ");
+    }
+}
+
+void SQLiteStatement::BindBlob(int index, const void* data, std::size_t size)
+{
+    if (SQLITE_OK != sqlite3_bind_blob64(_statement, index, data, static_cast<sqlite3_uint64>(size), SQLITE_TRANSIENT))
+    {
+        throw MakeSqliteError(_statement, "Failed to bind blob parameter: ");
+    }
+}
+
 bool SQLiteStatement::FetchRow()
 {
     int result = sqlite3_step(_statement);
@@ -97,14 +114,75 @@ bool SQLiteStatement::ExecuteStatement()
     throw MakeSqliteError(_statement, "Failed to execute statement: ");
 }
 
+bool SQLiteStatement::ForEachRow(const std::function<bool(const SQLiteStatement&)>& onRow)
+{
+    while (true == FetchRow())
+    {
+        if (false == onRow(*this))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+SQLiteStepResult SQLiteStatement::TryStep() noexcept
+{
+    const int result = sqlite3_step(_statement);
+    if (SQLITE_ROW == result)
+    {
+        return SQLiteStepResult::Row;
+    }
+    if (SQLITE_DONE == result)
+    {
+        return SQLiteStepResult::Done;
+    }
+    const int primaryResult = result & PrimaryResultCodeMask;
+    return ((SQLITE_BUSY == primaryResult) || (SQLITE_LOCKED == primaryResult)) ? SQLiteStepResult::Busy : SQLiteStepResult::Error;
+}
+
+std::string SQLiteStatement::ErrorMessage() const
+{
+    sqlite3* database = sqlite3_db_handle(_statement);
+    return (nullptr != database) ? sqlite3_errmsg(database) : "Unknown SQLite error";
+}
+
 std::string SQLiteStatement::ColumnText(int index) const
 {
+    return std::string(ColumnView(index));
+}
+
+std::string_view SQLiteStatement::ColumnView(int index) const
+{
+    // The text pointer must be fetched before the length, so the length counts the converted text.
     const unsigned char* value = sqlite3_column_text(_statement, index);
     if (nullptr == value)
     {
         return {};
     }
-    return reinterpret_cast<const char*>(value);
+    return {reinterpret_cast<const char*>(value), static_cast<std::size_t>(sqlite3_column_bytes(_statement, index))};
+}
+
+std::int64_t SQLiteStatement::ColumnInt64(int index) const
+{
+    return static_cast<std::int64_t>(sqlite3_column_int64(_statement, index));
+}
+
+SQLiteBlob SQLiteStatement::ColumnBlob(int index) const
+{
+    const void* data = sqlite3_column_blob(_statement, index);
+    const int size = sqlite3_column_bytes(_statement, index);
+    return {data, (nullptr != data) ? static_cast<std::size_t>(size) : 0};
+}
+
+void SQLiteStatement::Reset() noexcept
+{
+    sqlite3_reset(_statement);
+}
+
+void SQLiteStatement::ClearBindings() noexcept
+{
+    sqlite3_clear_bindings(_statement);
 }
 
 /**
@@ -118,3 +196,52 @@ void SQLiteStatement::Finalize()
         _statement = nullptr;
     }
 }
+
+SQLiteStatementLease::SQLiteStatementLease(SQLiteStatement& statement, bool& inUse) : _statement(&statement), _inUse(&inUse)
+{
+    *_inUse = true;
+}
+
+SQLiteStatementLease::SQLiteStatementLease(std::unique_ptr<SQLiteStatement> statement)
+    : _ownedStatement(std::move(statement)), _statement(_ownedStatement.get()), _inUse(nullptr)
+{
+}
+
+SQLiteStatementLease::~SQLiteStatementLease()
+{
+    Release();
+}
+
+SQLiteStatementLease::SQLiteStatementLease(SQLiteStatementLease&& other) noexcept
+    : _ownedStatement(std::move(other._ownedStatement)), _statement(std::exchange(other._statement, nullptr)),
+      _inUse(std::exchange(other._inUse, nullptr))
+{
+}
+
+SQLiteStatement& SQLiteStatementLease::operator*() const
+{
+    return *_statement;
+}
+
+SQLiteStatement* SQLiteStatementLease::operator->() const
+{
+    return _statement;
+}
+
+/**
+ * @brief Reset the leased statement and clear the cache flag.
+ */
+void SQLiteStatementLease::Release() noexcept
+{
+    if (nullptr == _statement)
+    {
+        return;
+    }
+    _statement->Reset();
+    _statement->ClearBindings();
+    if (nullptr != _inUse)
+    {
+        *_inUse = false;
+    }
+    _statement = nullptr;
+}
@@ -0,0 +1,136 @@
+// file SQLiteText.cpp
+
+#include "SQLite/SQLiteText.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <limits>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+#ifdef _WIN32
+namespace
+{
+/**
+ * @brief Convert UTF-16 text to a multi-byte code page, appending to a string.
+ *
+ * A return of 0 from WideCharToMultiByte is a failure for non-empty input, so the sized buffer is dropped
+ * rather than left holding NULs.
+ *
+ * @param[in] wide UTF-16 text
+ * @param[in] codePage Target code page
+ * @param[in,out] output Text to append to, unchanged on failure
+ * @return true on success, false if the text has no spelling in the code page
+ */
+bool AppendMultiByte(std::wstring_view wide, unsigned int codePage, std::string& output)
+{
+    if (true == wide.empty())
+    {
+        return true;
+    }
+    if (static_cast<std::size_t>(std::numeric_limits<int>::max()) < wide.size())
+    {
+        return false;
+    }
+    const DWORD flags = (CP_UTF8 == codePage) ? WC_ERR_INVALID_CHARS : 0;
+    const int wideLength = static_cast<int>(wide.size());
+    const int length = WideCharToMultiByte(codePage, flags, wide.data(), wideLength, nullptr, 0, nullptr, nullptr);
+    if (0 >= length)
+    {
+        return false;
+    }
+    const std::size_t offset = output.size();
+    output.resize(offset + static_cast<std::size_t>(length));
+    if (length != WideCharToMultiByte(codePage, flags, wide.data(), wideLength, output.data() + offset, length, nullptr, nullptr))
+    {
+        output.resize(offset);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Convert multi-byte text in a code page to UTF-16, assigned in place.
+ *
+ * @param[in] text Text in the code page
+ * @param[in] codePage Code page of the text
+ * @param[out] output UTF-16 text, empty on failure
+ * @return true on success, false if the text is not valid in the code page
+ */
+bool AssignWide(std::string_view text, unsigned int codePage, std::wstring& output)
+{
+    output.clear();
+    if (true == text.empty())
+    {
+        return true;
+    }
+    if (static_cast<std::size_t>(std::numeric_limits<int>::max()) < text.size())
+    {
+        return false;
+    }
+    const int textLength = static_cast<int>(text.size());
+    const int length = MultiByteToWideChar(codePage, MB_ERR_INVALID_CHARS, text.data(), textLength, nullptr, 0);
+    if (0 >= length)
+    {
+        return false;
+    }
+    output.resize(static_cast<std::size_t>(length));
+    if (length != MultiByteToWideChar(codePage, MB_ERR_INVALID_CHARS, text.data(), textLength, output.data(), length))
+    {
+        output.clear();
+        return false;
+    }
+    return true;
+}
+}
+#endif
+
+bool SQLiteText::AppendNative(const std::filesystem::path::string_type& native, std::size_t start, std::string& output)
+{
+    if (start >= native.size())
+    {
+        return true;
+    }
+#ifdef _WIN32
+    return AppendMultiByte(std::wstring_view(native).substr(start), CP_UTF8, output);
+#else
+    output.append(native, start, std::string::npos);
+    return true;
+#endif
+}
+
+bool SQLiteText::AssignNative(std::string_view text, std::filesystem::path::string_type& output)
+{
+#ifdef _WIN32
+    return AssignWide(text, CP_UTF8, output);
+#else
+    output.assign(text);
+    return true;
+#endif
+}
+
+std::string SQLiteText::FromPath(const std::filesystem::path& path)
+{
+    std::string text;
+    if (false == AppendNative(path.native(), 0, text))
+    {
+        throw std::runtime_error("Path has no UTF-8 spelling");
+    }
+    return text;
+}
+
+#ifdef _WIN32
+bool SQLiteText::FromAnsi(std::string_view text, std::string& output)
+{
+    output.clear();
+    std::wstring wide;
+    return (true == AssignWide(text, CP_ACP, wide)) && (true == AppendMultiByte(wide, CP_UTF8, output));
+}
+#endif
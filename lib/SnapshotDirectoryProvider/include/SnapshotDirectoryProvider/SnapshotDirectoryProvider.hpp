@@ -1,12 +1,21 @@
 #pragma once
 
-#include "TimestampProvider/TimestampProvider.hpp"
+#include "FileCopier/DirectoryCache.hpp"
+#include "StorageBackend/StorageBackend.hpp"
+#include "TimestampProvider/RunContext.hpp"
 
+#include <atomic>
 #include <filesystem>
+#include <functional>
 #include <mutex>
+#include <string>
+#include <vector>
 
 /**
  * @brief Infrastructure component that creates a single snapshot directory once.
+ *
+ * Once the directory exists, GetOrCreate() is a single acquire load that hands out the stored path.
+ * In a storage backend the snapshot is only a key prefix, so nothing is created there.
  */
 class SnapshotDirectoryProvider
 {
@@ -15,20 +24,40 @@ class SnapshotDirectoryProvider
      * @brief Construct a snapshot directory provider.
      *
      * @param[in] historyRootPath Root path for snapshot history
-     * @param[in] timestampProvider Timestamp provider
+     * @param[in] runContext Run whose timestamp names the snapshot
+     * @param[in] onCreated Optional callback run once with the new directory; an exception from it fails GetOrCreate
+     * @param[in] storage Backend the snapshot is stored in, historyRootPath then being a key prefix; nullptr uses the filesystem
      */
-    SnapshotDirectoryProvider(const std::filesystem::path& historyRootPath, const TimestampProvider& timestampProvider);
+    SnapshotDirectoryProvider(const std::filesystem::path& historyRootPath, const RunContext& runContext,
+                              const std::function<void(const std::filesystem::path&)>& onCreated = nullptr, StorageBackend* storage = nullptr);
 
     /**
      * @brief Get or create the snapshot directory.
      *
-     * @return Snapshot directory path
+     * A failed attempt is retried by the next call.
+     *
+     * @return Snapshot directory path, valid for the lifetime of the provider
+     */
+    const std::filesystem::path& GetOrCreate();
+
+    /**
+     * @brief Create the snapshot directories a batch of files is archived into, in one pass.
+     *
+     * Creates the snapshot itself if needed. Each distinct parent directory is ensured once, however many
+     * files of the batch it holds; files of the snapshot root need none. A storage backend needs none at all.
+     *
+     * @param[in] relativeFiles Snapshot-relative paths of the files about to be archived
+     * @param[in,out] directoryCache Directories of the run known to exist
+     * @return true on success, false if a directory could not be created
      */
-    std::filesystem::path GetOrCreate();
+    bool CreateParentDirectories(const std::vector<std::string>& relativeFiles, DirectoryCache& directoryCache);
 
   private:
     std::filesystem::path _historyRootPath;
-    const TimestampProvider& _timestampProvider;
+    const RunContext& _runContext;
+    std::function<void(const std::filesystem::path&)> _onCreated;
+    StorageBackend* _storage;
     std::once_flag _snapshotFlag;
+    std::atomic<bool> _created;
     std::filesystem::path _snapshotPath;
 };
@@ -1,18 +1,73 @@
 #include "SnapshotDirectoryProvider/SnapshotDirectoryProvider.hpp"
 
+#include <stdexcept>
 #include <utility>
 
 SnapshotDirectoryProvider::SnapshotDirectoryProvider(const std::filesystem::path& historyRootPath,
-                                                     const TimestampProvider& timestampProvider)
-    : _historyRootPath(historyRootPath), _timestampProvider(timestampProvider)
+                                                     const RunContext& runContext,
+                                                     const std::function<void(const std::filesystem::path&)>& onCreated,
+                                                     StorageBackend* storage)
+    : _historyRootPath(historyRootPath), _runContext(runContext), _onCreated(onCreated), _storage(storage), _created(false)
 {
 }
 
-std::filesystem::path SnapshotDirectoryProvider::GetOrCreate()
+const std::filesystem::path& SnapshotDirectoryProvider::GetOrCreate()
 {
+    if (true == _created.load(std::memory_order_acquire))
+    {
+        return _snapshotPath;
+    }
     std::call_once(_snapshotFlag, [&]() {
-        _snapshotPath = _historyRootPath / _timestampProvider.NowFilesystemSafe();
-        std::filesystem::create_directories(_snapshotPath);
+        const std::filesystem::path snapshotPath = _historyRootPath / _runContext.Timestamp();
+        if (nullptr == _storage)
+        {
+            std::filesystem::create_directories(snapshotPath);
+        }
+        if (nullptr != _onCreated)
+        {
+            _onCreated(snapshotPath);
+        }
+        _snapshotPath = snapshotPath;
+        _created.store(true, std::memory_order_release);
     });
     return _snapshotPath;
 }
+
+bool SnapshotDirectoryProvider::CreateParentDirectories(const std::vector<std::string>& relativeFiles, DirectoryCache& directoryCache)
+{
+    if (true == relativeFiles.empty())
+    {
+        return true;
+    }
+    const std::filesystem::path* snapshotPath = nullptr;
+    try
+    {
+        snapshotPath = &GetOrCreate();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+
+    if (nullptr != _storage)
+    {
+        return true;
+    }
+
+    // Batches come from one directory or from a scan sorted by directory, so a repeat is nearly always the previous parent.
+    std::filesystem::path previousParent;
+    for (const auto& relativeFile : relativeFiles)
+    {
+        std::filesystem::path parent = std::filesystem::path(relativeFile).parent_path();
+        if ((true == parent.empty()) || (parent == previousParent))
+        {
+            continue;
+        }
+        if (false == directoryCache.Ensure(*snapshotPath / parent))
+        {
+            return false;
+        }
+        previousParent = std::move(parent);
+    }
+    return true;
+}
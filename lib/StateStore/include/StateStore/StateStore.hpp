@@ -0,0 +1,343 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class SQLiteSession;
+struct MDB_env;
+
+/**
+ * @brief Storage engine behind a StateStore.
+ */
+enum class StateStoreBackend
+{
+    SQLite, /**< B-tree table in a SQLite database in WAL mode */
+    Lmdb,   /**< Memory-mapped copy-on-write B+tree; only in builds with liblmdb */
+    Lsm     /**< Write-optimized log-structured merge tree: a logged memtable over sorted, immutable runs */
+};
+
+/**
+ * @brief Convert a StateStoreBackend enumeration value to its string representation.
+ *
+ * @param[in] backend The backend to convert
+ * @return String representation of the backend
+ */
+inline const char* StateStoreBackendToString(StateStoreBackend backend)
+{
+    switch (backend)
+    {
+    case StateStoreBackend::SQLite:
+        return "sqlite";
+    case StateStoreBackend::Lmdb:
+        return "lmdb";
+    case StateStoreBackend::Lsm:
+        return "lsm";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Convert a string to its corresponding StateStoreBackend enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @param[out] outputBackend Parsed backend
+ * @return true if the string names a known backend, false otherwise
+ */
+inline bool StringToStateStoreBackend(const std::string& stringValue, StateStoreBackend& outputBackend)
+{
+    if ("sqlite" == stringValue)
+    {
+        outputBackend = StateStoreBackend::SQLite;
+        return true;
+    }
+    if ("lmdb" == stringValue)
+    {
+        outputBackend = StateStoreBackend::Lmdb;
+        return true;
+    }
+    if ("lsm" == stringValue)
+    {
+        outputBackend = StateStoreBackend::Lsm;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief One key and value, for StateStore::PutBatch.
+ */
+struct StateStoreEntry
+{
+    std::string key;   /**< Key, such as a repository-relative file path */
+    std::string value; /**< Encoded state stored under the key */
+};
+
+/**
+ * @brief Tuning options of the state store backends; each backend reads only its own.
+ */
+struct StateStoreOptions
+{
+    static constexpr std::uint64_t DefaultMapSize = 64ULL * 1024 * 1024 * 1024; /**< Default mapSize */
+    static constexpr std::size_t DefaultMemtableSize = 64 * 1024 * 1024;      /**< Default memtableSize */
+    static constexpr std::size_t DefaultMaxRuns = 4;                         /**< Default maxRuns */
+
+    std::uint64_t mapSize = DefaultMapSize;          /**< LMDB: largest size the database may grow to; address space is reserved, not memory */
+    std::size_t memtableSize = DefaultMemtableSize;  /**< LSM: bytes of keys and values buffered in memory before they are written out as a run */
+    std::size_t maxRuns = DefaultMaxRuns;            /**< LSM: runs kept before they are merged into one */
+};
+
+/**
+ * @brief Ordered key-value store for per-path state, with interchangeable storage engines.
+ *
+ * Keys and values are byte strings and keys compare bytewise. A store is used by one thread at a time;
+ * callers that share one serialize their calls. Callbacks must not call back into the store.
+ */
+class StateStore
+{
+  public:
+    /**
+     * @brief Callback receiving one entry of a scan; returns false to stop early.
+     */
+    using EntryCallback = std::function<bool(std::string_view, std::string_view)>;
+
+    virtual ~StateStore() = default;
+
+    /**
+     * @brief Open a store with the given engine, creating it if it does not exist.
+     *
+     * @param[in] backend Storage engine
+     * @param[in] location Database file for SQLite, directory for LMDB and LSM
+     * @param[in] options Tuning options
+     * @param[out] outputStore Opened store
+     * @return true on success, false if the engine is unavailable in this build or the store cannot be opened
+     */
+    static bool Open(StateStoreBackend backend, const std::filesystem::path& location, const StateStoreOptions& options,
+                     std::unique_ptr<StateStore>& outputStore);
+
+    /**
+     * @brief Check whether an engine is compiled into this build.
+     *
+     * @param[in] backend Storage engine
+     * @return true if Open can use it
+     */
+    static bool IsAvailable(StateStoreBackend backend);
+
+    /**
+     * @brief Look up the value stored under a key.
+     *
+     * @param[in] key Key to look up
+     * @param[out] outputValue Stored value
+     * @return true if the key is present, false if it is missing or on error
+     */
+    virtual bool Get(std::string_view key, std::string& outputValue) = 0;
+
+    /**
+     * @brief Store a value under a key, replacing any value stored there.
+     *
+     * @param[in] key Key to store under
+     * @param[in] value Value to store
+     * @return true on success, false on error
+     */
+    virtual bool Put(std::string_view key, std::string_view value) = 0;
+
+    /**
+     * @brief Store several values in one transaction; either all of them are stored or none is.
+     *
+     * @param[in] entries Keys and values; a key repeated later in the batch wins
+     * @return true on success, false on error
+     */
+    virtual bool PutBatch(const std::vector<StateStoreEntry>& entries) = 0;
+
+    /**
+     * @brief Visit the entries whose keys lie in a half-open range, in ascending key order.
+     *
+     * @param[in] first Smallest key visited
+     * @param[in] last Key the visit stops before, empty to visit to the end
+     * @param[in] onEntry Callback receiving each key and value, valid only during the call
+     * @return true if every entry in the range was visited, false on error or when stopped early
+     */
+    virtual bool Range(std::string_view first, std::string_view last, const EntryCallback& onEntry) = 0;
+
+    /**
+     * @brief Visit every entry in ascending key order.
+     *
+     * @param[in] onEntry Callback receiving each key and value, valid only during the call
+     * @return true if every entry was visited, false on error or when stopped early
+     */
+    bool Scan(const EntryCallback& onEntry);
+};
+
+/**
+ * @brief State store in a `WITHOUT ROWID` SQLite table keyed by the key BLOB.
+ *
+ * Runs on SQLiteSession with the Balanced profile: WAL mode, a larger page cache and a memory map, commits not synced.
+ */
+class SQLiteStateStore final : public StateStore
+{
+  public:
+    /**
+     * @brief Create a store on a database file; nothing is opened before Open.
+     *
+     * @param[in] databaseFile SQLite database holding the table
+     */
+    explicit SQLiteStateStore(const std::filesystem::path& databaseFile);
+
+    ~SQLiteStateStore() override;
+
+    SQLiteStateStore(const SQLiteStateStore&) = delete;
+    SQLiteStateStore& operator=(const SQLiteStateStore&) = delete;
+
+    /**
+     * @brief Open the database and create the table if it does not exist.
+     *
+     * @return true on success, false on error
+     */
+    bool Open();
+
+    bool Get(std::string_view key, std::string& outputValue) override;
+    bool Put(std::string_view key, std::string_view value) override;
+    bool PutBatch(const std::vector<StateStoreEntry>& entries) override;
+    bool Range(std::string_view first, std::string_view last, const EntryCallback& onEntry) override;
+
+  private:
+    std::filesystem::path _databaseFile;
+    std::unique_ptr<SQLiteSession> _session;
+};
+
+/**
+ * @brief State store in an LMDB environment: reads go through a read-only memory mapping without copies or locks.
+ *
+ * Keys are limited to LMDB's key size, 511 bytes in a default build; longer keys fail to store. Only
+ * builds where CMake found liblmdb have it; elsewhere Open fails.
+ */
+class LmdbStateStore final : public StateStore
+{
+  public:
+    /**
+     * @brief Create a store in a directory; nothing is opened before Open.
+     *
+     * @param[in] directory Directory holding data.mdb and lock.mdb, created by Open
+     * @param[in] mapSize Largest size the database may grow to
+     */
+    LmdbStateStore(const std::filesystem::path& directory, std::uint64_t mapSize);
+
+    ~LmdbStateStore() override;
+
+    LmdbStateStore(const LmdbStateStore&) = delete;
+    LmdbStateStore& operator=(const LmdbStateStore&) = delete;
+
+    /**
+     * @brief Create the directory and open the environment.
+     *
+     * @return true on success, false on error or in a build without LMDB
+     */
+    bool Open();
+
+    bool Get(std::string_view key, std::string& outputValue) override;
+    bool Put(std::string_view key, std::string_view value) override;
+    bool PutBatch(const std::vector<StateStoreEntry>& entries) override;
+    bool Range(std::string_view first, std::string_view last, const EntryCallback& onEntry) override;
+
+  private:
+    std::filesystem::path _directory;
+    std::uint64_t _mapSize;
+    MDB_env* _environment;
+    unsigned int _database;
+};
+
+/**
+ * @brief Write-optimized state store: a log-structured merge tree of sorted runs.
+ *
+ * Writes append one checksummed record per batch to a log and go into an in-memory sorted memtable, so a
+ * batch costs one sequential write. A full memtable is written out as an immutable run file of sorted
+ * entries with a sparse index of every IndexInterval-th key, and the log is cleared. Once more than
+ * maxRuns runs exist they are merged into one. A lookup checks the memtable and then the runs from the
+ * newest, reading at most one index interval of each; range scans merge all of them. Opening replays the
+ * log and drops a torn last record. The log is not synced, so a crash of the machine can lose the latest
+ * batches, but never leaves a batch half applied.
+ */
+class LsmStateStore final : public StateStore
+{
+  public:
+    /**
+     * @brief Entries between two keys of a run's sparse index.
+     */
+    static constexpr std::size_t IndexInterval = 16;
+
+    /**
+     * @brief Name of the log file in the store directory.
+     */
+    static constexpr const char* LogFileName = "state.log";
+
+    /**
+     * @brief Create a store in a directory; nothing is opened before Open.
+     *
+     * @param[in] directory Directory holding the log and the runs, created by Open
+     * @param[in] memtableSize Bytes of keys and values buffered before they are written out as a run
+     * @param[in] maxRuns Runs kept before they are merged into one
+     */
+    LsmStateStore(const std::filesystem::path& directory, std::size_t memtableSize, std::size_t maxRuns);
+
+    /**
+     * @brief Write the memtable out as a run, so the next Open need not replay the log.
+     */
+    ~LsmStateStore() override;
+
+    LsmStateStore(const LsmStateStore&) = delete;
+    LsmStateStore& operator=(const LsmStateStore&) = delete;
+
+    /**
+     * @brief Create the directory, load the runs' indexes and replay the log.
+     *
+     * @return true on success, false on error or a corrupt run
+     */
+    bool Open();
+
+    /**
+     * @brief Write the memtable out as a run and clear the log.
+     *
+     * @return true on success, false on error
+     */
+    bool Flush();
+
+    /**
+     * @brief Get the number of run files.
+     *
+     * @return Runs on disk
+     */
+    std::size_t RunCount() const;
+
+    bool Get(std::string_view key, std::string& outputValue) override;
+    bool Put(std::string_view key, std::string_view value) override;
+    bool PutBatch(const std::vector<StateStoreEntry>& entries) override;
+    bool Range(std::string_view first, std::string_view last, const EntryCallback& onEntry) override;
+
+  private:
+    struct Run;
+    class RunCursor;
+
+    bool LoadRun(const std::filesystem::path& file, std::uint64_t sequence);
+    bool ReplayLog();
+    bool AppendLog(const std::string& payload);
+    void Insert(std::string_view key, std::string_view value);
+    bool WriteRun(std::uint64_t sequence, const std::function<bool(const EntryCallback&)>& forEachEntry);
+    bool Compact();
+    bool Merge(std::string_view first, std::string_view last, bool withMemtable, const EntryCallback& onEntry);
+
+    std::filesystem::path _directory;
+    std::size_t _memtableSize;
+    std::size_t _maxRuns;
+    std::map<std::string, std::string, std::less<>> _memtable;
+    std::size_t _memtableBytes;
+    std::vector<std::unique_ptr<Run>> _runs; /**< Oldest first */
+    std::uint64_t _nextSequence;
+    std::ofstream _log;
+};
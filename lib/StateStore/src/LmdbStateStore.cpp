@@ -0,0 +1,200 @@
+// file LmdbStateStore.cpp:
+
+#include "StateStore/StateStore.hpp"
+
+#ifdef RDEMO_HAVE_LMDB
+#include <lmdb.h>
+#endif
+
+#include <system_error>
+
+#ifdef RDEMO_HAVE_LMDB
+namespace
+{
+/**
+ * @brief View bytes as an LMDB value without copying them.
+ *
+ * @param[in] bytes Bytes to view
+ * @return Value pointing into bytes
+ */
+MDB_val ToValue(std::string_view bytes)
+{
+    return MDB_val{bytes.size(), const_cast<char*>(bytes.data())};
+}
+
+/**
+ * @brief View an LMDB value as bytes.
+ *
+ * @param[in] value Value owned by the current transaction
+ * @return Bytes of the value, valid until the transaction ends
+ */
+std::string_view ToBytes(const MDB_val& value)
+{
+    return std::string_view(static_cast<const char*>(value.mv_data), value.mv_size);
+}
+
+/**
+ * @brief Transaction aborted on scope exit unless it was committed.
+ */
+class LmdbTransaction
+{
+  public:
+    LmdbTransaction(MDB_env* environment, unsigned int flags)
+    {
+        if (MDB_SUCCESS != mdb_txn_begin(environment, nullptr, flags, &_transaction))
+        {
+            _transaction = nullptr;
+        }
+    }
+
+    ~LmdbTransaction()
+    {
+        if (nullptr != _transaction)
+        {
+            mdb_txn_abort(_transaction);
+        }
+    }
+
+    LmdbTransaction(const LmdbTransaction&) = delete;
+    LmdbTransaction& operator=(const LmdbTransaction&) = delete;
+
+    MDB_txn* Get() const
+    {
+        return _transaction;
+    }
+
+    bool Commit()
+    {
+        const int result = mdb_txn_commit(_transaction);
+        _transaction = nullptr;
+        return MDB_SUCCESS == result;
+    }
+
+  private:
+    MDB_txn* _transaction = nullptr;
+};
+}
+#endif
+
+LmdbStateStore::LmdbStateStore(const std::filesystem::path& directory, std::uint64_t mapSize)
+    : _directory(directory), _mapSize(mapSize), _environment(nullptr), _database(0)
+{
+}
+
+LmdbStateStore::~LmdbStateStore()
+{
+#ifdef RDEMO_HAVE_LMDB
+    if (nullptr != _environment)
+    {
+        mdb_env_close(_environment);
+    }
+#endif
+}
+
+bool LmdbStateStore::Open()
+{
+#ifdef RDEMO_HAVE_LMDB
+    std::error_code ec;
+    std::filesystem::create_directories(_directory, ec);
+    if ((MDB_SUCCESS != mdb_env_create(&_environment)) || (MDB_SUCCESS != mdb_env_set_mapsize(_environment, static_cast<std::size_t>(_mapSize))) ||
+        (MDB_SUCCESS != mdb_env_open(_environment, _directory.string().c_str(), MDB_NOTLS, 0644)))
+    {
+        return false;
+    }
+    LmdbTransaction transaction(_environment, 0);
+    MDB_dbi database = 0;
+    if ((nullptr == transaction.Get()) || (MDB_SUCCESS != mdb_dbi_open(transaction.Get(), nullptr, 0, &database)) || (false == transaction.Commit()))
+    {
+        return false;
+    }
+    _database = database;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool LmdbStateStore::Get(std::string_view key, std::string& outputValue)
+{
+#ifdef RDEMO_HAVE_LMDB
+    LmdbTransaction transaction(_environment, MDB_RDONLY);
+    MDB_val keyValue = ToValue(key);
+    MDB_val value{};
+    if ((nullptr == transaction.Get()) || (MDB_SUCCESS != mdb_get(transaction.Get(), _database, &keyValue, &value)))
+    {
+        return false;
+    }
+    outputValue.assign(ToBytes(value));
+    return true;
+#else
+    static_cast<void>(key);
+    static_cast<void>(outputValue);
+    return false;
+#endif
+}
+
+bool LmdbStateStore::Put(std::string_view key, std::string_view value)
+{
+    return PutBatch({StateStoreEntry{std::string(key), std::string(value)}});
+}
+
+bool LmdbStateStore::PutBatch(const std::vector<StateStoreEntry>& entries)
+{
+#ifdef RDEMO_HAVE_LMDB
+    LmdbTransaction transaction(_environment, 0);
+    if (nullptr == transaction.Get())
+    {
+        return false;
+    }
+    for (const auto& entry : entries)
+    {
+        MDB_val keyValue = ToValue(entry.key);
+        MDB_val value = ToValue(entry.value);
+        if (MDB_SUCCESS != mdb_put(transaction.Get(), _database, &keyValue, &value, 0))
+        {
+            return false;
+        }
+    }
+    return transaction.Commit();
+#else
+    static_cast<void>(entries);
+    return false;
+#endif
+}
+
+bool LmdbStateStore::Range(std::string_view first, std::string_view last, const EntryCallback& onEntry)
+{
+#ifdef RDEMO_HAVE_LMDB
+    LmdbTransaction transaction(_environment, MDB_RDONLY);
+    MDB_cursor* cursor = nullptr;
+    if ((nullptr == transaction.Get()) || (MDB_SUCCESS != mdb_cursor_open(transaction.Get(), _database, &cursor)))
+    {
+        return false;
+    }
+    MDB_val keyValue = ToValue(first);
+    MDB_val value{};
+    // LMDB rejects an empty key, so a range from the start begins at the first entry.
+    int result = (true == first.empty()) ? mdb_cursor_get(cursor, &keyValue, &value, MDB_FIRST) : mdb_cursor_get(cursor, &keyValue, &value, MDB_SET_RANGE);
+    bool complete = true;
+    for (; MDB_SUCCESS == result; result = mdb_cursor_get(cursor, &keyValue, &value, MDB_NEXT))
+    {
+        const std::string_view key = ToBytes(keyValue);
+        if ((false == last.empty()) && (key >= last))
+        {
+            break;
+        }
+        if (false == onEntry(key, ToBytes(value)))
+        {
+            complete = false;
+            break;
+        }
+    }
+    mdb_cursor_close(cursor);
+    return (true == complete) && ((MDB_SUCCESS == result) || (MDB_NOTFOUND == result));
+#else
+    static_cast<void>(first);
+    static_cast<void>(last);
+    static_cast<void>(onEntry);
+    return false;
+#endif
+}
@@ -0,0 +1,733 @@
+// file LsmStateStore.cpp:
+
+#include "StateStore/StateStore.hpp"
+
+#include <xxhash.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+constexpr std::uint64_t RunMagic = 0x4e55524d53434452ULL; /**< "RDCSMRUN" in little-endian byte order */
+constexpr std::size_t RunHeaderSize = sizeof(std::uint64_t);
+constexpr std::size_t RunFooterSize = 5 * sizeof(std::uint64_t);
+constexpr std::size_t EntryHeaderSize = 2 * sizeof(std::uint32_t);
+constexpr std::size_t MemtableEntryOverhead = 64; /**< Approximate map node and string bookkeeping per memtable entry */
+constexpr const char* RunPrefix = "run-";
+constexpr const char* RunSuffix = ".sst";
+constexpr const char* TemporarySuffix = ".tmp";
+constexpr std::size_t SequenceDigits = 20;
+constexpr std::size_t RunBufferSize = 1024 * 1024; /**< Bytes of a run gathered before each write */
+
+/**
+ * @brief Append a value's bytes to a buffer, in host byte order.
+ */
+template <typename T>
+void AppendValue(std::string& buffer, const T& value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/**
+ * @brief Append one key and value in the entry layout shared by the log and the runs.
+ */
+void AppendEntry(std::string& buffer, std::string_view key, std::string_view value)
+{
+    AppendValue(buffer, static_cast<std::uint32_t>(key.size()));
+    AppendValue(buffer, static_cast<std::uint32_t>(value.size()));
+    buffer.append(key.data(), key.size());
+    buffer.append(value.data(), value.size());
+}
+
+/**
+ * @brief Read a value in host byte order from a stream.
+ */
+template <typename T>
+bool ReadValue(std::istream& stream, T& outputValue)
+{
+    return static_cast<bool>(stream.read(reinterpret_cast<char*>(&outputValue), sizeof(outputValue)));
+}
+
+/**
+ * @brief Read one entry in the layout written by AppendEntry.
+ *
+ * @param[in,out] stream Stream positioned on the entry
+ * @param[out] outputKey Key, assigned in place
+ * @param[out] outputValue Value, assigned in place
+ * @return true on success, false on a short read
+ */
+bool ReadEntry(std::istream& stream, std::string& outputKey, std::string& outputValue)
+{
+    std::uint32_t keySize = 0;
+    std::uint32_t valueSize = 0;
+    if ((false == ReadValue(stream, keySize)) || (false == ReadValue(stream, valueSize)))
+    {
+        return false;
+    }
+    outputKey.resize(keySize);
+    outputValue.resize(valueSize);
+    return static_cast<bool>(stream.read(outputKey.data(), keySize)) && static_cast<bool>(stream.read(outputValue.data(), valueSize));
+}
+
+/**
+ * @brief Parse the entries of a log record.
+ *
+ * @param[in] payload Record payload, a sequence of entries
+ * @param[in] onEntry Callback receiving each entry
+ * @return true if the payload is well formed, false otherwise
+ */
+bool ForEachPayloadEntry(std::string_view payload, const std::function<void(std::string_view, std::string_view)>& onEntry)
+{
+    std::size_t position = 0;
+    while (position < payload.size())
+    {
+        if (payload.size() - position < EntryHeaderSize)
+        {
+            return false;
+        }
+        std::uint32_t keySize = 0;
+        std::uint32_t valueSize = 0;
+        std::memcpy(&keySize, payload.data() + position, sizeof(keySize));
+        std::memcpy(&valueSize, payload.data() + position + sizeof(keySize), sizeof(valueSize));
+        position += EntryHeaderSize;
+        if (payload.size() - position < static_cast<std::size_t>(keySize) + valueSize)
+        {
+            return false;
+        }
+        onEntry(payload.substr(position, keySize), payload.substr(position + keySize, valueSize));
+        position += static_cast<std::size_t>(keySize) + valueSize;
+    }
+    return true;
+}
+
+/**
+ * @brief Name of the run file with a sequence number, zero-padded so names sort like the numbers.
+ */
+std::string RunFileName(std::uint64_t sequence)
+{
+    std::string digits = std::to_string(sequence);
+    return RunPrefix + std::string(SequenceDigits - std::min(SequenceDigits, digits.size()), '0') + digits + RunSuffix;
+}
+
+/**
+ * @brief Write a file's content through to the disk.
+ *
+ * @param[in] file File to sync
+ * @return true on success, false on error
+ */
+bool SyncFile(const std::filesystem::path& file)
+{
+#ifdef _WIN32
+    HANDLE handle = CreateFileW(file.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (INVALID_HANDLE_VALUE == handle)
+    {
+        return false;
+    }
+    const bool flushed = (FALSE != FlushFileBuffers(handle));
+    CloseHandle(handle);
+    return flushed;
+#else
+    const int descriptor = ::open(file.c_str(), O_RDONLY);
+    if (0 > descriptor)
+    {
+        return false;
+    }
+    const bool synced = (0 == ::fsync(descriptor));
+    ::close(descriptor);
+    return synced;
+#endif
+}
+}
+
+/**
+ * @brief Immutable sorted run on disk, with its sparse index in memory.
+ */
+struct LsmStateStore::Run
+{
+    std::filesystem::path file;             /**< Run file */
+    std::uint64_t sequence = 0;             /**< Higher sequences hold newer values */
+    std::ifstream stream;                   /**< Open for lookups and cursors */
+    std::uint64_t entriesEnd = 0;           /**< Offset of the index, where the entries end */
+    std::uint64_t entryCount = 0;           /**< Entries in the run */
+    std::vector<std::string> indexKeys;     /**< Key of every IndexInterval-th entry */
+    std::vector<std::uint64_t> indexOffsets; /**< Offset of the entry of each index key */
+};
+
+/**
+ * @brief Sequential reader over the entries of one run, starting at the first key of a range.
+ */
+class LsmStateStore::RunCursor
+{
+  public:
+    explicit RunCursor(Run& run) : _run(run), _valid(false), _failed(false), _offset(0)
+    {
+    }
+
+    /**
+     * @brief Position the cursor on the first entry whose key is not below a key.
+     *
+     * @param[in] first Key to seek to, empty for the first entry
+     */
+    void Seek(std::string_view first)
+    {
+        const auto upper = std::upper_bound(_run.indexKeys.begin(), _run.indexKeys.end(), first,
+                                            [](std::string_view key, const std::string& indexKey) { return key < indexKey; });
+        _offset = (_run.indexKeys.begin() == upper) ? RunHeaderSize : _run.indexOffsets[static_cast<std::size_t>(upper - _run.indexKeys.begin()) - 1];
+        _run.stream.clear();
+        _run.stream.seekg(static_cast<std::streamoff>(_offset));
+        Next();
+        while ((true == _valid) && (std::string_view(_key) < first))
+        {
+            Next();
+        }
+    }
+
+    /**
+     * @brief Move to the next entry.
+     */
+    void Next()
+    {
+        _valid = false;
+        if (_offset >= _run.entriesEnd)
+        {
+            return;
+        }
+        if (false == ReadEntry(_run.stream, _key, _value))
+        {
+            _failed = true;
+            return;
+        }
+        _offset += EntryHeaderSize + _key.size() + _value.size();
+        _valid = true;
+    }
+
+    bool Valid() const
+    {
+        return _valid;
+    }
+
+    bool Failed() const
+    {
+        return _failed;
+    }
+
+    const std::string& Key() const
+    {
+        return _key;
+    }
+
+    const std::string& Value() const
+    {
+        return _value;
+    }
+
+  private:
+    Run& _run;
+    bool _valid;
+    bool _failed;
+    std::uint64_t _offset;
+    std::string _key;
+    std::string _value;
+};
+
+LsmStateStore::LsmStateStore(const std::filesystem::path& directory, std::size_t memtableSize, std::size_t maxRuns)
+    : _directory(directory), _memtableSize(memtableSize), _maxRuns(std::max<std::size_t>(1, maxRuns)), _memtableBytes(0), _nextSequence(1)
+{
+}
+
+LsmStateStore::~LsmStateStore()
+{
+    if (true == _log.is_open())
+    {
+        Flush();
+    }
+}
+
+bool LsmStateStore::Open()
+{
+    std::error_code ec;
+    std::filesystem::create_directories(_directory, ec);
+    if (false == std::filesystem::is_directory(_directory, ec))
+    {
+        return false;
+    }
+
+    // Runs are found by name; a temporary file is a run or merge a crash interrupted.
+    std::vector<std::pair<std::uint64_t, std::filesystem::path>> runFiles;
+    for (const auto& entry : std::filesystem::directory_iterator(_directory, ec))
+    {
+        const std::string name = entry.path().filename().string();
+        if (name.size() > std::strlen(TemporarySuffix) && (0 == name.compare(name.size() - std::strlen(TemporarySuffix), std::string::npos, TemporarySuffix)))
+        {
+            std::filesystem::remove(entry.path(), ec);
+            continue;
+        }
+        if ((RunFileName(0).size() != name.size()) || (0 != name.rfind(RunPrefix, 0)))
+        {
+            continue;
+        }
+        runFiles.emplace_back(std::strtoull(name.c_str() + std::strlen(RunPrefix), nullptr, 10), entry.path());
+    }
+    if (0 != ec.value())
+    {
+        return false;
+    }
+    std::sort(runFiles.begin(), runFiles.end());
+    for (const auto& runFile : runFiles)
+    {
+        if (false == LoadRun(runFile.second, runFile.first))
+        {
+            return false;
+        }
+        _nextSequence = runFile.first + 1;
+    }
+    if (false == ReplayLog())
+    {
+        return false;
+    }
+    _log.open(_directory / LogFileName, std::ios::binary | std::ios::app);
+    return _log.is_open();
+}
+
+bool LsmStateStore::Flush()
+{
+    if (true == _memtable.empty())
+    {
+        return true;
+    }
+    const std::uint64_t sequence = _nextSequence++;
+    const bool written = WriteRun(sequence,
+                                  [this](const EntryCallback& onEntry)
+                                  {
+                                      for (const auto& entry : _memtable)
+                                      {
+                                          if (false == onEntry(entry.first, entry.second))
+                                          {
+                                              return false;
+                                          }
+                                      }
+                                      return true;
+                                  });
+    if (false == written)
+    {
+        return false;
+    }
+
+    // The run is on disk before the log that covers it is cleared.
+    _memtable.clear();
+    _memtableBytes = 0;
+    _log.close();
+    _log.open(_directory / LogFileName, std::ios::binary | std::ios::trunc);
+    if (false == _log.is_open())
+    {
+        return false;
+    }
+    return (_runs.size() <= _maxRuns) || (true == Compact());
+}
+
+std::size_t LsmStateStore::RunCount() const
+{
+    return _runs.size();
+}
+
+bool LsmStateStore::Get(std::string_view key, std::string& outputValue)
+{
+    const auto found = _memtable.find(key);
+    if (_memtable.end() != found)
+    {
+        outputValue = found->second;
+        return true;
+    }
+    std::string entryKey;
+    for (auto run = _runs.rbegin(); _runs.rend() != run; ++run)
+    {
+        const auto upper = std::upper_bound((*run)->indexKeys.begin(), (*run)->indexKeys.end(), key,
+                                            [](std::string_view searched, const std::string& indexKey) { return searched < indexKey; });
+        if ((*run)->indexKeys.begin() == upper)
+        {
+            continue;
+        }
+        // Only the interval between two index keys can hold the key.
+        const std::size_t interval = static_cast<std::size_t>(upper - (*run)->indexKeys.begin()) - 1;
+        std::ifstream& stream = (*run)->stream;
+        stream.clear();
+        stream.seekg(static_cast<std::streamoff>((*run)->indexOffsets[interval]));
+        std::uint64_t offset = (*run)->indexOffsets[interval];
+        for (std::size_t read = 0; (read < IndexInterval) && (offset < (*run)->entriesEnd); ++read)
+        {
+            if (false == ReadEntry(stream, entryKey, outputValue))
+            {
+                return false;
+            }
+            offset += EntryHeaderSize + entryKey.size() + outputValue.size();
+            if (key == entryKey)
+            {
+                return true;
+            }
+            if (key < std::string_view(entryKey))
+            {
+                break;
+            }
+        }
+    }
+    return false;
+}
+
+bool LsmStateStore::Put(std::string_view key, std::string_view value)
+{
+    std::string payload;
+    AppendEntry(payload, key, value);
+    if (false == AppendLog(payload))
+    {
+        return false;
+    }
+    Insert(key, value);
+    return (_memtableBytes < _memtableSize) || (true == Flush());
+}
+
+bool LsmStateStore::PutBatch(const std::vector<StateStoreEntry>& entries)
+{
+    std::string payload;
+    for (const auto& entry : entries)
+    {
+        AppendEntry(payload, entry.key, entry.value);
+    }
+    if (false == AppendLog(payload))
+    {
+        return false;
+    }
+    for (const auto& entry : entries)
+    {
+        Insert(entry.key, entry.value);
+    }
+    return (_memtableBytes < _memtableSize) || (true == Flush());
+}
+
+bool LsmStateStore::Range(std::string_view first, std::string_view last, const EntryCallback& onEntry)
+{
+    return Merge(first, last, true, onEntry);
+}
+
+/**
+ * @brief Open a run file, check its footer and load its sparse index.
+ *
+ * @param[in] file Run file
+ * @param[in] sequence Sequence number from its name
+ * @return true on success, false if the file cannot be read or is corrupt
+ */
+bool LsmStateStore::LoadRun(const std::filesystem::path& file, std::uint64_t sequence)
+{
+    auto run = std::make_unique<Run>();
+    run->file = file;
+    run->sequence = sequence;
+    run->stream.open(file, std::ios::binary);
+    std::error_code ec;
+    const std::uintmax_t size = std::filesystem::file_size(file, ec);
+    if ((false == run->stream.is_open()) || (0 != ec.value()) || (size < RunHeaderSize + RunFooterSize))
+    {
+        return false;
+    }
+    std::uint64_t magic = 0;
+    std::uint64_t indexCount = 0;
+    std::uint64_t checksum = 0;
+    std::uint64_t footerMagic = 0;
+    run->stream.seekg(static_cast<std::streamoff>(size - RunFooterSize));
+    if ((false == ReadValue(run->stream, run->entriesEnd)) || (false == ReadValue(run->stream, indexCount)) ||
+        (false == ReadValue(run->stream, run->entryCount)) || (false == ReadValue(run->stream, checksum)) || (false == ReadValue(run->stream, footerMagic)) ||
+        (RunMagic != footerMagic) || (run->entriesEnd < RunHeaderSize) || (run->entriesEnd > size - RunFooterSize))
+    {
+        return false;
+    }
+    run->stream.seekg(0);
+    if ((false == ReadValue(run->stream, magic)) || (RunMagic != magic))
+    {
+        return false;
+    }
+
+    // The checksum covers the index, which every lookup relies on; entries are only read through it.
+    std::string index(static_cast<std::size_t>(size - RunFooterSize - run->entriesEnd), '\0');
+    run->stream.seekg(static_cast<std::streamoff>(run->entriesEnd));
+    if ((false == static_cast<bool>(run->stream.read(index.data(), static_cast<std::streamsize>(index.size())))) ||
+        (XXH3_64bits(index.data(), index.size()) != checksum))
+    {
+        return false;
+    }
+    std::size_t position = 0;
+    for (std::uint64_t i = 0; i < indexCount; ++i)
+    {
+        std::uint32_t keySize = 0;
+        std::uint64_t offset = 0;
+        if (index.size() - position < sizeof(keySize))
+        {
+            return false;
+        }
+        std::memcpy(&keySize, index.data() + position, sizeof(keySize));
+        position += sizeof(keySize);
+        if (index.size() - position < static_cast<std::size_t>(keySize) + sizeof(offset))
+        {
+            return false;
+        }
+        run->indexKeys.emplace_back(index.data() + position, keySize);
+        std::memcpy(&offset, index.data() + position + keySize, sizeof(offset));
+        run->indexOffsets.push_back(offset);
+        position += keySize + sizeof(offset);
+    }
+    _runs.push_back(std::move(run));
+    return true;
+}
+
+/**
+ * @brief Apply the log's records to the memtable, then cut off a torn last record.
+ *
+ * @return true on success, false if the log cannot be read or truncated
+ */
+bool LsmStateStore::ReplayLog()
+{
+    const std::filesystem::path logFile = _directory / LogFileName;
+    std::error_code ec;
+    if (false == std::filesystem::exists(logFile, ec))
+    {
+        return true;
+    }
+    std::ifstream stream(logFile, std::ios::binary);
+    if (false == stream.is_open())
+    {
+        return false;
+    }
+    std::uint64_t validSize = 0;
+    std::string payload;
+    for (std::uint64_t payloadSize = 0; true == ReadValue(stream, payloadSize);)
+    {
+        std::uint64_t checksum = 0;
+        payload.resize(static_cast<std::size_t>(payloadSize));
+        if ((false == static_cast<bool>(stream.read(payload.data(), static_cast<std::streamsize>(payload.size())))) ||
+            (false == ReadValue(stream, checksum)) || (XXH3_64bits(payload.data(), payload.size()) != checksum))
+        {
+            break;
+        }
+        if (false == ForEachPayloadEntry(payload, [this](std::string_view key, std::string_view value) { Insert(key, value); }))
+        {
+            break;
+        }
+        validSize += sizeof(payloadSize) + payloadSize + sizeof(checksum);
+    }
+    stream.close();
+    if (validSize != std::filesystem::file_size(logFile, ec))
+    {
+        std::filesystem::resize_file(logFile, validSize, ec);
+    }
+    return 0 == ec.value();
+}
+
+/**
+ * @brief Append one record to the log: the payload size, the payload and its checksum.
+ *
+ * @param[in] payload Entries of one batch
+ * @return true once the record is handed to the operating system, false on a write error
+ */
+bool LsmStateStore::AppendLog(const std::string& payload)
+{
+    std::string record;
+    record.reserve(payload.size() + 2 * sizeof(std::uint64_t));
+    AppendValue(record, static_cast<std::uint64_t>(payload.size()));
+    record += payload;
+    AppendValue(record, static_cast<std::uint64_t>(XXH3_64bits(payload.data(), payload.size())));
+    _log.write(record.data(), static_cast<std::streamsize>(record.size()));
+    _log.flush();
+    return _log.good();
+}
+
+/**
+ * @brief Store an entry in the memtable and account for its size.
+ */
+void LsmStateStore::Insert(std::string_view key, std::string_view value)
+{
+    const auto found = _memtable.find(key);
+    if (_memtable.end() != found)
+    {
+        _memtableBytes = _memtableBytes - found->second.size() + value.size();
+        found->second.assign(value);
+        return;
+    }
+    _memtable.emplace(std::string(key), std::string(value));
+    _memtableBytes += key.size() + value.size() + MemtableEntryOverhead;
+}
+
+/**
+ * @brief Write sorted entries as a run under a temporary name, sync it, rename it into place and load it.
+ *
+ * @param[in] sequence Sequence number of the new run
+ * @param[in] forEachEntry Hands every entry, in ascending key order, to the callback it is given
+ * @return true on success, false on error
+ */
+bool LsmStateStore::WriteRun(std::uint64_t sequence, const std::function<bool(const EntryCallback&)>& forEachEntry)
+{
+    const std::filesystem::path runFile = _directory / RunFileName(sequence);
+    std::filesystem::path temporaryFile = runFile;
+    temporaryFile += TemporarySuffix;
+    {
+        std::ofstream output(temporaryFile, std::ios::binary | std::ios::trunc);
+        if (false == output.is_open())
+        {
+            return false;
+        }
+        std::string buffer;
+        AppendValue(buffer, RunMagic);
+        std::string index;
+        std::uint64_t offset = RunHeaderSize;
+        std::uint64_t entryCount = 0;
+        std::uint64_t indexCount = 0;
+        const bool listed = forEachEntry(
+            [&](std::string_view key, std::string_view value)
+            {
+                if (0 == entryCount % IndexInterval)
+                {
+                    AppendValue(index, static_cast<std::uint32_t>(key.size()));
+                    index.append(key.data(), key.size());
+                    AppendValue(index, offset);
+                    ++indexCount;
+                }
+                AppendEntry(buffer, key, value);
+                offset += EntryHeaderSize + key.size() + value.size();
+                ++entryCount;
+                if (RunBufferSize <= buffer.size())
+                {
+                    output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                    buffer.clear();
+                }
+                return output.good();
+            });
+        buffer += index;
+        AppendValue(buffer, offset);
+        AppendValue(buffer, indexCount);
+        AppendValue(buffer, entryCount);
+        AppendValue(buffer, static_cast<std::uint64_t>(XXH3_64bits(index.data(), index.size())));
+        AppendValue(buffer, RunMagic);
+        output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        output.close();
+        if ((false == listed) || (true == output.fail()))
+        {
+            std::error_code ec;
+            std::filesystem::remove(temporaryFile, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    if ((false == SyncFile(temporaryFile)) || (std::filesystem::rename(temporaryFile, runFile, ec), 0 != ec.value()))
+    {
+        std::filesystem::remove(temporaryFile, ec);
+        return false;
+    }
+    return LoadRun(runFile, sequence);
+}
+
+/**
+ * @brief Merge every run into one new run, keeping the newest value of each key, and delete the old runs.
+ *
+ * The merged run gets the highest sequence, so a crash before the old runs are deleted leaves them shadowed.
+ *
+ * @return true on success, false on error
+ */
+bool LsmStateStore::Compact()
+{
+    const std::size_t merged = _runs.size();
+    const std::uint64_t sequence = _nextSequence++;
+    if (false == WriteRun(sequence, [this](const EntryCallback& onEntry) { return Merge(std::string_view(), std::string_view(), false, onEntry); }))
+    {
+        return false;
+    }
+    std::error_code ec;
+    for (std::size_t i = 0; i < merged; ++i)
+    {
+        _runs[i]->stream.close();
+        std::filesystem::remove(_runs[i]->file, ec);
+    }
+    _runs.erase(_runs.begin(), _runs.begin() + static_cast<std::ptrdiff_t>(merged));
+    return true;
+}
+
+/**
+ * @brief Visit the newest value of every key in a range across the runs and, optionally, the memtable.
+ *
+ * @param[in] first Smallest key visited
+ * @param[in] last Key the visit stops before, empty to visit to the end
+ * @param[in] withMemtable Include the memtable, which holds the newest values
+ * @param[in] onEntry Callback receiving each key and value
+ * @return true if every entry in the range was visited, false on a read error or when stopped early
+ */
+bool LsmStateStore::Merge(std::string_view first, std::string_view last, bool withMemtable, const EntryCallback& onEntry)
+{
+    std::vector<std::unique_ptr<RunCursor>> cursors;
+    cursors.reserve(_runs.size());
+    for (auto& run : _runs)
+    {
+        cursors.push_back(std::make_unique<RunCursor>(*run));
+        cursors.back()->Seek(first);
+    }
+    auto memtableEntry = (true == withMemtable) ? _memtable.lower_bound(first) : _memtable.end();
+    std::string key;
+    while (true)
+    {
+        // Few runs are kept, so the smallest key is found by a linear pass rather than a heap.
+        const std::string* smallest = nullptr;
+        for (const auto& cursor : cursors)
+        {
+            if (true == cursor->Failed())
+            {
+                return false;
+            }
+            if ((true == cursor->Valid()) && ((nullptr == smallest) || (cursor->Key() < *smallest)))
+            {
+                smallest = &cursor->Key();
+            }
+        }
+        if ((_memtable.end() != memtableEntry) && ((nullptr == smallest) || (memtableEntry->first < *smallest)))
+        {
+            smallest = &memtableEntry->first;
+        }
+        if ((nullptr == smallest) || ((false == last.empty()) && (std::string_view(*smallest) >= last)))
+        {
+            return true;
+        }
+        key = *smallest;
+
+        // The memtable is newer than every run, and later runs are newer than earlier ones.
+        const std::string* value = nullptr;
+        if ((_memtable.end() != memtableEntry) && (memtableEntry->first == key))
+        {
+            value = &memtableEntry->second;
+        }
+        for (auto cursor = cursors.rbegin(); (nullptr == value) && (cursors.rend() != cursor); ++cursor)
+        {
+            if ((true == (*cursor)->Valid()) && ((*cursor)->Key() == key))
+            {
+                value = &(*cursor)->Value();
+            }
+        }
+        if (false == onEntry(key, *value))
+        {
+            return false;
+        }
+        for (auto& cursor : cursors)
+        {
+            if ((true == cursor->Valid()) && (cursor->Key() == key))
+            {
+                cursor->Next();
+            }
+        }
+        if ((_memtable.end() != memtableEntry) && (memtableEntry->first == key))
+        {
+            ++memtableEntry;
+        }
+    }
+}
@@ -0,0 +1,150 @@
+// file SQLiteStateStore.cpp:
+
+#include "StateStore/StateStore.hpp"
+
+#include "SQLite/SQLiteConnection.hpp"
+#include "SQLite/SQLiteSession.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+constexpr const char* SqlCreateStateTable = "CREATE TABLE IF NOT EXISTS state (key BLOB PRIMARY KEY, value BLOB NOT NULL) WITHOUT ROWID;";
+constexpr const char* SqlPutState = "INSERT OR REPLACE INTO state(key, value) VALUES (?1, ?2);";
+
+/**
+ * @brief Bind a key or value as a BLOB; an empty one binds a zero-length BLOB, not NULL.
+ *
+ * @param[in,out] statement Statement to bind to
+ * @param[in] index Parameter index
+ * @param[in] bytes Bytes to bind
+ */
+void BindBytes(SQLiteStatement& statement, int index, std::string_view bytes)
+{
+    static const char empty = 0;
+    statement.BindBlob(index, (true == bytes.empty()) ? &empty : bytes.data(), bytes.size());
+}
+
+/**
+ * @brief View a BLOB column as bytes.
+ *
+ * @param[in] statement Statement positioned on a row
+ * @param[in] index Column index
+ * @return Bytes of the column, valid until the statement is stepped
+ */
+std::string_view ColumnBytes(const SQLiteStatement& statement, int index)
+{
+    const SQLiteBlob blob = statement.ColumnBlob(index);
+    return (nullptr == blob.data) ? std::string_view() : std::string_view(static_cast<const char*>(blob.data), blob.size);
+}
+}
+
+SQLiteStateStore::SQLiteStateStore(const std::filesystem::path& databaseFile) : _databaseFile(databaseFile)
+{
+}
+
+SQLiteStateStore::~SQLiteStateStore() = default;
+
+bool SQLiteStateStore::Open()
+{
+    try
+    {
+        _session = std::make_unique<SQLiteSession>(_databaseFile, SQLitePerformanceProfile::Balanced);
+        _session->Acquire().Execute(SqlCreateStateTable);
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        _session.reset();
+        return false;
+    }
+}
+
+bool SQLiteStateStore::Get(std::string_view key, std::string& outputValue)
+{
+    try
+    {
+        auto cachedStatement = _session->Acquire().PrepareCached("SELECT value FROM state WHERE key=?1;");
+        BindBytes(*cachedStatement, 1, key);
+        if (SQLiteStepResult::Row != cachedStatement->TryStep())
+        {
+            return false;
+        }
+        outputValue.assign(ColumnBytes(*cachedStatement, 0));
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool SQLiteStateStore::Put(std::string_view key, std::string_view value)
+{
+    try
+    {
+        auto cachedStatement = _session->Acquire().PrepareCached(SqlPutState);
+        BindBytes(*cachedStatement, 1, key);
+        BindBytes(*cachedStatement, 2, value);
+        return cachedStatement->ExecuteStatement();
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool SQLiteStateStore::PutBatch(const std::vector<StateStoreEntry>& entries)
+{
+    try
+    {
+        auto& connection = _session->Acquire();
+        connection.Execute("BEGIN IMMEDIATE;");
+        try
+        {
+            auto cachedStatement = connection.PrepareCached(SqlPutState);
+            for (const auto& entry : entries)
+            {
+                BindBytes(*cachedStatement, 1, entry.key);
+                BindBytes(*cachedStatement, 2, entry.value);
+                if (false == cachedStatement->ExecuteStatement())
+                {
+                    connection.Execute("ROLLBACK;");
+                    return false;
+                }
+                cachedStatement->Reset();
+            }
+            connection.Execute("COMMIT;");
+        }
+        catch (const std::runtime_error&)
+        {
+            connection.Execute("ROLLBACK;");
+            throw;
+        }
+        return true;
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
+
+bool SQLiteStateStore::Range(std::string_view first, std::string_view last, const EntryCallback& onEntry)
+{
+    try
+    {
+        auto& connection = _session->Acquire();
+        auto cachedStatement = connection.PrepareCached((true == last.empty()) ? "SELECT key, value FROM state WHERE key>=?1 ORDER BY key;"
+                                                                               : "SELECT key, value FROM state WHERE key>=?1 AND key<?2 ORDER BY key;");
+        BindBytes(*cachedStatement, 1, first);
+        if (false == last.empty())
+        {
+            BindBytes(*cachedStatement, 2, last);
+        }
+        return cachedStatement->ForEachRow([&onEntry](const SQLiteStatement& row) { return onEntry(ColumnBytes(row, 0), ColumnBytes(row, 1)); });
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
+    }
+}
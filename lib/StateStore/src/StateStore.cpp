@@ -0,0 +1,58 @@
+// file StateStore.cpp:
+
+#include "StateStore/StateStore.hpp"
+
+bool StateStore::Open(StateStoreBackend backend, const std::filesystem::path& location, const StateStoreOptions& options,
+                      std::unique_ptr<StateStore>& outputStore)
+{
+    outputStore.reset();
+    switch (backend)
+    {
+    case StateStoreBackend::SQLite:
+    {
+        auto store = std::make_unique<SQLiteStateStore>(location);
+        if (false == store->Open())
+        {
+            return false;
+        }
+        outputStore = std::move(store);
+        return true;
+    }
+    case StateStoreBackend::Lmdb:
+    {
+        auto store = std::make_unique<LmdbStateStore>(location, options.mapSize);
+        if (false == store->Open())
+        {
+            return false;
+        }
+        outputStore = std::move(store);
+        return true;
+    }
+    case StateStoreBackend::Lsm:
+    {
+        auto store = std::make_unique<LsmStateStore>(location, options.memtableSize, options.maxRuns);
+        if (false == store->Open())
+        {
+            return false;
+        }
+        outputStore = std::move(store);
+        return true;
+    }
+    }
+    return false;
+}
+
+bool StateStore::IsAvailable(StateStoreBackend backend)
+{
+#ifdef RDEMO_HAVE_LMDB
+    static_cast<void>(backend);
+    return true;
+#else
+    return StateStoreBackend::Lmdb != backend;
+#endif
+}
+
+bool StateStore::Scan(const EntryCallback& onEntry)
+{
+    return Range(std::string_view(), std::string_view(), onEntry);
+}
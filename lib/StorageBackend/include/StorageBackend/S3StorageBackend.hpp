@@ -0,0 +1,120 @@
+#pragma once
+
+#include "StorageBackend/StorageBackend.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class HttpClient;
+class TaskPool;
+struct HttpResponse;
+
+/**
+ * @brief Connection and upload settings of an S3StorageBackend.
+ */
+struct S3Options
+{
+    /**
+     * @brief Default number of requests in flight at once, and of connections kept open.
+     */
+    static constexpr unsigned int DefaultConnections = 16;
+
+    /**
+     * @brief Default size in bytes of one part of a multipart upload; larger files are uploaded in parts.
+     */
+    static constexpr std::uint64_t DefaultPartSize = 16 * 1024 * 1024;
+
+    std::string endpoint;            /**< Service address as `http://host[:port]` */
+    std::string bucket;              /**< Bucket holding the objects, addressed in path style */
+    std::string prefix;              /**< Prepended to every key, such as `hosts/alpha/`, empty for none */
+    std::string region = "us-east-1"; /**< Region requests are signed for */
+    std::string accessKey;           /**< Access key id */
+    std::string secretKey;           /**< Secret access key */
+    std::string sessionToken;        /**< Session token of temporary credentials, empty for none */
+    unsigned int connections = DefaultConnections; /**< Requests in flight at once, and idle connections kept open */
+    std::uint64_t partSize = DefaultPartSize;      /**< Size in bytes of one part of a multipart upload, raised to the 5 MiB the protocol needs */
+};
+
+/**
+ * @brief Storage in a bucket of an S3-compatible object store.
+ *
+ * Requests are signed with AWS Signature Version 4 and sent over plain HTTP connections that are kept
+ * open and reused. Files larger than the part size are uploaded in parts, several at a time, and
+ * assembled by the store, so a reader sees the old object until the new one is complete. An object
+ * store has no rename: Rename copies the object on the server, in parts above 5 GiB, and deletes the
+ * original. Batched operations run their requests side by side on a pool of `connections` threads.
+ * Failed requests and server errors are retried a few times with a growing pause.
+ *
+ * There is no TLS; an https endpoint needs a local proxy that terminates it.
+ */
+class S3StorageBackend : public StorageBackend
+{
+  public:
+    /**
+     * @brief Create a backend; no connection is opened yet.
+     *
+     * @param[in] options Service address, bucket, credentials and upload settings
+     * @throws std::invalid_argument if the endpoint is not an `http://` address or the bucket is empty
+     */
+    explicit S3StorageBackend(const S3Options& options);
+    ~S3StorageBackend() override;
+
+    S3StorageBackend(const S3StorageBackend&) = delete;
+    S3StorageBackend& operator=(const S3StorageBackend&) = delete;
+
+    bool Put(const std::filesystem::path& source, const std::string& key) override;
+    bool Get(const std::string& key, const std::filesystem::path& destination) override;
+    bool Rename(const std::string& fromKey, const std::string& toKey) override;
+    bool List(const std::string& prefix, std::vector<std::string>& outputKeys) override;
+    bool Remove(const std::string& key) override;
+    bool Exists(const std::string& key, bool& outputExists) override;
+    std::future<bool> PutBatch(std::vector<StoragePut> puts) override;
+    std::future<bool> RenameBatch(std::vector<StorageRename> renames) override;
+    std::future<bool> RemoveBatch(std::vector<std::string> keys) override;
+
+    /**
+     * @brief Get the number of connections opened so far.
+     *
+     * @return Connections opened since the backend was created
+     */
+    std::size_t ConnectionsOpened() const;
+
+  private:
+    /**
+     * @brief One request to the bucket before it is signed.
+     */
+    struct S3Request
+    {
+        std::string method;                                       /**< HTTP method */
+        std::string key;                                          /**< Object key without the prefix, empty addresses the bucket */
+        std::vector<std::pair<std::string, std::string>> query;   /**< Unencoded query parameters */
+        std::vector<std::pair<std::string, std::string>> headers; /**< Extra headers with lowercase names, all signed */
+        std::string body;                                         /**< Body sent when bodyFile is empty */
+        std::filesystem::path bodyFile;                           /**< File a range of which is the body */
+        std::uint64_t bodyOffset;                                 /**< Start of the range of bodyFile */
+        std::uint64_t bodyLength;                                 /**< Length of the range of bodyFile */
+    };
+
+    bool Send(const S3Request& request, HttpResponse& outputResponse, std::ostream* successBody = nullptr);
+    bool Head(const std::string& key, int& outputStatus, std::uint64_t& outputSize);
+    bool PutInParts(const std::filesystem::path& source, const std::string& key, std::uint64_t size);
+    bool CopyInParts(const std::string& fromKey, const std::string& toKey, std::uint64_t size);
+    bool StartMultipart(const std::string& key, std::string& outputUploadId);
+    bool CompleteMultipart(const std::string& key, const std::string& uploadId, const std::vector<std::string>& etags);
+    void AbortMultipart(const std::string& key, const std::string& uploadId);
+    std::future<bool> RunBatch(std::vector<std::function<bool()>> operations);
+
+    S3Options _options;
+    std::string _host;
+    std::string _hostHeader;
+    std::unique_ptr<HttpClient> _client;
+    std::unique_ptr<TaskPool> _pool;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <filesystem>
+#include <future>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Upload of one local file to a key, for StorageBackend::PutBatch.
+ */
+struct StoragePut
+{
+    std::filesystem::path source; /**< Local file whose content is stored */
+    std::string key;              /**< Key the content is stored under */
+};
+
+/**
+ * @brief Move of one stored object to another key, for StorageBackend::RenameBatch.
+ */
+struct StorageRename
+{
+    std::string fromKey; /**< Key of the object to move */
+    std::string toKey;   /**< Key it is moved to; an object already there is replaced */
+};
+
+/**
+ * @brief Place backup files are written to, addressed by keys instead of paths.
+ *
+ * Keys are `/`-separated paths relative to the root of the store, such as `backup/docs/a.txt`. A store
+ * has no directories of its own: storing a key creates whatever its location needs, and listing a prefix
+ * finds every key below it. All operations are thread-safe; the batched variants return at once and
+ * complete in the background where the store can run requests side by side.
+ */
+class StorageBackend
+{
+  public:
+    virtual ~StorageBackend() = default;
+
+    /**
+     * @brief Store the content of a local file under a key, replacing any object stored there.
+     *
+     * A reader never sees a partly stored object: the key holds the old content or the new one.
+     *
+     * @param[in] source Local file to store
+     * @param[in] key Key to store it under
+     * @return true on success, false on error
+     */
+    virtual bool Put(const std::filesystem::path& source, const std::string& key) = 0;
+
+    /**
+     * @brief Write the object stored under a key to a local file, replacing the file.
+     *
+     * @param[in] key Key of the object
+     * @param[in] destination Local file to write
+     * @return true on success, false if the key is missing or on error
+     */
+    virtual bool Get(const std::string& key, const std::filesystem::path& destination) = 0;
+
+    /**
+     * @brief Move an object to another key, replacing any object stored there.
+     *
+     * @param[in] fromKey Key of the object to move
+     * @param[in] toKey Key it is moved to
+     * @return true on success, false if fromKey is missing or on error
+     */
+    virtual bool Rename(const std::string& fromKey, const std::string& toKey) = 0;
+
+    /**
+     * @brief List the keys starting with a prefix.
+     *
+     * @param[in] prefix Start of the keys to list, empty lists the whole store
+     * @param[out] outputKeys Matching keys, sorted
+     * @return true on success, false on error
+     */
+    virtual bool List(const std::string& prefix, std::vector<std::string>& outputKeys) = 0;
+
+    /**
+     * @brief Delete the object stored under a key; a missing key is not an error.
+     *
+     * @param[in] key Key of the object
+     * @return true on success, false on error
+     */
+    virtual bool Remove(const std::string& key) = 0;
+
+    /**
+     * @brief Check whether an object is stored under a key.
+     *
+     * @param[in] key Key to look up
+     * @param[out] outputExists Whether the key holds an object
+     * @return true on success, false on error
+     */
+    virtual bool Exists(const std::string& key, bool& outputExists) = 0;
+
+    /**
+     * @brief Store several local files, like Put for each of them.
+     *
+     * The default runs the uploads one after another once the result is waited for.
+     *
+     * @param[in] puts Files and the keys to store them under
+     * @return Becomes true once every file is stored, false if any failed
+     */
+    virtual std::future<bool> PutBatch(std::vector<StoragePut> puts);
+
+    /**
+     * @brief Move several objects, like Rename for each of them.
+     *
+     * The default runs the moves one after another once the result is waited for.
+     *
+     * @param[in] renames Objects to move and their new keys
+     * @return Becomes true once every object is moved, false if any failed
+     */
+    virtual std::future<bool> RenameBatch(std::vector<StorageRename> renames);
+
+    /**
+     * @brief Delete several objects, like Remove for each of them.
+     *
+     * The default runs the deletions one after another once the result is waited for.
+     *
+     * @param[in] keys Keys of the objects
+     * @return Becomes true once every object is deleted, false if any failed
+     */
+    virtual std::future<bool> RemoveBatch(std::vector<std::string> keys);
+};
+
+/**
+ * @brief Storage in a directory of a local or mounted filesystem; each key is a file below the root.
+ *
+ * Put copies to a temporary file next to the key and renames it into place. Directories are created as
+ * keys need them and are never removed.
+ */
+class FilesystemStorageBackend : public StorageBackend
+{
+  public:
+    /**
+     * @brief Suffix of the temporary file Put copies to before renaming it over the key.
+     */
+    static constexpr const char* TemporarySuffix = ".storing";
+
+    /**
+     * @brief Create a store rooted at a directory.
+     *
+     * @param[in] root Directory holding the keys, created on the first write
+     */
+    explicit FilesystemStorageBackend(const std::filesystem::path& root);
+
+    /**
+     * @brief Get the directory holding the keys.
+     *
+     * @return Root directory
+     */
+    const std::filesystem::path& Root() const;
+
+    bool Put(const std::filesystem::path& source, const std::string& key) override;
+    bool Get(const std::string& key, const std::filesystem::path& destination) override;
+    bool Rename(const std::string& fromKey, const std::string& toKey) override;
+    bool List(const std::string& prefix, std::vector<std::string>& outputKeys) override;
+    bool Remove(const std::string& key) override;
+    bool Exists(const std::string& key, bool& outputExists) override;
+
+  private:
+    std::filesystem::path _root;
+};
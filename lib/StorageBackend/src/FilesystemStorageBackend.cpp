@@ -0,0 +1,90 @@
+#include "StorageBackend/StorageBackend.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+FilesystemStorageBackend::FilesystemStorageBackend(const std::filesystem::path& root) : _root(root)
+{
+}
+
+const std::filesystem::path& FilesystemStorageBackend::Root() const
+{
+    return _root;
+}
+
+bool FilesystemStorageBackend::Put(const std::filesystem::path& source, const std::string& key)
+{
+    std::error_code ec;
+    const std::filesystem::path target = _root / key;
+    std::filesystem::path temporary = target;
+    temporary += TemporarySuffix;
+    std::filesystem::create_directories(target.parent_path(), ec);
+    if (true == std::filesystem::copy_file(source, temporary, std::filesystem::copy_options::overwrite_existing, ec))
+    {
+        std::filesystem::rename(temporary, target, ec);
+        if (0 == ec.value())
+        {
+            return true;
+        }
+    }
+    std::error_code removeError;
+    std::filesystem::remove(temporary, removeError);
+    return false;
+}
+
+bool FilesystemStorageBackend::Get(const std::string& key, const std::filesystem::path& destination)
+{
+    std::error_code ec;
+    return std::filesystem::copy_file(_root / key, destination, std::filesystem::copy_options::overwrite_existing, ec);
+}
+
+bool FilesystemStorageBackend::Rename(const std::string& fromKey, const std::string& toKey)
+{
+    std::error_code ec;
+    const std::filesystem::path target = _root / toKey;
+    std::filesystem::create_directories(target.parent_path(), ec);
+    std::filesystem::rename(_root / fromKey, target, ec);
+    return 0 == ec.value();
+}
+
+bool FilesystemStorageBackend::List(const std::string& prefix, std::vector<std::string>& outputKeys)
+{
+    outputKeys.clear();
+    // Only the directory the prefix ends in can hold matching keys.
+    const std::string::size_type slash = prefix.rfind('/');
+    const std::filesystem::path start = (std::string::npos == slash) ? _root : _root / prefix.substr(0, slash);
+    std::error_code ec;
+    if (false == std::filesystem::is_directory(start, ec))
+    {
+        return (0 == ec.value()) || (std::errc::no_such_file_or_directory == ec);
+    }
+    std::filesystem::recursive_directory_iterator entry(start, ec);
+    for (; (0 == ec.value()) && (std::filesystem::recursive_directory_iterator() != entry); entry.increment(ec))
+    {
+        if (false == entry->is_regular_file(ec))
+        {
+            continue;
+        }
+        std::string key = entry->path().lexically_relative(_root).generic_string();
+        if (0 == key.compare(0, prefix.size(), prefix))
+        {
+            outputKeys.push_back(std::move(key));
+        }
+    }
+    std::sort(outputKeys.begin(), outputKeys.end());
+    return 0 == ec.value();
+}
+
+bool FilesystemStorageBackend::Remove(const std::string& key)
+{
+    std::error_code ec;
+    std::filesystem::remove(_root / key, ec);
+    return 0 == ec.value();
+}
+
+bool FilesystemStorageBackend::Exists(const std::string& key, bool& outputExists)
+{
+    std::error_code ec;
+    outputExists = std::filesystem::is_regular_file(_root / key, ec);
+    return (0 == ec.value()) || (std::errc::no_such_file_or_directory == ec);
+}
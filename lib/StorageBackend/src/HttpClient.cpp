@@ -0,0 +1,396 @@
+#include "HttpClient.hpp"
+#include "TcpSocket/TcpSocket.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <utility>
+
+namespace
+{
+/**
+ * @brief Longest time a send or receive may block before the connection counts as failed.
+ */
+constexpr unsigned int SocketTimeoutSeconds = 120;
+
+/**
+ * @brief Bytes of a file body read and sent at a time.
+ */
+constexpr std::size_t FileBodyChunkSize = 1024 * 1024;
+
+/**
+ * @brief Bytes requested from the socket per receive.
+ */
+constexpr std::size_t ReceiveChunkSize = 64 * 1024;
+
+std::string ToLower(std::string text)
+{
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char character) { return static_cast<char>(std::tolower(character)); });
+    return text;
+}
+
+std::string Trim(const std::string& text)
+{
+    const std::string::size_type first = text.find_first_not_of(" \t");
+    if (std::string::npos == first)
+    {
+        return std::string();
+    }
+    return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+}
+}
+
+std::string HttpResponse::Header(const std::string& name) const
+{
+    for (const auto& header : headers)
+    {
+        if (name == header.first)
+        {
+            return header.second;
+        }
+    }
+    return std::string();
+}
+
+/**
+ * @brief One TCP connection to the server, used by one request at a time.
+ */
+class HttpConnection
+{
+  public:
+    /**
+     * @brief Connect to a server.
+     *
+     * @param[in] host Server host name or address
+     * @param[in] port Server port
+     * @return Connection, nullptr if none could be made
+     */
+    static std::unique_ptr<HttpConnection> Open(const std::string& host, std::uint16_t port)
+    {
+        TcpSocket socket = TcpSocket::Connect(host, port, SocketTimeoutSeconds);
+        if (false == socket.IsOpen())
+        {
+            return nullptr;
+        }
+        return std::unique_ptr<HttpConnection>(new HttpConnection(std::move(socket)));
+    }
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    /**
+     * @brief Write a request.
+     *
+     * @param[in] request Request to send
+     * @return true on success, false on error
+     */
+    bool Send(const HttpRequest& request)
+    {
+        const bool fileBody = (false == request.bodyFile.empty());
+        const std::uint64_t bodyLength = (true == fileBody) ? request.bodyLength : request.body.size();
+        std::string head = request.method + " " + request.target + " HTTP/1.1\r\n";
+        for (const auto& header : request.headers)
+        {
+            head += header.first + ": " + header.second + "\r\n";
+        }
+        head += "content-length: " + std::to_string(bodyLength) + "\r\n\r\n";
+        if (false == fileBody)
+        {
+            head += request.body;
+            return SendAll(head.data(), head.size());
+        }
+        if (false == SendAll(head.data(), head.size()))
+        {
+            return false;
+        }
+
+        std::ifstream input(request.bodyFile, std::ios::binary);
+        input.seekg(static_cast<std::streamoff>(request.bodyOffset));
+        std::vector<char> chunk(static_cast<std::size_t>(std::min<std::uint64_t>(FileBodyChunkSize, bodyLength)));
+        for (std::uint64_t sent = 0; sent < bodyLength;)
+        {
+            const std::size_t length = static_cast<std::size_t>(std::min<std::uint64_t>(chunk.size(), bodyLength - sent));
+            if ((false == static_cast<bool>(input.read(chunk.data(), static_cast<std::streamsize>(length)))) ||
+                (false == SendAll(chunk.data(), length)))
+            {
+                return false;
+            }
+            sent += length;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Read the response to the request sent last.
+     *
+     * @param[in] method Method of that request; a HEAD response has no body
+     * @param[out] outputResponse Response read
+     * @param[in] successBody Stream receiving the body of a 2xx response, nullptr keeps it in outputResponse.body
+     * @param[out] outputKeepAlive Whether the connection can carry another request
+     * @param[out] outputReceivedAny Whether any response byte arrived, after which the request must not be repeated
+     * @return true on success, false on error
+     */
+    bool Receive(const std::string& method, HttpResponse& outputResponse, std::ostream* successBody, bool& outputKeepAlive, bool& outputReceivedAny)
+    {
+        outputKeepAlive = false;
+        outputReceivedAny = false;
+        outputResponse = HttpResponse();
+        std::string line;
+        if (false == ReadLine(line))
+        {
+            return false;
+        }
+        outputReceivedAny = true;
+        // "HTTP/1.1 200 OK"
+        const std::string::size_type space = line.find(' ');
+        if ((std::string::npos == space) || (0 != line.compare(0, 5, "HTTP/")))
+        {
+            return false;
+        }
+        outputResponse.status = std::atoi(line.c_str() + space + 1);
+        while (true)
+        {
+            if (false == ReadLine(line))
+            {
+                return false;
+            }
+            if (true == line.empty())
+            {
+                break;
+            }
+            const std::string::size_type colon = line.find(':');
+            if (std::string::npos != colon)
+            {
+                outputResponse.headers.emplace_back(ToLower(line.substr(0, colon)), Trim(line.substr(colon + 1)));
+            }
+        }
+
+        std::ostream* sink = ((nullptr != successBody) && (200 <= outputResponse.status) && (outputResponse.status < 300)) ? successBody : nullptr;
+        const bool bodyless = ("HEAD" == method) || (204 == outputResponse.status) || (304 == outputResponse.status) ||
+                              ((100 <= outputResponse.status) && (outputResponse.status < 200));
+        const std::string connection = ToLower(outputResponse.Header("connection"));
+        const std::string contentLength = outputResponse.Header("content-length");
+        bool complete = true;
+        bool delimited = true;
+        if ((false == bodyless) && (std::string::npos != ToLower(outputResponse.Header("transfer-encoding")).find("chunked")))
+        {
+            complete = ReadChunkedBody(outputResponse.body, sink);
+        }
+        else if ((false == bodyless) && (false == contentLength.empty()))
+        {
+            complete = ReadBody(std::strtoull(contentLength.c_str(), nullptr, 10), outputResponse.body, sink);
+        }
+        else if (false == bodyless)
+        {
+            // Without a length the body runs until the server closes the connection.
+            delimited = false;
+            complete = ReadToClose(outputResponse.body, sink);
+        }
+        outputKeepAlive = (true == complete) && (true == delimited) && ("close" != connection);
+        return complete;
+    }
+
+  private:
+    explicit HttpConnection(TcpSocket&& socket) : _socket(std::move(socket)), _bufferStart(0)
+    {
+    }
+
+    bool SendAll(const char* data, std::size_t size)
+    {
+        return _socket.SendAll(data, size);
+    }
+
+    /**
+     * @brief Receive more bytes into the buffer.
+     *
+     * @return false once the connection is closed or failed
+     */
+    bool Fill()
+    {
+        if (0 < _bufferStart)
+        {
+            _buffer.erase(0, _bufferStart);
+            _bufferStart = 0;
+        }
+        char chunk[ReceiveChunkSize];
+        const std::size_t received = _socket.ReceiveSome(chunk, sizeof(chunk));
+        if (0 == received)
+        {
+            return false;
+        }
+        _buffer.append(chunk, received);
+        return true;
+    }
+
+    bool ReadLine(std::string& outputLine)
+    {
+        while (true)
+        {
+            const std::string::size_type end = _buffer.find("\r\n", _bufferStart);
+            if (std::string::npos != end)
+            {
+                outputLine.assign(_buffer, _bufferStart, end - _bufferStart);
+                _bufferStart = end + 2;
+                return true;
+            }
+            if (false == Fill())
+            {
+                return false;
+            }
+        }
+    }
+
+    /**
+     * @brief Pass the next bytes of a body on to the stream, or append them to the text body.
+     */
+    static bool Deliver(const char* data, std::size_t size, std::string& body, std::ostream* sink)
+    {
+        if (nullptr == sink)
+        {
+            body.append(data, size);
+            return true;
+        }
+        return static_cast<bool>(sink->write(data, static_cast<std::streamsize>(size)));
+    }
+
+    bool ReadBody(std::uint64_t length, std::string& body, std::ostream* sink)
+    {
+        while (0 < length)
+        {
+            if ((_buffer.size() == _bufferStart) && (false == Fill()))
+            {
+                return false;
+            }
+            const std::size_t available = static_cast<std::size_t>(std::min<std::uint64_t>(length, _buffer.size() - _bufferStart));
+            if (false == Deliver(_buffer.data() + _bufferStart, available, body, sink))
+            {
+                return false;
+            }
+            _bufferStart += available;
+            length -= available;
+        }
+        return true;
+    }
+
+    bool ReadChunkedBody(std::string& body, std::ostream* sink)
+    {
+        std::string line;
+        while (true)
+        {
+            if (false == ReadLine(line))
+            {
+                return false;
+            }
+            const std::uint64_t chunkLength = std::strtoull(line.c_str(), nullptr, 16);
+            if (0 == chunkLength)
+            {
+                // Trailers end with an empty line.
+                while ((true == ReadLine(line)) && (false == line.empty()))
+                {
+                }
+                return true == line.empty();
+            }
+            if ((false == ReadBody(chunkLength, body, sink)) || (false == ReadLine(line)))
+            {
+                return false;
+            }
+        }
+    }
+
+    bool ReadToClose(std::string& body, std::ostream* sink)
+    {
+        do
+        {
+            if (false == Deliver(_buffer.data() + _bufferStart, _buffer.size() - _bufferStart, body, sink))
+            {
+                return false;
+            }
+            _bufferStart = _buffer.size();
+        } while (true == Fill());
+        return true;
+    }
+
+    TcpSocket _socket;
+    std::string _buffer;
+    std::size_t _bufferStart;
+};
+
+HttpClient::HttpClient(const std::string& host, std::uint16_t port, std::size_t maxIdleConnections)
+    : _host(host), _port(port), _maxIdleConnections(maxIdleConnections), _connectionsOpened(0)
+{
+}
+
+HttpClient::~HttpClient() = default;
+
+bool HttpClient::Execute(const HttpRequest& request, HttpResponse& outputResponse, std::ostream* successBody)
+{
+    // A reused connection may have been closed by the server; then the request goes out again on a new one.
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        bool reused = false;
+        std::unique_ptr<HttpConnection> connection = TakeConnection(reused);
+        if (nullptr == connection)
+        {
+            return false;
+        }
+        bool keepAlive = false;
+        bool receivedAny = false;
+        if ((true == connection->Send(request)) && (true == connection->Receive(request.method, outputResponse, successBody, keepAlive, receivedAny)))
+        {
+            if (true == keepAlive)
+            {
+                ReturnConnection(std::move(connection));
+            }
+            return true;
+        }
+        if ((false == reused) || (true == receivedAny))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+std::size_t HttpClient::ConnectionsOpened() const
+{
+    std::lock_guard<std::mutex> lock(_idleMutex);
+    return _connectionsOpened;
+}
+
+/**
+ * @brief Take the most recently used idle connection, or open a new one.
+ *
+ * @param[out] outputReused Whether the connection carried a request before
+ * @return Connection, nullptr if none could be opened
+ */
+std::unique_ptr<HttpConnection> HttpClient::TakeConnection(bool& outputReused)
+{
+    {
+        std::lock_guard<std::mutex> lock(_idleMutex);
+        if (false == _idle.empty())
+        {
+            std::unique_ptr<HttpConnection> connection = std::move(_idle.back());
+            _idle.pop_back();
+            outputReused = true;
+            return connection;
+        }
+        ++_connectionsOpened;
+    }
+    outputReused = false;
+    return HttpConnection::Open(_host, _port);
+}
+
+/**
+ * @brief Keep a connection for the next request, or close it if enough are idle.
+ *
+ * @param[in] connection Connection whose response was read completely
+ */
+void HttpClient::ReturnConnection(std::unique_ptr<HttpConnection> connection)
+{
+    std::lock_guard<std::mutex> lock(_idleMutex);
+    if (_idle.size() < _maxIdleConnections)
+    {
+        _idle.push_back(std::move(connection));
+    }
+}
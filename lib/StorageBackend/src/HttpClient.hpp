@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief HTTP/1.1 request sent by HttpClient.
+ */
+struct HttpRequest
+{
+    std::string method;                                       /**< Request method */
+    std::string target;                                       /**< Encoded path and query */
+    std::vector<std::pair<std::string, std::string>> headers; /**< Headers besides Content-Length, which is added */
+    std::string body;                                         /**< Body sent when bodyFile is empty */
+    std::filesystem::path bodyFile;                           /**< File a range of which is sent as the body, empty sends body */
+    std::uint64_t bodyOffset = 0;                             /**< Start of the range of bodyFile */
+    std::uint64_t bodyLength = 0;                             /**< Length of the range of bodyFile */
+};
+
+/**
+ * @brief HTTP/1.1 response received by HttpClient.
+ */
+struct HttpResponse
+{
+    int status = 0;                                           /**< Status code */
+    std::vector<std::pair<std::string, std::string>> headers; /**< Headers with lowercase names */
+    std::string body;                                         /**< Body, unless a successful response was streamed elsewhere */
+
+    /**
+     * @brief Look up a header.
+     *
+     * @param[in] name Lowercase header name
+     * @return Value of the first header of that name, empty if there is none
+     */
+    std::string Header(const std::string& name) const;
+};
+
+class HttpConnection;
+
+/**
+ * @brief Minimal HTTP/1.1 client of one server, reusing its connections across requests.
+ *
+ * A request takes an idle keep-alive connection, or opens one, and hands it back once the response is
+ * read. A request failing on a reused connection, which the server may have closed in the meantime, is
+ * sent once more on a new connection. Plain TCP only; there is no TLS.
+ */
+class HttpClient
+{
+  public:
+    /**
+     * @brief Create a client; no connection is opened yet.
+     *
+     * @param[in] host Server host name or address
+     * @param[in] port Server port
+     * @param[in] maxIdleConnections Idle connections kept open for reuse
+     */
+    HttpClient(const std::string& host, std::uint16_t port, std::size_t maxIdleConnections);
+    ~HttpClient();
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    /**
+     * @brief Send a request and read the response; thread-safe.
+     *
+     * @param[in] request Request to send
+     * @param[out] outputResponse Response read
+     * @param[in] successBody Stream receiving the body of a 2xx response instead of outputResponse.body, nullptr keeps it there
+     * @return true if a complete response was read, whatever its status; false on a network or protocol error
+     */
+    bool Execute(const HttpRequest& request, HttpResponse& outputResponse, std::ostream* successBody = nullptr);
+
+    /**
+     * @brief Get the number of connections opened so far.
+     *
+     * @return Connections opened since the client was created
+     */
+    std::size_t ConnectionsOpened() const;
+
+  private:
+    std::unique_ptr<HttpConnection> TakeConnection(bool& outputReused);
+    void ReturnConnection(std::unique_ptr<HttpConnection> connection);
+
+    std::string _host;
+    std::uint16_t _port;
+    std::size_t _maxIdleConnections;
+
+    mutable std::mutex _idleMutex;
+    std::vector<std::unique_ptr<HttpConnection>> _idle;
+    std::size_t _connectionsOpened;
+};
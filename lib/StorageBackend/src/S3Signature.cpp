@@ -0,0 +1,208 @@
+#include "S3Signature.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+/**
+ * @brief Round constants of SHA-256.
+ */
+constexpr std::array<std::uint32_t, 64> RoundConstants = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be,
+    0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa,
+    0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+    0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+    0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+std::uint32_t RotateRight(std::uint32_t value, unsigned int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+std::string DigestString(const Sha256Digest& digest)
+{
+    return std::string(reinterpret_cast<const char*>(digest.data()), digest.size());
+}
+}
+
+Sha256::Sha256()
+    : _state{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19}, _block{}, _blockFill(0), _length(0)
+{
+}
+
+void Sha256::Update(const void* data, std::size_t size)
+{
+    const std::uint8_t* bytes = static_cast<const std::uint8_t*>(data);
+    _length += size;
+    while (0 < size)
+    {
+        const std::size_t taken = std::min(size, _block.size() - _blockFill);
+        std::memcpy(_block.data() + _blockFill, bytes, taken);
+        _blockFill += taken;
+        bytes += taken;
+        size -= taken;
+        if (_block.size() == _blockFill)
+        {
+            Transform(_block.data());
+            _blockFill = 0;
+        }
+    }
+}
+
+Sha256Digest Sha256::Finish()
+{
+    const std::uint64_t bitLength = _length * 8;
+    const std::uint8_t padding = 0x80;
+    Update(&padding, 1);
+    const std::uint8_t zero = 0;
+    while (56 != _blockFill)
+    {
+        Update(&zero, 1);
+    }
+    std::uint8_t lengthBytes[8];
+    for (int i = 0; i < 8; ++i)
+    {
+        lengthBytes[i] = static_cast<std::uint8_t>(bitLength >> (56 - (8 * i)));
+    }
+    Update(lengthBytes, sizeof(lengthBytes));
+
+    Sha256Digest digest{};
+    for (std::size_t i = 0; i < _state.size(); ++i)
+    {
+        digest[4 * i] = static_cast<std::uint8_t>(_state[i] >> 24);
+        digest[(4 * i) + 1] = static_cast<std::uint8_t>(_state[i] >> 16);
+        digest[(4 * i) + 2] = static_cast<std::uint8_t>(_state[i] >> 8);
+        digest[(4 * i) + 3] = static_cast<std::uint8_t>(_state[i]);
+    }
+    return digest;
+}
+
+Sha256Digest Sha256::Compute(const std::string& message)
+{
+    Sha256 sha;
+    sha.Update(message.data(), message.size());
+    return sha.Finish();
+}
+
+/**
+ * @brief Compress one 64-byte block into the state.
+ *
+ * @param[in] block Block to compress
+ */
+void Sha256::Transform(const std::uint8_t* block)
+{
+    std::array<std::uint32_t, 64> schedule{};
+    for (std::size_t i = 0; i < 16; ++i)
+    {
+        schedule[i] = (static_cast<std::uint32_t>(block[4 * i]) << 24) | (static_cast<std::uint32_t>(block[(4 * i) + 1]) << 16) |
+                      (static_cast<std::uint32_t>(block[(4 * i) + 2]) << 8) | static_cast<std::uint32_t>(block[(4 * i) + 3]);
+    }
+    for (std::size_t i = 16; i < 64; ++i)
+    {
+        const std::uint32_t s0 = RotateRight(schedule[i - 15], 7) ^ RotateRight(schedule[i - 15], 18) ^ (schedule[i - 15] >> 3);
+        const std::uint32_t s1 = RotateRight(schedule[i - 2], 17) ^ RotateRight(schedule[i - 2], 19) ^ (schedule[i - 2] >> 10);
+        schedule[i] = schedule[i - 16] + s0 + schedule[i - 7] + s1;
+    }
+
+    std::array<std::uint32_t, 8> work = _state;
+    for (std::size_t i = 0; i < 64; ++i)
+    {
+        const std::uint32_t s1 = RotateRight(work[4], 6) ^ RotateRight(work[4], 11) ^ RotateRight(work[4], 25);
+        const std::uint32_t choose = (work[4] & work[5]) ^ ((~work[4]) & work[6]);
+        const std::uint32_t temp1 = work[7] + s1 + choose + RoundConstants[i] + schedule[i];
+        const std::uint32_t s0 = RotateRight(work[0], 2) ^ RotateRight(work[0], 13) ^ RotateRight(work[0], 22);
+        const std::uint32_t majority = (work[0] & work[1]) ^ (work[0] & work[2]) ^ (work[1] & work[2]);
+        const std::uint32_t temp2 = s0 + majority;
+        work[7] = work[6];
+        work[6] = work[5];
+        work[5] = work[4];
+        work[4] = work[3] + temp1;
+        work[3] = work[2];
+        work[2] = work[1];
+        work[1] = work[0];
+        work[0] = temp1 + temp2;
+    }
+    for (std::size_t i = 0; i < _state.size(); ++i)
+    {
+        _state[i] += work[i];
+    }
+}
+
+Sha256Digest HmacSha256(const std::string& key, const std::string& message)
+{
+    constexpr std::size_t BlockSize = 64;
+    std::string blockKey = (BlockSize < key.size()) ? DigestString(Sha256::Compute(key)) : key;
+    blockKey.resize(BlockSize, '\0');
+    std::string innerPad(BlockSize, '\0');
+    std::string outerPad(BlockSize, '\0');
+    for (std::size_t i = 0; i < BlockSize; ++i)
+    {
+        innerPad[i] = static_cast<char>(blockKey[i] ^ 0x36);
+        outerPad[i] = static_cast<char>(blockKey[i] ^ 0x5c);
+    }
+    return Sha256::Compute(outerPad + DigestString(Sha256::Compute(innerPad + message)));
+}
+
+std::string HexEncode(const std::uint8_t* data, std::size_t size)
+{
+    static const char Digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(2 * size);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hex += Digits[data[i] >> 4];
+        hex += Digits[data[i] & 0x0f];
+    }
+    return hex;
+}
+
+std::string UriEncode(const std::string& value, bool keepSlash)
+{
+    static const char Digits[] = "0123456789ABCDEF";
+    std::string encoded;
+    encoded.reserve(value.size());
+    for (const char character : value)
+    {
+        const unsigned char byte = static_cast<unsigned char>(character);
+        if ((('A' <= byte) && (byte <= 'Z')) || (('a' <= byte) && (byte <= 'z')) || (('0' <= byte) && (byte <= '9')) || ('-' == byte) ||
+            ('_' == byte) || ('.' == byte) || ('~' == byte) || ((true == keepSlash) && ('/' == byte)))
+        {
+            encoded += character;
+            continue;
+        }
+        encoded += '%';
+        encoded += Digits[byte >> 4];
+        encoded += Digits[byte & 0x0f];
+    }
+    return encoded;
+}
+
+std::string SignS3Request(const S3SigningInput& input, const std::string& accessKey, const std::string& secretKey, const std::string& region)
+{
+    std::vector<std::pair<std::string, std::string>> headers = input.headers;
+    std::sort(headers.begin(), headers.end());
+    std::string canonicalHeaders;
+    std::string signedHeaders;
+    for (const auto& header : headers)
+    {
+        canonicalHeaders += header.first + ":" + header.second + "\n";
+        signedHeaders += (true == signedHeaders.empty()) ? header.first : ";" + header.first;
+    }
+    const std::string canonicalRequest = input.method + "\n" + input.canonicalUri + "\n" + input.canonicalQuery + "\n" + canonicalHeaders + "\n" +
+                                         signedHeaders + "\n" + input.payloadHash;
+
+    const std::string date = input.amzDate.substr(0, 8);
+    const std::string scope = date + "/" + region + "/s3/aws4_request";
+    const Sha256Digest requestHash = Sha256::Compute(canonicalRequest);
+    const std::string stringToSign = "AWS4-HMAC-SHA256\n" + input.amzDate + "\n" + scope + "\n" + HexEncode(requestHash.data(), requestHash.size());
+
+    const Sha256Digest dateKey = HmacSha256("AWS4" + secretKey, date);
+    const Sha256Digest regionKey = HmacSha256(DigestString(dateKey), region);
+    const Sha256Digest serviceKey = HmacSha256(DigestString(regionKey), "s3");
+    const Sha256Digest signingKey = HmacSha256(DigestString(serviceKey), "aws4_request");
+    const Sha256Digest signature = HmacSha256(DigestString(signingKey), stringToSign);
+    return "AWS4-HMAC-SHA256 Credential=" + accessKey + "/" + scope + ", SignedHeaders=" + signedHeaders +
+           ", Signature=" + HexEncode(signature.data(), signature.size());
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief SHA-256 digest.
+ */
+using Sha256Digest = std::array<std::uint8_t, 32>;
+
+/**
+ * @brief Incremental SHA-256 as specified in FIPS 180-4.
+ */
+class Sha256
+{
+  public:
+    Sha256();
+
+    /**
+     * @brief Add bytes to the message.
+     *
+     * @param[in] data Bytes to add
+     * @param[in] size Number of bytes
+     */
+    void Update(const void* data, std::size_t size);
+
+    /**
+     * @brief Finish the message and get its digest; the object must not be updated afterwards.
+     *
+     * @return Digest of everything added
+     */
+    Sha256Digest Finish();
+
+    /**
+     * @brief Hash a whole message at once.
+     *
+     * @param[in] message Message to hash
+     * @return Digest of the message
+     */
+    static Sha256Digest Compute(const std::string& message);
+
+  private:
+    void Transform(const std::uint8_t* block);
+
+    std::array<std::uint32_t, 8> _state;
+    std::array<std::uint8_t, 64> _block;
+    std::size_t _blockFill;
+    std::uint64_t _length;
+};
+
+/**
+ * @brief Compute an HMAC-SHA256 as specified in RFC 2104.
+ *
+ * @param[in] key Key bytes
+ * @param[in] message Message to authenticate
+ * @return Authentication code
+ */
+Sha256Digest HmacSha256(const std::string& key, const std::string& message);
+
+/**
+ * @brief Format bytes as lowercase hexadecimal.
+ *
+ * @param[in] data Bytes to format
+ * @param[in] size Number of bytes
+ * @return Two hex digits per byte
+ */
+std::string HexEncode(const std::uint8_t* data, std::size_t size);
+
+/**
+ * @brief Percent-encode everything but the unreserved characters of RFC 3986, as AWS Signature Version 4 expects.
+ *
+ * @param[in] value Text to encode
+ * @param[in] keepSlash Leave `/` unencoded, for object paths
+ * @return Encoded text
+ */
+std::string UriEncode(const std::string& value, bool keepSlash);
+
+/**
+ * @brief Request fields covered by an AWS Signature Version 4.
+ */
+struct S3SigningInput
+{
+    std::string method;                                       /**< HTTP method */
+    std::string canonicalUri;                                 /**< Encoded path, as sent */
+    std::string canonicalQuery;                               /**< Encoded query parameters sorted by name, as sent */
+    std::vector<std::pair<std::string, std::string>> headers; /**< Signed headers with lowercase names */
+    std::string payloadHash;                                  /**< Value of x-amz-content-sha256 */
+    std::string amzDate;                                      /**< Request time as `YYYYMMDDTHHMMSSZ` */
+};
+
+/**
+ * @brief Build the Authorization header value of an S3 request signed with AWS Signature Version 4.
+ *
+ * @param[in] input Request to sign
+ * @param[in] accessKey Access key id
+ * @param[in] secretKey Secret access key
+ * @param[in] region Region the request is scoped to
+ * @return Header value starting with `AWS4-HMAC-SHA256`
+ */
+std::string SignS3Request(const S3SigningInput& input, const std::string& accessKey, const std::string& secretKey, const std::string& region);
@@ -0,0 +1,641 @@
+#include "StorageBackend/S3StorageBackend.hpp"
+
+#include "HttpClient.hpp"
+#include "S3Signature.hpp"
+#include "TaskPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+namespace
+{
+/**
+ * @brief Attempts of a request before a network error or a server error is final.
+ */
+constexpr int MaxAttempts = 4;
+
+/**
+ * @brief Pause before the second attempt of a request, doubled before each further one.
+ */
+constexpr std::chrono::milliseconds RetryPause{200};
+
+/**
+ * @brief Smallest part the protocol accepts, except for the last part of an upload.
+ */
+constexpr std::uint64_t MinPartSize = 5 * 1024 * 1024;
+
+/**
+ * @brief Most parts of one multipart upload.
+ */
+constexpr std::uint64_t MaxParts = 10000;
+
+/**
+ * @brief Largest object a single copy request can copy.
+ */
+constexpr std::uint64_t MaxCopySize = 5ULL * 1024 * 1024 * 1024;
+
+/**
+ * @brief Part size of a copy in parts.
+ */
+constexpr std::uint64_t CopyPartSize = 1024 * 1024 * 1024;
+
+/**
+ * @brief Payload hash of requests whose file body is not hashed before it is sent.
+ */
+constexpr const char* UnsignedPayload = "UNSIGNED-PAYLOAD";
+
+/**
+ * @brief Format the current time as `YYYYMMDDTHHMMSSZ`.
+ */
+std::string AmzDate()
+{
+    const std::time_t now = std::time(nullptr);
+    std::tm timeStruct{};
+#ifdef _WIN32
+    gmtime_s(&timeStruct, &now);
+#else
+    gmtime_r(&now, &timeStruct);
+#endif
+    char buffer[17];
+    std::strftime(buffer, sizeof(buffer), "%Y%m%dT%H%M%SZ", &timeStruct);
+    return buffer;
+}
+
+std::string XmlEscape(const std::string& text)
+{
+    std::string escaped;
+    for (const char character : text)
+    {
+        switch (character)
+        {
+        case '&':
+            escaped += "&amp;";
+            break;
+        case '<':
+            escaped += "&lt;";
+            break;
+        case '>':
+            escaped += "&gt;";
+            break;
+        case '"':
+            escaped += "&quot;";
+            break;
+        default:
+            escaped += character;
+        }
+    }
+    return escaped;
+}
+
+std::string XmlUnescape(const std::string& text)
+{
+    static const std::pair<const char*, char> Entities[] = {{"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+    std::string unescaped;
+    for (std::size_t i = 0; i < text.size();)
+    {
+        bool replaced = false;
+        for (const auto& entity : Entities)
+        {
+            if (0 == text.compare(i, std::char_traits<char>::length(entity.first), entity.first))
+            {
+                unescaped += entity.second;
+                i += std::char_traits<char>::length(entity.first);
+                replaced = true;
+                break;
+            }
+        }
+        if (false == replaced)
+        {
+            unescaped += text[i++];
+        }
+    }
+    return unescaped;
+}
+
+/**
+ * @brief Find the text of the next element with a tag.
+ *
+ * @param[in] xml Document to search
+ * @param[in] tag Element name
+ * @param[in,out] position Where to start; moved past the element when it is found
+ * @param[out] outputText Unescaped text of the element
+ * @return true if an element was found
+ */
+bool NextElement(const std::string& xml, const std::string& tag, std::string::size_type& position, std::string& outputText)
+{
+    const std::string open = "<" + tag + ">";
+    const std::string close = "</" + tag + ">";
+    const std::string::size_type start = xml.find(open, position);
+    if (std::string::npos == start)
+    {
+        return false;
+    }
+    const std::string::size_type end = xml.find(close, start + open.size());
+    if (std::string::npos == end)
+    {
+        return false;
+    }
+    outputText = XmlUnescape(xml.substr(start + open.size(), end - start - open.size()));
+    position = end + close.size();
+    return true;
+}
+
+std::string ElementText(const std::string& xml, const std::string& tag)
+{
+    std::string::size_type position = 0;
+    std::string text;
+    NextElement(xml, tag, position, text);
+    return text;
+}
+
+/**
+ * @brief Check a response for success; copy and multipart completion report some errors in a 200 body.
+ */
+bool Succeeded(const HttpResponse& response)
+{
+    return (200 <= response.status) && (response.status < 300) && (std::string::npos == response.body.find("<Error>"));
+}
+}
+
+S3StorageBackend::S3StorageBackend(const S3Options& options) : _options(options)
+{
+    const std::string scheme = "http://";
+    if (0 != _options.endpoint.compare(0, scheme.size(), scheme))
+    {
+        throw std::invalid_argument("S3 endpoint must be an http:// address: " + _options.endpoint);
+    }
+    if (true == _options.bucket.empty())
+    {
+        throw std::invalid_argument("S3 bucket is empty");
+    }
+    _hostHeader = _options.endpoint.substr(scheme.size());
+    _hostHeader = _hostHeader.substr(0, _hostHeader.find('/'));
+    // "host", "host:port", "[v6]" or "[v6]:port"
+    const std::string::size_type bracket = _hostHeader.rfind(']');
+    const std::string::size_type colon = _hostHeader.rfind(':');
+    const bool hasPort = (std::string::npos != colon) && ((std::string::npos == bracket) || (bracket < colon));
+    _host = (true == hasPort) ? _hostHeader.substr(0, colon) : _hostHeader;
+    if ((false == _host.empty()) && ('[' == _host.front()) && (']' == _host.back()))
+    {
+        _host = _host.substr(1, _host.size() - 2);
+    }
+    const unsigned long port = (true == hasPort) ? std::strtoul(_hostHeader.c_str() + colon + 1, nullptr, 10) : 80;
+    if ((true == _host.empty()) || (0 == port) || (65535 < port))
+    {
+        throw std::invalid_argument("S3 endpoint has no valid host and port: " + _options.endpoint);
+    }
+    _options.connections = std::max(1U, _options.connections);
+    _options.partSize = std::max(MinPartSize, _options.partSize);
+    _client = std::make_unique<HttpClient>(_host, static_cast<std::uint16_t>(port), _options.connections);
+    _pool = std::make_unique<TaskPool>(_options.connections);
+}
+
+// Declared here, where the pool and the client are complete; the pool goes first since its tasks use the client.
+S3StorageBackend::~S3StorageBackend() = default;
+
+bool S3StorageBackend::Put(const std::filesystem::path& source, const std::string& key)
+{
+    std::error_code ec;
+    const std::uintmax_t size = std::filesystem::file_size(source, ec);
+    if (0 != ec.value())
+    {
+        return false;
+    }
+    if (_options.partSize < size)
+    {
+        return PutInParts(source, key, size);
+    }
+    HttpResponse response;
+    return (true == Send(S3Request{"PUT", key, {}, {}, std::string(), source, 0, size}, response)) && (200 == response.status);
+}
+
+bool S3StorageBackend::Get(const std::string& key, const std::filesystem::path& destination)
+{
+    bool received = false;
+    {
+        std::ofstream output(destination, std::ios::binary | std::ios::trunc);
+        HttpResponse response;
+        received = (true == static_cast<bool>(output)) && (true == Send(S3Request{"GET", key, {}, {}, std::string(), {}, 0, 0}, response, &output)) &&
+                   (200 == response.status) && (true == static_cast<bool>(output.flush()));
+    }
+    if (false == received)
+    {
+        std::error_code ec;
+        std::filesystem::remove(destination, ec);
+    }
+    return received;
+}
+
+bool S3StorageBackend::Rename(const std::string& fromKey, const std::string& toKey)
+{
+    int status = 0;
+    std::uint64_t size = 0;
+    if ((false == Head(fromKey, status, size)) || (200 != status))
+    {
+        return false;
+    }
+    bool copied = false;
+    if (MaxCopySize < size)
+    {
+        copied = CopyInParts(fromKey, toKey, size);
+    }
+    else
+    {
+        HttpResponse response;
+        const std::string copySource = "/" + _options.bucket + "/" + UriEncode(_options.prefix + fromKey, true);
+        copied = (true == Send(S3Request{"PUT", toKey, {}, {{"x-amz-copy-source", copySource}}, std::string(), {}, 0, 0}, response)) &&
+                 (true == Succeeded(response));
+    }
+    return (true == copied) && (true == Remove(fromKey));
+}
+
+bool S3StorageBackend::List(const std::string& prefix, std::vector<std::string>& outputKeys)
+{
+    outputKeys.clear();
+    std::string continuationToken;
+    bool truncated = false;
+    do
+    {
+        S3Request request{"GET", std::string(), {{"list-type", "2"}, {"prefix", _options.prefix + prefix}}, {}, std::string(), {}, 0, 0};
+        if (false == continuationToken.empty())
+        {
+            request.query.emplace_back("continuation-token", continuationToken);
+        }
+        HttpResponse response;
+        if ((false == Send(request, response)) || (200 != response.status))
+        {
+            return false;
+        }
+        std::string::size_type position = 0;
+        std::string key;
+        while (true == NextElement(response.body, "Key", position, key))
+        {
+            outputKeys.push_back(key.substr(std::min(key.size(), _options.prefix.size())));
+        }
+        truncated = ("true" == ElementText(response.body, "IsTruncated"));
+        continuationToken = ElementText(response.body, "NextContinuationToken");
+    } while ((true == truncated) && (false == continuationToken.empty()));
+    std::sort(outputKeys.begin(), outputKeys.end());
+    return true;
+}
+
+bool S3StorageBackend::Remove(const std::string& key)
+{
+    HttpResponse response;
+    return (true == Send(S3Request{"DELETE", key, {}, {}, std::string(), {}, 0, 0}, response)) &&
+           ((200 == response.status) || (204 == response.status) || (404 == response.status));
+}
+
+bool S3StorageBackend::Exists(const std::string& key, bool& outputExists)
+{
+    int status = 0;
+    std::uint64_t size = 0;
+    if ((false == Head(key, status, size)) || ((200 != status) && (404 != status)))
+    {
+        return false;
+    }
+    outputExists = (200 == status);
+    return true;
+}
+
+std::future<bool> S3StorageBackend::PutBatch(std::vector<StoragePut> puts)
+{
+    std::vector<std::function<bool()>> operations;
+    for (auto& put : puts)
+    {
+        operations.push_back([this, put = std::move(put)]() { return Put(put.source, put.key); });
+    }
+    return RunBatch(std::move(operations));
+}
+
+std::future<bool> S3StorageBackend::RenameBatch(std::vector<StorageRename> renames)
+{
+    std::vector<std::function<bool()>> operations;
+    for (auto& rename : renames)
+    {
+        operations.push_back([this, rename = std::move(rename)]() { return Rename(rename.fromKey, rename.toKey); });
+    }
+    return RunBatch(std::move(operations));
+}
+
+std::future<bool> S3StorageBackend::RemoveBatch(std::vector<std::string> keys)
+{
+    std::vector<std::function<bool()>> operations;
+    for (auto& key : keys)
+    {
+        operations.push_back([this, key = std::move(key)]() { return Remove(key); });
+    }
+    return RunBatch(std::move(operations));
+}
+
+std::size_t S3StorageBackend::ConnectionsOpened() const
+{
+    return _client->ConnectionsOpened();
+}
+
+/**
+ * @brief Sign and send a request, retrying network errors and server errors.
+ *
+ * @param[in] request Request to send
+ * @param[out] outputResponse Last response received
+ * @param[in] successBody Stream receiving the body of a 2xx response, rewound before every attempt; nullptr keeps it in the response
+ * @return true if a response was received, whatever its status; false on a network error
+ */
+bool S3StorageBackend::Send(const S3Request& request, HttpResponse& outputResponse, std::ostream* successBody)
+{
+    std::vector<std::pair<std::string, std::string>> query = request.query;
+    std::sort(query.begin(), query.end());
+    std::string canonicalQuery;
+    for (const auto& parameter : query)
+    {
+        canonicalQuery += (true == canonicalQuery.empty()) ? "" : "&";
+        canonicalQuery += UriEncode(parameter.first, false) + "=" + UriEncode(parameter.second, false);
+    }
+    std::string canonicalUri = "/" + UriEncode(_options.bucket, false);
+    if (false == request.key.empty())
+    {
+        canonicalUri += "/" + UriEncode(_options.prefix + request.key, true);
+    }
+    const bool fileBody = (false == request.bodyFile.empty());
+    std::string payloadHash = UnsignedPayload;
+    if (false == fileBody)
+    {
+        const Sha256Digest bodyHash = Sha256::Compute(request.body);
+        payloadHash = HexEncode(bodyHash.data(), bodyHash.size());
+    }
+
+    bool received = false;
+    for (int attempt = 0; attempt < MaxAttempts; ++attempt)
+    {
+        if (0 < attempt)
+        {
+            std::this_thread::sleep_for(RetryPause * (1 << (attempt - 1)));
+        }
+        S3SigningInput signing{request.method, canonicalUri, canonicalQuery, request.headers, payloadHash, AmzDate()};
+        signing.headers.emplace_back("host", _hostHeader);
+        signing.headers.emplace_back("x-amz-content-sha256", payloadHash);
+        signing.headers.emplace_back("x-amz-date", signing.amzDate);
+        if (false == _options.sessionToken.empty())
+        {
+            signing.headers.emplace_back("x-amz-security-token", _options.sessionToken);
+        }
+
+        HttpRequest http;
+        http.method = request.method;
+        http.target = (true == canonicalQuery.empty()) ? canonicalUri : canonicalUri + "?" + canonicalQuery;
+        http.headers = signing.headers;
+        http.headers.emplace_back("authorization", SignS3Request(signing, _options.accessKey, _options.secretKey, _options.region));
+        if (true == fileBody)
+        {
+            http.bodyFile = request.bodyFile;
+            http.bodyOffset = request.bodyOffset;
+            http.bodyLength = request.bodyLength;
+        }
+        else
+        {
+            http.body = request.body;
+        }
+        if (nullptr != successBody)
+        {
+            successBody->clear();
+            successBody->seekp(0);
+        }
+        received = _client->Execute(http, outputResponse, successBody);
+        // 503 is also how the store asks clients to slow down.
+        if ((true == received) && (outputResponse.status < 500))
+        {
+            return true;
+        }
+    }
+    return received;
+}
+
+/**
+ * @brief Look up an object's size.
+ *
+ * @param[in] key Key of the object
+ * @param[out] outputStatus Status of the response, 200 if the object exists and 404 if not
+ * @param[out] outputSize Size of an existing object
+ * @return true if a response was received, false on a network error
+ */
+bool S3StorageBackend::Head(const std::string& key, int& outputStatus, std::uint64_t& outputSize)
+{
+    HttpResponse response;
+    if (false == Send(S3Request{"HEAD", key, {}, {}, std::string(), {}, 0, 0}, response))
+    {
+        return false;
+    }
+    outputStatus = response.status;
+    outputSize = std::strtoull(response.Header("content-length").c_str(), nullptr, 10);
+    return true;
+}
+
+/**
+ * @brief Upload a large file as a multipart upload whose parts go out side by side.
+ *
+ * Called on a pool thread, as by a batch, the parts are uploaded one after another, since waiting there
+ * for other tasks of the pool could wait forever.
+ *
+ * @param[in] source Local file to store
+ * @param[in] key Key to store it under
+ * @param[in] size Size of the file in bytes
+ * @return true on success, false on error, after which the upload is aborted
+ */
+bool S3StorageBackend::PutInParts(const std::filesystem::path& source, const std::string& key, std::uint64_t size)
+{
+    const std::uint64_t partSize = std::max(_options.partSize, (size + MaxParts - 1) / MaxParts);
+    const std::size_t partCount = static_cast<std::size_t>((size + partSize - 1) / partSize);
+    std::string uploadId;
+    if (false == StartMultipart(key, uploadId))
+    {
+        return false;
+    }
+
+    std::vector<std::string> etags(partCount);
+    const auto uploadPart = [&](std::size_t index)
+    {
+        const std::uint64_t offset = index * partSize;
+        const S3Request request{"PUT", key, {{"partNumber", std::to_string(index + 1)}, {"uploadId", uploadId}}, {}, std::string(), source, offset,
+                                std::min(partSize, size - offset)};
+        HttpResponse response;
+        if ((false == Send(request, response)) || (200 != response.status))
+        {
+            return false;
+        }
+        etags[index] = response.Header("etag");
+        return false == etags[index].empty();
+    };
+
+    bool uploaded = true;
+    if (true == TaskPool::OnPoolThread())
+    {
+        for (std::size_t index = 0; (index < partCount) && (true == uploaded); ++index)
+        {
+            uploaded = uploadPart(index);
+        }
+    }
+    else
+    {
+        std::vector<std::future<bool>> parts;
+        for (std::size_t index = 0; index < partCount; ++index)
+        {
+            auto part = std::make_shared<std::promise<bool>>();
+            parts.push_back(part->get_future());
+            _pool->Submit([part, &uploadPart, index]() { part->set_value(uploadPart(index)); });
+        }
+        for (auto& part : parts)
+        {
+            uploaded = (true == part.get()) && (true == uploaded);
+        }
+    }
+    if ((true == uploaded) && (true == CompleteMultipart(key, uploadId, etags)))
+    {
+        return true;
+    }
+    AbortMultipart(key, uploadId);
+    return false;
+}
+
+/**
+ * @brief Copy an object too large for one copy request in parts, on the server.
+ *
+ * No data passes through the client, so the parts are copied one after another.
+ *
+ * @param[in] fromKey Key of the object to copy
+ * @param[in] toKey Key of the copy
+ * @param[in] size Size of the object in bytes
+ * @return true on success, false on error, after which the upload is aborted
+ */
+bool S3StorageBackend::CopyInParts(const std::string& fromKey, const std::string& toKey, std::uint64_t size)
+{
+    std::string uploadId;
+    if (false == StartMultipart(toKey, uploadId))
+    {
+        return false;
+    }
+    const std::string copySource = "/" + _options.bucket + "/" + UriEncode(_options.prefix + fromKey, true);
+    std::vector<std::string> etags;
+    for (std::uint64_t offset = 0; offset < size; offset += CopyPartSize)
+    {
+        const std::uint64_t last = std::min(size, offset + CopyPartSize) - 1;
+        const S3Request request{"PUT",
+                                toKey,
+                                {{"partNumber", std::to_string(etags.size() + 1)}, {"uploadId", uploadId}},
+                                {{"x-amz-copy-source", copySource}, {"x-amz-copy-source-range", "bytes=" + std::to_string(offset) + "-" + std::to_string(last)}},
+                                std::string(),
+                                {},
+                                0,
+                                0};
+        HttpResponse response;
+        if ((false == Send(request, response)) || (false == Succeeded(response)) || (true == ElementText(response.body, "ETag").empty()))
+        {
+            AbortMultipart(toKey, uploadId);
+            return false;
+        }
+        etags.push_back(ElementText(response.body, "ETag"));
+    }
+    if (true == CompleteMultipart(toKey, uploadId, etags))
+    {
+        return true;
+    }
+    AbortMultipart(toKey, uploadId);
+    return false;
+}
+
+/**
+ * @brief Start a multipart upload.
+ *
+ * @param[in] key Key the upload is stored under once complete
+ * @param[out] outputUploadId Id of the upload
+ * @return true on success, false on error
+ */
+bool S3StorageBackend::StartMultipart(const std::string& key, std::string& outputUploadId)
+{
+    HttpResponse response;
+    if ((false == Send(S3Request{"POST", key, {{"uploads", ""}}, {}, std::string(), {}, 0, 0}, response)) || (200 != response.status))
+    {
+        return false;
+    }
+    outputUploadId = ElementText(response.body, "UploadId");
+    return false == outputUploadId.empty();
+}
+
+/**
+ * @brief Assemble the uploaded parts into the object.
+ *
+ * @param[in] key Key of the upload
+ * @param[in] uploadId Id of the upload
+ * @param[in] etags ETag of each part, in part order
+ * @return true on success, false on error
+ */
+bool S3StorageBackend::CompleteMultipart(const std::string& key, const std::string& uploadId, const std::vector<std::string>& etags)
+{
+    std::string body = "<CompleteMultipartUpload>";
+    for (std::size_t index = 0; index < etags.size(); ++index)
+    {
+        body += "<Part><PartNumber>" + std::to_string(index + 1) + "</PartNumber><ETag>" + XmlEscape(etags[index]) + "</ETag></Part>";
+    }
+    body += "</CompleteMultipartUpload>";
+    HttpResponse response;
+    return (true == Send(S3Request{"POST", key, {{"uploadId", uploadId}}, {}, body, {}, 0, 0}, response)) && (true == Succeeded(response));
+}
+
+/**
+ * @brief Abort a multipart upload, so the store drops its parts; errors are ignored.
+ *
+ * @param[in] key Key of the upload
+ * @param[in] uploadId Id of the upload
+ */
+void S3StorageBackend::AbortMultipart(const std::string& key, const std::string& uploadId)
+{
+    HttpResponse response;
+    Send(S3Request{"DELETE", key, {{"uploadId", uploadId}}, {}, std::string(), {}, 0, 0}, response);
+}
+
+/**
+ * @brief Run operations on the pool.
+ *
+ * @param[in] operations Operations returning false on error
+ * @return Becomes true once every operation succeeded, false once all finished and any failed
+ */
+std::future<bool> S3StorageBackend::RunBatch(std::vector<std::function<bool()>> operations)
+{
+    struct BatchState
+    {
+        std::atomic<std::size_t> remaining;
+        std::atomic<bool> succeeded;
+        std::promise<bool> done;
+    };
+    auto state = std::make_shared<BatchState>();
+    state->remaining.store(operations.size());
+    state->succeeded.store(true);
+    std::future<bool> result = state->done.get_future();
+    if (true == operations.empty())
+    {
+        state->done.set_value(true);
+        return result;
+    }
+    for (auto& operation : operations)
+    {
+        _pool->Submit(
+            [state, operation = std::move(operation)]()
+            {
+                if (false == operation())
+                {
+                    state->succeeded.store(false);
+                }
+                if (1 == state->remaining.fetch_sub(1))
+                {
+                    state->done.set_value(state->succeeded.load());
+                }
+            });
+    }
+    return result;
+}
@@ -0,0 +1,45 @@
+#include "StorageBackend/StorageBackend.hpp"
+
+#include <utility>
+
+std::future<bool> StorageBackend::PutBatch(std::vector<StoragePut> puts)
+{
+    return std::async(std::launch::deferred,
+                      [this, puts = std::move(puts)]()
+                      {
+                          bool stored = true;
+                          for (const auto& put : puts)
+                          {
+                              stored = (true == Put(put.source, put.key)) && (true == stored);
+                          }
+                          return stored;
+                      });
+}
+
+std::future<bool> StorageBackend::RenameBatch(std::vector<StorageRename> renames)
+{
+    return std::async(std::launch::deferred,
+                      [this, renames = std::move(renames)]()
+                      {
+                          bool renamed = true;
+                          for (const auto& rename : renames)
+                          {
+                              renamed = (true == Rename(rename.fromKey, rename.toKey)) && (true == renamed);
+                          }
+                          return renamed;
+                      });
+}
+
+std::future<bool> StorageBackend::RemoveBatch(std::vector<std::string> keys)
+{
+    return std::async(std::launch::deferred,
+                      [this, keys = std::move(keys)]()
+                      {
+                          bool removed = true;
+                          for (const auto& key : keys)
+                          {
+                              removed = (true == Remove(key)) && (true == removed);
+                          }
+                          return removed;
+                      });
+}
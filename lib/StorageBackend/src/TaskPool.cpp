@@ -0,0 +1,67 @@
+#include "TaskPool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+thread_local bool t_onPoolThread = false;
+}
+
+TaskPool::TaskPool(unsigned int threadCount) : _stopping(false)
+{
+    for (unsigned int i = 0; i < std::max(1U, threadCount); ++i)
+    {
+        _threads.emplace_back([this]() { Run(); });
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _tasksCv.notify_all();
+    for (auto& thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+void TaskPool::Submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(std::move(task));
+    }
+    _tasksCv.notify_one();
+}
+
+bool TaskPool::OnPoolThread()
+{
+    return t_onPoolThread;
+}
+
+/**
+ * @brief Thread loop: run tasks until the pool stops and the queue is empty.
+ */
+void TaskPool::Run()
+{
+    t_onPoolThread = true;
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _tasksCv.wait(lock, [this]() { return (true == _stopping) || (false == _tasks.empty()); });
+            if (true == _tasks.empty())
+            {
+                return;
+            }
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+        task();
+    }
+}
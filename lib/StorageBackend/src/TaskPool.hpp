@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed set of threads running submitted tasks in submission order.
+ */
+class TaskPool
+{
+  public:
+    /**
+     * @brief Start the threads.
+     *
+     * @param[in] threadCount Threads running tasks, 0 uses one
+     */
+    explicit TaskPool(unsigned int threadCount);
+
+    /**
+     * @brief Run the tasks still queued, then join the threads.
+     */
+    ~TaskPool();
+
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    /**
+     * @brief Queue a task; thread-safe.
+     *
+     * @param[in] task Task to run on one of the threads
+     */
+    void Submit(std::function<void()> task);
+
+    /**
+     * @brief Check whether the calling thread belongs to any task pool.
+     *
+     * A task must not wait for other tasks of its pool, which may be queued behind it.
+     *
+     * @return true on a pool thread
+     */
+    static bool OnPoolThread();
+
+  private:
+    void Run();
+
+    std::mutex _mutex;
+    std::condition_variable _tasksCv;
+    std::deque<std::function<void()>> _tasks;
+    bool _stopping;
+    std::vector<std::thread> _threads;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Infrastructure component owning one connected TCP socket.
+ *
+ * Sends and receives block. One thread may send while another receives; Shutdown may be called from
+ * any thread to wake both. Nagle's algorithm is off, since every caller writes whole messages.
+ */
+class TcpSocket
+{
+  public:
+    /**
+     * @brief Create a closed socket.
+     */
+    TcpSocket();
+    ~TcpSocket();
+
+    TcpSocket(const TcpSocket&) = delete;
+    TcpSocket& operator=(const TcpSocket&) = delete;
+    TcpSocket(TcpSocket&& other) noexcept;
+    TcpSocket& operator=(TcpSocket&& other) noexcept;
+
+    /**
+     * @brief Connect to a server, trying each of its addresses in turn.
+     *
+     * @param[in] host Host name or address
+     * @param[in] port Port
+     * @param[in] timeoutSeconds Longest a send or receive may block before it fails, 0 blocks without limit
+     * @return Connected socket, closed if no address accepted the connection
+     */
+    static TcpSocket Connect(const std::string& host, std::uint16_t port, unsigned int timeoutSeconds);
+
+    /**
+     * @brief Check whether the socket is connected.
+     *
+     * @return true while a connection is held
+     */
+    bool IsOpen() const;
+
+    /**
+     * @brief Send every byte of a buffer.
+     *
+     * @param[in] data Bytes to send
+     * @param[in] size Number of bytes
+     * @return true on success, false once the connection failed
+     */
+    bool SendAll(const void* data, std::size_t size);
+
+    /**
+     * @brief Receive whatever is available, waiting for at least one byte.
+     *
+     * @param[out] buffer Receives the bytes
+     * @param[in] capacity Size of buffer
+     * @return Number of bytes received, 0 once the peer closed the connection or it failed
+     */
+    std::size_t ReceiveSome(void* buffer, std::size_t capacity);
+
+    /**
+     * @brief Receive exactly a number of bytes.
+     *
+     * @param[out] buffer Receives the bytes
+     * @param[in] size Number of bytes
+     * @return true on success, false if the connection ended first
+     */
+    bool ReceiveAll(void* buffer, std::size_t size);
+
+    /**
+     * @brief Stop both directions, waking threads blocked in a send or receive; thread-safe.
+     */
+    void Shutdown();
+
+  private:
+    friend class TcpListener;
+
+    explicit TcpSocket(std::intptr_t handle);
+    void Close();
+
+    std::intptr_t _handle;
+};
+
+/**
+ * @brief Infrastructure component accepting TCP connections on one address.
+ */
+class TcpListener
+{
+  public:
+    /**
+     * @brief Create a listener that is not listening yet.
+     */
+    TcpListener();
+    ~TcpListener();
+
+    TcpListener(const TcpListener&) = delete;
+    TcpListener& operator=(const TcpListener&) = delete;
+
+    /**
+     * @brief Bind to an address and start listening.
+     *
+     * @param[in] address Local address to bind, such as `0.0.0.0` or `127.0.0.1`
+     * @param[in] port Port, 0 picks a free one
+     * @return true on success, false on error
+     */
+    bool Listen(const std::string& address, std::uint16_t port);
+
+    /**
+     * @brief Get the port the listener is bound to, useful after listening on port 0.
+     *
+     * @return Bound port, 0 when not listening
+     */
+    std::uint16_t Port() const;
+
+    /**
+     * @brief Wait for the next connection.
+     *
+     * @param[in] timeoutSeconds Longest a send or receive on the accepted socket may block, 0 blocks without limit
+     * @return Accepted socket, closed once the listener was closed or failed
+     */
+    TcpSocket Accept(unsigned int timeoutSeconds);
+
+    /**
+     * @brief Stop accepting connections, waking a thread blocked in Accept within a fraction of a second; thread-safe.
+     */
+    void Close();
+
+  private:
+    std::intptr_t _handle;
+    std::uint16_t _port;
+    std::atomic<bool> _closed;
+};
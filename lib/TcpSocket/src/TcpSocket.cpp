@@ -0,0 +1,328 @@
+#include "TcpSocket/TcpSocket.hpp"
+
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef _WIN32
+using SocketHandle = SOCKET;
+const std::intptr_t InvalidHandle = static_cast<std::intptr_t>(INVALID_SOCKET);
+const int ShutdownBoth = SD_BOTH;
+#else
+using SocketHandle = int;
+const std::intptr_t InvalidHandle = -1;
+const int ShutdownBoth = SHUT_RDWR;
+#endif
+
+/**
+ * @brief Largest number of bytes handed to a single send or recv call.
+ */
+constexpr std::size_t MaxTransferSize = 1 << 30;
+
+/**
+ * @brief Time Accept waits for a connection before it checks again whether the listener was closed.
+ */
+constexpr long AcceptPollMicroseconds = 200 * 1000;
+
+SocketHandle Native(std::intptr_t handle)
+{
+    return static_cast<SocketHandle>(handle);
+}
+
+/**
+ * @brief Start Winsock once per process; a no-op elsewhere.
+ *
+ * @return true if sockets can be used
+ */
+bool StartNetworking()
+{
+#ifdef _WIN32
+    static const bool started = []()
+    {
+        WSADATA data;
+        return 0 == WSAStartup(MAKEWORD(2, 2), &data);
+    }();
+    return started;
+#else
+    return true;
+#endif
+}
+
+void CloseHandle(std::intptr_t handle)
+{
+#ifdef _WIN32
+    closesocket(Native(handle));
+#else
+    close(Native(handle));
+#endif
+}
+
+/**
+ * @brief Set the options every connected socket gets: no Nagle delay, keepalive probes and the send and receive timeouts.
+ *
+ * @param[in] handle Connected socket
+ * @param[in] timeoutSeconds Longest a send or receive may block, 0 for no limit
+ */
+void ConfigureConnection(std::intptr_t handle, unsigned int timeoutSeconds)
+{
+    const int enabled = 1;
+    setsockopt(Native(handle), IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&enabled), sizeof(enabled));
+    setsockopt(Native(handle), SOL_SOCKET, SO_KEEPALIVE, reinterpret_cast<const char*>(&enabled), sizeof(enabled));
+    if (0 == timeoutSeconds)
+    {
+        return;
+    }
+#ifdef _WIN32
+    const DWORD timeout = static_cast<DWORD>(timeoutSeconds) * 1000;
+#else
+    timeval timeout{};
+    timeout.tv_sec = static_cast<decltype(timeout.tv_sec)>(timeoutSeconds);
+#endif
+    setsockopt(Native(handle), SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+    setsockopt(Native(handle), SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+}
+}
+
+TcpSocket::TcpSocket() : _handle(InvalidHandle)
+{
+}
+
+TcpSocket::TcpSocket(std::intptr_t handle) : _handle(handle)
+{
+}
+
+TcpSocket::~TcpSocket()
+{
+    Close();
+}
+
+TcpSocket::TcpSocket(TcpSocket&& other) noexcept : _handle(std::exchange(other._handle, InvalidHandle))
+{
+}
+
+TcpSocket& TcpSocket::operator=(TcpSocket&& other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        _handle = std::exchange(other._handle, InvalidHandle);
+    }
+    return *this;
+}
+
+TcpSocket TcpSocket::Connect(const std::string& host, std::uint16_t port, unsigned int timeoutSeconds)
+{
+    if (false == StartNetworking())
+    {
+        return TcpSocket();
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (0 != getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses))
+    {
+        return TcpSocket();
+    }
+    std::intptr_t handle = InvalidHandle;
+    for (addrinfo* address = addresses; (nullptr != address) && (InvalidHandle == handle); address = address->ai_next)
+    {
+        handle = static_cast<std::intptr_t>(socket(address->ai_family, address->ai_socktype, address->ai_protocol));
+        if ((InvalidHandle != handle) && (0 != connect(Native(handle), address->ai_addr, static_cast<int>(address->ai_addrlen))))
+        {
+            CloseHandle(handle);
+            handle = InvalidHandle;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (InvalidHandle == handle)
+    {
+        return TcpSocket();
+    }
+    ConfigureConnection(handle, timeoutSeconds);
+    return TcpSocket(handle);
+}
+
+bool TcpSocket::IsOpen() const
+{
+    return InvalidHandle != _handle;
+}
+
+bool TcpSocket::SendAll(const void* data, std::size_t size)
+{
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    const char* bytes = static_cast<const char*>(data);
+    while (0 < size)
+    {
+        const int chunk = static_cast<int>(std::min(size, MaxTransferSize));
+        const auto sent = send(Native(_handle), bytes, chunk, flags);
+        if (sent <= 0)
+        {
+            return false;
+        }
+        bytes += sent;
+        size -= static_cast<std::size_t>(sent);
+    }
+    return true;
+}
+
+std::size_t TcpSocket::ReceiveSome(void* buffer, std::size_t capacity)
+{
+    const int chunk = static_cast<int>(std::min(capacity, MaxTransferSize));
+    const auto received = recv(Native(_handle), static_cast<char*>(buffer), chunk, 0);
+    return (0 < received) ? static_cast<std::size_t>(received) : 0;
+}
+
+bool TcpSocket::ReceiveAll(void* buffer, std::size_t size)
+{
+    char* bytes = static_cast<char*>(buffer);
+    while (0 < size)
+    {
+        const std::size_t received = ReceiveSome(bytes, size);
+        if (0 == received)
+        {
+            return false;
+        }
+        bytes += received;
+        size -= received;
+    }
+    return true;
+}
+
+void TcpSocket::Shutdown()
+{
+    if (InvalidHandle != _handle)
+    {
+        shutdown(Native(_handle), ShutdownBoth);
+    }
+}
+
+void TcpSocket::Close()
+{
+    if (InvalidHandle != _handle)
+    {
+        CloseHandle(_handle);
+        _handle = InvalidHandle;
+    }
+}
+
+TcpListener::TcpListener() : _handle(InvalidHandle), _port(0), _closed(false)
+{
+}
+
+TcpListener::~TcpListener()
+{
+    if (InvalidHandle != _handle)
+    {
+        CloseHandle(_handle);
+    }
+}
+
+bool TcpListener::Listen(const std::string& address, std::uint16_t port)
+{
+    if (false == StartNetworking())
+    {
+        return false;
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+    addrinfo* addresses = nullptr;
+    if (0 != getaddrinfo(address.c_str(), std::to_string(port).c_str(), &hints, &addresses))
+    {
+        return false;
+    }
+    std::intptr_t handle = static_cast<std::intptr_t>(socket(addresses->ai_family, addresses->ai_socktype, addresses->ai_protocol));
+    const int enabled = 1;
+    const bool listening = (InvalidHandle != handle) &&
+                           (0 == setsockopt(Native(handle), SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&enabled), sizeof(enabled))) &&
+                           (0 == bind(Native(handle), addresses->ai_addr, static_cast<int>(addresses->ai_addrlen))) &&
+                           (0 == listen(Native(handle), SOMAXCONN));
+    freeaddrinfo(addresses);
+    if (false == listening)
+    {
+        if (InvalidHandle != handle)
+        {
+            CloseHandle(handle);
+        }
+        return false;
+    }
+
+    sockaddr_storage bound{};
+    socklen_t boundLength = sizeof(bound);
+    getsockname(Native(handle), reinterpret_cast<sockaddr*>(&bound), &boundLength);
+    _port = (AF_INET6 == bound.ss_family) ? ntohs(reinterpret_cast<const sockaddr_in6*>(&bound)->sin6_port)
+                                          : ntohs(reinterpret_cast<const sockaddr_in*>(&bound)->sin_port);
+    _handle = handle;
+    return true;
+}
+
+std::uint16_t TcpListener::Port() const
+{
+    return _port;
+}
+
+TcpSocket TcpListener::Accept(unsigned int timeoutSeconds)
+{
+    if (InvalidHandle == _handle)
+    {
+        return TcpSocket();
+    }
+    // Waiting in short slices notices Close on every platform; Winsock would not wake a blocked accept.
+    while (false == _closed.load())
+    {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(Native(_handle), &readable);
+        timeval slice{};
+        slice.tv_usec = AcceptPollMicroseconds;
+        const int ready = select(static_cast<int>(_handle + 1), &readable, nullptr, nullptr, &slice);
+        if (ready < 0)
+        {
+            return TcpSocket();
+        }
+        if (0 == ready)
+        {
+            continue;
+        }
+        const std::intptr_t handle = static_cast<std::intptr_t>(accept(Native(_handle), nullptr, nullptr));
+        if (InvalidHandle == handle)
+        {
+            return TcpSocket();
+        }
+        ConfigureConnection(handle, timeoutSeconds);
+        return TcpSocket(handle);
+    }
+    return TcpSocket();
+}
+
+void TcpListener::Close()
+{
+    _closed.store(true);
+}
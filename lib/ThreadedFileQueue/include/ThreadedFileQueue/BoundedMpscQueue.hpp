@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Bounded lock-free multi-producer, single-consumer ring (Vyukov).
+ *
+ * Producers claim a cell with one compare-exchange on the enqueue cursor and publish it through the
+ * cell's sequence number. A full ring fails the push instead of waiting, so producers never block on a
+ * slow consumer. Only one thread may call TryPop.
+ *
+ * @tparam T Element type, must be default constructible and move assignable
+ */
+template <typename T>
+class BoundedMpscQueue
+{
+  public:
+    /**
+     * @brief Construct an empty ring.
+     *
+     * @param[in] capacity Minimum number of elements held, rounded up to a power of two
+     */
+    explicit BoundedMpscQueue(std::size_t capacity) : _mask(RoundUpToPowerOfTwo(capacity) - 1), _cells(new Cell[_mask + 1]), _enqueuePosition(0), _dequeuePosition(0)
+    {
+        for (std::size_t i = 0; i <= _mask; ++i)
+        {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedMpscQueue(const BoundedMpscQueue&) = delete;
+    BoundedMpscQueue& operator=(const BoundedMpscQueue&) = delete;
+
+    /**
+     * @brief Append an element unless the ring is full; safe to call from any number of threads.
+     *
+     * @param[in,out] value Element to append, moved from only on success
+     * @return true if the element was appended, false if the ring was full
+     */
+    bool TryPush(T& value)
+    {
+        std::size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Cell& cell = _cells[position & _mask];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == position)
+            {
+                if (true == _enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < position)
+            {
+                return false;
+            }
+            else
+            {
+                position = _enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Remove the oldest element; consumer thread only.
+     *
+     * An element whose producer is still writing it is not visible yet and is returned by a later call.
+     *
+     * @param[out] outputValue Removed element
+     * @return true if an element was removed, false if the ring appeared empty
+     */
+    bool TryPop(T& outputValue)
+    {
+        Cell& cell = _cells[_dequeuePosition & _mask];
+        if (cell.sequence.load(std::memory_order_acquire) != _dequeuePosition + 1)
+        {
+            return false;
+        }
+        outputValue = std::move(cell.value);
+        cell.sequence.store(_dequeuePosition + _mask + 1, std::memory_order_release);
+        ++_dequeuePosition;
+        return true;
+    }
+
+    /**
+     * @brief Get the number of elements the ring holds when full.
+     *
+     * @return Capacity after rounding
+     */
+    std::size_t Capacity() const
+    {
+        return _mask + 1;
+    }
+
+  private:
+    /**
+     * @brief Ring cell; the sequence number says whose turn it is.
+     */
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence{0}; /**< Equals the enqueue position when free, position + 1 when full */
+        T value{};                            /**< Stored element */
+    };
+
+    static constexpr std::size_t CacheLineSize = 64;
+
+    static std::size_t RoundUpToPowerOfTwo(std::size_t value)
+    {
+        std::size_t power = 1;
+        while (power < value)
+        {
+            power <<= 1;
+        }
+        return power;
+    }
+
+    std::size_t _mask;
+    std::unique_ptr<Cell[]> _cells;
+    alignas(CacheLineSize) std::atomic<std::size_t> _enqueuePosition;
+    alignas(CacheLineSize) std::size_t _dequeuePosition;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+/**
+ * @brief Unbounded lock-free multi-producer, single-consumer queue.
+ *
+ * Producers link nodes with a single atomic exchange and never wait on each other or on the
+ * consumer. Only one thread may call TryPop.
+ *
+ * @tparam T Element type, must be default constructible
+ */
+template <typename T>
+class MpscQueue
+{
+  public:
+    /**
+     * @brief Construct an empty queue.
+     */
+    MpscQueue() : _head(new Node()), _tail(_head.load(std::memory_order_relaxed))
+    {
+    }
+
+    /**
+     * @brief Destroy the queue and any elements that were never popped.
+     */
+    ~MpscQueue()
+    {
+        Node* node = _tail;
+        while (nullptr != node)
+        {
+            Node* next = node->next.load(std::memory_order_relaxed);
+            delete node;
+            node = next;
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * @brief Append an element; safe to call from any number of threads.
+     *
+     * @param[in] value Element to append
+     */
+    void Push(T value)
+    {
+        Node* node = new Node();
+        node->value = std::move(value);
+        Node* previous = _head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * @brief Remove the oldest element; consumer thread only.
+     *
+     * An element whose producer is still linking it in is not visible yet and is returned by a later call.
+     *
+     * @param[out] outputValue Removed element
+     * @return true if an element was removed, false if the queue appeared empty
+     */
+    bool TryPop(T& outputValue)
+    {
+        Node* next = _tail->next.load(std::memory_order_acquire);
+        if (nullptr == next)
+        {
+            return false;
+        }
+        outputValue = std::move(next->value);
+        delete _tail;
+        _tail = next;
+        return true;
+    }
+
+    /**
+     * @brief Check whether an element is ready to pop; consumer thread only.
+     *
+     * @return true if TryPop would currently fail
+     */
+    bool IsEmpty() const
+    {
+        return nullptr == _tail->next.load(std::memory_order_acquire);
+    }
+
+  private:
+    /**
+     * @brief Queue node; the node at the tail is a placeholder whose value was already consumed.
+     */
+    struct Node
+    {
+        std::atomic<Node*> next{nullptr}; /**< Next newer node */
+        T value{};                        /**< Stored element */
+    };
+
+    std::atomic<Node*> _head;
+    Node* _tail;
+};
@@ -1,32 +1,293 @@
 #pragma once
 
+#include "FileIterator/FileMetadata.hpp"
+
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
 #include <functional>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <string>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+class WorkQueue;
+class WorkerBudget;
+
+/**
+ * @brief Queue implementation used by ThreadedFileQueue.
+ */
+enum class QueueBackend
+{
+    Mutex,        /**< std::queue guarded by a mutex and condition variable */
+    LockFreeRing, /**< Lock-free bounded MPMC ring, threads park only when it is empty or full */
+    WorkStealing  /**< Per-worker Chase-Lev deques fed from a shared injector, idle workers steal */
+};
+
+/**
+ * @brief Convert a QueueBackend enumeration value to its string representation.
+ *
+ * @param[in] backend The backend to convert
+ * @return String representation of the backend
+ */
+inline const char* QueueBackendToString(QueueBackend backend)
+{
+    switch (backend)
+    {
+    case QueueBackend::Mutex:
+        return "mutex";
+    case QueueBackend::LockFreeRing:
+        return "ring";
+    case QueueBackend::WorkStealing:
+        return "stealing";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Convert a string to its corresponding QueueBackend enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @param[out] outputBackend Parsed backend
+ * @return true if the string names a known backend, false otherwise
+ */
+inline bool StringToQueueBackend(const std::string& stringValue, QueueBackend& outputBackend)
+{
+    if ("mutex" == stringValue)
+    {
+        outputBackend = QueueBackend::Mutex;
+        return true;
+    }
+    if ("ring" == stringValue)
+    {
+        outputBackend = QueueBackend::LockFreeRing;
+        return true;
+    }
+    if ("stealing" == stringValue)
+    {
+        outputBackend = QueueBackend::WorkStealing;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Order in which ThreadedFileQueue hands out files.
+ */
+enum class SchedulingPolicy
+{
+    Fifo,         /**< Arrival order */
+    LargestFirst, /**< Largest cost hint first among the files within the lookahead window */
+    LargeFileLane, /**< Files at or above the large-file threshold are handed out before all others */
+    PerDevice,     /**< Round-robin across the devices of the files, each with its own concurrency limit */
+    RecentFirst,   /**< Most recently modified file first among the files within the lookahead window */
+    PhysicalOrder  /**< Files within the lookahead window in elevator sweeps over the disk offset of their first extent */
+};
+
+/**
+ * @brief Convert a SchedulingPolicy enumeration value to its string representation.
+ *
+ * @param[in] policy The policy to convert
+ * @return String representation of the policy
+ */
+inline const char* SchedulingPolicyToString(SchedulingPolicy policy)
+{
+    switch (policy)
+    {
+    case SchedulingPolicy::Fifo:
+        return "fifo";
+    case SchedulingPolicy::LargestFirst:
+        return "largest-first";
+    case SchedulingPolicy::LargeFileLane:
+        return "large-lane";
+    case SchedulingPolicy::PerDevice:
+        return "device";
+    case SchedulingPolicy::RecentFirst:
+        return "recent-first";
+    case SchedulingPolicy::PhysicalOrder:
+        return "physical";
+    }
+    return "unknown";
+}
+
+/**
+ * @brief Convert a string to its corresponding SchedulingPolicy enumeration value.
+ *
+ * @param[in] stringValue The string to convert
+ * @param[out] outputPolicy Parsed policy
+ * @return true if the string names a known policy, false otherwise
+ */
+inline bool StringToSchedulingPolicy(const std::string& stringValue, SchedulingPolicy& outputPolicy)
+{
+    if ("fifo" == stringValue)
+    {
+        outputPolicy = SchedulingPolicy::Fifo;
+        return true;
+    }
+    if ("largest-first" == stringValue)
+    {
+        outputPolicy = SchedulingPolicy::LargestFirst;
+        return true;
+    }
+    if ("large-lane" == stringValue)
+    {
+        outputPolicy = SchedulingPolicy::LargeFileLane;
+        return true;
+    }
+    if ("device" == stringValue)
+    {
+        outputPolicy = SchedulingPolicy::PerDevice;
+        return true;
+    }
+    if ("recent-first" == stringValue)
+    {
+        outputPolicy = SchedulingPolicy::RecentFirst;
+        return true;
+    }
+    if ("physical" == stringValue)
+    {
+        outputPolicy = SchedulingPolicy::PhysicalOrder;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Base of data a producer attaches to work items for its consumer; the queue only carries it.
+ */
+struct WorkItemAttachment
+{
+    virtual ~WorkItemAttachment() = default;
+};
+
+/**
+ * @brief File queued for processing, with an optional hint of how expensive it is.
+ */
+struct FileWorkItem
+{
+    static constexpr std::uint64_t UnknownPhysicalOffset = UINT64_MAX; /**< physicalOffset not looked up yet or not available; such files end each sweep */
+
+    std::filesystem::path path; /**< File to process */
+    std::uint64_t costHint = 0; /**< Expected cost, typically the file size in bytes; 0 if unknown */
+    std::uint64_t device = 0;   /**< Device the file is stored on, for PerDevice scheduling; 0 if unknown */
+    bool hasMetadata = false;   /**< metadata was read by the producer, so the consumer need not stat the file again */
+    FileMetadata metadata{};    /**< Complete metadata of the file, meaningful if hasMetadata */
+    std::shared_ptr<const WorkItemAttachment> attachment{}; /**< Producer data for the consumer, shareable by the items of a batch; nullptr if none */
+    std::int64_t modificationTimeNs = 0; /**< Last modification time for RecentFirst scheduling, 0 if unknown, then taken from metadata if the producer read it */
+    std::uint64_t physicalOffset = UnknownPhysicalOffset; /**< Disk offset of the first extent for PhysicalOrder scheduling, looked up by the queue if unknown */
+};
+
+/**
+ * @brief Detect how many files of one device are best read at once.
+ *
+ * On Linux the block device behind the ID is looked up in sysfs: rotational disks get 2, NVMe
+ * devices 32 and other solid-state devices 8. Devices without a block device, such as network and
+ * virtual filesystems, and every device on other platforms, get no limit.
+ *
+ * @param[in] device Device ID as reported by stat
+ * @return Concurrency limit, 0 for no limit
+ */
+unsigned int DetectDeviceConcurrency(std::uint64_t device);
+
+/**
+ * @brief Detect where the first extent of a file lies on its device.
+ *
+ * On Linux the extent comes from the FS_IOC_FIEMAP ioctl, in bytes; on Windows from
+ * FSCTL_GET_RETRIEVAL_POINTERS, in clusters. Offsets are only comparable between files of one
+ * device. Empty files, files whose blocks are not allocated yet or stored inline, and filesystems
+ * without extent maps, such as network filesystems, have none.
+ *
+ * @param[in] path File to look up
+ * @param[out] outputOffset Offset of the first extent on the device
+ * @return true if the file has a placed extent, false otherwise
+ */
+bool DetectPhysicalOffset(const std::filesystem::path& path, std::uint64_t& outputOffset);
+
+/**
+ * @brief CPU a worker can be pinned to, with the NUMA node it belongs to.
+ */
+struct CpuPlacement
+{
+    unsigned int cpu;  /**< CPU number as used by the scheduler */
+    unsigned int node; /**< NUMA node of the CPU, 0 on machines with one node */
+};
+
+/**
+ * @brief Detect the CPUs the process may run on and their NUMA nodes.
+ *
+ * On Linux the CPUs come from the affinity mask of the calling thread and the nodes from
+ * /sys/devices/system/node; without that directory every CPU is on node 0. Other platforms
+ * report nothing, so pinning is skipped there.
+ *
+ * @return CPUs ordered by node, then by number; empty if unknown
+ */
+std::vector<CpuPlacement> DetectCpuPlacement();
+
+/**
+ * @brief Lower the calling thread to idle priority, so it only runs on CPU time and disk time nothing else wants.
+ *
+ * On Linux the thread moves to SCHED_IDLE and the idle I/O class; the I/O class takes effect with
+ * schedulers that honour it, such as BFQ. On Windows the thread enters background mode, which lowers
+ * its CPU, I/O and memory priority. Other platforms leave the thread unchanged.
+ *
+ * @return true if both priorities were lowered, false otherwise
+ */
+bool SetIdlePriority();
+
+/**
+ * @brief Tuning options for ThreadedFileQueue.
+ */
+struct ThreadedFileQueueOptions
+{
+    static constexpr std::size_t DefaultDequeueBatchSize = 16;                   /**< Default dequeueBatchSize */
+    static constexpr std::size_t DefaultLookaheadWindow = 4096;                  /**< Default lookaheadWindow */
+    static constexpr std::uint64_t DefaultLargeFileThreshold = 64 * 1024 * 1024; /**< Default largeFileThreshold */
+    static constexpr std::chrono::milliseconds DefaultAdaptInterval{250};        /**< Default adaptInterval */
+
+    QueueBackend backend = QueueBackend::LockFreeRing;            /**< Queue implementation for Fifo scheduling */
+    std::size_t dequeueBatchSize = DefaultDequeueBatchSize;       /**< Most files a worker takes per dequeue; 1 disables batching */
+    SchedulingPolicy scheduling = SchedulingPolicy::Fifo;         /**< Size-aware policies use their own mutex-guarded queue */
+    std::size_t lookaheadWindow = DefaultLookaheadWindow;         /**< Files LargestFirst, RecentFirst and PhysicalOrder reorder among; producers block beyond it */
+    std::uint64_t largeFileThreshold = DefaultLargeFileThreshold; /**< Cost hint that counts as large for LargeFileLane and LargestFirst */
+    bool adaptive = false;                                        /**< Hill-climb the number of active workers on measured throughput */
+    unsigned int minActiveThreads = 1;                            /**< Fewest active workers the adaptive controller goes down to */
+    unsigned int initialActiveThreads = 0;                        /**< Active workers before the first adjustment, 0 starts with all */
+    std::chrono::milliseconds adaptInterval = DefaultAdaptInterval; /**< Time between two adaptive adjustments */
+    std::function<unsigned int(std::uint64_t)> deviceConcurrency; /**< Per-device limit for PerDevice, 0 for none; empty uses DetectDeviceConcurrency */
+    std::function<bool(const std::filesystem::path&, std::uint64_t&)> physicalOffset; /**< Extent lookup for PhysicalOrder; empty uses DetectPhysicalOffset */
+    std::function<void(const std::vector<FileWorkItem>&)> batchWorkItem; /**< Receives each dequeued batch instead of workItem per file; empty calls workItem */
+    std::function<void(const FileWorkItem&)> fileWorkItem; /**< Receives each dequeued file with its metadata instead of workItem; ignored with batchWorkItem */
+    bool pinWorkers = false;                                      /**< Pin each worker to one CPU, spread over the NUMA nodes, and queue Fifo work per node */
+    std::vector<CpuPlacement> cpuPlacement;                       /**< CPUs pinWorkers uses; empty uses DetectCpuPlacement */
+    bool idlePriority = false;                                    /**< Lower each worker to idle CPU and I/O priority with SetIdlePriority */
+    const std::atomic<bool>* cancelRequested = nullptr;           /**< Once set, workers discard what they dequeue instead of processing it; must outlive the queue */
+    WorkerBudget* workerBudget = nullptr;                         /**< Slots and device limits shared with other queues, taken per batch; must outlive the queue */
+    unsigned int budgetWeight = 1;                                /**< Share of workerBudget relative to the other queues that joined it */
+};
+
 /**
  * @brief Infrastructure component for processing files with a threaded work queue.
+ *
+ * Owns the worker threads, the queue backend and the adaptive controller; what a worker does with the
+ * files it dequeues is left to ProcessBatch. Derived classes call Start once they can process files
+ * and Finalize in their destructor, before the state ProcessBatch uses is gone.
  */
-class ThreadedFileQueue
+class ThreadedWorkQueueBase
 {
   public:
-    /**
-     * @brief Construct a threaded work queue.
-     *
-     * @param[in] threadCount Number of worker threads
-     * @param[in] maxQueueSize Maximum queued items before producers block
-     * @param[in] workItem Work item callback
-     */
-    ThreadedFileQueue(unsigned int threadCount, std::size_t maxQueueSize,
-              const std::function<void(const std::filesystem::path&)>& workItem);
     /**
      * @brief Finalize and join worker threads.
      */
-    ~ThreadedFileQueue();
+    virtual ~ThreadedWorkQueueBase();
+
+    ThreadedWorkQueueBase(const ThreadedWorkQueueBase&) = delete;
+    ThreadedWorkQueueBase& operator=(const ThreadedWorkQueueBase&) = delete;
 
     /**
      * @brief Enqueue a file for processing.
@@ -34,20 +295,176 @@ class ThreadedFileQueue
      * @param[in] file File path to enqueue
      */
     void Enqueue(const std::filesystem::path& file);
+    /**
+     * @brief Enqueue several files at once, for example one directory listing.
+     *
+     * Costs one queue operation per piece that fits, instead of one per file.
+     *
+     * @param[in] files File paths to enqueue; left in a valid but unspecified state
+     */
+    void EnqueueBatch(std::vector<std::filesystem::path>&& files);
+    /**
+     * @brief Enqueue several files with cost hints.
+     *
+     * The work-stealing backend uses the hints to keep expensive files from piling up behind
+     * one worker; the other backends ignore them.
+     *
+     * @param[in] items Files to enqueue; left in a valid but unspecified state
+     */
+    void EnqueueBatch(std::vector<FileWorkItem>&& items);
     /**
      * @brief Signal completion and wait for workers to finish.
      */
     void Finalize();
 
+    /**
+     * @brief Get the number of workers currently allowed to take files.
+     *
+     * @return Active worker count, the thread count unless the queue is adaptive
+     */
+    unsigned int ActiveWorkerCount() const;
+
+  protected:
+    /**
+     * @brief Construct the queue without starting its workers.
+     *
+     * @param[in] threadCount Number of worker threads; with adaptive options the most that are active at once
+     * @param[in] maxQueueSize Maximum queued items before producers block
+     * @param[in] onWorkerExit Optional callback run on each worker thread after the queue is drained in Finalize
+     * @param[in] options Queue tuning options
+     */
+    ThreadedWorkQueueBase(unsigned int threadCount, std::size_t maxQueueSize, const std::function<void()>& onWorkerExit,
+                          const ThreadedFileQueueOptions& options);
+
+    /**
+     * @brief Start the worker threads; called once by the most derived constructor.
+     */
+    void Start();
+
+    /**
+     * @brief Process the files of one dequeue on a worker thread.
+     *
+     * @param[in] batch Between one and dequeueBatchSize files
+     */
+    virtual void ProcessBatch(const std::vector<FileWorkItem>& batch) = 0;
+
   private:
-    void WorkerLoop();
+    void WorkerLoop(std::size_t workerIndex);
+    bool WaitUntilActive(std::size_t workerIndex);
+    void ControllerLoop();
 
-    std::size_t _maxQueueSize;
-    std::function<void(const std::filesystem::path&)> _workItem;
-    std::mutex _queueMutex;
-    std::condition_variable _queueCv;
-    std::queue<std::filesystem::path> _fileQueue;
+    unsigned int _threadCount;
+    WorkerBudget* _workerBudget;
+    std::size_t _budgetJob;
+    std::vector<CpuPlacement> _workerCpus; /**< CPU of each worker, empty when workers are not pinned */
+    std::function<void()> _onWorkerExit;
+    bool _idlePriority;
+    const std::atomic<bool>* _cancelRequested;
+    std::unique_ptr<WorkQueue> _queue;
+    std::size_t _dequeueBatchSize;
     std::vector<std::thread> _workers;
-    bool _done;
-    bool _finalized;
+    std::atomic<bool> _finalized;
+
+    bool _adaptive;
+    unsigned int _minActiveThreads;
+    std::chrono::milliseconds _adaptInterval;
+    std::atomic<unsigned int> _activeWorkers;
+    std::atomic<std::uint64_t> _completedItems;
+    std::atomic<std::uint64_t> _completedCost;
+    std::atomic<std::uint64_t> _busyNs;
+    std::mutex _gateMutex;
+    std::condition_variable _gateCv;
+    std::thread _controller;
+};
+
+/**
+ * @brief Threaded work queue calling a handler of a fixed type, so the call is inlined.
+ *
+ * Workers make one virtual call per dequeue; the handler runs from there without type erasure. A
+ * handler taking `const std::vector<FileWorkItem>&` receives each dequeue whole, one taking
+ * `const FileWorkItem&` each file with its cost hint and metadata, and one taking
+ * `const std::filesystem::path&` each path.
+ *
+ * @tparam Handler Callable invoked on worker threads, usually a lambda
+ */
+template <typename Handler>
+class ThreadedWorkQueue final : public ThreadedWorkQueueBase
+{
+  public:
+    /**
+     * @brief Construct a threaded work queue and start its workers.
+     *
+     * @param[in] threadCount Number of worker threads; with adaptive options the most that are active at once
+     * @param[in] maxQueueSize Maximum queued items before producers block
+     * @param[in] handler Work item handler
+     * @param[in] onWorkerExit Optional callback run on each worker thread after the queue is drained in Finalize
+     * @param[in] options Queue tuning options; batchWorkItem and fileWorkItem are ignored
+     */
+    ThreadedWorkQueue(unsigned int threadCount, std::size_t maxQueueSize, Handler handler, const std::function<void()>& onWorkerExit = nullptr,
+                      const ThreadedFileQueueOptions& options = {})
+        : ThreadedWorkQueueBase(threadCount, maxQueueSize, onWorkerExit, options), _handler(std::move(handler))
+    {
+        Start();
+    }
+
+    ~ThreadedWorkQueue() override
+    {
+        Finalize();
+    }
+
+  private:
+    void ProcessBatch(const std::vector<FileWorkItem>& batch) override
+    {
+        if constexpr (true == std::is_invocable_v<Handler&, const std::vector<FileWorkItem>&>)
+        {
+            _handler(batch);
+        }
+        else if constexpr (true == std::is_invocable_v<Handler&, const FileWorkItem&>)
+        {
+            for (const auto& item : batch)
+            {
+                _handler(item);
+            }
+        }
+        else
+        {
+            for (const auto& item : batch)
+            {
+                _handler(item.path);
+            }
+        }
+    }
+
+    Handler _handler;
+};
+
+/**
+ * @brief Threaded work queue taking its handlers as std::function, chosen at run time through the options.
+ */
+class ThreadedFileQueue final : public ThreadedWorkQueueBase
+{
+  public:
+    /**
+     * @brief Construct a threaded work queue and start its workers.
+     *
+     * @param[in] threadCount Number of worker threads; with adaptive options the most that are active at once
+     * @param[in] maxQueueSize Maximum queued items before producers block
+     * @param[in] workItem Work item callback
+     * @param[in] onWorkerExit Optional callback run on each worker thread after the queue is drained in Finalize
+     * @param[in] options Queue tuning options
+     */
+    ThreadedFileQueue(unsigned int threadCount, std::size_t maxQueueSize,
+              const std::function<void(const std::filesystem::path&)>& workItem,
+              const std::function<void()>& onWorkerExit = nullptr, const ThreadedFileQueueOptions& options = {});
+    /**
+     * @brief Finalize and join worker threads.
+     */
+    ~ThreadedFileQueue() override;
+
+  private:
+    void ProcessBatch(const std::vector<FileWorkItem>& batch) override;
+
+    std::function<void(const std::filesystem::path&)> _workItem;
+    std::function<void(const std::vector<FileWorkItem>&)> _batchWorkItem;
+    std::function<void(const FileWorkItem&)> _fileWorkItem;
 };
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Worker slots shared by the queues of several concurrent jobs, with one concurrency limit per device.
+ *
+ * A worker of a joined queue takes a slot before it processes a dequeued batch and returns it afterwards,
+ * so however many threads the queues own, at most Slots batches run at once across all of them. The batch
+ * also takes one place on every device its files are on; a device at its limit holds the batch back until
+ * another batch of that device is done, whichever job it belongs to. Slots and device places are taken
+ * together, so a waiting worker holds nothing.
+ *
+ * A free slot goes to the job furthest below its weighted share: the one whose busy slots divided by its
+ * weight is lowest among the jobs with a batch that could start. Jobs without waiting workers take no share,
+ * so a job alone uses every slot.
+ */
+class WorkerBudget
+{
+  public:
+    /**
+     * @brief Create a budget.
+     *
+     * @param[in] slots Batches processed at once across all joined queues, at least 1
+     * @param[in] deviceConcurrency Limit of batches of one device at once, 0 for none; empty uses DetectDeviceConcurrency
+     */
+    explicit WorkerBudget(unsigned int slots, const std::function<unsigned int(std::uint64_t)>& deviceConcurrency = nullptr);
+
+    WorkerBudget(const WorkerBudget&) = delete;
+    WorkerBudget& operator=(const WorkerBudget&) = delete;
+
+    /**
+     * @brief Get the budget of the process, created on first use with one slot per hardware thread.
+     *
+     * @return Budget shared by every caller in the process
+     */
+    static std::shared_ptr<WorkerBudget> ProcessWide();
+
+    /**
+     * @brief Register a job drawing on the budget.
+     *
+     * @param[in] weight Share of the slots relative to the other jobs, at least 1
+     * @return Job ID for Acquire, Release and Leave
+     */
+    std::size_t Join(unsigned int weight);
+
+    /**
+     * @brief Unregister a job once none of its workers holds a slot.
+     *
+     * @param[in] job Job ID from Join
+     */
+    void Leave(std::size_t job);
+
+    /**
+     * @brief Wait for a slot and a place on every device of a batch, then take them.
+     *
+     * @param[in] job Job ID from Join
+     * @param[in] devices Devices of the batch, sorted and without duplicates; 0 stands for an unknown device and is not limited
+     */
+    void Acquire(std::size_t job, const std::vector<std::uint64_t>& devices);
+
+    /**
+     * @brief Return what Acquire took.
+     *
+     * @param[in] job Job ID from Join
+     * @param[in] devices The devices passed to Acquire
+     */
+    void Release(std::size_t job, const std::vector<std::uint64_t>& devices);
+
+    /**
+     * @brief Get the number of batches processed at once at most.
+     *
+     * @return Slot count
+     */
+    unsigned int Slots() const;
+
+  private:
+    struct Job
+    {
+        unsigned int weight;
+        unsigned int busy;
+        std::vector<const std::vector<std::uint64_t>*> waiting; /**< Devices of each batch a worker of the job waits to start */
+    };
+
+    bool DevicesHaveRoom(const std::vector<std::uint64_t>& devices);
+    bool CanStart(const Job& job, const std::vector<std::uint64_t>& devices);
+    unsigned int DeviceLimit(std::uint64_t device);
+
+    const unsigned int _slots;
+    std::function<unsigned int(std::uint64_t)> _deviceConcurrency;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    unsigned int _busySlots;
+    std::size_t _nextJob;
+    std::map<std::size_t, Job> _jobs;
+    std::map<std::uint64_t, unsigned int> _deviceBusy;
+    std::map<std::uint64_t, unsigned int> _deviceLimits; /**< Limits looked up so far, since detection reads sysfs */
+};
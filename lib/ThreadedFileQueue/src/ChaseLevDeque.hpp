@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Growable lock-free work-stealing deque (Chase-Lev, in the C11 formulation by Lê et al.).
+ *
+ * The owning thread pushes and pops at the bottom; any other thread may steal from the top.
+ * Elements are raw pointers so that a racing steal only ever reads a whole word. Arrays
+ * outgrown by Push are retired, not freed, until the deque is destroyed, because a thief may
+ * still be reading from them.
+ *
+ * @tparam T Pointee type; the deque does not own the pointers
+ */
+template <typename T>
+class ChaseLevDeque
+{
+  public:
+    /**
+     * @brief Construct an empty deque.
+     *
+     * @param[in] initialCapacity Initial capacity, rounded up to a power of two
+     */
+    explicit ChaseLevDeque(std::size_t initialCapacity = DefaultCapacity) : _top(0), _bottom(0)
+    {
+        std::size_t capacity = MinCapacity;
+        while (capacity < initialCapacity)
+        {
+            capacity <<= 1;
+        }
+        _arrays.push_back(std::make_unique<Array>(capacity));
+        _array.store(_arrays.back().get(), std::memory_order_relaxed);
+    }
+
+    ChaseLevDeque(const ChaseLevDeque&) = delete;
+    ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+    /**
+     * @brief Push an element at the bottom; owner thread only.
+     *
+     * @param[in] item Element to push
+     */
+    void Push(T* item)
+    {
+        const std::int64_t bottom = _bottom.load(std::memory_order_relaxed);
+        const std::int64_t top = _top.load(std::memory_order_acquire);
+        Array* array = _array.load(std::memory_order_relaxed);
+        if (static_cast<std::int64_t>(array->capacity) <= (bottom - top))
+        {
+            array = Grow(array, top, bottom);
+        }
+        array->Store(bottom, item);
+        _bottom.store(bottom + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Pop the most recently pushed element; owner thread only.
+     *
+     * @return Element, or nullptr if the deque is empty
+     */
+    T* Pop()
+    {
+        const std::int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+        Array* array = _array.load(std::memory_order_relaxed);
+        // Sequentially consistent so that the reservation of the bottom element is ordered before the read of top.
+        _bottom.store(bottom, std::memory_order_seq_cst);
+        std::int64_t top = _top.load(std::memory_order_seq_cst);
+        if (top > bottom)
+        {
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T* item = array->Load(bottom);
+        if (top == bottom)
+        {
+            // Last element: race thieves for it through top.
+            if (false == _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = nullptr;
+            }
+            _bottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /**
+     * @brief Steal the oldest element; any thread.
+     *
+     * @return Element, or nullptr if the deque is empty or the steal lost a race
+     */
+    T* Steal()
+    {
+        std::int64_t top = _top.load(std::memory_order_seq_cst);
+        const std::int64_t bottom = _bottom.load(std::memory_order_seq_cst);
+        if (top >= bottom)
+        {
+            return nullptr;
+        }
+
+        Array* array = _array.load(std::memory_order_acquire);
+        T* item = array->Load(top);
+        if (false == _top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return item;
+    }
+
+    /**
+     * @brief Approximate number of elements; any thread.
+     *
+     * @return Element count, possibly stale
+     */
+    std::size_t SizeHint() const
+    {
+        const std::int64_t bottom = _bottom.load(std::memory_order_relaxed);
+        const std::int64_t top = _top.load(std::memory_order_relaxed);
+        return (bottom > top) ? static_cast<std::size_t>(bottom - top) : 0;
+    }
+
+  private:
+    static constexpr std::size_t MinCapacity = 2;
+    static constexpr std::size_t DefaultCapacity = 64;
+    static constexpr std::size_t CacheLineSize = 64;
+
+    /**
+     * @brief Circular array of element slots.
+     */
+    struct Array
+    {
+        explicit Array(std::size_t arrayCapacity) : capacity(arrayCapacity), slots(new std::atomic<T*>[arrayCapacity])
+        {
+        }
+
+        T* Load(std::int64_t index) const
+        {
+            return slots[static_cast<std::size_t>(index) & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+
+        void Store(std::int64_t index, T* item)
+        {
+            slots[static_cast<std::size_t>(index) & (capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+
+        std::size_t capacity;                      /**< Number of slots, a power of two */
+        std::unique_ptr<std::atomic<T*>[]> slots; /**< Element slots */
+    };
+
+    /**
+     * @brief Replace the array with one twice as large holding the same elements; owner thread only.
+     */
+    Array* Grow(Array* array, std::int64_t top, std::int64_t bottom)
+    {
+        _arrays.push_back(std::make_unique<Array>(array->capacity * 2));
+        Array* grown = _arrays.back().get();
+        for (std::int64_t index = top; index < bottom; ++index)
+        {
+            grown->Store(index, array->Load(index));
+        }
+        _array.store(grown, std::memory_order_release);
+        return grown;
+    }
+
+    alignas(CacheLineSize) std::atomic<std::int64_t> _top;
+    alignas(CacheLineSize) std::atomic<std::int64_t> _bottom;
+    std::atomic<Array*> _array;
+    std::vector<std::unique_ptr<Array>> _arrays;
+};
@@ -0,0 +1,158 @@
+#include "CpuPlacement.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+#ifdef __linux__
+constexpr const char* NodeDirectory = "/sys/devices/system/node";
+constexpr const char* NodeDirectoryPrefix = "node";
+
+/**
+ * @brief Parse a sysfs CPU list such as "0-3,8,10-11".
+ *
+ * @param[in] cpuList List to parse
+ * @return CPUs of the list; malformed pieces are skipped
+ */
+std::vector<unsigned int> ParseCpuList(const std::string& cpuList)
+{
+    std::vector<unsigned int> cpus;
+    std::size_t start = 0;
+    while (start < cpuList.size())
+    {
+        const std::size_t end = std::min(cpuList.find(',', start), cpuList.size());
+        const std::string range = cpuList.substr(start, end - start);
+        const std::size_t dash = range.find('-');
+        try
+        {
+            const unsigned long first = std::stoul(range.substr(0, dash));
+            const unsigned long last = (std::string::npos == dash) ? first : std::stoul(range.substr(dash + 1));
+            for (unsigned long cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.push_back(static_cast<unsigned int>(cpu));
+            }
+        }
+        catch (const std::exception&)
+        {
+        }
+        start = end + 1;
+    }
+    return cpus;
+}
+
+/**
+ * @brief Map every CPU listed under the sysfs node directory to its node.
+ *
+ * @return Node of each CPU, empty on machines without NUMA information
+ */
+std::map<unsigned int, unsigned int> ReadCpuNodes()
+{
+    std::map<unsigned int, unsigned int> cpuNodes;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator entry(NodeDirectory, ec), end; (0 == ec.value()) && (entry != end); entry.increment(ec))
+    {
+        const std::string name = entry->path().filename().string();
+        if ((0 != name.rfind(NodeDirectoryPrefix, 0)) || (name.size() == std::char_traits<char>::length(NodeDirectoryPrefix)) ||
+            (false == std::all_of(name.begin() + std::char_traits<char>::length(NodeDirectoryPrefix), name.end(),
+                                  [](char character) { return ('0' <= character) && ('9' >= character); })))
+        {
+            continue;
+        }
+        const unsigned int node = static_cast<unsigned int>(std::stoul(name.substr(std::char_traits<char>::length(NodeDirectoryPrefix))));
+        std::ifstream cpuListStream(entry->path() / "cpulist");
+        std::string cpuList;
+        std::getline(cpuListStream, cpuList);
+        for (const unsigned int cpu : ParseCpuList(cpuList))
+        {
+            cpuNodes[cpu] = node;
+        }
+    }
+    return cpuNodes;
+}
+#endif
+}
+
+std::vector<CpuPlacement> DetectCpuPlacement()
+{
+    std::vector<CpuPlacement> placement;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (0 != sched_getaffinity(0, sizeof(allowed), &allowed))
+    {
+        return placement;
+    }
+    const std::map<unsigned int, unsigned int> cpuNodes = ReadCpuNodes();
+    for (unsigned int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (0 != CPU_ISSET(cpu, &allowed))
+        {
+            const auto node = cpuNodes.find(cpu);
+            placement.push_back(CpuPlacement{cpu, (cpuNodes.end() != node) ? node->second : 0});
+        }
+    }
+    std::stable_sort(placement.begin(), placement.end(), [](const CpuPlacement& left, const CpuPlacement& right) { return left.node < right.node; });
+#endif
+    return placement;
+}
+
+std::vector<CpuPlacement> InterleaveNodes(const std::vector<CpuPlacement>& placement)
+{
+    std::map<unsigned int, std::vector<CpuPlacement>> nodes;
+    for (const CpuPlacement& cpu : placement)
+    {
+        nodes[cpu.node].push_back(cpu);
+    }
+    std::vector<CpuPlacement> interleaved;
+    interleaved.reserve(placement.size());
+    for (std::size_t round = 0; interleaved.size() < placement.size(); ++round)
+    {
+        for (const auto& node : nodes)
+        {
+            if (round < node.second.size())
+            {
+                interleaved.push_back(node.second[round]);
+            }
+        }
+    }
+    return interleaved;
+}
+
+bool PinCurrentThread(unsigned int cpu)
+{
+#ifdef _WIN32
+    constexpr unsigned int MaskBits = sizeof(DWORD_PTR) * 8;
+    // Beyond one processor group a plain affinity mask cannot name the CPU.
+    return (MaskBits > cpu) && (0 != SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << cpu));
+#elif defined(__linux__)
+    if (CPU_SETSIZE <= cpu)
+    {
+        return false;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return 0 == pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+    (void)cpu;
+    return false;
+#endif
+}
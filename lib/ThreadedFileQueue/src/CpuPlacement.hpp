@@ -0,0 +1,23 @@
+#pragma once
+
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <vector>
+
+/**
+ * @brief Order CPUs so that consecutive workers alternate between the NUMA nodes.
+ *
+ * A pool smaller than the machine then still gets workers, and so memory bandwidth, on every node.
+ *
+ * @param[in] placement CPUs with their nodes, in any order
+ * @return The same CPUs, taking the next CPU of each node in turn
+ */
+std::vector<CpuPlacement> InterleaveNodes(const std::vector<CpuPlacement>& placement);
+
+/**
+ * @brief Restrict the calling thread to one CPU.
+ *
+ * @param[in] cpu CPU number
+ * @return true on success, false where pinning is unsupported or the CPU is not allowed
+ */
+bool PinCurrentThread(unsigned int cpu);
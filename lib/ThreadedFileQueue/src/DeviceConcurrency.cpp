@@ -0,0 +1,66 @@
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+namespace
+{
+#ifdef __linux__
+constexpr unsigned int RotationalDeviceConcurrency = 2;
+constexpr unsigned int SolidStateDeviceConcurrency = 8;
+constexpr unsigned int NvmeDeviceConcurrency = 32;
+
+/**
+ * @brief Read the rotational flag of a block device directory in sysfs.
+ *
+ * @param[in] blockDirectory Directory of the block device, or of one of its partitions
+ * @param[out] outputRotational The device has spinning platters
+ * @return true if the flag was found, false otherwise
+ */
+bool ReadRotational(const std::filesystem::path& blockDirectory, bool& outputRotational)
+{
+    // Partitions have no queue of their own; the disk they belong to is their parent directory.
+    for (const auto& queueDirectory : {blockDirectory / "queue", blockDirectory.parent_path() / "queue"})
+    {
+        std::ifstream rotational(queueDirectory / "rotational");
+        char flag = 0;
+        if ((true == rotational.is_open()) && (rotational >> flag))
+        {
+            outputRotational = ('1' == flag);
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+}
+
+unsigned int DetectDeviceConcurrency(std::uint64_t device)
+{
+#ifdef __linux__
+    const dev_t deviceId = static_cast<dev_t>(device);
+    std::error_code ec;
+    const std::filesystem::path blockDirectory = std::filesystem::canonical(
+        std::filesystem::path("/sys/dev/block") / (std::to_string(major(deviceId)) + ":" + std::to_string(minor(deviceId))), ec);
+    bool rotational = false;
+    if ((0 != ec.value()) || (false == ReadRotational(blockDirectory, rotational)))
+    {
+        return 0;
+    }
+    if (true == rotational)
+    {
+        return RotationalDeviceConcurrency;
+    }
+    const bool nvme = (0 == blockDirectory.filename().string().rfind("nvme", 0)) ||
+                      (0 == blockDirectory.parent_path().filename().string().rfind("nvme", 0));
+    return (true == nvme) ? NvmeDeviceConcurrency : SolidStateDeviceConcurrency;
+#else
+    (void)device;
+    return 0;
+#endif
+}
@@ -0,0 +1,186 @@
+#include "DeviceWorkQueue.hpp"
+
+#include <algorithm>
+
+DeviceWorkQueue::DeviceWorkQueue(std::size_t maxQueueSize, std::size_t consumerCount, const ThreadedFileQueueOptions& options)
+    : _deviceConcurrency((nullptr != options.deviceConcurrency) ? options.deviceConcurrency : DetectDeviceConcurrency),
+      _capacity(std::max<std::size_t>(1, maxQueueSize)), _resumeSize(_capacity / 2), _consumerCount(std::max<std::size_t>(1, consumerCount)),
+      _heldDevice(_consumerCount, NoDevice), _queued(0), _waitingProducers(0), _done(false)
+{
+}
+
+void DeviceWorkQueue::Push(FileWorkItem&& item)
+{
+    {
+        std::unique_lock lock(_queueMutex);
+        WaitForSpace(lock);
+        Insert(std::move(item));
+    }
+    _readyCv.notify_one();
+}
+
+void DeviceWorkQueue::PushBatch(std::vector<FileWorkItem>&& items)
+{
+    std::size_t next = 0;
+    while (next < items.size())
+    {
+        std::size_t count = 0;
+        {
+            std::unique_lock lock(_queueMutex);
+            WaitForSpace(lock);
+            count = std::min(items.size() - next, _capacity - _queued);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                Insert(std::move(items[next++]));
+            }
+        }
+        // Files of a device at its limit wake consumers that find nothing to take, which is harmless.
+        for (std::size_t i = 0; i < std::min(count, _consumerCount); ++i)
+        {
+            _readyCv.notify_one();
+        }
+    }
+}
+
+std::size_t DeviceWorkQueue::PopBatch(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount)
+{
+    std::size_t count = 0;
+    bool wakeProducer = false;
+    {
+        std::unique_lock lock(_queueMutex);
+        Release(workerIndex);
+        Lane* lane = nullptr;
+        std::uint64_t device = NoDevice;
+        _readyCv.wait(lock,
+                      [&]()
+                      {
+                          lane = TakeTurn(device);
+                          return (nullptr != lane) || ((true == _done) && (0 == _queued));
+                      });
+        if (nullptr == lane)
+        {
+            // Waiters held back by a device limit are woken one at a time, so each exiting consumer passes the wake-up on.
+            lock.unlock();
+            _readyCv.notify_one();
+            return 0;
+        }
+
+        count = FairShare(lane->items.size(), lane->limit, maxCount);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            outputItems.push_back(std::move(lane->items.front()));
+            lane->items.pop_front();
+        }
+        _queued -= count;
+        ++lane->active;
+        _heldDevice[workerIndex % _consumerCount] = device;
+        if (false == lane->items.empty())
+        {
+            _turns.push_back(device);
+        }
+        wakeProducer = (0 < _waitingProducers) && (_resumeSize >= _queued);
+    }
+    if (true == wakeProducer)
+    {
+        _notFullCv.notify_all();
+    }
+    return count;
+}
+
+void DeviceWorkQueue::FinishBatch(std::size_t workerIndex)
+{
+    {
+        std::lock_guard lock(_queueMutex);
+        Release(workerIndex);
+    }
+    _readyCv.notify_one();
+}
+
+void DeviceWorkQueue::Close()
+{
+    {
+        std::lock_guard lock(_queueMutex);
+        _done = true;
+    }
+    _readyCv.notify_all();
+}
+
+/**
+ * @brief Queue an item on its device's lane, creating the lane on the device's first file; caller holds the queue mutex.
+ *
+ * @param[in] item File to queue; moved from
+ */
+void DeviceWorkQueue::Insert(FileWorkItem&& item)
+{
+    auto lane = _lanes.find(item.device);
+    if (_lanes.end() == lane)
+    {
+        // Unknown devices share one unlimited lane; a limit is looked up once per device.
+        const std::size_t limit = (0 == item.device) ? 0 : _deviceConcurrency(item.device);
+        lane = _lanes.emplace(item.device, Lane{std::deque<FileWorkItem>(), (0 == limit) ? _consumerCount : limit, 0}).first;
+    }
+    if (true == lane->second.items.empty())
+    {
+        _turns.push_back(item.device);
+    }
+    lane->second.items.push_back(std::move(item));
+    ++_queued;
+}
+
+/**
+ * @brief Find the next device in round-robin order that has a free slot; caller holds the queue mutex.
+ *
+ * Devices at their limit are moved behind the others. The found device is removed from the turns;
+ * the caller puts it back if files remain.
+ *
+ * @param[out] outputDevice Found device
+ * @return Lane of the device, nullptr if every device with files waiting is at its limit
+ */
+DeviceWorkQueue::Lane* DeviceWorkQueue::TakeTurn(std::uint64_t& outputDevice)
+{
+    for (std::size_t checked = 0; checked < _turns.size(); ++checked)
+    {
+        const std::uint64_t device = _turns.front();
+        _turns.pop_front();
+        Lane& lane = _lanes[device];
+        if (lane.active < lane.limit)
+        {
+            outputDevice = device;
+            return &lane;
+        }
+        _turns.push_back(device);
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Free the device slot a worker holds, if any; caller holds the queue mutex.
+ *
+ * @param[in] workerIndex Index of the worker
+ */
+void DeviceWorkQueue::Release(std::size_t workerIndex)
+{
+    std::uint64_t& held = _heldDevice[workerIndex % _consumerCount];
+    if (NoDevice == held)
+    {
+        return;
+    }
+    --_lanes[held].active;
+    held = NoDevice;
+}
+
+/**
+ * @brief Block the calling producer until the queue has room for at least one item.
+ *
+ * @param[in/out] lock Held lock on the queue mutex
+ */
+void DeviceWorkQueue::WaitForSpace(std::unique_lock<std::mutex>& lock)
+{
+    if (_queued < _capacity)
+    {
+        return;
+    }
+    ++_waitingProducers;
+    _notFullCv.wait(lock, [&]() { return _queued < _capacity; });
+    --_waitingProducers;
+}
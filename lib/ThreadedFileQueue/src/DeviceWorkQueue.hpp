@@ -0,0 +1,75 @@
+#pragma once
+
+#include "WorkQueue.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Mutex-guarded work queue with one FIFO lane and one concurrency limit per device.
+ *
+ * Consumers take turns over the devices that have files waiting, so every device is kept busy
+ * instead of the one that happens to come next in enumeration order. A device is skipped while as
+ * many consumers as its limit are working on its files, which keeps a spinning disk from being
+ * driven into a seek storm while an NVMe device next to it gets deep parallelism. A consumer holds
+ * one slot of one device from PopBatch until FinishBatch.
+ */
+class DeviceWorkQueue : public WorkQueue
+{
+  public:
+    /**
+     * @brief Create an empty queue.
+     *
+     * @param[in] maxQueueSize Maximum queued items across all devices before producers block
+     * @param[in] consumerCount Number of consumer threads
+     * @param[in] options Per-device concurrency limits
+     */
+    DeviceWorkQueue(std::size_t maxQueueSize, std::size_t consumerCount, const ThreadedFileQueueOptions& options);
+
+    void Push(FileWorkItem&& item) override;
+    void PushBatch(std::vector<FileWorkItem>&& items) override;
+    std::size_t PopBatch(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount) override;
+    void FinishBatch(std::size_t workerIndex) override;
+    void Close() override;
+
+  private:
+    /**
+     * @brief Files and consumers of one device.
+     */
+    struct Lane
+    {
+        std::deque<FileWorkItem> items; /**< Files waiting, in arrival order */
+        std::size_t limit;              /**< Most consumers working on the device at once */
+        std::size_t active;             /**< Consumers working on the device */
+    };
+
+    /**
+     * @brief Marks a worker that holds no device slot.
+     */
+    static constexpr std::uint64_t NoDevice = UINT64_MAX;
+
+    void Insert(FileWorkItem&& item);
+    Lane* TakeTurn(std::uint64_t& outputDevice);
+    void Release(std::size_t workerIndex);
+    void WaitForSpace(std::unique_lock<std::mutex>& lock);
+
+    std::function<unsigned int(std::uint64_t)> _deviceConcurrency;
+    std::size_t _capacity;
+    std::size_t _resumeSize;
+    std::size_t _consumerCount;
+    std::mutex _queueMutex;
+    std::condition_variable _notFullCv;
+    std::condition_variable _readyCv;
+    std::unordered_map<std::uint64_t, Lane> _lanes;
+    std::deque<std::uint64_t> _turns;        /**< Devices with files waiting, in round-robin order */
+    std::vector<std::uint64_t> _heldDevice;  /**< Device each worker holds a slot of, NoDevice for none */
+    std::size_t _queued;
+    std::size_t _waitingProducers;
+    bool _done;
+};
@@ -0,0 +1,108 @@
+#include "MutexWorkQueue.hpp"
+
+MutexWorkQueue::MutexWorkQueue(std::size_t maxQueueSize, std::size_t consumerCount)
+    : _maxQueueSize(std::max<std::size_t>(1, maxQueueSize)), _resumeSize(_maxQueueSize / 2), _consumerCount(consumerCount),
+      _waitingProducers(0), _waitingConsumers(0), _done(false)
+{
+}
+
+void MutexWorkQueue::Push(FileWorkItem&& item)
+{
+    std::size_t wakeCount = 0;
+    {
+        std::unique_lock lock(_queueMutex);
+        WaitForSpace(lock);
+        _fileQueue.push(std::move(item));
+        wakeCount = std::min<std::size_t>(1, _waitingConsumers);
+    }
+    // Notify after unlocking so the woken consumer does not immediately block on the mutex.
+    WakeConsumers(wakeCount);
+}
+
+void MutexWorkQueue::PushBatch(std::vector<FileWorkItem>&& items)
+{
+    std::size_t next = 0;
+    while (next < items.size())
+    {
+        std::size_t wakeCount = 0;
+        {
+            std::unique_lock lock(_queueMutex);
+            WaitForSpace(lock);
+            const std::size_t count = std::min(items.size() - next, _maxQueueSize - _fileQueue.size());
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                _fileQueue.push(std::move(items[next++]));
+            }
+            wakeCount = std::min(count, _waitingConsumers);
+        }
+        WakeConsumers(wakeCount);
+    }
+}
+
+std::size_t MutexWorkQueue::PopBatch(std::size_t, std::vector<FileWorkItem>& outputItems, std::size_t maxCount)
+{
+    std::size_t count = 0;
+    bool wakeProducer = false;
+    {
+        std::unique_lock lock(_queueMutex);
+        if ((false == _done) && (true == _fileQueue.empty()))
+        {
+            ++_waitingConsumers;
+            _notEmptyCv.wait(lock, [&]() { return (true == _done) || (false == _fileQueue.empty()); });
+            --_waitingConsumers;
+        }
+
+        count = std::min(_fileQueue.size(), FairShare(_fileQueue.size(), _consumerCount, maxCount));
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            outputItems.push_back(std::move(_fileQueue.front()));
+            _fileQueue.pop();
+        }
+        // Blocked producers are resumed once the queue has drained to half capacity rather than on every
+        // pop, so a full queue does not ping-pong the producer for each freed slot.
+        wakeProducer = (0 < count) && (0 < _waitingProducers) && (_resumeSize >= _fileQueue.size());
+    }
+    if (true == wakeProducer)
+    {
+        _notFullCv.notify_one();
+    }
+    return count;
+}
+
+void MutexWorkQueue::Close()
+{
+    {
+        std::lock_guard lock(_queueMutex);
+        _done = true;
+    }
+    _notEmptyCv.notify_all();
+}
+
+/**
+ * @brief Block the calling producer until the queue has room for at least one item.
+ *
+ * @param[in/out] lock Held lock on the queue mutex
+ */
+void MutexWorkQueue::WaitForSpace(std::unique_lock<std::mutex>& lock)
+{
+    if (_fileQueue.size() < _maxQueueSize)
+    {
+        return;
+    }
+    ++_waitingProducers;
+    _notFullCv.wait(lock, [&]() { return _fileQueue.size() < _maxQueueSize; });
+    --_waitingProducers;
+}
+
+/**
+ * @brief Wake up to count waiting consumers, one per newly queued item.
+ *
+ * @param[in] count Number of consumers to wake
+ */
+void MutexWorkQueue::WakeConsumers(std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        _notEmptyCv.notify_one();
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "WorkQueue.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <queue>
+
+/**
+ * @brief Work queue backend guarded by a mutex, with separate not-full and not-empty channels.
+ *
+ * Producers wait on one condition variable and consumers on the other, and each operation
+ * wakes only as many waiters of the opposite side as it can serve, and only if they are actually
+ * waiting. Blocked producers are resumed once the queue has drained to half capacity.
+ */
+class MutexWorkQueue : public WorkQueue
+{
+  public:
+    /**
+     * @brief Create an empty queue.
+     *
+     * @param[in] maxQueueSize Maximum queued items before producers block
+     * @param[in] consumerCount Number of consumer threads, used to size fair-share batches
+     */
+    MutexWorkQueue(std::size_t maxQueueSize, std::size_t consumerCount);
+
+    void Push(FileWorkItem&& item) override;
+    void PushBatch(std::vector<FileWorkItem>&& items) override;
+    std::size_t PopBatch(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount) override;
+    void Close() override;
+
+  private:
+    void WaitForSpace(std::unique_lock<std::mutex>& lock);
+    void WakeConsumers(std::size_t count);
+
+    std::size_t _maxQueueSize;
+    std::size_t _resumeSize;
+    std::size_t _consumerCount;
+    std::mutex _queueMutex;
+    std::condition_variable _notFullCv;
+    std::condition_variable _notEmptyCv;
+    std::queue<FileWorkItem> _fileQueue;
+    std::size_t _waitingProducers;
+    std::size_t _waitingConsumers;
+    bool _done;
+};
@@ -0,0 +1,230 @@
+#include "NodeWorkQueue.hpp"
+
+#include <algorithm>
+#include <map>
+
+NodeWorkQueue::NodeWorkQueue(std::size_t maxQueueSize, const std::vector<unsigned int>& workerNodes)
+    : _maxQueueSize(std::max<std::size_t>(1, maxQueueSize)), _resumeSize(_maxQueueSize / 2),
+      _consumerCount(std::max<std::size_t>(1, workerNodes.size())), _nextLane(0), _queued(0), _waitingProducers(0), _sleepingWorkers(0),
+      _closed(false)
+{
+    std::map<unsigned int, std::size_t> laneOfNode;
+    for (const unsigned int node : workerNodes)
+    {
+        const auto lane = laneOfNode.emplace(node, _lanes.size());
+        if (true == lane.second)
+        {
+            _lanes.push_back(std::make_unique<Lane>());
+        }
+        _workerLanes.push_back(lane.first->second);
+        ++_lanes[lane.first->second]->consumerCount;
+    }
+    if (true == _lanes.empty())
+    {
+        _lanes.push_back(std::make_unique<Lane>());
+    }
+}
+
+void NodeWorkQueue::Push(FileWorkItem&& item)
+{
+    Reserve(1);
+    Lane& lane = *_lanes[_nextLane.fetch_add(1, std::memory_order_relaxed) % _lanes.size()];
+    {
+        std::lock_guard lock(lane.mutex);
+        lane.items.push_back(std::move(item));
+        lane.size.fetch_add(1);
+    }
+    SignalWork(1);
+}
+
+void NodeWorkQueue::PushBatch(std::vector<FileWorkItem>&& items)
+{
+    std::size_t next = 0;
+    while (next < items.size())
+    {
+        const std::size_t count = Reserve(items.size() - next);
+        // One run per lane, starting at a rotating lane so that short batches still spread out.
+        const std::size_t runLength = (count + _lanes.size() - 1) / _lanes.size();
+        const std::size_t firstLane = _nextLane.fetch_add(1, std::memory_order_relaxed);
+        const std::size_t end = next + count;
+        for (std::size_t lane = 0; next < end; ++lane)
+        {
+            Lane& target = *_lanes[(firstLane + lane) % _lanes.size()];
+            const std::size_t runEnd = std::min(end, next + runLength);
+            std::lock_guard lock(target.mutex);
+            target.size.fetch_add(runEnd - next);
+            while (next < runEnd)
+            {
+                target.items.push_back(std::move(items[next++]));
+            }
+        }
+        SignalWork(count);
+    }
+}
+
+std::size_t NodeWorkQueue::PopBatch(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount)
+{
+    std::size_t count = TryTake(workerIndex, outputItems, maxCount);
+    while (0 == count)
+    {
+        // Announce the sleep before the final search so a concurrent push either becomes visible
+        // to it or sees the sleeper and wakes it.
+        const std::uint32_t ticket = _workSignal.Load();
+        _sleepingWorkers.fetch_add(1);
+        count = TryTake(workerIndex, outputItems, maxCount);
+        if (0 < count)
+        {
+            _sleepingWorkers.fetch_sub(1);
+            break;
+        }
+        if ((true == _closed.load()) && (0 == _queued.load()))
+        {
+            _sleepingWorkers.fetch_sub(1);
+            return 0;
+        }
+        _workSignal.Wait(ticket);
+        _sleepingWorkers.fetch_sub(1);
+    }
+
+    const std::size_t remaining = _queued.fetch_sub(count) - count;
+    if ((0 < _waitingProducers.load()) && (_resumeSize >= remaining))
+    {
+        // Taken so a producer between its check and its wait cannot miss the notification.
+        {
+            std::lock_guard lock(_spaceMutex);
+        }
+        _notFullCv.notify_all();
+    }
+    if ((0 == remaining) && (true == _closed.load()))
+    {
+        _workSignal.Increment();
+        _workSignal.WakeAll();
+    }
+    return count;
+}
+
+void NodeWorkQueue::Close()
+{
+    _closed.store(true);
+    _workSignal.Increment();
+    _workSignal.WakeAll();
+}
+
+/**
+ * @brief Claim room for up to wanted items, blocking while the queue is full.
+ *
+ * @param[in] wanted Items the producer still has, at least 1
+ * @return Items claimed, at least 1
+ */
+std::size_t NodeWorkQueue::Reserve(std::size_t wanted)
+{
+    std::unique_lock lock(_spaceMutex);
+    if (_maxQueueSize <= _queued.load())
+    {
+        _waitingProducers.fetch_add(1);
+        _notFullCv.wait(lock, [&]() { return _queued.load() < _maxQueueSize; });
+        _waitingProducers.fetch_sub(1);
+    }
+    const std::size_t count = std::min(wanted, _maxQueueSize - _queued.load());
+    _queued.fetch_add(count);
+    return count;
+}
+
+/**
+ * @brief Take up to a fair share of one lane's items.
+ *
+ * @param[in,out] lane Lane to take from
+ * @param[out] outputItems Vector the items are appended to
+ * @param[in] maxCount Most items to take
+ * @param[in] consumerCount Consumers the lane is shared by
+ * @return Items taken, 0 if the lane was empty
+ */
+std::size_t NodeWorkQueue::TakeFrom(Lane& lane, std::vector<FileWorkItem>& outputItems, std::size_t maxCount, std::size_t consumerCount)
+{
+    std::lock_guard lock(lane.mutex);
+    const std::size_t count = std::min(lane.items.size(), FairShare(lane.items.size(), consumerCount, maxCount));
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        outputItems.push_back(std::move(lane.items.front()));
+        lane.items.pop_front();
+    }
+    lane.size.fetch_sub(count);
+    return count;
+}
+
+/**
+ * @brief Take from the worker's own lane, or from the fullest other lane once it is empty.
+ *
+ * A worker stealing from another node shares that lane with every consumer, so it takes a smaller
+ * bite than the node's own workers and leaves most of the lane to them.
+ *
+ * @param[in] workerIndex Index of the calling worker
+ * @param[out] outputItems Vector the items are appended to
+ * @param[in] maxCount Most items to take
+ * @return Items taken, 0 if every lane was empty
+ */
+std::size_t NodeWorkQueue::TryTake(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount)
+{
+    const std::size_t homeLane = (true == _workerLanes.empty()) ? 0 : _workerLanes[workerIndex % _workerLanes.size()];
+    Lane& home = *_lanes[homeLane];
+    if (0 < home.size.load())
+    {
+        const std::size_t count = TakeFrom(home, outputItems, maxCount, std::max<std::size_t>(1, home.consumerCount));
+        if (0 < count)
+        {
+            return count;
+        }
+    }
+
+    // A lane emptied by another thief between the scan and the take is just scanned past next time.
+    for (std::size_t attempt = 1; attempt < _lanes.size(); ++attempt)
+    {
+        std::size_t fullest = homeLane;
+        std::size_t fullestSize = 0;
+        for (std::size_t lane = 0; lane < _lanes.size(); ++lane)
+        {
+            const std::size_t size = _lanes[lane]->size.load(std::memory_order_relaxed);
+            if ((homeLane != lane) && (fullestSize < size))
+            {
+                fullest = lane;
+                fullestSize = size;
+            }
+        }
+        if (0 == fullestSize)
+        {
+            return 0;
+        }
+        const std::size_t count = TakeFrom(*_lanes[fullest], outputItems, maxCount, _consumerCount);
+        if (0 < count)
+        {
+            return count;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Publish new work and wake up to one sleeping worker per item.
+ *
+ * Sleepers of every node are woken alike; one that finds its own lane empty takes from the others.
+ *
+ * @param[in] count Number of items made available
+ */
+void NodeWorkQueue::SignalWork(std::size_t count)
+{
+    if (0 == count)
+    {
+        return;
+    }
+    _workSignal.Increment();
+    const std::size_t sleeping = _sleepingWorkers.load();
+    if ((1 < sleeping) && (count >= sleeping))
+    {
+        _workSignal.WakeAll();
+        return;
+    }
+    for (std::size_t i = 0; i < std::min(count, sleeping); ++i)
+    {
+        _workSignal.WakeOne();
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "ParkingWord.hpp"
+#include "WorkQueue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Work queue backend with one queue per NUMA node.
+ *
+ * Producers spread their files over the node queues in turn, a batch split into one run per
+ * node. A worker takes files from the queue of its own node and only looks at the other nodes
+ * once that queue is empty; it then takes from the fullest one. So on a multi-socket host the
+ * files, and the buffers and hash states handling them, mostly stay on one node. The capacity
+ * is shared by all nodes, and producers block once it is used up.
+ */
+class NodeWorkQueue : public WorkQueue
+{
+  public:
+    /**
+     * @brief Create an empty queue.
+     *
+     * @param[in] maxQueueSize Maximum queued items over all nodes before producers block
+     * @param[in] workerNodes Node of each worker, indexed by worker; the queue has one lane per distinct node
+     */
+    NodeWorkQueue(std::size_t maxQueueSize, const std::vector<unsigned int>& workerNodes);
+
+    void Push(FileWorkItem&& item) override;
+    void PushBatch(std::vector<FileWorkItem>&& items) override;
+    std::size_t PopBatch(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount) override;
+    void Close() override;
+
+  private:
+    static constexpr std::size_t CacheLineSize = 64;
+
+    /**
+     * @brief Queue of one node.
+     */
+    struct alignas(CacheLineSize) Lane
+    {
+        std::mutex mutex;                   /**< Guards items */
+        std::deque<FileWorkItem> items;     /**< Queued files in arrival order */
+        std::atomic<std::size_t> size{0};   /**< Size of items, read without the lock to pick a lane */
+        std::size_t consumerCount = 0;      /**< Workers of the node */
+    };
+
+    std::size_t Reserve(std::size_t wanted);
+    std::size_t TakeFrom(Lane& lane, std::vector<FileWorkItem>& outputItems, std::size_t maxCount, std::size_t consumerCount);
+    std::size_t TryTake(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount);
+    void SignalWork(std::size_t count);
+
+    std::size_t _maxQueueSize;
+    std::size_t _resumeSize;
+    std::size_t _consumerCount;
+    std::vector<std::unique_ptr<Lane>> _lanes;
+    std::vector<std::size_t> _workerLanes;
+    std::atomic<std::size_t> _nextLane;
+    std::mutex _spaceMutex;
+    std::condition_variable _notFullCv;
+    std::atomic<std::size_t> _queued;
+    std::atomic<std::size_t> _waitingProducers;
+    ParkingWord _workSignal;
+    std::atomic<std::uint32_t> _sleepingWorkers;
+    std::atomic<bool> _closed;
+};
@@ -0,0 +1,85 @@
+#include "ParkingWord.hpp"
+
+#if defined(__linux__)
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex word must be a plain 32-bit integer");
+
+namespace
+{
+#if defined(__linux__)
+/**
+ * @brief Issue a private futex operation on a word.
+ *
+ * @param[in] word Futex word
+ * @param[in] operation FUTEX_WAIT_PRIVATE or FUTEX_WAKE_PRIVATE
+ * @param[in] value Expected value for waits, number of threads for wakes
+ */
+void Futex(std::atomic<std::uint32_t>& word, int operation, std::uint32_t value)
+{
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), operation, value, nullptr, nullptr, 0);
+}
+#endif
+}
+
+ParkingWord::ParkingWord() : _value(0)
+{
+}
+
+std::uint32_t ParkingWord::Load() const
+{
+    return _value.load();
+}
+
+void ParkingWord::Increment()
+{
+    _value.fetch_add(1);
+}
+
+void ParkingWord::Wait(std::uint32_t expected)
+{
+#if defined(__linux__)
+    Futex(_value, FUTEX_WAIT_PRIVATE, expected);
+#elif defined(_WIN32)
+    WaitOnAddress(&_value, &expected, sizeof(expected), INFINITE);
+#else
+    std::unique_lock<std::mutex> lock(_mutex);
+    _cv.wait(lock, [&]() { return expected != _value.load(); });
+#endif
+}
+
+void ParkingWord::WakeOne()
+{
+#if defined(__linux__)
+    Futex(_value, FUTEX_WAKE_PRIVATE, 1);
+#elif defined(_WIN32)
+    WakeByAddressSingle(&_value);
+#else
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cv.notify_one();
+#endif
+}
+
+void ParkingWord::WakeAll()
+{
+#if defined(__linux__)
+    Futex(_value, FUTEX_WAKE_PRIVATE, INT_MAX);
+#elif defined(_WIN32)
+    WakeByAddressAll(&_value);
+#else
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cv.notify_all();
+#endif
+}
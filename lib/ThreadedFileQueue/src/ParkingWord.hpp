@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#if !defined(__linux__) && !defined(_WIN32)
+#include <condition_variable>
+#include <mutex>
+#endif
+
+/**
+ * @brief 32-bit counter that threads can sleep on until it changes.
+ *
+ * Uses futex on Linux and WaitOnAddress on Windows, so waiting and waking cost a system call
+ * only when a thread actually sleeps. Other platforms fall back to a mutex and condition variable.
+ */
+class ParkingWord
+{
+  public:
+    /**
+     * @brief Create a word with value 0.
+     */
+    ParkingWord();
+
+    ParkingWord(const ParkingWord&) = delete;
+    ParkingWord& operator=(const ParkingWord&) = delete;
+
+    /**
+     * @brief Read the current value.
+     *
+     * @return Current value
+     */
+    std::uint32_t Load() const;
+
+    /**
+     * @brief Advance the value so that sleepers waiting on an older value return.
+     */
+    void Increment();
+
+    /**
+     * @brief Sleep while the value still equals expected; may return spuriously.
+     *
+     * @param[in] expected Value observed before deciding to sleep
+     */
+    void Wait(std::uint32_t expected);
+
+    /**
+     * @brief Wake at most one sleeper.
+     */
+    void WakeOne();
+
+    /**
+     * @brief Wake every sleeper.
+     */
+    void WakeAll();
+
+  private:
+    std::atomic<std::uint32_t> _value;
+#if !defined(__linux__) && !defined(_WIN32)
+    std::mutex _mutex;
+    std::condition_variable _cv;
+#endif
+};
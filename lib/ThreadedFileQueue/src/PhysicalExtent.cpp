@@ -0,0 +1,73 @@
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <winioctl.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+bool DetectPhysicalOffset(const std::filesystem::path& path, std::uint64_t& outputOffset)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), FILE_READ_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        return false;
+    }
+    STARTING_VCN_INPUT_BUFFER start{};
+    RETRIEVAL_POINTERS_BUFFER pointers{};
+    DWORD returned = 0;
+    // The buffer holds one extent; ERROR_MORE_DATA only says the file has more.
+    const BOOL mapped = DeviceIoControl(file, FSCTL_GET_RETRIEVAL_POINTERS, &start, sizeof(start), &pointers, sizeof(pointers), &returned, nullptr);
+    const bool found = ((0 != mapped) || (ERROR_MORE_DATA == GetLastError())) && (0 < pointers.ExtentCount) && (0 <= pointers.Extents[0].Lcn.QuadPart);
+    CloseHandle(file);
+    if (false == found)
+    {
+        return false;
+    }
+    // Clusters, not bytes, which orders the files of one volume all the same.
+    outputOffset = static_cast<std::uint64_t>(pointers.Extents[0].Lcn.QuadPart);
+    return true;
+#elif defined(__linux__)
+    const int descriptor = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (0 > descriptor)
+    {
+        return false;
+    }
+    // Room for the request header and exactly one extent.
+    alignas(fiemap) unsigned char buffer[sizeof(fiemap) + sizeof(fiemap_extent)];
+    std::memset(buffer, 0, sizeof(buffer));
+    fiemap* request = reinterpret_cast<fiemap*>(buffer);
+    request->fm_start = 0;
+    request->fm_length = FIEMAP_MAX_OFFSET;
+    request->fm_extent_count = 1;
+    const bool mapped = (0 == ioctl(descriptor, FS_IOC_FIEMAP, request));
+    close(descriptor);
+    // Delayed allocations have no block yet, and inline or encoded extents no address a read would seek to.
+    constexpr std::uint32_t unplaced = FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_DELALLOC | FIEMAP_EXTENT_DATA_INLINE | FIEMAP_EXTENT_NOT_ALIGNED;
+    if ((false == mapped) || (0 == request->fm_mapped_extents) || (0 != (request->fm_extents[0].fe_flags & unplaced)))
+    {
+        return false;
+    }
+    outputOffset = request->fm_extents[0].fe_physical;
+    return true;
+#else
+    (void)path;
+    (void)outputOffset;
+    return false;
+#endif
+}
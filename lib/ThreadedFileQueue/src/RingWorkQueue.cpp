@@ -0,0 +1,252 @@
+#include "RingWorkQueue.hpp"
+
+#include <algorithm>
+
+namespace
+{
+constexpr std::size_t MinRingCapacity = 2;
+
+/**
+ * @brief Round a capacity up to the next power of two.
+ *
+ * @param[in] capacity Requested capacity
+ * @return Power-of-two capacity
+ */
+std::size_t RingCapacityFor(std::size_t capacity)
+{
+    std::size_t ringCapacity = MinRingCapacity;
+    while (ringCapacity < capacity)
+    {
+        ringCapacity <<= 1;
+    }
+    return ringCapacity;
+}
+}
+
+RingWorkQueue::RingWorkQueue(std::size_t maxQueueSize, std::size_t consumerCount)
+    : _mask(RingCapacityFor(maxQueueSize) - 1), _consumerCount(consumerCount), _cells(new Cell[_mask + 1]), _enqueuePosition(0),
+      _dequeuePosition(0), _waitingConsumers(0), _waitingProducers(0), _closed(false)
+{
+    for (std::size_t i = 0; i <= _mask; ++i)
+    {
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+void RingWorkQueue::Push(FileWorkItem&& item)
+{
+    PushWaiting(item);
+    SignalItems(1);
+}
+
+void RingWorkQueue::PushBatch(std::vector<FileWorkItem>&& items)
+{
+    std::size_t unsignalled = 0;
+    for (auto& item : items)
+    {
+        if (false == TryPush(item))
+        {
+            // Consumers must hear about what is already in the ring before this producer sleeps.
+            SignalItems(unsignalled);
+            unsignalled = 0;
+            PushWaiting(item);
+        }
+        ++unsignalled;
+    }
+    SignalItems(unsignalled);
+}
+
+std::size_t RingWorkQueue::PopBatch(std::size_t, std::vector<FileWorkItem>& outputItems, std::size_t maxCount)
+{
+    FileWorkItem item;
+    if (false == PopWaiting(item))
+    {
+        return 0;
+    }
+    outputItems.push_back(std::move(item));
+
+    const std::size_t available =
+        _enqueuePosition.load(std::memory_order_relaxed) - _dequeuePosition.load(std::memory_order_relaxed) + 1;
+    const std::size_t limit = FairShare(available, _consumerCount, maxCount);
+    std::size_t count = 1;
+    while ((count < limit) && (true == TryPop(item)))
+    {
+        outputItems.push_back(std::move(item));
+        ++count;
+    }
+    SignalSpace(count);
+    return count;
+}
+
+void RingWorkQueue::Close()
+{
+    _closed.store(true);
+    _itemSignal.Increment();
+    _itemSignal.WakeAll();
+}
+
+/**
+ * @brief Claim a free cell and move a file into it.
+ *
+ * @param[in/out] item File to store; moved from only on success
+ * @return true on success, false if the ring is full
+ */
+bool RingWorkQueue::TryPush(FileWorkItem& item)
+{
+    std::size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while (true)
+    {
+        cell = &_cells[position & _mask];
+        const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const std::intptr_t difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+        if (0 == difference)
+        {
+            if (true == _enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (0 > difference)
+        {
+            return false;
+        }
+        else
+        {
+            position = _enqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->value = std::move(item);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Claim a full cell and move its file out.
+ *
+ * @param[out] outputItem Removed file
+ * @return true on success, false if the ring is empty
+ */
+bool RingWorkQueue::TryPop(FileWorkItem& outputItem)
+{
+    std::size_t position = _dequeuePosition.load(std::memory_order_relaxed);
+    Cell* cell = nullptr;
+    while (true)
+    {
+        cell = &_cells[position & _mask];
+        const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const std::intptr_t difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position + 1);
+        if (0 == difference)
+        {
+            if (true == _dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (0 > difference)
+        {
+            return false;
+        }
+        else
+        {
+            position = _dequeuePosition.load(std::memory_order_relaxed);
+        }
+    }
+
+    outputItem = std::move(cell->value);
+    cell->value = FileWorkItem{};
+    cell->sequence.store(position + _mask + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Store a file, parking while the ring is full; does not signal consumers.
+ *
+ * @param[in/out] item File to store; moved from
+ */
+void RingWorkQueue::PushWaiting(FileWorkItem& item)
+{
+    while (false == TryPush(item))
+    {
+        // Announce the wait before the final retry so a concurrent pop either becomes visible to
+        // the retry or sees the waiter and wakes it.
+        const std::uint32_t ticket = _spaceSignal.Load();
+        _waitingProducers.fetch_add(1);
+        if (true == TryPush(item))
+        {
+            _waitingProducers.fetch_sub(1);
+            return;
+        }
+        _spaceSignal.Wait(ticket);
+        _waitingProducers.fetch_sub(1);
+    }
+}
+
+/**
+ * @brief Remove a file, parking while the ring is empty and open; does not signal producers.
+ *
+ * @param[out] outputItem Removed file
+ * @return true if a file was removed, false once the ring is closed and drained
+ */
+bool RingWorkQueue::PopWaiting(FileWorkItem& outputItem)
+{
+    while (false == TryPop(outputItem))
+    {
+        const std::uint32_t ticket = _itemSignal.Load();
+        _waitingConsumers.fetch_add(1);
+        if (true == TryPop(outputItem))
+        {
+            _waitingConsumers.fetch_sub(1);
+            return true;
+        }
+        if (true == _closed.load())
+        {
+            _waitingConsumers.fetch_sub(1);
+            // Items pushed before Close are still drained.
+            return TryPop(outputItem);
+        }
+        _itemSignal.Wait(ticket);
+        _waitingConsumers.fetch_sub(1);
+    }
+    return true;
+}
+
+/**
+ * @brief Publish new items and wake up to one asleep consumer per item.
+ *
+ * @param[in] count Number of items published
+ */
+void RingWorkQueue::SignalItems(std::size_t count)
+{
+    if (0 == count)
+    {
+        return;
+    }
+    _itemSignal.Increment();
+    const std::size_t waiting = _waitingConsumers.load();
+    if ((1 < waiting) && (count >= waiting))
+    {
+        _itemSignal.WakeAll();
+        return;
+    }
+    for (std::size_t i = 0; i < std::min(count, waiting); ++i)
+    {
+        _itemSignal.WakeOne();
+    }
+}
+
+/**
+ * @brief Publish freed cells and wake up to one asleep producer per cell.
+ *
+ * @param[in] count Number of cells freed
+ */
+void RingWorkQueue::SignalSpace(std::size_t count)
+{
+    _spaceSignal.Increment();
+    const std::size_t waiting = _waitingProducers.load();
+    for (std::size_t i = 0; i < std::min(count, waiting); ++i)
+    {
+        _spaceSignal.WakeOne();
+    }
+}
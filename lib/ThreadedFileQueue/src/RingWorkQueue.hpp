@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ParkingWord.hpp"
+#include "WorkQueue.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief Lock-free bounded multi-producer, multi-consumer ring (Vyukov) with parking.
+ *
+ * Producers and consumers claim cells with a single compare-exchange on their own cursor, and
+ * per-cell sequence numbers hand each cell over without locks. Threads sleep on a ParkingWord
+ * only when the ring is empty (consumers) or full (producers), and a wake is issued only when
+ * someone is actually asleep.
+ */
+class RingWorkQueue : public WorkQueue
+{
+  public:
+    /**
+     * @brief Create an empty ring.
+     *
+     * @param[in] maxQueueSize Minimum capacity, rounded up to a power of two
+     * @param[in] consumerCount Number of consumer threads, used to size fair-share batches
+     */
+    RingWorkQueue(std::size_t maxQueueSize, std::size_t consumerCount);
+
+    void Push(FileWorkItem&& item) override;
+    void PushBatch(std::vector<FileWorkItem>&& items) override;
+    std::size_t PopBatch(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount) override;
+    void Close() override;
+
+  private:
+    /**
+     * @brief Ring cell; the sequence number says whose turn it is.
+     */
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence; /**< Equals the enqueue position when free, position + 1 when full */
+        FileWorkItem value;                /**< Stored file */
+    };
+
+    static constexpr std::size_t CacheLineSize = 64;
+
+    bool TryPush(FileWorkItem& item);
+    bool TryPop(FileWorkItem& outputItem);
+    void PushWaiting(FileWorkItem& item);
+    bool PopWaiting(FileWorkItem& outputItem);
+    void SignalItems(std::size_t count);
+    void SignalSpace(std::size_t count);
+
+    std::size_t _mask;
+    std::size_t _consumerCount;
+    std::unique_ptr<Cell[]> _cells;
+    alignas(CacheLineSize) std::atomic<std::size_t> _enqueuePosition;
+    alignas(CacheLineSize) std::atomic<std::size_t> _dequeuePosition;
+    alignas(CacheLineSize) ParkingWord _itemSignal;
+    std::atomic<std::uint32_t> _waitingConsumers;
+    alignas(CacheLineSize) ParkingWord _spaceSignal;
+    std::atomic<std::uint32_t> _waitingProducers;
+    std::atomic<bool> _closed;
+};
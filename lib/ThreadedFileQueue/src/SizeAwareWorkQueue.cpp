@@ -0,0 +1,343 @@
+#include "SizeAwareWorkQueue.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+using HeapOrdering = bool (*)(const FileWorkItem&, const FileWorkItem&);
+
+/**
+ * @brief Heap ordering that puts the largest cost hint on top.
+ *
+ * @param[in] left First item
+ * @param[in] right Second item
+ * @return true if left is cheaper than right
+ */
+bool CheaperThan(const FileWorkItem& left, const FileWorkItem& right)
+{
+    return left.costHint < right.costHint;
+}
+
+/**
+ * @brief Get the modification time RecentFirst orders an item by.
+ *
+ * @param[in] item Queued file
+ * @return The item's modification time, else that of its metadata, else 0 so it goes last
+ */
+std::int64_t ModificationTimeOf(const FileWorkItem& item)
+{
+    if ((0 == item.modificationTimeNs) && (true == item.hasMetadata))
+    {
+        return item.metadata.modificationTimeNs;
+    }
+    return item.modificationTimeNs;
+}
+
+/**
+ * @brief Heap ordering that puts the most recently modified file on top.
+ *
+ * @param[in] left First item
+ * @param[in] right Second item
+ * @return true if left was modified before right
+ */
+bool OlderThan(const FileWorkItem& left, const FileWorkItem& right)
+{
+    return ModificationTimeOf(left) < ModificationTimeOf(right);
+}
+
+/**
+ * @brief Get the position PhysicalOrder sweeps an item at.
+ *
+ * @param[in] item Queued file
+ * @return Device and disk offset; offsets of different devices are not comparable, so each device is swept in turn
+ */
+std::pair<std::uint64_t, std::uint64_t> SweepPositionOf(const FileWorkItem& item)
+{
+    return {item.device, item.physicalOffset};
+}
+
+/**
+ * @brief Heap ordering that puts the lowest disk position on top.
+ *
+ * @param[in] left First item
+ * @param[in] right Second item
+ * @return true if left lies after right
+ */
+bool FartherThan(const FileWorkItem& left, const FileWorkItem& right)
+{
+    return SweepPositionOf(left) > SweepPositionOf(right);
+}
+
+/**
+ * @brief Get the heap ordering of a policy.
+ *
+ * @param[in] policy LargestFirst, RecentFirst or PhysicalOrder
+ * @return Ordering whose largest element is handed out first
+ */
+HeapOrdering HeapOrder(SchedulingPolicy policy)
+{
+    switch (policy)
+    {
+    case SchedulingPolicy::RecentFirst:
+        return OlderThan;
+    case SchedulingPolicy::PhysicalOrder:
+        return FartherThan;
+    default:
+        return CheaperThan;
+    }
+}
+}
+
+SizeAwareWorkQueue::SizeAwareWorkQueue(std::size_t maxQueueSize, std::size_t consumerCount, const ThreadedFileQueueOptions& options)
+    : _policy(options.scheduling),
+      _usesHeap((SchedulingPolicy::LargestFirst == options.scheduling) || (SchedulingPolicy::RecentFirst == options.scheduling) ||
+                (SchedulingPolicy::PhysicalOrder == options.scheduling)),
+      _capacity(std::max<std::size_t>(1, (true == _usesHeap) ? options.lookaheadWindow : maxQueueSize)),
+      _resumeSize(_capacity / 2), _consumerCount(consumerCount), _largeFileThreshold(options.largeFileThreshold),
+      _physicalOffset((options.physicalOffset) ? options.physicalOffset : DetectPhysicalOffset), _sweepPosition(0, 0), _waitingProducers(0),
+      _waitingConsumers(0), _done(false)
+{
+    if (true == _usesHeap)
+    {
+        _heap.reserve(_capacity);
+    }
+}
+
+void SizeAwareWorkQueue::Push(FileWorkItem&& item)
+{
+    LookUpPhysicalOffset(item);
+    std::size_t wakeCount = 0;
+    {
+        std::unique_lock lock(_queueMutex);
+        WaitForSpace(lock);
+        Insert(std::move(item));
+        wakeCount = std::min<std::size_t>(1, _waitingConsumers);
+    }
+    WakeConsumers(wakeCount);
+}
+
+void SizeAwareWorkQueue::PushBatch(std::vector<FileWorkItem>&& items)
+{
+    // The lookups open every file, so they run before the queue is locked.
+    for (auto& item : items)
+    {
+        LookUpPhysicalOffset(item);
+    }
+    std::size_t next = 0;
+    while (next < items.size())
+    {
+        std::size_t wakeCount = 0;
+        {
+            std::unique_lock lock(_queueMutex);
+            WaitForSpace(lock);
+            const std::size_t count = std::min(items.size() - next, _capacity - QueuedCount());
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                Insert(std::move(items[next++]));
+            }
+            wakeCount = std::min(count, _waitingConsumers);
+        }
+        WakeConsumers(wakeCount);
+    }
+}
+
+std::size_t SizeAwareWorkQueue::PopBatch(std::size_t, std::vector<FileWorkItem>& outputItems, std::size_t maxCount)
+{
+    std::size_t count = 0;
+    bool wakeProducer = false;
+    {
+        std::unique_lock lock(_queueMutex);
+        if ((false == _done) && (0 == QueuedCount()))
+        {
+            ++_waitingConsumers;
+            _notEmptyCv.wait(lock, [&]() { return (true == _done) || (0 != QueuedCount()); });
+            --_waitingConsumers;
+        }
+        if (0 == QueuedCount())
+        {
+            return 0;
+        }
+
+        const std::size_t limit = FairShare(QueuedCount(), _consumerCount, maxCount);
+        count = (true == _usesHeap) ? TakeFromHeap(outputItems, limit) : TakeFromLanes(outputItems, limit);
+        wakeProducer = (0 < _waitingProducers) && (_resumeSize >= QueuedCount());
+    }
+    if (true == wakeProducer)
+    {
+        _notFullCv.notify_one();
+    }
+    return count;
+}
+
+void SizeAwareWorkQueue::Close()
+{
+    {
+        std::lock_guard lock(_queueMutex);
+        _done = true;
+    }
+    _notEmptyCv.notify_all();
+}
+
+/**
+ * @brief Check whether an item counts as a large file.
+ *
+ * @param[in] item Queued file
+ * @return true if its cost hint reaches the large-file threshold
+ */
+bool SizeAwareWorkQueue::IsLarge(const FileWorkItem& item) const
+{
+    return _largeFileThreshold <= item.costHint;
+}
+
+/**
+ * @brief Number of queued items; caller holds the queue mutex.
+ *
+ * @return Queued item count
+ */
+std::size_t SizeAwareWorkQueue::QueuedCount() const
+{
+    return _heap.size() + _nextSweep.size() + _largeLane.size() + _smallLane.size();
+}
+
+/**
+ * @brief Look up the disk offset of an item for PhysicalOrder, unless the producer supplied it.
+ *
+ * @param[in,out] item File about to be queued
+ */
+void SizeAwareWorkQueue::LookUpPhysicalOffset(FileWorkItem& item) const
+{
+    if ((SchedulingPolicy::PhysicalOrder != _policy) || (FileWorkItem::UnknownPhysicalOffset != item.physicalOffset))
+    {
+        return;
+    }
+    std::uint64_t offset = 0;
+    if (true == _physicalOffset(item.path, offset))
+    {
+        item.physicalOffset = offset;
+    }
+}
+
+/**
+ * @brief Queue an item according to the policy; caller holds the queue mutex.
+ *
+ * @param[in] item File to queue; moved from
+ */
+void SizeAwareWorkQueue::Insert(FileWorkItem&& item)
+{
+    if ((SchedulingPolicy::PhysicalOrder == _policy) && (SweepPositionOf(item) < _sweepPosition))
+    {
+        // The sweep has passed the file; going back for it would cost a seek each way.
+        _nextSweep.push_back(std::move(item));
+        std::push_heap(_nextSweep.begin(), _nextSweep.end(), FartherThan);
+        return;
+    }
+    if (true == _usesHeap)
+    {
+        _heap.push_back(std::move(item));
+        std::push_heap(_heap.begin(), _heap.end(), HeapOrder(_policy));
+        return;
+    }
+    if (true == IsLarge(item))
+    {
+        _largeLane.push_back(std::move(item));
+        return;
+    }
+    _smallLane.push_back(std::move(item));
+}
+
+/**
+ * @brief Take the items on top of the heap, the most expensive, the most recent or the next ones on disk; caller holds the queue mutex.
+ *
+ * A large file is taken on its own so that the next large file goes to another worker. PhysicalOrder
+ * moves its sweep position to each item taken, and starts the next sweep from the lowest position
+ * once the current one has run out.
+ *
+ * @param[out] outputItems Vector the taken items are appended to
+ * @param[in] limit Most items to take
+ * @return Number of items taken
+ */
+std::size_t SizeAwareWorkQueue::TakeFromHeap(std::vector<FileWorkItem>& outputItems, std::size_t limit)
+{
+    if ((true == _heap.empty()) && (SchedulingPolicy::PhysicalOrder == _policy))
+    {
+        std::swap(_heap, _nextSweep);
+        _sweepPosition = {0, 0};
+    }
+    std::size_t count = 0;
+    while ((count < limit) && (false == _heap.empty()))
+    {
+        const bool large = IsLarge(_heap.front());
+        if ((0 < count) && (true == large))
+        {
+            break;
+        }
+        std::pop_heap(_heap.begin(), _heap.end(), HeapOrder(_policy));
+        if (SchedulingPolicy::PhysicalOrder == _policy)
+        {
+            _sweepPosition = SweepPositionOf(_heap.back());
+        }
+        outputItems.push_back(std::move(_heap.back()));
+        _heap.pop_back();
+        ++count;
+        if (true == large)
+        {
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Take one large file, or a batch of small files if no large file is waiting; caller holds the queue mutex.
+ *
+ * @param[out] outputItems Vector the taken items are appended to
+ * @param[in] limit Most small items to take
+ * @return Number of items taken
+ */
+std::size_t SizeAwareWorkQueue::TakeFromLanes(std::vector<FileWorkItem>& outputItems, std::size_t limit)
+{
+    if (false == _largeLane.empty())
+    {
+        outputItems.push_back(std::move(_largeLane.front()));
+        _largeLane.pop_front();
+        return 1;
+    }
+
+    const std::size_t count = std::min(limit, _smallLane.size());
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        outputItems.push_back(std::move(_smallLane.front()));
+        _smallLane.pop_front();
+    }
+    return count;
+}
+
+/**
+ * @brief Block the calling producer until the queue has room for at least one item.
+ *
+ * @param[in/out] lock Held lock on the queue mutex
+ */
+void SizeAwareWorkQueue::WaitForSpace(std::unique_lock<std::mutex>& lock)
+{
+    if (QueuedCount() < _capacity)
+    {
+        return;
+    }
+    ++_waitingProducers;
+    _notFullCv.wait(lock, [&]() { return QueuedCount() < _capacity; });
+    --_waitingProducers;
+}
+
+/**
+ * @brief Wake up to count waiting consumers, one per newly queued item.
+ *
+ * @param[in] count Number of consumers to wake
+ */
+void SizeAwareWorkQueue::WakeConsumers(std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        _notEmptyCv.notify_one();
+    }
+}
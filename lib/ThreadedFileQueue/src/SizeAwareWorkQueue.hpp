@@ -0,0 +1,74 @@
+#pragma once
+
+#include "WorkQueue.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Mutex-guarded work queue that hands out files by cost hint, modification time or disk position instead of arrival order.
+ *
+ * LargestFirst keeps up to lookaheadWindow files in a max-heap and always hands out the most
+ * expensive one. LargeFileLane keeps files at or above largeFileThreshold in a separate FIFO
+ * that is served before the small-file FIFO. Both start the big files early so the run does
+ * not end with one worker busy on a huge file while the rest sit idle. Large files are handed
+ * out one at a time; small files in fair-share batches. RecentFirst keeps the same heap ordered
+ * by modification time, so the files most likely to have changed are handed out first.
+ * PhysicalOrder keeps it ordered by the disk offset of each file's first extent, looked up as the
+ * file is queued, and serves it like an elevator: upwards from the last position handed out, with
+ * files queued behind that position waiting for the next sweep. On a rotational disk the heads
+ * then move across the platter once per sweep instead of once per file.
+ */
+class SizeAwareWorkQueue : public WorkQueue
+{
+  public:
+    /**
+     * @brief Create an empty queue.
+     *
+     * @param[in] maxQueueSize Maximum queued items before producers block, for LargeFileLane
+     * @param[in] consumerCount Number of consumer threads, used to size fair-share batches
+     * @param[in] options Scheduling policy, lookahead window, large-file threshold and extent lookup
+     */
+    SizeAwareWorkQueue(std::size_t maxQueueSize, std::size_t consumerCount, const ThreadedFileQueueOptions& options);
+
+    void Push(FileWorkItem&& item) override;
+    void PushBatch(std::vector<FileWorkItem>&& items) override;
+    std::size_t PopBatch(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount) override;
+    void Close() override;
+
+  private:
+    bool IsLarge(const FileWorkItem& item) const;
+    std::size_t QueuedCount() const;
+    void LookUpPhysicalOffset(FileWorkItem& item) const;
+    void Insert(FileWorkItem&& item);
+    std::size_t TakeFromHeap(std::vector<FileWorkItem>& outputItems, std::size_t limit);
+    std::size_t TakeFromLanes(std::vector<FileWorkItem>& outputItems, std::size_t limit);
+    void WaitForSpace(std::unique_lock<std::mutex>& lock);
+    void WakeConsumers(std::size_t count);
+
+    SchedulingPolicy _policy;
+    bool _usesHeap;
+    std::size_t _capacity;
+    std::size_t _resumeSize;
+    std::size_t _consumerCount;
+    std::uint64_t _largeFileThreshold;
+    std::function<bool(const std::filesystem::path&, std::uint64_t&)> _physicalOffset;
+    std::pair<std::uint64_t, std::uint64_t> _sweepPosition;
+    std::mutex _queueMutex;
+    std::condition_variable _notFullCv;
+    std::condition_variable _notEmptyCv;
+    std::vector<FileWorkItem> _heap;
+    std::vector<FileWorkItem> _nextSweep;
+    std::deque<FileWorkItem> _largeLane;
+    std::deque<FileWorkItem> _smallLane;
+    std::size_t _waitingProducers;
+    std::size_t _waitingConsumers;
+    bool _done;
+};
@@ -0,0 +1,43 @@
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef __linux__
+// From linux/ioprio.h, which older kernel headers do not ship.
+constexpr int IoPriorityWhoProcess = 1;
+constexpr int IoPriorityClassIdle = 3;
+constexpr int IoPriorityClassShift = 13;
+#endif
+}
+
+bool SetIdlePriority()
+{
+#ifdef _WIN32
+    // Lowers the I/O and memory priority of the thread along with its scheduling priority.
+    return 0 != SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined(__linux__)
+    sched_param parameter{};
+    parameter.sched_priority = 0;
+    const bool cpuLowered = (0 == pthread_setschedparam(pthread_self(), SCHED_IDLE, &parameter));
+    // Who 0 is the calling thread, not the whole process.
+    const bool ioLowered = (0 == syscall(SYS_ioprio_set, IoPriorityWhoProcess, 0, IoPriorityClassIdle << IoPriorityClassShift));
+    return (true == cpuLowered) && (true == ioLowered);
+#else
+    return false;
+#endif
+}
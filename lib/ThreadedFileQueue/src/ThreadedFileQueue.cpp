@@ -1,14 +1,154 @@
 #include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+#include "ThreadedFileQueue/WorkerBudget.hpp"
 
-ThreadedFileQueue::ThreadedFileQueue(unsigned int threadCount, std::size_t maxQueueSize,
-                                     const std::function<void(const std::filesystem::path&)>& workItem)
-    : _maxQueueSize(maxQueueSize), _workItem(workItem), _done(false), _finalized(false)
+#include "CpuPlacement.hpp"
+#include "MutexWorkQueue.hpp"
+#include "DeviceWorkQueue.hpp"
+#include "NodeWorkQueue.hpp"
+#include "RingWorkQueue.hpp"
+#include "SizeAwareWorkQueue.hpp"
+#include "WorkStealingWorkQueue.hpp"
+
+#include "Instrumentation/Instrumentation.hpp"
+
+#include <algorithm>
+
+namespace
 {
-    _workers.reserve(threadCount);
-    for (unsigned int i = 0; i < threadCount; ++i)
+constexpr double ThroughputTolerance = 0.05;
+constexpr double LatencyTolerance = 0.2;
+constexpr unsigned int AdaptStepDivisor = 8;
+
+/**
+ * @brief Pick the CPU of every worker when the options ask for pinned workers.
+ *
+ * @param[in] threadCount Number of worker threads
+ * @param[in] options Queue tuning options
+ * @return CPU of each worker, alternating between the nodes; empty when workers are not pinned
+ */
+std::vector<CpuPlacement> AssignWorkerCpus(unsigned int threadCount, const ThreadedFileQueueOptions& options)
+{
+    std::vector<CpuPlacement> workerCpus;
+    if (false == options.pinWorkers)
     {
-        _workers.emplace_back([this]() { WorkerLoop(); });
+        return workerCpus;
     }
+    const std::vector<CpuPlacement> cpus = InterleaveNodes((true == options.cpuPlacement.empty()) ? DetectCpuPlacement() : options.cpuPlacement);
+    for (unsigned int i = 0; (false == cpus.empty()) && (i < threadCount); ++i)
+    {
+        workerCpus.push_back(cpus[i % cpus.size()]);
+    }
+    return workerCpus;
+}
+
+/**
+ * @brief Create the queue implementation selected by the options.
+ *
+ * @param[in] maxQueueSize Maximum queued items before producers block
+ * @param[in] threadCount Number of worker threads consuming the queue
+ * @param[in] options Queue tuning options
+ * @param[in] workerCpus CPU of each pinned worker, empty when workers are not pinned
+ * @return Queue backend
+ */
+std::unique_ptr<WorkQueue> CreateWorkQueue(std::size_t maxQueueSize, unsigned int threadCount, const ThreadedFileQueueOptions& options,
+                                           const std::vector<CpuPlacement>& workerCpus)
+{
+    std::vector<unsigned int> workerNodes;
+    for (const CpuPlacement& cpu : workerCpus)
+    {
+        workerNodes.push_back(cpu.node);
+    }
+    const bool severalNodes = (false == workerNodes.empty()) &&
+                              (false == std::all_of(workerNodes.begin(), workerNodes.end(), [&](unsigned int node) { return workerNodes.front() == node; }));
+    if ((SchedulingPolicy::Fifo == options.scheduling) && (true == severalNodes))
+    {
+        return std::make_unique<NodeWorkQueue>(maxQueueSize, workerNodes);
+    }
+    if (SchedulingPolicy::PerDevice == options.scheduling)
+    {
+        return std::make_unique<DeviceWorkQueue>(maxQueueSize, threadCount, options);
+    }
+    if (SchedulingPolicy::Fifo != options.scheduling)
+    {
+        return std::make_unique<SizeAwareWorkQueue>(maxQueueSize, threadCount, options);
+    }
+
+    switch (options.backend)
+    {
+    case QueueBackend::Mutex:
+        return std::make_unique<MutexWorkQueue>(maxQueueSize, threadCount);
+    case QueueBackend::LockFreeRing:
+        return std::make_unique<RingWorkQueue>(maxQueueSize, threadCount);
+    case QueueBackend::WorkStealing:
+        return std::make_unique<WorkStealingWorkQueue>(maxQueueSize, threadCount);
+    }
+    return std::make_unique<MutexWorkQueue>(maxQueueSize, threadCount);
+}
+
+/**
+ * @brief Collect the devices a batch takes places on in a WorkerBudget.
+ *
+ * @param[in] batch Dequeued files
+ * @param[out] outputDevices Devices of the files, sorted and without duplicates; files on an unknown device add none
+ */
+void CollectBatchDevices(const std::vector<FileWorkItem>& batch, std::vector<std::uint64_t>& outputDevices)
+{
+    outputDevices.clear();
+    for (const auto& item : batch)
+    {
+        const std::uint64_t device = (0 != item.device) ? item.device : ((true == item.hasMetadata) ? item.metadata.device : 0);
+        if (0 != device)
+        {
+            outputDevices.push_back(device);
+        }
+    }
+    std::sort(outputDevices.begin(), outputDevices.end());
+    outputDevices.erase(std::unique(outputDevices.begin(), outputDevices.end()), outputDevices.end());
+}
+}
+
+ThreadedWorkQueueBase::ThreadedWorkQueueBase(unsigned int threadCount, std::size_t maxQueueSize, const std::function<void()>& onWorkerExit,
+                                             const ThreadedFileQueueOptions& options)
+    : _threadCount(threadCount), _workerBudget(options.workerBudget),
+      _budgetJob((nullptr != options.workerBudget) ? options.workerBudget->Join(options.budgetWeight) : 0), _workerCpus(AssignWorkerCpus(threadCount, options)), _onWorkerExit(onWorkerExit),
+      _idlePriority(options.idlePriority), _cancelRequested(options.cancelRequested), _queue(CreateWorkQueue(maxQueueSize, threadCount, options, _workerCpus)),
+      _dequeueBatchSize(std::max<std::size_t>(1, options.dequeueBatchSize)), _finalized(false),
+      _adaptive((true == options.adaptive) && (1 < threadCount)),
+      _minActiveThreads(std::min(threadCount, std::max(1u, options.minActiveThreads))),
+      _adaptInterval(std::max(std::chrono::milliseconds(1), options.adaptInterval)), _activeWorkers(threadCount), _completedItems(0),
+      _completedCost(0), _busyNs(0)
+{
+    if ((true == _adaptive) && (0 != options.initialActiveThreads))
+    {
+        _activeWorkers.store(std::min(threadCount, std::max(_minActiveThreads, options.initialActiveThreads)));
+    }
+}
+
+ThreadedWorkQueueBase::~ThreadedWorkQueueBase()
+{
+    Finalize();
+}
+
+void ThreadedWorkQueueBase::Start()
+{
+    _workers.reserve(_threadCount);
+    for (unsigned int i = 0; i < _threadCount; ++i)
+    {
+        _workers.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+    if (true == _adaptive)
+    {
+        _controller = std::thread([this]() { ControllerLoop(); });
+    }
+}
+
+ThreadedFileQueue::ThreadedFileQueue(unsigned int threadCount, std::size_t maxQueueSize,
+                                     const std::function<void(const std::filesystem::path&)>& workItem,
+                                     const std::function<void()>& onWorkerExit, const ThreadedFileQueueOptions& options)
+    : ThreadedWorkQueueBase(threadCount, maxQueueSize, onWorkerExit, options), _workItem(workItem), _batchWorkItem(options.batchWorkItem),
+      _fileWorkItem(options.fileWorkItem)
+{
+    Start();
 }
 
 ThreadedFileQueue::~ThreadedFileQueue()
@@ -16,26 +156,66 @@ ThreadedFileQueue::~ThreadedFileQueue()
     Finalize();
 }
 
-void ThreadedFileQueue::Enqueue(const std::filesystem::path& file)
+void ThreadedFileQueue::ProcessBatch(const std::vector<FileWorkItem>& batch)
 {
-    std::unique_lock lock(_queueMutex);
-    _queueCv.wait(lock, [&]() { return _fileQueue.size() < _maxQueueSize; });
-    _fileQueue.push(file);
-    _queueCv.notify_all();
+    RDEMO_SCOPE("queue.batch");
+    RDEMO_COUNT("queue.files", batch.size());
+    if (nullptr != _batchWorkItem)
+    {
+        _batchWorkItem(batch);
+        return;
+    }
+    if (nullptr != _fileWorkItem)
+    {
+        for (const auto& item : batch)
+        {
+            _fileWorkItem(item);
+        }
+        return;
+    }
+    for (const auto& item : batch)
+    {
+        _workItem(item.path);
+    }
 }
 
-void ThreadedFileQueue::Finalize()
+void ThreadedWorkQueueBase::Enqueue(const std::filesystem::path& file)
+{
+    _queue->Push(FileWorkItem{file});
+}
+
+void ThreadedWorkQueueBase::EnqueueBatch(std::vector<std::filesystem::path>&& files)
+{
+    std::vector<FileWorkItem> items;
+    items.reserve(files.size());
+    for (auto& file : files)
+    {
+        items.push_back(FileWorkItem{std::move(file)});
+    }
+    _queue->PushBatch(std::move(items));
+}
+
+void ThreadedWorkQueueBase::EnqueueBatch(std::vector<FileWorkItem>&& items)
+{
+    _queue->PushBatch(std::move(items));
+}
+
+void ThreadedWorkQueueBase::Finalize()
 {
     {
-        std::lock_guard lock(_queueMutex);
-        if (true == _finalized)
+        // Under the gate lock, so a parked worker or the controller cannot miss the flag.
+        std::lock_guard<std::mutex> lock(_gateMutex);
+        if (true == _finalized.exchange(true))
         {
             return;
         }
-        _done = true;
-        _finalized = true;
     }
-    _queueCv.notify_all();
+    _gateCv.notify_all();
+    _queue->Close();
+    if (true == _controller.joinable())
+    {
+        _controller.join();
+    }
 
     for (auto& worker : _workers)
     {
@@ -44,31 +224,179 @@ void ThreadedFileQueue::Finalize()
             worker.join();
         }
     }
+    if (nullptr != _workerBudget)
+    {
+        _workerBudget->Leave(_budgetJob);
+    }
+}
+
+unsigned int ThreadedWorkQueueBase::ActiveWorkerCount() const
+{
+    return _activeWorkers.load(std::memory_order_relaxed);
 }
 
 /**
  * @brief Worker thread loop for processing queued files.
+ *
+ * Adaptive queues park workers above the active count between batches; a parked worker holds no
+ * files, and the work-stealing backend lets the others steal whatever its deque still has. Once the
+ * queue is cancelled, dequeued files are dropped unprocessed. With a worker budget, each batch waits
+ * for its slot after it is dequeued, so a worker waiting for input never holds one.
+ *
+ * @param[in] workerIndex Index of the worker, passed to the queue backend
+ */
+void ThreadedWorkQueueBase::WorkerLoop(std::size_t workerIndex)
+{
+    // Pinned before the first file, so the buffers the worker allocates on first use land on its node.
+    // A CPU the thread may not use leaves it unpinned.
+    if (false == _workerCpus.empty())
+    {
+        PinCurrentThread(_workerCpus[workerIndex].cpu);
+    }
+    // Best effort: a platform or kernel that refuses leaves the worker at normal priority.
+    if (true == _idlePriority)
+    {
+        SetIdlePriority();
+    }
+    std::vector<FileWorkItem> batch;
+    batch.reserve(_dequeueBatchSize);
+    std::vector<std::uint64_t> batchDevices;
+    while ((true == WaitUntilActive(workerIndex)) && (0 < _queue->PopBatch(workerIndex, batch, _dequeueBatchSize)))
+    {
+        // A cancelled queue still dequeues, so producers blocked on a full queue get through and Finalize returns quickly.
+        if ((nullptr != _cancelRequested) && (true == _cancelRequested->load(std::memory_order_relaxed)))
+        {
+            batch.clear();
+            _queue->FinishBatch(workerIndex);
+            continue;
+        }
+        if (nullptr != _workerBudget)
+        {
+            RDEMO_SCOPE("queue.budget.wait");
+            CollectBatchDevices(batch, batchDevices);
+            _workerBudget->Acquire(_budgetJob, batchDevices);
+        }
+        if (false == _adaptive)
+        {
+            ProcessBatch(batch);
+            if (nullptr != _workerBudget)
+            {
+                _workerBudget->Release(_budgetJob, batchDevices);
+            }
+            batch.clear();
+            _queue->FinishBatch(workerIndex);
+            continue;
+        }
+
+        // Measured per batch, so workers meet on the shared counters once per dequeue.
+        std::uint64_t cost = 0;
+        const auto start = std::chrono::steady_clock::now();
+        ProcessBatch(batch);
+        const auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        if (nullptr != _workerBudget)
+        {
+            _workerBudget->Release(_budgetJob, batchDevices);
+        }
+        for (const auto& item : batch)
+        {
+            cost += item.costHint;
+        }
+        _completedItems.fetch_add(batch.size(), std::memory_order_relaxed);
+        _completedCost.fetch_add(cost, std::memory_order_relaxed);
+        _busyNs.fetch_add(static_cast<std::uint64_t>(busy.count()), std::memory_order_relaxed);
+        batch.clear();
+        _queue->FinishBatch(workerIndex);
+    }
+
+    if (nullptr != _onWorkerExit)
+    {
+        _onWorkerExit();
+    }
+}
+
+/**
+ * @brief Park a worker while it is above the active count.
+ *
+ * @param[in] workerIndex Index of the worker
+ * @return true once the worker may take files, including after Finalize so it drains the queue
+ */
+bool ThreadedWorkQueueBase::WaitUntilActive(std::size_t workerIndex)
+{
+    if ((false == _adaptive) || (workerIndex < _activeWorkers.load(std::memory_order_acquire)))
+    {
+        return true;
+    }
+    std::unique_lock<std::mutex> lock(_gateMutex);
+    _gateCv.wait(lock, [&]() { return (true == _finalized.load()) || (workerIndex < _activeWorkers.load(std::memory_order_acquire)); });
+    return true;
+}
+
+/**
+ * @brief Adaptive controller loop: hill-climb the active worker count on measured throughput.
+ *
+ * Each interval compares the throughput, in cost hint bytes plus one per file so files without hints
+ * still count, with the previous interval. A clear gain keeps the direction of the last step, a clear
+ * loss reverses it, and flat throughput at clearly higher per-file latency steps down, because the
+ * extra workers then only contend. Intervals without completed files carry no signal and are skipped.
  */
-void ThreadedFileQueue::WorkerLoop()
+void ThreadedWorkQueueBase::ControllerLoop()
 {
-    while (true)
+    const unsigned int maxActive = static_cast<unsigned int>(_workers.size());
+    const unsigned int step = std::max(1u, maxActive / AdaptStepDivisor);
+    int direction = 1;
+    double previousThroughput = -1.0;
+    double previousLatency = 0.0;
+    auto previousTime = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(_gateMutex);
+    while (false == _finalized.load())
     {
-        std::filesystem::path file;
+        _gateCv.wait_for(lock, _adaptInterval, [this]() { return _finalized.load(); });
+        if (true == _finalized.load())
+        {
+            return;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        const double seconds = std::chrono::duration<double>(now - previousTime).count();
+        previousTime = now;
+        const std::uint64_t items = _completedItems.exchange(0, std::memory_order_relaxed);
+        const std::uint64_t cost = _completedCost.exchange(0, std::memory_order_relaxed);
+        const std::uint64_t busyNs = _busyNs.exchange(0, std::memory_order_relaxed);
+        if ((0 == items) || (0.0 >= seconds))
         {
-            std::unique_lock lock(_queueMutex);
-            _queueCv.wait(lock, [&]() { return (true == _done) || (false == _fileQueue.empty()); });
-            if (true == _fileQueue.empty() && true == _done)
+            continue;
+        }
+        const double throughput = static_cast<double>(cost + items) / seconds;
+        const double latency = static_cast<double>(busyNs) / static_cast<double>(items);
+
+        if (0.0 <= previousThroughput)
+        {
+            if (throughput < previousThroughput * (1.0 - ThroughputTolerance))
             {
-                return;
+                direction = -direction;
             }
-            if (true == _fileQueue.empty())
+            else if ((throughput <= previousThroughput * (1.0 + ThroughputTolerance)) && (latency > previousLatency * (1.0 + LatencyTolerance)))
             {
-                continue;
+                direction = -1;
             }
-            file = std::move(_fileQueue.front());
-            _fileQueue.pop();
-            _queueCv.notify_all();
         }
-        _workItem(file);
+        previousThroughput = throughput;
+        previousLatency = latency;
+
+        const unsigned int active = _activeWorkers.load(std::memory_order_relaxed);
+        const unsigned int next = (0 < direction) ? std::min(maxActive, active + step)
+                                                  : std::max(_minActiveThreads, (active > step) ? active - step : _minActiveThreads);
+        if (next == active)
+        {
+            // At a bound: probe the other way next time.
+            direction = -direction;
+            continue;
+        }
+        _activeWorkers.store(next, std::memory_order_release);
+        if (next > active)
+        {
+            _gateCv.notify_all();
+        }
     }
 }
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Blocking queue backend behind ThreadedFileQueue.
+ */
+class WorkQueue
+{
+  public:
+    virtual ~WorkQueue() = default;
+
+    /**
+     * @brief Append a file, blocking while the queue is full.
+     *
+     * @param[in] item File to append; moved from
+     */
+    virtual void Push(FileWorkItem&& item) = 0;
+
+    /**
+     * @brief Append several files, blocking while the queue is full.
+     *
+     * Batches larger than the free space are appended in pieces as consumers make room.
+     *
+     * @param[in] items Files to append; left in a valid but unspecified state
+     */
+    virtual void PushBatch(std::vector<FileWorkItem>&& items) = 0;
+
+    /**
+     * @brief Remove up to maxCount files, blocking while the queue is empty and open.
+     *
+     * A consumer takes at most its fair share of what is queued, so a short queue is still
+     * spread across idle consumers.
+     *
+     * @param[in] workerIndex Index of the calling worker, below the consumer count
+     * @param[out] outputItems Vector the removed files are appended to
+     * @param[in] maxCount Maximum number of files to remove, at least 1
+     * @return Number of files removed, 0 once the queue is closed and drained
+     */
+    virtual std::size_t PopBatch(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount) = 0;
+
+    /**
+     * @brief Report that a consumer has processed the files of its last PopBatch.
+     *
+     * Backends that limit how many files are in flight per group free the consumer's slot here.
+     *
+     * @param[in] workerIndex Index of the calling worker
+     */
+    virtual void FinishBatch(std::size_t workerIndex)
+    {
+        (void)workerIndex;
+    }
+
+    /**
+     * @brief Mark the end of input and wake every waiting consumer.
+     */
+    virtual void Close() = 0;
+
+  protected:
+    /**
+     * @brief Number of files one consumer may take from a queue of the given length.
+     *
+     * @param[in] available Files currently queued
+     * @param[in] consumerCount Number of consumers sharing the queue
+     * @param[in] maxCount Caller's batch limit
+     * @return Batch size, at least 1
+     */
+    static std::size_t FairShare(std::size_t available, std::size_t consumerCount, std::size_t maxCount)
+    {
+        const std::size_t share = (available + consumerCount - 1) / std::max<std::size_t>(1, consumerCount);
+        return std::max<std::size_t>(1, std::min(share, maxCount));
+    }
+};
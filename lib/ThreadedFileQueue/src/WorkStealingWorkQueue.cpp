@@ -0,0 +1,294 @@
+#include "WorkStealingWorkQueue.hpp"
+
+#include <algorithm>
+
+namespace
+{
+constexpr std::uint64_t PerFileCost = 64 * 1024;
+constexpr std::uint64_t ClaimCostBudget = 64 * 1024 * 1024;
+constexpr int StealAttempts = 4;
+
+/**
+ * @brief Estimated cost of processing an item.
+ *
+ * Every file pays a fixed overhead for opening, stat'ing and recording it on top of its size,
+ * so many unknown or empty files still add up.
+ *
+ * @param[in] item Queued file
+ * @return Cost estimate in byte-equivalents
+ */
+std::uint64_t ItemCost(const FileWorkItem& item)
+{
+    return PerFileCost + item.costHint;
+}
+}
+
+WorkStealingWorkQueue::WorkStealingWorkQueue(std::size_t maxQueueSize, std::size_t consumerCount)
+    : _maxQueueSize(std::max<std::size_t>(1, maxQueueSize)), _resumeSize(_maxQueueSize / 2), _waitingProducers(0), _outstanding(0),
+      _sleepingWorkers(0), _closed(false)
+{
+    _workers.reserve(std::max<std::size_t>(1, consumerCount));
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, consumerCount); ++i)
+    {
+        _workers.push_back(std::make_unique<Worker>());
+    }
+}
+
+WorkStealingWorkQueue::~WorkStealingWorkQueue()
+{
+    for (auto& worker : _workers)
+    {
+        while (FileWorkItem* item = worker->deque.Pop())
+        {
+            delete item;
+        }
+    }
+}
+
+void WorkStealingWorkQueue::Push(FileWorkItem&& item)
+{
+    {
+        std::unique_lock lock(_injectorMutex);
+        WaitForSpace(lock);
+        // Counted before it becomes visible so a consumer can never take it first and underflow the count.
+        _outstanding.fetch_add(1);
+        _injector.push_back(std::move(item));
+    }
+    SignalWork(1);
+}
+
+void WorkStealingWorkQueue::PushBatch(std::vector<FileWorkItem>&& items)
+{
+    std::size_t next = 0;
+    while (next < items.size())
+    {
+        std::size_t count = 0;
+        {
+            std::unique_lock lock(_injectorMutex);
+            WaitForSpace(lock);
+            count = std::min(items.size() - next, _maxQueueSize - _injector.size());
+            _outstanding.fetch_add(count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                _injector.push_back(std::move(items[next++]));
+            }
+        }
+        SignalWork(count);
+    }
+}
+
+std::size_t WorkStealingWorkQueue::PopBatch(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount)
+{
+    // Items stay in the worker's deque, where they can still be stolen, until the worker is ready
+    // for the next one; handing out more than one at a time would hide them from thieves.
+    FileWorkItem item;
+    while (false == TryFind(workerIndex, maxCount, item))
+    {
+        // Announce the sleep before the final search so a concurrent push either becomes visible
+        // to it or sees the sleeper and wakes it.
+        const std::uint32_t ticket = _workSignal.Load();
+        _sleepingWorkers.fetch_add(1);
+        if (true == TryFind(workerIndex, maxCount, item))
+        {
+            _sleepingWorkers.fetch_sub(1);
+            break;
+        }
+        if ((true == _closed.load()) && (0 == _outstanding.load()))
+        {
+            _sleepingWorkers.fetch_sub(1);
+            return 0;
+        }
+        _workSignal.Wait(ticket);
+        _sleepingWorkers.fetch_sub(1);
+    }
+
+    outputItems.push_back(std::move(item));
+    if ((1 == _outstanding.fetch_sub(1)) && (true == _closed.load()))
+    {
+        _workSignal.Increment();
+        _workSignal.WakeAll();
+    }
+    return 1;
+}
+
+void WorkStealingWorkQueue::Close()
+{
+    _closed.store(true);
+    _workSignal.Increment();
+    _workSignal.WakeAll();
+}
+
+/**
+ * @brief Look for work: own deque first, then the injector, then other workers' deques.
+ *
+ * @param[in] workerIndex Index of the calling worker
+ * @param[in] maxCount Most items to claim from the injector at once
+ * @param[out] outputItem Item to process
+ * @return true if an item was found
+ */
+bool WorkStealingWorkQueue::TryFind(std::size_t workerIndex, std::size_t maxCount, FileWorkItem& outputItem)
+{
+    Worker& worker = *_workers[workerIndex % _workers.size()];
+    return (true == TryTakeLocal(worker, outputItem)) || (true == TryClaimInjected(worker, maxCount, outputItem)) ||
+           (true == TrySteal(workerIndex % _workers.size(), outputItem));
+}
+
+/**
+ * @brief Pop the most recently claimed item from the worker's own deque.
+ *
+ * @param[in/out] worker Calling worker
+ * @param[out] outputItem Item to process
+ * @return true if the deque was not empty
+ */
+bool WorkStealingWorkQueue::TryTakeLocal(Worker& worker, FileWorkItem& outputItem)
+{
+    FileWorkItem* item = worker.deque.Pop();
+    if (nullptr == item)
+    {
+        return false;
+    }
+    worker.pendingCost.fetch_sub(ItemCost(*item), std::memory_order_relaxed);
+    outputItem = std::move(*item);
+    delete item;
+    return true;
+}
+
+/**
+ * @brief Move a batch from the injector into the worker's deque and return its first item.
+ *
+ * The batch is limited to the worker's fair share, to maxCount items and to ClaimCostBudget,
+ * so one worker does not hoard several large files while others go idle.
+ *
+ * @param[in/out] worker Calling worker
+ * @param[in] maxCount Most items to claim
+ * @param[out] outputItem Item to process
+ * @return true if the injector was not empty
+ */
+bool WorkStealingWorkQueue::TryClaimInjected(Worker& worker, std::size_t maxCount, FileWorkItem& outputItem)
+{
+    bool wakeProducer = false;
+    {
+        std::lock_guard lock(_injectorMutex);
+        if (true == _injector.empty())
+        {
+            return false;
+        }
+        const std::size_t limit = FairShare(_injector.size(), _workers.size(), maxCount);
+        outputItem = std::move(_injector.front());
+        _injector.pop_front();
+        std::uint64_t claimedCost = ItemCost(outputItem);
+        while ((worker.claimed.size() + 1 < limit) && (false == _injector.empty()) && (ClaimCostBudget > claimedCost))
+        {
+            claimedCost += ItemCost(_injector.front());
+            worker.claimed.push_back(new FileWorkItem(std::move(_injector.front())));
+            _injector.pop_front();
+        }
+        wakeProducer = (0 < _waitingProducers) && (_resumeSize >= _injector.size());
+    }
+    if (true == wakeProducer)
+    {
+        _notFullCv.notify_one();
+    }
+
+    if (true == worker.claimed.empty())
+    {
+        return true;
+    }
+    // Pushed in reverse so the owner pops them in arrival order and thieves take the newest.
+    for (auto item = worker.claimed.rbegin(); item != worker.claimed.rend(); ++item)
+    {
+        worker.pendingCost.fetch_add(ItemCost(**item), std::memory_order_relaxed);
+        worker.deque.Push(*item);
+    }
+    const std::size_t claimedCount = worker.claimed.size();
+    worker.claimed.clear();
+    // The rest of the batch is stealable now; let sleeping workers know.
+    SignalWork(claimedCount);
+    return true;
+}
+
+/**
+ * @brief Steal an item, trying the worker with the most pending cost first.
+ *
+ * @param[in] workerIndex Index of the calling worker
+ * @param[out] outputItem Item to process
+ * @return true if an item was stolen
+ */
+bool WorkStealingWorkQueue::TrySteal(std::size_t workerIndex, FileWorkItem& outputItem)
+{
+    const std::size_t workerCount = _workers.size();
+    std::size_t richest = workerIndex;
+    std::uint64_t richestCost = 0;
+    for (std::size_t offset = 1; offset < workerCount; ++offset)
+    {
+        const std::size_t victim = (workerIndex + offset) % workerCount;
+        const std::uint64_t cost = _workers[victim]->pendingCost.load(std::memory_order_relaxed);
+        if (richestCost < cost)
+        {
+            richest = victim;
+            richestCost = cost;
+        }
+    }
+
+    for (std::size_t offset = 0; offset < workerCount; ++offset)
+    {
+        const std::size_t victim = (richest + offset) % workerCount;
+        if (workerIndex == victim)
+        {
+            continue;
+        }
+        Worker& victimWorker = *_workers[victim];
+        for (int attempt = 0; (attempt < StealAttempts) && (0 < victimWorker.deque.SizeHint()); ++attempt)
+        {
+            FileWorkItem* item = victimWorker.deque.Steal();
+            if (nullptr != item)
+            {
+                victimWorker.pendingCost.fetch_sub(ItemCost(*item), std::memory_order_relaxed);
+                outputItem = std::move(*item);
+                delete item;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Block the calling producer until the injector has room for at least one item.
+ *
+ * @param[in/out] lock Held lock on the injector mutex
+ */
+void WorkStealingWorkQueue::WaitForSpace(std::unique_lock<std::mutex>& lock)
+{
+    if (_injector.size() < _maxQueueSize)
+    {
+        return;
+    }
+    ++_waitingProducers;
+    _notFullCv.wait(lock, [&]() { return _injector.size() < _maxQueueSize; });
+    --_waitingProducers;
+}
+
+/**
+ * @brief Publish new work and wake up to one sleeping worker per item.
+ *
+ * @param[in] count Number of items made available
+ */
+void WorkStealingWorkQueue::SignalWork(std::size_t count)
+{
+    if (0 == count)
+    {
+        return;
+    }
+    _workSignal.Increment();
+    const std::size_t sleeping = _sleepingWorkers.load();
+    if ((1 < sleeping) && (count >= sleeping))
+    {
+        _workSignal.WakeAll();
+        return;
+    }
+    for (std::size_t i = 0; i < std::min(count, sleeping); ++i)
+    {
+        _workSignal.WakeOne();
+    }
+}
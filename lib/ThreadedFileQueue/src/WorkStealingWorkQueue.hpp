@@ -0,0 +1,76 @@
+#pragma once
+
+#include "ChaseLevDeque.hpp"
+#include "ParkingWord.hpp"
+#include "WorkQueue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Work queue backend with a per-worker Chase-Lev deque and work stealing.
+ *
+ * Producers append to a bounded injector queue. A worker with nothing local claims a batch
+ * from the injector into its own deque, limited by count and by the summed cost hints, and
+ * then works through it lock-free. Idle workers steal from the deque with the most pending
+ * cost, so small files queued behind a huge one are picked up by other workers.
+ */
+class WorkStealingWorkQueue : public WorkQueue
+{
+  public:
+    /**
+     * @brief Create an empty queue.
+     *
+     * @param[in] maxQueueSize Maximum items in the injector before producers block
+     * @param[in] consumerCount Number of worker threads, each with its own deque
+     */
+    WorkStealingWorkQueue(std::size_t maxQueueSize, std::size_t consumerCount);
+
+    /**
+     * @brief Destroy the queue and any items never handed out.
+     */
+    ~WorkStealingWorkQueue() override;
+
+    void Push(FileWorkItem&& item) override;
+    void PushBatch(std::vector<FileWorkItem>&& items) override;
+    std::size_t PopBatch(std::size_t workerIndex, std::vector<FileWorkItem>& outputItems, std::size_t maxCount) override;
+    void Close() override;
+
+  private:
+    static constexpr std::size_t CacheLineSize = 64;
+
+    /**
+     * @brief State owned by one worker.
+     */
+    struct alignas(CacheLineSize) Worker
+    {
+        ChaseLevDeque<FileWorkItem> deque;        /**< Claimed items, owner pops the bottom, thieves steal the top */
+        std::atomic<std::uint64_t> pendingCost{0}; /**< Summed cost of the items in deque */
+        std::vector<FileWorkItem*> claimed;       /**< Owner-only scratch buffer for injector claims */
+    };
+
+    bool TryFind(std::size_t workerIndex, std::size_t maxCount, FileWorkItem& outputItem);
+    bool TryTakeLocal(Worker& worker, FileWorkItem& outputItem);
+    bool TryClaimInjected(Worker& worker, std::size_t maxCount, FileWorkItem& outputItem);
+    bool TrySteal(std::size_t workerIndex, FileWorkItem& outputItem);
+    void WaitForSpace(std::unique_lock<std::mutex>& lock);
+    void SignalWork(std::size_t count);
+
+    std::size_t _maxQueueSize;
+    std::size_t _resumeSize;
+    std::mutex _injectorMutex;
+    std::condition_variable _notFullCv;
+    std::deque<FileWorkItem> _injector;
+    std::size_t _waitingProducers;
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<std::size_t> _outstanding;
+    ParkingWord _workSignal;
+    std::atomic<std::uint32_t> _sleepingWorkers;
+    std::atomic<bool> _closed;
+};
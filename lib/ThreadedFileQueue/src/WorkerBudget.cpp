@@ -0,0 +1,137 @@
+#include "ThreadedFileQueue/WorkerBudget.hpp"
+
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+
+#include <algorithm>
+#include <thread>
+
+WorkerBudget::WorkerBudget(unsigned int slots, const std::function<unsigned int(std::uint64_t)>& deviceConcurrency)
+    : _slots(std::max(1u, slots)), _deviceConcurrency((nullptr != deviceConcurrency) ? deviceConcurrency : DetectDeviceConcurrency), _busySlots(0),
+      _nextJob(0)
+{
+}
+
+std::shared_ptr<WorkerBudget> WorkerBudget::ProcessWide()
+{
+    static const std::shared_ptr<WorkerBudget> budget = std::make_shared<WorkerBudget>(std::max(1u, std::thread::hardware_concurrency()));
+    return budget;
+}
+
+std::size_t WorkerBudget::Join(unsigned int weight)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::size_t job = _nextJob++;
+    _jobs.emplace(job, Job{std::max(1u, weight), 0, {}});
+    return job;
+}
+
+void WorkerBudget::Leave(std::size_t job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.erase(job);
+    }
+    // The job may have been the one the others deferred to.
+    _cv.notify_all();
+}
+
+void WorkerBudget::Acquire(std::size_t job, const std::vector<std::uint64_t>& devices)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    Job& self = _jobs.at(job);
+    self.waiting.push_back(&devices);
+    _cv.wait(lock, [&]() { return CanStart(self, devices); });
+    self.waiting.erase(std::find(self.waiting.begin(), self.waiting.end(), &devices));
+    ++self.busy;
+    ++_busySlots;
+    for (const std::uint64_t device : devices)
+    {
+        ++_deviceBusy[device];
+    }
+}
+
+void WorkerBudget::Release(std::size_t job, const std::vector<std::uint64_t>& devices)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        --_jobs.at(job).busy;
+        --_busySlots;
+        for (const std::uint64_t device : devices)
+        {
+            auto busy = _deviceBusy.find(device);
+            if (0 == --busy->second)
+            {
+                _deviceBusy.erase(busy);
+            }
+        }
+    }
+    // Waiters of several jobs and devices may be unblocked, and each checks its own share.
+    _cv.notify_all();
+}
+
+unsigned int WorkerBudget::Slots() const
+{
+    return _slots;
+}
+
+bool WorkerBudget::DevicesHaveRoom(const std::vector<std::uint64_t>& devices)
+{
+    for (const std::uint64_t device : devices)
+    {
+        const unsigned int limit = DeviceLimit(device);
+        const auto busy = _deviceBusy.find(device);
+        if ((0 != limit) && (_deviceBusy.end() != busy) && (limit <= busy->second))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Check whether a waiting batch may start: a slot is free, its devices have room, and no job that
+ *        could start a batch is further below its weighted share.
+ *
+ * Shares are compared as busy / weight, cross-multiplied to stay in integers. Equal shares may both start.
+ *
+ * @param[in] job Job of the waiting worker
+ * @param[in] devices Devices of the waiting batch
+ * @return true if the batch may start now
+ */
+bool WorkerBudget::CanStart(const Job& job, const std::vector<std::uint64_t>& devices)
+{
+    if ((_slots <= _busySlots) || (false == DevicesHaveRoom(devices)))
+    {
+        return false;
+    }
+    for (const auto& other : _jobs)
+    {
+        const Job& rival = other.second;
+        if ((&rival == &job) || (rival.busy * job.weight >= job.busy * rival.weight))
+        {
+            continue;
+        }
+        for (const std::vector<std::uint64_t>* waitingDevices : rival.waiting)
+        {
+            if (true == DevicesHaveRoom(*waitingDevices))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+unsigned int WorkerBudget::DeviceLimit(std::uint64_t device)
+{
+    if (0 == device)
+    {
+        return 0;
+    }
+    auto limit = _deviceLimits.find(device);
+    if (_deviceLimits.end() == limit)
+    {
+        limit = _deviceLimits.emplace(device, _deviceConcurrency(device)).first;
+    }
+    return limit->second;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+
+/**
+ * @brief Facts fixed for the whole of one run, captured once when the run starts.
+ *
+ * Every row a run writes and the snapshot directory it creates carry the run's timestamp, which is
+ * formatted here a single time instead of once per file.
+ */
+class RunContext
+{
+  public:
+    /**
+     * @brief Capture the current time as the run's start.
+     */
+    RunContext();
+
+    /**
+     * @brief Continue a run that started earlier.
+     *
+     * @param[in] timestamp Timestamp recorded when the run started
+     */
+    explicit RunContext(std::string timestamp);
+
+    /**
+     * @brief Get the run timestamp recorded in the database and used as snapshot name.
+     *
+     * @return Filesystem-safe timestamp of the run's start
+     */
+    const std::string& Timestamp() const;
+
+  private:
+    std::string _timestamp;
+};
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <ctime>
 #include <string>
+#include <string_view>
 
 /**
  * @brief Infrastructure component providing timestamp strings using C time APIs.
@@ -14,4 +17,32 @@ class TimestampProvider
      * @return Timestamp string formatted for file names
      */
     std::string NowFilesystemSafe() const;
+
+    /**
+     * @brief Format a point in time as a filesystem-safe timestamp string in local time.
+     *
+     * @param[in] time Point in time to format
+     * @return Timestamp string formatted for file names
+     */
+    static std::string FormatFilesystemSafe(std::time_t time);
+
+    /**
+     * @brief Encode a filesystem-safe timestamp as seconds since 1970-01-01_00-00-00 of the same wall clock.
+     *
+     * The fields are counted as they read, without a time zone, so the values order like the strings and
+     * FormatWallClockSeconds gives the same string back on any machine.
+     *
+     * @param[in] timestamp Timestamp formatted by FormatFilesystemSafe
+     * @param[out] outputSeconds Encoded timestamp
+     * @return true on success, false if the timestamp is malformed
+     */
+    static bool ParseWallClockSeconds(std::string_view timestamp, std::int64_t& outputSeconds);
+
+    /**
+     * @brief Format seconds encoded by ParseWallClockSeconds as a filesystem-safe timestamp.
+     *
+     * @param[in] seconds Encoded timestamp
+     * @param[out] outputTimestamp Timestamp string; its buffer is reused
+     */
+    static void FormatWallClockSeconds(std::int64_t seconds, std::string& outputTimestamp);
 };
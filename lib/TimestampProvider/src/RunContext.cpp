@@ -0,0 +1,19 @@
+#include "TimestampProvider/RunContext.hpp"
+
+#include "TimestampProvider/TimestampProvider.hpp"
+
+#include <ctime>
+#include <utility>
+
+RunContext::RunContext() : _timestamp(TimestampProvider::FormatFilesystemSafe(std::time(nullptr)))
+{
+}
+
+RunContext::RunContext(std::string timestamp) : _timestamp(std::move(timestamp))
+{
+}
+
+const std::string& RunContext::Timestamp() const
+{
+    return _timestamp;
+}
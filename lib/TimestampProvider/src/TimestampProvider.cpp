@@ -1,24 +1,121 @@
 #include "TimestampProvider/TimestampProvider.hpp"
 
-#include <ctime>
-
 namespace
 {
 constexpr std::size_t TimestampBufferSize = 32;
+constexpr std::int64_t SecondsPerDay = 86400;
+constexpr const char* WallClockPattern = "dddd-dd-dd_dd-dd-dd";
+
+/**
+ * @brief Count the days from 1970-01-01 to a date of the proleptic Gregorian calendar.
+ */
+std::int64_t DaysFromCivil(std::int64_t year, std::int64_t month, std::int64_t day)
+{
+    year -= (month <= 2) ? 1 : 0;
+    const std::int64_t era = ((0 <= year) ? year : (year - 399)) / 400;
+    const std::int64_t yearOfEra = year - (era * 400);
+    const std::int64_t dayOfYear = ((153 * (month + ((2 < month) ? -3 : 9))) + 2) / 5 + day - 1;
+    const std::int64_t dayOfEra = (yearOfEra * 365) + (yearOfEra / 4) - (yearOfEra / 100) + dayOfYear;
+    return (era * 146097) + dayOfEra - 719468;
 }
 
+/**
+ * @brief Write a number as a fixed number of decimal digits.
+ */
+void AppendDigits(std::int64_t value, int digits, std::string& output)
+{
+    char buffer[TimestampBufferSize];
+    for (int index = digits - 1; 0 <= index; --index)
+    {
+        buffer[index] = static_cast<char>('0' + (value % 10));
+        value /= 10;
+    }
+    output.append(buffer, static_cast<std::size_t>(digits));
+}
+} // namespace
+
 std::string TimestampProvider::NowFilesystemSafe() const
 {
-    std::time_t currentTime = std::time(nullptr);
+    return FormatFilesystemSafe(std::time(nullptr));
+}
+
+std::string TimestampProvider::FormatFilesystemSafe(std::time_t time)
+{
     std::tm timeStruct{};
 
 #ifdef _WIN32
-    _localtime64_s(&timeStruct, &currentTime);
+    _localtime64_s(&timeStruct, &time);
 #else
-    localtime_r(&currentTime, &timeStruct);
+    localtime_r(&time, &timeStruct);
 #endif
 
     char buffer[TimestampBufferSize];
     std::strftime(buffer, sizeof(buffer), "%Y-%m-%d_%H-%M-%S", &timeStruct);
     return buffer;
 }
+
+bool TimestampProvider::ParseWallClockSeconds(std::string_view timestamp, std::int64_t& outputSeconds)
+{
+    const std::string_view pattern(WallClockPattern);
+    if (pattern.size() != timestamp.size())
+    {
+        return false;
+    }
+    for (std::size_t index = 0; index < pattern.size(); ++index)
+    {
+        const bool digit = ('0' <= timestamp[index]) && (timestamp[index] <= '9');
+        if ((('d' == pattern[index]) && (false == digit)) || (('d' != pattern[index]) && (pattern[index] != timestamp[index])))
+        {
+            return false;
+        }
+    }
+    auto field = [&timestamp](std::size_t offset, std::size_t length)
+    {
+        std::int64_t value = 0;
+        for (std::size_t index = offset; index < offset + length; ++index)
+        {
+            value = (value * 10) + (timestamp[index] - '0');
+        }
+        return value;
+    };
+    const std::int64_t month = field(5, 2);
+    const std::int64_t day = field(8, 2);
+    const std::int64_t hour = field(11, 2);
+    const std::int64_t minute = field(14, 2);
+    const std::int64_t second = field(17, 2);
+    if ((month < 1) || (12 < month) || (day < 1) || (31 < day) || (23 < hour) || (59 < minute) || (60 < second))
+    {
+        return false;
+    }
+    outputSeconds = (DaysFromCivil(field(0, 4), month, day) * SecondsPerDay) + (hour * 3600) + (minute * 60) + second;
+    return true;
+}
+
+void TimestampProvider::FormatWallClockSeconds(std::int64_t seconds, std::string& outputTimestamp)
+{
+    const std::int64_t days = ((0 <= seconds) ? seconds : (seconds - SecondsPerDay + 1)) / SecondsPerDay;
+    const std::int64_t secondOfDay = seconds - (days * SecondsPerDay);
+    // Inverse of DaysFromCivil.
+    const std::int64_t shifted = days + 719468;
+    const std::int64_t era = ((0 <= shifted) ? shifted : (shifted - 146096)) / 146097;
+    const std::int64_t dayOfEra = shifted - (era * 146097);
+    const std::int64_t yearOfEra = (dayOfEra - (dayOfEra / 1460) + (dayOfEra / 36524) - (dayOfEra / 146096)) / 365;
+    const std::int64_t dayOfYear = dayOfEra - ((365 * yearOfEra) + (yearOfEra / 4) - (yearOfEra / 100));
+    const std::int64_t monthIndex = ((5 * dayOfYear) + 2) / 153;
+    const std::int64_t day = dayOfYear - (((153 * monthIndex) + 2) / 5) + 1;
+    const std::int64_t month = monthIndex + ((monthIndex < 10) ? 3 : -9);
+    const std::int64_t year = yearOfEra + (era * 400) + ((month <= 2) ? 1 : 0);
+
+    outputTimestamp.clear();
+    AppendDigits(year, 4, outputTimestamp);
+    outputTimestamp += '-';
+    AppendDigits(month, 2, outputTimestamp);
+    outputTimestamp += '-';
+    AppendDigits(day, 2, outputTimestamp);
+    outputTimestamp += '_';
+    AppendDigits(secondOfDay / 3600, 2, outputTimestamp);
+    outputTimestamp += '-';
+    AppendDigits((secondOfDay / 60) % 60, 2, outputTimestamp);
+    outputTimestamp += '-';
+    AppendDigits(secondOfDay % 60, 2, outputTimestamp);
+}
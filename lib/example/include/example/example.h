@@ -1,6 +1,9 @@
 #ifndef EXAMPLE_H
 #define EXAMPLE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -35,11 +38,79 @@ int classify(int value);
 /**
  * @brief Compute factorial of n.
  *
+ * Looked up in a table of the 13 factorials an int holds.
+ *
  * @param n Non-negative integer
- * @return n! on success, -1 if n is negative
+ * @return n! on success, -1 if n is negative or n! does not fit in an int (n > 12)
  */
 int factorial(int n);
 
+/**
+ * @brief Instruction sets the batch functions can run on.
+ */
+typedef enum example_simd {
+    EXAMPLE_SIMD_SCALAR = 0, /**< Portable loop */
+    EXAMPLE_SIMD_SSE41 = 1,  /**< 4 lanes, x86 with SSE4.1 */
+    EXAMPLE_SIMD_AVX2 = 2,   /**< 8 lanes, x86 with AVX2 */
+    EXAMPLE_SIMD_NEON = 3    /**< 4 lanes, AArch64 */
+} example_simd;
+
+/**
+ * @brief Get the fastest instruction set this processor supports.
+ *
+ * @return Best supported instruction set
+ */
+example_simd example_simd_detect(void);
+
+/**
+ * @brief Get the instruction set the batch functions currently run on.
+ *
+ * @return The detected instruction set unless example_simd_select chose another
+ */
+example_simd example_simd_active(void);
+
+/**
+ * @brief Make the batch functions run on a given instruction set, e.g. to compare them.
+ *
+ * Batch calls already running on other threads finish on the instruction set they started with.
+ *
+ * @param simd Instruction set to use
+ * @return 0 on success, -1 if the processor or the build does not support it
+ */
+int example_simd_select(example_simd simd);
+
+/**
+ * @brief Add two arrays element by element.
+ *
+ * Sums wrap around modulo 2^32 instead of overflowing.
+ *
+ * @param a   First operands
+ * @param b   Second operands
+ * @param out Sums; may alias a or b
+ * @param n   Number of elements
+ */
+void add_n(const int32_t* a, const int32_t* b, int32_t* out, size_t n);
+
+/**
+ * @brief Clamp every element of an array to the range [min, max], as clamp does.
+ *
+ * @param values Values to clamp
+ * @param out    Clamped values; may alias values
+ * @param n      Number of elements
+ * @param min    Lower bound
+ * @param max    Upper bound
+ */
+void clamp_n(const int32_t* values, int32_t* out, size_t n, int32_t min, int32_t max);
+
+/**
+ * @brief Classify every element of an array, as classify does.
+ *
+ * @param values Values to classify
+ * @param out    Classes -1, 0, 1 or 2; may alias values
+ * @param n      Number of elements
+ */
+void classify_n(const int32_t* values, int32_t* out, size_t n);
+
 #ifdef __cplusplus
 }
 #endif
@@ -27,12 +27,14 @@ int classify(int value) {
     return 2;
 }
 
+/* 0! to 12!; 13! no longer fits in a 32-bit int. */
+static const int factorials[] = {
+    1, 1, 2, 6, 24, 120, 720, 5040, 40320, 362880, 3628800, 39916800, 479001600,
+};
+
 int factorial(int n) {
-    if (n < 0) {
+    if ((n < 0) || (n >= (int)(sizeof(factorials) / sizeof(factorials[0])))) {
         return -1;
     }
-    if (n == 0) {
-        return 1;
-    }
-    return n * factorial(n - 1);
+    return factorials[n];
 }
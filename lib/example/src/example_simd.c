@@ -0,0 +1,353 @@
+#include <example/example.h>
+
+/*
+ * Batch variants of add, clamp and classify. Every instruction set gets its own kernel, compiled for
+ * that set alone through a target attribute, so the library builds for the baseline processor and
+ * picks the widest kernel the running processor supports. Each kernel handles whole vectors and
+ * leaves the remaining elements to the scalar loop, so all of them produce the same output.
+ */
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define EXAMPLE_HAVE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define EXAMPLE_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define EXAMPLE_TARGET(isa) __attribute__((target(isa)))
+#else
+#define EXAMPLE_TARGET(isa)
+#endif
+
+/*
+ * Instruction set in use, or -1 until the first call detects one. Batch calls on any thread may race
+ * to detect it; they all store the same value, so relaxed atomic loads and stores suffice.
+ */
+#if defined(_MSC_VER)
+/* MSVC's C compiler has no <stdatomic.h> without /experimental:c11atomics. */
+#include <intrin.h>
+static volatile long selected_simd = -1;
+
+static int load_selected_simd(void) {
+    return (int)__iso_volatile_load32((const volatile __int32*)&selected_simd);
+}
+
+static void store_selected_simd(int simd) {
+    __iso_volatile_store32((volatile __int32*)&selected_simd, (__int32)simd);
+}
+#else
+#include <stdatomic.h>
+static _Atomic int selected_simd = -1;
+
+static int load_selected_simd(void) {
+    return atomic_load_explicit(&selected_simd, memory_order_relaxed);
+}
+
+static void store_selected_simd(int simd) {
+    atomic_store_explicit(&selected_simd, simd, memory_order_relaxed);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Scalar                                                                    */
+/* ------------------------------------------------------------------------- */
+
+static int32_t add_wrapping(int32_t a, int32_t b) {
+    return (int32_t)((uint32_t)a + (uint32_t)b);
+}
+
+static void add_n_scalar(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = add_wrapping(a[i], b[i]);
+    }
+}
+
+static void clamp_n_scalar(const int32_t* values, int32_t* out, size_t n, int32_t min, int32_t max) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = clamp(values[i], min, max);
+    }
+}
+
+static void classify_n_scalar(const int32_t* values, int32_t* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = classify(values[i]);
+    }
+}
+
+#ifdef EXAMPLE_HAVE_X86
+/* ------------------------------------------------------------------------- */
+/* SSE4.1: 4 lanes                                                           */
+/* ------------------------------------------------------------------------- */
+
+EXAMPLE_TARGET("sse4.1")
+static void add_n_sse41(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+        const __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(x, y));
+    }
+    add_n_scalar(a + i, b + i, out + i, n - i);
+}
+
+EXAMPLE_TARGET("sse4.1")
+static void clamp_n_sse41(const int32_t* values, int32_t* out, size_t n, int32_t min, int32_t max) {
+    const __m128i lower = _mm_set1_epi32(min);
+    const __m128i upper = _mm_set1_epi32(max);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i value = _mm_loadu_si128((const __m128i*)(values + i));
+        /* Like clamp, a value below min becomes min even when min > max. */
+        const __m128i below = _mm_cmpgt_epi32(lower, value);
+        const __m128i result = _mm_blendv_epi8(_mm_min_epi32(value, upper), lower, below);
+        _mm_storeu_si128((__m128i*)(out + i), result);
+    }
+    clamp_n_scalar(values + i, out + i, n - i, min, max);
+}
+
+EXAMPLE_TARGET("sse4.1")
+static void classify_n_sse41(const int32_t* values, int32_t* out, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i hundred = _mm_set1_epi32(100);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i value = _mm_loadu_si128((const __m128i*)(values + i));
+        /* Comparisons yield -1 for true: negative - positive - large gives -1, 0, 1 or 2. */
+        const __m128i negative = _mm_cmpgt_epi32(zero, value);
+        const __m128i positive = _mm_cmpgt_epi32(value, zero);
+        const __m128i large = _mm_cmpgt_epi32(value, hundred);
+        const __m128i result = _mm_sub_epi32(_mm_sub_epi32(negative, positive), large);
+        _mm_storeu_si128((__m128i*)(out + i), result);
+    }
+    classify_n_scalar(values + i, out + i, n - i);
+}
+
+/* ------------------------------------------------------------------------- */
+/* AVX2: 8 lanes                                                             */
+/* ------------------------------------------------------------------------- */
+
+EXAMPLE_TARGET("avx2")
+static void add_n_avx2(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+        const __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(x, y));
+    }
+    add_n_scalar(a + i, b + i, out + i, n - i);
+}
+
+EXAMPLE_TARGET("avx2")
+static void clamp_n_avx2(const int32_t* values, int32_t* out, size_t n, int32_t min, int32_t max) {
+    const __m256i lower = _mm256_set1_epi32(min);
+    const __m256i upper = _mm256_set1_epi32(max);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i value = _mm256_loadu_si256((const __m256i*)(values + i));
+        const __m256i below = _mm256_cmpgt_epi32(lower, value);
+        const __m256i result = _mm256_blendv_epi8(_mm256_min_epi32(value, upper), lower, below);
+        _mm256_storeu_si256((__m256i*)(out + i), result);
+    }
+    clamp_n_scalar(values + i, out + i, n - i, min, max);
+}
+
+EXAMPLE_TARGET("avx2")
+static void classify_n_avx2(const int32_t* values, int32_t* out, size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i hundred = _mm256_set1_epi32(100);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i value = _mm256_loadu_si256((const __m256i*)(values + i));
+        const __m256i negative = _mm256_cmpgt_epi32(zero, value);
+        const __m256i positive = _mm256_cmpgt_epi32(value, zero);
+        const __m256i large = _mm256_cmpgt_epi32(value, hundred);
+        const __m256i result = _mm256_sub_epi32(_mm256_sub_epi32(negative, positive), large);
+        _mm256_storeu_si256((__m256i*)(out + i), result);
+    }
+    classify_n_scalar(values + i, out + i, n - i);
+}
+
+static int x86_supports(example_simd simd) {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    __cpuid(info, 1);
+    if (simd == EXAMPLE_SIMD_SSE41) {
+        return (info[2] >> 19) & 1;
+    }
+    /* AVX2 also needs the operating system to save the YMM registers. */
+    if ((((info[2] >> 27) & 1) == 0) || (((info[2] >> 28) & 1) == 0) || (max_leaf < 7) || ((_xgetbv(0) & 6) != 6)) {
+        return 0;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] >> 5) & 1;
+#else
+    __builtin_cpu_init();
+    if (simd == EXAMPLE_SIMD_SSE41) {
+        return __builtin_cpu_supports("sse4.1") ? 1 : 0;
+    }
+    return __builtin_cpu_supports("avx2") ? 1 : 0;
+#endif
+}
+#endif
+
+#ifdef EXAMPLE_HAVE_NEON
+/* ------------------------------------------------------------------------- */
+/* NEON: 4 lanes, always present on AArch64                                  */
+/* ------------------------------------------------------------------------- */
+
+static void add_n_neon(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_s32(out + i, vaddq_s32(vld1q_s32(a + i), vld1q_s32(b + i)));
+    }
+    add_n_scalar(a + i, b + i, out + i, n - i);
+}
+
+static void clamp_n_neon(const int32_t* values, int32_t* out, size_t n, int32_t min, int32_t max) {
+    const int32x4_t lower = vdupq_n_s32(min);
+    const int32x4_t upper = vdupq_n_s32(max);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const int32x4_t value = vld1q_s32(values + i);
+        const uint32x4_t below = vcltq_s32(value, lower);
+        vst1q_s32(out + i, vbslq_s32(below, lower, vminq_s32(value, upper)));
+    }
+    clamp_n_scalar(values + i, out + i, n - i, min, max);
+}
+
+static void classify_n_neon(const int32_t* values, int32_t* out, size_t n) {
+    const int32x4_t zero = vdupq_n_s32(0);
+    const int32x4_t hundred = vdupq_n_s32(100);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const int32x4_t value = vld1q_s32(values + i);
+        const int32x4_t negative = vreinterpretq_s32_u32(vcltq_s32(value, zero));
+        const int32x4_t positive = vreinterpretq_s32_u32(vcgtq_s32(value, zero));
+        const int32x4_t large = vreinterpretq_s32_u32(vcgtq_s32(value, hundred));
+        vst1q_s32(out + i, vsubq_s32(vsubq_s32(negative, positive), large));
+    }
+    classify_n_scalar(values + i, out + i, n - i);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Dispatch                                                                  */
+/* ------------------------------------------------------------------------- */
+
+static int simd_supported(example_simd simd) {
+    switch (simd) {
+    case EXAMPLE_SIMD_SCALAR:
+        return 1;
+#ifdef EXAMPLE_HAVE_X86
+    case EXAMPLE_SIMD_SSE41:
+    case EXAMPLE_SIMD_AVX2:
+        return x86_supports(simd);
+#endif
+#ifdef EXAMPLE_HAVE_NEON
+    case EXAMPLE_SIMD_NEON:
+        return 1;
+#endif
+    default:
+        return 0;
+    }
+}
+
+example_simd example_simd_detect(void) {
+    if (simd_supported(EXAMPLE_SIMD_AVX2)) {
+        return EXAMPLE_SIMD_AVX2;
+    }
+    if (simd_supported(EXAMPLE_SIMD_SSE41)) {
+        return EXAMPLE_SIMD_SSE41;
+    }
+    if (simd_supported(EXAMPLE_SIMD_NEON)) {
+        return EXAMPLE_SIMD_NEON;
+    }
+    return EXAMPLE_SIMD_SCALAR;
+}
+
+example_simd example_simd_active(void) {
+    int simd = load_selected_simd();
+    if (simd < 0) {
+        simd = (int)example_simd_detect();
+        store_selected_simd(simd);
+    }
+    return (example_simd)simd;
+}
+
+int example_simd_select(example_simd simd) {
+    if (!simd_supported(simd)) {
+        return -1;
+    }
+    store_selected_simd((int)simd);
+    return 0;
+}
+
+void add_n(const int32_t* a, const int32_t* b, int32_t* out, size_t n) {
+    switch (example_simd_active()) {
+#ifdef EXAMPLE_HAVE_X86
+    case EXAMPLE_SIMD_AVX2:
+        add_n_avx2(a, b, out, n);
+        return;
+    case EXAMPLE_SIMD_SSE41:
+        add_n_sse41(a, b, out, n);
+        return;
+#endif
+#ifdef EXAMPLE_HAVE_NEON
+    case EXAMPLE_SIMD_NEON:
+        add_n_neon(a, b, out, n);
+        return;
+#endif
+    default:
+        add_n_scalar(a, b, out, n);
+        return;
+    }
+}
+
+void clamp_n(const int32_t* values, int32_t* out, size_t n, int32_t min, int32_t max) {
+    switch (example_simd_active()) {
+#ifdef EXAMPLE_HAVE_X86
+    case EXAMPLE_SIMD_AVX2:
+        clamp_n_avx2(values, out, n, min, max);
+        return;
+    case EXAMPLE_SIMD_SSE41:
+        clamp_n_sse41(values, out, n, min, max);
+        return;
+#endif
+#ifdef EXAMPLE_HAVE_NEON
+    case EXAMPLE_SIMD_NEON:
+        clamp_n_neon(values, out, n, min, max);
+        return;
+#endif
+    default:
+        clamp_n_scalar(values, out, n, min, max);
+        return;
+    }
+}
+
+void classify_n(const int32_t* values, int32_t* out, size_t n) {
+    switch (example_simd_active()) {
+#ifdef EXAMPLE_HAVE_X86
+    case EXAMPLE_SIMD_AVX2:
+        classify_n_avx2(values, out, n);
+        return;
+    case EXAMPLE_SIMD_SSE41:
+        classify_n_sse41(values, out, n);
+        return;
+#endif
+#ifdef EXAMPLE_HAVE_NEON
+    case EXAMPLE_SIMD_NEON:
+        classify_n_neon(values, out, n);
+        return;
+#endif
+    default:
+        classify_n_scalar(values, out, n);
+        return;
+    }
+}
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Performance regression gate for a Google Benchmark executable.
+
+Runs the benchmarks named by the baseline's filter several times, summarizes each one's throughput by
+its median and median absolute deviation (MAD), and fails when a median falls more than the tolerance
+below the baseline's median by more than the noise of both runs. Medians and MADs ignore the odd
+repetition slowed down by another process, which a mean and standard deviation would not.
+
+Exit codes: 0 passed, 1 regressed or a gated benchmark did not run, 77 the run is not comparable with
+the baseline (another build type), which ctest reports as skipped.
+"""
+from pathlib import Path
+import argparse
+import json
+import statistics
+import subprocess
+import sys
+import tempfile
+
+NOT_COMPARABLE = 77
+# Scales a MAD to the standard deviation of normally distributed samples.
+MAD_TO_SIGMA = 1.4826
+
+
+def throughput(run):
+    """Work per second of one repetition: bytes, else items, else iterations."""
+    for metric in ("bytes_per_second", "items_per_second"):
+        if metric in run:
+            return metric, float(run[metric])
+    seconds_per_unit = {"ns": 1e-9, "us": 1e-6, "ms": 1e-3, "s": 1.0}[run.get("time_unit", "ns")]
+    return "iterations_per_second", 1.0 / (float(run["real_time"]) * seconds_per_unit)
+
+
+def summarize(benchmark_json):
+    """Median and scaled MAD of the throughput of every benchmark, from its individual repetitions."""
+    samples = {}
+    metrics = {}
+    for run in benchmark_json["benchmarks"]:
+        if run.get("run_type") != "iteration" or run.get("error_occurred"):
+            continue
+        metric, value = throughput(run)
+        samples.setdefault(run["run_name"], []).append(value)
+        metrics[run["run_name"]] = metric
+    summary = {}
+    for name, values in samples.items():
+        median = statistics.median(values)
+        mad = statistics.median(abs(value - median) for value in values) * MAD_TO_SIGMA
+        summary[name] = {"metric": metrics[name], "median": median, "mad": mad, "samples": len(values)}
+    return summary
+
+
+def run_benchmarks(executable, benchmark_filter, repetitions, min_time):
+    with tempfile.TemporaryDirectory() as directory:
+        output = Path(directory) / "run.json"
+        command = [
+            str(executable),
+            f"--benchmark_filter={benchmark_filter}",
+            f"--benchmark_repetitions={repetitions}",
+            f"--benchmark_min_time={min_time}",
+            # Interleaved repetitions spread a slow phase of the machine over every benchmark instead of one.
+            "--benchmark_enable_random_interleaving=true",
+            f"--benchmark_out={output}",
+            "--benchmark_out_format=json",
+        ]
+        print("Running:", " ".join(command), flush=True)
+        subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+        return json.loads(output.read_text())
+
+
+def compare(baseline, current, tolerance, noise_factor):
+    """Print one line per gated benchmark; return the names that regressed or are missing."""
+    failures = []
+    print(f"{'Benchmark':<64} {'Baseline':>12} {'Current':>12} {'Change':>8}  Result")
+    for name, expected in sorted(baseline.items()):
+        actual = current.get(name)
+        if actual is None:
+            print(f"{name:<64} {expected['median']:>12.4g} {'-':>12} {'-':>8}  MISSING")
+            failures.append(name)
+            continue
+        change = (actual["median"] - expected["median"]) / expected["median"]
+        noise = noise_factor * (expected["mad"] + actual["mad"])
+        regressed = (-change * 100.0 > tolerance) and (expected["median"] - actual["median"] > noise)
+        print(f"{name:<64} {expected['median']:>12.4g} {actual['median']:>12.4g} {change * 100.0:>+7.1f}%  "
+              f"{'REGRESSED' if regressed else 'ok'}")
+        if regressed:
+            failures.append(name)
+    for name in sorted(set(current) - set(baseline)):
+        print(f"{name:<64} {'-':>12} {current[name]['median']:>12.4g} {'-':>8}  new, not gated")
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Fail when benchmark throughput regresses against a baseline.")
+    parser.add_argument("--benchmark", type=Path, required=True, help="Google Benchmark executable")
+    parser.add_argument("--baseline", type=Path, required=True, help="Baseline JSON; its filter selects the gated benchmarks")
+    parser.add_argument("--build-type", default="", help="Build type of the executable, compared with the baseline's")
+    parser.add_argument("--repetitions", type=int, default=9, help="Repetitions of each benchmark (default 9)")
+    parser.add_argument("--min-time", type=float, default=0.1, help="Seconds each repetition runs at least (default 0.1)")
+    parser.add_argument("--tolerance", type=float, default=10.0, help="Allowed drop of the median in percent (default 10)")
+    parser.add_argument("--noise-factor", type=float, default=3.0,
+                        help="A drop must also exceed this many MADs of baseline and run together (default 3)")
+    parser.add_argument("--output", type=Path, help="Also write the summary of this run here")
+    parser.add_argument("--update", action="store_true", help="Replace the baseline's numbers with this run's instead of comparing")
+    arguments = parser.parse_args()
+
+    baseline = json.loads(arguments.baseline.read_text())
+    if not arguments.update and arguments.build_type and baseline.get("buildType") != arguments.build_type:
+        print(f"Baseline was recorded on a {baseline.get('buildType')} build, this is {arguments.build_type}; not comparable")
+        return NOT_COMPARABLE
+
+    benchmark_json = run_benchmarks(arguments.benchmark, baseline["filter"], arguments.repetitions, arguments.min_time)
+    current = summarize(benchmark_json)
+    if arguments.output:
+        arguments.output.write_text(json.dumps({"context": benchmark_json["context"], "benchmarks": current}, indent=2) + "\n")
+
+    if arguments.update:
+        context = benchmark_json["context"]
+        baseline["buildType"] = arguments.build_type or baseline.get("buildType", "")
+        baseline["machine"] = {key: context.get(key) for key in ("host_name", "num_cpus", "mhz_per_cpu", "date")}
+        baseline["benchmarks"] = {name: {key: value[key] for key in ("metric", "median", "mad")} for name, value in sorted(current.items())}
+        arguments.baseline.write_text(json.dumps(baseline, indent=2) + "\n")
+        print(f"Wrote {len(current)} benchmarks to {arguments.baseline}")
+        return 0
+
+    failures = compare(baseline["benchmarks"], current, arguments.tolerance, arguments.noise_factor)
+    if failures:
+        print(f"{len(failures)} benchmark(s) regressed more than {arguments.tolerance}% or did not run")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
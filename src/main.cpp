@@ -1,15 +1,96 @@
 // file main.cpp:
 
 #include "BackupUtility/BackupUtility.hpp"
+#include "ErasureCode/ReedSolomon.hpp"
+#include "StorageBackend/S3StorageBackend.hpp"
 #include "cxxopts.hpp"
 
+#include <sqlite3.h>
+
+#if defined(RDEMO_ALLOCATOR_MIMALLOC)
+#include <mimalloc.h>
+#elif defined(RDEMO_ALLOCATOR_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#endif
+
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
 #include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <optional> // Required for std::optional
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 namespace
 {
 
+/**
+ * @brief Set by SIGINT and SIGTERM to stop a backup run and the watch and serve subcommands.
+ */
+std::atomic<bool> StopRequested{false};
+
+/**
+ * @brief Nanoseconds in one second, for the Unix times of the modification filters.
+ */
+constexpr std::int64_t NanosecondsPerSecond = 1000000000;
+
+/**
+ * @brief Bytes in one MiB, for the bandwidth limits.
+ */
+constexpr double BytesPerMebibyte = 1024.0 * 1024.0;
+
+/**
+ * @brief Convert a bandwidth limit in MiB/s to bytes per second.
+ *
+ * @param[in] mebibytesPerSecond Limit as given on the command line; negative values count as unlimited.
+ * @return Limit in bytes per second, 0 for unlimited.
+ */
+std::uint64_t MebibytesToBytes(double mebibytesPerSecond)
+{
+    return (0.0 < mebibytesPerSecond) ? static_cast<std::uint64_t>(std::llround(mebibytesPerSecond * BytesPerMebibyte)) : 0;
+}
+
+/**
+ * @brief Convert an injected latency in milliseconds to microseconds.
+ *
+ * @param[in] milliseconds Latency as given on the command line; negative values count as none.
+ * @return Latency in microseconds, 0 for none.
+ */
+std::uint64_t MillisecondsToMicroseconds(double milliseconds)
+{
+    return (0.0 < milliseconds) ? static_cast<std::uint64_t>(std::llround(milliseconds * 1000.0)) : 0;
+}
+
+/**
+ * @brief Collect every value of a repeatable option in command-line order.
+ *
+ * cxxopts splits vector values at commas, which paths may contain, so repeated scalar options are read
+ * from the sequence of parsed arguments instead.
+ *
+ * @param[in] parseResult The parsed command-line options.
+ * @param[in] name Long name of the option.
+ * @return Values of the option, empty if it was not given.
+ */
+std::vector<std::string> CollectOptionValues(const cxxopts::ParseResult& parseResult, const std::string& name)
+{
+    std::vector<std::string> values;
+    for (const auto& argument : parseResult.arguments())
+    {
+        if (name == argument.key())
+        {
+            values.push_back(argument.value());
+        }
+    }
+    return values;
+}
+
 /**
  * @brief Parses command-line arguments using cxxopts.
  *
@@ -24,9 +105,128 @@ std::optional<cxxopts::ParseResult> ParseCommandLineOptions(int argc, char* argv
 
     // clang-format off
     options.add_options()
-        ("s,source",  "Source directory", cxxopts::value<std::string>())
+        ("s,source",  "Source directory; repeat to back up several under their directory names", cxxopts::value<std::string>())
         ("b,backup",  "Backup directory", cxxopts::value<std::string>())
         ("v,verbose", "Verbose output")
+        ("stats", "Print stage timings and throughput counters after the backup")
+        ("dry-run", "Count the files and bytes a backup would add, modify and delete without writing anything")
+        ("dry-run-hash", "Like --dry-run, but hash files whose metadata changed instead of counting them as modified")
+        ("trace", "Write a Chrome trace-event JSON of the run to this file", cxxopts::value<std::string>())
+        ("trace-events", "Trace events kept per thread; older events are overwritten", cxxopts::value<std::size_t>())
+        ("io-trace", "Record every file system and database operation with its timing to this file, without paths", cxxopts::value<std::string>())
+        ("change-log", "List every path the run added, modified or deleted in this NDJSON file", cxxopts::value<std::string>())
+        ("replay-io-trace", "Generate the tree of this I/O trace in the empty --source and replay the recorded run into --backup", cxxopts::value<std::string>())
+        ("report-json", "Write the run's measurements and effective configuration as JSON to this file", cxxopts::value<std::string>())
+        ("metrics-file", "Write Prometheus metrics of the run to this file for the node exporter's textfile collector", cxxopts::value<std::string>())
+        ("slow-log", "Write every operation slower than --slow-threshold-ms with its stage and file to this file", cxxopts::value<std::string>())
+        ("slow-threshold-ms", "Duration in milliseconds from which --slow-log lists an operation (default 1000, 0 lists all)", cxxopts::value<unsigned int>())
+        ("status-segment", "Publish live counters in the shared-memory segment of this name for the status subcommand", cxxopts::value<std::string>())
+        ("paranoid", "Rehash every file even when size and mtime are unchanged")
+        ("sampled-check-size", "With --paranoid, check unchanged files of at least this many bytes by a sample of their blocks (0 hashes them whole)", cxxopts::value<std::uint64_t>())
+        ("sampled-check-blocks", "Blocks of 1 MiB a sampled check reads between the first and the last (default 8)", cxxopts::value<unsigned int>())
+        ("sampled-check-full-every", "Hash a sampled file whole on every this many paranoid runs (default 8, 0 never while unchanged)", cxxopts::value<unsigned int>())
+        ("no-resume", "Start a new run instead of continuing an interrupted one")
+        ("xattrs", "Record the extended attributes of every file along with its mode, owner and times (Linux)")
+        ("time-limit", "Stop the backup cleanly after this many seconds; the next run continues it", cxxopts::value<unsigned int>())
+        ("mmap-threshold", "Minimum file size in bytes for memory-mapped hashing (0 disables)", cxxopts::value<std::uintmax_t>())
+        ("hash", "Hash algorithm for new digests (XXH64, XXH3_64, XXH3_128, XXH3_128_TREE, BLAKE3)", cxxopts::value<std::string>())
+        ("tree-hash-threads", "Threads hashing one large file with XXH3_128_TREE or BLAKE3 (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("read-engine", "How files are read for hashing (blocking, io_uring)", cxxopts::value<std::string>())
+        ("read-queue-depth", "Reads in flight per hashing thread with --read-engine io_uring", cxxopts::value<unsigned int>())
+        ("unbuffered-io", "Keep large files out of the page cache while hashing and copying")
+        ("unbuffered-threshold", "Minimum file size in bytes for --unbuffered-io", cxxopts::value<std::uintmax_t>())
+        ("hash-buffer-size", "Read buffer size in bytes of each hashing thread", cxxopts::value<std::size_t>())
+        ("readahead-bytes", "Bytes of queued files read into the page cache ahead of the workers (0 disables)", cxxopts::value<std::uint64_t>())
+        ("read-bwlimit", "Read bandwidth limit in MiB/s shared by all threads (0 is unlimited)", cxxopts::value<double>())
+        ("write-bwlimit", "Write bandwidth limit in MiB/s shared by all threads (0 is unlimited)", cxxopts::value<double>())
+        ("read-iops", "Read requests per second shared by all threads (0 is unlimited)", cxxopts::value<std::uint64_t>())
+        ("write-iops", "Write requests per second shared by all threads (0 is unlimited)", cxxopts::value<std::uint64_t>())
+        ("read-latency", "Milliseconds added to every read, to test against a slow mount", cxxopts::value<double>())
+        ("write-latency", "Milliseconds added to every write, to test against a slow mount", cxxopts::value<double>())
+        ("metadata-latency", "Milliseconds added to every open, stat and directory listing", cxxopts::value<double>())
+        ("throttle-file", "File of I/O limits re-read while the backup runs", cxxopts::value<std::string>())
+        ("batch-size", "File state rows committed per database transaction", cxxopts::value<std::size_t>())
+        ("batch-interval-ms", "Maximum age in milliseconds of an uncommitted batch", cxxopts::value<unsigned int>())
+        ("writer-thread", "Commit file states from one dedicated writer thread")
+        ("writer-escalation-retries", "Busy retries of the state database after which the run switches to one writer thread (0 never switches)", cxxopts::value<std::uint64_t>())
+        ("state-shards", "Database files the file rows are split across (1 keeps them in the state database, 0 keeps the current layout)", cxxopts::value<std::size_t>())
+        ("daemon", "Stay running and back up on --interval, --trigger-file or --journal-threshold, keeping the database and index open")
+        ("interval", "Seconds between the starts of two daemon runs (0 runs only when triggered)", cxxopts::value<unsigned int>())
+        ("trigger-file", "File whose modification starts a daemon run", cxxopts::value<std::string>())
+        ("journal-threshold", "Journaled directories that start a daemon run (0 disables it)", cxxopts::value<std::uint64_t>())
+        ("partition", "Back up one partition of the plan made with partition-plan into its store below --backup", cxxopts::value<unsigned int>())
+        ("checkpoint-interval-ms", "Time in milliseconds between background WAL checkpoints (0 checkpoints on commit)", cxxopts::value<unsigned int>())
+        ("durability", "When backup copies are flushed to stable storage (none, end-of-run, batched)", cxxopts::value<std::string>())
+        ("db-profile", "SQLite durability and caching profile (safe, balanced, bulk)", cxxopts::value<std::string>())
+        ("hash-cache", "SQLite digest cache shared by jobs over overlapping trees", cxxopts::value<std::string>())
+        ("resume-appends", "With --hash-cache, hash and copy a file of 1 MiB or more that only grew from where its stored version ends")
+        ("copy-checkpoint", "Commit a checkpoint every this many bytes of a larger copy, so a copy an interrupted run left staged is continued (0 disables it)",
+         cxxopts::value<std::uint64_t>())
+        ("xattr-digests", "Cache digests in an extended attribute on each source file, reused by any job whose size and mtime still match")
+        ("content-store", "Store each distinct content once under objects/ and hardlink backup files to it")
+        ("chunked-history", "Archive previous versions as manifests over a deduplicating chunk store")
+        ("chunk-size", "Average chunk size in bytes for --chunked-history", cxxopts::value<std::uint32_t>())
+        ("delta-history", "Archive previous versions as reverse deltas against the new version")
+        ("delta-block-size", "Block size in bytes matched by --delta-history", cxxopts::value<std::uint32_t>())
+        ("compress-history", "zstd-compress archived files that are kept whole")
+        ("compression-level", "zstd level for --compress-history", cxxopts::value<int>())
+        ("compression-threads", "zstd worker threads for large archived files", cxxopts::value<unsigned int>())
+        ("compression-dictionaries", "Compress small archived files with zstd dictionaries trained per extension")
+        ("pack-small-files", "Append small files to large segment files under packs/ instead of storing each one")
+        ("pack-threshold", "Size in bytes below which --pack-small-files packs a file", cxxopts::value<std::uint64_t>())
+        ("inline-threshold", "Size in bytes below which --pack-small-files stores a file in the database instead of a segment (default 0, none)", cxxopts::value<std::uint64_t>())
+        ("snapshot-trees", "Link every successful run into a complete tree under snapshots/<timestamp>/")
+        ("state-copies", "Copy the state database online into state/<timestamp>/ after every successful run")
+        ("parity", "Keep Reed-Solomon parity under parity/ for large backup copies and closed pack segments, as k+m data and parity blocks per stripe (e.g. 10+2)", cxxopts::value<std::string>())
+        ("parity-threshold", "Size in bytes from which --parity protects a backup copy (default 1 MiB)", cxxopts::value<std::uint64_t>())
+        ("detect-moves", "Rename the backup copy of a file moved or renamed in the source instead of copying it again")
+        ("encryption-key", "Key file (32 bytes or 64 hex digits) backup copies are encrypted with", cxxopts::value<std::string>())
+        ("cipher", "Cipher of --encryption-key (auto, aes-256-gcm, chacha20-poly1305)", cxxopts::value<std::string>())
+        ("walk-threads", "Threads enumerating the source tree", cxxopts::value<unsigned int>())
+        ("ordered-walk", "Enumerate files in sorted depth-first order")
+        ("mft-walk", "On NTFS, list the source tree from the master file table (needs an elevated process)")
+        ("pre-scan", "Count files and bytes in a parallel metadata-only walk so progress has a total")
+        ("pre-scan-threads", "Threads of the --pre-scan walk (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("queue", "Work queue backend (ring, mutex, stealing)", cxxopts::value<std::string>())
+        ("schedule", "File scheduling policy (fifo, largest-first, large-lane, device, recent-first, physical)", cxxopts::value<std::string>())
+        ("large-file-threshold", "Size in bytes from which a file counts as large for size-aware scheduling", cxxopts::value<std::uint64_t>())
+        ("lookahead", "Queued files largest-first, recent-first and physical scheduling reorder among", cxxopts::value<std::size_t>())
+        ("device-class", "Storage class the pipeline defaults are tuned for (default, hdd, ssd, nvme, network)", cxxopts::value<std::string>())
+        ("threads", "Worker threads of the read/hash stage (0 uses the device class default)", cxxopts::value<unsigned int>())
+        ("queue-depth", "Files queued ahead of the workers", cxxopts::value<std::size_t>())
+        ("hash-threads", "Read/hash stage threads (0 uses the device class default)", cxxopts::value<unsigned int>())
+        ("hash-queue-depth", "Files queued ahead of the read/hash stage", cxxopts::value<std::size_t>())
+        ("adaptive-threads", "Grow or shrink the active read/hash threads from measured throughput, starting at --threads")
+        ("max-threads", "Most active read/hash threads with --adaptive-threads (0 uses four per core up to 64)", cxxopts::value<unsigned int>())
+        ("pin-threads", "Pin the read/hash threads to CPUs spread over the NUMA nodes and queue files per node")
+        ("nice-io", "Run the read/hash and copy threads at idle CPU and I/O priority, so they only use spare capacity")
+        ("copy-threads", "Copy stage threads (0 uses the device class default)", cxxopts::value<unsigned int>())
+        ("copy-queue-depth", "Files queued ahead of the copy stage", cxxopts::value<std::size_t>())
+        ("index-memory-limit", "Memory cap in bytes for preloading stored file states (0 disables)", cxxopts::value<std::size_t>())
+        ("no-state-snapshot", "Load the stored file states from the database instead of the snapshot file the last run wrote")
+        ("no-bulk-import", "Upsert every file row even when the database is empty, instead of appending them and building the indexes at the end")
+        ("merge-lookups", "Without a preloaded index, merge each directory listing with one ordered scan of its stored states instead of one query per file")
+        ("prefetch-states", "Without a preloaded index, read the stored states of each listed batch with a few queries and hand them to the workers")
+        ("memory-limit", "Memory budget in bytes split between state index, database cache, read buffers and queues (0 is unlimited)",
+         cxxopts::value<std::uint64_t>())
+        ("s3-endpoint", "Store the backup in a bucket of this S3-compatible service (http://host[:port]); credentials come from "
+                        "AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY and AWS_SESSION_TOKEN", cxxopts::value<std::string>())
+        ("s3-bucket", "Bucket of --s3-endpoint holding the backup", cxxopts::value<std::string>())
+        ("s3-prefix", "Prefix of every object key in the bucket", cxxopts::value<std::string>())
+        ("s3-region", "Region requests to --s3-endpoint are signed for (default us-east-1)", cxxopts::value<std::string>())
+        ("s3-connections", "Requests to --s3-endpoint in flight at once", cxxopts::value<unsigned int>())
+        ("s3-part-size", "Part size in bytes of multipart uploads to --s3-endpoint", cxxopts::value<std::uint64_t>())
+        ("journal", "Visit only the directories recorded by a running `watch` since the previous backup")
+        ("reconcile-runs", "Journal runs between two full walks of the source tree (0 always walks it)", cxxopts::value<unsigned int>())
+        ("change-list", "Visit only the directories named by `zfs diff -H` or `btrfs subvolume find-new` output", cxxopts::value<std::string>())
+        ("change-list-root", "Directory the absolute paths of --change-list are relative to (default: the source)", cxxopts::value<std::string>())
+        ("filter-file", "File of gitignore-style patterns excluding files and directories", cxxopts::value<std::string>())
+        ("exclude", "gitignore-style pattern to exclude, applied after --filter-file (repeatable)", cxxopts::value<std::vector<std::string>>())
+        ("include", "gitignore-style pattern to include again, applied after --exclude (repeatable)", cxxopts::value<std::vector<std::string>>())
+        ("min-size", "Skip files smaller than this many bytes", cxxopts::value<std::uint64_t>())
+        ("max-size", "Skip files larger than this many bytes", cxxopts::value<std::uint64_t>())
+        ("modified-after", "Skip files modified before this Unix time in seconds", cxxopts::value<std::int64_t>())
+        ("modified-before", "Skip files modified at or after this Unix time in seconds", cxxopts::value<std::int64_t>())
         ("h,help",    "Print help");
     // clang-format on
 
@@ -52,55 +252,2336 @@ std::optional<BackupConfig> SetupBackupConfiguration(const cxxopts::ParseResult&
 {
     BackupConfig config;
 
-    config.sourceDir = std::filesystem::path(parseResult["source"].as<std::string>());
+    const std::vector<std::string> sources = CollectOptionValues(parseResult, "source");
+    if (1 == sources.size())
+    {
+        config.sourceDir = std::filesystem::path(sources.front());
+    }
+    else
+    {
+        for (const auto& source : sources)
+        {
+            config.sources.push_back(BackupSource{std::filesystem::path(source), std::string()});
+        }
+    }
     config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
     config.verbose = (0 < parseResult.count("verbose"));
+    config.paranoid = (0 < parseResult.count("paranoid"));
+    if (0 < parseResult.count("sampled-check-size"))
+    {
+        config.sampledCheckThreshold = parseResult["sampled-check-size"].as<std::uint64_t>();
+    }
+    if (0 < parseResult.count("sampled-check-blocks"))
+    {
+        config.sampledCheckBlocks = parseResult["sampled-check-blocks"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("sampled-check-full-every"))
+    {
+        config.sampledCheckFullEvery = parseResult["sampled-check-full-every"].as<unsigned int>();
+    }
+    config.resume = (0 == parseResult.count("no-resume"));
+    config.extendedAttributes = (0 < parseResult.count("xattrs"));
+    if (0 < parseResult.count("time-limit"))
+    {
+        config.timeLimitSeconds = parseResult["time-limit"].as<unsigned int>();
+    }
+    config.stopRequested = &StopRequested;
+    config.unbufferedIo = (0 < parseResult.count("unbuffered-io"));
+    config.dedicatedWriter = (0 < parseResult.count("writer-thread"));
+    if (0 < parseResult.count("writer-escalation-retries"))
+    {
+        config.writerEscalationRetries = parseResult["writer-escalation-retries"].as<std::uint64_t>();
+    }
+    config.mergeStateLookups = (0 < parseResult.count("merge-lookups"));
+    config.prefetchStates = (0 < parseResult.count("prefetch-states"));
+    config.stateSnapshot = (0 == parseResult.count("no-state-snapshot"));
+    config.bulkImport = (0 == parseResult.count("no-bulk-import"));
+    if (0 < parseResult.count("hash-cache"))
+    {
+        config.hashCacheFile = std::filesystem::path(parseResult["hash-cache"].as<std::string>());
+    }
+    config.resumeAppends = (0 < parseResult.count("resume-appends"));
+    if ((true == config.resumeAppends) && (true == config.hashCacheFile.empty()))
+    {
+        std::cerr << "--resume-appends needs --hash-cache\n";
+        return std::nullopt;
+    }
+    if (0 < parseResult.count("copy-checkpoint"))
+    {
+        config.copyCheckpointInterval = parseResult["copy-checkpoint"].as<std::uint64_t>();
+    }
+    config.digestAttributes = (0 < parseResult.count("xattr-digests"));
+    config.contentStore = (0 < parseResult.count("content-store"));
+    config.chunkedHistory = (0 < parseResult.count("chunked-history"));
+    config.deltaHistory = (0 < parseResult.count("delta-history"));
+    if (1 < (static_cast<int>(config.contentStore) + static_cast<int>(config.chunkedHistory) + static_cast<int>(config.deltaHistory)))
+    {
+        std::cerr << "--content-store, --chunked-history and --delta-history cannot be combined\n";
+        return std::nullopt;
+    }
 
-    config.databaseFile = config.backupRoot / "backup.db";
+    if (0 < parseResult.count("chunk-size"))
+    {
+        config.averageChunkSize = parseResult["chunk-size"].as<std::uint32_t>();
+    }
+    if (0 < parseResult.count("delta-block-size"))
+    {
+        config.deltaBlockSize = parseResult["delta-block-size"].as<std::uint32_t>();
+    }
 
-    std::error_code errorCode;
-    config.sourceDir = std::filesystem::canonical(config.sourceDir, errorCode);
-    if ((0 != errorCode.value()) || (false == std::filesystem::is_directory(config.sourceDir)))
+    config.compressHistory = (0 < parseResult.count("compress-history"));
+    if ((true == config.compressHistory) && (false == FileCompressor::IsAvailable()))
     {
-        std::cerr << "Invalid source directory\n";
+        std::cerr << "--compress-history needs a build with zstd\n";
+        return std::nullopt;
+    }
+    if ((true == config.compressHistory) && (true == config.contentStore))
+    {
+        std::cerr << "--compress-history and --content-store cannot be combined\n";
+        return std::nullopt;
+    }
+    if (0 < parseResult.count("compression-level"))
+    {
+        config.compressionLevel = parseResult["compression-level"].as<int>();
+    }
+    if (0 < parseResult.count("compression-threads"))
+    {
+        config.compressionThreads = parseResult["compression-threads"].as<unsigned int>();
+    }
+    config.compressionDictionaries = (0 < parseResult.count("compression-dictionaries"));
+    if ((true == config.compressionDictionaries) && (false == config.compressHistory))
+    {
+        std::cerr << "--compression-dictionaries needs --compress-history\n";
         return std::nullopt;
     }
+    config.packSmallFiles = (0 < parseResult.count("pack-small-files"));
+    if (0 < parseResult.count("pack-threshold"))
+    {
+        config.packThreshold = parseResult["pack-threshold"].as<std::uint64_t>();
+    }
 
-    std::filesystem::create_directories(config.backupRoot, errorCode);
-    if (0 != errorCode.value())
+    if (0 < parseResult.count("inline-threshold"))
     {
-        std::cerr << "Failed to create backup directory\n";
+        config.inlineThreshold = parseResult["inline-threshold"].as<std::uint64_t>();
+    }
+    config.snapshotTrees = (0 < parseResult.count("snapshot-trees"));
+    config.stateCopies = (0 < parseResult.count("state-copies"));
+    if (0 < parseResult.count("parity"))
+    {
+        if (false == ReedSolomon::ParseShards(parseResult["parity"].as<std::string>(), config.parityDataShards, config.parityShards))
+        {
+            std::cerr << "--parity takes k+m data and parity blocks per stripe, each at least 1 and together at most 256\n";
+            return std::nullopt;
+        }
+        if ((true == config.chunkedHistory) || (true == config.deltaHistory) || (true == config.compressHistory) ||
+            (0 < parseResult.count("encryption-key")) || (0 < parseResult.count("s3-endpoint")))
+        {
+            std::cerr << "--parity cannot be combined with --chunked-history, --delta-history, --compress-history, --encryption-key or --s3-endpoint\n";
+            return std::nullopt;
+        }
+    }
+    if (0 < parseResult.count("parity-threshold"))
+    {
+        config.parityThreshold = parseResult["parity-threshold"].as<std::uint64_t>();
+    }
+    config.detectMoves = (0 < parseResult.count("detect-moves"));
+    if ((true == config.detectMoves) && ((true == config.contentStore) || (0 < parseResult.count("s3-endpoint"))))
+    {
+        std::cerr << "--detect-moves cannot be combined with --content-store or --s3-endpoint\n";
         return std::nullopt;
     }
+    if (0 < parseResult.count("encryption-key"))
+    {
+        if (false == FileEncryptor::IsAvailable())
+        {
+            std::cerr << "--encryption-key needs a build with OpenSSL\n";
+            return std::nullopt;
+        }
+        if ((true == config.contentStore) || (true == config.chunkedHistory) || (true == config.deltaHistory) || (true == config.compressHistory) ||
+            (true == config.packSmallFiles))
+        {
+            std::cerr << "--encryption-key cannot be combined with --content-store, --*-history or --pack-small-files\n";
+            return std::nullopt;
+        }
+        config.encryptionKeyFile = std::filesystem::path(parseResult["encryption-key"].as<std::string>());
+    }
+    if (0 < parseResult.count("cipher"))
+    {
+        const std::string cipher = parseResult["cipher"].as<std::string>();
+        if ("aes-256-gcm" == cipher)
+        {
+            config.encryptionAlgorithm = EncryptionAlgorithm::Aes256Gcm;
+        }
+        else if ("chacha20-poly1305" == cipher)
+        {
+            config.encryptionAlgorithm = EncryptionAlgorithm::ChaCha20Poly1305;
+        }
+        else if ("auto" != cipher)
+        {
+            std::cerr << "Invalid cipher\n";
+            return std::nullopt;
+        }
+    }
+    config.orderedWalk = (0 < parseResult.count("ordered-walk"));
+    config.mftWalk = (0 < parseResult.count("mft-walk"));
+    config.preScan = (0 < parseResult.count("pre-scan"));
+    if (0 < parseResult.count("pre-scan-threads"))
+    {
+        config.preScanThreads = parseResult["pre-scan-threads"].as<unsigned int>();
+    }
 
-    if (true == config.verbose)
+    config.useChangeJournal = (0 < parseResult.count("journal"));
+    if (0 < parseResult.count("reconcile-runs"))
     {
-        config.onProgress = [](const BackupProgress& progress)
-        { std::cout << "[" << progress.stage << "] " << progress.processed << "/" << progress.total << " : " << progress.file << '\n'; };
+        config.journalReconcileRuns = parseResult["reconcile-runs"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("change-list"))
+    {
+        config.changeListFile = parseResult["change-list"].as<std::string>();
+    }
+    if (0 < parseResult.count("change-list-root"))
+    {
+        config.changeListRoot = parseResult["change-list-root"].as<std::string>();
     }
 
-    return config;
-}
+    if (0 < parseResult.count("filter-file"))
+    {
+        std::ifstream filterFile(parseResult["filter-file"].as<std::string>());
+        if (false == filterFile.is_open())
+        {
+            std::cerr << "Cannot read filter file\n";
+            return std::nullopt;
+        }
+        for (std::string line; std::getline(filterFile, line);)
+        {
+            config.filterRules.patterns.push_back(line);
+        }
+    }
+    if (0 < parseResult.count("exclude"))
+    {
+        for (const auto& pattern : parseResult["exclude"].as<std::vector<std::string>>())
+        {
+            config.filterRules.patterns.push_back(pattern);
+        }
+    }
+    if (0 < parseResult.count("include"))
+    {
+        for (const auto& pattern : parseResult["include"].as<std::vector<std::string>>())
+        {
+            config.filterRules.patterns.push_back("!" + pattern);
+        }
+    }
+    if (0 < parseResult.count("min-size"))
+    {
+        config.filterRules.minSize = parseResult["min-size"].as<std::uint64_t>();
+    }
+    if (0 < parseResult.count("max-size"))
+    {
+        config.filterRules.maxSize = parseResult["max-size"].as<std::uint64_t>();
+    }
+    if (0 < parseResult.count("modified-after"))
+    {
+        config.filterRules.modifiedAfterNs = parseResult["modified-after"].as<std::int64_t>() * NanosecondsPerSecond;
+    }
+    if (0 < parseResult.count("modified-before"))
+    {
+        config.filterRules.modifiedBeforeNs = parseResult["modified-before"].as<std::int64_t>() * NanosecondsPerSecond;
+    }
+    PathFilter filter;
+    if (false == PathFilter::Compile(config.filterRules, filter))
+    {
+        std::cerr << "Invalid filter pattern\n";
+        return std::nullopt;
+    }
 
-} // namespace
+    if (0 < parseResult.count("walk-threads"))
+    {
+        config.walkThreads = parseResult["walk-threads"].as<unsigned int>();
+    }
 
-int main(int argc, char* argv[])
-{
-    std::optional<cxxopts::ParseResult> parseResult = ParseCommandLineOptions(argc, argv);
+    if (0 < parseResult.count("mmap-threshold"))
+    {
+        config.memoryMapThreshold = parseResult["mmap-threshold"].as<std::uintmax_t>();
+    }
 
-    if (false == parseResult.has_value())
+    if (0 < parseResult.count("batch-size"))
     {
-        return 0; // Help was shown or invalid arguments, exit gracefully.
+        config.stateBatchSize = parseResult["batch-size"].as<std::size_t>();
     }
 
-    std::optional<BackupConfig> backupConfiguration = SetupBackupConfiguration(parseResult.value());
+    if (0 < parseResult.count("state-shards"))
+    {
+        config.stateShards = parseResult["state-shards"].as<std::size_t>();
+    }
 
-    if (false == backupConfiguration.has_value())
+    if (0 < parseResult.count("index-memory-limit"))
     {
-        return 1; // Configuration failed, error message already printed.
+        config.stateIndexMemoryLimit = parseResult["index-memory-limit"].as<std::size_t>();
+    }
+
+    if (0 < parseResult.count("memory-limit"))
+    {
+        config.memoryLimit = parseResult["memory-limit"].as<std::uint64_t>();
+    }
+
+    if ((0 < parseResult.count("db-profile")) &&
+        (false == StringToSQLitePerformanceProfile(parseResult["db-profile"].as<std::string>(), config.databaseProfile)))
+    {
+        std::cerr << "Unknown database profile\n";
+        return std::nullopt;
+    }
+
+    if (0 < parseResult.count("checkpoint-interval-ms"))
+    {
+        config.checkpointIntervalMs = parseResult["checkpoint-interval-ms"].as<unsigned int>();
+    }
+
+    if ((0 < parseResult.count("durability")) && (false == StringToDurabilityPolicy(parseResult["durability"].as<std::string>(), config.durability)))
+    {
+        std::cerr << "Unknown durability policy\n";
+        return std::nullopt;
+    }
+
+    if (0 < parseResult.count("batch-interval-ms"))
+    {
+        config.stateBatchIntervalMs = parseResult["batch-interval-ms"].as<unsigned int>();
+    }
+
+    if (0 < parseResult.count("tree-hash-threads"))
+    {
+        config.treeHashThreads = parseResult["tree-hash-threads"].as<unsigned int>();
+    }
+
+    if (0 < parseResult.count("hash-buffer-size"))
+    {
+        config.hashBufferSize = parseResult["hash-buffer-size"].as<std::size_t>();
+    }
+    if (0 < parseResult.count("readahead-bytes"))
+    {
+        config.readaheadBytes = parseResult["readahead-bytes"].as<std::uint64_t>();
+    }
+
+    if (0 < parseResult.count("read-bwlimit"))
+    {
+        config.ioLimits.readBytesPerSecond = MebibytesToBytes(parseResult["read-bwlimit"].as<double>());
+    }
+    if (0 < parseResult.count("write-bwlimit"))
+    {
+        config.ioLimits.writeBytesPerSecond = MebibytesToBytes(parseResult["write-bwlimit"].as<double>());
+    }
+    if (0 < parseResult.count("read-iops"))
+    {
+        config.ioLimits.readOpsPerSecond = parseResult["read-iops"].as<std::uint64_t>();
+    }
+    if (0 < parseResult.count("write-iops"))
+    {
+        config.ioLimits.writeOpsPerSecond = parseResult["write-iops"].as<std::uint64_t>();
+    }
+    if (0 < parseResult.count("read-latency"))
+    {
+        config.ioLimits.readLatencyUs = MillisecondsToMicroseconds(parseResult["read-latency"].as<double>());
+    }
+    if (0 < parseResult.count("write-latency"))
+    {
+        config.ioLimits.writeLatencyUs = MillisecondsToMicroseconds(parseResult["write-latency"].as<double>());
+    }
+    if (0 < parseResult.count("metadata-latency"))
+    {
+        config.ioLimits.metadataLatencyUs = MillisecondsToMicroseconds(parseResult["metadata-latency"].as<double>());
+    }
+    if (0 < parseResult.count("throttle-file"))
+    {
+        config.throttleFile = std::filesystem::path(parseResult["throttle-file"].as<std::string>());
+    }
+
+    if (0 < parseResult.count("unbuffered-threshold"))
+    {
+        config.unbufferedThreshold = parseResult["unbuffered-threshold"].as<std::uintmax_t>();
+    }
+
+    if (0 < parseResult.count("read-queue-depth"))
+    {
+        config.readQueueDepth = parseResult["read-queue-depth"].as<unsigned int>();
+    }
+
+    if ((0 < parseResult.count("read-engine")) && (false == StringToReadEngine(parseResult["read-engine"].as<std::string>(), config.readEngine)))
+    {
+        std::cerr << "Unknown read engine\n";
+        return std::nullopt;
+    }
+
+    if ((0 < parseResult.count("hash")) && (false == StringToHashAlgorithm(parseResult["hash"].as<std::string>(), config.hashAlgorithm)))
+    {
+        std::cerr << "Unknown hash algorithm\n";
+        return std::nullopt;
+    }
+
+    if ((0 < parseResult.count("queue")) && (false == StringToQueueBackend(parseResult["queue"].as<std::string>(), config.queueBackend)))
+    {
+        std::cerr << "Unknown queue backend\n";
+        return std::nullopt;
+    }
+
+    if ((0 < parseResult.count("schedule")) && (false == StringToSchedulingPolicy(parseResult["schedule"].as<std::string>(), config.scheduling)))
+    {
+        std::cerr << "Unknown scheduling policy\n";
+        return std::nullopt;
+    }
+
+    if (0 < parseResult.count("large-file-threshold"))
+    {
+        config.largeFileThreshold = parseResult["large-file-threshold"].as<std::uint64_t>();
+    }
+    if (0 < parseResult.count("lookahead"))
+    {
+        config.lookaheadWindow = parseResult["lookahead"].as<std::size_t>();
+    }
+
+    if ((0 < parseResult.count("device-class")) && (false == StringToDeviceClass(parseResult["device-class"].as<std::string>(), config.deviceClass)))
+    {
+        std::cerr << "Unknown device class\n";
+        return std::nullopt;
+    }
+
+    // --threads and --queue-depth are the short spellings of the read/hash stage overrides.
+    for (const char* option : {"threads", "hash-threads"})
+    {
+        if (0 < parseResult.count(option))
+        {
+            config.hashThreads = parseResult[option].as<unsigned int>();
+        }
+    }
+
+    for (const char* option : {"queue-depth", "hash-queue-depth"})
+    {
+        if (0 < parseResult.count(option))
+        {
+            config.hashQueueDepth = parseResult[option].as<std::size_t>();
+        }
+    }
+
+    config.adaptiveThreads = (0 < parseResult.count("adaptive-threads"));
+    if (0 < parseResult.count("max-threads"))
+    {
+        config.maxAdaptiveThreads = parseResult["max-threads"].as<unsigned int>();
+    }
+    config.pinWorkers = (0 < parseResult.count("pin-threads"));
+    config.idlePriority = (0 < parseResult.count("nice-io"));
+
+    if (0 < parseResult.count("copy-threads"))
+    {
+        config.copyThreads = parseResult["copy-threads"].as<unsigned int>();
+    }
+
+    if (0 < parseResult.count("copy-queue-depth"))
+    {
+        config.copyQueueDepth = parseResult["copy-queue-depth"].as<std::size_t>();
+    }
+
+    if (0 < parseResult.count("trace"))
+    {
+        config.traceFile = parseResult["trace"].as<std::string>();
     }
 
-    if (false == RunBackup(backupConfiguration.value()))
+    if (0 < parseResult.count("trace-events"))
+    {
+        config.traceEventsPerThread = parseResult["trace-events"].as<std::size_t>();
+    }
+
+    if (0 < parseResult.count("io-trace"))
+    {
+        config.ioTraceFile = parseResult["io-trace"].as<std::string>();
+    }
+
+    if (0 < parseResult.count("change-log"))
+    {
+        config.changeLogFile = parseResult["change-log"].as<std::string>();
+    }
+
+    if (0 < parseResult.count("metrics-file"))
+    {
+        config.metricsFile = parseResult["metrics-file"].as<std::string>();
+    }
+
+    if (0 < parseResult.count("slow-log"))
+    {
+        config.slowOperationLog = parseResult["slow-log"].as<std::string>();
+    }
+
+    if (0 < parseResult.count("slow-threshold-ms"))
+    {
+        config.slowOperationThresholdMs = parseResult["slow-threshold-ms"].as<unsigned int>();
+    }
+
+    if (0 < parseResult.count("status-segment"))
+    {
+        config.statusSegment = parseResult["status-segment"].as<std::string>();
+    }
+
+    config.databaseFile = config.backupRoot / "backup.db";
+
+    if ((0 < parseResult.count("partition")) && (false == ApplyPartition(parseResult["partition"].as<unsigned int>(), config)))
+    {
+        std::cerr << "No such partition in the plan below --backup\n";
+        return std::nullopt;
+    }
+
+    // The database stays below --backup; only the file copies go to the bucket.
+    if (0 < parseResult.count("s3-endpoint"))
+    {
+        S3Options s3;
+        s3.endpoint = parseResult["s3-endpoint"].as<std::string>();
+        s3.bucket = (0 < parseResult.count("s3-bucket")) ? parseResult["s3-bucket"].as<std::string>() : std::string();
+        if (0 < parseResult.count("s3-prefix"))
+        {
+            s3.prefix = parseResult["s3-prefix"].as<std::string>();
+        }
+        if (0 < parseResult.count("s3-region"))
+        {
+            s3.region = parseResult["s3-region"].as<std::string>();
+        }
+        if (0 < parseResult.count("s3-connections"))
+        {
+            s3.connections = parseResult["s3-connections"].as<unsigned int>();
+        }
+        if (0 < parseResult.count("s3-part-size"))
+        {
+            s3.partSize = parseResult["s3-part-size"].as<std::uint64_t>();
+        }
+        const char* accessKey = std::getenv("AWS_ACCESS_KEY_ID");
+        const char* secretKey = std::getenv("AWS_SECRET_ACCESS_KEY");
+        const char* sessionToken = std::getenv("AWS_SESSION_TOKEN");
+        s3.accessKey = (nullptr != accessKey) ? accessKey : "";
+        s3.secretKey = (nullptr != secretKey) ? secretKey : "";
+        s3.sessionToken = (nullptr != sessionToken) ? sessionToken : "";
+        try
+        {
+            config.storage = std::make_shared<S3StorageBackend>(s3);
+        }
+        catch (const std::invalid_argument& error)
+        {
+            std::cerr << "Invalid S3 settings: " << error.what() << '\n';
+            return std::nullopt;
+        }
+    }
+
+    std::error_code errorCode;
+    if (true == config.sources.empty())
+    {
+        config.sourceDir = std::filesystem::canonical(config.sourceDir, errorCode);
+        if ((0 != errorCode.value()) || (false == std::filesystem::is_directory(config.sourceDir)))
+        {
+            std::cerr << "Invalid source directory\n";
+            return std::nullopt;
+        }
+    }
+    for (auto& source : config.sources)
+    {
+        source.path = std::filesystem::canonical(source.path, errorCode);
+        if ((0 != errorCode.value()) || (false == std::filesystem::is_directory(source.path)))
+        {
+            std::cerr << "Invalid source directory\n";
+            return std::nullopt;
+        }
+    }
+
+    // A dry run writes nothing, not even the backup directory.
+    const bool dryRun = (0 < parseResult.count("dry-run")) || (0 < parseResult.count("dry-run-hash"));
+    if (false == dryRun)
+    {
+        std::filesystem::create_directories(config.backupRoot, errorCode);
+    }
+    if (0 != errorCode.value())
+    {
+        std::cerr << "Failed to create backup directory\n";
+        return std::nullopt;
+    }
+
+    if (true == config.verbose)
+    {
+        // Verbose output lists every file, so per-file events are buffered for the reporter thread.
+        config.progressEventCapacity = BackupConfig::DefaultProgressEventCapacity;
+        config.onProgress = [](const BackupProgress& progress)
+        { std::cout << "[" << progress.stage << "] " << progress.processed << "/" << progress.total << " : " << progress.file << '\n'; };
+    }
+
+    return config;
+}
+
+/**
+ * @brief Prints the measurements of a backup run.
+ *
+ * @param[in] stats Measurements returned by RunBackup.
+ */
+void PrintBackupStats(const BackupStats& stats)
+{
+    constexpr double BytesPerMebibyte = 1024.0 * 1024.0;
+    const double elapsed = (0.0 < stats.elapsedSeconds) ? stats.elapsedSeconds : 1.0;
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Elapsed: " << stats.elapsedSeconds << " s\n";
+    std::cout << std::left << std::setw(16) << "Stage" << std::right << std::setw(12) << "Wall s" << std::setw(12) << "CPU s" << '\n';
+    for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+    {
+        std::cout << std::left << std::setw(16) << BackupStageToString(static_cast<BackupStage>(stage)) << std::right << std::setw(12)
+                  << stats.stages[stage].wallSeconds << std::setw(12) << stats.stages[stage].cpuSeconds << '\n';
+    }
+    constexpr double MillisecondsPerSecond = 1000.0;
+    std::cout << std::left << std::setw(16) << "Latency" << std::right << std::setw(12) << "Ops" << std::setw(12) << "p50 ms"
+              << std::setw(12) << "p99 ms" << std::setw(12) << "p99.9 ms" << std::setw(12) << "max ms" << '\n';
+    for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+    {
+        const BackupLatency& latency = stats.latencies[stage];
+        std::cout << std::left << std::setw(16) << BackupStageToString(static_cast<BackupStage>(stage)) << std::right << std::setw(12)
+                  << latency.count << std::setw(12) << (latency.p50Seconds * MillisecondsPerSecond) << std::setw(12)
+                  << (latency.p99Seconds * MillisecondsPerSecond) << std::setw(12) << (latency.p999Seconds * MillisecondsPerSecond)
+                  << std::setw(12) << (latency.maxSeconds * MillisecondsPerSecond) << '\n';
+    }
+    std::cout << "Read: " << (static_cast<double>(stats.bytesRead) / BytesPerMebibyte) << " MiB ("
+              << (static_cast<double>(stats.bytesRead) / BytesPerMebibyte / elapsed) << " MiB/s)\n";
+    std::cout << "Written: " << (static_cast<double>(stats.bytesWritten) / BytesPerMebibyte) << " MiB\n";
+    std::cout << "Hashed: " << (static_cast<double>(stats.bytesHashed) / BytesPerMebibyte) << " MiB\n";
+    std::cout << "Files:";
+    for (std::size_t changeType = 0; changeType < ChangeTypeCount; ++changeType)
+    {
+        std::cout << ' ' << ChangeTypeToString(static_cast<ChangeType>(changeType)) << '=' << stats.filesByChange[changeType];
+    }
+    std::cout << " (moved=" << stats.filesMoved << ", sampled=" << stats.filesSampled << ")\n";
+    std::cout << "Queue wait: " << stats.queueWaitSeconds << " s, enqueue wait: " << stats.enqueueWaitSeconds << " s\n";
+    std::cout << "SQLite busy retries: " << stats.sqliteBusyRetries << '\n';
+    if (true == stats.writerEscalated)
+    {
+        std::cout << "Switched to one writer thread after contention on the state database\n";
+    }
+    if (true == stats.stopped)
+    {
+        std::cout << "Stopped early: the counts cover the files processed before the stop\n";
+    }
+    if (0 < stats.preScanFiles)
+    {
+        std::cout << "Pre-scan: " << stats.preScanFiles << " files, " << (static_cast<double>(stats.preScanBytes) / BytesPerMebibyte) << " MiB\n";
+    }
+    if (false == stats.scopes.empty())
+    {
+        constexpr double NanosecondsPerMillisecond = 1000000.0;
+        std::cout << std::left << std::setw(28) << "Scope" << std::right << std::setw(12) << "Calls" << std::setw(14) << "Total ms" << std::setw(14)
+                  << "Value" << '\n';
+        for (const InstrumentationTotal& scope : stats.scopes)
+        {
+            std::cout << std::left << std::setw(28) << scope.name << std::right << std::setw(12) << scope.calls << std::setw(14)
+                      << (static_cast<double>(scope.totalNs) / NanosecondsPerMillisecond) << std::setw(14) << scope.value << '\n';
+        }
+    }
+}
+
+/**
+ * @brief Prints the outcome of an I/O trace replay, one line per operation.
+ *
+ * @param[in] report Report filled in by ReplayIoTrace.
+ */
+void PrintReplayReport(const IoTraceReplayReport& report)
+{
+    constexpr double NanosecondsPerMillisecond = 1e6;
+    std::cout << "Generated " << report.files << " files in " << report.directories << " directories, "
+              << (static_cast<double>(report.bytes) / BytesPerMebibyte) << " MiB\n";
+    std::cout << "Recorded: " << report.recordedSeconds << " s on " << report.recordedThreads << " threads; replayed: "
+              << report.stats.elapsedSeconds << " s\n";
+    std::cout << "Operation: recorded count, ms / replayed count, ms\n";
+    for (const IoTraceOperation& operation : report.operations)
+    {
+        std::cout << "  " << operation.name << ": " << operation.recordedCount << ", "
+                  << (static_cast<double>(operation.recordedNs) / NanosecondsPerMillisecond) << " / " << operation.replayedCount << ", "
+                  << (static_cast<double>(operation.replayedNs) / NanosecondsPerMillisecond) << '\n';
+    }
+}
+
+/**
+ * @brief Prints what a backup run would do.
+ *
+ * @param[in] preview Counts returned by PreviewBackup.
+ */
+void PrintBackupPreview(const BackupPreview& preview)
+{
+    constexpr double BytesPerMebibyte = 1024.0 * 1024.0;
+
+    std::cout << std::fixed << std::setprecision(3);
+    for (ChangeType changeType : {ChangeType::Added, ChangeType::Modified, ChangeType::Deleted, ChangeType::Unchanged})
+    {
+        const std::size_t index = static_cast<std::size_t>(changeType);
+        if ((ChangeType::Deleted == changeType) && (false == preview.deletionsCounted))
+        {
+            std::cout << std::left << std::setw(10) << ChangeTypeToString(changeType) << "unknown, the walk was incomplete\n";
+            continue;
+        }
+        std::cout << std::left << std::setw(10) << ChangeTypeToString(changeType) << std::right << std::setw(10) << preview.filesByChange[index]
+                  << " files";
+        if (ChangeType::Unchanged != changeType)
+        {
+            std::cout << std::setw(14) << (static_cast<double>(preview.bytesByChange[index]) / BytesPerMebibyte) << " MiB";
+        }
+        std::cout << '\n';
+    }
+}
+
+/**
+ * @brief Runs the restore subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunRestoreCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup restore", "Restore a backed up tree");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("t,target", "Directory the tree is restored into", cxxopts::value<std::string>())
+        ("at", "Restore the tree as of YYYY-MM-DD_HH-MM-SS or a prefix of it (default: the last run)", cxxopts::value<std::string>())
+        ("threads", "Restoring threads (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("no-verify", "Skip rehashing restored files against their stored digest")
+        ("no-metadata", "Leave the mode, owner, times and extended attributes of restored files as written")
+        ("encryption-key", "Key file the backup was encrypted with", cxxopts::value<std::string>())
+        ("priority", "gitignore-style pattern of files restored before all others (repeatable)", cxxopts::value<std::vector<std::string>>())
+        ("priority-file", "File of gitignore-style patterns of files restored before all others", cxxopts::value<std::string>())
+        ("priority-ready-file", "File created once every priority file is restored", cxxopts::value<std::string>())
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")) || (0 == parseResult.count("target")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    RestoreConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    config.databaseFile = config.backupRoot / "backup.db";
+    config.targetDir = std::filesystem::path(parseResult["target"].as<std::string>());
+    if (0 < parseResult.count("at"))
+    {
+        config.timestamp = parseResult["at"].as<std::string>();
+    }
+    if (0 < parseResult.count("threads"))
+    {
+        config.threads = parseResult["threads"].as<unsigned int>();
+    }
+    config.verify = (0 == parseResult.count("no-verify"));
+    config.restoreMetadata = (0 == parseResult.count("no-metadata"));
+    if (0 < parseResult.count("encryption-key"))
+    {
+        config.encryptionKeyFile = std::filesystem::path(parseResult["encryption-key"].as<std::string>());
+    }
+    if (0 < parseResult.count("priority-file"))
+    {
+        std::ifstream priorityFile(parseResult["priority-file"].as<std::string>());
+        if (false == priorityFile.is_open())
+        {
+            std::cerr << "Cannot read priority file\n";
+            return 1;
+        }
+        for (std::string line; std::getline(priorityFile, line);)
+        {
+            config.priorityPatterns.push_back(line);
+        }
+    }
+    if (0 < parseResult.count("priority"))
+    {
+        for (const auto& pattern : parseResult["priority"].as<std::vector<std::string>>())
+        {
+            config.priorityPatterns.push_back(pattern);
+        }
+    }
+    const std::filesystem::path readyFile =
+        (0 < parseResult.count("priority-ready-file")) ? std::filesystem::path(parseResult["priority-ready-file"].as<std::string>()) : std::filesystem::path();
+
+    // Orchestration watching the output or the ready file can start the service while the rest streams in.
+    auto onPriorityRestored = [&readyFile](std::size_t files)
+    {
+        std::cout << "Priority files restored: " << files << std::endl;
+        if ((false == readyFile.empty()) && (false == std::ofstream(readyFile).is_open()))
+        {
+            std::cerr << "Cannot create priority ready file\n";
+        }
+    };
+    if (false == RunRestore(config, onPriorityRestored))
+    {
+        std::cerr << "Restore failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the export subcommand, writing the archive to standard output unless a file is given.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunExportCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup export", "Write a backed up tree as a tar stream");
+    options.positional_help("[<timestamp>]");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("timestamp", "Export the tree as of YYYY-MM-DD_HH-MM-SS or a prefix of it (default: the last run)", cxxopts::value<std::string>())
+        ("o,output", "Archive file to write (default: standard output)", cxxopts::value<std::string>())
+        ("zstd", "Compress the archive with zstd")
+        ("compression-level", "zstd level for --zstd", cxxopts::value<int>())
+        ("compression-threads", "zstd worker threads for --zstd", cxxopts::value<unsigned int>())
+        ("threads", "Threads rebuilding archived versions (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("no-verify", "Skip rehashing rebuilt versions against their stored digest")
+        ("encryption-key", "Key file the backup was encrypted with", cxxopts::value<std::string>())
+        ("h,help", "Print help");
+    // clang-format on
+    options.parse_positional({"timestamp"});
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")))
+    {
+        std::cerr << options.help() << '\n';
+        return 0;
+    }
+
+    ExportConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    config.databaseFile = config.backupRoot / "backup.db";
+    if (0 < parseResult.count("timestamp"))
+    {
+        config.timestamp = parseResult["timestamp"].as<std::string>();
+    }
+    if (0 < parseResult.count("output"))
+    {
+        config.outputFile = std::filesystem::path(parseResult["output"].as<std::string>());
+    }
+    config.compress = (0 < parseResult.count("zstd"));
+    if ((true == config.compress) && (false == FileCompressor::IsAvailable()))
+    {
+        std::cerr << "--zstd needs a build with zstd\n";
+        return 1;
+    }
+    if (0 < parseResult.count("compression-level"))
+    {
+        config.compressionLevel = parseResult["compression-level"].as<int>();
+    }
+    if (0 < parseResult.count("compression-threads"))
+    {
+        config.compressionThreads = parseResult["compression-threads"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("threads"))
+    {
+        config.threads = parseResult["threads"].as<unsigned int>();
+    }
+    config.verify = (0 == parseResult.count("no-verify"));
+    if (0 < parseResult.count("encryption-key"))
+    {
+        config.encryptionKeyFile = std::filesystem::path(parseResult["encryption-key"].as<std::string>());
+    }
+
+    // Standard output may carry the archive, so everything else goes to standard error.
+    ExportReport report{};
+    if (false == RunExport(config, report))
+    {
+        std::cerr << "Export failed after " << report.members << " files\n";
+        return 1;
+    }
+    std::cerr << "Exported " << report.members << " files, " << report.contentBytes << " bytes (" << report.outputBytes << " written, "
+              << report.splicedBytes << " spliced)\n";
+    return 0;
+}
+
+/**
+ * @brief Runs the mount subcommand, serving the history in the foreground until it is unmounted.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunMountCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup mount", "Mount every point in time of a backup as a read-only filesystem");
+    options.positional_help("<mount point>");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("mountpoint", "Empty directory to mount on", cxxopts::value<std::string>())
+        ("cache-mb", "Memory of the block cache in MiB", cxxopts::value<std::size_t>())
+        ("no-verify", "Skip rehashing rebuilt versions against their stored digest")
+        ("encryption-key", "Key file the backup was encrypted with", cxxopts::value<std::string>())
+        ("h,help", "Print help");
+    // clang-format on
+    options.parse_positional({"mountpoint"});
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")) || (0 == parseResult.count("mountpoint")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+    if (false == IsMountSupported())
+    {
+        std::cerr << "mount needs a build with FUSE 3\n";
+        return 1;
+    }
+
+    MountConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    config.databaseFile = config.backupRoot / "backup.db";
+    config.mountPoint = std::filesystem::path(parseResult["mountpoint"].as<std::string>());
+    if (0 < parseResult.count("cache-mb"))
+    {
+        config.cacheMegabytes = parseResult["cache-mb"].as<std::size_t>();
+    }
+    config.verify = (0 == parseResult.count("no-verify"));
+    if (0 < parseResult.count("encryption-key"))
+    {
+        config.encryptionKeyFile = std::filesystem::path(parseResult["encryption-key"].as<std::string>());
+    }
+
+    if (false == RunMount(config))
+    {
+        std::cerr << "Mount failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the import subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code, 1 if the store is not new or a file could not be imported.
+ */
+int RunImportCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup import", "Seed a new backup from an existing mirror directory or tar archive");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory, whose backup/ must be missing or empty", cxxopts::value<std::string>())
+        ("mirror", "Existing copy of the source tree to adopt", cxxopts::value<std::string>())
+        ("tar", "Tar archive of the source tree to unpack, - reads standard input", cxxopts::value<std::string>())
+        ("s,source", "Source directory later backups will run on; matching files are recorded with its metadata", cxxopts::value<std::string>())
+        ("method", "How mirror files are placed (rename, hardlink, reflink)", cxxopts::value<std::string>())
+        ("hash", "Hash algorithm later backups use (XXH64, XXH3_64, XXH3_128, XXH3_128_TREE, BLAKE3)", cxxopts::value<std::string>())
+        ("threads", "Placing and hashing threads (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")) || (1 != parseResult.count("mirror") + parseResult.count("tar")))
+    {
+        std::cerr << options.help() << '\n';
+        return 0;
+    }
+
+    ImportConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    config.databaseFile = config.backupRoot / "backup.db";
+    if (0 < parseResult.count("mirror"))
+    {
+        config.mirrorDir = std::filesystem::path(parseResult["mirror"].as<std::string>());
+    }
+    if (0 < parseResult.count("tar"))
+    {
+        config.tarFile = std::filesystem::path(parseResult["tar"].as<std::string>());
+    }
+    if (0 < parseResult.count("source"))
+    {
+        config.sourceDir = std::filesystem::path(parseResult["source"].as<std::string>());
+    }
+    if ((0 < parseResult.count("method")) && (false == StringToImportMethod(parseResult["method"].as<std::string>(), config.method)))
+    {
+        std::cerr << "Unknown import method\n";
+        return 1;
+    }
+    if ((0 < parseResult.count("hash")) && (false == StringToHashAlgorithm(parseResult["hash"].as<std::string>(), config.hashAlgorithm)))
+    {
+        std::cerr << "Unknown hash algorithm\n";
+        return 1;
+    }
+    if (0 < parseResult.count("threads"))
+    {
+        config.threads = parseResult["threads"].as<unsigned int>();
+    }
+
+    ImportReport report{};
+    const bool imported = RunImport(config, report);
+    std::cout << "Imported " << report.files << " files, " << report.bytes << " bytes (" << report.matched << " matched the source, "
+              << report.skipped << " skipped, " << report.failed << " failed)\n";
+    if (false == imported)
+    {
+        std::cerr << "Import failed; it needs an empty backup directory and database\n";
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the verify subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code, 1 if the store cannot be read or a file failed verification.
+ */
+int RunVerifyCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup verify", "Rehash stored files against their recorded digests");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("snapshots", "Verify the versions archived under deleted/ too")
+        ("slices", "Runs it takes to cover the whole store, each run verifying the next slice (default 1)", cxxopts::value<unsigned int>())
+        ("threads", "Hashing threads (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("read-bwlimit", "Read bandwidth limit in MiB/s shared by all threads (0 is unlimited)", cxxopts::value<double>())
+        ("read-iops", "Read requests per second shared by all threads (0 is unlimited)", cxxopts::value<std::uint64_t>())
+        ("encryption-key", "Key file the backup was encrypted with", cxxopts::value<std::string>())
+        ("repair", "Rebuild damaged backup copies and pack segments in place from the parity kept by --parity")
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    VerifyConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    config.databaseFile = config.backupRoot / "backup.db";
+    config.snapshots = (0 < parseResult.count("snapshots"));
+    config.repair = (0 < parseResult.count("repair"));
+    if (0 < parseResult.count("slices"))
+    {
+        config.slices = parseResult["slices"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("threads"))
+    {
+        config.threads = parseResult["threads"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("read-bwlimit"))
+    {
+        config.ioLimits.readBytesPerSecond = MebibytesToBytes(parseResult["read-bwlimit"].as<double>());
+    }
+    if (0 < parseResult.count("read-iops"))
+    {
+        config.ioLimits.readOpsPerSecond = parseResult["read-iops"].as<std::uint64_t>();
+    }
+    if (0 < parseResult.count("encryption-key"))
+    {
+        config.encryptionKeyFile = std::filesystem::path(parseResult["encryption-key"].as<std::string>());
+    }
+
+    VerifyReport report;
+    if (false == RunVerify(config, report))
+    {
+        std::cerr << "Verify failed\n";
+        return 1;
+    }
+    for (const auto& issue : report.issues)
+    {
+        const char* problem = "unreadable";
+        if (VerifyIssueType::Missing == issue.type)
+        {
+            problem = "missing";
+        }
+        else if (VerifyIssueType::Mismatch == issue.type)
+        {
+            problem = "mismatch";
+        }
+        std::cout << problem << ": " << issue.path << '\n';
+    }
+    for (const auto& path : report.repaired)
+    {
+        std::cout << "repaired: " << path << '\n';
+    }
+    std::cout << "Verified slice " << (report.slice + 1) << " of " << report.slices << ": " << report.filesVerified << " files, "
+              << std::fixed << std::setprecision(1) << (static_cast<double>(report.bytesVerified) / BytesPerMebibyte) << " MiB, "
+              << report.issues.size() << " problems";
+    if (false == report.repaired.empty())
+    {
+        std::cout << ", " << report.repaired.size() << " repaired from parity";
+    }
+    if (0 != report.filesSkipped)
+    {
+        std::cout << ", " << report.filesSkipped << " archived versions not stored as plain copies skipped";
+    }
+    std::cout << '\n';
+    return (true == report.issues.empty()) ? 0 : 1;
+}
+
+/**
+ * @brief Runs the prune subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunPruneCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup prune", "Delete snapshots a retention policy no longer keeps");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("keep-last", "Keep the newest N snapshots", cxxopts::value<unsigned int>())
+        ("keep-daily", "Keep the newest snapshot of each of the newest N days", cxxopts::value<unsigned int>())
+        ("keep-weekly", "Keep the newest snapshot of each of the newest N weeks", cxxopts::value<unsigned int>())
+        ("threads", "Deleting threads (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("dry-run", "List the snapshots that would be pruned without deleting anything")
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    PruneConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    config.databaseFile = config.backupRoot / "backup.db";
+    if (0 < parseResult.count("keep-last"))
+    {
+        config.policy.keepLast = parseResult["keep-last"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("keep-daily"))
+    {
+        config.policy.keepDaily = parseResult["keep-daily"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("keep-weekly"))
+    {
+        config.policy.keepWeekly = parseResult["keep-weekly"].as<unsigned int>();
+    }
+    if ((0 == config.policy.keepLast) && (0 == config.policy.keepDaily) && (0 == config.policy.keepWeekly))
+    {
+        std::cerr << "At least one of --keep-last, --keep-daily and --keep-weekly must be above zero\n";
+        return 1;
+    }
+    if (0 < parseResult.count("threads"))
+    {
+        config.threads = parseResult["threads"].as<unsigned int>();
+    }
+    config.dryRun = (0 < parseResult.count("dry-run"));
+
+    PruneReport report;
+    if (false == RunPrune(config, report))
+    {
+        std::cerr << "Prune failed\n";
+        return 1;
+    }
+    for (const auto& name : report.pruned)
+    {
+        std::cout << ((true == config.dryRun) ? "would prune: " : "pruned: ") << name << '\n';
+    }
+    std::cout << "Kept " << report.kept.size() << " snapshots";
+    if (0 != report.keptAsDeltaBasis)
+    {
+        std::cout << " (" << report.keptAsDeltaBasis << " as delta bases)";
+    }
+    std::cout << ", pruned " << report.pruned.size() << " with " << report.versionsRemoved << " versions";
+    if (false == config.dryRun)
+    {
+        std::cout << ", reclaimed " << report.objectsReclaimed << " objects and " << report.chunksReclaimed << " chunks";
+        if (0 != report.parityReclaimed)
+        {
+            std::cout << ", " << report.parityReclaimed << " parity files";
+        }
+    }
+    std::cout << '\n';
+    return 0;
+}
+
+/**
+ * @brief Runs the consolidate subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunConsolidateCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup consolidate", "Rewrite delta versions in full so that restoring an old version stays fast");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("keyframe-every", "Most deltas applied to rebuild any version (0 is unbounded)", cxxopts::value<unsigned int>())
+        ("max-chain-mb", "Most MiB rebuilt along a chain of deltas (0 is unbounded)", cxxopts::value<double>())
+        ("threads", "Rewriting threads, at idle priority (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("bwlimit", "Read and write bandwidth limit in MiB/s shared by all threads (0 is unlimited)", cxxopts::value<double>())
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    ConsolidateConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    config.databaseFile = config.backupRoot / "backup.db";
+    if (0 < parseResult.count("keyframe-every"))
+    {
+        config.keyframeInterval = parseResult["keyframe-every"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("max-chain-mb"))
+    {
+        config.maxChainBytes = MebibytesToBytes(parseResult["max-chain-mb"].as<double>());
+    }
+    if ((0 == config.keyframeInterval) && (0 == config.maxChainBytes))
+    {
+        std::cerr << "At least one of --keyframe-every and --max-chain-mb must be above zero\n";
+        return 1;
+    }
+    if (0 < parseResult.count("threads"))
+    {
+        config.threads = parseResult["threads"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("bwlimit"))
+    {
+        config.ioLimits.readBytesPerSecond = MebibytesToBytes(parseResult["bwlimit"].as<double>());
+        config.ioLimits.writeBytesPerSecond = config.ioLimits.readBytesPerSecond;
+    }
+
+    ConsolidateReport report;
+    const bool consolidated = RunConsolidate(config, report);
+    std::cout << "Checked " << report.chains << " delta chains, wrote " << report.keyframesWritten << " keyframes (" << report.bytesWritten
+              << " bytes), longest chain left " << report.longestChain;
+    if (0 != report.failed)
+    {
+        std::cout << ", " << report.failed << " failed";
+    }
+    std::cout << '\n';
+    if (false == consolidated)
+    {
+        std::cerr << "Consolidation failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the tier subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunTierCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup tier", "Move old snapshots from the backup directory to a cold tier");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory, the hot tier", cxxopts::value<std::string>())
+        ("cold", "Directory of the cold tier", cxxopts::value<std::string>())
+        ("older-than-days", "Move the snapshots started more than this many days ago (default 30)", cxxopts::value<unsigned int>())
+        ("bwlimit", "Read and write bandwidth limit in MiB/s (0 is unlimited)", cxxopts::value<double>())
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")) || (0 == parseResult.count("cold")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    TierConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    config.databaseFile = config.backupRoot / "backup.db";
+    config.coldRoot = std::filesystem::path(parseResult["cold"].as<std::string>());
+    if (0 < parseResult.count("older-than-days"))
+    {
+        config.olderThanDays = parseResult["older-than-days"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("bwlimit"))
+    {
+        config.ioLimits.readBytesPerSecond = MebibytesToBytes(parseResult["bwlimit"].as<double>());
+        config.ioLimits.writeBytesPerSecond = config.ioLimits.readBytesPerSecond;
+    }
+
+    TierReport report;
+    const bool moved = RunTier(config, report);
+    std::cout << "Moved " << report.snapshotsMoved << " snapshots, " << report.filesMoved << " files (" << report.bytesMoved << " bytes), "
+              << report.deltasRebuilt << " deltas rebuilt in full\n";
+    if (false == moved)
+    {
+        std::cerr << "Moving to the cold tier failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the maintain subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunMaintainCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup maintain", "Compact the backup database and refresh its query statistics");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("purge-deleted-days", "Forget files deleted more than N days ago (0 keeps them all)", cxxopts::value<unsigned int>())
+        ("vacuum", "Rewrite a database created without incremental auto-vacuum once, so its free pages can be returned")
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    MaintainConfig config;
+    config.databaseFile = std::filesystem::path(parseResult["backup"].as<std::string>()) / "backup.db";
+    if (0 < parseResult.count("purge-deleted-days"))
+    {
+        config.purgeDeletedDays = parseResult["purge-deleted-days"].as<unsigned int>();
+    }
+    config.vacuum = (0 < parseResult.count("vacuum"));
+
+    MaintainReport report;
+    if (false == RunMaintain(config, report))
+    {
+        std::cerr << "Maintenance failed\n";
+        return 1;
+    }
+    std::cout << "Purged " << report.rowsPurged << " deleted file rows";
+    if (true == report.converted)
+    {
+        std::cout << ", switched to incremental auto-vacuum";
+    }
+    std::cout << ", database " << report.bytesBefore << " -> " << report.bytesAfter << " bytes\n";
+    return 0;
+}
+
+/**
+ * @brief Runs the replicate subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunReplicateCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup replicate", "Bring a copy of the backup in another directory up to date");
+    options.positional_help("<target>");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("target", "Directory the replica is kept in", cxxopts::value<std::string>())
+        ("threads", "Copying threads (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("h,help", "Print help");
+    // clang-format on
+    options.parse_positional({"target"});
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")) || (0 == parseResult.count("target")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    ReplicateConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    config.databaseFile = config.backupRoot / "backup.db";
+    config.target = std::filesystem::path(parseResult["target"].as<std::string>());
+    if (0 < parseResult.count("threads"))
+    {
+        config.threads = parseResult["threads"].as<unsigned int>();
+    }
+
+    ReplicateReport report;
+    if (false == RunReplicate(config, report))
+    {
+        std::cerr << "Replication failed\n";
+        return 1;
+    }
+    std::cout << ((true == report.full) ? "Full" : "Incremental") << " replication up to run " << report.runId << ": sent " << report.filesCopied
+              << " files (" << report.bytesCopied << " bytes), removed " << report.entriesRemoved << " entries\n";
+    return 0;
+}
+
+/**
+ * @brief Print one differing file as `+`, `-` or `M` followed by its path.
+ *
+ * @param[in] entry Differing file
+ */
+void PrintDiffEntry(const DiffEntry& entry)
+{
+    const char marker = (ChangeType::Added == entry.change) ? '+' : ((ChangeType::Deleted == entry.change) ? '-' : 'M');
+    std::cout << marker << ' ' << entry.path << '\n';
+}
+
+/**
+ * @brief Runs the diff subcommand, between two points in time of one backup or between two backups.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code: 0 if the trees hold the same files, 1 if they differ, 2 on error.
+ */
+int RunDiffCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup diff", "List the files that differ between two points in time of a backup, or between two backups");
+    options.positional_help("[<from> <to>]");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory compared from", cxxopts::value<std::string>())
+        ("against", "Backup directory compared to, instead of two points in time", cxxopts::value<std::string>())
+        ("times", "Points in time YYYY-MM-DD_HH-MM-SS or prefixes of them", cxxopts::value<std::vector<std::string>>())
+        ("h,help", "Print help");
+    // clang-format on
+    options.parse_positional({"times"});
+
+    auto parseResult = options.parse(argc, argv);
+    const std::size_t timeCount = (0 < parseResult.count("times")) ? parseResult["times"].as<std::vector<std::string>>().size() : 0;
+    const bool againstBackup = (0 < parseResult.count("against"));
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")) || ((false == againstBackup) && (2 != timeCount)) ||
+        ((true == againstBackup) && (0 != timeCount)))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+    const std::filesystem::path databaseFile = std::filesystem::path(parseResult["backup"].as<std::string>()) / "backup.db";
+
+    if (false == againstBackup)
+    {
+        SnapshotDiffConfig config;
+        config.databaseFile = databaseFile;
+        config.from = parseResult["times"].as<std::vector<std::string>>()[0];
+        config.to = parseResult["times"].as<std::vector<std::string>>()[1];
+        std::size_t differing = 0;
+        const bool compared = RunSnapshotDiff(config,
+                                              [&differing](const DiffEntry& entry)
+                                              {
+                                                  PrintDiffEntry(entry);
+                                                  ++differing;
+                                                  return true;
+                                              });
+        if (false == compared)
+        {
+            std::cerr << "Diff failed\n";
+            return 2;
+        }
+        std::cout << differing << " files differ\n";
+        return (0 == differing) ? 0 : 1;
+    }
+
+    DiffConfig config;
+    config.databaseFile = databaseFile;
+    config.otherDatabaseFile = std::filesystem::path(parseResult["against"].as<std::string>()) / "backup.db";
+
+    DiffReport report;
+    if (false == RunDiff(config, report))
+    {
+        std::cerr << "Diff failed\n";
+        return 2;
+    }
+    for (const auto& entry : report.entries)
+    {
+        PrintDiffEntry(entry);
+    }
+    std::cout << report.entries.size() << " files differ, " << report.directoriesCompared << " directories compared, "
+              << report.directoriesSkipped << " skipped as identical\n";
+    return (true == report.entries.empty()) ? 0 : 1;
+}
+
+/**
+ * @brief Runs the find subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code: 0 if a version matched, 1 if none did, 2 on error.
+ */
+int RunFindCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup find", "List the recorded versions of the files whose path matches a pattern");
+    options.positional_help("<pattern>");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("pattern", "GLOB pattern over the relative path, or text the path contains", cxxopts::value<std::string>())
+        ("h,help", "Print help");
+    // clang-format on
+    options.parse_positional({"pattern"});
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")) || (0 == parseResult.count("pattern")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    FindConfig config;
+    config.databaseFile = std::filesystem::path(parseResult["backup"].as<std::string>()) / "backup.db";
+    config.pattern = parseResult["pattern"].as<std::string>();
+
+    std::size_t found = 0;
+    const bool searched = RunFind(config,
+                                  [&found](const FoundVersion& version)
+                                  {
+                                      std::cout << version.version << ' ' << version.size << ' ' << version.path;
+                                      if (false == version.snapshot.empty())
+                                      {
+                                          std::cout << " (" << version.snapshot << ')';
+                                      }
+                                      std::cout << '\n';
+                                      ++found;
+                                      return true;
+                                  });
+    if (false == searched)
+    {
+        std::cerr << "Find failed\n";
+        return 2;
+    }
+    return (0 == found) ? 1 : 0;
+}
+
+/**
+ * @brief Runs the hash subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code, 1 if the manifest is incomplete.
+ */
+int RunHashCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup hash", "Write a hashdeep-style content manifest of a tree without copying anything");
+    options.positional_help("<dir>");
+
+    // clang-format off
+    options.add_options()
+        ("dir", "File or directory tree to hash", cxxopts::value<std::string>())
+        ("out", "Manifest file to write", cxxopts::value<std::string>())
+        ("sorted", "List files in sorted walk order instead of the order they are hashed in")
+        ("hash", "Hash algorithm of the digests (XXH64, XXH3_64, XXH3_128, XXH3_128_TREE, BLAKE3)", cxxopts::value<std::string>())
+        ("threads", "Hashing threads (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("walk-threads", "Threads enumerating the tree", cxxopts::value<unsigned int>())
+        ("read-engine", "How files are read for hashing (blocking, io_uring)", cxxopts::value<std::string>())
+        ("exclude", "gitignore-style pattern to exclude (repeatable)", cxxopts::value<std::vector<std::string>>())
+        ("hash-cache", "SQLite digest cache shared with backup jobs", cxxopts::value<std::string>())
+        ("xattr-digests", "Use and refresh the digests cached in an extended attribute on each file")
+        ("h,help", "Print help");
+    // clang-format on
+    options.parse_positional({"dir"});
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("dir")) || (0 == parseResult.count("out")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    HashManifestConfig config;
+    config.sourceDir = std::filesystem::path(parseResult["dir"].as<std::string>());
+    config.outputFile = std::filesystem::path(parseResult["out"].as<std::string>());
+    config.sorted = (0 < parseResult.count("sorted"));
+    if ((0 < parseResult.count("hash")) && (false == StringToHashAlgorithm(parseResult["hash"].as<std::string>(), config.hashAlgorithm)))
+    {
+        std::cerr << "Unknown hash algorithm\n";
+        return 1;
+    }
+    if ((0 < parseResult.count("read-engine")) && (false == StringToReadEngine(parseResult["read-engine"].as<std::string>(), config.readEngine)))
+    {
+        std::cerr << "Unknown read engine\n";
+        return 1;
+    }
+    if (0 < parseResult.count("threads"))
+    {
+        config.threads = parseResult["threads"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("walk-threads"))
+    {
+        config.walkThreads = parseResult["walk-threads"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("exclude"))
+    {
+        config.filterRules.patterns = parseResult["exclude"].as<std::vector<std::string>>();
+    }
+    if (0 < parseResult.count("hash-cache"))
+    {
+        config.hashCacheFile = std::filesystem::path(parseResult["hash-cache"].as<std::string>());
+    }
+    config.digestAttributes = (0 < parseResult.count("xattr-digests"));
+
+    HashManifestReport report{};
+    const bool hashed = RunHashManifest(config, report);
+    std::cout << "Hashed " << report.files << " files, " << std::fixed << std::setprecision(1)
+              << (static_cast<double>(report.bytes) / BytesPerMebibyte) << " MiB (" << report.cacheHits << " from cache, " << report.failed
+              << " failed)\n";
+    if (false == hashed)
+    {
+        std::cerr << "Manifest incomplete\n";
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the watch subcommand until SIGINT or SIGTERM.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunWatchCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup watch", "Record changed directories for `--journal` backups");
+
+    // clang-format off
+    options.add_options()
+        ("s,source", "Source directory", cxxopts::value<std::string>())
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("flush-interval-ms", "Time in milliseconds between two flushes of the recorded changes", cxxopts::value<unsigned int>())
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("source")) || (0 == parseResult.count("backup")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    WatchConfig config;
+    std::error_code errorCode;
+    // Journal keys must match the backup's, which runs on the canonical source path.
+    config.sourceDir = std::filesystem::canonical(std::filesystem::path(parseResult["source"].as<std::string>()), errorCode);
+    if ((0 != errorCode.value()) || (false == std::filesystem::is_directory(config.sourceDir)))
+    {
+        std::cerr << "Invalid source directory\n";
+        return 1;
+    }
+    const std::filesystem::path backupRoot(parseResult["backup"].as<std::string>());
+    std::filesystem::create_directories(backupRoot, errorCode);
+    if (0 != errorCode.value())
+    {
+        std::cerr << "Failed to create backup directory\n";
+        return 1;
+    }
+    config.databaseFile = backupRoot / "backup.db";
+    if (0 < parseResult.count("flush-interval-ms"))
+    {
+        config.flushIntervalMs = parseResult["flush-interval-ms"].as<unsigned int>();
+    }
+
+    std::signal(SIGINT, [](int) { StopRequested.store(true); });
+    std::signal(SIGTERM, [](int) { StopRequested.store(true); });
+    if (false == RunWatch(config, StopRequested))
+    {
+        std::cerr << "Watch failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the partition-plan subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunPartitionPlanCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup partition-plan", "Split a source tree by its top-level entries across the nodes of a distributed backup");
+
+    // clang-format off
+    options.add_options()
+        ("s,source", "Source directory", cxxopts::value<std::string>())
+        ("b,backup", "Backup directory shared by the nodes", cxxopts::value<std::string>())
+        ("partitions", "Number of partitions, one per node", cxxopts::value<unsigned int>())
+        ("rebalance", "Reassign every entry instead of only new ones")
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("source")) || (0 == parseResult.count("backup")) ||
+        (0 == parseResult.count("partitions")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    PartitionPlanConfig config;
+    config.sourceDir = std::filesystem::path(parseResult["source"].as<std::string>());
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    config.partitions = parseResult["partitions"].as<unsigned int>();
+    config.rebalance = (0 < parseResult.count("rebalance"));
+    if (0 == config.partitions)
+    {
+        std::cerr << "--partitions must be above zero\n";
+        return 1;
+    }
+
+    PartitionPlanReport report;
+    if (false == RunPartitionPlan(config, report))
+    {
+        std::cerr << "Partition plan failed\n";
+        return 1;
+    }
+    std::cout << "Plan " << report.created << ": " << report.entries << " entries, " << report.entriesWithHistory << " with history\n";
+    for (std::size_t partition = 0; partition < report.partitionCosts.size(); ++partition)
+    {
+        std::cout << "partition " << partition << ": estimated cost " << report.partitionCosts[partition] << '\n';
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the partition-merge subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunPartitionMergeCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup partition-merge", "Record the partitions' runs as one snapshot once all of them completed");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory shared by the nodes", cxxopts::value<std::string>())
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    PartitionMergeConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+
+    PartitionMergeReport report;
+    if (false == RunPartitionMerge(config, report))
+    {
+        for (const unsigned int partition : report.pendingPartitions)
+        {
+            std::cerr << "partition " << partition << " has no completed run since the plan\n";
+        }
+        std::cerr << "Partition merge failed\n";
+        return 1;
+    }
+    std::cout << "Merged snapshot " << report.snapshot << ": " << report.files << " files, " << report.bytes << " bytes\n";
+    return 0;
+}
+
+/**
+ * @brief Runs the status subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunStatusCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup status", "Print the live counters a backup run publishes with --status-segment");
+
+    // clang-format off
+    options.add_options()
+        ("n,name", "Segment name given to --status-segment", cxxopts::value<std::string>())
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("name")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    LiveStatus status;
+    if (false == ReadLiveStatus(parseResult["name"].as<std::string>(), status))
+    {
+        std::cerr << "No status segment of that name\n";
+        return 1;
+    }
+    std::cout << "pid " << status.processId << ", stage " << status.stage << '\n';
+    std::cout << "processed " << status.filesProcessed << " files, " << status.bytesProcessed << " bytes\n";
+    std::cout << "queued " << status.filesQueued << " files, " << status.queueDepth << " waiting\n";
+    if (0 < status.totalFiles)
+    {
+        std::cout << "total " << status.totalFiles << " files, " << status.totalBytes << " bytes" << ((true == status.totalFinal) ? "" : " so far") << '\n';
+    }
+    for (std::size_t worker = 0; worker < status.workers.size(); ++worker)
+    {
+        std::cout << "worker " << worker << ": " << status.workers[worker].files << " files, " << status.workers[worker].bytes << " bytes";
+        if (false == status.workers[worker].currentFile.empty())
+        {
+            std::cout << ", " << status.workers[worker].currentFile;
+        }
+        std::cout << '\n';
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the history subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunHistoryCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup history", "List the recorded backup runs with their stage times and counts, newest first");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Backup directory", cxxopts::value<std::string>())
+        ("limit", "Most runs listed, 0 for all", cxxopts::value<std::size_t>()->default_value("20"))
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    HistoryConfig config;
+    config.databaseFile = std::filesystem::path(parseResult["backup"].as<std::string>()) / "backup.db";
+    config.limit = parseResult["limit"].as<std::size_t>();
+
+    HistoryReport report;
+    if (false == RunHistory(config, report))
+    {
+        std::cerr << "History failed\n";
+        return 1;
+    }
+    std::cout << std::fixed << std::setprecision(3);
+    for (const auto& run : report.runs)
+    {
+        std::cout << run.started << ' ' << RunOutcomeToString(run.outcome) << ' ' << run.elapsedSeconds << " s, threads " << run.walkThreads << '/'
+                  << run.hashThreads << '/' << run.copyThreads << '\n';
+        std::cout << "  files:";
+        for (std::size_t changeType = 0; changeType < ChangeTypeCount; ++changeType)
+        {
+            std::cout << ' ' << ChangeTypeToString(static_cast<ChangeType>(changeType)) << '=' << run.filesByChange[changeType];
+        }
+        std::cout << " (moved=" << run.filesMoved << "), read " << run.bytesRead << " bytes, written " << run.bytesWritten << " bytes\n";
+        std::cout << "  wall s:";
+        for (std::size_t stage = 0; stage < BackupStageCount; ++stage)
+        {
+            std::cout << ' ' << BackupStageToString(static_cast<BackupStage>(stage)) << '=' << run.stages[stage].wallSeconds;
+        }
+        std::cout << '\n';
+    }
+    return 0;
+}
+
+/**
+ * @brief Split a `host:port` address; IPv6 hosts are written in brackets, `[::1]:7420`.
+ *
+ * @param[in] address Address as given on the command line; without a port the default port is kept.
+ * @param[out] outputHost Host part.
+ * @param[in,out] outputPort Port part, unchanged if the address has none.
+ * @return true if the address is well formed.
+ */
+bool SplitHostPort(const std::string& address, std::string& outputHost, std::uint16_t& outputPort)
+{
+    std::string port;
+    if ((false == address.empty()) && ('[' == address.front()))
+    {
+        const std::size_t close = address.find(']');
+        if ((std::string::npos == close) || ((close + 1 < address.size()) && (':' != address[close + 1])))
+        {
+            return false;
+        }
+        outputHost = address.substr(1, close - 1);
+        port = (close + 1 < address.size()) ? address.substr(close + 2) : std::string();
+    }
+    else
+    {
+        const std::size_t colon = address.rfind(':');
+        outputHost = address.substr(0, colon);
+        port = (std::string::npos != colon) ? address.substr(colon + 1) : std::string();
+    }
+    if (true == port.empty())
+    {
+        return false == outputHost.empty();
+    }
+    try
+    {
+        const unsigned long value = std::stoul(port);
+        if ((65535 < value) || (true == outputHost.empty()))
+        {
+            return false;
+        }
+        outputPort = static_cast<std::uint16_t>(value);
+    }
+    catch (const std::exception&)
+    {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Runs the serve subcommand until SIGINT or SIGTERM.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunServeCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup serve", "Accept backups pushed by `rdemo-backup push` clients");
+
+    // clang-format off
+    options.add_options()
+        ("b,backup", "Directory holding one backup per client name", cxxopts::value<std::string>())
+        ("listen", "Address and port to listen on (default 0.0.0.0:7420)", cxxopts::value<std::string>())
+        ("hash", "Hash algorithm clients hash with (XXH64, XXH3_64, XXH3_128, XXH3_128_TREE, BLAKE3)", cxxopts::value<std::string>())
+        ("threads", "Threads per client storing received files (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("metrics-listen", "Serve Prometheus metrics at GET /metrics on this address and port (default port 9742)", cxxopts::value<std::string>())
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("backup")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    ServeConfig config;
+    config.backupRoot = std::filesystem::path(parseResult["backup"].as<std::string>());
+    if ((0 < parseResult.count("listen")) && (false == SplitHostPort(parseResult["listen"].as<std::string>(), config.listenAddress, config.port)))
+    {
+        std::cerr << "Invalid listen address\n";
+        return 1;
+    }
+    if ((0 < parseResult.count("hash")) && (false == StringToHashAlgorithm(parseResult["hash"].as<std::string>(), config.hashAlgorithm)))
+    {
+        std::cerr << "Unknown hash algorithm\n";
+        return 1;
+    }
+    if (0 < parseResult.count("threads"))
+    {
+        config.threads = parseResult["threads"].as<unsigned int>();
+    }
+    if ((0 < parseResult.count("metrics-listen")) &&
+        (false == SplitHostPort(parseResult["metrics-listen"].as<std::string>(), config.metricsAddress, config.metricsPort)))
+    {
+        std::cerr << "Invalid metrics address\n";
+        return 1;
+    }
+    config.onListening = [](std::uint16_t port) { std::cout << "Listening on port " << port << std::endl; };
+    config.onMetricsListening = [](std::uint16_t port) { std::cout << "Serving metrics on port " << port << std::endl; };
+
+    std::signal(SIGINT, [](int) { StopRequested.store(true); });
+    std::signal(SIGTERM, [](int) { StopRequested.store(true); });
+    if (false == RunServe(config, StopRequested))
+    {
+        std::cerr << "Serve failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs the push subcommand.
+ *
+ * @param[in] argc Argument count, starting at the subcommand name.
+ * @param[in] argv Argument values, starting at the subcommand name.
+ * @return Process exit code.
+ */
+int RunPushCommand(int argc, char* argv[])
+{
+    cxxopts::Options options("rdemo-backup push", "Back up a directory to an `rdemo-backup serve` server");
+
+    // clang-format off
+    options.add_options()
+        ("s,source", "Source directory", cxxopts::value<std::string>())
+        ("server", "Server address and port (host[:port], default port 7420)", cxxopts::value<std::string>())
+        ("name", "Name of the backup on the server", cxxopts::value<std::string>())
+        ("exclude", "gitignore-style pattern to exclude (repeatable)", cxxopts::value<std::vector<std::string>>())
+        ("include", "gitignore-style pattern to include again, applied after --exclude (repeatable)", cxxopts::value<std::vector<std::string>>())
+        ("threads", "Threads hashing and uploading files (0 uses all cores)", cxxopts::value<unsigned int>())
+        ("batch-files", "Files listed per batch", cxxopts::value<std::size_t>())
+        ("batches-in-flight", "Batches sent before the oldest one is complete", cxxopts::value<std::size_t>())
+        ("no-compress", "Send file content uncompressed")
+        ("hash-cache", "SQLite digest cache shared by jobs over overlapping trees", cxxopts::value<std::string>())
+        ("h,help", "Print help");
+    // clang-format on
+
+    auto parseResult = options.parse(argc, argv);
+    if ((0 < parseResult.count("help")) || (0 == parseResult.count("source")) || (0 == parseResult.count("server")) ||
+        (0 == parseResult.count("name")))
+    {
+        std::cout << options.help() << '\n';
+        return 0;
+    }
+
+    RemoteBackupConfig config;
+    config.sourceDir = std::filesystem::path(parseResult["source"].as<std::string>());
+    config.name = parseResult["name"].as<std::string>();
+    if (false == SplitHostPort(parseResult["server"].as<std::string>(), config.host, config.port))
+    {
+        std::cerr << "Invalid server address\n";
+        return 1;
+    }
+    if (0 < parseResult.count("exclude"))
+    {
+        for (const auto& pattern : parseResult["exclude"].as<std::vector<std::string>>())
+        {
+            config.filterRules.patterns.push_back(pattern);
+        }
+    }
+    if (0 < parseResult.count("include"))
+    {
+        for (const auto& pattern : parseResult["include"].as<std::vector<std::string>>())
+        {
+            config.filterRules.patterns.push_back("!" + pattern);
+        }
+    }
+    if (0 < parseResult.count("threads"))
+    {
+        config.hashThreads = parseResult["threads"].as<unsigned int>();
+    }
+    if (0 < parseResult.count("batch-files"))
+    {
+        config.batchSize = parseResult["batch-files"].as<std::size_t>();
+    }
+    if (0 < parseResult.count("batches-in-flight"))
+    {
+        config.batchesInFlight = parseResult["batches-in-flight"].as<std::size_t>();
+    }
+    config.compress = (0 == parseResult.count("no-compress"));
+    if (0 < parseResult.count("hash-cache"))
+    {
+        config.hashCacheFile = std::filesystem::path(parseResult["hash-cache"].as<std::string>());
+    }
+
+    RemoteBackupReport report{};
+    const bool pushed = RunRemoteBackup(config, report);
+    std::cout << "Added " << report.filesByChange[static_cast<std::size_t>(ChangeType::Added)] << ", modified "
+              << report.filesByChange[static_cast<std::size_t>(ChangeType::Modified)] << ", deleted "
+              << report.filesByChange[static_cast<std::size_t>(ChangeType::Deleted)] << ", unchanged "
+              << report.filesByChange[static_cast<std::size_t>(ChangeType::Unchanged)] << " files; hashed " << report.bytesHashed
+              << " bytes, uploaded " << report.contentBytes << " bytes of content in " << report.bytesSent << " bytes\n";
+    if (false == pushed)
+    {
+        std::cerr << "Push failed" << ((true == report.error.empty()) ? std::string() : ": " + report.error) << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+#if defined(RDEMO_ALLOCATOR_MIMALLOC) || defined(RDEMO_ALLOCATOR_JEMALLOC)
+// Adapters from SQLite's sqlite3_mem_methods, which pass sizes as int, to the linked allocator.
+#if defined(RDEMO_ALLOCATOR_MIMALLOC)
+void* AllocatorMalloc(int size)
+{
+    return mi_malloc(static_cast<std::size_t>(size));
+}
+
+void AllocatorFree(void* block)
+{
+    mi_free(block);
+}
+
+void* AllocatorRealloc(void* block, int size)
+{
+    return mi_realloc(block, static_cast<std::size_t>(size));
+}
+
+int AllocatorSize(void* block)
+{
+    return static_cast<int>(mi_usable_size(block));
+}
+
+int AllocatorRoundup(int size)
+{
+    return static_cast<int>(mi_good_size(static_cast<std::size_t>(size)));
+}
+#else
+void* AllocatorMalloc(int size)
+{
+    return malloc(static_cast<std::size_t>(size));
+}
+
+void AllocatorFree(void* block)
+{
+    free(block);
+}
+
+void* AllocatorRealloc(void* block, int size)
+{
+    return realloc(block, static_cast<std::size_t>(size));
+}
+
+int AllocatorSize(void* block)
+{
+    return static_cast<int>(malloc_usable_size(block));
+}
+
+int AllocatorRoundup(int size)
+{
+    return (0 < size) ? static_cast<int>(nallocx(static_cast<std::size_t>(size), 0)) : 0;
+}
+#endif
+
+int AllocatorInit(void*)
+{
+    return SQLITE_OK;
+}
+
+void AllocatorShutdown(void*)
+{
+}
+
+/**
+ * @brief Route SQLite's allocations to the allocator the build links in.
+ *
+ * The allocator replaces malloc anyway, but SQLite's default wrapper prefixes every block with
+ * its size; asking the allocator for the usable size saves the prefix and the extra rounding.
+ * Has to run before any database is opened.
+ */
+void ConfigureSQLiteAllocator()
+{
+    static const sqlite3_mem_methods methods = {&AllocatorMalloc,  &AllocatorFree, &AllocatorRealloc, &AllocatorSize,
+                                                &AllocatorRoundup, &AllocatorInit, &AllocatorShutdown, nullptr};
+    sqlite3_config(SQLITE_CONFIG_MALLOC, &methods);
+}
+#else
+/**
+ * @brief Keep SQLite on its default allocator; the build links no replacement.
+ */
+void ConfigureSQLiteAllocator()
+{
+}
+#endif
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    ConfigureSQLiteAllocator();
+    if ((1 < argc) && (std::string("restore") == argv[1]))
+    {
+        return RunRestoreCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("export") == argv[1]))
+    {
+        return RunExportCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("mount") == argv[1]))
+    {
+        return RunMountCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("import") == argv[1]))
+    {
+        return RunImportCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("verify") == argv[1]))
+    {
+        return RunVerifyCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("prune") == argv[1]))
+    {
+        return RunPruneCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("consolidate") == argv[1]))
+    {
+        return RunConsolidateCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("tier") == argv[1]))
+    {
+        return RunTierCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("maintain") == argv[1]))
+    {
+        return RunMaintainCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("replicate") == argv[1]))
+    {
+        return RunReplicateCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("diff") == argv[1]))
+    {
+        return RunDiffCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("find") == argv[1]))
+    {
+        return RunFindCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("hash") == argv[1]))
+    {
+        return RunHashCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("watch") == argv[1]))
+    {
+        return RunWatchCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("serve") == argv[1]))
+    {
+        return RunServeCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("push") == argv[1]))
+    {
+        return RunPushCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("partition-plan") == argv[1]))
+    {
+        return RunPartitionPlanCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("partition-merge") == argv[1]))
+    {
+        return RunPartitionMergeCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("status") == argv[1]))
+    {
+        return RunStatusCommand(argc - 1, argv + 1);
+    }
+    if ((1 < argc) && (std::string("history") == argv[1]))
+    {
+        return RunHistoryCommand(argc - 1, argv + 1);
+    }
+
+    std::optional<cxxopts::ParseResult> parseResult = ParseCommandLineOptions(argc, argv);
+
+    if (false == parseResult.has_value())
+    {
+        return 0; // Help was shown or invalid arguments, exit gracefully.
+    }
+
+    std::optional<BackupConfig> backupConfiguration = SetupBackupConfiguration(parseResult.value());
+
+    if (false == backupConfiguration.has_value())
+    {
+        return 1; // Configuration failed, error message already printed.
+    }
+
+    const bool hashCandidates = (0 < parseResult.value().count("dry-run-hash"));
+    if ((true == hashCandidates) || (0 < parseResult.value().count("dry-run")))
+    {
+        BackupPreview preview{};
+        const bool previewed = PreviewBackup(backupConfiguration.value(), hashCandidates, preview);
+        PrintBackupPreview(preview);
+        if (false == previewed)
+        {
+            std::cerr << "Dry run failed\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (0 < parseResult.value().count("replay-io-trace"))
+    {
+        IoTraceReplayReport report{};
+        const bool replayed = ReplayIoTrace(parseResult.value()["replay-io-trace"].as<std::string>(), backupConfiguration.value(), report);
+        if (false == replayed)
+        {
+            std::cerr << "Replay failed\n";
+            return 1;
+        }
+        PrintReplayReport(report);
+        return 0;
+    }
+
+    // The first signal stops the run cleanly; a second one ends the process right away.
+    const auto requestStop = [](int)
+    {
+        if (true == StopRequested.exchange(true))
+        {
+            std::_Exit(EXIT_FAILURE);
+        }
+    };
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+
+    const bool printStats = (0 < parseResult.value().count("stats"));
+    if (0 < parseResult.value().count("daemon"))
+    {
+        DaemonConfig daemonConfig;
+        daemonConfig.backup = backupConfiguration.value();
+        if (0 < parseResult.value().count("interval"))
+        {
+            daemonConfig.intervalSeconds = parseResult.value()["interval"].as<unsigned int>();
+        }
+        if (0 < parseResult.value().count("trigger-file"))
+        {
+            daemonConfig.triggerFile = parseResult.value()["trigger-file"].as<std::string>();
+        }
+        if (0 < parseResult.value().count("journal-threshold"))
+        {
+            daemonConfig.journalThreshold = parseResult.value()["journal-threshold"].as<std::uint64_t>();
+        }
+        if ((0 == daemonConfig.intervalSeconds) && (true == daemonConfig.triggerFile.empty()) && (0 == daemonConfig.journalThreshold))
+        {
+            std::cerr << "--daemon needs --interval, --trigger-file or --journal-threshold\n";
+            return 1;
+        }
+        daemonConfig.onRunFinished = [printStats](bool success, const BackupStats& stats)
+        {
+            if (true == printStats)
+            {
+                PrintBackupStats(stats);
+            }
+            std::cout << ((true == success) ? "Backup completed successfully\n" : "Backup failed\n");
+        };
+        if (false == RunDaemon(daemonConfig, StopRequested))
+        {
+            std::cerr << "Daemon failed\n";
+            return 1;
+        }
+        return 0;
+    }
+    const bool writeReport = (0 < parseResult.value().count("report-json"));
+    BackupStats stats{};
+    const bool success = ((true == printStats) || (true == writeReport)) ? RunBackup(backupConfiguration.value(), stats)
+                                                                         : RunBackup(backupConfiguration.value());
+    if (true == printStats)
+    {
+        PrintBackupStats(stats);
+    }
+    if (true == writeReport)
+    {
+        const std::string reportFile = parseResult.value()["report-json"].as<std::string>();
+        std::ofstream reportStream(reportFile, std::ios::trunc);
+        reportStream << FormatBackupReport(backupConfiguration.value(), stats, success);
+        reportStream.close();
+        if (false == reportStream.good())
+        {
+            std::cerr << "Could not write the report to " << reportFile << "\n";
+            return 1;
+        }
+    }
+    if ((false == success) && (true == StopRequested.load()))
+    {
+        std::cerr << "Backup stopped early; the next run continues it\n";
+        return 2;
+    }
+    if (false == success)
     {
         std::cerr << "Backup failed\n";
         return 1;
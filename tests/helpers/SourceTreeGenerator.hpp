@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+/**
+ * @brief Shape of a synthetic source tree.
+ */
+struct SourceTreeOptions
+{
+    std::uint64_t seed = 1;                   /**< Seed making the tree reproducible */
+    std::size_t fileCount = 1000;             /**< Files in the initial tree */
+    unsigned int directoryDepth = 3;          /**< Directory levels below the root */
+    unsigned int directoryFanout = 4;         /**< Subdirectories of every directory above the deepest level */
+    double directorySkew = 1.0;               /**< Zipf exponent spreading files over directories, 0 spreads them evenly */
+    double paretoShape = 1.2;                 /**< Pareto shape of file sizes; smaller values give a heavier tail */
+    std::uint64_t minimumFileSize = 1024;     /**< Pareto scale, the smallest file size in bytes */
+    std::uint64_t maximumFileSize = 16 << 20; /**< Sizes above this many bytes are clamped */
+};
+
+/**
+ * @brief Share of a generated tree changed between two runs.
+ */
+struct SourceTreeMutation
+{
+    double rate = 0.01;          /**< Fraction of the current files touched */
+    double addFraction = 0.25;   /**< Part of the touched files added as new files */
+    double deleteFraction = 0.1; /**< Part of the touched files deleted; the remainder is rewritten */
+};
+
+/**
+ * @brief Counts of the files changed by one mutation.
+ */
+struct SourceTreeMutationSummary
+{
+    std::size_t modified = 0; /**< Files rewritten with new content */
+    std::size_t added = 0;    /**< Files created */
+    std::size_t deleted = 0;  /**< Files removed */
+};
+
+/**
+ * @brief Reproducible generator of large synthetic source trees with mutations between runs.
+ *
+ * Directory and file choices use std::mt19937_64, whose output the standard fixes, with hand-written
+ * uniform and Pareto transforms, so one seed gives the same tree with every standard library. File content
+ * is pseudo-random and thus incompressible.
+ */
+class SourceTreeGenerator
+{
+  public:
+    /**
+     * @brief File the generator created.
+     */
+    struct File
+    {
+        std::filesystem::path relativePath; /**< Path below the tree root */
+        std::uint64_t size;                 /**< Size in bytes */
+    };
+
+    /**
+     * @brief Construct a generator.
+     *
+     * @param[in] root Directory the tree is written to; its previous content is removed
+     * @param[in] options Tree shape
+     */
+    SourceTreeGenerator(const std::filesystem::path& root, const SourceTreeOptions& options)
+        : _root(root), _options(options), _random(options.seed)
+    {
+    }
+
+    /**
+     * @brief Write the initial tree.
+     *
+     * @return true on success, false if a file could not be written
+     */
+    bool Generate()
+    {
+        std::error_code errorCode;
+        std::filesystem::remove_all(_root, errorCode);
+        _directories.assign(1, std::filesystem::path());
+        for (std::size_t begin = 0, depth = 0; depth < _options.directoryDepth; ++depth)
+        {
+            const std::size_t end = _directories.size();
+            for (std::size_t parent = begin; parent < end; ++parent)
+            {
+                for (unsigned int child = 0; child < _options.directoryFanout; ++child)
+                {
+                    _directories.push_back(_directories[parent] / ("d" + std::to_string(child)));
+                }
+            }
+            begin = end;
+        }
+
+        _directoryWeights.clear();
+        double totalWeight = 0.0;
+        for (std::size_t rank = 0; rank < _directories.size(); ++rank)
+        {
+            totalWeight += 1.0 / std::pow(static_cast<double>(rank + 1), _options.directorySkew);
+            _directoryWeights.push_back(totalWeight);
+        }
+
+        _files.clear();
+        _nextFileId = 0;
+        for (std::size_t i = 0; i < _options.fileCount; ++i)
+        {
+            if (false == AddFile())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Change part of the tree.
+     *
+     * Rewritten files get new content and a later modification time, so every change is detectable.
+     *
+     * @param[in] mutation Share of files to touch
+     * @param[out] outputSummary Counts of the changed files
+     * @return true on success, false if a file could not be written or removed
+     */
+    bool Mutate(const SourceTreeMutation& mutation, SourceTreeMutationSummary& outputSummary)
+    {
+        outputSummary = SourceTreeMutationSummary();
+        const std::size_t touched = static_cast<std::size_t>(std::llround(mutation.rate * static_cast<double>(_files.size())));
+        const std::size_t toAdd = static_cast<std::size_t>(std::llround(mutation.addFraction * static_cast<double>(touched)));
+        const std::size_t toDelete =
+            std::min(touched - std::min(touched, toAdd), static_cast<std::size_t>(std::llround(mutation.deleteFraction * static_cast<double>(touched))));
+        const std::size_t toModify = touched - std::min(touched, toAdd + toDelete);
+
+        // Partial Fisher-Yates: the first toModify + toDelete entries become a random sample of the files.
+        const std::size_t sampled = std::min(_files.size(), toModify + toDelete);
+        for (std::size_t i = 0; i < sampled; ++i)
+        {
+            std::swap(_files[i], _files[i + static_cast<std::size_t>(_random() % (_files.size() - i))]);
+        }
+        for (std::size_t i = 0; i < std::min(sampled, toModify); ++i)
+        {
+            if (false == WriteContent(_root / _files[i].relativePath, _files[i].size, _random()))
+            {
+                return false;
+            }
+            std::error_code errorCode;
+            const std::filesystem::file_time_type modified = std::filesystem::last_write_time(_root / _files[i].relativePath, errorCode);
+            std::filesystem::last_write_time(_root / _files[i].relativePath, modified + std::chrono::seconds(1), errorCode);
+            ++outputSummary.modified;
+        }
+        for (std::size_t i = sampled; i > outputSummary.modified; --i)
+        {
+            std::error_code errorCode;
+            if (false == std::filesystem::remove(_root / _files[i - 1].relativePath, errorCode))
+            {
+                return false;
+            }
+            _files.erase(_files.begin() + static_cast<std::ptrdiff_t>(i - 1));
+            ++outputSummary.deleted;
+        }
+        for (std::size_t i = 0; i < toAdd; ++i)
+        {
+            if (false == AddFile())
+            {
+                return false;
+            }
+            ++outputSummary.added;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Move part of the files to new names, keeping their content and modification times.
+     *
+     * Each moved file goes to a directory picked like one for a new file, so most leave their directory.
+     *
+     * @param[in] fraction Share of the current files moved
+     * @param[out] outputRenamed Files moved
+     * @return true on success, false if a file could not be moved
+     */
+    bool Rename(double fraction, std::size_t& outputRenamed)
+    {
+        outputRenamed = 0;
+        const std::size_t toRename = std::min(_files.size(), static_cast<std::size_t>(std::llround(fraction * static_cast<double>(_files.size()))));
+        for (std::size_t i = 0; i < toRename; ++i)
+        {
+            std::swap(_files[i], _files[i + static_cast<std::size_t>(_random() % (_files.size() - i))]);
+            const std::filesystem::path renamed = PickDirectory() / ("f" + std::to_string(_nextFileId++) + ".bin");
+            std::error_code errorCode;
+            std::filesystem::create_directories((_root / renamed).parent_path(), errorCode);
+            std::filesystem::rename(_root / _files[i].relativePath, _root / renamed, errorCode);
+            if (0 != errorCode.value())
+            {
+                return false;
+            }
+            _files[i].relativePath = renamed;
+            ++outputRenamed;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Add one file of a given size, such as a disk image far above the largest generated size.
+     *
+     * @param[in] size Size in bytes
+     * @return true on success, false if the file could not be written
+     */
+    bool AddFileOfSize(std::uint64_t size)
+    {
+        return AddFile(PickDirectory(), size);
+    }
+
+    /**
+     * @brief Get the files currently in the tree.
+     *
+     * @return Files in no particular order
+     */
+    const std::vector<File>& Files() const
+    {
+        return _files;
+    }
+
+    /**
+     * @brief Get the total size of the tree.
+     *
+     * @return Sum of the file sizes in bytes
+     */
+    std::uint64_t TotalBytes() const
+    {
+        std::uint64_t total = 0;
+        for (const File& file : _files)
+        {
+            total += file.size;
+        }
+        return total;
+    }
+
+  private:
+    double NextUniform()
+    {
+        constexpr double Scale = 1.0 / static_cast<double>(std::uint64_t{1} << 53);
+        return static_cast<double>(_random() >> 11) * Scale;
+    }
+
+    const std::filesystem::path& PickDirectory()
+    {
+        const double pick = NextUniform() * _directoryWeights.back();
+        const std::size_t directory =
+            std::min(_directories.size() - 1, static_cast<std::size_t>(std::upper_bound(_directoryWeights.begin(), _directoryWeights.end(), pick) -
+                                                                        _directoryWeights.begin()));
+        return _directories[directory];
+    }
+
+    bool AddFile()
+    {
+        const std::filesystem::path& directory = PickDirectory();
+        const double sample = static_cast<double>(_options.minimumFileSize) / std::pow(1.0 - NextUniform(), 1.0 / _options.paretoShape);
+        return AddFile(directory, static_cast<std::uint64_t>(std::min(sample, static_cast<double>(_options.maximumFileSize))));
+    }
+
+    bool AddFile(const std::filesystem::path& directory, std::uint64_t size)
+    {
+        File file{directory / ("f" + std::to_string(_nextFileId++) + ".bin"), size};
+        std::error_code errorCode;
+        std::filesystem::create_directories((_root / file.relativePath).parent_path(), errorCode);
+        if (false == WriteContent(_root / file.relativePath, file.size, _random()))
+        {
+            return false;
+        }
+        _files.push_back(std::move(file));
+        return true;
+    }
+
+    static bool WriteContent(const std::filesystem::path& filePath, std::uint64_t size, std::uint64_t contentSeed)
+    {
+        constexpr std::size_t ChunkWords = 8192;
+        std::ofstream outputStream(filePath, std::ios::binary | std::ios::trunc);
+        std::vector<std::uint64_t> chunk(ChunkWords);
+        std::uint64_t state = contentSeed;
+        for (std::uint64_t remaining = size; 0 < remaining;)
+        {
+            for (std::uint64_t& word : chunk)
+            {
+                // splitmix64
+                std::uint64_t mixed = (state += 0x9E3779B97F4A7C15ULL);
+                mixed = (mixed ^ (mixed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                mixed = (mixed ^ (mixed >> 27)) * 0x94D049BB133111EBULL;
+                word = mixed ^ (mixed >> 31);
+            }
+            const std::uint64_t length = std::min<std::uint64_t>(remaining, ChunkWords * sizeof(std::uint64_t));
+            outputStream.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(length));
+            remaining -= length;
+        }
+        return static_cast<bool>(outputStream.flush());
+    }
+
+    std::filesystem::path _root;
+    SourceTreeOptions _options;
+    std::mt19937_64 _random;
+    std::vector<std::filesystem::path> _directories;
+    std::vector<double> _directoryWeights;
+    std::vector<File> _files;
+    std::uint64_t _nextFileId = 0;
+};
@@ -1,10 +1,12 @@
 /**
  * @file backup_unit_tests.cpp
- * @brief Unit tests for ChangeType enum conversions.
+ * @brief Unit tests for ChangeType enum conversions, stored timestamps and snapshot retention.
  */
 #include "BackupUtility/BackupUtility.hpp"
+#include "TimestampProvider/TimestampProvider.hpp"
 #include "gtest/gtest.h"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -23,3 +25,67 @@ TEST(RunUnitTests, ToStringAndBack)
         ASSERT_EQ(changeType, convertedType);
     }
 }
+
+TEST(RunUnitTests, WallClockSeconds_RoundTripAndOrderLikeTheStrings)
+{
+    // Arrange
+    const std::vector<std::string> timestamps = {"1970-01-01_00-00-00", "1999-12-31_23-59-59", "2000-02-29_12-30-00", "2024-03-01_00-00-00",
+                                                 "2024-12-31_23-59-59"};
+
+    // Act
+    std::vector<std::int64_t> seconds;
+    std::vector<std::string> formatted;
+    for (const auto& timestamp : timestamps)
+    {
+        std::int64_t value = -1;
+        ASSERT_TRUE(TimestampProvider::ParseWallClockSeconds(timestamp, value)) << timestamp;
+        seconds.push_back(value);
+        formatted.emplace_back();
+        TimestampProvider::FormatWallClockSeconds(value, formatted.back());
+    }
+
+    // Assert
+    EXPECT_EQ(timestamps, formatted);
+    EXPECT_EQ(0, seconds.front());
+    EXPECT_EQ(946684799, seconds[1]);
+    for (std::size_t index = 1; index < seconds.size(); ++index)
+    {
+        EXPECT_LT(seconds[index - 1], seconds[index]);
+    }
+}
+
+TEST(RunUnitTests, WallClockSeconds_RejectsMalformedTimestamps)
+{
+    // Arrange
+    const std::vector<std::string> malformed = {"", "2024-05-06", "2024-05-06 08-00-00", "2024-13-06_08-00-00", "2024-05-06_24-00-00",
+                                                "2024-05-06_08-00-0x"};
+
+    for (const auto& timestamp : malformed)
+    {
+        // Act
+        std::int64_t seconds = 0;
+        const bool parsed = TimestampProvider::ParseWallClockSeconds(timestamp, seconds);
+
+        // Assert
+        EXPECT_FALSE(parsed) << timestamp;
+    }
+}
+
+TEST(RetentionUnitTests, SelectSnapshotsToKeep_KeepsNewestPerRuleAndUndatedNames)
+{
+    // Arrange
+    const std::vector<std::string> names = {"2024-05-06_08-00-00", "2024-05-01_08-00-00", "2024-05-07_09-00-00", "2024-05-07_18-00-00",
+                                            "2024-05-05_23-00-00", "2024-04-20_12-00-00", "manual"};
+    RetentionPolicy policy;
+    policy.keepLast = 1;
+    policy.keepDaily = 2;
+    policy.keepWeekly = 3;
+
+    // Act
+    const std::vector<std::string> kept = SelectSnapshotsToKeep(names, policy);
+
+    // Assert
+    // Daily: 05-07 and 05-06. Weekly, from Monday: the weeks of 05-06, 04-29 and 04-15.
+    const std::vector<std::string> expected = {"2024-04-20_12-00-00", "2024-05-05_23-00-00", "2024-05-06_08-00-00", "2024-05-07_18-00-00", "manual"};
+    ASSERT_EQ(expected, kept);
+}
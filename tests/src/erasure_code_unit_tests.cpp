@@ -0,0 +1,135 @@
+/**
+ * @file erasure_code_unit_tests.cpp
+ * @brief Unit tests for the Reed-Solomon erasure code.
+ */
+#include "ErasureCode/ReedSolomon.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+std::vector<std::vector<std::uint8_t>> RandomShards(std::size_t count, std::size_t length, unsigned int seed)
+{
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::vector<std::vector<std::uint8_t>> shards(count, std::vector<std::uint8_t>(length));
+    for (std::vector<std::uint8_t>& shard : shards)
+    {
+        for (std::uint8_t& value : shard)
+        {
+            value = static_cast<std::uint8_t>(byte(generator));
+        }
+    }
+    return shards;
+}
+
+std::vector<std::vector<std::uint8_t>> EncodeWith(const ReedSolomon& code, const std::vector<std::vector<std::uint8_t>>& data,
+                                                  std::size_t length)
+{
+    std::vector<std::vector<std::uint8_t>> parity(code.ParityShards(), std::vector<std::uint8_t>(length, 0xAA));
+    std::vector<const std::uint8_t*> dataPointers;
+    std::vector<std::uint8_t*> parityPointers;
+    for (const std::vector<std::uint8_t>& shard : data)
+    {
+        dataPointers.push_back(shard.data());
+    }
+    for (std::vector<std::uint8_t>& shard : parity)
+    {
+        parityPointers.push_back(shard.data());
+    }
+    code.Encode(dataPointers.data(), parityPointers.data(), length);
+    return parity;
+}
+} // namespace
+
+TEST(ErasureCodeUnitTests, Encode_EveryKernel_ProducesTheScalarParity)
+{
+    // Arrange: an odd length exercises the vector loops and their scalar tails
+    constexpr std::size_t Length = 40000 + 17;
+    const std::vector<std::vector<std::uint8_t>> data = RandomShards(10, Length, 1);
+    const std::vector<std::vector<std::uint8_t>> expected = EncodeWith(ReedSolomon(10, 4, ErasureKernel::Scalar), data, Length);
+
+    for (const ErasureKernel kernel : ReedSolomon::SupportedKernels())
+    {
+        // Act
+        const std::vector<std::vector<std::uint8_t>> parity = EncodeWith(ReedSolomon(10, 4, kernel), data, Length);
+
+        // Assert
+        EXPECT_EQ(expected, parity) << ErasureKernelToString(kernel);
+    }
+}
+
+TEST(ErasureCodeUnitTests, Reconstruct_AnyParityCountOfShardsLost_RebuildsAll)
+{
+    // Arrange
+    constexpr std::size_t DataShards = 6;
+    constexpr std::size_t ParityShards = 3;
+    constexpr std::size_t Length = 1000;
+    const ReedSolomon code(DataShards, ParityShards);
+    const std::vector<std::vector<std::uint8_t>> data = RandomShards(DataShards, Length, 2);
+    std::vector<std::vector<std::uint8_t>> original = data;
+    for (std::vector<std::uint8_t>& shard : EncodeWith(code, data, Length))
+    {
+        original.push_back(shard);
+    }
+
+    // Act / Assert: every way of losing exactly m shards
+    for (unsigned int lost = 0; lost < (1u << (DataShards + ParityShards)); ++lost)
+    {
+        if (ParityShards != static_cast<std::size_t>(__builtin_popcount(lost)))
+        {
+            continue;
+        }
+        std::vector<std::vector<std::uint8_t>> shards = original;
+        std::vector<bool> present(DataShards + ParityShards, true);
+        std::vector<std::uint8_t*> pointers;
+        for (std::size_t index = 0; index < shards.size(); ++index)
+        {
+            if (0 != (lost & (1u << index)))
+            {
+                present[index] = false;
+                std::fill(shards[index].begin(), shards[index].end(), static_cast<std::uint8_t>(0x5C));
+            }
+            pointers.push_back(shards[index].data());
+        }
+
+        ASSERT_TRUE(code.Reconstruct(pointers.data(), present, Length)) << lost;
+        EXPECT_EQ(original, shards) << lost;
+    }
+}
+
+TEST(ErasureCodeUnitTests, Reconstruct_MoreThanParityCountLost_Fails)
+{
+    // Arrange
+    const ReedSolomon code(4, 2);
+    std::vector<std::vector<std::uint8_t>> shards = RandomShards(6, 64, 3);
+    std::vector<std::uint8_t*> pointers;
+    for (std::vector<std::uint8_t>& shard : shards)
+    {
+        pointers.push_back(shard.data());
+    }
+    const std::vector<bool> present = {false, true, false, true, true, false};
+
+    // Act / Assert
+    EXPECT_FALSE(code.Reconstruct(pointers.data(), present, 64));
+}
+
+TEST(ErasureCodeUnitTests, ParseShards_AcceptsValidCountsOnly)
+{
+    std::size_t dataShards = 0;
+    std::size_t parityShards = 0;
+    EXPECT_TRUE(ReedSolomon::ParseShards("10+2", dataShards, parityShards));
+    EXPECT_EQ(10u, dataShards);
+    EXPECT_EQ(2u, parityShards);
+    EXPECT_FALSE(ReedSolomon::ParseShards("10", dataShards, parityShards));
+    EXPECT_FALSE(ReedSolomon::ParseShards("0+2", dataShards, parityShards));
+    EXPECT_FALSE(ReedSolomon::ParseShards("4+0", dataShards, parityShards));
+    EXPECT_FALSE(ReedSolomon::ParseShards("250+10", dataShards, parityShards));
+    EXPECT_FALSE(ReedSolomon::ParseShards("4+-1", dataShards, parityShards));
+    EXPECT_THROW(ReedSolomon(0, 2), std::invalid_argument);
+}
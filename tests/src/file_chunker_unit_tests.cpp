@@ -0,0 +1,147 @@
+/**
+ * @file file_chunker_unit_tests.cpp
+ * @brief Unit tests for FileChunker content-defined chunking.
+ */
+#include "FileHasher/FileChunker.hpp"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class FileChunkerUnitTests : public ::testing::Test
+{
+  protected:
+    fs::path workDir;
+
+    void SetUp() override
+    {
+        const auto* testInfo = ::testing::UnitTest::GetInstance()->current_test_info();
+        workDir = fs::temp_directory_path() / ("chunker_" + std::string(testInfo->name()));
+        fs::remove_all(workDir);
+        fs::create_directories(workDir);
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+
+    static std::string RandomContent(std::size_t size, std::uint32_t seed)
+    {
+        std::string content(size, '\0');
+        for (auto& character : content)
+        {
+            seed = seed * 1103515245U + 12345U;
+            character = static_cast<char>(seed >> 24);
+        }
+        return content;
+    }
+
+    fs::path WriteFile(const std::string& name, const std::string& content)
+    {
+        fs::path filePath = workDir / name;
+        std::ofstream outputStream(filePath, std::ios::binary);
+        outputStream.write(content.data(), static_cast<std::streamsize>(content.size()));
+        return filePath;
+    }
+
+    static std::vector<FileChunk> ChunkFile(const FileChunker& chunker, const fs::path& filePath, HashDigest& fileDigest)
+    {
+        std::vector<FileChunk> chunks;
+        const bool result = chunker.Chunk(
+            filePath,
+            [&](const FileChunk& chunk, const std::uint8_t*)
+            {
+                chunks.push_back(chunk);
+                return true;
+            },
+            fileDigest);
+        EXPECT_TRUE(result);
+        return chunks;
+    }
+};
+
+TEST_F(FileChunkerUnitTests, Chunk_CoversFileWithinSizeLimits)
+{
+    // Arrange
+    fs::path filePath = WriteFile("data.bin", RandomContent(3 * 1024 * 1024 + 17, 1));
+    FileChunkerOptions options;
+    options.averageSize = 8192;
+    FileChunker chunker(options);
+
+    // Act
+    HashDigest fileDigest{};
+    std::vector<FileChunk> chunks = ChunkFile(chunker, filePath, fileDigest);
+
+    // Assert
+    ASSERT_FALSE(chunks.empty());
+    std::uint64_t expectedOffset = 0;
+    for (std::size_t i = 0; i < chunks.size(); ++i)
+    {
+        ASSERT_EQ(expectedOffset, chunks[i].offset);
+        ASSERT_LE(chunks[i].length, 4U * 8192U);
+        if (i + 1 < chunks.size())
+        {
+            ASSERT_GE(chunks[i].length, 8192U / 4U);
+        }
+        expectedOffset += chunks[i].length;
+    }
+    ASSERT_EQ(fs::file_size(filePath), expectedOffset);
+
+    HashDigest hasherDigest{};
+    ASSERT_TRUE(FileHasher(HashAlgorithm::XXH3_128).Compute(filePath, hasherDigest));
+    ASSERT_EQ(hasherDigest, fileDigest);
+}
+
+TEST_F(FileChunkerUnitTests, Chunk_AfterInsertion_KeepsMostChunks)
+{
+    // Arrange
+    const std::string original = RandomContent(1024 * 1024, 7);
+    std::string edited = original;
+    edited.insert(original.size() / 2, "inserted bytes that shift everything after them");
+    fs::path originalPath = WriteFile("original.bin", original);
+    fs::path editedPath = WriteFile("edited.bin", edited);
+    FileChunker chunker;
+
+    // Act
+    HashDigest originalDigest{};
+    HashDigest editedDigest{};
+    std::vector<FileChunk> originalChunks = ChunkFile(chunker, originalPath, originalDigest);
+    std::vector<FileChunk> editedChunks = ChunkFile(chunker, editedPath, editedDigest);
+
+    // Assert
+    std::set<std::string> originalDigests;
+    for (const auto& chunk : originalChunks)
+    {
+        originalDigests.insert(chunk.digest.ToHex());
+    }
+    std::size_t sharedCount = 0;
+    for (const auto& chunk : editedChunks)
+    {
+        sharedCount += originalDigests.count(chunk.digest.ToHex());
+    }
+    ASSERT_NE(originalDigest, editedDigest);
+    ASSERT_GE(sharedCount + 2, originalChunks.size()) << "Only the chunk around the insertion may change";
+}
+
+TEST_F(FileChunkerUnitTests, Chunk_EmptyFile_ProducesNoChunks)
+{
+    // Arrange
+    fs::path filePath = WriteFile("empty.bin", "");
+    FileChunker chunker;
+
+    // Act
+    HashDigest fileDigest{};
+    std::vector<FileChunk> chunks = ChunkFile(chunker, filePath, fileDigest);
+
+    // Assert
+    ASSERT_TRUE(chunks.empty());
+    ASSERT_EQ(16U, fileDigest.size);
+}
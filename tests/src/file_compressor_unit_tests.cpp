@@ -0,0 +1,211 @@
+/**
+ * @file file_compressor_unit_tests.cpp
+ * @brief Unit tests for FileCompressor round trips and incompressibility detection.
+ */
+#include "FileCompressor/FileCompressor.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class FileCompressorUnitTests : public ::testing::Test
+{
+  protected:
+    fs::path workDir;
+
+    void SetUp() override
+    {
+        if (false == FileCompressor::IsAvailable())
+        {
+            GTEST_SKIP() << "Built without zstd";
+        }
+        const auto* testInfo = ::testing::UnitTest::GetInstance()->current_test_info();
+        workDir = fs::temp_directory_path() / ("compressor_" + std::string(testInfo->name()));
+        fs::remove_all(workDir);
+        fs::create_directories(workDir);
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+
+    fs::path CreateFile(const std::string& name, const std::string& content)
+    {
+        fs::path filePath = workDir / name;
+        std::ofstream outputStream(filePath, std::ios::binary);
+        outputStream << content;
+        return filePath;
+    }
+
+    static std::string ReadContent(const fs::path& filePath)
+    {
+        std::ifstream inputStream(filePath, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(inputStream)), std::istreambuf_iterator<char>());
+    }
+
+    static std::string RandomContent(std::size_t size)
+    {
+        std::string content(size, '\0');
+        std::uint32_t randomState = 2463534242U;
+        for (auto& character : content)
+        {
+            randomState ^= randomState << 13;
+            randomState ^= randomState >> 17;
+            randomState ^= randomState << 5;
+            character = static_cast<char>(randomState);
+        }
+        return content;
+    }
+};
+
+TEST_F(FileCompressorUnitTests, CompressAndDecompress_RoundTripsAcrossStreamBuffers)
+{
+    // Arrange
+    std::string content;
+    for (int i = 0; content.size() < 3 * 1024 * 1024; ++i)
+    {
+        content += "line " + std::to_string(i) + " of a very repetitive log file\n";
+    }
+    fs::path sourcePath = CreateFile("source.log", content);
+    fs::path compressedPath = workDir / "source.log.zst";
+    FileCompressor compressor;
+
+    // Act
+    bool compressResult = compressor.Compress(sourcePath, compressedPath);
+    bool decompressResult = FileCompressor::Decompress(compressedPath, workDir / "restored.log");
+
+    // Assert
+    ASSERT_TRUE(compressResult);
+    ASSERT_TRUE(decompressResult);
+    ASSERT_LT(fs::file_size(compressedPath), content.size() / 4);
+    ASSERT_EQ(content, ReadContent(workDir / "restored.log"));
+}
+
+TEST_F(FileCompressorUnitTests, Compress_WithWorkerThreads_RoundTrips)
+{
+    // Arrange
+    FileCompressorOptions options;
+    options.workerThreads = 2;
+    options.multithreadThreshold = 0;
+    std::string content = RandomContent(512 * 1024);
+    content += std::string(2 * 1024 * 1024, 'z');
+    fs::path sourcePath = CreateFile("mixed.bin", std::string(64 * 1024, 'a') + content);
+    fs::path compressedPath = workDir / "mixed.bin.zst";
+    FileCompressor compressor(options);
+
+    // Act
+    bool compressResult = compressor.Compress(sourcePath, compressedPath);
+
+    // Assert
+    ASSERT_TRUE(compressResult);
+    ASSERT_TRUE(FileCompressor::Decompress(compressedPath, workDir / "restored.bin"));
+    ASSERT_EQ(ReadContent(sourcePath), ReadContent(workDir / "restored.bin"));
+}
+
+TEST_F(FileCompressorUnitTests, Compress_IncompressiblePrefix_WritesNothing)
+{
+    // Arrange
+    fs::path sourcePath = CreateFile("random.bin", RandomContent(512 * 1024));
+    fs::path compressedPath = workDir / "random.bin.zst";
+    FileCompressor compressor;
+
+    // Act
+    bool compressResult = compressor.Compress(sourcePath, compressedPath);
+
+    // Assert
+    ASSERT_FALSE(compressResult);
+    ASSERT_FALSE(fs::exists(compressedPath));
+}
+
+TEST_F(FileCompressorUnitTests, Decompress_TruncatedFrame_Fails)
+{
+    // Arrange
+    fs::path sourcePath = CreateFile("text.txt", std::string(1024 * 1024, 'x') + "tail");
+    fs::path compressedPath = workDir / "text.txt.zst";
+    ASSERT_TRUE(FileCompressor().Compress(sourcePath, compressedPath));
+    fs::resize_file(compressedPath, fs::file_size(compressedPath) - 4);
+
+    // Act
+    bool decompressResult = FileCompressor::Decompress(compressedPath, workDir / "restored.txt");
+
+    // Assert
+    ASSERT_FALSE(decompressResult);
+    ASSERT_FALSE(fs::exists(workDir / "restored.txt"));
+}
+
+TEST_F(FileCompressorUnitTests, CompressBuffer_CompressibleData_RoundTrips)
+{
+    // Arrange
+    const std::string content = std::string(256 * 1024, 'a') + RandomContent(1024);
+    std::vector<std::uint8_t> frame;
+    std::vector<std::uint8_t> restored;
+
+    // Act
+    bool compressResult = FileCompressor::CompressBuffer(content.data(), content.size(), FileCompressorOptions::DefaultLevel, frame);
+    bool decompressResult = FileCompressor::DecompressBuffer(frame.data(), frame.size(), content.size(), restored);
+
+    // Assert
+    ASSERT_TRUE(compressResult);
+    ASSERT_LT(frame.size(), content.size());
+    ASSERT_TRUE(decompressResult);
+    ASSERT_EQ(std::string(restored.begin(), restored.end()), content);
+}
+
+TEST_F(FileCompressorUnitTests, DecompressBuffer_LargerThanLimit_Fails)
+{
+    // Arrange
+    const std::string content(64 * 1024, 'b');
+    std::vector<std::uint8_t> frame;
+    ASSERT_TRUE(FileCompressor::CompressBuffer(content.data(), content.size(), FileCompressorOptions::DefaultLevel, frame));
+    std::vector<std::uint8_t> restored;
+
+    // Act
+    bool decompressResult = FileCompressor::DecompressBuffer(frame.data(), frame.size(), content.size() - 1, restored);
+
+    // Assert
+    ASSERT_FALSE(decompressResult);
+}
+
+TEST_F(FileCompressorUnitTests, Compress_SmallFileWithDictionary_RoundTripsOnlyWithIt)
+{
+    // Arrange
+    std::vector<std::uint8_t> samples;
+    std::vector<std::size_t> sampleSizes;
+    for (int i = 0; i < 256; ++i)
+    {
+        const std::string sample = "<entry id=\"" + std::to_string(i) + "\" kind=\"report\"><owner>team-" + std::to_string(i % 7) +
+                                   "</owner><status>archived</status><note>quarterly figures</note></entry>\n";
+        samples.insert(samples.end(), sample.begin(), sample.end());
+        sampleSizes.push_back(sample.size());
+    }
+    std::vector<std::uint8_t> dictionary;
+    ASSERT_TRUE(CompressionDictionaries::Train(samples, sampleSizes, 16 * 1024, dictionary));
+    CompressionDictionaries dictionaries;
+    ASSERT_TRUE(dictionaries.Add(".xml", dictionary));
+    FileCompressorOptions options;
+    options.dictionaries = &dictionaries;
+    const std::string content = "<entry id=\"9000\" kind=\"report\"><owner>team-3</owner><status>archived</status><note>quarterly figures</note></entry>\n";
+    fs::path sourcePath = CreateFile("entry.XML", content);
+    fs::path compressedPath = workDir / "entry.XML.zst";
+    FileCompressor compressor(options);
+
+    // Act
+    bool compressResult = compressor.Compress(sourcePath, compressedPath);
+
+    // Assert
+    ASSERT_TRUE(compressResult);
+    ASSERT_EQ(CompressionDictionaries::DictionaryId(dictionary), FileCompressor::FrameDictionaryId(compressedPath));
+    ASSERT_FALSE(FileCompressor::Decompress(compressedPath, workDir / "entry.out"));
+    ASSERT_FALSE(fs::exists(workDir / "entry.out"));
+    ASSERT_TRUE(FileCompressor::Decompress(compressedPath, workDir / "entry.out", &dictionaries));
+    ASSERT_EQ(content, ReadContent(workDir / "entry.out"));
+}
@@ -0,0 +1,354 @@
+/**
+ * @file file_copier_unit_tests.cpp
+ * @brief Unit tests for FileCopier copy mechanisms and their fallbacks, and for DirectoryCache.
+ */
+#include "FileCopier/DirectoryCache.hpp"
+#include "FileCopier/FileCopier.hpp"
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+class FileCopierUnitTests : public ::testing::TestWithParam<CopyMethod>
+{
+  protected:
+    fs::path workDir;
+
+    void SetUp() override
+    {
+        const auto* testInfo = ::testing::UnitTest::GetInstance()->current_test_info();
+        std::string testName = std::string(testInfo->name());
+        std::replace(testName.begin(), testName.end(), '/', '_');
+        workDir = fs::temp_directory_path() / ("copier_" + testName);
+        fs::remove_all(workDir);
+        fs::create_directories(workDir);
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+
+    fs::path CreateFile(const std::string& name, std::size_t size)
+    {
+        fs::path filePath = workDir / name;
+        std::ofstream outputStream(filePath, std::ios::binary);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            outputStream.put(static_cast<char>((i * 31) & 0xFF));
+        }
+        return filePath;
+    }
+
+    static std::string ReadContent(const fs::path& filePath)
+    {
+        std::ifstream inputStream(filePath, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(inputStream)), std::istreambuf_iterator<char>());
+    }
+
+#if !defined(_WIN32)
+    fs::path CreateSparseFile(const std::string& name, std::uintmax_t size, const std::vector<std::uintmax_t>& dataOffsets)
+    {
+        fs::path filePath = workDir / name;
+        {
+            std::ofstream outputStream(filePath, std::ios::binary);
+            const std::string block(64 * 1024, 'x');
+            for (std::uintmax_t offset : dataOffsets)
+            {
+                outputStream.seekp(static_cast<std::streamoff>(offset));
+                outputStream.write(block.data(), static_cast<std::streamsize>(block.size()));
+            }
+        }
+        fs::resize_file(filePath, size);
+        return filePath;
+    }
+
+    static std::uintmax_t AllocatedBytes(const fs::path& filePath)
+    {
+        struct stat fileStatus{};
+        stat(filePath.c_str(), &fileStatus);
+        return static_cast<std::uintmax_t>(fileStatus.st_blocks) * 512;
+    }
+#endif
+};
+
+TEST_P(FileCopierUnitTests, Copy_ProducesIdenticalFile)
+{
+    // Arrange
+    fs::path sourcePath = CreateFile("source.bin", 1000003);
+    fs::path destinationPath = workDir / "copy.bin";
+    FileCopier copier(GetParam());
+
+    // Act
+    CopyMethod usedMethod = CopyMethod::Buffered;
+    bool result = copier.Copy(sourcePath, destinationPath, usedMethod);
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_GE(usedMethod, GetParam()) << "Mechanisms cheaper than the first one must be skipped";
+    ASSERT_EQ(ReadContent(sourcePath), ReadContent(destinationPath));
+}
+
+TEST_P(FileCopierUnitTests, Copy_Unbuffered_ProducesIdenticalFile)
+{
+    // Arrange
+    // Spans several drop-behind intervals plus a partial one.
+    fs::path sourcePath = CreateFile("source.bin", (17 * 1024 * 1024) + 5);
+    fs::path destinationPath = workDir / "copy.bin";
+    FileCopier copier(GetParam(), 1);
+
+    // Act
+    bool result = copier.Copy(sourcePath, destinationPath);
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_EQ(ReadContent(sourcePath), ReadContent(destinationPath));
+}
+
+TEST_P(FileCopierUnitTests, Copy_Throttled_IsPacedToTheLimit)
+{
+    if (CopyMethod::Clone == GetParam())
+    {
+        GTEST_SKIP() << "A successful clone moves no data and is not charged";
+    }
+
+    // Arrange
+    fs::path sourcePath = CreateFile("source.bin", 2 * 1024 * 1024);
+    fs::path destinationPath = workDir / "copy.bin";
+    IoLimits limits;
+    limits.writeBytesPerSecond = 8 * 1024 * 1024;
+    IoThrottle throttle(limits);
+    FileCopier copier(GetParam(), 0, &throttle);
+
+    // Act
+    const auto start = std::chrono::steady_clock::now();
+    bool result = copier.Copy(sourcePath, destinationPath);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_EQ(ReadContent(sourcePath), ReadContent(destinationPath));
+    // 2 MiB at 8 MiB/s is 250 ms, less the burst the bucket starts with.
+    ASSERT_GE(elapsed, std::chrono::milliseconds(250) - IoThrottle::BurstWindow);
+}
+
+#if !defined(_WIN32)
+TEST_P(FileCopierUnitTests, Copy_DenseSource_KeepsNoReservedBlocksPastItsEnd)
+{
+    // Arrange
+    const std::uintmax_t fileSize = (3 * 1024 * 1024) + 7;
+    fs::path sourcePath = CreateFile("source.bin", fileSize);
+    fs::path destinationPath = workDir / "copy.bin";
+    FileCopier copier(GetParam());
+
+    // Act
+    bool result = copier.Copy(sourcePath, destinationPath);
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_EQ(fileSize, fs::file_size(destinationPath));
+    ASSERT_EQ(ReadContent(sourcePath), ReadContent(destinationPath));
+    ASSERT_GT(fileSize + (1024 * 1024), AllocatedBytes(destinationPath));
+}
+
+TEST_P(FileCopierUnitTests, Copy_SparseSource_KeepsContentAndHoles)
+{
+    // Arrange
+    const std::uintmax_t fileSize = 4 * 1024 * 1024;
+    fs::path sourcePath = CreateSparseFile("sparse.bin", fileSize, {0, 1024 * 1024 + 4096, 2 * 1024 * 1024});
+    if (fileSize <= AllocatedBytes(sourcePath))
+    {
+        GTEST_SKIP() << "The filesystem of the temporary directory does not keep holes";
+    }
+    fs::path destinationPath = workDir / "copy.bin";
+    FileCopier copier(GetParam());
+
+    // Act
+    CopyMethod usedMethod = CopyMethod::Buffered;
+    bool result = copier.Copy(sourcePath, destinationPath, usedMethod);
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_GE(usedMethod, GetParam());
+    ASSERT_EQ(fileSize, fs::file_size(destinationPath));
+    ASSERT_EQ(ReadContent(sourcePath), ReadContent(destinationPath));
+    ASSERT_GT(fileSize / 4, AllocatedBytes(destinationPath)) << "Holes must not be filled in";
+}
+#endif
+
+TEST_P(FileCopierUnitTests, Copy_OverExistingLargerFile_ReplacesIt)
+{
+    // Arrange
+    fs::path sourcePath = CreateFile("source.bin", 1000);
+    fs::path destinationPath = CreateFile("copy.bin", 50000);
+    FileCopier copier(GetParam());
+
+    // Act
+    bool result = copier.Copy(sourcePath, destinationPath);
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_EQ(1000U, fs::file_size(destinationPath));
+    ASSERT_EQ(ReadContent(sourcePath), ReadContent(destinationPath));
+}
+
+TEST_P(FileCopierUnitTests, Copy_EmptyFile_CreatesEmptyFile)
+{
+    // Arrange
+    fs::path sourcePath = CreateFile("empty.bin", 0);
+    fs::path destinationPath = workDir / "copy.bin";
+    FileCopier copier(GetParam());
+
+    // Act
+    bool result = copier.Copy(sourcePath, destinationPath);
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_TRUE(fs::exists(destinationPath));
+    ASSERT_EQ(0U, fs::file_size(destinationPath));
+}
+
+TEST_P(FileCopierUnitTests, Copy_MissingSource_ReturnsFalse)
+{
+    // Arrange
+    FileCopier copier(GetParam());
+
+    // Act
+    bool result = copier.Copy(workDir / "missing.bin", workDir / "copy.bin");
+
+    // Assert
+    ASSERT_FALSE(result);
+}
+
+TEST_P(FileCopierUnitTests, Move_ReplacesDestinationAndRemovesSource)
+{
+    // Arrange
+    fs::path sourcePath = CreateFile("source.bin", 4096);
+    fs::path destinationPath = CreateFile("moved.bin", 100);
+    const std::string sourceContent = ReadContent(sourcePath);
+    FileCopier copier(GetParam());
+
+    // Act
+    bool result = copier.Move(sourcePath, destinationPath);
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_FALSE(fs::exists(sourcePath));
+    ASSERT_EQ(sourceContent, ReadContent(destinationPath));
+}
+
+TEST_P(FileCopierUnitTests, LinkBatch_LinksPresentNamesAndReportsMissingOnes)
+{
+    // Arrange
+    fs::create_directories(workDir / "source");
+    fs::create_directories(workDir / "target");
+    const fs::path firstPath = CreateFile("source/first.bin", 4096);
+    CreateFile("source/second.bin", 100);
+    CreateFile("target/second.bin", 10);
+    FileCopier copier(GetParam());
+
+    // Act
+    std::vector<std::string> missing;
+    bool result = copier.LinkBatch(workDir / "source", workDir / "target", {"first.bin", "second.bin", "absent.bin"}, missing);
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_EQ(std::vector<std::string>{"absent.bin"}, missing);
+    ASSERT_TRUE(fs::equivalent(firstPath, workDir / "target" / "first.bin"));
+    ASSERT_EQ(ReadContent(workDir / "source" / "second.bin"), ReadContent(workDir / "target" / "second.bin"));
+    ASSERT_FALSE(fs::exists(workDir / "target" / "absent.bin"));
+}
+
+TEST_P(FileCopierUnitTests, CopyBatch_ManySmallFilesAndALargeOne_CopiesEachAndReportsFailures)
+{
+    // Arrange
+    fs::create_directories(workDir / "target");
+    std::vector<std::pair<fs::path, fs::path>> copies;
+    for (std::size_t i = 0; i < 100; ++i)
+    {
+        const std::string name = "small" + std::to_string(i) + ".bin";
+        copies.emplace_back(CreateFile(name, (i * 997) % (64 * 1024 + 1)), workDir / "target" / name);
+    }
+    copies.emplace_back(CreateFile("large.bin", 3 * 64 * 1024 + 5), workDir / "target" / "large.bin");
+    copies.emplace_back(workDir / "missing.bin", workDir / "target" / "missing.bin");
+    // A destination with another link is replaced, so the other link keeps its content.
+    const fs::path linkedPath = CreateFile("linked.bin", 10);
+    fs::create_hard_link(linkedPath, copies[1].second);
+#if !defined(_WIN32)
+    fs::permissions(copies[2].first, fs::perms::owner_read | fs::perms::owner_write);
+#endif
+    FileCopier copier(GetParam());
+
+    // Act
+    std::vector<std::size_t> failed;
+    bool result = copier.CopyBatch(copies, failed);
+
+    // Assert
+    ASSERT_FALSE(result);
+    ASSERT_EQ(std::vector<std::size_t>{copies.size() - 1}, failed);
+    for (std::size_t i = 0; i + 1 < copies.size(); ++i)
+    {
+        ASSERT_EQ(ReadContent(copies[i].first), ReadContent(copies[i].second)) << copies[i].first;
+        ASSERT_EQ(fs::status(copies[i].first).permissions(), fs::status(copies[i].second).permissions()) << copies[i].first;
+    }
+    ASSERT_EQ(10u, fs::file_size(linkedPath));
+}
+
+INSTANTIATE_TEST_SUITE_P(Methods, FileCopierUnitTests,
+                         ::testing::Values(CopyMethod::Clone, CopyMethod::CopyFileRange, CopyMethod::SendFile, CopyMethod::Native, CopyMethod::Buffered),
+                         [](const ::testing::TestParamInfo<CopyMethod>& info)
+                         {
+                             std::string name = CopyMethodToString(info.param);
+                             name.erase(std::remove(name.begin(), name.end(), '-'), name.end());
+                             return name;
+                         });
+
+TEST(CopyMethodUnitTests, ToStringAndBack)
+{
+    for (CopyMethod method : {CopyMethod::Clone, CopyMethod::CopyFileRange, CopyMethod::SendFile, CopyMethod::Native, CopyMethod::Buffered})
+    {
+        CopyMethod convertedMethod = CopyMethod::Buffered;
+        ASSERT_TRUE(StringToCopyMethod(CopyMethodToString(method), convertedMethod));
+        ASSERT_EQ(method, convertedMethod);
+    }
+}
+
+TEST(DirectoryCacheUnitTests, Ensure_CreatesEachDirectoryOnceAndReportsFailures)
+{
+    // Arrange
+    const fs::path workDir = fs::temp_directory_path() / "directory_cache_unit_tests";
+    fs::remove_all(workDir);
+    fs::create_directories(workDir);
+    std::ofstream(workDir / "file.txt") << "not a directory";
+    const fs::path nestedDir = workDir / "outer" / "inner";
+    DirectoryCache directoryCache;
+
+    // Act
+    const bool created = directoryCache.Ensure(nestedDir);
+    fs::remove(nestedDir);
+    const bool cached = directoryCache.Ensure(nestedDir);
+    const bool blocked = directoryCache.Ensure(workDir / "file.txt" / "child");
+
+    // Assert
+    ASSERT_TRUE(created);
+    ASSERT_TRUE(cached);
+    ASSERT_FALSE(fs::exists(nestedDir)) << "A known directory must not be created again";
+    ASSERT_TRUE(fs::is_directory(workDir / "outer"));
+    ASSERT_FALSE(blocked);
+    fs::remove_all(workDir);
+}
@@ -0,0 +1,193 @@
+/**
+ * @file file_encryptor_unit_tests.cpp
+ * @brief Unit tests for FileEncryptor round trips, key files and tamper detection.
+ */
+#include "FileEncryptor/FileEncryptor.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class FileEncryptorUnitTests : public ::testing::Test
+{
+  protected:
+    fs::path workDir;
+    FileEncryptor::Key key{};
+
+    void SetUp() override
+    {
+        if (false == FileEncryptor::IsAvailable())
+        {
+            GTEST_SKIP() << "Built without OpenSSL";
+        }
+        const auto* testInfo = ::testing::UnitTest::GetInstance()->current_test_info();
+        workDir = fs::temp_directory_path() / ("encryptor_" + std::string(testInfo->name()));
+        fs::remove_all(workDir);
+        fs::create_directories(workDir);
+        for (std::size_t index = 0; index < key.size(); ++index)
+        {
+            key[index] = static_cast<std::uint8_t>(index * 7);
+        }
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+
+    fs::path CreateFile(const std::string& name, const std::string& content)
+    {
+        fs::path filePath = workDir / name;
+        std::ofstream outputStream(filePath, std::ios::binary);
+        outputStream << content;
+        return filePath;
+    }
+
+    static std::string ReadContent(const fs::path& filePath)
+    {
+        std::ifstream inputStream(filePath, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(inputStream)), std::istreambuf_iterator<char>());
+    }
+
+    static std::string RandomContent(std::size_t size)
+    {
+        std::string content(size, '\0');
+        std::uint32_t randomState = 2463534242U;
+        for (auto& character : content)
+        {
+            randomState ^= randomState << 13;
+            randomState ^= randomState >> 17;
+            randomState ^= randomState << 5;
+            character = static_cast<char>(randomState);
+        }
+        return content;
+    }
+};
+
+TEST_F(FileEncryptorUnitTests, EncryptAndDecrypt_RoundTripsWithBothCiphers)
+{
+    // Arrange
+    const std::vector<std::size_t> sizes = {0, 1, FileEncryptor::SegmentSize - 1, FileEncryptor::SegmentSize, 3 * FileEncryptor::SegmentSize + 17};
+    for (EncryptionAlgorithm algorithm : {EncryptionAlgorithm::Aes256Gcm, EncryptionAlgorithm::ChaCha20Poly1305})
+    {
+        const FileEncryptor encryptor(key, algorithm);
+        for (std::size_t size : sizes)
+        {
+            const std::string content = RandomContent(size);
+            fs::path sourcePath = CreateFile("source.bin", content);
+            fs::path encryptedPath = workDir / "source.enc";
+            fs::path restoredPath = workDir / "restored.bin";
+
+            // Act
+            const bool encrypted = encryptor.Encrypt(sourcePath, encryptedPath);
+            const bool decrypted = encryptor.Decrypt(encryptedPath, restoredPath);
+
+            // Assert
+            ASSERT_TRUE(encrypted) << size;
+            ASSERT_TRUE(decrypted) << size;
+            EXPECT_TRUE(FileEncryptor::IsEncrypted(encryptedPath));
+            EXPECT_FALSE(FileEncryptor::IsEncrypted(sourcePath));
+            EXPECT_EQ(ReadContent(restoredPath), content) << size;
+            const std::uintmax_t segments = (0 == size) ? 1 : (size + FileEncryptor::SegmentSize - 1) / FileEncryptor::SegmentSize;
+            EXPECT_EQ(fs::file_size(encryptedPath), FileEncryptor::HeaderSize + size + (segments * FileEncryptor::TagSize));
+        }
+    }
+}
+
+TEST_F(FileEncryptorUnitTests, Writer_AcceptsContentInArbitraryPieces)
+{
+    // Arrange
+    const std::string content = RandomContent((2 * FileEncryptor::SegmentSize) + 1000);
+    fs::path encryptedPath = workDir / "pieces.enc";
+    fs::path restoredPath = workDir / "pieces.bin";
+    const FileEncryptor encryptor(key);
+
+    // Act
+    {
+        FileEncryptor::Writer writer(encryptor, encryptedPath);
+        ASSERT_TRUE(writer.IsOpen());
+        for (std::size_t offset = 0; offset < content.size(); offset += 777)
+        {
+            ASSERT_TRUE(writer.Write(content.data() + offset, std::min<std::size_t>(777, content.size() - offset)));
+        }
+        ASSERT_TRUE(writer.Finish());
+    }
+    const bool decrypted = encryptor.Decrypt(encryptedPath, restoredPath);
+
+    // Assert
+    ASSERT_TRUE(decrypted);
+    EXPECT_EQ(ReadContent(restoredPath), content);
+}
+
+TEST_F(FileEncryptorUnitTests, Decrypt_RejectsTamperedTruncatedAndWrongKeyFiles)
+{
+    // Arrange
+    const std::string content = RandomContent((2 * FileEncryptor::SegmentSize) + 5);
+    fs::path sourcePath = CreateFile("source.bin", content);
+    fs::path encryptedPath = workDir / "source.enc";
+    const FileEncryptor encryptor(key);
+    ASSERT_TRUE(encryptor.Encrypt(sourcePath, encryptedPath));
+    const std::string sealed = ReadContent(encryptedPath);
+
+    std::string flipped = sealed;
+    flipped[FileEncryptor::HeaderSize + FileEncryptor::SegmentSize + 100] ^= 1;
+    fs::path flippedPath = CreateFile("flipped.enc", flipped);
+    // Dropping the last segment leaves whole segments, but the new last one was not sealed as last.
+    fs::path truncatedPath =
+        CreateFile("truncated.enc", sealed.substr(0, FileEncryptor::HeaderSize + (2 * (FileEncryptor::SegmentSize + FileEncryptor::TagSize))));
+    FileEncryptor::Key otherKey = key;
+    otherKey[0] ^= 1;
+    const FileEncryptor otherEncryptor(otherKey);
+    fs::path restoredPath = workDir / "restored.bin";
+
+    // Act
+    const bool flippedDecrypted = encryptor.Decrypt(flippedPath, restoredPath);
+    const bool truncatedDecrypted = encryptor.Decrypt(truncatedPath, restoredPath);
+    const bool otherKeyDecrypted = otherEncryptor.Decrypt(encryptedPath, restoredPath);
+
+    // Assert
+    EXPECT_FALSE(flippedDecrypted);
+    EXPECT_FALSE(truncatedDecrypted);
+    EXPECT_FALSE(otherKeyDecrypted);
+    EXPECT_FALSE(fs::exists(restoredPath));
+}
+
+TEST_F(FileEncryptorUnitTests, LoadKey_ReadsRawAndHexKeys)
+{
+    // Arrange
+    fs::path rawPath = CreateFile("raw.key", std::string(key.begin(), key.end()));
+    std::string hex;
+    for (std::uint8_t byte : key)
+    {
+        const char digits[] = "0123456789abcdef";
+        hex += digits[byte >> 4];
+        hex += digits[byte & 0xF];
+    }
+    fs::path hexPath = CreateFile("hex.key", hex + "\n");
+    fs::path shortPath = CreateFile("short.key", hex.substr(2));
+    FileEncryptor::Key rawKey{};
+    FileEncryptor::Key hexKey{};
+    FileEncryptor::Key shortKey{};
+
+    // Act
+    const bool rawLoaded = FileEncryptor::LoadKey(rawPath, rawKey);
+    const bool hexLoaded = FileEncryptor::LoadKey(hexPath, hexKey);
+    const bool shortLoaded = FileEncryptor::LoadKey(shortPath, shortKey);
+    const bool missingLoaded = FileEncryptor::LoadKey(workDir / "missing.key", shortKey);
+
+    // Assert
+    ASSERT_TRUE(rawLoaded);
+    ASSERT_TRUE(hexLoaded);
+    EXPECT_EQ(rawKey, key);
+    EXPECT_EQ(hexKey, key);
+    EXPECT_FALSE(shortLoaded);
+    EXPECT_FALSE(missingLoaded);
+}
@@ -0,0 +1,839 @@
+/**
+ * @file file_hasher_unit_tests.cpp
+ * @brief Unit tests for FileHasher hashing paths.
+ */
+#include "FileHasher/FileHasher.hpp"
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace fs = std::filesystem;
+
+class FileHasherUnitTests : public ::testing::Test
+{
+  protected:
+    fs::path workDir;
+
+    void SetUp() override
+    {
+        const auto* testInfo = ::testing::UnitTest::GetInstance()->current_test_info();
+        workDir = fs::temp_directory_path() / ("hasher_" + std::string(testInfo->name()));
+        fs::remove_all(workDir);
+        fs::create_directories(workDir);
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+
+    fs::path CreateFile(const std::string& name, std::size_t size)
+    {
+        fs::path filePath = workDir / name;
+        std::ofstream outputStream(filePath, std::ios::binary);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            outputStream.put(static_cast<char>((i * 31) & 0xFF));
+        }
+        return filePath;
+    }
+
+#if !defined(_WIN32)
+    /**
+     * @brief Create a file of zeros with a data block at each offset, as holes or written out in full.
+     */
+    fs::path CreateSparseFile(const std::string& name, std::uintmax_t size, const std::vector<std::uintmax_t>& dataOffsets, bool dense)
+    {
+        fs::path filePath = workDir / name;
+        {
+            std::ofstream outputStream(filePath, std::ios::binary);
+            if (true == dense)
+            {
+                const std::string zeros(1024 * 1024, '\0');
+                for (std::uintmax_t written = 0; written < size; written += zeros.size())
+                {
+                    outputStream.write(zeros.data(), static_cast<std::streamsize>(std::min<std::uintmax_t>(zeros.size(), size - written)));
+                }
+            }
+            const std::string block(64 * 1024, 'x');
+            for (std::uintmax_t offset : dataOffsets)
+            {
+                outputStream.seekp(static_cast<std::streamoff>(offset));
+                outputStream.write(block.data(), static_cast<std::streamsize>(block.size()));
+            }
+        }
+        fs::resize_file(filePath, size);
+        return filePath;
+    }
+
+    static std::uintmax_t AllocatedBytes(const fs::path& filePath)
+    {
+        struct stat fileStatus{};
+        stat(filePath.c_str(), &fileStatus);
+        return static_cast<std::uintmax_t>(fileStatus.st_blocks) * 512;
+    }
+#endif
+};
+
+TEST_F(FileHasherUnitTests, Compute_MappedAndBufferedPaths_ProduceSameHash)
+{
+    // Arrange
+    fs::path filePath = CreateFile("data.bin", 100000);
+    const std::vector<HashAlgorithm> allAlgorithms = {HashAlgorithm::XXH64, HashAlgorithm::XXH3_64, HashAlgorithm::XXH3_128,
+                                                      HashAlgorithm::XXH3_128_Tree, HashAlgorithm::BLAKE3};
+
+    for (const auto& algorithm : allAlgorithms)
+    {
+        FileHasher bufferedHasher(algorithm, 0);
+        FileHasher mappedHasher(algorithm, 1);
+
+        // Act
+        HashDigest bufferedHash{};
+        HashDigest mappedHash{};
+        bool bufferedResult = bufferedHasher.Compute(filePath, bufferedHash);
+        bool mappedResult = mappedHasher.Compute(filePath, mappedHash);
+
+        // Assert
+        ASSERT_TRUE(bufferedResult);
+        ASSERT_TRUE(mappedResult);
+        ASSERT_EQ(HashAlgorithmDigestSize(algorithm), bufferedHash.size);
+        ASSERT_EQ(bufferedHash, mappedHash) << HashAlgorithmToString(algorithm);
+    }
+}
+
+#if !defined(_WIN32)
+TEST_F(FileHasherUnitTests, Compute_FileTruncatedWhileMapped_FallsBackInsteadOfCrashing)
+{
+    // Arrange: a mapped file that another thread truncates at a later point of the hash each round
+    const std::string content(32 * 1024 * 1024, 'r');
+    constexpr std::uintmax_t TruncatedSize = 4096;
+    const fs::path filePath = workDir / "shrinking.bin";
+    const FileHasher bufferedHasher(HashAlgorithm::XXH3_128, 0);
+    const FileHasher mappedHasher(HashAlgorithm::XXH3_128, 1);
+    HashDigest fullDigest{};
+    HashDigest truncatedDigest{};
+    {
+        std::ofstream outputStream(filePath, std::ios::binary);
+        outputStream.write(content.data(), static_cast<std::streamsize>(content.size()));
+    }
+    ASSERT_TRUE(bufferedHasher.Compute(filePath, fullDigest));
+    fs::resize_file(filePath, TruncatedSize);
+    ASSERT_TRUE(bufferedHasher.Compute(filePath, truncatedDigest));
+
+    for (int round = 0; round < 24; ++round)
+    {
+        {
+            std::ofstream outputStream(filePath, std::ios::binary);
+            outputStream.write(content.data(), static_cast<std::streamsize>(content.size()));
+        }
+        HashDigest digest{};
+        bool result = false;
+
+        // Act
+        std::thread hashing([&]() { result = mappedHasher.Compute(filePath, digest); });
+        std::this_thread::sleep_for(std::chrono::microseconds(round * 250));
+        fs::resize_file(filePath, TruncatedSize);
+        hashing.join();
+
+        // Assert: the process survived, and the digest is that of the file before or after the truncation
+        ASSERT_TRUE(result) << round;
+        ASSERT_TRUE((fullDigest == digest) || (truncatedDigest == digest)) << round;
+    }
+}
+#endif
+
+TEST_F(FileHasherUnitTests, ComputeMany_SmallFiles_MatchBufferDigestOfTheirContent)
+{
+    // Arrange
+    const std::vector<std::size_t> sizes = {0, 1, 4095, static_cast<std::size_t>(FileHasher::SmallFileSize),
+                                            static_cast<std::size_t>(FileHasher::SmallFileSize) + 1};
+    const std::vector<HashAlgorithm> allAlgorithms = {HashAlgorithm::XXH64, HashAlgorithm::XXH3_64, HashAlgorithm::XXH3_128,
+                                                      HashAlgorithm::XXH3_128_Tree, HashAlgorithm::BLAKE3};
+    std::vector<HashJob> jobs;
+    for (std::size_t size : sizes)
+    {
+        jobs.push_back(HashJob{CreateFile("file" + std::to_string(size) + ".bin", size), HashDigest{}, false});
+    }
+
+    for (const auto& algorithm : allAlgorithms)
+    {
+        FileHasher hasher(algorithm, 0);
+
+        // Act
+        hasher.ComputeMany(jobs);
+
+        // Assert
+        for (std::size_t i = 0; i < sizes.size(); ++i)
+        {
+            std::vector<char> content(sizes[i]);
+            for (std::size_t offset = 0; offset < content.size(); ++offset)
+            {
+                content[offset] = static_cast<char>((offset * 31) & 0xFF);
+            }
+            ASSERT_TRUE(jobs[i].hashed);
+            ASSERT_EQ(FileHasher::ComputeBuffer(algorithm, content.data(), content.size()), jobs[i].digest)
+                << HashAlgorithmToString(algorithm) << " " << sizes[i];
+        }
+    }
+}
+
+TEST_F(FileHasherUnitTests, ComputeAndAppend_GrownFile_ResumesAndMatchesCompute)
+{
+    // Arrange
+    const std::vector<HashAlgorithm> resumableAlgorithms = {HashAlgorithm::XXH64, HashAlgorithm::XXH3_64, HashAlgorithm::XXH3_128,
+                                                            HashAlgorithm::BLAKE3};
+    for (const auto& algorithm : resumableAlgorithms)
+    {
+        const fs::path sourcePath = CreateFile("source.bin", 300000);
+        const fs::path copyPath = workDir / "copy.bin";
+        FileHasher hasher(algorithm, 0);
+        HashResumePoint resumePoint{};
+        HashDigest firstDigest{};
+        ASSERT_TRUE(hasher.ComputeAndAppend(sourcePath, copyPath, resumePoint, firstDigest));
+        HashDigest pointDigest{};
+        ASSERT_TRUE(hasher.ResumePointDigest(resumePoint, pointDigest));
+        {
+            std::ofstream outputStream(sourcePath, std::ios::binary | std::ios::app);
+            outputStream << std::string(70000, 'z');
+        }
+
+        // Act
+        HashDigest grownDigest{};
+        bool appendResult = hasher.ComputeAndAppend(sourcePath, copyPath, resumePoint, grownDigest);
+
+        // Assert
+        HashDigest expectedGrownDigest{};
+        ASSERT_EQ(firstDigest, pointDigest) << HashAlgorithmToString(algorithm);
+        ASSERT_TRUE(appendResult) << HashAlgorithmToString(algorithm);
+        ASSERT_TRUE(hasher.Compute(sourcePath, expectedGrownDigest));
+        ASSERT_EQ(expectedGrownDigest, grownDigest) << HashAlgorithmToString(algorithm);
+        ASSERT_EQ(370000U, resumePoint.size);
+        ASSERT_EQ(370000U, fs::file_size(copyPath));
+        std::ifstream sourceStream(sourcePath, std::ios::binary);
+        std::ifstream copyStream(copyPath, std::ios::binary);
+        ASSERT_TRUE(std::equal(std::istreambuf_iterator<char>(sourceStream), std::istreambuf_iterator<char>(),
+                               std::istreambuf_iterator<char>(copyStream)));
+    }
+}
+
+TEST_F(FileHasherUnitTests, ComputeAndAppend_FromCheckpoint_ContinuesInterruptedCopy)
+{
+    // Arrange
+    const std::uintmax_t interval = 1024 * 1024;
+    const fs::path sourcePath = CreateFile("source.bin", (3 * interval) + 1000);
+    const fs::path copyPath = workDir / "copy.bin";
+    FileHasher hasher(HashAlgorithm::XXH3_128, 0);
+    std::vector<std::pair<HashResumePoint, std::uint64_t>> checkpoints;
+    HashResumePoint resumePoint{};
+    HashDigest fullDigest{};
+    ASSERT_TRUE(hasher.ComputeAndAppend(sourcePath, copyPath, resumePoint, fullDigest, interval,
+                                        [&checkpoints](const HashResumePoint& point, std::uint64_t chunkHash) { checkpoints.emplace_back(point, chunkHash); }));
+    ASSERT_EQ(3U, checkpoints.size());
+    std::uint64_t secondChunkHash = 0;
+    ASSERT_TRUE(hasher.ComputeRangeHash(copyPath, interval, interval, secondChunkHash));
+    fs::resize_file(copyPath, 2 * interval);
+
+    // Act
+    HashResumePoint checkpoint = checkpoints[1].first;
+    HashDigest resumedDigest{};
+    bool appendResult = hasher.ComputeAndAppend(sourcePath, copyPath, checkpoint, resumedDigest);
+
+    // Assert
+    ASSERT_EQ(interval, checkpoints[0].first.size);
+    ASSERT_EQ(2 * interval, checkpoints[1].first.size);
+    ASSERT_EQ(checkpoints[1].second, secondChunkHash);
+    ASSERT_TRUE(appendResult);
+    ASSERT_EQ(fullDigest, resumedDigest);
+    ASSERT_EQ(fs::file_size(sourcePath), fs::file_size(copyPath));
+}
+
+TEST_F(FileHasherUnitTests, ComputeAndAppend_RewrittenTail_IsRefused)
+{
+    // Arrange
+    const fs::path sourcePath = CreateFile("source.bin", 10000);
+    const fs::path copyPath = workDir / "copy.bin";
+    FileHasher hasher(HashAlgorithm::XXH3_128, 0);
+    HashResumePoint resumePoint{};
+    HashDigest digest{};
+    ASSERT_TRUE(hasher.ComputeAndAppend(sourcePath, copyPath, resumePoint, digest));
+    {
+        std::fstream outputStream(sourcePath, std::ios::binary | std::ios::in | std::ios::out);
+        outputStream.seekp(9990);
+        outputStream << "rewritten and grown";
+    }
+
+    // Act
+    bool appendResult = hasher.ComputeAndAppend(sourcePath, copyPath, resumePoint, digest);
+
+    // Assert
+    ASSERT_FALSE(appendResult);
+    ASSERT_FALSE(FileHasher::SupportsResume(HashAlgorithm::XXH3_128_Tree));
+}
+
+TEST_F(FileHasherUnitTests, ComputeSample_FirstAndLastBlocks_IgnoresChangesInBetween)
+{
+    // Arrange
+    // Sixteen blocks of 1 KiB and a partial last one; without random blocks only the first and the last are read.
+    const fs::path filePath = CreateFile("media.bin", (16 * 1024) + 100);
+    FileHasher hasher(HashAlgorithm::XXH3_128, 0);
+    HashDigest originalSample{};
+    HashDigest repeatedSample{};
+    ASSERT_TRUE(hasher.ComputeSample(filePath, 1024, 0, originalSample));
+    ASSERT_TRUE(hasher.ComputeSample(filePath, 1024, 0, repeatedSample));
+
+    // Act
+    HashDigest middleChangedSample{};
+    HashDigest tailChangedSample{};
+    {
+        std::fstream outputStream(filePath, std::ios::binary | std::ios::in | std::ios::out);
+        outputStream.seekp(8 * 1024);
+        outputStream << "middle";
+    }
+    bool middleResult = hasher.ComputeSample(filePath, 1024, 0, middleChangedSample);
+    {
+        std::fstream outputStream(filePath, std::ios::binary | std::ios::in | std::ios::out);
+        outputStream.seekp((16 * 1024) + 50);
+        outputStream << "tail";
+    }
+    bool tailResult = hasher.ComputeSample(filePath, 1024, 0, tailChangedSample);
+
+    // Assert
+    ASSERT_TRUE(middleResult && tailResult);
+    ASSERT_EQ(16u, originalSample.size);
+    ASSERT_EQ(originalSample, repeatedSample);
+    ASSERT_EQ(originalSample, middleChangedSample);
+    ASSERT_NE(originalSample, tailChangedSample);
+}
+
+TEST_F(FileHasherUnitTests, ComputeSample_SmallFile_ReadsEveryBlockAndTheSize)
+{
+    // Arrange
+    const fs::path filePath = CreateFile("small.bin", 5000);
+    const fs::path longerPath = CreateFile("longer.bin", 5001);
+    FileHasher hasher(HashAlgorithm::XXH3_128, 0);
+    HashDigest originalSample{};
+    HashDigest longerSample{};
+    ASSERT_TRUE(hasher.ComputeSample(filePath, 1024, 8, originalSample));
+    ASSERT_TRUE(hasher.ComputeSample(longerPath, 1024, 8, longerSample));
+
+    // Act
+    HashDigest changedSample{};
+    {
+        std::fstream outputStream(filePath, std::ios::binary | std::ios::in | std::ios::out);
+        outputStream.seekp(2500);
+        outputStream << "x";
+    }
+    bool changedResult = hasher.ComputeSample(filePath, 1024, 8, changedSample);
+    HashDigest missingSample{};
+    bool missingResult = hasher.ComputeSample(workDir / "missing.bin", 1024, 8, missingSample);
+
+    // Assert
+    ASSERT_TRUE(changedResult);
+    ASSERT_FALSE(missingResult);
+    ASSERT_NE(originalSample, changedSample);
+    ASSERT_NE(originalSample, longerSample);
+}
+
+TEST_F(FileHasherUnitTests, Compute_IoUringEngine_MatchesBlockingDigest)
+{
+    // Arrange
+    // A shallow queue makes the larger files cycle every buffer slot several times.
+    const std::vector<std::size_t> fileSizes = {0, 1, FileHasher::ReadBlockSize, (FileHasher::ReadBlockSize * 9) + 123};
+    const std::vector<HashAlgorithm> allAlgorithms = {HashAlgorithm::XXH64, HashAlgorithm::XXH3_64, HashAlgorithm::XXH3_128,
+                                                      HashAlgorithm::XXH3_128_Tree, HashAlgorithm::BLAKE3};
+
+    for (const auto& algorithm : allAlgorithms)
+    {
+        FileHasher blockingHasher(algorithm, 0);
+        FileHasher uringHasher(algorithm, 0, 0, ReadEngine::IoUring, 4);
+        for (const auto fileSize : fileSizes)
+        {
+            fs::path filePath = CreateFile("data_" + std::to_string(fileSize) + ".bin", fileSize);
+
+            // Act
+            HashDigest blockingHash{};
+            HashDigest uringHash{};
+            bool blockingResult = blockingHasher.Compute(filePath, blockingHash);
+            bool uringResult = uringHasher.Compute(filePath, uringHash);
+
+            // Assert
+            ASSERT_TRUE(blockingResult);
+            ASSERT_TRUE(uringResult);
+            ASSERT_EQ(blockingHash, uringHash) << HashAlgorithmToString(algorithm) << " " << fileSize;
+        }
+    }
+}
+
+TEST_F(FileHasherUnitTests, ComputeMany_IoUringEngine_MatchesComputeAndFlagsMissingFiles)
+{
+    // Arrange
+    // More files than slots, so finished files hand their slots on; the missing file must come back unhashed.
+    const std::vector<std::size_t> fileSizes = {0, 1, 4096, FileHasher::ReadBlockSize, (FileHasher::ReadBlockSize * 3) + 7, 100000, 5, 77777};
+    const std::vector<HashAlgorithm> allAlgorithms = {HashAlgorithm::XXH64, HashAlgorithm::XXH3_64, HashAlgorithm::XXH3_128,
+                                                      HashAlgorithm::XXH3_128_Tree, HashAlgorithm::BLAKE3};
+    std::vector<HashJob> jobs;
+    for (std::size_t index = 0; index < fileSizes.size(); ++index)
+    {
+        jobs.push_back(HashJob{CreateFile("data_" + std::to_string(index) + ".bin", fileSizes[index]), HashDigest{}, false});
+    }
+    jobs.push_back(HashJob{workDir / "missing.bin", HashDigest{}, true});
+
+    for (const auto& algorithm : allAlgorithms)
+    {
+        FileHasher blockingHasher(algorithm, 0);
+        FileHasher uringHasher(algorithm, 0, 0, ReadEngine::IoUring, 3);
+
+        // Act
+        uringHasher.ComputeMany(jobs);
+
+        // Assert
+        for (std::size_t index = 0; index < fileSizes.size(); ++index)
+        {
+            HashDigest expectedHash{};
+            ASSERT_TRUE(blockingHasher.Compute(jobs[index].filePath, expectedHash));
+            ASSERT_TRUE(jobs[index].hashed) << HashAlgorithmToString(algorithm) << " " << index;
+            ASSERT_EQ(expectedHash, jobs[index].digest) << HashAlgorithmToString(algorithm) << " " << index;
+        }
+        ASSERT_FALSE(jobs.back().hashed);
+    }
+}
+
+TEST_F(FileHasherUnitTests, Compute_Unbuffered_MatchesBufferedDigestAndCopy)
+{
+    // Arrange
+    fs::path filePath = CreateFile("data.bin", (9 * 1024 * 1024) + 17);
+    FileHasher bufferedHasher(HashAlgorithm::XXH3_128, 0);
+    FileHasher unbufferedHasher(HashAlgorithm::XXH3_128, 0, 0, ReadEngine::Blocking, FileHasher::DefaultReadQueueDepth, 1);
+
+    // Act
+    HashDigest bufferedHash{};
+    HashDigest unbufferedHash{};
+    HashDigest copiedHash{};
+    bool bufferedResult = bufferedHasher.Compute(filePath, bufferedHash);
+    bool unbufferedResult = unbufferedHasher.Compute(filePath, unbufferedHash);
+    bool copiedResult = unbufferedHasher.ComputeAndCopy(filePath, workDir / "copy.bin", copiedHash);
+
+    // Assert
+    ASSERT_TRUE(bufferedResult);
+    ASSERT_TRUE(unbufferedResult);
+    ASSERT_TRUE(copiedResult);
+    ASSERT_EQ(bufferedHash, unbufferedHash);
+    ASSERT_EQ(bufferedHash, copiedHash);
+    ASSERT_EQ(fs::file_size(filePath), fs::file_size(workDir / "copy.bin"));
+}
+
+#if defined(__linux__)
+TEST_F(FileHasherUnitTests, ComputeAndCopy_OwnedSourceFile_KeepsItsAccessTime)
+{
+    // Arrange
+    // An access time before the modification time is updated by every read under relatime, unless O_NOATIME is honored.
+    fs::path filePath = CreateFile("source.bin", (3 * 1024 * 1024) + 5);
+    const struct timespec times[2] = {{1000, 0}, {0, UTIME_OMIT}};
+    ASSERT_EQ(0, utimensat(AT_FDCWD, filePath.c_str(), times, 0));
+    FileHasher hasher(HashAlgorithm::XXH3_128, 1024 * 1024);
+
+    // Act
+    HashDigest mappedHash{};
+    HashDigest copiedHash{};
+    bool mappedResult = hasher.Compute(filePath, mappedHash);
+    bool copiedResult = hasher.ComputeAndCopy(filePath, workDir / "copy.bin", copiedHash);
+
+    // Assert
+    ASSERT_TRUE(mappedResult);
+    ASSERT_TRUE(copiedResult);
+    ASSERT_EQ(mappedHash, copiedHash);
+    struct stat fileStatus{};
+    ASSERT_EQ(0, stat(filePath.c_str(), &fileStatus));
+    ASSERT_EQ(1000, fileStatus.st_atim.tv_sec);
+}
+#endif
+
+TEST_F(FileHasherUnitTests, Compute_ReusedContext_MatchesPerThreadContext)
+{
+    // Arrange
+    // One byte rounds up to a single page, so the larger file takes many reads through the buffer.
+    FileHasher::Context smallContext(1);
+    const std::vector<fs::path> filePaths = {CreateFile("small.bin", 10), CreateFile("large.bin", 300000), CreateFile("empty.bin", 0)};
+    const std::vector<HashAlgorithm> allAlgorithms = {HashAlgorithm::XXH64, HashAlgorithm::XXH3_64, HashAlgorithm::XXH3_128,
+                                                      HashAlgorithm::XXH3_128_Tree, HashAlgorithm::BLAKE3};
+    ASSERT_TRUE(smallContext.IsValid());
+    ASSERT_LE(1U, smallContext.BufferSize());
+    ASSERT_EQ(0U, smallContext.BufferSize() % 512);
+
+    for (const auto& algorithm : allAlgorithms)
+    {
+        FileHasher hasher(algorithm, 0);
+        for (const auto& filePath : filePaths)
+        {
+            // Act
+            HashDigest contextHash{};
+            HashDigest copiedHash{};
+            HashDigest defaultHash{};
+            bool contextResult = hasher.Compute(filePath, smallContext, contextHash);
+            bool copiedResult = hasher.ComputeAndCopy(filePath, workDir / "copy.bin", smallContext, copiedHash);
+            bool defaultResult = hasher.Compute(filePath, defaultHash);
+
+            // Assert
+            ASSERT_TRUE(contextResult);
+            ASSERT_TRUE(copiedResult);
+            ASSERT_TRUE(defaultResult);
+            ASSERT_EQ(defaultHash, contextHash) << HashAlgorithmToString(algorithm) << " " << filePath;
+            ASSERT_EQ(defaultHash, copiedHash) << HashAlgorithmToString(algorithm) << " " << filePath;
+            ASSERT_EQ(fs::file_size(filePath), fs::file_size(workDir / "copy.bin"));
+        }
+    }
+}
+
+TEST_F(FileHasherUnitTests, Compute_Xxh3_128_ProducesFixedWidthDigest)
+{
+    // Arrange
+    fs::path filePath = CreateFile("data.bin", 4096);
+    FileHasher hasher(HashAlgorithm::XXH3_128);
+
+    // Act
+    HashDigest wideHash{};
+    HashDigest legacyHash{};
+    bool wideResult = hasher.Compute(filePath, wideHash);
+    bool legacyResult = hasher.Compute(filePath, HashAlgorithm::XXH64, legacyHash);
+
+    // Assert
+    ASSERT_TRUE(wideResult);
+    ASSERT_TRUE(legacyResult);
+    ASSERT_EQ(32u, wideHash.ToHex().size());
+    ASSERT_EQ(16u, legacyHash.ToHex().size());
+    ASSERT_NE(wideHash, legacyHash);
+}
+
+TEST_F(FileHasherUnitTests, Compute_TreeWithinOneSegment_MatchesLinearDigest)
+{
+    // Arrange
+    fs::path filePath = CreateFile("data.bin", 300000);
+    FileHasher treeHasher(HashAlgorithm::XXH3_128_Tree);
+
+    // Act
+    HashDigest treeHash{};
+    HashDigest linearHash{};
+    bool treeResult = treeHasher.Compute(filePath, treeHash);
+    bool linearResult = treeHasher.Compute(filePath, HashAlgorithm::XXH3_128, linearHash);
+
+    // Assert
+    ASSERT_TRUE(treeResult);
+    ASSERT_TRUE(linearResult);
+    ASSERT_EQ(linearHash, treeHash);
+}
+
+TEST_F(FileHasherUnitTests, Compute_TreeOverSeveralSegments_SameDigestOnEveryPath)
+{
+    // Arrange
+    fs::path filePath = CreateFile("large.bin", static_cast<std::size_t>(FileHasher::TreeSegmentSize) * 2 + 12345);
+    FileHasher parallelHasher(HashAlgorithm::XXH3_128_Tree, 0, 4);
+    FileHasher mappedHasher(HashAlgorithm::XXH3_128_Tree, 1, 1);
+    FileHasher bufferedHasher(HashAlgorithm::XXH3_128_Tree, 0, 1);
+
+    // Act
+    HashDigest parallelHash{};
+    HashDigest mappedHash{};
+    HashDigest bufferedHash{};
+    HashDigest copiedHash{};
+    HashDigest linearHash{};
+    bool parallelResult = parallelHasher.Compute(filePath, parallelHash);
+    bool mappedResult = mappedHasher.Compute(filePath, mappedHash);
+    bool bufferedResult = bufferedHasher.Compute(filePath, bufferedHash);
+    HashDigest parallelCopiedHash{};
+    HashDigest parallelCopyLinearHash{};
+    bool copiedResult = bufferedHasher.ComputeAndCopy(filePath, workDir / "copy.bin", copiedHash);
+    bool parallelCopiedResult = parallelHasher.ComputeAndCopy(filePath, workDir / "parallel_copy.bin", parallelCopiedHash);
+    bool linearResult = bufferedHasher.Compute(filePath, HashAlgorithm::XXH3_128, linearHash);
+    bool parallelCopyLinearResult = bufferedHasher.Compute(workDir / "parallel_copy.bin", HashAlgorithm::XXH3_128, parallelCopyLinearHash);
+
+    // Assert
+    ASSERT_TRUE(parallelResult && mappedResult && bufferedResult && copiedResult && linearResult);
+    ASSERT_TRUE(parallelCopiedResult && parallelCopyLinearResult);
+    ASSERT_EQ(parallelHash, mappedHash);
+    ASSERT_EQ(parallelHash, bufferedHash);
+    ASSERT_EQ(parallelHash, copiedHash);
+    ASSERT_EQ(parallelHash, parallelCopiedHash);
+    ASSERT_EQ(linearHash, parallelCopyLinearHash) << "Ranges written by several threads reassemble the file";
+    ASSERT_NE(parallelHash, linearHash) << "Multi-segment files use the tree digest";
+}
+
+TEST(Blake3UnitTests, ComputeBuffer_PublishedVectors_MatchReferenceDigests)
+{
+    // Arrange
+    // The official test vectors hash the repeating byte pattern 0, 1, ..., 250.
+    std::vector<std::uint8_t> patternInput(1025);
+    for (std::size_t i = 0; i < patternInput.size(); ++i)
+    {
+        patternInput[i] = static_cast<std::uint8_t>(i % 251);
+    }
+
+    // Act
+    const HashDigest emptyDigest = FileHasher::ComputeBuffer(HashAlgorithm::BLAKE3, "", 0);
+    const HashDigest abcDigest = FileHasher::ComputeBuffer(HashAlgorithm::BLAKE3, "abc", 3);
+    const HashDigest patternDigest = FileHasher::ComputeBuffer(HashAlgorithm::BLAKE3, patternInput.data(), patternInput.size());
+
+    // Assert
+    ASSERT_EQ(32u, emptyDigest.size);
+    ASSERT_EQ("af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262", emptyDigest.ToHex());
+    ASSERT_EQ("6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85", abcDigest.ToHex());
+    ASSERT_EQ("d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444", patternDigest.ToHex());
+}
+
+TEST_F(FileHasherUnitTests, Compute_Blake3OverSeveralSubtrees_SameDigestOnEveryPath)
+{
+    // Arrange
+    // Three full 4 MiB subtrees and a tail that splits into smaller ones and a partial last chunk.
+    fs::path filePath = CreateFile("large.bin", (3 * 4 * 1024 * 1024) + 12345);
+    FileHasher parallelHasher(HashAlgorithm::BLAKE3, 0, 4);
+    FileHasher mappedHasher(HashAlgorithm::BLAKE3, 1, 1);
+    FileHasher bufferedHasher(HashAlgorithm::BLAKE3, 0, 1);
+    std::vector<std::uint8_t> content;
+    HashDigest readHash{};
+    ASSERT_TRUE(bufferedHasher.ComputeAndRead(filePath, content, readHash));
+
+    // Act
+    HashDigest parallelHash{};
+    HashDigest mappedHash{};
+    HashDigest bufferedHash{};
+    HashDigest copiedHash{};
+    bool parallelResult = parallelHasher.Compute(filePath, parallelHash);
+    bool mappedResult = mappedHasher.Compute(filePath, mappedHash);
+    bool bufferedResult = bufferedHasher.Compute(filePath, bufferedHash);
+    HashDigest parallelCopiedHash{};
+    bool copiedResult = bufferedHasher.ComputeAndCopy(filePath, workDir / "copy.bin", copiedHash);
+    bool parallelCopiedResult = parallelHasher.ComputeAndCopy(filePath, workDir / "parallel_copy.bin", parallelCopiedHash);
+    const HashDigest bufferHash = FileHasher::ComputeBuffer(HashAlgorithm::BLAKE3, content.data(), content.size());
+    std::vector<std::uint8_t> copiedContent;
+    HashDigest copiedReadHash{};
+    ASSERT_TRUE(bufferedHasher.ComputeAndRead(workDir / "parallel_copy.bin", copiedContent, copiedReadHash));
+
+    // Assert
+    ASSERT_TRUE(parallelResult && mappedResult && bufferedResult && copiedResult && parallelCopiedResult);
+    ASSERT_EQ(bufferHash, parallelCopiedHash);
+    ASSERT_EQ(content, copiedContent) << "Ranges written by several threads reassemble the file";
+    ASSERT_EQ(32u, parallelHash.size);
+    ASSERT_EQ(bufferHash, parallelHash);
+    ASSERT_EQ(bufferHash, mappedHash);
+    ASSERT_EQ(bufferHash, bufferedHash);
+    ASSERT_EQ(bufferHash, copiedHash);
+    ASSERT_EQ(bufferHash, readHash);
+}
+
+TEST(HashDigestUnitTests, FromBytes_RoundTripsThroughHex)
+{
+    // Arrange
+    const std::uint8_t rawBytes[] = {0x00, 0x01, 0xab, 0xff, 0x10, 0x20, 0x30, 0x40};
+
+    // Act
+    HashDigest digest{};
+    bool result = HashDigest::FromBytes(rawBytes, sizeof(rawBytes), digest);
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_EQ("0001abff10203040", digest.ToHex());
+    ASSERT_FALSE(HashDigest::FromBytes(rawBytes, 0, digest));
+}
+
+TEST(HashAlgorithmUnitTests, ToStringAndBack)
+{
+    // Arrange
+    const std::vector<HashAlgorithm> allAlgorithms = {HashAlgorithm::XXH64, HashAlgorithm::XXH3_64, HashAlgorithm::XXH3_128,
+                                                      HashAlgorithm::XXH3_128_Tree, HashAlgorithm::BLAKE3};
+
+    for (const auto& algorithm : allAlgorithms)
+    {
+        // Act
+        HashAlgorithm convertedAlgorithm = HashAlgorithm::XXH64;
+        bool parsed = StringToHashAlgorithm(HashAlgorithmToString(algorithm), convertedAlgorithm);
+
+        // Assert
+        ASSERT_TRUE(parsed);
+        ASSERT_EQ(algorithm, convertedAlgorithm);
+    }
+}
+
+TEST_F(FileHasherUnitTests, Compute_EmptyFileBelowThreshold_Succeeds)
+{
+    // Arrange
+    fs::path filePath = CreateFile("empty.bin", 0);
+    FileHasher hasher(FileHasher::DefaultAlgorithm, 1);
+
+    // Act
+    HashDigest hash{};
+    bool result = hasher.Compute(filePath, hash);
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_EQ(HashAlgorithmDigestSize(FileHasher::DefaultAlgorithm), hash.size);
+}
+
+TEST_F(FileHasherUnitTests, Compute_MissingFile_ReturnsFalse)
+{
+    // Arrange
+    FileHasher hasher;
+
+    // Act
+    HashDigest hash{};
+    bool result = hasher.Compute(workDir / "missing.bin", hash);
+
+    // Assert
+    ASSERT_FALSE(result);
+}
+
+TEST_F(FileHasherUnitTests, ComputeAndCopy_CopiesContentAndMatchesCompute)
+{
+    // Arrange
+    fs::path sourcePath = CreateFile("source.bin", 600000);
+    fs::path destinationPath = workDir / "copy.bin";
+    FileHasher hasher;
+
+    // Act
+    HashDigest copyHash{};
+    HashDigest computeHash{};
+    bool copyResult = hasher.ComputeAndCopy(sourcePath, destinationPath, copyHash);
+    bool computeResult = hasher.Compute(sourcePath, computeHash);
+
+    // Assert
+    ASSERT_TRUE(copyResult);
+    ASSERT_TRUE(computeResult);
+    ASSERT_EQ(computeHash, copyHash);
+    std::ifstream sourceStream(sourcePath, std::ios::binary);
+    std::ifstream destinationStream(destinationPath, std::ios::binary);
+    const std::string sourceContent((std::istreambuf_iterator<char>(sourceStream)), std::istreambuf_iterator<char>());
+    const std::string destinationContent((std::istreambuf_iterator<char>(destinationStream)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(sourceContent, destinationContent);
+}
+
+TEST_F(FileHasherUnitTests, ComputeAndCopy_AboveOverlappedThreshold_CopiesContentAndMatchesCompute)
+{
+    // Arrange
+    // An odd size ends in a partial half, and the small context hands many halves to the writer thread.
+    fs::path sourcePath = CreateFile("source.bin", FileHasher::OverlappedCopyThreshold + 12345);
+    fs::path destinationPath = workDir / "copy.bin";
+    FileHasher::Context smallContext(256 * 1024);
+    ASSERT_TRUE(smallContext.IsValid());
+
+    for (const auto& algorithm : {HashAlgorithm::XXH64, HashAlgorithm::XXH3_128, HashAlgorithm::BLAKE3})
+    {
+        FileHasher hasher(algorithm, 0);
+
+        // Act
+        HashDigest copyHash{};
+        HashDigest contextCopyHash{};
+        HashDigest computeHash{};
+        bool copyResult = hasher.ComputeAndCopy(sourcePath, destinationPath, copyHash);
+        bool contextCopyResult = hasher.ComputeAndCopy(sourcePath, workDir / "context_copy.bin", smallContext, contextCopyHash);
+        bool computeResult = hasher.Compute(sourcePath, computeHash);
+
+        // Assert
+        ASSERT_TRUE(copyResult);
+        ASSERT_TRUE(contextCopyResult);
+        ASSERT_TRUE(computeResult);
+        ASSERT_EQ(computeHash, copyHash) << HashAlgorithmToString(algorithm);
+        ASSERT_EQ(computeHash, contextCopyHash) << HashAlgorithmToString(algorithm);
+        std::ifstream sourceStream(sourcePath, std::ios::binary);
+        std::ifstream destinationStream(destinationPath, std::ios::binary);
+        std::ifstream contextStream(workDir / "context_copy.bin", std::ios::binary);
+        const std::string sourceContent((std::istreambuf_iterator<char>(sourceStream)), std::istreambuf_iterator<char>());
+        const std::string destinationContent((std::istreambuf_iterator<char>(destinationStream)), std::istreambuf_iterator<char>());
+        const std::string contextContent((std::istreambuf_iterator<char>(contextStream)), std::istreambuf_iterator<char>());
+        ASSERT_EQ(sourceContent, destinationContent);
+        ASSERT_EQ(sourceContent, contextContent);
+    }
+}
+
+#if !defined(_WIN32)
+TEST_F(FileHasherUnitTests, Compute_SparseFile_MatchesDenseDigestAndCopyKeepsHoles)
+{
+    // Arrange
+    // Two whole tree segments of zeros after the first block, then a partial one ending in a hole.
+    const std::uintmax_t fileSize = 3 * FileHasher::TreeSegmentSize + (1024 * 1024) + 12345;
+    const std::vector<std::uintmax_t> dataOffsets = {0, 3 * FileHasher::TreeSegmentSize - 4096};
+    fs::path sparsePath = CreateSparseFile("sparse.bin", fileSize, dataOffsets, false);
+    if (fileSize <= AllocatedBytes(sparsePath))
+    {
+        GTEST_SKIP() << "The filesystem of the temporary directory does not keep holes";
+    }
+    fs::path densePath = CreateSparseFile("dense.bin", fileSize, dataOffsets, true);
+    const std::vector<HashAlgorithm> allAlgorithms = {HashAlgorithm::XXH64, HashAlgorithm::XXH3_64, HashAlgorithm::XXH3_128,
+                                                      HashAlgorithm::XXH3_128_Tree, HashAlgorithm::BLAKE3};
+
+    for (const auto& algorithm : allAlgorithms)
+    {
+        FileHasher hasher(algorithm, 1, 4);
+        fs::path copyPath = workDir / "copy.bin";
+
+        // Act
+        HashDigest denseHash{};
+        HashDigest sparseHash{};
+        HashDigest copiedHash{};
+        HashDigest streamedHash{};
+        std::uintmax_t streamedBytes = 0;
+        bool denseResult = hasher.Compute(densePath, denseHash);
+        bool sparseResult = hasher.Compute(sparsePath, sparseHash);
+        bool copiedResult = hasher.ComputeAndCopy(sparsePath, copyPath, copiedHash);
+        bool streamedResult = hasher.ComputeAndStream(
+            sparsePath,
+            [&streamedBytes](const std::uint8_t*, std::size_t length)
+            {
+                streamedBytes += length;
+                return true;
+            },
+            streamedHash);
+
+        // Assert
+        ASSERT_TRUE(denseResult && sparseResult && copiedResult && streamedResult);
+        ASSERT_EQ(denseHash, sparseHash) << HashAlgorithmToString(algorithm);
+        ASSERT_EQ(denseHash, copiedHash) << HashAlgorithmToString(algorithm);
+        ASSERT_EQ(denseHash, streamedHash) << HashAlgorithmToString(algorithm);
+        ASSERT_EQ(fileSize, streamedBytes);
+        ASSERT_EQ(fileSize, fs::file_size(copyPath));
+        ASSERT_GT(fileSize / 4, AllocatedBytes(copyPath)) << "Holes must not be filled in";
+        HashDigest copyContentHash{};
+        ASSERT_TRUE(hasher.Compute(copyPath, copyContentHash));
+        ASSERT_EQ(denseHash, copyContentHash);
+    }
+}
+#endif
+
+TEST_F(FileHasherUnitTests, Compute_Throttled_MatchesMappedDigestAndIsPaced)
+{
+    // Arrange
+    fs::path filePath = CreateFile("data.bin", 2 * 1024 * 1024);
+    HashDigest mappedHash{};
+    ASSERT_TRUE(FileHasher(FileHasher::DefaultAlgorithm, 1).Compute(filePath, mappedHash));
+    IoLimits limits;
+    limits.readBytesPerSecond = 8 * 1024 * 1024;
+    IoThrottle throttle(limits);
+    FileHasher hasher(FileHasher::DefaultAlgorithm, 1, 0, ReadEngine::Blocking, FileHasher::DefaultReadQueueDepth, 0,
+                      FileHasher::DefaultReadBufferSize, &throttle);
+
+    // Act
+    HashDigest throttledHash{};
+    const auto start = std::chrono::steady_clock::now();
+    bool result = hasher.Compute(filePath, throttledHash);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Assert
+    ASSERT_TRUE(result);
+    ASSERT_EQ(mappedHash, throttledHash);
+    // 2 MiB at 8 MiB/s is 250 ms, less the burst the bucket starts with.
+    ASSERT_GE(elapsed, std::chrono::milliseconds(250) - IoThrottle::BurstWindow);
+}
@@ -0,0 +1,512 @@
+/**
+ * @file file_iterator_unit_tests.cpp
+ * @brief Unit tests for sequential and parallel file enumeration.
+ */
+#include "FileIterator/FileIterator.hpp"
+#include "FileIterator/FileMetadata.hpp"
+#include "FileIterator/PathFilter.hpp"
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/xattr.h>
+#endif
+
+namespace fs = std::filesystem;
+
+class FileIteratorUnitTests : public ::testing::Test
+{
+  protected:
+    fs::path workDir;
+    std::vector<std::string> expectedFiles;
+
+    void SetUp() override
+    {
+        const auto* testInfo = ::testing::UnitTest::GetInstance()->current_test_info();
+        workDir = fs::temp_directory_path() / ("iterator_" + std::string(testInfo->name()));
+        fs::remove_all(workDir);
+
+        for (int directory = 0; directory < 5; ++directory)
+        {
+            for (int file = 0; file < 4; ++file)
+            {
+                const fs::path relativePath = fs::path("d" + std::to_string(directory)) / "sub" / ("f" + std::to_string(file) + ".txt");
+                fs::create_directories((workDir / relativePath).parent_path());
+                std::ofstream(workDir / relativePath) << "content";
+                expectedFiles.push_back(relativePath.generic_string());
+            }
+        }
+        std::ofstream(workDir / "root.txt") << "content";
+        expectedFiles.push_back("root.txt");
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+
+    std::vector<std::string> Collect(const FileIterator& iterator, bool& complete)
+    {
+        std::mutex filesMutex;
+        std::vector<std::string> files;
+        complete = iterator.Iterate(workDir,
+                                    [&](const fs::path& file)
+                                    {
+                                        std::lock_guard<std::mutex> lock(filesMutex);
+                                        files.push_back(file.lexically_relative(workDir).generic_string());
+                                    });
+        return files;
+    }
+};
+
+TEST_F(FileIteratorUnitTests, Iterate_ParallelUnordered_FindsSameFilesAsSequential)
+{
+    bool sequentialComplete = false;
+    bool parallelComplete = false;
+    const auto sequentialFiles = Collect(FileIterator(), sequentialComplete);
+    const auto parallelFiles = Collect(FileIterator(4, false), parallelComplete);
+
+    EXPECT_TRUE(sequentialComplete);
+    EXPECT_TRUE(parallelComplete);
+    EXPECT_THAT(sequentialFiles, testing::UnorderedElementsAreArray(expectedFiles));
+    EXPECT_THAT(parallelFiles, testing::UnorderedElementsAreArray(expectedFiles));
+}
+
+TEST_F(FileIteratorUnitTests, Iterate_ParallelOrdered_ReportsSortedDepthFirstOrder)
+{
+    bool complete = false;
+    const auto files = Collect(FileIterator(4, true), complete);
+
+    auto sortedFiles = expectedFiles;
+    std::sort(sortedFiles.begin(), sortedFiles.end());
+    std::rotate(sortedFiles.begin(), sortedFiles.end() - 1, sortedFiles.end());
+
+    EXPECT_TRUE(complete);
+    EXPECT_THAT(files, testing::ElementsAreArray(sortedFiles)) << "Files of a directory come before its subdirectories";
+}
+
+TEST_F(FileIteratorUnitTests, Iterate_MissingRoot_ReturnsFalse)
+{
+    bool called = false;
+    EXPECT_FALSE(FileIterator(4, false).Iterate(workDir / "missing", [&](const fs::path&) { called = true; }));
+    EXPECT_FALSE(called);
+}
+
+TEST_F(FileIteratorUnitTests, IterateBatches_GroupsFilesByDirectoryAndSplitsLargeOnes)
+{
+    const fs::path wideDirectory = workDir / "wide";
+    fs::create_directories(wideDirectory);
+    const std::size_t wideFileCount = FileIterator::MaxBatchSize + 10;
+    for (std::size_t file = 0; file < wideFileCount; ++file)
+    {
+        std::ofstream(wideDirectory / ("w" + std::to_string(file))) << "x";
+        expectedFiles.push_back("wide/w" + std::to_string(file));
+    }
+
+    for (const FileIterator& iterator : {FileIterator(), FileIterator(4, false), FileIterator(4, true)})
+    {
+        std::mutex filesMutex;
+        std::vector<std::string> files;
+        bool oversized = false;
+        bool mixedDirectories = false;
+        const bool complete = iterator.IterateBatches(workDir,
+                                                      [&](std::vector<fs::path>&& batch)
+                                                      {
+                                                          std::lock_guard<std::mutex> lock(filesMutex);
+                                                          oversized = oversized || (FileIterator::MaxBatchSize < batch.size());
+                                                          for (const auto& file : batch)
+                                                          {
+                                                              mixedDirectories = mixedDirectories || (batch.front().parent_path() != file.parent_path());
+                                                              files.push_back(file.lexically_relative(workDir).generic_string());
+                                                          }
+                                                      });
+        EXPECT_TRUE(complete);
+        EXPECT_FALSE(oversized);
+        EXPECT_FALSE(mixedDirectories);
+        EXPECT_THAT(files, testing::UnorderedElementsAreArray(expectedFiles));
+    }
+}
+
+TEST_F(FileIteratorUnitTests, IterateBatchesWithInfo_ReportsEachDirectoryAfterItsFiles)
+{
+    for (const FileIterator& iterator : {FileIterator(), FileIterator(4, false), FileIterator(4, true)})
+    {
+        // Arrange
+        std::mutex eventsMutex;
+        std::vector<std::string> reportedFiles;
+        std::vector<std::string> directories;
+        bool filesBeforeDirectory = true;
+
+        // Act
+        const bool complete = iterator.IterateBatchesWithInfo(
+            workDir,
+            [&](std::vector<FileEntry>&& batch)
+            {
+                std::lock_guard<std::mutex> lock(eventsMutex);
+                for (const auto& file : batch)
+                {
+                    reportedFiles.push_back(file.path.lexically_relative(workDir).generic_string());
+                }
+            },
+            [&](const fs::path& directory, bool listed)
+            {
+                std::lock_guard<std::mutex> lock(eventsMutex);
+                const std::string relativeDirectory = directory.lexically_relative(workDir).generic_string();
+                directories.push_back(relativeDirectory + ((true == listed) ? "" : ":failed"));
+                for (const auto& expectedFile : expectedFiles)
+                {
+                    const std::string parent = fs::path(expectedFile).parent_path().generic_string();
+                    if (((parent == relativeDirectory) || (parent.empty() && ("." == relativeDirectory))) &&
+                        (reportedFiles.end() == std::find(reportedFiles.begin(), reportedFiles.end(), expectedFile)))
+                    {
+                        filesBeforeDirectory = false;
+                    }
+                }
+            });
+
+        // Assert
+        EXPECT_TRUE(complete);
+        EXPECT_TRUE(filesBeforeDirectory) << "A directory is reported only after all of its files";
+        std::sort(directories.begin(), directories.end());
+        EXPECT_THAT(directories, testing::ElementsAre(".", "d0", "d0/sub", "d1", "d1/sub", "d2", "d2/sub", "d3", "d3/sub", "d4", "d4/sub"));
+    }
+}
+
+TEST_F(FileIteratorUnitTests, IterateWithInfo_ReportSizes_ReportsSizeOfEveryFile)
+{
+    for (const FileIterator& iterator : {FileIterator(1, false, true), FileIterator(4, false, true)})
+    {
+        std::mutex filesMutex;
+        std::size_t checked = 0;
+        const bool complete = iterator.IterateWithInfo(workDir,
+                                                       [&](const fs::path&, const FileEntryInfo& info)
+                                                       {
+                                                           std::lock_guard<std::mutex> lock(filesMutex);
+                                                           EXPECT_TRUE(info.hasSizeAndTime);
+                                                           EXPECT_EQ(std::string("content").size(), info.size);
+                                                           ++checked;
+                                                       });
+        EXPECT_TRUE(complete);
+        EXPECT_EQ(expectedFiles.size(), checked);
+    }
+}
+
+#ifndef _WIN32
+TEST_F(FileIteratorUnitTests, Iterate_Symlinks_ReportsFileLinksAndSkipsDirectoryLinks)
+{
+    fs::create_symlink(workDir / "root.txt", workDir / "link.txt");
+    fs::create_directory_symlink(workDir / "d0", workDir / "dirlink");
+    fs::create_symlink(workDir / "missing.txt", workDir / "dangling.txt");
+    expectedFiles.push_back("link.txt");
+
+    for (unsigned int threadCount : {1u, 4u})
+    {
+        bool complete = false;
+        const auto files = Collect(FileIterator(threadCount, false), complete);
+        EXPECT_TRUE(complete);
+        EXPECT_THAT(files, testing::UnorderedElementsAreArray(expectedFiles)) << threadCount << " thread(s)";
+    }
+}
+#endif
+
+#ifdef __linux__
+TEST_F(FileIteratorUnitTests, IterateWithInfo_ReportsInodeFromDirectoryRecord)
+{
+    std::size_t checked = 0;
+    const bool complete = FileIterator().IterateWithInfo(workDir,
+                                                         [&](const fs::path& file, const FileEntryInfo& info)
+                                                         {
+                                                             struct stat fileStatus{};
+                                                             ASSERT_EQ(0, stat(file.c_str(), &fileStatus));
+                                                             EXPECT_EQ(static_cast<std::uint64_t>(fileStatus.st_ino), info.inode);
+                                                             ++checked;
+                                                         });
+    EXPECT_TRUE(complete);
+    EXPECT_EQ(expectedFiles.size(), checked);
+}
+#endif
+
+TEST_F(FileIteratorUnitTests, Iterate_MoreParentDirectoriesThanRetainedHandles_FindsEveryFile)
+{
+    // Arrange
+    for (int directory = 0; directory < 300; ++directory)
+    {
+        const fs::path relativePath = fs::path("wide") / ("w" + std::to_string(directory)) / "leaf" / "file.txt";
+        fs::create_directories((workDir / relativePath).parent_path());
+        std::ofstream(workDir / relativePath) << "content";
+        expectedFiles.push_back(relativePath.generic_string());
+    }
+
+    // Act
+    bool sequentialComplete = false;
+    bool unorderedComplete = false;
+    bool orderedComplete = false;
+    const auto sequentialFiles = Collect(FileIterator(), sequentialComplete);
+    const auto unorderedFiles = Collect(FileIterator(4, false), unorderedComplete);
+    const auto orderedFiles = Collect(FileIterator(4, true), orderedComplete);
+
+    // Assert
+    EXPECT_TRUE(sequentialComplete);
+    EXPECT_TRUE(unorderedComplete);
+    EXPECT_TRUE(orderedComplete);
+    EXPECT_THAT(sequentialFiles, testing::UnorderedElementsAreArray(expectedFiles));
+    EXPECT_THAT(unorderedFiles, testing::UnorderedElementsAreArray(expectedFiles));
+    EXPECT_THAT(orderedFiles, testing::UnorderedElementsAreArray(expectedFiles));
+}
+
+TEST_F(FileIteratorUnitTests, IterateBatchesWithInfo_Filter_DropsExcludedFilesAndPrunesExcludedDirectories)
+{
+    // Arrange
+    PathFilterRules rules;
+    rules.patterns = {"/d1/", "f*.txt", "!f2.txt", "sub/f3.txt"};
+    PathFilter filter;
+    ASSERT_TRUE(PathFilter::Compile(rules, filter));
+    std::vector<std::string> includedFiles{"root.txt"};
+    for (const int directory : {0, 2, 3, 4})
+    {
+        includedFiles.push_back("d" + std::to_string(directory) + "/sub/f2.txt");
+    }
+
+    for (const FileIterator& iterator : {FileIterator(1, false, false, &filter), FileIterator(4, false, false, &filter),
+                                         FileIterator(4, true, false, &filter)})
+    {
+        std::mutex eventsMutex;
+        std::vector<std::string> files;
+        std::vector<std::string> directories;
+
+        // Act
+        const bool complete = iterator.IterateBatchesWithInfo(
+            workDir,
+            [&](std::vector<FileEntry>&& batch)
+            {
+                std::lock_guard<std::mutex> lock(eventsMutex);
+                for (const auto& file : batch)
+                {
+                    files.push_back(file.path.lexically_relative(workDir).generic_string());
+                }
+            },
+            [&](const fs::path& directory, bool)
+            {
+                std::lock_guard<std::mutex> lock(eventsMutex);
+                directories.push_back(directory.lexically_relative(workDir).generic_string());
+            });
+
+        // Assert
+        EXPECT_TRUE(complete);
+        EXPECT_THAT(files, testing::UnorderedElementsAreArray(includedFiles));
+        EXPECT_THAT(directories, testing::Not(testing::Contains("d1"))) << "Excluded directories are not descended into";
+        EXPECT_THAT(directories, testing::Not(testing::Contains("d1/sub")));
+    }
+}
+
+TEST_F(FileIteratorUnitTests, ListDirectoryWithInfo_FilterRoot_MatchesPathsFromTheRoot)
+{
+    // Arrange
+    PathFilterRules rules;
+    rules.patterns = {"/d3/sub/f0.txt"};
+    PathFilter filter;
+    ASSERT_TRUE(PathFilter::Compile(rules, filter));
+    const FileIterator iterator(1, false, false, &filter, workDir);
+    std::vector<std::string> files;
+
+    // Act
+    const bool listed = iterator.ListDirectoryWithInfo(workDir / "d3" / "sub",
+                                                       [&](std::vector<FileEntry>&& batch)
+                                                       {
+                                                           for (const auto& file : batch)
+                                                           {
+                                                               files.push_back(file.path.filename().string());
+                                                           }
+                                                       },
+                                                       nullptr);
+
+    // Assert
+    EXPECT_TRUE(listed);
+    EXPECT_THAT(files, testing::UnorderedElementsAre("f1.txt", "f2.txt", "f3.txt"));
+}
+
+/* ============================================================================ */
+/* METADATA */
+/* ============================================================================ */
+
+#ifndef _WIN32
+TEST_F(FileIteratorUnitTests, ReadFileMetadata_ReportsModeOwnerAndTimes)
+{
+    // Arrange
+    const fs::path file = workDir / "root.txt";
+    ASSERT_EQ(0, chmod(file.c_str(), 0640));
+    const struct timespec times[2] = {{1000000000, 123456789}, {1500000000, 987654321}};
+    ASSERT_EQ(0, utimensat(AT_FDCWD, file.c_str(), times, 0));
+    FileMetadata metadata{};
+
+    // Act
+    const bool read = ReadFileMetadata(file, metadata);
+
+    // Assert
+    ASSERT_TRUE(read);
+    EXPECT_EQ(7U, metadata.size);
+    EXPECT_TRUE(S_ISREG(metadata.mode));
+    EXPECT_EQ(0640U, metadata.mode & 07777);
+    EXPECT_EQ(static_cast<std::uint32_t>(getuid()), metadata.userId);
+    EXPECT_EQ(1000000000123456789LL, metadata.accessTimeNs);
+    EXPECT_EQ(1500000000987654321LL, metadata.modificationTimeNs);
+}
+#endif
+
+TEST_F(FileIteratorUnitTests, IterateBatches_StopRequested_StopsListingAndReportsIncomplete)
+{
+    // Arrange
+    std::atomic<bool> stopRequested{true};
+
+    for (unsigned int threads : {1u, 4u})
+    {
+        for (bool ordered : {false, true})
+        {
+            std::atomic<std::size_t> reported{0};
+
+            // Act
+            const bool complete = FileIterator(threads, ordered, false, nullptr, fs::path(), &stopRequested)
+                                      .IterateBatches(workDir, [&](std::vector<fs::path>&& batch) { reported += batch.size(); });
+
+            // Assert
+            EXPECT_FALSE(complete) << threads << " threads, ordered " << ordered;
+            EXPECT_EQ(0U, reported.load()) << threads << " threads, ordered " << ordered;
+        }
+    }
+}
+
+TEST_F(FileIteratorUnitTests, Iterate_MetadataLatency_ChargesEveryDirectoryAndOverlapsAcrossThreads)
+{
+    // Arrange
+    IoLimits limits;
+    limits.metadataLatencyUs = 10000;
+    IoThrottle throttle(limits);
+    bool sequentialComplete = false;
+    bool parallelComplete = false;
+
+    // Act
+    const auto sequentialStart = std::chrono::steady_clock::now();
+    const auto sequentialFiles = Collect(FileIterator(1, false, false, nullptr, fs::path(), nullptr, &throttle), sequentialComplete);
+    const auto sequentialElapsed = std::chrono::steady_clock::now() - sequentialStart;
+    const auto parallelStart = std::chrono::steady_clock::now();
+    const auto parallelFiles = Collect(FileIterator(4, false, false, nullptr, fs::path(), nullptr, &throttle), parallelComplete);
+    const auto parallelElapsed = std::chrono::steady_clock::now() - parallelStart;
+
+    // Assert
+    // The root, d0..d4 and their sub directories are eleven listings.
+    EXPECT_TRUE(sequentialComplete);
+    EXPECT_TRUE(parallelComplete);
+    EXPECT_THAT(sequentialFiles, testing::UnorderedElementsAreArray(expectedFiles));
+    EXPECT_THAT(parallelFiles, testing::UnorderedElementsAreArray(expectedFiles));
+    EXPECT_GE(sequentialElapsed, std::chrono::milliseconds(110));
+    EXPECT_LT(parallelElapsed, sequentialElapsed);
+}
+
+TEST_F(FileIteratorUnitTests, Iterate_VolumeIndexUnavailable_FallsBackToListingDirectories)
+{
+    // Arrange
+    bool unorderedComplete = false;
+    bool orderedComplete = false;
+    auto sortedFiles = expectedFiles;
+    std::sort(sortedFiles.begin(), sortedFiles.end());
+    std::rotate(sortedFiles.begin(), sortedFiles.end() - 1, sortedFiles.end());
+
+    // Act
+    const auto unorderedFiles = Collect(FileIterator(1, false, false, nullptr, fs::path(), nullptr, nullptr, true), unorderedComplete);
+    const auto orderedFiles = Collect(FileIterator(1, true, false, nullptr, fs::path(), nullptr, nullptr, true), orderedComplete);
+
+    // Assert
+    EXPECT_TRUE(unorderedComplete);
+    EXPECT_TRUE(orderedComplete);
+    EXPECT_THAT(unorderedFiles, testing::UnorderedElementsAreArray(expectedFiles));
+    EXPECT_THAT(orderedFiles, testing::ElementsAreArray(sortedFiles));
+}
+
+#ifndef _WIN32
+TEST_F(FileIteratorUnitTests, IterateWithInfo_ReportSizes_ReportsTheMetadataOfASeparateStat)
+{
+    // Arrange
+    ASSERT_EQ(0, chmod((workDir / "root.txt").c_str(), 0600));
+    std::mutex checkedMutex;
+    std::vector<std::string> mismatched;
+    std::size_t checked = 0;
+
+    // Act
+    const bool complete = FileIterator(2, false, true).IterateWithInfo(workDir,
+                                                                       [&](const fs::path& file, const FileEntryInfo& info)
+                                                                       {
+                                                                           FileMetadata expected{};
+                                                                           const bool read = ReadFileMetadata(file, expected);
+                                                                           std::lock_guard<std::mutex> lock(checkedMutex);
+                                                                           if ((false == read) || (false == info.hasMetadata) || (expected != info.metadata) ||
+                                                                               (expected.mode != info.metadata.mode) ||
+                                                                               (expected.userId != info.metadata.userId) ||
+                                                                               (expected.changeTimeNs != info.metadata.changeTimeNs))
+                                                                           {
+                                                                               mismatched.push_back(file.string());
+                                                                           }
+                                                                           ++checked;
+                                                                       });
+
+    // Assert
+    EXPECT_TRUE(complete);
+    EXPECT_EQ(expectedFiles.size(), checked);
+    EXPECT_THAT(mismatched, testing::IsEmpty());
+}
+#endif
+
+#ifdef __linux__
+TEST_F(FileIteratorUnitTests, ExtendedAttributes_RoundTripThroughEncoding)
+{
+    // Arrange
+    const fs::path source = workDir / "root.txt";
+    const fs::path target = workDir / "d0" / "sub" / "f0.txt";
+    const std::string binaryValue("\0\1\2value", 8);
+    if (0 != setxattr(source.c_str(), "user.rdemo.first", "one", 3, 0))
+    {
+        GTEST_SKIP() << "Filesystem refuses user extended attributes";
+    }
+    ASSERT_EQ(0, setxattr(source.c_str(), "user.rdemo.binary", binaryValue.data(), binaryValue.size(), 0));
+    ASSERT_EQ(0, setxattr(source.c_str(), "user.rdemo.empty", "", 0, 0));
+    std::string encoded;
+    std::string targetEncoded;
+    std::string plainEncoded;
+
+    // Act
+    const bool read = ReadExtendedAttributes(source, encoded);
+    const bool written = WriteExtendedAttributes(target, encoded);
+    const bool targetRead = ReadExtendedAttributes(target, targetEncoded);
+    const bool plainRead = ReadExtendedAttributes(workDir / "d1" / "sub" / "f0.txt", plainEncoded);
+    const bool truncatedWritten = WriteExtendedAttributes(target, encoded.substr(0, encoded.size() - 1));
+
+    // Assert
+    ASSERT_TRUE(read);
+    ASSERT_TRUE(written);
+    ASSERT_TRUE(targetRead);
+    EXPECT_EQ(encoded, targetEncoded);
+    char value[16] = {};
+    ASSERT_EQ(static_cast<ssize_t>(binaryValue.size()), getxattr(target.c_str(), "user.rdemo.binary", value, sizeof(value)));
+    EXPECT_EQ(binaryValue, std::string(value, binaryValue.size()));
+    EXPECT_EQ(0, getxattr(target.c_str(), "user.rdemo.empty", value, sizeof(value)));
+    EXPECT_TRUE(plainRead);
+    EXPECT_TRUE(plainEncoded.empty());
+    EXPECT_FALSE(truncatedWritten);
+}
+#endif
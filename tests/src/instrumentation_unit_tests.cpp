@@ -0,0 +1,114 @@
+/**
+ * @file instrumentation_unit_tests.cpp
+ * @brief Unit tests for the RDEMO_SCOPE and RDEMO_COUNT recorder.
+ */
+#include "Instrumentation/Instrumentation.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+const InstrumentationTotal* FindTotal(const std::vector<InstrumentationTotal>& totals, const std::string& name)
+{
+    const auto total = std::find_if(totals.begin(), totals.end(), [&name](const InstrumentationTotal& entry) { return name == entry.name; });
+    return (totals.end() == total) ? nullptr : &*total;
+}
+}
+
+TEST(InstrumentationUnitTests, Macros_BuiltWithoutInstrumentation_DoNotEvaluateTheirArguments)
+{
+    if (true == Instrumentation::Enabled)
+    {
+        GTEST_SKIP() << "Built with RDEMO_INSTRUMENTATION";
+    }
+
+    // Arrange
+    int evaluations = 0;
+
+    // Act
+    RDEMO_SCOPE((++evaluations, "test.disabled"));
+    RDEMO_COUNT("test.disabled.count", ++evaluations);
+
+    // Assert
+    ASSERT_EQ(0, evaluations);
+    ASSERT_TRUE(Instrumentation::Totals().empty());
+    ASSERT_TRUE(Instrumentation::Spans(0).empty());
+}
+
+TEST(InstrumentationUnitTests, Since_ScopesAndCountsOnSeveralThreads_SumsWhatWasRecordedAfterTheBaseline)
+{
+    if (false == Instrumentation::Enabled)
+    {
+        GTEST_SKIP() << "Built without RDEMO_INSTRUMENTATION";
+    }
+
+    // Arrange
+    RDEMO_COUNT("test.sum.count", 1000);
+    const std::vector<InstrumentationTotal> baseline = Instrumentation::Totals();
+
+    // Act
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < 4; ++thread)
+    {
+        threads.emplace_back(
+            []()
+            {
+                for (int i = 0; i < 10; ++i)
+                {
+                    RDEMO_SCOPE("test.sum.scope");
+                    RDEMO_COUNT("test.sum.count", 3);
+                }
+            });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    const std::vector<InstrumentationTotal> totals = Instrumentation::Since(baseline);
+
+    // Assert
+    const InstrumentationTotal* scope = FindTotal(totals, "test.sum.scope");
+    const InstrumentationTotal* count = FindTotal(totals, "test.sum.count");
+    ASSERT_NE(nullptr, scope);
+    ASSERT_NE(nullptr, count);
+    ASSERT_EQ(40U, scope->calls);
+    ASSERT_EQ(0U, scope->value);
+    ASSERT_EQ(40U, count->calls);
+    ASSERT_EQ(120U, count->value);
+    ASSERT_EQ(0U, count->totalNs);
+    ASSERT_TRUE(std::is_sorted(totals.begin(), totals.end(),
+                               [](const InstrumentationTotal& left, const InstrumentationTotal& right) { return left.name < right.name; }));
+}
+
+TEST(InstrumentationUnitTests, Spans_ScopeLeftAfterTheStart_IsReportedWithItsTiming)
+{
+    if (false == Instrumentation::Enabled)
+    {
+        GTEST_SKIP() << "Built without RDEMO_INSTRUMENTATION";
+    }
+
+    // Arrange
+    const std::uint64_t startNs = Instrumentation::NowNs();
+
+    // Act
+    {
+        RDEMO_SCOPE("test.span");
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    const std::uint64_t endNs = Instrumentation::NowNs();
+    const std::vector<InstrumentationSpan> spans = Instrumentation::Spans(startNs);
+
+    // Assert
+    const auto span = std::find_if(spans.begin(), spans.end(), [](const InstrumentationSpan& entry) { return std::string("test.span") == entry.name; });
+    ASSERT_NE(spans.end(), span);
+    ASSERT_LE(startNs, span->startNs);
+    ASSERT_LE(2000000U, span->durationNs);
+    ASSERT_LE(span->startNs + span->durationNs, endNs);
+}
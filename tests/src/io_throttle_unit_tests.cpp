@@ -0,0 +1,232 @@
+/**
+ * @file io_throttle_unit_tests.cpp
+ * @brief Unit tests for IoThrottle pacing and for parsing throttle control files.
+ */
+#include "IoThrottle/IoThrottle.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+TEST(IoThrottleUnitTests, Acquire_Unlimited_DoesNotWait)
+{
+    // Arrange
+    IoThrottle throttle;
+
+    // Act
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 1000; ++i)
+    {
+        throttle.AcquireRead(1024 * 1024);
+        throttle.AcquireWrite(1024 * 1024);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Assert
+    ASSERT_LT(elapsed, std::chrono::milliseconds(100));
+}
+
+TEST(IoThrottleUnitTests, AcquireRead_FromSeveralThreads_SharesTheByteBudget)
+{
+    // Arrange
+    IoLimits limits;
+    limits.readBytesPerSecond = 1000000;
+    IoThrottle throttle(limits);
+
+    // Act
+    // Four threads read 300000 bytes in total; at 1 MB/s that takes 300 ms less the starting burst.
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < 4; ++reader)
+    {
+        readers.emplace_back(
+            [&throttle]()
+            {
+                for (int i = 0; i < 15; ++i)
+                {
+                    throttle.AcquireRead(5000);
+                }
+            });
+    }
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Assert
+    ASSERT_GE(elapsed, std::chrono::milliseconds(300) - IoThrottle::BurstWindow);
+}
+
+TEST(IoThrottleUnitTests, AcquireWrite_OpsLimit_PacesRequestsRegardlessOfSize)
+{
+    // Arrange
+    IoLimits limits;
+    limits.writeOpsPerSecond = 100;
+    IoThrottle throttle(limits);
+
+    // Act
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 30; ++i)
+    {
+        throttle.AcquireWrite(1);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Assert
+    ASSERT_GE(elapsed, std::chrono::milliseconds(300) - IoThrottle::BurstWindow);
+}
+
+TEST(IoThrottleUnitTests, AcquireRead_DoesNotChargeTheWriteBudget)
+{
+    // Arrange
+    IoLimits limits;
+    limits.writeBytesPerSecond = 1;
+    IoThrottle throttle(limits);
+
+    // Act
+    const auto start = std::chrono::steady_clock::now();
+    throttle.AcquireRead(1024 * 1024 * 1024);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Assert
+    ASSERT_LT(elapsed, std::chrono::milliseconds(100));
+}
+
+TEST(IoThrottleUnitTests, SetLimits_LiftingTheLimit_WakesAThrottledThread)
+{
+    // Arrange
+    IoLimits limits;
+    limits.readBytesPerSecond = 1;
+    IoThrottle throttle(limits);
+    std::atomic<bool> finished{false};
+
+    // Act
+    // Without a wake-up this read would keep the thread asleep for about eleven days.
+    std::thread reader(
+        [&]()
+        {
+            throttle.AcquireRead(1000000);
+            finished.store(true);
+        });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    throttle.SetLimits(IoLimits());
+    reader.join();
+
+    // Assert
+    ASSERT_TRUE(finished.load());
+    ASSERT_EQ(0U, throttle.Limits().readBytesPerSecond);
+}
+
+TEST(IoThrottleUnitTests, AcquireRead_Latency_DelaysEveryRequestButOverlapsAcrossThreads)
+{
+    // Arrange
+    IoLimits limits;
+    limits.readLatencyUs = 20000;
+    IoThrottle throttle(limits);
+    std::vector<std::thread> threads;
+
+    // Act
+    const auto start = std::chrono::steady_clock::now();
+    for (int thread = 0; thread < 4; ++thread)
+    {
+        threads.emplace_back(
+            [&throttle]()
+            {
+                for (int request = 0; request < 5; ++request)
+                {
+                    throttle.AcquireRead(1);
+                }
+            });
+    }
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Assert
+    // Each thread waits out five latencies; queued one after another, the twenty requests would take 400 ms.
+    ASSERT_GE(elapsed, std::chrono::milliseconds(100));
+    ASSERT_LT(elapsed, std::chrono::milliseconds(300));
+}
+
+TEST(IoThrottleUnitTests, AcquireMetadata_OnlyMetadataLatency_DoesNotDelayReads)
+{
+    // Arrange
+    IoLimits limits;
+    limits.metadataLatencyUs = 30000;
+    IoThrottle throttle(limits);
+
+    // Act
+    const auto readStart = std::chrono::steady_clock::now();
+    throttle.AcquireRead(1024 * 1024);
+    const auto readElapsed = std::chrono::steady_clock::now() - readStart;
+    const auto metadataStart = std::chrono::steady_clock::now();
+    throttle.AcquireMetadata();
+    throttle.AcquireMetadata();
+    const auto metadataElapsed = std::chrono::steady_clock::now() - metadataStart;
+
+    // Assert
+    ASSERT_LT(readElapsed, std::chrono::milliseconds(20));
+    ASSERT_GE(metadataElapsed, std::chrono::milliseconds(60));
+    ASSERT_EQ(30000U, throttle.Limits().metadataLatencyUs);
+}
+
+TEST(IoLimitsParseTests, ParseIoLimits_LatencyKeys_AreMillisecondsWithFractions)
+{
+    // Arrange
+    IoLimits limits;
+
+    // Act
+    const bool parsed = ParseIoLimits("read-latency = 2.5\nwrite-latency = 10\nmetadata-latency = 0.25\n", limits);
+
+    // Assert
+    ASSERT_TRUE(parsed);
+    ASSERT_EQ(2500U, limits.readLatencyUs);
+    ASSERT_EQ(10000U, limits.writeLatencyUs);
+    ASSERT_EQ(250U, limits.metadataLatencyUs);
+    ASSERT_TRUE(limits.IsLimited());
+}
+
+TEST(IoLimitsParseTests, ParseIoLimits_ReadsEveryKeyAndKeepsMissingOnes)
+{
+    // Arrange
+    IoLimits limits;
+    limits.writeOpsPerSecond = 7;
+
+    // Act
+    const bool parsed = ParseIoLimits("# daytime limits\n"
+                                      "read-bandwidth = 1.5\r\n"
+                                      "\n"
+                                      "  write-bandwidth=20\n"
+                                      "read-iops = 300\n",
+                                      limits);
+
+    // Assert
+    ASSERT_TRUE(parsed);
+    ASSERT_EQ(1572864U, limits.readBytesPerSecond);
+    ASSERT_EQ(20U * 1024 * 1024, limits.writeBytesPerSecond);
+    ASSERT_EQ(300U, limits.readOpsPerSecond);
+    ASSERT_EQ(7U, limits.writeOpsPerSecond);
+}
+
+TEST(IoLimitsParseTests, ParseIoLimits_InvalidLine_LeavesLimitsUnchanged)
+{
+    for (const char* text : {"read-bandwidth = 5\nbogus = 1\n", "read-bandwidth 5\n", "read-bandwidth = -5\n", "read-iops = 5x\n", "write-iops =\n"})
+    {
+        // Arrange
+        IoLimits limits;
+        limits.readBytesPerSecond = 42;
+
+        // Act
+        const bool parsed = ParseIoLimits(text, limits);
+
+        // Assert
+        EXPECT_FALSE(parsed) << text;
+        EXPECT_EQ(42U, limits.readBytesPerSecond) << text;
+    }
+}
@@ -0,0 +1,131 @@
+/**
+ * @file mpsc_queue_unit_tests.cpp
+ * @brief Unit tests for the lock-free multi-producer queues.
+ */
+#include "ThreadedFileQueue/BoundedMpscQueue.hpp"
+#include "ThreadedFileQueue/MpscQueue.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(MpscQueueUnitTests, TryPop_OnEmptyQueue_ReturnsFalse)
+{
+    MpscQueue<int> queue;
+    int value = 0;
+    EXPECT_TRUE(queue.IsEmpty());
+    EXPECT_FALSE(queue.TryPop(value));
+}
+
+TEST(MpscQueueUnitTests, ConcurrentProducers_AllElementsArriveInPerProducerOrder)
+{
+    constexpr int ProducerCount = 4;
+    constexpr int ItemsPerProducer = 10000;
+    MpscQueue<int> queue;
+
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < ProducerCount; ++producer)
+    {
+        producers.emplace_back(
+            [&queue, producer]()
+            {
+                for (int i = 0; i < ItemsPerProducer; ++i)
+                {
+                    queue.Push(producer * ItemsPerProducer + i);
+                }
+            });
+    }
+
+    std::vector<int> lastSeen(ProducerCount, -1);
+    int received = 0;
+    while (ProducerCount * ItemsPerProducer > received)
+    {
+        int value = 0;
+        if (false == queue.TryPop(value))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        const int producer = value / ItemsPerProducer;
+        ASSERT_LT(lastSeen[producer], value % ItemsPerProducer);
+        lastSeen[producer] = value % ItemsPerProducer;
+        ++received;
+    }
+
+    for (auto& producerThread : producers)
+    {
+        producerThread.join();
+    }
+    EXPECT_TRUE(queue.IsEmpty());
+}
+
+TEST(BoundedMpscQueueUnitTests, TryPush_OnFullRing_FailsWithoutConsumingValue)
+{
+    BoundedMpscQueue<std::string> queue(3);
+    ASSERT_EQ(4U, queue.Capacity());
+    for (int i = 0; i < 4; ++i)
+    {
+        std::string value = std::to_string(i);
+        ASSERT_TRUE(queue.TryPush(value));
+    }
+
+    std::string rejected = "rejected";
+    EXPECT_FALSE(queue.TryPush(rejected));
+    EXPECT_EQ("rejected", rejected);
+
+    std::string value;
+    ASSERT_TRUE(queue.TryPop(value));
+    EXPECT_EQ("0", value);
+    EXPECT_TRUE(queue.TryPush(rejected));
+}
+
+TEST(BoundedMpscQueueUnitTests, ConcurrentProducers_EveryAcceptedElementArrivesInPerProducerOrder)
+{
+    constexpr int ProducerCount = 4;
+    constexpr int ItemsPerProducer = 10000;
+    BoundedMpscQueue<int> queue(64);
+    std::atomic<int> accepted{0};
+    std::atomic<int> finishedProducers{0};
+
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < ProducerCount; ++producer)
+    {
+        producers.emplace_back(
+            [&, producer]()
+            {
+                for (int i = 0; i < ItemsPerProducer; ++i)
+                {
+                    int value = producer * ItemsPerProducer + i;
+                    accepted.fetch_add((true == queue.TryPush(value)) ? 1 : 0);
+                }
+                finishedProducers.fetch_add(1);
+            });
+    }
+
+    std::vector<int> lastSeen(ProducerCount, -1);
+    int received = 0;
+    while ((ProducerCount > finishedProducers.load()) || (accepted.load() > received))
+    {
+        int value = 0;
+        if (false == queue.TryPop(value))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        const int producer = value / ItemsPerProducer;
+        ASSERT_LT(lastSeen[producer], value % ItemsPerProducer);
+        lastSeen[producer] = value % ItemsPerProducer;
+        ++received;
+    }
+
+    for (auto& producerThread : producers)
+    {
+        producerThread.join();
+    }
+    EXPECT_EQ(accepted.load(), received);
+    int value = 0;
+    EXPECT_FALSE(queue.TryPop(value));
+}
@@ -0,0 +1,176 @@
+/**
+ * @file path_filter_unit_tests.cpp
+ * @brief Unit tests for compiled include and exclude rules.
+ */
+#include "FileIterator/PathFilter.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+/**
+ * @brief Compile patterns into a filter, failing the test if they are rejected.
+ */
+PathFilter CompilePatterns(const std::vector<std::string>& patterns)
+{
+    PathFilterRules rules;
+    rules.patterns = patterns;
+    PathFilter filter;
+    EXPECT_TRUE(PathFilter::Compile(rules, filter));
+    return filter;
+}
+
+/**
+ * @brief Metadata of a file with a size and an mtime.
+ */
+FileEntryInfo MakeInfo(std::uint64_t size, std::int64_t modificationTimeNs)
+{
+    return FileEntryInfo{0, true, size, modificationTimeNs};
+}
+}
+
+TEST(PathFilterUnitTests, Compile_NoRules_IsEmptyAndExcludesNothing)
+{
+    const PathFilter filter = CompilePatterns({"", "# comment", "   "});
+
+    EXPECT_TRUE(filter.IsEmpty());
+    EXPECT_FALSE(filter.NeedsSizeAndTime());
+    EXPECT_FALSE(filter.ExcludesFile("a/b.txt", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesDirectory("a"));
+}
+
+TEST(PathFilterUnitTests, Compile_MalformedPattern_ReturnsFalse)
+{
+    PathFilter filter;
+    for (const std::string& pattern : std::vector<std::string>{"[abc", "trailing\\", "!", "/", std::string(PathFilter::MaxPatternTokens + 1, '?')})
+    {
+        PathFilterRules rules;
+        rules.patterns = {pattern};
+        EXPECT_FALSE(PathFilter::Compile(rules, filter)) << pattern;
+    }
+}
+
+TEST(PathFilterUnitTests, ExcludesFile_NamePattern_MatchesAtAnyDepth)
+{
+    const PathFilter filter = CompilePatterns({"build", "*.o"});
+
+    EXPECT_TRUE(filter.ExcludesFile("build", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesDirectory("src/build"));
+    EXPECT_TRUE(filter.ExcludesFile("main.o", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesFile("src/deep/main.o", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesFile("src/main.cpp", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesFile("src/builder", FileEntryInfo{}));
+}
+
+TEST(PathFilterUnitTests, ExcludesFile_AnchoredPattern_MatchesFromTheRootOnly)
+{
+    const PathFilter filter = CompilePatterns({"/todo.txt", "docs/*.md"});
+
+    EXPECT_TRUE(filter.ExcludesFile("todo.txt", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesFile("src/todo.txt", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesFile("docs/readme.md", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesFile("docs/api/readme.md", FileEntryInfo{})) << "A star does not cross a slash";
+    EXPECT_FALSE(filter.ExcludesFile("src/docs/readme.md", FileEntryInfo{}));
+}
+
+TEST(PathFilterUnitTests, ExcludesFile_Globstar_SpansDirectories)
+{
+    const PathFilter filter = CompilePatterns({"**/cache/*.tmp", "logs/**", "a/**/z"});
+
+    EXPECT_TRUE(filter.ExcludesFile("cache/x.tmp", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesFile("one/two/cache/x.tmp", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesFile("logs/2024/01/run.log", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesDirectory("logs")) << "A trailing globstar matches what is inside only";
+    EXPECT_TRUE(filter.ExcludesFile("a/z", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesFile("a/b/c/z", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesFile("a/bz", FileEntryInfo{}));
+}
+
+TEST(PathFilterUnitTests, ExcludesFile_ClassesAndSingleCharacters_MatchOneCharacter)
+{
+    const PathFilter filter = CompilePatterns({"file[0-2].txt", "v?.bin", "[!a-y]*.log", "lit\\*"});
+
+    EXPECT_TRUE(filter.ExcludesFile("file1.txt", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesFile("file3.txt", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesFile("v1.bin", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesFile("v10.bin", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesFile("zeta.log", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesFile("alpha.log", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesFile("lit*", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesFile("literal", FileEntryInfo{}));
+}
+
+TEST(PathFilterUnitTests, ExcludesFile_Negation_LastMatchingPatternDecides)
+{
+    const PathFilter filter = CompilePatterns({"*.log", "!keep.log", "keep.log", "!important/*.log"});
+
+    EXPECT_TRUE(filter.ExcludesFile("debug.log", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesFile("keep.log", FileEntryInfo{})) << "The later exclude overrides the earlier include";
+    EXPECT_FALSE(filter.ExcludesFile("important/debug.log", FileEntryInfo{}));
+    EXPECT_FALSE(filter.ExcludesFile("important/keep.log", FileEntryInfo{}));
+}
+
+TEST(PathFilterUnitTests, ExcludesDirectory_DirectoryOnlyPattern_IgnoresFiles)
+{
+    const PathFilter filter = CompilePatterns({"tmp/", "/out/"});
+
+    EXPECT_TRUE(filter.ExcludesDirectory("tmp"));
+    EXPECT_TRUE(filter.ExcludesDirectory("src/tmp"));
+    EXPECT_FALSE(filter.ExcludesFile("src/tmp", FileEntryInfo{}));
+    EXPECT_TRUE(filter.ExcludesDirectory("out"));
+    EXPECT_FALSE(filter.ExcludesDirectory("src/out"));
+}
+
+TEST(PathFilterUnitTests, ExcludesDirectoryTree_ExcludedAncestor_ExcludesDescendants)
+{
+    const PathFilter filter = CompilePatterns({"node_modules/"});
+
+    EXPECT_TRUE(filter.ExcludesDirectoryTree("web/node_modules/pkg/lib"));
+    EXPECT_TRUE(filter.ExcludesDirectoryTree("node_modules"));
+    EXPECT_FALSE(filter.ExcludesDirectoryTree("web/src"));
+    EXPECT_FALSE(filter.ExcludesDirectoryTree(""));
+}
+
+TEST(PathFilterUnitTests, ExcludesFile_SizeAndTimeLimits_ApplyToFilesWithMetadata)
+{
+    PathFilterRules rules;
+    rules.minSize = 10;
+    rules.maxSize = 100;
+    rules.modifiedAfterNs = 1000;
+    rules.modifiedBeforeNs = 2000;
+    PathFilter filter;
+    ASSERT_TRUE(PathFilter::Compile(rules, filter));
+
+    EXPECT_FALSE(filter.IsEmpty());
+    EXPECT_TRUE(filter.NeedsSizeAndTime());
+    EXPECT_FALSE(filter.ExcludesFile("f", MakeInfo(10, 1000)));
+    EXPECT_FALSE(filter.ExcludesFile("f", MakeInfo(100, 1999)));
+    EXPECT_TRUE(filter.ExcludesFile("f", MakeInfo(9, 1500)));
+    EXPECT_TRUE(filter.ExcludesFile("f", MakeInfo(101, 1500)));
+    EXPECT_TRUE(filter.ExcludesFile("f", MakeInfo(50, 999)));
+    EXPECT_TRUE(filter.ExcludesFile("f", MakeInfo(50, 2000)));
+    EXPECT_FALSE(filter.ExcludesFile("f", FileEntryInfo{})) << "Files without metadata pass the limits";
+    EXPECT_FALSE(filter.ExcludesDirectory("d"));
+}
+
+TEST(PathFilterUnitTests, WithoutLimits_KeepsPatternsAndDropsSizeAndTimeLimits)
+{
+    PathFilterRules rules;
+    rules.patterns = {"*.tmp"};
+    rules.maxSize = 100;
+    rules.modifiedAfterNs = 1000;
+    PathFilter filter;
+    ASSERT_TRUE(PathFilter::Compile(rules, filter));
+
+    const PathFilter patterns = filter.WithoutLimits();
+
+    EXPECT_TRUE(filter.ExcludesBySizeOrTime(101, 1500));
+    EXPECT_TRUE(filter.ExcludesBySizeOrTime(50, 999));
+    EXPECT_FALSE(filter.ExcludesBySizeOrTime(50, 1500)) << "Patterns play no part in the limits";
+    EXPECT_FALSE(patterns.NeedsSizeAndTime());
+    EXPECT_FALSE(patterns.ExcludesFile("big.bin", MakeInfo(101, 999)));
+    EXPECT_TRUE(patterns.ExcludesFile("a.tmp", MakeInfo(50, 1500)));
+}
@@ -0,0 +1,464 @@
+/**
+ * @file sqlite_unit_tests.cpp
+ * @brief Unit tests for the SQLite connection wrapper.
+ */
+#include "SQLite/SQLiteConnection.hpp"
+#include "SQLite/SQLiteMemoryLimit.hpp"
+#include "SQLite/SQLiteSession.hpp"
+#include "SQLite/SQLiteText.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class SQLiteUnitTests : public ::testing::Test
+{
+  protected:
+    fs::path workDir;
+
+    void SetUp() override
+    {
+        const auto* testInfo = ::testing::UnitTest::GetInstance()->current_test_info();
+        workDir = fs::temp_directory_path() / ("sqlite_" + std::string(testInfo->name()));
+        fs::remove_all(workDir);
+        fs::create_directories(workDir);
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+};
+
+TEST_F(SQLiteUnitTests, PrepareCached_ReusesStatementWithFreshBindings)
+{
+    SQLiteConnection connection(workDir / "cache.db", 1000);
+    connection.Execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT);");
+
+    const std::string insertSql = "INSERT INTO items(id, name) VALUES(?1, ?2);";
+    for (std::int64_t i = 1; i <= 3; ++i)
+    {
+        auto statement = connection.PrepareCached(insertSql);
+        statement->BindInt64(1, i);
+        statement->BindText(2, "item" + std::to_string(i));
+        EXPECT_TRUE(statement->ExecuteStatement());
+    }
+
+    const std::string selectSql = "SELECT name FROM items WHERE id=?1;";
+    for (std::int64_t i = 1; i <= 3; ++i)
+    {
+        auto statement = connection.PrepareCached(selectSql);
+        statement->BindInt64(1, i);
+        ASSERT_TRUE(statement->FetchRow());
+        EXPECT_EQ("item" + std::to_string(i), statement->ColumnText(0));
+    }
+
+    // Bindings are cleared on release, so an unbound parameter matches nothing.
+    auto statement = connection.PrepareCached(selectSql);
+    EXPECT_FALSE(statement->FetchRow());
+}
+
+TEST_F(SQLiteUnitTests, PrepareCached_NestedLeaseOfSameSql_UsesSeparateStatement)
+{
+    SQLiteConnection connection(workDir / "nested.db", 1000);
+    connection.Execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+    connection.Execute("INSERT INTO items(id) VALUES(1), (2);");
+
+    const std::string selectSql = "SELECT id FROM items WHERE id=?1;";
+    auto outer = connection.PrepareCached(selectSql);
+    outer->BindInt64(1, 1);
+    {
+        auto inner = connection.PrepareCached(selectSql);
+        EXPECT_NE(&*outer, &*inner);
+        inner->BindInt64(1, 2);
+        ASSERT_TRUE(inner->FetchRow());
+        EXPECT_EQ(2, inner->ColumnInt64(0));
+    }
+    ASSERT_TRUE(outer->FetchRow());
+    EXPECT_EQ(1, outer->ColumnInt64(0));
+}
+
+TEST_F(SQLiteUnitTests, ForEachRow_ViewsColumnsAndStopsWhenVisitorReturnsFalse)
+{
+    // Arrange
+    SQLiteConnection connection(workDir / "rows.db", 1000);
+    connection.Execute("CREATE TABLE items(id INTEGER PRIMARY KEY, name TEXT);");
+    connection.Execute("INSERT INTO items(id, name) VALUES(1, 'alpha'), (2, NULL), (3, 'pending'), (4, 'delta');");
+    connection.Execute("UPDATE items SET name = CAST(X'77697468006E756C' AS TEXT) WHERE id = 3;");
+    auto statement = connection.Prepare("SELECT id, name FROM items ORDER BY id;");
+    std::vector<std::string> names;
+
+    // Act
+    const bool completed = statement.ForEachRow(
+        [&names](const SQLiteStatement& row)
+        {
+            names.emplace_back(row.ColumnView(1));
+            return 3 != row.ColumnInt64(0);
+        });
+
+    // Assert
+    EXPECT_FALSE(completed) << "The visitor stopped the scan on the third row";
+    ASSERT_EQ(3U, names.size());
+    EXPECT_EQ("alpha", names[0]);
+    EXPECT_TRUE(names[1].empty()) << "NULL reads as an empty view";
+    EXPECT_EQ(std::string_view("with\0nul", 8), names[2]) << "The view length comes from the column, not a terminator";
+    ASSERT_TRUE(statement.FetchRow());
+    EXPECT_EQ("delta", statement.ColumnView(1));
+}
+
+TEST_F(SQLiteUnitTests, BusyRetries_CountsWaitsForLockHeldByOtherConnection)
+{
+    // Arrange
+    SQLiteSession session(workDir / "busy.db");
+    session.Acquire().Execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+    SQLiteConnection holder(workDir / "busy.db", 1000);
+    holder.Execute("BEGIN IMMEDIATE;");
+    std::thread releaser([&holder]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        holder.Execute("COMMIT;");
+    });
+
+    // Act
+    session.Acquire().Execute("INSERT INTO items(id) VALUES(1);");
+    releaser.join();
+
+    // Assert
+    EXPECT_LT(0U, session.BusyRetries());
+}
+
+TEST_F(SQLiteUnitTests, BusyTimeout_Expired_FailsWithoutWaitingForever)
+{
+    // Arrange
+    SQLiteConnection holder(workDir / "timeout.db", 1000);
+    holder.Execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+    holder.Execute("BEGIN IMMEDIATE;");
+    std::atomic<std::uint64_t> retries{0};
+    SQLiteConnection waiter(workDir / "timeout.db", 30, &retries);
+
+    // Act
+    const auto start = std::chrono::steady_clock::now();
+    EXPECT_THROW(waiter.Execute("INSERT INTO items(id) VALUES(1);"), std::runtime_error);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Assert
+    EXPECT_LT(0U, retries.load());
+    EXPECT_LT(elapsed, std::chrono::seconds(1));
+    holder.Execute("COMMIT;");
+}
+
+TEST_F(SQLiteUnitTests, TryStep_LockedAndFailingStatements_ReportStatusWithoutThrowing)
+{
+    // Arrange
+    SQLiteConnection holder(workDir / "trystep.db", 1000);
+    holder.Execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+    holder.Execute("INSERT INTO items(id) VALUES(1);");
+    holder.Execute("BEGIN IMMEDIATE;");
+    SQLiteConnection waiter(workDir / "trystep.db", 30);
+    auto insert = waiter.Prepare("INSERT INTO items(id) VALUES(?1);");
+    auto select = waiter.Prepare("SELECT id FROM items;");
+
+    // Act
+    insert.BindInt64(1, 2);
+    const SQLiteStepResult busyResult = insert.TryStep();
+    const std::string busyMessage = insert.ErrorMessage();
+    insert.Reset();
+    holder.Execute("COMMIT;");
+    insert.BindInt64(1, 1);
+    const SQLiteStepResult duplicateResult = insert.TryStep();
+    insert.Reset();
+    const SQLiteStepResult rowResult = select.TryStep();
+    const SQLiteStepResult doneResult = select.TryStep();
+
+    // Assert
+    EXPECT_EQ(SQLiteStepResult::Busy, busyResult);
+    EXPECT_NE(std::string::npos, busyMessage.find("locked"));
+    EXPECT_EQ(SQLiteStepResult::Error, duplicateResult);
+    EXPECT_EQ(SQLiteStepResult::Row, rowResult);
+    EXPECT_EQ(SQLiteStepResult::Done, doneResult);
+}
+
+TEST_F(SQLiteUnitTests, ReadOnlySession_WriterHoldsLock_ReadsLastCommitWithoutWaiting)
+{
+    // Arrange
+    SQLiteConnection writer(workDir / "snapshot.db", 1000);
+    writer.Execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+    writer.Execute("INSERT INTO items(id) VALUES(1);");
+    writer.Execute("BEGIN IMMEDIATE;");
+    writer.Execute("INSERT INTO items(id) VALUES(2);");
+    SQLiteSession readerSession(workDir / "snapshot.db", SQLitePerformanceProfile::Safe, SQLiteSession::DefaultMaxConnections, SQLiteOpenMode::ReadOnly);
+    readerSession.SetConnectionInitializer([](SQLiteConnection& connection) { connection.Execute("CREATE TEMP VIEW item_ids AS SELECT id FROM items;"); });
+
+    // Act
+    auto& reader = readerSession.Acquire();
+    auto count = reader.Prepare("SELECT COUNT(*) FROM item_ids;");
+    const bool counted = count.FetchRow();
+    const std::int64_t rows = (true == counted) ? count.ColumnInt64(0) : -1;
+    count.Reset();
+    writer.Execute("COMMIT;");
+    auto mmapSize = reader.Prepare("PRAGMA mmap_size;");
+
+    // Assert
+    EXPECT_TRUE(reader.IsReadOnly());
+    EXPECT_EQ(1, rows) << "The reader sees the last commit, not the open write transaction";
+    EXPECT_EQ(0U, readerSession.BusyRetries());
+    ASSERT_TRUE(mmapSize.FetchRow());
+    EXPECT_EQ(SQLiteConnection::ReadOnlyMmapSizeBytes, mmapSize.ColumnInt64(0));
+}
+
+TEST_F(SQLiteUnitTests, ReadOnlyConnection_RefusesWritesAndMissingFiles)
+{
+    // Arrange
+    {
+        SQLiteConnection writer(workDir / "readonly.db", 1000);
+        writer.Execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+    }
+    SQLiteConnection reader(workDir / "readonly.db", 1000, nullptr, SQLitePerformanceProfile::Safe, SQLiteOpenMode::ReadOnly);
+
+    // Act & Assert
+    EXPECT_THROW(reader.Execute("INSERT INTO items(id) VALUES(1);"), std::runtime_error);
+    EXPECT_THROW(reader.Execute("CREATE TABLE others(id INTEGER PRIMARY KEY);"), std::runtime_error);
+    EXPECT_NO_THROW(reader.Execute("CREATE TABLE IF NOT EXISTS items(id INTEGER PRIMARY KEY);"));
+    EXPECT_THROW(SQLiteConnection(workDir / "missing.db", 1000, nullptr, SQLitePerformanceProfile::Safe, SQLiteOpenMode::ReadOnly), std::runtime_error);
+    EXPECT_FALSE(fs::exists(workDir / "missing.db"));
+}
+
+TEST_F(SQLiteUnitTests, PerformanceProfile_AppliesPragmasToEveryConnection)
+{
+    // Arrange
+    SQLiteSession bulkSession(workDir / "bulk.db", SQLitePerformanceProfile::Bulk);
+    SQLiteConnection safeConnection(workDir / "safe.db", 1000, nullptr, SQLitePerformanceProfile::Safe);
+    SQLitePerformanceProfile parsedProfile = SQLitePerformanceProfile::Safe;
+
+    // Act
+    auto& bulkConnection = bulkSession.Acquire();
+    bulkConnection.Execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+    auto bulkSynchronous = bulkConnection.Prepare("PRAGMA synchronous;");
+    auto bulkPageSize = bulkConnection.Prepare("PRAGMA page_size;");
+    auto bulkTempStore = bulkConnection.Prepare("PRAGMA temp_store;");
+    auto safeSynchronous = safeConnection.Prepare("PRAGMA synchronous;");
+
+    // Assert
+    ASSERT_TRUE(bulkSynchronous.FetchRow());
+    EXPECT_EQ(0, bulkSynchronous.ColumnInt64(0)) << "Bulk loads skip fsyncs";
+    ASSERT_TRUE(bulkPageSize.FetchRow());
+    EXPECT_EQ(16384, bulkPageSize.ColumnInt64(0)) << "A new database takes the profile's page size";
+    ASSERT_TRUE(bulkTempStore.FetchRow());
+    EXPECT_EQ(2, bulkTempStore.ColumnInt64(0));
+    ASSERT_TRUE(safeSynchronous.FetchRow());
+    EXPECT_EQ(2, safeSynchronous.ColumnInt64(0));
+    EXPECT_TRUE(StringToSQLitePerformanceProfile("balanced", parsedProfile));
+    EXPECT_EQ(SQLitePerformanceProfile::Balanced, parsedProfile);
+    EXPECT_FALSE(StringToSQLitePerformanceProfile("reckless", parsedProfile));
+}
+
+TEST_F(SQLiteUnitTests, NewDatabase_UsesIncrementalAutoVacuum)
+{
+    // Arrange
+    SQLiteConnection connection(workDir / "new.db", 1000);
+
+    // Act
+    connection.Execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+    auto autoVacuum = connection.Prepare("PRAGMA auto_vacuum;");
+
+    // Assert
+    ASSERT_TRUE(autoVacuum.FetchRow());
+    EXPECT_EQ(2, autoVacuum.ColumnInt64(0)) << "2 is INCREMENTAL";
+}
+
+TEST_F(SQLiteUnitTests, BackgroundCheckpoints_DisableAutomaticCheckpointsAndTruncateOnStop)
+{
+    // Arrange
+    const fs::path databasePath = workDir / "checkpoint.db";
+    SQLiteSession session(databasePath);
+    session.Acquire().Execute("CREATE TABLE items(id INTEGER PRIMARY KEY, payload BLOB);");
+
+    // Act
+    session.StartCheckpointing(std::chrono::milliseconds(10));
+    std::int64_t autocheckpointWhileRunning = -1;
+    std::thread writer(
+        [&session, &autocheckpointWhileRunning]()
+        {
+            auto& connection = session.Acquire();
+            auto pragma = connection.Prepare("PRAGMA wal_autocheckpoint;");
+            if (true == pragma.FetchRow())
+            {
+                autocheckpointWhileRunning = pragma.ColumnInt64(0);
+            }
+            for (int i = 0; i < 200; ++i)
+            {
+                connection.Execute("INSERT INTO items(payload) VALUES(zeroblob(8192));");
+            }
+        });
+    writer.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const bool stopResult = session.StopCheckpointing();
+    auto pragma = session.Acquire().Prepare("PRAGMA wal_autocheckpoint;");
+
+    // Assert
+    EXPECT_EQ(0, autocheckpointWhileRunning) << "Commits must not checkpoint inline";
+    EXPECT_TRUE(stopResult);
+    std::error_code ec;
+    EXPECT_EQ(0U, fs::file_size(fs::path(databasePath.string() + "-wal"), ec)) << "The final checkpoint truncates the WAL";
+    ASSERT_TRUE(pragma.FetchRow());
+    EXPECT_EQ(1000, pragma.ColumnInt64(0)) << "Automatic checkpoints are restored";
+}
+
+TEST_F(SQLiteUnitTests, Acquire_ThreadsThatExit_ReturnConnectionsForReuse)
+{
+    // Arrange
+    SQLiteSession session(workDir / "pool.db");
+    bool sameConnectionOnRepeat = true;
+
+    // Act
+    for (int i = 0; i < 5; ++i)
+    {
+        std::thread worker(
+            [&session, &sameConnectionOnRepeat]()
+            {
+                SQLiteConnection* first = &session.Acquire();
+                sameConnectionOnRepeat = sameConnectionOnRepeat && (first == &session.Acquire());
+                first->Execute("CREATE TABLE IF NOT EXISTS items(id INTEGER PRIMARY KEY);");
+            });
+        worker.join();
+    }
+
+    // Assert
+    EXPECT_TRUE(sameConnectionOnRepeat);
+    EXPECT_EQ(1U, session.OpenConnections()) << "Each recreated thread reuses the connection of the one that exited";
+}
+
+TEST_F(SQLiteUnitTests, Lease_PoolAtBound_WaitsForReturnedConnection)
+{
+    // Arrange
+    SQLiteSession session(workDir / "bounded.db", SQLitePerformanceProfile::Safe, 1);
+    std::atomic<bool> leased{false};
+    std::thread holder(
+        [&session, &leased]()
+        {
+            auto lease = session.Lease();
+            leased.store(true);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        });
+    while (false == leased.load())
+    {
+        std::this_thread::yield();
+    }
+
+    // Act
+    const auto start = std::chrono::steady_clock::now();
+    {
+        auto lease = session.Lease();
+        lease->Execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+    }
+    const auto waited = std::chrono::steady_clock::now() - start;
+    holder.join();
+
+    // Assert
+    EXPECT_GE(waited, std::chrono::milliseconds(30)) << "A lease beyond the bound waits for a returned connection";
+    EXPECT_EQ(1U, session.OpenConnections());
+}
+
+TEST_F(SQLiteUnitTests, MemoryLimit_Scope_AppliesAndRestoresSoftHeapLimit)
+{
+    // Arrange
+    const std::uint64_t before = SQLiteMemoryLimit::Current();
+    std::uint64_t during = 0;
+
+    // Act
+    {
+        SQLiteMemoryLimit limit(8 * 1024 * 1024);
+        during = SQLiteMemoryLimit::Current();
+        SQLiteSession session(workDir / "limited.db");
+        session.Acquire().Execute("CREATE TABLE items(id INTEGER PRIMARY KEY);");
+    }
+
+    // Assert
+    EXPECT_EQ(8U * 1024 * 1024, during);
+    EXPECT_EQ(before, SQLiteMemoryLimit::Current()) << "The previous limit is back once the scope ends";
+}
+
+TEST_F(SQLiteUnitTests, BackupTo_WhileOthersReadAndWrite_CopiesLastCommitWithoutWal)
+{
+    // Arrange
+    SQLiteConnection source(workDir / "source.db", 1000);
+    source.Execute("CREATE TABLE items(id INTEGER PRIMARY KEY, payload TEXT);");
+    source.Execute("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 500) "
+                   "INSERT INTO items(id, payload) SELECT i, printf('%.200c', 'x') FROM n;");
+    SQLiteConnection writer(workDir / "source.db", 1000);
+    writer.Execute("BEGIN IMMEDIATE;");
+    writer.Execute("INSERT INTO items(id, payload) VALUES(501, 'uncommitted');");
+    SQLiteConnection reader(workDir / "source.db", 1000, nullptr, SQLitePerformanceProfile::Safe, SQLiteOpenMode::ReadOnly);
+    reader.Execute("BEGIN;");
+    auto readerCount = reader.Prepare("SELECT COUNT(*) FROM items;");
+    ASSERT_TRUE(readerCount.FetchRow());
+    readerCount.Reset();
+
+    // Act
+    const bool copied = source.BackupTo(workDir / "copy.db", 4, std::chrono::milliseconds(0));
+    const bool readerStillReads = readerCount.FetchRow();
+    reader.Execute("COMMIT;");
+    writer.Execute("ROLLBACK;");
+
+    // Assert
+    ASSERT_TRUE(copied);
+    EXPECT_TRUE(readerStillReads);
+    EXPECT_FALSE(fs::exists(workDir / "copy.db-wal")) << "The copy is a single file";
+    SQLiteConnection copy(workDir / "copy.db", 1000, nullptr, SQLitePerformanceProfile::Safe, SQLiteOpenMode::ReadOnly);
+    auto count = copy.Prepare("SELECT COUNT(*), MAX(id) FROM items;");
+    ASSERT_TRUE(count.FetchRow());
+    EXPECT_EQ(500, count.ColumnInt64(0));
+    EXPECT_EQ(500, count.ColumnInt64(1)) << "The open write transaction is not copied";
+}
+
+TEST_F(SQLiteUnitTests, Text_NonAsciiPath_RoundTripsThroughUtf8)
+{
+    // Arrange
+    const fs::path path = fs::path("root") / fs::u8path("caf\xC3\xA9") / fs::u8path("\xE6\x97\xA5\xE8\xA8\x98.txt");
+    const std::size_t tailStart = fs::path("root").native().size() + 1;
+    std::string key = "prefix/";
+
+    // Act
+    bool appended = SQLiteText::AppendNative(path.native(), tailStart, key);
+    fs::path::string_type native;
+    bool assigned = SQLiteText::AssignNative(std::string_view(key).substr(7), native);
+
+    // Assert
+    ASSERT_TRUE(appended);
+    ASSERT_TRUE(assigned);
+    EXPECT_EQ(key.substr(7), (fs::u8path("caf\xC3\xA9") / fs::u8path("\xE6\x97\xA5\xE8\xA8\x98.txt")).u8string());
+    EXPECT_EQ(native, path.lexically_relative("root").native());
+    EXPECT_EQ(SQLiteText::FromPath(path), path.u8string());
+}
+
+// Only Windows spellings are converted, so only they can fail to convert.
+#ifdef _WIN32
+TEST_F(SQLiteUnitTests, Text_UnconvertibleSpellings_FailWithoutPartialOutput)
+{
+    // Arrange
+    const std::wstring unpairedSurrogate(1, static_cast<wchar_t>(0xD800));
+    std::string key = "prefix";
+    std::wstring native = L"stale";
+
+    // Act
+    bool appended = SQLiteText::AppendNative(L"name" + unpairedSurrogate, 0, key);
+    bool assigned = SQLiteText::AssignNative("caf\xC3", native);
+
+    // Assert
+    EXPECT_FALSE(appended);
+    EXPECT_EQ("prefix", key);
+    EXPECT_FALSE(assigned);
+    EXPECT_TRUE(native.empty());
+    EXPECT_THROW(SQLiteText::FromPath(fs::path(L"name" + unpairedSurrogate)), std::runtime_error);
+}
+#endif
@@ -0,0 +1,258 @@
+/**
+ * @file state_store_unit_tests.cpp
+ * @brief Unit tests for the state store backends.
+ */
+#include "StateStore/StateStore.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+class StateStoreUnitTests : public ::testing::TestWithParam<StateStoreBackend>
+{
+  protected:
+    fs::path workDir;
+
+    void SetUp() override
+    {
+        if (false == StateStore::IsAvailable(GetParam()))
+        {
+            GTEST_SKIP() << StateStoreBackendToString(GetParam()) << " is not built in";
+        }
+        const auto* testInfo = ::testing::UnitTest::GetInstance()->current_test_info();
+        std::string name = testInfo->name();
+        for (char& character : name)
+        {
+            character = ('/' == character) ? '_' : character;
+        }
+        workDir = fs::temp_directory_path() / ("state_store_" + name);
+        fs::remove_all(workDir);
+        fs::create_directories(workDir);
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+
+    std::unique_ptr<StateStore> OpenStore(const StateStoreOptions& options = StateStoreOptions())
+    {
+        std::unique_ptr<StateStore> store;
+        EXPECT_TRUE(StateStore::Open(GetParam(), workDir / "state", options, store));
+        return store;
+    }
+};
+
+TEST_P(StateStoreUnitTests, PutAndGet_ReplacesValueAndMissesAbsentKey)
+{
+    // Arrange
+    auto store = OpenStore();
+    ASSERT_NE(nullptr, store);
+
+    // Act
+    ASSERT_TRUE(store->Put("a/file.txt", "first"));
+    ASSERT_TRUE(store->Put("a/file.txt", "second"));
+    ASSERT_TRUE(store->Put("empty", ""));
+
+    // Assert
+    std::string value;
+    ASSERT_TRUE(store->Get("a/file.txt", value));
+    EXPECT_EQ("second", value);
+    ASSERT_TRUE(store->Get("empty", value));
+    EXPECT_TRUE(value.empty());
+    EXPECT_FALSE(store->Get("a/missing.txt", value));
+}
+
+TEST_P(StateStoreUnitTests, RangeAndScan_VisitKeysInBytewiseOrder)
+{
+    // Arrange
+    auto store = OpenStore();
+    ASSERT_NE(nullptr, store);
+    const std::vector<StateStoreEntry> entries = {{"b/2", "v2"}, {"a/1", "v1"}, {"c/3", "v3"}, {"b/1", "v0"}, {"b/1", "v4"}};
+
+    // Act
+    ASSERT_TRUE(store->PutBatch(entries));
+    std::vector<std::pair<std::string, std::string>> scanned;
+    const bool scanVisitedAll = store->Scan(
+        [&scanned](std::string_view key, std::string_view value)
+        {
+            scanned.emplace_back(key, value);
+            return true;
+        });
+    std::vector<std::string> ranged;
+    const bool rangeVisitedAll = store->Range("b/", "c/",
+                                              [&ranged](std::string_view key, std::string_view)
+                                              {
+                                                  ranged.emplace_back(key);
+                                                  return true;
+                                              });
+
+    // Assert
+    EXPECT_TRUE(scanVisitedAll);
+    const std::vector<std::pair<std::string, std::string>> expected = {{"a/1", "v1"}, {"b/1", "v4"}, {"b/2", "v2"}, {"c/3", "v3"}};
+    EXPECT_EQ(expected, scanned);
+    EXPECT_TRUE(rangeVisitedAll);
+    EXPECT_EQ((std::vector<std::string>{"b/1", "b/2"}), ranged);
+    EXPECT_FALSE(store->Scan([](std::string_view, std::string_view) { return false; }));
+}
+
+TEST_P(StateStoreUnitTests, Reopen_KeepsEveryStoredValue)
+{
+    // Arrange
+    {
+        auto store = OpenStore();
+        ASSERT_NE(nullptr, store);
+        ASSERT_TRUE(store->PutBatch({{"k1", "v1"}, {"k2", "v2"}}));
+        ASSERT_TRUE(store->Put("k1", "v3"));
+    }
+
+    // Act
+    auto store = OpenStore();
+    ASSERT_NE(nullptr, store);
+
+    // Assert
+    std::string value;
+    ASSERT_TRUE(store->Get("k1", value));
+    EXPECT_EQ("v3", value);
+    ASSERT_TRUE(store->Get("k2", value));
+    EXPECT_EQ("v2", value);
+}
+
+TEST_P(StateStoreUnitTests, OpenByName_SelectsTheEngineAtRuntime)
+{
+    // Arrange
+    const std::string name = StateStoreBackendToString(GetParam());
+    StateStoreBackend backend = StateStoreBackend::SQLite;
+
+    // Act
+    const bool parsed = StringToStateStoreBackend(name, backend);
+    std::unique_ptr<StateStore> store;
+    const bool opened = (true == parsed) && (true == StateStore::Open(backend, workDir / "state", StateStoreOptions(), store));
+
+    // Assert
+    ASSERT_TRUE(parsed);
+    EXPECT_EQ(GetParam(), backend);
+    ASSERT_TRUE(opened);
+    ASSERT_TRUE(store->Put("key", "value"));
+    std::string value;
+    ASSERT_TRUE(store->Get("key", value));
+    EXPECT_EQ("value", value);
+    EXPECT_FALSE(StringToStateStoreBackend("rocksdb", backend)) << "Unknown engine names are rejected";
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, StateStoreUnitTests, ::testing::Values(StateStoreBackend::SQLite, StateStoreBackend::Lmdb, StateStoreBackend::Lsm),
+                         [](const ::testing::TestParamInfo<StateStoreBackend>& info) { return std::string(StateStoreBackendToString(info.param)); });
+
+class LsmStateStoreUnitTests : public ::testing::Test
+{
+  protected:
+    fs::path workDir;
+
+    void SetUp() override
+    {
+        const auto* testInfo = ::testing::UnitTest::GetInstance()->current_test_info();
+        workDir = fs::temp_directory_path() / ("lsm_state_store_" + std::string(testInfo->name()));
+        fs::remove_all(workDir);
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+
+    static std::string Key(int index)
+    {
+        char key[16];
+        std::snprintf(key, sizeof(key), "key%05d", index);
+        return key;
+    }
+};
+
+TEST_F(LsmStateStoreUnitTests, SmallMemtable_FlushesAndCompactsRunsWithNewestValues)
+{
+    // Arrange
+    LsmStateStore store(workDir, 4096, 2);
+    ASSERT_TRUE(store.Open());
+
+    // Act
+    for (int round = 0; round < 3; ++round)
+    {
+        std::vector<StateStoreEntry> batch;
+        for (int i = 0; i < 200; ++i)
+        {
+            batch.push_back({Key(i), "round" + std::to_string(round)});
+        }
+        ASSERT_TRUE(store.PutBatch(batch));
+    }
+    ASSERT_TRUE(store.Put(Key(7), "latest"));
+
+    // Assert
+    EXPECT_GE(2U, store.RunCount());
+    EXPECT_LT(0U, store.RunCount());
+    std::string value;
+    ASSERT_TRUE(store.Get(Key(7), value));
+    EXPECT_EQ("latest", value);
+    for (int i = 0; i < 200; i += 13)
+    {
+        if (7 != i)
+        {
+            ASSERT_TRUE(store.Get(Key(i), value));
+            EXPECT_EQ("round2", value);
+        }
+    }
+    EXPECT_FALSE(store.Get("key99999", value));
+    int count = 0;
+    std::string previous;
+    EXPECT_TRUE(store.Scan(
+        [&](std::string_view key, std::string_view)
+        {
+            EXPECT_LT(previous, std::string(key));
+            previous = key;
+            ++count;
+            return true;
+        }));
+    EXPECT_EQ(200, count);
+}
+
+TEST_F(LsmStateStoreUnitTests, Open_TornLastLogRecord_KeepsEarlierBatches)
+{
+    // Arrange: a crash leaves a log without runs, with half of its last record written
+    {
+        LsmStateStore store(workDir, 1024 * 1024, 4);
+        ASSERT_TRUE(store.Open());
+        ASSERT_TRUE(store.PutBatch({{"a", "1"}, {"b", "2"}}));
+        ASSERT_TRUE(store.Put("c", "3"));
+        fs::copy_file(workDir / LsmStateStore::LogFileName, workDir / "saved.log");
+    }
+    for (const auto& entry : fs::directory_iterator(workDir))
+    {
+        if (".sst" == entry.path().extension())
+        {
+            fs::remove(entry.path());
+        }
+    }
+    fs::rename(workDir / "saved.log", workDir / LsmStateStore::LogFileName);
+    fs::resize_file(workDir / LsmStateStore::LogFileName, fs::file_size(workDir / LsmStateStore::LogFileName) - 3);
+
+    // Act
+    LsmStateStore store(workDir, 1024 * 1024, 4);
+    ASSERT_TRUE(store.Open());
+
+    // Assert
+    std::string value;
+    ASSERT_TRUE(store.Get("b", value));
+    EXPECT_EQ("2", value);
+    EXPECT_FALSE(store.Get("c", value));
+    ASSERT_TRUE(store.Put("d", "4"));
+    ASSERT_TRUE(store.Get("d", value));
+    EXPECT_EQ("4", value);
+}
@@ -0,0 +1,710 @@
+/**
+ * @file storage_backend_unit_tests.cpp
+ * @brief Unit tests for FilesystemStorageBackend, and for S3StorageBackend against an in-process fake S3 service.
+ */
+#include "StorageBackend/S3StorageBackend.hpp"
+#include "StorageBackend/StorageBackend.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+void WriteFile(const fs::path& filePath, const std::string& content)
+{
+    fs::create_directories(filePath.parent_path());
+    std::ofstream outputStream(filePath, std::ios::binary);
+    outputStream << content;
+}
+
+std::string ReadFile(const fs::path& filePath)
+{
+    std::ifstream inputStream(filePath, std::ios::binary);
+    std::stringstream buffer;
+    buffer << inputStream.rdbuf();
+    return buffer.str();
+}
+
+std::string PatternContent(std::size_t size)
+{
+    std::string content(size, '\0');
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        content[i] = static_cast<char>('a' + ((i * 7 + i / 4099) % 26));
+    }
+    return content;
+}
+}
+
+class StorageBackendUnitTests : public ::testing::Test
+{
+  protected:
+    fs::path workDir;
+
+    void SetUp() override
+    {
+        const auto* testInfo = ::testing::UnitTest::GetInstance()->current_test_info();
+        workDir = fs::temp_directory_path() / ("storage_" + std::string(testInfo->name()));
+        fs::remove_all(workDir);
+        fs::create_directories(workDir);
+    }
+
+    void TearDown() override
+    {
+        std::error_code ec;
+        fs::remove_all(workDir, ec);
+    }
+};
+
+/* ============================================================================ */
+/* FILESYSTEM BACKEND */
+/* ============================================================================ */
+
+TEST_F(StorageBackendUnitTests, Filesystem_PutThenGet_RoundTripsContent)
+{
+    // Arrange
+    FilesystemStorageBackend storage(workDir / "store");
+    WriteFile(workDir / "input.txt", "payload");
+
+    // Act
+    const bool put = storage.Put(workDir / "input.txt", "backup/dir/file.txt");
+    const bool got = storage.Get("backup/dir/file.txt", workDir / "output.txt");
+
+    // Assert
+    ASSERT_TRUE(put);
+    ASSERT_TRUE(got);
+    ASSERT_EQ(ReadFile(workDir / "output.txt"), "payload");
+    ASSERT_TRUE(fs::exists(workDir / "store" / "backup" / "dir" / "file.txt"));
+    ASSERT_FALSE(fs::exists(workDir / "store" / "backup" / "dir" / (std::string("file.txt") + FilesystemStorageBackend::TemporarySuffix)));
+}
+
+TEST_F(StorageBackendUnitTests, Filesystem_List_ReturnsSortedKeysUnderPrefix)
+{
+    // Arrange
+    FilesystemStorageBackend storage(workDir / "store");
+    WriteFile(workDir / "input.txt", "x");
+    ASSERT_TRUE(storage.Put(workDir / "input.txt", "backup/b.txt"));
+    ASSERT_TRUE(storage.Put(workDir / "input.txt", "backup/a/c.txt"));
+    ASSERT_TRUE(storage.Put(workDir / "input.txt", "deleted/1/a.txt"));
+
+    // Act
+    std::vector<std::string> keys;
+    const bool listed = storage.List("backup/", keys);
+
+    // Assert
+    ASSERT_TRUE(listed);
+    ASSERT_EQ(keys, (std::vector<std::string>{"backup/a/c.txt", "backup/b.txt"}));
+}
+
+TEST_F(StorageBackendUnitTests, Filesystem_RenameAndRemove_UpdateExistence)
+{
+    // Arrange
+    FilesystemStorageBackend storage(workDir / "store");
+    WriteFile(workDir / "input.txt", "x");
+    ASSERT_TRUE(storage.Put(workDir / "input.txt", "backup/a.txt"));
+
+    // Act
+    const bool renamed = storage.Rename("backup/a.txt", "deleted/1/a.txt");
+    const bool renamedMissing = storage.Rename("backup/a.txt", "deleted/2/a.txt");
+    bool sourceExists = true;
+    bool targetExists = false;
+    ASSERT_TRUE(storage.Exists("backup/a.txt", sourceExists));
+    ASSERT_TRUE(storage.Exists("deleted/1/a.txt", targetExists));
+    const bool removed = storage.Remove("deleted/1/a.txt");
+    const bool removedMissing = storage.Remove("deleted/1/a.txt");
+    bool removedExists = true;
+    ASSERT_TRUE(storage.Exists("deleted/1/a.txt", removedExists));
+
+    // Assert
+    ASSERT_TRUE(renamed);
+    ASSERT_FALSE(renamedMissing);
+    ASSERT_FALSE(sourceExists);
+    ASSERT_TRUE(targetExists);
+    ASSERT_TRUE(removed);
+    ASSERT_TRUE(removedMissing);
+    ASSERT_FALSE(removedExists);
+}
+
+TEST_F(StorageBackendUnitTests, Filesystem_Batches_RunEveryOperation)
+{
+    // Arrange
+    FilesystemStorageBackend storage(workDir / "store");
+    WriteFile(workDir / "one.txt", "1");
+    WriteFile(workDir / "two.txt", "2");
+
+    // Act
+    const bool put = storage.PutBatch({{workDir / "one.txt", "backup/one.txt"}, {workDir / "two.txt", "backup/two.txt"}}).get();
+    const bool renamed = storage.RenameBatch({{"backup/one.txt", "deleted/1/one.txt"}, {"backup/two.txt", "deleted/1/two.txt"}}).get();
+    std::vector<std::string> archived;
+    ASSERT_TRUE(storage.List("deleted/", archived));
+    const bool removed = storage.RemoveBatch({"deleted/1/one.txt", "deleted/1/two.txt"}).get();
+    std::vector<std::string> remaining;
+    ASSERT_TRUE(storage.List("", remaining));
+
+    // Assert
+    ASSERT_TRUE(put);
+    ASSERT_TRUE(renamed);
+    ASSERT_EQ(archived, (std::vector<std::string>{"deleted/1/one.txt", "deleted/1/two.txt"}));
+    ASSERT_TRUE(removed);
+    ASSERT_TRUE(remaining.empty());
+}
+
+#if !defined(_WIN32)
+
+/* ============================================================================ */
+/* S3 BACKEND */
+/* ============================================================================ */
+
+namespace
+{
+/**
+ * @brief Minimal S3 service on a loopback port: objects, multipart uploads, server-side copies and paged listings.
+ */
+class FakeS3Server
+{
+  public:
+    static constexpr const char* Bucket = "test-bucket";
+    static constexpr const char* AccessKey = "AKIDEXAMPLE";
+    static constexpr std::size_t ListPageSize = 2;
+
+    FakeS3Server()
+    {
+        _listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        const int reuse = 1;
+        ::setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        ::bind(_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        ::listen(_listener, 64);
+        socklen_t length = sizeof(address);
+        ::getsockname(_listener, reinterpret_cast<sockaddr*>(&address), &length);
+        _port = ntohs(address.sin_port);
+        _acceptThread = std::thread([this]() { AcceptLoop(); });
+    }
+
+    ~FakeS3Server()
+    {
+        _stopping.store(true);
+        ::shutdown(_listener, SHUT_RDWR);
+        ::close(_listener);
+        _acceptThread.join();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (const int client : _clients)
+            {
+                ::shutdown(client, SHUT_RDWR);
+            }
+        }
+        for (auto& thread : _connectionThreads)
+        {
+            thread.join();
+        }
+    }
+
+    FakeS3Server(const FakeS3Server&) = delete;
+    FakeS3Server& operator=(const FakeS3Server&) = delete;
+
+    std::string Endpoint() const
+    {
+        return "http://127.0.0.1:" + std::to_string(_port);
+    }
+
+    std::map<std::string, std::string> Objects()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _objects;
+    }
+
+    std::size_t Requests() const
+    {
+        return _requests.load();
+    }
+
+    std::size_t PartsUploaded() const
+    {
+        return _partsUploaded.load();
+    }
+
+    std::size_t UnsignedRequests() const
+    {
+        return _unsignedRequests.load();
+    }
+
+  private:
+    struct Request
+    {
+        std::string method;
+        std::string key;
+        std::map<std::string, std::string> query;
+        std::map<std::string, std::string> headers;
+        std::string body;
+    };
+
+    void AcceptLoop()
+    {
+        while (false == _stopping.load())
+        {
+            const int client = ::accept(_listener, nullptr, nullptr);
+            if (client < 0)
+            {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            _clients.push_back(client);
+            _connectionThreads.emplace_back([this, client]() { Serve(client); });
+        }
+    }
+
+    void Serve(int client)
+    {
+        std::string buffer;
+        Request request;
+        while (true == ReadRequest(client, buffer, request))
+        {
+            ++_requests;
+            const std::string response = Handle(request);
+            if (false == SendAll(client, response))
+            {
+                break;
+            }
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _clients.erase(std::find(_clients.begin(), _clients.end(), client));
+        ::close(client);
+    }
+
+    static bool SendAll(int client, const std::string& data)
+    {
+        std::size_t sent = 0;
+        while (sent < data.size())
+        {
+            const ssize_t count = ::send(client, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (count <= 0)
+            {
+                return false;
+            }
+            sent += static_cast<std::size_t>(count);
+        }
+        return true;
+    }
+
+    static bool Fill(int client, std::string& buffer)
+    {
+        char chunk[65536];
+        const ssize_t count = ::recv(client, chunk, sizeof(chunk), 0);
+        if (count <= 0)
+        {
+            return false;
+        }
+        buffer.append(chunk, static_cast<std::size_t>(count));
+        return true;
+    }
+
+    static std::string Decode(const std::string& value)
+    {
+        std::string decoded;
+        for (std::size_t i = 0; i < value.size(); ++i)
+        {
+            if (('%' == value[i]) && (i + 2 < value.size()))
+            {
+                decoded += static_cast<char>(std::strtol(value.substr(i + 1, 2).c_str(), nullptr, 16));
+                i += 2;
+            }
+            else
+            {
+                decoded += value[i];
+            }
+        }
+        return decoded;
+    }
+
+    static bool ReadRequest(int client, std::string& buffer, Request& outputRequest)
+    {
+        std::size_t headerEnd = std::string::npos;
+        while (std::string::npos == (headerEnd = buffer.find("\r\n\r\n")))
+        {
+            if (false == Fill(client, buffer))
+            {
+                return false;
+            }
+        }
+        std::istringstream head(buffer.substr(0, headerEnd));
+        buffer.erase(0, headerEnd + 4);
+
+        outputRequest = Request{};
+        std::string target;
+        std::string line;
+        std::getline(head, line);
+        std::istringstream requestLine(line);
+        requestLine >> outputRequest.method >> target;
+        while (std::getline(head, line))
+        {
+            if ((false == line.empty()) && ('\r' == line.back()))
+            {
+                line.pop_back();
+            }
+            const std::size_t colon = line.find(':');
+            if (std::string::npos == colon)
+            {
+                continue;
+            }
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            std::string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            outputRequest.headers[name] = value;
+        }
+
+        const std::size_t queryStart = target.find('?');
+        const std::string path = Decode(target.substr(0, queryStart));
+        const std::string bucketPrefix = std::string("/") + Bucket + "/";
+        outputRequest.key = (0 == path.rfind(bucketPrefix, 0)) ? path.substr(bucketPrefix.size()) : std::string();
+        if (std::string::npos != queryStart)
+        {
+            std::istringstream query(target.substr(queryStart + 1));
+            std::string parameter;
+            while (std::getline(query, parameter, '&'))
+            {
+                const std::size_t equals = parameter.find('=');
+                outputRequest.query[Decode(parameter.substr(0, equals))] =
+                    (std::string::npos == equals) ? std::string() : Decode(parameter.substr(equals + 1));
+            }
+        }
+
+        const std::size_t length = std::strtoull(outputRequest.headers["content-length"].c_str(), nullptr, 10);
+        while (buffer.size() < length)
+        {
+            if (false == Fill(client, buffer))
+            {
+                return false;
+            }
+        }
+        outputRequest.body = buffer.substr(0, length);
+        buffer.erase(0, length);
+        return true;
+    }
+
+    static std::string Respond(int status, const std::string& body, const std::string& extraHeaders = std::string(),
+                               std::size_t contentLength = std::string::npos)
+    {
+        return "HTTP/1.1 " + std::to_string(status) + " X\r\n" + extraHeaders +
+               "Content-Length: " + std::to_string((std::string::npos == contentLength) ? body.size() : contentLength) + "\r\n\r\n" + body;
+    }
+
+    std::string Handle(const Request& request)
+    {
+        const bool signedRequest =
+            (0 != request.headers.count("authorization")) && (0 != request.headers.count("x-amz-date")) &&
+            (0 == request.headers.at("authorization").rfind(std::string("AWS4-HMAC-SHA256 Credential=") + AccessKey + "/", 0));
+        if (false == signedRequest)
+        {
+            ++_unsignedRequests;
+            return Respond(403, "<Error><Code>AccessDenied</Code></Error>");
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        const auto has = [&request](const char* name) { return 0 != request.query.count(name); };
+        if (("GET" == request.method) && (true == has("list-type")))
+        {
+            return List(request);
+        }
+        if (("POST" == request.method) && (true == has("uploads")))
+        {
+            const std::string uploadId = "upload-" + std::to_string(++_uploadCounter);
+            _uploads[uploadId].key = request.key;
+            return Respond(200, "<InitiateMultipartUploadResult><UploadId>" + uploadId + "</UploadId></InitiateMultipartUploadResult>");
+        }
+        if (("POST" == request.method) && (true == has("uploadId")))
+        {
+            auto upload = _uploads.find(request.query.at("uploadId"));
+            if (_uploads.end() == upload)
+            {
+                return Respond(404, "<Error><Code>NoSuchUpload</Code></Error>");
+            }
+            std::string content;
+            for (const auto& part : upload->second.parts)
+            {
+                content += part.second;
+            }
+            _objects[request.key] = content;
+            _uploads.erase(upload);
+            return Respond(200, "<CompleteMultipartUploadResult><Key>" + request.key + "</Key></CompleteMultipartUploadResult>");
+        }
+        if (("PUT" == request.method) && (true == has("uploadId")))
+        {
+            auto upload = _uploads.find(request.query.at("uploadId"));
+            if (_uploads.end() == upload)
+            {
+                return Respond(404, "<Error><Code>NoSuchUpload</Code></Error>");
+            }
+            const int partNumber = std::atoi(request.query.at("partNumber").c_str());
+            upload->second.parts[partNumber] = request.body;
+            ++_partsUploaded;
+            return Respond(200, std::string(), "ETag: \"part-" + std::to_string(partNumber) + "\"\r\n");
+        }
+        if (("DELETE" == request.method) && (true == has("uploadId")))
+        {
+            _uploads.erase(request.query.at("uploadId"));
+            return Respond(204, std::string());
+        }
+        if (("PUT" == request.method) && (0 != request.headers.count("x-amz-copy-source")))
+        {
+            const std::string source = Decode(request.headers.at("x-amz-copy-source"));
+            const std::string bucketPrefix = std::string("/") + Bucket + "/";
+            const auto object = _objects.find((0 == source.rfind(bucketPrefix, 0)) ? source.substr(bucketPrefix.size()) : source);
+            if (_objects.end() == object)
+            {
+                return Respond(404, "<Error><Code>NoSuchKey</Code></Error>");
+            }
+            _objects[request.key] = object->second;
+            return Respond(200, "<CopyObjectResult><ETag>\"copy\"</ETag></CopyObjectResult>");
+        }
+        if ("PUT" == request.method)
+        {
+            _objects[request.key] = request.body;
+            return Respond(200, std::string(), "ETag: \"object\"\r\n");
+        }
+        const auto object = _objects.find(request.key);
+        if ("DELETE" == request.method)
+        {
+            if (_objects.end() != object)
+            {
+                _objects.erase(object);
+            }
+            return Respond(204, std::string());
+        }
+        if (_objects.end() == object)
+        {
+            return ("HEAD" == request.method) ? Respond(404, std::string(), std::string(), 0) : Respond(404, "<Error><Code>NoSuchKey</Code></Error>");
+        }
+        if ("HEAD" == request.method)
+        {
+            return Respond(200, std::string(), std::string(), object->second.size());
+        }
+        return Respond(200, object->second);
+    }
+
+    std::string List(const Request& request)
+    {
+        const std::string prefix = (0 != request.query.count("prefix")) ? request.query.at("prefix") : std::string();
+        const std::string after = (0 != request.query.count("continuation-token")) ? request.query.at("continuation-token") : std::string();
+        std::string body = "<ListBucketResult>";
+        std::size_t listed = 0;
+        std::string last;
+        bool truncated = false;
+        for (auto object = _objects.upper_bound(after); _objects.end() != object; ++object)
+        {
+            if (0 != object->first.rfind(prefix, 0))
+            {
+                continue;
+            }
+            if (ListPageSize == listed)
+            {
+                truncated = true;
+                break;
+            }
+            body += "<Contents><Key>" + object->first + "</Key></Contents>";
+            last = object->first;
+            ++listed;
+        }
+        body += (true == truncated) ? "<IsTruncated>true</IsTruncated><NextContinuationToken>" + last + "</NextContinuationToken>"
+                                    : std::string("<IsTruncated>false</IsTruncated>");
+        body += "</ListBucketResult>";
+        return Respond(200, body);
+    }
+
+    struct Upload
+    {
+        std::string key;
+        std::map<int, std::string> parts;
+    };
+
+    int _listener = -1;
+    std::uint16_t _port = 0;
+    std::atomic<bool> _stopping{false};
+    std::thread _acceptThread;
+    std::mutex _mutex;
+    std::vector<int> _clients;
+    std::vector<std::thread> _connectionThreads;
+    std::map<std::string, std::string> _objects;
+    std::map<std::string, Upload> _uploads;
+    std::size_t _uploadCounter = 0;
+    std::atomic<std::size_t> _requests{0};
+    std::atomic<std::size_t> _partsUploaded{0};
+    std::atomic<std::size_t> _unsignedRequests{0};
+};
+
+S3Options FakeOptions(const FakeS3Server& server)
+{
+    S3Options options;
+    options.endpoint = server.Endpoint();
+    options.bucket = FakeS3Server::Bucket;
+    options.prefix = "hosts/alpha/";
+    options.accessKey = FakeS3Server::AccessKey;
+    options.secretKey = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+    options.connections = 4;
+    return options;
+}
+}
+
+TEST_F(StorageBackendUnitTests, S3_InvalidEndpoint_Throws)
+{
+    // Arrange
+    S3Options options;
+    options.endpoint = "https://s3.example.com";
+    options.bucket = "bucket";
+    S3Options noBucket;
+    noBucket.endpoint = "http://127.0.0.1:9000";
+
+    // Act & Assert
+    ASSERT_THROW(S3StorageBackend{options}, std::invalid_argument);
+    ASSERT_THROW(S3StorageBackend{noBucket}, std::invalid_argument);
+}
+
+TEST_F(StorageBackendUnitTests, S3_PutGetExistsRemove_RoundTripsUnderPrefix)
+{
+    // Arrange
+    FakeS3Server server;
+    S3StorageBackend storage(FakeOptions(server));
+    WriteFile(workDir / "input.txt", "hello object store");
+
+    // Act
+    const bool put = storage.Put(workDir / "input.txt", "backup/dir with space/file.txt");
+    const bool got = storage.Get("backup/dir with space/file.txt", workDir / "output.txt");
+    bool exists = false;
+    ASSERT_TRUE(storage.Exists("backup/dir with space/file.txt", exists));
+    const bool removed = storage.Remove("backup/dir with space/file.txt");
+    bool existsAfterRemove = true;
+    ASSERT_TRUE(storage.Exists("backup/dir with space/file.txt", existsAfterRemove));
+    const bool gotMissing = storage.Get("backup/missing.txt", workDir / "missing.txt");
+
+    // Assert
+    ASSERT_TRUE(put);
+    ASSERT_TRUE(got);
+    ASSERT_EQ(ReadFile(workDir / "output.txt"), "hello object store");
+    ASSERT_TRUE(exists);
+    ASSERT_TRUE(removed);
+    ASSERT_FALSE(existsAfterRemove);
+    ASSERT_FALSE(gotMissing);
+    ASSERT_FALSE(fs::exists(workDir / "missing.txt"));
+    ASSERT_EQ(server.UnsignedRequests(), 0U);
+}
+
+TEST_F(StorageBackendUnitTests, S3_LargeFile_UploadsInParts)
+{
+    // Arrange
+    FakeS3Server server;
+    S3Options options = FakeOptions(server);
+    options.partSize = 5 * 1024 * 1024;
+    S3StorageBackend storage(options);
+    const std::string content = PatternContent(12 * 1024 * 1024 + 123);
+    WriteFile(workDir / "large.bin", content);
+
+    // Act
+    const bool put = storage.Put(workDir / "large.bin", "backup/large.bin");
+
+    // Assert
+    ASSERT_TRUE(put);
+    ASSERT_EQ(server.PartsUploaded(), 3U);
+    const auto objects = server.Objects();
+    ASSERT_EQ(objects.count("hosts/alpha/backup/large.bin"), 1U);
+    ASSERT_TRUE(objects.at("hosts/alpha/backup/large.bin") == content);
+}
+
+TEST_F(StorageBackendUnitTests, S3_List_FollowsContinuationTokens)
+{
+    // Arrange
+    FakeS3Server server;
+    S3StorageBackend storage(FakeOptions(server));
+    WriteFile(workDir / "input.txt", "x");
+    for (const char* key : {"backup/a.txt", "backup/b.txt", "backup/c/d.txt", "backup/e.txt", "deleted/1/a.txt"})
+    {
+        ASSERT_TRUE(storage.Put(workDir / "input.txt", key));
+    }
+
+    // Act
+    std::vector<std::string> keys;
+    const bool listed = storage.List("backup/", keys);
+
+    // Assert
+    ASSERT_TRUE(listed);
+    ASSERT_EQ(keys, (std::vector<std::string>{"backup/a.txt", "backup/b.txt", "backup/c/d.txt", "backup/e.txt"}));
+}
+
+TEST_F(StorageBackendUnitTests, S3_RenameBatch_MovesObjectsOverReusedConnections)
+{
+    // Arrange
+    FakeS3Server server;
+    S3StorageBackend storage(FakeOptions(server));
+    constexpr int FileCount = 40;
+    std::vector<StoragePut> puts;
+    std::vector<StorageRename> renames;
+    for (int i = 0; i < FileCount; ++i)
+    {
+        const std::string name = "file" + std::to_string(i) + ".txt";
+        WriteFile(workDir / name, "content " + std::to_string(i));
+        puts.push_back(StoragePut{workDir / name, "backup/" + name});
+        renames.push_back(StorageRename{"backup/" + name, "deleted/20260101_000000/" + name});
+    }
+
+    // Act
+    const bool put = storage.PutBatch(puts).get();
+    const bool renamed = storage.RenameBatch(renames).get();
+    const bool renamedMissing = storage.Rename("backup/file0.txt", "deleted/x/file0.txt");
+
+    // Assert
+    ASSERT_TRUE(put);
+    ASSERT_TRUE(renamed);
+    ASSERT_FALSE(renamedMissing);
+    const auto objects = server.Objects();
+    ASSERT_EQ(objects.size(), static_cast<std::size_t>(FileCount));
+    ASSERT_EQ(objects.at("hosts/alpha/deleted/20260101_000000/file7.txt"), "content 7");
+    // A put, a head, a copy and a delete per file ran over the few pooled connections.
+    ASSERT_GE(server.Requests(), static_cast<std::size_t>(4 * FileCount));
+    ASSERT_LE(storage.ConnectionsOpened(), 8U);
+}
+
+TEST_F(StorageBackendUnitTests, S3_WrongCredentials_FailWithoutRetrying)
+{
+    // Arrange
+    FakeS3Server server;
+    S3Options options = FakeOptions(server);
+    options.accessKey = "WRONGKEY";
+    S3StorageBackend storage(options);
+    WriteFile(workDir / "input.txt", "x");
+
+    // Act
+    const bool put = storage.Put(workDir / "input.txt", "backup/a.txt");
+
+    // Assert
+    ASSERT_FALSE(put);
+    ASSERT_EQ(server.UnsignedRequests(), 1U);
+    ASSERT_TRUE(server.Objects().empty());
+}
+
+#endif
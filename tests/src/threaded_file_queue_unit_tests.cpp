@@ -0,0 +1,968 @@
+/**
+ * @file threaded_file_queue_unit_tests.cpp
+ * @brief Unit tests for ThreadedFileQueue across its queue backends.
+ */
+#include "ThreadedFileQueue/ThreadedFileQueue.hpp"
+#include "ThreadedFileQueue/WorkerBudget.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+class ThreadedFileQueueUnitTests : public ::testing::TestWithParam<QueueBackend>
+{
+  protected:
+    ThreadedFileQueueOptions Options() const
+    {
+        ThreadedFileQueueOptions options;
+        options.backend = GetParam();
+        return options;
+    }
+};
+
+TEST_P(ThreadedFileQueueUnitTests, Enqueue_FromSeveralProducers_ProcessesEveryFileOnce)
+{
+    constexpr int ProducerCount = 4;
+    constexpr int FilesPerProducer = 2000;
+
+    std::mutex processedMutex;
+    std::multiset<std::string> processed;
+    std::atomic<int> exitedWorkers{0};
+    {
+        ThreadedFileQueue queue(
+            8, 16,
+            [&](const fs::path& file)
+            {
+                std::lock_guard<std::mutex> lock(processedMutex);
+                processed.insert(file.string());
+            },
+            [&]() { ++exitedWorkers; }, Options());
+
+        std::vector<std::thread> producers;
+        for (int producer = 0; producer < ProducerCount; ++producer)
+        {
+            producers.emplace_back(
+                [&queue, producer]()
+                {
+                    for (int i = 0; i < FilesPerProducer; ++i)
+                    {
+                        queue.Enqueue(std::to_string(producer) + "_" + std::to_string(i));
+                    }
+                });
+        }
+        for (auto& producerThread : producers)
+        {
+            producerThread.join();
+        }
+        queue.Finalize();
+        queue.Finalize();
+    }
+
+    EXPECT_EQ(static_cast<std::size_t>(ProducerCount * FilesPerProducer), processed.size());
+    std::set<std::string> unique(processed.begin(), processed.end());
+    EXPECT_EQ(processed.size(), unique.size());
+    EXPECT_EQ(8, exitedWorkers.load());
+}
+
+TEST_P(ThreadedFileQueueUnitTests, Enqueue_WhenQueueIsFull_BlocksUntilWorkersDrain)
+{
+    std::atomic<bool> release{false};
+    std::atomic<int> processedCount{0};
+    ThreadedFileQueue queue(
+        1, 2,
+        [&](const fs::path&)
+        {
+            while (false == release.load())
+            {
+                std::this_thread::yield();
+            }
+            ++processedCount;
+        },
+        nullptr, Options());
+
+    std::atomic<int> enqueued{0};
+    std::thread producer(
+        [&]()
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                queue.Enqueue("file" + std::to_string(i));
+                ++enqueued;
+            }
+        });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_LT(enqueued.load(), 16) << "Producer must be throttled by the queue bound";
+
+    release.store(true);
+    producer.join();
+    queue.Finalize();
+    EXPECT_EQ(16, processedCount.load());
+}
+
+TEST_P(ThreadedFileQueueUnitTests, EnqueueBatch_LargerThanQueue_ProcessesEveryFileOnce)
+{
+    constexpr int BatchCount = 50;
+    constexpr int FilesPerBatch = 100;
+
+    std::mutex processedMutex;
+    std::multiset<std::string> processed;
+    {
+        ThreadedFileQueueOptions options = Options();
+        options.dequeueBatchSize = 8;
+        ThreadedFileQueue queue(
+            4, 16,
+            [&](const fs::path& file)
+            {
+                std::lock_guard<std::mutex> lock(processedMutex);
+                processed.insert(file.string());
+            },
+            nullptr, options);
+
+        for (int batch = 0; batch < BatchCount; ++batch)
+        {
+            std::vector<fs::path> files;
+            for (int i = 0; i < FilesPerBatch; ++i)
+            {
+                files.emplace_back(std::to_string(batch) + "_" + std::to_string(i));
+            }
+            queue.EnqueueBatch(std::move(files));
+        }
+        queue.Finalize();
+    }
+
+    EXPECT_EQ(static_cast<std::size_t>(BatchCount * FilesPerBatch), processed.size());
+    std::set<std::string> unique(processed.begin(), processed.end());
+    EXPECT_EQ(processed.size(), unique.size());
+}
+
+TEST_P(ThreadedFileQueueUnitTests, BatchWorkItem_ReceivesWholeDequeuesInsteadOfSingleFiles)
+{
+    constexpr int FileCount = 1000;
+    constexpr std::size_t DequeueBatchSize = 8;
+
+    std::mutex processedMutex;
+    std::multiset<std::string> processed;
+    std::atomic<std::size_t> largestBatch{0};
+    std::atomic<int> singleCalls{0};
+    {
+        ThreadedFileQueueOptions options = Options();
+        options.dequeueBatchSize = DequeueBatchSize;
+        options.batchWorkItem = [&](const std::vector<FileWorkItem>& items)
+        {
+            std::size_t largest = largestBatch.load();
+            while ((largest < items.size()) && (false == largestBatch.compare_exchange_weak(largest, items.size())))
+            {
+            }
+            std::lock_guard<std::mutex> lock(processedMutex);
+            for (const auto& item : items)
+            {
+                processed.insert(item.path.string());
+            }
+        };
+        ThreadedFileQueue queue(
+            4, 64, [&](const fs::path&) { ++singleCalls; }, nullptr, options);
+        std::vector<fs::path> files;
+        for (int i = 0; i < FileCount; ++i)
+        {
+            files.emplace_back("file" + std::to_string(i));
+        }
+        queue.EnqueueBatch(std::move(files));
+        queue.Finalize();
+    }
+
+    EXPECT_EQ(0, singleCalls.load());
+    EXPECT_EQ(static_cast<std::size_t>(FileCount), processed.size());
+    EXPECT_EQ(processed.size(), std::set<std::string>(processed.begin(), processed.end()).size());
+    EXPECT_LE(largestBatch.load(), DequeueBatchSize);
+}
+
+TEST_P(ThreadedFileQueueUnitTests, FileWorkItem_ReceivesTheMetadataEnqueuedWithEachFile)
+{
+    constexpr int FileCount = 500;
+
+    std::mutex processedMutex;
+    std::multiset<std::string> processed;
+    std::atomic<int> mismatches{0};
+    std::atomic<int> singleCalls{0};
+    {
+        ThreadedFileQueueOptions options = Options();
+        options.fileWorkItem = [&](const FileWorkItem& item)
+        {
+            const std::uint64_t index = std::stoull(item.path.string().substr(4));
+            if ((false == item.hasMetadata) || (index != item.metadata.inode) || ((index * 10) != item.metadata.size) ||
+                (static_cast<std::uint32_t>(0100644) != item.metadata.mode))
+            {
+                ++mismatches;
+            }
+            std::lock_guard<std::mutex> lock(processedMutex);
+            processed.insert(item.path.string());
+        };
+        ThreadedFileQueue queue(
+            4, 64, [&](const fs::path&) { ++singleCalls; }, nullptr, options);
+        std::vector<FileWorkItem> items;
+        for (int i = 0; i < FileCount; ++i)
+        {
+            FileMetadata metadata{};
+            metadata.inode = static_cast<std::uint64_t>(i);
+            metadata.size = static_cast<std::uint64_t>(i) * 10;
+            metadata.mode = 0100644;
+            items.push_back(FileWorkItem{"file" + std::to_string(i), metadata.size, 0, true, metadata});
+        }
+        queue.EnqueueBatch(std::move(items));
+        queue.Finalize();
+    }
+
+    EXPECT_EQ(0, singleCalls.load());
+    EXPECT_EQ(0, mismatches.load());
+    EXPECT_EQ(static_cast<std::size_t>(FileCount), processed.size());
+    EXPECT_EQ(processed.size(), std::set<std::string>(processed.begin(), processed.end()).size());
+}
+
+TEST_P(ThreadedFileQueueUnitTests, ThreadedWorkQueue_CallsEachKindOfHandler)
+{
+    constexpr int FileCount = 1000;
+
+    std::atomic<int> paths{0};
+    std::atomic<int> items{0};
+    std::atomic<int> batchedItems{0};
+    std::atomic<int> batches{0};
+    std::atomic<std::uint64_t> costSum{0};
+    {
+        ThreadedWorkQueue pathQueue(4, 64, [&](const fs::path&) { ++paths; }, nullptr, Options());
+        ThreadedWorkQueue itemQueue(
+            4, 64,
+            [&](const FileWorkItem& item)
+            {
+                ++items;
+                costSum += item.costHint;
+            },
+            nullptr, Options());
+        ThreadedWorkQueue batchQueue(
+            4, 64,
+            [&](const std::vector<FileWorkItem>& batch)
+            {
+                ++batches;
+                batchedItems += static_cast<int>(batch.size());
+            },
+            nullptr, Options());
+        for (int i = 0; i < FileCount; ++i)
+        {
+            const fs::path file = "file" + std::to_string(i);
+            pathQueue.Enqueue(file);
+            itemQueue.EnqueueBatch(std::vector<FileWorkItem>{FileWorkItem{file, static_cast<std::uint64_t>(i)}});
+            batchQueue.Enqueue(file);
+        }
+        pathQueue.Finalize();
+        itemQueue.Finalize();
+        batchQueue.Finalize();
+    }
+
+    EXPECT_EQ(FileCount, paths.load());
+    EXPECT_EQ(FileCount, items.load());
+    EXPECT_EQ(static_cast<std::uint64_t>(FileCount) * (FileCount - 1) / 2, costSum.load());
+    EXPECT_EQ(FileCount, batchedItems.load());
+    EXPECT_LE(batches.load(), FileCount);
+}
+
+TEST_P(ThreadedFileQueueUnitTests, CancelRequested_DropsQueuedFilesAndUnblocksProducers)
+{
+    constexpr int FileCount = 2000;
+
+    std::atomic<bool> cancelRequested{false};
+    std::atomic<int> processed{0};
+    {
+        ThreadedFileQueueOptions options = Options();
+        options.cancelRequested = &cancelRequested;
+        ThreadedFileQueue queue(
+            2, 8,
+            [&](const fs::path&)
+            {
+                // The first file cancels the queue, so everything after it is dropped.
+                cancelRequested.store(true);
+                ++processed;
+            },
+            nullptr, options);
+        for (int i = 0; i < FileCount; ++i)
+        {
+            queue.Enqueue("file" + std::to_string(i));
+        }
+        queue.Finalize();
+    }
+
+    EXPECT_LT(0, processed.load());
+    EXPECT_GT(FileCount / 2, processed.load());
+}
+
+TEST_P(ThreadedFileQueueUnitTests, Finalize_WithoutWork_ReturnsPromptly)
+{
+    std::atomic<int> exitedWorkers{0};
+    ThreadedFileQueue queue(
+        4, 8, [](const fs::path&) {}, [&]() { ++exitedWorkers; }, Options());
+    queue.Finalize();
+    EXPECT_EQ(4, exitedWorkers.load());
+}
+
+TEST_P(ThreadedFileQueueUnitTests, Adaptive_WithParkedWorkers_ProcessesEveryFileAndExitsEveryWorker)
+{
+    constexpr int FileCount = 500;
+    constexpr unsigned int ThreadCount = 8;
+
+    ThreadedFileQueueOptions options = Options();
+    options.adaptive = true;
+    options.initialActiveThreads = 1;
+    std::atomic<int> processed{0};
+    std::atomic<unsigned int> exitedWorkers{0};
+    {
+        ThreadedFileQueue queue(
+            ThreadCount, 16, [&](const fs::path&) { ++processed; }, [&]() { ++exitedWorkers; }, options);
+        EXPECT_EQ(1U, queue.ActiveWorkerCount());
+        for (int i = 0; i < FileCount; ++i)
+        {
+            queue.Enqueue("file" + std::to_string(i));
+        }
+        queue.Finalize();
+    }
+
+    EXPECT_EQ(FileCount, processed.load());
+    EXPECT_EQ(ThreadCount, exitedWorkers.load());
+}
+
+TEST(ThreadedFileQueueWorkStealingTests, LongFile_ItemsQueuedBehindItAreStolen)
+{
+    constexpr int SmallFileCount = 9;
+
+    std::atomic<int> smallProcessed{0};
+    std::atomic<bool> longFileSawAllSmall{false};
+    ThreadedFileQueueOptions options;
+    options.backend = QueueBackend::WorkStealing;
+    {
+        ThreadedFileQueue queue(
+            2, 64,
+            [&](const fs::path& file)
+            {
+                if ("long" != file.string())
+                {
+                    ++smallProcessed;
+                    return;
+                }
+                // The worker holding the long file must not keep the rest of its claim to itself.
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+                while ((SmallFileCount > smallProcessed.load()) && (std::chrono::steady_clock::now() < deadline))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                longFileSawAllSmall.store(SmallFileCount == smallProcessed.load());
+            },
+            nullptr, options);
+
+        std::vector<FileWorkItem> items;
+        items.push_back(FileWorkItem{"long", 0});
+        for (int i = 0; i < SmallFileCount; ++i)
+        {
+            items.push_back(FileWorkItem{"small" + std::to_string(i), 0});
+        }
+        queue.EnqueueBatch(std::move(items));
+        queue.Finalize();
+    }
+
+    EXPECT_TRUE(longFileSawAllSmall.load());
+    EXPECT_EQ(SmallFileCount, smallProcessed.load());
+}
+
+namespace
+{
+/**
+ * @brief Spread the CPUs this process may use over two pretend NUMA nodes.
+ *
+ * @return Placement with nodes 0 and 1, reusing CPU 0 when nothing is detected
+ */
+std::vector<CpuPlacement> TwoNodePlacement()
+{
+    std::vector<CpuPlacement> placement = DetectCpuPlacement();
+    if (true == placement.empty())
+    {
+        placement.push_back(CpuPlacement{0, 0});
+    }
+    if (1 == placement.size())
+    {
+        placement.push_back(placement.front());
+    }
+    for (std::size_t i = 0; i < placement.size(); ++i)
+    {
+        placement[i].node = static_cast<unsigned int>(i % 2);
+    }
+    return placement;
+}
+}
+
+TEST(ThreadedFileQueueNodeTests, PinnedWorkersOnTwoNodes_ProcessEveryFileOnce)
+{
+    constexpr int ProducerCount = 3;
+    constexpr int FilesPerProducer = 600;
+
+    std::mutex processedMutex;
+    std::multiset<std::string> processed;
+    ThreadedFileQueueOptions options;
+    options.pinWorkers = true;
+    options.cpuPlacement = TwoNodePlacement();
+    {
+        ThreadedFileQueue queue(
+            4, 32,
+            [&](const fs::path& file)
+            {
+                std::lock_guard<std::mutex> lock(processedMutex);
+                processed.insert(file.string());
+            },
+            nullptr, options);
+
+        std::vector<std::thread> producers;
+        for (int producer = 0; producer < ProducerCount; ++producer)
+        {
+            producers.emplace_back(
+                [&queue, producer]()
+                {
+                    // Single files and batches of every size, so lanes are fed both ways.
+                    for (int i = 0; i < FilesPerProducer;)
+                    {
+                        const int batchSize = std::min(FilesPerProducer - i, 1 + (i % 7));
+                        std::vector<FileWorkItem> items;
+                        for (int j = 0; j < batchSize; ++j, ++i)
+                        {
+                            items.push_back(FileWorkItem{std::to_string(producer) + "_" + std::to_string(i), 0});
+                        }
+                        if (1 == batchSize)
+                        {
+                            queue.Enqueue(items.front().path);
+                        }
+                        else
+                        {
+                            queue.EnqueueBatch(std::move(items));
+                        }
+                    }
+                });
+        }
+        for (auto& producer : producers)
+        {
+            producer.join();
+        }
+        queue.Finalize();
+    }
+
+    ASSERT_EQ(static_cast<std::size_t>(ProducerCount * FilesPerProducer), processed.size());
+    for (int producer = 0; producer < ProducerCount; ++producer)
+    {
+        for (int i = 0; i < FilesPerProducer; ++i)
+        {
+            ASSERT_EQ(1u, processed.count(std::to_string(producer) + "_" + std::to_string(i)));
+        }
+    }
+}
+
+TEST(ThreadedFileQueueNodeTests, BusyNode_ItsFilesAreTakenByTheOtherNode)
+{
+    constexpr int SmallFileCount = 9;
+
+    std::atomic<int> smallProcessed{0};
+    std::atomic<bool> longFileSawAllSmall{false};
+    ThreadedFileQueueOptions options;
+    options.pinWorkers = true;
+    options.dequeueBatchSize = 1;
+    options.cpuPlacement = TwoNodePlacement();
+    {
+        ThreadedFileQueue queue(
+            2, 64,
+            [&](const fs::path& file)
+            {
+                if ("long" != file.string())
+                {
+                    ++smallProcessed;
+                    return;
+                }
+                // Half of the small files are queued on the node of the worker stuck here.
+                const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+                while ((SmallFileCount > smallProcessed.load()) && (std::chrono::steady_clock::now() < deadline))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                longFileSawAllSmall.store(SmallFileCount == smallProcessed.load());
+            },
+            nullptr, options);
+
+        std::vector<FileWorkItem> items;
+        items.push_back(FileWorkItem{"long", 0});
+        for (int i = 0; i < SmallFileCount; ++i)
+        {
+            items.push_back(FileWorkItem{"small" + std::to_string(i), 0});
+        }
+        queue.EnqueueBatch(std::move(items));
+        queue.Finalize();
+    }
+
+    EXPECT_TRUE(longFileSawAllSmall.load());
+    EXPECT_EQ(SmallFileCount, smallProcessed.load());
+}
+
+TEST(ThreadedFileQueueNodeTests, DetectCpuPlacement_ListsEachCpuOnceOrderedByNode)
+{
+    const std::vector<CpuPlacement> placement = DetectCpuPlacement();
+#ifdef __linux__
+    ASSERT_FALSE(placement.empty());
+#endif
+    std::set<unsigned int> cpus;
+    for (std::size_t i = 0; i < placement.size(); ++i)
+    {
+        EXPECT_TRUE(cpus.insert(placement[i].cpu).second) << placement[i].cpu;
+        if (0 < i)
+        {
+            EXPECT_LE(placement[i - 1].node, placement[i].node);
+        }
+    }
+}
+
+namespace
+{
+/**
+ * @brief Run items through a single worker that is held on a gate file until all of them are queued.
+ *
+ * @param[in] options Queue options; dequeueBatchSize is forced to 1
+ * @param[in] items Items to queue behind the gate
+ * @return Paths in the order the worker processed them
+ */
+std::vector<std::string> ProcessingOrder(ThreadedFileQueueOptions options, std::vector<FileWorkItem> items)
+{
+    options.dequeueBatchSize = 1;
+    std::atomic<bool> gateEntered{false};
+    std::atomic<bool> gateReleased{false};
+    std::vector<std::string> order;
+    {
+        ThreadedFileQueue queue(
+            1, 64,
+            [&](const fs::path& file)
+            {
+                if ("gate" == file.string())
+                {
+                    gateEntered.store(true);
+                    while (false == gateReleased.load())
+                    {
+                        std::this_thread::yield();
+                    }
+                    return;
+                }
+                order.push_back(file.string());
+            },
+            nullptr, options);
+
+        queue.Enqueue("gate");
+        while (false == gateEntered.load())
+        {
+            std::this_thread::yield();
+        }
+        queue.EnqueueBatch(std::move(items));
+        gateReleased.store(true);
+        queue.Finalize();
+    }
+    return order;
+}
+}
+
+#ifdef __linux__
+TEST(ThreadedFileQueuePriorityTests, IdlePriority_LowersWorkersButNotTheCaller)
+{
+    constexpr int IoPriorityWhoProcess = 1;
+    constexpr int IoPriorityClassShift = 13;
+    constexpr int IoPriorityClassIdle = 3;
+
+    std::atomic<int> idleWorkers{0};
+    std::atomic<int> idleIoWorkers{0};
+    {
+        ThreadedFileQueueOptions options;
+        options.idlePriority = true;
+        ThreadedFileQueue queue(
+            2, 16,
+            [&](const fs::path&)
+            {
+                if (SCHED_IDLE == sched_getscheduler(0))
+                {
+                    ++idleWorkers;
+                }
+                if (IoPriorityClassIdle == (syscall(SYS_ioprio_get, IoPriorityWhoProcess, 0) >> IoPriorityClassShift))
+                {
+                    ++idleIoWorkers;
+                }
+            },
+            nullptr, options);
+        queue.EnqueueBatch(std::vector<fs::path>{"a", "b", "c", "d"});
+        queue.Finalize();
+    }
+
+    EXPECT_EQ(4, idleWorkers.load());
+    EXPECT_EQ(4, idleIoWorkers.load());
+    EXPECT_NE(SCHED_IDLE, sched_getscheduler(0));
+}
+#endif
+
+TEST(ThreadedFileQueueSchedulingTests, LargestFirst_HandsOutLargestCostHintFirst)
+{
+    ThreadedFileQueueOptions options;
+    options.scheduling = SchedulingPolicy::LargestFirst;
+    const auto order = ProcessingOrder(options, {{"c5", 5}, {"c1", 1}, {"c9", 9}, {"c3", 3}, {"c7", 7}});
+    EXPECT_EQ((std::vector<std::string>{"c9", "c7", "c5", "c3", "c1"}), order);
+}
+
+TEST(ThreadedFileQueueSchedulingTests, LargeFileLane_ServesLargeFilesBeforeSmallOnesInArrivalOrder)
+{
+    ThreadedFileQueueOptions options;
+    options.scheduling = SchedulingPolicy::LargeFileLane;
+    options.largeFileThreshold = 100;
+    const auto order = ProcessingOrder(options, {{"small1", 1}, {"large500", 500}, {"small2", 2}, {"large300", 300}});
+    EXPECT_EQ((std::vector<std::string>{"large500", "large300", "small1", "small2"}), order);
+}
+
+TEST(ThreadedFileQueueSchedulingTests, RecentFirst_HandsOutMostRecentlyModifiedFirstAndUnknownTimesLast)
+{
+    ThreadedFileQueueOptions options;
+    options.scheduling = SchedulingPolicy::RecentFirst;
+    FileMetadata statedMetadata{};
+    statedMetadata.modificationTimeNs = 300;
+    const auto order = ProcessingOrder(options, {FileWorkItem{"unknown", 900},
+                                                 FileWorkItem{"t100", 1, 0, false, {}, nullptr, 100},
+                                                 FileWorkItem{"t500", 1, 0, false, {}, nullptr, 500},
+                                                 FileWorkItem{"stated300", 1, 0, true, statedMetadata, nullptr, 0},
+                                                 FileWorkItem{"t200", 1, 0, false, {}, nullptr, 200}});
+    EXPECT_EQ((std::vector<std::string>{"t500", "stated300", "t200", "t100", "unknown"}), order);
+}
+
+TEST(ThreadedFileQueueSchedulingTests, PhysicalOrder_SweepsUpFromLastOffsetAndWrapsForFilesBehindIt)
+{
+    ThreadedFileQueueOptions options;
+    options.scheduling = SchedulingPolicy::PhysicalOrder;
+    const std::map<std::string, std::uint64_t> offsets{{"gate", 50}, {"o10", 10}, {"o30", 30}, {"o60", 60}, {"o70", 70}, {"o90", 90}};
+    options.physicalOffset = [&offsets](const fs::path& file, std::uint64_t& outputOffset)
+    {
+        const auto found = offsets.find(file.string());
+        if (offsets.end() == found)
+        {
+            return false;
+        }
+        outputOffset = found->second;
+        return true;
+    };
+    const auto order = ProcessingOrder(options, {{"o30", 1}, {"o90", 1}, {"unplaced", 1}, {"o10", 1}, {"o70", 1}, {"o60", 1}});
+    EXPECT_EQ((std::vector<std::string>{"o60", "o70", "o90", "unplaced", "o10", "o30"}), order);
+}
+
+TEST(ThreadedFileQueueSchedulingTests, DetectPhysicalOffset_MissingFile_HasNoExtent)
+{
+    std::uint64_t offset = 0;
+    EXPECT_FALSE(DetectPhysicalOffset(fs::temp_directory_path() / "rdemo_no_such_file_for_extents", offset));
+}
+
+TEST(ThreadedFileQueueSchedulingTests, LargestFirst_LookaheadWindowSmallerThanBatch_ProcessesEveryFile)
+{
+    ThreadedFileQueueOptions options;
+    options.scheduling = SchedulingPolicy::LargestFirst;
+    options.lookaheadWindow = 4;
+    std::atomic<int> processed{0};
+    {
+        ThreadedFileQueue queue(
+            3, 64, [&](const fs::path&) { ++processed; }, nullptr, options);
+        std::vector<FileWorkItem> items;
+        for (int i = 0; i < 500; ++i)
+        {
+            items.push_back(FileWorkItem{"file" + std::to_string(i), static_cast<std::uint64_t>(i % 17)});
+        }
+        queue.EnqueueBatch(std::move(items));
+        queue.Finalize();
+    }
+    EXPECT_EQ(500, processed.load());
+}
+
+TEST(ThreadedFileQueueSchedulingTests, PerDevice_AlternatesBetweenDevicesInArrivalOrder)
+{
+    ThreadedFileQueueOptions options;
+    options.scheduling = SchedulingPolicy::PerDevice;
+    options.deviceConcurrency = [](std::uint64_t) { return 1U; };
+    const auto order = ProcessingOrder(options, {{"a1", 0, 1}, {"a2", 0, 1}, {"a3", 0, 1}, {"b1", 0, 2}, {"b2", 0, 2}});
+    EXPECT_EQ((std::vector<std::string>{"a1", "b1", "a2", "b2", "a3"}), order);
+}
+
+TEST(ThreadedFileQueueSchedulingTests, PerDevice_NeverExceedsDeviceConcurrencyLimit)
+{
+    constexpr int FilesPerDevice = 200;
+    ThreadedFileQueueOptions options;
+    options.scheduling = SchedulingPolicy::PerDevice;
+    options.dequeueBatchSize = 4;
+    options.deviceConcurrency = [](std::uint64_t device) { return (1 == device) ? 1U : 3U; };
+    std::atomic<int> activeOnSlow{0};
+    std::atomic<int> activeOnFast{0};
+    std::atomic<int> peakOnSlow{0};
+    std::atomic<int> peakOnFast{0};
+    std::atomic<int> processed{0};
+    const auto track = [](std::atomic<int>& active, std::atomic<int>& peak)
+    {
+        const int now = ++active;
+        int seen = peak.load();
+        while ((now > seen) && (false == peak.compare_exchange_weak(seen, now)))
+        {
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        --active;
+    };
+    {
+        ThreadedFileQueue queue(
+            8, 64,
+            [&](const fs::path& file)
+            {
+                if ('s' == file.string()[0])
+                {
+                    track(activeOnSlow, peakOnSlow);
+                }
+                else
+                {
+                    track(activeOnFast, peakOnFast);
+                }
+                ++processed;
+            },
+            nullptr, options);
+        std::vector<FileWorkItem> items;
+        for (int i = 0; i < FilesPerDevice; ++i)
+        {
+            items.push_back(FileWorkItem{"s" + std::to_string(i), 0, 1});
+            items.push_back(FileWorkItem{"f" + std::to_string(i), 0, 2});
+        }
+        queue.EnqueueBatch(std::move(items));
+        queue.Finalize();
+    }
+    EXPECT_EQ(2 * FilesPerDevice, processed.load());
+    EXPECT_EQ(1, peakOnSlow.load());
+    EXPECT_GE(3, peakOnFast.load());
+}
+
+namespace
+{
+/**
+ * @brief Run files through an adaptive queue and track the active worker count seen by the work items.
+ *
+ * @param[in] initialActiveThreads Active workers before the first adjustment
+ * @param[in] fileCount Files to process
+ * @param[in] work Work done per file
+ * @param[out] outputMinActive Fewest active workers seen
+ * @param[out] outputMaxActive Most active workers seen
+ */
+void RunAdaptive(unsigned int initialActiveThreads, int fileCount, const std::function<void()>& work, unsigned int& outputMinActive,
+                 unsigned int& outputMaxActive)
+{
+    ThreadedFileQueueOptions options;
+    options.adaptive = true;
+    options.initialActiveThreads = initialActiveThreads;
+    options.dequeueBatchSize = 1;
+    options.adaptInterval = std::chrono::milliseconds(40);
+    std::atomic<unsigned int> minActive{initialActiveThreads};
+    std::atomic<unsigned int> maxActive{initialActiveThreads};
+    ThreadedFileQueue* queuePointer = nullptr;
+    {
+        ThreadedFileQueue queue(
+            8, 64,
+            [&](const fs::path&)
+            {
+                work();
+                const unsigned int active = queuePointer->ActiveWorkerCount();
+                unsigned int seen = minActive.load();
+                while ((active < seen) && (false == minActive.compare_exchange_weak(seen, active)))
+                {
+                }
+                seen = maxActive.load();
+                while ((active > seen) && (false == maxActive.compare_exchange_weak(seen, active)))
+                {
+                }
+            },
+            nullptr, options);
+        queuePointer = &queue;
+        std::vector<std::filesystem::path> files;
+        for (int i = 0; i < fileCount; ++i)
+        {
+            files.push_back("file" + std::to_string(i));
+        }
+        queue.EnqueueBatch(std::move(files));
+        queue.Finalize();
+    }
+    outputMinActive = minActive.load();
+    outputMaxActive = maxActive.load();
+}
+}
+
+TEST(ThreadedFileQueueAdaptiveTests, LatencyBoundWork_GrowsActiveWorkers)
+{
+    unsigned int minActive = 0;
+    unsigned int maxActive = 0;
+    RunAdaptive(2, 1500, []() { std::this_thread::sleep_for(std::chrono::milliseconds(2)); }, minActive, maxActive);
+    EXPECT_LT(2U, maxActive);
+}
+
+TEST(ThreadedFileQueueAdaptiveTests, SerializedWork_ShrinksActiveWorkers)
+{
+    std::mutex serializingMutex;
+    unsigned int minActive = 0;
+    unsigned int maxActive = 0;
+    RunAdaptive(
+        8, 1000,
+        [&]()
+        {
+            std::lock_guard<std::mutex> lock(serializingMutex);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        },
+        minActive, maxActive);
+    EXPECT_GT(8U, minActive);
+}
+
+TEST(ThreadedFileQueueBudgetTests, TwoQueuesSharingABudget_NeverRunMoreBatchesThanItsSlots)
+{
+    constexpr int FilesPerQueue = 100;
+    WorkerBudget budget(2);
+    ThreadedFileQueueOptions options;
+    options.dequeueBatchSize = 1;
+    options.workerBudget = &budget;
+    std::atomic<int> active{0};
+    std::atomic<int> peak{0};
+    std::atomic<int> processed{0};
+    const auto work = [&](const fs::path&)
+    {
+        const int now = ++active;
+        int seen = peak.load();
+        while ((now > seen) && (false == peak.compare_exchange_weak(seen, now)))
+        {
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+        --active;
+        ++processed;
+    };
+    {
+        ThreadedFileQueue first(4, 64, work, nullptr, options);
+        ThreadedFileQueue second(4, 64, work, nullptr, options);
+        for (int i = 0; i < FilesPerQueue; ++i)
+        {
+            first.Enqueue("first" + std::to_string(i));
+            second.Enqueue("second" + std::to_string(i));
+        }
+        first.Finalize();
+        second.Finalize();
+    }
+    EXPECT_EQ(2 * FilesPerQueue, processed.load());
+    EXPECT_GE(2, peak.load());
+}
+
+TEST(ThreadedFileQueueBudgetTests, DeviceLimit_HoldsAcrossQueuesAndMixedBatches)
+{
+    constexpr int FilesPerDevice = 100;
+    WorkerBudget budget(8, [](std::uint64_t device) { return (1 == device) ? 1U : 0U; });
+    ThreadedFileQueueOptions options;
+    options.dequeueBatchSize = 4;
+    options.workerBudget = &budget;
+    std::atomic<int> activeOnSlow{0};
+    std::atomic<int> peakOnSlow{0};
+    std::atomic<int> processed{0};
+    const auto work = [&](const fs::path& file)
+    {
+        if ('s' == file.string()[0])
+        {
+            const int now = ++activeOnSlow;
+            int seen = peakOnSlow.load();
+            while ((now > seen) && (false == peakOnSlow.compare_exchange_weak(seen, now)))
+            {
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            --activeOnSlow;
+        }
+        ++processed;
+    };
+    {
+        ThreadedFileQueue first(4, 64, work, nullptr, options);
+        ThreadedFileQueue second(4, 64, work, nullptr, options);
+        for (ThreadedFileQueue* queue : {&first, &second})
+        {
+            std::vector<FileWorkItem> items;
+            for (int i = 0; i < FilesPerDevice; ++i)
+            {
+                items.push_back(FileWorkItem{"s" + std::to_string(i), 0, 1});
+                items.push_back(FileWorkItem{"f" + std::to_string(i), 0, 2});
+            }
+            queue->EnqueueBatch(std::move(items));
+        }
+        first.Finalize();
+        second.Finalize();
+    }
+    EXPECT_EQ(4 * FilesPerDevice, processed.load());
+    EXPECT_EQ(1, peakOnSlow.load());
+}
+
+TEST(ThreadedFileQueueBudgetTests, FreedSlot_GoesToTheJobFurthestBelowItsWeightedShare)
+{
+    // Arrange
+    // The heavy job holds two of three slots and the light job one, so both are at their share.
+    WorkerBudget budget(3);
+    const std::size_t heavy = budget.Join(2);
+    const std::size_t light = budget.Join(1);
+    const std::vector<std::uint64_t> noDevices;
+    budget.Acquire(heavy, noDevices);
+    budget.Acquire(heavy, noDevices);
+    budget.Acquire(light, noDevices);
+    std::mutex orderMutex;
+    std::vector<std::string> order;
+    const auto waitFor = [&](std::size_t job, const std::string& name)
+    {
+        return std::thread(
+            [&, job, name]()
+            {
+                budget.Acquire(job, noDevices);
+                std::lock_guard<std::mutex> lock(orderMutex);
+                order.push_back(name);
+            });
+    };
+    std::thread lightWaiter = waitFor(light, "light");
+    std::thread heavyWaiter = waitFor(heavy, "heavy");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    // Act
+    // With one heavy slot back, the heavy job is at half its share and the light job at all of it.
+    budget.Release(heavy, noDevices);
+    heavyWaiter.join();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    std::vector<std::string> orderBeforeSecondRelease;
+    {
+        std::lock_guard<std::mutex> lock(orderMutex);
+        orderBeforeSecondRelease = order;
+    }
+    budget.Release(light, noDevices);
+    lightWaiter.join();
+
+    // Assert
+    EXPECT_EQ((std::vector<std::string>{"heavy"}), orderBeforeSecondRelease);
+    EXPECT_EQ((std::vector<std::string>{"heavy", "light"}), order);
+    budget.Release(heavy, noDevices);
+    budget.Release(heavy, noDevices);
+    budget.Release(light, noDevices);
+    budget.Leave(heavy);
+    budget.Leave(light);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, ThreadedFileQueueUnitTests, ::testing::Values(QueueBackend::Mutex, QueueBackend::LockFreeRing, QueueBackend::WorkStealing),
+                         [](const ::testing::TestParamInfo<QueueBackend>& info) { return std::string(QueueBackendToString(info.param)); });
@@ -5,7 +5,10 @@
 
 #include "gtest/gtest.h"
 
+#include <cstdint>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <example/example.h>
@@ -91,3 +94,115 @@ TEST_F(HostUnitTest, FactorialPositive)
 {
     ASSERT_EQ(120, factorial(5));
 }
+
+TEST_F(HostUnitTest, FactorialLargestThatFits)
+{
+    ASSERT_EQ(479001600, factorial(12));
+}
+
+TEST_F(HostUnitTest, FactorialOverflowing)
+{
+    ASSERT_EQ(-1, factorial(13));
+}
+
+// ---------------------------------------------------------------------------
+// add_n(), clamp_n(), classify_n() — every supported instruction set matches
+// the scalar functions, including the tail after the last full vector
+// ---------------------------------------------------------------------------
+class HostBatchTest : public ::testing::TestWithParam<example_simd> {
+protected:
+    void SetUp() override {
+        if (example_simd_select(GetParam()) != 0) {
+            GTEST_SKIP() << "instruction set not supported here";
+        }
+        // 37 elements: several full vectors of every width plus a remainder
+        for (int32_t i = 0; i < 37; ++i) {
+            values.push_back((i - 18) * 13);
+        }
+        values.front() = INT32_MIN;
+        values.back() = INT32_MAX;
+    }
+    void TearDown() override {
+        example_simd_select(example_simd_detect());
+    }
+
+    std::vector<int32_t> values;
+};
+
+TEST_P(HostBatchTest, AddMatchesScalarAndWraps)
+{
+    // Arrange
+    std::vector<int32_t> other(values.rbegin(), values.rend());
+    std::vector<int32_t> out(values.size());
+
+    // Act
+    add_n(values.data(), other.data(), out.data(), values.size());
+
+    // Assert
+    for (size_t i = 0; i < values.size(); ++i) {
+        ASSERT_EQ(static_cast<int32_t>(static_cast<uint32_t>(values[i]) + static_cast<uint32_t>(other[i])), out[i]) << i;
+    }
+    ASSERT_EQ(-1, out.front());
+}
+
+TEST_P(HostBatchTest, ClampMatchesScalar)
+{
+    std::vector<int32_t> out(values.size());
+    for (const std::pair<int32_t, int32_t>& range : {std::make_pair(-50, 100), std::make_pair(100, -50)}) {
+        // Act
+        clamp_n(values.data(), out.data(), values.size(), range.first, range.second);
+
+        // Assert
+        for (size_t i = 0; i < values.size(); ++i) {
+            ASSERT_EQ(clamp(values[i], range.first, range.second), out[i]) << i;
+        }
+    }
+}
+
+TEST_P(HostBatchTest, ClassifyMatchesScalarInPlace)
+{
+    // Arrange
+    std::vector<int32_t> out = values;
+
+    // Act
+    classify_n(out.data(), out.data(), out.size());
+
+    // Assert
+    for (size_t i = 0; i < values.size(); ++i) {
+        ASSERT_EQ(classify(values[i]), out[i]) << i;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(EverySimd, HostBatchTest,
+                         ::testing::Values(EXAMPLE_SIMD_SCALAR, EXAMPLE_SIMD_SSE41, EXAMPLE_SIMD_AVX2, EXAMPLE_SIMD_NEON));
+
+TEST(HostBatchDispatchTest, ConcurrentCallsAndSelection)
+{
+    // Arrange: batch calls on several threads while another thread switches instruction sets
+    const std::vector<int32_t> values = {-7, 0, 7, 70, 700, -70, 1, 100, 101};
+    std::vector<std::thread> threads;
+    std::vector<int> mismatches(4, 0);
+
+    // Act
+    for (size_t t = 0; t < mismatches.size(); ++t) {
+        threads.emplace_back([&values, &mismatches, t]() {
+            std::vector<int32_t> out(values.size());
+            for (int round = 0; round < 1000; ++round) {
+                classify_n(values.data(), out.data(), values.size());
+                for (size_t i = 0; i < values.size(); ++i) {
+                    mismatches[t] += (classify(values[i]) != out[i]) ? 1 : 0;
+                }
+            }
+        });
+    }
+    for (int round = 0; round < 1000; ++round) {
+        example_simd_select((0 == round % 2) ? EXAMPLE_SIMD_SCALAR : example_simd_detect());
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    example_simd_select(example_simd_detect());
+
+    // Assert
+    ASSERT_EQ(std::vector<int>(mismatches.size(), 0), mismatches);
+}